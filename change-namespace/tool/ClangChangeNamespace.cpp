@@ -28,18 +28,31 @@
 //    class Y { na::X x; };
 //    } // namespace y
 //    } // namespace x
+//
+// The translation units are run by the tool executor named by the -executor
+// option, e.g. all those of the compilation database on several threads with:
+//    clang-change-namespace --old_namespace "na::nb" --new_namespace "x::y" \
+//      --file_pattern ".*" -p build/ -executor=all-TUs -i
+// With a clangd static index of the project, only the translation units
+// referencing the symbols of the old namespace are parsed:
+//    clang-change-namespace ... -executor=all-TUs -index clangd.dex -i
 
 #include "ChangeNamespace.h"
+#include "index/ReferencingFiles.h"
+#include "index/Serialization.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/Execution.h"
 #include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <set>
 
 using namespace clang;
 using namespace llvm;
@@ -79,6 +92,13 @@ cl::opt<std::string> WhiteListFile(
              "to be updated when changing namespaces around them."),
     cl::init(""), cl::cat(ChangeNamespaceCategory));
 
+cl::opt<std::string> IndexFile(
+    "index",
+    cl::desc("A clangd static index of the project, e.g. written by "
+             "clangd-indexer. Only the translation units referencing the "
+             "symbols of the old namespace in the index are parsed."),
+    cl::init(""), cl::cat(ChangeNamespaceCategory));
+
 llvm::ErrorOr<std::vector<std::string>> GetWhiteListedSymbolPatterns() {
   std::vector<std::string> Patterns;
   if (WhiteListFile.empty())
@@ -96,14 +116,105 @@ llvm::ErrorOr<std::vector<std::string>> GetWhiteListedSymbolPatterns() {
   return Patterns;
 }
 
+// Reports each replacement to the execution context, keyed by its file.
+void reportReplacements(
+    const std::map<std::string, tooling::Replacements> &FileToReplacements,
+    tooling::ExecutionContext &Context) {
+  for (const auto &FileAndReplacements : FileToReplacements) {
+    for (tooling::Replacement R : FileAndReplacements.second) {
+      std::string Value;
+      llvm::raw_string_ostream OS(Value);
+      llvm::yaml::Output YAML(OS);
+      YAML << R;
+      Context.reportResult(FileAndReplacements.first, OS.str());
+    }
+  }
+}
+
+// Collects the replacements reported by the translation units. A header gets
+// the same replacements from each translation unit including it, they're only
+// added once.
+llvm::Expected<std::map<std::string, tooling::Replacements>>
+collectReplacements(tooling::ToolResults &Results) {
+  std::map<std::string, std::set<std::string>> FileToValues;
+  Results.forEachResult([&](llvm::StringRef Key, llvm::StringRef Value) {
+    FileToValues[Key].insert(Value);
+  });
+  std::map<std::string, tooling::Replacements> FileToReplacements;
+  for (const auto &FileAndValues : FileToValues) {
+    tooling::Replacements &Replaces = FileToReplacements[FileAndValues.first];
+    for (const std::string &Value : FileAndValues.second) {
+      tooling::Replacement R;
+      llvm::yaml::Input YAML(Value);
+      YAML >> R;
+      if (YAML.error())
+        return llvm::make_error<llvm::StringError>(
+            "Invalid replacement for " + FileAndValues.first,
+            llvm::inconvertibleErrorCode());
+      if (auto Err = Replaces.add(R))
+        return std::move(Err);
+    }
+  }
+  return FileToReplacements;
+}
+
+// Changes the namespaces in each translation unit of the executor with its
+// own tool, and reports the replacements to the execution context. The
+// executor may run several translation units at once. The translation units
+// which don't reference the old namespace according to the index, if any, are
+// skipped without being parsed.
+class ChangeNamespaceActionFactory : public tooling::FrontendActionFactory {
+public:
+  ChangeNamespaceActionFactory(ArrayRef<std::string> WhiteListPatterns,
+                               const clangd::ReferencingFiles *Selection,
+                               tooling::ExecutionContext &Context)
+      : WhiteListPatterns(WhiteListPatterns), Selection(Selection),
+        Context(Context) {}
+
+  FrontendAction *create() override {
+    llvm_unreachable("the actions are created by runInvocation");
+  }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    const auto &Inputs = Invocation->getFrontendOpts().Inputs;
+    if (Selection && !Inputs.empty() &&
+        !Selection->mayReference(Inputs.front().getFile()))
+      return true;
+    std::map<std::string, tooling::Replacements> FileToReplacements;
+    change_namespace::ChangeNamespaceTool NamespaceTool(
+        OldNamespace, NewNamespace, FilePattern, WhiteListPatterns,
+        &FileToReplacements, Style);
+    ast_matchers::MatchFinder Finder;
+    NamespaceTool.registerMatchers(&Finder);
+    std::unique_ptr<tooling::FrontendActionFactory> Factory =
+        tooling::newFrontendActionFactory(&Finder);
+    if (!Factory->runInvocation(Invocation, Files, PCHContainerOps,
+                                DiagConsumer))
+      return false;
+    reportReplacements(FileToReplacements, Context);
+    return true;
+  }
+
+private:
+  std::vector<std::string> WhiteListPatterns;
+  const clangd::ReferencingFiles *Selection;
+  tooling::ExecutionContext &Context;
+};
+
 } // anonymous namespace
 
 int main(int argc, const char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-  tooling::CommonOptionsParser OptionsParser(argc, argv,
-                                             ChangeNamespaceCategory);
-  const auto &Files = OptionsParser.getSourcePathList();
-  tooling::RefactoringTool Tool(OptionsParser.getCompilations(), Files);
+  // Without -executor, the source files are run one after the other.
+  auto Executor = tooling::createExecutorFromCommandLineArgs(
+      argc, argv, ChangeNamespaceCategory);
+  if (!Executor) {
+    llvm::errs() << llvm::toString(Executor.takeError()) << "\n";
+    return 1;
+  }
   llvm::ErrorOr<std::vector<std::string>> WhiteListPatterns =
       GetWhiteListedSymbolPatterns();
   if (!WhiteListPatterns) {
@@ -111,27 +222,42 @@ int main(int argc, const char **argv) {
                  << WhiteListPatterns.getError().message() << "\n";
     return 1;
   }
-  change_namespace::ChangeNamespaceTool NamespaceTool(
-      OldNamespace, NewNamespace, FilePattern, *WhiteListPatterns,
-      &Tool.getReplacements(), Style);
-  ast_matchers::MatchFinder Finder;
-  NamespaceTool.registerMatchers(&Finder);
-  std::unique_ptr<tooling::FrontendActionFactory> Factory =
-      tooling::newFrontendActionFactory(&Finder);
-
-  if (int Result = Tool.run(Factory.get()))
-    return Result;
+  std::unique_ptr<clangd::ReferencingFiles> Selection;
+  if (!IndexFile.empty()) {
+    std::unique_ptr<clangd::SymbolIndex> Index = clangd::loadIndex(IndexFile);
+    if (!Index) {
+      llvm::errs() << "Failed to load index " << IndexFile << "\n";
+      return 1;
+    }
+    Selection = llvm::make_unique<clangd::ReferencingFiles>(
+        *Index, clangd::findSymbolsInNamespace(*Index, OldNamespace));
+  }
+  if (llvm::Error Err = Executor->get()->execute(
+          llvm::make_unique<ChangeNamespaceActionFactory>(
+              *WhiteListPatterns, Selection.get(),
+              *Executor->get()->getExecutionContext()))) {
+    llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+    return 1;
+  }
+  llvm::Expected<std::map<std::string, tooling::Replacements>>
+      FileToReplacements =
+          collectReplacements(*Executor->get()->getToolResults());
+  if (!FileToReplacements) {
+    llvm::errs() << llvm::toString(FileToReplacements.takeError()) << "\n";
+    return 1;
+  }
+
   LangOptions DefaultLangOptions;
   IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts = new DiagnosticOptions();
   clang::TextDiagnosticPrinter DiagnosticPrinter(errs(), &*DiagOpts);
   DiagnosticsEngine Diagnostics(
       IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()), &*DiagOpts,
       &DiagnosticPrinter, false);
-  auto &FileMgr = Tool.getFiles();
+  FileManager FileMgr((FileSystemOptions()));
   SourceManager Sources(Diagnostics, FileMgr);
   Rewriter Rewrite(Sources, DefaultLangOptions);
 
-  if (!formatAndApplyAllReplacements(Tool.getReplacements(), Rewrite, Style)) {
+  if (!formatAndApplyAllReplacements(*FileToReplacements, Rewrite, Style)) {
     llvm::errs() << "Failed applying all replacements.\n";
     return 1;
   }
@@ -139,7 +265,7 @@ int main(int argc, const char **argv) {
     return Rewrite.overwriteChangedFiles();
 
   std::set<llvm::StringRef> ChangedFiles;
-  for (const auto &it : Tool.getReplacements())
+  for (const auto &it : *FileToReplacements)
     ChangedFiles.insert(it.first);
 
   if (DumpYAML) {
@@ -49,9 +49,13 @@ typedef llvm::DenseMap<const clang::FileEntry *,
 /// \brief Recursively descends through a directory structure rooted at \p
 /// Directory and attempts to deserialize *.yaml files as
 /// TranslationUnitReplacements. All docs that successfully deserialize are
-/// added to \p TUs.
+/// added to \p TUs. The *.yaml and *.fixes files in the binary format of
+/// BinaryReplacements.h are deserialized as TranslationUnitDiagnostics, and
+/// the fixes of a file identical to fixes already read are skipped.
 ///
-/// Directories starting with '.' are ignored during traversal.
+/// Directories starting with '.' are ignored during traversal. The files are
+/// deserialized in parallel, and their documents are added to \p TUs in the
+/// order of the traversal.
 ///
 /// \param[in] Directory Directory to begin search for serialized
 /// TranslationUnitReplacements.
@@ -60,16 +64,20 @@ typedef llvm::DenseMap<const clang::FileEntry *,
 /// \param[out] TUFiles Collection of all TranslationUnitReplacement files
 /// found in \c Directory.
 /// \param[in] Diagnostics DiagnosticsEngine used for error output.
+/// \param[in] Jobs Number of files deserialized in parallel. 0 uses one
+/// thread per hardware thread.
 ///
 /// \returns An error_code indicating success or failure in navigating the
 /// directory structure.
 std::error_code collectReplacementsFromDirectory(
     const llvm::StringRef Directory, TUReplacements &TUs,
-    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics);
+    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics,
+    unsigned Jobs = 1);
 
 std::error_code collectReplacementsFromDirectory(
     const llvm::StringRef Directory, TUDiagnostics &TUs,
-    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics);
+    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics,
+    unsigned Jobs = 1);
 
 /// \brief Deduplicate, check for conflicts, and extract all Replacements stored
 /// in \c TUs. Conflicting replacements are skipped.
@@ -83,16 +91,21 @@ std::error_code collectReplacementsFromDirectory(
 /// file they target. Only non conflicting replacements are kept into
 /// FileChanges.
 /// \param[in] SM SourceManager required for conflict reporting.
+/// \param[in] Jobs Number of threads grouping the replacements by file. 0
+/// uses one thread per hardware thread.
 ///
 /// \returns \parblock
 ///          \li true If all changes were converted successfully.
 ///          \li false If there were conflicts.
 bool mergeAndDeduplicate(const TUReplacements &TUs, const TUDiagnostics &TUDs,
                          FileToChangesMap &FileChanges,
-                         clang::SourceManager &SM);
+                         clang::SourceManager &SM, unsigned Jobs = 1);
 
 /// \brief Apply \c AtomicChange on File and rewrite it.
 ///
+/// Files are read with their own FileManager and \p Diagnostics isn't
+/// modified, so different files can be changed concurrently.
+///
 /// \param[in] File Path of the file where to apply AtomicChange.
 /// \param[in] Changes to apply.
 /// \param[in] Spec For code cleanup and formatting.
@@ -105,6 +118,35 @@ applyChanges(StringRef File, const std::vector<tooling::AtomicChange> &Changes,
              const tooling::ApplyChangesSpec &Spec,
              DiagnosticsEngine &Diagnostics);
 
+/// \brief Apply the replacements of the change description files found under
+/// \p Directory, like collectReplacementsFromDirectory, mergeAndDeduplicate
+/// and applyChanges, without keeping all of them in memory.
+///
+/// The files are read one at a time. Their replacements are buffered, then
+/// sorted by target file and offset and spilled to a temporary run file each
+/// time the buffer is full. The runs are merged to change the target files one
+/// at a time, each changed file being written to a temporary file next to it.
+/// The temporary files replace the target files once all of them were changed
+/// without conflicts.
+///
+/// \param[in] Directory Directory to begin search for change description
+/// files.
+/// \param[out] TUFiles Collection of all change description files found in
+/// \c Directory.
+/// \param[in] Spec For code cleanup and formatting.
+/// \param[in] MaxBufferedReplacements Number of replacements buffered before
+/// they are spilled to a run file.
+/// \param[in] Diagnostics DiagnosticsEngine used for error output.
+///
+/// \returns \parblock
+///          \li true If all files have been changed successfully.
+///          \li false If there were conflicts, in which case no file is
+/// changed, or other failures.
+bool applyReplacementsFromDirectoryStreaming(
+    const llvm::StringRef Directory, TUReplacementFiles &TUFiles,
+    const tooling::ApplyChangesSpec &Spec, size_t MaxBufferedReplacements,
+    clang::DiagnosticsEngine &Diagnostics);
+
 /// \brief Delete the replacement files.
 ///
 /// \param[in] Files Replacement files to delete.
@@ -0,0 +1,95 @@
+//===-- BinaryReplacements.h - Compact binary fixes format ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief This file provides the interface for writing and reading the fixes
+/// of TranslationUnitDiagnostics in a compact binary format.
+///
+/// The format only keeps what's needed to apply the fixes: the diagnostic
+/// names and messages are dropped. A file is a sequence of records, one per
+/// translation unit, so that records can be appended to it. A record is:
+/// \code
+///   "CTFX" version
+///   string-count (string-size string-bytes)*
+///   main-source-file-string
+///   file-count (path-string hash payload-size payload)*
+/// \endcode
+/// where the payload of a file is:
+/// \code
+///   fix-count (replacement-count (offset-delta length text-string)*)*
+/// \endcode
+/// All the numbers are ULEB128 encoded, and the strings are indices in the
+/// string table of the record, so that the paths and replacement texts are
+/// stored once. A fix holds the replacements of one diagnostic in the file,
+/// sorted by offset, the first offset being relative to 0 and the next ones
+/// to the previous one.
+///
+/// The hash of a file identifies its fixes independently of the string table,
+/// so that the identical fixes of a header, reported by each translation unit
+/// including it, can be skipped without decoding them.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_APPLYREPLACEMENTS_BINARYREPLACEMENTS_H
+#define LLVM_CLANG_APPLYREPLACEMENTS_BINARYREPLACEMENTS_H
+
+#include "clang/Tooling/Core/Diagnostic.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+namespace replace {
+
+/// \brief Remembers the fixes of the files already read from the binary
+/// format, to skip the identical ones. Thread-safe.
+class BinaryReplacementsFilter {
+public:
+  /// \brief Returns true the first time it's called with the fixes of
+  /// \p Path identified by \p Hash.
+  bool insert(llvm::StringRef Path, uint64_t Hash);
+
+private:
+  std::mutex Mu;
+  llvm::DenseSet<std::pair<uint64_t, uint64_t>> Seen;
+};
+
+/// \brief Returns true if \p Buffer starts with a record of the binary format.
+bool isBinaryReplacements(llvm::StringRef Buffer);
+
+/// \brief Appends the fixes of \p TU to \p OS as a record of the binary
+/// format.
+void writeBinaryReplacements(const tooling::TranslationUnitDiagnostics &TU,
+                             llvm::raw_ostream &OS);
+
+/// \brief Deserializes the records of \p Buffer, and adds a
+/// TranslationUnitDiagnostics per record to \p TUs. Each fix is read as a
+/// diagnostic without name nor message.
+///
+/// \param[in] Buffer The contents of a binary fixes file.
+/// \param[out] TUs Collection the deserialized records are added to.
+/// \param[in] Filter If not null, the fixes of a file identical to fixes
+/// already read through it are skipped.
+///
+/// \returns An error if \p Buffer is malformed, in which case the records
+/// before the malformed one are still added.
+llvm::Error
+readBinaryReplacements(llvm::StringRef Buffer,
+                       std::vector<tooling::TranslationUnitDiagnostics> &TUs,
+                       BinaryReplacementsFilter *Filter = nullptr);
+
+} // end namespace replace
+} // end namespace clang
+
+#endif // LLVM_CLANG_APPLYREPLACEMENTS_BINARYREPLACEMENTS_H
@@ -15,6 +15,7 @@
 ///
 //===----------------------------------------------------------------------===//
 #include "clang-apply-replacements/Tooling/ApplyReplacements.h"
+#include "clang-apply-replacements/Tooling/BinaryReplacements.h"
 #include "clang/Basic/LangOptions.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Format/Format.h"
@@ -23,10 +24,24 @@
 #include "clang/Tooling/DiagnosticsYaml.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <tuple>
 
 using namespace llvm;
 using namespace clang;
@@ -36,58 +51,85 @@ static void eatDiagnostics(const SMDiagnostic &, void *) {}
 namespace clang {
 namespace replace {
 
-std::error_code collectReplacementsFromDirectory(
-    const llvm::StringRef Directory, TUReplacements &TUs,
-    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics) {
-  using namespace llvm::sys::fs;
-  using namespace llvm::sys::path;
+/// \brief Returns the number of threads running \p Tasks tasks for the
+/// \p Jobs option, 0 meaning one thread per hardware thread.
+static size_t getThreadCount(unsigned Jobs, size_t Tasks) {
+  size_t Threads = Jobs ? Jobs : llvm::hardware_concurrency();
+  return std::max<size_t>(1, std::min(Threads, Tasks));
+}
 
-  std::error_code ErrorCode;
+/// \brief Runs \p Worker on \p Threads threads, the calling one included, and
+/// waits for all of them.
+static void runWorkers(llvm::function_ref<void()> Worker, size_t Threads) {
+  std::vector<std::thread> Pool;
+  for (size_t I = 1; I < Threads; ++I)
+    Pool.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Pool)
+    T.join();
+}
 
-  for (recursive_directory_iterator I(Directory, ErrorCode), E;
-       I != E && !ErrorCode; I.increment(ErrorCode)) {
-    if (filename(I->path())[0] == '.') {
-      // Indicate not to descend into directories beginning with '.'
-      I.no_push();
-      continue;
-    }
+/// \brief The binary format only holds diagnostics, ignore it when collecting
+/// TranslationUnitReplacements.
+static llvm::Error
+parseBinaryReplacementFile(StringRef Buffer, TUReplacements &TUs,
+                           BinaryReplacementsFilter &Filter) {
+  return llvm::Error::success();
+}
 
-    if (extension(I->path()) != ".yaml")
-      continue;
+static llvm::Error
+parseBinaryReplacementFile(StringRef Buffer, TUDiagnostics &TUs,
+                           BinaryReplacementsFilter &Filter) {
+  return readBinaryReplacements(Buffer, TUs, &Filter);
+}
 
-    TUFiles.push_back(I->path());
+/// \brief Deserializes the documents of the YAML file, or the records of the
+/// binary file, \p Path into \p TUs. The error messages are written to
+/// \p Errors, the function may be called on several threads.
+template <typename TranslationUnits>
+static void parseReplacementFile(StringRef Path, TranslationUnits &TUs,
+                                 BinaryReplacementsFilter &Filter,
+                                 std::string &Errors) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Out = MemoryBuffer::getFile(Path);
+  if (std::error_code BufferError = Out.getError()) {
+    raw_string_ostream OS(Errors);
+    OS << "Error reading " << Path << ": " << BufferError.message() << "\n";
+    return;
+  }
 
-    ErrorOr<std::unique_ptr<MemoryBuffer>> Out =
-        MemoryBuffer::getFile(I->path());
-    if (std::error_code BufferError = Out.getError()) {
-      errs() << "Error reading " << I->path() << ": " << BufferError.message()
-             << "\n";
-      continue;
+  if (isBinaryReplacements(Out.get()->getBuffer())) {
+    if (llvm::Error Err =
+            parseBinaryReplacementFile(Out.get()->getBuffer(), TUs, Filter)) {
+      raw_string_ostream OS(Errors);
+      OS << "Error reading " << Path << ": " << llvm::toString(std::move(Err))
+         << "\n";
     }
+    return;
+  }
 
-    yaml::Input YIn(Out.get()->getBuffer(), nullptr, &eatDiagnostics);
-    tooling::TranslationUnitReplacements TU;
+  yaml::Input YIn(Out.get()->getBuffer(), nullptr, &eatDiagnostics);
+  // A file can describe several translation units, one per document.
+  do {
+    typename TranslationUnits::value_type TU;
     YIn >> TU;
     if (YIn.error()) {
       // File doesn't appear to be a header change description. Ignore it.
-      continue;
+      break;
     }
 
     // Only keep files that properly parse.
-    TUs.push_back(TU);
-  }
-
-  return ErrorCode;
+    TUs.push_back(std::move(TU));
+  } while (YIn.nextDocument());
 }
 
-std::error_code collectReplacementsFromDirectory(
-    const llvm::StringRef Directory, TUDiagnostics &TUs,
-    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics) {
+/// \brief Adds the *.yaml and *.fixes files under \p Directory to \p TUFiles,
+/// ignoring the directories starting with '.'.
+static std::error_code findReplacementFiles(const llvm::StringRef Directory,
+                                            TUReplacementFiles &TUFiles) {
   using namespace llvm::sys::fs;
   using namespace llvm::sys::path;
 
   std::error_code ErrorCode;
-
   for (recursive_directory_iterator I(Directory, ErrorCode), E;
        I != E && !ErrorCode; I.increment(ErrorCode)) {
     if (filename(I->path())[0] == '.') {
@@ -96,128 +138,235 @@ std::error_code collectReplacementsFromDirectory(
       continue;
     }
 
-    if (extension(I->path()) != ".yaml")
+    StringRef Extension = extension(I->path());
+    if (Extension != ".yaml" && Extension != ".fixes")
       continue;
 
     TUFiles.push_back(I->path());
+  }
 
-    ErrorOr<std::unique_ptr<MemoryBuffer>> Out =
-        MemoryBuffer::getFile(I->path());
-    if (std::error_code BufferError = Out.getError()) {
-      errs() << "Error reading " << I->path() << ": " << BufferError.message()
-             << "\n";
-      continue;
-    }
-
-    yaml::Input YIn(Out.get()->getBuffer(), nullptr, &eatDiagnostics);
-    tooling::TranslationUnitDiagnostics TU;
-    YIn >> TU;
-    if (YIn.error()) {
-      // File doesn't appear to be a header change description. Ignore it.
-      continue;
-    }
+  return ErrorCode;
+}
 
-    // Only keep files that properly parse.
-    TUs.push_back(TU);
+/// \brief Finds the *.yaml and *.fixes files under \p Directory, and
+/// deserializes them on \p Jobs threads as TranslationUnitReplacements or
+/// TranslationUnitDiagnostics. The identical fixes of a file in binary records
+/// are only read once.
+template <typename TranslationUnits>
+static std::error_code
+collectFromDirectory(const llvm::StringRef Directory, TranslationUnits &TUs,
+                     TUReplacementFiles &TUFiles, unsigned Jobs) {
+  size_t FirstFile = TUFiles.size();
+  std::error_code ErrorCode = findReplacementFiles(Directory, TUFiles);
+
+  // Each file is deserialized into its own collection, which are then
+  // concatenated in the order of the traversal.
+  size_t FileCount = TUFiles.size() - FirstFile;
+  std::vector<TranslationUnits> FileTUs(FileCount);
+  std::vector<std::string> FileErrors(FileCount);
+  BinaryReplacementsFilter Filter;
+  std::atomic<size_t> NextFile(0);
+  runWorkers(
+      [&] {
+        for (size_t I = NextFile++; I < FileCount; I = NextFile++)
+          parseReplacementFile(TUFiles[FirstFile + I], FileTUs[I], Filter,
+                               FileErrors[I]);
+      },
+      getThreadCount(Jobs, FileCount));
+
+  for (size_t I = 0; I < FileCount; ++I) {
+    errs() << FileErrors[I];
+    std::move(FileTUs[I].begin(), FileTUs[I].end(), std::back_inserter(TUs));
   }
 
   return ErrorCode;
 }
 
+std::error_code collectReplacementsFromDirectory(
+    const llvm::StringRef Directory, TUReplacements &TUs,
+    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics,
+    unsigned Jobs) {
+  return collectFromDirectory(Directory, TUs, TUFiles, Jobs);
+}
+
+std::error_code collectReplacementsFromDirectory(
+    const llvm::StringRef Directory, TUDiagnostics &TUs,
+    TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics,
+    unsigned Jobs) {
+  return collectFromDirectory(Directory, TUs, TUFiles, Jobs);
+}
+
+namespace {
+/// \brief Replacements grouped by the path they target. The map is split in
+/// shards locked independently, so that it can be filled from several threads
+/// with little contention.
+class ShardedReplacementMap {
+public:
+  /// \brief The replacements targeting one path.
+  struct PathReplacements {
+    std::vector<tooling::Replacement> Replacements;
+    /// The replacements from diagnostics, to deduplicate the identical ones.
+    std::set<tooling::Replacement> DiagReplacements;
+  };
+
+  /// \brief Adds \p R to the replacements of its path, unless \p FromDiag
+  /// and an identical replacement from a diagnostic was already added.
+  void add(const tooling::Replacement &R, bool FromDiag) {
+    Shard &S = Shards[llvm::hash_value(R.getFilePath()) % NumShards];
+    std::lock_guard<std::mutex> Lock(S.Mu);
+    PathReplacements &Replaces = S.Paths[R.getFilePath()];
+    if (FromDiag && !Replaces.DiagReplacements.insert(R).second)
+      return;
+    Replaces.Replacements.push_back(R);
+  }
+
+  /// \brief Calls \p Callback with each path and its replacements, not
+  /// thread-safe.
+  template <typename CallbackT> void forEachPath(CallbackT Callback) {
+    for (Shard &S : Shards)
+      for (auto &PathAndReplacements : S.Paths)
+        Callback(PathAndReplacements.first(), PathAndReplacements.second);
+  }
+
+private:
+  static const unsigned NumShards = 64;
+
+  struct Shard {
+    std::mutex Mu;
+    llvm::StringMap<PathReplacements> Paths;
+  };
+
+  Shard Shards[NumShards];
+};
+} // namespace
+
 /// \brief Extract replacements from collected TranslationUnitReplacements and
 /// TranslationUnitDiagnostics and group them per file. Identical replacements
 /// from diagnostics are deduplicated.
 ///
+/// The replacements are grouped by path on \p Jobs threads, then each path is
+/// looked up once in the file manager, which isn't thread-safe.
+///
 /// \param[in] TUs Collection of all found and deserialized
 /// TranslationUnitReplacements.
 /// \param[in] TUDs Collection of all found and deserialized
 /// TranslationUnitDiagnostics.
 /// \param[in] SM Used to deduplicate paths.
+/// \param[in] Jobs Number of threads grouping the replacements.
 ///
 /// \returns A map mapping FileEntry to a set of Replacement targeting that
 /// file.
 static llvm::DenseMap<const FileEntry *, std::vector<tooling::Replacement>>
 groupReplacements(const TUReplacements &TUs, const TUDiagnostics &TUDs,
-                  const clang::SourceManager &SM) {
-  std::set<StringRef> Warned;
-  llvm::DenseMap<const FileEntry *, std::vector<tooling::Replacement>>
-      GroupedReplacements;
-
-  // Deduplicate identical replacements in diagnostics.
+                  const clang::SourceManager &SM, unsigned Jobs) {
+  // Deduplicate identical replacements in diagnostics. As the paths are part
+  // of the replacements, deduplicating them per path is enough.
   // FIXME: Find an efficient way to deduplicate on diagnostics level.
-  llvm::DenseMap<const FileEntry *, std::set<tooling::Replacement>>
-      DiagReplacements;
+  ShardedReplacementMap ReplacementsByPath;
+  size_t TUCount = TUs.size() + TUDs.size();
+  std::atomic<size_t> NextTU(0);
+  runWorkers(
+      [&] {
+        for (size_t I = NextTU++; I < TUCount; I = NextTU++) {
+          if (I < TUs.size()) {
+            for (const tooling::Replacement &R : TUs[I].Replacements)
+              ReplacementsByPath.add(R, false);
+            continue;
+          }
+          for (const auto &D : TUDs[I - TUs.size()].Diagnostics)
+            for (const auto &Fix : D.Fix)
+              for (const tooling::Replacement &R : Fix.second)
+                ReplacementsByPath.add(R, true);
+        }
+      },
+      getThreadCount(Jobs, TUCount));
+
+  // Visit the paths in order, to warn about the missing files consistently.
+  std::vector<std::pair<StringRef, std::vector<tooling::Replacement> *>> Paths;
+  ReplacementsByPath.forEachPath(
+      [&](StringRef Path, ShardedReplacementMap::PathReplacements &Replaces) {
+        Paths.emplace_back(Path, &Replaces.Replacements);
+      });
+  llvm::sort(Paths.begin(), Paths.end());
 
-  auto AddToGroup = [&](const tooling::Replacement &R, bool FromDiag) {
+  llvm::DenseMap<const FileEntry *, std::vector<tooling::Replacement>>
+      GroupedReplacements;
+  for (auto &PathAndReplacements : Paths) {
     // Use the file manager to deduplicate paths. FileEntries are
     // automatically canonicalized.
-    if (const FileEntry *Entry = SM.getFileManager().getFile(R.getFilePath())) {
-      if (FromDiag) {
-        auto &Replaces = DiagReplacements[Entry];
-        if (!Replaces.insert(R).second)
-          return;
-      }
-      GroupedReplacements[Entry].push_back(R);
-    } else if (Warned.insert(R.getFilePath()).second) {
-      errs() << "Described file '" << R.getFilePath()
+    if (const FileEntry *Entry =
+            SM.getFileManager().getFile(PathAndReplacements.first)) {
+      std::vector<tooling::Replacement> &Replaces = GroupedReplacements[Entry];
+      std::move(PathAndReplacements.second->begin(),
+                PathAndReplacements.second->end(),
+                std::back_inserter(Replaces));
+    } else {
+      errs() << "Described file '" << PathAndReplacements.first
              << "' doesn't exist. Ignoring...\n";
     }
-  };
-
-  for (const auto &TU : TUs)
-    for (const tooling::Replacement &R : TU.Replacements)
-      AddToGroup(R, false);
-
-  for (const auto &TU : TUDs)
-    for (const auto &D : TU.Diagnostics)
-      for (const auto &Fix : D.Fix)
-        for (const tooling::Replacement &R : Fix.second)
-          AddToGroup(R, true);
+  }
 
   // Sort replacements per file to keep consistent behavior when
   // clang-apply-replacements run on differents machine.
-  for (auto &FileAndReplacements : GroupedReplacements) {
-    llvm::sort(FileAndReplacements.second.begin(),
-               FileAndReplacements.second.end());
-  }
+  std::vector<std::vector<tooling::Replacement> *> FileReplacements;
+  for (auto &FileAndReplacements : GroupedReplacements)
+    FileReplacements.push_back(&FileAndReplacements.second);
+  std::atomic<size_t> NextFile(0);
+  runWorkers(
+      [&] {
+        for (size_t I = NextFile++; I < FileReplacements.size();
+             I = NextFile++)
+          llvm::sort(FileReplacements[I]->begin(), FileReplacements[I]->end());
+      },
+      getThreadCount(Jobs, FileReplacements.size()));
 
   return GroupedReplacements;
 }
 
+/// \brief Stores the sorted replacements \p Replaces of \p Entry into 1 big
+/// AtomicChange, to report the conflicting ones on the corresponding file.
+/// Conflicting replacements are skipped and set \p ConflictDetected.
+static tooling::AtomicChange
+makeFileChange(const FileEntry *Entry,
+               llvm::ArrayRef<tooling::Replacement> Replaces,
+               clang::SourceManager &SM, bool &ConflictDetected) {
+  const SourceLocation BeginLoc =
+      SM.getLocForStartOfFile(SM.getOrCreateFileID(Entry, SrcMgr::C_User));
+  tooling::AtomicChange FileChange(Entry->getName(), Entry->getName());
+  for (const auto &R : Replaces) {
+    llvm::Error Err =
+        FileChange.replace(SM, BeginLoc.getLocWithOffset(R.getOffset()),
+                           R.getLength(), R.getReplacementText());
+    if (Err) {
+      // FIXME: This will report conflicts by pair using a file+offset format
+      // which is not so much human readable.
+      // A first improvement could be to translate offset to line+col. For
+      // this and without loosing error message some modifications arround
+      // `tooling::ReplacementError` are need (access to
+      // `getReplacementErrString`).
+      // A better strategy could be to add a pretty printer methods for
+      // conflict reporting. Methods that could be parameterized to report a
+      // conflict in different format, file+offset, file+line+col, or even
+      // more human readable using VCS conflict markers.
+      // For now, printing directly the error reported by `AtomicChange` is
+      // the easiest solution.
+      errs() << llvm::toString(std::move(Err)) << "\n";
+      ConflictDetected = true;
+    }
+  }
+  return FileChange;
+}
+
 bool mergeAndDeduplicate(const TUReplacements &TUs, const TUDiagnostics &TUDs,
                          FileToChangesMap &FileChanges,
-                         clang::SourceManager &SM) {
-  auto GroupedReplacements = groupReplacements(TUs, TUDs, SM);
+                         clang::SourceManager &SM, unsigned Jobs) {
+  auto GroupedReplacements = groupReplacements(TUs, TUDs, SM, Jobs);
   bool ConflictDetected = false;
 
-  // To report conflicting replacements on corresponding file, all replacements
-  // are stored into 1 big AtomicChange.
   for (const auto &FileAndReplacements : GroupedReplacements) {
     const FileEntry *Entry = FileAndReplacements.first;
-    const SourceLocation BeginLoc =
-        SM.getLocForStartOfFile(SM.getOrCreateFileID(Entry, SrcMgr::C_User));
-    tooling::AtomicChange FileChange(Entry->getName(), Entry->getName());
-    for (const auto &R : FileAndReplacements.second) {
-      llvm::Error Err =
-          FileChange.replace(SM, BeginLoc.getLocWithOffset(R.getOffset()),
-                             R.getLength(), R.getReplacementText());
-      if (Err) {
-        // FIXME: This will report conflicts by pair using a file+offset format
-        // which is not so much human readable.
-        // A first improvement could be to translate offset to line+col. For
-        // this and without loosing error message some modifications arround
-        // `tooling::ReplacementError` are need (access to
-        // `getReplacementErrString`).
-        // A better strategy could be to add a pretty printer methods for
-        // conflict reporting. Methods that could be parameterized to report a
-        // conflict in different format, file+offset, file+line+col, or even
-        // more human readable using VCS conflict markers.
-        // For now, printing directly the error reported by `AtomicChange` is
-        // the easiest solution.
-        errs() << llvm::toString(std::move(Err)) << "\n";
-        ConflictDetected = true;
-      }
-    }
+    tooling::AtomicChange FileChange = makeFileChange(
+        Entry, FileAndReplacements.second, SM, ConflictDetected);
     FileChanges.try_emplace(Entry,
                             std::vector<tooling::AtomicChange>{FileChange});
   }
@@ -229,17 +378,321 @@ llvm::Expected<std::string>
 applyChanges(StringRef File, const std::vector<tooling::AtomicChange> &Changes,
              const tooling::ApplyChangesSpec &Spec,
              DiagnosticsEngine &Diagnostics) {
+  // A SourceManager would register itself in Diagnostics, only read the file.
   FileManager Files((FileSystemOptions()));
-  SourceManager SM(Diagnostics, Files);
-
   llvm::ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
-      SM.getFileManager().getBufferForFile(File);
+      Files.getBufferForFile(File);
   if (!Buffer)
     return errorCodeToError(Buffer.getError());
   return tooling::applyAtomicChanges(File, Buffer.get()->getBuffer(), Changes,
                                      Spec);
 }
 
+namespace {
+/// \brief A replacement of a run of the streaming mode, targeting the file of
+/// the canonical path \c FilePath.
+struct SpilledReplacement {
+  std::string FilePath;
+  unsigned Offset;
+  unsigned Length;
+  std::string Text;
+  bool FromDiag;
+
+  bool operator<(const SpilledReplacement &RHS) const {
+    return std::tie(FilePath, Offset, Length, Text, FromDiag) <
+           std::tie(RHS.FilePath, RHS.Offset, RHS.Length, RHS.Text,
+                    RHS.FromDiag);
+  }
+};
+
+/// \brief Buffers the replacements of the streaming mode, and spills them to
+/// sorted run files when the buffer is full.
+class ReplacementSpiller {
+public:
+  explicit ReplacementSpiller(size_t MaxBufferedReplacements)
+      : MaxBufferedReplacements(std::max<size_t>(1, MaxBufferedReplacements)),
+        Files((FileSystemOptions())) {}
+
+  ~ReplacementSpiller() {
+    for (const std::string &Run : Runs)
+      llvm::sys::fs::remove(Run);
+  }
+
+  /// \brief Adds \p R, ignoring it if its file doesn't exist. Returns false if
+  /// the buffer couldn't be spilled.
+  bool add(const tooling::Replacement &R, bool FromDiag) {
+    StringRef FilePath = getCanonicalPath(R.getFilePath());
+    if (FilePath.empty())
+      return true;
+    Buffer.push_back({FilePath, R.getOffset(), R.getLength(),
+                      R.getReplacementText(), FromDiag});
+    return Buffer.size() < MaxBufferedReplacements || spill();
+  }
+
+  /// \brief Sorts the buffered replacements and writes them to a new run.
+  bool spill();
+
+  const std::vector<std::string> &getRuns() const { return Runs; }
+
+private:
+  /// \brief Returns the path identifying the file of \p Path, or an empty
+  /// path if it doesn't exist. The file manager deduplicates the paths: the
+  /// first path a file was found with is the one of all its replacements.
+  StringRef getCanonicalPath(StringRef Path) {
+    auto Inserted = CanonicalPaths.try_emplace(Path);
+    if (Inserted.second) {
+      if (const FileEntry *Entry = Files.getFile(Path))
+        Inserted.first->second = Entry->getName();
+      else
+        errs() << "Described file '" << Path
+               << "' doesn't exist. Ignoring...\n";
+    }
+    return Inserted.first->second;
+  }
+
+  const size_t MaxBufferedReplacements;
+  FileManager Files;
+  llvm::StringMap<std::string> CanonicalPaths;
+  std::vector<SpilledReplacement> Buffer;
+  std::vector<std::string> Runs;
+};
+
+bool ReplacementSpiller::spill() {
+  if (Buffer.empty())
+    return true;
+  llvm::sort(Buffer.begin(), Buffer.end());
+  int FD;
+  SmallString<128> RunPath;
+  if (std::error_code EC = llvm::sys::fs::createTemporaryFile(
+          "clang-apply-replacements-run", "bin", FD, RunPath)) {
+    errs() << "Error creating run file: " << EC.message() << "\n";
+    return false;
+  }
+  Runs.push_back(RunPath.str());
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  for (const SpilledReplacement &R : Buffer) {
+    encodeULEB128(R.FilePath.size(), OS);
+    OS << R.FilePath;
+    encodeULEB128(R.Offset, OS);
+    encodeULEB128(R.Length, OS);
+    encodeULEB128(R.Text.size(), OS);
+    OS << R.Text;
+    OS << static_cast<char>(R.FromDiag);
+  }
+  Buffer.clear();
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    errs() << "Error writing run file " << RunPath << "\n";
+    return false;
+  }
+  return true;
+}
+
+/// \brief Reads the sorted replacements of a run file one at a time.
+class RunReader {
+public:
+  explicit RunReader(std::unique_ptr<MemoryBuffer> Run)
+      : Run(std::move(Run)), Cur(this->Run->getBuffer().bytes_begin()),
+        End(this->Run->getBuffer().bytes_end()) {}
+
+  /// \brief Reads the next replacement into \p R. Returns false at the end
+  /// of the run, or if it's malformed.
+  bool next(SpilledReplacement &R) {
+    uint64_t Offset, Length;
+    if (Cur == End || !readString(R.FilePath) || !readNumber(Offset) ||
+        !readNumber(Length) || !readString(R.Text) || Cur == End)
+      return false;
+    R.Offset = Offset;
+    R.Length = Length;
+    R.FromDiag = *Cur++ != 0;
+    return true;
+  }
+
+private:
+  bool readNumber(uint64_t &Value) {
+    unsigned Size = 0;
+    const char *Error = nullptr;
+    Value = decodeULEB128(Cur, &Size, End, &Error);
+    Cur += Size;
+    return !Error;
+  }
+
+  bool readString(std::string &S) {
+    uint64_t Size;
+    if (!readNumber(Size) || Size > static_cast<uint64_t>(End - Cur))
+      return false;
+    S.assign(reinterpret_cast<const char *>(Cur), Size);
+    Cur += Size;
+    return true;
+  }
+
+  std::unique_ptr<MemoryBuffer> Run;
+  const uint8_t *Cur;
+  const uint8_t *End;
+};
+} // namespace
+
+/// \brief Changes the file \p FilePath with its sorted replacements
+/// \p Replaces, and writes the changed code to a temporary file next to it,
+/// added to \p ChangedFiles with the file it replaces. Returns false if the
+/// replacements conflict or the file couldn't be changed.
+static bool
+changeFileToTemporary(StringRef FilePath,
+                      llvm::ArrayRef<tooling::Replacement> Replaces,
+                      const tooling::ApplyChangesSpec &Spec,
+                      DiagnosticsEngine &Diagnostics,
+                      std::vector<std::pair<std::string, std::string>>
+                          &ChangedFiles) {
+  // Each file has its own managers, to release its buffers once changed.
+  FileManager Files((FileSystemOptions()));
+  SourceManager SM(Diagnostics, Files);
+  const FileEntry *Entry = Files.getFile(FilePath);
+  if (!Entry) {
+    errs() << "Described file '" << FilePath
+           << "' doesn't exist. Ignoring...\n";
+    return true;
+  }
+  bool ConflictDetected = false;
+  tooling::AtomicChange FileChange =
+      makeFileChange(Entry, Replaces, SM, ConflictDetected);
+  if (ConflictDetected)
+    return false;
+
+  llvm::Expected<std::string> NewFileData =
+      applyChanges(FilePath, {FileChange}, Spec, Diagnostics);
+  if (!NewFileData) {
+    errs() << llvm::toString(NewFileData.takeError()) << "\n";
+    return true;
+  }
+
+  int FD;
+  SmallString<128> TempPath;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          FilePath + "-%%%%%%%%.tmp", FD, TempPath)) {
+    errs() << "Could not open a temporary file for " << FilePath << ": "
+           << EC.message() << "\n";
+    return false;
+  }
+  ChangedFiles.emplace_back(TempPath.str(), FilePath);
+  raw_fd_ostream FileStream(FD, /*shouldClose=*/true);
+  FileStream << *NewFileData;
+  FileStream.close();
+  if (FileStream.has_error()) {
+    FileStream.clear_error();
+    errs() << "Could not write " << TempPath << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool applyReplacementsFromDirectoryStreaming(
+    const llvm::StringRef Directory, TUReplacementFiles &TUFiles,
+    const tooling::ApplyChangesSpec &Spec, size_t MaxBufferedReplacements,
+    clang::DiagnosticsEngine &Diagnostics) {
+  if (std::error_code ErrorCode = findReplacementFiles(Directory, TUFiles)) {
+    errs() << "Trouble iterating over directory '" << Directory
+           << "': " << ErrorCode.message() << "\n";
+    return false;
+  }
+
+  // Read the change description files one at a time, and spill their
+  // replacements to sorted runs.
+  ReplacementSpiller Spiller(MaxBufferedReplacements);
+  BinaryReplacementsFilter Filter;
+  for (const std::string &Path : TUFiles) {
+    TUReplacements TURs;
+    TUDiagnostics TUDs;
+    std::string Errors;
+    parseReplacementFile(Path, TURs, Filter, Errors);
+    parseReplacementFile(Path, TUDs, Filter, Errors);
+    errs() << Errors;
+    for (const auto &TU : TURs)
+      for (const tooling::Replacement &R : TU.Replacements)
+        if (!Spiller.add(R, false))
+          return false;
+    for (const auto &TU : TUDs)
+      for (const auto &D : TU.Diagnostics)
+        for (const auto &Fix : D.Fix)
+          for (const tooling::Replacement &R : Fix.second)
+            if (!Spiller.add(R, true))
+              return false;
+  }
+  if (!Spiller.spill())
+    return false;
+
+  // Merge the runs, which visits the replacements of each file together,
+  // sorted by offset.
+  std::vector<std::unique_ptr<RunReader>> Readers;
+  typedef std::pair<SpilledReplacement, size_t> HeapEntry;
+  auto Greater = [](const HeapEntry &LHS, const HeapEntry &RHS) {
+    return RHS < LHS;
+  };
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>, decltype(Greater)>
+      Heap(Greater);
+  for (const std::string &Run : Spiller.getRuns()) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Run);
+    if (std::error_code BufferError = Buffer.getError()) {
+      errs() << "Error reading " << Run << ": " << BufferError.message()
+             << "\n";
+      return false;
+    }
+    Readers.push_back(llvm::make_unique<RunReader>(std::move(Buffer.get())));
+    SpilledReplacement R;
+    if (Readers.back()->next(R))
+      Heap.emplace(std::move(R), Readers.size() - 1);
+  }
+
+  std::vector<std::pair<std::string, std::string>> ChangedFiles;
+  auto RemoveChangedFiles = llvm::make_scope_exit([&] {
+    for (const auto &TempAndFile : ChangedFiles)
+      llvm::sys::fs::remove(TempAndFile.first);
+  });
+  bool Success = true;
+  std::string FilePath;
+  std::vector<tooling::Replacement> Replaces;
+  while (!Heap.empty()) {
+    FilePath = Heap.top().first.FilePath;
+    Replaces.clear();
+    const SpilledReplacement *LastDiag = nullptr;
+    SpilledReplacement Previous;
+    while (!Heap.empty() && Heap.top().first.FilePath == FilePath) {
+      HeapEntry Top = Heap.top();
+      Heap.pop();
+      SpilledReplacement R;
+      if (Readers[Top.second]->next(R))
+        Heap.emplace(std::move(R), Top.second);
+      // Deduplicate identical replacements in diagnostics, which are next to
+      // each other.
+      const SpilledReplacement &Current = Top.first;
+      if (Current.FromDiag && LastDiag && LastDiag->Offset == Current.Offset &&
+          LastDiag->Length == Current.Length && LastDiag->Text == Current.Text)
+        continue;
+      Replaces.emplace_back(Current.FilePath, Current.Offset, Current.Length,
+                            Current.Text);
+      if (Current.FromDiag) {
+        Previous = Current;
+        LastDiag = &Previous;
+      }
+    }
+    Success &= changeFileToTemporary(FilePath, Replaces, Spec, Diagnostics,
+                                     ChangedFiles);
+  }
+  if (!Success)
+    return false;
+
+  // All the files changed, replace them.
+  for (const auto &TempAndFile : ChangedFiles) {
+    if (std::error_code EC =
+            llvm::sys::fs::rename(TempAndFile.first, TempAndFile.second)) {
+      errs() << "Could not write " << TempAndFile.second << ": "
+             << EC.message() << "\n";
+      Success = false;
+    }
+  }
+  return Success;
+}
+
 bool deleteReplacementFiles(const TUReplacementFiles &Files,
                             clang::DiagnosticsEngine &Diagnostics) {
   bool Success = true;
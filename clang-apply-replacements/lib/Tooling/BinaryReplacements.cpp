@@ -0,0 +1,263 @@
+//===-- BinaryReplacements.cpp - Compact binary fixes format --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief This file provides the implementation for writing and reading the
+/// fixes of TranslationUnitDiagnostics in a compact binary format.
+///
+//===----------------------------------------------------------------------===//
+#include "clang-apply-replacements/Tooling/BinaryReplacements.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/xxhash.h"
+#include <cstring>
+#include <limits>
+#include <map>
+
+using namespace llvm;
+using namespace clang;
+
+static const char Magic[4] = {'C', 'T', 'F', 'X'};
+static const uint64_t Version = 1;
+
+namespace {
+/// \brief Assigns the indices of the strings of a record, each distinct string
+/// being stored once.
+class RecordStrings {
+public:
+  uint64_t getIndex(StringRef S) {
+    auto Inserted = Indices.try_emplace(S, Strings.size());
+    if (Inserted.second)
+      Strings.push_back(Inserted.first->first());
+    return Inserted.first->second;
+  }
+
+  void write(raw_ostream &OS) const {
+    encodeULEB128(Strings.size(), OS);
+    for (StringRef S : Strings) {
+      encodeULEB128(S.size(), OS);
+      OS << S;
+    }
+  }
+
+private:
+  StringMap<uint64_t> Indices;
+  std::vector<StringRef> Strings;
+};
+
+/// \brief Reads the numbers and bytes of a buffer in the binary format,
+/// failing instead of reading past its end.
+class RecordReader {
+public:
+  explicit RecordReader(StringRef Buffer)
+      : Cur(Buffer.bytes_begin()), End(Buffer.bytes_end()) {}
+
+  bool atEnd() const { return Cur == End; }
+
+  bool readMagic() {
+    if (End - Cur < static_cast<ptrdiff_t>(sizeof(Magic)) ||
+        std::memcmp(Cur, Magic, sizeof(Magic)) != 0)
+      return false;
+    Cur += sizeof(Magic);
+    return true;
+  }
+
+  bool readNumber(uint64_t &Value) {
+    unsigned Size = 0;
+    const char *Error = nullptr;
+    Value = decodeULEB128(Cur, &Size, End, &Error);
+    if (Error)
+      return false;
+    Cur += Size;
+    return true;
+  }
+
+  bool readBytes(uint64_t Size, StringRef &Bytes) {
+    if (Size > static_cast<uint64_t>(End - Cur))
+      return false;
+    Bytes = StringRef(reinterpret_cast<const char *>(Cur), Size);
+    Cur += Size;
+    return true;
+  }
+
+private:
+  const uint8_t *Cur;
+  const uint8_t *End;
+};
+} // namespace
+
+/// \brief Reads a string as an index in \p Strings.
+static bool readString(RecordReader &Reader, ArrayRef<StringRef> Strings,
+                       StringRef &S) {
+  uint64_t Index;
+  if (!Reader.readNumber(Index) || Index >= Strings.size())
+    return false;
+  S = Strings[Index];
+  return true;
+}
+
+/// \brief Reads the fixes of \p Path from \p Payload, adding a diagnostic per
+/// fix to \p TU.
+static bool readFileFixes(StringRef Path, StringRef Payload,
+                          ArrayRef<StringRef> Strings,
+                          tooling::TranslationUnitDiagnostics &TU) {
+  RecordReader Reader(Payload);
+  uint64_t FixCount;
+  if (!Reader.readNumber(FixCount))
+    return false;
+  for (uint64_t I = 0; I < FixCount; ++I) {
+    uint64_t ReplacementCount;
+    if (!Reader.readNumber(ReplacementCount))
+      return false;
+    tooling::Replacements Replaces;
+    uint64_t Offset = 0;
+    for (uint64_t J = 0; J < ReplacementCount; ++J) {
+      uint64_t Delta, Length;
+      StringRef Text;
+      if (!Reader.readNumber(Delta) || !Reader.readNumber(Length) ||
+          !readString(Reader, Strings, Text))
+        return false;
+      Offset += Delta;
+      if (Offset > std::numeric_limits<unsigned>::max() ||
+          Length > std::numeric_limits<unsigned>::max())
+        return false;
+      if (llvm::Error Err =
+              Replaces.add(tooling::Replacement(Path, Offset, Length, Text))) {
+        llvm::consumeError(std::move(Err));
+        return false;
+      }
+    }
+    tooling::Diagnostic Diag(/*DiagnosticName=*/"",
+                             tooling::Diagnostic::Warning,
+                             /*BuildDirectory=*/"");
+    Diag.Fix[Path] = std::move(Replaces);
+    TU.Diagnostics.push_back(std::move(Diag));
+  }
+  return Reader.atEnd();
+}
+
+/// \brief Reads the record at the position of \p Reader into \p TU.
+static bool readRecord(RecordReader &Reader,
+                       tooling::TranslationUnitDiagnostics &TU,
+                       replace::BinaryReplacementsFilter *Filter) {
+  uint64_t RecordVersion, StringCount;
+  if (!Reader.readMagic() || !Reader.readNumber(RecordVersion) ||
+      RecordVersion != Version || !Reader.readNumber(StringCount))
+    return false;
+  std::vector<StringRef> Strings;
+  for (uint64_t I = 0; I < StringCount; ++I) {
+    uint64_t Size;
+    StringRef S;
+    if (!Reader.readNumber(Size) || !Reader.readBytes(Size, S))
+      return false;
+    Strings.push_back(S);
+  }
+
+  StringRef MainSourceFile;
+  uint64_t FileCount;
+  if (!readString(Reader, Strings, MainSourceFile) ||
+      !Reader.readNumber(FileCount))
+    return false;
+  TU.MainSourceFile = MainSourceFile;
+  for (uint64_t I = 0; I < FileCount; ++I) {
+    StringRef Path, Payload;
+    uint64_t Hash, PayloadSize;
+    if (!readString(Reader, Strings, Path) || !Reader.readNumber(Hash) ||
+        !Reader.readNumber(PayloadSize) ||
+        !Reader.readBytes(PayloadSize, Payload))
+      return false;
+    if (Filter && !Filter->insert(Path, Hash))
+      continue;
+    if (!readFileFixes(Path, Payload, Strings, TU))
+      return false;
+  }
+  return true;
+}
+
+namespace clang {
+namespace replace {
+
+bool BinaryReplacementsFilter::insert(StringRef Path, uint64_t Hash) {
+  std::pair<uint64_t, uint64_t> Key(xxHash64(Path), Hash);
+  std::lock_guard<std::mutex> Lock(Mu);
+  return Seen.insert(Key).second;
+}
+
+bool isBinaryReplacements(StringRef Buffer) {
+  return Buffer.startswith(StringRef(Magic, sizeof(Magic)));
+}
+
+void writeBinaryReplacements(const tooling::TranslationUnitDiagnostics &TU,
+                             raw_ostream &OS) {
+  // The fixes of each file, one per diagnostic, in the order of the paths.
+  std::map<std::string, std::vector<const tooling::Replacements *>> FileFixes;
+  for (const tooling::Diagnostic &Diag : TU.Diagnostics)
+    for (const auto &FileAndReplacements : Diag.Fix)
+      if (!FileAndReplacements.second.empty())
+        FileFixes[FileAndReplacements.first()].push_back(
+            &FileAndReplacements.second);
+
+  RecordStrings Strings;
+  uint64_t MainSourceFile = Strings.getIndex(TU.MainSourceFile);
+  SmallString<1024> Files;
+  raw_svector_ostream FilesOS(Files);
+  encodeULEB128(FileFixes.size(), FilesOS);
+  for (const auto &PathAndFixes : FileFixes) {
+    // The hash is computed on the texts rather than their indices, which
+    // depend on the record.
+    SmallString<256> Payload, HashedPayload;
+    raw_svector_ostream PayloadOS(Payload), HashedPayloadOS(HashedPayload);
+    encodeULEB128(PathAndFixes.second.size(), PayloadOS);
+    encodeULEB128(PathAndFixes.second.size(), HashedPayloadOS);
+    for (const tooling::Replacements *Fix : PathAndFixes.second) {
+      encodeULEB128(Fix->size(), PayloadOS);
+      encodeULEB128(Fix->size(), HashedPayloadOS);
+      unsigned Offset = 0;
+      for (const tooling::Replacement &R : *Fix) {
+        encodeULEB128(R.getOffset() - Offset, PayloadOS);
+        encodeULEB128(R.getLength(), PayloadOS);
+        encodeULEB128(Strings.getIndex(R.getReplacementText()), PayloadOS);
+        encodeULEB128(R.getOffset() - Offset, HashedPayloadOS);
+        encodeULEB128(R.getLength(), HashedPayloadOS);
+        encodeULEB128(R.getReplacementText().size(), HashedPayloadOS);
+        HashedPayloadOS << R.getReplacementText();
+        Offset = R.getOffset();
+      }
+    }
+    encodeULEB128(Strings.getIndex(PathAndFixes.first), FilesOS);
+    encodeULEB128(xxHash64(HashedPayload), FilesOS);
+    encodeULEB128(Payload.size(), FilesOS);
+    FilesOS << Payload;
+  }
+
+  OS.write(Magic, sizeof(Magic));
+  encodeULEB128(Version, OS);
+  Strings.write(OS);
+  encodeULEB128(MainSourceFile, OS);
+  OS << Files;
+}
+
+llvm::Error
+readBinaryReplacements(StringRef Buffer,
+                       std::vector<tooling::TranslationUnitDiagnostics> &TUs,
+                       BinaryReplacementsFilter *Filter) {
+  RecordReader Reader(Buffer);
+  while (!Reader.atEnd()) {
+    tooling::TranslationUnitDiagnostics TU;
+    if (!readRecord(Reader, TU, Filter))
+      return llvm::make_error<llvm::StringError>(
+          "malformed binary replacements", llvm::inconvertibleErrorCode());
+    TUs.push_back(std::move(TU));
+  }
+  return llvm::Error::success();
+}
+
+} // end namespace replace
+} // end namespace clang
@@ -23,6 +23,11 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 using namespace llvm;
 using namespace clang;
@@ -43,6 +48,26 @@ static cl::opt<bool> RemoveTUReplacementFiles(
              "merging/replacing."),
     cl::init(false), cl::cat(ReplacementCategory));
 
+static cl::opt<unsigned>
+    Jobs("j",
+         cl::desc("Number of change description files read, and of files\n"
+                  "changed, in parallel. 0 uses one thread per hardware\n"
+                  "thread."),
+         cl::init(1), cl::cat(ReplacementCategory));
+
+static cl::opt<bool> Streaming(
+    "streaming",
+    cl::desc("Apply the replacements without keeping all of them in memory:\n"
+             "they are spilled to sorted temporary files, which are merged\n"
+             "to change one file at a time. Ignores -j."),
+    cl::init(false), cl::cat(ReplacementCategory));
+
+static cl::opt<unsigned> StreamingBufferSize(
+    "streaming-buffer-size",
+    cl::desc("Number of replacements kept in memory by -streaming before\n"
+             "they are spilled to a temporary file."),
+    cl::init(1000000), cl::cat(ReplacementCategory));
+
 static cl::opt<bool> DoFormat(
     "format",
     cl::desc("Enable formatting of code changed by applying replacements.\n"
@@ -105,16 +130,36 @@ int main(int argc, char **argv) {
   }
   format::FormatStyle FormatStyle = std::move(*FormatStyleOrError);
 
-  TUReplacements TURs;
+  tooling::ApplyChangesSpec Spec;
+  Spec.Cleanup = true;
+  Spec.Style = FormatStyle;
+  Spec.Format = DoFormat ? tooling::ApplyChangesSpec::kAll
+                         : tooling::ApplyChangesSpec::kNone;
+
   TUReplacementFiles TUFiles;
 
-  std::error_code ErrorCode =
-      collectReplacementsFromDirectory(Directory, TURs, TUFiles, Diagnostics);
+  // Remove the TUReplacementFiles (triggered by "remove-change-desc-files"
+  // command line option) when exiting main().
+  std::unique_ptr<ScopedFileRemover> Remover;
+
+  if (Streaming) {
+    if (RemoveTUReplacementFiles)
+      Remover.reset(new ScopedFileRemover(TUFiles, Diagnostics));
+    return applyReplacementsFromDirectoryStreaming(
+               Directory, TUFiles, Spec, StreamingBufferSize, Diagnostics)
+               ? 0
+               : 1;
+  }
+
+  TUReplacements TURs;
+
+  std::error_code ErrorCode = collectReplacementsFromDirectory(
+      Directory, TURs, TUFiles, Diagnostics, Jobs);
 
   TUDiagnostics TUDs;
   TUFiles.clear();
-  ErrorCode =
-      collectReplacementsFromDirectory(Directory, TUDs, TUFiles, Diagnostics);
+  ErrorCode = collectReplacementsFromDirectory(Directory, TUDs, TUFiles,
+                                               Diagnostics, Jobs);
 
   if (ErrorCode) {
     errs() << "Trouble iterating over directory '" << Directory
@@ -122,9 +167,6 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // Remove the TUReplacementFiles (triggered by "remove-change-desc-files"
-  // command line option) when exiting main().
-  std::unique_ptr<ScopedFileRemover> Remover;
   if (RemoveTUReplacementFiles)
     Remover.reset(new ScopedFileRemover(TUFiles, Diagnostics));
 
@@ -132,34 +174,49 @@ int main(int argc, char **argv) {
   SourceManager SM(Diagnostics, Files);
 
   FileToChangesMap Changes;
-  if (!mergeAndDeduplicate(TURs, TUDs, Changes, SM))
+  if (!mergeAndDeduplicate(TURs, TUDs, Changes, SM, Jobs))
     return 1;
 
-  tooling::ApplyChangesSpec Spec;
-  Spec.Cleanup = true;
-  Spec.Style = FormatStyle;
-  Spec.Format = DoFormat ? tooling::ApplyChangesSpec::kAll
-                         : tooling::ApplyChangesSpec::kNone;
-
-  for (const auto &FileChange : Changes) {
-    const FileEntry *Entry = FileChange.first;
-    StringRef FileName = Entry->getName();
-    llvm::Expected<std::string> NewFileData =
-        applyChanges(FileName, FileChange.second, Spec, Diagnostics);
-    if (!NewFileData) {
-      errs() << llvm::toString(NewFileData.takeError()) << "\n";
-      continue;
+  // The files are changed independently of each other, the messages are
+  // written under ErrsMu.
+  std::vector<const FileToChangesMap::value_type *> FileChanges;
+  for (const auto &FileChange : Changes)
+    FileChanges.push_back(&FileChange);
+  std::mutex ErrsMu;
+  auto Report = [&](const Twine &Message) {
+    std::lock_guard<std::mutex> Lock(ErrsMu);
+    errs() << Message << "\n";
+  };
+  std::atomic<size_t> NextFile(0);
+  auto Worker = [&] {
+    for (size_t I = NextFile++; I < FileChanges.size(); I = NextFile++) {
+      const FileEntry *Entry = FileChanges[I]->first;
+      StringRef FileName = Entry->getName();
+      llvm::Expected<std::string> NewFileData =
+          applyChanges(FileName, FileChanges[I]->second, Spec, Diagnostics);
+      if (!NewFileData) {
+        Report(llvm::toString(NewFileData.takeError()));
+        continue;
+      }
+
+      // Write new file to disk
+      std::error_code EC;
+      llvm::raw_fd_ostream FileStream(FileName, EC, llvm::sys::fs::F_None);
+      if (EC) {
+        Report("Could not open " + FileName + " for writing");
+        continue;
+      }
+      FileStream << *NewFileData;
     }
-
-    // Write new file to disk
-    std::error_code EC;
-    llvm::raw_fd_ostream FileStream(FileName, EC, llvm::sys::fs::F_None);
-    if (EC) {
-      llvm::errs() << "Could not open " << FileName << " for writing\n";
-      continue;
-    }
-    FileStream << *NewFileData;
-  }
+  };
+  unsigned ThreadCount = Jobs ? Jobs : llvm::hardware_concurrency();
+  std::vector<std::thread> Pool;
+  for (size_t I = 1; I < std::min<size_t>(ThreadCount, FileChanges.size());
+       ++I)
+    Pool.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Pool)
+    T.join();
 
   return 0;
 }
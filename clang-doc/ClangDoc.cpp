@@ -15,6 +15,7 @@
 
 #include "ClangDoc.h"
 #include "Mapper.h"
+#include "MapperCache.h"
 #include "Representation.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
@@ -27,30 +28,95 @@
 namespace clang {
 namespace doc {
 
+namespace {
+
+// Returns the digest of the options of an invocation that change its mapped
+// results, for the mapper cache.
+std::string getCommandDigest(CompilerInvocation &Invocation, bool PublicOnly) {
+  return digest(Invocation.getModuleHash() + " " +
+                (Invocation.getLangOpts()->CommentOpts.ParseAllComments
+                     ? "all-comments "
+                     : "doxygen-comments ") +
+                (PublicOnly ? "public" : "all"));
+}
+
+// Returns the absolute path of the main file of an invocation.
+std::string getMainPath(CompilerInvocation &Invocation, FileManager &Files) {
+  llvm::SmallString<128> Path(
+      Invocation.getFrontendOpts().Inputs.front().getFile());
+  Files.makeAbsolutePath(Path);
+  return Path.str();
+}
+
+} // namespace
+
 class MapperActionFactory : public tooling::FrontendActionFactory {
 public:
   MapperActionFactory(ClangDocContext CDCtx) : CDCtx(CDCtx) {}
   clang::FrontendAction *create() override;
 
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override;
+
 private:
   ClangDocContext CDCtx;
+  // Shared by the actions of all TUs, which may run concurrently.
+  ReportedResults Reported;
 };
 
 clang::FrontendAction *MapperActionFactory::create() {
   class ClangDocAction : public clang::ASTFrontendAction {
   public:
-    ClangDocAction(ClangDocContext CDCtx) : CDCtx(CDCtx) {}
+    ClangDocAction(ClangDocContext CDCtx, ReportedResults &Reported)
+        : CDCtx(CDCtx), Reported(Reported) {}
 
     std::unique_ptr<clang::ASTConsumer>
     CreateASTConsumer(clang::CompilerInstance &Compiler,
                       llvm::StringRef InFile) override {
-      return llvm::make_unique<MapASTVisitor>(&Compiler.getASTContext(), CDCtx);
+      return llvm::make_unique<MapASTVisitor>(
+          &Compiler.getASTContext(), CDCtx, &Reported,
+          CDCtx.Cache ? &Recorded : nullptr);
+    }
+
+  protected:
+    void EndSourceFileAction() override {
+      if (!CDCtx.Cache)
+        return;
+      CompilerInstance &Compiler = getCompilerInstance();
+      CompilerInvocation &Invocation = Compiler.getInvocation();
+      CDCtx.Cache->store(
+          getMainPath(Invocation, Compiler.getFileManager()),
+          getCommandDigest(Invocation, CDCtx.PublicOnly),
+          Compiler.getSourceManager(), Recorded);
     }
 
   private:
     ClangDocContext CDCtx;
+    ReportedResults &Reported;
+    MapperResults Recorded;
   };
-  return new ClangDocAction(CDCtx);
+  return new ClangDocAction(CDCtx, Reported);
+}
+
+bool MapperActionFactory::runInvocation(
+    std::shared_ptr<CompilerInvocation> Invocation, FileManager *Files,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+    DiagnosticConsumer *DiagConsumer) {
+  // The TUs whose files didn't change report their cached results instead of
+  // being parsed.
+  if (CDCtx.Cache && Invocation->getFrontendOpts().Inputs.size() == 1) {
+    if (auto Results = CDCtx.Cache->lookup(
+            getMainPath(*Invocation, *Files),
+            getCommandDigest(*Invocation, CDCtx.PublicOnly))) {
+      for (const auto &Result : *Results)
+        reportResult(CDCtx, &Reported, Result.first, Result.second);
+      return true;
+    }
+  }
+  return FrontendActionFactory::runInvocation(
+      std::move(Invocation), Files, std::move(PCHContainerOps), DiagConsumer);
 }
 
 std::unique_ptr<tooling::FrontendActionFactory>
@@ -0,0 +1,177 @@
+//===-- DocArchive.cpp - ClangDoc Documentation Archive ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DocArchive.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+
+namespace clang {
+namespace doc {
+
+namespace {
+
+// Docs are small, write them in large blocks.
+constexpr size_t SegmentBufferSize = 1 << 20;
+
+std::string getSegmentPath(StringRef Directory, unsigned Segment) {
+  llvm::SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, llvm::Twine(Segment) + ".segment");
+  return Path.str().str();
+}
+
+std::string getIndexPath(StringRef Directory) {
+  llvm::SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, DocArchiveIndex);
+  return Path.str().str();
+}
+
+llvm::Error makeStringError(const llvm::Twine &Message) {
+  return llvm::make_error<llvm::StringError>(Message,
+                                             llvm::inconvertibleErrorCode());
+}
+
+} // namespace
+
+void DocArchiveWriter::setError(const llvm::Twine &Message) {
+  std::lock_guard<std::mutex> Lock(IndexMutex);
+  if (FirstError.empty())
+    FirstError = Message.str();
+}
+
+void DocArchiveWriter::addDoc(StringRef Path, StringRef Doc) {
+  unsigned SegmentIndex = llvm::xxHash64(Path) % DocArchiveSegments;
+  Segment &S = Segments[SegmentIndex];
+  Location Loc;
+  {
+    std::lock_guard<std::mutex> Lock(S.Mutex);
+    if (!S.OS) {
+      std::string SegmentPath = getSegmentPath(Directory, SegmentIndex);
+      std::error_code EC;
+      S.OS = llvm::make_unique<llvm::raw_fd_ostream>(SegmentPath, EC,
+                                                     llvm::sys::fs::F_None);
+      if (EC) {
+        S.OS.reset();
+        setError("Unable to create doc segment " + SegmentPath + ": " +
+                 EC.message());
+        return;
+      }
+      S.OS->SetBufferSize(SegmentBufferSize);
+    }
+    Loc = {SegmentIndex, S.OS->tell(), Doc.size()};
+    *S.OS << Doc;
+  }
+  std::lock_guard<std::mutex> Lock(IndexMutex);
+  Index[Path] = Loc;
+}
+
+llvm::Error DocArchiveWriter::close() {
+  for (unsigned I = 0; I < DocArchiveSegments; ++I) {
+    Segment &S = Segments[I];
+    std::lock_guard<std::mutex> Lock(S.Mutex);
+    if (!S.OS) {
+      // Remove the segment of a previous archive.
+      llvm::sys::fs::remove(getSegmentPath(Directory, I));
+      continue;
+    }
+    S.OS->close();
+    if (S.OS->has_error())
+      setError("Unable to write a doc segment in " + Directory);
+    S.OS->clear_error();
+    S.OS.reset();
+  }
+  if (!FirstError.empty())
+    return makeStringError(FirstError);
+
+  // Sort the index, so that the same docs give the same archive.
+  std::vector<const llvm::StringMapEntry<Location> *> Entries;
+  Entries.reserve(Index.size());
+  for (const auto &Entry : Index)
+    Entries.push_back(&Entry);
+  std::sort(Entries.begin(), Entries.end(),
+            [](const llvm::StringMapEntry<Location> *A,
+               const llvm::StringMapEntry<Location> *B) {
+              return A->getKey() < B->getKey();
+            });
+  std::string IndexPath = getIndexPath(Directory);
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(IndexPath, EC, llvm::sys::fs::F_None);
+  if (EC)
+    return makeStringError("Unable to create doc index " + IndexPath + ": " +
+                           EC.message());
+  for (const auto *Entry : Entries) {
+    const Location &Loc = Entry->getValue();
+    OS << Loc.Segment << ' ' << Loc.Offset << ' ' << Loc.Size << ' '
+       << Entry->getKey() << '\n';
+  }
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    return makeStringError("Unable to write doc index " + IndexPath);
+  }
+  return llvm::Error::success();
+}
+
+llvm::Expected<std::unique_ptr<DocArchiveReader>>
+DocArchiveReader::open(StringRef Directory) {
+  std::string IndexPath = getIndexPath(Directory);
+  auto IndexBuffer = llvm::MemoryBuffer::getFile(IndexPath);
+  if (!IndexBuffer)
+    return makeStringError("Unable to read doc index " + IndexPath + ": " +
+                           IndexBuffer.getError().message());
+
+  std::unique_ptr<DocArchiveReader> Reader(new DocArchiveReader());
+  Reader->Segments.resize(DocArchiveSegments);
+  SmallVector<StringRef, 0> Lines;
+  IndexBuffer.get()->getBuffer().split(Lines, '\n', /*MaxSplit=*/-1,
+                                       /*KeepEmpty=*/false);
+  for (StringRef Line : Lines) {
+    StringRef Segment, Offset, Size, Path;
+    std::tie(Segment, Line) = Line.split(' ');
+    std::tie(Offset, Line) = Line.split(' ');
+    std::tie(Size, Path) = Line.split(' ');
+    unsigned SegmentIndex;
+    uint64_t DocOffset, DocSize;
+    if (Segment.getAsInteger(10, SegmentIndex) ||
+        SegmentIndex >= DocArchiveSegments ||
+        Offset.getAsInteger(10, DocOffset) || Size.getAsInteger(10, DocSize) ||
+        Path.empty())
+      return makeStringError("Malformed doc index " + IndexPath);
+
+    std::unique_ptr<llvm::MemoryBuffer> &Buffer =
+        Reader->Segments[SegmentIndex];
+    if (!Buffer) {
+      std::string SegmentPath = getSegmentPath(Directory, SegmentIndex);
+      auto SegmentBuffer = llvm::MemoryBuffer::getFile(
+          SegmentPath, /*FileSize=*/-1, /*RequiresNullTerminator=*/false);
+      if (!SegmentBuffer)
+        return makeStringError("Unable to read doc segment " + SegmentPath +
+                               ": " + SegmentBuffer.getError().message());
+      Buffer = std::move(SegmentBuffer.get());
+    }
+    StringRef Contents = Buffer->getBuffer();
+    if (DocOffset > Contents.size() || DocSize > Contents.size() - DocOffset)
+      return makeStringError("Truncated doc segment in " + Directory);
+    Reader->Docs[Path] = Contents.substr(DocOffset, DocSize);
+  }
+  return std::move(Reader);
+}
+
+llvm::Optional<StringRef> DocArchiveReader::getDoc(StringRef Path) const {
+  auto It = Docs.find(Path);
+  if (It == Docs.end())
+    return llvm::None;
+  return It->getValue();
+}
+
+} // namespace doc
+} // namespace clang
@@ -0,0 +1,103 @@
+//===-- DocArchive.h - ClangDoc Documentation Archive -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements an archive of the generated docs, in place of one
+// output file per info. The docs are appended to a few large segment files,
+// and an index maps the path each doc would have in the output directory to
+// its segment, offset and size, so that a docs server reads the archive
+// directly.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_DOCARCHIVE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_DOCARCHIVE_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace doc {
+
+// The number of segment files of an archive. The segment of a doc is given by
+// a hash of its path, so that the generating threads rarely wait for each
+// other.
+static const unsigned DocArchiveSegments = 16;
+
+// The name of the index file of an archive. Each line of the index is the
+// segment, the offset and the size of a doc, then its path, separated by
+// spaces.
+static const char DocArchiveIndex[] = "index";
+
+// Writes the docs into the segment files of a directory, replacing the archive
+// the directory held.
+class DocArchiveWriter {
+public:
+  DocArchiveWriter(StringRef Directory) : Directory(Directory) {}
+
+  // Appends the doc of Path, a relative path using '/' as separator, to its
+  // segment. A later doc of the same path replaces it. This can be called
+  // concurrently.
+  void addDoc(StringRef Path, StringRef Doc);
+
+  // Closes the segment files and writes the index, and returns the first error
+  // of the writes.
+  llvm::Error close();
+
+private:
+  struct Segment {
+    std::mutex Mutex;
+    std::unique_ptr<llvm::raw_fd_ostream> OS;
+  };
+  struct Location {
+    unsigned Segment;
+    uint64_t Offset;
+    uint64_t Size;
+  };
+
+  void setError(const llvm::Twine &Message);
+
+  std::string Directory;
+  Segment Segments[DocArchiveSegments];
+  std::mutex IndexMutex;
+  llvm::StringMap<Location> Index;
+  std::string FirstError;
+};
+
+// Reads the docs of an archive. The segment files are mapped in memory, and
+// only read when their docs are.
+class DocArchiveReader {
+public:
+  static llvm::Expected<std::unique_ptr<DocArchiveReader>>
+  open(StringRef Directory);
+
+  // Returns the doc of Path, or None if the archive has none.
+  llvm::Optional<StringRef> getDoc(StringRef Path) const;
+
+  size_t size() const { return Docs.size(); }
+
+private:
+  DocArchiveReader() = default;
+
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> Segments;
+  llvm::StringMap<StringRef> Docs;
+};
+
+} // namespace doc
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_DOCARCHIVE_H
@@ -9,17 +9,40 @@
 
 #include "Mapper.h"
 #include "BitcodeWriter.h"
+#include "ResultStore.h"
 #include "Serialize.h"
 #include "clang/AST/Comment.h"
 #include "clang/Index/USRGeneration.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/SHA1.h"
 
 using clang::comments::FullComment;
 
 namespace clang {
 namespace doc {
 
+bool ReportedResults::insert(StringRef Key, StringRef Value) {
+  // The keys are hashed USRs of a fixed size, so the concatenations of
+  // different keys and values are different.
+  llvm::SHA1 Hasher;
+  Hasher.update(Key);
+  Hasher.update(Value);
+  StringRef Digest = Hasher.final();
+  std::lock_guard<std::mutex> Lock(Mutex);
+  return Digests.insert(Digest).second;
+}
+
+void reportResult(const ClangDocContext &CDCtx, ReportedResults *Reported,
+                  StringRef Key, StringRef Value) {
+  if (Reported && !Reported->insert(Key, Value))
+    return;
+  if (CDCtx.Store)
+    CDCtx.Store->addResult(Key, Value);
+  else
+    CDCtx.ECtx->reportResult(Key, Value);
+}
+
 void MapASTVisitor::HandleTranslationUnit(ASTContext &Context) {
   TraverseDecl(Context.getTranslationUnitDecl());
 }
@@ -44,9 +67,13 @@ template <typename T> bool MapASTVisitor::mapDecl(const T *D) {
 
   // A null in place of I indicates that the serializer is skipping this decl
   // for some reason (e.g. we're only reporting public decls).
-  if (I)
-    CDCtx.ECtx->reportResult(llvm::toHex(llvm::toStringRef(I->USR)),
-                       serialize::serialize(I));
+  if (!I)
+    return true;
+  std::string Key = llvm::toHex(llvm::toStringRef(I->USR));
+  std::string Value = serialize::serialize(I);
+  if (Recorded)
+    Recorded->emplace_back(Key, Value);
+  reportResult(CDCtx, Reported, Key, Value);
   return true;
 }
 
@@ -18,9 +18,12 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_MAPPER_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_MAPPER_H
 
+#include "MapperCache.h"
 #include "Representation.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Tooling/Execution.h"
+#include "llvm/ADT/StringSet.h"
+#include <mutex>
 
 using namespace clang::comments;
 using namespace clang::tooling;
@@ -28,11 +31,33 @@ using namespace clang::tooling;
 namespace clang {
 namespace doc {
 
+// The results reported by the mappers of a process, shared by the mappers of
+// all TUs. The declarations of a header are mapped in each TU including it,
+// usually into identical results, which are only reported once.
+class ReportedResults {
+public:
+  // Records the result of Key and Value, and returns whether it wasn't
+  // reported yet.
+  bool insert(StringRef Key, StringRef Value);
+
+private:
+  std::mutex Mutex;
+  // The SHA1 digests of the reported keys and values.
+  llvm::StringSet<> Digests;
+};
+
+// Reports a result to the result store of CDCtx, or else to its execution
+// context, unless Reported holds an identical result.
+void reportResult(const ClangDocContext &CDCtx, ReportedResults *Reported,
+                  StringRef Key, StringRef Value);
+
 class MapASTVisitor : public clang::RecursiveASTVisitor<MapASTVisitor>,
                       public ASTConsumer {
 public:
-  explicit MapASTVisitor(ASTContext *Ctx, ClangDocContext CDCtx)
-      : CDCtx(CDCtx) {}
+  explicit MapASTVisitor(ASTContext *Ctx, ClangDocContext CDCtx,
+                         ReportedResults *Reported = nullptr,
+                         MapperResults *Recorded = nullptr)
+      : CDCtx(CDCtx), Reported(Reported), Recorded(Recorded) {}
 
   void HandleTranslationUnit(ASTContext &Context) override;
   bool VisitNamespaceDecl(const NamespaceDecl *D);
@@ -50,6 +75,10 @@ private:
                                     const ASTContext &Context) const;
 
   ClangDocContext CDCtx;
+  // The results already reported by the process, if they are deduplicated.
+  ReportedResults *Reported;
+  // If set, records all the results of the TU, e.g. to cache them.
+  MapperResults *Recorded;
 };
 
 } // namespace doc
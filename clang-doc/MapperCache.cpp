@@ -0,0 +1,167 @@
+//===-- MapperCache.cpp - ClangDoc Mapper Cache -----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MapperCache.h"
+#include "ResultStore.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+
+namespace clang {
+namespace doc {
+
+namespace {
+
+constexpr char GeneratedFile[] = "generated";
+
+// Writes Path through a temporary file, so that it is either complete or
+// unchanged.
+bool writeFileAtomically(StringRef Path,
+                         llvm::function_ref<void(llvm::raw_ostream &)> Write) {
+  int FD;
+  llvm::SmallString<128> TempPath;
+  if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%.tmp", FD, TempPath))
+    return false;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    Write(OS);
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath);
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(TempPath, Path)) {
+    llvm::sys::fs::remove(TempPath);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+std::string digest(StringRef Content) {
+  return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(Content)),
+                     /*LowerCase=*/true);
+}
+
+// The shards of a TU are named after its main file and the digest of its path,
+// like the shards of the clangd background index.
+std::string MapperCache::getShardPath(StringRef MainPath,
+                                      StringRef Extension) const {
+  llvm::SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, llvm::sys::path::filename(MainPath) + "." +
+                                    digest(MainPath).substr(0, 16) +
+                                    Extension);
+  return Path.str();
+}
+
+// The dependencies file of a TU holds the digest of its command, then the
+// digests and paths of the files it read:
+//
+//   command <digest>
+//   <digest> <path>
+//   ...
+llvm::Optional<MapperResults> MapperCache::lookup(StringRef MainPath,
+                                                  StringRef CommandDigest) {
+  auto Dependencies =
+      llvm::MemoryBuffer::getFile(getShardPath(MainPath, ".deps"));
+  if (!Dependencies)
+    return llvm::None;
+  SmallVector<StringRef, 64> Lines;
+  Dependencies.get()->getBuffer().split(Lines, '\n', /*MaxSplit=*/-1,
+                                        /*KeepEmpty=*/false);
+  if (Lines.empty() || Lines.front() != ("command " + CommandDigest).str())
+    return llvm::None;
+  for (StringRef Line : llvm::makeArrayRef(Lines).drop_front()) {
+    StringRef Digest, Path;
+    std::tie(Digest, Path) = Line.split(' ');
+    auto Content = llvm::MemoryBuffer::getFile(Path);
+    if (!Content || digest(Content.get()->getBuffer()) != Digest)
+      return llvm::None;
+  }
+
+  auto Buffer = llvm::MemoryBuffer::getFile(getShardPath(MainPath, ".results"));
+  if (!Buffer)
+    return llvm::None;
+  MapperResults Results;
+  if (auto Err = readResultRecords(Buffer.get()->getBuffer(),
+                                   [&](StringRef Key, StringRef Value) {
+                                     Results.emplace_back(Key, Value);
+                                   })) {
+    llvm::consumeError(std::move(Err));
+    return llvm::None;
+  }
+  return std::move(Results);
+}
+
+void MapperCache::store(StringRef MainPath, StringRef CommandDigest,
+                        SourceManager &SM, const MapperResults &Results) {
+  // The infos of the previous results may lose a contribution of the TU.
+  const std::string ResultsPath = getShardPath(MainPath, ".results");
+  if (auto Previous = llvm::MemoryBuffer::getFile(ResultsPath))
+    llvm::consumeError(readResultRecords(
+        Previous.get()->getBuffer(),
+        [&](StringRef Key, StringRef) { markChanged(Key); }));
+  for (const auto &Result : Results)
+    markChanged(Result.first);
+
+  FileManager &Files = SM.getFileManager();
+  std::string Dependencies = "command " + CommandDigest.str() + "\n";
+  for (auto I = SM.fileinfo_begin(), E = SM.fileinfo_end(); I != E; ++I) {
+    const llvm::MemoryBuffer *Content = SM.getMemoryBufferForFile(I->first);
+    if (!Content)
+      continue;
+    llvm::SmallString<128> Path(I->first->tryGetRealPathName());
+    if (Path.empty())
+      Path = I->first->getName();
+    Files.makeAbsolutePath(Path);
+    Dependencies +=
+        digest(Content->getBuffer()) + " " + Path.str().str() + "\n";
+  }
+
+  // The dependencies are written last, the results are up to date once they
+  // are.
+  const std::string DependenciesPath = getShardPath(MainPath, ".deps");
+  llvm::sys::fs::remove(DependenciesPath);
+  if (writeFileAtomically(ResultsPath, [&](llvm::raw_ostream &OS) {
+        for (const auto &Result : Results)
+          writeResultRecord(OS, Result.first, Result.second);
+      }))
+    writeFileAtomically(DependenciesPath,
+                        [&](llvm::raw_ostream &OS) { OS << Dependencies; });
+}
+
+void MapperCache::markChanged(StringRef Key) {
+  std::lock_guard<std::mutex> Lock(ChangedMutex);
+  Changed.insert(Key);
+}
+
+bool MapperCache::takeGenerated(StringRef Stamp) {
+  llvm::SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, GeneratedFile);
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    return false;
+  llvm::sys::fs::remove(Path);
+  return Buffer.get()->getBuffer() == Stamp;
+}
+
+void MapperCache::setGenerated(StringRef Stamp) {
+  llvm::SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, GeneratedFile);
+  writeFileAtomically(Path, [&](llvm::raw_ostream &OS) { OS << Stamp; });
+}
+
+} // namespace doc
+} // namespace clang
@@ -0,0 +1,77 @@
+//===-- MapperCache.h - ClangDoc Mapper Cache -------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a cache of the mapper results of each TU in a
+// directory, for the incremental regeneration of the docs. The results of a
+// TU are stored with the digest of its command and the digests of the files
+// it read, and are reused instead of mapping the TU again while none of them
+// changed. The keys of the results of the mapped TUs are recorded, so that
+// only their infos are reduced and generated again.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_MAPPERCACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_MAPPERCACHE_H
+
+#include "clang/Basic/LLVM.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringSet.h"
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace clang {
+namespace doc {
+
+// The results of the mapper for a TU, as keys and values.
+using MapperResults = std::vector<std::pair<std::string, std::string>>;
+
+class MapperCache {
+public:
+  MapperCache(StringRef Directory) : Directory(Directory) {}
+
+  // Returns the cached results of the TU of MainPath, if they were mapped with
+  // the same command digest and none of the files the TU read changed.
+  llvm::Optional<MapperResults> lookup(StringRef MainPath,
+                                       StringRef CommandDigest);
+
+  // Stores the results of the TU of MainPath, mapped with the files of SM.
+  // The keys of the results and of the previous results of the TU are
+  // recorded as changed.
+  void store(StringRef MainPath, StringRef CommandDigest,
+             SourceManager &SM, const MapperResults &Results);
+
+  // Returns whether the results of Key changed since the previous generation
+  // of the docs. This can be called concurrently once the mapping is done.
+  bool isChanged(StringRef Key) const { return Changed.count(Key); }
+
+  // Returns whether the docs of the previous run were generated with Stamp,
+  // e.g. the same format and output directory, and forgets it until
+  // setGenerated is called again.
+  bool takeGenerated(StringRef Stamp);
+  void setGenerated(StringRef Stamp);
+
+private:
+  std::string getShardPath(StringRef MainPath, StringRef Extension) const;
+  void markChanged(StringRef Key);
+
+  std::string Directory;
+  std::mutex ChangedMutex;
+  llvm::StringSet<> Changed;
+};
+
+// Returns the hexadecimal SHA1 digest of Content.
+std::string digest(StringRef Content);
+
+} // namespace doc
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_MAPPERCACHE_H
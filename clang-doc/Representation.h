@@ -280,9 +280,17 @@ struct EnumInfo : public SymbolInfo {
 llvm::Expected<std::unique_ptr<Info>>
 mergeInfos(std::vector<std::unique_ptr<Info>> &Values);
 
+class MapperCache;
+class ResultStoreWriter;
+
 struct ClangDocContext {
   tooling::ExecutionContext *ECtx;
   bool PublicOnly;
+  // If set, the results are stored on disk instead of being reported to ECtx.
+  ResultStoreWriter *Store;
+  // If set, the TUs whose files didn't change aren't mapped again, their
+  // cached results are reported instead.
+  MapperCache *Cache;
 };
 
 } // namespace doc
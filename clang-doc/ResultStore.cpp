@@ -0,0 +1,159 @@
+//===-- ResultStore.cpp - ClangDoc Result Store -----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ResultStore.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+namespace clang {
+namespace doc {
+
+namespace {
+
+constexpr char SegmentExtension[] = ".segment";
+
+unsigned getPartition(StringRef Key) {
+  if (Key.size() < 2)
+    return 0;
+  unsigned High = llvm::hexDigitValue(Key[0]);
+  unsigned Low = llvm::hexDigitValue(Key[1]);
+  if (High == -1U || Low == -1U)
+    return 0;
+  return (High << 4 | Low) % ResultPartitions;
+}
+
+void writeSize(llvm::raw_ostream &OS, uint32_t Size) {
+  char Bytes[4];
+  llvm::support::endian::write32le(Bytes, Size);
+  OS.write(Bytes, sizeof(Bytes));
+}
+
+// Returns the partition of a segment file, named "<partition>-<unique>".
+bool parseSegmentName(StringRef Path, unsigned &Partition) {
+  if (llvm::sys::path::extension(Path) != SegmentExtension)
+    return false;
+  StringRef Name = llvm::sys::path::stem(Path);
+  return !Name.split('-').first.getAsInteger(10, Partition) &&
+         Partition < ResultPartitions;
+}
+
+llvm::Error makeStringError(const llvm::Twine &Message) {
+  return llvm::make_error<llvm::StringError>(Message,
+                                             llvm::inconvertibleErrorCode());
+}
+
+} // namespace
+
+void writeResultRecord(llvm::raw_ostream &OS, StringRef Key, StringRef Value) {
+  writeSize(OS, Key.size());
+  writeSize(OS, Value.size());
+  OS << Key << Value;
+}
+
+llvm::Error
+readResultRecords(StringRef Data,
+                  llvm::function_ref<void(StringRef Key, StringRef Value)>
+                      Callback) {
+  while (!Data.empty()) {
+    if (Data.size() < 8)
+      return makeStringError("Truncated result record");
+    uint32_t KeySize = llvm::support::endian::read32le(Data.data());
+    uint32_t ValueSize = llvm::support::endian::read32le(Data.data() + 4);
+    Data = Data.drop_front(8);
+    if (Data.size() < uint64_t(KeySize) + ValueSize)
+      return makeStringError("Truncated result record");
+    Callback(Data.take_front(KeySize), Data.substr(KeySize, ValueSize));
+    Data = Data.drop_front(KeySize + ValueSize);
+  }
+  return llvm::Error::success();
+}
+
+void ResultStoreWriter::addResult(StringRef Key, StringRef Value) {
+  Segment &S = Segments[getPartition(Key)];
+  std::lock_guard<std::mutex> Lock(S.Mutex);
+  if (!S.OS) {
+    llvm::SmallString<128> Model(Directory);
+    llvm::sys::path::append(Model, llvm::Twine(getPartition(Key)) +
+                                       "-%%%%%%%%%%%%" + SegmentExtension);
+    int FD;
+    llvm::SmallString<128> Path;
+    if (std::error_code EC = llvm::sys::fs::createUniqueFile(Model, FD, Path)) {
+      std::lock_guard<std::mutex> Lock(ErrorMutex);
+      if (FirstError.empty())
+        FirstError = "Unable to create result segment " + Model.str().str() +
+                     ": " + EC.message();
+      return;
+    }
+    S.OS = llvm::make_unique<llvm::raw_fd_ostream>(FD, /*shouldClose=*/true);
+  }
+  writeResultRecord(*S.OS, Key, Value);
+}
+
+llvm::Error ResultStoreWriter::close() {
+  for (Segment &S : Segments) {
+    std::lock_guard<std::mutex> Lock(S.Mutex);
+    if (!S.OS)
+      continue;
+    S.OS->close();
+    if (S.OS->has_error() && FirstError.empty())
+      FirstError = "Unable to write a result segment in " + Directory;
+    S.OS->clear_error();
+    S.OS.reset();
+  }
+  if (!FirstError.empty())
+    return makeStringError(FirstError);
+  return llvm::Error::success();
+}
+
+llvm::Error readResultPartitions(
+    StringRef Directory,
+    llvm::function_ref<llvm::Error(llvm::StringMap<std::vector<StringRef>> &)>
+        Callback) {
+  std::vector<std::string> SegmentPaths[ResultPartitions];
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator It(Directory, EC), End;
+       !EC && It != End; It.increment(EC)) {
+    unsigned Partition;
+    if (parseSegmentName(It->path(), Partition))
+      SegmentPaths[Partition].push_back(It->path());
+  }
+  if (EC)
+    return makeStringError("Unable to read the result directory " + Directory +
+                           ": " + EC.message());
+
+  for (const auto &Paths : SegmentPaths) {
+    if (Paths.empty())
+      continue;
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> Buffers;
+    llvm::StringMap<std::vector<StringRef>> Groups;
+    for (const std::string &Path : Paths) {
+      auto Buffer = llvm::MemoryBuffer::getFile(Path);
+      if (!Buffer)
+        return makeStringError("Unable to read the result segment " + Path +
+                               ": " + Buffer.getError().message());
+      if (auto Err = readResultRecords(
+              Buffer.get()->getBuffer(), [&](StringRef Key, StringRef Value) {
+                Groups[Key].push_back(Value);
+              }))
+        return makeStringError("Unable to read the result segment " + Path +
+                               ": " + llvm::toString(std::move(Err)));
+      Buffers.push_back(std::move(Buffer.get()));
+    }
+    if (auto Err = Callback(Groups))
+      return Err;
+  }
+  return llvm::Error::success();
+}
+
+} // namespace doc
+} // namespace clang
@@ -0,0 +1,89 @@
+//===-- ResultStore.h - ClangDoc Result Store -------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a store of the mapper results on disk, in place of the
+// in-memory results of the executor. The results are appended to segment
+// files partitioned by their key, i.e. their hashed USR, so that the reducer
+// reads and reduces one partition at a time, and the mapping and reducing
+// phases can run in separate processes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_RESULTSTORE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_RESULTSTORE_H
+
+#include "clang/Basic/LLVM.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace doc {
+
+// The number of partitions of the results. The partition of a result is given
+// by the first byte of its key, so that the mapping processes agree on it.
+static const unsigned ResultPartitions = 256;
+
+// Appends the results of the mappers of a process to segment files of a
+// directory, one per partition, as sequences of result records. The segment
+// files of the processes are different, so that several mapping processes can
+// share a directory.
+class ResultStoreWriter {
+public:
+  ResultStoreWriter(StringRef Directory) : Directory(Directory) {}
+
+  // Appends the result of Key and Value to the segment of its partition. This
+  // can be called concurrently.
+  void addResult(StringRef Key, StringRef Value);
+
+  // Closes the segment files, and returns the first error of the writes.
+  llvm::Error close();
+
+private:
+  struct Segment {
+    std::mutex Mutex;
+    std::unique_ptr<llvm::raw_fd_ostream> OS;
+  };
+
+  std::string Directory;
+  Segment Segments[ResultPartitions];
+  std::mutex ErrorMutex;
+  std::string FirstError;
+};
+
+// Appends the record of a result to OS. A record is made of the sizes of the
+// key and of the value as 32-bit little-endian integers, then of the bytes of
+// the key and of the value.
+void writeResultRecord(llvm::raw_ostream &OS, StringRef Key, StringRef Value);
+
+// Calls Callback with the key and value of each record of Data. The keys and
+// values reference Data.
+llvm::Error
+readResultRecords(StringRef Data,
+                  llvm::function_ref<void(StringRef Key, StringRef Value)>
+                      Callback);
+
+// Reads the segment files of a directory one partition at a time, and calls
+// Callback with the results of the partition grouped by key. The values
+// reference the segment files, which are only kept in memory during the call.
+llvm::Error readResultPartitions(
+    StringRef Directory,
+    llvm::function_ref<llvm::Error(llvm::StringMap<std::vector<StringRef>> &)>
+        Callback);
+
+} // namespace doc
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_DOC_RESULTSTORE_H
@@ -21,8 +21,11 @@
 #include "BitcodeReader.h"
 #include "BitcodeWriter.h"
 #include "ClangDoc.h"
+#include "DocArchive.h"
 #include "Generators.h"
+#include "MapperCache.h"
 #include "Representation.h"
+#include "ResultStore.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/Decl.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
@@ -36,11 +39,16 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <thread>
 
 using namespace clang::ast_matchers;
 using namespace clang::tooling;
@@ -63,6 +71,43 @@ static llvm::cl::opt<bool> DoxygenOnly(
     llvm::cl::desc("Use only doxygen-style comments to generate docs."),
     llvm::cl::init(false), llvm::cl::cat(ClangDocCategory));
 
+static llvm::cl::opt<unsigned> ReduceThreads(
+    "reduce-threads",
+    llvm::cl::desc("Number of threads reducing the infos and generating the\n"
+                   "docs. 0 uses one thread per hardware thread."),
+    llvm::cl::init(0), llvm::cl::cat(ClangDocCategory));
+
+static llvm::cl::opt<std::string> IntermediateDirectory(
+    "intermediate-dir",
+    llvm::cl::desc("Directory storing the mapped infos on disk, partitioned\n"
+                   "by USR, instead of keeping them in memory."),
+    llvm::cl::init(""), llvm::cl::cat(ClangDocCategory));
+
+static llvm::cl::opt<bool> MapOnly(
+    "map-only",
+    llvm::cl::desc("Only map the decls into -intermediate-dir, e.g. to map\n"
+                   "the TUs in several processes sharing the directory."),
+    llvm::cl::init(false), llvm::cl::cat(ClangDocCategory));
+
+static llvm::cl::opt<bool> ReduceOnly(
+    "reduce-only",
+    llvm::cl::desc("Only reduce the infos stored in -intermediate-dir and\n"
+                   "generate their docs."),
+    llvm::cl::init(false), llvm::cl::cat(ClangDocCategory));
+
+static llvm::cl::opt<std::string> IncrementalDirectory(
+    "incremental-dir",
+    llvm::cl::desc("Directory caching the mapped infos of each TU. The TUs\n"
+                   "whose files didn't change aren't mapped again, and only\n"
+                   "the docs of the changed infos are generated again."),
+    llvm::cl::init(""), llvm::cl::cat(ClangDocCategory));
+
+static llvm::cl::opt<bool> Archive(
+    "archive",
+    llvm::cl::desc("Write the docs into a few segment files of the output\n"
+                   "directory with an index, instead of one file per info."),
+    llvm::cl::init(false), llvm::cl::cat(ClangDocCategory));
+
 enum OutputFormatTy {
   md,
   yaml,
@@ -140,33 +185,169 @@ getInfoOutputFile(StringRef Root,
   return Path;
 }
 
-// Iterate through tool results and build string map of info vectors from the
-// encoded bitstreams.
-bool bitcodeResultsToInfos(
-    tooling::ToolResults &Results,
-    llvm::StringMap<std::vector<std::unique_ptr<doc::Info>>> &Output) {
-  bool Err = false;
-  Results.forEachResult([&](StringRef Key, StringRef Value) {
-    llvm::BitstreamCursor Stream(Value);
+// The path of the documentation of an info relative to the output directory,
+// using '/' as separator whatever the platform, as stored in the archives.
+std::string
+getInfoArchivePath(llvm::SmallVectorImpl<doc::Reference> &Namespaces,
+                   StringRef Name, StringRef Ext) {
+  std::string Path;
+  for (auto R = Namespaces.rbegin(), E = Namespaces.rend(); R != E; ++R) {
+    Path.append(R->Name.begin(), R->Name.end());
+    Path += '/';
+  }
+  if (Name.empty())
+    Name = "GlobalNamespace";
+  Path.append(Name.begin(), Name.end());
+  Path.append(Ext.begin(), Ext.end());
+  return Path;
+}
+
+// Group the encoded bitstreams of the tool results by key, i.e. by hashed USR.
+// The bitstreams are only decoded when their group is reduced, so that only
+// the infos of the groups being reduced are in memory.
+llvm::StringMap<std::vector<StringRef>>
+groupBitcodeResults(tooling::ToolResults &Results) {
+  llvm::StringMap<std::vector<StringRef>> Groups;
+  for (const auto &KV : Results.AllKVResults())
+    Groups[KV.first].push_back(KV.second);
+  return Groups;
+}
+
+// Decode the encoded bitstreams of a group and reduce their infos into one.
+llvm::Expected<std::unique_ptr<doc::Info>>
+reduceBitcodeGroup(llvm::ArrayRef<StringRef> Bitcodes) {
+  std::vector<std::unique_ptr<doc::Info>> Infos;
+  Infos.reserve(Bitcodes.size());
+  for (StringRef Bitcode : Bitcodes) {
+    llvm::BitstreamCursor Stream(Bitcode);
     doc::ClangDocBitcodeReader Reader(Stream);
-    auto Infos = Reader.readBitcode();
-    if (!Infos) {
-      llvm::errs() << toString(Infos.takeError()) << "\n";
-      Err = true;
-      return;
+    auto Decoded = Reader.readBitcode();
+    if (!Decoded)
+      return Decoded.takeError();
+    for (auto &I : Decoded.get())
+      Infos.emplace_back(std::move(I));
+  }
+  return doc::mergeInfos(Infos);
+}
+
+// Generate the documentation of an info in its output file, unless the file
+// already holds it, or in the archive if any. The documentation is written to
+// a temporary file renamed over the output file, so that the infos sharing an
+// output file, e.g. the specializations of a class template, don't interleave
+// their writes when generated concurrently.
+llvm::Error generateInfoFile(doc::Generator &G, doc::Info *I, StringRef Format,
+                             doc::DocArchiveWriter *Archive) {
+  std::string Doc;
+  llvm::raw_string_ostream DocOS(Doc);
+  if (auto Err = G.generateDocForInfo(I, DocOS))
+    return Err;
+  DocOS.flush();
+  if (Archive) {
+    Archive->addDoc(getInfoArchivePath(I->Namespace, I->Name, "." + Format),
+                    Doc);
+    return llvm::Error::success();
+  }
+
+  auto InfoPath =
+      getInfoOutputFile(OutDirectory, I->Namespace, I->Name, "." + Format);
+  if (!InfoPath)
+    return InfoPath.takeError();
+  // Rewriting an unchanged file would update its modification time, e.g. for
+  // the tools publishing the docs.
+  auto Existing = llvm::MemoryBuffer::getFile(InfoPath.get());
+  if (Existing && Existing.get()->getBuffer() == Doc)
+    return llvm::Error::success();
+
+  int FD;
+  llvm::SmallString<128> TempPath;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          Twine(InfoPath.get()) + "-%%%%%%%%.tmp", FD, TempPath))
+    return llvm::make_error<llvm::StringError>(
+        "Error opening info file: " + EC.message(), EC);
+  {
+    llvm::raw_fd_ostream InfoOS(FD, /*shouldClose=*/true);
+    InfoOS << Doc;
+    InfoOS.close();
+    if (InfoOS.has_error()) {
+      InfoOS.clear_error();
+      llvm::sys::fs::remove(TempPath);
+      return llvm::make_error<llvm::StringError>(
+          (Twine("Error writing info file ") + TempPath).str(),
+          llvm::inconvertibleErrorCode());
     }
-    for (auto &I : Infos.get()) {
-      auto R =
-          Output.try_emplace(Key, std::vector<std::unique_ptr<doc::Info>>());
-      R.first->second.emplace_back(std::move(I));
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TempPath, InfoPath.get())) {
+    llvm::sys::fs::remove(TempPath);
+    return llvm::make_error<llvm::StringError>(
+        "Error renaming info file: " + EC.message(), EC);
+  }
+  return llvm::Error::success();
+}
+
+// Reduce the groups of encoded bitstreams into one info per USR, and generate
+// their docs. The groups are distributed across the threads, each one
+// decoding, reducing and generating the docs of a group before taking the next
+// one. If Unchanged is set, the groups of the USRs it didn't record as changed
+// are skipped, their docs are up to date. If Archive is set, the docs are
+// written to it. Returns true if a group couldn't be decoded.
+bool reduceGroups(llvm::StringMap<std::vector<StringRef>> &USRToBitcode,
+                  doc::Generator &G, StringRef Format,
+                  const doc::MapperCache *Unchanged,
+                  doc::DocArchiveWriter *Archive) {
+  std::vector<llvm::StringMapEntry<std::vector<StringRef>> *> Groups;
+  Groups.reserve(USRToBitcode.size());
+  for (auto &Group : USRToBitcode)
+    if (!Unchanged || Unchanged->isChanged(Group.getKey()))
+      Groups.push_back(&Group);
+
+  std::atomic<size_t> NextGroup(0);
+  std::atomic<bool> DecodeFailed(false);
+  std::mutex DiagMutex;
+  auto ReduceGroups = [&]() {
+    for (size_t Index = NextGroup++; Index < Groups.size();
+         Index = NextGroup++) {
+      auto Reduced = reduceBitcodeGroup(Groups[Index]->getValue());
+      if (!Reduced) {
+        std::lock_guard<std::mutex> Lock(DiagMutex);
+        llvm::errs() << toString(Reduced.takeError()) << "\n";
+        DecodeFailed = true;
+        continue;
+      }
+      if (auto Err =
+              generateInfoFile(G, Reduced.get().get(), Format, Archive)) {
+        std::lock_guard<std::mutex> Lock(DiagMutex);
+        llvm::errs() << toString(std::move(Err)) << "\n";
+      }
     }
-  });
-  return Err;
+  };
+
+  unsigned Threads = ReduceThreads;
+  if (Threads == 0)
+    Threads = std::max(1u, std::thread::hardware_concurrency());
+  Threads = std::min<size_t>(Threads, std::max<size_t>(1, Groups.size()));
+  if (Threads == 1) {
+    ReduceGroups();
+  } else {
+    llvm::ThreadPool Pool(Threads);
+    for (unsigned I = 0; I < Threads; ++I)
+      Pool.async(ReduceGroups);
+    Pool.wait();
+  }
+
+  return DecodeFailed;
+}
+
+// Write the index of the archive. Returns true on error.
+bool closeArchive(doc::DocArchiveWriter &DocArchive) {
+  if (auto Err = DocArchive.close()) {
+    llvm::errs() << toString(std::move(Err)) << "\n";
+    return true;
+  }
+  return false;
 }
 
 int main(int argc, const char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-  std::error_code OK;
 
   ExecutorName.setInitialValue("all-TUs");
   auto Exec = clang::tooling::createExecutorFromCommandLineArgs(
@@ -193,52 +374,113 @@ int main(int argc, const char **argv) {
                                   tooling::ArgumentInsertPosition::END),
         ArgAdjuster);
 
-  // Mapping phase
-  llvm::outs() << "Mapping decls...\n";
-  clang::doc::ClangDocContext CDCtx = {Exec->get()->getExecutionContext(),
-                                       PublicOnly};
-  auto Err =
-      Exec->get()->execute(doc::newMapperActionFactory(CDCtx), ArgAdjuster);
-  if (Err) {
-    llvm::errs() << toString(std::move(Err)) << "\n";
+  std::unique_ptr<doc::ResultStoreWriter> Store;
+  if (!IntermediateDirectory.empty()) {
+    // A complete run starts from an empty directory, the separate mapping
+    // processes share it.
+    if (CreateDirectory(IntermediateDirectory,
+                        /*ClearDirectory=*/!MapOnly && !ReduceOnly))
+      return 1;
+    Store = llvm::make_unique<doc::ResultStoreWriter>(IntermediateDirectory);
+  } else if (MapOnly || ReduceOnly) {
+    llvm::errs() << "-map-only and -reduce-only require -intermediate-dir.\n";
     return 1;
   }
 
-  // Collect values into output by key.
-  // In ToolResults, the Key is the hashed USR and the value is the
-  // bitcode-encoded representation of the Info object.
-  llvm::outs() << "Collecting infos...\n";
-  llvm::StringMap<std::vector<std::unique_ptr<doc::Info>>> USRToInfos;
-  if (bitcodeResultsToInfos(*Exec->get()->getToolResults(), USRToInfos))
-    return 1;
-
-  // First reducing phase (reduce all decls into one info per decl).
-  llvm::outs() << "Reducing " << USRToInfos.size() << " infos...\n";
-  for (auto &Group : USRToInfos) {
-    auto Reduced = doc::mergeInfos(Group.getValue());
-    if (!Reduced) {
-      llvm::errs() << llvm::toString(Reduced.takeError());
-      continue;
+  // The archive is rewritten as a whole, so the docs of all the infos are
+  // generated.
+  std::unique_ptr<doc::DocArchiveWriter> DocArchive;
+  if (Archive) {
+    if (!IncrementalDirectory.empty() || MapOnly) {
+      llvm::errs() << "-archive can't be used with -incremental-dir and "
+                      "-map-only.\n";
+      return 1;
     }
+    if (CreateDirectory(OutDirectory))
+      return 1;
+    DocArchive = llvm::make_unique<doc::DocArchiveWriter>(OutDirectory);
+  }
 
-    doc::Info *I = Reduced.get().get();
+  std::unique_ptr<doc::MapperCache> Cache;
+  // Set if the docs of the previous run are up to date for the infos whose
+  // results didn't change.
+  const doc::MapperCache *Unchanged = nullptr;
+  std::string Stamp;
+  if (!IncrementalDirectory.empty()) {
+    if (MapOnly || ReduceOnly) {
+      llvm::errs() << "-incremental-dir can't be used with -map-only and "
+                      "-reduce-only.\n";
+      return 1;
+    }
+    if (CreateDirectory(IncrementalDirectory))
+      return 1;
+    Cache = llvm::make_unique<doc::MapperCache>(IncrementalDirectory);
+    llvm::SmallString<128> OutputPath(OutDirectory);
+    llvm::sys::fs::make_absolute(OutputPath);
+    Stamp = Format + " " + OutputPath.str().str();
+    if (Cache->takeGenerated(Stamp) && llvm::sys::fs::is_directory(OutputPath))
+      Unchanged = Cache.get();
+  }
 
-    auto InfoPath =
-        getInfoOutputFile(OutDirectory, I->Namespace, I->Name, "." + Format);
-    if (!InfoPath) {
-      llvm::errs() << toString(InfoPath.takeError()) << "\n";
-      continue;
+  // Mapping phase
+  if (!ReduceOnly) {
+    llvm::outs() << "Mapping decls...\n";
+    clang::doc::ClangDocContext CDCtx = {Exec->get()->getExecutionContext(),
+                                         PublicOnly, Store.get(), Cache.get()};
+    auto Err =
+        Exec->get()->execute(doc::newMapperActionFactory(CDCtx), ArgAdjuster);
+    if (Err) {
+      llvm::errs() << toString(std::move(Err)) << "\n";
+      return 1;
     }
-    std::error_code FileErr;
-    llvm::raw_fd_ostream InfoOS(InfoPath.get(), FileErr, llvm::sys::fs::F_None);
-    if (FileErr != OK) {
-      llvm::errs() << "Error opening info file: " << FileErr.message() << "\n";
-      continue;
+    if (Store) {
+      if (auto Err = Store->close()) {
+        llvm::errs() << toString(std::move(Err)) << "\n";
+        return 1;
+      }
     }
+  }
+  if (MapOnly)
+    return 0;
 
-    if (auto Err = G->get()->generateDocForInfo(I, InfoOS))
+  // First reducing phase (reduce all decls into one info per decl).
+  if (Store) {
+    // The stored results are read and reduced one partition at a time.
+    llvm::outs() << "Reducing infos of " << IntermediateDirectory << "...\n";
+    bool DecodeFailed = false;
+    auto Err = doc::readResultPartitions(
+        IntermediateDirectory,
+        [&](llvm::StringMap<std::vector<StringRef>> &USRToBitcode) {
+          if (reduceGroups(USRToBitcode, *G->get(), Format, Unchanged,
+                           DocArchive.get()))
+            DecodeFailed = true;
+          return llvm::Error::success();
+        });
+    if (Err) {
       llvm::errs() << toString(std::move(Err)) << "\n";
+      return 1;
+    }
+    if (DecodeFailed)
+      return 1;
+    if (DocArchive && closeArchive(*DocArchive))
+      return 1;
+    if (Cache)
+      Cache->setGenerated(Stamp);
+    return 0;
   }
 
+  // Collect values into output by key.
+  // In ToolResults, the Key is the hashed USR and the value is the
+  // bitcode-encoded representation of the Info object.
+  llvm::outs() << "Collecting infos...\n";
+  auto USRToBitcode = groupBitcodeResults(*Exec->get()->getToolResults());
+  llvm::outs() << "Reducing " << USRToBitcode.size() << " infos...\n";
+  if (reduceGroups(USRToBitcode, *G->get(), Format, Unchanged,
+                   DocArchive.get()))
+    return 1;
+  if (DocArchive && closeArchive(*DocArchive))
+    return 1;
+  if (Cache)
+    Cache->setGenerated(Stamp);
   return 0;
 }
@@ -478,17 +478,35 @@ getUsedDecls(const HelperDeclRefGraph *RG,
 
 } // namespace
 
+ClangMoveAction::ClangMoveAction(ArrayRef<ClangMoveContext *> Contexts,
+                                 DeclarationReporter *const Reporter) {
+  // A single tool records the references to the helpers on its own.
+  bool ShareRGBuilder = Contexts.size() > 1;
+  for (ClangMoveContext *Context : Contexts) {
+    MoveTools.push_back(llvm::make_unique<ClangMoveTool>(
+        Context, Reporter, ShareRGBuilder ? &SharedRGBuilder : nullptr));
+    MoveTools.back()->registerMatchers(&MatchFinder);
+  }
+  if (ShareRGBuilder && !Contexts.front()->DumpDeclarations)
+    ClangMoveTool::registerHelperRefMatchers(&MatchFinder, *Contexts.front(),
+                                             &SharedRGBuilder);
+}
+
 std::unique_ptr<ASTConsumer>
 ClangMoveAction::CreateASTConsumer(CompilerInstance &Compiler,
                                    StringRef /*InFile*/) {
-  Compiler.getPreprocessor().addPPCallbacks(llvm::make_unique<FindAllIncludes>(
-      &Compiler.getSourceManager(), &MoveTool));
+  for (auto &MoveTool : MoveTools)
+    Compiler.getPreprocessor().addPPCallbacks(
+        llvm::make_unique<FindAllIncludes>(&Compiler.getSourceManager(),
+                                           MoveTool.get()));
   return MatchFinder.newASTConsumer();
 }
 
 ClangMoveTool::ClangMoveTool(ClangMoveContext *const Context,
-                             DeclarationReporter *const Reporter)
-    : Context(Context), Reporter(Reporter) {
+                             DeclarationReporter *const Reporter,
+                             HelperDeclRGBuilder *SharedRGBuilder)
+    : Context(Context), Reporter(Reporter),
+      RGBuilder(SharedRGBuilder ? SharedRGBuilder : &OwnRGBuilder) {
   if (!Context->Spec.NewHeader.empty())
     CCIncludes.push_back("#include \"" + Context->Spec.NewHeader + "\"\n");
 }
@@ -577,8 +595,7 @@ void ClangMoveTool::registerMatchers(ast_matchers::MatchFinder *Finder) {
   auto NotInMovedClass= allOf(unless(InMovedClass), InOldCC);
   auto IsOldCCHelper =
       allOf(NotInMovedClass, anyOf(isStaticStorageClass(), InAnonymousNS));
-  // Match helper classes separately with helper functions/variables since we
-  // want to reuse these matchers in finding helpers usage below.
+  // Match helper classes separately with helper functions/variables.
   //
   // There could be forward declarations usage for helpers, especially for
   // classes and functions. We need include these forward declarations.
@@ -595,21 +612,11 @@ void ClangMoveTool::registerMatchers(ast_matchers::MatchFinder *Finder) {
       namedDecl(anyOf(HelperFuncOrVar, HelperClasses)).bind("helper_decls"),
       this);
 
-  // Construct an AST-based call graph of helper declarations in old.cc.
-  // In the following matcheres, "dc" is a caller while "helper_decls" and
-  // "used_class" is a callee, so a new edge starting from caller to callee will
-  // be add in the graph.
-  //
-  // Find helper function/variable usages.
-  Finder->addMatcher(
-      declRefExpr(to(HelperFuncOrVar), hasAncestor(decl().bind("dc")))
-          .bind("func_ref"),
-      &RGBuilder);
-  // Find helper class usages.
-  Finder->addMatcher(
-      typeLoc(loc(recordType(hasDeclaration(HelperClasses.bind("used_class")))),
-              hasAncestor(decl().bind("dc"))),
-      &RGBuilder);
+  // The declarations in the moved classes are left out of the reference graph
+  // of the helpers when it's built.
+  InMovedClassMatcher = InMovedClass;
+  if (RGBuilder == &OwnRGBuilder)
+    registerHelperRefMatchers(Finder, *Context, RGBuilder);
 
   //============================================================================
   // Matchers for old files, including old.h/old.cc
@@ -662,6 +669,39 @@ void ClangMoveTool::registerMatchers(ast_matchers::MatchFinder *Finder) {
                      MatchCallbacks.back().get());
 }
 
+void ClangMoveTool::registerHelperRefMatchers(MatchFinder *Finder,
+                                              const ClangMoveContext &Context,
+                                              HelperDeclRGBuilder *RGBuilder) {
+  auto InOldCC = isExpansionInFile(
+      MakeAbsolutePath(Context.OriginalRunningDirectory, Context.Spec.OldCC));
+  auto InAnonymousNS = hasParent(namespaceDecl(isAnonymous()));
+  // Unlike the helpers of a tool, these include the declarations in the moved
+  // classes, which don't depend on the moved declarations. Helper classes are
+  // in anonymous namespaces, so never in a moved class.
+  auto IsOldCCHelper =
+      allOf(InOldCC, anyOf(isStaticStorageClass(), InAnonymousNS));
+  auto HelperFuncOrVar =
+      namedDecl(notInMacro(), anyOf(functionDecl(IsOldCCHelper),
+                                    varDecl(isDefinition(), IsOldCCHelper)));
+  auto HelperClasses = cxxRecordDecl(notInMacro(), InOldCC, InAnonymousNS);
+
+  // Construct an AST-based call graph of helper declarations in old.cc.
+  // In the following matcheres, "dc" is a caller while "helper_decls" and
+  // "used_class" is a callee, so a new edge starting from caller to callee will
+  // be add in the graph.
+  //
+  // Find helper function/variable usages.
+  Finder->addMatcher(
+      declRefExpr(to(HelperFuncOrVar), hasAncestor(decl().bind("dc")))
+          .bind("func_ref"),
+      RGBuilder);
+  // Find helper class usages.
+  Finder->addMatcher(
+      typeLoc(loc(recordType(hasDeclaration(HelperClasses.bind("used_class")))),
+              hasAncestor(decl().bind("dc"))),
+      RGBuilder);
+}
+
 void ClangMoveTool::run(const ast_matchers::MatchFinder::MatchResult &Result) {
   if (const auto *D = Result.Nodes.getNodeAs<NamedDecl>("decls_in_header")) {
     UnremovedDeclsInOldHeader.insert(D);
@@ -733,7 +773,7 @@ void ClangMoveTool::removeDeclsInOldFiles() {
     for (const auto *D : UnremovedDeclsInOldHeader)
       UnremovedDecls.push_back(D);
 
-    auto UsedDecls = getUsedDecls(RGBuilder.getGraph(), UnremovedDecls);
+    auto UsedDecls = getUsedDecls(RG.get(), UnremovedDecls);
 
     // We remove the helper declarations which are not used in the old.cc after
     // moving the given declarations.
@@ -811,7 +851,7 @@ void ClangMoveTool::moveDeclsToNewFiles() {
       NewCCDecls.push_back(MovedDecl);
   }
 
-  auto UsedDecls = getUsedDecls(RGBuilder.getGraph(), RemovedDecls);
+  auto UsedDecls = getUsedDecls(RG.get(), RemovedDecls);
   std::vector<const NamedDecl *> ActualNewCCDecls;
 
   // Filter out all unused helpers in NewCCDecls.
@@ -932,7 +972,12 @@ void ClangMoveTool::onEndOfTranslationUnit() {
     moveAll(SM, Context->Spec.OldCC, Context->Spec.NewCC);
     return;
   }
-  LLVM_DEBUG(RGBuilder.getGraph()->dump());
+  RG = RGBuilder->buildGraph([this](const Decl *Callee) {
+    return InMovedClassMatcher &&
+           !match(*InMovedClassMatcher, *Callee, Callee->getASTContext())
+                .empty();
+  });
+  LLVM_DEBUG(RG->dump());
   moveDeclsToNewFiles();
   removeDeclsInOldFiles();
 }
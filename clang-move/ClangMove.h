@@ -15,6 +15,8 @@
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
@@ -116,11 +118,21 @@ struct ClangMoveContext {
 // files to new files when all symbols produced from dump_decls are moved.
 class ClangMoveTool : public ast_matchers::MatchFinder::MatchCallback {
 public:
+  /// \param SharedRGBuilder If not null, the builder recording the references
+  /// to the helpers in old.cc for several tools, whose matchers are registered
+  /// by the caller. Otherwise the tool has its own.
   ClangMoveTool(ClangMoveContext *const Context,
-                DeclarationReporter *const Reporter);
+                DeclarationReporter *const Reporter,
+                HelperDeclRGBuilder *SharedRGBuilder = nullptr);
 
   void registerMatchers(ast_matchers::MatchFinder *Finder);
 
+  /// Register the matchers finding the references to the helpers in the old.cc
+  /// of \p Context, recorded by \p RGBuilder.
+  static void registerHelperRefMatchers(ast_matchers::MatchFinder *Finder,
+                                        const ClangMoveContext &Context,
+                                        HelperDeclRGBuilder *RGBuilder);
+
   void run(const ast_matchers::MatchFinder::MatchResult &Result) override;
 
   void onEndOfTranslationUnit() override;
@@ -196,17 +208,24 @@ private:
   ClangMoveContext *const Context;
   /// A reporter to report all declarations from old header. It is not owned.
   DeclarationReporter *const Reporter;
-  /// Builder for helper declarations reference graph.
-  HelperDeclRGBuilder RGBuilder;
+  /// Builder for helper declarations reference graph, either OwnRGBuilder or
+  /// one shared with other tools.
+  HelperDeclRGBuilder OwnRGBuilder;
+  HelperDeclRGBuilder *RGBuilder;
+  /// Matches the declarations in the classes being moved, which aren't
+  /// helpers.
+  llvm::Optional<ast_matchers::internal::Matcher<Decl>> InMovedClassMatcher;
+  /// The reference graph of the helpers, built at the end of the translation
+  /// unit.
+  std::unique_ptr<HelperDeclRefGraph> RG;
 };
 
+// Moves the declarations of each context out of the same old.h/cc, against a
+// single parse of the translation unit.
 class ClangMoveAction : public clang::ASTFrontendAction {
 public:
-  ClangMoveAction(ClangMoveContext *const Context,
-                  DeclarationReporter *const Reporter)
-      : MoveTool(Context, Reporter) {
-    MoveTool.registerMatchers(&MatchFinder);
-  }
+  ClangMoveAction(llvm::ArrayRef<ClangMoveContext *> Contexts,
+                  DeclarationReporter *const Reporter);
 
   ~ClangMoveAction() override = default;
 
@@ -216,22 +235,24 @@ public:
 
 private:
   ast_matchers::MatchFinder MatchFinder;
-  ClangMoveTool MoveTool;
+  /// Records the references to the helpers once for all the tools.
+  HelperDeclRGBuilder SharedRGBuilder;
+  std::vector<std::unique_ptr<ClangMoveTool>> MoveTools;
 };
 
 class ClangMoveActionFactory : public tooling::FrontendActionFactory {
 public:
-  ClangMoveActionFactory(ClangMoveContext *const Context,
+  ClangMoveActionFactory(llvm::ArrayRef<ClangMoveContext *> Contexts,
                          DeclarationReporter *const Reporter = nullptr)
-      : Context(Context), Reporter(Reporter) {}
+      : Contexts(Contexts.begin(), Contexts.end()), Reporter(Reporter) {}
 
   clang::FrontendAction *create() override {
-    return new ClangMoveAction(Context, Reporter);
+    return new ClangMoveAction(Contexts, Reporter);
   }
 
 private:
   // Not owned.
-  ClangMoveContext *const Context;
+  std::vector<ClangMoveContext *> Contexts;
   DeclarationReporter *const Reporter;
 };
 
@@ -119,9 +119,10 @@ void HelperDeclRGBuilder::run(
     LLVM_DEBUG(llvm::dbgs() << "Find helper function usage: "
                             << FuncRef->getDecl()->getNameAsString() << " ("
                             << FuncRef->getDecl() << ")\n");
-    RG->addEdge(
-        getOutmostClassOrFunDecl(DC->getCanonicalDecl()),
-        getOutmostClassOrFunDecl(FuncRef->getDecl()->getCanonicalDecl()));
+    Refs.push_back(
+        {getOutmostClassOrFunDecl(DC->getCanonicalDecl()),
+         getOutmostClassOrFunDecl(FuncRef->getDecl()->getCanonicalDecl()),
+         FuncRef->getDecl()});
   } else if (const auto *UsedClass =
                  Result.Nodes.getNodeAs<CXXRecordDecl>("used_class")) {
     const auto *DC = Result.Nodes.getNodeAs<Decl>("dc");
@@ -129,9 +130,19 @@ void HelperDeclRGBuilder::run(
     LLVM_DEBUG(llvm::dbgs()
                << "Find helper class usage: " << UsedClass->getNameAsString()
                << " (" << UsedClass << ")\n");
-    RG->addEdge(getOutmostClassOrFunDecl(DC->getCanonicalDecl()), UsedClass);
+    Refs.push_back({getOutmostClassOrFunDecl(DC->getCanonicalDecl()),
+                    UsedClass, UsedClass});
   }
 }
 
+std::unique_ptr<HelperDeclRefGraph> HelperDeclRGBuilder::buildGraph(
+    llvm::function_ref<bool(const Decl *)> IsExcludedCallee) const {
+  auto RG = llvm::make_unique<HelperDeclRefGraph>();
+  for (const HelperDeclRef &Ref : Refs)
+    if (!IsExcludedCallee(Ref.Referenced))
+      RG->addEdge(Ref.Caller, Ref.Callee);
+  return RG;
+}
+
 } // namespace move
 } // namespace clang
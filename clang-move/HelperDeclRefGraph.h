@@ -13,6 +13,7 @@
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Analysis/CallGraph.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
 #include <memory>
 #include <vector>
 
@@ -77,11 +78,19 @@ private:
 };
 
 // A builder helps to construct a call graph of helper declarations.
+//
+// The builder only records the references to helper declarations found by the
+// matchers, the graph is built afterwards. This lets the moves out of the same
+// old.cc share the references found in a single parse, each move building its
+// own graph without the callees it doesn't consider as helpers.
 class HelperDeclRGBuilder : public ast_matchers::MatchFinder::MatchCallback {
 public:
-  HelperDeclRGBuilder() : RG(new HelperDeclRefGraph) {}
   void run(const ast_matchers::MatchFinder::MatchResult &Result) override;
-  const HelperDeclRefGraph *getGraph() const { return RG.get(); }
+
+  // Build the graph of the references found, leaving out the references to the
+  // declarations for which IsExcludedCallee returns true.
+  std::unique_ptr<HelperDeclRefGraph> buildGraph(
+      llvm::function_ref<bool(const Decl *)> IsExcludedCallee) const;
 
   // Find out the outmost enclosing class/function declaration of a given D.
   // For a CXXMethodDecl, get its CXXRecordDecl; For a VarDecl/FunctionDecl, get
@@ -90,7 +99,15 @@ public:
   static const Decl *getOutmostClassOrFunDecl(const Decl *D);
 
 private:
-  std::unique_ptr<HelperDeclRefGraph> RG;
+  // A reference to the Referenced declaration, which is an edge from the
+  // Caller node to the Callee node in the graph.
+  struct HelperDeclRef {
+    const Decl *Caller;
+    const Decl *Callee;
+    const Decl *Referenced;
+  };
+
+  std::vector<HelperDeclRef> Refs;
 };
 
 } // namespace move
@@ -8,24 +8,54 @@
 //===----------------------------------------------------------------------===//
 
 #include "ClangMove.h"
+#include "index/ReferencingFiles.h"
+#include "index/Serialization.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/ArgumentsAdjusters.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/Execution.h"
 #include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <mutex>
 #include <set>
 #include <string>
+#include <tuple>
 
 using namespace clang;
 using namespace llvm;
 
+namespace {
+// A move of the -moves_file option.
+struct MoveSet {
+  std::vector<std::string> Names;
+  std::string NewHeader;
+  std::string NewCC;
+};
+} // namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(MoveSet)
+
+namespace llvm {
+namespace yaml {
+template <> struct MappingTraits<MoveSet> {
+  static void mapping(IO &IO, MoveSet &Set) {
+    IO.mapRequired("Names", Set.Names);
+    IO.mapOptional("NewHeader", Set.NewHeader);
+    IO.mapOptional("NewCC", Set.NewCC);
+  }
+};
+} // namespace yaml
+} // namespace llvm
+
 namespace {
 
 std::error_code CreateNewFile(const llvm::Twine &path) {
@@ -92,11 +122,143 @@ cl::opt<bool> DumpDecls(
              "An empty JSON will be returned if old header isn't specified."),
     cl::cat(ClangMoveCategory));
 
+cl::opt<std::string> MovesFile(
+    "moves_file",
+    cl::desc("A YAML file listing several moves out of the old header and cc, "
+             "each with the Names, NewHeader and NewCC keys of the -names, "
+             "-new_header and -new_cc options. The moves are run against a "
+             "single parse of each source file."),
+    cl::cat(ClangMoveCategory));
+
+cl::opt<std::string> IndexFile(
+    "index",
+    cl::desc("A clangd static index of the project, e.g. written by "
+             "clangd-indexer. Only the translation units referencing the "
+             "moved declarations in the index are parsed. Ignored with "
+             "-dump_decls."),
+    cl::cat(ClangMoveCategory));
+
+// Reports each replacement to the execution context, keyed by its file.
+void reportReplacements(
+    const std::map<std::string, tooling::Replacements> &FileToReplacements,
+    tooling::ExecutionContext &Context) {
+  for (const auto &FileAndReplacements : FileToReplacements) {
+    for (tooling::Replacement R : FileAndReplacements.second) {
+      std::string Value;
+      llvm::raw_string_ostream OS(Value);
+      llvm::yaml::Output YAML(OS);
+      YAML << R;
+      Context.reportResult(FileAndReplacements.first, OS.str());
+    }
+  }
+}
+
+// Collects the replacements reported by the translation units. A header gets
+// the same replacements from each translation unit including it, they're only
+// added once.
+llvm::Expected<std::map<std::string, tooling::Replacements>>
+collectReplacements(tooling::ToolResults &Results) {
+  std::map<std::string, std::set<std::string>> FileToValues;
+  Results.forEachResult([&](llvm::StringRef Key, llvm::StringRef Value) {
+    FileToValues[Key].insert(Value);
+  });
+  std::map<std::string, tooling::Replacements> FileToReplacements;
+  for (const auto &FileAndValues : FileToValues) {
+    tooling::Replacements &Replaces = FileToReplacements[FileAndValues.first];
+    for (const std::string &Value : FileAndValues.second) {
+      tooling::Replacement R;
+      llvm::yaml::Input YAML(Value);
+      YAML >> R;
+      if (YAML.error())
+        return llvm::make_error<llvm::StringError>(
+            "Invalid replacement for " + FileAndValues.first,
+            llvm::inconvertibleErrorCode());
+      if (auto Err = Replaces.add(R))
+        return std::move(Err);
+    }
+  }
+  return FileToReplacements;
+}
+
+// Moves the declarations in each translation unit of the executor with its
+// own context, and reports the replacements to the execution context. The
+// executor may run several translation units at once, the declarations they
+// find in the old header are merged in the shared reporter. The translation
+// units which don't reference the moved declarations according to the index,
+// if any, are skipped without being parsed.
+class ClangMoveExecutorActionFactory : public tooling::FrontendActionFactory {
+public:
+  ClangMoveExecutorActionFactory(const move::ClangMoveContext &Context,
+                                 ArrayRef<move::MoveDefinitionSpec> Specs,
+                                 const clangd::ReferencingFiles *Selection,
+                                 move::DeclarationReporter &Reporter,
+                                 tooling::ExecutionContext &Results)
+      : Context(Context), Specs(Specs), Selection(Selection),
+        Reporter(Reporter), Results(Results) {}
+
+  FrontendAction *create() override {
+    llvm_unreachable("the actions are created by runInvocation");
+  }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    const auto &Inputs = Invocation->getFrontendOpts().Inputs;
+    if (Selection && !Inputs.empty() &&
+        !Selection->mayReference(Inputs.front().getFile()))
+      return true;
+    // Each move has its own replacements, they're merged when collected.
+    std::vector<std::map<std::string, tooling::Replacements>>
+        FileToReplacements(Specs.size());
+    std::vector<move::ClangMoveContext> TUContexts;
+    for (size_t I = 0, E = Specs.size(); I != E; ++I)
+      TUContexts.push_back({Specs[I], FileToReplacements[I],
+                            Context.OriginalRunningDirectory,
+                            Context.FallbackStyle, Context.DumpDeclarations});
+    std::vector<move::ClangMoveContext *> TUContextPtrs;
+    for (move::ClangMoveContext &TUContext : TUContexts)
+      TUContextPtrs.push_back(&TUContext);
+    move::DeclarationReporter TUReporter;
+    move::ClangMoveActionFactory Factory(TUContextPtrs, &TUReporter);
+    bool Success = Factory.runInvocation(Invocation, Files, PCHContainerOps,
+                                         DiagConsumer);
+    {
+      std::lock_guard<std::mutex> Lock(ReporterMu);
+      for (const auto &Decl : TUReporter.getDeclarationList())
+        if (ReportedDecls
+                .insert(std::make_tuple(Decl.QualifiedName, Decl.Kind,
+                                        Decl.Templated))
+                .second)
+          Reporter.reportDeclaration(Decl.QualifiedName, Decl.Kind,
+                                     Decl.Templated);
+    }
+    for (const auto &MoveReplacements : FileToReplacements)
+      reportReplacements(MoveReplacements, Results);
+    return Success;
+  }
+
+private:
+  const move::ClangMoveContext &Context;
+  ArrayRef<move::MoveDefinitionSpec> Specs;
+  const clangd::ReferencingFiles *Selection;
+  move::DeclarationReporter &Reporter;
+  tooling::ExecutionContext &Results;
+  std::mutex ReporterMu;
+  std::set<std::tuple<std::string, std::string, bool>> ReportedDecls;
+};
+
 } // namespace
 
 int main(int argc, const char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
-  tooling::CommonOptionsParser OptionsParser(argc, argv, ClangMoveCategory);
+  // Without -executor, the source files are run one after the other.
+  auto Executor = tooling::createExecutorFromCommandLineArgs(
+      argc, argv, ClangMoveCategory);
+  if (!Executor) {
+    llvm::errs() << llvm::toString(Executor.takeError()) << "\n";
+    return 1;
+  }
 
   if (OldDependOnNew && NewDependOnOld) {
     llvm::errs() << "Provide either --old_depend_on_new or "
@@ -105,11 +267,6 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
-  tooling::RefactoringTool Tool(OptionsParser.getCompilations(),
-                                OptionsParser.getSourcePathList());
-  // Add "-fparse-all-comments" compile option to make clang parse all comments.
-  Tool.appendArgumentsAdjuster(tooling::getInsertArgumentAdjuster(
-      "-fparse-all-comments", tooling::ArgumentInsertPosition::BEGIN));
   move::MoveDefinitionSpec Spec;
   Spec.Names = {Names.begin(), Names.end()};
   Spec.OldHeader = OldHeader;
@@ -119,19 +276,75 @@ int main(int argc, const char **argv) {
   Spec.OldDependOnNew = OldDependOnNew;
   Spec.NewDependOnOld = NewDependOnOld;
 
+  std::vector<move::MoveDefinitionSpec> Specs;
+  if (!MovesFile.empty() && !DumpDecls) {
+    if (!Names.empty() || !NewHeader.empty() || !NewCC.empty()) {
+      llvm::errs() << "Provide either --moves_file or --names, --new_header "
+                      "and --new_cc.\n";
+      return 1;
+    }
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+        llvm::MemoryBuffer::getFile(MovesFile);
+    if (!Buffer) {
+      llvm::errs() << "Failed to read " << MovesFile << ": "
+                   << Buffer.getError().message() << "\n";
+      return 1;
+    }
+    std::vector<MoveSet> Sets;
+    llvm::yaml::Input YAML((*Buffer)->getBuffer());
+    YAML >> Sets;
+    if (YAML.error()) {
+      llvm::errs() << "Failed to parse " << MovesFile << ": "
+                   << YAML.error().message() << "\n";
+      return 1;
+    }
+    for (const MoveSet &Set : Sets) {
+      Specs.push_back(Spec);
+      Specs.back().Names = {Set.Names.begin(), Set.Names.end()};
+      Specs.back().NewHeader = Set.NewHeader;
+      Specs.back().NewCC = Set.NewCC;
+    }
+  } else {
+    Specs.push_back(Spec);
+  }
+
   llvm::SmallString<128> InitialDirectory;
   if (std::error_code EC = llvm::sys::fs::current_path(InitialDirectory))
     llvm::report_fatal_error("Cannot detect current path: " +
                              Twine(EC.message()));
 
-  move::ClangMoveContext Context{Spec, Tool.getReplacements(),
-                                 InitialDirectory.str(), Style, DumpDecls};
+  // Each translation unit runs with a copy of this context and its own
+  // replacements, which are reported to the executor.
+  std::map<std::string, tooling::Replacements> NoReplacements;
+  move::ClangMoveContext Context{Spec, NoReplacements, InitialDirectory.str(),
+                                 Style, DumpDecls};
   move::DeclarationReporter Reporter;
-  move::ClangMoveActionFactory Factory(&Context, &Reporter);
-
-  int CodeStatus = Tool.run(&Factory);
-  if (CodeStatus)
-    return CodeStatus;
+  // Add "-fparse-all-comments" compile option to make clang parse all comments.
+  tooling::ArgumentsAdjuster ParseAllComments =
+      tooling::getInsertArgumentAdjuster(
+          "-fparse-all-comments", tooling::ArgumentInsertPosition::BEGIN);
+  std::unique_ptr<clangd::ReferencingFiles> Selection;
+  if (!IndexFile.empty() && !DumpDecls) {
+    std::unique_ptr<clangd::SymbolIndex> Index = clangd::loadIndex(IndexFile);
+    if (!Index) {
+      llvm::errs() << "Failed to load index " << IndexFile << "\n";
+      return 1;
+    }
+    std::vector<std::string> MovedNames;
+    for (const move::MoveDefinitionSpec &MoveSpec : Specs)
+      MovedNames.insert(MovedNames.end(), MoveSpec.Names.begin(),
+                        MoveSpec.Names.end());
+    Selection = llvm::make_unique<clangd::ReferencingFiles>(
+        *Index, clangd::findSymbolsByName(*Index, MovedNames));
+  }
+  if (llvm::Error Err = Executor->get()->execute(
+          llvm::make_unique<ClangMoveExecutorActionFactory>(
+              Context, Specs, Selection.get(), Reporter,
+              *Executor->get()->getExecutionContext()),
+          ParseAllComments)) {
+    llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+    return 1;
+  }
 
   if (DumpDecls) {
     llvm::outs() << "[\n";
@@ -152,20 +365,16 @@ int main(int argc, const char **argv) {
     return 0;
   }
 
-  if (!NewCC.empty()) {
-    std::error_code EC = CreateNewFile(NewCC);
-    if (EC) {
-      llvm::errs() << "Failed to create " << NewCC << ": " << EC.message()
-                   << "\n";
-      return EC.value();
-    }
-  }
-  if (!NewHeader.empty()) {
-    std::error_code EC = CreateNewFile(NewHeader);
-    if (EC) {
-      llvm::errs() << "Failed to create " << NewHeader << ": " << EC.message()
-                   << "\n";
-      return EC.value();
+  for (const move::MoveDefinitionSpec &MoveSpec : Specs) {
+    for (StringRef NewFile : {MoveSpec.NewCC, MoveSpec.NewHeader}) {
+      if (NewFile.empty())
+        continue;
+      std::error_code EC = CreateNewFile(NewFile);
+      if (EC) {
+        llvm::errs() << "Failed to create " << NewFile << ": " << EC.message()
+                     << "\n";
+        return EC.value();
+      }
     }
   }
 
@@ -174,18 +383,25 @@ int main(int argc, const char **argv) {
   DiagnosticsEngine Diagnostics(
       IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()), &*DiagOpts,
       &DiagnosticPrinter, false);
-  auto &FileMgr = Tool.getFiles();
+  llvm::Expected<std::map<std::string, tooling::Replacements>>
+      FileToReplacements =
+          collectReplacements(*Executor->get()->getToolResults());
+  if (!FileToReplacements) {
+    llvm::errs() << llvm::toString(FileToReplacements.takeError()) << "\n";
+    return 1;
+  }
+  FileManager FileMgr((FileSystemOptions()));
   SourceManager SM(Diagnostics, FileMgr);
   Rewriter Rewrite(SM, LangOptions());
 
-  if (!formatAndApplyAllReplacements(Tool.getReplacements(), Rewrite, Style)) {
+  if (!formatAndApplyAllReplacements(*FileToReplacements, Rewrite, Style)) {
     llvm::errs() << "Failed applying all replacements.\n";
     return 1;
   }
 
   if (Dump) {
     std::set<llvm::StringRef> Files;
-    for (const auto &it : Tool.getReplacements())
+    for (const auto &it : *FileToReplacements)
       Files.insert(it.first);
     auto WriteToJson = [&](llvm::raw_ostream &OS) {
       OS << "[\n";
@@ -9,9 +9,12 @@
 
 #include "Query.h"
 #include "QuerySession.h"
+#include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Frontend/ASTUnit.h"
 #include "clang/Frontend/TextDiagnostic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace clang::ast_matchers;
@@ -43,6 +46,8 @@ bool HelpQuery::run(llvm::raw_ostream &OS, QuerySession &QS) const {
         "Set whether to bind the root matcher to \"root\".\n"
         "  set print-matcher (true|false)    "
         "Set whether to print the current matcher,\n"
+        "  set profile (true|false)          "
+        "Set whether to profile the matcher in each AST.\n"
         "  set output <feature>              "
         "Set whether to output only <feature> content.\n"
         "  enable output <feature>           "
@@ -79,66 +84,178 @@ struct CollectBoundNodes : MatchFinder::MatchCallback {
   }
 };
 
+/// Counts the nodes of an AST a matcher can match, traversing it like the
+/// MatchFinder does.
+class CandidateNodeCounter : public RecursiveASTVisitor<CandidateNodeCounter> {
+public:
+  CandidateNodeCounter(const DynTypedMatcher &Matcher) : Matcher(Matcher) {}
+
+  bool shouldVisitTemplateInstantiations() const { return true; }
+  bool shouldVisitImplicitCode() const { return true; }
+
+  bool VisitDecl(Decl *D) {
+    count(ast_type_traits::ASTNodeKind::getFromNode(*D));
+    return true;
+  }
+  bool VisitStmt(Stmt *S) {
+    count(ast_type_traits::ASTNodeKind::getFromNode(*S));
+    return true;
+  }
+  bool VisitTypeLoc(TypeLoc TL) {
+    count(ast_type_traits::ASTNodeKind::getFromNodeKind<TypeLoc>());
+    count(ast_type_traits::ASTNodeKind::getFromNode(*TL.getTypePtr()));
+    return true;
+  }
+
+  unsigned Count = 0;
+
+private:
+  void count(ast_type_traits::ASTNodeKind Kind) {
+    if (Matcher.canMatchNodesOfKind(Kind))
+      ++Count;
+  }
+
+  const DynTypedMatcher &Matcher;
+};
+
 } // namespace
 
+bool MatchQuery::collectMatches(ASTUnit &AST, const QuerySession &QS,
+                                bool WithText,
+                                std::vector<MatchOutput> &Outputs,
+                                MatchProfile *Profile) const {
+  // The matcher has a single callback, the only profiling record.
+  llvm::StringMap<llvm::TimeRecord> Records;
+  MatchFinder::MatchFinderOptions FinderOptions;
+  if (Profile)
+    FinderOptions.CheckProfiling.emplace(Records);
+  MatchFinder Finder(std::move(FinderOptions));
+  std::vector<BoundNodes> Matches;
+  DynTypedMatcher MaybeBoundMatcher = Matcher;
+  if (QS.BindRoot) {
+    llvm::Optional<DynTypedMatcher> M = Matcher.tryBind("root");
+    if (M)
+      MaybeBoundMatcher = *M;
+  }
+  CollectBoundNodes Collect(Matches);
+  if (!Finder.addDynamicMatcher(MaybeBoundMatcher, &Collect))
+    return false;
+  Finder.matchAST(AST.getASTContext());
+  if (Profile) {
+    for (const auto &Record : Records)
+      Profile->Time += Record.getValue();
+    CandidateNodeCounter Counter(MaybeBoundMatcher);
+    Counter.TraverseDecl(AST.getASTContext().getTranslationUnitDecl());
+    Profile->CandidateNodes = Counter.Count;
+  }
+
+  const SourceManager &SM = AST.getSourceManager();
+  for (auto MI = Matches.begin(), ME = Matches.end(); MI != ME; ++MI) {
+    Outputs.emplace_back();
+    MatchOutput &Output = Outputs.back();
+    llvm::raw_string_ostream KeyOS(Output.Key);
+    bool HasLocations = true;
+    llvm::raw_string_ostream OS(Output.Text);
+
+    for (auto BI = MI->getMap().begin(), BE = MI->getMap().end(); BI != BE;
+         ++BI) {
+      clang::SourceRange R = BI->second.getSourceRange();
+      if (R.isValid()) {
+        SourceLocation Begin = SM.getExpansionLoc(R.getBegin());
+        SourceLocation End = SM.getExpansionLoc(R.getEnd());
+        KeyOS << BI->first << ";" << BI->second.getNodeKind().asStringRef()
+              << ";" << SM.getFilename(Begin) << ";" << SM.getFileOffset(Begin)
+              << ";" << SM.getFileOffset(End) << "\n";
+      } else {
+        HasLocations = false;
+      }
+      if (!WithText)
+        continue;
+      if (QS.DiagOutput) {
+        if (R.isValid()) {
+          TextDiagnostic TD(OS, AST.getASTContext().getLangOpts(),
+                            &AST.getDiagnostics().getDiagnosticOptions());
+          TD.emitDiagnostic(
+              FullSourceLoc(R.getBegin(), AST.getSourceManager()),
+              DiagnosticsEngine::Note, "\"" + BI->first + "\" binds here",
+              CharSourceRange::getTokenRange(R), None);
+        }
+      }
+      if (QS.PrintOutput) {
+        OS << "Binding for \"" << BI->first << "\":\n";
+        BI->second.print(OS, AST.getASTContext().getPrintingPolicy());
+        OS << "\n";
+      }
+      if (QS.DetailedASTOutput) {
+        OS << "Binding for \"" << BI->first << "\":\n";
+        BI->second.dump(OS, AST.getSourceManager());
+        OS << "\n";
+      }
+    }
+
+    if (WithText && MI->getMap().empty())
+      OS << "No bindings.\n";
+    OS.flush();
+    KeyOS.flush();
+    if (!HasLocations)
+      Output.Key.clear();
+  }
+  return true;
+}
+
+/// Prints a line of the profile of a match query.
+static void printProfile(llvm::raw_ostream &OS, StringRef Name,
+                         const MatchQuery::MatchProfile &Profile,
+                         size_t Matches) {
+  OS << "  " << Name << ": "
+     << llvm::format("%.6f", Profile.Time.getWallTime()) << "s wall, "
+     << llvm::format("%.6f", Profile.Time.getProcessTime())
+     << "s user+system, " << Profile.CandidateNodes << " candidate "
+     << (Profile.CandidateNodes == 1 ? "node, " : "nodes, ") << Matches
+     << (Matches == 1 ? " match\n" : " matches\n");
+}
+
+void MatchQuery::printMatcher(llvm::raw_ostream &OS) const {
+  std::string prefixText = "Matcher: ";
+  OS << "\n  " << prefixText << Source << "\n";
+  OS << "  " << std::string(prefixText.size() + Source.size(), '=') << '\n';
+}
+
 bool MatchQuery::run(llvm::raw_ostream &OS, QuerySession &QS) const {
   unsigned MatchCount = 0;
+  std::string ProfileText;
+  llvm::raw_string_ostream ProfileOS(ProfileText);
+  MatchProfile Total;
 
   for (auto &AST : QS.ASTs) {
-    MatchFinder Finder;
-    std::vector<BoundNodes> Matches;
-    DynTypedMatcher MaybeBoundMatcher = Matcher;
-    if (QS.BindRoot) {
-      llvm::Optional<DynTypedMatcher> M = Matcher.tryBind("root");
-      if (M)
-        MaybeBoundMatcher = *M;
-    }
-    CollectBoundNodes Collect(Matches);
-    if (!Finder.addDynamicMatcher(MaybeBoundMatcher, &Collect)) {
+    std::vector<MatchOutput> Outputs;
+    MatchProfile Profile;
+    if (!collectMatches(*AST, QS, /*WithText=*/true, Outputs,
+                        QS.Profile ? &Profile : nullptr)) {
       OS << "Not a valid top-level matcher.\n";
       return false;
     }
-    Finder.matchAST(AST->getASTContext());
 
-    if (QS.PrintMatcher) {
-      std::string prefixText = "Matcher: ";
-      OS << "\n  " << prefixText << Source << "\n";
-      OS << "  " << std::string(prefixText.size() + Source.size(), '=') << '\n';
-    }
+    if (QS.PrintMatcher)
+      printMatcher(OS);
 
-    for (auto MI = Matches.begin(), ME = Matches.end(); MI != ME; ++MI) {
-      OS << "\nMatch #" << ++MatchCount << ":\n\n";
-
-      for (auto BI = MI->getMap().begin(), BE = MI->getMap().end(); BI != BE;
-           ++BI) {
-        if (QS.DiagOutput) {
-          clang::SourceRange R = BI->second.getSourceRange();
-          if (R.isValid()) {
-            TextDiagnostic TD(OS, AST->getASTContext().getLangOpts(),
-                              &AST->getDiagnostics().getDiagnosticOptions());
-            TD.emitDiagnostic(
-                FullSourceLoc(R.getBegin(), AST->getSourceManager()),
-                DiagnosticsEngine::Note, "\"" + BI->first + "\" binds here",
-                CharSourceRange::getTokenRange(R), None);
-          }
-        }
-        if (QS.PrintOutput) {
-          OS << "Binding for \"" << BI->first << "\":\n";
-          BI->second.print(OS, AST->getASTContext().getPrintingPolicy());
-          OS << "\n";
-        }
-        if (QS.DetailedASTOutput) {
-          OS << "Binding for \"" << BI->first << "\":\n";
-          BI->second.dump(OS, AST->getSourceManager());
-          OS << "\n";
-        }
-      }
+    for (const MatchOutput &Output : Outputs)
+      OS << "\nMatch #" << ++MatchCount << ":\n\n" << Output.Text;
 
-      if (MI->getMap().empty())
-        OS << "No bindings.\n";
+    if (QS.Profile) {
+      printProfile(ProfileOS, AST->getMainFileName(), Profile, Outputs.size());
+      Total.Time += Profile.Time;
+      Total.CandidateNodes += Profile.CandidateNodes;
     }
   }
 
+  if (QS.Profile) {
+    OS << "\nProfile of " << Source << ":\n" << ProfileOS.str();
+    if (QS.ASTs.size() > 1)
+      printProfile(OS, "Total", Total, MatchCount);
+    OS << "\n";
+  }
+
   OS << MatchCount << (MatchCount == 1 ? " match.\n" : " matches.\n");
   return true;
 }
@@ -14,9 +14,14 @@
 #include "clang/ASTMatchers/Dynamic/VariantValue.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/Support/Timer.h"
 #include <string>
+#include <vector>
 
 namespace clang {
+
+class ASTUnit;
+
 namespace query {
 
 enum OutputKind { OK_Diag, OK_Print, OK_DetailedAST };
@@ -91,6 +96,37 @@ struct MatchQuery : Query {
       : Query(QK_Match), Matcher(Matcher), Source(Source) {}
   bool run(llvm::raw_ostream &OS, QuerySession &QS) const override;
 
+  /// The output of one match.
+  struct MatchOutput {
+    /// The bindings as configured by the session, printed after the
+    /// "Match #N:" header.
+    std::string Text;
+    /// Identifies the match by the names, kinds and locations of its bound
+    /// nodes, to recognize it in the different translation units including
+    /// the same header. Empty if a bound node has no location.
+    std::string Key;
+  };
+
+  /// The cost of matching a translation unit, for the profile setting.
+  struct MatchProfile {
+    /// The time spent running the matcher and collecting its matches.
+    llvm::TimeRecord Time;
+    /// The number of nodes of the translation unit the matcher can match,
+    /// i.e. the nodes it is run on.
+    unsigned CandidateNodes = 0;
+  };
+
+  /// Matches \p AST as configured by \p QS, and adds the output of each match
+  /// to \p Outputs. Only the keys are computed if \p WithText is false.
+  /// If \p Profile isn't null, the matcher is profiled into it.
+  /// Returns false if the matcher isn't a valid top-level matcher.
+  bool collectMatches(ASTUnit &AST, const QuerySession &QS, bool WithText,
+                      std::vector<MatchOutput> &Outputs,
+                      MatchProfile *Profile = nullptr) const;
+
+  /// Prints the header of the matcher, for the print-matcher setting.
+  void printMatcher(llvm::raw_ostream &OS) const;
+
   ast_matchers::dynamic::DynTypedMatcher Matcher;
 
   StringRef Source;
@@ -0,0 +1,118 @@
+//===---- QueryBatch.cpp - clang-query batch mode -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryBatch.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace clang::ast_matchers;
+using namespace clang::ast_matchers::dynamic;
+
+namespace clang {
+namespace query {
+
+bool BatchQueryRunner::addQuery(const QueryRef &Q, llvm::raw_ostream &OS) {
+  const auto *Match = llvm::dyn_cast<MatchQuery>(Q.get());
+  if (!Match)
+    return Q->run(OS, QS);
+
+  // Check the matcher once, rather than in each thread.
+  MatchFinder Finder;
+  MatchFinder::MatchCallback *NoCallback = nullptr;
+  DynTypedMatcher MaybeBoundMatcher = Match->Matcher;
+  if (QS.BindRoot) {
+    llvm::Optional<DynTypedMatcher> M = Match->Matcher.tryBind("root");
+    if (M)
+      MaybeBoundMatcher = *M;
+  }
+  if (!Finder.addDynamicMatcher(MaybeBoundMatcher, NoCallback)) {
+    OS << "Not a valid top-level matcher.\n";
+    return false;
+  }
+  Queries.push_back({Match, Q, QS});
+  return true;
+}
+
+void BatchQueryRunner::printFileOutputs(const FileOutputs &Outputs,
+                                        llvm::raw_ostream &OS) {
+  for (size_t I = 0, E = Queries.size(); I != E; ++I) {
+    const RecordedQuery &Q = Queries[I];
+    if (!CountOnly && Q.Settings.PrintMatcher && !Outputs[I].empty())
+      Q.Query->printMatcher(OS);
+    for (const MatchQuery::MatchOutput &Output : Outputs[I]) {
+      if (!Output.Key.empty() &&
+          !SeenMatches[I].insert(llvm::xxHash64(Output.Key)).second)
+        continue;
+      ++MatchCounts[I];
+      if (!CountOnly)
+        OS << "\nMatch #" << MatchCounts[I] << ":\n\n" << Output.Text;
+    }
+  }
+}
+
+bool BatchQueryRunner::run(ArrayRef<std::string> Files,
+                           const ASTBuilder &BuildAST, unsigned Threads,
+                           llvm::raw_ostream &OS) {
+  MatchCounts.assign(Queries.size(), 0);
+  SeenMatches.assign(Queries.size(), llvm::DenseSet<uint64_t>());
+
+  // The outputs of the files processed out of order wait for the previous
+  // ones, only their outputs are kept, not their ASTs.
+  std::mutex OutputMu;
+  std::vector<llvm::Optional<FileOutputs>> PendingOutputs(Files.size());
+  size_t NextOutput = 0;
+  std::atomic<bool> Failed(false);
+  std::atomic<size_t> NextFile(0);
+  auto Worker = [&] {
+    for (size_t I = NextFile++; I < Files.size(); I = NextFile++) {
+      FileOutputs Outputs(Queries.size());
+      if (std::unique_ptr<ASTUnit> AST = BuildAST(Files[I])) {
+        for (size_t Q = 0, E = Queries.size(); Q != E; ++Q)
+          Queries[Q].Query->collectMatches(*AST, Queries[Q].Settings,
+                                           /*WithText=*/!CountOnly,
+                                           Outputs[Q]);
+      } else {
+        Failed = true;
+      }
+
+      std::lock_guard<std::mutex> Lock(OutputMu);
+      PendingOutputs[I] = std::move(Outputs);
+      for (; NextOutput < Files.size() && PendingOutputs[NextOutput];
+           ++NextOutput) {
+        printFileOutputs(*PendingOutputs[NextOutput], OS);
+        PendingOutputs[NextOutput].reset();
+      }
+      OS.flush();
+    }
+  };
+  std::vector<std::thread> Pool;
+  for (size_t I = 1; I < std::min<size_t>(Threads, Files.size()); ++I)
+    Pool.emplace_back(Worker);
+  Worker();
+  for (std::thread &T : Pool)
+    T.join();
+
+  for (size_t I = 0, E = Queries.size(); I != E; ++I) {
+    if (Queries.size() > 1)
+      OS << Queries[I].Query->Source << ": ";
+    OS << MatchCounts[I]
+       << (MatchCounts[I] == 1 ? " match.\n" : " matches.\n");
+  }
+  return !Failed;
+}
+
+} // namespace query
+} // namespace clang
@@ -0,0 +1,86 @@
+//===--- QueryBatch.h - clang-query -----------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_QUERY_QUERY_BATCH_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_QUERY_QUERY_BATCH_H
+
+#include "Query.h"
+#include "QuerySession.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+class ASTUnit;
+
+namespace query {
+
+/// Runs the match queries of a session over translation units streamed
+/// through a thread pool, instead of matching ASTs all loaded up front: each
+/// AST is built, matched and discarded by a thread.
+///
+/// The matches are printed in the order of the translation units. A match
+/// found in a header is only printed and counted for the first translation
+/// unit including it.
+class BatchQueryRunner {
+public:
+  /// Builds the AST of a translation unit, or returns null if it fails. May be
+  /// called on several threads.
+  typedef std::function<std::unique_ptr<ASTUnit>(StringRef File)> ASTBuilder;
+
+  /// \param QS The session the queries are parsed and run in, without ASTs.
+  /// \param CountOnly If true, only the number of matches of each match
+  /// query is printed.
+  BatchQueryRunner(QuerySession &QS, bool CountOnly)
+      : QS(QS), CountOnly(CountOnly) {}
+
+  /// Runs \p Q right away if it's not a match query, otherwise records it
+  /// with the current settings of the session. Returns false if it failed.
+  bool addQuery(const QueryRef &Q, llvm::raw_ostream &OS);
+
+  /// Matches the recorded queries against the ASTs of \p Files, built by
+  /// \p BuildAST on \p Threads threads, then prints the number of matches of
+  /// each query. Returns false if an AST couldn't be built.
+  bool run(ArrayRef<std::string> Files, const ASTBuilder &BuildAST,
+           unsigned Threads, llvm::raw_ostream &OS);
+
+private:
+  /// A match query, with the settings of the session when it was added.
+  struct RecordedQuery {
+    const MatchQuery *Query;
+    QueryRef Ref;
+    QuerySession Settings;
+  };
+
+  /// The outputs of the matches of each recorded query in a translation unit.
+  typedef std::vector<std::vector<MatchQuery::MatchOutput>> FileOutputs;
+
+  /// Prints the outputs of a translation unit, skipping the matches already
+  /// printed.
+  void printFileOutputs(const FileOutputs &Outputs, llvm::raw_ostream &OS);
+
+  QuerySession &QS;
+  bool CountOnly;
+  std::vector<RecordedQuery> Queries;
+  /// The number of matches of each recorded query.
+  std::vector<unsigned> MatchCounts;
+  /// The hashes of the keys of the printed matches of each recorded query.
+  std::vector<llvm::DenseSet<uint64_t>> SeenMatches;
+};
+
+} // namespace query
+} // namespace clang
+
+#endif
@@ -27,6 +27,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Query.h"
+#include "QueryBatch.h"
 #include "QueryParser.h"
 #include "QuerySession.h"
 #include "clang/Frontend/ASTUnit.h"
@@ -36,6 +37,9 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include <fstream>
 #include <string>
 
@@ -63,6 +67,27 @@ static cl::opt<std::string> PreloadFile(
     cl::desc("Preload commands from file and start interactive mode"),
     cl::value_desc("file"), cl::cat(ClangQueryCategory));
 
+static cl::opt<bool> Batch(
+    "batch",
+    cl::desc("Build, match and discard the ASTs of the source files one by\n"
+             "one on a thread pool, instead of loading them all before\n"
+             "running the commands. Requires -c or -f. The matches in\n"
+             "headers are only reported for the first source file\n"
+             "including them."),
+    cl::init(false), cl::cat(ClangQueryCategory));
+
+static cl::opt<bool> CountOnly(
+    "count-only",
+    cl::desc("In batch mode, only print the number of matches of each\n"
+             "match command."),
+    cl::init(false), cl::cat(ClangQueryCategory));
+
+static cl::opt<unsigned>
+    Jobs("j",
+         cl::desc("Number of threads building and matching ASTs in batch\n"
+                  "mode. 0 uses all the hardware threads."),
+         cl::init(1), cl::cat(ClangQueryCategory));
+
 bool runCommandsInFile(const char *ExeName, std::string const &FileName,
                        QuerySession &QS) {
   std::ifstream Input(FileName.c_str());
@@ -81,6 +106,61 @@ bool runCommandsInFile(const char *ExeName, std::string const &FileName,
   return false;
 }
 
+/// Parses the commands of -c or -f, running them through \p Runner.
+static bool addBatchCommands(const char *ExeName, BatchQueryRunner &Runner,
+                             QuerySession &QS, llvm::StringSaver &Saver) {
+  // The match queries refer to their command line until they are run.
+  auto AddCommand = [&](StringRef Line) {
+    QueryRef Q = QueryParser::parse(Saver.save(Line), QS);
+    return Runner.addQuery(Q, llvm::outs());
+  };
+  for (const std::string &Command : Commands)
+    if (!AddCommand(Command))
+      return false;
+  for (const std::string &FileName : CommandFiles) {
+    std::ifstream Input(FileName.c_str());
+    if (!Input.is_open()) {
+      llvm::errs() << ExeName << ": cannot open " << FileName << "\n";
+      return false;
+    }
+    while (Input.good()) {
+      std::string Line;
+      std::getline(Input, Line);
+      if (!AddCommand(Line))
+        return false;
+    }
+  }
+  return true;
+}
+
+/// Runs the commands of -c or -f over the source files in batch mode.
+static int runBatch(const char *ExeName, CommonOptionsParser &OptionsParser) {
+  QuerySession QS(None);
+  BatchQueryRunner Runner(QS, CountOnly);
+  llvm::BumpPtrAllocator Alloc;
+  llvm::StringSaver Saver(Alloc);
+  if (!addBatchCommands(ExeName, Runner, QS, Saver))
+    return 1;
+
+  // Each AST is built by its own tool, with its own file system so that the
+  // threads don't share a working directory.
+  auto BuildAST = [&](StringRef File) -> std::unique_ptr<ASTUnit> {
+    ClangTool Tool(OptionsParser.getCompilations(), File,
+                   std::make_shared<PCHContainerOperations>(),
+                   llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>(
+                       llvm::vfs::createPhysicalFileSystem().release()));
+    std::vector<std::unique_ptr<ASTUnit>> ASTs;
+    if (Tool.buildASTs(ASTs) != 0 || ASTs.size() != 1)
+      return nullptr;
+    return std::move(ASTs.front());
+  };
+  unsigned Threads = Jobs == 0 ? llvm::hardware_concurrency() : Jobs;
+  return Runner.run(OptionsParser.getSourcePathList(), BuildAST, Threads,
+                    llvm::outs())
+             ? 0
+             : 1;
+}
+
 int main(int argc, const char **argv) {
   llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
 
@@ -97,6 +177,14 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
+  if (Batch) {
+    if (Commands.empty() && CommandFiles.empty()) {
+      llvm::errs() << argv[0] << ": --batch requires -c or -f\n";
+      return 1;
+    }
+    return runBatch(argv[0], OptionsParser);
+  }
+
   ClangTool Tool(OptionsParser.getCompilations(),
                  OptionsParser.getSourcePathList());
   std::vector<std::unique_ptr<ASTUnit>> ASTs;
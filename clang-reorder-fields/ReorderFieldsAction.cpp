@@ -22,33 +22,56 @@
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Lex/Lexer.h"
 #include "clang/Tooling/Refactoring.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SetVector.h"
 #include <algorithm>
 #include <string>
+#include <vector>
 
 namespace clang {
 namespace reorder_fields {
 using namespace clang::ast_matchers;
 using llvm::SmallSetVector;
 
-/// \brief Finds the definition of a record by name.
+/// \brief Finds the definitions of records by name, in a single traversal of
+/// the AST.
 ///
-/// \returns nullptr if the name is ambiguous or not found.
-static const RecordDecl *findDefinition(StringRef RecordName,
-                                        ASTContext &Context) {
+/// \returns the definition of each record of \p Records, nullptr if its name is
+/// ambiguous or not found. A missing definition is only reported for a single
+/// record.
+static std::vector<const RecordDecl *>
+findDefinitions(ArrayRef<RecordFieldsOrder> Records, ASTContext &Context) {
+  std::vector<StringRef> Names;
+  for (const auto &Record : Records)
+    Names.push_back(Record.RecordName);
   auto Results =
-      match(recordDecl(hasName(RecordName), isDefinition()).bind("recordDecl"),
+      match(recordDecl(hasAnyName(Names), isDefinition()).bind("recordDecl"),
             Context);
-  if (Results.empty()) {
-    llvm::errs() << "Definition of " << RecordName << "  not found\n";
-    return nullptr;
+
+  std::vector<const RecordDecl *> Definitions(Records.size());
+  std::vector<unsigned> NumDefinitions(Records.size());
+  for (const auto &Result : Results) {
+    const auto *RD = Result.getNodeAs<RecordDecl>("recordDecl");
+    // Several names may match the same definition, e.g. Foo and ::Foo.
+    for (unsigned I = 0, E = Records.size(); I < E; ++I)
+      if (!match(namedDecl(hasName(Records[I].RecordName)), *RD, Context)
+               .empty()) {
+        Definitions[I] = RD;
+        ++NumDefinitions[I];
+      }
   }
-  if (Results.size() > 1) {
-    llvm::errs() << "The name " << RecordName
-                 << " is ambiguous, several definitions found\n";
-    return nullptr;
+  for (unsigned I = 0, E = Records.size(); I < E; ++I) {
+    // With several records, a translation unit usually defines only some.
+    if (!NumDefinitions[I] && Records.size() == 1) {
+      llvm::errs() << "Definition of " << Records[I].RecordName
+                   << "  not found\n";
+    } else if (NumDefinitions[I] > 1) {
+      llvm::errs() << "The name " << Records[I].RecordName
+                   << " is ambiguous, several definitions found\n";
+      Definitions[I] = nullptr;
+    }
   }
-  return selectFirst<RecordDecl>("recordDecl", Results);
+  return Definitions;
 }
 
 /// \brief Calculates the new order of fields.
@@ -248,63 +271,161 @@ static bool reorderFieldsInInitListExpr(
   return true;
 }
 
+/// \brief Reorders the fields in the definition of a record and in the member
+/// initializers of its constructors.
+///
+/// \returns true on success.
+static bool reorderFieldsInDeclarations(
+    const RecordDecl *Definition, ArrayRef<unsigned> NewFieldsOrder,
+    ASTContext &Context,
+    std::map<std::string, tooling::Replacements> &Replacements) {
+  if (!reorderFieldsInDefinition(Definition, NewFieldsOrder, Context,
+                                 Replacements))
+    return false;
+
+  // CXXRD will be nullptr if C code (not C++) is being processed.
+  const CXXRecordDecl *CXXRD = dyn_cast<CXXRecordDecl>(Definition);
+  if (CXXRD)
+    for (const auto *C : CXXRD->ctors())
+      if (const auto *D = dyn_cast_or_null<CXXConstructorDecl>(
+              C->getDefinition()))
+        reorderFieldsInConstructor(D, NewFieldsOrder, Context, Replacements);
+  return true;
+}
+
+/// \brief Whether the init list expressions of a record must be reordered.
+///
+/// We only need to reorder init list expressions for
+/// plain C structs or C++ aggregate types.
+/// For other types the order of constructor parameters is used,
+/// which we don't change at the moment.
+static bool hasReorderedInitListExprs(const RecordDecl *Definition) {
+  const CXXRecordDecl *CXXRD = dyn_cast<CXXRecordDecl>(Definition);
+  return !CXXRD || CXXRD->isAggregate();
+}
+
+bool reorderFields(const RecordDecl *Definition,
+                   ArrayRef<unsigned> NewFieldsOrder, ASTContext &Context,
+                   std::map<std::string, tooling::Replacements> &Replacements) {
+  if (!reorderFieldsInDeclarations(Definition, NewFieldsOrder, Context,
+                                   Replacements))
+    return false;
+
+  // Now (v0) partial initialization is not supported.
+  if (hasReorderedInitListExprs(Definition))
+    for (auto Result :
+         match(initListExpr(hasType(equalsNode(Definition)))
+                   .bind("initListExpr"),
+               Context))
+      if (!reorderFieldsInInitListExpr(
+              Result.getNodeAs<InitListExpr>("initListExpr"), NewFieldsOrder,
+              Context, Replacements)) {
+        Replacements.clear();
+        return false;
+      }
+  return true;
+}
+
+/// \brief Adds the replacements of \p From to \p Into, either all of them or
+/// none if one conflicts with those of \p Into.
+///
+/// \returns true on success.
+static bool
+mergeReplacements(const std::map<std::string, tooling::Replacements> &From,
+                  std::map<std::string, tooling::Replacements> &Into) {
+  std::map<std::string, tooling::Replacements> Merged;
+  for (const auto &FileAndReplaces : From) {
+    tooling::Replacements &Replaces = Merged[FileAndReplaces.first];
+    auto It = Into.find(FileAndReplaces.first);
+    if (It != Into.end())
+      Replaces = It->second;
+    for (const auto &R : FileAndReplaces.second)
+      if (auto Err = Replaces.add(R)) {
+        consumeError(std::move(Err));
+        return false;
+      }
+  }
+  for (auto &FileAndReplaces : Merged)
+    Into[FileAndReplaces.first] = std::move(FileAndReplaces.second);
+  return true;
+}
+
 namespace {
 class ReorderingConsumer : public ASTConsumer {
-  StringRef RecordName;
-  ArrayRef<std::string> DesiredFieldsOrder;
+  ArrayRef<RecordFieldsOrder> Records;
   std::map<std::string, tooling::Replacements> &Replacements;
 
+  /// The reordering of a record found in the translation unit.
+  struct RecordReordering {
+    const RecordFieldsOrder *Record;
+    const RecordDecl *Definition;
+    SmallVector<unsigned, 4> NewFieldsOrder;
+    std::map<std::string, tooling::Replacements> Replacements;
+    bool Failed = false;
+  };
+
 public:
-  ReorderingConsumer(StringRef RecordName,
-                     ArrayRef<std::string> DesiredFieldsOrder,
+  ReorderingConsumer(ArrayRef<RecordFieldsOrder> Records,
                      std::map<std::string, tooling::Replacements> &Replacements)
-      : RecordName(RecordName), DesiredFieldsOrder(DesiredFieldsOrder),
-        Replacements(Replacements) {}
+      : Records(Records), Replacements(Replacements) {}
 
   ReorderingConsumer(const ReorderingConsumer &) = delete;
   ReorderingConsumer &operator=(const ReorderingConsumer &) = delete;
 
   void HandleTranslationUnit(ASTContext &Context) override {
-    const RecordDecl *RD = findDefinition(RecordName, Context);
-    if (!RD)
-      return;
-    SmallVector<unsigned, 4> NewFieldsOrder =
-        getNewFieldsOrder(RD, DesiredFieldsOrder);
-    if (NewFieldsOrder.empty())
-      return;
-    if (!reorderFieldsInDefinition(RD, NewFieldsOrder, Context, Replacements))
-      return;
-
-    // CXXRD will be nullptr if C code (not C++) is being processed.
-    const CXXRecordDecl *CXXRD = dyn_cast<CXXRecordDecl>(RD);
-    if (CXXRD)
-      for (const auto *C : CXXRD->ctors())
-        if (const auto *D = dyn_cast<CXXConstructorDecl>(C->getDefinition()))
-          reorderFieldsInConstructor(cast<const CXXConstructorDecl>(D),
-                                     NewFieldsOrder, Context, Replacements);
-
-    // We only need to reorder init list expressions for
-    // plain C structs or C++ aggregate types.
-    // For other types the order of constructor parameters is used,
-    // which we don't change at the moment.
-    // Now (v0) partial initialization is not supported.
-    if (!CXXRD || CXXRD->isAggregate())
+    std::vector<const RecordDecl *> Definitions =
+        findDefinitions(Records, Context);
+    // Each record has its own replacements, so that one failing to be
+    // reordered doesn't drop those of the others.
+    std::vector<RecordReordering> Reorderings;
+    for (unsigned I = 0, E = Records.size(); I < E; ++I) {
+      if (!Definitions[I])
+        continue;
+      RecordReordering Reordering;
+      Reordering.Record = &Records[I];
+      Reordering.Definition = Definitions[I];
+      Reordering.NewFieldsOrder =
+          getNewFieldsOrder(Definitions[I], Records[I].FieldsOrder);
+      if (Reordering.NewFieldsOrder.empty() ||
+          !reorderFieldsInDeclarations(Reordering.Definition,
+                                       Reordering.NewFieldsOrder, Context,
+                                       Reordering.Replacements))
+        continue;
+      Reorderings.push_back(std::move(Reordering));
+    }
+
+    // The init list expressions of all the records are found in a single
+    // traversal. Now (v0) partial initialization is not supported.
+    llvm::DenseMap<const RecordDecl *, RecordReordering *> InitListRecords;
+    for (RecordReordering &Reordering : Reorderings)
+      if (hasReorderedInitListExprs(Reordering.Definition))
+        InitListRecords[Reordering.Definition] = &Reordering;
+    if (!InitListRecords.empty())
       for (auto Result :
-           match(initListExpr(hasType(equalsNode(RD))).bind("initListExpr"),
-                 Context))
-        if (!reorderFieldsInInitListExpr(
-                Result.getNodeAs<InitListExpr>("initListExpr"), NewFieldsOrder,
-                Context, Replacements)) {
-          Replacements.clear();
-          return;
-        }
+           match(initListExpr().bind("initListExpr"), Context)) {
+        const auto *InitListEx =
+            Result.getNodeAs<InitListExpr>("initListExpr");
+        auto It =
+            InitListRecords.find(InitListEx->getType()->getAsRecordDecl());
+        if (It == InitListRecords.end() || It->second->Failed)
+          continue;
+        RecordReordering &Reordering = *It->second;
+        Reordering.Failed = !reorderFieldsInInitListExpr(
+            InitListEx, Reordering.NewFieldsOrder, Context,
+            Reordering.Replacements);
+      }
+
+    for (const RecordReordering &Reordering : Reorderings)
+      if (!Reordering.Failed &&
+          !mergeReplacements(Reordering.Replacements, Replacements))
+        llvm::errs() << "The reordering of " << Reordering.Record->RecordName
+                     << " conflicts with the reordering of another record\n";
   }
 };
 } // end anonymous namespace
 
 std::unique_ptr<ASTConsumer> ReorderFieldsAction::newASTConsumer() {
-  return llvm::make_unique<ReorderingConsumer>(RecordName, DesiredFieldsOrder,
-                                               Replacements);
+  return llvm::make_unique<ReorderingConsumer>(Records, Replacements);
 }
 
 } // namespace reorder_fields
@@ -9,7 +9,7 @@
 ///
 /// \file
 /// This file contains the declarations of the ReorderFieldsAction class and
-/// the FieldPosition struct.
+/// of the reorderFields function.
 ///
 //===----------------------------------------------------------------------===//
 
@@ -17,15 +17,45 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_REORDER_FIELDS_ACTION_H
 
 #include "clang/Tooling/Refactoring.h"
+#include <map>
+#include <string>
+#include <vector>
 
 namespace clang {
 class ASTConsumer;
+class ASTContext;
+class RecordDecl;
 
 namespace reorder_fields {
 
+/// \brief Computes the replacements reordering the fields of the record
+/// \p Definition, so that the field of index \p NewFieldsOrder[I] comes I-th,
+/// along with the member initializers of its constructors and its aggregate
+/// initializations in \p Context.
+///
+/// \returns false if the fields can't be reordered. The replacements of
+/// \p Replacements may then have been dropped.
+bool reorderFields(const RecordDecl *Definition,
+                   llvm::ArrayRef<unsigned> NewFieldsOrder, ASTContext &Context,
+                   std::map<std::string, tooling::Replacements> &Replacements);
+
+/// \brief The desired order of the fields of a record.
+struct RecordFieldsOrder {
+  /// The name of the record, matched like \c hasName.
+  std::string RecordName;
+  /// The names of all the fields of the record, in their desired order.
+  std::vector<std::string> FieldsOrder;
+};
+
+/// \brief Reorders the fields of one or several records in each translation
+/// unit.
+///
+/// The definitions of the records are looked up, and their aggregate
+/// initializations rewritten, in a single traversal of the AST whatever the
+/// number of records. A record which can't be reordered is reported and
+/// skipped, the others are still reordered.
 class ReorderFieldsAction {
-  llvm::StringRef RecordName;
-  llvm::ArrayRef<std::string> DesiredFieldsOrder;
+  std::vector<RecordFieldsOrder> Records;
   std::map<std::string, tooling::Replacements> &Replacements;
 
 public:
@@ -33,8 +63,14 @@ public:
       llvm::StringRef RecordName,
       llvm::ArrayRef<std::string> DesiredFieldsOrder,
       std::map<std::string, tooling::Replacements> &Replacements)
-      : RecordName(RecordName), DesiredFieldsOrder(DesiredFieldsOrder),
-        Replacements(Replacements) {}
+      : Replacements(Replacements) {
+    Records.push_back({RecordName.str(), DesiredFieldsOrder.vec()});
+  }
+
+  ReorderFieldsAction(
+      llvm::ArrayRef<RecordFieldsOrder> Records,
+      std::map<std::string, tooling::Replacements> &Replacements)
+      : Records(Records), Replacements(Replacements) {}
 
   ReorderFieldsAction(const ReorderFieldsAction &) = delete;
   ReorderFieldsAction &operator=(const ReorderFieldsAction &) = delete;
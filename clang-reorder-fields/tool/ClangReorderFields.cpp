@@ -18,54 +18,213 @@
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/LangOptions.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/Execution.h"
 #include "clang/Tooling/Refactoring.h"
+#include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
 #include <cstdlib>
+#include <set>
 #include <string>
 #include <system_error>
 
 using namespace llvm;
 using namespace clang;
+using reorder_fields::RecordFieldsOrder;
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(RecordFieldsOrder)
+
+namespace llvm {
+namespace yaml {
+template <> struct MappingTraits<RecordFieldsOrder> {
+  static void mapping(IO &IO, RecordFieldsOrder &Record) {
+    IO.mapRequired("RecordName", Record.RecordName);
+    IO.mapRequired("FieldsOrder", Record.FieldsOrder);
+  }
+};
+} // namespace yaml
+} // namespace llvm
 
 cl::OptionCategory ClangReorderFieldsCategory("clang-reorder-fields options");
 
 static cl::opt<std::string>
-    RecordName("record-name", cl::Required,
-               cl::desc("The name of the struct/class."),
+    RecordName("record-name", cl::desc("The name of the struct/class."),
                cl::cat(ClangReorderFieldsCategory));
 
 static cl::list<std::string> FieldsOrder("fields-order", cl::CommaSeparated,
-                                         cl::OneOrMore,
                                          cl::desc("The desired fields order."),
                                          cl::cat(ClangReorderFieldsCategory));
 
+static cl::opt<std::string> RecordsFile(
+    "records-file",
+    cl::desc("A YAML file listing several structs/classes to reorder in a "
+             "single pass, each with RecordName and FieldsOrder keys, instead "
+             "of -record-name and -fields-order."),
+    cl::cat(ClangReorderFieldsCategory));
+
 static cl::opt<bool> Inplace("i", cl::desc("Overwrite edited files."),
                              cl::cat(ClangReorderFieldsCategory));
 
 const char Usage[] = "A tool to reorder fields in C/C++ structs/classes.\n";
 
-int main(int argc, const char **argv) {
-  tooling::CommonOptionsParser OP(argc, argv, ClangReorderFieldsCategory,
-                                  Usage);
+namespace {
+
+// Reports each replacement to the execution context, keyed by its file, and
+// the main file of the translation unit with an empty value, so that it's
+// printed even if unchanged.
+void reportReplacements(
+    StringRef MainFile,
+    const std::map<std::string, tooling::Replacements> &FileToReplacements,
+    tooling::ExecutionContext &Context) {
+  Context.reportResult(MainFile, "");
+  for (const auto &FileAndReplacements : FileToReplacements) {
+    for (tooling::Replacement R : FileAndReplacements.second) {
+      std::string Value;
+      llvm::raw_string_ostream OS(Value);
+      llvm::yaml::Output YAML(OS);
+      YAML << R;
+      Context.reportResult(FileAndReplacements.first, OS.str());
+    }
+  }
+}
 
-  auto Files = OP.getSourcePathList();
-  tooling::RefactoringTool Tool(OP.getCompilations(), Files);
+// Collects the replacements reported by the translation units, and their main
+// files. A header gets the same replacements from each translation unit
+// including it, they're only added once.
+llvm::Error
+collectReplacements(tooling::ToolResults &Results,
+                    std::map<std::string, tooling::Replacements> &Replacements,
+                    std::set<std::string> &MainFiles) {
+  std::map<std::string, std::set<std::string>> FileToValues;
+  Results.forEachResult([&](llvm::StringRef Key, llvm::StringRef Value) {
+    if (Value.empty())
+      MainFiles.insert(Key);
+    else
+      FileToValues[Key].insert(Value);
+  });
+  for (const auto &FileAndValues : FileToValues) {
+    tooling::Replacements &Replaces = Replacements[FileAndValues.first];
+    for (const std::string &Value : FileAndValues.second) {
+      tooling::Replacement R;
+      llvm::yaml::Input YAML(Value);
+      YAML >> R;
+      if (YAML.error())
+        return llvm::make_error<llvm::StringError>(
+            "Invalid replacement for " + FileAndValues.first,
+            llvm::inconvertibleErrorCode());
+      if (auto Err = Replaces.add(R))
+        return Err;
+    }
+  }
+  return llvm::Error::success();
+}
 
-  reorder_fields::ReorderFieldsAction Action(RecordName, FieldsOrder,
-                                             Tool.getReplacements());
+// Reorders the fields of the records in each translation unit of the
+// executor, and reports the replacements to the execution context. The
+// executor may run several translation units at once.
+class ReorderFieldsActionFactory : public tooling::FrontendActionFactory {
+public:
+  ReorderFieldsActionFactory(ArrayRef<RecordFieldsOrder> Records,
+                             tooling::ExecutionContext &Context)
+      : Records(Records), Context(Context) {}
+
+  FrontendAction *create() override {
+    llvm_unreachable("the actions are created by runInvocation");
+  }
 
-  auto Factory = tooling::newFrontendActionFactory(&Action);
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    std::string MainFile = Invocation->getFrontendOpts().Inputs[0].getFile();
+    std::map<std::string, tooling::Replacements> FileToReplacements;
+    reorder_fields::ReorderFieldsAction Action(Records, FileToReplacements);
+    std::unique_ptr<tooling::FrontendActionFactory> Factory =
+        tooling::newFrontendActionFactory(&Action);
+    if (!Factory->runInvocation(Invocation, Files, PCHContainerOps,
+                                DiagConsumer))
+      return false;
+    reportReplacements(MainFile, FileToReplacements, Context);
+    return true;
+  }
 
-  if (Inplace)
-    return Tool.runAndSave(Factory.get());
+private:
+  ArrayRef<RecordFieldsOrder> Records;
+  tooling::ExecutionContext &Context;
+};
+
+// Reads the records to reorder from -records-file, or -record-name and
+// -fields-order.
+llvm::Expected<std::vector<RecordFieldsOrder>> getRecords() {
+  std::vector<RecordFieldsOrder> Records;
+  if (RecordsFile.empty()) {
+    if (RecordName.empty() || FieldsOrder.empty())
+      return llvm::make_error<llvm::StringError>(
+          "Either -records-file, or -record-name and -fields-order must be "
+          "specified",
+          llvm::inconvertibleErrorCode());
+    Records.push_back(
+        {RecordName, std::vector<std::string>(FieldsOrder.begin(),
+                                              FieldsOrder.end())});
+    return Records;
+  }
+  if (!RecordName.empty() || !FieldsOrder.empty())
+    return llvm::make_error<llvm::StringError>(
+        "-records-file can't be specified with -record-name or -fields-order",
+        llvm::inconvertibleErrorCode());
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+      llvm::MemoryBuffer::getFile(RecordsFile);
+  if (!Buffer)
+    return llvm::make_error<llvm::StringError>(
+        "Can't read " + RecordsFile + ": " + Buffer.getError().message(),
+        llvm::inconvertibleErrorCode());
+  llvm::yaml::Input YAML(Buffer.get()->getBuffer());
+  YAML >> Records;
+  if (YAML.error())
+    return llvm::make_error<llvm::StringError>(
+        "Invalid records file " + RecordsFile, llvm::inconvertibleErrorCode());
+  return Records;
+}
+
+} // namespace
+
+int main(int argc, const char **argv) {
+  // Without -executor, the source files are run one after the other.
+  auto Executor = tooling::createExecutorFromCommandLineArgs(
+      argc, argv, ClangReorderFieldsCategory, Usage);
+  if (!Executor) {
+    llvm::errs() << llvm::toString(Executor.takeError()) << "\n";
+    return 1;
+  }
+  llvm::Expected<std::vector<RecordFieldsOrder>> Records = getRecords();
+  if (!Records) {
+    llvm::errs() << llvm::toString(Records.takeError()) << "\n";
+    return 1;
+  }
+
+  int ExitCode = 0;
+  if (llvm::Error Err = Executor->get()->execute(
+          llvm::make_unique<ReorderFieldsActionFactory>(
+              *Records, *Executor->get()->getExecutionContext()))) {
+    llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+    ExitCode = 1;
+  }
+  std::map<std::string, tooling::Replacements> Replacements;
+  std::set<std::string> MainFiles;
+  if (llvm::Error Err = collectReplacements(
+          *Executor->get()->getToolResults(), Replacements, MainFiles)) {
+    llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+    return 1;
+  }
 
-  int ExitCode = Tool.run(Factory.get());
   LangOptions DefaultLangOptions;
   IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts(new DiagnosticOptions());
   TextDiagnosticPrinter DiagnosticPrinter(errs(), &*DiagOpts);
@@ -73,12 +232,20 @@ int main(int argc, const char **argv) {
       IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()), &*DiagOpts,
       &DiagnosticPrinter, false);
 
-  auto &FileMgr = Tool.getFiles();
+  FileManager FileMgr((FileSystemOptions()));
   SourceManager Sources(Diagnostics, FileMgr);
   Rewriter Rewrite(Sources, DefaultLangOptions);
-  Tool.applyAllReplacements(Rewrite);
+  for (const auto &FileAndReplacements : Replacements)
+    if (!tooling::applyAllReplacements(FileAndReplacements.second, Rewrite)) {
+      llvm::errs() << "Failed applying replacements to "
+                   << FileAndReplacements.first << "\n";
+      ExitCode = 1;
+    }
+
+  if (Inplace)
+    return Rewrite.overwriteChangedFiles() ? 1 : ExitCode;
 
-  for (const auto &File : Files) {
+  for (const auto &File : MainFiles) {
     const auto *Entry = FileMgr.getFile(File);
     const auto ID = Sources.getOrCreateFileID(Entry, SrcMgr::C_User);
     Rewrite.getEditBuffer(ID).write(outs());
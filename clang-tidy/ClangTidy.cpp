@@ -18,11 +18,16 @@
 #include "ClangTidy.h"
 #include "ClangTidyDiagnosticConsumer.h"
 #include "ClangTidyModuleRegistry.h"
+#include "ClangTidyPreambleCache.h"
 #include "ClangTidyProfiling.h"
+#include "ClangTidyResultCache.h"
+#include "clang-apply-replacements/Tooling/BinaryReplacements.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Basic/Version.h"
 #include "clang/Config/config.h"
 #include "clang/Format/Format.h"
 #include "clang/Frontend/ASTConsumers.h"
@@ -40,12 +45,25 @@
 #include "clang/StaticAnalyzer/Frontend/AnalysisConsumer.h"
 #endif // CLANG_ENABLE_STATIC_ANALYZER
 #include "clang/Tooling/DiagnosticsYaml.h"
+#include "clang/Tooling/Execution.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/xxhash.h"
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
 #include <utility>
 
 using namespace clang::ast_matchers;
@@ -55,6 +73,42 @@ using namespace llvm;
 
 LLVM_INSTANTIATE_REGISTRY(clang::tidy::ClangTidyModuleRegistry)
 
+namespace {
+
+/// The result of a translation unit run by a ToolExecutor, as reported to its
+/// execution context.
+struct ExecutorResult {
+  std::string MainSourceFile;
+  std::string BuildDirectory;
+  std::vector<clang::tooling::Diagnostic> Warnings;
+  std::vector<clang::tooling::Diagnostic> Errors;
+  clang::tidy::ClangTidyStats Stats;
+};
+
+} // namespace
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<ExecutorResult> {
+  static void mapping(IO &IO, ExecutorResult &R) {
+    IO.mapRequired("MainSourceFile", R.MainSourceFile);
+    IO.mapRequired("BuildDirectory", R.BuildDirectory);
+    IO.mapOptional("Warnings", R.Warnings);
+    IO.mapOptional("Errors", R.Errors);
+    IO.mapOptional("ErrorsDisplayed", R.Stats.ErrorsDisplayed);
+    IO.mapOptional("ErrorsIgnoredCheckFilter",
+                   R.Stats.ErrorsIgnoredCheckFilter);
+    IO.mapOptional("ErrorsIgnoredNOLINT", R.Stats.ErrorsIgnoredNOLINT);
+    IO.mapOptional("ErrorsIgnoredNonUserCode",
+                   R.Stats.ErrorsIgnoredNonUserCode);
+    IO.mapOptional("ErrorsIgnoredLineFilter", R.Stats.ErrorsIgnoredLineFilter);
+  }
+};
+
+} // namespace yaml
+} // namespace llvm
+
 namespace clang {
 namespace tidy {
 
@@ -96,13 +150,14 @@ private:
 class ErrorReporter {
 public:
   ErrorReporter(ClangTidyContext &Context, bool ApplyFixes,
-                llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS)
+                llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                unsigned Threads = 1)
       : Files(FileSystemOptions(), BaseFS), DiagOpts(new DiagnosticOptions()),
         DiagPrinter(new TextDiagnosticPrinter(llvm::outs(), &*DiagOpts)),
         Diags(IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs), &*DiagOpts,
               DiagPrinter),
         SourceMgr(Diags, Files), Context(Context), ApplyFixes(ApplyFixes),
-        TotalFixes(0), AppliedFixes(0), WarningsAsErrors(0) {
+        Threads(Threads), TotalFixes(0), AppliedFixes(0), WarningsAsErrors(0) {
     DiagOpts->ShowColors = llvm::sys::Process::StandardOutHasColors();
     DiagPrinter->BeginSourceFile(LangOpts);
   }
@@ -190,57 +245,121 @@ public:
   }
 
   void Finish() {
-    if (ApplyFixes && TotalFixes > 0) {
-      Rewriter Rewrite(SourceMgr, LangOpts);
-      for (const auto &FileAndReplacements : FileReplacements) {
-        StringRef File = FileAndReplacements.first();
-        llvm::ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
-            SourceMgr.getFileManager().getBufferForFile(File);
-        if (!Buffer) {
-          llvm::errs() << "Can't get buffer for file " << File << ": "
-                       << Buffer.getError().message() << "\n";
-          // FIXME: Maybe don't apply fixes for other files as well.
-          continue;
-        }
-        StringRef Code = Buffer.get()->getBuffer();
-        auto Style = format::getStyle(
-            *Context.getOptionsForFile(File).FormatStyle, File, "none");
-        if (!Style) {
-          llvm::errs() << llvm::toString(Style.takeError()) << "\n";
-          continue;
-        }
-        llvm::Expected<tooling::Replacements> Replacements =
-            format::cleanupAroundReplacements(Code, FileAndReplacements.second,
-                                              *Style);
-        if (!Replacements) {
-          llvm::errs() << llvm::toString(Replacements.takeError()) << "\n";
-          continue;
-        }
-        if (llvm::Expected<tooling::Replacements> FormattedReplacements =
-                format::formatReplacements(Code, *Replacements, *Style)) {
-          Replacements = std::move(FormattedReplacements);
-          if (!Replacements)
-            llvm_unreachable("!Replacements");
-        } else {
-          llvm::errs() << llvm::toString(FormattedReplacements.takeError())
-                       << ". Skipping formatting.\n";
-        }
-        if (!tooling::applyAllReplacements(Replacements.get(), Rewrite)) {
-          llvm::errs() << "Can't apply replacements for file " << File << "\n";
-        }
-      }
-      if (Rewrite.overwriteChangedFiles()) {
-        llvm::errs() << "clang-tidy failed to apply suggested fixes.\n";
-      } else {
-        llvm::errs() << "clang-tidy applied " << AppliedFixes << " of "
-                     << TotalFixes << " suggested fixes.\n";
-      }
+    if (!ApplyFixes || TotalFixes == 0)
+      return;
+    // The format styles are read from the options first, then the files are
+    // fixed independently of each other.
+    std::vector<FileFix> Fixes;
+    for (const auto &FileAndReplacements : FileReplacements)
+      Fixes.push_back(
+          {FileAndReplacements.first(), &FileAndReplacements.second,
+           *Context.getOptionsForFile(FileAndReplacements.first())
+                .FormatStyle});
+
+    std::mutex ErrsMu;
+    std::atomic<bool> WriteFailed(false);
+    std::atomic<size_t> NextFix(0);
+    auto Worker = [&] {
+      for (size_t I = NextFix++; I < Fixes.size(); I = NextFix++)
+        if (!applyFileFix(Fixes[I], ErrsMu))
+          WriteFailed = true;
+    };
+    std::vector<std::thread> Pool;
+    for (size_t I = 1; I < std::min<size_t>(Threads, Fixes.size()); ++I)
+      Pool.emplace_back(Worker);
+    Worker();
+    for (std::thread &T : Pool)
+      T.join();
+
+    if (WriteFailed) {
+      llvm::errs() << "clang-tidy failed to apply suggested fixes.\n";
+    } else {
+      llvm::errs() << "clang-tidy applied " << AppliedFixes << " of "
+                   << TotalFixes << " suggested fixes.\n";
     }
   }
 
   unsigned getWarningsAsErrorsCount() const { return WarningsAsErrors; }
 
 private:
+  /// The replacements of a file and the format style to apply them with.
+  struct FileFix {
+    StringRef File;
+    const Replacements *Replaces;
+    std::string FormatStyle;
+  };
+
+  /// Cleans up, formats and applies the replacements of \p Fix, and writes the
+  /// file if it changed. Returns false if it couldn't be written. May be called
+  /// on several threads, the messages are written under \p ErrsMu.
+  bool applyFileFix(const FileFix &Fix, std::mutex &ErrsMu) {
+    auto Report = [&](const Twine &Message) {
+      std::lock_guard<std::mutex> Lock(ErrsMu);
+      llvm::errs() << Message << "\n";
+    };
+    // Large files are memory mapped.
+    llvm::ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+        Files.getVirtualFileSystem()->getBufferForFile(Fix.File);
+    if (!Buffer) {
+      Report("Can't get buffer for file " + Fix.File + ": " +
+             Buffer.getError().message());
+      // FIXME: Maybe don't apply fixes for other files as well.
+      return true;
+    }
+    StringRef Code = Buffer.get()->getBuffer();
+    auto Style = format::getStyle(Fix.FormatStyle, Fix.File, "none");
+    if (!Style) {
+      Report(llvm::toString(Style.takeError()));
+      return true;
+    }
+    llvm::Expected<tooling::Replacements> Replacements =
+        format::cleanupAroundReplacements(Code, *Fix.Replaces, *Style);
+    if (!Replacements) {
+      Report(llvm::toString(Replacements.takeError()));
+      return true;
+    }
+    if (llvm::Expected<tooling::Replacements> FormattedReplacements =
+            format::formatReplacements(Code, *Replacements, *Style)) {
+      Replacements = std::move(FormattedReplacements);
+      if (!Replacements)
+        llvm_unreachable("!Replacements");
+    } else {
+      Report(llvm::toString(FormattedReplacements.takeError()) +
+             ". Skipping formatting.");
+    }
+    llvm::Expected<std::string> NewCode =
+        tooling::applyAllReplacements(Code, *Replacements);
+    if (!NewCode) {
+      llvm::consumeError(NewCode.takeError());
+      Report("Can't apply replacements for file " + Fix.File);
+      return true;
+    }
+    if (*NewCode == Code)
+      return true;
+    // Write a temporary file first, so that the file is either fixed or left
+    // untouched.
+    int FD;
+    SmallString<128> TempPath;
+    if (llvm::sys::fs::createUniqueFile(Fix.File + "-%%%%%%.tmp", FD,
+                                        TempPath))
+      return false;
+    {
+      llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+      OS << *NewCode;
+      OS.close();
+      if (OS.has_error()) {
+        OS.clear_error();
+        llvm::sys::fs::remove(TempPath);
+        return false;
+      }
+    }
+    if (llvm::sys::fs::rename(TempPath, Fix.File)) {
+      llvm::sys::fs::remove(TempPath);
+      return false;
+    }
+    return true;
+  }
+
   SourceLocation getLocation(StringRef FilePath, unsigned Offset) {
     if (FilePath.empty())
       return SourceLocation();
@@ -265,22 +384,172 @@ private:
   llvm::StringMap<Replacements> FileReplacements;
   ClangTidyContext &Context;
   bool ApplyFixes;
+  unsigned Threads;
   unsigned TotalFixes;
   unsigned AppliedFixes;
   unsigned WarningsAsErrors;
 };
 
+/// Runs the matchers of \c Finder only on the top-level declarations whose
+/// diagnostics aren't discarded: those of the main file and of the headers
+/// matching the header filter. Checks that need to see the declarations of the
+/// other headers, or the template instantiations they contain, miss them.
+/// With the header owners of the context, the headers owned by other
+/// translation units are skipped as well. With MatchChangedLinesOnly, only the
+/// declarations containing lines of the line filter are matched, looking into
+/// namespaces; the declarations they refer to are still reachable through the
+/// AST.
+class UserCodeMatchConsumer : public ASTConsumer {
+public:
+  UserCodeMatchConsumer(ast_matchers::MatchFinder &Finder,
+                        ClangTidyContext &Context, const SourceManager &SM)
+      : Finder(Finder), SM(SM),
+        HeaderFilter(*Context.getOptions().HeaderFilterRegex),
+        SystemHeaders(*Context.getOptions().SystemHeaders),
+        MainFile(Context.getCurrentFile()),
+        HeaderOwners(Context.getHeaderOwners()), ChangedLines(nullptr) {
+    if (Context.getMatchChangedLinesOnly() &&
+        !Context.getGlobalOptions().LineFilter.empty())
+      ChangedLines = &Context.getGlobalOptions().LineFilter;
+  }
+
+  bool HandleTopLevelDecl(DeclGroupRef DG) override {
+    for (Decl *D : DG)
+      addDecl(D, Decls);
+    return true;
+  }
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    // The declarations of a preamble aren't passed to HandleTopLevelDecl.
+    if (Context.getExternalSource()) {
+      std::vector<Decl *> PreambleDecls;
+      for (Decl *D : Context.getTranslationUnitDecl()->decls())
+        if (D->isFromASTFile())
+          addDecl(D, PreambleDecls);
+      Decls.insert(Decls.begin(), PreambleDecls.begin(), PreambleDecls.end());
+    }
+    Context.setTraversalScope(Decls);
+    Finder.matchAST(Context);
+    // The other consumers traverse the whole translation unit.
+    Context.setTraversalScope({Context.getTranslationUnitDecl()});
+  }
+
+private:
+  void addDecl(Decl *D, std::vector<Decl *> &Out) {
+    if (!isUserCode(D->getLocation()))
+      return;
+    if (!ChangedLines) {
+      Out.push_back(D);
+      return;
+    }
+    if (isa<NamespaceDecl>(D) || isa<LinkageSpecDecl>(D)) {
+      for (Decl *Child : cast<DeclContext>(D)->decls())
+        addDecl(Child, Out);
+      return;
+    }
+    if (containsChangedLines(D->getSourceRange()))
+      Out.push_back(D);
+  }
+
+  bool containsChangedLines(SourceRange Range) const {
+    SourceLocation Begin = SM.getExpansionLoc(Range.getBegin());
+    SourceLocation End = SM.getExpansionRange(Range.getEnd()).getEnd();
+    FileID FID = SM.getFileID(Begin);
+    const FileEntry *File = SM.getFileEntryForID(FID);
+    // Keep the declarations whose lines can't be compared.
+    if (!File || SM.getFileID(End) != FID)
+      return true;
+    unsigned BeginLine = SM.getExpansionLineNumber(Begin);
+    unsigned EndLine = SM.getExpansionLineNumber(End);
+    // As in ClangTidyDiagnosticConsumer::passesLineFilter.
+    for (const FileFilter &Filter : *ChangedLines) {
+      if (!File->getName().endswith(Filter.Name))
+        continue;
+      if (Filter.LineRanges.empty())
+        return true;
+      for (const FileFilter::LineRange &Lines : Filter.LineRanges)
+        if (Lines.first <= EndLine && BeginLine <= Lines.second)
+          return true;
+    }
+    return false;
+  }
+
+  bool isUserCode(SourceLocation Loc) {
+    FileID FID = SM.getFileID(SM.getExpansionLoc(Loc));
+    auto It = UserFiles.find(FID);
+    if (It != UserFiles.end())
+      return It->second;
+    bool IsUserCode = true;
+    // As in ClangTidyDiagnosticConsumer::checkFilters, the declarations
+    // without a file (e.g. from -D) are kept.
+    if (FID != SM.getMainFileID())
+      if (const FileEntry *File = SM.getFileEntryForID(FID)) {
+        IsUserCode = (SystemHeaders || !SM.isInSystemHeader(Loc)) &&
+                     HeaderFilter.match(File->getName());
+        if (IsUserCode && HeaderOwners)
+          IsUserCode = HeaderOwners->claim(headerKey(FID, *File), MainFile);
+      }
+    UserFiles[FID] = IsUserCode;
+    return IsUserCode;
+  }
+
+  /// Identifies the header by its path and contents, the translation units
+  /// may see different versions of a generated header.
+  std::string headerKey(FileID FID, const FileEntry &File) const {
+    StringRef Name = File.tryGetRealPathName();
+    if (Name.empty())
+      Name = File.getName();
+    return (Name + ":" + llvm::utohexstr(llvm::xxHash64(SM.getBufferData(FID))))
+        .str();
+  }
+
+  ast_matchers::MatchFinder &Finder;
+  const SourceManager &SM;
+  llvm::Regex HeaderFilter;
+  bool SystemHeaders;
+  std::string MainFile;
+  ClangTidyHeaderOwners *HeaderOwners;
+  const std::vector<FileFilter> *ChangedLines;
+  llvm::DenseMap<FileID, bool> UserFiles;
+  std::vector<Decl *> Decls;
+};
+
 class ClangTidyASTConsumer : public MultiplexConsumer {
 public:
   ClangTidyASTConsumer(std::vector<std::unique_ptr<ASTConsumer>> Consumers,
+                       ClangTidyContext &Context,
                        std::unique_ptr<ClangTidyProfiling> Profiling,
                        std::unique_ptr<ast_matchers::MatchFinder> Finder,
                        std::vector<std::unique_ptr<ClangTidyCheck>> Checks)
-      : MultiplexConsumer(std::move(Consumers)),
+      : MultiplexConsumer(std::move(Consumers)), Context(Context),
         Profiling(std::move(Profiling)), Finder(std::move(Finder)),
         Checks(std::move(Checks)) {}
 
+  ~ClangTidyASTConsumer() override {
+    Context.clearTranslationUnitCaches();
+    if (!Profiling)
+      return;
+    for (const auto &Check : Checks) {
+      const ast_matchers::MatchFinder::MatchCallback &Callback = *Check;
+      Profiling->MatchCounts[Callback.getID()] += Check->getMatchCount();
+      if (allocationTrackingEnabled())
+        Profiling->Allocations[Callback.getID()] += Check->getAllocations();
+    }
+  }
+
+  void HandleTranslationUnit(ASTContext &Ctx) override {
+    // Only now are the identifiers of the translation unit known, skip the
+    // checks that can't find anything in it.
+    for (const auto &Check : Checks)
+      if (Check->isApplicable(Ctx))
+        Check->registerMatchers(&*Finder);
+    // The budgets only cover the matching, not the parsing.
+    Context.startBudgets();
+    MultiplexConsumer::HandleTranslationUnit(Ctx);
+  }
+
 private:
+  ClangTidyContext &Context;
   // Destructor order matters! Profiling must be destructed last.
   // Or at least after Finder.
   std::unique_ptr<ClangTidyProfiling> Profiling;
@@ -290,16 +559,27 @@ private:
 
 } // namespace
 
+/// Returns the check factories of the registered modules. The modules are
+/// instantiated once per process, instead of once per translation unit.
+static const ClangTidyCheckFactories &getRegisteredCheckFactories() {
+  // Never destroyed, the checks may be created until the process exits.
+  static const ClangTidyCheckFactories *Factories = [] {
+    auto *Result = new ClangTidyCheckFactories;
+    for (ClangTidyModuleRegistry::iterator
+             I = ClangTidyModuleRegistry::begin(),
+             E = ClangTidyModuleRegistry::end();
+         I != E; ++I) {
+      std::unique_ptr<ClangTidyModule> Module(I->instantiate());
+      Module->addCheckFactories(*Result);
+    }
+    return Result;
+  }();
+  return *Factories;
+}
+
 ClangTidyASTConsumerFactory::ClangTidyASTConsumerFactory(
     ClangTidyContext &Context)
-    : Context(Context), CheckFactories(new ClangTidyCheckFactories) {
-  for (ClangTidyModuleRegistry::iterator I = ClangTidyModuleRegistry::begin(),
-                                         E = ClangTidyModuleRegistry::end();
-       I != E; ++I) {
-    std::unique_ptr<ClangTidyModule> Module(I->instantiate());
-    Module->addCheckFactories(*CheckFactories);
-  }
-}
+    : Context(Context), CheckFactories(&getRegisteredCheckFactories()) {}
 
 #if CLANG_ENABLE_STATIC_ANALYZER
 static void setStaticAnalyzerCheckerOpts(const ClangTidyOptions &Opts,
@@ -371,27 +651,38 @@ ClangTidyASTConsumerFactory::CreateASTConsumer(
   std::unique_ptr<ClangTidyProfiling> Profiling;
   if (Context.getEnableProfiling()) {
     Profiling = llvm::make_unique<ClangTidyProfiling>(
-        Context.getProfileStorageParams());
+        Context.getProfileStorageParams(), Context.getProfileAggregator(),
+        Context.getCurrentFile());
     FinderOptions.CheckProfiling.emplace(Profiling->Records);
   }
 
   std::unique_ptr<ast_matchers::MatchFinder> Finder(
       new ast_matchers::MatchFinder(std::move(FinderOptions)));
 
-  for (auto &Check : Checks) {
-    Check->registerMatchers(&*Finder);
+  // The matchers are registered once the translation unit is parsed, see
+  // ClangTidyASTConsumer::HandleTranslationUnit.
+  for (auto &Check : Checks)
     Check->registerPPCallbacks(Compiler);
-  }
 
   std::vector<std::unique_ptr<ASTConsumer>> Consumers;
-  if (!Checks.empty())
-    Consumers.push_back(Finder->newASTConsumer());
+  if (!Checks.empty()) {
+    if (Context.getMatchUserCodeOnly() || Context.getMatchChangedLinesOnly() ||
+        Context.getHeaderOwners())
+      Consumers.push_back(llvm::make_unique<UserCodeMatchConsumer>(
+          *Finder, Context, Compiler.getSourceManager()));
+    else
+      Consumers.push_back(Finder->newASTConsumer());
+  }
 
 #if CLANG_ENABLE_STATIC_ANALYZER
   AnalyzerOptionsRef AnalyzerOptions = Compiler.getAnalyzerOpts();
   AnalyzerOptions->CheckersControlList =
       getCheckersControlList(Context, Context.canEnableAnalyzerAlphaCheckers());
   if (!AnalyzerOptions->CheckersControlList.empty()) {
+    // The analyzer has its own budget, the check options can override it.
+    if (Context.getOptions().AnalyzerNodeBudget)
+      AnalyzerOptions->Config["max-nodes"] =
+          llvm::utostr(*Context.getOptions().AnalyzerNodeBudget);
     setStaticAnalyzerCheckerOpts(Context.getOptions(), AnalyzerOptions);
     AnalyzerOptions->AnalysisStoreOpt = RegionStoreModel;
     AnalyzerOptions->AnalysisDiagOpt = PD_NONE;
@@ -405,7 +696,7 @@ ClangTidyASTConsumerFactory::CreateASTConsumer(
   }
 #endif // CLANG_ENABLE_STATIC_ANALYZER
   return llvm::make_unique<ClangTidyASTConsumer>(
-      std::move(Consumers), std::move(Profiling), std::move(Finder),
+      std::move(Consumers), Context, std::move(Profiling), std::move(Finder),
       std::move(Checks));
 }
 
@@ -444,7 +735,31 @@ void ClangTidyCheck::run(const ast_matchers::MatchFinder::MatchResult &Result) {
   // For historical reasons, checks don't implement the MatchFinder run()
   // callback directly. We keep the run()/check() distinction to avoid interface
   // churn, and to allow us to add cross-cutting logic in the future.
+  if (OverBudget || Context->isTranslationUnitOverBudget())
+    return;
+  ++MatchCount;
+  llvm::Optional<AllocationScope> Allocating;
+  if (allocationTrackingEnabled())
+    Allocating.emplace(Allocations);
+  if (!Context->hasBudgets()) {
+    check(Result);
+    return;
+  }
+  auto Start = std::chrono::steady_clock::now();
   check(Result);
+  auto Time = std::chrono::steady_clock::now() - Start;
+  CheckTime += Time;
+  const SourceManager &SM = *Result.SourceManager;
+  OverBudget = !Context->spendBudget(
+      CheckName, SM.getLocForStartOfFile(SM.getMainFileID()), Time, CheckTime);
+}
+
+bool ClangTidyCheck::mentionsIdentifier(const ASTContext &Context,
+                                        StringRef Name) {
+  // The identifiers of a PCH or a preamble are only loaded once looked up.
+  if (Context.Idents.getExternalIdentifierLookup())
+    return true;
+  return Context.Idents.find(Name) != Context.Idents.end();
 }
 
 OptionsView::OptionsView(StringRef CheckName,
@@ -502,15 +817,11 @@ getCheckOptions(const ClangTidyOptions &Options,
   return Factory.getCheckOptions();
 }
 
-std::vector<ClangTidyError>
-runClangTidy(clang::tidy::ClangTidyContext &Context,
-             const CompilationDatabase &Compilations,
-             ArrayRef<std::string> InputFiles,
-             llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
-             bool EnableCheckProfile, llvm::StringRef StoreCheckProfile) {
-  ClangTool Tool(Compilations, InputFiles,
-                 std::make_shared<PCHContainerOperations>(), BaseFS);
+namespace {
 
+/// Returns the adjuster adding the arguments of the options of each file to
+/// its command, and removing the plugin arguments.
+ArgumentsAdjuster getArgumentsAdjuster(ClangTidyContext &Context) {
   // Add extra arguments passed by the clang-tidy command-line.
   ArgumentsAdjuster PerFileExtraArgumentsInserter =
       [&Context](const CommandLineArguments &Args, StringRef Filename) {
@@ -545,60 +856,604 @@ runClangTidy(clang::tidy::ClangTidyContext &Context,
         return AdjustedArgs;
       };
 
-  Tool.appendArgumentsAdjuster(PerFileExtraArgumentsInserter);
-  Tool.appendArgumentsAdjuster(PluginArgumentsRemover);
-  Context.setEnableProfiling(EnableCheckProfile);
-  Context.setProfileStoragePrefix(StoreCheckProfile);
+  return combineAdjusters(PerFileExtraArgumentsInserter,
+                          PluginArgumentsRemover);
+}
 
-  ClangTidyDiagnosticConsumer DiagConsumer(Context);
+/// Adds the arguments of the options of each file to the commands of \p Tool.
+void appendArgumentsAdjusters(ClangTool &Tool, ClangTidyContext &Context) {
+  Tool.appendArgumentsAdjuster(getArgumentsAdjuster(Context));
+}
+
+/// Runs the checks on the translation units of a tool, sharing the preambles
+/// of the context if it has a preamble cache.
+class ClangTidyActionFactory : public FrontendActionFactory {
+public:
+  ClangTidyActionFactory(ClangTidyContext &Context)
+      : Context(Context), ConsumerFactory(Context) {}
+  FrontendAction *create() override { return new Action(&ConsumerFactory); }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    // Explicitly set ProgramAction to RunAnalysis to make the preprocessor
+    // define __clang_analyzer__ macro. The frontend analyzer action will not
+    // be called here.
+    Invocation->getFrontendOpts().ProgramAction = frontend::RunAnalysis;
+
+    // Reuse the preamble of the translation units with the same leading
+    // directives and compile options.
+    std::shared_ptr<const PrecompiledPreamble> Preamble;
+    std::unique_ptr<llvm::MemoryBuffer> MainFileBuffer;
+    IntrusiveRefCntPtr<FileManager> PreambleFiles;
+    const auto &Inputs = Invocation->getFrontendOpts().Inputs;
+    ClangTidyPreambleCache *Cache = Context.getPreambleCache();
+    if (Cache && Inputs.size() == 1 && Inputs[0].isFile()) {
+      if (auto Buffer = Files->getBufferForFile(Inputs[0].getFile()))
+        MainFileBuffer = std::move(*Buffer);
+      IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS =
+          Files->getVirtualFileSystem();
+      if (MainFileBuffer)
+        Preamble = Cache->get(*Invocation, *MainFileBuffer, VFS,
+                              PCHContainerOps);
+      if (Preamble) {
+        Preamble->AddImplicitPreamble(*Invocation, VFS, MainFileBuffer.get());
+        // The file system may be overlaid to make the preamble visible.
+        if (VFS != Files->getVirtualFileSystem()) {
+          PreambleFiles = new FileManager(Files->getFileSystemOpts(), VFS);
+          Files = PreambleFiles.get();
+        }
+      }
+    }
+    return FrontendActionFactory::runInvocation(
+        Invocation, Files, PCHContainerOps, DiagConsumer);
+  }
+
+private:
+  class Action : public ASTFrontendAction {
+  public:
+    Action(ClangTidyASTConsumerFactory *Factory) : Factory(Factory) {}
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
+                                                   StringRef File) override {
+      return Factory->CreateASTConsumer(Compiler, File);
+    }
+
+  private:
+    ClangTidyASTConsumerFactory *Factory;
+  };
+
+  ClangTidyContext &Context;
+  ClangTidyASTConsumerFactory ConsumerFactory;
+};
+
+/// Runs the checks on \p InputFiles with one ClangTool, collecting the
+/// diagnostics in \p DiagConsumer.
+void runClangTidyTool(ClangTidyContext &Context,
+                      const CompilationDatabase &Compilations,
+                      ArrayRef<std::string> InputFiles,
+                      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                      ClangTidyDiagnosticConsumer &DiagConsumer) {
+  ClangTool Tool(Compilations, InputFiles,
+                 std::make_shared<PCHContainerOperations>(), BaseFS);
+  appendArgumentsAdjusters(Tool, Context);
   DiagnosticsEngine DE(new DiagnosticIDs(), new DiagnosticOptions(),
                        &DiagConsumer, /*ShouldOwnClient=*/false);
   Context.setDiagnosticsEngine(&DE);
   Tool.setDiagnosticConsumer(&DiagConsumer);
 
-  class ActionFactory : public FrontendActionFactory {
-  public:
-    ActionFactory(ClangTidyContext &Context) : ConsumerFactory(Context) {}
-    FrontendAction *create() override { return new Action(&ConsumerFactory); }
-
-    bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
-                       FileManager *Files,
-                       std::shared_ptr<PCHContainerOperations> PCHContainerOps,
-                       DiagnosticConsumer *DiagConsumer) override {
-      // Explicitly set ProgramAction to RunAnalysis to make the preprocessor
-      // define __clang_analyzer__ macro. The frontend analyzer action will not
-      // be called here.
-      Invocation->getFrontendOpts().ProgramAction = frontend::RunAnalysis;
-      return FrontendActionFactory::runInvocation(
-          Invocation, Files, PCHContainerOps, DiagConsumer);
+  ClangTidyActionFactory Factory(Context);
+  Tool.run(&Factory);
+}
+
+/// Returns the key of the results of \p File in a ClangTidyResultCache, or
+/// None if the file can't be preprocessed.
+llvm::Optional<std::string>
+computeResultKey(ClangTidyContext &Context,
+                 const CompilationDatabase &Compilations, StringRef File,
+                 llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS) {
+  llvm::SHA1 Hasher;
+  auto Update = [&](StringRef Data) {
+    Hasher.update(Data);
+    Hasher.update(StringRef("\0", 1));
+  };
+  Update(getClangToolFullVersion("clang-tidy"));
+  Update(configurationAsText(Context.getOptionsForFile(File)));
+  Update(Context.getMatchUserCodeOnly() ? "user-code" : "all-code");
+  Update(Context.getMatchChangedLinesOnly() ? "changed-lines" : "all-lines");
+  // The checks don't see the preprocessor callbacks of a preamble.
+  Update(Context.getPreambleCache() ? "preamble" : "no-preamble");
+  for (const FileFilter &Filter : Context.getGlobalOptions().LineFilter) {
+    Update(Filter.Name);
+    for (const FileFilter::LineRange &Range : Filter.LineRanges)
+      Update(llvm::formatv("{0}-{1}", Range.first, Range.second).str());
+  }
+
+  ClangTool Tool(Compilations, File, std::make_shared<PCHContainerOperations>(),
+                 BaseFS);
+  appendArgumentsAdjusters(Tool, Context);
+  Tool.appendArgumentsAdjuster(
+      [&](const CommandLineArguments &Args, StringRef Filename) {
+        for (const std::string &Arg : Args)
+          Update(Arg);
+        return Args;
+      });
+  for (const CompileCommand &Command : Compilations.getCompileCommands(File))
+    Update(Command.Directory);
+  // The diagnostics are reported by the run of the checks.
+  IgnoringDiagConsumer IgnoreDiags;
+  Tool.setDiagnosticConsumer(&IgnoreDiags);
+  if (Tool.run(ClangTidyResultCache::newHashingActionFactory(Hasher).get()))
+    return llvm::None;
+  return llvm::toHex(Hasher.final());
+}
+
+/// Runs the checks on \p File, or replays its results from \p Cache if none
+/// of the inputs of the translation unit changed.
+void runClangTidyCached(ClangTidyContext &Context,
+                        const CompilationDatabase &Compilations,
+                        const std::string &File,
+                        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                        ClangTidyDiagnosticConsumer &DiagConsumer,
+                        const ClangTidyResultCache &Cache) {
+  llvm::Optional<std::string> Key =
+      computeResultKey(Context, Compilations, File, BaseFS);
+  if (Key) {
+    std::vector<CompileCommand> Commands =
+        Compilations.getCompileCommands(File);
+    Context.setCurrentFile(File);
+    if (auto Cached = Cache.load(
+            *Key, Context,
+            Commands.empty() ? StringRef() : StringRef(Commands[0].Directory))) {
+      DiagConsumer.addErrors(std::move(Cached->Errors), Cached->Stats);
+      return;
     }
+  }
 
-  private:
-    class Action : public ASTFrontendAction {
-    public:
-      Action(ClangTidyASTConsumerFactory *Factory) : Factory(Factory) {}
-      std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
-                                                     StringRef File) override {
-        return Factory->CreateASTConsumer(Compiler, File);
+  ClangTidyStats Before = Context.getStats();
+  ClangTidyDiagnosticConsumer FileConsumer(Context,
+                                           /*RemoveIncompatibleErrors=*/false);
+  runClangTidyTool(Context, Compilations, File, BaseFS, FileConsumer);
+  ClangTidyResultCache::Result R;
+  R.Errors = FileConsumer.take();
+  // The results of the checks skipped by their time budgets vary between runs.
+  if (Key && !Context.hasChecksOverBudget()) {
+    const ClangTidyStats &After = Context.getStats();
+    R.Stats.ErrorsDisplayed = After.ErrorsDisplayed - Before.ErrorsDisplayed;
+    R.Stats.ErrorsIgnoredCheckFilter =
+        After.ErrorsIgnoredCheckFilter - Before.ErrorsIgnoredCheckFilter;
+    R.Stats.ErrorsIgnoredNOLINT =
+        After.ErrorsIgnoredNOLINT - Before.ErrorsIgnoredNOLINT;
+    R.Stats.ErrorsIgnoredNonUserCode =
+        After.ErrorsIgnoredNonUserCode - Before.ErrorsIgnoredNonUserCode;
+    R.Stats.ErrorsIgnoredLineFilter =
+        After.ErrorsIgnoredLineFilter - Before.ErrorsIgnoredLineFilter;
+    Cache.store(*Key, File, R);
+  }
+  // The stats are already counted in Context.
+  DiagConsumer.addErrors(std::move(R.Errors), ClangTidyStats());
+}
+
+/// Lets the contexts of several threads share an options provider, and the
+/// configuration files it caches. The thread-safe providers aren't locked.
+class SynchronizedOptionsProvider : public ClangTidyOptionsProvider {
+public:
+  SynchronizedOptionsProvider(ClangTidyOptionsProvider &Base, std::mutex &Mu)
+      : Base(Base), Mu(Mu) {}
+
+  const ClangTidyGlobalOptions &getGlobalOptions() override {
+    if (Base.isThreadSafe())
+      return Base.getGlobalOptions();
+    std::lock_guard<std::mutex> Lock(Mu);
+    return Base.getGlobalOptions();
+  }
+
+  std::vector<OptionsSource> getRawOptions(StringRef FileName) override {
+    if (Base.isThreadSafe())
+      return Base.getRawOptions(FileName);
+    std::lock_guard<std::mutex> Lock(Mu);
+    return Base.getRawOptions(FileName);
+  }
+
+  bool isThreadSafe() const override { return true; }
+
+private:
+  ClangTidyOptionsProvider &Base;
+  std::mutex &Mu;
+};
+
+/// Returns a context for another thread, sharing the options provider of
+/// \p Context, guarded by \p OptionsMu, and the state of its run.
+std::unique_ptr<ClangTidyContext>
+createThreadContext(ClangTidyContext &Context, std::mutex &OptionsMu,
+                    bool EnableCheckProfile, StringRef StoreCheckProfile) {
+  auto ThreadContext = llvm::make_unique<ClangTidyContext>(
+      llvm::make_unique<SynchronizedOptionsProvider>(
+          Context.getOptionsProvider(), OptionsMu),
+      Context.canEnableAnalyzerAlphaCheckers());
+  ThreadContext->setEnableProfiling(EnableCheckProfile);
+  ThreadContext->setProfileStoragePrefix(StoreCheckProfile);
+  ThreadContext->setMatchUserCodeOnly(Context.getMatchUserCodeOnly());
+  ThreadContext->setMatchChangedLinesOnly(Context.getMatchChangedLinesOnly());
+  ThreadContext->setHeaderOwners(Context.getHeaderOwners());
+  ThreadContext->setPreambleCache(Context.getPreambleCache());
+  ThreadContext->setProfileAggregator(Context.getProfileAggregator());
+  return ThreadContext;
+}
+
+/// Runs the checks on each translation unit of a ToolExecutor with its own
+/// context, and reports its results to the execution context of the executor.
+/// The executor may run several translation units at once.
+class ExecutorActionFactory : public FrontendActionFactory {
+public:
+  ExecutorActionFactory(ClangTidyContext &Context, std::mutex &OptionsMu,
+                        ExecutionContext &Results, bool EnableCheckProfile,
+                        StringRef StoreCheckProfile)
+      : Context(Context), OptionsMu(OptionsMu), Results(Results),
+        EnableCheckProfile(EnableCheckProfile),
+        StoreCheckProfile(StoreCheckProfile) {}
+
+  FrontendAction *create() override {
+    llvm_unreachable("the actions are created by runInvocation");
+  }
+
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    std::unique_ptr<ClangTidyContext> TUContext = createThreadContext(
+        Context, OptionsMu, EnableCheckProfile, StoreCheckProfile);
+    // Overlapping fixes may come from different translation units, they're
+    // only removed once the results are merged.
+    ClangTidyDiagnosticConsumer TUConsumer(*TUContext,
+                                           /*RemoveIncompatibleErrors=*/false);
+    DiagnosticsEngine DE(new DiagnosticIDs(), new DiagnosticOptions(),
+                         &TUConsumer, /*ShouldOwnClient=*/false);
+    TUContext->setDiagnosticsEngine(&DE);
+    ClangTidyActionFactory Factory(*TUContext);
+    bool Success = Factory.runInvocation(Invocation, Files, PCHContainerOps,
+                                         &TUConsumer);
+
+    ExecutorResult R;
+    const auto &Inputs = Invocation->getFrontendOpts().Inputs;
+    if (!Inputs.empty() && Inputs[0].isFile())
+      R.MainSourceFile = Inputs[0].getFile();
+    R.BuildDirectory = TUContext->getCurrentBuildDirectory();
+    for (ClangTidyError &Error : TUConsumer.take()) {
+      if (Error.DiagLevel == ClangTidyError::Warning)
+        R.Warnings.push_back(std::move(Error));
+      else
+        R.Errors.push_back(std::move(Error));
+    }
+    R.Stats = TUContext->getStats();
+    std::string Value;
+    {
+      llvm::raw_string_ostream OS(Value);
+      llvm::yaml::Output YAML(OS);
+      YAML << R;
+    }
+    Results.reportResult(R.MainSourceFile, Value);
+    return Success;
+  }
+
+private:
+  ClangTidyContext &Context;
+  std::mutex &OptionsMu;
+  ExecutionContext &Results;
+  bool EnableCheckProfile;
+  std::string StoreCheckProfile;
+};
+
+/// Statuses of files, including missing ones, shared by the threads.
+struct SharedStatCache {
+  std::mutex Mu;
+  llvm::StringMap<llvm::ErrorOr<llvm::vfs::Status>> Statuses;
+};
+
+/// A file opened through a StatCachingFileSystem, reporting the name it was
+/// opened with.
+class RenamedFile : public llvm::vfs::File {
+public:
+  RenamedFile(std::unique_ptr<llvm::vfs::File> Underlying, std::string Name)
+      : Underlying(std::move(Underlying)), Name(std::move(Name)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status() override {
+    auto S = Underlying->status();
+    if (!S)
+      return S;
+    return llvm::vfs::Status::copyWithNewName(*S, Name);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  getBuffer(const Twine &Name, int64_t FileSize, bool RequiresNullTerminator,
+            bool IsVolatile) override {
+    return Underlying->getBuffer(Name, FileSize, RequiresNullTerminator,
+                                 IsVolatile);
+  }
+
+  std::error_code close() override { return Underlying->close(); }
+
+private:
+  std::unique_ptr<llvm::vfs::File> Underlying;
+  std::string Name;
+};
+
+/// The file system of one thread, caching file statuses in a SharedStatCache.
+/// The underlying file system is shared with the other threads, so its working
+/// directory is never changed: each thread resolves relative paths against its
+/// own.
+class StatCachingFileSystem : public llvm::vfs::ProxyFileSystem {
+public:
+  StatCachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                        SharedStatCache &Cache)
+      : ProxyFileSystem(FS), Cache(Cache) {
+    if (auto WD = FS->getCurrentWorkingDirectory())
+      WorkingDirectory = *WD;
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const Twine &Path) override {
+    std::string Absolute = makeAbsolute(Path);
+    llvm::Optional<llvm::ErrorOr<llvm::vfs::Status>> S;
+    {
+      std::lock_guard<std::mutex> Lock(Cache.Mu);
+      auto It = Cache.Statuses.find(Absolute);
+      if (It != Cache.Statuses.end())
+        S = It->second;
+    }
+    if (!S) {
+      S = getUnderlyingFS().status(Absolute);
+      std::lock_guard<std::mutex> Lock(Cache.Mu);
+      Cache.Statuses.try_emplace(Absolute, *S);
+    }
+    if (!*S)
+      return S->getError();
+    return llvm::vfs::Status::copyWithNewName(**S, Path.str());
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const Twine &Path) override {
+    auto F = getUnderlyingFS().openFileForRead(makeAbsolute(Path));
+    if (!F)
+      return F;
+    return std::unique_ptr<llvm::vfs::File>(
+        new RenamedFile(std::move(*F), Path.str()));
+  }
+
+  llvm::vfs::directory_iterator dir_begin(const Twine &Dir,
+                                          std::error_code &EC) override {
+    return getUnderlyingFS().dir_begin(makeAbsolute(Dir), EC);
+  }
+
+  std::error_code getRealPath(const Twine &Path,
+                              SmallVectorImpl<char> &Output) const override {
+    return getUnderlyingFS().getRealPath(makeAbsolute(Path), Output);
+  }
+
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+    return WorkingDirectory;
+  }
+
+  std::error_code setCurrentWorkingDirectory(const Twine &Path) override {
+    WorkingDirectory = makeAbsolute(Path);
+    return std::error_code();
+  }
+
+private:
+  std::string makeAbsolute(const Twine &Path) const {
+    SmallString<256> Result;
+    Path.toVector(Result);
+    if (!llvm::sys::path::is_absolute(Result)) {
+      SmallString<256> Relative = std::move(Result);
+      Result = WorkingDirectory;
+      llvm::sys::path::append(Result, Relative);
+    }
+    llvm::sys::path::remove_dots(Result, /*remove_dot_dot=*/true);
+    return Result.str();
+  }
+
+  SharedStatCache &Cache;
+  std::string WorkingDirectory;
+};
+
+} // namespace
+
+std::vector<ClangTidyError>
+runClangTidy(clang::tidy::ClangTidyContext &Context,
+             const CompilationDatabase &Compilations,
+             ArrayRef<std::string> InputFiles,
+             llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+             bool EnableCheckProfile, llvm::StringRef StoreCheckProfile,
+             unsigned Threads, llvm::StringRef ResultCacheDirectory,
+             ClangTidyErrorSink *Sink) {
+  Context.setEnableProfiling(EnableCheckProfile);
+  Context.setProfileStoragePrefix(StoreCheckProfile);
+
+  llvm::Optional<ClangTidyResultCache> Cache;
+  if (!ResultCacheDirectory.empty()) {
+    Cache.emplace(ResultCacheDirectory);
+    // The stored results of a translation unit would miss the diagnostics of
+    // the headers owned by it in the run that stored them.
+    Context.setHeaderOwners(nullptr);
+  }
+  // Runs the files of one thread.
+  std::mutex SinkMu;
+  auto Run = [&](ClangTidyContext &Context, ArrayRef<std::string> Files,
+                 llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS,
+                 ClangTidyDiagnosticConsumer &DiagConsumer) {
+    if (!Cache && !Sink)
+      return runClangTidyTool(Context, Compilations, Files, FS, DiagConsumer);
+    for (const std::string &File : Files) {
+      if (!Sink) {
+        runClangTidyCached(Context, Compilations, File, FS, DiagConsumer,
+                           *Cache);
+        continue;
       }
+      // The stats are counted in Context, only the errors are passed on.
+      ClangTidyDiagnosticConsumer FileConsumer(Context);
+      if (Cache)
+        runClangTidyCached(Context, Compilations, File, FS, FileConsumer,
+                           *Cache);
+      else
+        runClangTidyTool(Context, Compilations, File, FS, FileConsumer);
+      std::vector<ClangTidyError> Errors = FileConsumer.take();
+      std::lock_guard<std::mutex> Lock(SinkMu);
+      Sink->handleErrors(File, std::move(Errors));
+    }
+  };
 
-    private:
-      ClangTidyASTConsumerFactory *Factory;
-    };
+  ClangTidyDiagnosticConsumer DiagConsumer(Context);
+  if (Threads <= 1 || InputFiles.size() <= 1) {
+    Run(Context, InputFiles, BaseFS, DiagConsumer);
+    return DiagConsumer.take();
+  }
 
-    ClangTidyASTConsumerFactory ConsumerFactory;
+  // Each thread has its own context and diagnostics, merged when all the files
+  // are processed. The thread contexts share the options of the main one.
+  std::mutex OptionsMu, ErrorsMu;
+  SharedStatCache StatCache;
+  std::atomic<size_t> NextFile(0);
+  auto Worker = [&] {
+    std::unique_ptr<ClangTidyContext> ThreadContext = createThreadContext(
+        Context, OptionsMu, EnableCheckProfile, StoreCheckProfile);
+    // Overlapping fixes may come from different threads, they're only removed
+    // once the errors are merged.
+    ClangTidyDiagnosticConsumer ThreadConsumer(
+        *ThreadContext, /*RemoveIncompatibleErrors=*/false);
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS(
+        new StatCachingFileSystem(BaseFS, StatCache));
+    for (size_t I = NextFile++; I < InputFiles.size(); I = NextFile++)
+      Run(*ThreadContext, InputFiles[I], FS, ThreadConsumer);
+    std::vector<ClangTidyError> Errors = ThreadConsumer.take();
+    std::lock_guard<std::mutex> Lock(ErrorsMu);
+    DiagConsumer.addErrors(std::move(Errors), ThreadContext->getStats());
   };
+  std::vector<std::thread> Pool;
+  for (size_t I = 0; I < std::min<size_t>(Threads, InputFiles.size()); ++I)
+    Pool.emplace_back(Worker);
+  for (std::thread &T : Pool)
+    T.join();
+  return DiagConsumer.take();
+}
 
-  ActionFactory Factory(Context);
-  Tool.run(&Factory);
+namespace {
+
+/// Writes the diagnostics of each file of a request to the client.
+class ServerErrorSink : public ClangTidyErrorSink {
+public:
+  ServerErrorSink(raw_ostream &Out) : Out(Out) {}
+
+  void handleErrors(StringRef MainFile,
+                    std::vector<ClangTidyError> Errors) override {
+    exportReplacements(MainFile, Errors, Out);
+    Out.flush();
+  }
+
+private:
+  raw_ostream &Out;
+};
+
+/// Reads a line of \p In into \p Line, without its line break. Returns false
+/// at the end of \p In.
+bool readLine(std::FILE *In, std::string &Line) {
+  Line.clear();
+  char Buffer[256];
+  while (std::fgets(Buffer, sizeof(Buffer), In)) {
+    Line += Buffer;
+    if (Line.back() == '\n') {
+      Line.pop_back();
+      if (!Line.empty() && Line.back() == '\r')
+        Line.pop_back();
+      return true;
+    }
+  }
+  return !Line.empty();
+}
+
+} // namespace
+
+void serveClangTidy(ClangTidyContext &Context,
+                    const CompilationDatabase &Compilations,
+                    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                    std::FILE *In, raw_ostream &Out, bool EnableCheckProfile,
+                    StringRef StoreCheckProfile, unsigned Threads,
+                    StringRef ResultCacheDirectory) {
+  ServerErrorSink Sink(Out);
+  std::vector<std::string> Files;
+  std::string Line;
+  bool More = true;
+  while (More) {
+    More = readLine(In, Line);
+    if (More && !StringRef(Line).trim().empty()) {
+      Files.push_back(Line);
+      continue;
+    }
+    if (Files.empty())
+      continue;
+    runClangTidy(Context, Compilations, Files, BaseFS, EnableCheckProfile,
+                 StoreCheckProfile, Threads, ResultCacheDirectory, &Sink);
+    Files.clear();
+  }
+}
+
+std::vector<ClangTidyError>
+runClangTidyWithExecutor(ClangTidyContext &Context, ToolExecutor &Executor,
+                         bool EnableCheckProfile, StringRef StoreCheckProfile) {
+  Context.setEnableProfiling(EnableCheckProfile);
+  Context.setProfileStoragePrefix(StoreCheckProfile);
+
+  // The arguments adjuster reads the options of the main context, which the
+  // contexts of the translation units share.
+  std::mutex OptionsMu;
+  ArgumentsAdjuster Adjuster = getArgumentsAdjuster(Context);
+  auto SynchronizedAdjuster = [&](const CommandLineArguments &Args,
+                                  StringRef Filename) {
+    std::lock_guard<std::mutex> Lock(OptionsMu);
+    return Adjuster(Args, Filename);
+  };
+  // The executor fails if any translation unit can't be compiled, the results
+  // of the others are still reported.
+  if (llvm::Error Err = Executor.execute(
+          llvm::make_unique<ExecutorActionFactory>(
+              Context, OptionsMu, *Executor.getExecutionContext(),
+              EnableCheckProfile, StoreCheckProfile),
+          SynchronizedAdjuster))
+    llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+
+  ClangTidyDiagnosticConsumer DiagConsumer(Context);
+  Executor.getToolResults()->forEachResult([&](StringRef Key,
+                                               StringRef Value) {
+    ExecutorResult R;
+    llvm::yaml::Input YAML(Value);
+    YAML >> R;
+    if (YAML.error()) {
+      llvm::errs() << "Invalid clang-tidy result for " << Key << "\n";
+      return;
+    }
+    // Whether warnings are treated as errors depends on the options of the
+    // main file.
+    Context.setCurrentFile(R.MainSourceFile);
+    std::vector<ClangTidyError> Errors;
+    auto Add = [&](std::vector<tooling::Diagnostic> &Diagnostics,
+                   ClangTidyError::Level Level) {
+      for (tooling::Diagnostic &D : Diagnostics) {
+        ClangTidyError Error(D.DiagnosticName, Level, R.BuildDirectory,
+                             Level == ClangTidyError::Warning &&
+                                 Context.treatAsError(D.DiagnosticName));
+        Error.Message = std::move(D.Message);
+        Error.Fix = std::move(D.Fix);
+        Error.Notes = std::move(D.Notes);
+        Errors.push_back(std::move(Error));
+      }
+    };
+    Add(R.Warnings, ClangTidyError::Warning);
+    Add(R.Errors, ClangTidyError::Error);
+    DiagConsumer.addErrors(std::move(Errors), R.Stats);
+  });
   return DiagConsumer.take();
 }
 
-void handleErrors(llvm::ArrayRef<ClangTidyError> Errors,
-                  ClangTidyContext &Context, bool Fix,
-                  unsigned &WarningsAsErrorsCount,
-                  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS) {
-  ErrorReporter Reporter(Context, Fix, BaseFS);
+static void reportErrors(ErrorReporter &Reporter,
+                         llvm::ArrayRef<ClangTidyError> Errors) {
   llvm::vfs::FileSystem &FileSystem =
       *Reporter.getSourceManager().getFileManager().getVirtualFileSystem();
   auto InitialWorkingDir = FileSystem.getCurrentWorkingDirectory();
@@ -617,13 +1472,76 @@ void handleErrors(llvm::ArrayRef<ClangTidyError> Errors,
     // Return to the initial directory to correctly resolve next Error.
     FileSystem.setCurrentWorkingDirectory(InitialWorkingDir.get());
   }
+}
+
+void handleErrors(llvm::ArrayRef<ClangTidyError> Errors,
+                  ClangTidyContext &Context, bool Fix,
+                  unsigned &WarningsAsErrorsCount,
+                  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                  unsigned Threads) {
+  ErrorReporter Reporter(Context, Fix, BaseFS, Threads);
+  reportErrors(Reporter, Errors);
   Reporter.Finish();
   WarningsAsErrorsCount += Reporter.getWarningsAsErrorsCount();
 }
 
+class ClangTidyStreamingReporter::Impl {
+public:
+  Impl(ClangTidyContext &Context,
+       llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+       raw_ostream *ExportFixes, ExportFixesFormat Format)
+      : Reporter(Context, /*ApplyFixes=*/false, BaseFS),
+        ExportFixes(ExportFixes), Format(Format), FoundErrors(false) {}
+
+  ErrorReporter Reporter;
+  raw_ostream *ExportFixes;
+  ExportFixesFormat Format;
+  // The hashes of the reported diagnostics, those of headers are reported by
+  // each translation unit including them.
+  llvm::DenseSet<uint64_t> Reported;
+  bool FoundErrors;
+};
+
+ClangTidyStreamingReporter::ClangTidyStreamingReporter(
+    ClangTidyContext &Context,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+    raw_ostream *ExportFixes, ExportFixesFormat Format)
+    : P(llvm::make_unique<Impl>(Context, BaseFS, ExportFixes, Format)) {}
+
+ClangTidyStreamingReporter::~ClangTidyStreamingReporter() = default;
+
+void ClangTidyStreamingReporter::handleErrors(
+    StringRef MainFile, std::vector<ClangTidyError> Errors) {
+  llvm::erase_if(Errors, [&](const ClangTidyError &Error) {
+    const tooling::DiagnosticMessage &M = Error.Message;
+    std::string Key = llvm::formatv("{0}:{1}:{2}", M.FilePath, M.FileOffset,
+                                    M.Message);
+    return !P->Reported.insert(llvm::xxHash64(Key)).second;
+  });
+  if (Errors.empty())
+    return;
+  for (const ClangTidyError &Error : Errors)
+    if (Error.DiagLevel == ClangTidyError::Error)
+      P->FoundErrors = true;
+  reportErrors(P->Reporter, Errors);
+  llvm::outs().flush();
+  if (P->ExportFixes) {
+    exportReplacements(MainFile, Errors, *P->ExportFixes, P->Format);
+    P->ExportFixes->flush();
+  }
+}
+
+unsigned ClangTidyStreamingReporter::getWarningsAsErrorsCount() const {
+  return P->Reporter.getWarningsAsErrorsCount();
+}
+
+bool ClangTidyStreamingReporter::foundErrors() const {
+  return P->FoundErrors;
+}
+
 void exportReplacements(const llvm::StringRef MainFilePath,
                         const std::vector<ClangTidyError> &Errors,
-                        raw_ostream &OS) {
+                        raw_ostream &OS, ExportFixesFormat Format) {
   TranslationUnitDiagnostics TUD;
   TUD.MainSourceFile = MainFilePath;
   for (const auto &Error : Errors) {
@@ -631,6 +1549,10 @@ void exportReplacements(const llvm::StringRef MainFilePath,
     TUD.Diagnostics.insert(TUD.Diagnostics.end(), Diag);
   }
 
+  if (Format == ExportFixesFormat::Binary) {
+    replace::writeBinaryReplacements(TUD, OS);
+    return;
+  }
   yaml::Output YAML(OS);
   YAML << TUD;
 }
@@ -10,6 +10,7 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDY_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDY_H
 
+#include "ClangTidyAllocations.h"
 #include "ClangTidyDiagnosticConsumer.h"
 #include "ClangTidyOptions.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
@@ -18,6 +19,8 @@
 #include "clang/Tooling/Refactoring.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <cstdio>
 #include <memory>
 #include <type_traits>
 #include <vector>
@@ -27,6 +30,7 @@ namespace clang {
 class CompilerInstance;
 namespace tooling {
 class CompilationDatabase;
+class ToolExecutor;
 }
 
 namespace tidy {
@@ -158,6 +162,15 @@ public:
   /// matches occur in the order of the AST traversal.
   virtual void registerMatchers(ast_matchers::MatchFinder *Finder) {}
 
+  /// \brief Override this to tell whether the check can find anything in the
+  /// translation unit of \p Context.
+  ///
+  /// This is called once the translation unit is parsed, before
+  /// ``registerMatchers``. The matchers of a check that returns false aren't
+  /// registered, so checks for a language or a library don't slow down the
+  /// other translation units. Use ``getLangOpts`` and ``mentionsIdentifier``.
+  virtual bool isApplicable(const ASTContext &Context) const { return true; }
+
   /// \brief ``ClangTidyChecks`` that register ASTMatchers should do the actual
   /// work in here.
   virtual void check(const ast_matchers::MatchFinder::MatchResult &Result) {}
@@ -173,11 +186,24 @@ public:
   /// whether it has the default value or it has been overridden.
   virtual void storeOptions(ClangTidyOptions::OptionMap &Options) {}
 
+  /// \brief Returns the number of matches handled by the check in the current
+  /// translation unit.
+  unsigned getMatchCount() const { return MatchCount; }
+
+  /// \brief Returns the heap allocations of the check in the current
+  /// translation unit, if allocation tracking is enabled.
+  const AllocationCount &getAllocations() const { return Allocations; }
+
 private:
   void run(const ast_matchers::MatchFinder::MatchResult &Result) override;
   StringRef getID() const override { return CheckName; }
   std::string CheckName;
   ClangTidyContext *Context;
+  unsigned MatchCount = 0;
+  AllocationCount Allocations;
+  std::chrono::steady_clock::duration CheckTime =
+      std::chrono::steady_clock::duration::zero();
+  bool OverBudget = false;
 
 protected:
   OptionsView Options;
@@ -185,6 +211,15 @@ protected:
   StringRef getCurrentMainFile() const { return Context->getCurrentFile(); }
   /// \brief Returns the language options from the context.
   LangOptions getLangOpts() const { return Context->getLangOpts(); }
+  /// \brief Returns the instance of \p T shared by all checks in the current
+  /// translation unit, see \c ClangTidyContext::getTranslationUnitCache.
+  template <typename T> T &getTranslationUnitCache() const {
+    return Context->getTranslationUnitCache<T>();
+  }
+  /// \brief Returns false if \p Name appears nowhere in the translation unit
+  /// of \p Context: in no identifier, macro name or keyword. With a
+  /// precompiled header, or a preamble, this is always true.
+  static bool mentionsIdentifier(const ASTContext &Context, StringRef Name);
 };
 
 class ClangTidyCheckFactories;
@@ -205,7 +240,8 @@ public:
 
 private:
   ClangTidyContext &Context;
-  std::unique_ptr<ClangTidyCheckFactories> CheckFactories;
+  // Shared by all the consumer factories of the process.
+  const ClangTidyCheckFactories *CheckFactories;
 };
 
 /// \brief Fills the list of check names that are enabled when the provided
@@ -223,6 +259,56 @@ ClangTidyOptions::OptionMap
 getCheckOptions(const ClangTidyOptions &Options,
                 bool AllowEnablingAnalyzerAlphaCheckers);
 
+/// \brief Receives the diagnostics of each translation unit of a run as soon
+/// as it's processed, instead of all of them once the run is finished.
+class ClangTidyErrorSink {
+public:
+  virtual ~ClangTidyErrorSink() {}
+
+  /// \brief Handles the \p Errors of the translation unit of \p MainFile. The
+  /// calls are serialized, also when the files are processed on several
+  /// threads.
+  virtual void handleErrors(StringRef MainFile,
+                            std::vector<ClangTidyError> Errors) = 0;
+};
+
+/// \brief The formats the fixes can be exported in.
+enum class ExportFixesFormat {
+  /// A TranslationUnitDiagnostics YAML document, with the messages.
+  YAML,
+  /// A record of the compact binary format of clang-apply-replacements,
+  /// holding only the fixes.
+  Binary
+};
+
+/// \brief Displays the diagnostics of each translation unit as it's
+/// processed, and appends them to \p ExportFixes if it's not null, in a YAML
+/// document or binary record per translation unit. The diagnostics of headers
+/// already reported by another translation unit are skipped. Doesn't apply
+/// fixes.
+class ClangTidyStreamingReporter : public ClangTidyErrorSink {
+public:
+  ClangTidyStreamingReporter(
+      ClangTidyContext &Context,
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+      raw_ostream *ExportFixes = nullptr,
+      ExportFixesFormat Format = ExportFixesFormat::YAML);
+  ~ClangTidyStreamingReporter() override;
+
+  void handleErrors(StringRef MainFile,
+                    std::vector<ClangTidyError> Errors) override;
+
+  /// \brief Returns the number of warnings reported as errors.
+  unsigned getWarningsAsErrorsCount() const;
+
+  /// \brief Returns true if compiler errors were reported.
+  bool foundErrors() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> P;
+};
+
 /// \brief Run a set of clang-tidy checks on a set of files.
 ///
 /// \param EnableCheckProfile If provided, it enables check profile collection
@@ -230,13 +316,62 @@ getCheckOptions(const ClangTidyOptions &Options,
 /// \param StoreCheckProfile If provided, and EnableCheckProfile is true,
 /// the profile will not be output to stderr, but will instead be stored
 /// as a JSON file in the specified directory.
+/// \param Threads If greater than 1, the files are processed on this many
+/// threads. Each thread has its own context forwarding to the options of
+/// \p Context, and the threads share a cache of file statuses.
+/// \param ResultCacheDirectory If provided, the results of each file are
+/// stored in a ClangTidyResultCache in this directory, and replayed from it
+/// when none of the inputs of the translation unit changed.
+/// \param Sink If provided, the diagnostics of each file are passed to it once
+/// the file is processed, and none are returned.
 std::vector<ClangTidyError>
 runClangTidy(clang::tidy::ClangTidyContext &Context,
              const tooling::CompilationDatabase &Compilations,
              ArrayRef<std::string> InputFiles,
              llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
              bool EnableCheckProfile = false,
-             llvm::StringRef StoreCheckProfile = StringRef());
+             llvm::StringRef StoreCheckProfile = StringRef(),
+             unsigned Threads = 1,
+             llvm::StringRef ResultCacheDirectory = StringRef(),
+             ClangTidyErrorSink *Sink = nullptr);
+
+/// \brief Runs a clang-tidy server for the clients checking files again and
+/// again, e.g. editors and pre-commit hooks.
+///
+/// Each request read from \p In is the paths of the files to check, one per
+/// line, followed by an empty line or the end of \p In. The files of a request
+/// are run as by \c runClangTidy, and the diagnostics and fixes of each one
+/// are written to \p Out as a YAML document, in the format of
+/// \c exportReplacements, as soon as the file is processed. Files without
+/// diagnostics get an empty document, so that there is one per requested
+/// file. Returns at the end of \p In.
+///
+/// The check factories, the options provider of \p Context, its preamble
+/// cache and \p Compilations are kept between the requests. The file statuses
+/// shared by the threads are only kept during a request, as files change
+/// between requests.
+void serveClangTidy(ClangTidyContext &Context,
+                    const tooling::CompilationDatabase &Compilations,
+                    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                    std::FILE *In, raw_ostream &Out,
+                    bool EnableCheckProfile = false,
+                    llvm::StringRef StoreCheckProfile = StringRef(),
+                    unsigned Threads = 1,
+                    llvm::StringRef ResultCacheDirectory = StringRef());
+
+/// \brief Run a set of clang-tidy checks on the translation units of
+/// \p Executor, e.g. all those of a compilation database, in this process or
+/// in others.
+///
+/// Each translation unit has its own context forwarding to the options of
+/// \p Context. Its diagnostics and stats are reported to the execution context
+/// of \p Executor as a YAML document keyed by the main file, and the results
+/// of all translation units are merged once they're processed.
+std::vector<ClangTidyError>
+runClangTidyWithExecutor(ClangTidyContext &Context,
+                         tooling::ToolExecutor &Executor,
+                         bool EnableCheckProfile = false,
+                         llvm::StringRef StoreCheckProfile = StringRef());
 
 // FIXME: This interface will need to be significantly extended to be useful.
 // FIXME: Implement confidence levels for displaying/fixing errors.
@@ -244,16 +379,19 @@ runClangTidy(clang::tidy::ClangTidyContext &Context,
 /// \brief Displays the found \p Errors to the users. If \p Fix is true, \p
 /// Errors containing fixes are automatically applied and reformatted. If no
 /// clang-format configuration file is found, the given \P FormatStyle is used.
+/// The fixed files are formatted and written on up to \p Threads threads.
 void handleErrors(llvm::ArrayRef<ClangTidyError> Errors,
                   ClangTidyContext &Context, bool Fix,
                   unsigned &WarningsAsErrorsCount,
-                  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS);
+                  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> BaseFS,
+                  unsigned Threads = 1);
 
-/// \brief Serializes replacements into YAML and writes them to the specified
-/// output stream.
+/// \brief Serializes replacements into YAML, or into the compact binary format
+/// of clang-apply-replacements, and writes them to the specified output stream.
 void exportReplacements(StringRef MainFilePath,
                         const std::vector<ClangTidyError> &Errors,
-                        raw_ostream &OS);
+                        raw_ostream &OS,
+                        ExportFixesFormat Format = ExportFixesFormat::YAML);
 
 } // end namespace tidy
 } // end namespace clang
@@ -0,0 +1,51 @@
+//===--- ClangTidyAllocations.cpp - clang-tidy ------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidyAllocations.h"
+#include "llvm/Support/Compiler.h"
+#include <atomic>
+
+namespace clang {
+namespace tidy {
+
+static std::atomic<bool> TrackingEnabled(false);
+// The innermost scope of each thread.
+static LLVM_THREAD_LOCAL AllocationScope *CurrentScope = nullptr;
+
+void enableAllocationTracking() { TrackingEnabled = true; }
+
+bool allocationTrackingEnabled() {
+  return TrackingEnabled.load(std::memory_order_relaxed);
+}
+
+AllocationScope::AllocationScope(AllocationCount &Count)
+    : Count(Count), Start(Count), Parent(CurrentScope) {
+  CurrentScope = this;
+}
+
+AllocationScope::~AllocationScope() {
+  CurrentScope = Parent;
+  if (!Parent)
+    return;
+  Parent->Count.Bytes += Count.Bytes - Start.Bytes;
+  Parent->Count.Calls += Count.Calls - Start.Calls;
+}
+
+void AllocationScope::recordAllocation(size_t Size) {
+  // Scopes are only created while tracking is enabled, but this is cheaper.
+  if (!TrackingEnabled.load(std::memory_order_relaxed))
+    return;
+  if (AllocationScope *Scope = CurrentScope) {
+    Scope->Count.Bytes += Size;
+    ++Scope->Count.Calls;
+  }
+}
+
+} // end namespace tidy
+} // end namespace clang
@@ -0,0 +1,73 @@
+//===--- ClangTidyAllocations.h - clang-tidy --------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Counts the heap allocations of the operations of a tool, e.g. of each
+// clang-tidy check or of each clangd trace span, so that allocation
+// regressions show up in the same profiles as time regressions.
+//
+// Allocations are counted by replacing the global operator new, which a tool
+// does by including ClangTidyAllocationHooks.inc in one of its source files.
+// Memory allocated with malloc() directly, like the slabs of
+// llvm::BumpPtrAllocator, isn't counted.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYALLOCATIONS_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYALLOCATIONS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace clang {
+namespace tidy {
+
+/// \brief The number and total size of heap allocations.
+struct AllocationCount {
+  uint64_t Bytes = 0;
+  uint64_t Calls = 0;
+
+  AllocationCount &operator+=(const AllocationCount &Other) {
+    Bytes += Other.Bytes;
+    Calls += Other.Calls;
+    return *this;
+  }
+};
+
+/// \brief Starts counting allocations. Only has an effect in tools that
+/// include ClangTidyAllocationHooks.inc.
+void enableAllocationTracking();
+/// \brief Whether enableAllocationTracking() was called.
+bool allocationTrackingEnabled();
+
+/// \brief Adds the allocations of the current thread to a count while alive.
+/// Scopes nest: the allocations of an inner scope are also added to the
+/// outer ones when it ends, the way timings of nested operations are
+/// inclusive.
+class AllocationScope {
+public:
+  explicit AllocationScope(AllocationCount &Count);
+  ~AllocationScope();
+  AllocationScope(const AllocationScope &) = delete;
+  AllocationScope &operator=(const AllocationScope &) = delete;
+
+  /// \brief Called by the hooks for each allocation.
+  static void recordAllocation(size_t Size);
+
+private:
+  AllocationCount &Count;
+  // The count when the scope started, only what was added since is added to
+  // Parent.
+  AllocationCount Start;
+  AllocationScope *Parent;
+};
+
+} // end namespace tidy
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYALLOCATIONS_H
@@ -23,6 +23,8 @@
 #include "clang/Frontend/DiagnosticRenderer.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Process.h"
+#include <iterator>
 #include <tuple>
 #include <vector>
 using namespace clang;
@@ -142,17 +144,21 @@ static llvm::Regex ConsumeGlob(StringRef &GlobList) {
   return llvm::Regex(RegexText);
 }
 
-GlobList::GlobList(StringRef Globs)
-    : Positive(!ConsumeNegativeIndicator(Globs)), Regex(ConsumeGlob(Globs)),
-      NextGlob(Globs.empty() ? nullptr : new GlobList(Globs)) {}
-
-bool GlobList::contains(StringRef S, bool Contains) {
-  if (Regex.match(S))
-    Contains = Positive;
+GlobList::GlobList(StringRef Globs) {
+  do {
+    GlobListItem Item;
+    Item.IsPositive = !ConsumeNegativeIndicator(Globs);
+    Item.Regex = ConsumeGlob(Globs);
+    Items.push_back(std::move(Item));
+  } while (!Globs.empty());
+}
 
-  if (NextGlob)
-    Contains = NextGlob->contains(S, Contains);
-  return Contains;
+bool GlobList::contains(StringRef S) {
+  // The last matching glob decides, so stop at the first one from the end.
+  for (GlobListItem &Item : llvm::reverse(Items))
+    if (Item.Regex.match(S))
+      return Item.IsPositive;
+  return false;
 }
 
 class ClangTidyContext::CachedGlobList {
@@ -176,11 +182,27 @@ private:
   llvm::StringMap<Tristate> Cache;
 };
 
+bool ClangTidyHeaderOwners::claim(StringRef Header, StringRef MainFile) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto R = Owners.try_emplace(Header, MainFile);
+  if (R.second)
+    return true;
+  // A later translation unit may have claimed the header first, its
+  // diagnostics in the header are duplicates of ours.
+  if (MainFile > R.first->second)
+    return false;
+  R.first->second = MainFile;
+  return true;
+}
+
 ClangTidyContext::ClangTidyContext(
     std::unique_ptr<ClangTidyOptionsProvider> OptionsProvider,
     bool AllowEnablingAnalyzerAlphaCheckers)
     : DiagEngine(nullptr), OptionsProvider(std::move(OptionsProvider)),
-      Profile(false),
+      Profile(false), MatchUserCodeOnly(false), MatchChangedLinesOnly(false),
+      HeaderOwners(nullptr), PreambleCache(nullptr), ProfileAggregator(nullptr),
+      HasBudgets(false), TranslationUnitOverBudget(false),
+      ChecksOverBudget(false), BudgetTime(0), BudgetStartMallocUsage(0),
       AllowEnablingAnalyzerAlphaCheckers(AllowEnablingAnalyzerAlphaCheckers) {
   // Before the first translation unit we can get errors related to command-line
   // parsing, use empty string for the file name in this case.
@@ -199,6 +221,53 @@ DiagnosticBuilder ClangTidyContext::diag(
   return DiagEngine->Report(Loc, ID);
 }
 
+void ClangTidyContext::startBudgets() {
+  const ClangTidyOptions &Options = getOptions();
+  HasBudgets = Options.CheckTimeBudget || Options.TranslationUnitTimeBudget ||
+               Options.TranslationUnitMemoryBudget;
+  TranslationUnitOverBudget = false;
+  ChecksOverBudget = false;
+  BudgetTime = std::chrono::steady_clock::duration::zero();
+  if (Options.TranslationUnitMemoryBudget)
+    BudgetStartMallocUsage = llvm::sys::Process::GetMallocUsage();
+}
+
+bool ClangTidyContext::spendBudget(
+    StringRef CheckName, SourceLocation Loc,
+    std::chrono::steady_clock::duration Time,
+    std::chrono::steady_clock::duration CheckTime) {
+  const ClangTidyOptions &Options = getOptions();
+  BudgetTime += Time;
+  if (Options.TranslationUnitTimeBudget &&
+      BudgetTime >
+          std::chrono::milliseconds(*Options.TranslationUnitTimeBudget)) {
+    diag(CheckName, Loc, "translation unit exceeded its time budget of %0 ms, "
+                         "skipping all checks for the rest of it")
+        << *Options.TranslationUnitTimeBudget;
+    TranslationUnitOverBudget = true;
+  } else if (Options.TranslationUnitMemoryBudget &&
+             llvm::sys::Process::GetMallocUsage() >
+                 BudgetStartMallocUsage +
+                     (size_t(*Options.TranslationUnitMemoryBudget) << 20)) {
+    diag(CheckName, Loc,
+         "translation unit exceeded its memory budget of %0 MB, skipping all "
+         "checks for the rest of it")
+        << *Options.TranslationUnitMemoryBudget;
+    TranslationUnitOverBudget = true;
+  } else if (Options.CheckTimeBudget &&
+             CheckTime > std::chrono::milliseconds(*Options.CheckTimeBudget)) {
+    diag(CheckName, Loc, "check exceeded its time budget of %0 ms, skipping it "
+                         "for the rest of the translation unit")
+        << *Options.CheckTimeBudget;
+    ChecksOverBudget = true;
+    return false;
+  }
+  if (!TranslationUnitOverBudget)
+    return true;
+  ChecksOverBudget = true;
+  return false;
+}
+
 void ClangTidyContext::setSourceManager(SourceManager *SourceMgr) {
   DiagEngine->setSourceManager(SourceMgr);
 }
@@ -290,92 +359,108 @@ void ClangTidyDiagnosticConsumer::finalizeLastError() {
   LastErrorPassesLineFilter = false;
 }
 
-static bool IsNOLINTFound(StringRef NolintDirectiveText, StringRef Line,
-                          unsigned DiagID, const ClangTidyContext &Context) {
-  const size_t NolintIndex = Line.find(NolintDirectiveText);
-  if (NolintIndex == StringRef::npos)
-    return false;
-
-  size_t BracketIndex = NolintIndex + NolintDirectiveText.size();
+// Parses the check list following a NOLINT directive ending at \p Pos, up to
+// the end of its line.
+static void parseNOLINTChecks(StringRef Buffer, size_t Pos, bool &AllChecks,
+                              SmallVectorImpl<StringRef> &Checks) {
+  AllChecks = true;
   // Check if the specific checks are specified in brackets.
-  if (BracketIndex < Line.size() && Line[BracketIndex] == '(') {
-    ++BracketIndex;
-    const size_t BracketEndIndex = Line.find(')', BracketIndex);
-    if (BracketEndIndex != StringRef::npos) {
-      StringRef ChecksStr =
-          Line.substr(BracketIndex, BracketEndIndex - BracketIndex);
-      // Allow disabling all the checks with "*".
-      if (ChecksStr != "*") {
-        StringRef CheckName = Context.getCheckName(DiagID);
-        // Allow specifying a few check names, delimited with comma.
-        SmallVector<StringRef, 1> Checks;
-        ChecksStr.split(Checks, ',', -1, false);
-        llvm::transform(Checks, Checks.begin(),
-                        [](StringRef S) { return S.trim(); });
-        return llvm::find(Checks, CheckName) != Checks.end();
-      }
-    }
-  }
-  return true;
+  if (Pos >= Buffer.size() || Buffer[Pos] != '(')
+    return;
+  ++Pos;
+  const size_t BracketEndIndex = Buffer.find_first_of(")\r\n", Pos);
+  if (BracketEndIndex == StringRef::npos || Buffer[BracketEndIndex] != ')')
+    return;
+  StringRef ChecksStr = Buffer.substr(Pos, BracketEndIndex - Pos);
+  // Allow disabling all the checks with "*".
+  if (ChecksStr == "*")
+    return;
+  AllChecks = false;
+  // Allow specifying a few check names, delimited with comma.
+  ChecksStr.split(Checks, ',', -1, false);
+  llvm::transform(Checks, Checks.begin(), [](StringRef S) { return S.trim(); });
 }
 
-static bool LineIsMarkedWithNOLINT(SourceManager &SM, SourceLocation Loc,
-                                   unsigned DiagID,
-                                   const ClangTidyContext &Context) {
-  bool Invalid;
-  const char *CharacterData = SM.getCharacterData(Loc, &Invalid);
-  if (Invalid)
-    return false;
-
-  // Check if there's a NOLINT on this line.
-  const char *P = CharacterData;
-  while (*P != '\0' && *P != '\r' && *P != '\n')
-    ++P;
-  StringRef RestOfLine(CharacterData, P - CharacterData + 1);
-  if (IsNOLINTFound("NOLINT", RestOfLine, DiagID, Context))
-    return true;
-
-  // Check if there's a NOLINTNEXTLINE on the previous line.
-  const char *BufBegin =
-      SM.getCharacterData(SM.getLocForStartOfFile(SM.getFileID(Loc)), &Invalid);
-  if (Invalid || P == BufBegin)
-    return false;
-
-  // Scan backwards over the current line.
-  P = CharacterData;
-  while (P != BufBegin && *P != '\n')
-    --P;
-
-  // If we reached the begin of the file there is no line before it.
-  if (P == BufBegin)
-    return false;
-
-  // Skip over the newline.
-  --P;
-  const char *LineEnd = P;
-
-  // Now we're on the previous line. Skip to the beginning of it.
-  while (P != BufBegin && *P != '\n')
-    --P;
-
-  RestOfLine = StringRef(P, LineEnd - P + 1);
-  if (IsNOLINTFound("NOLINTNEXTLINE", RestOfLine, DiagID, Context))
-    return true;
+ArrayRef<ClangTidyDiagnosticConsumer::NOLINTComment>
+ClangTidyDiagnosticConsumer::getNOLINTComments(FileID File,
+                                               const SourceManager &Sources) {
+  // The file IDs and the buffers belong to the source manager.
+  if (&Sources != NOLINTSources) {
+    NOLINTComments.clear();
+    NOLINTSources = &Sources;
+  }
+  auto Inserted = NOLINTComments.try_emplace(File);
+  std::vector<NOLINTComment> &Comments = Inserted.first->second;
+  if (!Inserted.second)
+    return Comments;
 
-  return false;
+  bool Invalid = false;
+  StringRef Buffer = Sources.getBufferData(File, &Invalid);
+  if (Invalid)
+    return Comments;
+  const StringRef NOLINT = "NOLINT";
+  const StringRef NextLine = "NEXTLINE";
+  for (size_t Pos = Buffer.find(NOLINT); Pos != StringRef::npos;
+       Pos = Buffer.find(NOLINT, Pos + NOLINT.size())) {
+    NOLINTComment Comment;
+    Comment.Offset = Pos;
+    Comment.Line = Sources.getLineNumber(File, Pos);
+    size_t End = Pos + NOLINT.size();
+    Comment.NextLine = Buffer.substr(End).startswith(NextLine);
+    if (Comment.NextLine)
+      End += NextLine.size();
+    parseNOLINTChecks(Buffer, End, Comment.AllChecks, Comment.Checks);
+    Comments.push_back(std::move(Comment));
+  }
+  return Comments;
 }
 
-static bool LineIsMarkedWithNOLINTinMacro(SourceManager &SM, SourceLocation Loc,
-                                          unsigned DiagID,
-                                          const ClangTidyContext &Context) {
+bool ClangTidyDiagnosticConsumer::lineIsMarkedWithNOLINT(
+    SourceLocation Location, unsigned DiagID, const SourceManager &Sources) {
+  auto Suppresses = [&](const NOLINTComment &Comment) {
+    return Comment.AllChecks ||
+           llvm::is_contained(Comment.Checks, Context.getCheckName(DiagID));
+  };
+
   while (true) {
-    if (LineIsMarkedWithNOLINT(SM, Loc, DiagID, Context))
-      return true;
-    if (!Loc.isMacroID())
+    std::pair<FileID, unsigned> Decomposed =
+        Sources.getDecomposedSpellingLoc(Location);
+    ArrayRef<NOLINTComment> Comments =
+        getNOLINTComments(Decomposed.first, Sources);
+    if (!Comments.empty()) {
+      unsigned Line = Sources.getLineNumber(Decomposed.first,
+                                            Decomposed.second);
+      // Check if there's a NOLINT after the location on its line. The first
+      // one decides, and a NOLINTNEXTLINE suppresses its own line as well.
+      auto It = std::lower_bound(
+          Comments.begin(), Comments.end(), Decomposed.second,
+          [](const NOLINTComment &C, unsigned Offset) {
+            return C.Offset < Offset;
+          });
+      if (It != Comments.end() && It->Line == Line &&
+          (It->NextLine || Suppresses(*It)))
+        return true;
+
+      // Check if there's a NOLINTNEXTLINE on the previous line.
+      It = std::lower_bound(Comments.begin(), Comments.end(), Line - 1,
+                            [](const NOLINTComment &C, unsigned PrevLine) {
+                              return C.Line < PrevLine;
+                            });
+      It = std::find_if(It, Comments.end(), [&](const NOLINTComment &C) {
+        return C.Line != Line - 1 || C.NextLine;
+      });
+      if (It != Comments.end() && It->Line == Line - 1 && Suppresses(*It))
+        return true;
+    }
+    if (!Location.isMacroID())
       return false;
-    Loc = SM.getImmediateExpansionRange(Loc).getBegin();
+    Location = Sources.getImmediateExpansionRange(Location).getBegin();
   }
-  return false;
+}
+
+void ClangTidyDiagnosticConsumer::EndSourceFile() {
+  NOLINTComments.clear();
+  NOLINTSources = nullptr;
 }
 
 void ClangTidyDiagnosticConsumer::HandleDiagnostic(
@@ -385,9 +470,8 @@ void ClangTidyDiagnosticConsumer::HandleDiagnostic(
 
   if (Info.getLocation().isValid() && DiagLevel != DiagnosticsEngine::Error &&
       DiagLevel != DiagnosticsEngine::Fatal &&
-      LineIsMarkedWithNOLINTinMacro(Info.getSourceManager(),
-                                    Info.getLocation(), Info.getID(),
-                                    Context)) {
+      lineIsMarkedWithNOLINT(Info.getLocation(), Info.getID(),
+                             Info.getSourceManager())) {
     ++Context.Stats.ErrorsIgnoredNOLINT;
     // Ignored a warning, should ignore related notes as well
     LastErrorWasIgnored = true;
@@ -457,22 +541,53 @@ void ClangTidyDiagnosticConsumer::HandleDiagnostic(
     checkFilters(Info.getLocation(), Info.getSourceManager());
 }
 
+bool ClangTidyDiagnosticConsumer::passesHeaderFilter(StringRef FileName) {
+  auto Inserted = HeaderFilterResults.try_emplace(FileName, false);
+  if (Inserted.second)
+    Inserted.first->second = getHeaderFilter()->match(FileName);
+  return Inserted.first->second;
+}
+
 bool ClangTidyDiagnosticConsumer::passesLineFilter(StringRef FileName,
-                                                   unsigned LineNumber) const {
+                                                   unsigned LineNumber) {
   if (Context.getGlobalOptions().LineFilter.empty())
     return true;
-  for (const FileFilter &Filter : Context.getGlobalOptions().LineFilter) {
-    if (FileName.endswith(Filter.Name)) {
-      if (Filter.LineRanges.empty())
-        return true;
+
+  auto Inserted = LineFilters.try_emplace(FileName);
+  FileLineFilter &Filter = Inserted.first->second;
+  if (Inserted.second) {
+    // The first entry matching the file name decides.
+    const auto &Filters = Context.getGlobalOptions().LineFilter;
+    auto It = llvm::find_if(Filters, [&](const FileFilter &Entry) {
+      return FileName.endswith(Entry.Name);
+    });
+    Filter.Matches = It != Filters.end();
+    if (Filter.Matches) {
+      Filter.LineRanges = It->LineRanges;
+      llvm::sort(Filter.LineRanges.begin(), Filter.LineRanges.end());
+      // Merge the overlapping ranges, so that the start and end lines are both
+      // increasing.
+      std::vector<FileFilter::LineRange> Merged;
       for (const FileFilter::LineRange &Range : Filter.LineRanges) {
-        if (Range.first <= LineNumber && LineNumber <= Range.second)
-          return true;
+        if (!Merged.empty() && Range.first <= Merged.back().second)
+          Merged.back().second = std::max(Merged.back().second, Range.second);
+        else
+          Merged.push_back(Range);
       }
-      return false;
+      Filter.LineRanges = std::move(Merged);
     }
   }
-  return false;
+
+  if (!Filter.Matches)
+    return false;
+  if (Filter.LineRanges.empty())
+    return true;
+  auto It = std::upper_bound(
+      Filter.LineRanges.begin(), Filter.LineRanges.end(), LineNumber,
+      [](unsigned Line, const FileFilter::LineRange &Range) {
+        return Line < Range.first;
+      });
+  return It != Filter.LineRanges.begin() && LineNumber <= std::prev(It)->second;
 }
 
 void ClangTidyDiagnosticConsumer::checkFilters(SourceLocation Location,
@@ -505,7 +620,7 @@ void ClangTidyDiagnosticConsumer::checkFilters(SourceLocation Location,
   StringRef FileName(File->getName());
   LastErrorRelatesToUserCode = LastErrorRelatesToUserCode ||
                                Sources.isInMainFile(Location) ||
-                               getHeaderFilter()->match(FileName);
+                               passesHeaderFilter(FileName);
 
   unsigned LineNumber = Sources.getExpansionLineNumber(Location);
   LastErrorPassesLineFilter =
@@ -657,8 +772,23 @@ struct EqualClangTidyError {
 };
 } // end anonymous namespace
 
+void ClangTidyDiagnosticConsumer::addErrors(std::vector<ClangTidyError> Added,
+                                            const ClangTidyStats &Stats) {
+  AddedErrors.insert(AddedErrors.end(), std::make_move_iterator(Added.begin()),
+                     std::make_move_iterator(Added.end()));
+  Context.Stats.ErrorsDisplayed += Stats.ErrorsDisplayed;
+  Context.Stats.ErrorsIgnoredCheckFilter += Stats.ErrorsIgnoredCheckFilter;
+  Context.Stats.ErrorsIgnoredNOLINT += Stats.ErrorsIgnoredNOLINT;
+  Context.Stats.ErrorsIgnoredNonUserCode += Stats.ErrorsIgnoredNonUserCode;
+  Context.Stats.ErrorsIgnoredLineFilter += Stats.ErrorsIgnoredLineFilter;
+}
+
 std::vector<ClangTidyError> ClangTidyDiagnosticConsumer::take() {
   finalizeLastError();
+  // The added errors were finalized by their consumers.
+  Errors.insert(Errors.end(), std::make_move_iterator(AddedErrors.begin()),
+                std::make_move_iterator(AddedErrors.end()));
+  AddedErrors.clear();
 
   std::sort(Errors.begin(), Errors.end(), LessClangTidyError());
   Errors.erase(std::unique(Errors.begin(), Errors.end(), EqualClangTidyError()),
@@ -17,9 +17,12 @@
 #include "clang/Tooling/Core/Diagnostic.h"
 #include "clang/Tooling/Refactoring.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Regex.h"
 #include "llvm/Support/Timer.h"
+#include <chrono>
+#include <mutex>
 
 namespace clang {
 
@@ -34,6 +37,9 @@ class CompilationDatabase;
 
 namespace tidy {
 
+class ClangTidyPreambleCache;
+class ClangTidyProfileAggregator;
+
 /// \brief A detected error complete with information to display diagnostic and
 /// automatic fix.
 ///
@@ -59,14 +65,14 @@ public:
 
   /// \brief Returns \c true if the pattern matches \p S. The result is the last
   /// matching glob's Positive flag.
-  bool contains(StringRef S) { return contains(S, false); }
+  bool contains(StringRef S);
 
 private:
-  bool contains(StringRef S, bool Contains);
-
-  bool Positive;
-  llvm::Regex Regex;
-  std::unique_ptr<GlobList> NextGlob;
+  struct GlobListItem {
+    bool IsPositive;
+    llvm::Regex Regex;
+  };
+  std::vector<GlobListItem> Items;
 };
 
 /// \brief Contains displayed and ignored diagnostic counters for a ClangTidy
@@ -88,6 +94,31 @@ struct ClangTidyStats {
   }
 };
 
+/// \brief Records which translation unit of a run analyzes each header, so
+/// that the other translation units including it skip its declarations.
+///
+/// A header is owned by the main file with the smallest name among those that
+/// claimed it, so the owners don't depend on the order in which the
+/// translation units are processed. Can be shared by several threads.
+class ClangTidyHeaderOwners {
+public:
+  /// \brief Returns \c true if \p MainFile analyzes \p Header, which
+  /// identifies both the path and the contents of the header.
+  bool claim(StringRef Header, StringRef MainFile);
+
+private:
+  std::mutex Mu;
+  llvm::StringMap<std::string> Owners;
+};
+
+/// \brief Base of the data computed by a check or a utility, and shared by all
+/// checks in a translation unit. See \c
+/// ClangTidyContext::getTranslationUnitCache.
+class ClangTidyTranslationUnitCache {
+public:
+  virtual ~ClangTidyTranslationUnitCache() {}
+};
+
 /// \brief Every \c ClangTidyCheck reports errors through a \c DiagnosticsEngine
 /// provided by this context.
 ///
@@ -175,6 +206,84 @@ public:
   llvm::Optional<ClangTidyProfiling::StorageParams>
   getProfileStorageParams() const;
 
+  /// \brief Control whether the matchers only traverse the top-level
+  /// declarations of the main file and the headers matching the header filter.
+  void setMatchUserCodeOnly(bool MatchUserCodeOnly) {
+    this->MatchUserCodeOnly = MatchUserCodeOnly;
+  }
+  bool getMatchUserCodeOnly() const { return MatchUserCodeOnly; }
+
+  /// \brief Control whether the matchers only traverse the declarations
+  /// containing lines of the line filter. Implies \c MatchUserCodeOnly.
+  void setMatchChangedLinesOnly(bool MatchChangedLinesOnly) {
+    this->MatchChangedLinesOnly = MatchChangedLinesOnly;
+  }
+  bool getMatchChangedLinesOnly() const { return MatchChangedLinesOnly; }
+
+  /// \brief Sets the owners of the headers shared by the translation units of
+  /// the run, or \c nullptr to analyze the headers in each translation unit.
+  void setHeaderOwners(ClangTidyHeaderOwners *HeaderOwners) {
+    this->HeaderOwners = HeaderOwners;
+  }
+  ClangTidyHeaderOwners *getHeaderOwners() const { return HeaderOwners; }
+
+  /// \brief Sets the cache of the preambles shared by the translation units of
+  /// the run, or \c nullptr to parse the headers of each translation unit.
+  void setPreambleCache(ClangTidyPreambleCache *PreambleCache) {
+    this->PreambleCache = PreambleCache;
+  }
+  ClangTidyPreambleCache *getPreambleCache() const { return PreambleCache; }
+
+  /// \brief Sets the aggregator summing the check profiles of the translation
+  /// units of the run, or \c nullptr to print the profile of each. Only used
+  /// when profiling is enabled.
+  void setProfileAggregator(ClangTidyProfileAggregator *ProfileAggregator) {
+    this->ProfileAggregator = ProfileAggregator;
+  }
+  ClangTidyProfileAggregator *getProfileAggregator() const {
+    return ProfileAggregator;
+  }
+
+  /// \brief Returns the instance of \p T shared by the checks in the current
+  /// translation unit, default-constructing it on first use. \p T derives
+  /// from \c ClangTidyTranslationUnitCache and is identified by the address
+  /// of its static \c ID member.
+  template <typename T> T &getTranslationUnitCache() {
+    std::unique_ptr<ClangTidyTranslationUnitCache> &Cache =
+        TranslationUnitCaches[&T::ID];
+    if (!Cache)
+      Cache = llvm::make_unique<T>();
+    return static_cast<T &>(*Cache);
+  }
+
+  /// \brief Destroys the caches of the translation unit, once its AST is
+  /// processed.
+  void clearTranslationUnitCaches() { TranslationUnitCaches.clear(); }
+
+  /// \brief Starts measuring the time and memory budgets of the checks in the
+  /// current translation unit.
+  void startBudgets();
+
+  /// \brief Returns true if the options of the current translation unit set
+  /// budgets to the checks, and they're measured.
+  bool hasBudgets() const { return HasBudgets; }
+
+  /// \brief Adds the time \p CheckName spent handling a match to the budgets
+  /// of the current translation unit, \p CheckTime being its total time in the
+  /// translation unit. Reports at \p Loc a budget being exceeded, and returns
+  /// false if the check has to be skipped for the rest of the translation unit.
+  bool spendBudget(StringRef CheckName, SourceLocation Loc,
+                   std::chrono::steady_clock::duration Time,
+                   std::chrono::steady_clock::duration CheckTime);
+
+  /// \brief Returns true if all checks are skipped for the rest of the current
+  /// translation unit.
+  bool isTranslationUnitOverBudget() const { return TranslationUnitOverBudget; }
+
+  /// \brief Returns true if checks were skipped in the current translation
+  /// unit because of their budgets.
+  bool hasChecksOverBudget() const { return ChecksOverBudget; }
+
   /// \brief Should be called when starting to process new translation unit.
   void setCurrentBuildDirectory(StringRef BuildDirectory) {
     CurrentBuildDirectory = BuildDirectory;
@@ -191,6 +300,9 @@ public:
     return AllowEnablingAnalyzerAlphaCheckers;
   }
 
+  /// \brief Returns the provider of the options of all files.
+  ClangTidyOptionsProvider &getOptionsProvider() { return *OptionsProvider; }
+
 private:
   // Writes to Stats.
   friend class ClangTidyDiagnosticConsumer;
@@ -215,6 +327,21 @@ private:
   bool Profile;
   std::string ProfilePrefix;
 
+  bool MatchUserCodeOnly;
+  bool MatchChangedLinesOnly;
+  ClangTidyHeaderOwners *HeaderOwners;
+  ClangTidyPreambleCache *PreambleCache;
+  ClangTidyProfileAggregator *ProfileAggregator;
+
+  llvm::DenseMap<const void *, std::unique_ptr<ClangTidyTranslationUnitCache>>
+      TranslationUnitCaches;
+
+  bool HasBudgets;
+  bool TranslationUnitOverBudget;
+  bool ChecksOverBudget;
+  std::chrono::steady_clock::duration BudgetTime;
+  size_t BudgetStartMallocUsage;
+
   bool AllowEnablingAnalyzerAlphaCheckers;
 };
 
@@ -234,9 +361,17 @@ public:
   void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel,
                         const Diagnostic &Info) override;
 
+  void EndSourceFile() override;
+
   // Retrieve the diagnostics that were captured.
   std::vector<ClangTidyError> take();
 
+  // Adds the diagnostics and stats taken from a consumer of another context,
+  // e.g. one running on another thread. take() then returns them along with
+  // the captured ones, removing duplicates and incompatible fixes of all.
+  void addErrors(std::vector<ClangTidyError> Errors,
+                 const ClangTidyStats &Stats);
+
 private:
   void finalizeLastError();
   void removeIncompatibleErrors();
@@ -248,12 +383,49 @@ private:
   /// \brief Updates \c LastErrorRelatesToUserCode and LastErrorPassesLineFilter
   /// according to the diagnostic \p Location.
   void checkFilters(SourceLocation Location, const SourceManager& Sources);
-  bool passesLineFilter(StringRef FileName, unsigned LineNumber) const;
+  bool passesHeaderFilter(StringRef FileName);
+  bool passesLineFilter(StringRef FileName, unsigned LineNumber);
+
+  /// \brief A \c NOLINT or \c NOLINTNEXTLINE comment.
+  struct NOLINTComment {
+    /// \brief The offset of the comment in its file.
+    unsigned Offset;
+    unsigned Line;
+    bool NextLine;
+    /// \brief Whether the comment has no check list, or a \c * one.
+    bool AllChecks;
+    SmallVector<StringRef, 1> Checks;
+  };
+
+  /// \brief Returns whether \p Location, or one of the macro expansions it
+  /// comes from, is on a line marked with a \c NOLINT comment suppressing
+  /// \p DiagID.
+  bool lineIsMarkedWithNOLINT(SourceLocation Location, unsigned DiagID,
+                              const SourceManager &Sources);
+
+  /// \brief Returns the \c NOLINT comments of \p File, sorted by offset.
+  /// Each file is scanned once, on the first diagnostic in it.
+  ArrayRef<NOLINTComment> getNOLINTComments(FileID File,
+                                            const SourceManager &Sources);
 
   ClangTidyContext &Context;
   bool RemoveIncompatibleErrors;
   std::vector<ClangTidyError> Errors;
+  std::vector<ClangTidyError> AddedErrors;
   std::unique_ptr<llvm::Regex> HeaderFilter;
+  /// \brief Whether \c HeaderFilter matches each file name seen.
+  llvm::StringMap<bool> HeaderFilterResults;
+
+  /// \brief The line ranges of the \c LineFilter entry of a file, sorted and
+  /// merged.
+  struct FileLineFilter {
+    /// \brief Whether an entry of the \c LineFilter matches the file.
+    bool Matches;
+    std::vector<FileFilter::LineRange> LineRanges;
+  };
+  llvm::StringMap<FileLineFilter> LineFilters;
+  const SourceManager *NOLINTSources = nullptr;
+  llvm::DenseMap<FileID, std::vector<NOLINTComment>> NOLINTComments;
   bool LastErrorRelatesToUserCode;
   bool LastErrorPassesLineFilter;
   bool LastErrorWasIgnored;
@@ -11,12 +11,15 @@
 #include "ClangTidyModuleRegistry.h"
 #include "clang/Basic/LLVM.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_ostream.h"
+#include <chrono>
 #include <utility>
 
 #define DEBUG_TYPE "clang-tidy-options"
@@ -25,6 +28,23 @@ using clang::tidy::ClangTidyOptions;
 using clang::tidy::FileFilter;
 using OptionsSource = clang::tidy::ClangTidyOptionsProvider::OptionsSource;
 
+namespace {
+
+/// The configuration of a directory stored in the configuration cache, with
+/// the modification times validating it.
+struct CachedConfig {
+  std::string Directory;
+  uint64_t DirectoryTime = 0;
+  /// Empty when the directory has no configuration file.
+  std::string ConfigFile;
+  uint64_t ConfigTime = 0;
+  uint64_t ConfigSize = 0;
+  /// The parsed options, as returned by configurationAsText.
+  std::string Options;
+};
+
+} // namespace
+
 LLVM_YAML_IS_FLOW_SEQUENCE_VECTOR(FileFilter)
 LLVM_YAML_IS_FLOW_SEQUENCE_VECTOR(FileFilter::LineRange)
 
@@ -79,6 +99,17 @@ struct NOptionMap {
   std::vector<ClangTidyOptions::StringPair> Options;
 };
 
+template <> struct MappingTraits<CachedConfig> {
+  static void mapping(IO &IO, CachedConfig &Config) {
+    IO.mapRequired("Directory", Config.Directory);
+    IO.mapRequired("DirectoryTime", Config.DirectoryTime);
+    IO.mapOptional("ConfigFile", Config.ConfigFile);
+    IO.mapOptional("ConfigTime", Config.ConfigTime);
+    IO.mapOptional("ConfigSize", Config.ConfigSize);
+    IO.mapOptional("Options", Config.Options);
+  }
+};
+
 template <> struct MappingTraits<ClangTidyOptions> {
   static void mapping(IO &IO, ClangTidyOptions &Options) {
     MappingNormalization<NOptionMap, ClangTidyOptions::OptionMap> NOpts(
@@ -90,6 +121,12 @@ template <> struct MappingTraits<ClangTidyOptions> {
     IO.mapOptional("AnalyzeTemporaryDtors", Ignored); // legacy compatibility
     IO.mapOptional("FormatStyle", Options.FormatStyle);
     IO.mapOptional("User", Options.User);
+    IO.mapOptional("CheckTimeBudget", Options.CheckTimeBudget);
+    IO.mapOptional("TranslationUnitTimeBudget",
+                   Options.TranslationUnitTimeBudget);
+    IO.mapOptional("TranslationUnitMemoryBudget",
+                   Options.TranslationUnitMemoryBudget);
+    IO.mapOptional("AnalyzerNodeBudget", Options.AnalyzerNodeBudget);
     IO.mapOptional("CheckOptions", NOpts->Options);
     IO.mapOptional("ExtraArgs", Options.ExtraArgs);
     IO.mapOptional("ExtraArgsBefore", Options.ExtraArgsBefore);
@@ -149,6 +186,12 @@ ClangTidyOptions::mergeWith(const ClangTidyOptions &Other) const {
   overrideValue(Result.SystemHeaders, Other.SystemHeaders);
   overrideValue(Result.FormatStyle, Other.FormatStyle);
   overrideValue(Result.User, Other.User);
+  overrideValue(Result.CheckTimeBudget, Other.CheckTimeBudget);
+  overrideValue(Result.TranslationUnitTimeBudget,
+                Other.TranslationUnitTimeBudget);
+  overrideValue(Result.TranslationUnitMemoryBudget,
+                Other.TranslationUnitMemoryBudget);
+  overrideValue(Result.AnalyzerNodeBudget, Other.AnalyzerNodeBudget);
   mergeVectors(Result.ExtraArgs, Other.ExtraArgs);
   mergeVectors(Result.ExtraArgsBefore, Other.ExtraArgsBefore);
 
@@ -245,14 +288,33 @@ FileOptionsProvider::getRawOptions(StringRef FileName) {
        CurrentPath = llvm::sys::path::parent_path(CurrentPath)) {
     llvm::Optional<OptionsSource> Result;
 
-    auto Iter = CachedOptions.find(CurrentPath);
-    if (Iter != CachedOptions.end())
-      Result = Iter->second;
+    // The configuration of each directory is checked on its own, a directory
+    // may have got a configuration file since its parent's was found.
+    if (RevalidateConfigFiles) {
+      Result = tryReadValidatedConfigFile(CurrentPath);
+      if (Result) {
+        RawOptions.push_back(*Result);
+        break;
+      }
+      continue;
+    }
 
+    {
+      std::lock_guard<std::mutex> Lock(CacheMu);
+      auto Iter = CachedOptions.find(CurrentPath);
+      if (Iter != CachedOptions.end())
+        Result = Iter->second;
+    }
+
+    // The configuration files are read outside of the lock: several threads
+    // may read the same one, but don't wait for each other.
     if (!Result)
-      Result = tryReadConfigFile(CurrentPath);
+      Result = ConfigCacheDirectory.empty()
+                   ? tryReadConfigFile(CurrentPath)
+                   : tryReadCachedConfigFile(CurrentPath);
 
     if (Result) {
+      std::lock_guard<std::mutex> Lock(CacheMu);
       // Store cached value for all intermediate directories.
       while (Path != CurrentPath) {
         LLVM_DEBUG(llvm::dbgs()
@@ -317,6 +379,129 @@ FileOptionsProvider::tryReadConfigFile(StringRef Directory) {
   return llvm::None;
 }
 
+static uint64_t getTime(const llvm::sys::fs::file_status &Status) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Status.getLastModificationTime().time_since_epoch())
+      .count();
+}
+
+void FileOptionsProvider::setConfigCacheDirectory(StringRef Directory) {
+  ConfigCacheDirectory = Directory;
+  if (std::error_code EC =
+          llvm::sys::fs::create_directories(ConfigCacheDirectory)) {
+    llvm::errs() << "Can't create the configuration cache "
+                 << ConfigCacheDirectory << ": " << EC.message() << "\n";
+    ConfigCacheDirectory.clear();
+  }
+}
+
+llvm::Optional<OptionsSource>
+FileOptionsProvider::tryReadCachedConfigFile(StringRef Directory) {
+  // The entries depend on the configuration file names looked for.
+  llvm::SHA1 Hasher;
+  Hasher.update(Directory);
+  for (const ConfigFileHandler &ConfigHandler : ConfigHandlers) {
+    Hasher.update(StringRef("\0", 1));
+    Hasher.update(ConfigHandler.first);
+  }
+  SmallString<128> EntryPath(ConfigCacheDirectory);
+  llvm::sys::path::append(EntryPath, llvm::toHex(Hasher.final()) + ".yaml");
+
+  // A configuration file added to or removed from the directory changes the
+  // modification time of the directory.
+  llvm::sys::fs::file_status DirectoryStatus;
+  if (llvm::sys::fs::status(Directory, DirectoryStatus))
+    return tryReadConfigFile(Directory);
+
+  if (auto Buffer = llvm::MemoryBuffer::getFile(EntryPath)) {
+    CachedConfig Cached;
+    llvm::yaml::Input YAML((*Buffer)->getBuffer());
+    YAML >> Cached;
+    llvm::sys::fs::file_status ConfigStatus;
+    if (!YAML.error() && Cached.Directory == Directory &&
+        Cached.DirectoryTime == getTime(DirectoryStatus)) {
+      if (Cached.ConfigFile.empty())
+        return llvm::None;
+      if (!llvm::sys::fs::status(Cached.ConfigFile, ConfigStatus) &&
+          Cached.ConfigTime == getTime(ConfigStatus) &&
+          Cached.ConfigSize == ConfigStatus.getSize()) {
+        if (llvm::ErrorOr<ClangTidyOptions> ParsedOptions =
+                parseConfiguration(Cached.Options))
+          return OptionsSource(*ParsedOptions, Cached.ConfigFile);
+      }
+    }
+  }
+
+  llvm::Optional<OptionsSource> Result = tryReadConfigFile(Directory);
+  CachedConfig Cached;
+  Cached.Directory = Directory;
+  Cached.DirectoryTime = getTime(DirectoryStatus);
+  if (Result) {
+    llvm::sys::fs::file_status ConfigStatus;
+    if (llvm::sys::fs::status(Result->second, ConfigStatus))
+      return Result;
+    Cached.ConfigFile = Result->second;
+    Cached.ConfigTime = getTime(ConfigStatus);
+    Cached.ConfigSize = ConfigStatus.getSize();
+    Cached.Options = configurationAsText(Result->first);
+  }
+
+  // Entries are written atomically, so that the processes sharing the cache
+  // never read a partial one.
+  int FD;
+  SmallString<128> TempPath;
+  if (llvm::sys::fs::createUniqueFile(EntryPath + "-%%%%%%.tmp", FD, TempPath))
+    return Result;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    llvm::yaml::Output YAML(OS);
+    YAML << Cached;
+  }
+  if (llvm::sys::fs::rename(TempPath, EntryPath))
+    llvm::sys::fs::remove(TempPath);
+  return Result;
+}
+
+llvm::Optional<OptionsSource>
+FileOptionsProvider::tryReadValidatedConfigFile(StringRef Directory) {
+  // A configuration file added to or removed from the directory changes the
+  // modification time of the directory.
+  llvm::sys::fs::file_status DirectoryStatus;
+  if (llvm::sys::fs::status(Directory, DirectoryStatus))
+    return tryReadConfigFile(Directory);
+
+  llvm::Optional<ValidatedConfig> Previous;
+  {
+    std::lock_guard<std::mutex> Lock(CacheMu);
+    auto It = ValidatedConfigs.find(Directory);
+    if (It != ValidatedConfigs.end())
+      Previous = It->second;
+  }
+  if (Previous && Previous->DirectoryTime == getTime(DirectoryStatus)) {
+    if (!Previous->Config)
+      return llvm::None;
+    llvm::sys::fs::file_status ConfigStatus;
+    if (!llvm::sys::fs::status(Previous->Config->second, ConfigStatus) &&
+        Previous->ConfigTime == getTime(ConfigStatus) &&
+        Previous->ConfigSize == ConfigStatus.getSize())
+      return Previous->Config;
+  }
+
+  ValidatedConfig Validated;
+  Validated.DirectoryTime = getTime(DirectoryStatus);
+  Validated.Config = tryReadConfigFile(Directory);
+  if (Validated.Config) {
+    llvm::sys::fs::file_status ConfigStatus;
+    if (llvm::sys::fs::status(Validated.Config->second, ConfigStatus))
+      return Validated.Config;
+    Validated.ConfigTime = getTime(ConfigStatus);
+    Validated.ConfigSize = ConfigStatus.getSize();
+  }
+  std::lock_guard<std::mutex> Lock(CacheMu);
+  ValidatedConfigs[Directory] = Validated;
+  return Validated.Config;
+}
+
 /// \brief Parses -line-filter option and stores it to the \c Options.
 std::error_code parseLineFilter(StringRef LineFilter,
                                 clang::tidy::ClangTidyGlobalOptions &Options) {
@@ -325,6 +510,95 @@ std::error_code parseLineFilter(StringRef LineFilter,
   return Input.error();
 }
 
+/// \brief Parses -diff option and appends its changed lines to the
+/// \c Options.
+std::error_code parseUnifiedDiff(StringRef Diff, unsigned StripComponents,
+                                 clang::tidy::ClangTidyGlobalOptions &Options) {
+  StringRef FileName;
+  // The filter of FileName, created with its first added line.
+  llvm::Optional<size_t> Filter;
+  auto AddLine = [&](unsigned Line) {
+    if (FileName.empty())
+      return;
+    if (!Filter) {
+      Filter = Options.LineFilter.size();
+      Options.LineFilter.emplace_back();
+      Options.LineFilter.back().Name = FileName;
+    }
+    std::vector<FileFilter::LineRange> &Ranges =
+        Options.LineFilter[*Filter].LineRanges;
+    if (!Ranges.empty() && Ranges.back().second + 1 == Line)
+      Ranges.back().second = Line;
+    else
+      Ranges.emplace_back(Line, Line);
+  };
+
+  // The lines of the current hunk that remain to be read, and the number of
+  // the next line of the new file.
+  unsigned OldLines = 0, NewLines = 0, NextLine = 0;
+  SmallVector<StringRef, 0> Lines;
+  Diff.split(Lines, '\n');
+  for (StringRef Line : Lines) {
+    Line = Line.rtrim('\r');
+    if (OldLines > 0 || NewLines > 0) {
+      if (Line.startswith("\\"))
+        continue; // "\ No newline at end of file".
+      if (Line.empty() || Line[0] == ' ') {
+        if (OldLines == 0 || NewLines == 0)
+          return llvm::errc::invalid_argument;
+        --OldLines;
+        --NewLines;
+        ++NextLine;
+      } else if (Line[0] == '-') {
+        if (OldLines == 0)
+          return llvm::errc::invalid_argument;
+        --OldLines;
+      } else if (Line[0] == '+') {
+        if (NewLines == 0)
+          return llvm::errc::invalid_argument;
+        --NewLines;
+        AddLine(NextLine++);
+      } else {
+        return llvm::errc::invalid_argument;
+      }
+      continue;
+    }
+
+    // Outside of the hunks, so "+++ " isn't an added line.
+    if (Line.startswith("+++ ")) {
+      // The name may be followed by a timestamp.
+      FileName = Line.drop_front(4).split('\t').first.trim().trim('"');
+      if (FileName == "/dev/null")
+        FileName = StringRef();
+      for (unsigned I = 0; I < StripComponents && !FileName.empty(); ++I)
+        FileName = FileName.split('/').second;
+      Filter.reset();
+      continue;
+    }
+    if (!Line.startswith("@@ "))
+      continue;
+    // @@ -OldStart[,OldCount] +NewStart[,NewCount] @@
+    SmallVector<StringRef, 4> Fields;
+    Line.split(Fields, ' ', /*MaxSplit=*/3);
+    if (Fields.size() < 3 || !Fields[1].startswith("-") ||
+        !Fields[2].startswith("+"))
+      return llvm::errc::invalid_argument;
+    auto ParseRange = [](StringRef Range, unsigned &Start, unsigned &Count) {
+      std::pair<StringRef, StringRef> Parts = Range.drop_front().split(',');
+      Count = 1;
+      return !Parts.first.getAsInteger(10, Start) &&
+             (Parts.second.empty() || !Parts.second.getAsInteger(10, Count));
+    };
+    unsigned OldStart;
+    if (!ParseRange(Fields[1], OldStart, OldLines) ||
+        !ParseRange(Fields[2], NextLine, NewLines))
+      return llvm::errc::invalid_argument;
+  }
+  if (OldLines > 0 || NewLines > 0)
+    return llvm::errc::invalid_argument;
+  return std::error_code();
+}
+
 llvm::ErrorOr<ClangTidyOptions> parseConfiguration(StringRef Config) {
   llvm::yaml::Input Input(Config);
   ClangTidyOptions Options;
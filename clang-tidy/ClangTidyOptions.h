@@ -18,6 +18,7 @@
 #include "llvm/Support/VirtualFileSystem.h"
 #include <functional>
 #include <map>
+#include <mutex>
 #include <string>
 #include <system_error>
 #include <utility>
@@ -94,6 +95,24 @@ struct ClangTidyOptions {
   /// comments in the relevant check.
   llvm::Optional<std::string> User;
 
+  /// \brief Time in milliseconds each check can spend handling its matches in
+  /// a translation unit. A check exceeding it is skipped for the rest of the
+  /// translation unit.
+  llvm::Optional<unsigned> CheckTimeBudget;
+
+  /// \brief Time in milliseconds all checks together can spend handling their
+  /// matches in a translation unit, after which they are all skipped.
+  llvm::Optional<unsigned> TranslationUnitTimeBudget;
+
+  /// \brief Megabytes the heap can grow by while the checks handle the matches
+  /// of a translation unit, after which they are all skipped. The heap is the
+  /// one of the process, shared by the threads of a parallel run.
+  llvm::Optional<unsigned> TranslationUnitMemoryBudget;
+
+  /// \brief Maximum number of nodes the static analyzer explores in each
+  /// function, after which it stops analyzing the function.
+  llvm::Optional<unsigned> AnalyzerNodeBudget;
+
   typedef std::pair<std::string, std::string> StringPair;
   typedef std::map<std::string, std::string> OptionMap;
 
@@ -139,6 +158,11 @@ public:
   /// \brief Returns options applying to a specific translation unit with the
   /// specified \p FileName.
   ClangTidyOptions getOptions(llvm::StringRef FileName);
+
+  /// \brief Returns whether \c getGlobalOptions and \c getRawOptions can be
+  /// called by several threads at once. The subclasses overriding them need
+  /// to override this too.
+  virtual bool isThreadSafe() const { return false; }
 };
 
 /// \brief Implementation of the \c ClangTidyOptionsProvider interface, which
@@ -152,6 +176,7 @@ public:
     return GlobalOptions;
   }
   std::vector<OptionsSource> getRawOptions(llvm::StringRef FileName) override;
+  bool isThreadSafe() const override { return true; }
 
 private:
   ClangTidyGlobalOptions GlobalOptions;
@@ -248,12 +273,56 @@ public:
 
   std::vector<OptionsSource> getRawOptions(llvm::StringRef FileName) override;
 
+  /// \brief Persists the configuration found in each directory, along with
+  /// the modification times of the directory and of its configuration file,
+  /// in \p Directory. The entries stay valid while these times don't change,
+  /// so that the clang-tidy processes sharing \p Directory don't look for and
+  /// parse the configuration files again.
+  void setConfigCacheDirectory(llvm::StringRef Directory);
+
+  /// \brief Checks whether the configuration files changed whenever options
+  /// are requested, for long-running processes. The configuration found in
+  /// each directory is kept in memory, along with the modification times of
+  /// the directory and of its configuration file, and the file is only parsed
+  /// again when they change.
+  void setRevalidateConfigFiles(bool Revalidate) {
+    RevalidateConfigFiles = Revalidate;
+  }
+
 protected:
   /// \brief Try to read configuration files from \p Directory using registered
   /// \c ConfigHandlers.
   llvm::Optional<OptionsSource> tryReadConfigFile(llvm::StringRef Directory);
 
+  /// \brief Like \c tryReadConfigFile, but reads the configuration of
+  /// \p Directory from the configuration cache when it's still valid, and
+  /// stores it otherwise.
+  llvm::Optional<OptionsSource>
+  tryReadCachedConfigFile(llvm::StringRef Directory);
+
+  /// \brief Like \c tryReadConfigFile, but returns the configuration read
+  /// from \p Directory before if its files didn't change since.
+  llvm::Optional<OptionsSource>
+  tryReadValidatedConfigFile(llvm::StringRef Directory);
+
+  /// \brief The configuration read from a directory, with the modification
+  /// times it's valid for.
+  struct ValidatedConfig {
+    uint64_t DirectoryTime = 0;
+    uint64_t ConfigTime = 0;
+    uint64_t ConfigSize = 0;
+    llvm::Optional<OptionsSource> Config;
+  };
+
+  /// \brief Guards \c CachedOptions, so that several threads can get options
+  /// at once.
+  std::mutex CacheMu;
   llvm::StringMap<OptionsSource> CachedOptions;
+  /// \brief The configurations of the directories, with
+  /// RevalidateConfigFiles. Also guarded by \c CacheMu.
+  llvm::StringMap<ValidatedConfig> ValidatedConfigs;
+  bool RevalidateConfigFiles = false;
+  std::string ConfigCacheDirectory;
   ClangTidyOptions OverrideOptions;
   ConfigFileHandlers ConfigHandlers;
   llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS;
@@ -263,6 +332,13 @@ protected:
 std::error_code parseLineFilter(llvm::StringRef LineFilter,
                                 ClangTidyGlobalOptions &Options);
 
+/// \brief Parses a unified diff and appends the lines it adds or changes in each
+/// file to the LineFilter of \p Options. \p StripComponents leading path
+/// components are removed from the file names, as with \c patch -p.
+std::error_code parseUnifiedDiff(llvm::StringRef Diff,
+                                 unsigned StripComponents,
+                                 ClangTidyGlobalOptions &Options);
+
 /// \brief Parses configuration from JSON and returns \c ClangTidyOptions or an
 /// error.
 llvm::ErrorOr<ClangTidyOptions> parseConfiguration(llvm::StringRef Config);
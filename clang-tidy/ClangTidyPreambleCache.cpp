@@ -0,0 +1,119 @@
+//===--- ClangTidyPreambleCache.cpp - clang-tidy ----------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidyPreambleCache.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Lex/HeaderSearchOptions.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+
+namespace clang {
+namespace tidy {
+
+namespace {
+
+/// Returns the key grouping the main files of the invocations that can share a
+/// preamble. The cached preamble still has to be checked with
+/// PrecompiledPreamble::CanReuse().
+std::string computePreambleKey(const CompilerInvocation &Invocation,
+                               StringRef Preamble, llvm::vfs::FileSystem &VFS) {
+  llvm::SHA1 Hasher;
+  auto Update = [&](StringRef Data) {
+    Hasher.update(Data);
+    Hasher.update(StringRef("\0", 1));
+  };
+  // The module hash covers the language and target options, the macros and
+  // the system header search options.
+  Update(Invocation.getModuleHash());
+  for (const HeaderSearchOptions::Entry &E :
+       Invocation.getHeaderSearchOpts().UserEntries) {
+    Update(E.Path);
+    Update(llvm::utostr(E.Group));
+    Update(E.IsFramework ? "framework" : "directory");
+  }
+  const PreprocessorOptions &PPOpts = Invocation.getPreprocessorOpts();
+  for (const std::string &Include : PPOpts.Includes)
+    Update(Include);
+  for (const std::string &Include : PPOpts.MacroIncludes)
+    Update(Include);
+  // Quoted includes are looked up from the directory of the main file first,
+  // and relative paths from the working directory.
+  const FrontendOptions &FEOpts = Invocation.getFrontendOpts();
+  if (!FEOpts.Inputs.empty() && FEOpts.Inputs[0].isFile())
+    Update(llvm::sys::path::parent_path(FEOpts.Inputs[0].getFile()));
+  if (auto WD = VFS.getCurrentWorkingDirectory())
+    Update(*WD);
+  Update(Preamble);
+  return llvm::toHex(Hasher.final());
+}
+
+} // namespace
+
+std::shared_ptr<const PrecompiledPreamble> ClangTidyPreambleCache::get(
+    const CompilerInvocation &Invocation, llvm::MemoryBuffer &MainFileBuffer,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps) {
+  PreambleBounds Bounds =
+      ComputePreambleBounds(*Invocation.getLangOpts(), &MainFileBuffer, 0);
+  if (Bounds.Size == 0)
+    return nullptr;
+
+  std::shared_ptr<Entry> E;
+  {
+    std::string Key = computePreambleKey(
+        Invocation, MainFileBuffer.getBuffer().take_front(Bounds.Size), *VFS);
+    std::lock_guard<std::mutex> Lock(Mu);
+    std::shared_ptr<Entry> &Slot = Entries[Key];
+    if (!Slot)
+      Slot = std::make_shared<Entry>();
+    E = Slot;
+  }
+
+  // The other translation units of the group wait for the preamble being
+  // built instead of building their own.
+  std::lock_guard<std::mutex> Lock(E->Mu);
+  if (E->Preamble &&
+      E->Preamble->CanReuse(Invocation, &MainFileBuffer, Bounds, VFS.get()))
+    return E->Preamble;
+  // Don't retry the headers that failed to compile, the translation units
+  // report their errors.
+  if (E->BuildFailed)
+    return nullptr;
+
+  CompilerInvocation PreambleInvocation(Invocation);
+  // The preamble is built by a GeneratePCH action, which doesn't define the
+  // macro that clang-tidy defines for the analysis.
+  if (Invocation.getFrontendOpts().ProgramAction == frontend::RunAnalysis)
+    PreambleInvocation.getPreprocessorOpts().addMacroDef("__clang_analyzer__");
+  // The warnings in the headers of the preamble are lost, the errors make the
+  // build fail and are reported by the translation unit.
+  IgnoringDiagConsumer IgnoreDiags;
+  IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+      CompilerInstance::createDiagnostics(
+          &PreambleInvocation.getDiagnosticOpts(), &IgnoreDiags,
+          /*ShouldOwnClient=*/false);
+  PreambleCallbacks Callbacks;
+  llvm::ErrorOr<PrecompiledPreamble> Built = PrecompiledPreamble::Build(
+      PreambleInvocation, &MainFileBuffer, Bounds, *Diags, VFS,
+      std::move(PCHContainerOps), /*StoreInMemory=*/false, Callbacks);
+  // The translation units using the previous preamble keep it alive.
+  E->Preamble = nullptr;
+  if (!Built) {
+    E->BuildFailed = true;
+    return nullptr;
+  }
+  E->Preamble = std::make_shared<const PrecompiledPreamble>(std::move(*Built));
+  return E->Preamble;
+}
+
+} // end namespace tidy
+} // end namespace clang
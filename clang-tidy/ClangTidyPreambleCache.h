@@ -0,0 +1,63 @@
+//===--- ClangTidyPreambleCache.h - clang-tidy ------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPREAMBLECACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPREAMBLECACHE_H
+
+#include "clang/Frontend/PrecompiledPreamble.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace clang {
+
+class CompilerInvocation;
+class PCHContainerOperations;
+
+namespace tidy {
+
+/// \brief Shares precompiled preambles between the translation units of a
+/// run, so that the headers included by the leading directives of several main
+/// files are parsed once.
+///
+/// The preambles are grouped by the options affecting the parse, the
+/// directories of the main file and of the compilation, and the text of the
+/// leading directives. A cached preamble is rebuilt when one of the files it
+/// read changed. The preambles are stored in temporary files, removed with the
+/// cache. Can be shared by several threads.
+class ClangTidyPreambleCache {
+public:
+  /// \brief Returns the preamble of the main file of \p Invocation, whose
+  /// contents are \p MainFileBuffer, building it if no cached one can be
+  /// reused. Returns \c nullptr if the main file has no leading directives,
+  /// or their headers can't be compiled.
+  std::shared_ptr<const PrecompiledPreamble>
+  get(const CompilerInvocation &Invocation, llvm::MemoryBuffer &MainFileBuffer,
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS,
+      std::shared_ptr<PCHContainerOperations> PCHContainerOps);
+
+private:
+  struct Entry {
+    std::mutex Mu;
+    std::shared_ptr<const PrecompiledPreamble> Preamble;
+    bool BuildFailed = false;
+  };
+
+  std::mutex Mu;
+  llvm::StringMap<std::shared_ptr<Entry>> Entries;
+};
+
+} // end namespace tidy
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPREAMBLECACHE_H
@@ -11,9 +11,11 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <system_error>
 #include <utility>
 
@@ -22,6 +24,74 @@
 namespace clang {
 namespace tidy {
 
+void ClangTidyProfileAggregator::add(
+    llvm::StringRef SourceFile,
+    const llvm::StringMap<llvm::TimeRecord> &Records,
+    const llvm::StringMap<unsigned> &MatchCounts,
+    const llvm::StringMap<AllocationCount> &Allocations) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  ++TranslationUnits;
+  for (const auto &Record : Records) {
+    CheckProfile &Check = Checks[Record.getKey()];
+    Check.Total += Record.getValue();
+    ++Check.TranslationUnits;
+    double Wall = Record.getValue().getWallTime();
+    auto Pos = std::find_if(Check.Slowest.begin(), Check.Slowest.end(),
+                            [&](const std::pair<double, std::string> &S) {
+                              return S.first < Wall;
+                            });
+    if (static_cast<unsigned>(Pos - Check.Slowest.begin()) < OutliersPerCheck) {
+      Check.Slowest.insert(Pos, {Wall, SourceFile});
+      if (Check.Slowest.size() > OutliersPerCheck)
+        Check.Slowest.pop_back();
+    }
+  }
+  for (const auto &Count : MatchCounts)
+    Checks[Count.getKey()].Matches += Count.getValue();
+  for (const auto &Count : Allocations)
+    Checks[Count.getKey()].Allocations += Count.getValue();
+  HasAllocations |= !Allocations.empty();
+}
+
+void ClangTidyProfileAggregator::print(llvm::raw_ostream &OS) const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  std::vector<const llvm::StringMapEntry<CheckProfile> *> Sorted;
+  double TotalWall = 0;
+  for (const auto &Check : Checks) {
+    Sorted.push_back(&Check);
+    TotalWall += Check.getValue().Total.getWallTime();
+  }
+  llvm::sort(Sorted.begin(), Sorted.end(),
+             [](const llvm::StringMapEntry<CheckProfile> *LHS,
+                const llvm::StringMapEntry<CheckProfile> *RHS) {
+               return LHS->getValue().Total.getWallTime() >
+                      RHS->getValue().Total.getWallTime();
+             });
+
+  OS << "===" << std::string(73, '-') << "===\n"
+     << llvm::formatv("clang-tidy checks profiling of {0} translation units\n",
+                      TranslationUnits)
+     << "===" << std::string(73, '-') << "===\n"
+     << llvm::formatv("  Total Wall Time: {0:f4} seconds\n\n", TotalWall)
+     << "   Wall (s)   User (s) System (s)    Matches   Memory (B)   TUs"
+     << (HasAllocations ? "  Allocs (B)   Allocs" : "") << "  Name\n";
+  for (const auto *Check : Sorted) {
+    const CheckProfile &P = Check->getValue();
+    OS << llvm::formatv("{0,11:f4}{1,11:f4}{2,11:f4}{3,11}{4,13}{5,6}",
+                        P.Total.getWallTime(), P.Total.getUserTime(),
+                        P.Total.getSystemTime(), P.Matches,
+                        P.Total.getMemUsed(), P.TranslationUnits);
+    if (HasAllocations)
+      OS << llvm::formatv("{0,12}{1,9}", P.Allocations.Bytes,
+                          P.Allocations.Calls);
+    OS << "  " << Check->getKey() << "\n";
+    for (const auto &Slow : P.Slowest)
+      OS << llvm::formatv("{0,11:f4}  slowest in {1}\n", Slow.first,
+                          Slow.second);
+  }
+  OS.flush();
+}
+
 ClangTidyProfiling::StorageParams::StorageParams(llvm::StringRef ProfilePrefix,
                                                  llvm::StringRef SourceFile)
     : Timestamp(std::chrono::system_clock::now()), SourceFilename(SourceFile) {
@@ -41,6 +111,23 @@ ClangTidyProfiling::StorageParams::StorageParams(llvm::StringRef ProfilePrefix,
 
 void ClangTidyProfiling::printUserFriendlyTable(llvm::raw_ostream &OS) {
   TG->print(OS);
+  if (!Allocations.empty()) {
+    std::vector<const llvm::StringMapEntry<AllocationCount> *> Sorted;
+    for (const auto &Allocation : Allocations)
+      Sorted.push_back(&Allocation);
+    llvm::sort(Sorted.begin(), Sorted.end(),
+               [](const llvm::StringMapEntry<AllocationCount> *LHS,
+                  const llvm::StringMapEntry<AllocationCount> *RHS) {
+                 return LHS->getValue().Bytes > RHS->getValue().Bytes;
+               });
+    OS << "===" << std::string(73, '-') << "===\n"
+       << "clang-tidy checks allocations\n"
+       << "===" << std::string(73, '-') << "===\n"
+       << "  Allocated (B)  Allocations  Name\n";
+    for (const auto *Allocation : Sorted)
+      OS << llvm::formatv("{0,15}{1,13}  {2}\n", Allocation->getValue().Bytes,
+                          Allocation->getValue().Calls, Allocation->getKey());
+  }
   OS.flush();
 }
 
@@ -49,7 +136,14 @@ void ClangTidyProfiling::printAsJSON(llvm::raw_ostream &OS) {
   OS << "\"file\": \"" << Storage->SourceFilename << "\",\n";
   OS << "\"timestamp\": \"" << Storage->Timestamp << "\",\n";
   OS << "\"profile\": {\n";
-  TG->printJSONValues(OS, "");
+  const char *Delim = TG->printJSONValues(OS, "");
+  for (const auto &Allocation : Allocations) {
+    OS << Delim << "\"alloc.bytes." << Allocation.getKey()
+       << "\": " << Allocation.getValue().Bytes << ",\n";
+    OS << "\"alloc.calls." << Allocation.getKey()
+       << "\": " << Allocation.getValue().Calls;
+    Delim = ",\n";
+  }
   OS << "\n}\n";
   OS << "}\n";
   OS.flush();
@@ -77,10 +171,18 @@ void ClangTidyProfiling::storeProfileData() {
   printAsJSON(OS);
 }
 
-ClangTidyProfiling::ClangTidyProfiling(llvm::Optional<StorageParams> Storage)
-    : Storage(std::move(Storage)) {}
+ClangTidyProfiling::ClangTidyProfiling(llvm::Optional<StorageParams> Storage,
+                                       ClangTidyProfileAggregator *Aggregator,
+                                       llvm::StringRef SourceFile)
+    : Storage(std::move(Storage)), Aggregator(Aggregator),
+      SourceFile(SourceFile) {}
 
 ClangTidyProfiling::~ClangTidyProfiling() {
+  if (Aggregator)
+    Aggregator->add(SourceFile, Records, MatchCounts, Allocations);
+  if (Aggregator && !Storage.hasValue())
+    return;
+
   TG.emplace("clang-tidy", "clang-tidy checks profiling", Records);
 
   if (!Storage.hasValue())
@@ -10,11 +10,13 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPROFILING_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPROFILING_H
 
+#include "ClangTidyAllocations.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Chrono.h"
 #include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
@@ -22,6 +24,45 @@
 namespace clang {
 namespace tidy {
 
+/// \brief Sums the check profiles of the translation units of a run, so that
+/// the checks costing the most can be found across all of them. Can be shared
+/// by several threads.
+class ClangTidyProfileAggregator {
+public:
+  /// \brief Keeps the \p OutliersPerCheck slowest translation units of each
+  /// check.
+  explicit ClangTidyProfileAggregator(unsigned OutliersPerCheck = 3)
+      : OutliersPerCheck(OutliersPerCheck) {}
+
+  /// \brief Adds the times, match counts and allocations of the checks of
+  /// \p SourceFile.
+  void add(llvm::StringRef SourceFile,
+           const llvm::StringMap<llvm::TimeRecord> &Records,
+           const llvm::StringMap<unsigned> &MatchCounts,
+           const llvm::StringMap<AllocationCount> &Allocations);
+
+  /// \brief Prints the checks ranked by their total wall time, with their
+  /// slowest translation units. The memory is only measured with
+  /// -track-memory, the allocations with -track-allocations.
+  void print(llvm::raw_ostream &OS) const;
+
+private:
+  struct CheckProfile {
+    llvm::TimeRecord Total;
+    unsigned Matches = 0;
+    AllocationCount Allocations;
+    unsigned TranslationUnits = 0;
+    /// The slowest translation units, by decreasing wall time.
+    std::vector<std::pair<double, std::string>> Slowest;
+  };
+
+  unsigned OutliersPerCheck;
+  mutable std::mutex Mu;
+  unsigned TranslationUnits = 0;
+  bool HasAllocations = false;
+  llvm::StringMap<CheckProfile> Checks;
+};
+
 class ClangTidyProfiling {
 public:
   struct StorageParams {
@@ -39,6 +80,9 @@ private:
 
   llvm::Optional<StorageParams> Storage;
 
+  ClangTidyProfileAggregator *Aggregator = nullptr;
+  std::string SourceFile;
+
   void printUserFriendlyTable(llvm::raw_ostream &OS);
   void printAsJSON(llvm::raw_ostream &OS);
 
@@ -46,10 +90,18 @@ private:
 
 public:
   llvm::StringMap<llvm::TimeRecord> Records;
+  /// The number of matches handled by each check.
+  llvm::StringMap<unsigned> MatchCounts;
+  /// The heap allocations of each check, if allocation tracking is enabled.
+  llvm::StringMap<AllocationCount> Allocations;
 
   ClangTidyProfiling() = default;
 
-  ClangTidyProfiling(llvm::Optional<StorageParams> Storage);
+  /// With an \p Aggregator, the profile of \p SourceFile is added to it
+  /// instead of being printed, but it's still stored.
+  ClangTidyProfiling(llvm::Optional<StorageParams> Storage,
+                     ClangTidyProfileAggregator *Aggregator = nullptr,
+                     llvm::StringRef SourceFile = llvm::StringRef());
 
   ~ClangTidyProfiling();
 };
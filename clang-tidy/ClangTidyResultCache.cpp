@@ -0,0 +1,203 @@
+//===--- ClangTidyResultCache.cpp - clang-tidy ------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidyResultCache.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Tooling/DiagnosticsYaml.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+
+/// The stored form of a ClangTidyResultCache::Result.
+struct CachedResult {
+  std::string MainSourceFile;
+  std::vector<clang::tooling::Diagnostic> Diagnostics;
+  clang::tidy::ClangTidyStats Stats;
+};
+
+} // namespace
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<CachedResult> {
+  static void mapping(IO &IO, CachedResult &R) {
+    IO.mapRequired("MainSourceFile", R.MainSourceFile);
+    IO.mapRequired("Diagnostics", R.Diagnostics);
+    IO.mapOptional("ErrorsDisplayed", R.Stats.ErrorsDisplayed);
+    IO.mapOptional("ErrorsIgnoredCheckFilter",
+                   R.Stats.ErrorsIgnoredCheckFilter);
+    IO.mapOptional("ErrorsIgnoredNOLINT", R.Stats.ErrorsIgnoredNOLINT);
+    IO.mapOptional("ErrorsIgnoredNonUserCode",
+                   R.Stats.ErrorsIgnoredNonUserCode);
+    IO.mapOptional("ErrorsIgnoredLineFilter", R.Stats.ErrorsIgnoredLineFilter);
+  }
+};
+
+} // namespace yaml
+} // namespace llvm
+
+namespace clang {
+namespace tidy {
+
+namespace {
+
+class HashingCallbacks : public PPCallbacks {
+public:
+  HashingCallbacks(const SourceManager &SM, llvm::SHA1 &Hasher)
+      : SM(SM), Hasher(Hasher) {}
+
+  void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                   SrcMgr::CharacteristicKind FileType,
+                   FileID PrevFID) override {
+    if (Reason != EnterFile)
+      return;
+    FileID FID = SM.getFileID(Loc);
+    // The predefines buffer has no file entry, and holds the macros defined
+    // by the compile command.
+    const FileEntry *File = SM.getFileEntryForID(FID);
+    update(File ? File->getName() : "<built-in>");
+    bool Invalid = false;
+    update(SM.getBufferData(FID, &Invalid));
+  }
+
+  void FileSkipped(const FileEntry &SkippedFile, const Token &FilenameTok,
+                   SrcMgr::CharacteristicKind FileType) override {
+    update(SkippedFile.getName());
+  }
+
+private:
+  void update(StringRef Data) {
+    Hasher.update(Data);
+    // Separate the strings, so that they can't be concatenated differently.
+    Hasher.update(StringRef("\0", 1));
+  }
+
+  const SourceManager &SM;
+  llvm::SHA1 &Hasher;
+};
+
+class HashingAction : public PreprocessOnlyAction {
+public:
+  explicit HashingAction(llvm::SHA1 &Hasher) : Hasher(Hasher) {}
+
+protected:
+  bool BeginSourceFileAction(CompilerInstance &CI) override {
+    CI.getPreprocessor().addPPCallbacks(
+        llvm::make_unique<HashingCallbacks>(CI.getSourceManager(), Hasher));
+    return PreprocessOnlyAction::BeginSourceFileAction(CI);
+  }
+
+private:
+  llvm::SHA1 &Hasher;
+};
+
+class HashingActionFactory : public tooling::FrontendActionFactory {
+public:
+  explicit HashingActionFactory(llvm::SHA1 &Hasher) : Hasher(Hasher) {}
+  FrontendAction *create() override { return new HashingAction(Hasher); }
+
+private:
+  llvm::SHA1 &Hasher;
+};
+
+} // namespace
+
+ClangTidyResultCache::ClangTidyResultCache(StringRef Directory)
+    : Directory(Directory) {}
+
+std::unique_ptr<tooling::FrontendActionFactory>
+ClangTidyResultCache::newHashingActionFactory(llvm::SHA1 &Hasher) {
+  return llvm::make_unique<HashingActionFactory>(Hasher);
+}
+
+std::unique_ptr<PPCallbacks>
+ClangTidyResultCache::newHashingCallbacks(const SourceManager &SM,
+                                          llvm::SHA1 &Hasher) {
+  return llvm::make_unique<HashingCallbacks>(SM, Hasher);
+}
+
+llvm::Optional<ClangTidyResultCache::Result>
+ClangTidyResultCache::load(StringRef Key, const ClangTidyContext &Context,
+                           StringRef BuildDirectory) const {
+  auto Buffer = llvm::MemoryBuffer::getFile(pathForKey(Key));
+  if (!Buffer)
+    return llvm::None;
+  CachedResult Cached;
+  llvm::yaml::Input YAML((*Buffer)->getBuffer());
+  YAML >> Cached;
+  if (YAML.error())
+    return llvm::None;
+
+  Result R;
+  R.Stats = Cached.Stats;
+  for (tooling::Diagnostic &D : Cached.Diagnostics) {
+    // Only warnings are stored. Whether they're treated as errors depends on
+    // the options, which are part of the key.
+    ClangTidyError Error(D.DiagnosticName, ClangTidyError::Warning,
+                         BuildDirectory,
+                         Context.treatAsError(D.DiagnosticName));
+    Error.Message = std::move(D.Message);
+    Error.Fix = std::move(D.Fix);
+    Error.Notes = std::move(D.Notes);
+    R.Errors.push_back(std::move(Error));
+  }
+  return std::move(R);
+}
+
+void ClangTidyResultCache::store(StringRef Key, StringRef MainFile,
+                                 const Result &R) const {
+  // Compiler errors may be caused by the environment, e.g. missing generated
+  // headers, so they're reported again by the next run.
+  if (llvm::any_of(R.Errors, [](const ClangTidyError &Error) {
+        return Error.DiagLevel != ClangTidyError::Warning;
+      }))
+    return;
+
+  CachedResult Cached;
+  Cached.MainSourceFile = MainFile;
+  for (const ClangTidyError &Error : R.Errors)
+    Cached.Diagnostics.push_back(Error);
+  Cached.Stats = R.Stats;
+
+  // Write to a temporary file first, so that concurrent readers never see a
+  // partial entry.
+  if (llvm::sys::fs::create_directories(Directory))
+    return;
+  std::string Path = pathForKey(Key);
+  int FD;
+  SmallString<128> TempPath;
+  if (llvm::sys::fs::createUniqueFile(Path + "-%%%%%%.tmp", FD, TempPath))
+    return;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    llvm::yaml::Output YAML(OS);
+    YAML << Cached;
+  }
+  if (llvm::sys::fs::rename(TempPath, Path))
+    llvm::sys::fs::remove(TempPath);
+}
+
+std::string ClangTidyResultCache::pathForKey(StringRef Key) const {
+  SmallString<128> Path(Directory);
+  llvm::sys::path::append(Path, Key + ".yaml");
+  return Path.str();
+}
+
+} // namespace tidy
+} // namespace clang
@@ -0,0 +1,77 @@
+//===--- ClangTidyResultCache.h - clang-tidy --------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYRESULTCACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYRESULTCACHE_H
+
+#include "ClangTidyDiagnosticConsumer.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/SHA1.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+class PPCallbacks;
+class SourceManager;
+
+namespace tidy {
+
+/// \brief Stores the diagnostics of translation units in a directory, so that
+/// the translation units that didn't change aren't analyzed again.
+///
+/// Entries are keyed by a hash of everything the results depend on: the
+/// contents of the files read by the preprocessor, the compile command, the
+/// effective options and the version of clang-tidy. A new header that would
+/// shadow one found later in the include paths isn't detected. Entries are
+/// written atomically, so several clang-tidy processes can share a directory.
+class ClangTidyResultCache {
+public:
+  struct Result {
+    std::vector<ClangTidyError> Errors;
+    ClangTidyStats Stats;
+  };
+
+  explicit ClangTidyResultCache(llvm::StringRef Directory);
+
+  /// \brief Returns a factory of actions that preprocess a translation unit,
+  /// adding the names and contents of the files it reads to \p Hasher.
+  static std::unique_ptr<tooling::FrontendActionFactory>
+  newHashingActionFactory(llvm::SHA1 &Hasher);
+
+  /// \brief Returns preprocessor callbacks adding the names and contents of
+  /// the files read by the preprocessor of \p SM to \p Hasher, for the
+  /// translation units that are parsed anyway, e.g. by the clang-tidy plugin.
+  static std::unique_ptr<PPCallbacks>
+  newHashingCallbacks(const SourceManager &SM, llvm::SHA1 &Hasher);
+
+  /// \brief Returns the result stored for \p Key, if any. The errors are
+  /// reported for the current file of \p Context, from \p BuildDirectory.
+  llvm::Optional<Result> load(llvm::StringRef Key,
+                              const ClangTidyContext &Context,
+                              llvm::StringRef BuildDirectory) const;
+
+  /// \brief Stores the result of \p MainFile for \p Key. Results with
+  /// compiler errors aren't stored.
+  void store(llvm::StringRef Key, llvm::StringRef MainFile,
+             const Result &R) const;
+
+private:
+  std::string pathForKey(llvm::StringRef Key) const;
+
+  std::string Directory;
+};
+
+} // end namespace tidy
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYRESULTCACHE_H
@@ -24,6 +24,9 @@ namespace abseil {
 class DurationDivisionCheck : public ClangTidyCheck {
 public:
   using ClangTidyCheck::ClangTidyCheck;
+  bool isApplicable(const ASTContext &Context) const override {
+    return mentionsIdentifier(Context, "absl");
+  }
   void registerMatchers(ast_matchers::MatchFinder *finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &result) override;
 };
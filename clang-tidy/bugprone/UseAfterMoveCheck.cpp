@@ -13,6 +13,8 @@
 #include "clang/Lex/Lexer.h"
 
 #include "../utils/ExprSequence.h"
+#include "../utils/FunctionAnalysisCache.h"
+#include "../utils/Matchers.h"
 
 using namespace clang::ast_matchers;
 using namespace clang::tidy::utils;
@@ -37,7 +39,7 @@ struct UseAfterMove {
 /// various internal helper functions).
 class UseAfterMoveFinder {
 public:
-  UseAfterMoveFinder(ASTContext *TheContext);
+  UseAfterMoveFinder(ASTContext *TheContext, FunctionAnalysisCache &Analyses);
 
   // Within the given function body, finds the first use of 'MovedVariable' that
   // occurs after 'MovingCall' (the expression that performs the move). If a
@@ -60,8 +62,9 @@ private:
                   llvm::SmallPtrSetImpl<const DeclRefExpr *> *DeclRefs);
 
   ASTContext *Context;
-  std::unique_ptr<ExprSequence> Sequence;
-  std::unique_ptr<StmtToBlockMap> BlockMap;
+  FunctionAnalysisCache &Analyses;
+  const ExprSequence *Sequence;
+  const StmtToBlockMap *BlockMap;
   llvm::SmallPtrSet<const CFGBlock *, 8> Visited;
 };
 
@@ -81,30 +84,24 @@ static StatementMatcher inDecltypeOrTemplateArg() {
                    to(functionDecl(ast_matchers::isTemplateInstantiation())))));
 }
 
-UseAfterMoveFinder::UseAfterMoveFinder(ASTContext *TheContext)
-    : Context(TheContext) {}
+UseAfterMoveFinder::UseAfterMoveFinder(ASTContext *TheContext,
+                                       FunctionAnalysisCache &Analyses)
+    : Context(TheContext), Analyses(Analyses), Sequence(nullptr),
+      BlockMap(nullptr) {}
 
 bool UseAfterMoveFinder::find(Stmt *FunctionBody, const Expr *MovingCall,
                               const ValueDecl *MovedVariable,
                               UseAfterMove *TheUseAfterMove) {
-  // Generate the CFG manually instead of through an AnalysisDeclContext because
-  // it seems the latter can't be used to generate a CFG for the body of a
-  // labmda.
-  //
-  // We include implicit and temporary destructors in the CFG so that
+  // The CFG of the function body is shared with the other moves in it and the
+  // other checks. It includes implicit and temporary destructors so that
   // destructors marked [[noreturn]] are handled correctly in the control flow
   // analysis. (These are used in some styles of assertion macros.)
-  CFG::BuildOptions Options;
-  Options.AddImplicitDtors = true;
-  Options.AddTemporaryDtors = true;
-  std::unique_ptr<CFG> TheCFG =
-      CFG::buildCFG(nullptr, FunctionBody, Context, Options);
-  if (!TheCFG)
+  const FunctionAnalysis *Analysis = Analyses.get(FunctionBody, Context);
+  if (!Analysis)
     return false;
 
-  Sequence =
-      llvm::make_unique<ExprSequence>(TheCFG.get(), FunctionBody, Context);
-  BlockMap = llvm::make_unique<StmtToBlockMap>(TheCFG.get(), Context);
+  Sequence = Analysis->Sequence.get();
+  BlockMap = Analysis->BlockMap.get();
   Visited.clear();
 
   const CFGBlock *Block = BlockMap->blockContainingStmt(MovingCall);
@@ -378,9 +375,11 @@ void UseAfterMoveCheck::registerMatchers(MatchFinder *Finder) {
   if (!getLangOpts().CPlusPlus11)
     return;
 
+  auto *StdMove =
+      getTranslationUnitCache<utils::NameSetCache>().get({"::std::move"});
   auto CallMoveMatcher =
-      callExpr(callee(functionDecl(hasName("::std::move"))), argumentCountIs(1),
-               hasArgument(0, declRefExpr().bind("arg")),
+      callExpr(callee(functionDecl(matchers::hasAnyNameInSet(StdMove))),
+               argumentCountIs(1), hasArgument(0, declRefExpr().bind("arg")),
                anyOf(hasAncestor(lambdaExpr().bind("containing-lambda")),
                      hasAncestor(functionDecl().bind("containing-func"))),
                unless(inDecltypeOrTemplateArg()))
@@ -428,7 +427,8 @@ void UseAfterMoveCheck::check(const MatchFinder::MatchResult &Result) {
   if (!Arg->getDecl()->getDeclContext()->isFunctionOrMethod())
     return;
 
-  UseAfterMoveFinder finder(Result.Context);
+  UseAfterMoveFinder finder(Result.Context,
+                            getTranslationUnitCache<FunctionAnalysisCache>());
   UseAfterMove Use;
   if (finder.find(FunctionBody, MovingCall, Arg->getDecl(), &Use))
     emitDiagnostic(MovingCall, Arg, Use, this, Result.Context);
@@ -29,6 +29,9 @@ public:
   TypeMismatchCheck(StringRef Name, ClangTidyContext *Context)
       : ClangTidyCheck(Name, Context) {}
 
+  bool isApplicable(const ASTContext &Context) const override {
+    return mentionsIdentifier(Context, "MPI_Comm");
+  }
   void registerMatchers(ast_matchers::MatchFinder *Finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
 
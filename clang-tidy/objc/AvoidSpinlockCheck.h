@@ -25,6 +25,11 @@ class AvoidSpinlockCheck : public ClangTidyCheck {
  public:
   AvoidSpinlockCheck(StringRef Name, ClangTidyContext *Context)
       : ClangTidyCheck(Name, Context) {}
+  bool isApplicable(const ASTContext &Context) const override {
+    return mentionsIdentifier(Context, "OSSpinlockLock") ||
+           mentionsIdentifier(Context, "OSSpinlockUnlock") ||
+           mentionsIdentifier(Context, "OSSpinlockTry");
+  }
   void registerMatchers(ast_matchers::MatchFinder *Finder) override;
   void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
 };
@@ -0,0 +1,237 @@
+//===--- AtomicMemoryOrderCheck.cpp - clang-tidy --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AtomicMemoryOrderCheck.h"
+
+#include "../utils/OptionsUtils.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Regex.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+constexpr char RelaxedOrder[] = "std::memory_order_relaxed";
+
+/// Returns the atomic method equivalent to the operator \p Kind, or an empty
+/// string if there is none.
+StringRef getEquivalentMethod(OverloadedOperatorKind Kind) {
+  switch (Kind) {
+  case OO_PlusPlus:
+  case OO_PlusEqual:
+    return "fetch_add";
+  case OO_MinusMinus:
+  case OO_MinusEqual:
+    return "fetch_sub";
+  case OO_AmpEqual:
+    return "fetch_and";
+  case OO_PipeEqual:
+    return "fetch_or";
+  case OO_CaretEqual:
+    return "fetch_xor";
+  case OO_Equal:
+    return "store";
+  default:
+    return StringRef();
+  }
+}
+
+/// Returns whether \p E is an expression statement, whose value is discarded.
+bool isDiscarded(const Expr &E, ASTContext &Context) {
+  const Stmt *Child = &E;
+  auto Parents = Context.getParents(*Child);
+  while (Parents.size() == 1 && Parents[0].get<ExprWithCleanups>()) {
+    Child = Parents[0].get<ExprWithCleanups>();
+    Parents = Context.getParents(*Child);
+  }
+  if (Parents.size() != 1)
+    return false;
+  const auto *Parent = Parents[0].get<Stmt>();
+  if (!Parent || isa<Expr>(Parent))
+    return false;
+  if (const auto *For = dyn_cast<ForStmt>(Parent))
+    return For->getInc() == Child || For->getBody() == Child;
+  if (const auto *While = dyn_cast<WhileStmt>(Parent))
+    return While->getBody() == Child;
+  if (const auto *Do = dyn_cast<DoStmt>(Parent))
+    return Do->getBody() == Child;
+  if (const auto *If = dyn_cast<IfStmt>(Parent))
+    return If->getThen() == Child || If->getElse() == Child;
+  if (const auto *ForRange = dyn_cast<CXXForRangeStmt>(Parent))
+    return ForRange->getBody() == Child;
+  return isa<CompoundStmt>(Parent) || isa<SwitchCase>(Parent) ||
+         isa<LabelStmt>(Parent);
+}
+
+StringRef getText(const Expr &E, const ASTContext &Context) {
+  return Lexer::getSourceText(
+      CharSourceRange::getTokenRange(E.getSourceRange()),
+      Context.getSourceManager(), Context.getLangOpts());
+}
+
+/// Returns the fix making the operation \p Op explicitly relaxed, if any.
+llvm::Optional<FixItHint> getRelaxedFix(const Expr &Op, const Expr &Object,
+                                        ASTContext &Context) {
+  if (Op.getBeginLoc().isMacroID() || Op.getEndLoc().isMacroID())
+    return llvm::None;
+
+  if (const auto *Call = dyn_cast<CXXMemberCallExpr>(&Op)) {
+    const CXXMethodDecl *Method = Call->getMethodDecl();
+    // The implicit conversion is a load.
+    if (isa<CXXConversionDecl>(Method)) {
+      if (!isa<DeclRefExpr>(Object) && !isa<MemberExpr>(Object))
+        return llvm::None;
+      return FixItHint::CreateInsertion(
+          Lexer::getLocForEndOfToken(Object.getEndLoc(), 0,
+                                     Context.getSourceManager(),
+                                     Context.getLangOpts()),
+          (Twine(".load(") + RelaxedOrder + ")").str());
+    }
+    // A relaxed failure order needs a relaxed success order, which changes the
+    // semantics of the exchange too much to be fixed.
+    if (Method->getName().startswith("compare_exchange"))
+      return llvm::None;
+    const bool HasWrittenArgs =
+        llvm::any_of(Call->arguments(), [](const Expr *Arg) {
+          return !isa<CXXDefaultArgExpr>(Arg);
+        });
+    return FixItHint::CreateInsertion(
+        Call->getRParenLoc(),
+        (Twine(HasWrittenArgs ? ", " : "") + RelaxedOrder).str());
+  }
+
+  // The operators return the new value, the atomic methods the old one: only
+  // replace the operators whose value is discarded.
+  const auto *Operator = cast<CXXOperatorCallExpr>(&Op);
+  const StringRef Method = getEquivalentMethod(Operator->getOperator());
+  if (Method.empty() || !isDiscarded(Op, Context) ||
+      (!isa<DeclRefExpr>(Object) && !isa<MemberExpr>(Object)))
+    return llvm::None;
+  const bool IsIncrement = Operator->getOperator() == OO_PlusPlus ||
+                           Operator->getOperator() == OO_MinusMinus;
+  const StringRef Operand =
+      IsIncrement ? StringRef("1") : getText(*Operator->getArg(1), Context);
+  if (Operand.empty())
+    return llvm::None;
+  return FixItHint::CreateReplacement(
+      Op.getSourceRange(), (getText(Object, Context) + "." + Method + "(" +
+                            Operand + ", " + RelaxedOrder + ")")
+                               .str());
+}
+
+} // namespace
+
+AtomicMemoryOrderCheck::AtomicMemoryOrderCheck(StringRef Name,
+                                               ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      AtomicClasses(utils::options::parseStringList(
+          Options.get("AtomicClasses", "::std::atomic"))),
+      Counters(utils::options::parseStringList(Options.get("Counters", ""))),
+      CounterAnnotation(Options.get("CounterAnnotation", "counter")) {}
+
+void AtomicMemoryOrderCheck::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "AtomicClasses",
+                utils::options::serializeStringList(AtomicClasses));
+  Options.store(Opts, "Counters",
+                utils::options::serializeStringList(Counters));
+  Options.store(Opts, "CounterAnnotation", CounterAnnotation);
+}
+
+void AtomicMemoryOrderCheck::registerMatchers(MatchFinder *Finder) {
+  if (!getLangOpts().CPlusPlus11)
+    return;
+
+  const auto AtomicType = hasUnqualifiedDesugaredType(
+      recordType(hasDeclaration(cxxRecordDecl(hasAnyName(SmallVector<
+          StringRef, 4>(AtomicClasses.begin(), AtomicClasses.end()))))));
+  // The named atomics may be counters.
+  const auto NamedAtomic =
+      anyOf(declRefExpr(to(varDecl().bind("atomic"))),
+            memberExpr(member(fieldDecl().bind("atomic"))), anything());
+  const auto Atomic =
+      expr(anyOf(expr(hasType(AtomicType), NamedAtomic),
+                 hasType(pointsTo(AtomicType))))
+          .bind("object");
+
+  // The methods taking a memory order have it as their last parameter,
+  // defaulted to std::memory_order_seq_cst.
+  const auto ImplicitOrderCall = cxxMemberCallExpr(
+      on(Atomic), anyOf(hasAnyArgument(cxxDefaultArgExpr()),
+                        callee(cxxConversionDecl())));
+  const auto SeqCstOperator = cxxOperatorCallExpr(
+      anyOf(hasOverloadedOperatorName("="), hasOverloadedOperatorName("++"),
+            hasOverloadedOperatorName("--"), hasOverloadedOperatorName("+="),
+            hasOverloadedOperatorName("-="), hasOverloadedOperatorName("&="),
+            hasOverloadedOperatorName("|="), hasOverloadedOperatorName("^=")),
+      hasArgument(0, ignoringParenImpCasts(Atomic)));
+  const auto Loop = stmt(anyOf(forStmt(), cxxForRangeStmt(), whileStmt(),
+                               doStmt()))
+                        .bind("loop");
+  // The operations on dependent atomics are only resolved in the
+  // instantiations, whose identical diagnostics are merged.
+  Finder->addMatcher(expr(anyOf(ImplicitOrderCall, SeqCstOperator),
+                          anyOf(hasAncestor(Loop), anything()))
+                         .bind("op"),
+                     this);
+}
+
+bool AtomicMemoryOrderCheck::isCounter(const ValueDecl &Atomic) const {
+  for (const auto *Annotation : Atomic.specific_attrs<AnnotateAttr>())
+    if (Annotation->getAnnotation() == CounterAnnotation)
+      return true;
+  return llvm::any_of(Counters, [&](const std::string &Counter) {
+    return llvm::Regex(Counter).match(Atomic.getName());
+  });
+}
+
+void AtomicMemoryOrderCheck::check(const MatchFinder::MatchResult &Result) {
+  const auto *Op = Result.Nodes.getNodeAs<Expr>("op");
+  const auto *Object = Result.Nodes.getNodeAs<Expr>("object");
+  const auto *Atomic = Result.Nodes.getNodeAs<ValueDecl>("atomic");
+  const bool InLoop = Result.Nodes.getNodeAs<Stmt>("loop") != nullptr;
+  const bool IsCounter =
+      Atomic && Atomic->getIdentifier() && isCounter(*Atomic);
+  if (!InLoop && !IsCounter)
+    return;
+
+  std::string Operation;
+  if (const auto *Operator = dyn_cast<CXXOperatorCallExpr>(Op))
+    Operation =
+        (Twine("operator") + getOperatorSpelling(Operator->getOperator()))
+            .str();
+  else if (isa<CXXConversionDecl>(
+               cast<CXXMemberCallExpr>(Op)->getMethodDecl()))
+    Operation = "load";
+  else
+    Operation = cast<CXXMemberCallExpr>(Op)->getMethodDecl()->getName().str();
+
+  auto Diag = diag(Op->getBeginLoc(),
+                   "atomic '%0' is implicitly sequentially consistent%select{| "
+                   "in a loop}1, which costs a full fence on weakly ordered "
+                   "architectures; consider %select{an explicit memory "
+                   "order|'std::memory_order_relaxed' for this counter}2")
+              << Operation << InLoop << IsCounter;
+  // Only the counters are known not to order other memory accesses.
+  if (!IsCounter)
+    return;
+  if (auto Fix = getRelaxedFix(*Op, *Object->IgnoreParenImpCasts(),
+                               *Result.Context))
+    Diag << *Fix;
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
@@ -0,0 +1,46 @@
+//===--- AtomicMemoryOrderCheck.h - clang-tidy ------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_ATOMIC_MEMORY_ORDER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_ATOMIC_MEMORY_ORDER_H
+
+#include "../ClangTidy.h"
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+/// \brief Finds the atomic operations that are implicitly sequentially
+/// consistent, i.e. the operators and the methods called without a memory
+/// order, in loops and on the atomics used as counters.
+///
+/// The operations on counters are fixed to `std::memory_order_relaxed`.
+///
+/// For the user-facing documentation see:
+/// http://clang.llvm.org/extra/clang-tidy/checks/performance-atomic-memory-order.html
+class AtomicMemoryOrderCheck : public ClangTidyCheck {
+public:
+  AtomicMemoryOrderCheck(StringRef Name, ClangTidyContext *Context);
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override;
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
+
+private:
+  bool isCounter(const ValueDecl &Atomic) const;
+
+  const std::vector<std::string> AtomicClasses;
+  const std::vector<std::string> Counters;
+  const std::string CounterAnnotation;
+};
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_ATOMIC_MEMORY_ORDER_H
@@ -0,0 +1,226 @@
+//===--- AvoidStdFunctionInHotParamsCheck.cpp - clang-tidy ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AvoidStdFunctionInHotParamsCheck.h"
+
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+/// The uses of a callable parameter in its function.
+struct CallableUses {
+  unsigned Calls = 0;
+  // The conversions to bool and the comparisons with nullptr.
+  unsigned Tests = 0;
+  // The uses that may copy or store the callable.
+  unsigned Others = 0;
+};
+
+CallableUses getUses(const ParmVarDecl &Param, const FunctionDecl &Function,
+                     ASTContext &Context) {
+  const auto ParamRef = declRefExpr(to(equalsNode(&Param)));
+  const auto Call = cxxOperatorCallExpr(
+      hasOverloadedOperatorName("()"),
+      hasArgument(0, ignoringParenImpCasts(ParamRef.bind("call"))));
+  const auto Test = expr(anyOf(
+      cxxMemberCallExpr(on(ParamRef.bind("test")),
+                        callee(cxxConversionDecl())),
+      cxxOperatorCallExpr(
+          anyOf(hasOverloadedOperatorName("=="),
+                hasOverloadedOperatorName("!=")),
+          hasAnyArgument(ignoringParenImpCasts(ParamRef.bind("test"))),
+          hasAnyArgument(ignoringParenImpCasts(cxxNullPtrLiteralExpr())))));
+  llvm::SmallPtrSet<const DeclRefExpr *, 4> Calls, Tests;
+  for (const auto &Nodes :
+       match(decl(forEachDescendant(expr(anyOf(Call, Test)))), Function,
+             Context)) {
+    if (const auto *CallRef = Nodes.getNodeAs<DeclRefExpr>("call"))
+      Calls.insert(CallRef);
+    else
+      Tests.insert(Nodes.getNodeAs<DeclRefExpr>("test"));
+  }
+
+  CallableUses Uses;
+  Uses.Calls = Calls.size();
+  Uses.Tests = Tests.size();
+  for (const auto &Nodes : match(decl(forEachDescendant(ParamRef.bind("ref"))),
+                                 Function, Context)) {
+    const auto *Ref = Nodes.getNodeAs<DeclRefExpr>("ref");
+    if (!Calls.count(Ref) && !Tests.count(Ref))
+      ++Uses.Others;
+  }
+  // A lambda capturing the callable by copy may outlive the call.
+  for (const auto &Nodes :
+       match(decl(forEachDescendant(lambdaExpr().bind("lambda"))), Function,
+             Context)) {
+    for (const LambdaCapture &Capture :
+         Nodes.getNodeAs<LambdaExpr>("lambda")->captures())
+      if (Capture.capturesVariable() && Capture.getCapturedVar() == &Param &&
+          Capture.getCaptureKind() == LCK_ByCopy)
+        ++Uses.Others;
+  }
+  return Uses;
+}
+
+bool isReferencedOutsideOfCallExpr(const FunctionDecl &Function,
+                                   ASTContext &Context) {
+  auto Matches = match(declRefExpr(to(functionDecl(equalsNode(&Function))),
+                                   unless(hasAncestor(callExpr()))),
+                       Context);
+  return !Matches.empty();
+}
+
+/// Returns the text of the function type of the `std::function` type of
+/// \p Param, or an empty string if the type isn't written as a specialization
+/// of `std::function`.
+StringRef getWrittenSignature(const ParmVarDecl &Param,
+                              const ASTContext &Context) {
+  const TypeSourceInfo *TypeInfo = Param.getTypeSourceInfo();
+  if (!TypeInfo)
+    return StringRef();
+  TypeLoc Loc = TypeInfo->getTypeLoc();
+  if (auto ReferenceLoc = Loc.getAs<LValueReferenceTypeLoc>())
+    Loc = ReferenceLoc.getPointeeLoc();
+  Loc = Loc.getUnqualifiedLoc();
+  if (auto ElaboratedLoc = Loc.getAs<ElaboratedTypeLoc>())
+    Loc = ElaboratedLoc.getNamedTypeLoc();
+  auto SpecializationLoc = Loc.getAs<TemplateSpecializationTypeLoc>();
+  if (!SpecializationLoc || SpecializationLoc.getNumArgs() != 1)
+    return StringRef();
+  return Lexer::getSourceText(
+      CharSourceRange::getTokenRange(
+          SpecializationLoc.getArgLoc(0).getSourceRange()),
+      Context.getSourceManager(), Context.getLangOpts());
+}
+
+} // namespace
+
+AvoidStdFunctionInHotParamsCheck::AvoidStdFunctionInHotParamsCheck(
+    StringRef Name, ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      IncludeStyle(utils::IncludeSorter::parseIncludeStyle(
+          Options.getLocalOrGlobal("IncludeStyle", "llvm"))),
+      FunctionRefClass(Options.get("FunctionRefClass", "")),
+      FunctionRefHeader(Options.get("FunctionRefHeader", "")) {}
+
+void AvoidStdFunctionInHotParamsCheck::storeOptions(
+    ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "IncludeStyle",
+                utils::IncludeSorter::toString(IncludeStyle));
+  Options.store(Opts, "FunctionRefClass", FunctionRefClass);
+  Options.store(Opts, "FunctionRefHeader", FunctionRefHeader);
+}
+
+void AvoidStdFunctionInHotParamsCheck::registerPPCallbacks(
+    CompilerInstance &Compiler) {
+  Inserter.reset(new utils::IncludeInserter(
+      Compiler.getSourceManager(), Compiler.getLangOpts(), IncludeStyle));
+  Compiler.getPreprocessor().addPPCallbacks(Inserter->CreatePPCallbacks());
+}
+
+void AvoidStdFunctionInHotParamsCheck::registerMatchers(MatchFinder *Finder) {
+  if (!getLangOpts().CPlusPlus11)
+    return;
+
+  const auto StdFunctionType = hasCanonicalType(
+      hasDeclaration(cxxRecordDecl(hasName("::std::function"))));
+  const auto StdFunctionParam =
+      parmVarDecl(hasType(qualType(anyOf(qualType(StdFunctionType),
+                                         references(StdFunctionType)))),
+                  decl().bind("param"));
+  // The signature of a virtual method is shared with its overrides.
+  Finder->addMatcher(
+      functionDecl(hasBody(stmt()), isDefinition(), unless(isImplicit()),
+                   unless(cxxMethodDecl(isVirtual())),
+                   has(typeLoc(forEach(StdFunctionParam))),
+                   unless(isInstantiated()), decl().bind("function")),
+      this);
+}
+
+void AvoidStdFunctionInHotParamsCheck::check(
+    const MatchFinder::MatchResult &Result) {
+  const auto *Param = Result.Nodes.getNodeAs<ParmVarDecl>("param");
+  const auto *Function = Result.Nodes.getNodeAs<FunctionDecl>("function");
+  ASTContext &Context = *Result.Context;
+
+  // The callables passed by rvalue or non-const reference are meant to be
+  // consumed or modified.
+  const QualType Type = Param->getType();
+  if (Type->isRValueReferenceType() ||
+      (Type->isLValueReferenceType() &&
+       !Type->getPointeeType().isConstQualified()))
+    return;
+  const CallableUses Uses = getUses(*Param, *Function, Context);
+  if (Uses.Calls == 0 || Uses.Others != 0)
+    return;
+
+  const bool HasFunctionRef = !FunctionRefClass.empty();
+  auto Diag = diag(Param->getLocation(),
+                   "parameter %0 of type %1 is only invoked; consider "
+                   "%select{making its type a template parameter|passing it "
+                   "as '%3'}2 to avoid constructing a 'std::function' for "
+                   "each call")
+              << Param << Type << HasFunctionRef << FunctionRefClass;
+
+  // Do not propose fixes when:
+  // 1. the callable is tested, the class replacing std::function may not
+  //    support it,
+  // 2. the function is referenced outside of a call expression, as the
+  //    signature change could introduce build errors,
+  // 3. a declaration of the parameter is in a macro, has a default argument,
+  //    or isn't written as a std::function specialization.
+  if (!HasFunctionRef || Uses.Tests != 0 ||
+      isReferencedOutsideOfCallExpr(*Function, Context))
+    return;
+  const unsigned Index = Param->getFunctionScopeIndex();
+  std::vector<FixItHint> Fixes;
+  for (const FunctionDecl *Decl = Function; Decl != nullptr;
+       Decl = Decl->getPreviousDecl()) {
+    const ParmVarDecl &CurrentParam = *Decl->getParamDecl(Index);
+    const StringRef Signature = getWrittenSignature(CurrentParam, Context);
+    // The replaced type of a named parameter extends to its name, so that the
+    // name stays separated from the new type when the old one ends with '&'.
+    const bool IsNamed = !CurrentParam.getName().empty();
+    const SourceLocation TypeEnd =
+        CurrentParam.getTypeSourceInfo()->getTypeLoc().getEndLoc();
+    const CharSourceRange TypeRange =
+        IsNamed ? CharSourceRange::getCharRange(CurrentParam.getBeginLoc(),
+                                                CurrentParam.getLocation())
+                : CharSourceRange::getTokenRange(CurrentParam.getBeginLoc(),
+                                                 TypeEnd);
+    if (Signature.empty() || CurrentParam.hasDefaultArg() ||
+        TypeRange.getBegin().isMacroID() || TypeRange.getEnd().isMacroID())
+      return;
+    Fixes.push_back(FixItHint::CreateReplacement(
+        TypeRange, (llvm::Twine(FunctionRefClass) + "<" + Signature + ">" +
+                    (IsNamed ? " " : ""))
+                       .str()));
+  }
+  for (const FixItHint &Fix : Fixes)
+    Diag << Fix;
+  if (FunctionRefHeader.empty())
+    return;
+  if (auto IncludeFixit = Inserter->CreateIncludeInsertion(
+          Context.getSourceManager().getFileID(Param->getBeginLoc()),
+          FunctionRefHeader, /*IsAngled=*/false))
+    Diag << *IncludeFixit;
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
@@ -0,0 +1,155 @@
+//===--- DevirtualizationOpportunityCheck.cpp - clang-tidy ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DevirtualizationOpportunityCheck.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/Lex/Lexer.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+/// Returns the location of the `final` specifier following the token at
+/// \p Loc, or an invalid location in macros.
+SourceLocation getFinalLoc(SourceLocation Loc, const ASTContext &Context) {
+  if (Loc.isInvalid() || Loc.isMacroID())
+    return SourceLocation();
+  return Lexer::getLocForEndOfToken(Loc, 0, Context.getSourceManager(),
+                                    Context.getLangOpts());
+}
+
+} // namespace
+
+DevirtualizationOpportunityCheck::DevirtualizationOpportunityCheck(
+    StringRef Name, ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      LoopCallsOnly(Options.get("LoopCallsOnly", 0) != 0) {}
+
+void DevirtualizationOpportunityCheck::storeOptions(
+    ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "LoopCallsOnly", LoopCallsOnly);
+}
+
+void DevirtualizationOpportunityCheck::registerMatchers(MatchFinder *Finder) {
+  if (!getLangOpts().CPlusPlus11)
+    return;
+
+  Finder->addMatcher(
+      cxxRecordDecl(isDefinition(), unless(isImplicit())).bind("record"), this);
+  Finder->addMatcher(
+      cxxMemberCallExpr(callee(cxxMethodDecl(isVirtual())),
+                        hasAncestor(stmt(anyOf(forStmt(), cxxForRangeStmt(),
+                                               whileStmt(), doStmt()))))
+          .bind("call"),
+      this);
+}
+
+void DevirtualizationOpportunityCheck::check(
+    const MatchFinder::MatchResult &Result) {
+  if (const auto *Record = Result.Nodes.getNodeAs<CXXRecordDecl>("record")) {
+    collectRecord(*Record, *Result.Context);
+    return;
+  }
+
+  // The qualified calls aren't virtual.
+  const auto *Call = Result.Nodes.getNodeAs<CXXMemberCallExpr>("call");
+  const auto *Callee = dyn_cast<MemberExpr>(Call->getCallee()->IgnoreParens());
+  if (!Callee || Callee->hasQualifier())
+    return;
+  LoopCalls.try_emplace(Call->getMethodDecl()->getCanonicalDecl(),
+                        Call->getBeginLoc());
+  QualType ObjectType = Call->getImplicitObjectArgument()->getType();
+  if (ObjectType->isPointerType())
+    ObjectType = ObjectType->getPointeeType();
+  if (const auto *Class = ObjectType->getAsCXXRecordDecl())
+    LoopCalls.try_emplace(Class->getCanonicalDecl(), Call->getBeginLoc());
+}
+
+void DevirtualizationOpportunityCheck::collectRecord(
+    const CXXRecordDecl &Record, ASTContext &Context) {
+  for (const CXXBaseSpecifier &Base : Record.bases())
+    if (const CXXRecordDecl *BaseDecl = Base.getType()->getAsCXXRecordDecl())
+      Overridden.insert(BaseDecl->getCanonicalDecl());
+  for (const CXXMethodDecl *Method : Record.methods())
+    for (const CXXMethodDecl *OverriddenMethod : Method->overridden_methods())
+      Overridden.insert(OverriddenMethod->getCanonicalDecl());
+
+  // The classes of the headers may be derived in other translation units, and
+  // the templates with other arguments.
+  if (!Record.isPolymorphic() || Record.hasAttr<FinalAttr>() ||
+      Record.isLambda() || Record.isDependentContext() ||
+      Record.getDescribedClassTemplate() ||
+      isa<ClassTemplateSpecializationDecl>(&Record) ||
+      !Context.getSourceManager().isInMainFile(Record.getLocation()))
+    return;
+  CandidateClasses.push_back(
+      {&Record, getFinalLoc(Record.getLocation(), Context)});
+  for (const CXXMethodDecl *Method : Record.methods()) {
+    if (!Method->isVirtual() || Method->isPure() || Method->isImplicit() ||
+        isa<CXXDestructorDecl>(Method) || Method->hasAttr<FinalAttr>() ||
+        !Method->getTypeSourceInfo())
+      continue;
+    CandidateMethods.push_back(
+        {Method,
+         getFinalLoc(Method->getTypeSourceInfo()->getTypeLoc().getEndLoc(),
+                     Context)});
+  }
+}
+
+void DevirtualizationOpportunityCheck::onEndOfTranslationUnit() {
+  for (const Candidate &C : CandidateClasses) {
+    const auto *Record = cast<CXXRecordDecl>(C.Decl);
+    if (!Record->isAbstract() &&
+        !Overridden.count(Record->getCanonicalDecl()))
+      reportCandidate(C, /*IsClass=*/true);
+  }
+  // The methods of the classes without derived classes are covered by the
+  // class.
+  for (const Candidate &C : CandidateMethods) {
+    const auto *Method = cast<CXXMethodDecl>(C.Decl);
+    if (Overridden.count(Method->getParent()->getCanonicalDecl()) &&
+        !Overridden.count(Method->getCanonicalDecl()))
+      reportCandidate(C, /*IsClass=*/false);
+  }
+
+  CandidateClasses.clear();
+  CandidateMethods.clear();
+  Overridden.clear();
+  LoopCalls.clear();
+}
+
+void DevirtualizationOpportunityCheck::reportCandidate(const Candidate &C,
+                                                       bool IsClass) {
+  const auto LoopCall = LoopCalls.find(C.Decl->getCanonicalDecl());
+  const bool IsCalledInLoop = LoopCall != LoopCalls.end();
+  if (LoopCallsOnly && !IsCalledInLoop)
+    return;
+
+  {
+    auto Diag = diag(C.Decl->getLocation(),
+                     "%select{virtual method %1 has no overrides|polymorphic "
+                     "class %1 has no derived classes}0 in this translation "
+                     "unit; consider marking it 'final' to let the compiler "
+                     "devirtualize its calls")
+                << IsClass << C.Decl;
+    if (C.FinalLoc.isValid())
+      Diag << FixItHint::CreateInsertion(C.FinalLoc, " final");
+  }
+  if (IsCalledInLoop)
+    diag(LoopCall->second, "virtual call in a loop here", DiagnosticIDs::Note);
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
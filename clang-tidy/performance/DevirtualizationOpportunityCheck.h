@@ -0,0 +1,65 @@
+//===--- DevirtualizationOpportunityCheck.h - clang-tidy --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_DEVIRTUALIZATION_OPPORTUNITY_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_DEVIRTUALIZATION_OPPORTUNITY_H
+
+#include "../ClangTidy.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+/// \brief Finds the polymorphic classes without derived classes and the
+/// virtual methods without overrides, which could be marked `final` to let
+/// the compiler devirtualize their calls.
+///
+/// Only the classes defined in the main file are reported, since the classes
+/// of the headers may be derived in other translation units.
+///
+/// For the user-facing documentation see:
+/// http://clang.llvm.org/extra/clang-tidy/checks/performance-devirtualization-opportunity.html
+class DevirtualizationOpportunityCheck : public ClangTidyCheck {
+public:
+  DevirtualizationOpportunityCheck(StringRef Name, ClangTidyContext *Context);
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override;
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void onEndOfTranslationUnit() override;
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
+
+private:
+  /// A class or a virtual method that could be final, with the location of
+  /// the `final` specifier, invalid if it can't be inserted.
+  struct Candidate {
+    const NamedDecl *Decl;
+    SourceLocation FinalLoc;
+  };
+
+  void collectRecord(const CXXRecordDecl &Record, ASTContext &Context);
+  void reportCandidate(const Candidate &C, bool IsClass);
+
+  const bool LoopCallsOnly;
+
+  std::vector<Candidate> CandidateClasses;
+  std::vector<Candidate> CandidateMethods;
+  /// The canonical declarations of the classes with derived classes and of
+  /// the overridden methods.
+  llvm::SmallPtrSet<const Decl *, 32> Overridden;
+  /// The first virtual call in a loop on the objects of a class, and of a
+  /// method.
+  llvm::DenseMap<const Decl *, SourceLocation> LoopCalls;
+};
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_DEVIRTUALIZATION_OPPORTUNITY_H
@@ -0,0 +1,173 @@
+//===--- FalseSharingCheck.cpp - clang-tidy -------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FalseSharingCheck.h"
+
+#include "../utils/OptionsUtils.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/RecordLayout.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+ast_matchers::internal::Matcher<FieldDecl>
+synchronizationField(ArrayRef<std::string> SynchronizationClasses) {
+  const auto Class = cxxRecordDecl(hasAnyName(SmallVector<StringRef, 8>(
+      SynchronizationClasses.begin(), SynchronizationClasses.end())));
+  return fieldDecl(
+      hasType(hasUnqualifiedDesugaredType(recordType(hasDeclaration(Class)))));
+}
+
+} // namespace
+
+FalseSharingCheck::FalseSharingCheck(StringRef Name, ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      CacheLineSize(Options.get("CacheLineSize", 64U)),
+      SynchronizationClasses(utils::options::parseStringList(Options.get(
+          "SynchronizationClasses",
+          "::std::atomic;::std::atomic_flag;::std::mutex;"
+          "::std::recursive_mutex;::std::shared_mutex;::std::timed_mutex"))),
+      ThreadIndexRegexp(Options.get(
+          "ThreadIndexRegexp", "^(tid|(thread|worker|cpu)_?(id|idx|index))$")),
+      ThreadIndexPattern(ThreadIndexRegexp, llvm::Regex::IgnoreCase) {}
+
+void FalseSharingCheck::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "CacheLineSize", CacheLineSize);
+  Options.store(Opts, "SynchronizationClasses",
+                utils::options::serializeStringList(SynchronizationClasses));
+  Options.store(Opts, "ThreadIndexRegexp", ThreadIndexRegexp);
+}
+
+void FalseSharingCheck::registerMatchers(MatchFinder *Finder) {
+  if (!getLangOpts().CPlusPlus11)
+    return;
+
+  Finder->addMatcher(
+      cxxRecordDecl(isDefinition(), unless(isExpansionInSystemHeader()),
+                    has(synchronizationField(SynchronizationClasses)))
+          .bind("record"),
+      this);
+
+  // The writes to the elements of an array indexed by a thread index.
+  const auto Index =
+      ignoringParenImpCasts(declRefExpr(to(varDecl().bind("index"))));
+  const auto Slot =
+      expr(anyOf(arraySubscriptExpr(hasBase(ignoringParenImpCasts(
+                                        expr(hasType(constantArrayType()))
+                                            .bind("array"))),
+                                    hasIndex(Index)),
+                 cxxOperatorCallExpr(
+                     hasOverloadedOperatorName("[]"),
+                     hasArgument(0, expr(hasType(cxxRecordDecl(hasAnyName(
+                                             "::std::array", "::std::deque",
+                                             "::std::vector"))))
+                                        .bind("array")),
+                     hasArgument(1, Index))))
+          .bind("slot");
+  const auto Written = ignoringParenImpCasts(anyOf(
+      Slot, memberExpr(hasObjectExpression(ignoringParenImpCasts(Slot)))));
+  Finder->addMatcher(
+      expr(anyOf(binaryOperator(isAssignmentOperator(), hasLHS(Written)),
+                 unaryOperator(anyOf(hasOperatorName("++"),
+                                     hasOperatorName("--")),
+                               hasUnaryOperand(Written)),
+                 cxxOperatorCallExpr(
+                     anyOf(hasOverloadedOperatorName("="),
+                           hasOverloadedOperatorName("+="),
+                           hasOverloadedOperatorName("-="),
+                           hasOverloadedOperatorName("&="),
+                           hasOverloadedOperatorName("|="),
+                           hasOverloadedOperatorName("^="),
+                           hasOverloadedOperatorName("++"),
+                           hasOverloadedOperatorName("--")),
+                     hasArgument(0, Written)),
+                 cxxMemberCallExpr(on(Written),
+                                   callee(cxxMethodDecl(unless(isConst()))))),
+           unless(isInTemplateInstantiation())),
+      this);
+}
+
+void FalseSharingCheck::check(const MatchFinder::MatchResult &Result) {
+  if (const auto *Record = Result.Nodes.getNodeAs<RecordDecl>("record"))
+    checkRecord(*Record, *Result.Context);
+  else
+    checkThreadSlot(*Result.Nodes.getNodeAs<Expr>("slot"),
+                    *Result.Nodes.getNodeAs<Expr>("array"),
+                    *Result.Nodes.getNodeAs<VarDecl>("index"),
+                    *Result.Context);
+}
+
+void FalseSharingCheck::checkRecord(const RecordDecl &Record,
+                                    ASTContext &Context) {
+  // The layouts of the templates depend on their arguments.
+  if (Record.isUnion() || Record.isDependentType() || Record.isInvalidDecl() ||
+      isa<ClassTemplateSpecializationDecl>(&Record))
+    return;
+
+  const ASTRecordLayout &Layout = Context.getASTRecordLayout(&Record);
+  const FieldDecl *Previous = nullptr;
+  for (const auto &Nodes :
+       match(cxxRecordDecl(forEach(
+                 synchronizationField(SynchronizationClasses).bind("field"))),
+             Record, Context)) {
+    const auto *Field = Nodes.getNodeAs<FieldDecl>("field");
+    if (Previous) {
+      const CharUnits Distance = Context.toCharUnitsFromBits(
+          Layout.getFieldOffset(Field->getFieldIndex()) -
+          Layout.getFieldOffset(Previous->getFieldIndex()));
+      if (Distance.getQuantity() < CacheLineSize)
+        diag(Field->getLocation(),
+             "%0 is %1 bytes after %2 and may share a cache line with it; "
+             "consider aligning it with "
+             "'alignas(std::hardware_destructive_interference_size)'")
+            << Field << static_cast<unsigned>(Distance.getQuantity())
+            << Previous;
+    }
+    Previous = Field;
+  }
+}
+
+void FalseSharingCheck::checkThreadSlot(const Expr &Slot, const Expr &Array,
+                                        const VarDecl &Index,
+                                        ASTContext &Context) {
+  if (!ThreadIndexPattern.match(Index.getName()))
+    return;
+  const QualType ElementType = Slot.getType();
+  if (ElementType->isIncompleteType() || ElementType->isDependentType())
+    return;
+  const CharUnits Size = Context.getTypeSizeInChars(ElementType);
+  if (Size.isZero() || Size.getQuantity() >= CacheLineSize)
+    return;
+
+  // Report each array once.
+  const Expr *ArrayExpr = Array.IgnoreParenImpCasts();
+  const Decl *ArrayDecl = nullptr;
+  if (const auto *Ref = dyn_cast<DeclRefExpr>(ArrayExpr))
+    ArrayDecl = Ref->getDecl();
+  else if (const auto *Member = dyn_cast<MemberExpr>(ArrayExpr))
+    ArrayDecl = Member->getMemberDecl();
+  if (ArrayDecl && !ReportedArrays.insert(ArrayDecl).second)
+    return;
+
+  diag(Slot.getBeginLoc(),
+       "the elements of type %0 indexed by the thread index %1 are %2 bytes "
+       "and may share a cache line with the elements of other threads; "
+       "consider aligning them with "
+       "'alignas(std::hardware_destructive_interference_size)'")
+      << ElementType << &Index << static_cast<unsigned>(Size.getQuantity());
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
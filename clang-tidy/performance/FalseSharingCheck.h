@@ -0,0 +1,51 @@
+//===--- FalseSharingCheck.h - clang-tidy -----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_FALSE_SHARING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_FALSE_SHARING_H
+
+#include "../ClangTidy.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Support/Regex.h"
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+/// \brief Finds the objects written by concurrent threads that may share a
+/// cache line: the atomic and mutex fields of a record closer than a cache
+/// line, and the elements smaller than a cache line of the arrays indexed by
+/// a thread index.
+///
+/// For the user-facing documentation see:
+/// http://clang.llvm.org/extra/clang-tidy/checks/performance-false-sharing.html
+class FalseSharingCheck : public ClangTidyCheck {
+public:
+  FalseSharingCheck(StringRef Name, ClangTidyContext *Context);
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override;
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
+
+private:
+  void checkRecord(const RecordDecl &Record, ASTContext &Context);
+  void checkThreadSlot(const Expr &Slot, const Expr &Array,
+                       const VarDecl &Index, ASTContext &Context);
+
+  const unsigned CacheLineSize;
+  const std::vector<std::string> SynchronizationClasses;
+  const std::string ThreadIndexRegexp;
+  llvm::Regex ThreadIndexPattern;
+  llvm::SmallPtrSet<const Decl *, 8> ReportedArrays;
+};
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_FALSE_SHARING_H
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "FasterStringFindCheck.h"
+#include "../utils/Matchers.h"
 #include "../utils/OptionsUtils.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
@@ -76,8 +77,8 @@ void FasterStringFindCheck::registerMatchers(MatchFinder *Finder) {
           hasArgument(0, SingleChar),
           on(expr(
               hasType(hasUnqualifiedDesugaredType(recordType(hasDeclaration(
-                  recordDecl(hasAnyName(SmallVector<StringRef, 4>(
-                      StringLikeClasses.begin(), StringLikeClasses.end()))))))),
+                  recordDecl(
+                      matchers::hasAnyListedName(StringLikeClasses)))))),
               unless(hasSubstitutedType())))),
       this);
 }
@@ -70,7 +70,9 @@ bool ForRangeCopyCheck::handleConstValueCopy(const VarDecl &LoopVar,
     return false;
   }
   llvm::Optional<bool> Expensive =
-      utils::type_traits::isExpensiveToCopy(LoopVar.getType(), Context);
+      utils::type_traits::isExpensiveToCopy(
+          LoopVar.getType(), Context,
+          &getTranslationUnitCache<utils::type_traits::TypeTraitsCache>());
   if (!Expensive || !*Expensive)
     return false;
   auto Diagnostic =
@@ -87,7 +89,9 @@ bool ForRangeCopyCheck::handleCopyIsOnlyConstReferenced(
     const VarDecl &LoopVar, const CXXForRangeStmt &ForRange,
     ASTContext &Context) {
   llvm::Optional<bool> Expensive =
-      utils::type_traits::isExpensiveToCopy(LoopVar.getType(), Context);
+      utils::type_traits::isExpensiveToCopy(
+          LoopVar.getType(), Context,
+          &getTranslationUnitCache<utils::type_traits::TypeTraitsCache>());
   if (LoopVar.getType().isConstQualified() || !Expensive || !*Expensive)
     return false;
   // We omit the case where the loop variable is not used in the loop body. E.g.
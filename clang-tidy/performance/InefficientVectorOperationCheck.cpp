@@ -42,11 +42,18 @@ namespace {
 //   - PushBackOrEmplaceBackCallName: 'v.push_back(i)' (as cxxMemberCallExpr).
 //   - LoopInitVarName: 'i' (as VarDecl).
 //   - LoopEndExpr: '10+1' (as Expr).
+//
+// The calls appending to the other kinds of containers are bound to
+// StringAppendCallName, HashContainerInsertCallName and ProtoAddFieldCallName
+// instead of PushBackOrEmplaceBackCallName.
 static const char LoopCounterName[] = "for_loop_counter";
 static const char LoopParentName[] = "loop_parent";
 static const char VectorVarDeclName[] = "vector_var_decl";
 static const char VectorVarDeclStmtName[] = "vector_var_decl_stmt";
 static const char PushBackOrEmplaceBackCallName[] = "append_call";
+static const char StringAppendCallName[] = "string_append_call";
+static const char HashContainerInsertCallName[] = "hash_container_insert_call";
+static const char ProtoAddFieldCallName[] = "proto_add_field_call";
 static const char LoopInitVarName[] = "loop_init_var";
 static const char LoopEndExprName[] = "loop_end_expr";
 
@@ -58,36 +65,111 @@ ast_matchers::internal::Matcher<Expr> supportedContainerTypesMatcher() {
       "::std::unordered_map", "::std::array", "::std::deque")));
 }
 
+// The kinds of containers, as selected in the diagnostic.
+enum ContainerKind { CK_Vector, CK_String, CK_HashContainer, CK_RepeatedField };
+
+// Matches the default constructed variables of a class matching \p Class.
+DeclarationMatcher defaultConstructedVarDecl(const DeclarationMatcher &Class) {
+  return varDecl(hasInitializer(cxxConstructExpr(
+                     hasType(Class), hasDeclaration(cxxConstructorDecl(
+                                         isDefaultConstructor())))))
+      .bind(VectorVarDeclName);
+}
+
+SmallVector<StringRef, 5> toNames(const std::vector<std::string> &Classes) {
+  return SmallVector<StringRef, 5>(Classes.begin(), Classes.end());
+}
+
 } // namespace
 
 InefficientVectorOperationCheck::InefficientVectorOperationCheck(
     StringRef Name, ClangTidyContext *Context)
     : ClangTidyCheck(Name, Context),
       VectorLikeClasses(utils::options::parseStringList(
-          Options.get("VectorLikeClasses", "::std::vector"))) {}
+          Options.get("VectorLikeClasses", "::std::vector"))),
+      StringLikeClasses(utils::options::parseStringList(
+          Options.get("StringLikeClasses", "::std::basic_string"))),
+      HashContainerClasses(utils::options::parseStringList(Options.get(
+          "HashContainerClasses",
+          "::std::unordered_map;::std::unordered_multimap;"
+          "::std::unordered_set;::std::unordered_multiset"))),
+      EnableProto(Options.get("EnableProto", 0)) {}
 
 void InefficientVectorOperationCheck::storeOptions(
     ClangTidyOptions::OptionMap &Opts) {
   Options.store(Opts, "VectorLikeClasses",
                 utils::options::serializeStringList(VectorLikeClasses));
+  Options.store(Opts, "StringLikeClasses",
+                utils::options::serializeStringList(StringLikeClasses));
+  Options.store(Opts, "HashContainerClasses",
+                utils::options::serializeStringList(HashContainerClasses));
+  Options.store(Opts, "EnableProto", EnableProto);
 }
 
 void InefficientVectorOperationCheck::registerMatchers(MatchFinder *Finder) {
-  const auto VectorDecl = cxxRecordDecl(hasAnyName(SmallVector<StringRef, 5>(
-      VectorLikeClasses.begin(), VectorLikeClasses.end())));
-  const auto VectorDefaultConstructorCall = cxxConstructExpr(
-      hasType(VectorDecl),
-      hasDeclaration(cxxConstructorDecl(isDefaultConstructor())));
-  const auto VectorVarDecl =
-      varDecl(hasInitializer(VectorDefaultConstructorCall))
-          .bind(VectorVarDeclName);
+  const auto VectorDecl = cxxRecordDecl(hasAnyName(toNames(VectorLikeClasses)));
+  const auto VectorVarDecl = defaultConstructedVarDecl(VectorDecl);
   const auto VectorAppendCallExpr =
       cxxMemberCallExpr(
           callee(cxxMethodDecl(hasAnyName("push_back", "emplace_back"))),
           on(hasType(VectorDecl)),
           onImplicitObjectArgument(declRefExpr(to(VectorVarDecl))))
           .bind(PushBackOrEmplaceBackCallName);
-  const auto VectorAppendCall = expr(ignoringImplicit(VectorAppendCallExpr));
+  addLoopMatchers(Finder, VectorAppendCallExpr);
+
+  // Match the characters appended to strings, one per iteration:
+  //   s.push_back(c);
+  //   s += c;
+  if (!StringLikeClasses.empty()) {
+    const auto StringVarRef = declRefExpr(to(defaultConstructedVarDecl(
+        cxxRecordDecl(hasAnyName(toNames(StringLikeClasses))))));
+    addLoopMatchers(
+        Finder,
+        expr(anyOf(
+                 cxxMemberCallExpr(callee(cxxMethodDecl(hasName("push_back"))),
+                                   onImplicitObjectArgument(StringVarRef)),
+                 cxxOperatorCallExpr(
+                     hasOverloadedOperatorName("+="),
+                     hasArgument(0, StringVarRef),
+                     hasArgument(1, hasType(isAnyCharacter())))))
+            .bind(StringAppendCallName));
+  }
+
+  // Match the single elements inserted into hash containers:
+  //   m.insert(std::make_pair(k, v));
+  //   m.emplace(k, v);
+  if (!HashContainerClasses.empty()) {
+    const auto HashContainerVarRef = declRefExpr(to(defaultConstructedVarDecl(
+        cxxRecordDecl(hasAnyName(toNames(HashContainerClasses))))));
+    addLoopMatchers(
+        Finder,
+        cxxMemberCallExpr(
+            anyOf(cxxMemberCallExpr(
+                      callee(cxxMethodDecl(hasName("insert"))),
+                      argumentCountIs(1),
+                      unless(hasArgument(
+                          0, ignoringImplicit(cxxStdInitializerListExpr())))),
+                  cxxMemberCallExpr(callee(cxxMethodDecl(hasName("emplace"))))),
+            onImplicitObjectArgument(HashContainerVarRef))
+            .bind(HashContainerInsertCallName));
+  }
+
+  // Match the elements added to the repeated fields of protobuf messages:
+  //   m.add_field(x);
+  if (EnableProto) {
+    const auto ProtoVarRef = declRefExpr(to(defaultConstructedVarDecl(
+        cxxRecordDecl(isDerivedFrom(hasAnyName(
+            "::google::protobuf::MessageLite", "::proto2::MessageLite"))))));
+    addLoopMatchers(
+        Finder, cxxMemberCallExpr(callee(cxxMethodDecl(matchesName("::add_"))),
+                                  onImplicitObjectArgument(ProtoVarRef))
+                    .bind(ProtoAddFieldCallName));
+  }
+}
+
+void InefficientVectorOperationCheck::addLoopMatchers(
+    MatchFinder *Finder, const StatementMatcher &AppendCallExpr) {
+  const auto AppendCall = expr(ignoringImplicit(AppendCallExpr));
   const auto VectorVarDefStmt =
       declStmt(hasSingleDecl(equalsBoundNode(VectorVarDeclName)))
           .bind(VectorVarDeclStmtName);
@@ -98,11 +180,11 @@ void InefficientVectorOperationCheck::registerMatchers(MatchFinder *Finder) {
   const auto RefersToLoopVar = ignoringParenImpCasts(
       declRefExpr(to(varDecl(equalsBoundNode(LoopInitVarName)))));
 
-  // Matchers for the loop whose body has only 1 push_back/emplace_back calling
-  // statement.
+  // Matchers for the loop whose body has only 1 statement appending to the
+  // container.
   const auto HasInterestingLoopBody =
-      hasBody(anyOf(compoundStmt(statementCountIs(1), has(VectorAppendCall)),
-                    VectorAppendCall));
+      hasBody(anyOf(compoundStmt(statementCountIs(1), has(AppendCall)),
+                    AppendCall));
   const auto InInterestingCompoundStmt =
       hasParent(compoundStmt(has(VectorVarDefStmt)).bind(LoopParentName));
 
@@ -147,8 +229,20 @@ void InefficientVectorOperationCheck::check(
   const auto *ForLoop = Result.Nodes.getNodeAs<ForStmt>(LoopCounterName);
   const auto *RangeLoop =
       Result.Nodes.getNodeAs<CXXForRangeStmt>(RangeLoopName);
-  const auto *VectorAppendCall =
-      Result.Nodes.getNodeAs<CXXMemberCallExpr>(PushBackOrEmplaceBackCallName);
+  static const std::pair<const char *, ContainerKind> AppendCallNames[] = {
+      {PushBackOrEmplaceBackCallName, CK_Vector},
+      {StringAppendCallName, CK_String},
+      {HashContainerInsertCallName, CK_HashContainer},
+      {ProtoAddFieldCallName, CK_RepeatedField}};
+  const CallExpr *AppendCall = nullptr;
+  ContainerKind Kind = CK_Vector;
+  for (const auto &Name : AppendCallNames) {
+    AppendCall = Result.Nodes.getNodeAs<CallExpr>(Name.first);
+    if (AppendCall) {
+      Kind = Name.second;
+      break;
+    }
+  }
   const auto *LoopEndExpr = Result.Nodes.getNodeAs<Expr>(LoopEndExprName);
   const auto *LoopParent = Result.Nodes.getNodeAs<CompoundStmt>(LoopParentName);
 
@@ -157,8 +251,10 @@ void InefficientVectorOperationCheck::check(
     LoopStmt = RangeLoop;
 
   llvm::SmallPtrSet<const DeclRefExpr *, 16> AllVectorVarRefs =
-      utils::decl_ref_expr::allDeclRefExprs(*VectorVarDecl, *LoopParent,
-                                            *Context);
+      utils::decl_ref_expr::allDeclRefExprs(
+          *VectorVarDecl, *LoopParent, *Context,
+          &getTranslationUnitCache<
+              utils::decl_ref_expr::DeclRefExprIndexCache>());
   for (const auto *Ref : AllVectorVarRefs) {
     // Skip cases where there are usages (defined as DeclRefExpr that refers to
     // "v") of vector variable `v` before the for loop. We consider these usages
@@ -173,14 +269,35 @@ void InefficientVectorOperationCheck::check(
     }
   }
 
+  // The container is the object of the member call, or the left operand of
+  // the operator call.
+  const Expr *ContainerExpr = AppendCall->getArg(0);
+  if (const auto *MemberCall = dyn_cast<CXXMemberCallExpr>(AppendCall))
+    ContainerExpr = MemberCall->getImplicitObjectArgument();
   llvm::StringRef VectorVarName = Lexer::getSourceText(
-      CharSourceRange::getTokenRange(
-          VectorAppendCall->getImplicitObjectArgument()->getSourceRange()),
-      SM, Context->getLangOpts());
+      CharSourceRange::getTokenRange(ContainerExpr->getSourceRange()), SM,
+      Context->getLangOpts());
+
+  // The repeated field of 'add_field()' is reserved through the
+  // 'mutable_field()' accessor, if the message has one.
+  std::string ReserveCall = (VectorVarName + ".reserve(").str();
+  if (Kind == CK_RepeatedField) {
+    StringRef Field = AppendCall->getDirectCallee()->getName();
+    Field.consume_front("add_");
+    std::string Accessor = ("mutable_" + Field).str();
+    const CXXRecordDecl *Message =
+        cast<CXXMemberCallExpr>(AppendCall)->getRecordDecl();
+    ReserveCall.clear();
+    if (llvm::any_of(Message->methods(), [&](const CXXMethodDecl *Method) {
+          return Method->getDeclName().isIdentifier() &&
+                 Method->getName() == Accessor;
+        }))
+      ReserveCall = (VectorVarName + "." + Accessor + "()->Reserve(").str();
+  }
 
   std::string ReserveStmt;
   // Handle for-range loop cases.
-  if (RangeLoop) {
+  if (RangeLoop && !ReserveCall.empty()) {
     // Get the range-expression in a for-range statement represented as
     // `for (range-declarator: range-expression)`.
     StringRef RangeInitExpName = Lexer::getSourceText(
@@ -188,22 +305,20 @@ void InefficientVectorOperationCheck::check(
             RangeLoop->getRangeInit()->getSourceRange()),
         SM, Context->getLangOpts());
 
-    ReserveStmt =
-        (VectorVarName + ".reserve(" + RangeInitExpName + ".size()" + ");\n")
-            .str();
-  } else if (ForLoop) {
+    ReserveStmt = ReserveCall + (RangeInitExpName + ".size()" + ");\n").str();
+  } else if (ForLoop && !ReserveCall.empty()) {
     // Handle counter-based loop cases.
     StringRef LoopEndSource = Lexer::getSourceText(
         CharSourceRange::getTokenRange(LoopEndExpr->getSourceRange()), SM,
         Context->getLangOpts());
-    ReserveStmt = (VectorVarName + ".reserve(" + LoopEndSource + ");\n").str();
+    ReserveStmt = ReserveCall + (LoopEndSource + ");\n").str();
   }
 
-  auto Diag =
-      diag(VectorAppendCall->getBeginLoc(),
-           "%0 is called inside a loop; "
-           "consider pre-allocating the vector capacity before the loop")
-      << VectorAppendCall->getMethodDecl()->getDeclName();
+  auto Diag = diag(AppendCall->getBeginLoc(),
+                   "%0 is called inside a loop; consider pre-allocating the "
+                   "%select{vector|string|container|repeated field}1 capacity "
+                   "before the loop")
+              << AppendCall->getDirectCallee()->getDeclName() << Kind;
 
   if (!ReserveStmt.empty())
     Diag << FixItHint::CreateInsertion(LoopStmt->getBeginLoc(), ReserveStmt);
@@ -17,7 +17,9 @@ namespace tidy {
 namespace performance {
 
 /// Finds possible inefficient `std::vector` operations (e.g. `push_back`) in
-/// for loops that may cause unnecessary memory reallocations.
+/// for loops that may cause unnecessary memory reallocations. Also finds the
+/// characters appended to strings, the elements inserted into hash containers
+/// and, optionally, the elements added to protobuf repeated fields.
 ///
 /// For the user-facing documentation see:
 /// http://clang.llvm.org/extra/clang-tidy/checks/performance-inefficient-vector-operation.html
@@ -29,7 +31,14 @@ public:
   void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
 
 private:
+  /// Adds the matchers of the loops whose body is a single \p AppendCall.
+  void addLoopMatchers(ast_matchers::MatchFinder *Finder,
+                       const ast_matchers::StatementMatcher &AppendCall);
+
   const std::vector<std::string> VectorLikeClasses;
+  const std::vector<std::string> StringLikeClasses;
+  const std::vector<std::string> HashContainerClasses;
+  const bool EnableProto;
 };
 
 } // namespace performance
@@ -0,0 +1,568 @@
+//===--- MapDoubleLookupCheck.cpp - clang-tidy ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MapDoubleLookupCheck.h"
+
+#include "../utils/FunctionAnalysisCache.h"
+#include "../utils/OptionsUtils.h"
+#include "clang/Analysis/Analyses/ExprMutationAnalyzer.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+// The number of blocks between two lookups beyond which they are not
+// considered.
+const unsigned MaxPathLength = 16;
+
+/// A lookup of a key in a map variable, with `operator[]` or a method.
+struct Lookup {
+  const Expr *Call;
+  const DeclRefExpr *Object;
+  const VarDecl *Map;
+  // The key as written, and stripped of its implicit conversions.
+  const Expr *KeyArg;
+  const Expr *Key;
+  // The method name, "[]" for operator[].
+  StringRef Method;
+  const CFGBlock *Block;
+};
+
+/// Strips the implicit conversions of \p Key, including the implicit
+/// converting constructors, e.g. from a string literal to a `std::string`.
+const Expr *stripKey(const Expr *Key) {
+  while (true) {
+    const Expr *Stripped = nullptr;
+    while (Key != Stripped) {
+      Stripped = Key;
+      Key = Key->IgnoreImplicit()->IgnoreParens();
+    }
+    const auto *Construct = dyn_cast<CXXConstructExpr>(Key);
+    if (!Construct || isa<CXXTemporaryObjectExpr>(Construct) ||
+        Construct->isListInitialization() || Construct->getNumArgs() == 0)
+      return Key;
+    for (unsigned I = 1, E = Construct->getNumArgs(); I < E; ++I)
+      if (!isa<CXXDefaultArgExpr>(Construct->getArg(I)))
+        return Key;
+    Key = Construct->getArg(0);
+  }
+}
+
+/// Returns true if \p First and \p Second, stripped keys, are the same
+/// variable or literal. The variables must not be modified by the calls
+/// between the lookups, so they must be local or const.
+bool isSameKey(const Expr *First, const Expr *Second,
+               const ASTContext &Context) {
+  const auto *FirstRef = dyn_cast<DeclRefExpr>(First);
+  const auto *SecondRef = dyn_cast<DeclRefExpr>(Second);
+  if (FirstRef || SecondRef) {
+    if (!FirstRef || !SecondRef || FirstRef->getDecl() != SecondRef->getDecl())
+      return false;
+    if (isa<EnumConstantDecl>(FirstRef->getDecl()))
+      return true;
+    const auto *Var = dyn_cast<VarDecl>(FirstRef->getDecl());
+    return Var && (Var->hasLocalStorage() || Var->getType().isConstQualified());
+  }
+  if (!isa<IntegerLiteral>(First) && !isa<CharacterLiteral>(First) &&
+      !isa<StringLiteral>(First))
+    return false;
+  llvm::FoldingSetNodeID FirstID, SecondID;
+  First->Profile(FirstID, Context, /*Canonical=*/true);
+  Second->Profile(SecondID, Context, /*Canonical=*/true);
+  return FirstID == SecondID;
+}
+
+/// Returns true if \p E is a call of `end()` on \p Map.
+bool isEndOf(const Expr *E, const VarDecl *Map) {
+  const auto *Call = dyn_cast<CXXMemberCallExpr>(E->IgnoreImplicit());
+  if (!Call || !Call->getMethodDecl() ||
+      Call->getMethodDecl()->getName() != "end")
+    return false;
+  const auto *Object = dyn_cast<DeclRefExpr>(
+      Call->getImplicitObjectArgument()->IgnoreParenImpCasts());
+  return Object && Object->getDecl() == Map;
+}
+
+/// Returns true if \p E is the literal 0.
+bool isZero(const Expr *E) {
+  const auto *Literal = dyn_cast<IntegerLiteral>(E->IgnoreParenImpCasts());
+  return Literal && Literal->getValue() == 0;
+}
+
+/// Returns the `if` statement whose condition only tests whether the key of
+/// \p Check, a lookup with `count`, `contains` or `find`, is in the map, or
+/// null. Sets \p Negated if the condition holds when the key is not in it.
+const IfStmt *getTestingIf(const Lookup &Check, ASTContext &Context,
+                           bool &Negated) {
+  const bool IsFind = Check.Method == "find";
+  if (!IsFind && Check.Method != "count" && Check.Method != "contains")
+    return nullptr;
+  Negated = false;
+  bool Compared = false;
+  const Stmt *Child = Check.Call;
+  while (true) {
+    const auto Parents = Context.getParents(*Child);
+    if (Parents.size() != 1)
+      return nullptr;
+    const auto *Parent = Parents[0].get<Stmt>();
+    if (!Parent)
+      return nullptr;
+    if (const auto *If = dyn_cast<IfStmt>(Parent))
+      return If->getCond() == Child && (Compared || !IsFind) ? If : nullptr;
+
+    const Expr *LHS = nullptr, *RHS = nullptr;
+    bool IsEqual = false;
+    if (const auto *Binary = dyn_cast<BinaryOperator>(Parent)) {
+      if (!Binary->isEqualityOp())
+        return nullptr;
+      LHS = Binary->getLHS();
+      RHS = Binary->getRHS();
+      IsEqual = Binary->getOpcode() == BO_EQ;
+    } else if (const auto *Operator = dyn_cast<CXXOperatorCallExpr>(Parent)) {
+      const OverloadedOperatorKind Kind = Operator->getOperator();
+      if ((Kind != OO_EqualEqual && Kind != OO_ExclaimEqual) ||
+          Operator->getNumArgs() != 2)
+        return nullptr;
+      LHS = Operator->getArg(0);
+      RHS = Operator->getArg(1);
+      IsEqual = Kind == OO_EqualEqual;
+    } else if (const auto *Unary = dyn_cast<UnaryOperator>(Parent)) {
+      if (Unary->getOpcode() != UO_LNot || IsFind)
+        return nullptr;
+      Negated = !Negated;
+    } else if (!isa<ImplicitCastExpr>(Parent) && !isa<ParenExpr>(Parent) &&
+               !isa<MaterializeTemporaryExpr>(Parent) &&
+               !isa<CXXBindTemporaryExpr>(Parent) &&
+               !isa<ExprWithCleanups>(Parent)) {
+      return nullptr;
+    }
+
+    if (LHS) {
+      // The lookup is compared once, with the end of the map or zero.
+      if (Compared)
+        return nullptr;
+      const Expr *Other = LHS == Child ? RHS : LHS;
+      if (IsFind ? !isEndOf(Other, Check.Map) : !isZero(Other))
+        return nullptr;
+      Compared = true;
+      if (IsEqual)
+        Negated = !Negated;
+    }
+    Child = Parent;
+  }
+}
+
+/// Returns true if every execution of \p To goes through \p From just before,
+/// adding to \p Path the blocks executed in between.
+bool getDominatingPath(const CFGBlock *From, const CFGBlock *To,
+                       SmallVectorImpl<const CFGBlock *> &Path) {
+  for (unsigned I = 0; I < MaxPathLength; ++I) {
+    if (To->pred_size() != 1)
+      return false;
+    const CFGBlock *Pred = *To->pred_begin();
+    if (!Pred)
+      return false;
+    if (Pred == From)
+      return true;
+    Path.push_back(Pred);
+    To = Pred;
+  }
+  return false;
+}
+
+/// Returns true if the class of \p Map has the `try_emplace` method.
+bool hasTryEmplace(const VarDecl &Map, const LangOptions &LangOpts) {
+  const CXXRecordDecl *Record =
+      Map.getType().getNonReferenceType()->getAsCXXRecordDecl();
+  if (!Record)
+    return false;
+  const StringRef Name = Record->getName();
+  if (Record->isInStdNamespace())
+    return LangOpts.CPlusPlus17 && (Name == "map" || Name == "unordered_map");
+  const auto *Namespace = dyn_cast<NamespaceDecl>(Record->getDeclContext());
+  return Namespace && Namespace->getName() == "llvm" &&
+         Namespace->getParent()->isTranslationUnit() &&
+         (Name == "DenseMap" || Name == "StringMap");
+}
+
+/// Returns true if the text of \p S can be replaced.
+bool isInFile(const Stmt *S) {
+  return !S->getBeginLoc().isMacroID() && !S->getEndLoc().isMacroID();
+}
+
+/// Finds the repeated lookups of the maps in the body of a function.
+class RepeatedLookupFinder {
+public:
+  RepeatedLookupFinder(const Stmt &Body, ASTContext &Context,
+                       const utils::FunctionAnalysis &Analysis,
+                       SmallVector<Lookup, 8> Lookups)
+      : Body(Body), Context(Context), Analysis(Analysis),
+        Analyzer(Body, Context), Lookups(std::move(Lookups)) {}
+
+  /// Calls \p Report with each lookup repeating a previous one, and the
+  /// previous lookup.
+  void find(llvm::function_ref<void(const Lookup &, const Lookup &)> Report);
+
+  /// Returns the fixes replacing the lookups in the `if` statement testing
+  /// \p First with a single lookup, if \p Second is the first of them.
+  std::vector<FixItHint> getFixes(const Lookup &First, const Lookup &Second);
+
+private:
+  bool isRepeatedLookup(const Lookup &First, const Lookup &Second);
+  bool isModifiedBetween(const VarDecl *Var, const Lookup &First,
+                         const Lookup &Second,
+                         ArrayRef<const CFGBlock *> Path);
+  bool isModifiedIn(const VarDecl *Var, const Stmt *S,
+                    ArrayRef<const Lookup *> Lookups);
+  ArrayRef<const DeclRefExpr *> getModifications(const VarDecl *Var);
+  std::vector<FixItHint> getLookupFixes(const Lookup &First,
+                                        const Lookup &Second,
+                                        const IfStmt &If);
+  std::vector<FixItHint> getInsertionFixes(const Lookup &First,
+                                           const Lookup &Second,
+                                           const IfStmt &If);
+  StringRef getText(const Expr *E);
+
+  const Stmt &Body;
+  ASTContext &Context;
+  const utils::FunctionAnalysis &Analysis;
+  ExprMutationAnalyzer Analyzer;
+  SmallVector<Lookup, 8> Lookups;
+  llvm::DenseMap<const VarDecl *, SmallVector<const DeclRefExpr *, 4>>
+      Modifications;
+  llvm::SmallPtrSet<const IfStmt *, 4> FixedIfs;
+};
+
+void RepeatedLookupFinder::find(
+    llvm::function_ref<void(const Lookup &, const Lookup &)> Report) {
+  // The lookups are in the order of the source, the previous lookup is the
+  // closest one.
+  for (size_t I = 1, E = Lookups.size(); I < E; ++I) {
+    const Lookup &Second = Lookups[I];
+    for (size_t J = I; J-- > 0;) {
+      const Lookup &First = Lookups[J];
+      if (First.Map == Second.Map &&
+          isSameKey(First.Key, Second.Key, Context) &&
+          isRepeatedLookup(First, Second)) {
+        Report(First, Second);
+        break;
+      }
+    }
+  }
+}
+
+bool RepeatedLookupFinder::isRepeatedLookup(const Lookup &First,
+                                            const Lookup &Second) {
+  SmallVector<const CFGBlock *, 4> Path;
+  if (First.Block == Second.Block) {
+    if (!Analysis.Sequence->inSequence(First.Call, Second.Call))
+      return false;
+  } else if (!getDominatingPath(First.Block, Second.Block, Path)) {
+    return false;
+  }
+  if (isModifiedBetween(First.Map, First, Second, Path))
+    return false;
+  if (const auto *KeyRef = dyn_cast<DeclRefExpr>(First.Key))
+    if (const auto *KeyVar = dyn_cast<VarDecl>(KeyRef->getDecl()))
+      return !isModifiedBetween(KeyVar, First, Second, Path);
+  return true;
+}
+
+bool RepeatedLookupFinder::isModifiedBetween(const VarDecl *Var,
+                                             const Lookup &First,
+                                             const Lookup &Second,
+                                             ArrayRef<const CFGBlock *> Path) {
+  for (const DeclRefExpr *Ref : getModifications(Var)) {
+    if (Ref == First.Object || Ref == Second.Object)
+      continue;
+    const CFGBlock *Block = Analysis.BlockMap->blockContainingStmt(Ref);
+    // The modifications in a lambda may happen anywhere.
+    if (!Block)
+      return true;
+    if (Block != First.Block && Block != Second.Block) {
+      if (llvm::is_contained(Path, Block))
+        return true;
+      continue;
+    }
+    if ((Block != First.Block ||
+         !Analysis.Sequence->inSequence(Ref, First.Call)) &&
+        (Block != Second.Block ||
+         !Analysis.Sequence->inSequence(Second.Call, Ref)))
+      return true;
+  }
+  return false;
+}
+
+bool RepeatedLookupFinder::isModifiedIn(const VarDecl *Var, const Stmt *S,
+                                        ArrayRef<const Lookup *> Lookups) {
+  const SourceManager &SM = Context.getSourceManager();
+  const SourceRange Range = S->getSourceRange();
+  for (const DeclRefExpr *Ref : getModifications(Var)) {
+    if (llvm::any_of(Lookups,
+                     [Ref](const Lookup *L) { return L->Object == Ref; }))
+      continue;
+    if (!SM.isBeforeInTranslationUnit(Ref->getBeginLoc(), Range.getBegin()) &&
+        !SM.isBeforeInTranslationUnit(Range.getEnd(), Ref->getBeginLoc()))
+      return true;
+  }
+  return false;
+}
+
+ArrayRef<const DeclRefExpr *>
+RepeatedLookupFinder::getModifications(const VarDecl *Var) {
+  auto Inserted = Modifications.try_emplace(Var);
+  SmallVectorImpl<const DeclRefExpr *> &Refs = Inserted.first->second;
+  if (!Inserted.second)
+    return Refs;
+
+  // The lookups and the iterations don't modify the map, even though they
+  // call non-const methods.
+  const auto VarRef = declRefExpr(to(varDecl(equalsNode(Var))));
+  llvm::SmallPtrSet<const DeclRefExpr *, 8> ReadRefs;
+  for (const auto &Nodes :
+       match(findAll(cxxMemberCallExpr(
+                 on(VarRef.bind("ref")),
+                 callee(cxxMethodDecl(hasAnyName(
+                     "at", "begin", "cbegin", "cend", "contains", "count",
+                     "empty", "end", "find", "lookup", "size"))))),
+             Body, Context))
+    ReadRefs.insert(Nodes.getNodeAs<DeclRefExpr>("ref"));
+  for (const auto &Nodes : match(findAll(VarRef.bind("ref")), Body, Context)) {
+    const auto *Ref = Nodes.getNodeAs<DeclRefExpr>("ref");
+    if (!ReadRefs.count(Ref) && Analyzer.isMutated(Ref))
+      Refs.push_back(Ref);
+  }
+  return Refs;
+}
+
+std::vector<FixItHint> RepeatedLookupFinder::getFixes(const Lookup &First,
+                                                      const Lookup &Second) {
+  bool Negated;
+  const IfStmt *If = getTestingIf(First, Context, Negated);
+  if (!If || If->getInit() || If->getConditionVariable() ||
+      FixedIfs.count(If) || !isInFile(If))
+    return {};
+  const SourceManager &SM = Context.getSourceManager();
+  const SourceRange Then = If->getThen()->getSourceRange();
+  if (SM.isBeforeInTranslationUnit(Second.Call->getBeginLoc(),
+                                   Then.getBegin()) ||
+      SM.isBeforeInTranslationUnit(Then.getEnd(), Second.Call->getBeginLoc()))
+    return {};
+
+  std::vector<FixItHint> Fixes = Negated ? getInsertionFixes(First, Second, *If)
+                                         : getLookupFixes(First, Second, *If);
+  if (!Fixes.empty())
+    FixedIfs.insert(If);
+  return Fixes;
+}
+
+std::vector<FixItHint>
+RepeatedLookupFinder::getLookupFixes(const Lookup &First, const Lookup &Second,
+                                     const IfStmt &If) {
+  if (!Context.getLangOpts().CPlusPlus17)
+    return {};
+  // All the lookups of the key in the branch read the value, and are replaced
+  // with the iterator found by the condition.
+  const Stmt *Then = If.getThen();
+  const SourceManager &SM = Context.getSourceManager();
+  SmallVector<const Lookup *, 4> Reads;
+  for (const Lookup &L : Lookups) {
+    if (L.Map != First.Map || !isSameKey(L.Key, First.Key, Context) ||
+        SM.isBeforeInTranslationUnit(L.Call->getBeginLoc(),
+                                     Then->getBeginLoc()) ||
+        SM.isBeforeInTranslationUnit(Then->getEndLoc(), L.Call->getBeginLoc()))
+      continue;
+    if ((L.Method != "[]" && L.Method != "at") || !isInFile(L.Call))
+      return {};
+    Reads.push_back(&L);
+  }
+  if (Reads.empty() || Reads.front() != &Second ||
+      isModifiedIn(First.Map, Then, Reads))
+    return {};
+  if (const auto *KeyRef = dyn_cast<DeclRefExpr>(First.Key))
+    if (const auto *KeyVar = dyn_cast<VarDecl>(KeyRef->getDecl()))
+      if (isModifiedIn(KeyVar, Then, {}))
+        return {};
+  // The iterator must not hide another declaration used in the statement.
+  const auto ItDecl = namedDecl(hasName("It"));
+  if (!match(stmt(anyOf(hasDescendant(ItDecl),
+                        hasDescendant(declRefExpr(to(ItDecl))),
+                        hasDescendant(memberExpr(member(ItDecl))))),
+             If, Context)
+           .empty())
+    return {};
+
+  const StringRef MapText = getText(First.Object);
+  std::vector<FixItHint> Fixes;
+  Fixes.push_back(FixItHint::CreateReplacement(
+      If.getCond()->getSourceRange(),
+      ("auto It = " + MapText + ".find(" + getText(First.KeyArg) +
+       "); It != " + MapText + ".end()")
+          .str()));
+  for (const Lookup *Read : Reads)
+    Fixes.push_back(FixItHint::CreateReplacement(
+        Read->Call->getSourceRange(), "It->second"));
+  return Fixes;
+}
+
+std::vector<FixItHint>
+RepeatedLookupFinder::getInsertionFixes(const Lookup &First,
+                                        const Lookup &Second,
+                                        const IfStmt &If) {
+  if (If.getElse() || Second.Method != "[]" ||
+      !hasTryEmplace(*First.Map, Context.getLangOpts()))
+    return {};
+  // The branch only assigns the value of the key.
+  const Stmt *Then = If.getThen();
+  const auto *Block = dyn_cast<CompoundStmt>(Then);
+  if (Block && Block->size() != 1)
+    return {};
+  const auto *Assign = dyn_cast<Expr>(Block ? Block->body_front() : Then);
+  if (!Assign)
+    return {};
+  Assign = Assign->IgnoreImplicit();
+  const Expr *Value = nullptr;
+  if (const auto *Binary = dyn_cast<BinaryOperator>(Assign)) {
+    if (Binary->getOpcode() == BO_Assign &&
+        Binary->getLHS()->IgnoreParens() == Second.Call)
+      Value = Binary->getRHS();
+  } else if (const auto *Operator = dyn_cast<CXXOperatorCallExpr>(Assign)) {
+    if (Operator->getOperator() == OO_Equal &&
+        Operator->getArg(0)->IgnoreParens() == Second.Call)
+      Value = Operator->getArg(1);
+  }
+  if (!Value || !isInFile(Assign) ||
+      !match(findAll(declRefExpr(to(varDecl(equalsNode(First.Map))))),
+             *Value, Context)
+           .empty())
+    return {};
+
+  const std::string Insertion =
+      (getText(First.Object) + ".try_emplace(" + getText(Second.KeyArg) +
+       ", " + getText(Value) + ")")
+          .str();
+  if (Block)
+    return {FixItHint::CreateReplacement(
+        SourceRange(If.getBeginLoc(), Block->getEndLoc()), Insertion + ";")};
+  return {FixItHint::CreateReplacement(
+      SourceRange(If.getBeginLoc(), Assign->getEndLoc()), Insertion)};
+}
+
+StringRef RepeatedLookupFinder::getText(const Expr *E) {
+  return Lexer::getSourceText(
+      CharSourceRange::getTokenRange(E->getSourceRange()),
+      Context.getSourceManager(), Context.getLangOpts());
+}
+
+} // namespace
+
+MapDoubleLookupCheck::MapDoubleLookupCheck(StringRef Name,
+                                           ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      MapClasses(utils::options::parseStringList(
+          Options.get("MapClasses", "::std::map;::std::unordered_map;"
+                                    "::llvm::DenseMap;::llvm::StringMap"))) {}
+
+void MapDoubleLookupCheck::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "MapClasses",
+                utils::options::serializeStringList(MapClasses));
+}
+
+void MapDoubleLookupCheck::registerMatchers(MatchFinder *Finder) {
+  if (!getLangOpts().CPlusPlus)
+    return;
+
+  // The lookups are analyzed per function body, whose CFG orders them.
+  Finder->addMatcher(functionDecl(isDefinition(), hasBody(compoundStmt()),
+                                  unless(isInstantiated()))
+                         .bind("function"),
+                     this);
+  Finder->addMatcher(
+      lambdaExpr(unless(isInTemplateInstantiation())).bind("lambda"), this);
+}
+
+void MapDoubleLookupCheck::check(const MatchFinder::MatchResult &Result) {
+  const Stmt *Body = nullptr;
+  if (const auto *Function = Result.Nodes.getNodeAs<FunctionDecl>("function"))
+    Body = Function->getBody();
+  else if (const auto *Lambda = Result.Nodes.getNodeAs<LambdaExpr>("lambda"))
+    Body = Lambda->getBody();
+  if (!Body)
+    return;
+  ASTContext &Context = *Result.Context;
+
+  const auto MapRef =
+      declRefExpr(to(varDecl(hasLocalStorage()).bind("map")),
+                  hasType(cxxRecordDecl(hasAnyName(SmallVector<StringRef, 4>(
+                      MapClasses.begin(), MapClasses.end())))))
+          .bind("object");
+  const auto LookupCall = expr(anyOf(
+      cxxMemberCallExpr(on(MapRef),
+                        callee(cxxMethodDecl(
+                            hasAnyName("at", "contains", "count", "find",
+                                       "lookup"))
+                                   .bind("method")),
+                        argumentCountIs(1), hasArgument(0, expr().bind("key"))),
+      cxxOperatorCallExpr(hasOverloadedOperatorName("[]"),
+                          hasArgument(0, ignoringParenImpCasts(MapRef)),
+                          hasArgument(1, expr().bind("key")))));
+
+  SmallVector<Lookup, 8> Lookups;
+  for (const auto &Nodes :
+       match(findAll(LookupCall.bind("lookup")), *Body, Context)) {
+    const auto *Method = Nodes.getNodeAs<CXXMethodDecl>("method");
+    const auto *KeyArg = Nodes.getNodeAs<Expr>("key");
+    Lookups.push_back({Nodes.getNodeAs<Expr>("lookup"),
+                       Nodes.getNodeAs<DeclRefExpr>("object"),
+                       Nodes.getNodeAs<VarDecl>("map"), KeyArg,
+                       stripKey(KeyArg),
+                       Method ? Method->getName() : StringRef("[]"),
+                       nullptr});
+  }
+  if (Lookups.size() < 2)
+    return;
+
+  const utils::FunctionAnalysis *Analysis =
+      getTranslationUnitCache<utils::FunctionAnalysisCache>().get(Body,
+                                                                  &Context);
+  if (!Analysis)
+    return;
+  // The lookups in the lambdas are analyzed with the lambda body.
+  for (Lookup &L : Lookups)
+    L.Block = Analysis->BlockMap->blockContainingStmt(L.Call);
+  Lookups.erase(llvm::remove_if(Lookups,
+                                [](const Lookup &L) { return !L.Block; }),
+                Lookups.end());
+
+  RepeatedLookupFinder Finder(*Body, Context, *Analysis, std::move(Lookups));
+  Finder.find([&](const Lookup &First, const Lookup &Second) {
+    {
+      auto Diag = diag(Second.Call->getBeginLoc(),
+                       "%0 is looked up again with the same key; consider "
+                       "reusing the result of the previous lookup")
+                  << First.Map;
+      for (const FixItHint &Fix : Finder.getFixes(First, Second))
+        Diag << Fix;
+    }
+    diag(First.Call->getBeginLoc(), "previous lookup is here",
+         DiagnosticIDs::Note);
+  });
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
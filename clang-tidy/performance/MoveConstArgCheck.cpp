@@ -9,6 +9,7 @@
 
 #include "MoveConstArgCheck.h"
 
+#include "../utils/Matchers.h"
 #include "clang/Lex/Lexer.h"
 
 using namespace clang::ast_matchers;
@@ -44,9 +45,11 @@ void MoveConstArgCheck::registerMatchers(MatchFinder *Finder) {
   if (!getLangOpts().CPlusPlus)
     return;
 
+  auto *StdMove =
+      getTranslationUnitCache<utils::NameSetCache>().get({"::std::move"});
   auto MoveCallMatcher =
-      callExpr(callee(functionDecl(hasName("::std::move"))), argumentCountIs(1),
-               unless(isInTemplateInstantiation()))
+      callExpr(callee(functionDecl(matchers::hasAnyNameInSet(StdMove))),
+               argumentCountIs(1), unless(isInTemplateInstantiation()))
           .bind("call-move");
 
   Finder->addMatcher(MoveCallMatcher, this);
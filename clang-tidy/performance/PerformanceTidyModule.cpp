@@ -10,17 +10,26 @@
 #include "../ClangTidy.h"
 #include "../ClangTidyModule.h"
 #include "../ClangTidyModuleRegistry.h"
+#include "AtomicMemoryOrderCheck.h"
+#include "AvoidStdFunctionInHotParamsCheck.h"
+#include "DevirtualizationOpportunityCheck.h"
+#include "FalseSharingCheck.h"
 #include "FasterStringFindCheck.h"
 #include "ForRangeCopyCheck.h"
 #include "ImplicitConversionInLoopCheck.h"
 #include "InefficientAlgorithmCheck.h"
 #include "InefficientStringConcatenationCheck.h"
 #include "InefficientVectorOperationCheck.h"
+#include "MapDoubleLookupCheck.h"
 #include "MoveConstArgCheck.h"
 #include "MoveConstructorInitCheck.h"
 #include "NoexceptMoveConstructorCheck.h"
+#include "SharedPtrCopyCheck.h"
+#include "StringViewParameterCheck.h"
+#include "StructPaddingCheck.h"
 #include "TypePromotionInMathFnCheck.h"
 #include "UnnecessaryCopyInitialization.h"
+#include "UnnecessaryCopyOnReturnCheck.h"
 #include "UnnecessaryValueParamCheck.h"
 
 namespace clang {
@@ -30,6 +39,14 @@ namespace performance {
 class PerformanceModule : public ClangTidyModule {
 public:
   void addCheckFactories(ClangTidyCheckFactories &CheckFactories) override {
+    CheckFactories.registerCheck<AtomicMemoryOrderCheck>(
+        "performance-atomic-memory-order");
+    CheckFactories.registerCheck<AvoidStdFunctionInHotParamsCheck>(
+        "performance-avoid-std-function-in-hot-params");
+    CheckFactories.registerCheck<DevirtualizationOpportunityCheck>(
+        "performance-devirtualization-opportunity");
+    CheckFactories.registerCheck<FalseSharingCheck>(
+        "performance-false-sharing");
     CheckFactories.registerCheck<FasterStringFindCheck>(
         "performance-faster-string-find");
     CheckFactories.registerCheck<ForRangeCopyCheck>(
@@ -42,16 +59,26 @@ public:
         "performance-inefficient-string-concatenation");
     CheckFactories.registerCheck<InefficientVectorOperationCheck>(
         "performance-inefficient-vector-operation");
+    CheckFactories.registerCheck<MapDoubleLookupCheck>(
+        "performance-map-double-lookup");
     CheckFactories.registerCheck<MoveConstArgCheck>(
         "performance-move-const-arg");
     CheckFactories.registerCheck<MoveConstructorInitCheck>(
         "performance-move-constructor-init");
     CheckFactories.registerCheck<NoexceptMoveConstructorCheck>(
         "performance-noexcept-move-constructor");
+    CheckFactories.registerCheck<SharedPtrCopyCheck>(
+        "performance-shared-ptr-copy");
+    CheckFactories.registerCheck<StringViewParameterCheck>(
+        "performance-string-view-parameter");
+    CheckFactories.registerCheck<StructPaddingCheck>(
+        "performance-struct-padding");
     CheckFactories.registerCheck<TypePromotionInMathFnCheck>(
         "performance-type-promotion-in-math-fn");
     CheckFactories.registerCheck<UnnecessaryCopyInitialization>(
         "performance-unnecessary-copy-initialization");
+    CheckFactories.registerCheck<UnnecessaryCopyOnReturnCheck>(
+        "performance-unnecessary-copy-on-return");
     CheckFactories.registerCheck<UnnecessaryValueParamCheck>(
         "performance-unnecessary-value-param");
   }
@@ -0,0 +1,247 @@
+//===--- SharedPtrCopyCheck.cpp - clang-tidy ------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SharedPtrCopyCheck.h"
+
+#include "../utils/DeclRefExprUtils.h"
+#include "../utils/FixItHintUtils.h"
+#include "../utils/OptionsUtils.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+enum class SharedPointerUse { Other, OnlyRead, OnlyDereferenced };
+
+SmallVector<BoundNodes, 1> matchDescendants(const StatementMatcher &Matcher,
+                                            const Stmt &Scope,
+                                            ASTContext &Context) {
+  return match(stmt(forEachDescendant(Matcher)), Scope, Context);
+}
+
+SmallVector<BoundNodes, 1> matchDescendants(const StatementMatcher &Matcher,
+                                            const Decl &Scope,
+                                            ASTContext &Context) {
+  return match(decl(forEachDescendant(Matcher)), Scope, Context);
+}
+
+/// Returns whether the shared pointer \p Var is only read in \p Scope, i.e.
+/// only accessed in a const fashion and never copied, and whether it is even
+/// only dereferenced, so that the pointee would suffice.
+template <typename Node>
+SharedPointerUse getUse(const VarDecl &Var, const Node &Scope,
+                        ASTContext &Context,
+                        utils::decl_ref_expr::DeclRefExprIndexCache &Index) {
+  const auto AllRefs =
+      utils::decl_ref_expr::allDeclRefExprs(Var, Scope, Context, &Index);
+  if (AllRefs.empty())
+    return SharedPointerUse::Other;
+  const auto ConstRefs = utils::decl_ref_expr::constReferenceDeclRefExprs(
+      Var, Scope, Context, &Index);
+  for (const DeclRefExpr *Ref : AllRefs)
+    if (!ConstRefs.count(Ref))
+      return SharedPointerUse::Other;
+
+  // The copies are const uses, but share the ownership.
+  const auto Ref = ignoringParenImpCasts(
+      declRefExpr(to(varDecl(equalsNode(&Var)))).bind("ref"));
+  const auto Copy = expr(anyOf(
+      cxxConstructExpr(hasDeclaration(cxxConstructorDecl(isCopyConstructor())),
+                       hasArgument(0, Ref)),
+      cxxOperatorCallExpr(hasOverloadedOperatorName("="),
+                          hasArgument(1, Ref))));
+  if (!matchDescendants(Copy, Scope, Context).empty())
+    return SharedPointerUse::Other;
+
+  const auto Dereference = expr(anyOf(
+      cxxOperatorCallExpr(anyOf(hasOverloadedOperatorName("*"),
+                                hasOverloadedOperatorName("->")),
+                          argumentCountIs(1), hasArgument(0, Ref)),
+      cxxMemberCallExpr(
+          on(Ref), callee(cxxMethodDecl(anyOf(hasName("get"),
+                                              cxxConversionDecl())))),
+      cxxOperatorCallExpr(anyOf(hasOverloadedOperatorName("=="),
+                                hasOverloadedOperatorName("!=")),
+                          hasAnyArgument(Ref),
+                          hasAnyArgument(ignoringParenImpCasts(
+                              cxxNullPtrLiteralExpr())))));
+  llvm::SmallPtrSet<const DeclRefExpr *, 16> Dereferences;
+  for (const auto &Nodes : matchDescendants(Dereference, Scope, Context))
+    Dereferences.insert(Nodes.getNodeAs<DeclRefExpr>("ref"));
+  for (const DeclRefExpr *Ref : AllRefs)
+    if (!Dereferences.count(Ref))
+      return SharedPointerUse::OnlyRead;
+  return SharedPointerUse::OnlyDereferenced;
+}
+
+bool isReferencedOutsideOfCallExpr(const FunctionDecl &Function,
+                                   ASTContext &Context) {
+  auto Matches = match(declRefExpr(to(functionDecl(equalsNode(&Function))),
+                                   unless(hasAncestor(callExpr()))),
+                       Context);
+  return !Matches.empty();
+}
+
+} // namespace
+
+SharedPtrCopyCheck::SharedPtrCopyCheck(StringRef Name,
+                                       ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      SharedPointerClasses(utils::options::parseStringList(Options.get(
+          "SharedPointerClasses", "::std::shared_ptr;::boost::shared_ptr"))) {}
+
+void SharedPtrCopyCheck::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "SharedPointerClasses",
+                utils::options::serializeStringList(SharedPointerClasses));
+}
+
+void SharedPtrCopyCheck::registerMatchers(MatchFinder *Finder) {
+  if (!getLangOpts().CPlusPlus11)
+    return;
+
+  // The references don't match, their desugared type isn't a record.
+  const auto SharedPointer = hasType(hasUnqualifiedDesugaredType(
+      recordType(hasDeclaration(cxxRecordDecl(hasAnyName(
+          SmallVector<StringRef, 4>(SharedPointerClasses.begin(),
+                                    SharedPointerClasses.end())))))));
+
+  Finder->addMatcher(
+      functionDecl(hasBody(stmt()), isDefinition(), unless(isImplicit()),
+                   unless(cxxMethodDecl(anyOf(isOverride(), isFinal()))),
+                   has(typeLoc(
+                       forEach(parmVarDecl(SharedPointer).bind("param")))),
+                   unless(isInstantiated()))
+          .bind("function"),
+      this);
+
+  // The copies of the other variables, e.g. of members, keep the pointee
+  // alive while the original is reassigned.
+  const auto Source = varDecl(hasLocalStorage(),
+                              unless(hasType(referenceType())))
+                          .bind("source");
+  const auto CopyOfSource = ignoringImplicit(cxxConstructExpr(
+      hasDeclaration(cxxConstructorDecl(isCopyConstructor())),
+      hasArgument(0, ignoringParenImpCasts(declRefExpr(to(Source))))));
+  Finder->addMatcher(
+      declStmt(hasSingleDecl(varDecl(hasLocalStorage(), SharedPointer,
+                                     hasInitializer(CopyOfSource))
+                                 .bind("local")),
+               hasParent(compoundStmt().bind("scope")),
+               unless(isInTemplateInstantiation())),
+      this);
+
+  // The loop variables initialized from a temporary aren't copies.
+  Finder->addMatcher(
+      cxxForRangeStmt(
+          hasLoopVariable(
+              varDecl(SharedPointer,
+                      unless(hasInitializer(
+                          expr(hasDescendant(materializeTemporaryExpr())))))
+                  .bind("loopVar")),
+          unless(isInTemplateInstantiation()))
+          .bind("forRange"),
+      this);
+}
+
+void SharedPtrCopyCheck::check(const MatchFinder::MatchResult &Result) {
+  ASTContext &Context = *Result.Context;
+  if (const auto *Param = Result.Nodes.getNodeAs<ParmVarDecl>("param"))
+    handleParam(*Param, *Result.Nodes.getNodeAs<FunctionDecl>("function"),
+                Context);
+  else if (const auto *Local = Result.Nodes.getNodeAs<VarDecl>("local"))
+    handleLocal(*Local, *Result.Nodes.getNodeAs<VarDecl>("source"),
+                *Result.Nodes.getNodeAs<Stmt>("scope"), Context);
+  else
+    handleLoopVar(*Result.Nodes.getNodeAs<VarDecl>("loopVar"),
+                  *Result.Nodes.getNodeAs<CXXForRangeStmt>("forRange"),
+                  Context);
+}
+
+void SharedPtrCopyCheck::handleParam(const ParmVarDecl &Param,
+                                     const FunctionDecl &Function,
+                                     ASTContext &Context) {
+  const SharedPointerUse Use = getUse(
+      Param, Function, Context,
+      getTranslationUnitCache<utils::decl_ref_expr::DeclRefExprIndexCache>());
+  if (Use == SharedPointerUse::Other)
+    return;
+  auto Diag = diag(Param.getLocation(),
+                   "parameter %0 copies a shared pointer for each call but is "
+                   "only %select{read; consider a const reference|"
+                   "dereferenced; consider a reference or a pointer to the "
+                   "pointee, or a const reference}1")
+              << &Param << (Use == SharedPointerUse::OnlyDereferenced);
+
+  // Do not propose fixes when the parameter is in a macro, or when the
+  // signature change could break overrides or the uses of the function
+  // outside of call expressions.
+  const auto *Method = dyn_cast<CXXMethodDecl>(&Function);
+  if (Param.getBeginLoc().isMacroID() || (Method && Method->isVirtual()) ||
+      isReferencedOutsideOfCallExpr(Function, Context))
+    return;
+  const unsigned Index = Param.getFunctionScopeIndex();
+  for (const FunctionDecl *Decl = &Function; Decl != nullptr;
+       Decl = Decl->getPreviousDecl()) {
+    const ParmVarDecl &CurrentParam = *Decl->getParamDecl(Index);
+    Diag << utils::fixit::changeVarDeclToReference(CurrentParam, Context);
+    if (!CurrentParam.getType().isConstQualified())
+      Diag << utils::fixit::changeVarDeclToConst(CurrentParam);
+  }
+}
+
+void SharedPtrCopyCheck::handleLocal(const VarDecl &Local,
+                                     const VarDecl &Source, const Stmt &Scope,
+                                     ASTContext &Context) {
+  auto &Index =
+      getTranslationUnitCache<utils::decl_ref_expr::DeclRefExprIndexCache>();
+  // The copy keeps the pointee alive if the source is reassigned or reset.
+  if (!utils::decl_ref_expr::isOnlyUsedAsConst(Source, Scope, Context, &Index))
+    return;
+  const SharedPointerUse Use = getUse(Local, Scope, Context, Index);
+  if (Use == SharedPointerUse::Other)
+    return;
+  auto Diag = diag(Local.getLocation(),
+                   "local copy %0 of the shared pointer %1 is only "
+                   "%select{read|dereferenced}2; consider a const reference")
+              << &Local << &Source
+              << (Use == SharedPointerUse::OnlyDereferenced);
+  if (Local.getBeginLoc().isMacroID())
+    return;
+  Diag << utils::fixit::changeVarDeclToReference(Local, Context);
+  if (!Local.getType().isConstQualified())
+    Diag << utils::fixit::changeVarDeclToConst(Local);
+}
+
+void SharedPtrCopyCheck::handleLoopVar(const VarDecl &LoopVar,
+                                       const CXXForRangeStmt &ForRange,
+                                       ASTContext &Context) {
+  const SharedPointerUse Use = getUse(
+      LoopVar, *ForRange.getBody(), Context,
+      getTranslationUnitCache<utils::decl_ref_expr::DeclRefExprIndexCache>());
+  if (Use == SharedPointerUse::Other)
+    return;
+  auto Diag = diag(LoopVar.getLocation(),
+                   "loop variable %0 copies a shared pointer in each iteration "
+                   "but is only %select{read|dereferenced}1; consider a const "
+                   "reference")
+              << &LoopVar << (Use == SharedPointerUse::OnlyDereferenced);
+  if (LoopVar.getBeginLoc().isMacroID())
+    return;
+  Diag << utils::fixit::changeVarDeclToReference(LoopVar, Context);
+  if (!LoopVar.getType().isConstQualified())
+    Diag << utils::fixit::changeVarDeclToConst(LoopVar);
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
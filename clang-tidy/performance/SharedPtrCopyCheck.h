@@ -0,0 +1,47 @@
+//===--- SharedPtrCopyCheck.h - clang-tidy ----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_SHARED_PTR_COPY_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_SHARED_PTR_COPY_H
+
+#include "../ClangTidy.h"
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+/// \brief Finds the copies of shared pointers that are only read, which update
+/// the reference count atomically for nothing: the parameters taken by value,
+/// the local copies of local variables and the range-based for loop variables.
+///
+/// For the user-facing documentation see:
+/// http://clang.llvm.org/extra/clang-tidy/checks/performance-shared-ptr-copy.html
+class SharedPtrCopyCheck : public ClangTidyCheck {
+public:
+  SharedPtrCopyCheck(StringRef Name, ClangTidyContext *Context);
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override;
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
+
+private:
+  void handleParam(const ParmVarDecl &Param, const FunctionDecl &Function,
+                   ASTContext &Context);
+  void handleLocal(const VarDecl &Local, const VarDecl &Source,
+                   const Stmt &Scope, ASTContext &Context);
+  void handleLoopVar(const VarDecl &LoopVar, const CXXForRangeStmt &ForRange,
+                     ASTContext &Context);
+
+  const std::vector<std::string> SharedPointerClasses;
+};
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_SHARED_PTR_COPY_H
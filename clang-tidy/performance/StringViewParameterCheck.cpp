@@ -0,0 +1,217 @@
+//===--- StringViewParameterCheck.cpp - clang-tidy ------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StringViewParameterCheck.h"
+
+#include "../utils/DeclRefExprUtils.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/STLExtras.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+constexpr char StdStringView[] = "std::string_view";
+constexpr char StdStringViewHeader[] = "string_view";
+
+// The methods of std::string that std::string_view also has, with the same
+// meaning and return type.
+const char *const ReadOnlyMethods[] = {
+    "at", "back", "begin", "cbegin", "cend", "compare", "copy", "crbegin",
+    "crend", "data", "empty", "end", "find", "find_first_not_of",
+    "find_first_of", "find_last_not_of", "find_last_of", "front", "length",
+    "rbegin", "rend", "rfind", "size"};
+
+/// Returns the parent of \p E, skipping the implicit conversions, the
+/// temporaries and the parentheses, and sets \p Child to the child of the
+/// parent leading to \p E.
+const Expr *getParentExpr(const Expr &E, ASTContext &Context,
+                          const Expr *&Child) {
+  Child = &E;
+  while (true) {
+    const auto Parents = Context.getParents(*Child);
+    if (Parents.size() != 1)
+      return nullptr;
+    const auto *Parent = Parents[0].get<Expr>();
+    if (!Parent ||
+        !(isa<ImplicitCastExpr>(Parent) || isa<ParenExpr>(Parent) ||
+          isa<MaterializeTemporaryExpr>(Parent) ||
+          isa<CXXBindTemporaryExpr>(Parent)))
+      return Parent;
+    Child = Parent;
+  }
+}
+
+/// Returns whether the string \p E is only read with an operation that a
+/// string view supports as well.
+bool isReadOnlyUse(const Expr &E, ASTContext &Context) {
+  const Expr *Child = nullptr;
+  const Expr *Parent = getParentExpr(E, Context, Child);
+  if (!Parent)
+    return false;
+
+  if (const auto *Member = dyn_cast<MemberExpr>(Parent)) {
+    const Expr *CallChild = nullptr;
+    const auto *Call = dyn_cast_or_null<CXXMemberCallExpr>(
+        getParentExpr(*Member, Context, CallChild));
+    if (!Call || !Call->getMethodDecl() ||
+        !Call->getMethodDecl()->getIdentifier())
+      return false;
+    const StringRef Name = Call->getMethodDecl()->getName();
+    // The substring of a string view is a string view.
+    if (Name == "substr")
+      return isReadOnlyUse(*Call, Context);
+    return llvm::is_contained(ReadOnlyMethods, Name);
+  }
+
+  const auto *Operator = dyn_cast<CXXOperatorCallExpr>(Parent);
+  if (!Operator)
+    return false;
+  switch (Operator->getOperator()) {
+  case OO_EqualEqual:
+  case OO_ExclaimEqual:
+  case OO_Less:
+  case OO_Greater:
+  case OO_LessEqual:
+  case OO_GreaterEqual:
+    return true;
+  case OO_Subscript:
+    return Operator->getArg(0) == Child;
+  case OO_LessLess:
+    return Operator->getNumArgs() == 2 && Operator->getArg(1) == Child;
+  default:
+    return false;
+  }
+}
+
+bool isReferencedOutsideOfCallExpr(const FunctionDecl &Function,
+                                   ASTContext &Context) {
+  auto Matches = match(declRefExpr(to(functionDecl(equalsNode(&Function))),
+                                   unless(hasAncestor(callExpr()))),
+                       Context);
+  return !Matches.empty();
+}
+
+} // namespace
+
+StringViewParameterCheck::StringViewParameterCheck(StringRef Name,
+                                                   ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      IncludeStyle(utils::IncludeSorter::parseIncludeStyle(
+          Options.getLocalOrGlobal("IncludeStyle", "llvm"))),
+      StringViewClass(Options.get("StringViewClass", StdStringView)),
+      StringViewHeader(Options.get("StringViewHeader", StdStringViewHeader)) {}
+
+void StringViewParameterCheck::storeOptions(
+    ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "IncludeStyle",
+                utils::IncludeSorter::toString(IncludeStyle));
+  Options.store(Opts, "StringViewClass", StringViewClass);
+  Options.store(Opts, "StringViewHeader", StringViewHeader);
+}
+
+void StringViewParameterCheck::registerPPCallbacks(
+    CompilerInstance &Compiler) {
+  Inserter.reset(new utils::IncludeInserter(
+      Compiler.getSourceManager(), Compiler.getLangOpts(), IncludeStyle));
+  Compiler.getPreprocessor().addPPCallbacks(Inserter->CreatePPCallbacks());
+}
+
+void StringViewParameterCheck::registerMatchers(MatchFinder *Finder) {
+  // std::string_view is a C++17 class, the string view classes of the
+  // libraries may be used in any C++ version.
+  if (!getLangOpts().CPlusPlus ||
+      (!getLangOpts().CPlusPlus17 && StringViewClass == StdStringView))
+    return;
+
+  const auto ConstStdString = qualType(
+      isConstQualified(),
+      hasUnqualifiedDesugaredType(recordType(hasDeclaration(
+          classTemplateSpecializationDecl(
+              hasName("::std::basic_string"),
+              hasTemplateArgument(0, refersToType(asString("char"))))))));
+  const auto StringParam =
+      parmVarDecl(hasType(lValueReferenceType(pointee(ConstStdString))))
+          .bind("param");
+  // The signature of a virtual method is shared with its overrides.
+  Finder->addMatcher(
+      functionDecl(hasBody(stmt()), isDefinition(), unless(isImplicit()),
+                   unless(cxxMethodDecl(isVirtual())),
+                   has(typeLoc(forEach(StringParam))),
+                   unless(isInstantiated()))
+          .bind("function"),
+      this);
+}
+
+void StringViewParameterCheck::check(const MatchFinder::MatchResult &Result) {
+  const auto *Param = Result.Nodes.getNodeAs<ParmVarDecl>("param");
+  const auto *Function = Result.Nodes.getNodeAs<FunctionDecl>("function");
+  ASTContext &Context = *Result.Context;
+
+  const auto Refs = utils::decl_ref_expr::allDeclRefExprs(
+      *Param, *Function, Context,
+      &getTranslationUnitCache<utils::decl_ref_expr::DeclRefExprIndexCache>());
+  if (Refs.empty())
+    return;
+  for (const DeclRefExpr *Ref : Refs)
+    if (!isReadOnlyUse(*Ref, Context))
+      return;
+
+  auto Diag = diag(Param->getLocation(),
+                   "parameter %0 is only read with operations that '%1' "
+                   "supports; consider passing it as '%1' to avoid "
+                   "constructing a temporary 'std::string' from string "
+                   "literals and character pointers")
+              << Param << StringViewClass;
+
+  // Do not propose fixes when the signature change could break the uses of
+  // the function outside of call expressions, or when a declaration of the
+  // parameter is in a macro or has a default argument.
+  if (isReferencedOutsideOfCallExpr(*Function, Context))
+    return;
+  const unsigned Index = Param->getFunctionScopeIndex();
+  std::vector<FixItHint> Fixes;
+  for (const FunctionDecl *Decl = Function; Decl != nullptr;
+       Decl = Decl->getPreviousDecl()) {
+    const ParmVarDecl &CurrentParam = *Decl->getParamDecl(Index);
+    // The replaced type of a named parameter extends to its name, which stays
+    // separated from the new type.
+    const bool IsNamed = !CurrentParam.getName().empty();
+    const SourceLocation TypeEnd =
+        CurrentParam.getTypeSourceInfo()->getTypeLoc().getEndLoc();
+    const CharSourceRange TypeRange =
+        IsNamed ? CharSourceRange::getCharRange(CurrentParam.getBeginLoc(),
+                                                CurrentParam.getLocation())
+                : CharSourceRange::getTokenRange(CurrentParam.getBeginLoc(),
+                                                 TypeEnd);
+    if (CurrentParam.hasDefaultArg() || TypeRange.getBegin().isMacroID() ||
+        TypeRange.getEnd().isMacroID())
+      return;
+    Fixes.push_back(FixItHint::CreateReplacement(
+        TypeRange, IsNamed ? StringViewClass + " " : StringViewClass));
+  }
+  for (const FixItHint &Fix : Fixes)
+    Diag << Fix;
+  if (StringViewHeader.empty())
+    return;
+  if (auto IncludeFixit = Inserter->CreateIncludeInsertion(
+          Context.getSourceManager().getFileID(Param->getBeginLoc()),
+          StringViewHeader,
+          /*IsAngled=*/StringViewHeader == StdStringViewHeader))
+    Diag << *IncludeFixit;
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
@@ -0,0 +1,224 @@
+//===--- StructPaddingCheck.cpp - clang-tidy ------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StructPaddingCheck.h"
+#include "../../clang-reorder-fields/ReorderFieldsAction.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/RecordLayout.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include <algorithm>
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+struct FieldLayout {
+  CharUnits Size;
+  CharUnits Align;
+};
+
+/// Returns the size of a record of alignment \p RecordAlign whose fields are
+/// laid out in \p Order.
+CharUnits getRecordSize(ArrayRef<FieldLayout> Fields, ArrayRef<unsigned> Order,
+                        CharUnits RecordAlign) {
+  CharUnits Offset = CharUnits::Zero();
+  for (unsigned Index : Order)
+    Offset = Offset.alignTo(Fields[Index].Align) + Fields[Index].Size;
+  return Offset.alignTo(RecordAlign);
+}
+
+/// Returns whether the layout of \p Record only depends on the sizes and the
+/// alignments of its fields.
+bool hasPlainLayout(const RecordDecl &Record) {
+  if (Record.isUnion() || Record.isInvalidDecl() ||
+      Record.hasFlexibleArrayMember() || Record.hasAttr<PackedAttr>() ||
+      Record.hasAttr<MaxFieldAlignmentAttr>())
+    return false;
+  if (const auto *CXXRecord = dyn_cast<CXXRecordDecl>(&Record)) {
+    if (CXXRecord->isLambda() || CXXRecord->getNumBases() != 0 ||
+        CXXRecord->getNumVBases() != 0 || CXXRecord->isDynamicClass())
+      return false;
+  }
+  for (const FieldDecl *Field : Record.fields()) {
+    if (Field->isBitField() || Field->getType()->isIncompleteType() ||
+        Field->getType()->isDependentType())
+      return false;
+  }
+  return true;
+}
+
+/// Returns whether the reordering of the fields of \p Record can be applied
+/// safely with clang-reorder-fields.
+bool canReorderFields(const RecordDecl &Record, ASTContext &Context) {
+  const SourceManager &SM = Context.getSourceManager();
+  // The constructors and the aggregate initializations of the records of the
+  // headers may be in other translation units.
+  if (!SM.isInMainFile(Record.getLocation()))
+    return false;
+
+  // clang-reorder-fields doesn't move the fields across access specifiers,
+  // nor the declarators of a shared declaration.
+  const FieldDecl *First = *Record.field_begin();
+  SourceLocation PreviousBegin;
+  for (const FieldDecl *Field : Record.fields()) {
+    const SourceRange Range = Field->getSourceRange();
+    if (Field->getAccess() != First->getAccess() ||
+        Range.getBegin().isMacroID() || Range.getEnd().isMacroID() ||
+        Range.getBegin() == PreviousBegin)
+      return false;
+    PreviousBegin = Range.getBegin();
+  }
+
+  // A member initialized from another one may read it before its
+  // initialization once reordered.
+  const auto MemberRef = memberExpr(hasObjectExpression(cxxThisExpr()),
+                                    member(fieldDecl().bind("field")));
+  auto UsesField = [&](const Expr *Init) {
+    for (const auto &Nodes :
+         match(expr(anyOf(MemberRef, hasDescendant(MemberRef))), *Init,
+               Context))
+      if (Nodes.getNodeAs<FieldDecl>("field")->getParent() == &Record)
+        return true;
+    return false;
+  };
+  for (const FieldDecl *Field : Record.fields())
+    if (Field->hasInClassInitializer() &&
+        UsesField(Field->getInClassInitializer()))
+      return false;
+  const auto *CXXRecord = dyn_cast<CXXRecordDecl>(&Record);
+  if (CXXRecord) {
+    for (const CXXConstructorDecl *Ctor : CXXRecord->ctors()) {
+      const auto *Definition =
+          dyn_cast_or_null<CXXConstructorDecl>(Ctor->getDefinition());
+      if (!Definition)
+        continue;
+      for (const CXXCtorInitializer *Init : Definition->inits())
+        if (Init->isMemberInitializer() && Init->isWritten() &&
+            UsesField(Init->getInit()))
+          return false;
+    }
+  }
+
+  // clang-reorder-fields only rewrites the complete aggregate
+  // initializations.
+  if (CXXRecord && !CXXRecord->isAggregate())
+    return true;
+  const unsigned NumFields =
+      std::distance(Record.field_begin(), Record.field_end());
+  for (const auto &Nodes :
+       match(initListExpr(hasType(equalsNode(&Record))).bind("init"),
+             Context)) {
+    const auto *InitList = Nodes.getNodeAs<InitListExpr>("init");
+    if (!InitList->isExplicit())
+      continue;
+    if (const auto *SyntacticForm = InitList->getSyntacticForm())
+      InitList = SyntacticForm;
+    if (InitList->getNumInits() != 0 && InitList->getNumInits() != NumFields)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+StructPaddingCheck::StructPaddingCheck(StringRef Name,
+                                       ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      SavedPercentThreshold(Options.get("SavedPercentThreshold", 10U)) {}
+
+void StructPaddingCheck::storeOptions(ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "SavedPercentThreshold", SavedPercentThreshold);
+}
+
+void StructPaddingCheck::registerMatchers(MatchFinder *Finder) {
+  Finder->addMatcher(recordDecl(isDefinition(), unless(isImplicit()),
+                                unless(isExpansionInSystemHeader()))
+                         .bind("record"),
+                     this);
+}
+
+void StructPaddingCheck::check(const MatchFinder::MatchResult &Result) {
+  const auto *Record = Result.Nodes.getNodeAs<RecordDecl>("record");
+  ASTContext &Context = *Result.Context;
+
+  // The templates are laid out once instantiated, with the layouts of their
+  // arguments.
+  if (Record->isDependentType() || Record->isAnonymousStructOrUnion() ||
+      isa<ClassTemplateSpecializationDecl>(Record) || Record->field_empty() ||
+      !hasPlainLayout(*Record))
+    return;
+
+  SmallVector<FieldLayout, 8> Fields;
+  CharUnits FieldsSize = CharUnits::Zero();
+  for (const FieldDecl *Field : Record->fields()) {
+    Fields.push_back({Context.getTypeSizeInChars(Field->getType()),
+                      Context.getDeclAlign(Field)});
+    FieldsSize += Fields.back().Size;
+  }
+
+  const ASTRecordLayout &Layout = Context.getASTRecordLayout(Record);
+  SmallVector<unsigned, 8> Order(Fields.size());
+  for (unsigned I = 0, E = Fields.size(); I < E; ++I)
+    Order[I] = I;
+  // Give up on the layouts that the simulation doesn't reproduce.
+  const CharUnits Size = getRecordSize(Fields, Order, Layout.getAlignment());
+  if (Size != Layout.getSize())
+    return;
+
+  // When the sizes are multiples of the alignments, the fields sorted by
+  // decreasing alignment leave no padding but at the end.
+  std::stable_sort(Order.begin(), Order.end(), [&](unsigned L, unsigned R) {
+    return Fields[L].Align > Fields[R].Align;
+  });
+  const CharUnits NewSize = getRecordSize(Fields, Order, Layout.getAlignment());
+  if (NewSize >= Size ||
+      (Size - NewSize).getQuantity() * 100 <
+          Size.getQuantity() * SavedPercentThreshold)
+    return;
+
+  auto Diag = diag(Record->getLocation(),
+                   "%0 is %1 bytes, %2 of which are padding; ordering its "
+                   "fields by decreasing alignment reduces its size to %3 "
+                   "bytes")
+              << Record << static_cast<unsigned>(Size.getQuantity())
+              << static_cast<unsigned>((Size - FieldsSize).getQuantity())
+              << static_cast<unsigned>(NewSize.getQuantity());
+
+  if (!canReorderFields(*Record, Context))
+    return;
+  std::map<std::string, tooling::Replacements> Replacements;
+  if (!reorder_fields::reorderFields(Record, Order, Context, Replacements))
+    return;
+  SourceManager &SM = Context.getSourceManager();
+  std::vector<FixItHint> Fixes;
+  for (const auto &FileReplacements : Replacements) {
+    const FileEntry *File = SM.getFileManager().getFile(FileReplacements.first);
+    if (!File)
+      return;
+    const SourceLocation FileStart =
+        SM.getLocForStartOfFile(SM.translateFile(File));
+    for (const tooling::Replacement &R : FileReplacements.second) {
+      const SourceLocation Begin = FileStart.getLocWithOffset(R.getOffset());
+      Fixes.push_back(FixItHint::CreateReplacement(
+          CharSourceRange::getCharRange(
+              Begin, Begin.getLocWithOffset(R.getLength())),
+          R.getReplacementText()));
+    }
+  }
+  for (const FixItHint &Fix : Fixes)
+    Diag << Fix;
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
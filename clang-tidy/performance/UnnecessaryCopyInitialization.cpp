@@ -29,6 +29,7 @@ void recordFixes(const VarDecl &Var, ASTContext &Context,
 } // namespace
 
 using namespace ::clang::ast_matchers;
+using utils::decl_ref_expr::DeclRefExprIndexCache;
 using utils::decl_ref_expr::isOnlyUsedAsConst;
 
 UnnecessaryCopyInitialization::UnnecessaryCopyInitialization(
@@ -53,14 +54,18 @@ void UnnecessaryCopyInitialization::registerMatchers(MatchFinder *Finder) {
       callExpr(callee(functionDecl(returns(ConstReference))),
                unless(callee(cxxMethodDecl())));
 
-  auto localVarCopiedFrom = [this](const internal::Matcher<Expr> &CopyCtorArg) {
+  auto *TypeTraits =
+      &getTranslationUnitCache<utils::type_traits::TypeTraitsCache>();
+  auto localVarCopiedFrom = [this, TypeTraits](
+                                const internal::Matcher<Expr> &CopyCtorArg) {
     return compoundStmt(
                forEachDescendant(
                    declStmt(
                        has(varDecl(hasLocalStorage(),
                                    hasType(qualType(
                                        hasCanonicalType(
-                                           matchers::isExpensiveToCopy()),
+                                           matchers::isExpensiveToCopy(
+                                               TypeTraits)),
                                        unless(hasDeclaration(namedDecl(
                                            matchers::matchesAnyListedName(
                                                AllowedTypes)))))),
@@ -118,11 +123,12 @@ void UnnecessaryCopyInitialization::check(
 void UnnecessaryCopyInitialization::handleCopyFromMethodReturn(
     const VarDecl &Var, const Stmt &BlockStmt, bool IssueFix,
     const VarDecl *ObjectArg, ASTContext &Context) {
+  auto &Index = getTranslationUnitCache<DeclRefExprIndexCache>();
   bool IsConstQualified = Var.getType().isConstQualified();
-  if (!IsConstQualified && !isOnlyUsedAsConst(Var, BlockStmt, Context))
+  if (!IsConstQualified && !isOnlyUsedAsConst(Var, BlockStmt, Context, &Index))
     return;
   if (ObjectArg != nullptr &&
-      !isOnlyUsedAsConst(*ObjectArg, BlockStmt, Context))
+      !isOnlyUsedAsConst(*ObjectArg, BlockStmt, Context, &Index))
     return;
 
   auto Diagnostic =
@@ -141,8 +147,9 @@ void UnnecessaryCopyInitialization::handleCopyFromMethodReturn(
 void UnnecessaryCopyInitialization::handleCopyFromLocalVar(
     const VarDecl &NewVar, const VarDecl &OldVar, const Stmt &BlockStmt,
     bool IssueFix, ASTContext &Context) {
-  if (!isOnlyUsedAsConst(NewVar, BlockStmt, Context) ||
-      !isOnlyUsedAsConst(OldVar, BlockStmt, Context))
+  auto &Index = getTranslationUnitCache<DeclRefExprIndexCache>();
+  if (!isOnlyUsedAsConst(NewVar, BlockStmt, Context, &Index) ||
+      !isOnlyUsedAsConst(OldVar, BlockStmt, Context, &Index))
     return;
 
   auto Diagnostic = diag(NewVar.getLocation(),
@@ -0,0 +1,242 @@
+//===--- UnnecessaryCopyOnReturnCheck.cpp - clang-tidy --------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "UnnecessaryCopyOnReturnCheck.h"
+
+#include "../utils/Matchers.h"
+#include "../utils/TypeTraits.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/Preprocessor.h"
+
+using namespace clang::ast_matchers;
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+namespace {
+
+/// Returns true if the object of type \p Type can be returned from
+/// \p Function without a conversion.
+bool hasReturnType(QualType Type, const FunctionDecl &Function) {
+  return Type.getCanonicalType().getUnqualifiedType() ==
+         Function.getReturnType().getCanonicalType().getUnqualifiedType();
+}
+
+/// Returns true if \p Var is a variable of \p Function that can be moved
+/// implicitly by a return statement.
+bool isReturnableLocal(const VarDecl &Var, const FunctionDecl &Function) {
+  return Var.getParentFunctionOrMethod() == &Function &&
+         !Var.isExceptionVariable() && !Var.getType().isVolatileQualified();
+}
+
+} // namespace
+
+UnnecessaryCopyOnReturnCheck::UnnecessaryCopyOnReturnCheck(
+    StringRef Name, ClangTidyContext *Context)
+    : ClangTidyCheck(Name, Context),
+      IncludeStyle(utils::IncludeSorter::parseIncludeStyle(
+          Options.getLocalOrGlobal("IncludeStyle", "llvm"))) {}
+
+void UnnecessaryCopyOnReturnCheck::registerMatchers(MatchFinder *Finder) {
+  // Copy elision of named objects and the implicit moves on return are only
+  // worth checking in C++11, where the objects can be moved.
+  if (!getLangOpts().CPlusPlus11)
+    return;
+
+  // The lambdas are skipped, forFunction() finds the enclosing function of
+  // their body.
+  const auto InFunction =
+      allOf(forFunction(functionDecl().bind("function")),
+            unless(hasAncestor(lambdaExpr())),
+            unless(isInTemplateInstantiation()));
+  const auto LocalVar = declRefExpr(
+      to(varDecl(hasAutomaticStorageDuration(),
+                 unless(hasType(references(anything()))))
+             .bind("var")));
+  const auto CopyConstruct = cxxConstructExpr(
+      hasDeclaration(cxxConstructorDecl(isCopyConstructor())));
+
+  auto *StdMove =
+      getTranslationUnitCache<utils::NameSetCache>().get({"::std::move"});
+  Finder->addMatcher(
+      returnStmt(
+          hasReturnValue(ignoringImplicit(cxxConstructExpr(hasArgument(
+              0, ignoringParenImpCasts(
+                     callExpr(callee(functionDecl(
+                                  matchers::hasAnyNameInSet(StdMove))),
+                              argumentCountIs(1),
+                              hasArgument(0, ignoringParenImpCasts(LocalVar)))
+                         .bind("move")))))),
+          InFunction),
+      this);
+
+  Finder->addMatcher(
+      returnStmt(hasReturnValue(ignoringImplicit(
+                     cxxConstructExpr(CopyConstruct,
+                                      hasArgument(0, ignoringParenImpCasts(
+                                                         LocalVar)))
+                         .bind("construct"))),
+                 InFunction),
+      this);
+
+  Finder->addMatcher(
+      returnStmt(
+          hasReturnValue(ignoringImplicit(
+              cxxConstructExpr(
+                  CopyConstruct,
+                  hasArgument(0, ignoringParenImpCasts(
+                                     memberExpr(has(ignoringParenImpCasts(
+                                                    cxxThisExpr())),
+                                                member(fieldDecl()))
+                                         .bind("member"))))
+                  .bind("construct"))),
+          InFunction),
+      this);
+}
+
+void UnnecessaryCopyOnReturnCheck::check(
+    const MatchFinder::MatchResult &Result) {
+  const auto *Function = Result.Nodes.getNodeAs<FunctionDecl>("function");
+  const auto *Var = Result.Nodes.getNodeAs<VarDecl>("var");
+  const auto *Construct =
+      Result.Nodes.getNodeAs<CXXConstructExpr>("construct");
+
+  if (const auto *Move = Result.Nodes.getNodeAs<CallExpr>("move"))
+    handleMoveOnReturn(*Move, *Var, *Function, *Result.Context);
+  else if (const auto *Member = Result.Nodes.getNodeAs<MemberExpr>("member"))
+    handleCopiedMember(*Construct, *Member, *Function, *Result.Context);
+  else
+    handleCopiedVariable(*Construct, *Var, *Function, *Result.Context);
+}
+
+void UnnecessaryCopyOnReturnCheck::registerPPCallbacks(
+    CompilerInstance &Compiler) {
+  Inserter.reset(new utils::IncludeInserter(
+      Compiler.getSourceManager(), Compiler.getLangOpts(), IncludeStyle));
+  Compiler.getPreprocessor().addPPCallbacks(Inserter->CreatePPCallbacks());
+}
+
+void UnnecessaryCopyOnReturnCheck::storeOptions(
+    ClangTidyOptions::OptionMap &Opts) {
+  Options.store(Opts, "IncludeStyle",
+                utils::IncludeSorter::toString(IncludeStyle));
+}
+
+void UnnecessaryCopyOnReturnCheck::handleMoveOnReturn(
+    const CallExpr &Move, const VarDecl &Var, const FunctionDecl &Function,
+    const ASTContext &Context) {
+  // The move is needed to convert the object to another return type.
+  if (!Var.getType()->isRecordType() ||
+      !hasReturnType(Var.getType(), Function) ||
+      !isReturnableLocal(Var, Function))
+    return;
+  // A const parameter is copied either way, which performance-move-const-arg
+  // reports.
+  const bool IsParam = isa<ParmVarDecl>(Var);
+  if (IsParam && Var.getType().isConstQualified())
+    return;
+
+  const SourceManager &SM = Context.getSourceManager();
+  const Expr *Arg = Move.getArg(0);
+  CharSourceRange BeforeArgumentRange = Lexer::makeFileCharRange(
+      CharSourceRange::getCharRange(Move.getBeginLoc(), Arg->getBeginLoc()), SM,
+      Context.getLangOpts());
+  CharSourceRange AfterArgumentRange = Lexer::makeFileCharRange(
+      CharSourceRange::getCharRange(Move.getEndLoc(),
+                                    Move.getEndLoc().getLocWithOffset(1)),
+      SM, Context.getLangOpts());
+  if (BeforeArgumentRange.isInvalid() || AfterArgumentRange.isInvalid())
+    return;
+
+  diag(BeforeArgumentRange.getBegin(),
+       "%select{moving the local variable %1 in a return statement prevents "
+       "copy elision|the parameter %1 is moved implicitly in a return "
+       "statement}0; remove std::move()")
+      << IsParam << &Var << FixItHint::CreateRemoval(BeforeArgumentRange)
+      << FixItHint::CreateRemoval(AfterArgumentRange);
+}
+
+void UnnecessaryCopyOnReturnCheck::handleCopiedVariable(
+    const CXXConstructExpr &Construct, const VarDecl &Var,
+    const FunctionDecl &Function, const ASTContext &Context) {
+  if (Construct.isElidable() || Var.isNRVOVariable())
+    return;
+  if (!hasReturnType(Var.getType(), Function) ||
+      !isReturnableLocal(Var, Function))
+    return;
+  if (!utils::type_traits::isExpensiveToCopy(
+           Var.getType(), Context,
+           &getTranslationUnitCache<utils::type_traits::TypeTraitsCache>())
+           .getValueOr(false))
+    return;
+
+  const bool IsParam = isa<ParmVarDecl>(Var);
+  if (Var.getType().isConstQualified()) {
+    // Moving the object would copy it anyway.
+    if (!utils::type_traits::hasNonTrivialMoveConstructor(Var.getType()))
+      return;
+    diag(Construct.getBeginLoc(),
+         "the const %select{local variable|parameter}0 %1 is copied on return; "
+         "consider making it non-const so that it can be moved")
+        << IsParam << &Var;
+    return;
+  }
+  // The object is copied because its type has no move constructor. Nothing
+  // avoids the copy of a parameter, a local can still be constructed in the
+  // return slot.
+  if (IsParam)
+    return;
+  diag(Construct.getBeginLoc(),
+       "the local variable %0 is copied on return because the copy can't be "
+       "elided; consider returning the same local variable from all the "
+       "return statements of the function")
+      << &Var;
+}
+
+void UnnecessaryCopyOnReturnCheck::handleCopiedMember(
+    const CXXConstructExpr &Construct, const MemberExpr &Member,
+    const FunctionDecl &Function, const ASTContext &Context) {
+  // Only the members of an object about to expire can be moved.
+  const auto *Method = dyn_cast<CXXMethodDecl>(&Function);
+  if (!Method || Method->getRefQualifier() != RQ_RValue)
+    return;
+  const QualType MemberType = Member.getType();
+  if (MemberType->isReferenceType() || MemberType.isConstQualified() ||
+      MemberType.isVolatileQualified())
+    return;
+  if (!utils::type_traits::isExpensiveToCopy(
+           MemberType, Context,
+           &getTranslationUnitCache<utils::type_traits::TypeTraitsCache>())
+           .getValueOr(false) ||
+      !utils::type_traits::hasNonTrivialMoveConstructor(MemberType))
+    return;
+
+  auto Diag = diag(Member.getBeginLoc(),
+                   "the member %0 is copied on return from an rvalue "
+                   "reference qualified member function; consider moving it")
+              << Member.getMemberDecl();
+  // Do not propose fixes in macros since we cannot place them correctly.
+  if (Member.getBeginLoc().isMacroID() || Member.getEndLoc().isMacroID())
+    return;
+  const SourceManager &SM = Context.getSourceManager();
+  SourceLocation EndLoc = Lexer::getLocForEndOfToken(
+      Member.getEndLoc(), 0, SM, Context.getLangOpts());
+  Diag << FixItHint::CreateInsertion(Member.getBeginLoc(), "std::move(")
+       << FixItHint::CreateInsertion(EndLoc, ")");
+  if (auto IncludeFixit = Inserter->CreateIncludeInsertion(
+          SM.getFileID(Member.getBeginLoc()), "utility",
+          /*IsAngled=*/true))
+    Diag << *IncludeFixit;
+}
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
@@ -0,0 +1,54 @@
+//===--- UnnecessaryCopyOnReturnCheck.h - clang-tidy ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_UNNECESSARY_COPY_ON_RETURN_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_UNNECESSARY_COPY_ON_RETURN_H
+
+#include "../ClangTidy.h"
+#include "../utils/IncludeInserter.h"
+
+namespace clang {
+namespace tidy {
+namespace performance {
+
+/// \brief Finds the return statements copying an object of an expensive to
+/// copy type that could have been elided or moved, and the `std::move` calls
+/// in return statements that prevent the copy elision.
+///
+/// For the user-facing documentation see:
+/// http://clang.llvm.org/extra/clang-tidy/checks/performance-unnecessary-copy-on-return.html
+class UnnecessaryCopyOnReturnCheck : public ClangTidyCheck {
+public:
+  UnnecessaryCopyOnReturnCheck(StringRef Name, ClangTidyContext *Context);
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override;
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override;
+  void registerPPCallbacks(CompilerInstance &Compiler) override;
+  void storeOptions(ClangTidyOptions::OptionMap &Opts) override;
+
+private:
+  void handleMoveOnReturn(const CallExpr &Move, const VarDecl &Var,
+                          const FunctionDecl &Function,
+                          const ASTContext &Context);
+  void handleCopiedVariable(const CXXConstructExpr &Construct,
+                            const VarDecl &Var, const FunctionDecl &Function,
+                            const ASTContext &Context);
+  void handleCopiedMember(const CXXConstructExpr &Construct,
+                          const MemberExpr &Member,
+                          const FunctionDecl &Function,
+                          const ASTContext &Context);
+
+  std::unique_ptr<utils::IncludeInserter> Inserter;
+  const utils::IncludeSorter::IncludeStyle IncludeStyle;
+};
+
+} // namespace performance
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_PERFORMANCE_UNNECESSARY_COPY_ON_RETURN_H
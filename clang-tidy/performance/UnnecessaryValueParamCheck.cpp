@@ -80,7 +80,8 @@ void UnnecessaryValueParamCheck::registerMatchers(MatchFinder *Finder) {
     return;
   const auto ExpensiveValueParamDecl = parmVarDecl(
       hasType(qualType(
-          hasCanonicalType(matchers::isExpensiveToCopy()),
+          hasCanonicalType(matchers::isExpensiveToCopy(
+              &getTranslationUnitCache<utils::type_traits::TypeTraitsCache>())),
           unless(anyOf(hasCanonicalType(referenceType()),
                        hasDeclaration(namedDecl(
                            matchers::matchesAnyListedName(AllowedTypes))))))),
@@ -113,7 +114,9 @@ void UnnecessaryValueParamCheck::check(const MatchFinder::MatchResult &Result) {
   // copy.
   if (!IsConstQualified) {
     auto AllDeclRefExprs = utils::decl_ref_expr::allDeclRefExprs(
-        *Param, *Function, *Result.Context);
+        *Param, *Function, *Result.Context,
+        &getTranslationUnitCache<
+            utils::decl_ref_expr::DeclRefExprIndexCache>());
     if (AllDeclRefExprs.size() == 1) {
       auto CanonicalType = Param->getType().getCanonicalType();
       const auto &DeclRefExpr = **AllDeclRefExprs.begin();
@@ -9,62 +9,288 @@
 
 #include "../ClangTidy.h"
 #include "../ClangTidyModule.h"
+#include "../ClangTidyResultCache.h"
+#include "clang/Basic/Version.h"
 #include "clang/Config/config.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/SHA1.h"
 
 namespace clang {
 namespace tidy {
 
-/// The core clang tidy plugin action. This just provides the AST consumer and
+/// The core clang tidy plugin action. This provides the AST consumer and
 /// command line flag parsing for using clang-tidy as a clang plugin.
+///
+/// The diagnostics of the checks are collected and filtered as by the
+/// clang-tidy tool (check and header filters, NOLINT comments), then reported
+/// by the compiler at the end of the translation unit, with their fixes as
+/// fix-it hints.
 class ClangTidyPluginAction : public PluginASTAction {
-  /// Wrapper to grant the context the same lifetime as the action. We use
-  /// MultiplexConsumer to avoid writing out all the forwarding methods.
-  class WrapConsumer : public MultiplexConsumer {
+  /// The options of the plugin that aren't ClangTidyOptions.
+  struct PluginOptions {
+    std::string ExportFixes;
+    ExportFixesFormat FixesFormat = ExportFixesFormat::YAML;
+    std::string ResultCache;
+  };
+
+  /// The state of the plugin for a translation unit. It's a base of
+  /// WrapConsumer, before MultiplexConsumer, so that it's destroyed after
+  /// the consumers of the checks, which use the context until then.
+  struct TranslationUnitState {
     std::unique_ptr<ClangTidyContext> Context;
+    std::unique_ptr<ClangTidyDiagnosticConsumer> DiagConsumer;
+    std::unique_ptr<DiagnosticsEngine> DiagEngine;
+    llvm::Optional<ClangTidyResultCache> Cache;
+    std::unique_ptr<llvm::SHA1> Hasher;
+  };
 
+  /// Wrapper to grant the context the same lifetime as the action, and to
+  /// report the diagnostics of the checks. We use MultiplexConsumer to avoid
+  /// writing out all the forwarding methods.
+  class WrapConsumer : private TranslationUnitState, public MultiplexConsumer {
   public:
-    WrapConsumer(std::unique_ptr<ClangTidyContext> Context,
+    WrapConsumer(TranslationUnitState State, CompilerInstance &Compiler,
+                 StringRef File, const PluginOptions &Options,
                  std::vector<std::unique_ptr<ASTConsumer>> Consumer)
-        : MultiplexConsumer(std::move(Consumer)), Context(std::move(Context)) {}
+        : TranslationUnitState(std::move(State)),
+          MultiplexConsumer(std::move(Consumer)), Compiler(Compiler),
+          MainFile(File), Options(Options) {
+      llvm::sys::fs::make_absolute(MainFile);
+    }
+
+    void HandleTranslationUnit(ASTContext &Ctx) override {
+      llvm::Optional<std::string> Key;
+      llvm::Optional<ClangTidyResultCache::Result> Cached;
+      if (Cache) {
+        Key = computeResultKey();
+        Cached = Cache->load(*Key, *Context,
+                             Context->getCurrentBuildDirectory());
+      }
+
+      std::vector<ClangTidyError> Errors;
+      if (Cached) {
+        Errors = std::move(Cached->Errors);
+      } else {
+        MultiplexConsumer::HandleTranslationUnit(Ctx);
+        Errors = DiagConsumer->take();
+        // The results of the checks skipped by their time budgets vary
+        // between runs, and compiler errors may be fixed by the next one.
+        if (Key && !Context->hasChecksOverBudget() &&
+            !Compiler.getDiagnostics().hasErrorOccurred()) {
+          ClangTidyResultCache::Result R;
+          R.Errors = Errors;
+          R.Stats = Context->getStats();
+          Cache->store(*Key, MainFile, R);
+        }
+      }
+
+      for (const ClangTidyError &Error : Errors)
+        reportError(Error);
+      if (!Options.ExportFixes.empty())
+        exportFixes(Errors);
+    }
+
+  private:
+    /// Returns the key of the results in the result cache, from the files
+    /// read by the preprocessor and the options of the main file.
+    std::string computeResultKey() {
+      auto Update = [&](StringRef Data) {
+        Hasher->update(Data);
+        Hasher->update(StringRef("\0", 1));
+      };
+      Update(getClangToolFullVersion("clang-tidy-plugin"));
+      Update(configurationAsText(Context->getOptionsForFile(MainFile)));
+      for (const FileFilter &Filter : Context->getGlobalOptions().LineFilter) {
+        Update(Filter.Name);
+        for (const FileFilter::LineRange &Range : Filter.LineRanges)
+          Update(llvm::formatv("{0}-{1}", Range.first, Range.second).str());
+      }
+      return llvm::toHex(Hasher->final());
+    }
+
+    void reportError(const ClangTidyError &Error) {
+      DiagnosticsEngine &Diags = Compiler.getDiagnostics();
+      const tooling::DiagnosticMessage &Message = Error.Message;
+      {
+        auto Level = static_cast<DiagnosticsEngine::Level>(Error.DiagLevel);
+        std::string Name = Error.DiagnosticName;
+        if (Error.IsWarningAsError) {
+          Name += ",-warnings-as-errors";
+          Level = DiagnosticsEngine::Error;
+        }
+        auto Diag =
+            Diags.Report(getLocation(Message.FilePath, Message.FileOffset),
+                         Diags.getCustomDiagID(Level, "%0 [%1]"))
+            << Message.Message << Name;
+        for (const auto &FileAndReplacements : Error.Fix) {
+          for (const auto &Repl : FileAndReplacements.second) {
+            SourceLocation FixLoc =
+                getLocation(Repl.getFilePath(), Repl.getOffset());
+            if (FixLoc.isValid())
+              Diag << FixItHint::CreateReplacement(
+                  CharSourceRange::getCharRange(
+                      FixLoc, FixLoc.getLocWithOffset(Repl.getLength())),
+                  Repl.getReplacementText());
+          }
+        }
+      }
+      for (const tooling::DiagnosticMessage &Note : Error.Notes)
+        Diags.Report(getLocation(Note.FilePath, Note.FileOffset),
+                     Diags.getCustomDiagID(DiagnosticsEngine::Note, "%0"))
+            << Note.Message;
+    }
+
+    void exportFixes(const std::vector<ClangTidyError> &Errors) {
+      std::error_code EC;
+      llvm::raw_fd_ostream OS(Options.ExportFixes, EC, llvm::sys::fs::F_None);
+      if (EC) {
+        DiagnosticsEngine &Diags = Compiler.getDiagnostics();
+        Diags.Report(Diags.getCustomDiagID(
+            DiagnosticsEngine::Error,
+            "can't write the clang-tidy fixes to '%0': %1"))
+            << Options.ExportFixes << EC.message();
+        return;
+      }
+      exportReplacements(MainFile, Errors, OS, Options.FixesFormat);
+    }
+
+    SourceLocation getLocation(StringRef FilePath, unsigned Offset) {
+      if (FilePath.empty())
+        return SourceLocation();
+      SourceManager &SM = Compiler.getSourceManager();
+      const FileEntry *File = SM.getFileManager().getFile(FilePath);
+      if (!File)
+        return SourceLocation();
+      FileID ID = SM.getOrCreateFileID(File, SrcMgr::C_User);
+      return SM.getLocForStartOfFile(ID).getLocWithOffset(Offset);
+    }
+
+    CompilerInstance &Compiler;
+    SmallString<256> MainFile;
+    PluginOptions Options;
   };
 
 public:
   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
                                                  StringRef File) override {
-    // Insert the current diagnostics engine.
-    Context->setDiagnosticsEngine(&Compiler.getDiagnostics());
+    TranslationUnitState State;
+    State.Context = std::move(Context);
+    // The diagnostics of the checks are filtered by a consumer of their own,
+    // then reported by the compiler.
+    State.DiagConsumer =
+        llvm::make_unique<ClangTidyDiagnosticConsumer>(*State.Context);
+    State.DiagEngine = llvm::make_unique<DiagnosticsEngine>(
+        new DiagnosticIDs(), new DiagnosticOptions(), State.DiagConsumer.get(),
+        /*ShouldOwnClient=*/false);
+    State.Context->setDiagnosticsEngine(State.DiagEngine.get());
+    if (!Options.ResultCache.empty()) {
+      State.Cache.emplace(Options.ResultCache);
+      State.Hasher = llvm::make_unique<llvm::SHA1>();
+      Compiler.getPreprocessor().addPPCallbacks(
+          ClangTidyResultCache::newHashingCallbacks(
+              Compiler.getSourceManager(), *State.Hasher));
+    }
 
     // Create the AST consumer.
-    ClangTidyASTConsumerFactory Factory(*Context);
+    ClangTidyASTConsumerFactory Factory(*State.Context);
     std::vector<std::unique_ptr<ASTConsumer>> Vec;
     Vec.push_back(Factory.CreateASTConsumer(Compiler, File));
 
-    return llvm::make_unique<WrapConsumer>(std::move(Context), std::move(Vec));
+    return llvm::make_unique<WrapConsumer>(std::move(State), Compiler, File,
+                                           Options, std::move(Vec));
   }
 
-  bool ParseArgs(const CompilerInstance &,
+  bool ParseArgs(const CompilerInstance &Compiler,
                  const std::vector<std::string> &Args) override {
     ClangTidyGlobalOptions GlobalOptions;
     ClangTidyOptions DefaultOptions;
     ClangTidyOptions OverrideOptions;
-
-    // Parse the extra command line args.
-    // FIXME: This is very limited at the moment.
-    for (StringRef Arg : Args)
-      if (Arg.startswith("-checks="))
-        OverrideOptions.Checks = Arg.substr(strlen("-checks="));
-
-    auto Options = llvm::make_unique<FileOptionsProvider>(
-        GlobalOptions, DefaultOptions, OverrideOptions);
-    Context = llvm::make_unique<ClangTidyContext>(std::move(Options));
+    llvm::Optional<ClangTidyOptions> Config;
+    bool EnableCheckProfile = false;
+    SmallString<256> ProfilePrefix;
+
+    DiagnosticsEngine &Diags = Compiler.getDiagnostics();
+    auto Invalid = [&](StringRef Message, StringRef Arg) {
+      Diags.Report(Diags.getCustomDiagID(DiagnosticsEngine::Error,
+                                         "clang-tidy plugin: %0 '%1'"))
+          << Message << Arg;
+      return false;
+    };
+
+    // Parse the extra command line args, named as the options of clang-tidy.
+    for (StringRef Arg : Args) {
+      std::string Value;
+      if (parseOption(Arg, "-checks", Value)) {
+        OverrideOptions.Checks = Value;
+      } else if (parseOption(Arg, "-warnings-as-errors", Value)) {
+        OverrideOptions.WarningsAsErrors = Value;
+      } else if (parseOption(Arg, "-header-filter", Value)) {
+        OverrideOptions.HeaderFilterRegex = Value;
+      } else if (Arg == "-system-headers") {
+        OverrideOptions.SystemHeaders = true;
+      } else if (parseOption(Arg, "-config", Value)) {
+        llvm::ErrorOr<ClangTidyOptions> Parsed = parseConfiguration(Value);
+        if (!Parsed)
+          return Invalid("invalid configuration", Value);
+        Config = *Parsed;
+      } else if (parseOption(Arg, "-line-filter", Value)) {
+        if (parseLineFilter(Value, GlobalOptions))
+          return Invalid("invalid line filter", Value);
+      } else if (parseOption(Arg, "-export-fixes", Value)) {
+        Options.ExportFixes = Value;
+      } else if (parseOption(Arg, "-export-fixes-format", Value)) {
+        if (Value == "yaml")
+          Options.FixesFormat = ExportFixesFormat::YAML;
+        else if (Value == "binary")
+          Options.FixesFormat = ExportFixesFormat::Binary;
+        else
+          return Invalid("unknown fixes format", Value);
+      } else if (parseOption(Arg, "-result-cache", Value)) {
+        Options.ResultCache = Value;
+      } else if (Arg == "-enable-check-profile") {
+        EnableCheckProfile = true;
+      } else if (parseOption(Arg, "-store-check-profile", Value)) {
+        EnableCheckProfile = true;
+        ProfilePrefix = Value;
+        llvm::sys::fs::make_absolute(ProfilePrefix);
+      } else {
+        return Invalid("unknown argument", Arg);
+      }
+    }
+
+    std::unique_ptr<ClangTidyOptionsProvider> Provider;
+    if (Config)
+      Provider = llvm::make_unique<ConfigOptionsProvider>(
+          GlobalOptions,
+          ClangTidyOptions::getDefaults().mergeWith(DefaultOptions), *Config,
+          OverrideOptions);
+    else
+      Provider = llvm::make_unique<FileOptionsProvider>(
+          GlobalOptions, DefaultOptions, OverrideOptions);
+    Context = llvm::make_unique<ClangTidyContext>(std::move(Provider));
+    Context->setEnableProfiling(EnableCheckProfile);
+    Context->setProfileStoragePrefix(ProfilePrefix);
     return true;
   }
 
 private:
+  /// Returns true if \p Arg is the option \p Name with a value, and sets
+  /// \p Value to it.
+  static bool parseOption(StringRef Arg, StringRef Name, std::string &Value) {
+    if (!Arg.startswith(Name) || !Arg.substr(Name.size()).startswith("="))
+      return false;
+    Value = Arg.substr(Name.size() + 1);
+    return true;
+  }
+
   std::unique_ptr<ClangTidyContext> Context;
+  PluginOptions Options;
 };
 } // namespace tidy
 } // namespace clang
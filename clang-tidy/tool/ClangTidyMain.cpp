@@ -16,8 +16,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "../ClangTidy.h"
+#include "../ClangTidyAllocationHooks.inc"
+#include "../ClangTidyPreambleCache.h"
+#include "../ClangTidyProfiling.h"
 #include "clang/Config/config.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/Execution.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetSelect.h"
@@ -108,6 +112,24 @@ JSON array of objects:
                                        cl::init(""),
                                        cl::cat(ClangTidyCategory));
 
+static cl::opt<std::string> Diff("diff", cl::desc(R"(
+Unified diff of the changes to check, or '-'
+to read it from stdin. The lines it adds are
+appended to -line-filter, and the matchers of
+the checks only run on the declarations
+containing them, as with -match-user-code-only.
+Diagnostics outside of these declarations can
+be missed.
+)"),
+                                 cl::value_desc("filename"),
+                                 cl::cat(ClangTidyCategory));
+
+static cl::opt<unsigned> DiffStrip("diff-strip", cl::desc(R"(
+Number of leading path components to remove
+from the file names of -diff, as with patch -p.
+)"),
+                                   cl::init(1), cl::cat(ClangTidyCategory));
+
 static cl::opt<bool> Fix("fix", cl::desc(R"(
 Apply suggested fixes. Without -fix-errors
 clang-tidy will bail out if any compilation
@@ -176,6 +198,28 @@ configuration of all checks.
 )"),
                                 cl::init(false), cl::cat(ClangTidyCategory));
 
+static cl::opt<bool> MatchUserCodeOnly("match-user-code-only", cl::desc(R"(
+Only run the matchers of the checks on the
+declarations of the main file and of the headers
+whose diagnostics are displayed (see
+-header-filter and -system-headers). This is
+faster, but checks that look at the declarations
+of other headers may miss some problems.
+)"),
+                                       cl::init(false),
+                                       cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> AnalyzeHeadersOnce("analyze-headers-once", cl::desc(R"(
+Only match the declarations of each header in
+one of the translation units including it, the
+one with the smallest file name. The headers are
+identified by their path and contents. Implies
+-match-user-code-only. Ignored with
+-result-cache.
+)"),
+                                        cl::init(false),
+                                        cl::cat(ClangTidyCategory));
+
 static cl::opt<bool> EnableCheckProfile("enable-check-profile", cl::desc(R"(
 Enable per-check timing profiles, and print a
 report to stderr.
@@ -183,6 +227,18 @@ report to stderr.
                                         cl::init(false),
                                         cl::cat(ClangTidyCategory));
 
+static cl::opt<bool> AggregateCheckProfile("aggregate-check-profile",
+                                           cl::desc(R"(
+Enable per-check timing profiles, and print a
+single report summing them over all translation
+units to stderr: the checks ranked by their
+total time, with their match counts and their
+slowest translation units. The memory is only
+measured with -track-memory.
+)"),
+                                           cl::init(false),
+                                           cl::cat(ClangTidyCategory));
+
 static cl::opt<std::string> StoreCheckProfile("store-check-profile",
                                               cl::desc(R"(
 By default reports are printed in tabulated
@@ -192,6 +248,13 @@ these per-TU profiles are instead stored as JSON.
                                               cl::value_desc("prefix"),
                                               cl::cat(ClangTidyCategory));
 
+static cl::opt<bool> TrackAllocations("track-allocations", cl::desc(R"(
+Count the heap allocations of each check in the
+check profiles, in bytes and calls.
+)"),
+                                      cl::init(false),
+                                      cl::cat(ClangTidyCategory));
+
 /// This option allows enabling the experimental alpha checkers from the static
 /// analyzer. This option is set to false and not visible in help, because it is
 /// highly not recommended for users.
@@ -208,6 +271,52 @@ code with clang-apply-replacements.
                                         cl::value_desc("filename"),
                                         cl::cat(ClangTidyCategory));
 
+static cl::opt<ExportFixesFormat> ExportFixesFormatOpt(
+    "export-fixes-format", cl::desc(R"(
+Format of the -export-fixes file. The binary
+format only stores the fixes, with the paths
+and replacement texts stored once, and is
+smaller and faster for clang-apply-replacements
+to read.
+)"),
+    cl::values(clEnumValN(ExportFixesFormat::YAML, "yaml",
+                          "YAML diagnostics (default)"),
+               clEnumValN(ExportFixesFormat::Binary, "binary",
+                          "compact binary fixes")),
+    cl::init(ExportFixesFormat::YAML), cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> StreamDiagnostics("stream-diagnostics", cl::desc(R"(
+Display the diagnostics of each file, and append
+them to the -export-fixes file, as soon as the
+file is processed instead of once all files are.
+The exported fixes are a YAML document per file.
+Can't be used with -fix.
+)"),
+                                       cl::init(false),
+                                       cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> Serve("serve", cl::desc(R"(
+Run as a server for editors and pre-commit
+hooks. Each request read from the standard input
+is the files to check, one per line, followed by
+an empty line. The diagnostics and fixes of each
+file are written to the standard output as a
+YAML document, in the format of -export-fixes.
+The checks, the configuration files read, the
+compilation database and, with -reuse-preambles,
+the preambles are kept between the requests.
+)"),
+                           cl::init(false), cl::cat(ClangTidyCategory));
+
+static cl::opt<unsigned> Jobs("j", cl::desc(R"(
+Number of files to process in parallel, each
+on its own thread. The threads share the
+configuration files and file statuses read.
+With -fix, also the number of files formatted
+and written in parallel.
+)"),
+                             cl::init(1), cl::cat(ClangTidyCategory));
+
 static cl::opt<bool> Quiet("quiet", cl::desc(R"(
 Run clang-tidy in quiet mode. This suppresses
 printing statistics about ignored warnings and
@@ -217,6 +326,41 @@ options are specified.
                            cl::init(false),
                            cl::cat(ClangTidyCategory));
 
+static cl::opt<std::string> ConfigCache("config-cache", cl::desc(R"(
+Directory in which the configuration found in each
+directory is stored, with the modification times
+of the directory and of its configuration file.
+The directories that didn't change since they were
+stored aren't searched for a configuration file
+again. The directory can be shared by several
+clang-tidy processes, e.g. the ones of a
+run-clang-tidy.py run.
+)"),
+                                        cl::value_desc("directory"),
+                                        cl::cat(ClangTidyCategory));
+
+static cl::opt<std::string> ResultCache("result-cache", cl::desc(R"(
+Directory in which the results of each translation
+unit are stored. The translation units whose
+files, compile command and options didn't change
+since they were stored aren't analyzed again.
+The directory can be shared by several runs.
+)"),
+                                        cl::value_desc("directory"),
+                                        cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> ReusePreambles("reuse-preambles", cl::desc(R"(
+Precompile the headers included by the leading
+directives of each file once, and reuse them for
+the files of the run with the same directives,
+directory and compile options. The checks don't
+see the preprocessor events of these directives,
+and compiler warnings in these headers aren't
+reported.
+)"),
+                                    cl::init(false),
+                                    cl::cat(ClangTidyCategory));
+
 static cl::opt<std::string> VfsOverlay("vfsoverlay", cl::desc(R"(
 Overlay the virtual filesystem described by file
 over the real file system.
@@ -263,6 +407,21 @@ static std::unique_ptr<ClangTidyOptionsProvider> createOptionsProvider(
     llvm::cl::PrintHelpMessage(/*Hidden=*/false, /*Categorized=*/true);
     return nullptr;
   }
+  if (!Diff.empty()) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Text =
+        llvm::MemoryBuffer::getFileOrSTDIN(Diff);
+    if (!Text) {
+      llvm::errs() << "Can't read diff '" << Diff
+                   << "': " << Text.getError().message() << "\n";
+      return nullptr;
+    }
+    if (std::error_code Err = parseUnifiedDiff((*Text)->getBuffer(), DiffStrip,
+                                               GlobalOptions)) {
+      llvm::errs() << "Invalid diff '" << Diff << "': " << Err.message()
+                   << "\n";
+      return nullptr;
+    }
+  }
 
   ClangTidyOptions DefaultOptions;
   DefaultOptions.Checks = DefaultChecks;
@@ -300,8 +459,14 @@ static std::unique_ptr<ClangTidyOptionsProvider> createOptionsProvider(
       return nullptr;
     }
   }
-  return llvm::make_unique<FileOptionsProvider>(GlobalOptions, DefaultOptions,
-                                                OverrideOptions, std::move(FS));
+  auto Provider = llvm::make_unique<FileOptionsProvider>(
+      GlobalOptions, DefaultOptions, OverrideOptions, std::move(FS));
+  if (!ConfigCache.empty())
+    Provider->setConfigCacheDirectory(ConfigCache);
+  // The configuration files may change while the server runs.
+  if (Serve)
+    Provider->setRevalidateConfigFiles(true);
+  return std::move(Provider);
 }
 
 llvm::IntrusiveRefCntPtr<vfs::FileSystem>
@@ -355,6 +520,8 @@ static int clangTidyMain(int argc, const char **argv) {
   };
 
   SmallString<256> ProfilePrefix = MakeAbsolute(StoreCheckProfile);
+  if (TrackAllocations)
+    enableAllocationTracking();
 
   StringRef FileName("dummy");
   auto PathList = OptionsParser.getSourcePathList();
@@ -412,24 +579,117 @@ static int clangTidyMain(int argc, const char **argv) {
     return 1;
   }
 
-  if (PathList.empty()) {
+  // With -executor, the translation units are chosen by the executor, e.g. all
+  // those of the compilation database.
+  const bool UseExecutor = ExecutorName.getNumOccurrences() > 0;
+  if (PathList.empty() && !UseExecutor && !Serve) {
     llvm::errs() << "Error: no input files specified.\n";
     llvm::cl::PrintHelpMessage(/*Hidden=*/false, /*Categorized=*/true);
     return 1;
   }
 
+  if (UseExecutor && (StreamDiagnostics || !ResultCache.empty() || Jobs > 1 ||
+                      !VfsOverlay.empty())) {
+    llvm::errs() << "Error: -executor can't be used with -j, -result-cache, "
+                    "-stream-diagnostics or -vfsoverlay, the translation "
+                    "units are run by the executor.\n";
+    return 1;
+  }
+
+  if (Serve && (UseExecutor || Fix || FixErrors || StreamDiagnostics ||
+                !ExportFixes.empty() || AnalyzeHeadersOnce)) {
+    llvm::errs() << "Error: -serve can't be used with -executor, -fix, "
+                    "-export-fixes, -stream-diagnostics or "
+                    "-analyze-headers-once, each request gets all the "
+                    "diagnostics and fixes of its files.\n";
+    return 1;
+  }
+
   llvm::InitializeAllTargetInfos();
   llvm::InitializeAllTargetMCs();
   llvm::InitializeAllAsmParsers();
 
   ClangTidyContext Context(std::move(OwningOptionsProvider),
                            AllowEnablingAnalyzerAlphaCheckers);
-  std::vector<ClangTidyError> Errors =
-      runClangTidy(Context, OptionsParser.getCompilations(), PathList, BaseFS,
-                   EnableCheckProfile, ProfilePrefix);
+  Context.setMatchUserCodeOnly(MatchUserCodeOnly);
+  if (!Diff.empty()) {
+    if (Context.getGlobalOptions().LineFilter.empty()) {
+      llvm::errs() << "No relevant changes found.\n";
+      return 0;
+    }
+    Context.setMatchChangedLinesOnly(true);
+  }
+  ClangTidyHeaderOwners HeaderOwners;
+  if (AnalyzeHeadersOnce)
+    Context.setHeaderOwners(&HeaderOwners);
+  ClangTidyPreambleCache PreambleCache;
+  if (ReusePreambles)
+    Context.setPreambleCache(&PreambleCache);
+  ClangTidyProfileAggregator ProfileAggregator;
+  if (AggregateCheckProfile)
+    Context.setProfileAggregator(&ProfileAggregator);
+  if (Serve) {
+    serveClangTidy(Context, OptionsParser.getCompilations(), BaseFS, stdin,
+                   llvm::outs(), EnableCheckProfile || AggregateCheckProfile,
+                   ProfilePrefix, Jobs, ResultCache);
+    if (AggregateCheckProfile)
+      ProfileAggregator.print(llvm::errs());
+    return 0;
+  }
+  std::unique_ptr<llvm::raw_fd_ostream> StreamedFixes;
+  llvm::Optional<ClangTidyStreamingReporter> StreamingReporter;
+  if (StreamDiagnostics) {
+    if (Fix || FixErrors) {
+      llvm::errs() << "Error: -stream-diagnostics can't be used with -fix, the "
+                      "fixes of all files are applied together.\n";
+      return 1;
+    }
+    if (!ExportFixes.empty()) {
+      std::error_code EC;
+      StreamedFixes = llvm::make_unique<llvm::raw_fd_ostream>(
+          ExportFixes, EC, llvm::sys::fs::F_None);
+      if (EC) {
+        llvm::errs() << "Error opening output file: " << EC.message() << '\n';
+        return 1;
+      }
+    }
+    StreamingReporter.emplace(Context, BaseFS, StreamedFixes.get(),
+                              ExportFixesFormatOpt);
+  }
+  std::vector<ClangTidyError> Errors;
+  if (UseExecutor) {
+    auto Plugin = llvm::find_if(
+        ToolExecutorPluginRegistry::entries(),
+        [](const ToolExecutorPluginRegistry::entry &Entry) {
+          return Entry.getName() == ExecutorName;
+        });
+    if (Plugin == ToolExecutorPluginRegistry::end()) {
+      llvm::errs() << "Error: executor \"" << ExecutorName
+                   << "\" is not registered.\n";
+      return 1;
+    }
+    auto Executor = Plugin->instantiate()->create(OptionsParser);
+    if (!Executor) {
+      llvm::errs() << "Error: " << llvm::toString(Executor.takeError())
+                   << "\n";
+      return 1;
+    }
+    Errors = runClangTidyWithExecutor(
+        Context, **Executor, EnableCheckProfile || AggregateCheckProfile,
+        ProfilePrefix);
+  } else {
+    Errors = runClangTidy(Context, OptionsParser.getCompilations(), PathList,
+                          BaseFS, EnableCheckProfile || AggregateCheckProfile,
+                          ProfilePrefix, Jobs, ResultCache,
+                          StreamingReporter.getPointer());
+  }
+  if (AggregateCheckProfile)
+    ProfileAggregator.print(llvm::errs());
   bool FoundErrors = llvm::find_if(Errors, [](const ClangTidyError &E) {
                        return E.DiagLevel == ClangTidyError::Error;
                      }) != Errors.end();
+  if (StreamingReporter)
+    FoundErrors = StreamingReporter->foundErrors();
 
   const bool DisableFixes = Fix && FoundErrors && !FixErrors;
 
@@ -437,7 +697,9 @@ static int clangTidyMain(int argc, const char **argv) {
 
   // -fix-errors implies -fix.
   handleErrors(Errors, Context, (FixErrors || Fix) && !DisableFixes, WErrorCount,
-               BaseFS);
+               BaseFS, Jobs);
+  if (StreamingReporter)
+    WErrorCount += StreamingReporter->getWarningsAsErrorsCount();
 
   if (!ExportFixes.empty() && !Errors.empty()) {
     std::error_code EC;
@@ -446,7 +708,7 @@ static int clangTidyMain(int argc, const char **argv) {
       llvm::errs() << "Error opening output file: " << EC.message() << '\n';
       return 1;
     }
-    exportReplacements(FilePath.str(), Errors, OS);
+    exportReplacements(FilePath.str(), Errors, OS, ExportFixesFormatOpt);
   }
 
   if (!Quiet) {
@@ -0,0 +1,335 @@
+#!/usr/bin/env python
+#
+#===- clang-tidy-benchmark.py - Per-check benchmark ----------*- python -*--===#
+#
+#                     The LLVM Compiler Infrastructure
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+#===------------------------------------------------------------------------===#
+
+"""
+clang-tidy check benchmark
+==========================
+
+Runs each check in isolation over a corpus of source files, records its time
+and memory with the check profiles of clang-tidy, and compares them with a
+stored baseline.
+
+When no source file is given, the corpus is generated: sources stressing deep
+template instantiations, huge functions and many macro expansions.
+
+Example invocations.
+- Benchmark the performance checks over the generated corpus and store the
+  results as the baseline.
+    clang-tidy-benchmark.py -checks='performance-*' -output baseline.json
+
+- Benchmark them again, and fail if a check got more than 1.5 times slower.
+    clang-tidy-benchmark.py -checks='performance-*' -baseline baseline.json
+
+- Benchmark all checks over a corpus of files.
+    clang-tidy-benchmark.py -extra-arg=-std=c++14 src/*.cpp
+"""
+
+from __future__ import print_function
+
+import argparse
+import glob
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+BASELINE_VERSION = 1
+
+
+def generate_deep_templates(scale):
+  """Returns a source instantiating deep recursive and variadic templates."""
+  depth = 100 * scale
+  lines = [
+      '#include <string>',
+      '#include <utility>',
+      '#include <vector>',
+      '',
+      'template <int N> struct Deep {',
+      '  using Next = Deep<N - 1>;',
+      '  static int value(std::vector<int> &V) {',
+      '    V.push_back(N);',
+      '    return Next::value(V) + N;',
+      '  }',
+      '};',
+      'template <> struct Deep<0> {',
+      '  static int value(std::vector<int> &) { return 0; }',
+      '};',
+      '',
+      'template <typename... Ts> struct Tuple;',
+      'template <> struct Tuple<> {};',
+      'template <typename T, typename... Ts>',
+      'struct Tuple<T, Ts...> : Tuple<Ts...> {',
+      '  T Head;',
+      '  std::string name() const { return std::to_string(sizeof(T)); }',
+      '};',
+      '',
+  ]
+  for i in range(scale):
+    types = ', '.join(['int', 'double', 'std::string', 'char'] * (8 * scale))
+    lines.append('Tuple<%s> Tuple%d;' % (types, i))
+  lines.append('int deep() {')
+  lines.append('  std::vector<int> V;')
+  for i in range(scale):
+    lines.append('  int Value%d = Deep<%d>::value(V);' % (i, depth - i))
+  lines.append('  return static_cast<int>(V.size());')
+  lines.append('}')
+  return '\n'.join(lines) + '\n'
+
+
+def generate_huge_function(scale):
+  """Returns a source with a single function of thousands of statements."""
+  lines = [
+      '#include <map>',
+      '#include <memory>',
+      '#include <string>',
+      '#include <vector>',
+      '',
+      'struct Item {',
+      '  std::string Name;',
+      '  std::vector<int> Values;',
+      '};',
+      '',
+      'int huge(const std::vector<Item> &Items, std::map<std::string, int> &M) {',
+      '  int Total = 0;',
+  ]
+  for i in range(500 * scale):
+    lines.extend([
+        '  for (const auto &I : Items) {',
+        '    std::string Key%d = I.Name + "%d";' % (i, i),
+        '    if (M.find(Key%d) != M.end())' % i,
+        '      Total += M[Key%d];' % i,
+        '    else',
+        '      Total -= static_cast<int>(I.Values.size()) * %d;' % i,
+        '  }',
+        '  auto Ptr%d = std::make_shared<Item>(Items[%d %% Items.size()]);' %
+        (i, i),
+        '  Total += Ptr%d->Values.empty() ? 0 : Ptr%d->Values.front();' %
+        (i, i),
+    ])
+  lines.append('  return Total;')
+  lines.append('}')
+  return '\n'.join(lines) + '\n'
+
+
+def generate_many_macros(scale):
+  """Returns a source defining and expanding thousands of macros."""
+  count = 1000 * scale
+  lines = [
+      '#include <string>',
+      '',
+      '#define CONCAT_IMPL(A, B) A##B',
+      '#define CONCAT(A, B) CONCAT_IMPL(A, B)',
+      '#define CHECK_ARG(X) ((X) > 0 ? (X) : -(X))',
+  ]
+  for i in range(count):
+    lines.append('#define MACRO_%d(X) (CHECK_ARG(X) + %d)' % (i, i))
+  for i in range(count):
+    lines.append('#define DECLARE_%d int CONCAT(Declared, %d) = MACRO_%d(%d);'
+                 % (i, i, i, i))
+  for i in range(count):
+    lines.append('DECLARE_%d' % i)
+  lines.append('std::string macros(int X) {')
+  lines.append('  std::string Result;')
+  for i in range(count):
+    lines.append('  Result += std::to_string(MACRO_%d(X));' % i)
+  lines.append('  return Result;')
+  lines.append('}')
+  return '\n'.join(lines) + '\n'
+
+
+def generate_corpus(directory, scale):
+  """Writes the generated sources in directory and returns their paths."""
+  generators = [('deep_templates.cpp', generate_deep_templates),
+                ('huge_function.cpp', generate_huge_function),
+                ('many_macros.cpp', generate_many_macros)]
+  files = []
+  for name, generator in generators:
+    path = os.path.join(directory, name)
+    with open(path, 'w') as out:
+      out.write(generator(scale))
+    files.append(path)
+  return files
+
+
+def list_checks(clang_tidy_binary, checks):
+  """Returns the names of the checks enabled by the checks filter."""
+  output = subprocess.check_output(
+      [clang_tidy_binary, '-list-checks', '-checks=-*,' + checks])
+  names = []
+  for line in output.decode('utf-8').splitlines():
+    line = line.strip()
+    if line and not line.startswith('Enabled checks'):
+      names.append(line)
+  return names
+
+
+def run_check(args, check, files, profile_dir):
+  """Runs check alone over files, and returns its summed profile."""
+  invocation = [args.clang_tidy_binary, '-quiet', '-checks=-*,' + check,
+                '-enable-check-profile', '-store-check-profile=' + profile_dir]
+  if args.track_memory:
+    invocation.append('-track-memory')
+  if args.build_path:
+    invocation.append('-p=' + args.build_path)
+  for arg in args.extra_arg:
+    invocation.append('-extra-arg=%s' % arg)
+  invocation.extend(files)
+  if not args.build_path:
+    invocation.append('--')
+
+  profile = {'wall': 0.0, 'user': 0.0, 'sys': 0.0, 'mem': 0}
+  with open(os.devnull, 'w') as devnull:
+    subprocess.call(invocation, stdout=devnull, stderr=devnull)
+  prefix = 'time.clang-tidy.%s.' % check
+  for profile_file in glob.glob(os.path.join(profile_dir, '*.json')):
+    with open(profile_file) as f:
+      values = json.load(f).get('profile', {})
+    for key in profile:
+      profile[key] += values.get(prefix + key, 0)
+    os.remove(profile_file)
+  return profile
+
+
+def benchmark(args, checks, files):
+  """Returns the best profile of each check over the repetitions."""
+  results = {}
+  profile_dir = tempfile.mkdtemp(prefix='clang-tidy-benchmark-profiles-')
+  try:
+    for index, check in enumerate(checks):
+      best = None
+      for _ in range(args.repeat):
+        profile = run_check(args, check, files, profile_dir)
+        if best is None or profile['wall'] < best['wall']:
+          best = profile
+      results[check] = best
+      print('[%d/%d] %-60s %10.4fs %12d B' %
+            (index + 1, len(checks), check, best['wall'], best['mem']))
+      sys.stdout.flush()
+  finally:
+    shutil.rmtree(profile_dir, ignore_errors=True)
+  return results
+
+
+def compare(results, baseline, threshold, min_time):
+  """Prints the checks slower or bigger than their baseline, and returns
+  whether there are any."""
+  regressions = []
+  for check, profile in sorted(results.items()):
+    old = baseline.get(check)
+    if old is None:
+      continue
+    # The fastest checks are dominated by the noise of the measure.
+    if (profile['wall'] - old['wall'] > min_time and
+        profile['wall'] > old['wall'] * threshold):
+      regressions.append((profile['wall'] / max(old['wall'], 1e-9), check,
+                          'time', old['wall'], profile['wall']))
+    if (old['mem'] > 0 and profile['mem'] > old['mem'] * threshold):
+      regressions.append((float(profile['mem']) / old['mem'], check, 'memory',
+                          old['mem'], profile['mem']))
+
+  new_checks = sorted(set(results) - set(baseline))
+  if new_checks:
+    print('\nChecks without baseline: ' + ', '.join(new_checks))
+  if not regressions:
+    print('\nNo check regressed by more than %.2fx.' % threshold)
+    return False
+  print('\nChecks regressed by more than %.2fx:' % threshold)
+  for ratio, check, kind, old, new in sorted(regressions, reverse=True):
+    print('  %-60s %-6s %12.4f -> %12.4f (%.2fx)' %
+          (check, kind, old, new, ratio))
+  return True
+
+
+def main():
+  parser = argparse.ArgumentParser(description='Runs each clang-tidy check in '
+                                   'isolation over a corpus, and compares its '
+                                   'time and memory with a baseline.')
+  parser.add_argument('-clang-tidy-binary', metavar='PATH',
+                      default='clang-tidy',
+                      help='path to clang-tidy binary')
+  parser.add_argument('-checks', default='*,-clang-analyzer-*',
+                      help='filter of the checks to benchmark, each one is '
+                      'run alone')
+  parser.add_argument('-p', dest='build_path',
+                      help='path used to read a compile command database, '
+                      'when the corpus files are part of a project')
+  parser.add_argument('-extra-arg', dest='extra_arg', action='append',
+                      default=[],
+                      help='additional argument to append to the compiler '
+                      'command line')
+  parser.add_argument('-scale', type=int, default=1,
+                      help='size factor of the generated corpus')
+  parser.add_argument('-keep-corpus', metavar='DIR',
+                      help='write the generated corpus in DIR and keep it')
+  parser.add_argument('-repeat', type=int, default=1,
+                      help='number of runs of each check, the fastest is '
+                      'kept')
+  parser.add_argument('-track-memory', action='store_true',
+                      help='record the memory allocated by each check')
+  parser.add_argument('-output', metavar='FILE',
+                      help='store the results in FILE, which can be used as '
+                      'a baseline')
+  parser.add_argument('-baseline', metavar='FILE',
+                      help='compare the results with the ones stored in '
+                      'FILE, and fail if a check regressed')
+  parser.add_argument('-threshold', type=float, default=1.5,
+                      help='ratio to the baseline above which a check '
+                      'regressed')
+  parser.add_argument('-min-time', type=float, default=0.05,
+                      help='increase of the wall time, in seconds, below '
+                      'which a check never regressed')
+  parser.add_argument('files', nargs='*',
+                      help='source files of the corpus, generated when '
+                      'empty')
+  args = parser.parse_args()
+
+  corpus_dir = None
+  files = args.files
+  if not files:
+    if args.keep_corpus:
+      corpus_dir = args.keep_corpus
+      if not os.path.isdir(corpus_dir):
+        os.makedirs(corpus_dir)
+    else:
+      corpus_dir = tempfile.mkdtemp(prefix='clang-tidy-benchmark-corpus-')
+    files = generate_corpus(corpus_dir, args.scale)
+
+  try:
+    checks = list_checks(args.clang_tidy_binary, args.checks)
+    if not checks:
+      print('No check matches the filter %s' % args.checks, file=sys.stderr)
+      return 1
+    results = benchmark(args, checks, files)
+  finally:
+    if corpus_dir and not args.keep_corpus:
+      shutil.rmtree(corpus_dir, ignore_errors=True)
+
+  if args.output:
+    with open(args.output, 'w') as out:
+      json.dump({'version': BASELINE_VERSION, 'checks': results}, out,
+                indent=2, sort_keys=True)
+
+  if args.baseline:
+    with open(args.baseline) as f:
+      baseline = json.load(f)
+    if baseline.get('version') != BASELINE_VERSION:
+      print('Unsupported baseline version in %s' % args.baseline,
+            file=sys.stderr)
+      return 1
+    if compare(results, baseline['checks'], args.threshold, args.min_time):
+      return 1
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
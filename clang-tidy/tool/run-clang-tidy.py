@@ -76,7 +76,7 @@ def make_absolute(f, directory):
 
 def get_tidy_invocation(f, clang_tidy_binary, checks, tmpdir, build_path,
                         header_filter, extra_arg, extra_arg_before, quiet,
-                        config):
+                        config, config_cache):
   """Gets a command line for clang-tidy."""
   start = [clang_tidy_binary]
   if header_filter is not None:
@@ -102,6 +102,8 @@ def get_tidy_invocation(f, clang_tidy_binary, checks, tmpdir, build_path,
       start.append('-quiet')
   if config:
       start.append('-config=' + config)
+  elif config_cache:
+      start.append('-config-cache=' + config_cache)
   start.append(f)
   return start
 
@@ -160,7 +162,8 @@ def run_tidy(args, tmpdir, build_path, queue, lock, failed_files):
     invocation = get_tidy_invocation(name, args.clang_tidy_binary, args.checks,
                                      tmpdir, build_path, args.header_filter,
                                      args.extra_arg, args.extra_arg_before,
-                                     args.quiet, args.config)
+                                     args.quiet, args.config,
+                                     args.config_cache)
 
     proc = subprocess.Popen(invocation, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
     output, err = proc.communicate()
@@ -224,6 +227,12 @@ def main():
                       'command line.')
   parser.add_argument('-quiet', action='store_true',
                       help='Run clang-tidy in quiet mode')
+  parser.add_argument('-config-cache', metavar='directory',
+                      dest='config_cache',
+                      help='Directory in which the clang-tidy instances '
+                      'store the configuration of each directory. By '
+                      'default, the instances of the run share a temporary '
+                      'one.')
   args = parser.parse_args()
 
   db_path = 'compile_commands.json'
@@ -259,6 +268,12 @@ def main():
     check_clang_apply_replacements_binary(args)
     tmpdir = tempfile.mkdtemp()
 
+  # Spare each clang-tidy instance the search of the configuration files.
+  config_cache_tmpdir = None
+  if not args.config_cache:
+    config_cache_tmpdir = tempfile.mkdtemp()
+    args.config_cache = config_cache_tmpdir
+
   # Build up a big regexy filter from all command line arguments.
   file_name_re = re.compile('|'.join(args.files))
 
@@ -291,6 +306,8 @@ def main():
     print('\nCtrl-C detected, goodbye.')
     if tmpdir:
       shutil.rmtree(tmpdir)
+    if config_cache_tmpdir:
+      shutil.rmtree(config_cache_tmpdir)
     os.kill(0, 9)
 
   if args.export_fixes:
@@ -313,6 +330,8 @@ def main():
 
   if tmpdir:
     shutil.rmtree(tmpdir)
+  if config_cache_tmpdir:
+    shutil.rmtree(config_cache_tmpdir)
   sys.exit(return_code)
 
 if __name__ == '__main__':
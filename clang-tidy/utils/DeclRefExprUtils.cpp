@@ -38,13 +38,86 @@ void extractNodesByIdTo(ArrayRef<BoundNodes> Matches, StringRef ID,
     Nodes.insert(Match.getNodeAs<Node>(ID));
 }
 
+// Matches the DeclRefExprs to any variable, bound to "declRef", and those
+// where a const method is called on the variable or the variable is a const
+// reference or value argument to a CallExpr or CXXConstructExpr, bound to
+// "constRef". See constReferenceDeclRefExprs().
+StatementMatcher declRefExprUses() {
+  auto ConstRef = declRefExpr(to(varDecl())).bind("constRef");
+  auto ConstMethodCallee = callee(cxxMethodDecl(isConst()));
+  auto ConstReferenceOrValue =
+      qualType(anyOf(referenceType(pointee(qualType(isConstQualified()))),
+                     unless(anyOf(referenceType(), pointerType()))));
+  auto UsedAsConstRefOrValueArg = forEachArgumentWithParam(
+      ConstRef, parmVarDecl(hasType(ConstReferenceOrValue)));
+  return expr(eachOf(
+      declRefExpr(to(varDecl())).bind("declRef"),
+      cxxMemberCallExpr(ConstMethodCallee, on(ConstRef)),
+      cxxOperatorCallExpr(ConstMethodCallee, hasArgument(0, ConstRef)),
+      callExpr(UsedAsConstRefOrValueArg),
+      cxxConstructExpr(UsedAsConstRefOrValueArg)));
+}
+
 } // namespace
 
+DeclRefExprIndex::DeclRefExprIndex(const Stmt &Stmt, ASTContext &Context) {
+  add(match(findAll(declRefExprUses()), Stmt, Context));
+}
+
+DeclRefExprIndex::DeclRefExprIndex(const Decl &Decl, ASTContext &Context) {
+  add(match(decl(forEachDescendant(declRefExprUses())), Decl, Context));
+}
+
+void DeclRefExprIndex::add(ArrayRef<BoundNodes> Matches) {
+  for (const auto &Match : Matches) {
+    if (const auto *Ref = Match.getNodeAs<DeclRefExpr>("declRef"))
+      Vars[cast<VarDecl>(Ref->getDecl())].All.insert(Ref);
+    if (const auto *Ref = Match.getNodeAs<DeclRefExpr>("constRef"))
+      Vars[cast<VarDecl>(Ref->getDecl())].Const.insert(Ref);
+  }
+}
+
+const DeclRefExprIndex::Uses &
+DeclRefExprIndex::getUses(const VarDecl &VarDecl) const {
+  auto It = Vars.find(&VarDecl);
+  return It == Vars.end() ? NoUses : It->second;
+}
+
+const SmallPtrSet<const DeclRefExpr *, 16> &
+DeclRefExprIndex::allDeclRefExprs(const VarDecl &VarDecl) const {
+  return getUses(VarDecl).All;
+}
+
+const SmallPtrSet<const DeclRefExpr *, 16> &
+DeclRefExprIndex::constReferenceDeclRefExprs(const VarDecl &VarDecl) const {
+  return getUses(VarDecl).Const;
+}
+
+char DeclRefExprIndexCache::ID;
+
+const DeclRefExprIndex &DeclRefExprIndexCache::get(const Stmt &Stmt,
+                                                   ASTContext &Context) {
+  std::unique_ptr<DeclRefExprIndex> &Index = Indexes[&Stmt];
+  if (!Index)
+    Index = llvm::make_unique<DeclRefExprIndex>(Stmt, Context);
+  return *Index;
+}
+
+const DeclRefExprIndex &DeclRefExprIndexCache::get(const Decl &Decl,
+                                                   ASTContext &Context) {
+  std::unique_ptr<DeclRefExprIndex> &Index = Indexes[&Decl];
+  if (!Index)
+    Index = llvm::make_unique<DeclRefExprIndex>(Decl, Context);
+  return *Index;
+}
+
 // Finds all DeclRefExprs where a const method is called on VarDecl or VarDecl
 // is the a const reference or value argument to a CallExpr or CXXConstructExpr.
 SmallPtrSet<const DeclRefExpr *, 16>
 constReferenceDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt,
-                           ASTContext &Context) {
+                           ASTContext &Context, DeclRefExprIndexCache *Index) {
+  if (Index)
+    return Index->get(Stmt, Context).constReferenceDeclRefExprs(VarDecl);
   auto DeclRefToVar =
       declRefExpr(to(varDecl(equalsNode(&VarDecl)))).bind("declRef");
   auto ConstMethodCallee = callee(cxxMethodDecl(isConst()));
@@ -75,7 +148,9 @@ constReferenceDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt,
 // is the a const reference or value argument to a CallExpr or CXXConstructExpr.
 SmallPtrSet<const DeclRefExpr *, 16>
 constReferenceDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl,
-                           ASTContext &Context) {
+                           ASTContext &Context, DeclRefExprIndexCache *Index) {
+  if (Index)
+    return Index->get(Decl, Context).constReferenceDeclRefExprs(VarDecl);
   auto DeclRefToVar =
       declRefExpr(to(varDecl(equalsNode(&VarDecl)))).bind("declRef");
   auto ConstMethodCallee = callee(cxxMethodDecl(isConst()));
@@ -106,19 +181,27 @@ constReferenceDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl,
 }
 
 bool isOnlyUsedAsConst(const VarDecl &Var, const Stmt &Stmt,
-                       ASTContext &Context) {
+                       ASTContext &Context, DeclRefExprIndexCache *Index) {
   // Collect all DeclRefExprs to the loop variable and all CallExprs and
   // CXXConstructExprs where the loop variable is used as argument to a const
   // reference parameter.
   // If the difference is empty it is safe for the loop variable to be a const
   // reference.
+  if (Index) {
+    const DeclRefExprIndex &StmtIndex = Index->get(Stmt, Context);
+    return isSetDifferenceEmpty(StmtIndex.allDeclRefExprs(Var),
+                                StmtIndex.constReferenceDeclRefExprs(Var));
+  }
   auto AllDeclRefs = allDeclRefExprs(Var, Stmt, Context);
   auto ConstReferenceDeclRefs = constReferenceDeclRefExprs(Var, Stmt, Context);
   return isSetDifferenceEmpty(AllDeclRefs, ConstReferenceDeclRefs);
 }
 
 SmallPtrSet<const DeclRefExpr *, 16>
-allDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt, ASTContext &Context) {
+allDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt, ASTContext &Context,
+                DeclRefExprIndexCache *Index) {
+  if (Index)
+    return Index->get(Stmt, Context).allDeclRefExprs(VarDecl);
   auto Matches = match(
       findAll(declRefExpr(to(varDecl(equalsNode(&VarDecl)))).bind("declRef")),
       Stmt, Context);
@@ -128,7 +211,10 @@ allDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt, ASTContext &Context) {
 }
 
 SmallPtrSet<const DeclRefExpr *, 16>
-allDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl, ASTContext &Context) {
+allDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl, ASTContext &Context,
+                DeclRefExprIndexCache *Index) {
+  if (Index)
+    return Index->get(Decl, Context).allDeclRefExprs(VarDecl);
   auto Matches = match(
       decl(forEachDescendant(
           declRefExpr(to(varDecl(equalsNode(&VarDecl)))).bind("declRef"))),
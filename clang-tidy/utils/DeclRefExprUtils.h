@@ -10,43 +10,102 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_DECLREFEXPRUTILS_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_DECLREFEXPRUTILS_H
 
+#include "../ClangTidyDiagnosticConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Type.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
+#include <memory>
 
 namespace clang {
 namespace tidy {
 namespace utils {
 namespace decl_ref_expr {
 
+/// \brief The ``DeclRefExprs`` to each variable within a ``Stmt`` or a
+/// ``Decl``, and those where the variable is guaranteed to be accessed in a
+/// const fashion, collected with a single traversal.
+class DeclRefExprIndex {
+public:
+  DeclRefExprIndex(const Stmt &Stmt, ASTContext &Context);
+  DeclRefExprIndex(const Decl &Decl, ASTContext &Context);
+
+  /// Returns set of all ``DeclRefExprs`` to ``VarDecl``.
+  const llvm::SmallPtrSet<const DeclRefExpr *, 16> &
+  allDeclRefExprs(const VarDecl &VarDecl) const;
+
+  /// Returns set of all ``DeclRefExprs`` to ``VarDecl`` where ``VarDecl`` is
+  /// guaranteed to be accessed in a const fashion.
+  const llvm::SmallPtrSet<const DeclRefExpr *, 16> &
+  constReferenceDeclRefExprs(const VarDecl &VarDecl) const;
+
+private:
+  struct Uses {
+    llvm::SmallPtrSet<const DeclRefExpr *, 16> All;
+    llvm::SmallPtrSet<const DeclRefExpr *, 16> Const;
+  };
+
+  void add(ArrayRef<ast_matchers::BoundNodes> Matches);
+  const Uses &getUses(const VarDecl &VarDecl) const;
+
+  llvm::DenseMap<const VarDecl *, Uses> Vars;
+  Uses NoUses;
+};
+
+/// \brief Shares the ``DeclRefExprIndex`` of each ``Stmt`` or ``Decl``
+/// between the checks of a translation unit, so that the variables of a
+/// function are all indexed with one traversal of its body.
+class DeclRefExprIndexCache : public ClangTidyTranslationUnitCache {
+public:
+  static char ID;
+
+  /// Returns the index of ``Stmt``, building it on first use.
+  const DeclRefExprIndex &get(const Stmt &Stmt, ASTContext &Context);
+
+  /// Returns the index of ``Decl``, building it on first use.
+  const DeclRefExprIndex &get(const Decl &Decl, ASTContext &Context);
+
+private:
+  llvm::DenseMap<const void *, std::unique_ptr<DeclRefExprIndex>> Indexes;
+};
+
 /// \brief Returns true if all ``DeclRefExpr`` to the variable within ``Stmt``
 /// do not modify it.
 ///
 /// Returns ``true`` if only const methods or operators are called on the
 /// variable or the variable is a const reference or value argument to a
 /// ``callExpr()``.
+///
+/// With an ``Index``, the uses are looked up in the index of ``Stmt`` instead
+/// of being matched again. The same applies to the functions below.
 bool isOnlyUsedAsConst(const VarDecl &Var, const Stmt &Stmt,
-                       ASTContext &Context);
+                       ASTContext &Context,
+                       DeclRefExprIndexCache *Index = nullptr);
 
 /// Returns set of all ``DeclRefExprs`` to ``VarDecl`` within ``Stmt``.
 llvm::SmallPtrSet<const DeclRefExpr *, 16>
-allDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt, ASTContext &Context);
+allDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt, ASTContext &Context,
+                DeclRefExprIndexCache *Index = nullptr);
 
 /// Returns set of all ``DeclRefExprs`` to ``VarDecl`` within ``Decl``.
 llvm::SmallPtrSet<const DeclRefExpr *, 16>
-allDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl, ASTContext &Context);
+allDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl, ASTContext &Context,
+                DeclRefExprIndexCache *Index = nullptr);
 
 /// Returns set of all ``DeclRefExprs`` to ``VarDecl`` within ``Stmt`` where
 /// ``VarDecl`` is guaranteed to be accessed in a const fashion.
 llvm::SmallPtrSet<const DeclRefExpr *, 16>
 constReferenceDeclRefExprs(const VarDecl &VarDecl, const Stmt &Stmt,
-                           ASTContext &Context);
+                           ASTContext &Context,
+                           DeclRefExprIndexCache *Index = nullptr);
 
 /// Returns set of all ``DeclRefExprs`` to ``VarDecl`` within ``Decl`` where
 /// ``VarDecl`` is guaranteed to be accessed in a const fashion.
 llvm::SmallPtrSet<const DeclRefExpr *, 16>
 constReferenceDeclRefExprs(const VarDecl &VarDecl, const Decl &Decl,
-                           ASTContext &Context);
+                           ASTContext &Context,
+                           DeclRefExprIndexCache *Index = nullptr);
 
 /// Returns ``true`` if ``DeclRefExpr`` is the argument of a copy-constructor
 /// call expression within ``Decl``.
@@ -0,0 +1,45 @@
+//===--- FunctionAnalysisCache.cpp - clang-tidy ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FunctionAnalysisCache.h"
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+char FunctionAnalysisCache::ID;
+
+const FunctionAnalysis *FunctionAnalysisCache::get(const Stmt *Body,
+                                                   ASTContext *Context) {
+  auto Inserted = Analyses.try_emplace(Body);
+  std::unique_ptr<FunctionAnalysis> &Analysis = Inserted.first->second;
+  if (!Inserted.second)
+    return Analysis.get();
+
+  // The CFG is built directly instead of through an AnalysisDeclContext, which
+  // can't build the CFG of the body of a lambda.
+  CFG::BuildOptions Options;
+  Options.AddImplicitDtors = true;
+  Options.AddTemporaryDtors = true;
+  std::unique_ptr<CFG> TheCFG =
+      CFG::buildCFG(nullptr, const_cast<Stmt *>(Body), Context, Options);
+  if (!TheCFG)
+    return nullptr;
+
+  Analysis = llvm::make_unique<FunctionAnalysis>();
+  Analysis->Sequence =
+      llvm::make_unique<ExprSequence>(TheCFG.get(), Body, Context);
+  Analysis->BlockMap = llvm::make_unique<StmtToBlockMap>(TheCFG.get(), Context);
+  Analysis->TheCFG = std::move(TheCFG);
+  return Analysis.get();
+}
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
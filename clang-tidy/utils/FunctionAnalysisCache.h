@@ -0,0 +1,56 @@
+//===--- FunctionAnalysisCache.h - clang-tidy -------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_FUNCTIONANALYSISCACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_FUNCTIONANALYSISCACHE_H
+
+#include "../ClangTidyDiagnosticConsumer.h"
+#include "ExprSequence.h"
+#include "clang/Analysis/CFG.h"
+#include "llvm/ADT/DenseMap.h"
+#include <memory>
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+/// The control flow analyses of a function body.
+struct FunctionAnalysis {
+  std::unique_ptr<CFG> TheCFG;
+  std::unique_ptr<ExprSequence> Sequence;
+  std::unique_ptr<StmtToBlockMap> BlockMap;
+};
+
+/// Shares the control flow analyses of the function bodies between the checks
+/// of a translation unit, so that each body is analyzed once however many
+/// checks and matches need it. Get it with
+/// `ClangTidyCheck::getTranslationUnitCache<FunctionAnalysisCache>()`.
+///
+/// The CFGs are built with the implicit and temporary destructors, so that
+/// destructors marked [[noreturn]] end the control flow. Checks needing other
+/// CFG build options build their own CFG.
+class FunctionAnalysisCache : public ClangTidyTranslationUnitCache {
+public:
+  static char ID;
+
+  /// Returns the analyses of \p Body, the body of a function, method or
+  /// lambda, building them on first use. Returns nullptr if no CFG can be
+  /// built for \p Body.
+  const FunctionAnalysis *get(const Stmt *Body, ASTContext *Context);
+
+private:
+  // Null if the CFG can't be built.
+  llvm::DenseMap<const Stmt *, std::unique_ptr<FunctionAnalysis>> Analyses;
+};
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_FUNCTIONANALYSISCACHE_H
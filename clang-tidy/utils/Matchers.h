@@ -10,8 +10,11 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_MATCHERS_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_MATCHERS_H
 
+#include "NameLookupTable.h"
+#include "NameSetCache.h"
 #include "TypeTraits.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
+#include <memory>
 
 namespace clang {
 namespace tidy {
@@ -31,9 +34,12 @@ AST_MATCHER(BinaryOperator, isComparisonOperator) {
   return Node.isComparisonOp();
 }
 
-AST_MATCHER(QualType, isExpensiveToCopy) {
-  llvm::Optional<bool> IsExpensive =
-      utils::type_traits::isExpensiveToCopy(Node, Finder->getASTContext());
+// Matches the types expensive to copy. With a `Cache`, the checks of a
+// translation unit compute the trait once per type.
+AST_MATCHER_P(QualType, isExpensiveToCopy,
+              utils::type_traits::TypeTraitsCache *, Cache) {
+  llvm::Optional<bool> IsExpensive = utils::type_traits::isExpensiveToCopy(
+      Node, Finder->getASTContext(), Cache);
   return IsExpensive && *IsExpensive;
 }
 
@@ -55,6 +61,29 @@ AST_MATCHER_P(NamedDecl, matchesAnyListedName, std::vector<std::string>,
     });
 }
 
+// Matches the declarations having one of the names of a shared set, like
+// `hasAnyName`, but matching each declaration once for all the checks of a
+// translation unit.
+AST_MATCHER_P(NamedDecl, hasAnyNameInSet, utils::NameSetCache::NameSet *,
+              Set) {
+  return Set->matches(Node);
+}
+
+// Matches the declarations having one of the names of a table, like
+// `hasAnyName`, for long configurable lists of names. Create the table in
+// `registerMatchers`, e.g.
+// `hasAnyNameInTable(std::make_shared<utils::NameLookupTable>(Names))`.
+AST_MATCHER_P(NamedDecl, hasAnyNameInTable,
+              std::shared_ptr<utils::NameLookupTable>, Table) {
+  return Table->matches(Node);
+}
+
+// Returns a matcher of the declarations having one of `Names`.
+inline ast_matchers::internal::Matcher<NamedDecl>
+hasAnyListedName(llvm::ArrayRef<std::string> Names) {
+  return hasAnyNameInTable(std::make_shared<utils::NameLookupTable>(Names));
+}
+
 } // namespace matchers
 } // namespace tidy
 } // namespace clang
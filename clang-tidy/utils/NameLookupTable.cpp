@@ -0,0 +1,102 @@
+//===--- NameLookupTable.cpp - clang-tidy ---------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "NameLookupTable.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/Basic/CharInfo.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+namespace {
+
+bool isIdentifier(StringRef Name) {
+  return !Name.empty() && isValidIdentifier(Name) &&
+         !Name.startswith("operator");
+}
+
+/// Returns whether the enclosing context \p Context may be skipped by a
+/// qualified name, like `hasName` does.
+bool isTransparent(const DeclContext &Context) {
+  if (const auto *Namespace = dyn_cast<NamespaceDecl>(&Context))
+    return Namespace->isInlineNamespace();
+  return Context.isTransparentContext() || isa<LinkageSpecDecl>(Context);
+}
+
+} // namespace
+
+NameLookupTable::NameLookupTable(llvm::ArrayRef<std::string> Names) {
+  std::vector<std::string> Others;
+  for (const std::string &Name : Names) {
+    StringRef Rest = Name;
+    const bool FullyQualified = Rest.consume_front("::");
+    SmallVector<StringRef, 4> Components;
+    Rest.split(Components, "::");
+    if (!llvm::all_of(Components, isIdentifier)) {
+      Others.push_back(Name);
+      continue;
+    }
+    QualifiedName Entry;
+    Entry.FullyQualified = FullyQualified;
+    for (auto I = Components.rbegin() + 1, E = Components.rend(); I != E; ++I)
+      Entry.Qualifiers.push_back(*I);
+    NamesByIdentifier[Components.back()].push_back(std::move(Entry));
+  }
+  if (!Others.empty())
+    OtherNames.emplace(std::move(Others));
+}
+
+bool NameLookupTable::matchesQualifiers(const NamedDecl &Node,
+                                        const QualifiedName &Name) {
+  const DeclContext *Context = Node.getDeclContext();
+  for (const std::string &Qualifier : Name.Qualifiers) {
+    // Skip the inline namespaces and the linkage specifications, unless the
+    // qualifier names the inline namespace.
+    while (Context && !Context->isTranslationUnit()) {
+      const auto *Named = dyn_cast<NamedDecl>(Context);
+      if (Named && Named->getIdentifier() && Named->getName() == Qualifier)
+        break;
+      if (!isTransparent(*Context))
+        return false;
+      Context = Context->getParent();
+    }
+    if (!Context || Context->isTranslationUnit())
+      return false;
+    Context = Context->getParent();
+  }
+  if (!Name.FullyQualified)
+    return true;
+  for (; Context && !Context->isTranslationUnit();
+       Context = Context->getParent())
+    if (!isTransparent(*Context))
+      return false;
+  return true;
+}
+
+bool NameLookupTable::matches(const NamedDecl &Node) {
+  if (const IdentifierInfo *Identifier = Node.getIdentifier()) {
+    auto Inserted = NamesByIdentifierInfo.try_emplace(Identifier, nullptr);
+    if (Inserted.second) {
+      auto Iter = NamesByIdentifier.find(Identifier->getName());
+      if (Iter != NamesByIdentifier.end())
+        Inserted.first->second = &Iter->second;
+    }
+    if (const QualifiedNames *Candidates = Inserted.first->second)
+      for (const QualifiedName &Name : *Candidates)
+        if (matchesQualifiers(Node, Name))
+          return true;
+  }
+  return OtherNames && OtherNames->matchesNode(Node);
+}
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
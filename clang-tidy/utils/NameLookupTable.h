@@ -0,0 +1,67 @@
+//===--- NameLookupTable.h - clang-tidy -------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_NAMELOOKUPTABLE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_NAMELOOKUPTABLE_H
+
+#include "clang/AST/Decl.h"
+#include "clang/ASTMatchers/ASTMatchersInternal.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+/// \brief A list of names, spelled like the ones of `hasAnyName`, compiled
+/// for a fast lookup of the declarations.
+///
+/// The names are hashed on their last component. A declaration is looked up
+/// by its `IdentifierInfo`, once per identifier, and only the names with the
+/// same identifier have their qualifiers compared to the enclosing contexts
+/// of the declaration. Checks configured with hundreds of names thus cost a
+/// pointer lookup for most of the declarations they see.
+///
+/// The names whose last component isn't an identifier, e.g. operators or
+/// template specializations, are matched with `hasAnyName`.
+///
+/// The identifiers are those of a single translation unit: create the table
+/// in `registerMatchers`, which runs for each translation unit.
+class NameLookupTable {
+public:
+  explicit NameLookupTable(llvm::ArrayRef<std::string> Names);
+
+  /// \brief Returns whether \p Node has one of the names of the table.
+  bool matches(const NamedDecl &Node);
+
+private:
+  /// A name of the table: its qualifiers, innermost first.
+  struct QualifiedName {
+    std::vector<std::string> Qualifiers;
+    bool FullyQualified;
+  };
+  using QualifiedNames = std::vector<QualifiedName>;
+
+  static bool matchesQualifiers(const NamedDecl &Node,
+                                const QualifiedName &Name);
+
+  llvm::StringMap<QualifiedNames> NamesByIdentifier;
+  llvm::DenseMap<const IdentifierInfo *, const QualifiedNames *>
+      NamesByIdentifierInfo;
+  llvm::Optional<ast_matchers::internal::HasNameMatcher> OtherNames;
+};
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_NAMELOOKUPTABLE_H
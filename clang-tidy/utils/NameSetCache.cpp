@@ -0,0 +1,39 @@
+//===--- NameSetCache.cpp - clang-tidy ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "NameSetCache.h"
+#include <algorithm>
+#include <cassert>
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+char NameSetCache::ID;
+
+bool NameSetCache::NameSet::matches(const NamedDecl &Node) {
+  auto Inserted = Results.try_emplace(&Node, false);
+  if (Inserted.second)
+    Inserted.first->second = Matcher.matchesNode(Node);
+  return Inserted.first->second;
+}
+
+NameSetCache::NameSet *NameSetCache::get(std::vector<std::string> Names) {
+  assert(!Names.empty() && "a name set needs names");
+  std::sort(Names.begin(), Names.end());
+  Names.erase(std::unique(Names.begin(), Names.end()), Names.end());
+  std::unique_ptr<NameSet> &Set = Sets[Names];
+  if (!Set)
+    Set = llvm::make_unique<NameSet>(Names);
+  return Set.get();
+}
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
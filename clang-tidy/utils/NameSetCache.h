@@ -0,0 +1,61 @@
+//===--- NameSetCache.h - clang-tidy ----------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_NAMESETCACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_NAMESETCACHE_H
+
+#include "../ClangTidyDiagnosticConsumer.h"
+#include "clang/ASTMatchers/ASTMatchersInternal.h"
+#include "llvm/ADT/DenseMap.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+/// Shares the name lookups of the checks of a translation unit: the checks
+/// looking for the same set of names, e.g. `::std::move` or the standard
+/// containers, get the same `NameSet`, which matches each declaration once.
+/// Get it with `ClangTidyCheck::getTranslationUnitCache<NameSetCache>()`, and
+/// match the set with `matchers::hasAnyNameInSet`.
+class NameSetCache : public ClangTidyTranslationUnitCache {
+public:
+  static char ID;
+
+  /// A set of names, matched like `hasAnyName`, and the declarations found
+  /// to have one of them or not.
+  class NameSet {
+  public:
+    explicit NameSet(std::vector<std::string> Names)
+        : Matcher(std::move(Names)) {}
+
+    /// Returns whether \p Node has one of the names of the set.
+    bool matches(const NamedDecl &Node);
+
+  private:
+    ast_matchers::internal::HasNameMatcher Matcher;
+    llvm::DenseMap<const NamedDecl *, bool> Results;
+  };
+
+  /// Returns the set of \p Names, in any order, creating it on first use.
+  /// \p Names can't be empty.
+  NameSet *get(std::vector<std::string> Names);
+
+private:
+  std::map<std::vector<std::string>, std::unique_ptr<NameSet>> Sets;
+};
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_NAMESETCACHE_H
@@ -39,8 +39,25 @@ bool hasDeletedCopyConstructor(QualType Type) {
 
 } // namespace
 
+char TypeTraitsCache::ID;
+
+llvm::Optional<bool>
+TypeTraitsCache::isExpensiveToCopy(QualType Type, const ASTContext &Context) {
+  void *Key = Context.getCanonicalType(Type).getAsOpaquePtr();
+  auto Iter = ExpensiveToCopy.find(Key);
+  if (Iter != ExpensiveToCopy.end())
+    return Iter->second;
+  llvm::Optional<bool> Result = type_traits::isExpensiveToCopy(Type, Context);
+  if (Result)
+    ExpensiveToCopy[Key] = *Result;
+  return Result;
+}
+
 llvm::Optional<bool> isExpensiveToCopy(QualType Type,
-                                       const ASTContext &Context) {
+                                       const ASTContext &Context,
+                                       TypeTraitsCache *Cache) {
+  if (Cache)
+    return Cache->isExpensiveToCopy(Type, Context);
   if (Type->isDependentType() || Type->isIncompleteType())
     return llvm::None;
   return !Type.isTriviallyCopyableType(Context) &&
@@ -10,17 +10,39 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_TYPETRAITS_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_UTILS_TYPETRAITS_H
 
+#include "../ClangTidyDiagnosticConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Type.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace clang {
 namespace tidy {
 namespace utils {
 namespace type_traits {
 
+/// Shares the type traits computed for each canonical type between the checks
+/// and the matchers of a translation unit. Get it with
+/// `ClangTidyCheck::getTranslationUnitCache<TypeTraitsCache>()`.
+class TypeTraitsCache : public ClangTidyTranslationUnitCache {
+public:
+  static char ID;
+
+  /// Returns `isExpensiveToCopy(Type, Context)`, computing it on first use.
+  llvm::Optional<bool> isExpensiveToCopy(QualType Type,
+                                         const ASTContext &Context);
+
+private:
+  // Only the complete types are cached: an incomplete type may be completed
+  // later in the translation unit.
+  llvm::DenseMap<void *, bool> ExpensiveToCopy;
+};
+
 /// Returns `true` if `Type` is expensive to copy.
+///
+/// With a `Cache`, the result is computed once per canonical type.
 llvm::Optional<bool> isExpensiveToCopy(QualType Type,
-                                       const ASTContext &Context);
+                                       const ASTContext &Context,
+                                       TypeTraitsCache *Cache = nullptr);
 
 /// Returns `true` if `Type` is trivially default constructible.
 bool isTriviallyDefaultConstructible(QualType Type, const ASTContext &Context);
@@ -0,0 +1,442 @@
+//===--- BinaryTracer.cpp - Compact, low-overhead trace recording ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Each thread appends fixed-size records to its own ring buffer, without
+// locking. A background thread drains the buffers to the output periodically.
+// Event names are interned: the first time a thread sees a name it takes a
+// lock to assign it an ID, afterwards it finds the ID in its own cache.
+//
+// A binary trace is the magic "CLANGDTR", followed by a sequence of entries.
+// An entry is a 32-bit tag followed by its fields, all little endian:
+//  - 'N' name:    u32 ID, u32 size, the name;
+//  - 'T' thread:  u64 thread ID, u32 name ID, or ~0 if the thread is unnamed;
+//  - 'E' event:   u64 start and u64 duration in ns since the trace started
+//                 (duration is ~0 for instant events), u32 name ID,
+//                 u64 thread ID;
+//  - 'D' dropped: u64 thread ID, u64 number of events dropped because the
+//                 thread's buffer was full.
+// Entries may refer to names defined later in the trace.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Context.h"
+#include "Trace.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Threading.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace trace {
+namespace {
+
+constexpr char Magic[] = "CLANGDTR";
+constexpr uint32_t NameTag = 'N', ThreadTag = 'T', EventTag = 'E',
+                   DroppedTag = 'D';
+constexpr uint64_t InstantDuration = ~uint64_t(0);
+constexpr uint32_t NoName = ~uint32_t(0);
+
+struct Record {
+  uint64_t Start;
+  uint64_t Duration;
+  uint32_t Name;
+  uint64_t Thread;
+};
+
+// A single-producer, single-consumer queue of records.
+class ThreadBuffer {
+public:
+  static constexpr uint64_t Capacity = 4096;
+
+  // Called by the owning thread only.
+  void push(const Record &R) {
+    uint64_t H = Head.load(std::memory_order_relaxed);
+    if (H - Tail.load(std::memory_order_acquire) == Capacity) {
+      Dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Records[H % Capacity] = R;
+    Head.store(H + 1, std::memory_order_release);
+  }
+
+  // Called by the flusher only.
+  template <typename Fn> void drain(Fn F) {
+    uint64_t T = Tail.load(std::memory_order_relaxed);
+    uint64_t H = Head.load(std::memory_order_acquire);
+    for (; T != H; ++T)
+      F(Records[T % Capacity]);
+    Tail.store(T, std::memory_order_release);
+  }
+  uint64_t takeDropped() {
+    return Dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+  // Owned by the thread using the buffer.
+  uint64_t ThreadID = 0;
+  StringMap<uint32_t> Names;
+
+private:
+  std::atomic<uint64_t> Head = {0};
+  std::atomic<uint64_t> Tail = {0};
+  std::atomic<uint64_t> Dropped = {0};
+  Record Records[Capacity];
+};
+
+// State shared by the tracer and the threads using its buffers, which may
+// outlive it.
+struct Registry {
+  std::mutex Mu;
+  std::vector<std::unique_ptr<ThreadBuffer>> Buffers /*GUARDED_BY(Mu)*/;
+  // Buffers of threads that exited, available to new threads.
+  std::vector<ThreadBuffer *> FreeBuffers /*GUARDED_BY(Mu)*/;
+  StringMap<uint32_t> NameIDs /*GUARDED_BY(Mu)*/;
+  // Entries not written yet.
+  std::vector<std::pair<uint32_t, std::string>> NewNames /*GUARDED_BY(Mu)*/;
+  std::vector<std::pair<uint64_t, uint32_t>> NewThreads /*GUARDED_BY(Mu)*/;
+
+  uint32_t intern(StringRef Name) /*REQUIRES(Mu)*/ {
+    auto R = NameIDs.try_emplace(Name, NameIDs.size());
+    if (R.second)
+      NewNames.emplace_back(R.first->second, Name);
+    return R.first->second;
+  }
+};
+
+// The buffer of the current thread for the active tracer.
+struct ThreadState {
+  uint64_t TracerID = 0;
+  std::shared_ptr<Registry> Owner;
+  ThreadBuffer *Buffer = nullptr;
+
+  ~ThreadState() { release(); }
+
+  void release() {
+    if (!Owner)
+      return;
+    std::lock_guard<std::mutex> Lock(Owner->Mu);
+    Buffer->Names.clear();
+    Owner->FreeBuffers.push_back(Buffer);
+    Owner.reset();
+    Buffer = nullptr;
+  }
+};
+
+class BinaryTracer : public EventTracer {
+public:
+  BinaryTracer(raw_ostream &Out, std::chrono::milliseconds FlushInterval)
+      : Out(Out), FlushInterval(FlushInterval),
+        Reg(std::make_shared<Registry>()), ID(nextTracerID()),
+        Start(std::chrono::steady_clock::now()) {
+    Out.write(Magic, sizeof(Magic) - 1);
+    Flusher = std::thread([this] {
+      std::unique_lock<std::mutex> Lock(FlusherMu);
+      while (!Stopping) {
+        FlusherCV.wait_for(Lock, this->FlushInterval);
+        flush();
+      }
+    });
+  }
+
+  ~BinaryTracer() {
+    {
+      std::lock_guard<std::mutex> Lock(FlusherMu);
+      Stopping = true;
+    }
+    FlusherCV.notify_one();
+    Flusher.join();
+    flush();
+  }
+
+  Context beginSpan(StringRef Name, json::Object *Args) override {
+    ThreadBuffer &B = buffer();
+    return Context::current().derive(SpanKey,
+                                     SpanStart{nameID(B, Name), timestamp()});
+  }
+
+  void endSpan() override {
+    const SpanStart &S = Context::current().getExisting(SpanKey);
+    ThreadBuffer &B = buffer();
+    B.push({S.Time, timestamp() - S.Time, S.Name, B.ThreadID});
+  }
+
+  void instant(StringRef Name, json::Object &&Args) override {
+    ThreadBuffer &B = buffer();
+    B.push({timestamp(), InstantDuration, nameID(B, Name), B.ThreadID});
+  }
+
+private:
+  struct SpanStart {
+    uint32_t Name;
+    uint64_t Time;
+  };
+  static Key<SpanStart> SpanKey;
+
+  static uint64_t nextTracerID() {
+    static std::atomic<uint64_t> Next = {1};
+    return Next++;
+  }
+
+  uint64_t timestamp() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - Start)
+        .count();
+  }
+
+  // Returns the buffer of the current thread, acquiring one if needed.
+  ThreadBuffer &buffer() {
+    static thread_local ThreadState State;
+    if (State.TracerID == ID)
+      return *State.Buffer;
+    State.release();
+    std::lock_guard<std::mutex> Lock(Reg->Mu);
+    if (Reg->FreeBuffers.empty()) {
+      Reg->Buffers.push_back(llvm::make_unique<ThreadBuffer>());
+      Reg->FreeBuffers.push_back(Reg->Buffers.back().get());
+    }
+    State.Buffer = Reg->FreeBuffers.back();
+    Reg->FreeBuffers.pop_back();
+    State.Owner = Reg;
+    State.TracerID = ID;
+    State.Buffer->ThreadID = get_threadid();
+    SmallString<32> ThreadName;
+    get_thread_name(ThreadName);
+    Reg->NewThreads.emplace_back(State.Buffer->ThreadID,
+                                 ThreadName.empty() ? NoName
+                                                    : Reg->intern(ThreadName));
+    return *State.Buffer;
+  }
+
+  uint32_t nameID(ThreadBuffer &B, StringRef Name) {
+    auto It = B.Names.find(Name);
+    if (It != B.Names.end())
+      return It->second;
+    uint32_t NameID;
+    {
+      std::lock_guard<std::mutex> Lock(Reg->Mu);
+      NameID = Reg->intern(Name);
+    }
+    B.Names[Name] = NameID;
+    return NameID;
+  }
+
+  // Writes everything recorded so far. Called by the flusher, or after it
+  // stopped.
+  void flush() {
+    std::vector<std::pair<uint32_t, std::string>> Names;
+    std::vector<std::pair<uint64_t, uint32_t>> Threads;
+    std::vector<ThreadBuffer *> Buffers;
+    {
+      std::lock_guard<std::mutex> Lock(Reg->Mu);
+      Names = std::move(Reg->NewNames);
+      Reg->NewNames.clear();
+      Threads = std::move(Reg->NewThreads);
+      Reg->NewThreads.clear();
+      for (const auto &B : Reg->Buffers)
+        Buffers.push_back(B.get());
+    }
+    for (const auto &N : Names) {
+      write32(NameTag);
+      write32(N.first);
+      write32(N.second.size());
+      Out << N.second;
+    }
+    for (const auto &T : Threads) {
+      write32(ThreadTag);
+      write64(T.first);
+      write32(T.second);
+    }
+    for (ThreadBuffer *B : Buffers) {
+      B->drain([&](const Record &R) {
+        write32(EventTag);
+        write64(R.Start);
+        write64(R.Duration);
+        write32(R.Name);
+        write64(R.Thread);
+      });
+      if (uint64_t Dropped = B->takeDropped()) {
+        write32(DroppedTag);
+        write64(B->ThreadID);
+        write64(Dropped);
+      }
+    }
+    Out.flush();
+  }
+
+  void write32(uint32_t V) {
+    char Buf[sizeof(V)];
+    support::endian::write32le(Buf, V);
+    Out.write(Buf, sizeof(Buf));
+  }
+  void write64(uint64_t V) {
+    char Buf[sizeof(V)];
+    support::endian::write64le(Buf, V);
+    Out.write(Buf, sizeof(Buf));
+  }
+
+  raw_ostream &Out; // Written by the flusher only.
+  const std::chrono::milliseconds FlushInterval;
+  std::shared_ptr<Registry> Reg;
+  const uint64_t ID;
+  const std::chrono::steady_clock::time_point Start;
+
+  std::mutex FlusherMu;
+  std::condition_variable FlusherCV;
+  bool Stopping /*GUARDED_BY(FlusherMu)*/ = false;
+  std::thread Flusher;
+};
+
+Key<BinaryTracer::SpanStart> BinaryTracer::SpanKey;
+
+// Reads the fields of a binary trace.
+class Reader {
+public:
+  Reader(StringRef Data) : Data(Data) {}
+
+  bool eof() const { return Data.empty(); }
+  bool failed() const { return Failed; }
+
+  uint32_t read32() {
+    if (Data.size() < 4)
+      return fail();
+    uint32_t V = support::endian::read32le(Data.data());
+    Data = Data.drop_front(4);
+    return V;
+  }
+  uint64_t read64() {
+    if (Data.size() < 8)
+      return fail();
+    uint64_t V = support::endian::read64le(Data.data());
+    Data = Data.drop_front(8);
+    return V;
+  }
+  StringRef readString(size_t Size) {
+    if (Data.size() < Size) {
+      fail();
+      return "";
+    }
+    StringRef S = Data.take_front(Size);
+    Data = Data.drop_front(Size);
+    return S;
+  }
+
+private:
+  uint32_t fail() {
+    Failed = true;
+    Data = "";
+    return 0;
+  }
+
+  StringRef Data;
+  bool Failed = false;
+};
+
+} // namespace
+
+std::unique_ptr<EventTracer>
+createBinaryTracer(raw_ostream &OS, std::chrono::milliseconds FlushInterval) {
+  return llvm::make_unique<BinaryTracer>(OS, FlushInterval);
+}
+
+Error convertBinaryTrace(StringRef Data, raw_ostream &OS) {
+  auto Malformed = [](const Twine &Msg) {
+    return make_error<StringError>("Malformed binary trace: " + Msg,
+                                   inconvertibleErrorCode());
+  };
+  if (!Data.consume_front(StringRef(Magic, sizeof(Magic) - 1)))
+    return Malformed("bad magic");
+
+  // Names may be defined after their uses, collect them first.
+  DenseMap<uint32_t, StringRef> Names;
+  std::vector<json::Object> Events;
+  Reader R(Data);
+  while (!R.eof()) {
+    uint32_t Tag = R.read32();
+    if (Tag == NameTag) {
+      uint32_t ID = R.read32();
+      Names[ID] = R.readString(R.read32());
+    } else if (Tag == ThreadTag) {
+      uint64_t TID = R.read64();
+      uint32_t Name = R.read32();
+      if (Name != NoName)
+        Events.push_back(json::Object{{"ph", "M"},
+                                      {"tid", int64_t(TID)},
+                                      {"name", "thread_name"},
+                                      {"args", json::Object{{"name", Name}}}});
+    } else if (Tag == EventTag) {
+      uint64_t Start = R.read64();
+      uint64_t Duration = R.read64();
+      uint32_t Name = R.read32();
+      uint64_t TID = R.read64();
+      json::Object Event{{"name", Name},
+                         {"tid", int64_t(TID)},
+                         {"ts", Start / 1000.0}};
+      if (Duration == InstantDuration) {
+        Event["ph"] = "i";
+      } else {
+        Event["ph"] = "X";
+        Event["dur"] = Duration / 1000.0;
+      }
+      Events.push_back(std::move(Event));
+    } else if (Tag == DroppedTag) {
+      uint64_t TID = R.read64();
+      uint64_t Count = R.read64();
+      Events.push_back(json::Object{{"ph", "i"},
+                                    {"tid", int64_t(TID)},
+                                    {"name", "Dropped events"},
+                                    {"args", json::Object{{"count", Count}}}});
+    } else if (!R.failed()) {
+      return Malformed(formatv("unknown tag {0}", Tag));
+    }
+  }
+  if (R.failed())
+    return Malformed("truncated entry");
+
+  // Events store name IDs until now.
+  auto Resolve = [&](json::Value &V) -> Error {
+    auto ID = V.getAsInteger();
+    if (!ID)
+      return Error::success();
+    auto It = Names.find(*ID);
+    if (It == Names.end())
+      return Malformed(formatv("undefined name {0}", *ID));
+    V = It->second;
+    return Error::success();
+  };
+  OS << R"({"displayTimeUnit":"ns","traceEvents":[)" << "\n";
+  OS << json::Value(json::Object{{"ph", "M"},
+                                 {"pid", 0},
+                                 {"name", "process_name"},
+                                 {"args", json::Object{{"name", "clangd"}}}});
+  for (json::Object &Event : Events) {
+    if (auto *Args = Event.getObject("args"))
+      if (Event.getString("name") == Optional<StringRef>("thread_name"))
+        if (auto Err = Resolve((*Args)["name"]))
+          return Err;
+    if (auto Err = Resolve(Event["name"]))
+      return Err;
+    Event["pid"] = 0;
+    OS << ",\n" << json::Value(std::move(Event));
+  }
+  OS << "\n]}";
+  OS.flush();
+  return Error::success();
+}
+
+} // namespace trace
+} // namespace clangd
+} // namespace clang
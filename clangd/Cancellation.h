@@ -81,6 +81,31 @@ std::pair<Context, Canceler> cancelableTask();
 /// This isn't free (context lookup) - don't call it in a tight loop.
 bool isCancelled(const Context &Ctx = Context::current());
 
+/// Amortizes isCancelled() over the iterations of a hot loop: the context is
+/// only checked every Period calls, and a cancellation stays seen afterwards.
+///
+///   CancellationCheckpoint Checkpoint;
+///   for (const Item &I : Items) {
+///     if (Checkpoint.cancelled())
+///       break;
+///     process(I);
+///   }
+class CancellationCheckpoint {
+public:
+  explicit CancellationCheckpoint(unsigned Period = 1024) : Period(Period) {}
+
+  bool cancelled() {
+    if (!Cancelled && ++Calls % Period == 0)
+      Cancelled = isCancelled();
+    return Cancelled;
+  }
+
+private:
+  const unsigned Period;
+  unsigned Calls = 0;
+  bool Cancelled = false;
+};
+
 /// Conventional error when no result is returned due to cancellation.
 class CancelledError : public llvm::ErrorInfo<CancelledError> {
 public:
@@ -15,6 +15,7 @@
 #include "llvm/ADT/ScopeExit.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/ScopedPrinter.h"
 
@@ -265,6 +266,26 @@ void ClangdLSPServer::notify(StringRef Method, json::Value Params) {
   Transp.notify(Method, std::move(Params));
 }
 
+void ClangdLSPServer::showMessage(MessageType Type, StringRef Message) {
+  sendMessage("window/showMessage", Type, Message);
+}
+
+void ClangdLSPServer::logMessage(MessageType Type, StringRef Message) {
+  sendMessage("window/logMessage", Type, Message);
+}
+
+void ClangdLSPServer::sendMessage(StringRef Method, MessageType Type,
+                                  StringRef Message) {
+  ShowMessageParams Params;
+  Params.type = Type;
+  Params.message = Message;
+  std::lock_guard<std::mutex> Lock(MessagesMutex);
+  if (PendingMessages)
+    PendingMessages->emplace_back(Method.str(), std::move(Params));
+  else
+    notify(Method, Params);
+}
+
 void ClangdLSPServer::onInitialize(const InitializeParams &Params,
                                    Callback<json::Value> Reply) {
   if (Params.rootUri && *Params.rootUri)
@@ -328,6 +349,11 @@ void ClangdLSPServer::onInitialize(const InitializeParams &Params,
                  {"commands", {ExecuteCommandParams::CLANGD_APPLY_FIX_COMMAND}},
              }},
         }}}});
+
+  std::lock_guard<std::mutex> Lock(MessagesMutex);
+  for (const auto &Message : *PendingMessages)
+    notify(Message.first, Message.second);
+  PendingMessages.reset();
 }
 
 void ClangdLSPServer::onShutdown(const ShutdownParams &Params,
@@ -348,6 +374,17 @@ void ClangdLSPServer::onSync(const NoParams &Params,
                             "Not idle after a minute"));
 }
 
+// $/memoryUsage is a clangd extension: it replies with the estimated memory
+// used by each component, and records the same numbers in the trace.
+void ClangdLSPServer::onMemoryUsage(const NoParams &Params,
+                                    Callback<json::Value> Reply) {
+  MemoryTree Memory, Disk;
+  Server->profile(Memory, Disk);
+  DraftMgr.profile(Memory.child("drafts"));
+  record(Memory, "clangd");
+  Reply(json::Object{{"memory", toJSON(Memory)}, {"disk", toJSON(Disk)}});
+}
+
 void ClangdLSPServer::onDocumentDidOpen(
     const DidOpenTextDocumentParams &Params) {
   PathRef File = Params.textDocument.uri.file();
@@ -378,7 +415,7 @@ void ClangdLSPServer::onDocumentDidChange(
     return;
   }
 
-  Server->addDocument(File, *Contents, WantDiags);
+  Server->addDocument(File, std::move(*Contents), WantDiags);
 }
 
 void ClangdLSPServer::onFileEvent(const DidChangeWatchedFilesParams &Params) {
@@ -453,12 +490,34 @@ void ClangdLSPServer::onRename(const RenameParams &Params,
               return Reply(Replacements.takeError());
 
             // Turn the replacements into the format specified by the Language
-            // Server Protocol. Fuse them into one big JSON array.
-            std::vector<TextEdit> Edits;
-            for (const auto &R : *Replacements)
-              Edits.push_back(replacementToEdit(*Code, R));
+            // Server Protocol. Fuse those of each file into one big JSON
+            // array, in a single edit.
             WorkspaceEdit WE;
-            WE.changes = {{Params.textDocument.uri.uri(), Edits}};
+            WE.changes.emplace();
+            std::vector<TextEdit> &Edits =
+                (*WE.changes)[Params.textDocument.uri.uri()];
+            std::map<std::string, std::vector<tooling::Replacement>>
+                OtherFiles;
+            for (const auto &R : *Replacements) {
+              if (R.getFilePath() == File)
+                Edits.push_back(replacementToEdit(*Code, R));
+              else
+                OtherFiles[R.getFilePath()].push_back(R);
+            }
+            // The other files were renamed from their contents on disk.
+            for (const auto &FileAndReplacements : OtherFiles) {
+              auto Buffer = MemoryBuffer::getFile(FileAndReplacements.first);
+              if (!Buffer) {
+                elog("Could not read {0} to rename: {1}",
+                     FileAndReplacements.first, Buffer.getError().message());
+                continue;
+              }
+              std::vector<TextEdit> &FileEdits =
+                  (*WE.changes)[URIForFile(FileAndReplacements.first).uri()];
+              for (const auto &R : FileAndReplacements.second)
+                FileEdits.push_back(
+                    replacementToEdit((*Buffer)->getBuffer(), R));
+            }
             Reply(WE);
           },
           std::move(Reply)));
@@ -467,8 +526,16 @@ void ClangdLSPServer::onRename(const RenameParams &Params,
 void ClangdLSPServer::onDocumentDidClose(
     const DidCloseTextDocumentParams &Params) {
   PathRef File = Params.textDocument.uri.file();
-  DraftMgr.removeDraft(File);
+  // Stop the work on the file first: once removeDocument() returns, its
+  // diagnostics are no longer reported, so they can't be recorded again below.
   Server->removeDocument(File);
+  DraftMgr.removeDraft(File);
+  {
+    // The client may have dropped the diagnostics of the closed file, so
+    // publish them again if it's reopened.
+    std::lock_guard<std::mutex> Lock(FixItsMutex);
+    PublishedDiagnostics.erase(File);
+  }
 }
 
 void ClangdLSPServer::onDocumentOnTypeFormatting(
@@ -695,7 +762,7 @@ void ClangdLSPServer::onChangeConfiguration(
 void ClangdLSPServer::onReference(const ReferenceParams &Params,
                                   Callback<std::vector<Location>> Reply) {
   Server->findReferences(Params.textDocument.uri.file(), Params.position,
-                         std::move(Reply));
+                         ClangdServerOpts.ReferencesLimit, std::move(Reply));
 }
 
 ClangdLSPServer::ClangdLSPServer(class Transport &Transp,
@@ -713,6 +780,7 @@ ClangdLSPServer::ClangdLSPServer(class Transport &Transp,
   MsgHandler->bind("initialize", &ClangdLSPServer::onInitialize);
   MsgHandler->bind("shutdown", &ClangdLSPServer::onShutdown);
   MsgHandler->bind("sync", &ClangdLSPServer::onSync);
+  MsgHandler->bind("$/memoryUsage", &ClangdLSPServer::onMemoryUsage);
   MsgHandler->bind("textDocument/rangeFormatting", &ClangdLSPServer::onDocumentRangeFormatting);
   MsgHandler->bind("textDocument/onTypeFormatting", &ClangdLSPServer::onDocumentOnTypeFormatting);
   MsgHandler->bind("textDocument/formatting", &ClangdLSPServer::onDocumentFormatting);
@@ -780,18 +848,27 @@ void ClangdLSPServer::onDiagnosticsReady(PathRef File,
                });
   }
 
+  json::Value Published = std::move(LSPDiagnostics);
   // Cache FixIts
   {
     // FIXME(ibiryukov): should be deleted when documents are removed
     std::lock_guard<std::mutex> Lock(FixItsMutex);
     FixItsMap[File] = LocalFixIts;
+    // Most rebuilds, e.g. after edits to comments or function bodies, leave
+    // the diagnostics unchanged. Don't make the client render them again.
+    auto It = PublishedDiagnostics.find(File);
+    if (It != PublishedDiagnostics.end() && It->second == Published) {
+      vlog("Diagnostics for {0} are unchanged, not publishing", File);
+      return;
+    }
+    PublishedDiagnostics[File] = Published;
   }
 
   // Publish diagnostics.
   notify("textDocument/publishDiagnostics",
          json::Object{
              {"uri", URI},
-             {"diagnostics", std::move(LSPDiagnostics)},
+             {"diagnostics", std::move(Published)},
          });
 }
 
@@ -49,6 +49,14 @@ public:
   /// \return Whether we shut down cleanly with a 'shutdown' -> 'exit' sequence.
   bool run();
 
+  /// Shows a message to the user, with window/showMessage. Messages sent
+  /// before the client initializes the server are held until it does.
+  /// Can be called from any thread.
+  void showMessage(MessageType Type, llvm::StringRef Message);
+  /// Logs a message in the client, with window/logMessage, which isn't shown
+  /// to the user unless they look for it. Held and sent as showMessage().
+  void logMessage(MessageType Type, llvm::StringRef Message);
+
 private:
   // Implement DiagnosticsConsumer.
   void onDiagnosticsReady(PathRef File, std::vector<Diag> Diagnostics) override;
@@ -58,6 +66,7 @@ private:
   void onInitialize(const InitializeParams &, Callback<llvm::json::Value>);
   void onShutdown(const ShutdownParams &, Callback<std::nullptr_t>);
   void onSync(const NoParams &, Callback<std::nullptr_t>);
+  void onMemoryUsage(const NoParams &, Callback<llvm::json::Value>);
   void onDocumentDidOpen(const DidOpenTextDocumentParams &);
   void onDocumentDidChange(const DidChangeTextDocumentParams &);
   void onDocumentDidClose(const DidCloseTextDocumentParams &);
@@ -110,6 +119,9 @@ private:
       DiagnosticToReplacementMap;
   /// Caches FixIts per file and diagnostics
   llvm::StringMap<DiagnosticToReplacementMap> FixItsMap;
+  /// The diagnostics last published for each open file, so that rebuilds that
+  /// don't change them aren't published again. Also guarded by FixItsMutex.
+  llvm::StringMap<llvm::json::Value> PublishedDiagnostics;
 
   // Most code should not deal with Transport directly.
   // MessageHandler deals with incoming messages, use call() etc for outgoing.
@@ -120,6 +132,14 @@ private:
   std::mutex TranspWriter;
   void call(StringRef Method, llvm::json::Value Params);
   void notify(StringRef Method, llvm::json::Value Params);
+  void sendMessage(StringRef Method, MessageType Type,
+                   llvm::StringRef Message);
+  // Messages for showMessage() and logMessage() before initialize was
+  // answered, with their methods. None after.
+  using PendingMessage = std::pair<std::string, ShowMessageParams>;
+  llvm::Optional<std::vector<PendingMessage>> PendingMessages{
+      std::vector<PendingMessage>()}; /* GUARDED_BY(MessagesMutex) */
+  std::mutex MessagesMutex;
 
   RealFileSystemProvider FSProvider;
   /// Options used for code completion
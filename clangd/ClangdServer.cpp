@@ -9,6 +9,7 @@
 
 #include "ClangdServer.h"
 #include "CodeComplete.h"
+#include "CrossFileRename.h"
 #include "FindSymbols.h"
 #include "Headers.h"
 #include "SourceCode.h"
@@ -23,6 +24,8 @@
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Refactoring/RefactoringResultConsumer.h"
 #include "clang/Tooling/Refactoring/Rename/RenamingAction.h"
+#include "clang/Tooling/Refactoring/Rename/USRFinder.h"
+#include "clang/Tooling/Refactoring/Rename/USRFindingAction.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/ScopeExit.h"
@@ -44,6 +47,26 @@ std::string getStandardResourceDir() {
   return CompilerInvocation::GetResourcesPath("clangd", (void *)&Dummy);
 }
 
+tooling::CompileCommand withResourceDir(tooling::CompileCommand Cmd,
+                                        StringRef ResourceDir) {
+  // FIXME: Don't overwrite it if it's already there.
+  Cmd.CommandLine.push_back(("-resource-dir=" + ResourceDir).str());
+  return Cmd;
+}
+
+// Makes the command import the headers covered by module maps from implicit
+// modules, built into CachePath and shared by all files. Preambles then hold
+// little more than the imports. Does nothing if CachePath is empty.
+tooling::CompileCommand withImplicitModules(tooling::CompileCommand Cmd,
+                                            StringRef CachePath) {
+  if (CachePath.empty())
+    return Cmd;
+  Cmd.CommandLine.push_back("-fmodules");
+  Cmd.CommandLine.push_back("-fimplicit-module-maps");
+  Cmd.CommandLine.push_back(("-fmodules-cache-path=" + CachePath).str());
+  return Cmd;
+}
+
 class RefactoringResultCollector final
     : public tooling::RefactoringResultConsumer {
 public:
@@ -66,6 +89,39 @@ public:
   Optional<Expected<tooling::AtomicChanges>> Result;
 };
 
+// Lets Sema completion and index-only completion race to reply to a request.
+class CompletionReply {
+public:
+  CompletionReply(Callback<CodeCompleteResult> CB) : CB(std::move(CB)) {}
+
+  // Replies, unless a reply was sent already.
+  void reply(Expected<CodeCompleteResult> Result) {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      if (Replied) {
+        if (!Result)
+          consumeError(Result.takeError());
+        return;
+      }
+      Replied = true;
+    }
+    CV.notify_all();
+    CB(std::move(Result));
+  }
+
+  // Returns whether a reply was sent before D.
+  bool waitForReply(Deadline D) {
+    std::unique_lock<std::mutex> Lock(Mu);
+    return wait(Lock, CV, D, [&] { return Replied; });
+  }
+
+private:
+  std::mutex Mu;
+  std::condition_variable CV;
+  bool Replied /* GUARDED_BY(Mu) */ = false;
+  Callback<CodeCompleteResult> CB;
+};
+
 // Update the FileIndex with new ASTs and plumb the diagnostics responses.
 struct UpdateIndexCallbacks : public ParsingCallbacks {
   UpdateIndexCallbacks(FileIndex *FIndex, DiagnosticsConsumer &DiagConsumer)
@@ -104,12 +160,42 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
                            const FileSystemProvider &FSProvider,
                            DiagnosticsConsumer &DiagConsumer,
                            const Options &Opts)
-    : CDB(CDB), FSProvider(FSProvider),
+    : CDB(CDB),
+      CachingFSProvider(Opts.CacheFileStatus
+                            ? llvm::make_unique<StatCachingFSProvider>(
+                                  FSProvider)
+                            : nullptr),
+      FSProvider(CachingFSProvider
+                     ? static_cast<const FileSystemProvider &>(
+                           *CachingFSProvider)
+                     : FSProvider),
       ResourceDir(Opts.ResourceDir ? *Opts.ResourceDir
                                    : getStandardResourceDir()),
-      DynamicIdx(Opts.BuildDynamicSymbolIndex
-                     ? new FileIndex(Opts.HeavyweightDynamicSymbolIndex)
-                     : nullptr),
+      ModulesCachePath(Opts.ImplicitModulesCachePath),
+      StaticIdx(Opts.StaticIndex),
+      PreambleStorageFactory(
+          Opts.PersistPreambleIndex
+              ? Opts.PackedBackgroundIndexStorage
+                    ? BackgroundIndexStorage::createPackedDiskStorageFactory()
+                    : BackgroundIndexStorage::createDiskBackedStorageFactory()
+              : nullptr),
+      DynamicIdx(
+          Opts.BuildDynamicSymbolIndex
+              ? new FileIndex(
+                    Opts.HeavyweightDynamicSymbolIndex,
+                    PreambleStorageFactory
+                        ? [this](PathRef File) {
+                            ProjectInfo Project;
+                            this->CDB.getCompileCommand(File, &Project);
+                            return PreambleStorageFactory(Project.SourceRoot);
+                          }
+                        : FileIndex::PreambleStorageFn())
+              : nullptr),
+      AsyncCompileCommands(Opts.AsyncCompileCommands),
+      IncluderCommands(Opts.IncluderCommands),
+      CrossFileRename(Opts.CrossFileRename),
+      SpeculativePreambles(Opts.SpeculativePreambles != 0),
+      ClangTidyOptProvider(Opts.ClangTidyOptProvider),
       WorkspaceRoot(Opts.WorkspaceRoot),
       PCHs(std::make_shared<PCHContainerOperations>()),
       // Pass a callback into `WorkScheduler` to extract symbols from a newly
@@ -120,11 +206,15 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
       WorkScheduler(Opts.AsyncThreadsCount, Opts.StorePreamblesInMemory,
                     llvm::make_unique<UpdateIndexCallbacks>(DynamicIdx.get(),
                                                             DiagConsumer),
-                    Opts.UpdateDebounce, Opts.RetentionPolicy) {
+                    Opts.UpdateDebounce, Opts.RetentionPolicy,
+                    Opts.ParallelFirstBuild,
+                    {Opts.SpeculativePreambles,
+                     Opts.SpeculativePreambleMemory}) {
   // Adds an index to the stack, at higher priority than existing indexes.
   auto AddIndex = [&](SymbolIndex *Idx) {
     if (this->Index != nullptr) {
-      MergedIdx.push_back(llvm::make_unique<MergedIndex>(Idx, this->Index));
+      MergedIdx.push_back(llvm::make_unique<MergedIndex>(
+          Idx, this->Index, Opts.StaticIndexTimeout));
       this->Index = MergedIdx.back().get();
     } else {
       this->Index = Idx;
@@ -135,22 +225,154 @@ ClangdServer::ClangdServer(const GlobalCompilationDatabase &CDB,
   if (Opts.BackgroundIndex) {
     BackgroundIdx = llvm::make_unique<BackgroundIndex>(
         Context::current().clone(), ResourceDir, FSProvider, CDB,
-        BackgroundIndexStorage::createDiskBackedStorageFactory());
+        Opts.PackedBackgroundIndexStorage
+            ? BackgroundIndexStorage::createPackedDiskStorageFactory()
+            : BackgroundIndexStorage::createDiskBackedStorageFactory(
+                  Opts.BackgroundIndexStringDictionary),
+        Opts.LazyBackgroundIndexRefs);
     AddIndex(BackgroundIdx.get());
+    // Headers indexed in the background needn't be indexed with preambles.
+    if (DynamicIdx)
+      DynamicIdx->skipIndexedHeaders(
+          [this](StringRef AbsPath, const IndexFileIn::FileDigest &Digest) {
+            return BackgroundIdx->isIndexed(AbsPath, Digest);
+          });
   }
   if (DynamicIdx)
     AddIndex(DynamicIdx.get());
+  if (AsyncCompileCommands)
+    CommandsChanged = CDB.watch([this](const std::vector<std::string> &Files) {
+      std::lock_guard<std::mutex> Lock(CommandsMutex);
+      ++CommandsGeneration;
+      for (const std::string &File : Files)
+        CachedCommands.erase(File);
+    });
+  if (Opts.MemoryLimit)
+    MemoryMonitor = llvm::make_unique<MemoryPressureMonitor>(
+        Opts.MemoryLimit, Opts.MemoryCheckInterval,
+        [this](unsigned Level) { relieveMemoryPressure(Level); },
+        [this] { memoryPressureCleared(); });
+  if (BackgroundIdx && Opts.ThrottleBackgroundIndex)
+    LoadMonitor = llvm::make_unique<SystemLoadMonitor>(
+        Opts.LoadCheckInterval, [this](const SystemLoad &Load) {
+          BackgroundIdx->adaptToLoad(Load);
+        });
 }
 
-void ClangdServer::addDocument(PathRef File, StringRef Contents,
+void ClangdServer::addDocument(PathRef File, std::string Contents,
                                WantDiagnostics WantDiags) {
-  WorkScheduler.update(File,
-                       ParseInputs{getCompileCommand(File),
-                                   FSProvider.getFileSystem(), Contents.str()},
-                       WantDiags);
+  // The user is likely to need the symbols near the file being edited first.
+  if (BackgroundIdx)
+    BackgroundIdx->boostRelated(File);
+  // And to switch to its header or source file.
+  if (SpeculativePreambles) {
+    std::string FilePath = File;
+    WarmUps.runAsync("counterpart:" + sys::path::filename(File),
+                     [this, FilePath] {
+                       if (auto Counterpart = switchSourceHeader(FilePath))
+                         buildSpeculativePreamble(*Counterpart);
+                     });
+  }
+  if (!AsyncCompileCommands) {
+    WorkScheduler.update(File,
+                         ParseInputs{getCompileCommand(File),
+                                     FSProvider.getFileSystem(),
+                                     std::move(Contents),
+                                     getClangTidyOptions(File)},
+                         WantDiags);
+    return;
+  }
+
+  std::lock_guard<std::mutex> Lock(CommandsMutex);
+  auto Cached = CachedCommands.find(File);
+  if (Cached != CachedCommands.end()) {
+    WorkScheduler.update(File,
+                         ParseInputs{Cached->second, FSProvider.getFileSystem(),
+                                     std::move(Contents),
+                                     getClangTidyOptions(File)},
+                         WantDiags);
+    return;
+  }
+  // Features other than diagnostics mostly work with the fallback command.
+  // The file is parsed again with the real command once it's known.
+  auto Pending = PendingCommands.try_emplace(File);
+  Pending.first->second = {Contents, WantDiags};
+  WorkScheduler.update(
+      File,
+      ParseInputs{
+          withImplicitModules(
+              withResourceDir(CDB.getFallbackCommand(File), ResourceDir),
+              ModulesCachePath),
+          FSProvider.getFileSystem(), std::move(Contents),
+          getClangTidyOptions(File)},
+      WantDiagnostics::No);
+  if (Pending.second)
+    lookupCompileCommandLocked(File);
+}
+
+void ClangdServer::lookupCompileCommandLocked(PathRef File) {
+  uint64_t Generation = CommandsGeneration;
+  std::string FilePath = File;
+  CommandLookups.runAsync(
+      "command:" + sys::path::filename(File), [this, FilePath, Generation] {
+        auto Cmd = getCompileCommand(FilePath);
+        std::lock_guard<std::mutex> Lock(CommandsMutex);
+        // The database changed during the lookup, the result may be stale.
+        if (Generation != CommandsGeneration)
+          return lookupCompileCommandLocked(FilePath);
+        CachedCommands[FilePath] = Cmd;
+        auto Pending = PendingCommands.find(FilePath);
+        if (Pending == PendingCommands.end())
+          return; // The file was closed.
+        WorkScheduler.update(FilePath,
+                             ParseInputs{std::move(Cmd),
+                                         FSProvider.getFileSystem(),
+                                         std::move(Pending->second.Contents),
+                                         getClangTidyOptions(FilePath)},
+                             Pending->second.WantDiags);
+        PendingCommands.erase(Pending);
+      });
+}
+
+void ClangdServer::warmUp(PathRef File,
+                          const std::vector<Location> &Locations) {
+  // Only the first few results are likely to be opened.
+  constexpr unsigned MaxFiles = 3;
+  std::vector<std::string> Files;
+  for (const Location &Loc : Locations) {
+    std::string LocFile = Loc.uri.file();
+    if (LocFile != File && !llvm::is_contained(Files, LocFile))
+      Files.push_back(std::move(LocFile));
+    if (Files.size() == MaxFiles)
+      break;
+  }
+  if (BackgroundIdx)
+    for (const std::string &LocFile : Files)
+      BackgroundIdx->boostRelated(LocFile);
+  if (!SpeculativePreambles || Files.empty())
+    return;
+  WarmUps.runAsync("warmup:" + sys::path::filename(File), [this, Files] {
+    for (const std::string &LocFile : Files)
+      buildSpeculativePreamble(LocFile);
+  });
+}
+
+void ClangdServer::buildSpeculativePreamble(PathRef File) {
+  auto FS = FSProvider.getFileSystem();
+  auto Buffer = FS->getBufferForFile(File);
+  if (!Buffer)
+    return;
+  WorkScheduler.buildSpeculativePreamble(
+      File, ParseInputs{getCompileCommand(File), std::move(FS),
+                        (*Buffer)->getBuffer(), getClangTidyOptions(File)});
 }
 
 void ClangdServer::removeDocument(PathRef File) {
+  if (!AsyncCompileCommands)
+    return WorkScheduler.remove(File);
+  // Under the lock, so that a finished lookup doesn't add the file back.
+  std::lock_guard<std::mutex> Lock(CommandsMutex);
+  PendingCommands.erase(File);
   WorkScheduler.remove(File);
 }
 
@@ -174,6 +396,20 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
     if (isCancelled())
       return CB(make_error<CancelledError>());
 
+    if (CodeCompleteOpts.Index && CodeCompleteOpts.IndexOnlyAtNamespaceScope) {
+      if (auto Scopes = namespaceScopesAt(IP->Contents, Pos)) {
+        FuzzyFindRequest Req;
+        if (CodeCompleteOpts.Limit)
+          Req.Limit = CodeCompleteOpts.Limit;
+        Req.RestrictForCodeCompletion = true;
+        Req.Scopes = std::move(*Scopes);
+        Req.AnyScope = CodeCompleteOpts.AllScopes;
+        Req.ProximityPaths.push_back(File);
+        return CB(indexOnlyCodeComplete(File, IP->Contents, Pos, Req,
+                                        CodeCompleteOpts));
+      }
+    }
+
     Optional<SpeculativeFuzzyFind> SpecFuzzyFind;
     if (CodeCompleteOpts.Index && CodeCompleteOpts.SpeculativeIndexRequest) {
       SpecFuzzyFind.emplace();
@@ -183,6 +419,29 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
       }
     }
 
+    auto Reply = std::make_shared<CompletionReply>(std::move(CB));
+    if (SpecFuzzyFind && SpecFuzzyFind->CachedReq &&
+        CodeCompleteOpts.IndexOnlyDeadline) {
+      Deadline D(std::chrono::steady_clock::now() +
+                 *CodeCompleteOpts.IndexOnlyDeadline);
+      EarlyCompletions.runAsync(
+          "IndexOnlyCompletion",
+          Bind(
+              [Reply, D, File, Pos, CodeCompleteOpts](std::string Contents,
+                                                      FuzzyFindRequest Req) {
+                auto Result = indexOnlyCodeComplete(File, Contents, Pos, Req,
+                                                    CodeCompleteOpts);
+                if (Result.Completions.empty() || Reply->waitForReply(D))
+                  return;
+                vlog("Code complete: Sema took longer than {0}ms, replying "
+                     "with {1} index results",
+                     CodeCompleteOpts.IndexOnlyDeadline->count(),
+                     Result.Completions.size());
+                Reply->reply(std::move(Result));
+              },
+              IP->Contents.str(), *SpecFuzzyFind->CachedReq));
+    }
+
     // FIXME(ibiryukov): even if Preamble is non-null, we may want to check
     // both the old and the new version in case only one of them matches.
     CodeCompleteResult Result = clangd::codeComplete(
@@ -190,7 +449,7 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
         CodeCompleteOpts, SpecFuzzyFind ? SpecFuzzyFind.getPointer() : nullptr);
     {
       clang::clangd::trace::Span Tracer("Completion results callback");
-      CB(std::move(Result));
+      Reply->reply(std::move(Result));
     }
     if (SpecFuzzyFind && SpecFuzzyFind->NewReq.hasValue()) {
       std::lock_guard<std::mutex> Lock(CachedCompletionFuzzyFindRequestMutex);
@@ -266,9 +525,9 @@ ClangdServer::formatOnType(StringRef Code, PathRef File, Position Pos) {
 
 void ClangdServer::rename(PathRef File, Position Pos, StringRef NewName,
                           Callback<std::vector<tooling::Replacement>> CB) {
-  auto Action = [Pos](Path File, std::string NewName,
-                      Callback<std::vector<tooling::Replacement>> CB,
-                      Expected<InputsAndAST> InpAST) {
+  auto Action = [Pos, this](Path File, std::string NewName,
+                            Callback<std::vector<tooling::Replacement>> CB,
+                            Expected<InputsAndAST> InpAST) {
     if (!InpAST)
       return CB(InpAST.takeError());
     auto &AST = InpAST->AST;
@@ -302,12 +561,32 @@ void ClangdServer::rename(PathRef File, Position Pos, StringRef NewName,
         //   * rename only in the "main" header
         //   * provide an error if there are symbols we won't rename (e.g.
         //     std::vector)
-        //   * rename globally in project
         //   * rename in open files
+        // With CrossFileRename, the other files are renamed from the index.
         if (Rep.getFilePath() == File)
           Replacements.push_back(Rep);
       }
     }
+
+    // The function-locals can't be referenced from other files.
+    const NamedDecl *ND =
+        tooling::getNamedDeclAt(AST.getASTContext(), SourceLocationBeg);
+    if (CrossFileRename && Index && ND && ND->getDeclName().isIdentifier() &&
+        !ND->getParentFunctionOrMethod()) {
+      // The USRs include those of the constructors and destructor of a class,
+      // and of the overrides of a method, as renamed in the main file.
+      DenseSet<SymbolID> IDs;
+      for (const std::string &USR :
+           tooling::getUSRsForDeclaration(ND, AST.getASTContext()))
+        IDs.insert(SymbolID(USR));
+      // FIXME: The unsaved changes of the other open files are ignored, their
+      // occurrences are checked against the files on disk.
+      std::vector<tooling::Replacement> OtherFiles = renameWithIndex(
+          *Index, IDs, ND->getName(), NewName, File,
+          *FSProvider.getFileSystem(), AST.getASTContext().getLangOpts());
+      Replacements.insert(Replacements.end(), OtherFiles.begin(),
+                          OtherFiles.end());
+    }
     return CB(std::move(Replacements));
   };
 
@@ -336,14 +615,17 @@ void ClangdServer::dumpAST(PathRef File,
 
 void ClangdServer::findDefinitions(PathRef File, Position Pos,
                                    Callback<std::vector<Location>> CB) {
-  auto Action = [Pos, this](Callback<std::vector<Location>> CB,
+  auto Action = [Pos, this](Path File, Callback<std::vector<Location>> CB,
                             Expected<InputsAndAST> InpAST) {
     if (!InpAST)
       return CB(InpAST.takeError());
-    CB(clangd::findDefinitions(InpAST->AST, Pos, Index));
+    auto Definitions = clangd::findDefinitions(InpAST->AST, Pos, Index);
+    warmUp(File, Definitions);
+    CB(std::move(Definitions));
   };
 
-  WorkScheduler.runWithAST("Definitions", File, Bind(Action, std::move(CB)));
+  WorkScheduler.runWithAST("Definitions", File,
+                           Bind(Action, File.str(), std::move(CB)));
 }
 
 Optional<Path> ClangdServer::switchSourceHeader(PathRef Path) {
@@ -452,31 +734,70 @@ void ClangdServer::findHover(PathRef File, Position Pos,
 tooling::CompileCommand ClangdServer::getCompileCommand(PathRef File) {
   trace::Span Span("GetCompileCommand");
   Optional<tooling::CompileCommand> C = CDB.getCompileCommand(File);
+  if (!C && IncluderCommands) {
+    // The commands of open files already have the extra flags.
+    if (auto Includer = WorkScheduler.getIncluderCommand(File)) {
+      vlog("Parsing {0} with the command of {1}", File, Includer->Filename);
+      return transferCompileCommand(std::move(*Includer), File);
+    }
+    if (BackgroundIdx)
+      if (auto Includer = BackgroundIdx->getIncluder(File))
+        if ((C = CDB.getCompileCommand(*Includer))) {
+          vlog("Parsing {0} with the command of {1}", File, *Includer);
+          C = transferCompileCommand(std::move(*C), File);
+        }
+  }
   if (!C) // FIXME: Suppress diagnostics? Let the user know?
     C = CDB.getFallbackCommand(File);
+  return withImplicitModules(withResourceDir(std::move(*C), ResourceDir),
+                             ModulesCachePath);
+}
 
-  // Inject the resource dir.
-  // FIXME: Don't overwrite it if it's already there.
-  C->CommandLine.push_back("-resource-dir=" + ResourceDir);
-  return std::move(*C);
+tidy::ClangTidyOptions ClangdServer::getClangTidyOptions(PathRef File) {
+  if (!ClangTidyOptProvider)
+    return tidy::ClangTidyOptions();
+  std::lock_guard<std::mutex> Lock(ClangTidyOptMutex);
+  return ClangTidyOptProvider->getOptions(File);
 }
 
 void ClangdServer::onFileEvent(const DidChangeWatchedFilesParams &Params) {
-  // FIXME: Do nothing for now. This will be used for indexing and potentially
-  // invalidating other caches.
+  std::vector<std::string> Changed;
+  for (const FileEvent &Event : Params.changes) {
+    if (CachingFSProvider)
+      CachingFSProvider->cache().invalidate(Event.uri.file());
+    Changed.push_back(Event.uri.file());
+  }
+  // Open files are only rebuilt when they change, rebuild the ones whose
+  // preambles or ASTs are outdated now.
+  for (const Path &File : WorkScheduler.getFilesIncluding(Changed)) {
+    vlog("Rebuilding {0} after the files it includes changed", File);
+    WorkScheduler.reparse(File, FSProvider.getFileSystem());
+  }
 }
 
 void ClangdServer::workspaceSymbols(
     StringRef Query, int Limit, Callback<std::vector<SymbolInformation>> CB) {
   std::string QueryCopy = Query;
+  // Clients send a query per keystroke, and won't show the results of the
+  // earlier ones.
+  auto Task = cancelableTask();
+  {
+    std::lock_guard<std::mutex> Lock(WorkspaceSymbolsMutex);
+    if (CancelWorkspaceSymbols)
+      CancelWorkspaceSymbols();
+    CancelWorkspaceSymbols = std::move(Task.second);
+  }
   WorkScheduler.run(
       "getWorkspaceSymbols",
       Bind(
-          [QueryCopy, Limit, this](decltype(CB) CB) {
+          [QueryCopy, Limit, this](Context Ctx, decltype(CB) CB) {
+            WithContext WithCancel(std::move(Ctx));
+            if (isCancelled())
+              return CB(make_error<CancelledError>());
             CB(clangd::getWorkspaceSymbols(QueryCopy, Limit, Index,
                                            WorkspaceRoot.getValueOr("")));
           },
-          std::move(CB)));
+          std::move(Task.first), std::move(CB)));
 }
 
 void ClangdServer::documentSymbols(StringRef File,
@@ -491,16 +812,23 @@ void ClangdServer::documentSymbols(StringRef File,
                            Bind(Action, std::move(CB)));
 }
 
-void ClangdServer::findReferences(PathRef File, Position Pos,
+void ClangdServer::findReferences(PathRef File, Position Pos, uint32_t Limit,
                                   Callback<std::vector<Location>> CB) {
-  auto Action = [Pos, this](Callback<std::vector<Location>> CB,
-                            Expected<InputsAndAST> InpAST) {
+  auto Action = [Pos, Limit, this](Path File,
+                                   Callback<std::vector<Location>> CB,
+                                   Expected<InputsAndAST> InpAST) {
     if (!InpAST)
       return CB(InpAST.takeError());
-    CB(clangd::findReferences(InpAST->AST, Pos, Index));
+    auto Refs = clangd::findReferences(InpAST->AST, Pos, Index, Limit);
+    // The references were cut short.
+    if (isCancelled())
+      return CB(make_error<CancelledError>());
+    warmUp(File, Refs);
+    CB(std::move(Refs));
   };
 
-  WorkScheduler.runWithAST("References", File, Bind(Action, std::move(CB)));
+  WorkScheduler.runWithAST("References", File,
+                           Bind(Action, File.str(), std::move(CB)));
 }
 
 std::vector<std::pair<Path, std::size_t>>
@@ -508,9 +836,43 @@ ClangdServer::getUsedBytesPerFile() const {
   return WorkScheduler.getUsedBytesPerFile();
 }
 
+void ClangdServer::relieveMemoryPressure(unsigned Level) {
+  WorkScheduler.dropIdleASTs();
+  WorkScheduler.dropSpeculativePreambles();
+  if (Level >= 1)
+    WorkScheduler.storePreamblesOnDisk();
+  if (Level >= 2 && BackgroundIdx) {
+    BackgroundIdx->dropCachedRefs();
+    BackgroundIdx->dropCachedFiles();
+  }
+  releaseFreeMemory();
+}
+
+void ClangdServer::memoryPressureCleared() {
+  WorkScheduler.restorePreambleStorage();
+}
+
+void ClangdServer::profile(MemoryTree &Memory, MemoryTree &Disk) const {
+  WorkScheduler.profile(Memory.child("files"), Disk.child("preambles"));
+  if (DynamicIdx)
+    DynamicIdx->profile(Memory.child("dynamic_index"));
+  if (BackgroundIdx)
+    BackgroundIdx->profile(Memory.child("background_index"));
+  if (StaticIdx)
+    StaticIdx->profile(Memory.child("static_index"));
+  if (CachingFSProvider)
+    Memory.child("file_status_cache")
+        .addUsage(CachingFSProvider->cache().getUsedBytes());
+  // Strings shared by the slabs of the dynamic and background indexes.
+  Memory.child("string_pool").addUsage(StringPool::global().bytes());
+}
+
 LLVM_NODISCARD bool
 ClangdServer::blockUntilIdleForTest(Optional<double> TimeoutSeconds) {
-  return WorkScheduler.blockUntilIdle(timeoutSeconds(TimeoutSeconds)) &&
+  return CommandLookups.wait(timeoutSeconds(TimeoutSeconds)) &&
+         EarlyCompletions.wait(timeoutSeconds(TimeoutSeconds)) &&
+         WarmUps.wait(timeoutSeconds(TimeoutSeconds)) &&
+         WorkScheduler.blockUntilIdle(timeoutSeconds(TimeoutSeconds)) &&
          (!BackgroundIdx ||
           BackgroundIdx->blockUntilIdleForTest(TimeoutSeconds));
 }
@@ -13,10 +13,13 @@
 #include "Cancellation.h"
 #include "ClangdUnit.h"
 #include "CodeComplete.h"
+#include "FS.h"
 #include "FSProvider.h"
 #include "Function.h"
 #include "GlobalCompilationDatabase.h"
+#include "MemoryPressure.h"
 #include "Protocol.h"
+#include "SystemLoad.h"
 #include "TUScheduler.h"
 #include "index/Background.h"
 #include "index/FileIndex.h"
@@ -26,6 +29,7 @@
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringRef.h"
+#include <chrono>
 #include <functional>
 #include <future>
 #include <string>
@@ -73,6 +77,12 @@ public:
     /// Cached preambles are potentially large. If false, store them on disk.
     bool StorePreamblesInMemory = true;
 
+    /// If non-zero, ClangdServer frees memory when the resident memory of the
+    /// process exceeds this many bytes. See relieveMemoryPressure().
+    size_t MemoryLimit = 0;
+    /// How often the resident memory is checked against MemoryLimit.
+    std::chrono::milliseconds MemoryCheckInterval = std::chrono::seconds(5);
+
     /// If true, ClangdServer builds a dynamic in-memory index for symbols in
     /// opened files and uses the index to augment code completion results.
     bool BuildDynamicSymbolIndex = false;
@@ -82,9 +92,43 @@ public:
     /// If true, ClangdServer automatically indexes files in the current project
     /// on background threads. The index is stored in the project root.
     bool BackgroundIndex = false;
+    /// If true, the background index stores all shards of a project in a
+    /// single file instead of a file per source file.
+    bool PackedBackgroundIndexStorage = false;
+    /// If true, the shards of the background index refer to a dictionary of
+    /// the strings common to the shards of a project. Only used if the storage
+    /// isn't packed.
+    bool BackgroundIndexStringDictionary = false;
+    /// If true, the background index keeps refs in its storage rather than in
+    /// memory, and reads them when they're queried.
+    bool LazyBackgroundIndexRefs = false;
+    /// If true, the background index runs fewer threads while the machine is
+    /// busy, and pauses while a compiler runs. See
+    /// BackgroundIndex::adaptToLoad().
+    bool ThrottleBackgroundIndex = false;
+    /// How often the load of the machine is checked to throttle the
+    /// background index.
+    std::chrono::milliseconds LoadCheckInterval = std::chrono::seconds(5);
+    /// If true, the dynamic index stores the symbols of each preamble in the
+    /// project root, and loads them when the same preamble is built again.
+    bool PersistPreambleIndex = false;
+
+    /// If true, the status of files is cached across all parses and indexing
+    /// of the server. Cached entries are dropped when onFileEvent() reports a
+    /// change, changes it doesn't report are missed.
+    bool CacheFileStatus = false;
+
+    /// If set, files are parsed with implicit modules, and the modules are
+    /// built into this directory and shared by all files. Experimental: a
+    /// preamble isn't rebuilt when only headers of the modules it imports
+    /// change.
+    std::string ImplicitModulesCachePath;
 
     /// If set, use this index to augment code completion results.
     SymbolIndex *StaticIndex = nullptr;
+    /// If set, code completion queries the static index on another thread,
+    /// and returns without its results if they take longer than this.
+    llvm::Optional<std::chrono::milliseconds> StaticIndexTimeout;
 
     /// Clangd's workspace root. Relevant for "workspace" operations not bound
     /// to a particular file.
@@ -98,8 +142,48 @@ public:
     llvm::Optional<std::string> ResourceDir = llvm::None;
 
     /// Time to wait after a new file version before computing diagnostics.
-    std::chrono::steady_clock::duration UpdateDebounce =
-        std::chrono::milliseconds(500);
+    DebouncePolicy UpdateDebounce;
+
+    /// If true, the first AST of a file is built without a preamble while the
+    /// preamble is built in parallel. This gets the first diagnostics out
+    /// sooner, at the cost of parsing the headers twice.
+    bool ParallelFirstBuild = false;
+
+    /// If non-zero, the preambles of the files likely to be opened next are
+    /// built in the background while worker threads are idle, up to this
+    /// many at once: the header or source counterpart of each added document,
+    /// and the files of the results of findDefinitions() and findReferences().
+    /// The background index also indexes their directories first.
+    unsigned SpeculativePreambles = 0;
+    /// The size in bytes the speculative preambles are kept within.
+    size_t SpeculativePreambleMemory = 256 << 20;
+
+    /// If true, compile commands are looked up on another thread, so that a
+    /// slow compilation database doesn't delay addDocument(). Until its command
+    /// is known, a file is parsed with the fallback command, and doesn't get
+    /// diagnostics. Commands are cached until the database reports a change.
+    bool AsyncCompileCommands = false;
+
+    /// If true, a file without a command in the compilation database, e.g. a
+    /// header, gets the flags of a file including it instead of the fallback
+    /// command: an open file whose preamble or AST read it, or else a file
+    /// the background index found including it.
+    bool IncluderCommands = false;
+
+    /// If true, rename() also changes the occurrences of the symbol in the
+    /// other files, found by their refs in the index. Those files aren't
+    /// parsed, only the token at each ref is checked.
+    bool CrossFileRename = false;
+
+    /// If non-zero, ClangdLSPServer returns at most this many references to a
+    /// symbol. Unlike other results, they aren't limited by default: the
+    /// protocol has no way to ask for the rest.
+    uint32_t ReferencesLimit = 0;
+
+    /// If set, the clang-tidy checks enabled by the options of each file run on
+    /// its AST, and their diagnostics are reported with the others. The
+    /// provider is only accessed under a lock.
+    tidy::ClangTidyOptionsProvider *ClangTidyOptProvider = nullptr;
   };
   // Sensible default options for use in tests.
   // Features like indexing must be enabled if desired.
@@ -125,7 +209,7 @@ public:
   /// \p File is already tracked. Also schedules parsing of the AST for it on a
   /// separate thread. When the parsing is complete, DiagConsumer passed in
   /// constructor will receive onDiagnosticsReady callback.
-  void addDocument(PathRef File, StringRef Contents,
+  void addDocument(PathRef File, std::string Contents,
                    WantDiagnostics WD = WantDiagnostics::Auto);
 
   /// Remove \p File from list of tracked files, schedule a request to free
@@ -174,7 +258,8 @@ public:
                        Callback<std::vector<DocumentSymbol>> CB);
 
   /// Retrieve locations for symbol references.
-  void findReferences(PathRef File, Position Pos,
+  /// If \p Limit is non-zero, returns at most Limit references.
+  void findReferences(PathRef File, Position Pos, uint32_t Limit,
                       Callback<std::vector<Location>> CB);
 
   /// Run formatting for \p Rng inside \p File with content \p Code.
@@ -191,7 +276,8 @@ public:
   formatOnType(StringRef Code, PathRef File, Position Pos);
 
   /// Rename all occurrences of the symbol at the \p Pos in \p File to
-  /// \p NewName.
+  /// \p NewName. With Options::CrossFileRename, the replacements include
+  /// those of other files.
   void rename(PathRef File, Position Pos, llvm::StringRef NewName,
               Callback<std::vector<tooling::Replacement>> CB);
 
@@ -200,6 +286,7 @@ public:
   /// \p File. \p File must be in the list of added documents.
   void dumpAST(PathRef File, llvm::unique_function<void(std::string)> Callback);
   /// Called when an event occurs for a watched file in the workspace.
+  /// Open files including a changed file are parsed again.
   void onFileEvent(const DidChangeWatchedFilesParams &Params);
 
   /// Returns estimated memory usage for each of the currently open files.
@@ -208,9 +295,26 @@ public:
   /// here, as this metric does not account (at least) for:
   ///   - memory occupied by static and dynamic index,
   ///   - memory required for in-flight requests,
-  /// FIXME: those metrics might be useful too, we should add them.
+  /// See profile() for a breakdown including the indexes.
   std::vector<std::pair<Path, std::size_t>> getUsedBytesPerFile() const;
 
+  /// Records the memory used by open files and indexes in \p Memory, and the
+  /// preambles stored on disk in \p Disk. Like getUsedBytesPerFile(), this
+  /// doesn't account for in-flight requests.
+  void profile(MemoryTree &Memory, MemoryTree &Disk) const;
+
+  /// Frees memory, with actions that are more disruptive as \p Level grows:
+  ///   0. drop the idle ASTs, they are rebuilt when needed, and the
+  ///      speculative preambles;
+  ///   1. store preambles on disk, moving the existing ones as they rebuild;
+  ///   2. drop the refs the background index cached, if it loads them lazily.
+  /// Afterwards, free memory of the allocator is returned to the system.
+  /// Called with increasing levels while over Options::MemoryLimit.
+  void relieveMemoryPressure(unsigned Level);
+  /// Undoes the actions of relieveMemoryPressure() that have a lasting
+  /// effect: preambles are stored as configured again.
+  void memoryPressureCleared();
+
   /// Returns the active dynamic index if one was built.
   /// This can be useful for testing, debugging, or observing memory usage.
   const SymbolIndex *dynamicIndex() const { return DynamicIdx.get(); }
@@ -228,17 +332,34 @@ private:
              ArrayRef<tooling::Range> Ranges);
 
   tooling::CompileCommand getCompileCommand(PathRef File);
+  tidy::ClangTidyOptions getClangTidyOptions(PathRef File);
+  // Starts looking up the command of a file in PendingCommands.
+  void lookupCompileCommandLocked(PathRef File);
+  // Boosts the indexing of the files in \p Locations, which are likely to be
+  // opened next, and builds their preambles speculatively. \p File is the
+  // file of the request.
+  void warmUp(PathRef File, const std::vector<Location> &Locations);
+  // Reads \p File and builds its preamble speculatively. Runs on WarmUps.
+  void buildSpeculativePreamble(PathRef File);
 
   const GlobalCompilationDatabase &CDB;
+  // If set, wraps the provider passed to the constructor.
+  std::unique_ptr<StatCachingFSProvider> CachingFSProvider;
   const FileSystemProvider &FSProvider;
 
   Path ResourceDir;
+  // Empty unless files are parsed with implicit modules.
+  std::string ModulesCachePath;
   // The index used to look up symbols. This could be:
   //   - null (all index functionality is optional)
   //   - the dynamic index owned by ClangdServer (DynamicIdx)
   //   - the static index passed to the constructor
   //   - a merged view of a static and dynamic index (MergedIndex)
   const SymbolIndex *Index = nullptr;
+  // The static index passed to the constructor, if any.
+  const SymbolIndex *StaticIdx;
+  // If set, the storage of preamble symbols for each project.
+  BackgroundIndexStorage::Factory PreambleStorageFactory;
   // If present, an index of symbols in open files. Read via *Index.
   std::unique_ptr<FileIndex> DynamicIdx;
   // If present, the new "auto-index" maintained in background threads.
@@ -251,12 +372,52 @@ private:
       CachedCompletionFuzzyFindRequestByFile;
   mutable std::mutex CachedCompletionFuzzyFindRequestMutex;
 
+  // Cancels the last workspaceSymbols() request, superseded by the next one.
+  std::mutex WorkspaceSymbolsMutex;
+  Canceler CancelWorkspaceSymbols /* GUARDED_BY(WorkspaceSymbolsMutex) */;
+
+  const bool AsyncCompileCommands;
+  const bool IncluderCommands;
+  const bool CrossFileRename;
+  const bool SpeculativePreambles;
+  // With AsyncCompileCommands, the inputs of files whose command is being
+  // looked up.
+  struct PendingUpdate {
+    std::string Contents;
+    WantDiagnostics WantDiags;
+  };
+  // Also held when passing them to WorkScheduler, to keep updates in order.
+  std::mutex CommandsMutex;
+  llvm::StringMap<tooling::CompileCommand>
+      CachedCommands /* GUARDED_BY(CommandsMutex) */;
+  llvm::StringMap<PendingUpdate>
+      PendingCommands /* GUARDED_BY(CommandsMutex) */;
+  // Incremented when commands change, to not cache results of older lookups.
+  uint64_t CommandsGeneration /* GUARDED_BY(CommandsMutex) */ = 0;
+  GlobalCompilationDatabase::CommandChanged::Subscription CommandsChanged;
+
+  // The provider of the clang-tidy options of each file, may read and cache
+  // .clang-tidy files.
+  std::mutex ClangTidyOptMutex;
+  tidy::ClangTidyOptionsProvider
+      *ClangTidyOptProvider /* GUARDED_BY(ClangTidyOptMutex) */;
+
   llvm::Optional<std::string> WorkspaceRoot;
   std::shared_ptr<PCHContainerOperations> PCHs;
-  // WorkScheduler has to be the last member, because its destructor has to be
-  // called before all other members to stop the worker thread that references
-  // ClangdServer.
+  // WorkScheduler has to be the last member but MemoryMonitor, because its
+  // destructor has to be called before all other members to stop the worker
+  // thread that references ClangdServer.
   TUScheduler WorkScheduler;
+  // Lookups of compile commands, which update WorkScheduler when done.
+  AsyncTaskRunner CommandLookups;
+  // Index-only completions, racing with Sema completions in WorkScheduler.
+  AsyncTaskRunner EarlyCompletions;
+  // Reads of the files whose preambles are built speculatively.
+  AsyncTaskRunner WarmUps{ThreadPriority::Low};
+  // Stopped first, as it uses WorkScheduler and the indexes.
+  std::unique_ptr<MemoryPressureMonitor> MemoryMonitor;
+  // Stopped before BackgroundIdx, which it throttles.
+  std::unique_ptr<SystemLoadMonitor> LoadMonitor;
 };
 
 } // namespace clangd
@@ -33,6 +33,9 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 
@@ -218,18 +221,37 @@ private:
   const LangOptions &LangOpts;
 };
 
+// Runs Action, and if it crashes while crash recovery is enabled, logs the
+// crash and returns false. The memory the action allocated is leaked.
+bool runRecoveringFromCrash(StringRef What, PathRef FileName,
+                            function_ref<void()> Action) {
+  CrashRecoveryContext CRC;
+  if (CRC.RunSafely(Action))
+    return true;
+  elog("Crashed while building {0} for {1}, recovered", What, FileName);
+  trace::metric("CrashRecovered");
+  return false;
+}
+
 } // namespace
 
 void dumpAST(ParsedAST &AST, raw_ostream &OS) {
   AST.getASTContext().getTranslationUnitDecl()->dump(OS, true);
 }
 
+// FIXME: Every edit re-parses the whole main file after the preamble, even if
+// it only touched one function body. Sema can't re-parse a single body against
+// an existing ASTContext, so doing better needs support in clang itself.
+// Reusing main-file index results for unchanged top-level decls isn't possible
+// either: ParsedAST doesn't track which decls changed, and refs and locations
+// in every decl after an edit shift along with it.
 Optional<ParsedAST>
 ParsedAST::build(std::unique_ptr<CompilerInvocation> CI,
                  std::shared_ptr<const PreambleData> Preamble,
                  std::unique_ptr<MemoryBuffer> Buffer,
                  std::shared_ptr<PCHContainerOperations> PCHs,
-                 IntrusiveRefCntPtr<vfs::FileSystem> VFS) {
+                 IntrusiveRefCntPtr<vfs::FileSystem> VFS,
+                 const tidy::ClangTidyOptions &ClangTidyOpts) {
   assert(CI);
   // Command-line parsing sets DisableFree to true by default, but we don't want
   // to leak memory in clangd.
@@ -259,37 +281,38 @@ ParsedAST::build(std::unique_ptr<CompilerInvocation> CI,
   //    ancestors outside this scope).
   // In practice almost all checks work well without modifications.
   std::vector<std::unique_ptr<tidy::ClangTidyCheck>> CTChecks;
-  ast_matchers::MatchFinder CTFinder;
+  llvm::Optional<ast_matchers::MatchFinder> CTFinder;
   llvm::Optional<tidy::ClangTidyContext> CTContext;
-  {
+  // The time spent in the matchers of each check, only measured when tracing.
+  llvm::StringMap<llvm::TimeRecord> CTTimes;
+  if (ClangTidyOpts.Checks) {
     trace::Span Tracer("ClangTidyInit");
     tidy::ClangTidyCheckFactories CTFactories;
     for (const auto &E : tidy::ClangTidyModuleRegistry::entries())
       E.instantiate()->addCheckFactories(CTFactories);
-    auto CTOpts = tidy::ClangTidyOptions::getDefaults();
-    // FIXME: this needs to be configurable, and we need to support .clang-tidy
-    // files and other options providers.
-    // These checks exercise the matcher- and preprocessor-based hooks.
-    CTOpts.Checks = "bugprone-sizeof-expression,"
-                    "bugprone-macro-repeated-side-effects,"
-                    "modernize-deprecated-headers";
     CTContext.emplace(llvm::make_unique<tidy::DefaultOptionsProvider>(
-        tidy::ClangTidyGlobalOptions(), CTOpts));
+        tidy::ClangTidyGlobalOptions(),
+        tidy::ClangTidyOptions::getDefaults().mergeWith(ClangTidyOpts)));
     CTContext->setDiagnosticsEngine(&Clang->getDiagnostics());
     CTContext->setASTContext(&Clang->getASTContext());
     CTContext->setCurrentFile(MainInput.getFile());
     CTFactories.createChecks(CTContext.getPointer(), CTChecks);
+    ast_matchers::MatchFinder::MatchFinderOptions FinderOpts;
+    if (Tracer.Args)
+      FinderOpts.CheckProfiling.emplace(CTTimes);
+    CTFinder.emplace(std::move(FinderOpts));
     for (const auto &Check : CTChecks) {
       // FIXME: the PP callbacks skip the entire preamble.
       // Checks that want to see #includes in the main file do not see them.
       Check->registerPPCallbacks(*Clang);
-      Check->registerMatchers(&CTFinder);
+      Check->registerMatchers(CTFinder.getPointer());
     }
   }
 
   // Copy over the includes from the preamble, then combine with the
   // non-preamble includes below.
-  auto Includes = Preamble ? Preamble->Includes : IncludeStructure{};
+  auto Includes = Preamble ? Preamble->includesFor(MainInput.getFile())
+                           : IncludeStructure{};
   // Replay the preamble includes so that clang-tidy checks can see them.
   if (Preamble)
     ReplayPreamble::attach(Includes, *Clang);
@@ -305,11 +328,15 @@ ParsedAST::build(std::unique_ptr<CompilerInvocation> CI,
   std::vector<Decl *> ParsedDecls = Action->takeTopLevelDecls();
   // AST traversals should exclude the preamble, to avoid performance cliffs.
   Clang->getASTContext().setTraversalScope(ParsedDecls);
-  {
+  if (CTFinder) {
     // Run the AST-dependent part of the clang-tidy checks.
     // (The preprocessor part ran already, via PPCallbacks).
     trace::Span Tracer("ClangTidyMatch");
-    CTFinder.matchAST(Clang->getASTContext());
+    CTFinder->matchAST(Clang->getASTContext());
+    // Milliseconds spent in the matchers of each check.
+    for (const auto &Time : CTTimes)
+      SPAN_ATTACH(Tracer, Time.getKey().str(),
+                  Time.getValue().getWallTime() * 1000);
   }
 
   // UnitDiagsConsumer is local, we can not store it in CompilerInstance that
@@ -374,6 +401,8 @@ std::size_t ParsedAST::getUsedBytes() const {
   // Message and Fixes inside each diagnostic.
   std::size_t Total =
       clangd::getUsedBytes(LocalTopLevelDecls) + clangd::getUsedBytes(Diags);
+  if (DeclOccurrences)
+    Total += clangd::getUsedBytes(*DeclOccurrences);
 
   // FIXME: the rest of the function is almost a direct copy-paste from
   // libclang's clang_getCXTUResourceUsage. We could share the implementation.
@@ -404,12 +433,69 @@ const IncludeStructure &ParsedAST::getIncludeStructure() const {
   return Includes;
 }
 
+ArrayRef<DeclOccurrence> ParsedAST::getDeclOccurrences() {
+  if (DeclOccurrences)
+    return *DeclOccurrences;
+  trace::Span Tracer("DeclOccurrences");
+  class Collector : public index::IndexDataConsumer {
+  public:
+    bool handleDeclOccurence(const Decl *D, index::SymbolRoleSet Roles,
+                             ArrayRef<index::SymbolRelation> Relations,
+                             SourceLocation Loc,
+                             ASTNodeInfo ASTNode) override {
+      Occurrences.push_back({Loc, D, Roles, ASTNode.OrigE});
+      return true;
+    }
+
+    std::vector<DeclOccurrence> Occurrences;
+  } C;
+  index::IndexingOptions IndexOpts;
+  IndexOpts.SystemSymbolFilter =
+      index::IndexingOptions::SystemSymbolFilterKind::All;
+  IndexOpts.IndexFunctionLocals = true;
+  indexTopLevelDecls(getASTContext(), getPreprocessor(), LocalTopLevelDecls, C,
+                     IndexOpts);
+  // Keep the traversal order of occurrences at the same location.
+  std::stable_sort(C.Occurrences.begin(), C.Occurrences.end(),
+                   [](const DeclOccurrence &L, const DeclOccurrence &R) {
+                     return L.Loc < R.Loc;
+                   });
+  SPAN_ATTACH(Tracer, "occurrences", int(C.Occurrences.size()));
+  DeclOccurrences = std::move(C.Occurrences);
+  return *DeclOccurrences;
+}
+
+ArrayRef<DeclOccurrence> ParsedAST::getDeclOccurrencesAt(SourceLocation Loc) {
+  ArrayRef<DeclOccurrence> All = getDeclOccurrences();
+  auto Begin = std::lower_bound(
+      All.begin(), All.end(), Loc,
+      [](const DeclOccurrence &O, SourceLocation L) { return O.Loc < L; });
+  auto End = std::upper_bound(
+      Begin, All.end(), Loc,
+      [](SourceLocation L, const DeclOccurrence &O) { return L < O.Loc; });
+  return All.slice(Begin - All.begin(), End - Begin);
+}
+
+const std::vector<DocumentSymbol> *ParsedAST::getCachedDocumentSymbols() const {
+  return DocumentSymbols ? DocumentSymbols.getPointer() : nullptr;
+}
+
+void ParsedAST::cacheDocumentSymbols(std::vector<DocumentSymbol> Symbols) {
+  DocumentSymbols = std::move(Symbols);
+}
+
 PreambleData::PreambleData(PrecompiledPreamble Preamble,
                            std::vector<Diag> Diags, IncludeStructure Includes,
                            std::unique_ptr<PreambleFileStatusCache> StatCache)
     : Preamble(std::move(Preamble)), Diags(std::move(Diags)),
       Includes(std::move(Includes)), StatCache(std::move(StatCache)) {}
 
+IncludeStructure PreambleData::includesFor(StringRef File) const {
+  IncludeStructure Result = Includes;
+  Result.recordSameIncludes(File, MainFile);
+  return Result;
+}
+
 ParsedAST::ParsedAST(std::shared_ptr<const PreambleData> Preamble,
                      std::unique_ptr<CompilerInstance> Clang,
                      std::unique_ptr<FrontendAction> Action,
@@ -464,15 +550,25 @@ buildPreamble(PathRef FileName, CompilerInvocation &CI,
   auto Bounds =
       ComputePreambleBounds(*CI.getLangOpts(), ContentsBuffer.get(), 0);
 
-  if (OldPreamble &&
+  // A preamble stored in memory is not reused when preambles should be stored
+  // on disk, so that they move there as their files are rebuilt.
+  if (OldPreamble && (StoreInMemory || !OldPreamble->StoredInMemory) &&
       compileCommandsAreEqual(Inputs.CompileCommand, OldCompileCommand) &&
       OldPreamble->Preamble.CanReuse(CI, ContentsBuffer.get(), Bounds,
                                      Inputs.FS.get())) {
     vlog("Reusing preamble for file {0}", Twine(FileName));
+    trace::metric("PreambleReused");
     return OldPreamble;
   }
+  if (OldPreamble)
+    trace::metric("PreambleRebuilt");
   vlog("Preamble for file {0} cannot be reused. Attempting to rebuild it.",
        FileName);
+  // FIXME: Preambles are lost when clangd exits, and heavy TUs have to rebuild
+  // them on first open. A store next to the on-disk index, keyed by compile
+  // command, preamble bounds and header digests, could keep them across
+  // restarts. This needs a way to adopt an existing PCH file into a
+  // PrecompiledPreamble, which only clang's Build() can create today.
 
   trace::Span Tracer("BuildPreamble");
   SPAN_ATTACH(Tracer, "File", FileName);
@@ -482,7 +578,10 @@ buildPreamble(PathRef FileName, CompilerInvocation &CI,
                                           &PreambleDiagnostics, false);
 
   // Skip function bodies when building the preamble to speed up building
-  // the preamble and make it smaller.
+  // the preamble and make it smaller. Only headers have function bodies: the
+  // preamble of the main file is its leading directives. Sema keeps the bodies
+  // that later code needs: those of constexpr functions, and of functions with
+  // deduced return types.
   assert(!CI.getFrontendOpts().SkipFunctionBodies);
   CI.getFrontendOpts().SkipFunctionBodies = true;
   // We don't want to write comment locations into PCH. They are racy and slow
@@ -499,10 +598,14 @@ buildPreamble(PathRef FileName, CompilerInvocation &CI,
   SmallString<32> AbsFileName(FileName);
   Inputs.FS->makeAbsolute(AbsFileName);
   auto StatCache = llvm::make_unique<PreambleFileStatusCache>(AbsFileName);
-  auto BuiltPreamble = PrecompiledPreamble::Build(
-      CI, ContentsBuffer.get(), Bounds, *PreambleDiagsEngine,
-      StatCache->getProducingFS(Inputs.FS), PCHs, StoreInMemory,
-      SerializedDeclsCollector);
+  ErrorOr<PrecompiledPreamble> BuiltPreamble =
+      std::make_error_code(std::errc::state_not_recoverable);
+  runRecoveringFromCrash("the preamble", FileName, [&] {
+    BuiltPreamble = PrecompiledPreamble::Build(
+        CI, ContentsBuffer.get(), Bounds, *PreambleDiagsEngine,
+        StatCache->getProducingFS(Inputs.FS), PCHs, StoreInMemory,
+        SerializedDeclsCollector);
+  });
 
   // When building the AST for the main file, we do want the function
   // bodies.
@@ -511,9 +614,13 @@ buildPreamble(PathRef FileName, CompilerInvocation &CI,
   if (BuiltPreamble) {
     vlog("Built preamble of size {0} for file {1}", BuiltPreamble->getSize(),
          FileName);
-    return std::make_shared<PreambleData>(
+    auto Preamble = std::make_shared<PreambleData>(
         std::move(*BuiltPreamble), PreambleDiagnostics.take(),
         SerializedDeclsCollector.takeIncludes(), std::move(StatCache));
+    Preamble->CompileCommand = Inputs.CompileCommand;
+    Preamble->MainFile = FileName;
+    Preamble->StoredInMemory = StoreInMemory;
+    return Preamble;
   } else {
     elog("Could not build a preamble for file {0}", FileName);
     return nullptr;
@@ -537,9 +644,14 @@ Optional<ParsedAST> buildAST(PathRef FileName,
     // dirs.
   }
 
-  return ParsedAST::build(
-      llvm::make_unique<CompilerInvocation>(*Invocation), Preamble,
-      MemoryBuffer::getMemBufferCopy(Inputs.Contents), PCHs, std::move(VFS));
+  Optional<ParsedAST> AST;
+  runRecoveringFromCrash("the AST", FileName, [&] {
+    AST = ParsedAST::build(llvm::make_unique<CompilerInvocation>(*Invocation),
+                           Preamble,
+                           MemoryBuffer::getMemBufferCopy(Inputs.Contents),
+                           PCHs, std::move(VFS), Inputs.ClangTidyOpts);
+  });
+  return AST;
 }
 
 SourceLocation getBeginningOfIdentifier(ParsedAST &Unit, const Position &Pos,
@@ -10,19 +10,23 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_CLANGDUNIT_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_CLANGDUNIT_H
 
+#include "../clang-tidy/ClangTidyOptions.h"
 #include "Diagnostics.h"
 #include "FS.h"
+#include "FileDistance.h"
 #include "Function.h"
 #include "Headers.h"
 #include "Path.h"
 #include "Protocol.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Frontend/PrecompiledPreamble.h"
+#include "clang/Index/IndexSymbol.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Serialization/ASTBitCodes.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -50,14 +54,31 @@ struct PreambleData {
                std::unique_ptr<PreambleFileStatusCache> StatCache);
 
   tooling::CompileCommand CompileCommand;
+  // The file the preamble was built for. Other files of its directory with
+  // the same preamble may use it too.
+  std::string MainFile;
   PrecompiledPreamble Preamble;
   std::vector<Diag> Diags;
   // Processes like code completions and go-to-definitions will need #include
   // information, and their compile action skips preamble range.
+  // The includes are rooted at MainFile, see includesFor().
   IncludeStructure Includes;
   // Cache of FS operations performed when building the preamble.
   // When reusing a preamble, this cache can be consumed to save IO.
   std::unique_ptr<PreambleFileStatusCache> StatCache;
+  // Whether the PCH is stored in memory rather than in a temporary file.
+  bool StoredInMemory = false;
+  // #include spellings computed by code completions using this preamble, which
+  // has the same header search paths.
+  mutable IncludePathCache IncludePaths;
+  // File proximity of symbols for the code completions of each main file
+  // using this preamble, created by the first one.
+  mutable std::mutex FileProximityMu;
+  mutable llvm::StringMap<std::unique_ptr<URIDistance>>
+      FileProximity; /* GUARDED_BY(FileProximityMu) */
+
+  // Returns the includes of the preamble, rooted at \p File.
+  IncludeStructure includesFor(llvm::StringRef File) const;
 };
 
 /// Information required to run clang, e.g. to parse AST or do code completion.
@@ -65,19 +86,37 @@ struct ParseInputs {
   tooling::CompileCommand CompileCommand;
   IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS;
   std::string Contents;
+  /// The clang-tidy checks to run on the AST, and their options. No checks run
+  /// unless Checks is set.
+  tidy::ClangTidyOptions ClangTidyOpts;
+};
+
+/// A reference to a declaration, reported by indexing the top-level decls of
+/// the main file.
+struct DeclOccurrence {
+  /// As reported by the indexer, i.e. possibly a macro location.
+  SourceLocation Loc;
+  /// The canonical declaration.
+  const Decl *D;
+  index::SymbolRoleSet Roles;
+  /// The AST node of the reference, if any.
+  const Expr *E;
 };
 
 /// Stores and provides access to parsed AST.
 class ParsedAST {
 public:
   /// Attempts to run Clang and store parsed AST. If \p Preamble is non-null
-  /// it is reused during parsing.
+  /// it is reused during parsing. The clang-tidy checks enabled by
+  /// \p ClangTidyOpts run on the top-level decls of the main file, and their
+  /// diagnostics are added to those of the AST.
   static llvm::Optional<ParsedAST>
   build(std::unique_ptr<clang::CompilerInvocation> CI,
         std::shared_ptr<const PreambleData> Preamble,
         std::unique_ptr<llvm::MemoryBuffer> Buffer,
         std::shared_ptr<PCHContainerOperations> PCHs,
-        IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS);
+        IntrusiveRefCntPtr<llvm::vfs::FileSystem> VFS,
+        const tidy::ClangTidyOptions &ClangTidyOpts);
 
   ParsedAST(ParsedAST &&Other);
   ParsedAST &operator=(ParsedAST &&Other);
@@ -106,6 +145,17 @@ public:
   std::size_t getUsedBytes() const;
   const IncludeStructure &getIncludeStructure() const;
 
+  /// Returns the declaration references inside getLocalTopLevelDecls(),
+  /// sorted by location. Computed by the first call, so position-based
+  /// queries on the same AST don't traverse it again.
+  ArrayRef<DeclOccurrence> getDeclOccurrences();
+  /// Returns the occurrences whose location is exactly \p Loc.
+  ArrayRef<DeclOccurrence> getDeclOccurrencesAt(SourceLocation Loc);
+
+  /// The document symbols of the main file, if cached by getDocumentSymbols().
+  const std::vector<DocumentSymbol> *getCachedDocumentSymbols() const;
+  void cacheDocumentSymbols(std::vector<DocumentSymbol> Symbols);
+
 private:
   ParsedAST(std::shared_ptr<const PreambleData> Preamble,
             std::unique_ptr<CompilerInstance> Clang,
@@ -130,6 +180,10 @@ private:
   // top-level decls from the preamble.
   std::vector<Decl *> LocalTopLevelDecls;
   IncludeStructure Includes;
+  // Computed on first use. ParsedAST is only accessed by one thread at a time,
+  // so no locking is needed.
+  llvm::Optional<std::vector<DeclOccurrence>> DeclOccurrences;
+  llvm::Optional<std::vector<DocumentSymbol>> DocumentSymbols;
 };
 
 using PreambleParsedCallback =
@@ -43,6 +43,7 @@
 #include "clang/Format/Format.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendActions.h"
+#include "clang/Lex/Lexer.h"
 #include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Sema/CodeCompleteConsumer.h"
 #include "clang/Sema/Sema.h"
@@ -182,23 +183,44 @@ std::string getOptionalParameters(const CodeCompletionString &CCS,
 
 /// Creates a `HeaderFile` from \p Header which can be either a URI or a literal
 /// include.
-static Expected<HeaderFile> toHeaderFile(StringRef Header, StringRef HintPath) {
+static Expected<HeaderFile> toHeaderFile(StringRef Header,
+                                         CachedURIResolver &URIs) {
   if (isLiteralInclude(Header))
     return HeaderFile{Header.str(), /*Verbatim=*/true};
-  auto U = URI::parse(Header);
-  if (!U)
-    return U.takeError();
-
-  auto IncludePath = URI::includeSpelling(*U);
+  auto IncludePath = URIs.includeSpelling(Header);
   if (!IncludePath)
     return IncludePath.takeError();
   if (!IncludePath->empty())
-    return HeaderFile{std::move(*IncludePath), /*Verbatim=*/true};
+    return HeaderFile{IncludePath->str(), /*Verbatim=*/true};
 
-  auto Resolved = URI::resolve(*U, HintPath);
+  auto Resolved = URIs.resolve(Header);
   if (!Resolved)
     return Resolved.takeError();
-  return HeaderFile{std::move(*Resolved), /*Verbatim=*/false};
+  return HeaderFile{Resolved->str(), /*Verbatim=*/false};
+}
+
+// Scores a candidate with the ranking model, keeping the heuristic component
+// scores for debugging.
+CodeCompletion::Scores
+scoreCandidate(const SymbolQualitySignals &Quality,
+               const SymbolRelevanceSignals &Relevance,
+               CodeCompleteOptions::CodeCompletionRankingModel Model) {
+  CodeCompletion::Scores Scores;
+  Scores.Quality = Quality.evaluate();
+  Scores.Relevance = Relevance.evaluate();
+  switch (Model) {
+  case CodeCompleteOptions::Heuristics:
+    Scores.Total = evaluateSymbolAndRelevance(Scores.Quality, Scores.Relevance);
+    break;
+  case CodeCompleteOptions::DecisionForest:
+    Scores.Total = evaluateDecisionForest(Quality, Relevance);
+    break;
+  }
+  // NameMatch is in fact a multiplier on total score, so rescoring is sound.
+  Scores.ExcludingName = Relevance.NameMatch
+                             ? Scores.Total / Relevance.NameMatch
+                             : Scores.Quality;
+  return Scores;
 }
 
 /// A code completion result, in clang-native form.
@@ -286,6 +308,7 @@ struct CodeCompletionBuilder {
                         CodeCompletionString *SemaCCS,
                         ArrayRef<std::string> QueryScopes,
                         const IncludeInserter &Includes, StringRef FileName,
+                        CachedURIResolver &URIs,
                         CodeCompletionContext::Kind ContextKind,
                         const CodeCompleteOptions &Opts)
       : ASTCtx(ASTCtx), ExtractDocumentation(Opts.IncludeComments),
@@ -347,10 +370,10 @@ struct CodeCompletionBuilder {
     auto Inserted =
         [&](StringRef Header) -> Expected<std::pair<std::string, bool>> {
       auto ResolvedDeclaring =
-          toHeaderFile(C.IndexResult->CanonicalDeclaration.FileURI, FileName);
+          toHeaderFile(C.IndexResult->CanonicalDeclaration.FileURI, URIs);
       if (!ResolvedDeclaring)
         return ResolvedDeclaring.takeError();
-      auto ResolvedInserted = toHeaderFile(Header, FileName);
+      auto ResolvedInserted = toHeaderFile(Header, URIs);
       if (!ResolvedInserted)
         return ResolvedInserted.takeError();
       return std::make_pair(
@@ -696,6 +719,8 @@ struct CompletionRecorder : public CodeCompleteConsumer {
   CodeCompletionContext CCContext;
   Sema *CCSema = nullptr; // Sema that created the results.
   // FIXME: Sema is scary. Can we store ASTContext and Preprocessor, instead?
+  // Whether results that matched the filter were dropped by preselect().
+  bool Truncated = false;
 
   void ProcessCodeCompleteResults(class Sema &S, CodeCompletionContext Context,
                                   CodeCompletionResult *InResults,
@@ -728,6 +753,7 @@ struct CompletionRecorder : public CodeCompleteConsumer {
     // Record the completion context.
     CCSema = &S;
     CCContext = Context;
+    FuzzyMatcher Filter(S.getPreprocessor().getCodeCompletionFilter());
 
     // Retain the results we might want.
     for (unsigned I = 0; I < NumResults; ++I) {
@@ -746,8 +772,18 @@ struct CompletionRecorder : public CodeCompleteConsumer {
         continue;
       // We choose to never append '::' to completion results in clangd.
       Result.StartsNestedNameSpecifier = false;
+      // Results that don't match the filter would be dropped when scored, but
+      // only after bundling them and computing their signals.
+      auto Match = matchName(Filter, Result);
+      if (!Match)
+        continue;
       Results.push_back(Result);
+      NameMatches.push_back(*Match);
     }
+    // Global scopes can have 100k+ matching results, e.g. after `::` in a file
+    // including windows.h. Only a few of them can make it to the top.
+    if (Opts.Limit && Results.size() > Opts.Limit * PreselectFactor)
+      preselect(Opts.Limit * PreselectFactor);
     ResultsCallback();
   }
 
@@ -773,6 +809,13 @@ struct CompletionRecorder : public CodeCompleteConsumer {
     return CCS->getTypedText();
   }
 
+  // Returns the score of Result against the filter, which must be from Results.
+  float nameMatch(const CodeCompletionResult &Result) const {
+    assert(&Result >= Results.data() &&
+           &Result < Results.data() + Results.size());
+    return NameMatches[&Result - Results.data()];
+  }
+
   // Build a CodeCompletion string for R, which must be from Results.
   // The CCS will be owned by this recorder.
   CodeCompletionString *codeCompletionString(const CodeCompletionResult &R) {
@@ -783,10 +826,62 @@ struct CompletionRecorder : public CodeCompleteConsumer {
   }
 
 private:
+  // With more results matching the filter than Limit times this, only the best
+  // ones by name match and quality are kept.
+  static constexpr size_t PreselectFactor = 10;
+
+  Optional<float> matchName(FuzzyMatcher &Filter,
+                            const CodeCompletionResult &Result) {
+    // Macros can be very spammy, so we only support prefix completion.
+    // We won't end up with underfull index results, as macros are sema-only.
+    StringRef Name = getName(Result);
+    if (Result.Kind == CodeCompletionResult::RK_Macro &&
+        !Name.startswith_lower(Filter.pattern()))
+      return None;
+    return Filter.match(Name);
+  }
+
+  // Keeps the N results with the best name match and quality, in their
+  // original order. This ignores relevance signals, e.g. proximity, which are
+  // not known yet, so the completion list is marked incomplete.
+  void preselect(size_t N) {
+    trace::Span Tracer("Preselect sema results");
+    std::vector<std::pair<float, size_t>> Scored;
+    Scored.reserve(Results.size());
+    for (size_t I = 0; I < Results.size(); ++I) {
+      SymbolQualitySignals Quality;
+      Quality.merge(Results[I]);
+      Scored.push_back({NameMatches[I] * Quality.evaluate(), I});
+    }
+    std::nth_element(Scored.begin(), Scored.begin() + N, Scored.end(),
+                     [](const std::pair<float, size_t> &L,
+                        const std::pair<float, size_t> &R) {
+                       return L.first > R.first;
+                     });
+    Scored.resize(N);
+    llvm::sort(Scored, [](const std::pair<float, size_t> &L,
+                          const std::pair<float, size_t> &R) {
+      return L.second < R.second;
+    });
+    std::vector<CodeCompletionResult> Kept;
+    std::vector<float> KeptMatches;
+    Kept.reserve(N);
+    KeptMatches.reserve(N);
+    for (const auto &S : Scored) {
+      Kept.push_back(Results[S.second]);
+      KeptMatches.push_back(NameMatches[S.second]);
+    }
+    SPAN_ATTACH(Tracer, "dropped", int64_t(Results.size() - N));
+    Results = std::move(Kept);
+    NameMatches = std::move(KeptMatches);
+    Truncated = true;
+  }
+
   CodeCompleteOptions Opts;
   std::shared_ptr<GlobalCodeCompletionAllocator> CCAllocator;
   CodeCompletionTUInfo CCTUInfo;
   unique_function<void()> ResultsCallback;
+  std::vector<float> NameMatches; // Parallel to Results.
 };
 
 struct ScoredSignature {
@@ -1183,6 +1278,24 @@ SmallVector<StringRef, 1> getRankedIncludes(const Symbol &Sym) {
   return Headers;
 }
 
+// Returns the sources of file proximity for completions in MainFile: the file
+// itself and its transitive includes.
+static StringMap<SourceParams>
+fileProximitySources(const IncludeStructure &Includes, StringRef MainFile) {
+  FileDistanceOptions ProxOpts{}; // Use defaults.
+  StringMap<SourceParams> ProxSources;
+  for (auto &Entry : Includes.includeDepth(MainFile)) {
+    auto &Source = ProxSources[Entry.getKey()];
+    Source.Cost = Entry.getValue() * ProxOpts.IncludeCost;
+    // Symbols near our transitive includes are good, but only consider
+    // things in the same directory or below it. Otherwise there can be
+    // many false positives.
+    if (Entry.getValue() > 0)
+      Source.MaxUpTraversals = 1;
+  }
+  return ProxSources;
+}
+
 // Runs Sema-based (AST) and Index-based completion, returns merged results.
 //
 // There are a few tricky considerations:
@@ -1223,6 +1336,9 @@ class CodeCompleteFlow {
   int NSema = 0, NIndex = 0, NBoth = 0; // Counters for logging.
   bool Incomplete = false; // Would more be available with a higher limit?
   Optional<FuzzyMatcher> Filter;        // Initialized once Sema runs.
+  // The name matches the index computed for its results, so that they aren't
+  // matched again. Speculative results come without them.
+  DenseMap<SymbolID, float> IndexNameMatches;
   std::vector<std::string> QueryScopes; // Initialized once Sema runs.
   // Initialized once QueryScopes is initialized, if there are scopes.
   Optional<ScopeDistance> ScopeProximity;
@@ -1232,7 +1348,12 @@ class CodeCompleteFlow {
   // Include-insertion and proximity scoring rely on the include structure.
   // This is available after Sema has run.
   Optional<IncludeInserter> Inserter;  // Available during runWithSema.
-  Optional<URIDistance> FileProximity; // Initialized once Sema runs.
+  // Initialized once Sema runs. Points to OwnedFileProximity unless the
+  // preamble's is used.
+  URIDistance *FileProximity = nullptr;
+  Optional<URIDistance> OwnedFileProximity;
+  // Resolves the headers to insert, which the results share.
+  CachedURIResolver URIs;
   /// Speculative request based on the cached request and the filter text before
   /// the cursor.
   /// Initialized right before sema run. This is only set if `SpecFuzzyFind` is
@@ -1245,7 +1366,7 @@ public:
                    SpeculativeFuzzyFind *SpecFuzzyFind,
                    const CodeCompleteOptions &Opts)
       : FileName(FileName), Includes(Includes), SpecFuzzyFind(SpecFuzzyFind),
-        Opts(Opts) {}
+        Opts(Opts), URIs(FileName) {}
 
   CodeCompleteResult run(const SemaCompleteInput &SemaCCInput) && {
     trace::Span Tracer("CodeCompleteFlow");
@@ -1272,33 +1393,44 @@ public:
             SemaCCInput.FileName, Style.takeError());
         Style = format::getLLVMStyle();
       }
+      // Include spellings are shared with other completions using the preamble,
+      // unless it's stale and has other header search paths.
+      IncludePathCache *PathCache = nullptr;
+      if (const PreambleData *Preamble = SemaCCInput.Preamble)
+        if (Preamble->CompileCommand.Directory ==
+                SemaCCInput.Command.Directory &&
+            Preamble->CompileCommand.CommandLine ==
+                SemaCCInput.Command.CommandLine)
+          PathCache = &Preamble->IncludePaths;
       // If preprocessor was run, inclusions from preprocessor callback should
       // already be added to Includes.
       Inserter.emplace(
           SemaCCInput.FileName, SemaCCInput.Contents, *Style,
           SemaCCInput.Command.Directory,
-          Recorder->CCSema->getPreprocessor().getHeaderSearchInfo());
+          Recorder->CCSema->getPreprocessor().getHeaderSearchInfo(),
+          PathCache);
       for (const auto &Inc : Includes.MainFileIncludes)
         Inserter->addExisting(Inc);
 
       // Most of the cost of file proximity is in initializing the FileDistance
-      // structures based on the observed includes, once per query. Conceptually
-      // that happens here (though the per-URI-scheme initialization is lazy).
-      // The per-result proximity scoring is (amortized) very cheap.
-      FileDistanceOptions ProxOpts{}; // Use defaults.
+      // structures based on the observed includes, and in the first lookups
+      // of each URI. So the distances are shared by the completions of a file
+      // using a preamble, unless the file has includes that it doesn't.
       const auto &SM = Recorder->CCSema->getSourceManager();
-      StringMap<SourceParams> ProxSources;
-      for (auto &Entry : Includes.includeDepth(
-               SM.getFileEntryForID(SM.getMainFileID())->getName())) {
-        auto &Source = ProxSources[Entry.getKey()];
-        Source.Cost = Entry.getValue() * ProxOpts.IncludeCost;
-        // Symbols near our transitive includes are good, but only consider
-        // things in the same directory or below it. Otherwise there can be
-        // many false positives.
-        if (Entry.getValue() > 0)
-          Source.MaxUpTraversals = 1;
+      StringRef MainFile = SM.getFileEntryForID(SM.getMainFileID())->getName();
+      const PreambleData *Preamble = SemaCCInput.Preamble;
+      if (Preamble && Preamble->Includes.MainFileIncludes.size() ==
+                          Includes.MainFileIncludes.size()) {
+        std::lock_guard<std::mutex> Lock(Preamble->FileProximityMu);
+        auto &Cached = Preamble->FileProximity[MainFile];
+        if (!Cached)
+          Cached = llvm::make_unique<URIDistance>(
+              fileProximitySources(Includes, MainFile));
+        FileProximity = Cached.get();
+      } else {
+        OwnedFileProximity.emplace(fileProximitySources(Includes, MainFile));
+        FileProximity = OwnedFileProximity.getPointer();
       }
-      FileProximity.emplace(ProxSources, ProxOpts);
 
       Output = runWithSema();
       Inserter.reset(); // Make sure this doesn't out-live Clang.
@@ -1371,6 +1503,8 @@ private:
                             ? queryIndex()
                             : SymbolSlab();
     trace::Span Tracer("Populate CodeCompleteResult");
+    if (Recorder->Truncated)
+      Incomplete = true;
     // Merge Sema and Index results, score them, and pick the winners.
     auto Top = mergeResults(Recorder->Results, IndexResults);
     CodeCompleteResult Output;
@@ -1418,8 +1552,11 @@ private:
 
     // Run the query against the index.
     SymbolSlab::Builder ResultsBuilder;
-    if (Opts.Index->fuzzyFind(
-            Req, [&](const Symbol &Sym) { ResultsBuilder.insert(Sym); }))
+    if (Opts.Index->fuzzyFindScored(
+            Req, [&](const Symbol &Sym, float NameMatch) {
+              ResultsBuilder.insert(Sym);
+              IndexNameMatches[Sym.ID] = NameMatch;
+            }))
       Incomplete = true;
     return std::move(ResultsBuilder).build();
   }
@@ -1482,11 +1619,12 @@ private:
   }
 
   Optional<float> fuzzyScore(const CompletionCandidate &C) {
-    // Macros can be very spammy, so we only support prefix completion.
-    // We won't end up with underfull index results, as macros are sema-only.
-    if (C.SemaResult && C.SemaResult->Kind == CodeCompletionResult::RK_Macro &&
-        !C.Name.startswith_lower(Filter->pattern()))
-      return None;
+    // Sema results were matched against the filter as they were recorded.
+    if (C.SemaResult)
+      return Recorder->nameMatch(*C.SemaResult);
+    auto It = IndexNameMatches.find(C.IndexResult->ID);
+    if (It != IndexNameMatches.end())
+      return It->second;
     return Filter->match(C.Name);
   }
 
@@ -1497,7 +1635,7 @@ private:
     SymbolRelevanceSignals Relevance;
     Relevance.Context = Recorder->CCContext.getKind();
     Relevance.Query = SymbolRelevanceSignals::CodeComplete;
-    Relevance.FileProximityMatch = FileProximity.getPointer();
+    Relevance.FileProximityMatch = FileProximity;
     if (ScopeProximity)
       Relevance.ScopeProximityMatch = ScopeProximity.getPointer();
     if (PreferredType)
@@ -1538,14 +1676,8 @@ private:
       }
     }
 
-    CodeCompletion::Scores Scores;
-    Scores.Quality = Quality.evaluate();
-    Scores.Relevance = Relevance.evaluate();
-    Scores.Total = evaluateSymbolAndRelevance(Scores.Quality, Scores.Relevance);
-    // NameMatch is in fact a multiplier on total score, so rescoring is sound.
-    Scores.ExcludingName = Relevance.NameMatch
-                               ? Scores.Total / Relevance.NameMatch
-                               : Scores.Quality;
+    CodeCompletion::Scores Scores =
+        scoreCandidate(Quality, Relevance, Opts.RankingModel);
 
     dlog("CodeComplete: {0} ({1}) = {2}\n{3}{4}\n", First.Name,
          to_string(Origin), Scores.Total, to_string(Quality),
@@ -1566,7 +1698,7 @@ private:
                           : nullptr;
       if (!Builder)
         Builder.emplace(Recorder->CCSema->getASTContext(), Item, SemaCCS,
-                        QueryScopes, *Inserter, FileName,
+                        QueryScopes, *Inserter, FileName, URIs,
                         Recorder->CCContext.getKind(), Opts);
       else
         Builder->add(Item, SemaCCS);
@@ -1606,11 +1738,188 @@ codeComplete(PathRef FileName, const tooling::CompileCommand &Command,
              std::shared_ptr<PCHContainerOperations> PCHs,
              CodeCompleteOptions Opts, SpeculativeFuzzyFind *SpecFuzzyFind) {
   return CodeCompleteFlow(FileName,
-                          Preamble ? Preamble->Includes : IncludeStructure(),
+                          Preamble ? Preamble->includesFor(FileName)
+                                   : IncludeStructure(),
                           SpecFuzzyFind, Opts)
       .run({FileName, Command, Preamble, Contents, Pos, VFS, PCHs});
 }
 
+CodeCompleteResult indexOnlyCodeComplete(PathRef FileName, StringRef Contents,
+                                         Position Pos,
+                                         const FuzzyFindRequest &IndexReq,
+                                         const CodeCompleteOptions &Opts) {
+  trace::Span Tracer("Index-only completion");
+  CodeCompleteResult Output;
+  Output.HasMore = true;
+  auto Offset = positionToOffset(Contents, Pos);
+  if (!Offset) {
+    consumeError(Offset.takeError());
+    return Output;
+  }
+  auto Req = speculativeFuzzyFindRequestForCompletion(IndexReq, FileName,
+                                                      Contents, Pos);
+  if (!Opts.Index || !Req)
+    return Output;
+  size_t Begin = *Offset - Req->Query.size();
+  if (Begin > 0 && (Contents[Begin - 1] == '.' || Contents[Begin - 1] == '>' ||
+                    Contents[Begin - 1] == ':'))
+    return Output;
+  // Positions count UTF-16 code units, convert the offsets back.
+  Range TextEditRange;
+  TextEditRange.start = offsetToPosition(Contents, Begin);
+  TextEditRange.end = offsetToPosition(Contents, *Offset);
+
+  Optional<ScopeDistance> ScopeProximity;
+  if (!Req->Scopes.empty())
+    ScopeProximity.emplace(Req->Scopes);
+  Opts.Index->fuzzyFindScored(*Req, [&](const Symbol &Sym, float NameMatch) {
+    SymbolQualitySignals Quality;
+    Quality.merge(Sym);
+    SymbolRelevanceSignals Relevance;
+    Relevance.Query = SymbolRelevanceSignals::CodeComplete;
+    Relevance.NameMatch = NameMatch;
+    if (ScopeProximity)
+      Relevance.ScopeProximityMatch = ScopeProximity.getPointer();
+    Relevance.merge(Sym);
+
+    CodeCompletion C;
+    C.Name = Sym.Name;
+    C.Scope = Sym.Scope;
+    // As in CodeCompletionBuilder, qualify relative to the closest scope.
+    StringRef ShortestQualifier = Sym.Scope;
+    for (StringRef Scope : Req->Scopes) {
+      StringRef Qualifier = Sym.Scope;
+      if (Qualifier.consume_front(Scope) &&
+          Qualifier.size() < ShortestQualifier.size())
+        ShortestQualifier = Qualifier;
+    }
+    C.RequiredQualifier = ShortestQualifier;
+    C.Signature = Sym.Signature;
+    // The simplified argument snippets need CodeCompletionBuilder.
+    if (Opts.EnableFunctionArgSnippets)
+      C.SnippetSuffix = Sym.CompletionSnippetSuffix;
+    C.ReturnType = Sym.ReturnType;
+    if (Opts.IncludeComments)
+      C.Documentation = Sym.Documentation;
+    C.Kind = toCompletionItemKind(Sym.SymInfo.Kind);
+    C.Origin = Sym.Origin;
+    C.Deprecated = Sym.Flags & Symbol::Deprecated;
+    C.CompletionTokenRange = TextEditRange;
+    C.Score = scoreCandidate(Quality, Relevance, Opts.RankingModel);
+    Output.Completions.push_back(std::move(C));
+  });
+  llvm::sort(Output.Completions,
+             [](const CodeCompletion &L, const CodeCompletion &R) {
+               return L.Score.Total > R.Score.Total;
+             });
+  if (Opts.Limit && Output.Completions.size() > Opts.Limit)
+    Output.Completions.resize(Opts.Limit);
+  SPAN_ATTACH(Tracer, "returned_results",
+              int64_t(Output.Completions.size()));
+  return Output;
+}
+
+Optional<std::vector<std::string>> namespaceScopesAt(StringRef Contents,
+                                                     Position Pos) {
+  auto Offset = positionToOffset(Contents, Pos);
+  if (!Offset) {
+    consumeError(Offset.takeError());
+    return None;
+  }
+  // The lexer needs a null-terminated buffer.
+  std::string Code = Contents.substr(0, *Offset);
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = LangOpts.CPlusPlus11 = LangOpts.CPlusPlus17 = true;
+  LangOpts.LineComment = true;
+  Lexer RawLexer(SourceLocation(), LangOpts, Code.data(), Code.data(),
+                 Code.data() + Code.size());
+
+  struct Block {
+    // The name of a namespace, possibly qualified or empty (for anonymous
+    // namespaces and linkage specifications). None for other blocks.
+    Optional<std::string> Namespace;
+    std::vector<std::string> UsingDirectives;
+  };
+  std::vector<Block> Blocks(1);
+  Blocks.front().Namespace.emplace();
+  enum { Other, Using, Extern, Namespace, UsingNamespace } State = Other;
+  std::string Name;
+  Token Tok;
+  RawLexer.LexFromRawLexer(Tok);
+  while (Tok.isNot(tok::eof)) {
+    if (Tok.is(tok::hash) && Tok.isAtStartOfLine()) {
+      // Skip preprocessor directives.
+      do
+        RawLexer.LexFromRawLexer(Tok);
+      while (Tok.isNot(tok::eof) && !Tok.isAtStartOfLine());
+      continue;
+    }
+    bool InName = State == Namespace || State == UsingNamespace;
+    if (Tok.is(tok::raw_identifier)) {
+      StringRef Identifier = Tok.getRawIdentifier();
+      if (Identifier == "using") {
+        State = Using;
+      } else if (Identifier == "extern") {
+        State = Extern;
+      } else if (Identifier == "namespace") {
+        State = State == Using ? UsingNamespace : Namespace;
+        Name.clear();
+      } else if (InName) {
+        Name += Identifier;
+      } else {
+        State = Other;
+      }
+    } else if (Tok.is(tok::coloncolon) && InName) {
+      Name += "::";
+    } else if (Tok.is(tok::string_literal) && State == Extern) {
+      // extern "C"
+    } else if (Tok.is(tok::l_brace)) {
+      Blocks.emplace_back();
+      if (State == Namespace)
+        Blocks.back().Namespace = Name;
+      else if (State == Extern)
+        Blocks.back().Namespace.emplace();
+      State = Other;
+    } else if (Tok.is(tok::r_brace)) {
+      if (Blocks.size() > 1)
+        Blocks.pop_back();
+      State = Other;
+    } else if (Tok.is(tok::semi) && State == UsingNamespace) {
+      Blocks.back().UsingDirectives.push_back(Name);
+      State = Other;
+    } else {
+      State = Other;
+    }
+    RawLexer.LexFromRawLexer(Tok);
+  }
+
+  std::vector<std::string> Enclosing; // Unqualified names, outermost first.
+  for (const Block &B : Blocks) {
+    if (!B.Namespace)
+      return None;
+    SmallVector<StringRef, 4> Parts;
+    StringRef(*B.Namespace).split(Parts, "::", -1, /*KeepEmpty=*/false);
+    Enclosing.insert(Enclosing.end(), Parts.begin(), Parts.end());
+  }
+  std::vector<std::string> Scopes;
+  for (size_t N = Enclosing.size() + 1; N-- > 0;) {
+    std::string Scope;
+    for (size_t I = 0; I < N; ++I)
+      Scope += Enclosing[I] + "::";
+    Scopes.push_back(std::move(Scope));
+  }
+  for (const Block &B : Blocks)
+    for (StringRef Directive : B.UsingDirectives) {
+      Directive.consume_front("::");
+      std::string Scope = (Directive + "::").str();
+      if (Directive.empty() ||
+          std::find(Scopes.begin(), Scopes.end(), Scope) != Scopes.end())
+        continue;
+      Scopes.push_back(std::move(Scope));
+    }
+  return Scopes;
+}
+
 SignatureHelp signatureHelp(PathRef FileName,
                             const tooling::CompileCommand &Command,
                             const PreambleData *Preamble, StringRef Contents,
@@ -30,6 +30,7 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
+#include <chrono>
 #include <future>
 
 namespace clang {
@@ -88,6 +89,17 @@ struct CodeCompleteOptions {
   /// this should be effective for a number of code completions.
   bool SpeculativeIndexRequest = false;
 
+  /// If set along with SpeculativeIndexRequest, and Sema code completion takes
+  /// longer than this, ClangdServer replies with indexOnlyCodeComplete()
+  /// instead. Such results are marked incomplete, so the client asks again as
+  /// the user types. Sema completion still runs to refine the cached request.
+  llvm::Optional<std::chrono::milliseconds> IndexOnlyDeadline;
+
+  /// If true, completions at namespace scope, as found by namespaceScopesAt(),
+  /// are answered by indexOnlyCodeComplete() without running Sema. Symbols of
+  /// the main file come from the dynamic index, as of its last parse.
+  bool IndexOnlyAtNamespaceScope = false;
+
   // Populated internally by clangd, do not set.
   /// If `Index` is set, it is used to augment the code completion
   /// results.
@@ -109,6 +121,15 @@ struct CodeCompleteOptions {
   ///
   /// Such completions can insert scope qualifiers.
   bool AllScopes = false;
+
+  /// How completion candidates are ranked.
+  enum CodeCompletionRankingModel {
+    /// The hand-tuned formulas of SymbolQualitySignals::evaluate() and
+    /// SymbolRelevanceSignals::evaluate().
+    Heuristics,
+    /// The decision forest of evaluateDecisionForest().
+    DecisionForest,
+  } RankingModel = Heuristics;
 };
 
 // Semi-structured representation of a code-complete suggestion for our C++ API.
@@ -229,6 +250,24 @@ CodeCompleteResult codeComplete(PathRef FileName,
                                 CodeCompleteOptions Opts,
                                 SpeculativeFuzzyFind *SpecFuzzyFind = nullptr);
 
+/// Completes the identifier before \p Pos using only Opts.Index, with \p Req
+/// as the index request, e.g. the request of an earlier completion in the
+/// file. Its query is replaced with the identifier. This needs no preamble or
+/// parse, but doesn't know what's in scope, so results are always marked
+/// incomplete. Returns no results in member access and qualified contexts,
+/// where the scopes of Req are likely wrong.
+CodeCompleteResult indexOnlyCodeComplete(PathRef FileName, StringRef Contents,
+                                         Position Pos,
+                                         const FuzzyFindRequest &Req,
+                                         const CodeCompleteOptions &Opts);
+
+/// Returns the scopes visible at \p Pos if a raw lexer finds it at namespace
+/// scope, i.e. not in a class, function body or initializer: the enclosing
+/// namespaces from the innermost to the global one, then the namespaces named
+/// by using-directives. Returns None elsewhere.
+llvm::Optional<std::vector<std::string>> namespaceScopesAt(StringRef Contents,
+                                                           Position Pos);
+
 /// Get signature help at a specified \p Pos in \p FileName.
 SignatureHelp signatureHelp(PathRef FileName,
                             const tooling::CompileCommand &Command,
@@ -9,10 +9,78 @@
 
 #include "Context.h"
 #include <cassert>
+#include <new>
 
 namespace clang {
 namespace clangd {
 
+namespace {
+
+// The size of the small nodes, enough for the values attached to requests,
+// e.g. IDs, cancellation flags and trace spans.
+constexpr std::size_t SmallNodeSize = 128;
+// At most this many free nodes are kept by each thread.
+constexpr unsigned MaxFreeNodes = 256;
+
+struct FreeNode {
+  FreeNode *Next;
+};
+
+// The free nodes of a thread. It's trivially destructible, so that it can
+// still be used while the thread_local contexts are destroyed at thread exit.
+struct FreeList {
+  FreeNode *Head;
+  unsigned Size;
+  // Set at thread exit, once the free nodes were released.
+  bool Closed;
+};
+
+thread_local FreeList FreeNodes = {nullptr, 0, false};
+
+// Releases the free nodes at thread exit.
+struct FreeListCleanup {
+  ~FreeListCleanup() {
+    FreeNodes.Closed = true;
+    while (FreeNode *Node = FreeNodes.Head) {
+      FreeNodes.Head = Node->Next;
+      ::operator delete(Node);
+    }
+    FreeNodes.Size = 0;
+  }
+};
+
+} // namespace
+
+void *Context::allocateNode(std::size_t Size) {
+  if (Size > SmallNodeSize)
+    return ::operator new(Size);
+  if (FreeNode *Node = FreeNodes.Head) {
+    FreeNodes.Head = Node->Next;
+    --FreeNodes.Size;
+    return Node;
+  }
+  // All the small nodes have the same size, to be reused for any value.
+  return ::operator new(SmallNodeSize);
+}
+
+void Context::deallocateNode(void *Ptr, std::size_t Size) {
+  if (Size > SmallNodeSize || FreeNodes.Closed ||
+      FreeNodes.Size == MaxFreeNodes) {
+    ::operator delete(Ptr);
+    return;
+  }
+  if (!FreeNodes.Head) {
+    // Constructed on the first use of the thread, to be destroyed at its
+    // exit.
+    static thread_local FreeListCleanup Cleanup;
+    (void)Cleanup;
+  }
+  FreeNode *Node = static_cast<FreeNode *>(Ptr);
+  Node->Next = FreeNodes.Head;
+  FreeNodes.Head = Node;
+  ++FreeNodes.Size;
+}
+
 Context Context::empty() { return Context(/*DataPtr=*/nullptr); }
 
 Context::Context(std::shared_ptr<const Data> DataPtr)
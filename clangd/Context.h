@@ -17,6 +17,7 @@
 
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Compiler.h"
+#include <cstddef>
 #include <memory>
 #include <type_traits>
 
@@ -67,6 +68,11 @@ public:
 /// You can't add data to an existing context, instead you create a new
 /// immutable context derived from it with extra data added. When you retrieve
 /// data, the context will walk up the parent chain until the key is found.
+///
+/// Deriving a context allocates a single node holding the value and its
+/// reference count. The nodes of small values are recycled by each thread, so
+/// deriving them doesn't call the allocator in steady state. Copying a context
+/// with clone() only increments a reference count.
 class Context {
 public:
   /// Returns an empty root context that contains no data.
@@ -102,7 +108,7 @@ public:
     for (const Data *DataPtr = this->DataPtr.get(); DataPtr != nullptr;
          DataPtr = DataPtr->Parent.get()) {
       if (DataPtr->KeyPtr == &Key)
-        return static_cast<const Type *>(DataPtr->Value->getValuePtr());
+        return static_cast<const Type *>(DataPtr->Value);
     }
     return nullptr;
   }
@@ -121,20 +127,16 @@ public:
   template <class Type>
   Context derive(const Key<Type> &Key,
                  typename std::decay<Type>::type Value) const & {
-    return Context(std::make_shared<Data>(Data{
-        /*Parent=*/DataPtr, &Key,
-        llvm::make_unique<TypedAnyStorage<typename std::decay<Type>::type>>(
-            std::move(Value))}));
+    return Context(makeData<typename std::decay<Type>::type>(
+        /*Parent=*/DataPtr, &Key, std::move(Value)));
   }
 
   template <class Type>
   Context
   derive(const Key<Type> &Key,
          typename std::decay<Type>::type Value) && /* takes ownership */ {
-    return Context(std::make_shared<Data>(Data{
-        /*Parent=*/std::move(DataPtr), &Key,
-        llvm::make_unique<TypedAnyStorage<typename std::decay<Type>::type>>(
-            std::move(Value))}));
+    return Context(makeData<typename std::decay<Type>::type>(
+        /*Parent=*/std::move(DataPtr), &Key, std::move(Value)));
   }
 
   /// Derives a child context, using an anonymous key.
@@ -153,34 +155,67 @@ public:
   Context clone() const;
 
 private:
-  class AnyStorage {
-  public:
-    virtual ~AnyStorage() = default;
-    virtual void *getValuePtr() = 0;
+  struct Data {
+    std::shared_ptr<const Data> Parent;
+    const void *KeyPtr;
+    // Points to the value of the TypedData.
+    const void *Value;
   };
 
-  template <class T> class TypedAnyStorage : public Context::AnyStorage {
+  // The node of a value. It's created by allocate_shared(), so it's destroyed
+  // as a TypedData and Data needs no virtual destructor.
+  template <class T> struct TypedData : Data {
     static_assert(std::is_same<typename std::decay<T>::type, T>::value,
-                  "Argument to TypedAnyStorage must be decayed");
-
-  public:
-    TypedAnyStorage(T &&Value) : Value(std::move(Value)) {}
+                  "Argument to TypedData must be decayed");
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+                  "Over-aligned values can't be stored in a Context");
 
-    void *getValuePtr() override { return &Value; }
+    TypedData(std::shared_ptr<const Data> Parent, const void *KeyPtr,
+              T &&Value)
+        : Data{std::move(Parent), KeyPtr, &Storage}, Storage(std::move(Value)) {
+    }
 
-  private:
-    T Value;
+    // The value is destroyed before the base, so Parent outlives it. We do
+    // that to allow classes stored in Context's child layers to store
+    // references to the data in the parent layers.
+    T Storage;
   };
 
-  struct Data {
-    // We need to make sure Parent outlives the Value, so the order of members
-    // is important. We do that to allow classes stored in Context's child
-    // layers to store references to the data in the parent layers.
-    std::shared_ptr<const Data> Parent;
-    const void *KeyPtr;
-    std::unique_ptr<AnyStorage> Value;
+  // Allocates the node of a value with its reference count. The small nodes
+  // come from a free list of the thread, and are returned to the free list of
+  // the thread releasing them.
+  template <class T> struct NodeAllocator {
+    using value_type = T;
+
+    NodeAllocator() = default;
+    template <class U> NodeAllocator(const NodeAllocator<U> &) {}
+
+    T *allocate(std::size_t N) {
+      return static_cast<T *>(allocateNode(N * sizeof(T)));
+    }
+    void deallocate(T *Ptr, std::size_t N) {
+      deallocateNode(Ptr, N * sizeof(T));
+    }
+
+    template <class U> bool operator==(const NodeAllocator<U> &) const {
+      return true;
+    }
+    template <class U> bool operator!=(const NodeAllocator<U> &) const {
+      return false;
+    }
   };
 
+  static void *allocateNode(std::size_t Size);
+  static void deallocateNode(void *Ptr, std::size_t Size);
+
+  template <class T>
+  static std::shared_ptr<const Data>
+  makeData(std::shared_ptr<const Data> Parent, const void *KeyPtr, T &&Value) {
+    return std::allocate_shared<TypedData<T>>(NodeAllocator<TypedData<T>>(),
+                                              std::move(Parent), KeyPtr,
+                                              std::move(Value));
+  }
+
   std::shared_ptr<const Data> DataPtr;
 };
 
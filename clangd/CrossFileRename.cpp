@@ -0,0 +1,113 @@
+//===--- CrossFileRename.cpp --------------------------------*- C++-*------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "CrossFileRename.h"
+
+#include "Logger.h"
+#include "SourceCode.h"
+#include "URI.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/StringMap.h"
+#include <map>
+#include <set>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// Returns the offset of OldName in Code at the start of a ref, or None if the
+// token there isn't OldName. The ref of a destructor starts at its tilde.
+Optional<size_t> checkOccurrence(StringRef Code,
+                                 const SymbolLocation::Position &Start,
+                                 StringRef OldName,
+                                 const LangOptions &LangOpts) {
+  Position P;
+  P.line = Start.line();
+  P.character = Start.column();
+  auto Offset =
+      positionToOffset(Code, P, /*AllowColumnsBeyondLineLength=*/false);
+  if (!Offset) {
+    consumeError(Offset.takeError());
+    return None;
+  }
+  Lexer RawLexer(SourceLocation(), LangOpts, Code.begin(),
+                 Code.begin() + *Offset, Code.end());
+  Token Tok;
+  RawLexer.LexFromRawLexer(Tok);
+  if (Tok.is(tok::tilde))
+    RawLexer.LexFromRawLexer(Tok);
+  if (!Tok.is(tok::raw_identifier) || Tok.getRawIdentifier() != OldName)
+    return None;
+  return Tok.getRawIdentifier().data() - Code.data();
+}
+
+} // namespace
+
+std::vector<tooling::Replacement>
+renameWithIndex(const SymbolIndex &Index, const DenseSet<SymbolID> &IDs,
+                StringRef OldName, StringRef NewName, PathRef MainFile,
+                vfs::FileSystem &FS, const LangOptions &LangOpts) {
+  // The refs are grouped by file, whose URI is only resolved once.
+  StringMap<std::string> URIToPath;
+  std::map<std::string, std::vector<SymbolLocation::Position>> FileToStarts;
+  RefsRequest Req;
+  Req.IDs = IDs;
+  Index.refsBySymbol(Req, [&](const SymbolID &, ArrayRef<Ref> Refs) {
+    for (const Ref &R : Refs) {
+      auto It = URIToPath.find(R.Location.FileURI);
+      if (It == URIToPath.end()) {
+        std::string Path;
+        if (auto U = URI::parse(R.Location.FileURI)) {
+          if (auto P = URI::resolve(*U, MainFile))
+            Path = std::move(*P);
+          else
+            consumeError(P.takeError());
+        } else {
+          consumeError(U.takeError());
+        }
+        if (Path.empty())
+          log("Could not resolve URI: {0}", R.Location.FileURI);
+        It = URIToPath.try_emplace(R.Location.FileURI, std::move(Path)).first;
+      }
+      // The main file's occurrences come from its AST.
+      if (!It->second.empty() && It->second != MainFile)
+        FileToStarts[It->second].push_back(R.Location.Start);
+    }
+  });
+
+  std::vector<tooling::Replacement> Replacements;
+  unsigned Skipped = 0;
+  for (const auto &FileAndStarts : FileToStarts) {
+    auto Buffer = FS.getBufferForFile(FileAndStarts.first);
+    if (!Buffer) {
+      log("Could not read {0} to rename: {1}", FileAndStarts.first,
+          Buffer.getError().message());
+      Skipped += FileAndStarts.second.size();
+      continue;
+    }
+    StringRef Code = (*Buffer)->getBuffer();
+    // The indexes may report the same ref several times.
+    std::set<size_t> Offsets;
+    for (const SymbolLocation::Position &Start : FileAndStarts.second) {
+      if (auto Offset = checkOccurrence(Code, Start, OldName, LangOpts))
+        Offsets.insert(*Offset);
+      else
+        ++Skipped;
+    }
+    for (size_t Offset : Offsets)
+      Replacements.emplace_back(FileAndStarts.first, Offset, OldName.size(),
+                                NewName);
+  }
+  if (Skipped)
+    log("Skipped {0} stale occurrences of {1} in the index", Skipped, OldName);
+  return Replacements;
+}
+
+} // namespace clangd
+} // namespace clang
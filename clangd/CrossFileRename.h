@@ -0,0 +1,46 @@
+//===--- CrossFileRename.h ----------------------------------*- C++-*------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Renames the occurrences of a symbol in the files that aren't parsed, from
+// the refs of an index.
+//
+//===----------------------------------------------------------------------===//
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_CROSSFILERENAME_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_CROSSFILERENAME_H
+
+#include "Path.h"
+#include "index/Index.h"
+#include "clang/Basic/LangOptions.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// Returns the replacements renaming \p OldName to \p NewName at the refs of
+/// the symbols \p IDs in \p Index, except those in \p MainFile, whose AST is
+/// authoritative.
+///
+/// The files aren't parsed: the refs of a file are grouped, the file is read
+/// from \p FS once, and only the token at each ref is lexed with
+/// \p LangOpts. A ref where it isn't \p OldName, e.g. in a file changed since
+/// it was indexed, is skipped.
+std::vector<tooling::Replacement>
+renameWithIndex(const SymbolIndex &Index, const llvm::DenseSet<SymbolID> &IDs,
+                llvm::StringRef OldName, llvm::StringRef NewName,
+                PathRef MainFile, llvm::vfs::FileSystem &FS,
+                const LangOptions &LangOpts);
+
+} // namespace clangd
+} // namespace clang
+
+#endif
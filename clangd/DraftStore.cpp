@@ -10,10 +10,59 @@
 #include "DraftStore.h"
 #include "SourceCode.h"
 #include "llvm/Support/Errc.h"
+#include <algorithm>
 
 using namespace llvm;
 namespace clang {
 namespace clangd {
+namespace {
+
+// Appends the offsets of the lines starting in Text, which is at Offset.
+void addLineStarts(StringRef Text, size_t Offset,
+                   std::vector<size_t> &LineStarts) {
+  for (size_t NL = Text.find('\n'); NL != StringRef::npos;
+       NL = Text.find('\n', NL + 1))
+    LineStarts.push_back(Offset + NL + 1);
+}
+
+} // namespace
+
+void DraftStore::replace(Draft &D, size_t Offset, size_t Length,
+                         StringRef Text) {
+  D.Contents.replace(Offset, Length, Text.data(), Text.size());
+  // Lines starting within the replaced range are gone, lines after it move.
+  auto &Starts = D.LineStarts;
+  size_t First =
+      std::upper_bound(Starts.begin(), Starts.end(), Offset) - Starts.begin();
+  size_t Last = std::upper_bound(Starts.begin() + First, Starts.end(),
+                                 Offset + Length) -
+                Starts.begin();
+  for (size_t I = Last; I < Starts.size(); ++I)
+    Starts[I] = Starts[I] - Length + Text.size();
+  std::vector<size_t> Inserted;
+  addLineStarts(Text, Offset, Inserted);
+  Starts.erase(Starts.begin() + First, Starts.begin() + Last);
+  Starts.insert(Starts.begin() + First, Inserted.begin(), Inserted.end());
+}
+
+Expected<size_t> DraftStore::positionToOffset(const Draft &D, Position P) {
+  if (P.line >= 0 && P.character >= 0 &&
+      static_cast<size_t>(P.line) < D.LineStarts.size()) {
+    size_t Start = D.LineStarts[P.line];
+    size_t End = static_cast<size_t>(P.line) + 1 < D.LineStarts.size()
+                     ? D.LineStarts[P.line + 1] - 1
+                     : D.Contents.size();
+    Position InLine = P;
+    InLine.line = 0;
+    Expected<size_t> Offset = clangd::positionToOffset(
+        StringRef(D.Contents).slice(Start, End), InLine, false);
+    if (Offset)
+      return Start + *Offset;
+    consumeError(Offset.takeError());
+  }
+  // Produce the error for the whole document.
+  return clangd::positionToOffset(D.Contents, P, false);
+}
 
 Optional<std::string> DraftStore::getDraft(PathRef File) const {
   std::lock_guard<std::mutex> Lock(Mutex);
@@ -22,7 +71,7 @@ Optional<std::string> DraftStore::getDraft(PathRef File) const {
   if (It == Drafts.end())
     return None;
 
-  return It->second;
+  return It->second.Contents;
 }
 
 std::vector<Path> DraftStore::getActiveFiles() const {
@@ -35,10 +84,21 @@ std::vector<Path> DraftStore::getActiveFiles() const {
   return ResultVector;
 }
 
+void DraftStore::profile(MemoryTree &MT) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (const auto &D : Drafts)
+    MT.child(D.getKey())
+        .addUsage(D.getValue().Contents.capacity() +
+                  D.getValue().LineStarts.capacity() * sizeof(size_t));
+}
+
 void DraftStore::addDraft(PathRef File, StringRef Contents) {
   std::lock_guard<std::mutex> Lock(Mutex);
 
-  Drafts[File] = Contents;
+  Draft &D = Drafts[File];
+  D.Contents = Contents;
+  D.LineStarts = {0};
+  addLineStarts(Contents, 0, D.LineStarts);
 }
 
 Expected<std::string>
@@ -53,29 +113,44 @@ DraftStore::updateDraft(PathRef File,
         llvm::errc::invalid_argument);
   }
 
-  std::string Contents = EntryIt->second;
+  Draft &D = EntryIt->second;
+
+  // Changes are applied in place. Each entry can restore the draft as it was
+  // before the corresponding change, in case a later change fails.
+  struct Undo {
+    size_t Offset;
+    size_t Length;
+    std::string Replaced;
+  };
+  std::vector<Undo> Undos;
+  auto Fail = [&](Error E) -> Expected<std::string> {
+    for (auto It = Undos.rbegin(); It != Undos.rend(); ++It)
+      replace(D, It->Offset, It->Length, It->Replaced);
+    return std::move(E);
+  };
 
   for (const TextDocumentContentChangeEvent &Change : Changes) {
     if (!Change.range) {
-      Contents = Change.text;
+      Undos.push_back({0, Change.text.size(), D.Contents});
+      replace(D, 0, D.Contents.size(), Change.text);
       continue;
     }
 
     const Position &Start = Change.range->start;
-    Expected<size_t> StartIndex = positionToOffset(Contents, Start, false);
+    Expected<size_t> StartIndex = positionToOffset(D, Start);
     if (!StartIndex)
-      return StartIndex.takeError();
+      return Fail(StartIndex.takeError());
 
     const Position &End = Change.range->end;
-    Expected<size_t> EndIndex = positionToOffset(Contents, End, false);
+    Expected<size_t> EndIndex = positionToOffset(D, End);
     if (!EndIndex)
-      return EndIndex.takeError();
+      return Fail(EndIndex.takeError());
 
     if (*EndIndex < *StartIndex)
-      return make_error<StringError>(
+      return Fail(make_error<StringError>(
           formatv("Range's end position ({0}) is before start position ({1})",
                   End, Start),
-          llvm::errc::invalid_argument);
+          llvm::errc::invalid_argument));
 
     // Since the range length between two LSP positions is dependent on the
     // contents of the buffer we compute the range length between the start and
@@ -84,29 +159,21 @@ DraftStore::updateDraft(PathRef File,
 
     // EndIndex and StartIndex are in bytes, but Change.rangeLength is in UTF-16
     // code units.
-    ssize_t ComputedRangeLength =
-        lspLength(Contents.substr(*StartIndex, *EndIndex - *StartIndex));
+    StringRef Replaced = StringRef(D.Contents).slice(*StartIndex, *EndIndex);
+    ssize_t ComputedRangeLength = lspLength(Replaced);
 
     if (Change.rangeLength && ComputedRangeLength != *Change.rangeLength)
-      return make_error<StringError>(
+      return Fail(make_error<StringError>(
           formatv("Change's rangeLength ({0}) doesn't match the "
                   "computed range length ({1}).",
                   *Change.rangeLength, *EndIndex - *StartIndex),
-          llvm::errc::invalid_argument);
-
-    std::string NewContents;
-    NewContents.reserve(*StartIndex + Change.text.length() +
-                        (Contents.length() - *EndIndex));
-
-    NewContents = Contents.substr(0, *StartIndex);
-    NewContents += Change.text;
-    NewContents += Contents.substr(*EndIndex);
+          llvm::errc::invalid_argument));
 
-    Contents = std::move(NewContents);
+    Undos.push_back({*StartIndex, Change.text.size(), Replaced.str()});
+    replace(D, *StartIndex, *EndIndex - *StartIndex, Change.text);
   }
 
-  EntryIt->second = Contents;
-  return Contents;
+  return D.Contents;
 }
 
 void DraftStore::removeDraft(PathRef File) {
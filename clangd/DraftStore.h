@@ -10,6 +10,7 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_DRAFTSTORE_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_DRAFTSTORE_H
 
+#include "MemoryTree.h"
 #include "Path.h"
 #include "Protocol.h"
 #include "clang/Basic/LLVM.h"
@@ -24,6 +25,10 @@ namespace clangd {
 /// A thread-safe container for files opened in a workspace, addressed by
 /// filenames. The contents are owned by the DraftStore. This class supports
 /// both whole and incremental updates of the documents.
+///
+/// Incremental updates are applied in place, and positions are resolved with
+/// an index of line offsets, so that the cost of an edit doesn't depend on the
+/// size of the document (except for the copy of the new version).
 class DraftStore {
 public:
   /// \return Contents of the stored document.
@@ -49,9 +54,23 @@ public:
   /// Remove the draft from the store.
   void removeDraft(PathRef File);
 
+  /// Records the memory used by each draft in \p MT.
+  void profile(MemoryTree &MT) const;
+
 private:
+  struct Draft {
+    std::string Contents;
+    /// Offset of the start of each line in Contents.
+    std::vector<size_t> LineStarts;
+  };
+  /// Replaces \p Length bytes at \p Offset in \p D with \p Text, and updates
+  /// its line offsets.
+  static void replace(Draft &D, size_t Offset, size_t Length, StringRef Text);
+  /// Like positionToOffset(D.Contents, P, false).
+  static llvm::Expected<size_t> positionToOffset(const Draft &D, Position P);
+
   mutable std::mutex Mutex;
-  llvm::StringMap<std::string> Drafts;
+  llvm::StringMap<Draft> Drafts;
 };
 
 } // namespace clangd
@@ -97,5 +97,96 @@ IntrusiveRefCntPtr<vfs::FileSystem> PreambleFileStatusCache::getConsumingFS(
   return IntrusiveRefCntPtr<CacheVFS>(new CacheVFS(std::move(FS), *this));
 }
 
+size_t PreambleFileStatusCache::getUsedBytes() const {
+  // Each bucket holds an entry pointer and a hash.
+  size_t Bytes =
+      StatCache.getNumBuckets() * (sizeof(void *) + sizeof(unsigned));
+  Bytes += MainFilePath.capacity();
+  for (const auto &Entry : StatCache)
+    Bytes += sizeof(Entry) + Entry.getKeyLength() + 1 +
+             Entry.second.getName().size();
+  return Bytes;
+}
+
+Optional<vfs::Status> SharedFileStatusCache::lookup(StringRef Path) const {
+  Shard &S = shardFor(Path);
+  std::lock_guard<std::mutex> Lock(S.Mu);
+  auto I = S.StatCache.find(Path);
+  if (I != S.StatCache.end())
+    return I->getValue();
+  return None;
+}
+
+void SharedFileStatusCache::update(StringRef Path, vfs::Status Status) {
+  Shard &S = shardFor(Path);
+  std::lock_guard<std::mutex> Lock(S.Mu);
+  S.StatCache[Path] = std::move(Status);
+}
+
+void SharedFileStatusCache::invalidate(StringRef Path) {
+  Shard &S = shardFor(Path);
+  std::lock_guard<std::mutex> Lock(S.Mu);
+  S.StatCache.erase(Path);
+}
+
+IntrusiveRefCntPtr<vfs::FileSystem>
+SharedFileStatusCache::getFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> FS) {
+  class SharedCacheFS : public vfs::ProxyFileSystem {
+  public:
+    SharedCacheFS(IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                  SharedFileStatusCache &StatCache)
+        : ProxyFileSystem(std::move(FS)), StatCache(StatCache) {}
+
+    ErrorOr<std::unique_ptr<vfs::File>>
+    openFileForRead(const Twine &Path) override {
+      auto File = getUnderlyingFS().openFileForRead(Path);
+      if (!File || !*File)
+        return File;
+      SmallString<128> AbsPath;
+      if (makeAbsolute(Path, AbsPath))
+        if (auto S = File->get()->status())
+          StatCache.update(AbsPath, std::move(*S));
+      return File;
+    }
+
+    ErrorOr<vfs::Status> status(const Twine &Path) override {
+      SmallString<128> AbsPath;
+      if (!makeAbsolute(Path, AbsPath))
+        return getUnderlyingFS().status(Path);
+      if (auto S = StatCache.lookup(AbsPath))
+        return vfs::Status::copyWithNewName(*S, Path);
+      auto S = getUnderlyingFS().status(Path);
+      if (S)
+        StatCache.update(AbsPath, *S);
+      return S;
+    }
+
+  private:
+    bool makeAbsolute(const Twine &Path, SmallString<128> &AbsPath) {
+      Path.toVector(AbsPath);
+      if (getUnderlyingFS().makeAbsolute(AbsPath))
+        return false;
+      sys::path::remove_dots(AbsPath, /*remove_dot_dot=*/false);
+      return true;
+    }
+
+    SharedFileStatusCache &StatCache;
+  };
+  return IntrusiveRefCntPtr<SharedCacheFS>(
+      new SharedCacheFS(std::move(FS), *this));
+}
+
+size_t SharedFileStatusCache::getUsedBytes() const {
+  size_t Bytes = 0;
+  for (const Shard &S : Shards) {
+    std::lock_guard<std::mutex> Lock(S.Mu);
+    Bytes += S.StatCache.getNumBuckets() * (sizeof(void *) + sizeof(unsigned));
+    for (const auto &Entry : S.StatCache)
+      Bytes += sizeof(Entry) + Entry.getKeyLength() + 1 +
+               Entry.second.getName().size();
+  }
+  return Bytes;
+}
+
 } // namespace clangd
 } // namespace clang
@@ -10,9 +10,13 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_FS_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_FS_H
 
+#include "FSProvider.h"
 #include "clang/Basic/LLVM.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/VirtualFileSystem.h"
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -61,11 +65,72 @@ public:
   IntrusiveRefCntPtr<llvm::vfs::FileSystem>
   getConsumingFS(IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS) const;
 
+  /// Returns the estimated memory used by the cache.
+  size_t getUsedBytes() const;
+
 private:
   std::string MainFilePath;
   llvm::StringMap<llvm::vfs::Status> StatCache;
 };
 
+/// Records the status of existing files, shared by all the filesystems of a
+/// process: preamble builds of different TUs, background indexing and code
+/// completion all stat the same headers, which is slow on network filesystems.
+///
+/// The cache is keyed by absolute path, and entries are kept until
+/// invalidate() is called for them, e.g. when the client reports that a file
+/// changed. Changes it isn't told about are not seen until then. Accesses are
+/// spread over several independently locked shards, so concurrent builds
+/// rarely wait for each other.
+class SharedFileStatusCache {
+public:
+  /// \p Path is an absolute path.
+  llvm::Optional<llvm::vfs::Status> lookup(llvm::StringRef Path) const;
+  void update(llvm::StringRef Path, llvm::vfs::Status S);
+  /// Drops the cached status of \p Path.
+  void invalidate(llvm::StringRef Path);
+
+  /// Returns a VFS that answers status() from the cache, and records the
+  /// status of the files it stats or opens.
+  ///
+  /// Note that the returned VFS should not outlive the cache.
+  IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+  getFileSystem(IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS);
+
+  /// Returns the estimated memory used by the cache.
+  size_t getUsedBytes() const;
+
+private:
+  struct Shard {
+    mutable std::mutex Mu;
+    llvm::StringMap<llvm::vfs::Status> StatCache;
+  };
+  static constexpr unsigned NumShards = 16;
+  Shard &shardFor(llvm::StringRef Path) const {
+    return Shards[llvm::hash_value(Path) % NumShards];
+  }
+
+  mutable Shard Shards[NumShards];
+};
+
+/// Provides the filesystems of \p Base, with stats cached in a cache shared by
+/// all of them.
+class StatCachingFSProvider : public FileSystemProvider {
+public:
+  StatCachingFSProvider(const FileSystemProvider &Base) : Base(Base) {}
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>
+  getFileSystem() const override {
+    return Cache.getFileSystem(Base.getFileSystem());
+  }
+
+  SharedFileStatusCache &cache() const { return Cache; }
+
+private:
+  const FileSystemProvider &Base;
+  mutable SharedFileStatusCache Cache;
+};
+
 } // namespace clangd
 } // namespace clang
 
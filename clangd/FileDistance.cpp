@@ -147,6 +147,7 @@ unsigned FileDistance::distance(StringRef Path) {
 }
 
 unsigned URIDistance::distance(StringRef URI) {
+  std::lock_guard<std::mutex> Lock(Mu);
   auto R = Cache.try_emplace(hash_value(URI), FileDistance::Unreachable);
   if (!R.second)
     return R.first->getSecond();
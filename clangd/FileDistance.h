@@ -49,6 +49,7 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Support/StringSaver.h"
 #include <memory>
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -90,6 +91,7 @@ private:
 // Supports lookups like FileDistance, but the lookup keys are URIs.
 // We convert each of the sources to the scheme of the URI and do a FileDistance
 // comparison on the bodies.
+// This is thread-safe, so that requests can share the memoized results.
 class URIDistance {
 public:
   // \p Sources must contain absolute paths, not URIs.
@@ -105,8 +107,9 @@ private:
   // Returns the FileDistance for a URI scheme, creating it if needed.
   FileDistance &forScheme(llvm::StringRef Scheme);
 
+  std::mutex Mu;
   // We cache the results using the original strings so we can skip URI parsing.
-  llvm::DenseMap<llvm::hash_code, unsigned> Cache;
+  llvm::DenseMap<llvm::hash_code, unsigned> Cache; /* GUARDED_BY(Mu) */
   llvm::StringMap<SourceParams> Sources;
   llvm::StringMap<std::unique_ptr<FileDistance>> ByScheme;
   FileDistanceOptions Opts;
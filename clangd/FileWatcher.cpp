@@ -0,0 +1,144 @@
+//===--- FileWatcher.cpp - Watch directories for file changes ---*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FileWatcher.h"
+#include "Logger.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+#include <cerrno>
+#include <cstring>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+
+bool FileWatcher::isSupported() {
+#ifdef __linux__
+  return true;
+#else
+  return false;
+#endif
+}
+
+FileWatcher::FileWatcher(ChangeCallback OnChange,
+                         std::chrono::milliseconds Quiet)
+    : OnChange(std::move(OnChange)), Quiet(Quiet) {
+#ifdef __linux__
+  NotifyFD = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (NotifyFD < 0) {
+    elog("Failed to watch files: {0}", std::strerror(errno));
+    return;
+  }
+  if (pipe(WakeFDs) != 0) {
+    elog("Failed to watch files: {0}", std::strerror(errno));
+    close(NotifyFD);
+    NotifyFD = -1;
+    return;
+  }
+  Thread = std::thread([this] { run(); });
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+  if (NotifyFD < 0)
+    return;
+  char Stop = 0;
+  while (write(WakeFDs[1], &Stop, 1) < 0 && errno == EINTR)
+    ;
+  Thread.join();
+  close(NotifyFD);
+  close(WakeFDs[0]);
+  close(WakeFDs[1]);
+#endif
+}
+
+void FileWatcher::watchDirectory(StringRef Dir) {
+#ifdef __linux__
+  if (NotifyFD < 0)
+    return;
+  std::lock_guard<std::mutex> Lock(Mu);
+  if (!WatchedDirs.insert(Dir).second)
+    return;
+  int WD = inotify_add_watch(NotifyFD, Dir.str().c_str(),
+                             IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                                 IN_MOVED_FROM | IN_MOVED_TO);
+  if (WD < 0) {
+    vlog("Failed to watch {0}: {1}", Dir, std::strerror(errno));
+    return;
+  }
+  Dirs[WD] = Dir;
+#endif
+}
+
+void FileWatcher::run() {
+#ifdef __linux__
+  using Clock = std::chrono::steady_clock;
+  StringSet<> Pending;
+  Clock::time_point FirstChange, LastChange;
+  while (true) {
+    int Timeout = -1; // No changes to report, wait for some.
+    if (!Pending.empty()) {
+      auto Deadline = std::min(LastChange + Quiet, FirstChange + 10 * Quiet);
+      Timeout = std::max<int64_t>(
+          0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                 Deadline - Clock::now())
+                 .count());
+    }
+    pollfd FDs[] = {{NotifyFD, POLLIN, 0}, {WakeFDs[0], POLLIN, 0}};
+    int Ready = poll(FDs, 2, Timeout);
+    if (Ready < 0) {
+      if (errno == EINTR)
+        continue;
+      elog("Stopped watching files: {0}", std::strerror(errno));
+      return;
+    }
+    if (FDs[1].revents)
+      return;
+    if (Ready == 0) {
+      std::vector<std::string> Changed;
+      for (const auto &File : Pending)
+        Changed.push_back(File.first());
+      Pending.clear();
+      vlog("{0} watched files changed", Changed.size());
+      OnChange(std::move(Changed));
+      continue;
+    }
+
+    alignas(inotify_event) char Buffer[4096];
+    ssize_t Size = read(NotifyFD, Buffer, sizeof(Buffer));
+    if (Size <= 0)
+      continue;
+    std::lock_guard<std::mutex> Lock(Mu);
+    for (char *P = Buffer; P < Buffer + Size;) {
+      const auto *Event = reinterpret_cast<const inotify_event *>(P);
+      P += sizeof(inotify_event) + Event->len;
+      if (Event->mask & IN_Q_OVERFLOW)
+        elog("Too many changes to watched files, some were missed");
+      auto Dir = Dirs.find(Event->wd);
+      if (Event->len == 0 || Dir == Dirs.end())
+        continue;
+      SmallString<128> Path(Dir->second);
+      sys::path::append(Path, Event->name);
+      if (Pending.empty())
+        FirstChange = Clock::now();
+      LastChange = Clock::now();
+      Pending.insert(Path);
+    }
+  }
+#endif
+}
+
+} // namespace clangd
+} // namespace clang
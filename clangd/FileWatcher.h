@@ -0,0 +1,73 @@
+//===--- FileWatcher.h - Watch directories for file changes -----*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// FileWatcher reports files that change on disk, e.g. when switching
+// branches, so that the results derived from them can be recomputed.
+// It is currently implemented with inotify on Linux only, on other platforms
+// no changes are reported.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_FILEWATCHER_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_FILEWATCHER_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// Watches directories (non-recursively) and reports the files created,
+/// modified, moved or deleted in them.
+/// Changes are coalesced: a batch is reported once no more changes happened
+/// for a quiet period, or after ten quiet periods while changes keep coming.
+/// So a burst of changes, e.g. from a checkout, is reported at once.
+class FileWatcher {
+public:
+  /// Receives the absolute paths of the changed files, without duplicates.
+  /// Runs on the watcher's thread.
+  using ChangeCallback = std::function<void(std::vector<std::string>)>;
+
+  FileWatcher(ChangeCallback OnChange,
+              std::chrono::milliseconds Quiet = std::chrono::milliseconds(500));
+  /// Stops watching, pending changes are not reported.
+  ~FileWatcher();
+
+  /// Starts watching \p Dir, an absolute path. No-op if it's already watched.
+  /// Threadsafe.
+  void watchDirectory(llvm::StringRef Dir);
+
+  /// Whether changes can be watched on this platform.
+  static bool isSupported();
+
+private:
+  void run();
+
+  ChangeCallback OnChange;
+  const std::chrono::milliseconds Quiet;
+  int NotifyFD = -1;
+  // Written to when the watcher is destroyed, to stop the thread.
+  int WakeFDs[2] = {-1, -1};
+  std::mutex Mu;
+  llvm::StringSet<> WatchedDirs;          /* GUARDED_BY(Mu) */
+  llvm::DenseMap<int, std::string> Dirs; /* GUARDED_BY(Mu) */
+  std::thread Thread;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif
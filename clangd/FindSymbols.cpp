@@ -9,8 +9,8 @@
 #include "FindSymbols.h"
 
 #include "AST.h"
+#include "Cancellation.h"
 #include "ClangdUnit.h"
-#include "FuzzyMatch.h"
 #include "Logger.h"
 #include "Quality.h"
 #include "SourceCode.h"
@@ -124,25 +124,20 @@ getWorkspaceSymbols(StringRef Query, int Limit, const SymbolIndex *const Index,
     Req.Limit = Limit;
   TopN<ScoredSymbolInfo, ScoredSymbolGreater> Top(
       Req.Limit ? *Req.Limit : std::numeric_limits<size_t>::max());
-  FuzzyMatcher Filter(Req.Query);
-  Index->fuzzyFind(Req, [HintPath, &Top, &Filter](const Symbol &Sym) {
+  CachedURIResolver URIs(HintPath);
+  Index->fuzzyFindScored(Req, [&URIs, &Top](const Symbol &Sym,
+                                            float NameMatch) {
     // Prefer the definition over e.g. a function declaration in a header
     auto &CD = Sym.Definition ? Sym.Definition : Sym.CanonicalDeclaration;
-    auto Uri = URI::parse(CD.FileURI);
-    if (!Uri) {
-      log("Workspace symbol: Could not parse URI '{0}' for symbol '{1}'.",
-          CD.FileURI, Sym.Name);
-      return;
-    }
-    auto Path = URI::resolve(*Uri, HintPath);
+    auto Path = URIs.resolve(CD.FileURI);
     if (!Path) {
       log("Workspace symbol: Could not resolve path for URI '{0}' for symbol "
-          "'{1}'.",
-          Uri->toString(), Sym.Name);
+          "'{1}': {2}",
+          CD.FileURI, Sym.Name, Path.takeError());
       return;
     }
     Location L;
-    L.uri = URIForFile((*Path));
+    L.uri = URIForFile(Path->str());
     Position Start, End;
     Start.line = CD.Start.line();
     Start.character = CD.Start.column();
@@ -159,13 +154,7 @@ getWorkspaceSymbols(StringRef Query, int Limit, const SymbolIndex *const Index,
     Quality.merge(Sym);
     SymbolRelevanceSignals Relevance;
     Relevance.Query = SymbolRelevanceSignals::Generic;
-    if (auto NameMatch = Filter.match(Sym.Name))
-      Relevance.NameMatch = *NameMatch;
-    else {
-      log("Workspace symbol: {0} didn't match query {1}", Sym.Name,
-          Filter.pattern());
-      return;
-    }
+    Relevance.NameMatch = NameMatch;
     Relevance.merge(Sym);
     auto Score =
         evaluateSymbolAndRelevance(Quality.evaluate(), Relevance.evaluate());
@@ -174,6 +163,8 @@ getWorkspaceSymbols(StringRef Query, int Limit, const SymbolIndex *const Index,
 
     Top.push({Score, std::move(Info)});
   });
+  if (isCancelled())
+    return make_error<CancelledError>();
   for (auto &R : std::move(Top).items())
     Result.push_back(std::move(R.second));
   return Result;
@@ -319,7 +310,12 @@ std::vector<DocumentSymbol> collectDocSymbols(ParsedAST &AST) {
 } // namespace
 
 llvm::Expected<std::vector<DocumentSymbol>> getDocumentSymbols(ParsedAST &AST) {
-  return collectDocSymbols(AST);
+  // Editors ask for the outline after every edit, and often more than once.
+  if (const auto *Cached = AST.getCachedDocumentSymbols())
+    return *Cached;
+  std::vector<DocumentSymbol> Symbols = collectDocSymbols(AST);
+  AST.cacheDocumentSymbols(Symbols);
+  return std::move(Symbols);
 }
 
 } // namespace clangd
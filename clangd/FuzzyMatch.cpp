@@ -68,6 +68,10 @@ constexpr int FuzzyMatcher::MaxPat;
 constexpr int FuzzyMatcher::MaxWord;
 
 static char lower(char C) { return C >= 'A' && C <= 'Z' ? C + ('a' - 'A') : C; }
+// Summarizes the characters of a string in a 64-bit mask, ignoring case.
+// Distinct characters may share a bit, so the mask of a word that contains all
+// the pattern characters is a superset of the pattern's, but not conversely.
+static uint64_t charBit(char C) { return uint64_t{1} << (lower(C) & 63); }
 // A "negative infinity" score that won't overflow.
 // We use this to mark unreachable states and forbidden solutions.
 // Score field is 15 bits wide, min value is -2^14, we use half of that.
@@ -79,8 +83,11 @@ FuzzyMatcher::FuzzyMatcher(StringRef Pattern)
     : PatN(std::min<int>(MaxPat, Pattern.size())),
       ScoreScale(PatN ? float{1} / (PerfectBonus * PatN) : 0), WordN(0) {
   std::copy(Pattern.begin(), Pattern.begin() + PatN, Pat);
-  for (int I = 0; I < PatN; ++I)
+  PatChars = 0;
+  for (int I = 0; I < PatN; ++I) {
     LowPat[I] = lower(Pat[I]);
+    PatChars |= charBit(Pat[I]);
+  }
   Scores[0][0][Miss] = {0, Miss};
   Scores[0][0][Match] = {AwfulScore, Miss};
   for (int P = 0; P <= PatN; ++P)
@@ -106,10 +113,30 @@ Optional<float> FuzzyMatcher::match(StringRef Word) {
   // If the pattern is as long as the word, we have an exact string match,
   // since every pattern character must match something.
   if (WordN == PatN)
-    Score *= 2; // May not be perfect 2 if case differs in a significant way.
+    Score *= MaxScore; // May not be perfect if case differs significantly.
   return Score;
 }
 
+void FuzzyMatcher::match(ArrayRef<StringRef> Words,
+                         MutableArrayRef<Optional<float>> Scores) {
+  assert(Words.size() == Scores.size());
+  for (size_t I = 0; I < Words.size(); ++I) {
+    // Most candidates lack some pattern character: rejecting them by their
+    // character mask avoids copying and lowercasing them.
+    if (PatN) {
+      StringRef Word = Words[I].take_front(MaxWord);
+      uint64_t WordChars = 0;
+      for (char C : Word)
+        WordChars |= charBit(C);
+      if (PatChars & ~WordChars) {
+        Scores[I] = None;
+        continue;
+      }
+    }
+    Scores[I] = match(Words[I]);
+  }
+}
+
 // We get CharTypes from a lookup table. Each is 2 bits, 4 fit in each byte.
 // The top 6 bits of the char select the byte, the bottom 2 select the offset.
 // e.g. 'q' = 010100 01 = byte 28 (55), bits 3-2 (01) -> Lower.
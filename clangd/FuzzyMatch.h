@@ -79,6 +79,12 @@ public:
   // "Super" scores in (1,2] are possible if the pattern is the full word.
   // Characters beyond MaxWord are ignored.
   llvm::Optional<float> match(llvm::StringRef Word);
+  // The highest score match() can return, for a match of the full word.
+  constexpr static float MaxScore = 2;
+  // Scores each of Words as match() would, cheaply rejecting words that lack
+  // some pattern character. Scores.size() must equal Words.size().
+  void match(llvm::ArrayRef<llvm::StringRef> Words,
+             llvm::MutableArrayRef<llvm::Optional<float>> Scores);
 
   llvm::StringRef pattern() const { return llvm::StringRef(Pat, PatN); }
   bool empty() const { return PatN == 0; }
@@ -111,6 +117,7 @@ private:
   char LowPat[MaxPat];      // Pattern in lowercase
   CharRole PatRole[MaxPat]; // Pattern segmentation info
   CharTypeSet PatTypeSet;   // Bitmask of 1<<CharType for all Pattern characters
+  uint64_t PatChars;        // Bitmask of charBit() for all Pattern characters
   float ScoreScale;         // Normalizes scores for the pattern length.
 
   // Word data is initialized on each call to match(), mostly by init().
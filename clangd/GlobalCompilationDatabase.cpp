@@ -8,7 +8,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "GlobalCompilationDatabase.h"
+#include "LazyCompilationDatabase.h"
 #include "Logger.h"
+#include "clang/Driver/Types.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -30,6 +32,36 @@ GlobalCompilationDatabase::getFallbackCommand(PathRef File) const {
                                  /*Output=*/"");
 }
 
+tooling::CompileCommand transferCompileCommand(tooling::CompileCommand TU,
+                                               PathRef Header) {
+  // The file may be named relative to the directory of the command.
+  auto Absolute = [&](StringRef Path) -> SmallString<128> {
+    SmallString<128> Result(Path);
+    if (!sys::path::is_absolute(Path)) {
+      Result = TU.Directory;
+      sys::path::append(Result, Path);
+    }
+    sys::path::remove_dots(Result, /*remove_dot_dot=*/true);
+    return Result;
+  };
+  SmallString<128> File = Absolute(TU.Filename);
+  auto Arg = llvm::find_if(TU.CommandLine, [&](const std::string &Arg) {
+    return Absolute(Arg) == File;
+  });
+  if (Arg != TU.CommandLine.end())
+    Arg = TU.CommandLine.erase(Arg);
+  // The right language isn't implied by a .h extension.
+  auto TUType = driver::types::lookupTypeForExtension(
+      sys::path::extension(TU.Filename).trim('.'));
+  auto HeaderType = driver::types::lookupTypeForExtension(
+      sys::path::extension(Header).trim('.'));
+  if (driver::types::isCXX(TUType) && !driver::types::isCXX(HeaderType))
+    Arg = std::next(TU.CommandLine.insert(Arg, "-xc++-header"));
+  TU.CommandLine.insert(Arg, Header.str());
+  TU.Filename = Header;
+  return TU;
+}
+
 DirectoryBasedGlobalCompilationDatabase::
     DirectoryBasedGlobalCompilationDatabase(Optional<Path> CompileCommandsDir)
     : CompileCommandsDir(std::move(CompileCommandsDir)) {}
@@ -52,16 +84,32 @@ DirectoryBasedGlobalCompilationDatabase::getCompileCommand(
 }
 
 std::pair<tooling::CompilationDatabase *, /*Cached*/ bool>
-DirectoryBasedGlobalCompilationDatabase::getCDBInDirLocked(PathRef Dir) const {
+DirectoryBasedGlobalCompilationDatabase::getCDBInDir(PathRef Dir) const {
+  CachedCDB *Entry;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto &Slot = CompilationDatabases[Dir];
+    if (!Slot)
+      Slot = llvm::make_unique<CachedCDB>();
+    Entry = Slot.get();
+  }
+  std::lock_guard<std::mutex> Lock(Entry->Mutex);
   // FIXME(ibiryukov): Invalidate cached compilation databases on changes
-  auto CachedIt = CompilationDatabases.find(Dir);
-  if (CachedIt != CompilationDatabases.end())
-    return {CachedIt->second.get(), true};
-  std::string Error = "";
-  auto CDB = tooling::CompilationDatabase::loadFromDirectory(Dir, Error);
-  auto Result = CDB.get();
-  CompilationDatabases.insert(std::make_pair(Dir, std::move(CDB)));
-  return {Result, false};
+  if (Entry->Loaded)
+    return {Entry->CDB.get(), true};
+  std::unique_ptr<tooling::CompilationDatabase> CDB;
+  // compile_commands.json is read lazily, commands of files missing from it
+  // are interpolated as JSONCompilationDatabase does.
+  if (auto Lazy = LazyJSONCompilationDatabase::loadFromDirectory(Dir)) {
+    CDB = tooling::inferMissingCompileCommands(std::move(*Lazy));
+  } else {
+    consumeError(Lazy.takeError());
+    std::string Error = "";
+    CDB = tooling::CompilationDatabase::loadFromDirectory(Dir, Error);
+  }
+  Entry->CDB = std::move(CDB);
+  Entry->Loaded = true;
+  return {Entry->CDB.get(), false};
 }
 
 tooling::CompilationDatabase *
@@ -74,15 +122,14 @@ DirectoryBasedGlobalCompilationDatabase::getCDBForFile(
 
   tooling::CompilationDatabase *CDB = nullptr;
   bool Cached = false;
-  std::lock_guard<std::mutex> Lock(Mutex);
   if (CompileCommandsDir) {
-    std::tie(CDB, Cached) = getCDBInDirLocked(*CompileCommandsDir);
+    std::tie(CDB, Cached) = getCDBInDir(*CompileCommandsDir);
     if (Project && CDB)
       Project->SourceRoot = *CompileCommandsDir;
   } else {
     for (auto Path = path::parent_path(File); !CDB && !Path.empty();
          Path = path::parent_path(Path)) {
-      std::tie(CDB, Cached) = getCDBInDirLocked(Path);
+      std::tie(CDB, Cached) = getCDBInDir(Path);
       if (Project && CDB)
         Project->SourceRoot = Path;
     }
@@ -120,7 +167,7 @@ OverlayCDB::getCompileCommand(PathRef File, ProjectInfo *Project) const {
 tooling::CompileCommand OverlayCDB::getFallbackCommand(PathRef File) const {
   auto Cmd = Base ? Base->getFallbackCommand(File)
                   : GlobalCompilationDatabase::getFallbackCommand(File);
-  std::lock_guard<std::mutex> Lock(Mutex);
+  // FallbackFlags never change, so this needs no lock.
   Cmd.CommandLine.insert(Cmd.CommandLine.end(), FallbackFlags.begin(),
                          FallbackFlags.end());
   return Cmd;
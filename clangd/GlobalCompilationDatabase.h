@@ -78,13 +78,20 @@ private:
   tooling::CompilationDatabase *getCDBForFile(PathRef File,
                                               ProjectInfo *) const;
   std::pair<tooling::CompilationDatabase *, /*Cached*/ bool>
-  getCDBInDirLocked(PathRef File) const;
-
+  getCDBInDir(PathRef File) const;
+
+  /// A directory's compilation database, loaded under its own lock so that
+  /// loading one doesn't block lookups in other directories.
+  struct CachedCDB {
+    std::mutex Mutex;
+    std::unique_ptr<clang::tooling::CompilationDatabase> CDB;
+    bool Loaded = false;
+  };
   mutable std::mutex Mutex;
   /// Caches compilation databases loaded from directories(keys are
   /// directories).
-  mutable llvm::StringMap<std::unique_ptr<clang::tooling::CompilationDatabase>>
-      CompilationDatabases;
+  mutable llvm::StringMap<std::unique_ptr<CachedCDB>>
+      CompilationDatabases; /* GUARDED_BY(Mutex) */
 
   /// Used for command argument pointing to folder where compile_commands.json
   /// is located.
@@ -117,6 +124,12 @@ private:
   CommandChanged::Subscription BaseChanged;
 };
 
+/// Turns the command compiling \p TU into one parsing \p Header on its own,
+/// with the flags of the translation unit. Headers that aren't in the
+/// compilation database get the command of a file including them this way.
+tooling::CompileCommand transferCompileCommand(tooling::CompileCommand TU,
+                                               PathRef Header);
+
 } // namespace clangd
 } // namespace clang
 
@@ -90,6 +90,15 @@ void IncludeStructure::recordInclude(StringRef IncludingName,
   IncludeChildren[Parent].push_back(Child);
 }
 
+void IncludeStructure::recordSameIncludes(StringRef Name, StringRef Other) {
+  auto It = NameToIndex.find(Other);
+  if (It == NameToIndex.end() || Name == Other)
+    return;
+  auto Children = IncludeChildren.lookup(It->second);
+  auto &NameChildren = IncludeChildren[fileIndex(Name)];
+  NameChildren.append(Children.begin(), Children.end());
+}
+
 unsigned IncludeStructure::fileIndex(StringRef Name) {
   auto R = NameToIndex.try_emplace(Name, RealPathNames.size());
   if (R.second)
@@ -129,6 +138,14 @@ StringMap<unsigned> IncludeStructure::includeDepth(StringRef Root) const {
   return Result;
 }
 
+std::vector<std::string> IncludeStructure::includedFiles() const {
+  std::vector<std::string> Result;
+  for (const auto &Name : RealPathNames)
+    if (!Name.empty())
+      Result.push_back(Name);
+  return Result;
+}
+
 void IncludeInserter::addExisting(const Inclusion &Inc) {
   IncludedHeaders.insert(Inc.Written);
   if (!Inc.Resolved.empty())
@@ -137,6 +154,19 @@ void IncludeInserter::addExisting(const Inclusion &Inc) {
 
 /// FIXME(ioeric): we might not want to insert an absolute include path if the
 /// path is not shortened.
+Optional<std::string> IncludePathCache::get(PathRef Header) const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto It = Spellings.find(Header);
+  if (It == Spellings.end())
+    return None;
+  return It->second;
+}
+
+void IncludePathCache::set(PathRef Header, std::string Spelling) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  Spellings[Header] = std::move(Spelling);
+}
+
 bool IncludeInserter::shouldInsertInclude(
     const HeaderFile &DeclaringHeader, const HeaderFile &InsertedHeader) const {
   assert(DeclaringHeader.valid() && InsertedHeader.valid());
@@ -154,6 +184,9 @@ IncludeInserter::calculateIncludePath(const HeaderFile &DeclaringHeader,
   assert(DeclaringHeader.valid() && InsertedHeader.valid());
   if (InsertedHeader.Verbatim)
     return InsertedHeader.File;
+  if (PathCache)
+    if (auto Cached = PathCache->get(InsertedHeader.File))
+      return std::move(*Cached);
   bool IsSystem = false;
   std::string Suggested = HeaderSearchInfo.suggestPathToFileForDiagnostics(
       InsertedHeader.File, BuildDir, &IsSystem);
@@ -161,6 +194,8 @@ IncludeInserter::calculateIncludePath(const HeaderFile &DeclaringHeader,
     Suggested = "<" + Suggested + ">";
   else
     Suggested = "\"" + Suggested + "\"";
+  if (PathCache)
+    PathCache->set(InsertedHeader.File, Suggested);
   return Suggested;
 }
 
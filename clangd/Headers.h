@@ -21,6 +21,7 @@
 #include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/VirtualFileSystem.h"
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -68,11 +69,18 @@ public:
   // Usually it should be SM.getFileEntryForID(SM.getMainFileID())->getName().
   llvm::StringMap<unsigned> includeDepth(llvm::StringRef Root) const;
 
+  // Absolute paths of all the included files, directly or transitively.
+  std::vector<std::string> includedFiles() const;
+
   // This updates IncludeDepth(), but not MainFileIncludes.
   void recordInclude(llvm::StringRef IncludingName,
                      llvm::StringRef IncludedName,
                      llvm::StringRef IncludedRealName);
 
+  // Records that \p Name includes the files \p Other includes, e.g. a main
+  // file using the preamble built for another file with the same includes.
+  void recordSameIncludes(llvm::StringRef Name, llvm::StringRef Other);
+
 private:
   // Identifying files in a way that persists from preamble build to subsequent
   // builds is surprisingly hard. FileID is unavailable in InclusionDirective(),
@@ -90,14 +98,31 @@ private:
 std::unique_ptr<PPCallbacks>
 collectIncludeStructureCallback(const SourceManager &SM, IncludeStructure *Out);
 
+/// Remembers how headers are spelled in #include directives. The spellings
+/// only depend on the header search paths and build directory, so a cache can
+/// be shared by all the requests using a preamble. Thread-safe.
+class IncludePathCache {
+public:
+  /// Returns the spelling stored for the absolute path \p Header, if any.
+  llvm::Optional<std::string> get(PathRef Header) const;
+  void set(PathRef Header, std::string Spelling);
+
+private:
+  mutable std::mutex Mu;
+  llvm::StringMap<std::string> Spellings /* GUARDED_BY(Mu) */;
+};
+
 // Calculates insertion edit for including a new header in a file.
 class IncludeInserter {
 public:
+  /// If \p PathCache is set, it must be for the header search paths of
+  /// \p HeaderSearchInfo and \p BuildDir.
   IncludeInserter(StringRef FileName, StringRef Code,
                   const format::FormatStyle &Style, StringRef BuildDir,
-                  HeaderSearch &HeaderSearchInfo)
+                  HeaderSearch &HeaderSearchInfo,
+                  IncludePathCache *PathCache = nullptr)
       : FileName(FileName), Code(Code), BuildDir(BuildDir),
-        HeaderSearchInfo(HeaderSearchInfo),
+        HeaderSearchInfo(HeaderSearchInfo), PathCache(PathCache),
         Inserter(FileName, Code, Style.IncludeStyle) {}
 
   void addExisting(const Inclusion &Inc);
@@ -137,6 +162,7 @@ private:
   StringRef Code;
   StringRef BuildDir;
   HeaderSearch &HeaderSearchInfo;
+  IncludePathCache *PathCache; // May be null.
   llvm::StringSet<> IncludedHeaders; // Both written and resolved.
   tooling::HeaderIncludes Inserter;  // Computers insertion replacement.
 };
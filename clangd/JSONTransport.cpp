@@ -10,6 +10,7 @@
 #include "Protocol.h" // For LSPError
 #include "Transport.h"
 #include "llvm/Support/Errno.h"
+#include <chrono>
 
 using namespace llvm;
 namespace clang {
@@ -33,6 +34,17 @@ json::Object encodeError(Error E) {
   };
 }
 
+// Counts the bytes written to it, and discards them.
+class CountingOstream : public raw_ostream {
+public:
+  ~CountingOstream() override { flush(); }
+
+private:
+  uint64_t Count = 0;
+  void write_impl(const char *, size_t Size) override { Count += Size; }
+  uint64_t current_pos() const override { return Count; }
+};
+
 Error decodeError(const json::Object &O) {
   std::string Msg = O.getString("message").getValueOr("Unspecified error");
   if (auto Code = O.getInteger("code"))
@@ -101,29 +113,35 @@ private:
   // Dispatches incoming message to Handler onNotify/onCall/onReply.
   bool handleMessage(json::Value Message, MessageHandler &Handler);
   // Writes outgoing message to Out stream.
+  // The message is serialized twice, to measure it and then to write it, so
+  // that large responses are streamed rather than copied into a string.
   void sendMessage(json::Value Message) {
-    std::string S;
-    raw_string_ostream OS(S);
-    OS << formatv(Pretty ? "{0:2}" : "{0}", Message);
-    OS.flush();
-    Out << "Content-Length: " << S.size() << "\r\n\r\n" << S;
+    const char *Format = Pretty ? "{0:2}" : "{0}";
+    CountingOstream Size;
+    Size << formatv(Format, Message);
+    Out << "Content-Length: " << Size.tell() << "\r\n\r\n"
+        << formatv(Format, Message);
     Out.flush();
-    vlog(">>> {0}\n", S);
+    vlog(Pretty ? ">>> {0:2}\n" : ">>> {0}\n", Message);
   }
 
   // Read raw string messages from input stream.
-  Optional<std::string> readRawMessage() {
+  // The result points into Buffer, and is valid until the next read.
+  Optional<StringRef> readRawMessage() {
     return Style == JSONStreamStyle::Delimited ? readDelimitedMessage()
                                                : readStandardMessage();
   }
-  Optional<std::string> readDelimitedMessage();
-  Optional<std::string> readStandardMessage();
+  Optional<StringRef> readDelimitedMessage();
+  Optional<StringRef> readStandardMessage();
 
   std::FILE *In;
   raw_ostream &Out;
   raw_ostream &InMirror;
   bool Pretty;
   JSONStreamStyle Style;
+  // Reused by every message, so that reading one usually doesn't allocate.
+  std::string Buffer;
+  std::string Line;
 };
 
 bool JSONTransport::handleMessage(json::Value Message,
@@ -186,14 +204,17 @@ bool readLine(std::FILE *In, std::string &Out) {
   }
 }
 
+// Buffers above this size are freed after use, rather than kept for the next
+// message, so that a huge message doesn't hold on to its memory.
+static constexpr size_t MaxRetainedBuffer = 16 << 20; // 16M
+
 // Returns None when:
 //  - ferror() or feof() are set.
 //  - Content-Length is missing or empty (protocol error)
-Optional<std::string> JSONTransport::readStandardMessage() {
+Optional<StringRef> JSONTransport::readStandardMessage() {
   // A Language Server Protocol message starts with a set of HTTP headers,
   // delimited  by \r\n, and terminated by an empty line (\r\n).
   unsigned long long ContentLength = 0;
-  std::string Line;
   while (true) {
     if (feof(In) || ferror(In) || !readLine(In, Line))
       return None;
@@ -238,22 +259,23 @@ Optional<std::string> JSONTransport::readStandardMessage() {
     return None;
   }
 
-  std::string JSON(ContentLength, '\0');
+  if (Buffer.capacity() > MaxRetainedBuffer)
+    std::string().swap(Buffer);
+  Buffer.resize(ContentLength);
   for (size_t Pos = 0, Read; Pos < ContentLength; Pos += Read) {
     // Handle EINTR which is sent when a debugger attaches on some platforms.
-    Read = sys::RetryAfterSignal(0u, ::fread, &JSON[Pos], 1,
+    Read = sys::RetryAfterSignal(0u, ::fread, &Buffer[Pos], 1,
                                  ContentLength - Pos, In);
     if (Read == 0) {
       elog("Input was aborted. Read only {0} bytes of expected {1}.", Pos,
            ContentLength);
       return None;
     }
-    InMirror << StringRef(&JSON[Pos], Read);
+    InMirror << StringRef(&Buffer[Pos], Read);
     clearerr(In); // If we're done, the error was transient. If we're not done,
                   // either it was transient or we'll see it again on retry.
-    Pos += Read;
   }
-  return std::move(JSON);
+  return StringRef(Buffer);
 }
 
 // For lit tests we support a simplified syntax:
@@ -261,9 +283,8 @@ Optional<std::string> JSONTransport::readStandardMessage() {
 // - lines starting with # are ignored.
 // This is a testing path, so favor simplicity over performance here.
 // When returning None, feof() or ferror() will be set.
-Optional<std::string> JSONTransport::readDelimitedMessage() {
-  std::string JSON;
-  std::string Line;
+Optional<StringRef> JSONTransport::readDelimitedMessage() {
+  Buffer.clear();
   while (readLine(In, Line)) {
     InMirror << Line;
     auto LineRef = StringRef(Line).trim();
@@ -274,16 +295,77 @@ Optional<std::string> JSONTransport::readDelimitedMessage() {
     if (LineRef.rtrim() == "---")
       break;
 
-    JSON += Line;
+    Buffer += Line;
   }
 
   if (ferror(In)) {
     elog("Input error while reading message!");
     return None;
   }
-  return std::move(JSON); // Including at EOF
+  return StringRef(Buffer); // Including at EOF
 }
 
+// Records the messages received by a transport, then dispatches them to the
+// real handler.
+class RecordingTransport : public Transport,
+                           private Transport::MessageHandler {
+public:
+  RecordingTransport(std::unique_ptr<Transport> Base, raw_ostream &Out)
+      : Base(std::move(Base)), Out(Out),
+        Start(std::chrono::steady_clock::now()) {}
+
+  void notify(StringRef Method, json::Value Params) override {
+    Base->notify(Method, std::move(Params));
+  }
+  void call(StringRef Method, json::Value Params, json::Value ID) override {
+    Base->call(Method, std::move(Params), std::move(ID));
+  }
+  void reply(json::Value ID, Expected<json::Value> Result) override {
+    Base->reply(std::move(ID), std::move(Result));
+  }
+
+  Error loop(MessageHandler &Handler) override {
+    this->Handler = &Handler;
+    return Base->loop(*this);
+  }
+
+private:
+  bool onNotify(StringRef Method, json::Value Params) override {
+    record(json::Object{
+        {"jsonrpc", "2.0"}, {"method", Method}, {"params", Params}});
+    return Handler->onNotify(Method, std::move(Params));
+  }
+  bool onCall(StringRef Method, json::Value Params, json::Value ID) override {
+    record(json::Object{{"jsonrpc", "2.0"},
+                        {"id", ID},
+                        {"method", Method},
+                        {"params", Params}});
+    return Handler->onCall(Method, std::move(Params), std::move(ID));
+  }
+  bool onReply(json::Value ID, Expected<json::Value> Result) override {
+    if (Result) {
+      record(json::Object{{"jsonrpc", "2.0"}, {"id", ID}, {"result", *Result}});
+      return Handler->onReply(std::move(ID), std::move(Result));
+    }
+    json::Object Err = encodeError(Result.takeError());
+    record(json::Object{{"jsonrpc", "2.0"}, {"id", ID}, {"error", Err}});
+    return Handler->onReply(std::move(ID), decodeError(Err));
+  }
+
+  // Writes Message in the delimited style, after its arrival time.
+  void record(json::Value Message) {
+    auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - Start);
+    Out << "# t=" << Elapsed.count() << "\n" << Message << "\n---\n";
+    Out.flush();
+  }
+
+  std::unique_ptr<Transport> Base;
+  raw_ostream &Out;
+  std::chrono::steady_clock::time_point Start;
+  MessageHandler *Handler = nullptr;
+};
+
 } // namespace
 
 std::unique_ptr<Transport> newJSONTransport(std::FILE *In, raw_ostream &Out,
@@ -292,5 +374,10 @@ std::unique_ptr<Transport> newJSONTransport(std::FILE *In, raw_ostream &Out,
   return llvm::make_unique<JSONTransport>(In, Out, InMirror, Pretty, Style);
 }
 
+std::unique_ptr<Transport>
+newRecordingTransport(std::unique_ptr<Transport> Base, raw_ostream &Out) {
+  return llvm::make_unique<RecordingTransport>(std::move(Base), Out);
+}
+
 } // namespace clangd
 } // namespace clang
@@ -0,0 +1,369 @@
+//===--- LazyCompilationDatabase.cpp - Lazy compile_commands.json ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The saved index starts with a magic string, then:
+//   - Size    : uint64, of the compile_commands.json
+//   - ModTime : uint64, of the compile_commands.json
+//   - Count   : uint32, the number of entries
+// followed by a record per entry:
+//   - Offset, Length : uint64, of the entry in the compile_commands.json
+//   - PathSize       : uint32
+//   - Path           : char[PathSize], the key in Files
+//
+//===----------------------------------------------------------------------===//
+
+#include "LazyCompilationDatabase.h"
+#include "Logger.h"
+#include "Trace.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+constexpr char Magic[] = "CDBIDX01";
+constexpr size_t MagicSize = sizeof(Magic) - 1;
+
+Error makeError(const Twine &Msg) {
+  return make_error<StringError>(Msg, inconvertibleErrorCode());
+}
+
+std::string normalizePath(StringRef Directory, StringRef File) {
+  SmallString<128> Path;
+  if (sys::path::is_absolute(File))
+    Path = File;
+  else {
+    Path = Directory;
+    sys::path::append(Path, File);
+  }
+  sys::path::native(Path);
+  sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  return Path.str();
+}
+
+// Finds the bounds of the entries of a compile_commands.json, without
+// parsing their commands.
+class Scanner {
+public:
+  Scanner(StringRef Data) : Data(Data) {}
+
+  // Calls Found with the bounds, "directory" and "file" of each entry.
+  Error scan(function_ref<void(size_t Begin, size_t End, StringRef Directory,
+                               StringRef File)>
+                 Found) {
+    if (!consume('['))
+      return error("expected [");
+    if (consume(']'))
+      return Error::success();
+    do {
+      skipSpace();
+      size_t Begin = Pos;
+      if (!consume('{'))
+        return error("expected {");
+      std::string Directory, File;
+      if (!consume('}')) {
+        do {
+          StringRef Key;
+          if (!readString(Key) || !consume(':'))
+            return error("expected key");
+          skipSpace();
+          if (Key == "\"directory\"" || Key == "\"file\"") {
+            StringRef Value;
+            if (!readString(Value))
+              return error("expected string");
+            auto Decoded = json::parse(Value);
+            if (!Decoded)
+              return Decoded.takeError();
+            (Key == "\"file\"" ? File : Directory) =
+                Decoded->getAsString().getValueOr("").str();
+          } else if (!skipValue()) {
+            return error("expected value");
+          }
+        } while (consume(','));
+        if (!consume('}'))
+          return error("expected }");
+      }
+      Found(Begin, Pos, Directory, File);
+    } while (consume(','));
+    if (!consume(']'))
+      return error("expected ]");
+    return Error::success();
+  }
+
+private:
+  Error error(const Twine &Msg) {
+    return makeError(Msg + " at offset " + Twine(Pos));
+  }
+
+  void skipSpace() {
+    while (Pos < Data.size() && isSpace(Data[Pos]))
+      ++Pos;
+  }
+  static bool isSpace(char C) {
+    return C == ' ' || C == '\t' || C == '\r' || C == '\n';
+  }
+
+  bool consume(char C) {
+    skipSpace();
+    if (Pos == Data.size() || Data[Pos] != C)
+      return false;
+    ++Pos;
+    return true;
+  }
+
+  // Reads a string literal, including its quotes and escapes.
+  bool readString(StringRef &Literal) {
+    skipSpace();
+    size_t Begin = Pos;
+    if (Pos == Data.size() || Data[Pos] != '"')
+      return false;
+    for (++Pos; Pos < Data.size(); ++Pos) {
+      if (Data[Pos] == '\\')
+        ++Pos;
+      else if (Data[Pos] == '"') {
+        Literal = Data.slice(Begin, ++Pos);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool skipValue() {
+    skipSpace();
+    if (Pos == Data.size())
+      return false;
+    StringRef Literal;
+    switch (Data[Pos]) {
+    case '"':
+      return readString(Literal);
+    case '[':
+    case '{': {
+      unsigned Depth = 0;
+      while (Pos < Data.size()) {
+        char C = Data[Pos];
+        if (C == '"') {
+          if (!readString(Literal))
+            return false;
+          continue;
+        }
+        ++Pos;
+        if (C == '[' || C == '{')
+          ++Depth;
+        else if ((C == ']' || C == '}') && --Depth == 0)
+          return true;
+      }
+      return false;
+    }
+    default: // A number, true, false or null.
+      size_t Begin = Pos;
+      while (Pos < Data.size() && !isSpace(Data[Pos]) && Data[Pos] != ',' &&
+             Data[Pos] != '}' && Data[Pos] != ']')
+        ++Pos;
+      return Pos > Begin;
+    }
+  }
+
+  StringRef Data;
+  size_t Pos = 0;
+};
+
+} // namespace
+
+Expected<std::unique_ptr<LazyJSONCompilationDatabase>>
+LazyJSONCompilationDatabase::loadFromDirectory(PathRef Dir) {
+  trace::Span Tracer("LazyCDB load");
+  SmallString<128> JSONPath(Dir);
+  sys::path::append(JSONPath, "compile_commands.json");
+  sys::fs::file_status Status;
+  if (auto EC = sys::fs::status(JSONPath, Status))
+    return errorCodeToError(EC);
+  // Large files are mapped rather than read.
+  auto Buffer = MemoryBuffer::getFile(JSONPath, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return errorCodeToError(Buffer.getError());
+  std::unique_ptr<LazyJSONCompilationDatabase> CDB(
+      new LazyJSONCompilationDatabase(std::move(*Buffer)));
+  uint64_t ModTime =
+      Status.getLastModificationTime().time_since_epoch().count();
+
+  SmallString<128> IndexPath(Dir);
+  sys::path::append(IndexPath, ".clangd-index");
+  bool CanSave = sys::fs::is_directory(IndexPath);
+  sys::path::append(IndexPath, "compile_commands.idx");
+  if (CanSave) {
+    if (auto Index = MemoryBuffer::getFile(IndexPath)) {
+      if (auto Err = CDB->readIndex((*Index)->getBuffer(), ModTime)) {
+        vlog("Ignoring compile commands index {0}: {1}", IndexPath,
+             std::move(Err));
+        CDB->Files.clear();
+      } else {
+        return std::move(CDB);
+      }
+    }
+  }
+  if (auto Err = CDB->scan())
+    return std::move(Err);
+  if (CanSave)
+    CDB->writeIndex(IndexPath, ModTime);
+  return std::move(CDB);
+}
+
+Error LazyJSONCompilationDatabase::scan() {
+  return Scanner(Buffer->getBuffer())
+      .scan([&](size_t Begin, size_t End, StringRef Directory, StringRef File) {
+        if (File.empty())
+          return;
+        Files[normalizePath(Directory, File)].push_back({Begin, End - Begin});
+      });
+}
+
+Error LazyJSONCompilationDatabase::readIndex(StringRef Data, uint64_t ModTime) {
+  auto Consume = [&](size_t N) -> Optional<StringRef> {
+    if (Data.size() < N)
+      return None;
+    StringRef Result = Data.take_front(N);
+    Data = Data.drop_front(N);
+    return Result;
+  };
+  auto Header = Consume(MagicSize + 20);
+  if (!Header || !Header->startswith(StringRef(Magic, MagicSize)))
+    return makeError("bad header");
+  const char *P = Header->data() + MagicSize;
+  if (support::endian::read64le(P) != Buffer->getBufferSize() ||
+      support::endian::read64le(P + 8) != ModTime)
+    return makeError("stale");
+  for (uint32_t Count = support::endian::read32le(P + 16); Count > 0;
+       --Count) {
+    auto Record = Consume(20);
+    if (!Record)
+      return makeError("truncated");
+    Entry E{support::endian::read64le(Record->data()),
+            support::endian::read64le(Record->data() + 8)};
+    auto Path = Consume(support::endian::read32le(Record->data() + 16));
+    if (!Path || E.Offset + E.Length > Buffer->getBufferSize())
+      return makeError("truncated");
+    Files[*Path].push_back(E);
+  }
+  return Error::success();
+}
+
+void LazyJSONCompilationDatabase::writeIndex(PathRef IndexPath,
+                                             uint64_t ModTime) const {
+  // Write to a temporary file first, so that readers never see half an index.
+  int FD;
+  SmallString<128> TempPath;
+  if (auto EC = sys::fs::createUniqueFile(IndexPath + ".tmp-%%%%%%%%", FD,
+                                          TempPath)) {
+    vlog("Failed to save compile commands index {0}: {1}", IndexPath,
+         EC.message());
+    return;
+  }
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    char Header[20];
+    support::endian::write64le(Header, Buffer->getBufferSize());
+    support::endian::write64le(Header + 8, ModTime);
+    uint32_t Count = 0;
+    for (const auto &F : Files)
+      Count += F.second.size();
+    support::endian::write32le(Header + 16, Count);
+    OS << StringRef(Magic, MagicSize) << StringRef(Header, sizeof(Header));
+    for (const auto &F : Files)
+      for (const Entry &E : F.second) {
+        char Record[20];
+        support::endian::write64le(Record, E.Offset);
+        support::endian::write64le(Record + 8, E.Length);
+        support::endian::write32le(Record + 16, F.first().size());
+        OS << StringRef(Record, sizeof(Record)) << F.first();
+      }
+  }
+  if (auto EC = sys::fs::rename(TempPath, IndexPath)) {
+    vlog("Failed to save compile commands index {0}: {1}", IndexPath,
+         EC.message());
+    sys::fs::remove(TempPath);
+  }
+}
+
+Optional<tooling::CompileCommand>
+LazyJSONCompilationDatabase::parse(const Entry &E) const {
+  auto JSON = json::parse(Buffer->getBuffer().substr(E.Offset, E.Length));
+  if (!JSON) {
+    elog("Bad compile_commands.json entry: {0}", JSON.takeError());
+    return None;
+  }
+  const json::Object *O = JSON->getAsObject();
+  if (!O)
+    return None;
+  auto Directory = O->getString("directory");
+  auto File = O->getString("file");
+  if (!Directory || !File)
+    return None;
+  std::vector<std::string> Argv;
+  if (const json::Array *Args = O->getArray("arguments")) {
+    for (const json::Value &Arg : *Args)
+      if (auto S = Arg.getAsString())
+        Argv.push_back(*S);
+  } else if (auto Command = O->getString("command")) {
+    // Splits the command as JSONCompilationDatabase does on this platform.
+    BumpPtrAllocator Arena;
+    StringSaver Saver(Arena);
+    SmallVector<const char *, 32> Tokens;
+    if (Triple(sys::getProcessTriple()).isOSWindows())
+      cl::TokenizeWindowsCommandLine(*Command, Saver, Tokens);
+    else
+      cl::TokenizeGNUCommandLine(*Command, Saver, Tokens);
+    Argv.assign(Tokens.begin(), Tokens.end());
+  } else {
+    return None;
+  }
+  return tooling::CompileCommand(*Directory, *File, std::move(Argv),
+                                 O->getString("output").getValueOr(""));
+}
+
+std::vector<tooling::CompileCommand>
+LazyJSONCompilationDatabase::getCompileCommands(StringRef FilePath) const {
+  std::vector<tooling::CompileCommand> Commands;
+  auto It = Files.find(normalizePath("", FilePath));
+  if (It == Files.end())
+    return Commands;
+  for (const Entry &E : It->second)
+    if (auto Cmd = parse(E))
+      Commands.push_back(std::move(*Cmd));
+  return Commands;
+}
+
+std::vector<std::string> LazyJSONCompilationDatabase::getAllFiles() const {
+  std::vector<std::string> Result;
+  Result.reserve(Files.size());
+  for (const auto &F : Files)
+    Result.push_back(F.first());
+  return Result;
+}
+
+std::vector<tooling::CompileCommand>
+LazyJSONCompilationDatabase::getAllCompileCommands() const {
+  std::vector<tooling::CompileCommand> Commands;
+  for (const auto &F : Files)
+    for (const Entry &E : F.second)
+      if (auto Cmd = parse(E))
+        Commands.push_back(std::move(*Cmd));
+  return Commands;
+}
+
+} // namespace clangd
+} // namespace clang
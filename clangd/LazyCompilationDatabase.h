@@ -0,0 +1,73 @@
+//===--- LazyCompilationDatabase.h - Lazy compile_commands.json --*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Parsing the compile_commands.json of a large project takes seconds, and the
+// parsed commands take several times the size of the file, while clangd only
+// needs the commands of the files that are open or being indexed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_LAZYCOMPILATIONDATABASE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_LAZYCOMPILATIONDATABASE_H
+
+#include "Path.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// A compilation database reading a compile_commands.json on demand.
+///
+/// The file is mapped into memory, and scanned once for the offsets of the
+/// entries of each file: only their "directory" and "file" strings are
+/// decoded. An entry is fully parsed when its commands are requested.
+///
+/// If the directory has a .clangd-index/ (written by the background index),
+/// the offsets are saved there in compile_commands.idx, and reused while the
+/// size and modification time of the compile_commands.json are unchanged.
+class LazyJSONCompilationDatabase : public tooling::CompilationDatabase {
+public:
+  /// Loads \p Dir/compile_commands.json. Does not interpolate commands for
+  /// files missing from it, see tooling::inferMissingCompileCommands().
+  static llvm::Expected<std::unique_ptr<LazyJSONCompilationDatabase>>
+  loadFromDirectory(PathRef Dir);
+
+  std::vector<tooling::CompileCommand>
+  getCompileCommands(llvm::StringRef FilePath) const override;
+  std::vector<std::string> getAllFiles() const override;
+  std::vector<tooling::CompileCommand> getAllCompileCommands() const override;
+
+private:
+  struct Entry {
+    uint64_t Offset;
+    uint64_t Length;
+  };
+
+  LazyJSONCompilationDatabase(std::unique_ptr<llvm::MemoryBuffer> Buffer)
+      : Buffer(std::move(Buffer)) {}
+  // Finds the entries of the file in Buffer.
+  llvm::Error scan();
+  llvm::Error readIndex(llvm::StringRef Data, uint64_t ModTime);
+  void writeIndex(PathRef IndexPath, uint64_t ModTime) const;
+  llvm::Optional<tooling::CompileCommand> parse(const Entry &E) const;
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  // Keys are absolute paths, with native separators and no dots.
+  llvm::StringMap<std::vector<Entry>> Files;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_LAZYCOMPILATIONDATABASE_H
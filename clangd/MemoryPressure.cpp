@@ -0,0 +1,93 @@
+//===--- MemoryPressure.cpp - Respond to high memory usage ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MemoryPressure.h"
+#include "Logger.h"
+#include "Trace.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+
+size_t getResidentMemory() {
+#ifdef __linux__
+  // The second field of statm is the number of resident pages.
+  auto Statm = MemoryBuffer::getFileAsStream("/proc/self/statm");
+  if (!Statm)
+    return 0;
+  StringRef Resident = (*Statm)->getBuffer().split(' ').second.split(' ').first;
+  size_t Pages;
+  if (Resident.getAsInteger(10, Pages))
+    return 0;
+  return Pages * sys::Process::getPageSize();
+#else
+  return 0;
+#endif
+}
+
+void releaseFreeMemory() {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+}
+
+MemoryPressureMonitor::MemoryPressureMonitor(
+    size_t LimitBytes, std::chrono::milliseconds Interval,
+    std::function<void(unsigned Level)> Relieve, std::function<void()> Cleared,
+    std::function<size_t()> ResidentMemory)
+    : Relieve(std::move(Relieve)), Cleared(std::move(Cleared)),
+      ResidentMemory(std::move(ResidentMemory)) {
+  Thread = std::thread([this, LimitBytes, Interval] {
+    run(LimitBytes, Interval);
+  });
+}
+
+MemoryPressureMonitor::~MemoryPressureMonitor() {
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Stopping = true;
+  }
+  CV.notify_one();
+  Thread.join();
+}
+
+void MemoryPressureMonitor::run(size_t LimitBytes,
+                                std::chrono::milliseconds Interval) {
+  unsigned Level = 0;
+  bool Relieved = false;
+  std::unique_lock<std::mutex> Lock(Mu);
+  while (!CV.wait_for(Lock, Interval, [&] { return Stopping; })) {
+    size_t Resident = ResidentMemory();
+    if (Resident <= LimitBytes) {
+      Level = 0;
+      if (Relieved && Resident <= LimitBytes / 4 * 3) {
+        log("Resident memory of {0} MB is back under the limit of {1} MB",
+            Resident >> 20, LimitBytes >> 20);
+        Relieved = false;
+        Cleared();
+      }
+      continue;
+    }
+    log("Resident memory of {0} MB exceeds the limit of {1} MB, freeing "
+        "memory (level {2})",
+        Resident >> 20, LimitBytes >> 20, Level);
+    trace::metric("MemoryPressure", Level);
+    Relieved = true;
+    Relieve(Level++);
+  }
+}
+
+} // namespace clangd
+} // namespace clang
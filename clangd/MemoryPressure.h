@@ -0,0 +1,61 @@
+//===--- MemoryPressure.h - Respond to high memory usage ---------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_MEMORYPRESSURE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_MEMORYPRESSURE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace clang {
+namespace clangd {
+
+/// Returns the resident memory of the process in bytes, or 0 if unknown.
+size_t getResidentMemory();
+
+/// Returns free memory of the allocator to the operating system, where
+/// supported (glibc keeps freed memory cached otherwise).
+void releaseFreeMemory();
+
+/// Checks the resident memory of the process periodically. While it exceeds
+/// the limit, calls Relieve with the number of checks it exceeded the limit
+/// before, so that more disruptive actions are only taken when cheaper ones
+/// didn't help. Once it falls to 3/4 of the limit, calls Cleared so that the
+/// actions can be undone. The margin keeps them from flipping at the limit.
+/// Does nothing where the resident memory is unknown.
+class MemoryPressureMonitor {
+public:
+  /// \p ResidentMemory is replaced by tests.
+  MemoryPressureMonitor(
+      size_t LimitBytes, std::chrono::milliseconds Interval,
+      std::function<void(unsigned Level)> Relieve,
+      std::function<void()> Cleared,
+      std::function<size_t()> ResidentMemory = getResidentMemory);
+  ~MemoryPressureMonitor();
+
+private:
+  void run(size_t LimitBytes, std::chrono::milliseconds Interval);
+
+  std::function<void(unsigned)> Relieve;
+  std::function<void()> Cleared;
+  std::function<size_t()> ResidentMemory;
+  std::mutex Mu;
+  std::condition_variable CV;
+  bool Stopping /*GUARDED_BY(Mu)*/ = false;
+  std::thread Thread;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_MEMORYPRESSURE_H
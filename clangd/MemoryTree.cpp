@@ -0,0 +1,60 @@
+//===--- MemoryTree.cpp - Hierarchical memory accounting ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MemoryTree.h"
+#include "Trace.h"
+#include "llvm/ADT/STLExtras.h"
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+void recordNode(const MemoryTree &MT, std::string &Name) {
+  trace::metric(Name, MT.total());
+  size_t Size = Name.size();
+  for (const auto &Child : MT.children()) {
+    Name += '.';
+    Name += Child.first;
+    recordNode(*Child.second, Name);
+    Name.resize(Size);
+  }
+}
+
+} // namespace
+
+MemoryTree &MemoryTree::child(StringRef Name) {
+  auto &Child = Children[Name.str()];
+  if (!Child)
+    Child = llvm::make_unique<MemoryTree>();
+  return *Child;
+}
+
+size_t MemoryTree::total() const {
+  size_t Total = Self;
+  for (const auto &Child : Children)
+    Total += Child.second->total();
+  return Total;
+}
+
+json::Value toJSON(const MemoryTree &MT) {
+  json::Object Result{{"_self", int64_t(MT.self())},
+                      {"_total", int64_t(MT.total())}};
+  for (const auto &Child : MT.children())
+    Result[Child.first] = toJSON(*Child.second);
+  return std::move(Result);
+}
+
+void record(const MemoryTree &MT, StringRef RootName) {
+  std::string Name = ("MemoryUsage." + RootName).str();
+  recordNode(MT, Name);
+}
+
+} // namespace clangd
+} // namespace clang
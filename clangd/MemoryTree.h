@@ -0,0 +1,58 @@
+//===--- MemoryTree.h - Hierarchical memory accounting -----------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_MEMORYTREE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_MEMORYTREE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include <map>
+#include <memory>
+#include <string>
+
+namespace clang {
+namespace clangd {
+
+/// The memory used by a component, broken down by subcomponent. Components
+/// record the bytes they use directly with addUsage(), and describe their
+/// parts in children. Usage is an estimate, as computed by the various
+/// getUsedBytes() and estimateMemoryUsage() functions.
+class MemoryTree {
+public:
+  /// Returns the subcomponent called \p Name, creating it if needed.
+  MemoryTree &child(llvm::StringRef Name);
+
+  /// Records \p Bytes used by the component itself.
+  void addUsage(size_t Bytes) { Self += Bytes; }
+
+  /// The bytes used by the component itself, excluding children.
+  size_t self() const { return Self; }
+  /// The bytes used by the component and all its children.
+  size_t total() const;
+
+  const std::map<std::string, std::unique_ptr<MemoryTree>> &children() const {
+    return Children;
+  }
+
+private:
+  size_t Self = 0;
+  std::map<std::string, std::unique_ptr<MemoryTree>> Children;
+};
+
+/// Serializes a tree as {"_self": bytes, "_total": bytes, child: {...}, ...}.
+llvm::json::Value toJSON(const MemoryTree &);
+
+/// Records the total usage of each node of a tree with trace::metric(). The
+/// metric of a node is called "MemoryUsage.<RootName>.<child>.<child>...".
+void record(const MemoryTree &, llvm::StringRef RootName);
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_MEMORYTREE_H
@@ -0,0 +1,217 @@
+//===--- MetricsTracer.cpp - Aggregate latencies and metrics --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Context.h"
+#include "Trace.h"
+#include "llvm/ADT/StringMap.h"
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace trace {
+namespace {
+
+// Counts latencies in exponentially growing buckets, so that percentiles are
+// accurate to 20% at any scale. Bucket 0 counts latencies under 1us, bucket I
+// those in [Ratio^(I-1), Ratio^I) us.
+class Histogram {
+public:
+  void add(double Micros) {
+    unsigned Bucket = 0;
+    if (Micros >= 1)
+      Bucket = std::min<unsigned>(NumBuckets - 1,
+                                  std::log(Micros) / std::log(Ratio) + 1);
+    ++Buckets[Bucket];
+    ++Count;
+    Sum += Micros;
+    Max = std::max(Max, Micros);
+  }
+
+  // Returns the upper bound of the bucket containing the percentile P.
+  double percentile(double P) const {
+    uint64_t Rank = std::max<uint64_t>(1, std::ceil(P * Count));
+    uint64_t Seen = 0;
+    for (unsigned I = 0; I < NumBuckets; ++I) {
+      Seen += Buckets[I];
+      if (Seen >= Rank)
+        return std::min(Max, std::pow(Ratio, I));
+    }
+    return Max;
+  }
+
+  json::Object toJSON() const {
+    return json::Object{
+        {"count", int64_t(Count)},
+        {"mean_ms", Count ? Sum / Count / 1000 : 0},
+        {"p50_ms", percentile(0.5) / 1000},
+        {"p95_ms", percentile(0.95) / 1000},
+        {"p99_ms", percentile(0.99) / 1000},
+        {"max_ms", Max / 1000},
+    };
+  }
+
+private:
+  static constexpr double Ratio = 1.2;
+  // Ratio^NumBuckets us is about 3 hours.
+  static constexpr unsigned NumBuckets = 128;
+
+  uint64_t Buckets[NumBuckets] = {};
+  uint64_t Count = 0;
+  double Sum = 0;
+  double Max = 0;
+};
+
+struct Aggregate {
+  uint64_t Count = 0;
+  double Sum = 0;
+  double Last = 0;
+};
+
+class MetricsTracer : public EventTracer {
+public:
+  MetricsTracer(std::chrono::milliseconds Interval,
+                std::function<void(const json::Value &)> Export,
+                EventTracer *Next)
+      : Export(std::move(Export)), Next(Next),
+        Start(std::chrono::steady_clock::now()) {
+    Exporter = std::thread([this, Interval] {
+      std::unique_lock<std::mutex> Lock(ExporterMu);
+      while (!ExporterCV.wait_for(Lock, Interval, [&] { return Stopping; }))
+        this->Export(snapshot());
+    });
+  }
+
+  ~MetricsTracer() {
+    {
+      std::lock_guard<std::mutex> Lock(ExporterMu);
+      Stopping = true;
+    }
+    ExporterCV.notify_one();
+    Exporter.join();
+    Export(snapshot());
+  }
+
+  Context beginSpan(StringRef Name, json::Object *Args) override {
+    Context Ctx =
+        Next ? Next->beginSpan(Name, Args) : Context::current().clone();
+    return std::move(Ctx).derive(
+        SpanKey, SpanStart{Name.split(':').first,
+                           std::chrono::steady_clock::now(), Args});
+  }
+
+  void endSpan() override {
+    const SpanStart &S = Context::current().getExisting(SpanKey);
+    double Micros = std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - S.Time)
+                        .count();
+    // Set by the span before it ends, with allocation tracking.
+    Optional<int64_t> AllocBytes, AllocCalls;
+    if (S.Args) {
+      AllocBytes = S.Args->getInteger("alloc_bytes");
+      AllocCalls = S.Args->getInteger("alloc_calls");
+    }
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      Spans[S.Name].add(Micros);
+      if (AllocBytes && AllocCalls) {
+        tidy::AllocationCount &A = SpanAllocations[S.Name];
+        A.Bytes += *AllocBytes;
+        A.Calls += *AllocCalls;
+      }
+    }
+    if (Next)
+      Next->endSpan();
+  }
+
+  void instant(StringRef Name, json::Object &&Args) override {
+    if (Next)
+      Next->instant(Name, std::move(Args));
+  }
+
+  void metric(StringRef Name, double Value) override {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      Aggregate &A = Metrics[Name];
+      ++A.Count;
+      A.Sum += Value;
+      A.Last = Value;
+    }
+    if (Next)
+      Next->metric(Name, Value);
+  }
+
+private:
+  struct SpanStart {
+    std::string Name;
+    std::chrono::steady_clock::time_point Time;
+    json::Object *Args;
+  };
+  static Key<SpanStart> SpanKey;
+
+  json::Value snapshot() {
+    json::Object SpansJSON, MetricsJSON;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      for (const auto &S : Spans) {
+        json::Object Span = S.second.toJSON();
+        auto Allocations = SpanAllocations.find(S.first());
+        if (Allocations != SpanAllocations.end()) {
+          Span["alloc_bytes"] = int64_t(Allocations->second.Bytes);
+          Span["alloc_calls"] = int64_t(Allocations->second.Calls);
+        }
+        SpansJSON[S.first()] = std::move(Span);
+      }
+      for (const auto &M : Metrics)
+        MetricsJSON[M.first()] =
+            json::Object{{"count", int64_t(M.second.Count)},
+                         {"sum", M.second.Sum},
+                         {"last", M.second.Last}};
+    }
+    return json::Object{
+        {"uptime_ms", std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - Start)
+                          .count()},
+        {"spans", std::move(SpansJSON)},
+        {"metrics", std::move(MetricsJSON)},
+    };
+  }
+
+  std::function<void(const json::Value &)> Export;
+  EventTracer *Next;
+  const std::chrono::steady_clock::time_point Start;
+
+  std::mutex Mu;
+  StringMap<Histogram> Spans /*GUARDED_BY(Mu)*/;
+  StringMap<tidy::AllocationCount> SpanAllocations /*GUARDED_BY(Mu)*/;
+  StringMap<Aggregate> Metrics /*GUARDED_BY(Mu)*/;
+
+  std::mutex ExporterMu;
+  std::condition_variable ExporterCV;
+  bool Stopping /*GUARDED_BY(ExporterMu)*/ = false;
+  std::thread Exporter;
+};
+
+Key<MetricsTracer::SpanStart> MetricsTracer::SpanKey;
+
+} // namespace
+
+std::unique_ptr<EventTracer>
+createMetricsTracer(std::chrono::milliseconds Interval,
+                    std::function<void(const json::Value &)> Export,
+                    EventTracer *Next) {
+  return llvm::make_unique<MetricsTracer>(Interval, std::move(Export), Next);
+}
+
+} // namespace trace
+} // namespace clangd
+} // namespace clang
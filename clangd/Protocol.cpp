@@ -488,6 +488,11 @@ json::Value toJSON(const ApplyWorkspaceEditParams &Params) {
   return json::Object{{"edit", Params.edit}};
 }
 
+json::Value toJSON(const ShowMessageParams &Params) {
+  return json::Object{{"type", static_cast<int>(Params.type)},
+                      {"message", Params.message}};
+}
+
 bool fromJSON(const json::Value &Params, TextDocumentPositionParams &R) {
   json::ObjectMapper O(Params);
   return O && O.map("textDocument", R.textDocument) &&
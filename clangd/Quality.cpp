@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 #include "Quality.h"
 #include "AST.h"
+#include "CompletionModel.h"
 #include "FileDistance.h"
 #include "URI.h"
 #include "index/Index.h"
@@ -426,6 +427,52 @@ float evaluateSymbolAndRelevance(float SymbolQuality, float SymbolRelevance) {
   return SymbolQuality * SymbolRelevance;
 }
 
+static Example toExample(const SymbolQualitySignals &Quality,
+                         const SymbolRelevanceSignals &Relevance) {
+  Example E;
+  E.setNumReferences(Quality.References);
+  E.setIsDeprecated(Quality.Deprecated);
+  E.setIsReservedName(Quality.ReservedName);
+  E.setIsImplementationDetail(Quality.ImplementationDetail);
+  E.setSymbolCategory(Quality.Category);
+  E.setIsForbidden(Relevance.Forbidden);
+  E.setNeedsFixIts(Relevance.NeedsFixIts);
+  E.setIsInBaseClass(Relevance.InBaseClass);
+  E.setFileProximity(std::max(
+      uriProximity(Relevance.SymbolURI, Relevance.FileProximityMatch).first,
+      Relevance.SemaFileProximityScore));
+  float ScopeProximity = 1;
+  if (Relevance.ScopeProximityMatch)
+    ScopeProximity = Relevance.SemaSaysInScope
+                         ? 2.0
+                         : scopeBoost(*Relevance.ScopeProximityMatch,
+                                      Relevance.SymbolScope);
+  E.setScopeProximity(ScopeProximity);
+  E.setSymbolScope(Relevance.Scope);
+  E.setIsInstanceMember(Relevance.IsInstanceMember);
+  E.setIsMemberAccess(
+      Relevance.Context == CodeCompletionContext::CCC_DotMemberAccess ||
+      Relevance.Context == CodeCompletionContext::CCC_ArrowMemberAccess);
+  E.setTypeMatchesPreferred(Relevance.TypeMatchesPreferred);
+  return E;
+}
+
+float evaluateDecisionForest(const SymbolQualitySignals &Quality,
+                             const SymbolRelevanceSignals &Relevance) {
+  // The forest scores in log space, so that its trees add up.
+  float Score = Evaluate(toExample(Quality, Relevance));
+  return Relevance.NameMatch * std::exp(Score);
+}
+
+void evaluateDecisionForest(ArrayRef<SymbolQualitySignals> Quality,
+                            ArrayRef<SymbolRelevanceSignals> Relevance,
+                            MutableArrayRef<float> Scores) {
+  assert(Quality.size() == Relevance.size() &&
+         Quality.size() == Scores.size());
+  for (size_t I = 0; I < Scores.size(); ++I)
+    Scores[I] = evaluateDecisionForest(Quality[I], Relevance[I]);
+}
+
 // Produces an integer that sorts in the same order as F.
 // That is: a < b <==> encodeFloat(a) < encodeFloat(b).
 static uint32_t encodeFloat(float F) {
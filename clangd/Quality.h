@@ -142,6 +142,18 @@ llvm::raw_ostream &operator<<(llvm::raw_ostream &,
 /// Combine symbol quality and relevance into a single score.
 float evaluateSymbolAndRelevance(float SymbolQuality, float SymbolRelevance);
 
+/// Combines the signals into a single score with the decision forest compiled
+/// from quality/model at build time. Like the heuristics, the score is
+/// proportional to NameMatch. The shipped model mirrors the heuristics, as a
+/// starting point for trained ones.
+float evaluateDecisionForest(const SymbolQualitySignals &Quality,
+                             const SymbolRelevanceSignals &Relevance);
+/// Scores a batch of candidates: Scores[I] is the score of Quality[I] and
+/// Relevance[I].
+void evaluateDecisionForest(llvm::ArrayRef<SymbolQualitySignals> Quality,
+                            llvm::ArrayRef<SymbolRelevanceSignals> Relevance,
+                            llvm::MutableArrayRef<float> Scores);
+
 /// TopN<T> is a lossy container that preserves only the "best" N elements.
 template <typename T, typename Compare = std::greater<T>> class TopN {
 public:
@@ -169,6 +181,12 @@ public:
     return Dropped;
   }
 
+  // Returns the worst candidate in the set, which must not be empty.
+  const value_type &worst() const {
+    assert(!Heap.empty());
+    return Heap.front();
+  }
+
   // Returns candidates from best to worst.
   std::vector<value_type> items() && {
     std::sort_heap(Heap.begin(), Heap.end(), Greater);
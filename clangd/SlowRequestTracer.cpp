@@ -0,0 +1,229 @@
+//===--- SlowRequestTracer.cpp - Trace the requests that are slow ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Context.h"
+#include "Trace.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/Threading.h"
+#include <mutex>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace trace {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The spans recorded for a request, beyond these they are only counted. Spans
+// of background work started by a request, like the background index started
+// by "initialize", would grow its buffer forever.
+constexpr unsigned MaxSpansPerRequest = 1000;
+
+class SlowRequestTracer;
+
+// The spans of a request, recorded by any thread that works on it. Owned by
+// the context of the request, destroyed when no work on it is left.
+class RequestBuffer {
+public:
+  RequestBuffer(SlowRequestTracer &Tracer, StringRef Name)
+      : Tracer(Tracer), Start(Clock::now()) {
+    Spans.push_back({Name, NoParent, get_threadid(), 0, -1, {}});
+  }
+  ~RequestBuffer();
+
+  // Returns the index of the new span, or None if the buffer is full. Instant
+  // events end when they start.
+  Optional<unsigned> add(StringRef Name, unsigned Parent,
+                         bool Instant = false) {
+    double Now = millisecondsSinceStart();
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (Spans.size() >= MaxSpansPerRequest) {
+      ++Dropped;
+      return None;
+    }
+    Spans.push_back(
+        {Name, Parent, get_threadid(), Now, Instant ? Now : -1, {}});
+    return Spans.size() - 1;
+  }
+
+  void end(unsigned Index) {
+    double Now = millisecondsSinceStart();
+    std::lock_guard<std::mutex> Lock(Mu);
+    Spans[Index].EndMs = Now;
+  }
+
+  // The args of a span are complete when its context is destroyed.
+  void setArgs(unsigned Index, const json::Object &Args) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Spans[Index].Args = Args;
+  }
+
+private:
+  static constexpr unsigned NoParent = ~0u;
+
+  struct SpanRecord {
+    std::string Name;
+    unsigned Parent;
+    uint64_t Thread;
+    double StartMs;
+    double EndMs; // Negative until the span ends.
+    json::Object Args;
+  };
+
+  double millisecondsSinceStart() const {
+    return std::chrono::duration<double, std::milli>(Clock::now() - Start)
+        .count();
+  }
+
+  json::Value toJSON(unsigned Index,
+                     ArrayRef<std::vector<unsigned>> Children) const {
+    const SpanRecord &S = Spans[Index];
+    json::Object Result{
+        {"name", S.Name},
+        {"thread", int64_t(S.Thread)},
+        {"start_ms", S.StartMs},
+    };
+    if (S.EndMs >= 0)
+      Result["duration_ms"] = S.EndMs - S.StartMs;
+    if (!S.Args.empty())
+      Result["args"] = json::Object(S.Args);
+    if (!Children[Index].empty()) {
+      json::Array ChildrenJSON;
+      for (unsigned Child : Children[Index])
+        ChildrenJSON.push_back(toJSON(Child, Children));
+      Result["children"] = std::move(ChildrenJSON);
+    }
+    return std::move(Result);
+  }
+
+  friend class SlowRequestTracer;
+
+  SlowRequestTracer &Tracer;
+  const Clock::time_point Start;
+  mutable std::mutex Mu;
+  std::vector<SpanRecord> Spans /*GUARDED_BY(Mu)*/;
+  unsigned Dropped /*GUARDED_BY(Mu)*/ = 0;
+};
+
+// Stored in the context of each recorded span.
+struct SpanHandle {
+  RequestBuffer *Request;
+  unsigned Index;
+  json::Object *Args;
+
+  ~SpanHandle() {
+    if (Args)
+      Request->setArgs(Index, *Args);
+  }
+};
+
+class SlowRequestTracer : public EventTracer {
+public:
+  SlowRequestTracer(std::chrono::milliseconds Threshold,
+                    std::function<void(const json::Value &)> Export,
+                    EventTracer *Next)
+      : Threshold(Threshold), Export(std::move(Export)), Next(Next) {}
+
+  Context beginSpan(StringRef Name, json::Object *Args) override {
+    Context Ctx =
+        Next ? Next->beginSpan(Name, Args) : Context::current().clone();
+    if (const auto *Parent = Context::current().get(SpanKey)) {
+      auto Index = (*Parent)->Request->add(Name, (*Parent)->Index);
+      // Spans that don't fit are attributed to their parent.
+      return std::move(Ctx).derive(
+          SpanKey, llvm::make_unique<SpanHandle>(SpanHandle{
+                       (*Parent)->Request, Index ? *Index : (*Parent)->Index,
+                       Index ? Args : nullptr}));
+    }
+    // A span outside of any other starts a request.
+    auto Request = llvm::make_unique<RequestBuffer>(*this, Name);
+    RequestBuffer *R = Request.get();
+    return std::move(Ctx)
+        .derive(RequestKey, std::move(Request))
+        .derive(SpanKey,
+                llvm::make_unique<SpanHandle>(SpanHandle{R, 0, Args}));
+  }
+
+  void endSpan() override {
+    const auto &Handle = Context::current().getExisting(SpanKey);
+    if (Handle->Args) // Not a span that was attributed to its parent.
+      Handle->Request->end(Handle->Index);
+    if (Next)
+      Next->endSpan();
+  }
+
+  void instant(StringRef Name, json::Object &&Args) override {
+    // Instant events within a request are recorded as empty spans.
+    if (const auto *Parent = Context::current().get(SpanKey)) {
+      RequestBuffer &R = *(*Parent)->Request;
+      if (auto Index = R.add(Name, (*Parent)->Index, /*Instant=*/true))
+        R.setArgs(*Index, Args);
+    }
+    if (Next)
+      Next->instant(Name, std::move(Args));
+  }
+
+  void metric(StringRef Name, double Value) override {
+    if (Next)
+      Next->metric(Name, Value);
+  }
+
+  // Called when no work on the request is left.
+  void finish(const RequestBuffer &R) {
+    double Milliseconds = R.millisecondsSinceStart();
+    if (Milliseconds < Threshold.count())
+      return;
+    json::Object Slow;
+    {
+      std::lock_guard<std::mutex> Lock(R.Mu);
+      std::vector<std::vector<unsigned>> Children(R.Spans.size());
+      for (unsigned I = 1; I < R.Spans.size(); ++I)
+        Children[R.Spans[I].Parent].push_back(I);
+      Slow = json::Object{
+          {"request", R.Spans.front().Name},
+          {"duration_ms", Milliseconds},
+          {"threshold_ms", int64_t(Threshold.count())},
+          {"spans", R.toJSON(0, Children)},
+      };
+      if (R.Dropped)
+        Slow["dropped_spans"] = int64_t(R.Dropped);
+    }
+    std::lock_guard<std::mutex> Lock(ExportMu);
+    Export(json::Value(std::move(Slow)));
+  }
+
+private:
+  static Key<std::unique_ptr<RequestBuffer>> RequestKey;
+  static Key<std::unique_ptr<SpanHandle>> SpanKey;
+
+  const std::chrono::milliseconds Threshold;
+  std::mutex ExportMu;
+  std::function<void(const json::Value &)> Export /*GUARDED_BY(ExportMu)*/;
+  EventTracer *Next;
+};
+
+Key<std::unique_ptr<RequestBuffer>> SlowRequestTracer::RequestKey;
+Key<std::unique_ptr<SpanHandle>> SlowRequestTracer::SpanKey;
+
+RequestBuffer::~RequestBuffer() { Tracer.finish(*this); }
+
+} // namespace
+
+std::unique_ptr<EventTracer>
+createSlowRequestTracer(std::chrono::milliseconds Threshold,
+                        std::function<void(const json::Value &)> Export,
+                        EventTracer *Next) {
+  return llvm::make_unique<SlowRequestTracer>(Threshold, std::move(Export),
+                                              Next);
+}
+
+} // namespace trace
+} // namespace clangd
+} // namespace clang
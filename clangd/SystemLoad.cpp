@@ -0,0 +1,117 @@
+//===--- SystemLoad.cpp - Load of the machine clangd runs on --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SystemLoad.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+#ifdef __linux__
+double readLoadAverage() {
+  // The first field of loadavg is the average over the last minute.
+  auto LoadAvg = MemoryBuffer::getFileAsStream("/proc/loadavg");
+  if (!LoadAvg)
+    return -1;
+  double Load;
+  if ((*LoadAvg)->getBuffer().split(' ').first.getAsDouble(Load))
+    return -1;
+  return Load;
+}
+
+size_t readAvailableMemory() {
+  auto MemInfo = MemoryBuffer::getFileAsStream("/proc/meminfo");
+  if (!MemInfo)
+    return 0;
+  StringRef Rest = (*MemInfo)->getBuffer();
+  while (!Rest.empty()) {
+    StringRef Line;
+    std::tie(Line, Rest) = Rest.split('\n');
+    if (!Line.consume_front("MemAvailable:"))
+      continue;
+    size_t KB;
+    if (Line.trim().split(' ').first.getAsInteger(10, KB))
+      return 0;
+    return KB << 10;
+  }
+  return 0;
+}
+
+bool findCompilerProcess() {
+  std::error_code EC;
+  for (sys::fs::directory_iterator It("/proc", EC), End; It != End && !EC;
+       It.increment(EC)) {
+    StringRef PID = sys::path::filename(It->path());
+    if (PID.empty() || !llvm::all_of(PID, isDigit))
+      continue;
+    // The process may have exited meanwhile.
+    auto Comm = MemoryBuffer::getFileAsStream(It->path() + "/comm");
+    if (Comm && isCompilerProcess((*Comm)->getBuffer().rtrim()))
+      return true;
+  }
+  return false;
+}
+#endif
+
+} // namespace
+
+SystemLoad getSystemLoad() {
+  SystemLoad Load;
+#ifdef __linux__
+  Load.LoadAverage = readLoadAverage();
+  Load.AvailableMemory = readAvailableMemory();
+  Load.CompilerRunning = findCompilerProcess();
+#endif
+  return Load;
+}
+
+bool isCompilerProcess(StringRef ProcessName) {
+  // Versioned compilers, like gcc-8 or clang-7.
+  StringRef Name, Version;
+  std::tie(Name, Version) = ProcessName.rsplit('-');
+  if (Version.empty() || !llvm::all_of(Version, isDigit))
+    Name = ProcessName;
+  return StringSwitch<bool>(Name)
+      .Cases("cc1", "cc1plus", "cc", "c++", "gcc", "g++", true)
+      .Cases("clang", "clang++", "cl.exe", "clang-cl", "rustc", "javac", true)
+      .Cases("ld", "ld.bfd", "ld.gold", "ld.lld", "lld", "link.exe", true)
+      .Default(false);
+}
+
+SystemLoadMonitor::SystemLoadMonitor(
+    std::chrono::milliseconds Interval,
+    std::function<void(const SystemLoad &)> OnSample)
+    : OnSample(std::move(OnSample)) {
+  Thread = std::thread([this, Interval] { run(Interval); });
+}
+
+SystemLoadMonitor::~SystemLoadMonitor() {
+  {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Stopping = true;
+  }
+  CV.notify_one();
+  Thread.join();
+}
+
+void SystemLoadMonitor::run(std::chrono::milliseconds Interval) {
+  std::unique_lock<std::mutex> Lock(Mu);
+  while (!CV.wait_for(Lock, Interval, [&] { return Stopping; }))
+    OnSample(getSystemLoad());
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,63 @@
+//===--- SystemLoad.h - Load of the machine clangd runs on -------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_SYSTEMLOAD_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_SYSTEMLOAD_H
+
+#include "llvm/ADT/StringRef.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace clang {
+namespace clangd {
+
+/// What else the machine is busy with, e.g. a build of the project.
+struct SystemLoad {
+  /// The average number of runnable processes over the last minute, or a
+  /// negative number if unknown.
+  double LoadAverage = -1;
+  /// The memory that can be allocated without swapping in bytes, or 0 if
+  /// unknown.
+  size_t AvailableMemory = 0;
+  /// Whether a compiler or a linker is running, i.e. probably a build.
+  bool CompilerRunning = false;
+};
+
+/// Samples the load of the machine. Only implemented on Linux, the load is
+/// unknown elsewhere.
+SystemLoad getSystemLoad();
+
+/// Whether \p ProcessName is the name of a compiler or linker process.
+bool isCompilerProcess(llvm::StringRef ProcessName);
+
+/// Samples the load of the machine periodically, and passes it to OnSample.
+class SystemLoadMonitor {
+public:
+  SystemLoadMonitor(std::chrono::milliseconds Interval,
+                    std::function<void(const SystemLoad &)> OnSample);
+  ~SystemLoadMonitor();
+
+private:
+  void run(std::chrono::milliseconds Interval);
+
+  std::function<void(const SystemLoad &)> OnSample;
+  std::mutex Mu;
+  std::condition_variable CV;
+  bool Stopping /*GUARDED_BY(Mu)*/ = false;
+  std::thread Thread;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_SYSTEMLOAD_H
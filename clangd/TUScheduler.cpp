@@ -48,7 +48,10 @@
 #include "Trace.h"
 #include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/Path.h"
 #include <algorithm>
@@ -81,33 +84,71 @@ class TUScheduler::ASTCache {
 public:
   using Key = const ASTWorker *;
 
-  ASTCache(unsigned MaxRetainedASTs) : MaxRetainedASTs(MaxRetainedASTs) {}
+  ASTCache(const ASTRetentionPolicy &Policy)
+      : MaxRetainedASTs(Policy.MaxRetainedASTs),
+        MaxRetainedBytes(Policy.MaxRetainedBytes),
+        WeighByBuildTime(Policy.WeighByBuildTime) {}
 
   /// Returns result of getUsedBytes() for the AST cached by \p K.
   /// If no AST is cached, 0 is returned.
   std::size_t getUsedBytes(Key K) {
     std::lock_guard<std::mutex> Lock(Mut);
     auto It = findByKey(K);
-    if (It == LRU.end() || !It->second)
+    if (It == LRU.end())
       return 0;
-    return It->second->getUsedBytes();
+    return It->UsedBytes;
   }
 
-  /// Store the value in the pool, possibly removing the last used AST.
+  /// Store the value in the pool, possibly removing the least recently used
+  /// ASTs to stay within the limits of the retention policy. \p BuildTime is
+  /// how long the AST took to build.
   /// The value should not be in the pool when this function is called.
-  void put(Key K, std::unique_ptr<ParsedAST> V) {
+  void put(Key K, std::unique_ptr<ParsedAST> V,
+           steady_clock::duration BuildTime = steady_clock::duration::zero()) {
     std::unique_lock<std::mutex> Lock(Mut);
     assert(findByKey(K) == LRU.end());
 
-    LRU.insert(LRU.begin(), {K, std::move(V)});
-    if (LRU.size() <= MaxRetainedASTs)
-      return;
-    // We're past the limit, remove the last element.
-    std::unique_ptr<ParsedAST> ForCleanup = std::move(LRU.back().second);
-    LRU.pop_back();
+    std::size_t Bytes = V ? V->getUsedBytes() : 0;
+    double Weight =
+        WeighByBuildTime
+            ? Inflation + std::chrono::duration<double>(BuildTime).count()
+            : 0;
+    LRU.insert(LRU.begin(), {K, std::move(V), Bytes, Weight});
+    TotalBytes += Bytes;
+    // The most recently used AST is kept even if it's over the memory limit
+    // on its own, evicting it would make its file rebuild on every request.
+    std::vector<std::unique_ptr<ParsedAST>> ForCleanup;
+    while (LRU.size() > MaxRetainedASTs ||
+           (MaxRetainedBytes && TotalBytes > MaxRetainedBytes &&
+            LRU.size() > 1)) {
+      // We're past the limit, remove the lightest element. Ties (and all
+      // elements, unless they are weighed) go to the least recently used one.
+      auto Victim = std::prev(LRU.end());
+      for (auto It = std::next(LRU.begin()); It != LRU.end(); ++It)
+        if (It->Weight <= Victim->Weight)
+          Victim = It;
+      Inflation = Victim->Weight;
+      TotalBytes -= Victim->UsedBytes;
+      trace::log(formatv("Evicting idle AST of {0} bytes, {1} bytes in {2} "
+                         "ASTs remain",
+                         Victim->UsedBytes, TotalBytes, LRU.size() - 1));
+      ForCleanup.push_back(std::move(Victim->AST));
+      LRU.erase(Victim);
+    }
     // Run the expensive destructor outside the lock.
     Lock.unlock();
-    ForCleanup.reset();
+    ForCleanup.clear();
+  }
+
+  /// Removes all values from the cache.
+  void clear() {
+    std::unique_lock<std::mutex> Lock(Mut);
+    std::vector<Entry> ForCleanup = std::move(LRU);
+    LRU.clear();
+    TotalBytes = 0;
+    // Run the expensive destructors outside the lock.
+    Lock.unlock();
+    ForCleanup.clear();
   }
 
   /// Returns the cached value for \p K, or llvm::None if the value is not in
@@ -116,9 +157,13 @@ public:
   Optional<std::unique_ptr<ParsedAST>> take(Key K) {
     std::unique_lock<std::mutex> Lock(Mut);
     auto Existing = findByKey(K);
-    if (Existing == LRU.end())
+    if (Existing == LRU.end()) {
+      trace::metric("ASTCacheMiss");
       return None;
-    std::unique_ptr<ParsedAST> V = std::move(Existing->second);
+    }
+    trace::metric("ASTCacheHit");
+    std::unique_ptr<ParsedAST> V = std::move(Existing->AST);
+    TotalBytes -= Existing->UsedBytes;
     LRU.erase(Existing);
     // GCC 4.8 fails to compile `return V;`, as it tries to call the copy
     // constructor of unique_ptr, so we call the move ctor explicitly to avoid
@@ -127,22 +172,105 @@ public:
   }
 
 private:
-  using KVPair = std::pair<Key, std::unique_ptr<ParsedAST>>;
+  struct Entry {
+    Key K;
+    std::unique_ptr<ParsedAST> AST;
+    /// Result of AST->getUsedBytes() when the AST was stored. Idle ASTs don't
+    /// change, so it doesn't have to be recomputed.
+    std::size_t UsedBytes;
+    /// The build time of the AST in seconds, plus Inflation when it was
+    /// stored, if ASTs are weighed. Otherwise 0.
+    double Weight;
+  };
 
-  std::vector<KVPair>::iterator findByKey(Key K) {
-    return llvm::find_if(LRU, [K](const KVPair &P) { return P.first == K; });
+  std::vector<Entry>::iterator findByKey(Key K) {
+    return llvm::find_if(LRU, [K](const Entry &E) { return E.K == K; });
   }
 
   std::mutex Mut;
   unsigned MaxRetainedASTs;
+  std::size_t MaxRetainedBytes;
+  bool WeighByBuildTime;
   /// Items sorted in LRU order, i.e. first item is the most recently accessed
   /// one.
-  std::vector<KVPair> LRU; /* GUARDED_BY(Mut) */
+  std::vector<Entry> LRU; /* GUARDED_BY(Mut) */
+  /// Sum of UsedBytes of all items.
+  std::size_t TotalBytes = 0; /* GUARDED_BY(Mut) */
+  /// Weight of the last evicted item. Items stored later weigh more than their
+  /// build time alone, so that they outweigh the items that stay unused.
+  double Inflation = 0; /* GUARDED_BY(Mut) */
+};
+
+/// Preambles of all files, indexed by what determines their contents, so that
+/// files starting with the same includes and built with the same flags can
+/// share one preamble.
+/// Only weak references are kept: a preamble is freed with the last worker
+/// using it.
+class TUScheduler::PreamblePool {
+public:
+  /// Returns a preamble built for a file in the same directory with the same
+  /// preamble text and an equivalent compile command, if there is one.
+  /// PrecompiledPreamble::CanReuse() must still be checked before using it.
+  std::shared_ptr<const PreambleData> get(PathRef File,
+                                          const ParseInputs &Inputs,
+                                          const CompilerInvocation &CI) {
+    std::string K = key(File, Inputs, CI);
+    std::lock_guard<std::mutex> Lock(Mut);
+    auto It = Preambles.find(K);
+    if (It == Preambles.end())
+      return nullptr;
+    return It->second.lock();
+  }
+
+  /// Makes \p Preamble, built for \p Inputs, available to other workers.
+  void put(PathRef File, const ParseInputs &Inputs,
+           const CompilerInvocation &CI,
+           std::shared_ptr<const PreambleData> Preamble) {
+    std::string K = key(File, Inputs, CI);
+    std::lock_guard<std::mutex> Lock(Mut);
+    // Drop the entries of freed preambles.
+    for (auto It = Preambles.begin(); It != Preambles.end();) {
+      auto Next = std::next(It);
+      if (It->second.expired())
+        Preambles.erase(It);
+      It = Next;
+    }
+    Preambles[K] = Preamble;
+  }
+
+private:
+  /// Quoted includes are resolved relative to the main file, so only
+  /// preambles of files in the same directory can be shared. The name of the
+  /// file itself is dropped from the compile command.
+  static std::string key(PathRef File, const ParseInputs &Inputs,
+                         const CompilerInvocation &CI) {
+    const tooling::CompileCommand &Cmd = Inputs.CompileCommand;
+    std::string Key = sys::path::parent_path(File);
+    Key += '\0';
+    Key += Cmd.Directory;
+    for (const std::string &Arg : Cmd.CommandLine) {
+      Key += '\0';
+      if (Arg != File && Arg != Cmd.Filename)
+        Key += Arg;
+    }
+    auto Bounds = ComputePreambleBounds(
+        *CI.getLangOpts(), MemoryBuffer::getMemBuffer(Inputs.Contents).get(),
+        0);
+    Key += '\0';
+    Key += StringRef(Inputs.Contents).take_front(Bounds.Size);
+    return Key;
+  }
+
+  std::mutex Mut;
+  llvm::StringMap<std::weak_ptr<const PreambleData>> Preambles;
 };
 
 namespace {
 class ASTWorkerHandle;
 
+/// Number of recent AST build durations used to compute the debounce.
+constexpr unsigned RebuildTimesToKeep = 5;
+
 /// Owns one instance of the AST, schedules updates and reads of it.
 /// Also responsible for building and providing access to the preamble.
 /// Each ASTWorker processes the async requests sent to it on a separate
@@ -156,10 +284,12 @@ class ASTWorkerHandle;
 class ASTWorker {
   friend class ASTWorkerHandle;
   ASTWorker(PathRef FileName, TUScheduler::ASTCache &LRUCache,
-            Semaphore &Barrier, bool RunSync,
-            steady_clock::duration UpdateDebounce,
+            TUScheduler::PreamblePool &SharedPreambles, Semaphore &Barrier,
+            bool RunSync, DebouncePolicy UpdateDebounce,
+            bool ParallelFirstBuild,
             std::shared_ptr<PCHContainerOperations> PCHs,
-            bool StorePreamblesInMemory, ParsingCallbacks &Callbacks);
+            const std::atomic<bool> &StorePreamblesInMemory,
+            ParsingCallbacks &Callbacks);
 
 public:
   /// Create a new ASTWorker and return a handle to it.
@@ -167,16 +297,23 @@ public:
   /// is null, all requests will be processed on the calling thread
   /// synchronously instead. \p Barrier is acquired when processing each
   /// request, it is used to limit the number of actively running threads.
+  /// If \p ParallelFirstBuild is true and \p Tasks is not null, the first
+  /// preamble is built on a separate thread while the worker parses the file
+  /// without it.
   static ASTWorkerHandle create(PathRef FileName,
                                 TUScheduler::ASTCache &IdleASTs,
+                                TUScheduler::PreamblePool &SharedPreambles,
                                 AsyncTaskRunner *Tasks, Semaphore &Barrier,
-                                steady_clock::duration UpdateDebounce,
+                                DebouncePolicy UpdateDebounce,
+                                bool ParallelFirstBuild,
                                 std::shared_ptr<PCHContainerOperations> PCHs,
-                                bool StorePreamblesInMemory,
+                                const std::atomic<bool> &StorePreamblesInMemory,
                                 ParsingCallbacks &Callbacks);
   ~ASTWorker();
 
-  void update(ParseInputs Inputs, WantDiagnostics);
+  /// If \p ForceRebuild is true, the preamble and AST are rebuilt even if the
+  /// inputs are the same, e.g. because included files changed.
+  void update(ParseInputs Inputs, WantDiagnostics, bool ForceRebuild = false);
   void runWithAST(StringRef Name,
                   unique_function<void(Expected<InputsAndAST>)> Action);
   bool blockUntilIdle(Deadline Timeout) const;
@@ -194,8 +331,13 @@ public:
 
   std::size_t getUsedBytes() const;
   bool isASTCached() const;
+  /// Whether the last preamble or AST read any of \p Files. Threadsafe.
+  bool includesAny(const llvm::StringSet<> &Files) const;
 
 private:
+  /// Records the files read by a newly built AST.
+  void recordASTIncludes(const ParsedAST *AST);
+
   // Must be called exactly once on processing thread. Will return after
   // stop() is called on a separate thread and all pending requests are
   // processed.
@@ -212,6 +354,8 @@ private:
   Deadline scheduleLocked();
   /// Should the first task in the queue be skipped instead of run?
   bool shouldSkipHeadLocked() const;
+  /// The requests queued behind the first one and their ages, for tracing.
+  json::Value queueState() const;
 
   struct Request {
     unique_function<void()> Action;
@@ -223,13 +367,19 @@ private:
 
   /// Handles retention of ASTs.
   TUScheduler::ASTCache &IdleASTs;
+  /// Preambles which may be shared with other workers.
+  TUScheduler::PreamblePool &SharedPreambles;
   const bool RunSync;
   /// Time to wait after an update to see whether another update obsoletes it.
-  const steady_clock::duration UpdateDebounce;
+  const DebouncePolicy UpdateDebounce;
+  /// Whether to parse the file without a preamble while the first preamble is
+  /// being built.
+  const bool ParallelFirstBuild;
   /// File that ASTWorker is responsible for.
   const Path FileName;
-  /// Whether to keep the built preambles in memory or on disk.
-  const bool StorePreambleInMemory;
+  /// Whether to keep the built preambles in memory or on disk. Owned by the
+  /// TUScheduler, which may switch it to disk under memory pressure.
+  const std::atomic<bool> &StorePreambleInMemory;
   /// Callback invoked when preamble or main file AST is built.
   ParsingCallbacks &Callbacks;
   /// Helper class required to build the ASTs.
@@ -241,12 +391,22 @@ private:
   /// Whether the diagnostics for the current FileInputs were reported to the
   /// users before.
   bool DiagsWereReported = false;
-  /// Size of the last AST
+  /// How long the current AST took to build, which the AST cache weighs. Only
+  /// accessed on the worker thread.
+  steady_clock::duration ASTBuildTime = steady_clock::duration::zero();
   /// Guards members used by both TUScheduler and the worker thread.
   mutable std::mutex Mutex;
   std::shared_ptr<const PreambleData> LastBuiltPreamble; /* GUARDED_BY(Mutex) */
+  /// Files read by the last AST, including main file #includes that are not
+  /// in the preamble.
+  std::vector<std::string> ASTIncludes; /* GUARDED_BY(Mutex) */
+  /// Durations of the recent AST builds for updates, oldest first.
+  std::vector<steady_clock::duration> RebuildTimes; /* GUARDED_BY(Mutex) */
   /// Becomes ready when the first preamble build finishes.
   Notification PreambleWasBuilt;
+  /// The preamble build running in parallel with the first AST build, if any.
+  /// Only accessed on the worker thread and in the destructor.
+  std::future<void> PendingPreamble;
   /// Set to true to signal run() to finish processing.
   bool Done;                    /* GUARDED_BY(Mutex) */
   std::deque<Request> Requests; /* GUARDED_BY(Mutex) */
@@ -302,16 +462,18 @@ private:
   std::shared_ptr<ASTWorker> Worker;
 };
 
-ASTWorkerHandle ASTWorker::create(PathRef FileName,
-                                  TUScheduler::ASTCache &IdleASTs,
-                                  AsyncTaskRunner *Tasks, Semaphore &Barrier,
-                                  steady_clock::duration UpdateDebounce,
-                                  std::shared_ptr<PCHContainerOperations> PCHs,
-                                  bool StorePreamblesInMemory,
-                                  ParsingCallbacks &Callbacks) {
-  std::shared_ptr<ASTWorker> Worker(new ASTWorker(
-      FileName, IdleASTs, Barrier, /*RunSync=*/!Tasks, UpdateDebounce,
-      std::move(PCHs), StorePreamblesInMemory, Callbacks));
+ASTWorkerHandle
+ASTWorker::create(PathRef FileName, TUScheduler::ASTCache &IdleASTs,
+                  TUScheduler::PreamblePool &SharedPreambles,
+                  AsyncTaskRunner *Tasks, Semaphore &Barrier,
+                  DebouncePolicy UpdateDebounce, bool ParallelFirstBuild,
+                  std::shared_ptr<PCHContainerOperations> PCHs,
+                  const std::atomic<bool> &StorePreamblesInMemory,
+                  ParsingCallbacks &Callbacks) {
+  std::shared_ptr<ASTWorker> Worker(
+      new ASTWorker(FileName, IdleASTs, SharedPreambles, Barrier,
+                    /*RunSync=*/!Tasks, UpdateDebounce, ParallelFirstBuild,
+                    std::move(PCHs), StorePreamblesInMemory, Callbacks));
   if (Tasks)
     Tasks->runAsync("worker:" + sys::path::filename(FileName),
                     [Worker]() { Worker->run(); });
@@ -320,16 +482,22 @@ ASTWorkerHandle ASTWorker::create(PathRef FileName,
 }
 
 ASTWorker::ASTWorker(PathRef FileName, TUScheduler::ASTCache &LRUCache,
+                     TUScheduler::PreamblePool &SharedPreambles,
                      Semaphore &Barrier, bool RunSync,
-                     steady_clock::duration UpdateDebounce,
+                     DebouncePolicy UpdateDebounce, bool ParallelFirstBuild,
                      std::shared_ptr<PCHContainerOperations> PCHs,
-                     bool StorePreamblesInMemory, ParsingCallbacks &Callbacks)
-    : IdleASTs(LRUCache), RunSync(RunSync), UpdateDebounce(UpdateDebounce),
+                     const std::atomic<bool> &StorePreamblesInMemory,
+                     ParsingCallbacks &Callbacks)
+    : IdleASTs(LRUCache), SharedPreambles(SharedPreambles), RunSync(RunSync),
+      UpdateDebounce(UpdateDebounce), ParallelFirstBuild(ParallelFirstBuild),
       FileName(FileName), StorePreambleInMemory(StorePreamblesInMemory),
       Callbacks(Callbacks), PCHs(std::move(PCHs)), Barrier(Barrier),
       Done(false) {}
 
 ASTWorker::~ASTWorker() {
+  // The pending preamble build refers to this worker.
+  if (PendingPreamble.valid())
+    PendingPreamble.wait();
   // Make sure we remove the cached AST, if any.
   IdleASTs.take(this);
 #ifndef NDEBUG
@@ -339,12 +507,14 @@ ASTWorker::~ASTWorker() {
 #endif
 }
 
-void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags) {
+void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags,
+                       bool ForceRebuild) {
   auto Task = [=]() mutable {
     // Will be used to check if we can avoid rebuilding the AST.
     bool InputsAreTheSame =
+        !ForceRebuild &&
         std::tie(FileInputs.CompileCommand, FileInputs.Contents) ==
-        std::tie(Inputs.CompileCommand, Inputs.Contents);
+            std::tie(Inputs.CompileCommand, Inputs.Contents);
 
     tooling::CompileCommand OldCommand = std::move(FileInputs.CompileCommand);
     bool PrevDiagsWereReported = DiagsWereReported;
@@ -367,25 +537,85 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags) {
       return;
     }
 
+    // The next preamble may reuse the one being built in parallel. That build
+    // needs a slot of the barrier, so give ours up while waiting for it.
+    if (PendingPreamble.valid()) {
+      Barrier.unlock();
+      PendingPreamble.wait();
+      Barrier.lock(TaskPriority::Normal);
+      PendingPreamble = std::future<void>();
+    }
     std::shared_ptr<const PreambleData> OldPreamble =
         getPossiblyStalePreamble();
-    std::shared_ptr<const PreambleData> NewPreamble = buildPreamble(
-        FileName, *Invocation, OldPreamble, OldCommand, Inputs, PCHs,
-        StorePreambleInMemory,
-        [this](ASTContext &Ctx, std::shared_ptr<clang::Preprocessor> PP) {
-          Callbacks.onPreambleAST(FileName, Ctx, std::move(PP));
-        });
+    // Prefer a preamble of another file with the same includes and flags, so
+    // that sibling files don't build their own copies.
+    std::shared_ptr<const PreambleData> ReusablePreamble = OldPreamble;
+    const tooling::CompileCommand *ReusableCommand = &OldCommand;
+    if (auto Shared = SharedPreambles.get(FileName, Inputs, *Invocation)) {
+      if (Shared != OldPreamble)
+        vlog("Trying to share a preamble with another file for {0}",
+             FileName);
+      ReusablePreamble = std::move(Shared);
+      // The pool only matches equivalent compile commands.
+      ReusableCommand = &Inputs.CompileCommand;
+    }
 
-    bool CanReuseAST = InputsAreTheSame && (OldPreamble == NewPreamble);
-    {
-      std::lock_guard<std::mutex> Lock(Mutex);
-      LastBuiltPreamble = NewPreamble;
+    // When there is no preamble to start from, build it on a separate thread
+    // and meanwhile parse the whole file without it. Skipping the PCH write
+    // and read makes that parse finish sooner than a preamble build, so the
+    // first diagnostics and the first AST reads don't wait for the preamble.
+    // The AST built for the next update uses the new preamble. Reads of the
+    // current preamble that don't wait for the first one may get none.
+    bool BuildPreambleInParallel = ParallelFirstBuild && !RunSync &&
+                                   !ReusablePreamble &&
+                                   WantDiags != WantDiagnostics::No;
+    std::shared_ptr<const PreambleData> NewPreamble;
+    if (BuildPreambleInParallel) {
+      vlog("Building the first preamble for {0} in parallel", FileName);
+      std::shared_ptr<CompilerInvocation> PreambleInvocation =
+          std::make_shared<CompilerInvocation>(*Invocation);
+      bool StoreInMemory = StorePreambleInMemory;
+      PendingPreamble = runAsync<void>([this, Inputs, PreambleInvocation,
+                                        StoreInMemory]() {
+        std::lock_guard<Semaphore> BarrierLock(Barrier);
+        std::shared_ptr<const PreambleData> Preamble = buildPreamble(
+            FileName, *PreambleInvocation, /*OldPreamble=*/nullptr,
+            tooling::CompileCommand(), Inputs, PCHs, StoreInMemory,
+            [this](ASTContext &Ctx, std::shared_ptr<clang::Preprocessor> PP) {
+              Callbacks.onPreambleAST(FileName, Ctx, std::move(PP));
+            });
+        if (Preamble)
+          SharedPreambles.put(FileName, Inputs, *PreambleInvocation, Preamble);
+        {
+          std::lock_guard<std::mutex> Lock(Mutex);
+          LastBuiltPreamble = std::move(Preamble);
+        }
+        PreambleWasBuilt.notify();
+      });
+    } else {
+      NewPreamble = buildPreamble(
+          FileName, *Invocation, ReusablePreamble, *ReusableCommand, Inputs,
+          PCHs, StorePreambleInMemory,
+          [this](ASTContext &Ctx, std::shared_ptr<clang::Preprocessor> PP) {
+            Callbacks.onPreambleAST(FileName, Ctx, std::move(PP));
+          });
+      if (NewPreamble)
+        SharedPreambles.put(FileName, Inputs, *Invocation, NewPreamble);
+      {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        LastBuiltPreamble = NewPreamble;
+      }
     }
+    ReusablePreamble.reset();
+
+    bool CanReuseAST = InputsAreTheSame && !BuildPreambleInParallel &&
+                       (OldPreamble == NewPreamble);
     // Before doing the expensive AST reparse, we want to release our reference
     // to the old preamble, so it can be freed if there are no other references
     // to it.
     OldPreamble.reset();
-    PreambleWasBuilt.notify();
+    if (!BuildPreambleInParallel)
+      PreambleWasBuilt.notify();
 
     if (!CanReuseAST) {
       IdleASTs.take(this); // Remove the old AST if it's still in cache.
@@ -422,9 +652,18 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags) {
     // Get the AST for diagnostics.
     Optional<std::unique_ptr<ParsedAST>> AST = IdleASTs.take(this);
     if (!AST) {
+      auto RebuildStart = steady_clock::now();
       Optional<ParsedAST> NewAST =
           buildAST(FileName, std::move(Invocation), Inputs, NewPreamble, PCHs);
       AST = NewAST ? llvm::make_unique<ParsedAST>(std::move(*NewAST)) : nullptr;
+      recordASTIncludes(AST->get());
+      ASTBuildTime = steady_clock::now() - RebuildStart;
+      // Remember how long the rebuild took to pick the debounce for the next
+      // updates.
+      std::lock_guard<std::mutex> Lock(Mutex);
+      RebuildTimes.push_back(ASTBuildTime);
+      if (RebuildTimes.size() > RebuildTimesToKeep)
+        RebuildTimes.erase(RebuildTimes.begin());
     }
     // We want to report the diagnostics even if this update was cancelled.
     // It seems more useful than making the clients wait indefinitely if they
@@ -441,7 +680,7 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags) {
       DiagsWereReported = true;
     }
     // Stash the AST in the cache for further use.
-    IdleASTs.put(this, std::move(*AST));
+    IdleASTs.put(this, std::move(*AST), ASTBuildTime);
   };
 
   startTask("Update", std::move(Task), WantDiags);
@@ -454,6 +693,7 @@ void ASTWorker::runWithAST(
       return Action(make_error<CancelledError>());
     Optional<std::unique_ptr<ParsedAST>> AST = IdleASTs.take(this);
     if (!AST) {
+      auto RebuildStart = steady_clock::now();
       std::unique_ptr<CompilerInvocation> Invocation =
           buildCompilerInvocation(FileInputs);
       // Try rebuilding the AST.
@@ -464,10 +704,13 @@ void ASTWorker::runWithAST(
                          FileInputs, getPossiblyStalePreamble(), PCHs)
               : None;
       AST = NewAST ? llvm::make_unique<ParsedAST>(std::move(*NewAST)) : nullptr;
+      recordASTIncludes(AST->get());
+      ASTBuildTime = steady_clock::now() - RebuildStart;
     }
     // Make sure we put the AST back into the LRU cache.
-    auto _ = make_scope_exit(
-        [&AST, this]() { IdleASTs.put(this, std::move(*AST)); });
+    auto _ = make_scope_exit([&AST, this]() {
+      IdleASTs.put(this, std::move(*AST), ASTBuildTime);
+    });
     // Run the user-provided action.
     if (!*AST)
       return Action(
@@ -528,6 +771,27 @@ std::size_t ASTWorker::getUsedBytes() const {
 
 bool ASTWorker::isASTCached() const { return IdleASTs.getUsedBytes(this) != 0; }
 
+bool ASTWorker::includesAny(const StringSet<> &Files) const {
+  auto IsChanged = [&](const std::string &F) { return Files.count(F) != 0; };
+  std::shared_ptr<const PreambleData> Preamble;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (llvm::any_of(ASTIncludes, IsChanged))
+      return true;
+    Preamble = LastBuiltPreamble;
+  }
+  return Preamble &&
+         llvm::any_of(Preamble->Includes.includedFiles(), IsChanged);
+}
+
+void ASTWorker::recordASTIncludes(const ParsedAST *AST) {
+  std::vector<std::string> Includes;
+  if (AST)
+    Includes = AST->getIncludeStructure().includedFiles();
+  std::lock_guard<std::mutex> Lock(Mutex);
+  ASTIncludes = std::move(Includes);
+}
+
 void ASTWorker::stop() {
   {
     std::lock_guard<std::mutex> Lock(DiagsMu);
@@ -581,6 +845,10 @@ void ASTWorker::run() {
           Ctx.emplace(Requests.front().Ctx.clone());
           Tracer.emplace("Debounce");
           SPAN_ATTACH(*Tracer, "next_request", Requests.front().Name);
+          SPAN_ATTACH(*Tracer, "debounce_ms",
+                      std::chrono::duration_cast<std::chrono::milliseconds>(
+                          UpdateDebounce.compute(RebuildTimes))
+                          .count());
           if (!(Wait == Deadline::infinity()))
             SPAN_ATTACH(*Tracer, "sleep_ms",
                         std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -595,9 +863,24 @@ void ASTWorker::run() {
     } // unlock Mutex
 
     {
-      std::lock_guard<Semaphore> BarrierLock(Barrier);
+      // Reads are interactive, so they go before queued rebuilds of other
+      // files.
+      auto BarrierStart = steady_clock::now();
+      Barrier.lock(Req.UpdateType ? TaskPriority::Normal
+                                  : TaskPriority::Interactive);
+      auto Unlock = llvm::make_scope_exit([&] { Barrier.unlock(); });
       WithContext Guard(std::move(Req.Ctx));
       trace::Span Tracer(Req.Name);
+      // Where the request waited, e.g. for the slow request log.
+      SPAN_ATTACH(Tracer, "queued_ms",
+                  std::chrono::duration<double, std::milli>(BarrierStart -
+                                                            Req.AddTime)
+                      .count());
+      SPAN_ATTACH(Tracer, "barrier_ms",
+                  std::chrono::duration<double, std::milli>(
+                      steady_clock::now() - BarrierStart)
+                      .count());
+      SPAN_ATTACH(Tracer, "queue", queueState());
       Req.Action();
     }
 
@@ -643,10 +926,23 @@ Deadline ASTWorker::scheduleLocked() {
     if (R.UpdateType == None || R.UpdateType == WantDiagnostics::Yes)
       return Deadline::zero();
   // Front request needs to be debounced, so determine when we're ready.
-  Deadline D(Requests.front().AddTime + UpdateDebounce);
+  Deadline D(Requests.front().AddTime + UpdateDebounce.compute(RebuildTimes));
   return D;
 }
 
+json::Value ASTWorker::queueState() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  json::Array Queue;
+  auto Now = steady_clock::now();
+  for (auto I = std::next(Requests.begin()), E = Requests.end(); I != E; ++I)
+    Queue.push_back(json::Object{
+        {"name", I->Name},
+        {"age_ms",
+         std::chrono::duration<double, std::milli>(Now - I->AddTime).count()},
+    });
+  return std::move(Queue);
+}
+
 // Returns true if Requests.front() is a dead update that can be skipped.
 bool ASTWorker::shouldSkipHeadLocked() const {
   assert(!Requests.empty());
@@ -683,6 +979,20 @@ bool ASTWorker::blockUntilIdle(Deadline Timeout) const {
 
 } // namespace
 
+steady_clock::duration
+DebouncePolicy::compute(ArrayRef<steady_clock::duration> History) const {
+  assert(Min <= Max && "Invalid policy");
+  if (History.empty())
+    return Max;
+  // Use the median, so that a single odd rebuild doesn't change the debounce.
+  std::vector<steady_clock::duration> Sorted(History.begin(), History.end());
+  auto Median = Sorted.begin() + Sorted.size() / 2;
+  std::nth_element(Sorted.begin(), Median, Sorted.end());
+  auto Target = std::chrono::duration_cast<steady_clock::duration>(
+      *Median * RebuildRatio);
+  return std::max(Min, std::min(Max, Target));
+}
+
 unsigned getDefaultAsyncThreadsCount() {
   unsigned HardwareConcurrency = std::thread::hardware_concurrency();
   // C++ standard says that hardware_concurrency()
@@ -697,34 +1007,46 @@ struct TUScheduler::FileData {
   /// Latest inputs, passed to TUScheduler::update().
   std::string Contents;
   tooling::CompileCommand Command;
+  tidy::ClangTidyOptions ClangTidyOpts;
   ASTWorkerHandle Worker;
 };
 
 TUScheduler::TUScheduler(unsigned AsyncThreadsCount,
                          bool StorePreamblesInMemory,
                          std::unique_ptr<ParsingCallbacks> Callbacks,
-                         std::chrono::steady_clock::duration UpdateDebounce,
-                         ASTRetentionPolicy RetentionPolicy)
-    : StorePreamblesInMemory(StorePreamblesInMemory),
+                         DebouncePolicy UpdateDebounce,
+                         ASTRetentionPolicy RetentionPolicy,
+                         bool ParallelFirstBuild,
+                         SpeculativePreambleBudget Speculative)
+    : DefaultStorePreamblesInMemory(StorePreamblesInMemory),
+      StorePreamblesInMemory(StorePreamblesInMemory),
       PCHOps(std::make_shared<PCHContainerOperations>()),
       Callbacks(Callbacks ? move(Callbacks)
                           : llvm::make_unique<ParsingCallbacks>()),
       Barrier(AsyncThreadsCount),
-      IdleASTs(llvm::make_unique<ASTCache>(RetentionPolicy.MaxRetainedASTs)),
-      UpdateDebounce(UpdateDebounce) {
+      IdleASTs(llvm::make_unique<ASTCache>(RetentionPolicy)),
+      SharedPreambles(llvm::make_unique<PreamblePool>()),
+      UpdateDebounce(UpdateDebounce), ParallelFirstBuild(ParallelFirstBuild),
+      Speculative(Speculative) {
   if (0 < AsyncThreadsCount) {
     PreambleTasks.emplace();
     WorkerThreads.emplace();
+    SpeculativeTasks.emplace(ThreadPriority::Low);
   }
 }
 
 TUScheduler::~TUScheduler() {
   // Notify all workers that they need to stop.
-  Files.clear();
+  {
+    std::lock_guard<std::mutex> Lock(FilesMu);
+    Files.clear();
+  }
 
   // Wait for all in-flight tasks to finish.
   if (PreambleTasks)
     PreambleTasks->wait();
+  if (SpeculativeTasks)
+    SpeculativeTasks->wait();
   if (WorkerThreads)
     WorkerThreads->wait();
 }
@@ -736,29 +1058,152 @@ bool TUScheduler::blockUntilIdle(Deadline D) const {
   if (PreambleTasks)
     if (!PreambleTasks->wait(D))
       return false;
+  if (SpeculativeTasks)
+    if (!SpeculativeTasks->wait(D))
+      return false;
   return true;
 }
 
 void TUScheduler::update(PathRef File, ParseInputs Inputs,
                          WantDiagnostics WantDiags) {
-  std::unique_ptr<FileData> &FD = Files[File];
-  if (!FD) {
+  auto It = Files.find(File);
+  if (It == Files.end()) {
     // Create a new worker to process the AST-related tasks.
     ASTWorkerHandle Worker = ASTWorker::create(
-        File, *IdleASTs, WorkerThreads ? WorkerThreads.getPointer() : nullptr,
-        Barrier, UpdateDebounce, PCHOps, StorePreamblesInMemory, *Callbacks);
-    FD = std::unique_ptr<FileData>(new FileData{
-        Inputs.Contents, Inputs.CompileCommand, std::move(Worker)});
+        File, *IdleASTs, *SharedPreambles,
+        WorkerThreads ? WorkerThreads.getPointer() : nullptr, Barrier,
+        UpdateDebounce, ParallelFirstBuild, PCHOps, StorePreamblesInMemory,
+        *Callbacks);
+    std::unique_ptr<FileData> FD(
+        new FileData{Inputs.Contents, Inputs.CompileCommand,
+                     Inputs.ClangTidyOpts, std::move(Worker)});
+    std::lock_guard<std::mutex> Lock(FilesMu);
+    It = Files.try_emplace(File, std::move(FD)).first;
   } else {
-    FD->Contents = Inputs.Contents;
-    FD->Command = Inputs.CompileCommand;
+    FileData &FD = *It->second;
+    FD.Contents = Inputs.Contents;
+    FD.ClangTidyOpts = Inputs.ClangTidyOpts;
+    std::lock_guard<std::mutex> Lock(FilesMu);
+    FD.Command = Inputs.CompileCommand;
+  }
+  It->second->Worker->update(std::move(Inputs), WantDiags);
+}
+
+void TUScheduler::reparse(PathRef File,
+                          IntrusiveRefCntPtr<vfs::FileSystem> FS) {
+  auto It = Files.find(File);
+  if (It == Files.end())
+    return;
+  FileData &FD = *It->second;
+  FD.Worker->update(
+      ParseInputs{FD.Command, std::move(FS), FD.Contents, FD.ClangTidyOpts},
+      WantDiagnostics::Auto, /*ForceRebuild=*/true);
+}
+
+Optional<tooling::CompileCommand>
+TUScheduler::getIncluderCommand(PathRef Header) const {
+  StringSet<> Included;
+  Included.insert(Header);
+  std::lock_guard<std::mutex> Lock(FilesMu);
+  for (auto &&PathAndFile : Files)
+    if (PathAndFile.first() != Header &&
+        PathAndFile.second->Worker->includesAny(Included))
+      return PathAndFile.second->Command;
+  return None;
+}
+
+std::vector<Path>
+TUScheduler::getFilesIncluding(ArrayRef<std::string> ChangedFiles) const {
+  StringSet<> Changed;
+  for (const std::string &F : ChangedFiles)
+    Changed.insert(F);
+  std::vector<Path> Result;
+  for (auto &&PathAndFile : Files)
+    if (PathAndFile.second->Worker->includesAny(Changed))
+      Result.push_back(PathAndFile.first());
+  return Result;
+}
+
+void TUScheduler::buildSpeculativePreamble(PathRef File, ParseInputs Inputs) {
+  if (!SpeculativeTasks || Speculative.MaxBuilds == 0)
+    return;
+  {
+    std::lock_guard<std::mutex> Lock(SpeculativeMutex);
+    if (SpeculativeBuilds >= Speculative.MaxBuilds ||
+        !SpeculativeFiles.insert(File).second)
+      return;
+    ++SpeculativeBuilds;
   }
-  FD->Worker->update(std::move(Inputs), WantDiags);
+  auto Task = [this](std::string File, ParseInputs Inputs, Context Ctx) {
+    WithContext Guard(std::move(Ctx));
+    std::shared_ptr<const PreambleData> Preamble;
+    auto Done =
+        make_scope_exit([&] { keepSpeculativePreamble(File, Preamble); });
+    // Only use a slot no open file is waiting for.
+    if (!Barrier.try_lock())
+      return;
+    auto Unlock = make_scope_exit([&] { Barrier.unlock(); });
+    std::unique_ptr<CompilerInvocation> Invocation =
+        buildCompilerInvocation(Inputs);
+    if (!Invocation || SharedPreambles->get(File, Inputs, *Invocation))
+      return;
+    trace::Span Tracer("SpeculativePreamble");
+    SPAN_ATTACH(Tracer, "file", File);
+    Preamble = buildPreamble(
+        File, *Invocation, /*OldPreamble=*/nullptr, tooling::CompileCommand(),
+        Inputs, PCHOps, StorePreamblesInMemory,
+        [&](ASTContext &Ctx, std::shared_ptr<clang::Preprocessor> PP) {
+          Callbacks->onPreambleAST(File, Ctx, std::move(PP));
+        });
+    if (Preamble)
+      SharedPreambles->put(File, Inputs, *Invocation, Preamble);
+  };
+  SpeculativeTasks->runAsync(
+      "speculative:" + sys::path::filename(File),
+      Bind(Task, std::string(File), std::move(Inputs),
+           Context::current().derive(kFileBeingProcessed, File)));
+}
+
+void TUScheduler::keepSpeculativePreamble(
+    PathRef File, std::shared_ptr<const PreambleData> Preamble) {
+  std::lock_guard<std::mutex> Lock(SpeculativeMutex);
+  --SpeculativeBuilds;
+  if (!Preamble) {
+    SpeculativeFiles.erase(File);
+    return;
+  }
+  SpeculativeBytes += Preamble->Preamble.getSize();
+  SpeculativePreambles.emplace_back(File, std::move(Preamble));
+  while (!SpeculativePreambles.empty() &&
+         SpeculativeBytes > Speculative.MaxBytes) {
+    auto &Oldest = SpeculativePreambles.front();
+    vlog("Dropping the speculative preamble of {0}", Oldest.first);
+    SpeculativeBytes -= Oldest.second->Preamble.getSize();
+    SpeculativeFiles.erase(Oldest.first);
+    SpeculativePreambles.pop_front();
+  }
+}
+
+void TUScheduler::dropSpeculativePreambles() {
+  std::lock_guard<std::mutex> Lock(SpeculativeMutex);
+  for (const auto &FileAndPreamble : SpeculativePreambles)
+    SpeculativeFiles.erase(FileAndPreamble.first);
+  SpeculativePreambles.clear();
+  SpeculativeBytes = 0;
 }
 
 void TUScheduler::remove(PathRef File) {
-  bool Removed = Files.erase(File);
-  if (!Removed)
+  // The worker is stopped outside of the lock.
+  std::unique_ptr<FileData> FD;
+  {
+    std::lock_guard<std::mutex> Lock(FilesMu);
+    auto It = Files.find(File);
+    if (It != Files.end()) {
+      FD = std::move(It->second);
+      Files.erase(It);
+    }
+  }
+  if (!FD)
     elog("Trying to remove file from TUScheduler that is not tracked: {0}",
          File);
 }
@@ -832,7 +1277,8 @@ void TUScheduler::runWithPreamble(
       Preamble = Worker->getPossiblyStalePreamble();
     }
 
-    std::lock_guard<Semaphore> BarrierLock(Barrier);
+    Barrier.lock(TaskPriority::Interactive);
+    auto Unlock = llvm::make_scope_exit([&] { Barrier.unlock(); });
     WithContext Guard(std::move(Ctx));
     trace::Span Tracer(Name);
     SPAN_ATTACH(Tracer, "file", File);
@@ -857,6 +1303,26 @@ TUScheduler::getUsedBytesPerFile() const {
   return Result;
 }
 
+void TUScheduler::profile(MemoryTree &Memory, MemoryTree &Disk) const {
+  llvm::DenseSet<const PreambleData *> SeenPreambles;
+  for (auto &&PathAndFile : Files) {
+    ASTWorker &Worker = *PathAndFile.second->Worker;
+    MemoryTree &File = Memory.child(PathAndFile.first());
+    File.child("ast").addUsage(IdleASTs->getUsedBytes(&Worker));
+    auto Preamble = Worker.getPossiblyStalePreamble();
+    if (!Preamble || !SeenPreambles.insert(Preamble.get()).second)
+      continue;
+    if (Preamble->StoredInMemory)
+      File.child("preamble").addUsage(Preamble->Preamble.getSize());
+    else
+      Disk.child(PathAndFile.first()).addUsage(Preamble->Preamble.getSize());
+    if (Preamble->StatCache)
+      File.child("stat_cache").addUsage(Preamble->StatCache->getUsedBytes());
+  }
+}
+
+void TUScheduler::dropIdleASTs() { IdleASTs->clear(); }
+
 std::vector<Path> TUScheduler::getFilesWithCachedAST() const {
   std::vector<Path> Result;
   for (auto &&PathAndFile : Files) {
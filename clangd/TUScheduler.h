@@ -12,9 +12,15 @@
 
 #include "ClangdUnit.h"
 #include "Function.h"
+#include "MemoryTree.h"
 #include "Threading.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include <atomic>
+#include <deque>
 #include <future>
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -50,6 +56,52 @@ struct ASTRetentionPolicy {
   /// Maximum number of ASTs to be retained in memory when there are no pending
   /// requests for them.
   unsigned MaxRetainedASTs = 3;
+  /// Maximum total size of the ASTs retained in memory when there are no
+  /// pending requests for them, as reported by ParsedAST::getUsedBytes(). The
+  /// least recently used ASTs are evicted first. 0 means no limit.
+  std::size_t MaxRetainedBytes = 0;
+  /// Whether ASTs that were slow to build are kept in preference to more
+  /// recently used ones that are quick to rebuild, so that switching between
+  /// more files than are retained doesn't keep rebuilding the heavy ones. Each
+  /// AST is weighed by its build time plus the weight of the last evicted AST,
+  /// so that ASTs that aren't used anymore are still evicted eventually.
+  bool WeighByBuildTime = false;
+};
+
+/// Limits the preambles built speculatively for files that aren't open yet,
+/// see TUScheduler::buildSpeculativePreamble().
+struct SpeculativePreambleBudget {
+  /// Maximum number of speculative builds running at once. Each also needs a
+  /// worker slot free when it starts. 0 disables speculative builds.
+  unsigned MaxBuilds = 0;
+  /// Maximum total size of the speculative preambles kept alive, as reported
+  /// by PrecompiledPreamble::getSize(). The oldest ones are dropped first.
+  std::size_t MaxBytes = 0;
+};
+
+/// Determines how long an ASTWorker waits after an update before rebuilding
+/// the AST, in case another update makes it obsolete.
+/// Files that are cheap to rebuild get diagnostics quickly, expensive ones
+/// wait longer so that we don't rebuild them on every pause in typing.
+struct DebouncePolicy {
+  DebouncePolicy() = default;
+  /// A policy that always waits for \p Fixed.
+  template <typename Rep, typename Period>
+  /*implicit*/ DebouncePolicy(std::chrono::duration<Rep, Period> Fixed)
+      : Min(Fixed), Max(Fixed) {}
+
+  /// The minimum time to wait.
+  std::chrono::steady_clock::duration Min = std::chrono::milliseconds(50);
+  /// The maximum time to wait.
+  std::chrono::steady_clock::duration Max = std::chrono::seconds(2);
+  /// Time to wait as a fraction of the time recent rebuilds took, e.g. with
+  /// RebuildRatio = 0.5 and rebuilds taking 1s we wait for 500ms.
+  float RebuildRatio = 0.5;
+
+  /// Computes the time to wait based on durations of recent rebuilds, oldest
+  /// first. Waits for Max when there are none.
+  std::chrono::steady_clock::duration
+  compute(llvm::ArrayRef<std::chrono::steady_clock::duration> History) const;
 };
 
 class ParsingCallbacks {
@@ -88,14 +140,33 @@ class TUScheduler {
 public:
   TUScheduler(unsigned AsyncThreadsCount, bool StorePreamblesInMemory,
               std::unique_ptr<ParsingCallbacks> ASTCallbacks,
-              std::chrono::steady_clock::duration UpdateDebounce,
-              ASTRetentionPolicy RetentionPolicy);
+              DebouncePolicy UpdateDebounce,
+              ASTRetentionPolicy RetentionPolicy,
+              bool ParallelFirstBuild = false,
+              SpeculativePreambleBudget Speculative = {});
   ~TUScheduler();
 
   /// Returns estimated memory usage for each of the currently open files.
   /// The order of results is unspecified.
   std::vector<std::pair<Path, std::size_t>> getUsedBytesPerFile() const;
 
+  /// Records the memory used by open files in \p Memory, and the preambles
+  /// stored on disk in \p Disk. Each preamble is counted once, under the
+  /// first file using it.
+  void profile(MemoryTree &Memory, MemoryTree &Disk) const;
+
+  /// Frees all idle ASTs. They are rebuilt by the next request needing them.
+  void dropIdleASTs();
+
+  /// Stores preambles built from now on in temporary files instead of memory.
+  /// Preambles already in memory are rebuilt on disk when their files change.
+  void storePreamblesOnDisk() { StorePreamblesInMemory = false; }
+  /// Stores preambles built from now on as configured on construction. The
+  /// preambles on disk are kept as long as they can be reused.
+  void restorePreambleStorage() {
+    StorePreamblesInMemory = DefaultStorePreamblesInMemory;
+  }
+
   /// Returns a list of files with ASTs currently stored in memory. This method
   /// is not very reliable and is only used for test. E.g., the results will not
   /// contain files that currently run something over their AST.
@@ -108,6 +179,31 @@ public:
   /// (i.e. WantDiagnostics is downgraded to Auto).
   void update(PathRef File, ParseInputs Inputs, WantDiagnostics WD);
 
+  /// Returns the open files whose last preamble or AST read any of \p Files
+  /// (absolute paths).
+  std::vector<Path> getFilesIncluding(llvm::ArrayRef<std::string> Files) const;
+
+  /// Returns the command of an open file, other than \p Header, whose last
+  /// preamble or AST read \p Header (an absolute path), if any. Headers
+  /// without a command of their own are parsed with the flags it gives them.
+  /// Threadsafe.
+  llvm::Optional<tooling::CompileCommand>
+  getIncluderCommand(PathRef Header) const;
+
+  /// Schedules a rebuild of the preamble and AST of \p File from its latest
+  /// inputs, e.g. after files it includes changed on disk.
+  void reparse(PathRef File, IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS);
+
+  /// Builds the preamble of \p File, which isn't open, in the background and
+  /// keeps it within the speculative budget. Opening the file, or a sibling
+  /// with the same preamble and flags, then reuses it. Nothing is built when
+  /// the budget is exhausted, no worker slot is free, or a reusable preamble
+  /// already exists. Threadsafe.
+  void buildSpeculativePreamble(PathRef File, ParseInputs Inputs);
+
+  /// Frees the preambles kept by buildSpeculativePreamble().
+  void dropSpeculativePreambles();
+
   /// Remove \p File from the list of tracked files and schedule removal of its
   /// resources. Pending diagnostics for closed files may not be delivered, even
   /// if requested with WantDiags::Auto or WantDiags::Yes.
@@ -165,6 +261,8 @@ public:
   /// Responsible for retaining and rebuilding idle ASTs. An implementation is
   /// an LRU cache.
   class ASTCache;
+  /// Lets workers of files with the same preamble share it.
+  class PreamblePool;
 
   // The file being built/processed in the current thread. This is a hack in
   // order to get the file name into the index implementations. Do not depend on
@@ -174,17 +272,40 @@ public:
   static llvm::Optional<llvm::StringRef> getFileBeingProcessedInContext();
 
 private:
-  const bool StorePreamblesInMemory;
+  const bool DefaultStorePreamblesInMemory;
+  std::atomic<bool> StorePreamblesInMemory;
   const std::shared_ptr<PCHContainerOperations> PCHOps;
   std::unique_ptr<ParsingCallbacks> Callbacks; // not nullptr
   Semaphore Barrier;
+  /// Held when changing Files or their commands, so that other threads can
+  /// read them in getIncluderCommand().
+  mutable std::mutex FilesMu;
   llvm::StringMap<std::unique_ptr<FileData>> Files;
   std::unique_ptr<ASTCache> IdleASTs;
+  std::unique_ptr<PreamblePool> SharedPreambles;
   // None when running tasks synchronously and non-None when running tasks
   // asynchronously.
   llvm::Optional<AsyncTaskRunner> PreambleTasks;
   llvm::Optional<AsyncTaskRunner> WorkerThreads;
-  std::chrono::steady_clock::duration UpdateDebounce;
+  /// Runs the speculative preamble builds at a low priority.
+  llvm::Optional<AsyncTaskRunner> SpeculativeTasks;
+  DebouncePolicy UpdateDebounce;
+  bool ParallelFirstBuild;
+
+  /// Records a finished speculative build of \p File, and drops the oldest
+  /// preambles over the budget. \p Preamble is null if none was built.
+  void keepSpeculativePreamble(PathRef File,
+                               std::shared_ptr<const PreambleData> Preamble);
+
+  const SpeculativePreambleBudget Speculative;
+  std::mutex SpeculativeMutex;
+  /// The files whose speculative preamble is being built or kept.
+  llvm::StringSet<> SpeculativeFiles /* GUARDED_BY(SpeculativeMutex) */;
+  unsigned SpeculativeBuilds /* GUARDED_BY(SpeculativeMutex) */ = 0;
+  /// The kept speculative preambles, oldest first.
+  std::deque<std::pair<Path, std::shared_ptr<const PreambleData>>>
+      SpeculativePreambles /* GUARDED_BY(SpeculativeMutex) */;
+  std::size_t SpeculativeBytes /* GUARDED_BY(SpeculativeMutex) */ = 0;
 };
 
 /// Runs \p Action asynchronously with a new std::thread. The context will be
@@ -3,6 +3,7 @@
 #include "llvm/ADT/ScopeExit.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Threading.h"
+#include <algorithm>
 #include <thread>
 #ifdef __USE_POSIX
 #include <pthread.h>
@@ -25,17 +26,50 @@ void Notification::wait() const {
   CV.wait(Lock, [this] { return Notified; });
 }
 
+StringRef toString(TaskPriority Priority) {
+  switch (Priority) {
+  case TaskPriority::Interactive:
+    return "interactive";
+  case TaskPriority::Normal:
+    return "normal";
+  }
+  llvm_unreachable("unhandled TaskPriority");
+}
+
 Semaphore::Semaphore(std::size_t MaxLocks) : FreeSlots(MaxLocks) {}
 
-void Semaphore::lock() {
+void Semaphore::lock(TaskPriority Priority) {
   trace::Span Span("WaitForFreeSemaphoreSlot");
+  SPAN_ATTACH(Span, "priority", toString(Priority));
   // trace::Span can also acquire locks in ctor and dtor, we make sure it
   // happens when Semaphore's own lock is not held.
+  bool SlotsLeft;
   {
     std::unique_lock<std::mutex> Lock(Mutex);
-    SlotsChanged.wait(Lock, [&]() { return FreeSlots > 0; });
+    bool Interactive = Priority == TaskPriority::Interactive;
+    if (Interactive)
+      ++WaitingInteractive;
+    ++Waiting;
+    SlotsChanged.wait(Lock, [&]() {
+      return FreeSlots > 0 && (Interactive || WaitingInteractive == 0);
+    });
+    --Waiting;
+    if (Interactive)
+      --WaitingInteractive;
     --FreeSlots;
+    SlotsLeft = FreeSlots > 0;
   }
+  // Normal tasks may have been held back by this one.
+  if (SlotsLeft)
+    SlotsChanged.notify_all();
+}
+
+bool Semaphore::try_lock() {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (FreeSlots == 0 || WaitingInteractive != 0)
+    return false;
+  --FreeSlots;
+  return true;
 }
 
 void Semaphore::unlock() {
@@ -43,7 +77,90 @@ void Semaphore::unlock() {
   ++FreeSlots;
   Lock.unlock();
 
-  SlotsChanged.notify_one();
+  // Wake everyone, a waiter that can't take the slot must not swallow it.
+  SlotsChanged.notify_all();
+}
+
+std::size_t Semaphore::waiting() {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  return Waiting;
+}
+
+TaskThreadPool::TaskThreadPool(unsigned MaxIdleThreads)
+    : MaxIdleThreads(MaxIdleThreads) {}
+
+TaskThreadPool::~TaskThreadPool() {
+  std::unique_lock<std::mutex> Lock(Mutex);
+  ShuttingDown = true;
+  for (Lane &L : Lanes)
+    L.TaskAdded.notify_all();
+  ThreadsChanged.wait(Lock, [&] { return Threads == 0; });
+}
+
+void TaskThreadPool::waitUntilIdle() {
+  std::unique_lock<std::mutex> Lock(Mutex);
+  ThreadsChanged.wait(Lock, [&] {
+    unsigned IdleThreads = 0;
+    for (const Lane &L : Lanes)
+      IdleThreads += L.IdleThreads;
+    return IdleThreads == Threads;
+  });
+}
+
+TaskThreadPool &TaskThreadPool::global() {
+  // Enough idle threads for a burst of requests on every core.
+  static TaskThreadPool *Pool =
+      new TaskThreadPool(std::max(4u, std::thread::hardware_concurrency()));
+  return *Pool;
+}
+
+void TaskThreadPool::run(const Twine &Name, ThreadPriority Priority,
+                         unique_function<void()> Action) {
+  Lane &L = Lanes[static_cast<unsigned>(Priority)];
+  bool Spawn;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    assert(!ShuttingDown && "Running a task on a destroyed pool");
+    L.Tasks.emplace_back(Name.str(), std::move(Action));
+    // The idle threads may have been woken for the tasks queued before.
+    Spawn = L.Tasks.size() > L.IdleThreads;
+    if (Spawn)
+      ++Threads;
+  }
+  if (!Spawn)
+    return L.TaskAdded.notify_one();
+  std::thread T([this, &L] { work(L); });
+  if (Priority != ThreadPriority::Normal)
+    setThreadPriority(T, Priority);
+  T.detach();
+}
+
+void TaskThreadPool::work(Lane &L) {
+  std::unique_lock<std::mutex> Lock(Mutex);
+  while (true) {
+    if (L.Tasks.empty()) {
+      if (ShuttingDown || L.IdleThreads >= MaxIdleThreads)
+        break;
+      ++L.IdleThreads;
+      ThreadsChanged.notify_all();
+      L.TaskAdded.wait(Lock,
+                       [&] { return !L.Tasks.empty() || ShuttingDown; });
+      --L.IdleThreads;
+      continue;
+    }
+    auto Task = std::move(L.Tasks.front());
+    L.Tasks.pop_front();
+    Lock.unlock();
+    set_thread_name(Task.first);
+    Task.second();
+    // Destroy the task before the thread is idle, its owner may be waiting
+    // for that.
+    Task.second = nullptr;
+    Lock.lock();
+  }
+  --Threads;
+  // Notify under the lock, the pool may be destroyed once it's released.
+  ThreadsChanged.notify_all();
 }
 
 AsyncTaskRunner::~AsyncTaskRunner() { wait(); }
@@ -71,16 +188,16 @@ void AsyncTaskRunner::runAsync(const Twine &Name,
     }
   });
 
-  std::thread(
-      [](std::string Name, decltype(Action) Action, decltype(CleanupTask)) {
-        set_thread_name(Name);
-        Action();
-        // Make sure function stored by Action is destroyed before CleanupTask
-        // is run.
-        Action = nullptr;
-      },
-      Name.str(), std::move(Action), std::move(CleanupTask))
-      .detach();
+  TaskThreadPool::global().run(
+      Name, Priority,
+      Bind(
+          [](decltype(Action) &&Action, decltype(CleanupTask) &&) {
+            Action();
+            // Make sure function stored by Action is destroyed before
+            // CleanupTask is run.
+            Action = nullptr;
+          },
+          std::move(Action), std::move(CleanupTask)));
 }
 
 Deadline timeoutSeconds(Optional<double> Seconds) {
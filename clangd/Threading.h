@@ -15,9 +15,12 @@
 #include "llvm/ADT/Twine.h"
 #include <cassert>
 #include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 namespace clang {
@@ -37,18 +40,36 @@ private:
   mutable std::mutex Mu;
 };
 
+/// How urgently a task needs a Semaphore slot.
+enum class TaskPriority {
+  /// The user is waiting for the result, e.g. hover or code completion.
+  Interactive,
+  /// Everything else, e.g. rebuilds producing diagnostics.
+  Normal,
+};
+llvm::StringRef toString(TaskPriority);
+
 /// Limits the number of threads that can acquire the lock at the same time.
+/// While interactive tasks are waiting, free slots are only given to them.
 class Semaphore {
 public:
   Semaphore(std::size_t MaxLocks);
 
-  void lock();
+  void lock(TaskPriority Priority = TaskPriority::Normal);
+  /// Takes a slot without waiting, if one is free and no interactive task is
+  /// waiting for it. Returns false otherwise.
+  bool try_lock();
   void unlock();
 
+  /// The number of lock() calls waiting for a slot. Used by tests.
+  std::size_t waiting();
+
 private:
   std::mutex Mutex;
   std::condition_variable SlotsChanged;
   std::size_t FreeSlots;
+  std::size_t Waiting = 0;
+  std::size_t WaitingInteractive = 0;
 };
 
 /// A point in time we can wait for.
@@ -98,31 +119,79 @@ LLVM_NODISCARD bool wait(std::unique_lock<std::mutex> &Lock,
   return true;
 }
 
-/// Runs tasks on separate (detached) threads and wait for all tasks to finish.
-/// Objects that need to spawn threads can own an AsyncTaskRunner to ensure they
-/// all complete on destruction.
+enum class ThreadPriority {
+  Low = 0,
+  Normal = 1,
+};
+void setThreadPriority(std::thread &T, ThreadPriority Priority);
+
+/// Runs tasks on threads that are kept once their task is done, rather than on
+/// a new thread per task. Each ThreadPriority has its own lane of threads,
+/// running at that priority. A thread is spawned whenever no idle one is left,
+/// so that a task never waits for another, e.g. for an ASTWorker loop running
+/// until its file is closed. Up to MaxIdleThreads idle threads are kept in each
+/// lane, the others exit.
+class TaskThreadPool {
+public:
+  TaskThreadPool(unsigned MaxIdleThreads);
+  /// Waits for the threads to exit, after their tasks finish.
+  ~TaskThreadPool();
+
+  /// The pool of the AsyncTaskRunners. It is never destroyed, its idle threads
+  /// are left running at exit.
+  static TaskThreadPool &global();
+
+  /// Runs \p Action in the lane of \p Priority, on a thread named \p Name.
+  void run(const llvm::Twine &Name, ThreadPriority Priority,
+           llvm::unique_function<void()> Action);
+
+  /// Waits until every thread of the pool is idle, the others having exited.
+  /// Used by tests.
+  void waitUntilIdle();
+
+private:
+  struct Lane {
+    std::deque<std::pair<std::string, llvm::unique_function<void()>>> Tasks;
+    unsigned IdleThreads = 0;
+    std::condition_variable TaskAdded;
+  };
+  /// The loop of a thread of \p L.
+  void work(Lane &L);
+
+  const unsigned MaxIdleThreads;
+  std::mutex Mutex;
+  /// Indexed by ThreadPriority.
+  Lane Lanes[2];
+  unsigned Threads = 0;
+  bool ShuttingDown = false;
+  /// Notified when a thread becomes idle or exits.
+  std::condition_variable ThreadsChanged;
+};
+
+/// Runs tasks on the threads of TaskThreadPool::global() and waits for all
+/// tasks to finish. Objects that need to run tasks asynchronously can own an
+/// AsyncTaskRunner to ensure they all complete on destruction.
 class AsyncTaskRunner {
 public:
+  /// \p Priority is the lane of the pool the tasks run in.
+  AsyncTaskRunner(ThreadPriority Priority = ThreadPriority::Normal)
+      : Priority(Priority) {}
   /// Destructor waits for all pending tasks to finish.
   ~AsyncTaskRunner();
 
   void wait() const { (void)wait(Deadline::infinity()); }
   LLVM_NODISCARD bool wait(Deadline D) const;
-  // The name is used for tracing and debugging (e.g. to name a spawned thread).
+  // The name is used for tracing and debugging (e.g. to name the thread
+  // running the task).
   void runAsync(const llvm::Twine &Name, llvm::unique_function<void()> Action);
 
 private:
+  const ThreadPriority Priority;
   mutable std::mutex Mutex;
   mutable std::condition_variable TasksReachedZero;
   std::size_t InFlightTasks = 0;
 };
 
-enum class ThreadPriority {
-  Low = 0,
-  Normal = 1,
-};
-void setThreadPriority(std::thread &T, ThreadPriority Priority);
-
 } // namespace clangd
 } // namespace clang
 #endif
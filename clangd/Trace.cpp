@@ -205,6 +205,12 @@ void log(const Twine &Message) {
   T->instant("Log", json::Object{{"Message", Message.str()}});
 }
 
+void metric(StringRef Name, double Value) {
+  if (!T)
+    return;
+  T->metric(Name, Value);
+}
+
 // Returned context owns Args.
 static Context makeSpanContext(Twine Name, json::Object *Args) {
   if (!T)
@@ -220,9 +226,17 @@ static Context makeSpanContext(Twine Name, json::Object *Args) {
 // beginSpan() context is destroyed, when the tracing engine will consume them.
 Span::Span(Twine Name)
     : Args(T ? new json::Object() : nullptr),
-      RestoreCtx(makeSpanContext(Name, Args)) {}
+      RestoreCtx(makeSpanContext(Name, Args)) {
+  if (Args && tidy::allocationTrackingEnabled())
+    Allocating.emplace(Allocated);
+}
 
 Span::~Span() {
+  if (Allocating) {
+    Allocating.reset();
+    (*Args)["alloc_bytes"] = int64_t(Allocated.Bytes);
+    (*Args)["alloc_calls"] = int64_t(Allocated.Calls);
+  }
   if (T)
     T->endSpan();
 }
@@ -18,11 +18,16 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_TRACE_H_
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_TRACE_H_
 
+#include "../clang-tidy/ClangTidyAllocations.h"
 #include "Context.h"
 #include "Function.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/JSON.h"
+#include "llvm/Support/Error.h"
 #include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <functional>
 
 namespace clang {
 namespace clangd {
@@ -49,6 +54,9 @@ public:
 
   /// Called for instant events.
   virtual void instant(llvm::StringRef Name, llvm::json::Object &&Args) = 0;
+
+  /// Called for each value recorded by trace::metric().
+  virtual void metric(llvm::StringRef Name, double Value) {}
 };
 
 /// Sets up a global EventTracer that consumes events produced by Span and
@@ -68,12 +76,60 @@ public:
 std::unique_ptr<EventTracer> createJSONTracer(llvm::raw_ostream &OS,
                                               bool Pretty = false);
 
+/// Create an instance of EventTracer that is cheap enough to stay enabled.
+/// Events are written to \p OS in a compact binary format by a background
+/// thread, every \p FlushInterval. Span and event args are not recorded, and
+/// events are dropped if a thread produces them faster than they are flushed.
+/// The trace can be converted with convertBinaryTrace().
+std::unique_ptr<EventTracer> createBinaryTracer(
+    llvm::raw_ostream &OS,
+    std::chrono::milliseconds FlushInterval = std::chrono::milliseconds(100));
+
+/// Converts a trace written by the tracer from createBinaryTracer() to the
+/// Trace Event format of createJSONTracer().
+llvm::Error convertBinaryTrace(llvm::StringRef Data, llvm::raw_ostream &OS);
+
+/// Create an instance of EventTracer that aggregates events instead of
+/// recording them: spans into a latency histogram per name, and values of
+/// trace::metric() into their count, sum and last value. Names of spans are
+/// truncated at the first ':', which separates file names from task names.
+/// With allocation tracking, the allocations of the spans are summed too.
+///
+/// Every \p Interval, and when the tracer is destroyed, \p Export is called
+/// with a snapshot of the aggregates since the tracer was created. Events are
+/// also forwarded to \p Next, if set.
+std::unique_ptr<EventTracer>
+createMetricsTracer(std::chrono::milliseconds Interval,
+                    std::function<void(const llvm::json::Value &)> Export,
+                    EventTracer *Next = nullptr);
+
+/// Create an instance of EventTracer that writes the traces of the requests
+/// that are slow, and only those. A request is a span outside of any other,
+/// e.g. an LSP call. The spans and instant events within it, on any thread,
+/// are recorded in a buffer carried by its context. When the context is
+/// destroyed, i.e. no work on the request is left, the buffer is discarded
+/// unless the request took at least \p Threshold. For slow requests, \p Export
+/// is called with the tree of their spans, including their args. Calls to
+/// \p Export are serialized. Events are also forwarded to \p Next, if set.
+std::unique_ptr<EventTracer>
+createSlowRequestTracer(std::chrono::milliseconds Threshold,
+                        std::function<void(const llvm::json::Value &)> Export,
+                        EventTracer *Next = nullptr);
+
 /// Records a single instant event, associated with the current thread.
 void log(const llvm::Twine &Name);
 
+/// Records a value of a metric, such as a cache hit (1) or the size of a data
+/// structure.
+void metric(llvm::StringRef Name, double Value = 1);
+
 /// Records an event whose duration is the lifetime of the Span object.
 /// This lifetime is extended when the span's context is reused.
 ///
+/// With allocation tracking enabled (see ClangTidyAllocations.h), the heap
+/// allocations made on the span's thread while it's alive are attached to it
+/// as the "alloc_bytes" and "alloc_calls" args.
+///
 /// This is the main public interface for producing tracing events.
 ///
 /// Arbitrary JSON metadata can be attached while this span is active:
@@ -92,6 +148,8 @@ public:
 
 private:
   WithContext RestoreCtx;
+  tidy::AllocationCount Allocated;
+  llvm::Optional<tidy::AllocationScope> Allocating;
 };
 
 /// Attach a key-value pair to a Span event.
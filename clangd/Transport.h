@@ -86,6 +86,14 @@ newJSONTransport(std::FILE *In, llvm::raw_ostream &Out,
                  llvm::raw_ostream *InMirror, bool Pretty,
                  JSONStreamStyle = JSONStreamStyle::Standard);
 
+// Returns a Transport that forwards to Base, and writes each message it
+// receives to Out. Messages are written in the delimited style, each preceded
+// by a "# t=<milliseconds>" comment giving its arrival time since the
+// transport was created. Such recordings can be replayed by clangd-replay, or
+// fed to clangd with -input-style=delimited.
+std::unique_ptr<Transport>
+newRecordingTransport(std::unique_ptr<Transport> Base, llvm::raw_ostream &Out);
+
 } // namespace clangd
 } // namespace clang
 
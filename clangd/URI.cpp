@@ -238,5 +238,52 @@ Expected<std::string> URI::includeSpelling(const URI &Uri) {
   return S->get()->getIncludeSpelling(Uri);
 }
 
+void CachedURIResolver::Outcome::set(Expected<std::string> Result) {
+  Done = true;
+  if (Result) {
+    Value = std::move(*Result);
+  } else {
+    Failed = true;
+    Value = llvm::toString(Result.takeError());
+  }
+}
+
+Expected<StringRef> CachedURIResolver::Outcome::get() const {
+  if (Failed)
+    return make_string_error(Value);
+  return StringRef(Value);
+}
+
+CachedURIResolver::Entry &CachedURIResolver::entry(StringRef FileURI) {
+  auto Inserted = Entries.try_emplace(FileURI);
+  Entry &E = Inserted.first->second;
+  if (Inserted.second) {
+    auto U = URI::parse(FileURI);
+    if (U)
+      E.Parsed = std::move(*U);
+    else
+      E.ParseError = llvm::toString(U.takeError());
+  }
+  return E;
+}
+
+Expected<StringRef> CachedURIResolver::resolve(StringRef FileURI) {
+  Entry &E = entry(FileURI);
+  if (!E.Parsed)
+    return make_string_error(E.ParseError);
+  if (!E.Resolved.Done)
+    E.Resolved.set(URI::resolve(*E.Parsed, HintPath));
+  return E.Resolved.get();
+}
+
+Expected<StringRef> CachedURIResolver::includeSpelling(StringRef FileURI) {
+  Entry &E = entry(FileURI);
+  if (!E.Parsed)
+    return make_string_error(E.ParseError);
+  if (!E.Spelling.Done)
+    E.Spelling.set(URI::includeSpelling(*E.Parsed));
+  return E.Spelling.get();
+}
+
 } // namespace clangd
 } // namespace clang
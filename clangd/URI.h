@@ -10,6 +10,8 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_PATHURI_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_PATHURI_H
 
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/Registry.h"
@@ -92,6 +94,48 @@ private:
   std::string Body;
 };
 
+/// Memoizes resolving the URIs of index results. The results of a request
+/// usually point into few distinct files, and resolving a URI parses and
+/// percent-decodes it and looks up its scheme each time.
+///
+/// URIs are keyed by their text rather than their address: the results of an
+/// index may be temporary, so the memory of a URI may be reused by another.
+/// Not thread-safe, meant to live as long as a request.
+class CachedURIResolver {
+public:
+  /// \p HintPath is passed to URI::resolve().
+  explicit CachedURIResolver(llvm::StringRef HintPath = "")
+      : HintPath(HintPath) {}
+
+  /// Same as URI::resolve() on URI::parse(\p FileURI). The result is valid as
+  /// long as the resolver.
+  llvm::Expected<llvm::StringRef> resolve(llvm::StringRef FileURI);
+  /// Same as URI::includeSpelling() on URI::parse(\p FileURI).
+  llvm::Expected<llvm::StringRef> includeSpelling(llvm::StringRef FileURI);
+
+private:
+  // The result of an operation, or the message of its error.
+  struct Outcome {
+    bool Done = false;
+    bool Failed = false;
+    std::string Value;
+
+    void set(llvm::Expected<std::string> Result);
+    llvm::Expected<llvm::StringRef> get() const;
+  };
+  struct Entry {
+    llvm::Optional<URI> Parsed;
+    std::string ParseError;
+    Outcome Resolved;
+    Outcome Spelling;
+  };
+
+  Entry &entry(llvm::StringRef FileURI);
+
+  std::string HintPath;
+  llvm::StringMap<Entry> Entries;
+};
+
 /// URIScheme is an extension point for teaching clangd to recognize a custom
 /// URI scheme. This is expected to be implemented and exposed via the
 /// URISchemeRegistry.
@@ -8,13 +8,12 @@
 //===----------------------------------------------------------------------===//
 #include "XRefs.h"
 #include "AST.h"
+#include "Cancellation.h"
 #include "Logger.h"
 #include "SourceCode.h"
 #include "URI.h"
 #include "clang/AST/DeclTemplate.h"
 #include "clang/AST/RecursiveASTVisitor.h"
-#include "clang/Index/IndexDataConsumer.h"
-#include "clang/Index/IndexingAction.h"
 #include "clang/Index/USRGeneration.h"
 #include "llvm/Support/Path.h"
 
@@ -43,25 +42,21 @@ void logIfOverflow(const SymbolLocation &Loc) {
 }
 
 // Convert a SymbolLocation to LSP's Location.
-// HintPath is used to resolve the path of URI.
+// URIs resolves the path of URI, memoizing it for the other locations in the
+// same file.
 // FIXME: figure out a good home for it, and share the implementation with
 // FindSymbols.
 Optional<Location> toLSPLocation(const SymbolLocation &Loc,
-                                 StringRef HintPath) {
+                                 CachedURIResolver &URIs) {
   if (!Loc)
     return None;
-  auto Uri = URI::parse(Loc.FileURI);
-  if (!Uri) {
-    log("Could not parse URI: {0}", Loc.FileURI);
-    return None;
-  }
-  auto Path = URI::resolve(*Uri, HintPath);
+  auto Path = URIs.resolve(Loc.FileURI);
   if (!Path) {
-    log("Could not resolve URI: {0}", Loc.FileURI);
+    log("Could not resolve URI {0}: {1}", Loc.FileURI, Path.takeError());
     return None;
   }
   Location LSPLoc;
-  LSPLoc.uri = URIForFile(*Path);
+  LSPLoc.uri = URIForFile(Path->str());
   LSPLoc.range.start.line = Loc.Start.line();
   LSPLoc.range.start.character = Loc.Start.column();
   LSPLoc.range.end.line = Loc.End.line();
@@ -81,139 +76,88 @@ struct DeclInfo {
   bool IsReferencedExplicitly = false;
 };
 
-/// Finds declarations locations that a given source location refers to.
-class DeclarationAndMacrosFinder : public index::IndexDataConsumer {
-  std::vector<MacroDecl> MacroInfos;
-  // The value of the map indicates whether the declaration has been referenced
-  // explicitly in the code.
-  // True means the declaration is explicitly referenced at least once; false
-  // otherwise.
-  DenseMap<const Decl *, bool> Decls;
-  const SourceLocation &SearchedLocation;
-  const ASTContext &AST;
-  Preprocessor &PP;
-
-public:
-  DeclarationAndMacrosFinder(const SourceLocation &SearchedLocation,
-                             ASTContext &AST, Preprocessor &PP)
-      : SearchedLocation(SearchedLocation), AST(AST), PP(PP) {}
-
-  // Get all DeclInfo of the found declarations.
-  // The results are sorted by "IsReferencedExplicitly" and declaration
-  // location.
-  std::vector<DeclInfo> getFoundDecls() const {
-    std::vector<DeclInfo> Result;
-    for (auto It : Decls) {
-      Result.emplace_back();
-      Result.back().D = It.first;
-      Result.back().IsReferencedExplicitly = It.second;
-    }
+struct IdentifiedSymbol {
+  std::vector<DeclInfo> Decls;
+  std::vector<MacroDecl> Macros;
+};
 
-    // Sort results. Declarations being referenced explicitly come first.
-    llvm::sort(Result, [](const DeclInfo &L, const DeclInfo &R) {
-      if (L.IsReferencedExplicitly != R.IsReferencedExplicitly)
-        return L.IsReferencedExplicitly > R.IsReferencedExplicitly;
-      return L.D->getBeginLoc() < R.D->getBeginLoc();
-    });
-    return Result;
-  }
+// Checks whether E has an implicit AST node (e.g. ImplicitCastExpr).
+bool hasImplicitExpr(const Expr *E) {
+  if (!E || E->child_begin() == E->child_end())
+    return false;
+  // Use the first child is good enough for most cases -- normally the
+  // expression returned by handleDeclOccurence contains exactly one
+  // child expression.
+  const auto *FirstChild = *E->child_begin();
+  return isa<ExprWithCleanups>(FirstChild) ||
+         isa<MaterializeTemporaryExpr>(FirstChild) ||
+         isa<CXXBindTemporaryExpr>(FirstChild) ||
+         isa<ImplicitCastExpr>(FirstChild);
+}
 
-  std::vector<MacroDecl> takeMacroInfos() {
-    // Don't keep the same Macro info multiple times.
-    llvm::sort(MacroInfos, [](const MacroDecl &Left, const MacroDecl &Right) {
-      return Left.Info < Right.Info;
-    });
+// Finds the macro at the searched location, if any.
+Optional<MacroDecl> getMacroAtLocation(ParsedAST &AST,
+                                       SourceLocation SearchedLocation) {
+  Token Result;
+  auto &Mgr = AST.getASTContext().getSourceManager();
+  Preprocessor &PP = AST.getPreprocessor();
+  if (Lexer::getRawToken(Mgr.getSpellingLoc(SearchedLocation), Result, Mgr,
+                         AST.getASTContext().getLangOpts(), false))
+    return None;
+  if (Result.is(tok::raw_identifier))
+    PP.LookUpIdentifierInfo(Result);
+  IdentifierInfo *IdentifierInfo = Result.getIdentifierInfo();
+  if (!IdentifierInfo || !IdentifierInfo->hadMacroDefinition())
+    return None;
+  std::pair<FileID, unsigned int> DecLoc =
+      Mgr.getDecomposedExpansionLoc(SearchedLocation);
+  // Get the definition just before the searched location so that a macro
+  // referenced in a '#undef MACRO' can still be found.
+  SourceLocation BeforeSearchedLocation = Mgr.getMacroArgExpandedLocation(
+      Mgr.getLocForStartOfFile(DecLoc.first)
+          .getLocWithOffset(DecLoc.second - 1));
+  MacroDefinition MacroDef =
+      PP.getMacroDefinitionAtLoc(IdentifierInfo, BeforeSearchedLocation);
+  if (MacroInfo *MacroInf = MacroDef.getMacroInfo())
+    return MacroDecl{IdentifierInfo->getName(), MacroInf};
+  return None;
+}
 
-    auto Last = std::unique(MacroInfos.begin(), MacroInfos.end(),
-                            [](const MacroDecl &Left, const MacroDecl &Right) {
-                              return Left.Info == Right.Info;
-                            });
-    MacroInfos.erase(Last, MacroInfos.end());
-    return std::move(MacroInfos);
+// Finds declarations and macros that a given source location refers to.
+// Declarations are looked up in the occurrences precomputed for the AST.
+IdentifiedSymbol getSymbolAtPosition(ParsedAST &AST, SourceLocation Pos) {
+  IdentifiedSymbol Result;
+  if (auto Macro = getMacroAtLocation(AST, Pos)) {
+    Result.Macros.push_back(*Macro);
+    return Result;
   }
 
-  bool
-  handleDeclOccurence(const Decl *D, index::SymbolRoleSet Roles,
-                      ArrayRef<index::SymbolRelation> Relations,
-                      SourceLocation Loc,
-                      index::IndexDataConsumer::ASTNodeInfo ASTNode) override {
-    if (Loc == SearchedLocation) {
-      // Check whether the E has an implicit AST node (e.g. ImplicitCastExpr).
-      auto hasImplicitExpr = [](const Expr *E) {
-        if (!E || E->child_begin() == E->child_end())
-          return false;
-        // Use the first child is good enough for most cases -- normally the
-        // expression returned by handleDeclOccurence contains exactly one
-        // child expression.
-        const auto *FirstChild = *E->child_begin();
-        return isa<ExprWithCleanups>(FirstChild) ||
-               isa<MaterializeTemporaryExpr>(FirstChild) ||
-               isa<CXXBindTemporaryExpr>(FirstChild) ||
-               isa<ImplicitCastExpr>(FirstChild);
-      };
-
-      bool IsExplicit = !hasImplicitExpr(ASTNode.OrigE);
-      // Find and add definition declarations (for GoToDefinition).
-      // We don't use parameter `D`, as Parameter `D` is the canonical
-      // declaration, which is the first declaration of a redeclarable
-      // declaration, and it could be a forward declaration.
-      if (const auto *Def = getDefinition(D)) {
-        Decls[Def] |= IsExplicit;
-      } else {
-        // Couldn't find a definition, fall back to use `D`.
-        Decls[D] |= IsExplicit;
-      }
-    }
-    return true;
+  // The value of the map indicates whether the declaration has been referenced
+  // explicitly in the code.
+  DenseMap<const Decl *, bool> Decls;
+  for (const DeclOccurrence &O : AST.getDeclOccurrencesAt(Pos)) {
+    bool IsExplicit = !hasImplicitExpr(O.E);
+    // Find and add definition declarations (for GoToDefinition).
+    // We don't use `O.D`, as it is the canonical declaration, which is the
+    // first declaration of a redeclarable declaration, and it could be a
+    // forward declaration.
+    if (const auto *Def = getDefinition(O.D))
+      Decls[Def] |= IsExplicit;
+    else // Couldn't find a definition, fall back to use `O.D`.
+      Decls[O.D] |= IsExplicit;
   }
-
-private:
-  void finish() override {
-    // Also handle possible macro at the searched location.
-    Token Result;
-    auto &Mgr = AST.getSourceManager();
-    if (!Lexer::getRawToken(Mgr.getSpellingLoc(SearchedLocation), Result, Mgr,
-                            AST.getLangOpts(), false)) {
-      if (Result.is(tok::raw_identifier)) {
-        PP.LookUpIdentifierInfo(Result);
-      }
-      IdentifierInfo *IdentifierInfo = Result.getIdentifierInfo();
-      if (IdentifierInfo && IdentifierInfo->hadMacroDefinition()) {
-        std::pair<FileID, unsigned int> DecLoc =
-            Mgr.getDecomposedExpansionLoc(SearchedLocation);
-        // Get the definition just before the searched location so that a macro
-        // referenced in a '#undef MACRO' can still be found.
-        SourceLocation BeforeSearchedLocation = Mgr.getMacroArgExpandedLocation(
-            Mgr.getLocForStartOfFile(DecLoc.first)
-                .getLocWithOffset(DecLoc.second - 1));
-        MacroDefinition MacroDef =
-            PP.getMacroDefinitionAtLoc(IdentifierInfo, BeforeSearchedLocation);
-        MacroInfo *MacroInf = MacroDef.getMacroInfo();
-        if (MacroInf) {
-          MacroInfos.push_back(MacroDecl{IdentifierInfo->getName(), MacroInf});
-          assert(Decls.empty());
-        }
-      }
-    }
+  for (auto It : Decls) {
+    Result.Decls.emplace_back();
+    Result.Decls.back().D = It.first;
+    Result.Decls.back().IsReferencedExplicitly = It.second;
   }
-};
-
-struct IdentifiedSymbol {
-  std::vector<DeclInfo> Decls;
-  std::vector<MacroDecl> Macros;
-};
-
-IdentifiedSymbol getSymbolAtPosition(ParsedAST &AST, SourceLocation Pos) {
-  auto DeclMacrosFinder = DeclarationAndMacrosFinder(Pos, AST.getASTContext(),
-                                                     AST.getPreprocessor());
-  index::IndexingOptions IndexOpts;
-  IndexOpts.SystemSymbolFilter =
-      index::IndexingOptions::SystemSymbolFilterKind::All;
-  IndexOpts.IndexFunctionLocals = true;
-  indexTopLevelDecls(AST.getASTContext(), AST.getPreprocessor(),
-                     AST.getLocalTopLevelDecls(), DeclMacrosFinder, IndexOpts);
-
-  return {DeclMacrosFinder.getFoundDecls(), DeclMacrosFinder.takeMacroInfos()};
+  // Sort results. Declarations being referenced explicitly come first.
+  llvm::sort(Result.Decls, [](const DeclInfo &L, const DeclInfo &R) {
+    if (L.IsReferencedExplicitly != R.IsReferencedExplicitly)
+      return L.IsReferencedExplicitly > R.IsReferencedExplicitly;
+    return L.D->getBeginLoc() < R.D->getBeginLoc();
+  });
+  return Result;
 }
 
 Range getTokenRange(ParsedAST &AST, SourceLocation TokLoc) {
@@ -333,17 +277,18 @@ std::vector<Location> findDefinitions(ParsedAST &AST, Position Pos,
         SourceMgr.getFileEntryForID(SourceMgr.getMainFileID());
     if (auto Path = getRealPath(FE, SourceMgr))
       HintPath = *Path;
+    CachedURIResolver URIs(HintPath);
     // Query the index and populate the empty slot.
-    Index->lookup(QueryRequest, [&HintPath, &ResultCandidates,
+    Index->lookup(QueryRequest, [&URIs, &ResultCandidates,
                                  &CandidatesIndex](const Symbol &Sym) {
       auto It = CandidatesIndex.find(Sym.ID);
       assert(It != CandidatesIndex.end());
       auto &Value = ResultCandidates[It->second];
 
       if (!Value.Def)
-        Value.Def = toLSPLocation(Sym.Definition, HintPath);
+        Value.Def = toLSPLocation(Sym.Definition, URIs);
       if (!Value.Decl)
-        Value.Decl = toLSPLocation(Sym.CanonicalDeclaration, HintPath);
+        Value.Decl = toLSPLocation(Sym.CanonicalDeclaration, URIs);
     });
   }
 
@@ -361,67 +306,50 @@ std::vector<Location> findDefinitions(ParsedAST &AST, Position Pos,
 
 namespace {
 
-/// Collects references to symbols within the main file.
-class ReferenceFinder : public index::IndexDataConsumer {
-public:
-  struct Reference {
-    const Decl *CanonicalTarget;
-    SourceLocation Loc;
-    index::SymbolRoleSet Role;
-  };
-
-  ReferenceFinder(ASTContext &AST, Preprocessor &PP,
-                  const std::vector<const Decl *> &TargetDecls)
-      : AST(AST) {
-    for (const Decl *D : TargetDecls)
-      CanonicalTargets.insert(D->getCanonicalDecl());
-  }
-
-  std::vector<Reference> take() && {
-    llvm::sort(References, [](const Reference &L, const Reference &R) {
-      return std::tie(L.Loc, L.CanonicalTarget, L.Role) <
-             std::tie(R.Loc, R.CanonicalTarget, R.Role);
-    });
-    // We sometimes see duplicates when parts of the AST get traversed twice.
-    References.erase(
-        std::unique(References.begin(), References.end(),
-                    [](const Reference &L, const Reference &R) {
-                      return std::tie(L.CanonicalTarget, L.Loc, L.Role) ==
-                             std::tie(R.CanonicalTarget, R.Loc, R.Role);
-                    }),
-        References.end());
-    return std::move(References);
-  }
-
-  bool
-  handleDeclOccurence(const Decl *D, index::SymbolRoleSet Roles,
-                      ArrayRef<index::SymbolRelation> Relations,
-                      SourceLocation Loc,
-                      index::IndexDataConsumer::ASTNodeInfo ASTNode) override {
-    assert(D->isCanonicalDecl() && "expect D to be a canonical declaration");
-    const SourceManager &SM = AST.getSourceManager();
-    Loc = SM.getFileLoc(Loc);
-    if (SM.isWrittenInMainFile(Loc) && CanonicalTargets.count(D))
-      References.push_back({D, Loc, Roles});
-    return true;
-  }
+struct Reference {
+  const Decl *CanonicalTarget;
+  SourceLocation Loc;
+  index::SymbolRoleSet Role;
+};
 
-private:
+// Finds references to Decls within the main file, using the occurrences
+// precomputed for the AST.
+std::vector<Reference> findRefs(const std::vector<const Decl *> &Decls,
+                                ParsedAST &AST) {
   SmallSet<const Decl *, 4> CanonicalTargets;
+  for (const Decl *D : Decls)
+    CanonicalTargets.insert(D->getCanonicalDecl());
   std::vector<Reference> References;
-  const ASTContext &AST;
-};
+  if (CanonicalTargets.empty())
+    return References;
 
-std::vector<ReferenceFinder::Reference>
-findRefs(const std::vector<const Decl *> &Decls, ParsedAST &AST) {
-  ReferenceFinder RefFinder(AST.getASTContext(), AST.getPreprocessor(), Decls);
-  index::IndexingOptions IndexOpts;
-  IndexOpts.SystemSymbolFilter =
-      index::IndexingOptions::SystemSymbolFilterKind::All;
-  IndexOpts.IndexFunctionLocals = true;
-  indexTopLevelDecls(AST.getASTContext(), AST.getPreprocessor(),
-                     AST.getLocalTopLevelDecls(), RefFinder, IndexOpts);
-  return std::move(RefFinder).take();
+  const SourceManager &SM = AST.getASTContext().getSourceManager();
+  CancellationCheckpoint Checkpoint;
+  for (const DeclOccurrence &O : AST.getDeclOccurrences()) {
+    if (Checkpoint.cancelled())
+      break;
+    assert(O.D->isCanonicalDecl() && "expect D to be a canonical declaration");
+    if (!CanonicalTargets.count(O.D))
+      continue;
+    SourceLocation Loc = SM.getFileLoc(O.Loc);
+    if (SM.isWrittenInMainFile(Loc))
+      References.push_back({O.D, Loc, O.Roles});
+  }
+
+  llvm::sort(References, [](const Reference &L, const Reference &R) {
+    return std::tie(L.Loc, L.CanonicalTarget, L.Role) <
+           std::tie(R.Loc, R.CanonicalTarget, R.Role);
+  });
+  // We sometimes see duplicates when parts of the AST get traversed twice.
+  References.erase(std::unique(References.begin(), References.end(),
+                               [](const Reference &L, const Reference &R) {
+                                 return std::tie(L.CanonicalTarget, L.Loc,
+                                                 L.Role) ==
+                                        std::tie(R.CanonicalTarget, R.Loc,
+                                                 R.Role);
+                               }),
+                   References.end());
+  return References;
 }
 
 } // namespace
@@ -699,7 +627,8 @@ Optional<Hover> getHover(ParsedAST &AST, Position Pos) {
 }
 
 std::vector<Location> findReferences(ParsedAST &AST, Position Pos,
-                                     const SymbolIndex *Index) {
+                                     const SymbolIndex *Index,
+                                     uint32_t Limit) {
   std::vector<Location> Results;
   const SourceManager &SM = AST.getASTContext().getSourceManager();
   auto MainFilePath = getRealPath(SM.getFileEntryForID(SM.getMainFileID()), SM);
@@ -725,9 +654,13 @@ std::vector<Location> findReferences(ParsedAST &AST, Position Pos,
     Result.uri = URIForFile(*MainFilePath);
     Results.push_back(std::move(Result));
   }
+  if (Limit && Results.size() >= Limit) {
+    Results.resize(Limit);
+    return Results;
+  }
 
   // Now query the index for references from other files.
-  if (!Index)
+  if (!Index || isCancelled())
     return Results;
   RefsRequest Req;
   for (const Decl *D : TargetDecls) {
@@ -741,11 +674,18 @@ std::vector<Location> findReferences(ParsedAST &AST, Position Pos,
   }
   if (Req.IDs.empty())
     return Results;
-  Index->refs(Req, [&](const Ref &R) {
-    auto LSPLoc = toLSPLocation(R.Location, /*HintPath=*/*MainFilePath);
-    // Avoid indexed results for the main file - the AST is authoritative.
-    if (LSPLoc && LSPLoc->uri.file() != *MainFilePath)
-      Results.push_back(std::move(*LSPLoc));
+  CancellationCheckpoint Checkpoint;
+  CachedURIResolver URIs(*MainFilePath);
+  Index->refsBySymbol(Req, [&](const SymbolID &, ArrayRef<Ref> Refs) {
+    for (const Ref &R : Refs) {
+      // Converting URIs is slow for symbols with many references.
+      if ((Limit && Results.size() >= Limit) || Checkpoint.cancelled())
+        return;
+      auto LSPLoc = toLSPLocation(R.Location, URIs);
+      // Avoid indexed results for the main file - the AST is authoritative.
+      if (LSPLoc && LSPLoc->uri.file() != *MainFilePath)
+        Results.push_back(std::move(*LSPLoc));
+    }
   });
   return Results;
 }
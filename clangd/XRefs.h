@@ -35,8 +35,12 @@ std::vector<DocumentHighlight> findDocumentHighlights(ParsedAST &AST,
 llvm::Optional<Hover> getHover(ParsedAST &AST, Position Pos);
 
 /// Returns reference locations of the symbol at a specified \p Pos.
+/// If the current task is cancelled, returns the references found so far.
+/// If \p Limit is non-zero, returns at most Limit references, those in the
+/// main file first.
 std::vector<Location> findReferences(ParsedAST &AST, Position Pos,
-                                     const SymbolIndex *Index = nullptr);
+                                     const SymbolIndex *Index = nullptr,
+                                     uint32_t Limit = 0);
 
 } // namespace clangd
 } // namespace clang
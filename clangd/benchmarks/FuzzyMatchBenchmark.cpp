@@ -0,0 +1,139 @@
+//===--- FuzzyMatchBenchmark.cpp - Clangd fuzzy matching benchmarks -*- C++-*-//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmarks of the fuzzy matching of identifiers, by code completion and
+// workspace symbols, and of the trigrams that Dex generates for them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../FuzzyMatch.h"
+#include "../index/dex/Trigram.h"
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// Identifiers in the naming styles of real code: camelCase, PascalCase,
+// snake_case, UPPER_CASE and member prefixes. Names are made of common
+// identifier parts, the corpus only depends on its size.
+std::vector<std::string> generateIdentifiers(size_t N) {
+  static const char *Parts[] = {
+      "get",  "set",    "is",     "has",    "make",  "create", "find",
+      "add",  "remove", "update", "parse",  "print", "to",     "from",
+      "node", "decl",   "expr",   "type",   "name",  "value",  "index",
+      "file", "path",   "buffer", "string", "map",   "list",   "state",
+      "info", "kind",   "loc",    "range",  "token", "scope",  "symbol"};
+  constexpr unsigned NumParts = sizeof(Parts) / sizeof(Parts[0]);
+  std::mt19937 Gen(42);
+  std::uniform_int_distribution<unsigned> Part(0, NumParts - 1);
+  std::uniform_int_distribution<unsigned> NumNameParts(1, 4);
+  std::uniform_int_distribution<unsigned> Style(0, 4);
+
+  std::vector<std::string> Identifiers;
+  for (size_t I = 0; I < N; ++I) {
+    unsigned S = Style(Gen);
+    std::string Name = S == 4 ? "m_" : "";
+    for (unsigned NP = NumNameParts(Gen), J = 0; J < NP; ++J) {
+      std::string P = Parts[Part(Gen)];
+      if ((S == 2 || S == 3) && J > 0)
+        Name += '_';
+      if (S == 3)
+        for (char &C : P)
+          C = toupper(C);
+      else if ((S == 0 && J > 0) || S == 1 || S == 4)
+        P[0] = toupper(P[0]);
+      Name += P;
+    }
+    Identifiers.push_back(std::move(Name));
+  }
+  return Identifiers;
+}
+
+const std::vector<std::string> &identifiers() {
+  static const auto *Identifiers =
+      new std::vector<std::string>(generateIdentifiers(100000));
+  return *Identifiers;
+}
+
+// Patterns typed by users, by range(0): a first letter, a few initials, a
+// prefix that spans parts, and a pattern that matches few words.
+const char *pattern(int64_t Index) {
+  static const char *Patterns[] = {"g", "gnt", "getNodeT", "xqz"};
+  return Patterns[Index];
+}
+
+static void FuzzyMatch(benchmark::State &State) {
+  const auto &Words = identifiers();
+  FuzzyMatcher Matcher(pattern(State.range(0)));
+  for (auto _ : State)
+    for (const std::string &Word : Words)
+      benchmark::DoNotOptimize(Matcher.match(Word));
+  State.SetItemsProcessed(State.iterations() * Words.size());
+}
+BENCHMARK(FuzzyMatch)->DenseRange(0, 3);
+
+static void FuzzyMatchBatch(benchmark::State &State) {
+  std::vector<StringRef> Words(identifiers().begin(), identifiers().end());
+  std::vector<Optional<float>> Scores(Words.size());
+  FuzzyMatcher Matcher(pattern(State.range(0)));
+  for (auto _ : State) {
+    Matcher.match(Words, Scores);
+    benchmark::DoNotOptimize(Scores.data());
+  }
+  State.SetItemsProcessed(State.iterations() * Words.size());
+}
+BENCHMARK(FuzzyMatchBatch)->DenseRange(0, 3);
+
+static void IdentifierTrigrams(benchmark::State &State) {
+  const auto &Words = identifiers();
+  for (auto _ : State)
+    for (const std::string &Word : Words)
+      benchmark::DoNotOptimize(dex::generateIdentifierTrigrams(Word));
+  State.SetItemsProcessed(State.iterations() * Words.size());
+}
+BENCHMARK(IdentifierTrigrams);
+
+static void PackedIdentifierTrigrams(benchmark::State &State) {
+  const auto &Words = identifiers();
+  std::vector<dex::PackedTrigram> Trigrams;
+  for (auto _ : State)
+    for (const std::string &Word : Words) {
+      dex::generateIdentifierTrigrams(Word, Trigrams);
+      benchmark::DoNotOptimize(Trigrams.data());
+    }
+  State.SetItemsProcessed(State.iterations() * Words.size());
+}
+BENCHMARK(PackedIdentifierTrigrams);
+
+static void QueryTrigrams(benchmark::State &State) {
+  // Queries are prefixes of identifiers, as typed.
+  std::vector<std::string> Queries;
+  for (const std::string &Word : identifiers())
+    for (size_t Len = 1; Len <= Word.size() && Queries.size() < 10000;
+         Len += 3)
+      Queries.push_back(Word.substr(0, Len));
+  for (auto _ : State)
+    for (const std::string &Query : Queries)
+      benchmark::DoNotOptimize(dex::generateQueryTrigrams(Query));
+  State.SetItemsProcessed(State.iterations() * Queries.size());
+}
+BENCHMARK(QueryTrigrams);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
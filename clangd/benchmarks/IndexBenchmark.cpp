@@ -7,25 +7,124 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "../index/FileIndex.h"
+#include "../index/MemIndex.h"
 #include "../index/Serialization.h"
 #include "../index/dex/Dex.h"
 #include "benchmark/benchmark.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Regex.h"
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
 #include <streambuf>
 #include <string>
 
-const char *IndexFilename;
-const char *RequestsFilename;
+const char *IndexFilename = nullptr;
+const char *RequestsFilename = nullptr;
 
 using namespace llvm;
 namespace clang {
 namespace clangd {
 namespace {
 
+// A synthetic corpus, so that build scaling can be measured without a real
+// index. Names are made of common identifier parts, so that their trigrams are
+// distributed roughly like those of real code. The corpus only depends on its
+// size.
+struct SyntheticCorpus {
+  // Consecutive symbols are declared in the same file.
+  static constexpr unsigned SymbolsPerFile = 50;
+
+  SymbolSlab Symbols;
+  RefSlab Refs;
+};
+
+const SyntheticCorpus &syntheticCorpus(size_t NumSymbols) {
+  static std::mutex Mu;
+  static std::map<size_t, std::unique_ptr<SyntheticCorpus>> Cache;
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto &Corpus = Cache[NumSymbols];
+  if (Corpus)
+    return *Corpus;
+
+  static const char *Parts[] = {
+      "get",  "set",    "is",     "has",    "make",  "create", "find",
+      "add",  "remove", "update", "parse",  "print", "to",     "from",
+      "node", "decl",   "expr",   "type",   "name",  "value",  "index",
+      "file", "path",   "buffer", "string", "map",   "list",   "state",
+      "info", "kind",   "loc",    "range",  "token", "scope",  "symbol"};
+  constexpr unsigned NumParts = sizeof(Parts) / sizeof(Parts[0]);
+  std::mt19937 Gen(NumSymbols);
+  std::uniform_int_distribution<unsigned> Part(0, NumParts - 1);
+  std::uniform_int_distribution<unsigned> NumNameParts(1, 4);
+  std::geometric_distribution<unsigned> References(0.01);
+
+  SymbolSlab::Builder Symbols;
+  RefSlab::Builder Refs;
+  std::string Name, Scope, FileURI;
+  for (size_t I = 0; I < NumSymbols; ++I) {
+    Name.clear();
+    for (unsigned N = NumNameParts(Gen), J = 0; J < N; ++J) {
+      std::string P = Parts[Part(Gen)];
+      if (J > 0)
+        P[0] = toupper(P[0]);
+      Name += P;
+    }
+    Name += std::to_string(I % 100);
+    size_t File = I / SyntheticCorpus::SymbolsPerFile;
+    Scope = "ns" + std::to_string(File % 1000) + "::";
+    FileURI = "file:///synthetic/dir" + std::to_string(File % 100) + "/file" +
+              std::to_string(File) + ".h";
+
+    Symbol Sym;
+    Sym.ID = SymbolID(Scope + Name + std::to_string(I));
+    Sym.Name = Name;
+    Sym.Scope = Scope;
+    Sym.SymInfo.Kind = index::SymbolKind::Function;
+    Sym.SymInfo.Lang = index::SymbolLanguage::CXX;
+    Sym.CanonicalDeclaration.FileURI = FileURI.c_str();
+    Sym.Definition.FileURI = FileURI.c_str();
+    Sym.References = References(Gen);
+    Sym.Flags |= Symbol::IndexedForCodeCompletion;
+    Symbols.insert(Sym);
+
+    Ref R;
+    R.Location.FileURI = FileURI.c_str();
+    R.Kind = RefKind::Reference;
+    for (unsigned J = 0; J < std::min(Sym.References, 20u); ++J) {
+      R.Location.Start.setLine(J);
+      Refs.insert(Sym.ID, R);
+    }
+  }
+  Corpus = llvm::make_unique<SyntheticCorpus>();
+  Corpus->Symbols = std::move(Symbols).build();
+  Corpus->Refs = std::move(Refs).build();
+  return *Corpus;
+}
+
+// Every other ID of the corpus, the first half of them replaced by IDs that
+// are not in the index.
+std::vector<SymbolID> lookupIDs(const SyntheticCorpus &Corpus) {
+  std::vector<SymbolID> IDs;
+  size_t I = 0;
+  for (const Symbol &Sym : Corpus.Symbols)
+    if (I++ % 2 == 0)
+      IDs.push_back(Sym.ID);
+  for (size_t J = 0; J < IDs.size() / 2; ++J)
+    IDs[J] = SymbolID("missing" + std::to_string(J));
+  return IDs;
+}
+
+// Reports the size of an index as a counter of the benchmark.
+void reportMemory(benchmark::State &State, const SymbolIndex &Index) {
+  State.counters["bytes"] = Index.estimateMemoryUsage();
+}
+
 std::unique_ptr<SymbolIndex> buildMem() {
   return loadIndex(IndexFilename, /*UseDex=*/false);
 }
@@ -67,6 +166,10 @@ std::vector<FuzzyFindRequest> extractQueriesFromLogs() {
 }
 
 static void MemQueries(benchmark::State &State) {
+  if (!IndexFilename) {
+    State.SkipWithError("no index file given");
+    return;
+  }
   const auto Mem = buildMem();
   const auto Requests = extractQueriesFromLogs();
   for (auto _ : State)
@@ -76,6 +179,10 @@ static void MemQueries(benchmark::State &State) {
 BENCHMARK(MemQueries);
 
 static void DexQueries(benchmark::State &State) {
+  if (!IndexFilename) {
+    State.SkipWithError("no index file given");
+    return;
+  }
   const auto Dex = buildDex();
   const auto Requests = extractQueriesFromLogs();
   for (auto _ : State)
@@ -84,28 +191,139 @@ static void DexQueries(benchmark::State &State) {
 }
 BENCHMARK(DexQueries);
 
+static void ReadIndexFile(benchmark::State &State) {
+  const auto &Corpus = syntheticCorpus(State.range(0));
+  IndexFileOut Out;
+  Out.Symbols = &Corpus.Symbols;
+  Out.Refs = &Corpus.Refs;
+  std::string Data;
+  {
+    raw_string_ostream OS(Data);
+    OS << Out;
+  }
+  for (auto _ : State) {
+    auto In = readIndexFile(Data);
+    if (!In) {
+      State.SkipWithError(toString(In.takeError()).c_str());
+      break;
+    }
+    benchmark::DoNotOptimize(In->Symbols);
+  }
+  State.SetBytesProcessed(State.iterations() * Data.size());
+}
+BENCHMARK(ReadIndexFile)->RangeMultiplier(10)->Range(10000, 1000000);
+
+static void MemBuild(benchmark::State &State) {
+  const auto &Corpus = syntheticCorpus(State.range(0));
+  for (auto _ : State) {
+    MemIndex Index(Corpus.Symbols, Corpus.Refs);
+    benchmark::DoNotOptimize(Index);
+    State.PauseTiming();
+    reportMemory(State, Index);
+    State.ResumeTiming();
+  }
+}
+BENCHMARK(MemBuild)->RangeMultiplier(10)->Range(10000, 10000000);
+
+static void DexBuild(benchmark::State &State) {
+  const auto &Corpus = syntheticCorpus(State.range(0));
+  for (auto _ : State) {
+    dex::Dex Index(Corpus.Symbols, Corpus.Refs);
+    benchmark::DoNotOptimize(Index);
+    State.PauseTiming();
+    reportMemory(State, Index);
+    State.ResumeTiming();
+  }
+}
+BENCHMARK(DexBuild)->RangeMultiplier(10)->Range(10000, 10000000);
+
+// Builds the index of a FileSymbols holding the corpus split in files, with
+// half of the symbols duplicated in another file. Args are the number of
+// symbols and whether duplicates are merged.
+static void FileSymbolsBuild(benchmark::State &State) {
+  const auto &Corpus = syntheticCorpus(State.range(0));
+  auto Handling = State.range(1) ? DuplicateHandling::Merge
+                                 : DuplicateHandling::PickOne;
+  for (auto _ : State) {
+    State.PauseTiming();
+    FileSymbols Files;
+    for (unsigned Copy = 0; Copy < 2; ++Copy) {
+      Optional<SymbolSlab::Builder> FileSymbols;
+      FileSymbols.emplace();
+      unsigned FileNumber = 0;
+      auto Flush = [&] {
+        Files.update("/synthetic/" + std::to_string(Copy) + "/" +
+                         std::to_string(FileNumber++),
+                     llvm::make_unique<SymbolSlab>(
+                         std::move(*FileSymbols).build()),
+                     llvm::make_unique<RefSlab>());
+        FileSymbols.emplace();
+      };
+      size_t I = 0, FileSize = 0;
+      for (const Symbol &Sym : Corpus.Symbols) {
+        if (Copy == 1 && I++ % 2)
+          continue;
+        FileSymbols->insert(Sym);
+        if (++FileSize % SyntheticCorpus::SymbolsPerFile == 0)
+          Flush();
+      }
+      Flush();
+    }
+    State.ResumeTiming();
+    auto Index = Files.buildIndex(IndexType::Light, Handling);
+    benchmark::DoNotOptimize(Index);
+  }
+}
+BENCHMARK(FileSymbolsBuild)
+    ->RangeMultiplier(10)
+    ->Ranges({{10000, 1000000}, {0, 1}});
+
+static void DexLookup(benchmark::State &State) {
+  const auto &Corpus = syntheticCorpus(State.range(0));
+  dex::Dex Dex(Corpus.Symbols, Corpus.Refs);
+  LookupRequest Req;
+  for (const SymbolID &ID : lookupIDs(Corpus))
+    Req.IDs.insert(ID);
+  for (auto _ : State)
+    Dex.lookup(Req, [](const Symbol &S) { benchmark::DoNotOptimize(S); });
+  State.SetItemsProcessed(State.iterations() * Req.IDs.size());
+}
+BENCHMARK(DexLookup)->RangeMultiplier(10)->Range(10000, 1000000);
+
+static void DexRefs(benchmark::State &State) {
+  const auto &Corpus = syntheticCorpus(State.range(0));
+  dex::Dex Dex(Corpus.Symbols, Corpus.Refs);
+  RefsRequest Req;
+  for (const auto &SymRefs : Corpus.Refs)
+    Req.IDs.insert(SymRefs.first);
+  for (auto _ : State)
+    Dex.refs(Req, [](const Ref &R) { benchmark::DoNotOptimize(R); });
+  State.SetItemsProcessed(State.iterations() * Corpus.Refs.numRefs());
+}
+BENCHMARK(DexRefs)->RangeMultiplier(10)->Range(10000, 1000000);
+
 } // namespace
 } // namespace clangd
 } // namespace clang
 
-// FIXME(kbobyrev): Add index building time benchmarks.
-// FIXME(kbobyrev): Add memory consumption "benchmarks" by manually measuring
-// in-memory index size and reporting it as time.
 // FIXME(kbobyrev): Create a logger wrapper to suppress debugging info printer.
 int main(int argc, char *argv[]) {
-  if (argc < 3) {
+  // Benchmarks of queries need an index and requests, benchmarks of the
+  // synthetic corpus run without them.
+  if (argc >= 3 && argv[1][0] != '-' && argv[2][0] != '-') {
+    IndexFilename = argv[1];
+    RequestsFilename = argv[2];
+    // Trim first two arguments of the benchmark invocation and pretend no
+    // arguments were passed in the first place.
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  } else if (argc >= 2 && argv[1][0] != '-') {
     errs() << "Usage: " << argv[0]
-           << " global-symbol-index.yaml requests.json "
+           << " [global-symbol-index.yaml requests.json] "
               "BENCHMARK_OPTIONS...\n";
     return -1;
   }
-  IndexFilename = argv[1];
-  RequestsFilename = argv[2];
-  // Trim first two arguments of the benchmark invocation and pretend no
-  // arguments were passed in the first place.
-  argv[2] = argv[0];
-  argv += 2;
-  argc -= 2;
   ::benchmark::Initialize(&argc, argv);
   ::benchmark::RunSpecifiedBenchmarks();
 }
@@ -0,0 +1,146 @@
+//===--- PathBenchmark.cpp - Clangd file proximity and URI benchmarks -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmarks of the file proximity signals of code completion, and of the
+// parsing and resolving of the URIs of index results.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../FileDistance.h"
+#include "../URI.h"
+#include "benchmark/benchmark.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Error.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// Files in a source tree whose directories nest Depth levels deep, with a few
+// directories per level. The files only depend on their number and the depth.
+std::vector<std::string> generatePaths(size_t N, unsigned Depth,
+                                       unsigned Seed) {
+  static const char *Dirs[] = {"src",  "include", "lib",   "core",
+                               "util", "detail",  "impl",  "common",
+                               "io",   "net",     "parse", "third_party"};
+  constexpr unsigned NumDirs = sizeof(Dirs) / sizeof(Dirs[0]);
+  std::mt19937 Gen(Seed);
+  std::uniform_int_distribution<unsigned> Dir(0, NumDirs - 1);
+  std::uniform_int_distribution<unsigned> Level(1, Depth);
+  std::vector<std::string> Paths;
+  for (size_t I = 0; I < N; ++I) {
+    std::string Path = "/home/user/project";
+    for (unsigned L = Level(Gen); L > 0; --L)
+      (Path += "/") += Dirs[Dir(Gen)];
+    Path += "/file" + std::to_string(I) + ".h";
+    Paths.push_back(std::move(Path));
+  }
+  return Paths;
+}
+
+// The sources of file proximity of a completion: the main file and its
+// includes, as set up by code completion.
+StringMap<SourceParams> generateSources(unsigned Depth) {
+  FileDistanceOptions Opts;
+  StringMap<SourceParams> Sources;
+  Sources["/home/user/project/src/main.cpp"].Cost = 0;
+  for (const std::string &Include : generatePaths(50, Depth, /*Seed=*/1)) {
+    auto &Source = Sources[Include];
+    Source.Cost = Opts.IncludeCost;
+    Source.MaxUpTraversals = 1;
+  }
+  return Sources;
+}
+
+// The files of the candidates of completions. The distances are memoized by
+// the proximity of a completion, so the memo is built on each iteration.
+static void FileProximity(benchmark::State &State) {
+  StringMap<SourceParams> Sources = generateSources(State.range(0));
+  std::vector<std::string> Paths =
+      generatePaths(10000, State.range(0), /*Seed=*/2);
+  for (auto _ : State) {
+    FileDistance Distance(Sources);
+    for (const std::string &Path : Paths)
+      benchmark::DoNotOptimize(Distance.distance(Path));
+  }
+  State.SetItemsProcessed(State.iterations() * Paths.size());
+}
+BENCHMARK(FileProximity)->Arg(4)->Arg(16)->Arg(64);
+
+static void URIProximity(benchmark::State &State) {
+  StringMap<SourceParams> Sources = generateSources(State.range(0));
+  std::vector<std::string> URIs;
+  for (const std::string &Path :
+       generatePaths(10000, State.range(0), /*Seed=*/2))
+    URIs.push_back(URI::createFile(Path).toString());
+  for (auto _ : State) {
+    URIDistance Distance(Sources);
+    for (const std::string &U : URIs)
+      benchmark::DoNotOptimize(Distance.distance(U));
+  }
+  State.SetItemsProcessed(State.iterations() * URIs.size());
+}
+BENCHMARK(URIProximity)->Arg(4)->Arg(16)->Arg(64);
+
+// URIs of index results, some of them percent-encoded.
+std::vector<std::string> generateURIs(unsigned Depth) {
+  std::vector<std::string> URIs;
+  for (std::string &Path : generatePaths(10000, Depth, /*Seed=*/3)) {
+    if (URIs.size() % 4 == 0)
+      Path.insert(Path.rfind('/') + 1, "with space+");
+    URIs.push_back(URI::createFile(Path).toString());
+  }
+  return URIs;
+}
+
+static void URIParse(benchmark::State &State) {
+  std::vector<std::string> URIs = generateURIs(State.range(0));
+  for (auto _ : State)
+    for (const std::string &U : URIs)
+      benchmark::DoNotOptimize(cantFail(URI::parse(U)).body());
+  State.SetItemsProcessed(State.iterations() * URIs.size());
+}
+BENCHMARK(URIParse)->Arg(4)->Arg(16);
+
+static void URIResolve(benchmark::State &State) {
+  std::vector<URI> URIs;
+  for (const std::string &U : generateURIs(State.range(0)))
+    URIs.push_back(cantFail(URI::parse(U)));
+  for (auto _ : State)
+    for (const URI &U : URIs)
+      benchmark::DoNotOptimize(cantFail(URI::resolve(U)));
+  State.SetItemsProcessed(State.iterations() * URIs.size());
+}
+BENCHMARK(URIResolve)->Arg(4)->Arg(16);
+
+// Index results point into few files, each resolved once per request.
+static void CachedURIResolve(benchmark::State &State) {
+  std::vector<std::string> Files = generateURIs(State.range(0));
+  Files.resize(100);
+  std::vector<std::string> URIs;
+  for (unsigned I = 0; I < 10000; ++I)
+    URIs.push_back(Files[(I * 7) % Files.size()]);
+  for (auto _ : State) {
+    CachedURIResolver Resolver;
+    for (const std::string &U : URIs)
+      benchmark::DoNotOptimize(cantFail(Resolver.resolve(U)));
+  }
+  State.SetItemsProcessed(State.iterations() * URIs.size());
+}
+BENCHMARK(CachedURIResolve)->Arg(4)->Arg(16);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -0,0 +1,94 @@
+//===--- PostingListBenchmark.cpp - Clangd posting list benchmarks -*- C++-*-//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmarks of the compressed posting lists of Dex: decoding whole lists, as
+// for a trigram of a short query, and skipping through them with advanceTo(),
+// as when intersecting the posting lists of several trigrams.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../index/dex/Iterator.h"
+#include "../index/dex/PostingList.h"
+#include "benchmark/benchmark.h"
+#include <random>
+#include <vector>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace dex {
+namespace {
+
+// Sorted documents of an index of 1M symbols, each in the list with
+// probability 1 / Gap. Small gaps are those of common trigrams, large gaps
+// compress to more bytes per document.
+std::vector<DocID> generateDocuments(unsigned Gap) {
+  std::mt19937 Gen(Gap);
+  std::uniform_int_distribution<DocID> Step(1, 2 * Gap - 1);
+  std::vector<DocID> Documents;
+  for (DocID ID = Step(Gen); ID < 1000000; ID += Step(Gen))
+    Documents.push_back(ID);
+  return Documents;
+}
+
+static void PostingListBuild(benchmark::State &State) {
+  std::vector<DocID> Documents = generateDocuments(State.range(0));
+  for (auto _ : State)
+    benchmark::DoNotOptimize(PostingList(Documents).bytes());
+  State.SetItemsProcessed(State.iterations() * Documents.size());
+}
+BENCHMARK(PostingListBuild)->Arg(2)->Arg(64)->Arg(4096);
+
+static void PostingListDecode(benchmark::State &State) {
+  std::vector<DocID> Documents = generateDocuments(State.range(0));
+  PostingList List(Documents);
+  for (auto _ : State) {
+    auto It = List.iterator();
+    DocID Sum = 0;
+    for (; !It->reachedEnd(); It->advance())
+      Sum += It->peek();
+    benchmark::DoNotOptimize(Sum);
+  }
+  State.SetItemsProcessed(State.iterations() * Documents.size());
+  State.SetBytesProcessed(State.iterations() * List.bytes());
+}
+BENCHMARK(PostingListDecode)->Arg(2)->Arg(64)->Arg(4096);
+
+// Advances through a list to the documents of a sparser one, as an AND
+// iterator does. range(0) is the gap of the list, range(1) that of the
+// targets.
+static void PostingListAdvanceTo(benchmark::State &State) {
+  PostingList List(generateDocuments(State.range(0)));
+  std::vector<DocID> Targets = generateDocuments(State.range(1));
+  for (auto _ : State) {
+    auto It = List.iterator();
+    size_t Found = 0;
+    for (DocID Target : Targets) {
+      It->advanceTo(Target);
+      if (It->reachedEnd())
+        break;
+      if (It->peek() == Target)
+        ++Found;
+    }
+    benchmark::DoNotOptimize(Found);
+  }
+  State.SetItemsProcessed(State.iterations() * Targets.size());
+}
+BENCHMARK(PostingListAdvanceTo)
+    ->Args({2, 64})
+    ->Args({2, 4096})
+    ->Args({64, 64})
+    ->Args({64, 4096});
+
+} // namespace
+} // namespace dex
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -0,0 +1,171 @@
+//===--- ProtocolBenchmark.cpp - Clangd LSP handling benchmarks -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Benchmarks of the work done for each message of the client before it reaches
+// ClangdServer: reading and parsing it, and applying the edits of a document.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../DraftStore.h"
+#include "../Protocol.h"
+#include "../Transport.h"
+#include "benchmark/benchmark.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdio>
+#include <random>
+#include <string>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// A source file of NumLines lines, with some non-ASCII characters that
+// positions must be converted for.
+std::string generateFile(unsigned NumLines) {
+  std::string Code;
+  for (unsigned I = 0; I < NumLines; ++I) {
+    Code += "  int variable" + std::to_string(I) + " = compute(" +
+            std::to_string(I) + ");";
+    Code += I % 10 == 0 ? " // \xc3\xa9t\xc3\xa9\n" : "\n";
+  }
+  return Code;
+}
+
+// Typing: each change inserts a character at a random line.
+static void DraftStoreIncrementalEdit(benchmark::State &State) {
+  const unsigned NumLines = State.range(0);
+  DraftStore Drafts;
+  Drafts.addDraft("/file.cpp", generateFile(NumLines));
+  std::mt19937 Gen(42);
+  std::uniform_int_distribution<int> Line(0, NumLines - 1);
+  TextDocumentContentChangeEvent Change;
+  Change.text = "x";
+  for (auto _ : State) {
+    Position Pos;
+    Pos.line = Line(Gen);
+    Pos.character = 2;
+    Change.range = Range{Pos, Pos};
+    Change.rangeLength = 0;
+    benchmark::DoNotOptimize(cantFail(Drafts.updateDraft("/file.cpp", Change)));
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+BENCHMARK(DraftStoreIncrementalEdit)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// Clients that don't support incremental sync send the whole document.
+static void DraftStoreFullEdit(benchmark::State &State) {
+  DraftStore Drafts;
+  Drafts.addDraft("/file.cpp", "");
+  TextDocumentContentChangeEvent Change;
+  Change.text = generateFile(State.range(0));
+  for (auto _ : State)
+    benchmark::DoNotOptimize(cantFail(Drafts.updateDraft("/file.cpp", Change)));
+  State.SetItemsProcessed(State.iterations());
+  State.SetBytesProcessed(State.iterations() * Change.text.size());
+}
+BENCHMARK(DraftStoreFullEdit)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// Counts the messages, until the "exit" notification.
+class CountingHandler : public Transport::MessageHandler {
+public:
+  bool onNotify(StringRef Method, json::Value) override {
+    ++Messages;
+    return Method != "exit";
+  }
+  bool onCall(StringRef, json::Value, json::Value) override {
+    ++Messages;
+    return true;
+  }
+  bool onReply(json::Value, Expected<json::Value> Result) override {
+    consumeError(Result.takeError());
+    ++Messages;
+    return true;
+  }
+
+  size_t Messages = 0;
+};
+
+// A session of a client: completion requests, and edits of a document whose
+// size is range(0) lines, the first one opening it.
+static void JSONTransportRead(benchmark::State &State) {
+  std::string Text = generateFile(State.range(0));
+  std::string Input;
+  size_t NumMessages = 0;
+  auto Write = [&](json::Value Message) {
+    std::string JSON = formatv("{0}", Message).str();
+    Input +=
+        formatv("Content-Length: {0}\r\n\r\n{1}", JSON.size(), JSON).str();
+    ++NumMessages;
+  };
+  Write(json::Object{
+      {"jsonrpc", "2.0"},
+      {"method", "textDocument/didOpen"},
+      {"params",
+       json::Object{{"textDocument", json::Object{{"uri", "file:///file.cpp"},
+                                                  {"languageId", "cpp"},
+                                                  {"version", 0},
+                                                  {"text", Text}}}}},
+  });
+  for (int I = 1; I <= 100; ++I) {
+    json::Object Pos{{"line", I}, {"character", 2}};
+    Write(json::Object{
+        {"jsonrpc", "2.0"},
+        {"method", "textDocument/didChange"},
+        {"params",
+         json::Object{
+             {"textDocument",
+              json::Object{{"uri", "file:///file.cpp"}, {"version", I}}},
+             {"contentChanges",
+              json::Array{json::Object{
+                  {"range", json::Object{{"start", json::Object(Pos)},
+                                         {"end", json::Object(Pos)}}},
+                  {"rangeLength", 0},
+                  {"text", "x"}}}}}},
+    });
+    Write(json::Object{
+        {"jsonrpc", "2.0"},
+        {"id", I},
+        {"method", "textDocument/completion"},
+        {"params",
+         json::Object{
+             {"textDocument", json::Object{{"uri", "file:///file.cpp"}}},
+             {"position", json::Object(Pos)}}},
+    });
+  }
+  Write(json::Object{{"jsonrpc", "2.0"}, {"method", "exit"}});
+
+  std::FILE *In = std::tmpfile();
+  if (!In) {
+    State.SkipWithError("Can't create a temporary file");
+    return;
+  }
+  std::fwrite(Input.data(), 1, Input.size(), In);
+  auto Transport = newJSONTransport(In, nulls(), /*InMirror=*/nullptr,
+                                    /*Pretty=*/false);
+  for (auto _ : State) {
+    std::rewind(In);
+    CountingHandler Handler;
+    cantFail(Transport->loop(Handler));
+    benchmark::DoNotOptimize(Handler.Messages);
+  }
+  std::fclose(In);
+  State.SetItemsProcessed(State.iterations() * NumMessages);
+  State.SetBytesProcessed(State.iterations() * Input.size());
+}
+BENCHMARK(JSONTransportRead)->Arg(1000)->Arg(10000);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
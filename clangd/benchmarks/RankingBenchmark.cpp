@@ -0,0 +1,93 @@
+//===--- RankingBenchmark.cpp - Clangd ranking model benchmarks -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../Quality.h"
+#include "benchmark/benchmark.h"
+#include <random>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Random signals, covering the branches of both the heuristics and the
+// decision forest. They only depend on their number.
+struct Candidates {
+  std::vector<SymbolQualitySignals> Quality;
+  std::vector<SymbolRelevanceSignals> Relevance;
+};
+
+Candidates generateCandidates(size_t N) {
+  std::mt19937 Gen(42);
+  // True for one in ten candidates.
+  auto Coin = [&] {
+    return std::uniform_int_distribution<int>(0, 9)(Gen) == 0;
+  };
+  Candidates C;
+  for (size_t I = 0; I < N; ++I) {
+    SymbolQualitySignals Quality;
+    Quality.Deprecated = Coin();
+    Quality.ReservedName = Coin();
+    Quality.ImplementationDetail = Coin();
+    Quality.References = std::uniform_int_distribution<unsigned>(0, 5000)(Gen);
+    Quality.Category = static_cast<SymbolQualitySignals::SymbolCategory>(
+        std::uniform_int_distribution<int>(0, SymbolQualitySignals::Keyword)(
+            Gen));
+    C.Quality.push_back(Quality);
+
+    SymbolRelevanceSignals Relevance;
+    Relevance.NameMatch = std::uniform_real_distribution<float>(0, 1)(Gen);
+    Relevance.Forbidden = Coin();
+    Relevance.NeedsFixIts = Coin();
+    Relevance.InBaseClass = Coin();
+    Relevance.SemaFileProximityScore =
+        std::uniform_real_distribution<float>(0, 1)(Gen);
+    Relevance.SemaSaysInScope = Coin();
+    Relevance.Scope = static_cast<SymbolRelevanceSignals::AccessibleScope>(
+        std::uniform_int_distribution<int>(
+            0, SymbolRelevanceSignals::GlobalScope)(Gen));
+    Relevance.Query = SymbolRelevanceSignals::CodeComplete;
+    Relevance.Context = Coin() ? CodeCompletionContext::CCC_DotMemberAccess
+                               : CodeCompletionContext::CCC_Expression;
+    Relevance.IsInstanceMember = Coin();
+    Relevance.TypeMatchesPreferred = Coin();
+    C.Relevance.push_back(Relevance);
+  }
+  return C;
+}
+
+static void Heuristics(benchmark::State &State) {
+  Candidates C = generateCandidates(State.range(0));
+  std::vector<float> Scores(C.Quality.size());
+  for (auto _ : State) {
+    for (size_t I = 0; I < Scores.size(); ++I)
+      Scores[I] = evaluateSymbolAndRelevance(C.Quality[I].evaluate(),
+                                             C.Relevance[I].evaluate());
+    benchmark::DoNotOptimize(Scores.data());
+  }
+  State.SetItemsProcessed(State.iterations() * Scores.size());
+}
+BENCHMARK(Heuristics)->Arg(1000)->Arg(100000);
+
+static void DecisionForest(benchmark::State &State) {
+  Candidates C = generateCandidates(State.range(0));
+  std::vector<float> Scores(C.Quality.size());
+  for (auto _ : State) {
+    evaluateDecisionForest(C.Quality, C.Relevance, Scores);
+    benchmark::DoNotOptimize(Scores.data());
+  }
+  State.SetItemsProcessed(State.iterations() * Scores.size());
+}
+BENCHMARK(DecisionForest)->Arg(1000)->Arg(100000);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -20,11 +20,19 @@
 #include "index/SymbolCollector.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Driver/Types.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/SHA1.h"
+#include "llvm/Support/VirtualFileSystem.h"
 
+#include <algorithm>
+#include <iterator>
+#include <list>
 #include <memory>
 #include <numeric>
 #include <queue>
@@ -34,15 +42,372 @@
 using namespace llvm;
 namespace clang {
 namespace clangd {
+namespace {
+// Priorities of the tasks on the queue, higher ones run first.
+// Indexing the TUs near the files being edited makes their symbols available
+// soonest.
+// Headers no TU includes are indexed last, they're the least likely to be used.
+constexpr unsigned IndexUncoveredHeaderPriority = 0;
+constexpr unsigned IndexFilePriority = 1;
+constexpr unsigned IndexBoostedFilePriority = 2;
+// Loading the commands only enqueues more tasks.
+constexpr unsigned LoadCommandsPriority = 3;
+// Refs read from storage are kept until they take more than this.
+constexpr size_t LazyRefsCacheBytes = 64 << 20;
+// Files read by indexing are kept until they take more than this.
+constexpr size_t FileContentsCacheBytes = 128 << 20;
+// Indexing pauses while less memory than this is available, indexing a TU
+// takes hundreds of MB.
+constexpr size_t MinAvailableMemory = size_t(1) << 30;
+
+// Removes the first element of V that is equal to X; V must contain X.
+template <typename VectorT, typename T> void eraseOne(VectorT &V, const T &X) {
+  auto It = llvm::find(V, X);
+  assert(It != V.end() && "Erasing element that is not present");
+  V.erase(It);
+}
+
+} // namespace
+
+// Remembers which shards hold refs of each symbol, and reads the refs of a
+// shard from its storage when they are queried. The most recently read slabs
+// are cached, up to LazyRefsCacheBytes.
+class BackgroundIndex::LazyRefStore {
+public:
+  // Records that \p Refs are the refs of the file at \p Path, stored in
+  // \p Storage. If either is null, the refs of the file are forgotten.
+  void update(StringRef Path, const RefSlab *Refs,
+              BackgroundIndexStorage *Storage) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto R = ShardIDs.try_emplace(Path, Shards.size());
+    if (R.second) {
+      Shards.emplace_back();
+      Shards.back().Path = R.first->first();
+    }
+    unsigned ID = R.first->second;
+    Shard &S = Shards[ID];
+    for (const SymbolID &Sym : S.Symbols) {
+      auto It = SymbolShards.find(Sym);
+      assert(It != SymbolShards.end());
+      eraseOne(It->second, ID);
+      if (It->second.empty())
+        SymbolShards.erase(It);
+    }
+    S.Symbols.clear();
+    S.Storage = Refs ? Storage : nullptr;
+    ++S.Version;
+    if (S.Storage)
+      for (const auto &SymRefs : *Refs) {
+        S.Symbols.push_back(SymRefs.first);
+        SymbolShards[SymRefs.first].push_back(ID);
+      }
+    S.Symbols.shrink_to_fit();
+    auto Cached = llvm::find_if(
+        Cache, [&](const CacheEntry &E) { return E.first == ID; });
+    if (Cached != Cache.end()) {
+      CachedBytes -= Cached->second->bytes();
+      Cache.erase(Cached);
+    }
+  }
+
+  void refs(const RefsRequest &Req,
+            function_ref<void(const Ref &)> Callback) const {
+    std::vector<unsigned> ShardsToRead;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      DenseSet<unsigned> Seen;
+      for (const SymbolID &ID : Req.IDs) {
+        auto It = SymbolShards.find(ID);
+        if (It == SymbolShards.end())
+          continue;
+        for (unsigned S : It->second)
+          if (Seen.insert(S).second)
+            ShardsToRead.push_back(S);
+      }
+    }
+    std::vector<Ref> Filtered;
+    for (unsigned S : ShardsToRead) {
+      auto Refs = read(S);
+      if (!Refs)
+        continue;
+      for (const auto &SymRefs : *Refs)
+        if (Req.IDs.count(SymRefs.first))
+          for (const Ref &R : filterRefs(SymRefs.second, Req.Filter, Filtered))
+            Callback(R);
+    }
+  }
+
+  void dropCache() {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Cache.clear();
+    CachedBytes = 0;
+  }
+
+  void profile(MemoryTree &MT) const {
+    std::lock_guard<std::mutex> Lock(Mu);
+    MemoryTree &Locations = MT.child("locations");
+    Locations.addUsage(SymbolShards.getMemorySize() +
+                       Shards.capacity() * sizeof(Shard));
+    for (const Shard &S : Shards)
+      Locations.addUsage(S.Symbols.capacity() * sizeof(SymbolID));
+    MT.child("cache").addUsage(CachedBytes);
+  }
+
+private:
+  struct Shard {
+    StringRef Path; // Owned by ShardIDs.
+    BackgroundIndexStorage *Storage = nullptr;
+    // Symbols the shard has refs of.
+    std::vector<SymbolID> Symbols;
+    // Incremented by each update, so that reads racing with it aren't cached.
+    unsigned Version = 0;
+  };
+  using CacheEntry = std::pair<unsigned, std::shared_ptr<const RefSlab>>;
+
+  // Returns the refs of shard \p ID, from the cache or its storage.
+  std::shared_ptr<const RefSlab> read(unsigned ID) const {
+    StringRef Path;
+    BackgroundIndexStorage *Storage;
+    unsigned Version;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      auto Cached = llvm::find_if(
+          Cache, [&](const CacheEntry &E) { return E.first == ID; });
+      if (Cached != Cache.end()) {
+        Cache.splice(Cache.begin(), Cache, Cached);
+        return Cached->second;
+      }
+      Path = Shards[ID].Path;
+      Storage = Shards[ID].Storage;
+      Version = Shards[ID].Version;
+    }
+    if (!Storage)
+      return nullptr;
+    trace::metric("BackgroundIndexRefsRead");
+    auto Loaded = Storage->loadShard(Path);
+    if (!Loaded || !Loaded->Refs) {
+      elog("Couldn't read the refs of {0} from the background index storage",
+           Path);
+      return nullptr;
+    }
+    auto Refs = std::make_shared<const RefSlab>(std::move(*Loaded->Refs));
+    std::lock_guard<std::mutex> Lock(Mu);
+    bool Cached = llvm::any_of(
+        Cache, [&](const CacheEntry &E) { return E.first == ID; });
+    if (Shards[ID].Version != Version || Cached)
+      return Refs;
+    Cache.emplace_front(ID, Refs);
+    CachedBytes += Refs->bytes();
+    // The most recent slab is kept even if it's over the limit on its own.
+    while (CachedBytes > LazyRefsCacheBytes && Cache.size() > 1) {
+      CachedBytes -= Cache.back().second->bytes();
+      Cache.pop_back();
+    }
+    return Refs;
+  }
+
+  mutable std::mutex Mu;
+  StringMap<unsigned> ShardIDs; /* GUARDED_BY(Mu) */
+  std::vector<Shard> Shards; /* GUARDED_BY(Mu) */
+  DenseMap<SymbolID, SmallVector<unsigned, 1>>
+      SymbolShards; /* GUARDED_BY(Mu) */
+  // Most recently used first.
+  mutable std::list<CacheEntry> Cache; /* GUARDED_BY(Mu) */
+  mutable size_t CachedBytes = 0; /* GUARDED_BY(Mu) */
+};
+
+static BackgroundIndex::FileDigest digest(StringRef Content) {
+  return SHA1::hash({(const uint8_t *)Content.data(), Content.size()});
+}
+
+// Caches the files read by indexing along with their digests, so that headers
+// included by many TUs are read and hashed once per version. Entries are keyed
+// by absolute path, and used while the file's identity, size and modification
+// time are unchanged. The most recently read files are kept, up to
+// FileContentsCacheBytes.
+class BackgroundIndex::FileContentCache {
+public:
+  // Returns a VFS that reads files through the cache.
+  // Note that the returned VFS should not outlive the cache.
+  IntrusiveRefCntPtr<vfs::FileSystem>
+  getFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> FS) {
+    return IntrusiveRefCntPtr<CachingFS>(new CachingFS(std::move(FS), *this));
+  }
+
+  // Returns the digest of \p Content, the contents of the file \p AbsPath.
+  // The digest isn't computed again if \p Content was read through the cache.
+  FileDigest digest(StringRef AbsPath, StringRef Content) const {
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      auto It = ByPath.find(AbsPath);
+      if (It != ByPath.end()) {
+        const Entry &E = *It->second;
+        if (E.Buf->getBufferStart() == Content.data() &&
+            E.Buf->getBufferSize() == Content.size())
+          return E.Digest;
+      }
+    }
+    return clangd::digest(Content);
+  }
+
+  void dropCache() {
+    std::lock_guard<std::mutex> Lock(Mu);
+    ByPath.clear();
+    Cache.clear();
+    CachedBytes = 0;
+  }
+
+  void profile(MemoryTree &MT) const {
+    std::lock_guard<std::mutex> Lock(Mu);
+    MT.addUsage(CachedBytes + ByPath.getMemorySize() +
+                Cache.size() * sizeof(Entry));
+  }
+
+private:
+  struct Entry {
+    std::string Path;
+    sys::fs::UniqueID UID;
+    sys::TimePoint<> MTime;
+    uint64_t Size;
+    std::shared_ptr<const MemoryBuffer> Buf;
+    FileDigest Digest;
+  };
+
+  // Refers to the contents of a cached file, keeping them alive.
+  class SharedBuffer : public MemoryBuffer {
+  public:
+    SharedBuffer(std::shared_ptr<const MemoryBuffer> Buf, StringRef Name)
+        : Buf(std::move(Buf)), Name(Name) {
+      init(this->Buf->getBufferStart(), this->Buf->getBufferEnd(),
+           /*RequiresNullTerminator=*/false);
+    }
+    StringRef getBufferIdentifier() const override { return Name; }
+    BufferKind getBufferKind() const override { return MemoryBuffer_Malloc; }
+
+  private:
+    std::shared_ptr<const MemoryBuffer> Buf;
+    std::string Name;
+  };
+
+  class CachedFile : public vfs::File {
+  public:
+    CachedFile(vfs::Status S, std::shared_ptr<const MemoryBuffer> Buf)
+        : S(std::move(S)), Buf(std::move(Buf)) {}
+    ErrorOr<vfs::Status> status() override { return S; }
+    ErrorOr<std::unique_ptr<MemoryBuffer>> getBuffer(const Twine &Name, int64_t,
+                                                     bool, bool) override {
+      return llvm::make_unique<SharedBuffer>(Buf, Name.str());
+    }
+    std::error_code close() override { return {}; }
+
+  private:
+    vfs::Status S;
+    std::shared_ptr<const MemoryBuffer> Buf;
+  };
+
+  class CachingFS : public vfs::ProxyFileSystem {
+  public:
+    CachingFS(IntrusiveRefCntPtr<vfs::FileSystem> FS, FileContentCache &Cache)
+        : ProxyFileSystem(std::move(FS)), Cache(Cache) {}
+
+    ErrorOr<std::unique_ptr<vfs::File>>
+    openFileForRead(const Twine &Path) override {
+      SmallString<128> AbsPath;
+      Path.toVector(AbsPath);
+      if (getUnderlyingFS().makeAbsolute(AbsPath))
+        return getUnderlyingFS().openFileForRead(Path);
+      // Match the paths the file filter sees.
+      sys::path::remove_dots(AbsPath, /*remove_dot_dot=*/true);
+      auto S = getUnderlyingFS().status(Path);
+      if (!S || !S->isRegularFile())
+        return getUnderlyingFS().openFileForRead(Path);
+      if (auto Buf = Cache.lookup(AbsPath, *S))
+        return std::unique_ptr<vfs::File>(
+            new CachedFile(std::move(*S), std::move(Buf)));
+
+      auto File = getUnderlyingFS().openFileForRead(Path);
+      if (!File)
+        return File;
+      // The status of the open file matches the contents read.
+      auto FileStatus = (*File)->status();
+      if (!FileStatus)
+        return File;
+      auto Buf = (*File)->getBuffer(Path, FileStatus->getSize(),
+                                    /*RequiresNullTerminator=*/true,
+                                    /*IsVolatile=*/false);
+      if (!Buf)
+        return Buf.getError();
+      return std::unique_ptr<vfs::File>(
+          new CachedFile(vfs::Status::copyWithNewName(*FileStatus, Path),
+                         Cache.insert(AbsPath, *FileStatus, std::move(*Buf))));
+    }
+
+  private:
+    FileContentCache &Cache;
+  };
+
+  // Returns the cached contents of \p AbsPath, if they match \p S.
+  std::shared_ptr<const MemoryBuffer> lookup(StringRef AbsPath,
+                                             const vfs::Status &S) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto It = ByPath.find(AbsPath);
+    if (It == ByPath.end())
+      return nullptr;
+    if (It->second->UID != S.getUniqueID() ||
+        It->second->MTime != S.getLastModificationTime() ||
+        It->second->Size != S.getSize())
+      return nullptr;
+    Cache.splice(Cache.begin(), Cache, It->second);
+    return It->second->Buf;
+  }
+
+  // Caches \p Buf, the contents of \p AbsPath with status \p S.
+  std::shared_ptr<const MemoryBuffer>
+  insert(StringRef AbsPath, const vfs::Status &S,
+         std::unique_ptr<MemoryBuffer> Buf) {
+    std::shared_ptr<const MemoryBuffer> Shared = std::move(Buf);
+    if (Shared->getBufferSize() > FileContentsCacheBytes)
+      return Shared;
+    FileDigest Digest = clangd::digest(Shared->getBuffer());
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto It = ByPath.find(AbsPath);
+    if (It != ByPath.end()) {
+      CachedBytes -= It->second->Buf->getBufferSize();
+      Cache.erase(It->second);
+      ByPath.erase(It);
+    }
+    Cache.push_front(Entry{AbsPath.str(), S.getUniqueID(),
+                           S.getLastModificationTime(), S.getSize(), Shared,
+                           Digest});
+    ByPath[AbsPath] = Cache.begin();
+    CachedBytes += Shared->getBufferSize();
+    while (CachedBytes > FileContentsCacheBytes) {
+      CachedBytes -= Cache.back().Buf->getBufferSize();
+      ByPath.erase(Cache.back().Path);
+      Cache.pop_back();
+    }
+    return Shared;
+  }
+
+  mutable std::mutex Mu;
+  // Most recently used first.
+  std::list<Entry> Cache;                       /* GUARDED_BY(Mu) */
+  StringMap<std::list<Entry>::iterator> ByPath; /* GUARDED_BY(Mu) */
+  size_t CachedBytes = 0;                       /* GUARDED_BY(Mu) */
+};
 
 BackgroundIndex::BackgroundIndex(
     Context BackgroundContext, StringRef ResourceDir,
     const FileSystemProvider &FSProvider, const GlobalCompilationDatabase &CDB,
-    BackgroundIndexStorage::Factory IndexStorageFactory, size_t ThreadPoolSize)
+    BackgroundIndexStorage::Factory IndexStorageFactory, bool LazyRefs,
+    size_t ThreadPoolSize)
     : SwapIndex(make_unique<MemIndex>()), ResourceDir(ResourceDir),
       FSProvider(FSProvider), CDB(CDB),
       BackgroundContext(std::move(BackgroundContext)),
+      LazyRefs(LazyRefs ? llvm::make_unique<LazyRefStore>() : nullptr),
+      FileContents(llvm::make_unique<FileContentCache>()),
       IndexStorageFactory(std::move(IndexStorageFactory)),
+      LoadLimit(ThreadPoolSize),
       CommandsChanged(
           CDB.watch([&](const std::vector<std::string> &ChangedFiles) {
             enqueue(ChangedFiles);
@@ -50,116 +415,389 @@ BackgroundIndex::BackgroundIndex(
   assert(ThreadPoolSize > 0 && "Thread pool size can't be zero.");
   assert(this->IndexStorageFactory && "Storage factory can not be null!");
   while (ThreadPoolSize--) {
-    ThreadPool.emplace_back([this] { run(); });
+    ThreadPool.emplace_back([this] {
+      WithContext Background(this->BackgroundContext.clone());
+      Queue.work();
+    });
     // Set priority to low, since background indexing is a long running task we
     // do not want to eat up cpu when there are any other high priority threads.
-    // FIXME: In the future we might want a more general way of handling this to
-    // support tasks with various priorities.
     setThreadPriority(ThreadPool.back(), ThreadPriority::Low);
   }
+  if (FileWatcher::isSupported())
+    Watcher = llvm::make_unique<FileWatcher>(
+        [this](std::vector<std::string> Files) { filesChanged(Files); });
 }
 
 BackgroundIndex::~BackgroundIndex() {
+  // Stop the watcher first, it enqueues tasks.
+  Watcher.reset();
   stop();
   for (auto &Thread : ThreadPool)
     Thread.join();
 }
 
-void BackgroundIndex::stop() {
-  {
-    std::lock_guard<std::mutex> Lock(QueueMu);
-    ShouldStop = true;
+void BackgroundIndex::stop() { Queue.stop(); }
+
+void BackgroundIndex::adaptToLoad(const SystemLoad &Load) {
+  unsigned PoolSize = ThreadPool.size();
+  unsigned Limit;
+  if (Load.CompilerRunning)
+    Limit = 0;
+  else if (Load.AvailableMemory && Load.AvailableMemory < MinAvailableMemory)
+    Limit = 0;
+  else if (Load.LoadAverage < 0)
+    Limit = PoolSize;
+  else {
+    // The load average includes the indexing threads, and lags behind them.
+    // So the limit moves by a thread at a time, until the CPUs are just busy.
+    // A thread keeps indexing while other work keeps the CPUs busy, its low
+    // priority leaves them to the other work.
+    double Idle = llvm::hardware_concurrency() - Load.LoadAverage;
+    Limit = std::max(LoadLimit, 1u);
+    if (Idle < 0.5 && Limit > 1)
+      --Limit;
+    else if (Idle >= 1.5 && Limit < PoolSize)
+      ++Limit;
   }
-  QueueCV.notify_all();
+  trace::metric("BackgroundIndexThreads", Limit);
+  if (Limit == LoadLimit)
+    return;
+  vlog("Background index runs {0} of {1} threads (load {2}, {3} MB "
+       "available{4})",
+       Limit, PoolSize, Load.LoadAverage, Load.AvailableMemory >> 20,
+       Load.CompilerRunning ? ", a compiler is running" : "");
+  LoadLimit = Limit;
+  Queue.setMaxActiveTasks(Limit);
 }
 
-void BackgroundIndex::run() {
-  WithContext Background(BackgroundContext.clone());
-  while (true) {
-    Optional<Task> Task;
-    {
-      std::unique_lock<std::mutex> Lock(QueueMu);
-      QueueCV.wait(Lock, [&] { return ShouldStop || !Queue.empty(); });
-      if (ShouldStop) {
-        Queue.clear();
-        QueueCV.notify_all();
-        return;
-      }
-      ++NumActiveTasks;
-      Task = std::move(Queue.front());
-      Queue.pop_front();
-    }
-    (*Task)();
-    {
-      std::unique_lock<std::mutex> Lock(QueueMu);
-      assert(NumActiveTasks > 0 && "before decrementing");
-      --NumActiveTasks;
-    }
-    QueueCV.notify_all();
-  }
+void BackgroundIndex::refs(const RefsRequest &Req,
+                           function_ref<void(const Ref &)> Callback) const {
+  // Refs that couldn't be stored are still in the index.
+  SwapIndex::refs(Req, Callback);
+  if (LazyRefs)
+    LazyRefs->refs(Req, Callback);
+}
+
+void BackgroundIndex::refsBySymbol(
+    const RefsRequest &Req,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> Callback) const {
+  if (!LazyRefs)
+    return SwapIndex::refsBySymbol(Req, Callback);
+  // The refs of a symbol may come from several shards, refs() gathers them.
+  SymbolIndex::refsBySymbol(Req, Callback);
+}
+
+size_t BackgroundIndex::estimateMemoryUsage() const {
+  MemoryTree MT;
+  profile(MT);
+  return MT.total();
+}
+
+void BackgroundIndex::profile(MemoryTree &MT) const {
+  SwapIndex::profile(MT);
+  if (LazyRefs)
+    LazyRefs->profile(MT.child("lazy_refs"));
+  FileContents->profile(MT.child("file_contents"));
+}
+
+void BackgroundIndex::dropCachedRefs() {
+  if (LazyRefs)
+    LazyRefs->dropCache();
 }
 
+void BackgroundIndex::dropCachedFiles() { FileContents->dropCache(); }
+
 bool BackgroundIndex::blockUntilIdleForTest(
     llvm::Optional<double> TimeoutSeconds) {
-  std::unique_lock<std::mutex> Lock(QueueMu);
-  return wait(Lock, QueueCV, timeoutSeconds(TimeoutSeconds),
-              [&] { return Queue.empty() && NumActiveTasks == 0; });
+  return Queue.blockUntilIdleForTest(TimeoutSeconds);
 }
 
 void BackgroundIndex::enqueue(const std::vector<std::string> &ChangedFiles) {
-  enqueueTask([this, ChangedFiles] {
-    trace::Span Tracer("BackgroundIndexEnqueue");
-    // We're doing this asynchronously, because we'll read shards here too.
-    // FIXME: read shards here too.
-
-    log("Enqueueing {0} commands for indexing", ChangedFiles.size());
-    SPAN_ATTACH(Tracer, "files", int64_t(ChangedFiles.size()));
+  enqueueTask(
+      [this, ChangedFiles] {
+        trace::Span Tracer("BackgroundIndexEnqueue");
+        // We're doing this asynchronously, because we read shards here too.
+        log("Enqueueing {0} commands for indexing", ChangedFiles.size());
+        SPAN_ATTACH(Tracer, "files", int64_t(ChangedFiles.size()));
 
-    // We shuffle the files because processing them in a random order should
-    // quickly give us good coverage of headers in the project.
-    std::vector<unsigned> Permutation(ChangedFiles.size());
-    std::iota(Permutation.begin(), Permutation.end(), 0);
-    std::mt19937 Generator(std::random_device{}());
-    std::shuffle(Permutation.begin(), Permutation.end(), Generator);
+        // We shuffle the files because processing them in a random order
+        // should quickly give us good coverage of headers in the project.
+        std::vector<unsigned> Permutation(ChangedFiles.size());
+        std::iota(Permutation.begin(), Permutation.end(), 0);
+        std::mt19937 Generator(std::random_device{}());
+        std::shuffle(Permutation.begin(), Permutation.end(), Generator);
 
-    for (const unsigned I : Permutation)
-      enqueue(ChangedFiles[I]);
-  });
+        // TUs whose stored shards are up to date aren't indexed again.
+        unsigned Loaded = 0;
+        StringSet<> SourceRoots;
+        for (const unsigned I : Permutation) {
+          const std::string &File = ChangedFiles[I];
+          ProjectInfo Project;
+          auto Cmd = CDB.getCompileCommand(File, &Project);
+          if (!Cmd)
+            continue;
+          if (!Project.SourceRoot.empty())
+            SourceRoots.insert(Project.SourceRoot);
+          auto *Storage = IndexStorageFactory(Project.SourceRoot);
+          if (loadShards(File, Storage)) {
+            ++Loaded;
+            continue;
+          }
+          enqueue(File, std::move(*Cmd), Storage, IndexFilePriority);
+        }
+        SPAN_ATTACH(Tracer, "loaded", int64_t(Loaded));
+        if (Loaded) {
+          log("Loaded the stored index of {0} unchanged files", Loaded);
+          reset(IndexedSymbols.buildIndex(IndexType::Light,
+                                          DuplicateHandling::Merge));
+        }
+        if (!SourceRoots.empty())
+          indexUncoveredHeadersWhenDone(SourceRoots);
+      },
+      LoadCommandsPriority);
 }
 
 void BackgroundIndex::enqueue(const std::string &File) {
   ProjectInfo Project;
-  if (auto Cmd = CDB.getCompileCommand(File, &Project)) {
-    auto *Storage = IndexStorageFactory(Project.SourceRoot);
-    enqueueTask(Bind(
-        [this, File, Storage](tooling::CompileCommand Cmd) {
-          Cmd.CommandLine.push_back("-resource-dir=" + ResourceDir);
-          if (auto Error = index(std::move(Cmd), Storage))
-            log("Indexing {0} failed: {1}", File, std::move(Error));
-        },
-        std::move(*Cmd)));
+  if (auto Cmd = CDB.getCompileCommand(File, &Project))
+    enqueue(File, std::move(*Cmd), IndexStorageFactory(Project.SourceRoot),
+            IndexFilePriority);
+}
+
+void BackgroundIndex::enqueue(StringRef File, tooling::CompileCommand Cmd,
+                              BackgroundIndexStorage *Storage,
+                              unsigned Priority) {
+  std::string Path = File;
+  bool IsTU = Priority != IndexUncoveredHeaderPriority;
+  if (IsTU) {
+    std::lock_guard<std::mutex> Lock(UncoveredHeadersMu);
+    ++PendingTUs;
   }
+  enqueueTask(Bind(
+                  [this, Path, Storage, IsTU](tooling::CompileCommand Cmd) {
+                    Cmd.CommandLine.push_back("-resource-dir=" + ResourceDir);
+                    if (auto Error = index(std::move(Cmd), Storage))
+                      log("Indexing {0} failed: {1}", Path, std::move(Error));
+                    if (IsTU) {
+                      std::lock_guard<std::mutex> Lock(UncoveredHeadersMu);
+                      if (--PendingTUs == 0)
+                        enqueueUncoveredHeadersLocked();
+                    }
+                  },
+                  std::move(Cmd)),
+              Priority, sys::path::parent_path(File));
 }
 
-void BackgroundIndex::enqueueTask(Task T) {
+void BackgroundIndex::indexUncoveredHeadersWhenDone(
+    const StringSet<> &SourceRoots) {
+  std::lock_guard<std::mutex> Lock(UncoveredHeadersMu);
+  for (const auto &Root : SourceRoots)
+    UncoveredHeaderRoots.insert(Root.first());
+  // Otherwise the last TU to finish enqueues the headers.
+  if (PendingTUs == 0)
+    enqueueUncoveredHeadersLocked();
+}
+
+void BackgroundIndex::enqueueUncoveredHeadersLocked() {
+  if (UncoveredHeaderRoots.empty())
+    return;
+  std::vector<std::string> Roots;
+  for (const auto &Root : UncoveredHeaderRoots)
+    Roots.push_back(Root.first());
+  UncoveredHeaderRoots.clear();
+  enqueueTask([this, Roots] { indexUncoveredHeaders(Roots); },
+              IndexUncoveredHeaderPriority);
+}
+
+// Returns whether \p Path is the directory \p Root or is under it.
+static bool isInDirectory(StringRef Path, StringRef Root) {
+  Root = Root.rtrim(sys::path::get_separator());
+  Path = Path.rtrim(sys::path::get_separator());
+  return Path.startswith(Root) &&
+         (Path.size() == Root.size() ||
+          sys::path::is_separator(Path[Root.size()]));
+}
+
+static bool isHeader(StringRef Path) {
+  auto Type = driver::types::lookupTypeForExtension(
+      sys::path::extension(Path).trim('.'));
+  return Type != driver::types::TY_INVALID &&
+         driver::types::onlyPrecompileType(Type);
+}
+
+void BackgroundIndex::indexUncoveredHeaders(
+    const std::vector<std::string> &SourceRoots) {
+  trace::Span Tracer("BackgroundIndexUncoveredHeaders");
+  auto IsInProject = [&](StringRef Path) {
+    return llvm::any_of(SourceRoots, [&](StringRef Root) {
+      return isInDirectory(Path, Root);
+    });
+  };
+  StringSet<> Covered, Dirs;
+  // For each ancestor directory of indexed TUs, one of the TUs below it.
+  StringMap<std::string> TUBelow;
   {
-    std::lock_guard<std::mutex> Lock(QueueMu);
-    Queue.push_back(std::move(T));
+    std::lock_guard<std::mutex> Lock(DependenciesMu);
+    for (StringRef Path : FilePaths) {
+      Covered.insert(Path);
+      if (IsInProject(Path))
+        Dirs.insert(sys::path::parent_path(Path));
+    }
+    for (const auto &TU : TUDependencies) {
+      StringRef Path = FilePaths[TU.first];
+      if (isHeader(Path))
+        continue; // Not in the CDB.
+      for (StringRef Dir = sys::path::parent_path(Path); IsInProject(Dir);
+           Dir = sys::path::parent_path(Dir))
+        if (!TUBelow.try_emplace(Dir, Path).second)
+          break; // Its ancestors are set too.
+    }
   }
-  QueueCV.notify_all();
+
+  auto FS = FSProvider.getFileSystem();
+  unsigned Enqueued = 0, Loaded = 0;
+  for (const auto &Dir : Dirs) {
+    std::error_code EC;
+    for (vfs::directory_iterator It = FS->dir_begin(Dir.first(), EC), End;
+         !EC && It != End; It.increment(EC)) {
+      StringRef Header = It->path();
+      if (It->type() != sys::fs::file_type::regular_file ||
+          !isHeader(Header) || Covered.count(Header))
+        continue;
+      std::string TU;
+      for (StringRef D = Dir.first(); !D.empty() && TU.empty();
+           D = sys::path::parent_path(D))
+        TU = TUBelow.lookup(D);
+      if (TU.empty())
+        continue;
+      ProjectInfo Project;
+      auto Cmd = CDB.getCompileCommand(TU, &Project);
+      if (!Cmd)
+        continue;
+      auto *Storage = IndexStorageFactory(Project.SourceRoot);
+      if (loadShards(Header, Storage)) {
+        ++Loaded;
+        continue;
+      }
+      enqueue(Header, transferCompileCommand(std::move(*Cmd), Header), Storage,
+              IndexUncoveredHeaderPriority);
+      ++Enqueued;
+    }
+  }
+  SPAN_ATTACH(Tracer, "enqueued", int64_t(Enqueued));
+  SPAN_ATTACH(Tracer, "loaded", int64_t(Loaded));
+  if (Enqueued || Loaded)
+    log("Found {0} headers no indexed file includes, loaded {1} from storage",
+        Enqueued + Loaded, Loaded);
+  if (Loaded)
+    reset(
+        IndexedSymbols.buildIndex(IndexType::Light, DuplicateHandling::Merge));
 }
 
-static BackgroundIndex::FileDigest digest(StringRef Content) {
-  return SHA1::hash({(const uint8_t *)Content.data(), Content.size()});
+void BackgroundIndex::boostRelated(StringRef Path) {
+  Queue.boost(sys::path::parent_path(Path), IndexBoostedFilePriority);
 }
 
-static Optional<BackgroundIndex::FileDigest> digestFile(const SourceManager &SM,
-                                                        FileID FID) {
-  bool Invalid = false;
-  StringRef Content = SM.getBufferData(FID, &Invalid);
-  if (Invalid)
+Optional<std::string> BackgroundIndex::getIncluder(StringRef Header) {
+  std::lock_guard<std::mutex> Lock(DependenciesMu);
+  auto It = FileIDs.find(Header);
+  if (It == FileIDs.end())
     return None;
-  return digest(Content);
+  auto Dependents = FileDependents.find(It->second);
+  if (Dependents == FileDependents.end())
+    return None;
+  for (unsigned TU : Dependents->second) {
+    const auto &Deps = TUDependencies[TU];
+    // Skip the stale TUs, and the headers indexed with borrowed commands.
+    if (std::binary_search(Deps.begin(), Deps.end(), It->second) &&
+        !isHeader(FilePaths[TU]))
+      return FilePaths[TU].str();
+  }
+  return None;
+}
+
+void BackgroundIndex::filesChanged(const std::vector<std::string> &Files) {
+  std::vector<std::string> TUs;
+  {
+    std::lock_guard<std::mutex> Lock(DependenciesMu);
+    DenseSet<unsigned> Affected;
+    for (const std::string &File : Files) {
+      auto It = FileIDs.find(File);
+      if (It == FileIDs.end())
+        continue;
+      unsigned ID = It->second;
+      if (TUDependencies.count(ID))
+        Affected.insert(ID);
+      auto Dependents = FileDependents.find(ID);
+      if (Dependents == FileDependents.end())
+        continue;
+      // Only walk the TUs that read the file, dropping the stale ones.
+      llvm::erase_if(Dependents->second, [&](unsigned TU) {
+        const auto &Deps = TUDependencies[TU];
+        return !std::binary_search(Deps.begin(), Deps.end(), ID);
+      });
+      Affected.insert(Dependents->second.begin(), Dependents->second.end());
+    }
+    for (unsigned TU : Affected)
+      TUs.push_back(FilePaths[TU]);
+  }
+  if (TUs.empty())
+    return;
+  log("{0} changed files affect {1} indexed files", Files.size(), TUs.size());
+  {
+    // The main files may be unchanged, don't let index() skip them.
+    std::lock_guard<std::mutex> Lock(DigestsMu);
+    for (const std::string &TU : TUs)
+      IndexedFileDigests.erase(TU);
+  }
+  enqueue(TUs);
+}
+
+void BackgroundIndex::recordDependencies(
+    StringRef MainFile, const StringMap<FileDigest> &Dependencies) {
+  std::vector<std::string> NewDirs;
+  {
+    std::lock_guard<std::mutex> Lock(DependenciesMu);
+    auto Intern = [&](StringRef Path) {
+      auto R = FileIDs.try_emplace(Path, FilePaths.size());
+      if (R.second) {
+        FilePaths.push_back(R.first->first());
+        NewDirs.push_back(sys::path::parent_path(Path));
+      }
+      return R.first->second;
+    };
+    unsigned TU = Intern(MainFile);
+    std::vector<unsigned> NewDeps;
+    for (const auto &Dep : Dependencies)
+      NewDeps.push_back(Intern(Dep.first()));
+    llvm::sort(NewDeps);
+    std::vector<unsigned> &Deps = TUDependencies[TU];
+    // Add reverse edges for the new dependencies only. The removed ones stay
+    // until filesChanged() finds them stale.
+    std::vector<unsigned> Added;
+    std::set_difference(NewDeps.begin(), NewDeps.end(), Deps.begin(),
+                        Deps.end(), std::back_inserter(Added));
+    for (unsigned Dep : Added)
+      FileDependents[Dep].push_back(TU);
+    Deps = std::move(NewDeps);
+  }
+  if (Watcher)
+    for (const std::string &Dir : NewDirs)
+      Watcher->watchDirectory(Dir);
+}
+
+void BackgroundIndex::enqueueTask(std::function<void()> Run, unsigned Priority,
+                                  StringRef Tag) {
+  BackgroundQueue::Task T(std::move(Run));
+  T.QueuePri = Priority;
+  T.Tag = Tag;
+  Queue.push(std::move(T));
+}
+
+bool BackgroundIndex::isIndexed(StringRef AbsPath, const FileDigest &Digest) {
+  std::lock_guard<std::mutex> Lock(DigestsMu);
+  auto It = IndexedFileDigests.find(AbsPath);
+  return It != IndexedFileDigests.end() && It->second == Digest;
 }
 
 // Resolves URI to file paths with cache.
@@ -196,6 +834,7 @@ private:
 void BackgroundIndex::update(StringRef MainFile, SymbolSlab Symbols,
                              RefSlab Refs,
                              const StringMap<FileDigest> &FilesToUpdate,
+                             const StringMap<FileDigest> &Dependencies,
                              BackgroundIndexStorage *IndexStorage) {
   // Partition symbols/references into files.
   struct File {
@@ -203,6 +842,10 @@ void BackgroundIndex::update(StringRef MainFile, SymbolSlab Symbols,
     DenseSet<const Ref *> Refs;
   };
   StringMap<File> Files;
+  // The shard of the main file records the dependencies, so it's written even
+  // if the file has no symbols.
+  if (FilesToUpdate.count(MainFile))
+    Files[MainFile];
   URIToFileCache URICache(MainFile);
   for (const auto &Sym : Symbols) {
     if (Sym.CanonicalDeclaration) {
@@ -237,8 +880,8 @@ void BackgroundIndex::update(StringRef MainFile, SymbolSlab Symbols,
   for (const auto &F : Files) {
     StringRef Path = F.first();
     vlog("Update symbols in {0}", Path);
-    SymbolSlab::Builder Syms;
-    RefSlab::Builder Refs;
+    SymbolSlab::Builder Syms(&StringPool::global());
+    RefSlab::Builder Refs(&StringPool::global());
     for (const auto *S : F.second.Symbols)
       Syms.insert(*S);
     for (const auto *R : F.second.Refs)
@@ -251,14 +894,19 @@ void BackgroundIndex::update(StringRef MainFile, SymbolSlab Symbols,
     // We need to store shards before updating the index, since the latter
     // consumes slabs.
     // FIXME: Store Hash in the Shard.
+    bool Stored = false;
     if (IndexStorage) {
       IndexFileOut Shard;
       Shard.Symbols = SS.get();
       Shard.Refs = RS.get();
       Shard.Digest = &Hash;
+      if (Path == MainFile)
+        Shard.Dependencies = &Dependencies;
       if (auto Error = IndexStorage->storeShard(Path, Shard))
         elog("Failed to write background-index shard for file {0}: {1}", Path,
              std::move(Error));
+      else
+        Stored = true;
     }
 
     std::lock_guard<std::mutex> Lock(DigestsMu);
@@ -266,38 +914,147 @@ void BackgroundIndex::update(StringRef MainFile, SymbolSlab Symbols,
     // if this thread sees the older version but finishes later. This should be
     // rare in practice.
     IndexedFileDigests[Path] = Hash;
+    if (LazyRefs) {
+      // Refs of a file are only kept in memory if they can't be read back.
+      LazyRefs->update(Path, RS.get(), Stored ? IndexStorage : nullptr);
+      if (Stored)
+        RS.reset();
+    }
     IndexedSymbols.update(Path, std::move(SS), std::move(RS));
   }
 }
 
+// Copies a slab read from storage, with its strings in the global pool.
+static SymbolSlab pooled(const SymbolSlab &Slab) {
+  SymbolSlab::Builder Builder(&StringPool::global());
+  for (const Symbol &S : Slab)
+    Builder.insert(S);
+  return std::move(Builder).build();
+}
+static RefSlab pooled(const RefSlab &Slab) {
+  RefSlab::Builder Builder(&StringPool::global());
+  for (const auto &Sym : Slab)
+    for (const Ref &R : Sym.second)
+      Builder.insert(Sym.first, R);
+  return std::move(Builder).build();
+}
+
+bool BackgroundIndex::loadShards(StringRef MainFile,
+                                 BackgroundIndexStorage *IndexStorage) {
+  auto Main = IndexStorage->loadShard(MainFile);
+  if (!Main || !Main->Digest || !Main->Dependencies)
+    return false;
+  auto FS = FileContents->getFileSystem(FSProvider.getFileSystem());
+  auto IsUnchanged = [&](StringRef Path, const FileDigest &Stored) {
+    auto Buf = FS->getBufferForFile(Path);
+    return Buf &&
+           FileContents->digest(Path, Buf->get()->getBuffer()) == Stored;
+  };
+  if (!IsUnchanged(MainFile, *Main->Digest))
+    return false;
+  for (const auto &Dep : *Main->Dependencies)
+    if (!IsUnchanged(Dep.first(), Dep.second))
+      return false;
+
+  // None of the inputs changed, so the stored shards are what indexing would
+  // produce. Files without symbols have no shards.
+  std::vector<std::pair<std::string, std::unique_ptr<IndexFileIn>>> Shards;
+  for (const auto &Dep : *Main->Dependencies) {
+    if (Dep.first() == MainFile)
+      continue;
+    if (auto Shard = IndexStorage->loadShard(Dep.first())) {
+      // The shard was written for another version of the file.
+      if (!Shard->Digest || *Shard->Digest != Dep.second)
+        return false;
+      Shards.emplace_back(Dep.first(), std::move(Shard));
+    }
+  }
+  recordDependencies(MainFile, *Main->Dependencies);
+  Shards.emplace_back(MainFile, std::move(Main));
+
+  vlog("Loaded {0} shards of {1} from storage", Shards.size(), MainFile);
+  std::lock_guard<std::mutex> Lock(DigestsMu);
+  for (auto &S : Shards) {
+    IndexFileIn &Shard = *S.second;
+    IndexedFileDigests[S.first] = *Shard.Digest;
+    std::unique_ptr<RefSlab> Refs;
+    if (LazyRefs)
+      LazyRefs->update(S.first, Shard.Refs ? Shard.Refs.getPointer() : nullptr,
+                       IndexStorage);
+    else
+      Refs = llvm::make_unique<RefSlab>(Shard.Refs ? pooled(*Shard.Refs)
+                                                   : RefSlab());
+    IndexedSymbols.update(
+        S.first,
+        llvm::make_unique<SymbolSlab>(Shard.Symbols ? pooled(*Shard.Symbols)
+                                                    : SymbolSlab()),
+        std::move(Refs));
+  }
+  return true;
+}
+
+// Computes the absolute path of \p FE as seen by the indexer. Returns false
+// if the file has none.
+static bool absoluteFilePath(const SourceManager &SM, const FileEntry *FE,
+                             SmallVectorImpl<char> &AbsPath) {
+  if (!FE || FE->getName().empty())
+    return false; // Skip invalid files.
+  AbsPath.assign(FE->getName().begin(), FE->getName().end());
+  if (std::error_code EC =
+          SM.getFileManager().getVirtualFileSystem()->makeAbsolute(AbsPath)) {
+    elog("Warning: could not make absolute file: {0}", EC.message());
+    return false; // Skip files without absolute path.
+  }
+  sys::path::remove_dots(AbsPath, /*remove_dot_dot=*/true);
+  return true;
+}
+
+// Adds the digests of all files the TU read to \p Dependencies. The file filter
+// only sees the files with index results, but e.g. a header that only defines
+// macros changes the TU too.
+static void recordReadFiles(
+    const SourceManager &SM,
+    llvm::StringMap<BackgroundIndex::FileDigest> &Dependencies,
+    const std::function<BackgroundIndex::FileDigest(StringRef, StringRef)>
+        &Digest) {
+  for (auto It = SM.fileinfo_begin(), End = SM.fileinfo_end(); It != End;
+       ++It) {
+    const llvm::MemoryBuffer *Buf = It->second->getRawBuffer();
+    SmallString<128> AbsPath;
+    if (!Buf || !absoluteFilePath(SM, It->first, AbsPath))
+      continue;
+    if (!Dependencies.count(AbsPath))
+      Dependencies[AbsPath] = Digest(AbsPath, Buf->getBuffer());
+  }
+}
+
 // Creates a filter to not collect index results from files with unchanged
 // digests.
 // \p FileDigests contains file digests for the current indexed files, and all
 // changed files will be added to \p FilesToUpdate.
+// The digests of all files seen are added to \p Dependencies. \p Digest
+// computes the digest of a file from its absolute path and contents.
 decltype(SymbolCollector::Options::FileFilter) createFileFilter(
     const llvm::StringMap<BackgroundIndex::FileDigest> &FileDigests,
-    llvm::StringMap<BackgroundIndex::FileDigest> &FilesToUpdate) {
-  return [&FileDigests, &FilesToUpdate](const SourceManager &SM, FileID FID) {
-    StringRef Path;
-    if (const auto *F = SM.getFileEntryForID(FID))
-      Path = F->getName();
-    if (Path.empty())
-      return false; // Skip invalid files.
-    SmallString<128> AbsPath(Path);
-    if (std::error_code EC =
-            SM.getFileManager().getVirtualFileSystem()->makeAbsolute(AbsPath)) {
-      elog("Warning: could not make absolute file: {0}", EC.message());
-      return false; // Skip files without absolute path.
-    }
-    sys::path::remove_dots(AbsPath, /*remove_dot_dot=*/true);
-    auto Digest = digestFile(SM, FID);
-    if (!Digest)
+    llvm::StringMap<BackgroundIndex::FileDigest> &FilesToUpdate,
+    llvm::StringMap<BackgroundIndex::FileDigest> &Dependencies,
+    std::function<BackgroundIndex::FileDigest(StringRef, StringRef)> Digest) {
+  return [&FileDigests, &FilesToUpdate, &Dependencies,
+          Digest](const SourceManager &SM, FileID FID) {
+    SmallString<128> AbsPath;
+    if (!absoluteFilePath(SM, SM.getFileEntryForID(FID), AbsPath))
       return false;
+    bool Invalid = false;
+    StringRef Content = SM.getBufferData(FID, &Invalid);
+    if (Invalid)
+      return false;
+    auto FileDigest = Digest(AbsPath, Content);
+    Dependencies[AbsPath] = FileDigest;
     auto D = FileDigests.find(AbsPath);
-    if (D != FileDigests.end() && D->second == Digest)
+    if (D != FileDigests.end() && D->second == FileDigest)
       return false; // Skip files that haven't changed.
 
-    FilesToUpdate[AbsPath] = *Digest;
+    FilesToUpdate[AbsPath] = FileDigest;
     return true;
   };
 }
@@ -313,12 +1070,14 @@ Error BackgroundIndex::index(tooling::CompileCommand Cmd,
     AbsolutePath = Cmd.Directory;
     sys::path::append(AbsolutePath, Cmd.Filename);
   }
+  // Match the paths of the files seen by the indexer.
+  sys::path::remove_dots(AbsolutePath, /*remove_dot_dot=*/true);
 
-  auto FS = FSProvider.getFileSystem();
+  auto FS = FileContents->getFileSystem(FSProvider.getFileSystem());
   auto Buf = FS->getBufferForFile(AbsolutePath);
   if (!Buf)
     return errorCodeToError(Buf.getError());
-  auto Hash = digest(Buf->get()->getBuffer());
+  auto Hash = FileContents->digest(AbsolutePath, Buf->get()->getBuffer());
 
   // Take a snapshot of the digests to avoid locking for each file in the TU.
   llvm::StringMap<FileDigest> DigestsSnapshot;
@@ -350,8 +1109,14 @@ Error BackgroundIndex::index(tooling::CompileCommand Cmd,
                              "Couldn't build compiler instance");
 
   SymbolCollector::Options IndexOpts;
-  StringMap<FileDigest> FilesToUpdate;
-  IndexOpts.FileFilter = createFileFilter(DigestsSnapshot, FilesToUpdate);
+  IndexOpts.SkipUnusedCompletionInfo = true;
+  StringMap<FileDigest> FilesToUpdate, Dependencies;
+  std::function<FileDigest(StringRef, StringRef)> Digest =
+      [this](StringRef AbsPath, StringRef Content) {
+        return FileContents->digest(AbsPath, Content);
+      };
+  IndexOpts.FileFilter =
+      createFileFilter(DigestsSnapshot, FilesToUpdate, Dependencies, Digest);
   SymbolSlab Symbols;
   RefSlab Refs;
   auto Action = createStaticIndexingAction(
@@ -369,6 +1134,7 @@ Error BackgroundIndex::index(tooling::CompileCommand Cmd,
                              "BeginSourceFile() failed");
   if (!Action->Execute())
     return createStringError(inconvertibleErrorCode(), "Execute() failed");
+  recordReadFiles(Clang->getSourceManager(), Dependencies, Digest);
   Action->EndSourceFile();
 
   log("Indexed {0} ({1} symbols, {2} refs)", Inputs.CompileCommand.Filename,
@@ -376,7 +1142,8 @@ Error BackgroundIndex::index(tooling::CompileCommand Cmd,
   SPAN_ATTACH(Tracer, "symbols", int(Symbols.size()));
   SPAN_ATTACH(Tracer, "refs", int(Refs.numRefs()));
   update(AbsolutePath, std::move(Symbols), std::move(Refs), FilesToUpdate,
-         IndexStorage);
+         Dependencies, IndexStorage);
+  recordDependencies(AbsolutePath, Dependencies);
   {
     // Make sure hash for the main file is always updated even if there is no
     // index data in it.
@@ -12,16 +12,20 @@
 
 #include "Context.h"
 #include "FSProvider.h"
+#include "FileWatcher.h"
 #include "GlobalCompilationDatabase.h"
+#include "SystemLoad.h"
 #include "index/FileIndex.h"
 #include "index/Index.h"
 #include "index/Serialization.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/SHA1.h"
 #include "llvm/Support/Threading.h"
 #include <condition_variable>
-#include <deque>
+#include <functional>
+#include <limits>
 #include <string>
 #include <thread>
 #include <vector>
@@ -53,13 +57,76 @@ public:
 
   // Creates an Index Storage that saves shards into disk. Index storage uses
   // CDBDirectory + ".clangd-index/" as the folder to save shards.
-  static Factory createDiskBackedStorageFactory();
+  // If UseStringDictionary is set, the shards refer to a dictionary of the
+  // strings common to the shards of the CDB, which is saved in the folder too.
+  static Factory
+  createDiskBackedStorageFactory(bool UseStringDictionary = false);
+
+  // Like createDiskBackedStorageFactory, but packs all shards of a CDB into a
+  // single append-only file in CDBDirectory + ".clangd-index/".
+  static Factory createPackedDiskStorageFactory();
+};
+
+// A priority queue of tasks which can be run on (external) worker threads.
+class BackgroundQueue {
+public:
+  // A task to be run by the queue.
+  struct Task {
+    explicit Task(std::function<void()> Run) : Run(std::move(Run)) {}
+
+    std::function<void()> Run;
+    // Higher-priority tasks will run first.
+    unsigned QueuePri = 0;
+    // Allows the priority to be boosted later.
+    std::string Tag;
+
+    bool operator<(const Task &O) const { return QueuePri < O.QueuePri; }
+  };
+
+  // Adds tasks to the queue.
+  void push(Task);
+  void append(std::vector<Task>);
+
+  // Raises the priority of all current and future tasks with \p Tag to at
+  // least \p NewPriority.
+  void boost(llvm::StringRef Tag, unsigned NewPriority);
+
+  // Processes items on the queue until the queue is stopped.
+  // Blocks while the queue is empty. May be called from several threads, the
+  // callers share the tasks.
+  void work();
+
+  // Stops processing new tasks, allowing work() to return. Tasks that are
+  // still queued are discarded.
+  void stop();
+
+  // Runs at most \p Limit tasks at once, the other callers of work() wait.
+  // 0 pauses the queue. Running tasks aren't interrupted.
+  void setMaxActiveTasks(unsigned Limit);
+
+  // Waits until the queue is empty and no tasks are running.
+  LLVM_NODISCARD bool
+  blockUntilIdleForTest(llvm::Optional<double> TimeoutSeconds);
+
+private:
+  std::mutex Mu;
+  unsigned NumActiveTasks = 0; // Only idle when queue is empty *and* no tasks.
+  unsigned MaxActiveTasks = std::numeric_limits<unsigned>::max();
+  std::condition_variable CV;
+  bool ShouldStop = false;
+  std::vector<Task> Queue; // max-heap
+  llvm::StringMap<unsigned> Boosts;
 };
 
 // Builds an in-memory index by by running the static indexer action over
 // all commands in a compilation database. Indexing happens in the background.
-// FIXME: it should also persist its state on disk for fast start.
-// FIXME: it should watch for changes to files on disk.
+// The files read by the indexed TUs are watched, and the TUs depending on a
+// file are indexed again when it changes on disk. Once the TUs are indexed,
+// the project headers none of them includes are indexed as TUs of their own.
+//
+// With LazyRefs, only symbols are kept in memory. The refs of each file are
+// read back from its stored shard when refs() asks for them, and the recently
+// read ones are cached.
 class BackgroundIndex : public SwapIndex {
 public:
   // FIXME: resource-dir injection should be hoisted somewhere common.
@@ -67,15 +134,48 @@ public:
                   const FileSystemProvider &,
                   const GlobalCompilationDatabase &CDB,
                   BackgroundIndexStorage::Factory IndexStorageFactory,
+                  bool LazyRefs = false,
                   size_t ThreadPoolSize = llvm::hardware_concurrency());
   ~BackgroundIndex(); // Blocks while the current task finishes.
 
+  void refs(const RefsRequest &,
+            llvm::function_ref<void(const Ref &)>) const override;
+  void refsBySymbol(
+      const RefsRequest &,
+      llvm::function_ref<void(const SymbolID &, llvm::ArrayRef<Ref>)>)
+      const override;
+  size_t estimateMemoryUsage() const override;
+  void profile(MemoryTree &MT) const override;
+
+  // Frees the cache of refs read from storage, if refs are loaded lazily.
+  void dropCachedRefs();
+  // Frees the cache of file contents read by indexing.
+  void dropCachedFiles();
+
   // Enqueue translation units for indexing.
   // The indexing happens in a background thread, so the symbols will be
   // available sometime later.
   void enqueue(const std::vector<std::string> &ChangedFiles);
   void enqueue(const std::string &File);
 
+  // Index the TUs related to \p Path (e.g. a file opened in the editor) before
+  // the others. Currently these are the TUs in the same directory.
+  void boostRelated(llvm::StringRef Path);
+
+  // Enqueue the TUs that read any of \p Files (absolute paths) when they were
+  // last indexed. Called by the file watcher.
+  void filesChanged(const std::vector<std::string> &Files);
+
+  // Returns a TU from the compilation database that read \p Header (an
+  // absolute path) when it was last indexed, if any.
+  llvm::Optional<std::string> getIncluder(llvm::StringRef Header);
+
+  // Adapts the number of threads that index to the load of the machine, so
+  // that indexing doesn't slow down builds: pauses while a compiler runs or
+  // memory is short, and runs fewer threads while the CPUs are busy. Called
+  // periodically by a SystemLoadMonitor.
+  void adaptToLoad(const SystemLoad &Load);
+
   // Cause background threads to stop after ther current task, any remaining
   // tasks will be discarded.
   void stop();
@@ -86,11 +186,21 @@ public:
 
   using FileDigest = decltype(llvm::SHA1::hash({}));
 
+  // Returns whether the symbols of the file at \p AbsPath are indexed, from
+  // contents with digest \p Digest.
+  bool isIndexed(llvm::StringRef AbsPath, const FileDigest &Digest);
+
 private:
   /// Given index results from a TU, only update files in \p FilesToUpdate.
   void update(llvm::StringRef MainFile, SymbolSlab Symbols, RefSlab Refs,
               const llvm::StringMap<FileDigest> &FilesToUpdate,
+              const llvm::StringMap<FileDigest> &Dependencies,
               BackgroundIndexStorage *IndexStorage);
+  /// Loads the stored shards of \p MainFile and its dependencies into
+  /// IndexedSymbols if none of these files changed since they were indexed.
+  /// Returns false if the TU needs to be indexed again.
+  bool loadShards(llvm::StringRef MainFile,
+                  BackgroundIndexStorage *IndexStorage);
 
   // configuration
   std::string ResourceDir;
@@ -105,21 +215,54 @@ private:
   FileSymbols IndexedSymbols;
   llvm::StringMap<FileDigest> IndexedFileDigests; // Key is absolute file path.
   std::mutex DigestsMu;
+  // Locates and caches refs that are kept in storage. Null unless LazyRefs.
+  class LazyRefStore;
+  std::unique_ptr<LazyRefStore> LazyRefs;
+  // Contents and digests of the files read by indexing, shared by the TUs.
+  class FileContentCache;
+  std::unique_ptr<FileContentCache> FileContents;
+
+  // include graph
+  // Remembers the files \p MainFile read, and watches them for changes.
+  void recordDependencies(llvm::StringRef MainFile,
+                          const llvm::StringMap<FileDigest> &Dependencies);
+  std::mutex DependenciesMu;
+  // Absolute paths of the TUs and their dependencies are interned, as large
+  // projects have millions of dependency edges.
+  llvm::StringMap<unsigned> FileIDs;      /* GUARDED_BY(DependenciesMu) */
+  std::vector<llvm::StringRef> FilePaths; /* GUARDED_BY(DependenciesMu) */
+  // The files each TU read when it was last indexed, sorted.
+  llvm::DenseMap<unsigned, std::vector<unsigned>>
+      TUDependencies; /* GUARDED_BY(DependenciesMu) */
+  // The reverse edges: the TUs that read each file. May contain stale TUs that
+  // no longer read the file, which filesChanged() checks and drops.
+  llvm::DenseMap<unsigned, std::vector<unsigned>>
+      FileDependents; /* GUARDED_BY(DependenciesMu) */
+  std::unique_ptr<FileWatcher> Watcher; // Null if watching is unsupported.
 
   BackgroundIndexStorage::Factory IndexStorageFactory;
 
   // queue management
-  using Task = std::function<void()>;
-  void run(); // Main loop executed by Thread. Runs tasks from Queue.
-  void enqueueTask(Task T);
-  void enqueueLocked(tooling::CompileCommand Cmd,
-                     BackgroundIndexStorage *IndexStorage);
-  std::mutex QueueMu;
-  unsigned NumActiveTasks = 0; // Only idle when queue is empty *and* no tasks.
-  std::condition_variable QueueCV;
-  bool ShouldStop = false;
-  std::deque<Task> Queue;
-  std::vector<std::thread> ThreadPool; // FIXME: Abstract this away.
+  void enqueue(llvm::StringRef File, tooling::CompileCommand Cmd,
+               BackgroundIndexStorage *Storage, unsigned Priority);
+  // Indexes the headers in directories under \p SourceRoots that hold files
+  // already indexed, but that no indexed TU reads. Each header is parsed on
+  // its own, with the command of the nearest indexed TU.
+  void indexUncoveredHeaders(const std::vector<std::string> &SourceRoots);
+  // Runs indexUncoveredHeaders() for \p SourceRoots once no TUs from the CDB
+  // are queued or being indexed.
+  void indexUncoveredHeadersWhenDone(const llvm::StringSet<> &SourceRoots);
+  void enqueueUncoveredHeadersLocked();
+  std::mutex UncoveredHeadersMu;
+  unsigned PendingTUs = 0;                /* GUARDED_BY(UncoveredHeadersMu) */
+  llvm::StringSet<> UncoveredHeaderRoots; /* GUARDED_BY(UncoveredHeadersMu) */
+  void enqueueTask(std::function<void()> Run, unsigned Priority,
+                   llvm::StringRef Tag = "");
+  BackgroundQueue Queue;
+  std::vector<std::thread> ThreadPool;
+  // The number of threads allowed to index by adaptToLoad(), only accessed
+  // by the thread that calls it.
+  unsigned LoadLimit;
   GlobalCompilationDatabase::CommandChanged::Subscription CommandsChanged;
 };
 
@@ -9,9 +9,13 @@
 
 #include "Logger.h"
 #include "index/Background.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JamCRC.h"
+#include "llvm/Support/LockFileManager.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/SHA1.h"
 
 namespace clang {
@@ -35,13 +39,89 @@ std::string getShardPathFromFilePath(llvm::StringRef ShardRoot,
 
 // Uses disk as a storage for index shards. Creates a directory called
 // ".clangd-index/" under the path provided during construction.
+//
+// If UseStringDictionary is set, a string dictionary is built from the first
+// shards stored and written to ".clangd-index/strings.dict". The shards stored
+// later refer to its strings, which are common to most shards of a project.
+// The shards written with a dictionary can't be loaded without it, they are
+// rebuilt if it's deleted.
 class DiskBackedIndexStorage : public BackgroundIndexStorage {
   std::string DiskShardRoot;
+  bool UseStringDictionary;
+  std::string DictionaryPath;
+  mutable std::mutex DictionaryMu;
+  // Set once there's a dictionary, and never changed.
+  mutable std::shared_ptr<const StringDictionary> Dictionary;
+  // Collects the strings of the first shards stored, until there's a
+  // dictionary.
+  mutable StringDictionary::Builder DictionaryBuilder;
+
+  // The number of shards the dictionary is built from.
+  static constexpr size_t DictionarySamples = 32;
+
+  std::shared_ptr<const StringDictionary> dictionary() const {
+    std::lock_guard<std::mutex> Lock(DictionaryMu);
+    return Dictionary;
+  }
+
+  void loadDictionary() {
+    auto Buffer = llvm::MemoryBuffer::getFile(DictionaryPath);
+    if (!Buffer)
+      return;
+    auto Dict = StringDictionary::fromData(Buffer->get()->getBuffer());
+    if (!Dict) {
+      elog("Error while reading string dictionary {0}: {1}", DictionaryPath,
+           Dict.takeError());
+      return;
+    }
+    Dictionary = std::make_shared<StringDictionary>(std::move(*Dict));
+  }
+
+  // Builds the dictionary once enough shards were sampled.
+  void sampleShard(const IndexFileOut &Shard) const {
+    std::lock_guard<std::mutex> Lock(DictionaryMu);
+    if (Dictionary)
+      return;
+    DictionaryBuilder.addSample(Shard);
+    if (DictionaryBuilder.samples() < DictionarySamples)
+      return;
+    auto Dict = std::make_shared<StringDictionary>(DictionaryBuilder.build());
+    DictionaryBuilder = StringDictionary::Builder();
+    // Written to a temporary file first, so that a partial dictionary is never
+    // read.
+    std::string TempPath = DictionaryPath + ".tmp";
+    {
+      std::error_code EC;
+      llvm::raw_fd_ostream OS(TempPath, EC);
+      if (EC) {
+        elog("Failed to write string dictionary {0}: {1}", TempPath,
+             EC.message());
+        return;
+      }
+      OS << Dict->data();
+      OS.close();
+      if (OS.has_error()) {
+        elog("Failed to write string dictionary {0}: {1}", TempPath,
+             OS.error().message());
+        OS.clear_error();
+        return;
+      }
+    }
+    if (auto EC = llvm::sys::fs::rename(TempPath, DictionaryPath)) {
+      elog("Failed to write string dictionary {0}: {1}", DictionaryPath,
+           EC.message());
+      return;
+    }
+    log("Built a string dictionary of {0} strings for {1}",
+        Dict->strings().size(), DiskShardRoot);
+    Dictionary = std::move(Dict);
+  }
 
 public:
   // Sets DiskShardRoot to (Directory + ".clangd-index/") which is the base
   // directory for all shard files.
-  DiskBackedIndexStorage(llvm::StringRef Directory) {
+  DiskBackedIndexStorage(llvm::StringRef Directory, bool UseStringDictionary)
+      : UseStringDictionary(UseStringDictionary) {
     llvm::SmallString<128> CDBDirectory(Directory);
     llvm::sys::path::append(CDBDirectory, ".clangd-index/");
     DiskShardRoot = CDBDirectory.str();
@@ -51,6 +131,11 @@ public:
       elog("Failed to create directory {0} for index storage: {1}",
            DiskShardRoot, EC.message());
     }
+    llvm::sys::path::append(CDBDirectory, "strings.dict");
+    DictionaryPath = CDBDirectory.str();
+    // The dictionary of shards stored earlier is loaded even if new shards
+    // don't use one.
+    loadDictionary();
   }
 
   std::unique_ptr<IndexFileIn>
@@ -60,7 +145,10 @@ public:
     auto Buffer = llvm::MemoryBuffer::getFile(ShardPath);
     if (!Buffer)
       return nullptr;
-    if (auto I = readIndexFile(Buffer->get()->getBuffer()))
+    // The strings are copied, so the dictionary needn't outlive the shard.
+    auto Dict = dictionary();
+    if (auto I = readIndexFile(Buffer->get()->getBuffer(), /*CopyStrings=*/true,
+                               /*DecompressDocumentation=*/true, Dict.get()))
       return llvm::make_unique<IndexFileIn>(std::move(*I));
     else
       elog("Error while reading shard {0}: {1}", ShardIdentifier,
@@ -70,6 +158,12 @@ public:
 
   llvm::Error storeShard(llvm::StringRef ShardIdentifier,
                          IndexFileOut Shard) const override {
+    std::shared_ptr<const StringDictionary> Dict;
+    if (UseStringDictionary) {
+      sampleShard(Shard);
+      Dict = dictionary();
+      Shard.Dictionary = Dict.get();
+    }
     auto ShardPath = getShardPathFromFilePath(DiskShardRoot, ShardIdentifier);
     std::error_code EC;
     llvm::raw_fd_ostream OS(ShardPath, EC);
@@ -81,6 +175,330 @@ public:
   }
 };
 
+constexpr size_t DiskBackedIndexStorage::DictionarySamples;
+
+// Uses disk as a storage for index shards, packing all shards into a single
+// file ".clangd-index/shards.pack" under the path provided during
+// construction. Loading the shards of a large project then takes a single
+// open() rather than one per source file, which matters on network
+// filesystems.
+//
+// The file starts with a magic string, followed by a record per stored shard:
+//   - KeySize  : uint32
+//   - DataSize : uint32
+//   - CRC      : uint32, of Key and Data
+//   - Key      : char[KeySize], the shard identifier
+//   - Data     : char[DataSize], the serialized shard
+// Records are only ever appended, the last record of a key wins. A truncated
+// record at the end (e.g. after a crash during a write) is dropped, and
+// records with a bad checksum are ignored when loading. When stale records
+// take most of the file, the live records are copied to a new file that
+// atomically replaces the old one.
+//
+// Several clangd processes may share the file. Writes, i.e. appending,
+// dropping a truncated record and compacting, happen under a lock file, and
+// each process catches up with the records the others appended, or with a
+// compacted file, before writing and when a shard is missing.
+class PackedIndexStorage : public BackgroundIndexStorage {
+public:
+  PackedIndexStorage(llvm::StringRef Directory) {
+    llvm::SmallString<128> ShardRoot(Directory);
+    llvm::sys::path::append(ShardRoot, ".clangd-index/");
+    std::error_code EC = llvm::sys::fs::create_directory(ShardRoot);
+    if (EC)
+      elog("Failed to create directory {0} for index storage: {1}", ShardRoot,
+           EC.message());
+    llvm::sys::path::append(ShardRoot, "shards.pack");
+    PackPath = ShardRoot.str();
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (auto Err = withFileLock([&] { return sync(/*Locked=*/true); }))
+      elog("Failed to open index storage {0}: {1}", PackPath, std::move(Err));
+  }
+
+  ~PackedIndexStorage() override { close(); }
+
+  std::unique_ptr<IndexFileIn>
+  loadShard(llvm::StringRef ShardIdentifier) const override {
+    std::unique_ptr<llvm::MemoryBuffer> Record;
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      auto It = Records.find(ShardIdentifier);
+      if (It == Records.end()) {
+        // Another process may have stored it since.
+        if (auto Err = sync(/*Locked=*/false))
+          elog("Failed to read index storage {0}: {1}", PackPath,
+               std::move(Err));
+        It = Records.find(ShardIdentifier);
+      }
+      if (It == Records.end() || ReadFD < 0)
+        return nullptr;
+      auto Buf = llvm::MemoryBuffer::getOpenFileSlice(
+          ReadFD, PackPath, It->second.Size, It->second.Offset);
+      if (!Buf) {
+        elog("Error while reading shard {0}: {1}", ShardIdentifier,
+             Buf.getError().message());
+        return nullptr;
+      }
+      Record = std::move(*Buf);
+    }
+    llvm::StringRef Data = Record->getBuffer();
+    uint32_t KeySize = llvm::support::endian::read32le(Data.data());
+    uint32_t CRC = llvm::support::endian::read32le(Data.data() + 8);
+    if (checksum(Data.drop_front(HeaderSize)) != CRC ||
+        Data.substr(HeaderSize, KeySize) != ShardIdentifier) {
+      elog("Corrupted record of shard {0} in {1}", ShardIdentifier, PackPath);
+      return nullptr;
+    }
+    if (auto I = readIndexFile(Data.drop_front(HeaderSize + KeySize)))
+      return llvm::make_unique<IndexFileIn>(std::move(*I));
+    else
+      elog("Error while reading shard {0}: {1}", ShardIdentifier,
+           I.takeError());
+    return nullptr;
+  }
+
+  llvm::Error storeShard(llvm::StringRef ShardIdentifier,
+                         IndexFileOut Shard) const override {
+    std::string Record(HeaderSize, '\0');
+    Record += ShardIdentifier;
+    {
+      llvm::raw_string_ostream OS(Record);
+      OS << Shard;
+    }
+    char *Header = &Record[0];
+    llvm::support::endian::write32le(Header, ShardIdentifier.size());
+    llvm::support::endian::write32le(
+        Header + 4, Record.size() - HeaderSize - ShardIdentifier.size());
+    llvm::support::endian::write32le(
+        Header + 8, checksum(llvm::StringRef(Record).drop_front(HeaderSize)));
+
+    std::lock_guard<std::mutex> Lock(Mu);
+    return withFileLock([&]() -> llvm::Error {
+      // Append after the records the other processes wrote.
+      if (auto Err = sync(/*Locked=*/true))
+        return Err;
+      // A single write, so that a crash can only truncate the last record.
+      *Out << Record;
+      Out->flush();
+      if (Out->has_error()) {
+        Out->clear_error();
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "failed to append to %s",
+                                       PackPath.c_str());
+      }
+      addRecord(ShardIdentifier, {FileSize, Record.size()});
+      FileSize += Record.size();
+
+      if (FileSize > MinCompactedSize && LiveBytes < FileSize / 2)
+        if (auto Err = compact())
+          elog("Failed to compact index storage {0}: {1}", PackPath,
+               std::move(Err));
+      return llvm::Error::success();
+    });
+  }
+
+private:
+  // Identifies the file format, including its version.
+  static constexpr llvm::StringLiteral Magic = "CdPk0001";
+  static constexpr size_t HeaderSize = 12;
+  // Don't bother compacting small files.
+  static constexpr uint64_t MinCompactedSize = 64 << 20;
+
+  struct Location {
+    uint64_t Offset; // of the record in the file
+    uint64_t Size;   // of the whole record
+  };
+
+  static uint32_t checksum(llvm::StringRef Data) {
+    llvm::JamCRC CRC;
+    CRC.update(llvm::makeArrayRef(Data.data(), Data.size()));
+    return CRC.getCRC();
+  }
+
+  void addRecord(llvm::StringRef Key, Location L) const {
+    auto &Slot = Records[Key];
+    LiveBytes -= Slot.Size;
+    Slot = L;
+    LiveBytes += L.Size;
+  }
+
+  // Runs \p Action holding the lock file of the pack, so that no other process
+  // writes to it meanwhile. Requires Mu.
+  llvm::Error withFileLock(llvm::function_ref<llvm::Error()> Action) const {
+    while (true) {
+      llvm::LockFileManager Lock(PackPath);
+      switch (Lock) {
+      case llvm::LockFileManager::LFS_Error:
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "failed to lock %s: %s",
+                                       PackPath.c_str(),
+                                       Lock.getErrorMessage().c_str());
+      case llvm::LockFileManager::LFS_Owned:
+        return Action();
+      case llvm::LockFileManager::LFS_Shared:
+        // The owner is likely stuck if it held the lock for that long.
+        if (Lock.waitForUnlock() == llvm::LockFileManager::Res_Timeout)
+          Lock.unsafeRemoveLockFile();
+        break;
+      }
+    }
+  }
+
+  // Forgets the records and closes the pack file. Requires Mu.
+  void close() const {
+    Records.clear();
+    LiveBytes = 0;
+    FileSize = 0;
+    Out.reset();
+    OutFD = -1;
+    if (ReadFD >= 0) {
+      llvm::sys::Process::SafelyCloseFileDescriptor(ReadFD);
+      ReadFD = -1;
+    }
+  }
+
+  // Indexes the records appended to the pack file since the last call, and
+  // reopens it if another process replaced it. With \p Locked, the caller
+  // holds the lock file: the pack is created if needed and opened for
+  // appending, and the bytes after the last complete record, which no process
+  // is writing then, are dropped. Requires Mu.
+  llvm::Error sync(bool Locked) const {
+    if (Locked && !llvm::sys::fs::exists(PackPath))
+      close();
+    llvm::sys::fs::file_status Status;
+    if (ReadFD >= 0 && !llvm::sys::fs::status(PackPath, Status) &&
+        Status.getUniqueID() != FileID) {
+      vlog("Reopening index storage {0}, it was replaced", PackPath);
+      close();
+    }
+    if (Locked && !Out) {
+      if (std::error_code EC = llvm::sys::fs::openFileForWrite(
+              PackPath, OutFD, llvm::sys::fs::CD_OpenAlways,
+              llvm::sys::fs::F_Append))
+        return llvm::errorCodeToError(EC);
+      Out = llvm::make_unique<llvm::raw_fd_ostream>(OutFD,
+                                                    /*shouldClose=*/true);
+    }
+    if (ReadFD < 0) {
+      if (std::error_code EC =
+              llvm::sys::fs::openFileForRead(PackPath, ReadFD)) {
+        // Nothing was stored yet.
+        if (!Locked && EC == std::errc::no_such_file_or_directory)
+          return llvm::Error::success();
+        return llvm::errorCodeToError(EC);
+      }
+      if (std::error_code EC = llvm::sys::fs::status(ReadFD, Status))
+        return llvm::errorCodeToError(EC);
+      FileID = Status.getUniqueID();
+    }
+
+    if (std::error_code EC = llvm::sys::fs::status(ReadFD, Status))
+      return llvm::errorCodeToError(EC);
+    uint64_t Size = Status.getSize();
+    if (Size < FileSize) {
+      // Not written by this class, start over.
+      close();
+      return sync(Locked);
+    }
+    if (Size > FileSize) {
+      auto Buf = llvm::MemoryBuffer::getOpenFileSlice(
+          ReadFD, PackPath, Size - FileSize, FileSize);
+      if (!Buf)
+        return llvm::errorCodeToError(Buf.getError());
+      llvm::StringRef Data = (*Buf)->getBuffer();
+      // The offset in Data of the end of the last complete record.
+      uint64_t GoodSize = 0;
+      if (FileSize == 0 && Data.startswith(Magic))
+        GoodSize = Magic.size();
+      if (FileSize != 0 || GoodSize != 0) {
+        while (GoodSize + HeaderSize <= Data.size()) {
+          const char *Header = Data.data() + GoodSize;
+          uint32_t KeySize = llvm::support::endian::read32le(Header);
+          uint32_t DataSize = llvm::support::endian::read32le(Header + 4);
+          uint64_t RecordSize = HeaderSize + uint64_t(KeySize) + DataSize;
+          if (GoodSize + RecordSize > Data.size())
+            break;
+          addRecord(llvm::StringRef(Header + HeaderSize, KeySize),
+                    {FileSize + GoodSize, RecordSize});
+          GoodSize += RecordSize;
+        }
+        if (Locked && GoodSize != Data.size())
+          log("Dropping a truncated record at the end of {0}", PackPath);
+      } else if (Locked) {
+        log("Discarding index storage {0} with an unknown format", PackPath);
+      }
+      FileSize += GoodSize;
+    }
+
+    if (!Locked)
+      return llvm::Error::success();
+    if (Size != FileSize)
+      if (std::error_code EC = llvm::sys::fs::resize_file(OutFD, FileSize))
+        return llvm::errorCodeToError(EC);
+    if (FileSize == 0) {
+      *Out << Magic;
+      Out->flush();
+      if (Out->has_error()) {
+        Out->clear_error();
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "failed to write %s", PackPath.c_str());
+      }
+      FileSize = Magic.size();
+    }
+    return llvm::Error::success();
+  }
+
+  // Replaces the pack file with one containing only the live records.
+  // Requires Mu and the lock file.
+  llvm::Error compact() const {
+    vlog("Compacting index storage {0}: {1} of {2} bytes are live", PackPath,
+         LiveBytes, FileSize);
+    std::string TempPath = PackPath + ".tmp";
+    {
+      std::error_code EC;
+      llvm::raw_fd_ostream TempOut(TempPath, EC, llvm::sys::fs::F_None);
+      if (EC)
+        return llvm::errorCodeToError(EC);
+      TempOut << Magic;
+      for (const auto &R : Records) {
+        auto Buf = llvm::MemoryBuffer::getOpenFileSlice(
+            ReadFD, PackPath, R.second.Size, R.second.Offset);
+        if (!Buf)
+          return llvm::errorCodeToError(Buf.getError());
+        TempOut << (*Buf)->getBuffer();
+      }
+      TempOut.close();
+      if (TempOut.has_error()) {
+        TempOut.clear_error();
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "failed to write %s", TempPath.c_str());
+      }
+    }
+    if (std::error_code EC = llvm::sys::fs::rename(TempPath, PackPath))
+      return llvm::errorCodeToError(EC);
+    close();
+    return sync(/*Locked=*/true);
+  }
+
+  std::string PackPath;
+  mutable std::mutex Mu;
+  // Latest record of each shard.
+  mutable llvm::StringMap<Location> Records; /* GUARDED_BY(Mu) */
+  // Total size of the latest records.
+  mutable uint64_t LiveBytes = 0; /* GUARDED_BY(Mu) */
+  // Size of the indexed part of the file.
+  mutable uint64_t FileSize = 0; /* GUARDED_BY(Mu) */
+  // Identifies the file ReadFD and Out refer to.
+  mutable llvm::sys::fs::UniqueID FileID; /* GUARDED_BY(Mu) */
+  mutable int ReadFD = -1;                /* GUARDED_BY(Mu) */
+  mutable int OutFD = -1;                 /* GUARDED_BY(Mu) */
+  mutable std::unique_ptr<llvm::raw_fd_ostream> Out; /* GUARDED_BY(Mu) */
+};
+
+constexpr llvm::StringLiteral PackedIndexStorage::Magic;
+constexpr size_t PackedIndexStorage::HeaderSize;
+constexpr uint64_t PackedIndexStorage::MinCompactedSize;
+
 // Doesn't persist index shards anywhere (used when the CDB dir is unknown).
 // We could consider indexing into ~/.clangd/ or so instead.
 class NullStorage : public BackgroundIndexStorage {
@@ -101,8 +519,9 @@ public:
 // Creates and owns IndexStorages for multiple CDBs.
 class DiskBackedIndexStorageManager {
 public:
-  DiskBackedIndexStorageManager()
-      : IndexStorageMapMu(llvm::make_unique<std::mutex>()) {}
+  DiskBackedIndexStorageManager(bool Packed, bool UseStringDictionary = false)
+      : Packed(Packed), UseStringDictionary(UseStringDictionary),
+        IndexStorageMapMu(llvm::make_unique<std::mutex>()) {}
 
   // Creates or fetches to storage from cache for the specified CDB.
   BackgroundIndexStorage *operator()(llvm::StringRef CDBDirectory) {
@@ -120,9 +539,14 @@ private:
   std::unique_ptr<BackgroundIndexStorage> create(llvm::StringRef CDBDirectory) {
     if (CDBDirectory.empty())
       return llvm::make_unique<NullStorage>();
-    return llvm::make_unique<DiskBackedIndexStorage>(CDBDirectory);
+    if (Packed)
+      return llvm::make_unique<PackedIndexStorage>(CDBDirectory);
+    return llvm::make_unique<DiskBackedIndexStorage>(CDBDirectory,
+                                                     UseStringDictionary);
   }
 
+  bool Packed;
+  bool UseStringDictionary;
   llvm::StringMap<std::unique_ptr<BackgroundIndexStorage>> IndexStorageMap;
   std::unique_ptr<std::mutex> IndexStorageMapMu;
 };
@@ -130,8 +554,14 @@ private:
 } // namespace
 
 BackgroundIndexStorage::Factory
-BackgroundIndexStorage::createDiskBackedStorageFactory() {
-  return DiskBackedIndexStorageManager();
+BackgroundIndexStorage::createDiskBackedStorageFactory(
+    bool UseStringDictionary) {
+  return DiskBackedIndexStorageManager(/*Packed=*/false, UseStringDictionary);
+}
+
+BackgroundIndexStorage::Factory
+BackgroundIndexStorage::createPackedDiskStorageFactory() {
+  return DiskBackedIndexStorageManager(/*Packed=*/true);
 }
 
 } // namespace clangd
@@ -0,0 +1,218 @@
+//===--- CachingIndex.cpp - Cache of index results ---------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CachingIndex.h"
+#include "Cancellation.h"
+#include "FuzzyMatch.h"
+#include "Quality.h"
+#include "Trace.h"
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// Whether results of Cached are results of Req, modulo query and limit.
+bool sameFilters(const FuzzyFindRequest &Cached, const FuzzyFindRequest &Req) {
+  return std::tie(Cached.Scopes, Cached.AnyScope,
+                  Cached.RestrictForCodeCompletion, Cached.ProximityPaths) ==
+         std::tie(Req.Scopes, Req.AnyScope, Req.RestrictForCodeCompletion,
+                  Req.ProximityPaths);
+}
+
+} // namespace
+
+CachingIndex::CachingIndex(const SwapIndex &Base, size_t MaxEntries)
+    : Base(Base), MaxEntries(MaxEntries),
+      BaseChanged(Base.watch([this](const SwapIndex *) { invalidate(); })) {}
+
+std::shared_ptr<const CachingIndex::Entry>
+CachingIndex::find(const FuzzyFindRequest &Req) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  auto Best = Entries.end();
+  for (auto I = Entries.begin(); I != Entries.end(); ++I) {
+    const FuzzyFindRequest &Cached = (*I)->Req;
+    if (!sameFilters(Cached, Req))
+      continue;
+    if (Cached.Query == Req.Query && Cached.Limit == Req.Limit) {
+      Best = I;
+      break;
+    }
+    // Every symbol matching the longer query also matches its prefix, so the
+    // complete results of the prefix are candidates for Req.
+    if (!(*I)->More && StringRef(Req.Query).startswith(Cached.Query) &&
+        (Best == Entries.end() ||
+         Cached.Query.size() > (*Best)->Req.Query.size()))
+      Best = I;
+  }
+  if (Best == Entries.end())
+    return nullptr;
+  Entries.splice(Entries.begin(), Entries, Best);
+  return Entries.front();
+}
+
+bool CachingIndex::fuzzyFind(
+    const FuzzyFindRequest &Req,
+    function_ref<void(const Symbol &)> Callback) const {
+  trace::Span Tracer("CachingIndex fuzzyFind");
+  // Results of unlimited requests may be arbitrarily large, don't keep them.
+  if (!Req.Limit)
+    return Base.fuzzyFind(Req, Callback);
+
+  if (auto Hit = find(Req)) {
+    if (Hit->Req.Query == Req.Query && Hit->Req.Limit == Req.Limit) {
+      SPAN_ATTACH(Tracer, "cache", "hit");
+      for (const Symbol *Sym : Hit->Results)
+        Callback(*Sym);
+      return Hit->More;
+    }
+    SPAN_ATTACH(Tracer, "cache", "refilter");
+    FuzzyMatcher Filter(Req.Query);
+    using ScoredSymbol = std::pair<float, const Symbol *>;
+    TopN<ScoredSymbol> Top(*Req.Limit);
+    bool More = false;
+    for (const Symbol *Sym : Hit->Results)
+      if (auto Score = Filter.match(Sym->Name))
+        More |= Top.push({*Score * quality(*Sym), Sym});
+    for (const auto &Item : std::move(Top).items())
+      Callback(*Item.second);
+    return More;
+  }
+
+  SPAN_ATTACH(Tracer, "cache", "miss");
+  uint64_t StartGeneration;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    StartGeneration = Generation;
+  }
+  auto New = std::make_shared<Entry>();
+  New->Req = Req;
+  SymbolSlab::Builder Builder;
+  std::vector<SymbolID> IDs;
+  New->More = Base.fuzzyFind(Req, [&](const Symbol &Sym) {
+    Builder.insert(Sym);
+    IDs.push_back(Sym.ID);
+    Callback(Sym);
+  });
+  New->Slab = std::move(Builder).build();
+  New->Results.reserve(IDs.size());
+  for (const SymbolID &ID : IDs)
+    New->Results.push_back(&*New->Slab.find(ID));
+
+  bool More = New->More;
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (Generation == StartGeneration && MaxEntries > 0) {
+    Entries.push_front(std::move(New));
+    if (Entries.size() > MaxEntries)
+      Entries.pop_back();
+  }
+  return More;
+}
+
+void CachingIndex::lookup(const LookupRequest &Req,
+                          function_ref<void(const Symbol &)> Callback) const {
+  Base.lookup(Req, Callback);
+}
+
+std::shared_ptr<const CachingIndex::RefEntry>
+CachingIndex::findRefs(const SymbolID &ID, RefKind Filter) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (auto I = RefEntries.begin(); I != RefEntries.end(); ++I)
+    if ((*I)->Filter == Filter && (*I)->IDs.count(ID)) {
+      RefEntries.splice(RefEntries.begin(), RefEntries, I);
+      return RefEntries.front();
+    }
+  return nullptr;
+}
+
+void CachingIndex::refs(const RefsRequest &Req,
+                        function_ref<void(const Ref &)> Callback) const {
+  refsBySymbol(Req, [&](const SymbolID &, ArrayRef<Ref> Refs) {
+    for (const Ref &R : Refs)
+      Callback(R);
+  });
+}
+
+void CachingIndex::refsBySymbol(
+    const RefsRequest &Req,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> Callback) const {
+  trace::Span Tracer("CachingIndex refsBySymbol");
+  RefsRequest Missing;
+  Missing.Filter = Req.Filter;
+  for (const SymbolID &ID : Req.IDs) {
+    auto Hit = findRefs(ID, Req.Filter);
+    if (!Hit) {
+      Missing.IDs.insert(ID);
+      continue;
+    }
+    for (const auto &Sym : Hit->Slab)
+      if (Sym.first == ID)
+        Callback(ID, Sym.second);
+  }
+  SPAN_ATTACH(Tracer, "misses", static_cast<int>(Missing.IDs.size()));
+  if (Missing.IDs.empty())
+    return;
+
+  uint64_t StartGeneration;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    StartGeneration = Generation;
+  }
+  RefSlab::Builder Builder;
+  Base.refsBySymbol(Missing, [&](const SymbolID &ID, ArrayRef<Ref> Refs) {
+    for (const Ref &R : Refs)
+      Builder.insert(ID, R);
+    Callback(ID, Refs);
+  });
+  // The refs may have been cut short.
+  if (isCancelled())
+    return;
+  auto New = std::make_shared<RefEntry>();
+  New->IDs = std::move(Missing.IDs);
+  New->Filter = Req.Filter;
+  New->Slab = std::move(Builder).build();
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (Generation == StartGeneration && MaxEntries > 0) {
+    RefEntries.push_front(std::move(New));
+    if (RefEntries.size() > MaxEntries)
+      RefEntries.pop_back();
+  }
+}
+
+size_t CachingIndex::estimateMemoryUsage() const {
+  size_t Bytes = Base.estimateMemoryUsage();
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (const auto &E : Entries)
+    Bytes += E->Slab.bytes() + E->Results.capacity() * sizeof(const Symbol *);
+  for (const auto &E : RefEntries)
+    Bytes += E->Slab.bytes() + E->IDs.getMemorySize();
+  return Bytes;
+}
+
+void CachingIndex::profile(MemoryTree &MT) const {
+  Base.profile(MT);
+  MemoryTree &Cache = MT.child("cache");
+  std::lock_guard<std::mutex> Lock(Mutex);
+  for (const auto &E : Entries)
+    Cache.addUsage(E->Slab.bytes() +
+                   E->Results.capacity() * sizeof(const Symbol *));
+  for (const auto &E : RefEntries)
+    Cache.addUsage(E->Slab.bytes() + E->IDs.getMemorySize());
+}
+
+void CachingIndex::invalidate() {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Entries.clear();
+  RefEntries.clear();
+  ++Generation;
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,98 @@
+//===--- CachingIndex.h - Cache of index results -----------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_CACHINGINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_CACHINGINDEX_H
+
+#include "Index.h"
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace clang {
+namespace clangd {
+
+// CachingIndex remembers the results of recent fuzzyFind requests to its base
+// index. Code completion sends a request per keystroke, and the queries
+// usually grow by one character at a time ("fo", "foo", "foob"):
+//  - a request that was seen before is answered from the cache;
+//  - a request whose query extends a cached query that returned all of its
+//    matches is answered by re-filtering those matches with FuzzyMatcher.
+//    Re-filtered results are ranked by name match and symbol quality, without
+//    the base index's boosts.
+// Other fuzzyFind requests and lookup() are forwarded to the base index.
+//
+// The refs of recently requested symbols are remembered too, as references
+// to a symbol are usually requested again while its uses are edited.
+//
+// The cache is dropped whenever the base index is reset.
+class CachingIndex : public SymbolIndex {
+public:
+  // The base index must outlive the CachingIndex.
+  CachingIndex(const SwapIndex &Base, size_t MaxEntries = 16);
+
+  bool fuzzyFind(const FuzzyFindRequest &,
+                 llvm::function_ref<void(const Symbol &)>) const override;
+  void lookup(const LookupRequest &,
+              llvm::function_ref<void(const Symbol &)>) const override;
+  void refs(const RefsRequest &,
+            llvm::function_ref<void(const Ref &)>) const override;
+  void refsBySymbol(
+      const RefsRequest &,
+      llvm::function_ref<void(const SymbolID &, llvm::ArrayRef<Ref>)>)
+      const override;
+  size_t estimateMemoryUsage() const override;
+  void profile(MemoryTree &MT) const override;
+
+  // Drops all cached results.
+  void invalidate();
+
+private:
+  struct Entry {
+    FuzzyFindRequest Req;
+    // Owns the data of the results, which must survive a reset of Base.
+    SymbolSlab Slab;
+    // Results in the order returned by Base.
+    std::vector<const Symbol *> Results;
+    // Whether Base indicated it had more results.
+    bool More;
+  };
+
+  // Returns the entry that can answer Req, if any, marking it recently used.
+  std::shared_ptr<const Entry> find(const FuzzyFindRequest &Req) const;
+
+  struct RefEntry {
+    // The requested symbols, some of which may have no refs.
+    llvm::DenseSet<SymbolID> IDs;
+    RefKind Filter;
+    // Owns the data of the refs, which must survive a reset of Base.
+    RefSlab Slab;
+  };
+
+  // Returns the entry holding the refs of ID of kinds Filter, if any, marking
+  // it recently used.
+  std::shared_ptr<const RefEntry> findRefs(const SymbolID &ID,
+                                           RefKind Filter) const;
+
+  const SwapIndex &Base;
+  const size_t MaxEntries;
+  mutable std::mutex Mutex;
+  // Most recently used entries first.
+  mutable std::list<std::shared_ptr<const Entry>> Entries;
+  mutable std::list<std::shared_ptr<const RefEntry>> RefEntries;
+  // Incremented on invalidation so results of requests that raced with it
+  // are not cached.
+  uint64_t Generation = 0;
+  SwapIndex::IndexChanged::Subscription BaseChanged;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_CACHINGINDEX_H
@@ -22,10 +22,17 @@ const char IWYUPragma[] = "// IWYU pragma: private, include ";
 
 void CanonicalIncludes::addPathSuffixMapping(StringRef Suffix,
                                              StringRef CanonicalPath) {
-  int Components =
-      std::distance(sys::path::begin(Suffix), sys::path::end(Suffix));
-  MaxSuffixComponents = std::max(MaxSuffixComponents, Components);
-  SuffixHeaderMapping[Suffix] = CanonicalPath;
+  unsigned Node = 0;
+  for (auto It = sys::path::rbegin(Suffix), End = sys::path::rend(Suffix);
+       It != End; ++It) {
+    auto Child =
+        SuffixNodes[Node].Children.try_emplace(*It, SuffixNodes.size());
+    Node = Child.first->second;
+    if (Child.second)
+      SuffixNodes.emplace_back();
+  }
+  if (Node != 0)
+    SuffixNodes[Node].CanonicalPath = CanonicalPath;
 }
 
 void CanonicalIncludes::addMapping(StringRef Path, StringRef CanonicalPath) {
@@ -67,13 +74,16 @@ StringRef CanonicalIncludes::mapHeader(ArrayRef<std::string> Headers,
   if (MapIt != FullPathMapping.end())
     return MapIt->second;
 
-  int Components = 1;
+  // The shortest matching suffix wins.
+  unsigned Node = 0;
   for (auto It = sys::path::rbegin(Header), End = sys::path::rend(Header);
-       It != End && Components <= MaxSuffixComponents; ++It, ++Components) {
-    auto SubPath = Header.substr(It->data() - Header.begin());
-    auto MappingIt = SuffixHeaderMapping.find(SubPath);
-    if (MappingIt != SuffixHeaderMapping.end())
-      return MappingIt->second;
+       It != End; ++It) {
+    auto Child = SuffixNodes[Node].Children.find(*It);
+    if (Child == SuffixNodes[Node].Children.end())
+      break;
+    Node = Child->second;
+    if (!SuffixNodes[Node].CanonicalPath.empty())
+      return SuffixNodes[Node].CanonicalPath;
   }
   return Header;
 }
@@ -35,7 +35,7 @@ namespace clangd {
 /// Only const methods (i.e. mapHeader) in this class are thread safe.
 class CanonicalIncludes {
 public:
-  CanonicalIncludes() = default;
+  CanonicalIncludes() : SuffixNodes(1) {}
 
   /// Adds a string-to-string mapping from \p Path to \p CanonicalPath.
   void addMapping(llvm::StringRef Path, llvm::StringRef CanonicalPath);
@@ -59,11 +59,18 @@ public:
 private:
   /// A map from full include path to a canonical path.
   llvm::StringMap<std::string> FullPathMapping;
-  /// A map from a suffix (one or components of a path) to a canonical path.
-  llvm::StringMap<std::string> SuffixHeaderMapping;
-  /// Maximum number of path components stored in a key of SuffixHeaderMapping.
-  /// Used to reduce the number of lookups into SuffixHeaderMapping.
-  int MaxSuffixComponents = 0;
+  /// Suffixes (one or more components of a path) mapped to canonical paths,
+  /// as a trie of their components from last to first. A header is matched
+  /// in one walk from its last component, which for most headers ends at the
+  /// root.
+  struct SuffixNode {
+    /// Indexes of the children in SuffixNodes, by path component.
+    llvm::StringMap<unsigned> Children;
+    /// Empty unless a suffix ends here.
+    std::string CanonicalPath;
+  };
+  /// The root is SuffixNodes[0].
+  std::vector<SuffixNode> SuffixNodes;
   /// A map from fully qualified symbol names to header names.
   llvm::StringMap<std::string> SymbolMapping;
 };
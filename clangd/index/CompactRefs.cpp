@@ -0,0 +1,138 @@
+//===--- CompactRefs.cpp - Compressed storage of refs ---------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The refs of a symbol are encoded as:
+//   NumFiles
+//   for each file: FileIndex NumRefs
+//     for each ref: (StartLine - previous StartLine) StartColumn
+//                   ((EndLine - StartLine) << 3 | Kind) EndColumn
+// Every number is a varint: 7 bits per byte, the high bit is set if more bytes
+// follow. The previous StartLine is 0 for the first ref of a file.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompactRefs.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/StringSaver.h"
+#include <tuple>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+constexpr uint8_t More = 1 << 7;
+// RefKind is a combination of 3 flags.
+constexpr unsigned KindBits = 3;
+
+void writeVar(uint32_t I, std::vector<uint8_t> &Out) {
+  while (I >= More) {
+    Out.push_back(I | More);
+    I >>= 7;
+  }
+  Out.push_back(I);
+}
+
+uint32_t readVar(const uint8_t *&P) {
+  uint32_t Val = 0;
+  for (unsigned Shift = 0;; Shift += 7) {
+    uint8_t B = *P++;
+    Val |= uint32_t(B & ~More) << Shift;
+    if (!(B & More))
+      return Val;
+  }
+}
+
+} // namespace
+
+CompactRefs::CompactRefs(const RefSlab &Slab) : NumRefs(Slab.numRefs()) {
+  StringMap<uint32_t> FileIndexes;
+  StringSaver Strings(Arena);
+  auto FileIndex = [&](StringRef URI) {
+    auto R = FileIndexes.try_emplace(URI, Files.size());
+    if (R.second)
+      Files.push_back(Strings.save(URI).data());
+    return R.first->second;
+  };
+
+  std::vector<std::pair<uint32_t, const Ref *>> SymbolRefs;
+  std::vector<std::pair<SymbolID, uint32_t>> SymbolOffsets;
+  SymbolOffsets.reserve(Slab.size());
+  for (const auto &Sym : Slab) {
+    SymbolOffsets.emplace_back(Sym.first, Data.size());
+    SymbolRefs.clear();
+    for (const Ref &R : Sym.second)
+      SymbolRefs.emplace_back(FileIndex(R.Location.FileURI), &R);
+    llvm::sort(SymbolRefs, [](const std::pair<uint32_t, const Ref *> &L,
+                              const std::pair<uint32_t, const Ref *> &R) {
+      return std::tie(L.first, L.second->Location.Start) <
+             std::tie(R.first, R.second->Location.Start);
+    });
+
+    unsigned NumFiles = 0;
+    for (size_t I = 0; I < SymbolRefs.size(); ++I)
+      if (I == 0 || SymbolRefs[I].first != SymbolRefs[I - 1].first)
+        ++NumFiles;
+    writeVar(NumFiles, Data);
+    for (size_t Begin = 0, End; Begin < SymbolRefs.size(); Begin = End) {
+      uint32_t File = SymbolRefs[Begin].first;
+      End = Begin + 1;
+      while (End < SymbolRefs.size() && SymbolRefs[End].first == File)
+        ++End;
+      writeVar(File, Data);
+      writeVar(End - Begin, Data);
+      uint32_t Line = 0;
+      for (size_t I = Begin; I < End; ++I) {
+        const SymbolLocation &Loc = SymbolRefs[I].second->Location;
+        writeVar(Loc.Start.line() - Line, Data);
+        writeVar(Loc.Start.column(), Data);
+        // Lines are clamped independently, so an end may precede its start.
+        uint32_t Lines = Loc.End.line() > Loc.Start.line()
+                             ? Loc.End.line() - Loc.Start.line()
+                             : 0;
+        writeVar(Lines << KindBits |
+                     static_cast<uint8_t>(SymbolRefs[I].second->Kind),
+                 Data);
+        writeVar(Loc.End.column(), Data);
+        Line = Loc.Start.line();
+      }
+    }
+  }
+  Offsets = SymbolIDMap<uint32_t>(std::move(SymbolOffsets));
+  Data.shrink_to_fit();
+  Files.shrink_to_fit();
+}
+
+void CompactRefs::refs(const SymbolID &ID, RefKind Filter,
+                       function_ref<void(const Ref &)> Callback) const {
+  const uint32_t *Offset = Offsets.find(ID);
+  if (!Offset)
+    return;
+  const uint8_t *P = Data.data() + *Offset;
+  Ref R;
+  for (uint32_t NumFiles = readVar(P); NumFiles > 0; --NumFiles) {
+    R.Location.FileURI = Files[readVar(P)];
+    uint32_t Line = 0;
+    for (uint32_t NumRefs = readVar(P); NumRefs > 0; --NumRefs) {
+      Line += readVar(P);
+      R.Location.Start.setLine(Line);
+      R.Location.Start.setColumn(readVar(P));
+      uint32_t LinesAndKind = readVar(P);
+      R.Location.End.setLine(Line + (LinesAndKind >> KindBits));
+      R.Location.End.setColumn(readVar(P));
+      R.Kind = static_cast<RefKind>(LinesAndKind & ((1 << KindBits) - 1));
+      if (static_cast<int>(Filter & R.Kind))
+        Callback(R);
+    }
+  }
+}
+
+} // namespace clangd
+} // namespace clang
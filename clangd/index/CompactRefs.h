@@ -0,0 +1,62 @@
+//===--- CompactRefs.h - Compressed storage of refs --------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_COMPACTREFS_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_COMPACTREFS_H
+
+#include "Index.h"
+#include "SymbolIDMap.h"
+#include "llvm/Support/Allocator.h"
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// An immutable set of refs, encoded in a fraction of the memory of a RefSlab,
+/// where each Ref takes 24 bytes:
+///  - file URIs are replaced by indexes into a table of unique URIs;
+///  - the refs of a symbol are grouped by file, and sorted by position so that
+///    their lines can be delta-encoded;
+///  - all numbers are variable-length, so most refs take 4 or 5 bytes.
+/// Refs are decoded when they are read, in an unspecified order.
+class CompactRefs {
+public:
+  CompactRefs() = default;
+  /// Encodes the refs of \p Slab, the file URIs are copied.
+  explicit CompactRefs(const RefSlab &Slab);
+  CompactRefs(CompactRefs &&) = default;
+  CompactRefs &operator=(CompactRefs &&) = default;
+
+  /// Calls \p Callback on each ref of \p ID whose kind is in \p Filter. The
+  /// refs are only valid during the callback.
+  void refs(const SymbolID &ID, RefKind Filter,
+            llvm::function_ref<void(const Ref &)> Callback) const;
+
+  /// Returns the number of symbols with refs.
+  size_t size() const { return Offsets.size(); }
+  size_t numRefs() const { return NumRefs; }
+  size_t bytes() const {
+    return sizeof(*this) + Arena.getTotalMemory() +
+           Files.capacity() * sizeof(const char *) + Offsets.getMemorySize() +
+           Data.capacity();
+  }
+
+private:
+  llvm::BumpPtrAllocator Arena; // Owns the file URIs.
+  std::vector<const char *> Files;
+  // Where the refs of each symbol start in Data.
+  SymbolIDMap<uint32_t> Offsets;
+  std::vector<uint8_t> Data;
+  size_t NumRefs = 0;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_COMPACTREFS_H
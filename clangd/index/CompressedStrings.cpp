@@ -0,0 +1,220 @@
+//===--- CompressedStrings.cpp - Block-compressed string array ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The serialized strings are:
+//   NumStrings
+//   for each block: Offset UncompressedSize
+//   the blocks
+// The numbers are little-endian 32 bit ints. Offsets are relative to the first
+// block, which ends where the next one starts. A block holds StringsPerBlock
+// null-terminated strings (fewer for the last one). It is compressed with zlib
+// unless UncompressedSize is 0.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CompressedStrings.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
+#include <algorithm>
+#include <mutex>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// The number of decompressed blocks kept in memory. Readers of cold strings,
+// like hover and the final completion items, come back to the same few
+// symbols.
+constexpr size_t CachedBlocks = 8;
+constexpr size_t EntrySize = 2 * sizeof(uint32_t);
+
+Error makeError(const Twine &Msg) {
+  return make_error<StringError>(Msg, inconvertibleErrorCode());
+}
+
+void write32(uint32_t I, std::string &Out) {
+  char Buf[4];
+  support::endian::write32le(Buf, I);
+  Out.append(Buf, sizeof(Buf));
+}
+
+uint32_t read32(StringRef Data, size_t Offset) {
+  return support::endian::read32le(Data.data() + Offset);
+}
+
+size_t numBlocks(size_t NumStrings) {
+  return (NumStrings + CompressedStrings::StringsPerBlock - 1) /
+         CompressedStrings::StringsPerBlock;
+}
+
+} // namespace
+
+struct CompressedStrings::Block {
+  // Owns the strings of a compressed block, the strings of an uncompressed one
+  // point into the serialized data.
+  SmallVector<char, 0> Chars;
+  std::vector<StringRef> Strings;
+};
+
+// The most recently used blocks, most recent first.
+class CompressedStrings::BlockCache {
+public:
+  std::shared_ptr<const Block> get(size_t Index) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    for (auto It = Entries.begin(); It != Entries.end(); ++It) {
+      if (It->first != Index)
+        continue;
+      std::rotate(Entries.begin(), It, It + 1);
+      return Entries.front().second;
+    }
+    return nullptr;
+  }
+
+  void put(size_t Index, std::shared_ptr<const Block> B) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    if (Entries.size() == CachedBlocks)
+      Entries.pop_back();
+    Entries.emplace(Entries.begin(), Index, std::move(B));
+  }
+
+  size_t bytes() {
+    std::lock_guard<std::mutex> Lock(Mu);
+    size_t Bytes = 0;
+    for (const auto &Entry : Entries)
+      Bytes += sizeof(Block) + Entry.second->Chars.capacity() +
+               Entry.second->Strings.capacity() * sizeof(StringRef);
+    return Bytes;
+  }
+
+private:
+  std::mutex Mu;
+  std::vector<std::pair<size_t, std::shared_ptr<const Block>>> Entries;
+};
+
+CompressedStrings::CompressedStrings() : Cache(new BlockCache) {}
+
+CompressedStrings::CompressedStrings(ArrayRef<StringRef> Strings)
+    : NumStrings(Strings.size()), Cache(new BlockCache) {
+  std::string Header, Blocks;
+  write32(Strings.size(), Header);
+  for (size_t Begin = 0; Begin < Strings.size(); Begin += StringsPerBlock) {
+    std::string Raw;
+    for (StringRef S : Strings.slice(Begin).take_front(StringsPerBlock)) {
+      assert(S.find('\0') == StringRef::npos && "strings can't contain nulls");
+      Raw.append(S);
+      Raw.push_back(0);
+    }
+    write32(Blocks.size(), Header);
+    SmallString<0> Compressed;
+    bool IsCompressed = false;
+    if (zlib::isAvailable()) {
+      if (Error E = zlib::compress(Raw, Compressed))
+        consumeError(std::move(E));
+      else // Tiny blocks may not shrink.
+        IsCompressed = Compressed.size() < Raw.size();
+    }
+    if (IsCompressed) {
+      write32(Raw.size(), Header);
+      Blocks.append(Compressed.begin(), Compressed.end());
+    } else {
+      write32(0, Header);
+      Blocks.append(Raw);
+    }
+  }
+  Storage.reserve(Header.size() + Blocks.size());
+  Storage.assign(Header.begin(), Header.end());
+  Storage.insert(Storage.end(), Blocks.begin(), Blocks.end());
+  Data = StringRef(Storage.data(), Storage.size());
+}
+
+CompressedStrings::CompressedStrings(CompressedStrings &&) = default;
+CompressedStrings &CompressedStrings::
+operator=(CompressedStrings &&) = default;
+CompressedStrings::~CompressedStrings() = default;
+
+Expected<CompressedStrings> CompressedStrings::fromData(StringRef Data,
+                                                        bool CopyData) {
+  if (Data.size() < sizeof(uint32_t))
+    return makeError("Truncated compressed strings");
+  CompressedStrings Result;
+  Result.NumStrings = read32(Data, 0);
+  size_t NumBlocks = numBlocks(Result.NumStrings);
+  size_t HeaderSize = sizeof(uint32_t) + NumBlocks * EntrySize;
+  if (Data.size() < HeaderSize)
+    return makeError("Truncated compressed strings");
+  uint32_t Previous = 0;
+  for (size_t I = 0; I < NumBlocks; ++I) {
+    uint32_t Offset = read32(Data, sizeof(uint32_t) + I * EntrySize);
+    if (Offset < Previous || Offset > Data.size() - HeaderSize)
+      return makeError("Bad compressed strings: invalid block offset");
+    Previous = Offset;
+  }
+  if (CopyData) {
+    Result.Storage.assign(Data.begin(), Data.end());
+    Data = StringRef(Result.Storage.data(), Result.Storage.size());
+  }
+  Result.Data = Data;
+  return std::move(Result);
+}
+
+StringRef CompressedStrings::blockData(size_t Index,
+                                       uint32_t &UncompressedSize) const {
+  size_t NumBlocks = numBlocks(NumStrings);
+  size_t HeaderSize = sizeof(uint32_t) + NumBlocks * EntrySize;
+  size_t Entry = sizeof(uint32_t) + Index * EntrySize;
+  size_t Begin = HeaderSize + read32(Data, Entry);
+  size_t End = Index + 1 == NumBlocks
+                   ? Data.size()
+                   : HeaderSize + read32(Data, Entry + EntrySize);
+  UncompressedSize = read32(Data, Entry + sizeof(uint32_t));
+  return Data.slice(Begin, End);
+}
+
+std::shared_ptr<const CompressedStrings::Block>
+CompressedStrings::block(size_t Index) const {
+  if (auto Cached = Cache->get(Index))
+    return Cached;
+  // Decompress without holding the lock, concurrent readers of the same block
+  // may both decompress it.
+  auto Result = std::make_shared<Block>();
+  uint32_t UncompressedSize;
+  StringRef Raw = blockData(Index, UncompressedSize);
+  if (UncompressedSize) {
+    if (Error E = zlib::uncompress(Raw, Result->Chars, UncompressedSize)) {
+      consumeError(std::move(E));
+      Result->Chars.clear();
+    }
+    Raw = StringRef(Result->Chars.data(), Result->Chars.size());
+  }
+  while (!Raw.empty()) {
+    size_t Len = Raw.find('\0');
+    Result->Strings.push_back(Raw.take_front(Len));
+    Raw = Raw.drop_front(std::min(Raw.size(), Len + 1));
+  }
+  Cache->put(Index, Result);
+  return Result;
+}
+
+std::string CompressedStrings::get(size_t Index) const {
+  assert(Index < NumStrings && "string index out of range");
+  auto B = block(Index / StringsPerBlock);
+  size_t InBlock = Index % StringsPerBlock;
+  // A corrupt block may hold fewer strings.
+  return InBlock < B->Strings.size() ? B->Strings[InBlock].str() : "";
+}
+
+size_t CompressedStrings::bytes() const {
+  return sizeof(*this) + Storage.capacity() + (Cache ? Cache->bytes() : 0);
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,74 @@
+//===--- CompressedStrings.h - Block-compressed string array ----*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_COMPRESSEDSTRINGS_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_COMPRESSEDSTRINGS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// An immutable array of strings that are rarely read, e.g. the documentation
+/// of the symbols of an index. Consecutive strings are compressed together in
+/// blocks, which compress much better than single strings, and a few recently
+/// decompressed blocks are cached.
+///
+/// The strings are stored in their serialized form, which may be borrowed from
+/// a memory-mapped index file.
+class CompressedStrings {
+public:
+  /// The number of strings compressed together.
+  static constexpr unsigned StringsPerBlock = 64;
+
+  CompressedStrings();
+  /// Compresses \p Strings, which must not contain null characters. The
+  /// blocks are stored uncompressed if zlib isn't available.
+  explicit CompressedStrings(llvm::ArrayRef<llvm::StringRef> Strings);
+  CompressedStrings(CompressedStrings &&);
+  CompressedStrings &operator=(CompressedStrings &&);
+  ~CompressedStrings();
+
+  /// Reads strings serialized by data(). If \p CopyData is false, \p Data
+  /// must outlive the result.
+  static llvm::Expected<CompressedStrings> fromData(llvm::StringRef Data,
+                                                    bool CopyData = true);
+  /// The serialized strings.
+  llvm::StringRef data() const { return Data; }
+
+  size_t size() const { return NumStrings; }
+  /// Returns the string at \p Index. Safe to call concurrently.
+  std::string get(size_t Index) const;
+
+  /// The memory used by the compressed strings and the cached blocks.
+  size_t bytes() const;
+
+private:
+  struct Block;
+  class BlockCache;
+
+  std::shared_ptr<const Block> block(size_t Index) const;
+  llvm::StringRef blockData(size_t Index, uint32_t &UncompressedSize) const;
+
+  // Owns Data, unless it is borrowed.
+  std::vector<char> Storage;
+  llvm::StringRef Data;
+  size_t NumStrings = 0;
+  std::unique_ptr<BlockCache> Cache;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_COMPRESSEDSTRINGS_H
@@ -11,6 +11,8 @@
 #include "ClangdUnit.h"
 #include "Logger.h"
 #include "SymbolCollector.h"
+#include "Trace.h"
+#include "index/Background.h"
 #include "index/Index.h"
 #include "index/MemIndex.h"
 #include "index/Merge.h"
@@ -21,7 +23,10 @@
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
 #include <memory>
 
 using namespace llvm;
@@ -30,7 +35,8 @@ namespace clangd {
 
 static std::pair<SymbolSlab, RefSlab>
 indexSymbols(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
-             ArrayRef<Decl *> DeclsToIndex, bool IsIndexMainAST) {
+             ArrayRef<Decl *> DeclsToIndex, bool IsIndexMainAST,
+             decltype(SymbolCollector::Options::FileFilter) FileFilter) {
   SymbolCollector::Options CollectorOpts;
   // FIXME(ioeric): we might also want to collect include headers. We would need
   // to make sure all includes are canonicalized (with CanonicalIncludes), which
@@ -40,6 +46,9 @@ indexSymbols(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
   CollectorOpts.CollectIncludePath = false;
   CollectorOpts.CountReferences = false;
   CollectorOpts.Origin = SymbolOrigin::Dynamic;
+  CollectorOpts.Strings = &StringPool::global();
+  CollectorOpts.SkipUnusedCompletionInfo = true;
+  CollectorOpts.FileFilter = std::move(FileFilter);
 
   index::IndexingOptions IndexOpts;
   // We only need declarations, because we don't count references.
@@ -75,105 +84,211 @@ indexSymbols(ASTContext &AST, std::shared_ptr<Preprocessor> PP,
 std::pair<SymbolSlab, RefSlab> indexMainDecls(ParsedAST &AST) {
   return indexSymbols(AST.getASTContext(), AST.getPreprocessorPtr(),
                       AST.getLocalTopLevelDecls(),
-                      /*IsIndexMainAST=*/true);
+                      /*IsIndexMainAST=*/true, /*FileFilter=*/nullptr);
 }
 
-SymbolSlab indexHeaderSymbols(ASTContext &AST,
-                              std::shared_ptr<Preprocessor> PP) {
+SymbolSlab indexHeaderSymbols(
+    ASTContext &AST, std::shared_ptr<Preprocessor> PP,
+    decltype(SymbolCollector::Options::FileFilter) FileFilter) {
   std::vector<Decl *> DeclsToIndex(
       AST.getTranslationUnitDecl()->decls().begin(),
       AST.getTranslationUnitDecl()->decls().end());
   return indexSymbols(AST, std::move(PP), DeclsToIndex,
-                      /*IsIndexMainAST=*/false)
+                      /*IsIndexMainAST=*/false, std::move(FileFilter))
       .first;
 }
 
+// Accepts the main file, and the headers \p IsIndexed rejects. Sets
+// \p Skipped if any header was rejected.
+static decltype(SymbolCollector::Options::FileFilter)
+unindexedHeaderFilter(const FileIndex::IndexedHeaderFn &IsIndexed,
+                      bool &Skipped) {
+  return [&IsIndexed, &Skipped](const SourceManager &SM, FileID FID) {
+    if (FID == SM.getMainFileID())
+      return true;
+    const auto *F = SM.getFileEntryForID(FID);
+    if (!F || F->getName().empty())
+      return true;
+    SmallString<128> AbsPath(F->getName());
+    if (SM.getFileManager().getVirtualFileSystem()->makeAbsolute(AbsPath))
+      return true;
+    sys::path::remove_dots(AbsPath, /*remove_dot_dot=*/true);
+    bool Invalid = false;
+    StringRef Content = SM.getBufferData(FID, &Invalid);
+    if (Invalid)
+      return true;
+    if (!IsIndexed(AbsPath, SHA1::hash({(const uint8_t *)Content.data(),
+                                        Content.size()})))
+      return true;
+    Skipped = true;
+    return false;
+  };
+}
+
+// Digests everything the symbols of a preamble depend on: the predefines
+// (which carry the -D flags), and the names and contents of all files read.
+// This includes the main file, whose buffer holds only the preamble here.
+static IndexFileIn::FileDigest preambleDigest(ASTContext &AST,
+                                              const Preprocessor &PP) {
+  const auto &SM = AST.getSourceManager();
+  std::vector<std::pair<StringRef, StringRef>> Files;
+  for (auto It = SM.fileinfo_begin(), End = SM.fileinfo_end(); It != End;
+       ++It) {
+    const llvm::MemoryBuffer *Buf = It->second->getRawBuffer();
+    Files.emplace_back(It->first->getName(),
+                       Buf ? Buf->getBuffer() : StringRef());
+  }
+  // The file table is hashed by pointer, its order isn't stable.
+  llvm::sort(Files);
+  SHA1 Hasher;
+  auto AddString = [&](StringRef S) {
+    uint32_t Size = S.size();
+    Hasher.update(ArrayRef<uint8_t>((const uint8_t *)&Size, sizeof(Size)));
+    Hasher.update(S);
+  };
+  AddString(PP.getPredefines());
+  for (const auto &File : Files) {
+    AddString(File.first);
+    AddString(File.second);
+  }
+  IndexFileIn::FileDigest Digest;
+  StringRef Result = Hasher.result();
+  std::copy(Result.begin(), Result.end(), Digest.begin());
+  return Digest;
+}
+
+// Removes the first element of V that is equal to X; V must contain X.
+template <typename VectorT, typename T>
+static void eraseOne(VectorT &V, const T &X) {
+  auto It = llvm::find(V, X);
+  assert(It != V.end() && "Erasing element that is not present");
+  V.erase(It);
+}
+
 void FileSymbols::update(PathRef Path, std::unique_ptr<SymbolSlab> Symbols,
                          std::unique_ptr<RefSlab> Refs) {
+  // Old slabs are released outside the lock, as destroying them may be slow.
+  std::shared_ptr<SymbolSlab> OldSymbols;
+  std::shared_ptr<RefSlab> OldRefs;
   std::lock_guard<std::mutex> Lock(Mutex);
-  if (!Symbols)
-    FileToSymbols.erase(Path);
-  else
+
+  auto SymbolsIt = FileToSymbols.find(Path);
+  if (SymbolsIt != FileToSymbols.end()) {
+    OldSymbols = std::move(SymbolsIt->second);
+    FileToSymbols.erase(SymbolsIt);
+    for (const auto &Sym : *OldSymbols) {
+      auto It = SymbolOccurrences.find(Sym.ID);
+      assert(It != SymbolOccurrences.end());
+      eraseOne(It->second, &Sym);
+      if (It->second.empty())
+        SymbolOccurrences.erase(It);
+      MergedSymbols.erase(Sym.ID);
+    }
+  }
+  if (Symbols) {
+    for (const auto &Sym : *Symbols) {
+      SymbolOccurrences[Sym.ID].push_back(&Sym);
+      MergedSymbols.erase(Sym.ID);
+    }
     FileToSymbols[Path] = std::move(Symbols);
-  if (!Refs)
-    FileToRefs.erase(Path);
-  else
+  }
+
+  auto RefsIt = FileToRefs.find(Path);
+  if (RefsIt != FileToRefs.end()) {
+    OldRefs = std::move(RefsIt->second);
+    FileToRefs.erase(RefsIt);
+    for (const auto &SymRefs : *OldRefs) {
+      auto It = RefOccurrences.find(SymRefs.first);
+      assert(It != RefOccurrences.end());
+      // Another slab may hold equal refs, find the range of this one.
+      auto Range = llvm::find_if(It->second, [&](ArrayRef<Ref> R) {
+        return R.data() == SymRefs.second.data() &&
+               R.size() == SymRefs.second.size();
+      });
+      assert(Range != It->second.end() && "Erasing refs that are not present");
+      It->second.erase(Range);
+      if (It->second.empty())
+        RefOccurrences.erase(It);
+      MergedRefs.erase(SymRefs.first);
+    }
+  }
+  if (Refs) {
+    for (const auto &SymRefs : *Refs) {
+      RefOccurrences[SymRefs.first].push_back(SymRefs.second);
+      MergedRefs.erase(SymRefs.first);
+    }
     FileToRefs[Path] = std::move(Refs);
+  }
 }
 
 std::unique_ptr<SymbolIndex>
 FileSymbols::buildIndex(IndexType Type, DuplicateHandling DuplicateHandle) {
   std::vector<std::shared_ptr<SymbolSlab>> SymbolSlabs;
   std::vector<std::shared_ptr<RefSlab>> RefSlabs;
+  std::vector<const Symbol *> AllSymbols;
+  DenseMap<SymbolID, ArrayRef<Ref>> AllRefs;
+  // Merge results used by this index, shared with FileSymbols.
+  std::vector<std::shared_ptr<const Symbol>> SymsStorage;
+  std::vector<std::shared_ptr<const std::vector<Ref>>> RefsStorage;
+  size_t StorageSize = 0;
   {
     std::lock_guard<std::mutex> Lock(Mutex);
     for (const auto &FileAndSymbols : FileToSymbols)
       SymbolSlabs.push_back(FileAndSymbols.second);
     for (const auto &FileAndRefs : FileToRefs)
       RefSlabs.push_back(FileAndRefs.second);
-  }
-  std::vector<const Symbol *> AllSymbols;
-  std::vector<Symbol> SymsStorage;
-  switch (DuplicateHandle) {
-  case DuplicateHandling::Merge: {
-    DenseMap<SymbolID, Symbol> Merged;
-    for (const auto &Slab : SymbolSlabs) {
-      for (const auto &Sym : *Slab) {
-        auto I = Merged.try_emplace(Sym.ID, Sym);
-        if (!I.second)
-          I.first->second = mergeSymbol(I.first->second, Sym);
+
+    AllSymbols.reserve(SymbolOccurrences.size());
+    for (const auto &Occurrences : SymbolOccurrences) {
+      const auto &Syms = Occurrences.second;
+      if (Syms.size() == 1 || DuplicateHandle == DuplicateHandling::PickOne) {
+        AllSymbols.push_back(Syms.front());
+        continue;
       }
+      // Only symbols whose sources changed since the last build are merged;
+      // the others reuse a previous result.
+      auto &Merged = MergedSymbols[Occurrences.first];
+      if (!Merged) {
+        Symbol S = *Syms.front();
+        for (const Symbol *Other : makeArrayRef(Syms).drop_front())
+          S = mergeSymbol(S, *Other);
+        // FIXME: aggregate symbol reference count based on references.
+        Merged = std::make_shared<const Symbol>(std::move(S));
+      }
+      AllSymbols.push_back(Merged.get());
+      SymsStorage.push_back(Merged);
     }
-    SymsStorage.reserve(Merged.size());
-    for (auto &Sym : Merged) {
-      SymsStorage.push_back(std::move(Sym.second));
-      AllSymbols.push_back(&SymsStorage.back());
-    }
-    // FIXME: aggregate symbol reference count based on references.
-    break;
-  }
-  case DuplicateHandling::PickOne: {
-    llvm::DenseSet<SymbolID> AddedSymbols;
-    for (const auto &Slab : SymbolSlabs)
-      for (const auto &Sym : *Slab)
-        if (AddedSymbols.insert(Sym.ID).second)
-          AllSymbols.push_back(&Sym);
-    break;
-  }
-  }
 
-  std::vector<Ref> RefsStorage; // Contiguous ranges for each SymbolID.
-  DenseMap<SymbolID, ArrayRef<Ref>> AllRefs;
-  {
-    DenseMap<SymbolID, SmallVector<Ref, 4>> MergedRefs;
-    size_t Count = 0;
-    for (const auto &RefSlab : RefSlabs)
-      for (const auto &Sym : *RefSlab) {
-        MergedRefs[Sym.first].append(Sym.second.begin(), Sym.second.end());
-        Count += Sym.second.size();
+    AllRefs.reserve(RefOccurrences.size());
+    for (const auto &Occurrences : RefOccurrences) {
+      const auto &Ranges = Occurrences.second;
+      // Refs of each slab are already sorted.
+      if (Ranges.size() == 1) {
+        AllRefs.try_emplace(Occurrences.first, Ranges.front());
+        continue;
+      }
+      auto &Merged = MergedRefs[Occurrences.first];
+      if (!Merged) {
+        std::vector<Ref> SymRefs;
+        for (ArrayRef<Ref> Range : Ranges)
+          SymRefs.insert(SymRefs.end(), Range.begin(), Range.end());
+        // Sorting isn't required, but yields more stable results over rebuilds.
+        llvm::sort(SymRefs);
+        Merged = std::make_shared<const std::vector<Ref>>(std::move(SymRefs));
       }
-    RefsStorage.reserve(Count);
-    AllRefs.reserve(MergedRefs.size());
-    for (auto &Sym : MergedRefs) {
-      auto &SymRefs = Sym.second;
-      // Sorting isn't required, but yields more stable results over rebuilds.
-      llvm::sort(SymRefs);
-      llvm::copy(SymRefs, back_inserter(RefsStorage));
-      AllRefs.try_emplace(
-          Sym.first,
-          ArrayRef<Ref>(&RefsStorage[RefsStorage.size() - SymRefs.size()],
-                        SymRefs.size()));
+      AllRefs.try_emplace(Occurrences.first, *Merged);
+      StorageSize += Merged->size() * sizeof(Ref);
+      RefsStorage.push_back(Merged);
     }
   }
 
-  size_t StorageSize =
-      RefsStorage.size() * sizeof(Ref) + SymsStorage.size() * sizeof(Symbol);
+  StorageSize += SymsStorage.size() * sizeof(Symbol);
   for (const auto &Slab : SymbolSlabs)
     StorageSize += Slab->bytes();
   for (const auto &RefSlab : RefSlabs)
     StorageSize += RefSlab->bytes();
 
-  // Index must keep the slabs and contiguous ranges alive.
+  // Index must keep the slabs and merge results alive.
   switch (Type) {
   case IndexType::Light:
     return llvm::make_unique<MemIndex>(
@@ -191,20 +306,56 @@ FileSymbols::buildIndex(IndexType Type, DuplicateHandling DuplicateHandle) {
   llvm_unreachable("Unknown clangd::IndexType");
 }
 
-FileIndex::FileIndex(bool UseDex)
+FileIndex::FileIndex(bool UseDex, PreambleStorageFn PreambleStorage)
     : MergedIndex(&MainFileIndex, &PreambleIndex), UseDex(UseDex),
+      PreambleStorage(std::move(PreambleStorage)),
       PreambleIndex(llvm::make_unique<MemIndex>()),
       MainFileIndex(llvm::make_unique<MemIndex>()) {}
 
+void FileIndex::profile(MemoryTree &MT) const {
+  PreambleIndex.profile(MT.child("preamble"));
+  MainFileIndex.profile(MT.child("main"));
+}
+
 void FileIndex::updatePreamble(PathRef Path, ASTContext &AST,
                                std::shared_ptr<Preprocessor> PP) {
-  auto Symbols = indexHeaderSymbols(AST, std::move(PP));
-  PreambleSymbols.update(Path,
-                         llvm::make_unique<SymbolSlab>(std::move(Symbols)),
+  BackgroundIndexStorage *Storage =
+      PreambleStorage ? PreambleStorage(Path) : nullptr;
+  std::unique_ptr<SymbolSlab> Symbols;
+  IndexFileIn::FileDigest Digest;
+  std::string ShardID;
+  if (Storage) {
+    Digest = preambleDigest(AST, *PP);
+    ShardID = "preamble." + toHex(Digest);
+    auto Shard = Storage->loadShard(ShardID);
+    if (Shard && Shard->Symbols && Shard->Digest && *Shard->Digest == Digest) {
+      vlog("Loaded preamble symbols of {0} from storage", Path);
+      Symbols = llvm::make_unique<SymbolSlab>(std::move(*Shard->Symbols));
+    }
+  }
+  if (!Symbols) {
+    bool Skipped = false;
+    Symbols = llvm::make_unique<SymbolSlab>(indexHeaderSymbols(
+        AST, PP,
+        IndexedHeaders ? unindexedHeaderFilter(IndexedHeaders, Skipped)
+                       : nullptr));
+    // A slab missing some headers is only valid while the other index has
+    // them, so it's not stored.
+    if (Storage && !Skipped) {
+      IndexFileOut Shard;
+      Shard.Symbols = Symbols.get();
+      Shard.Digest = &Digest;
+      if (auto Err = Storage->storeShard(ShardID, Shard))
+        elog("Failed to store preamble symbols of {0}: {1}", Path,
+             std::move(Err));
+    }
+  }
+  PreambleSymbols.update(Path, std::move(Symbols),
                          llvm::make_unique<RefSlab>());
   PreambleIndex.reset(
       PreambleSymbols.buildIndex(UseDex ? IndexType::Heavy : IndexType::Light,
                                  DuplicateHandling::PickOne));
+  trace::metric("DynamicIndexBytes", estimateMemoryUsage());
 }
 
 void FileIndex::updateMain(PathRef Path, ParsedAST &AST) {
@@ -214,6 +365,7 @@ void FileIndex::updateMain(PathRef Path, ParsedAST &AST) {
       llvm::make_unique<RefSlab>(std::move(Contents.second)));
   MainFileIndex.reset(
       MainFileSymbols.buildIndex(IndexType::Light, DuplicateHandling::PickOne));
+  trace::metric("DynamicIndexBytes", estimateMemoryUsage());
 }
 
 } // namespace clangd
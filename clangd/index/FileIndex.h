@@ -20,11 +20,15 @@
 #include "Index.h"
 #include "MemIndex.h"
 #include "Merge.h"
+#include "Serialization.h"
+#include "SymbolCollector.h"
 #include "clang/Lex/Preprocessor.h"
+#include <functional>
 #include <memory>
 
 namespace clang {
 namespace clangd {
+class BackgroundIndexStorage;
 
 /// Select between in-memory index implementations, which have tradeoffs.
 enum class IndexType {
@@ -55,6 +59,12 @@ enum class DuplicateHandling {
 ///
 /// The snapshot semantics keeps critical sections minimal since we only need
 /// locking when we swap or obtain references to snapshots.
+///
+/// The merged view of all files is maintained incrementally: update() only
+/// touches the symbols and refs of the file being replaced, and buildIndex()
+/// only re-merges symbols and refs that changed since the previous build.
+/// Merged results are immutable once built and shared with the indexes, so
+/// indexes built earlier stay valid after later updates.
 class FileSymbols {
 public:
   /// Updates all symbols and refs in a file.
@@ -74,13 +84,45 @@ private:
   llvm::StringMap<std::shared_ptr<SymbolSlab>> FileToSymbols;
   /// Stores the latest ref snapshots for all active files.
   llvm::StringMap<std::shared_ptr<RefSlab>> FileToRefs;
+
+  /// All occurrences of each symbol in FileToSymbols, in order of update.
+  /// Pointers are owned by the slabs in FileToSymbols.
+  llvm::DenseMap<SymbolID, llvm::SmallVector<const Symbol *, 1>>
+      SymbolOccurrences;
+  /// All ref ranges of each symbol in FileToRefs, in order of update.
+  /// Ranges are owned by the slabs in FileToRefs.
+  llvm::DenseMap<SymbolID, llvm::SmallVector<llvm::ArrayRef<Ref>, 1>>
+      RefOccurrences;
+  /// Merge results for symbols that occur in more than one file. Entries are
+  /// dropped by update() when any of their sources change, and recomputed by
+  /// the next buildIndex(). Indexes share ownership of the entries they use.
+  llvm::DenseMap<SymbolID, std::shared_ptr<const Symbol>> MergedSymbols;
+  /// Sorted concatenation of refs for symbols referenced from more than one
+  /// file. Invalidated in the same way as MergedSymbols.
+  llvm::DenseMap<SymbolID, std::shared_ptr<const std::vector<Ref>>> MergedRefs;
 };
 
 /// This manages symbols from files and an in-memory index on all symbols.
 /// FIXME: Expose an interface to remove files that are closed.
 class FileIndex : public MergedIndex {
 public:
-  FileIndex(bool UseDex = true);
+  /// Returns the storage for preamble symbols of a main file, or nullptr.
+  using PreambleStorageFn = std::function<BackgroundIndexStorage *(PathRef)>;
+
+  /// If \p PreambleStorage is set, preamble symbols are stored keyed by a
+  /// digest of the preamble, and loaded instead of indexing a preamble again.
+  FileIndex(bool UseDex = true, PreambleStorageFn PreambleStorage = nullptr);
+
+  /// Returns whether another index has the symbols of the header with absolute
+  /// path \p AbsPath and contents digest \p Digest.
+  using IndexedHeaderFn = std::function<bool(
+      llvm::StringRef AbsPath, const IndexFileIn::FileDigest &Digest)>;
+  /// Preamble symbols of the headers \p IsIndexed accepts are not collected,
+  /// the index this is merged with provides them. Must be called before the
+  /// first update.
+  void skipIndexedHeaders(IndexedHeaderFn IsIndexed) {
+    IndexedHeaders = std::move(IsIndexed);
+  }
 
   /// Update preamble symbols of file \p Path with all declarations in \p AST
   /// and macros in \p PP.
@@ -91,8 +133,12 @@ public:
   /// `indexMainDecls`.
   void updateMain(PathRef Path, ParsedAST &AST);
 
+  void profile(MemoryTree &MT) const override;
+
 private:
   bool UseDex; // FIXME: this should be always on.
+  PreambleStorageFn PreambleStorage;
+  IndexedHeaderFn IndexedHeaders;
 
   // Contains information from each file's preamble only.
   // These are large, but update fairly infrequently (preambles are stable).
@@ -124,9 +170,11 @@ private:
 std::pair<SymbolSlab, RefSlab> indexMainDecls(ParsedAST &AST);
 
 /// Idex declarations from \p AST and macros from \p PP that are declared in
-/// included headers.
-SymbolSlab indexHeaderSymbols(ASTContext &AST,
-                              std::shared_ptr<Preprocessor> PP);
+/// included headers. If \p FileFilter is set, only the files it accepts are
+/// indexed.
+SymbolSlab indexHeaderSymbols(
+    ASTContext &AST, std::shared_ptr<Preprocessor> PP,
+    decltype(SymbolCollector::Options::FileFilter) FileFilter = nullptr);
 
 } // namespace clangd
 } // namespace clang
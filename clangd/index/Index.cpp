@@ -8,12 +8,18 @@
 //===----------------------------------------------------------------------===//
 
 #include "Index.h"
+#include "FuzzyMatch.h"
 #include "Logger.h"
+#include "Merge.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/SHA1.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <iterator>
+#include <thread>
 
 using namespace llvm;
 namespace clang {
@@ -71,6 +77,21 @@ Expected<SymbolID> SymbolID::fromStr(StringRef Str) {
   return fromRaw(fromHex(Str));
 }
 
+void SymbolIDCollisionDetector::record(const SymbolID &ID, StringRef USR) {
+  uint64_t Hash = xxHash64(USR);
+  std::lock_guard<std::mutex> Lock(Mu);
+  auto R = USRHashes.try_emplace(ID, Hash);
+  if (!R.second && R.first->second != Hash)
+    Collisions.insert(ID);
+}
+
+std::vector<SymbolID> SymbolIDCollisionDetector::collisions() const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  std::vector<SymbolID> Result(Collisions.begin(), Collisions.end());
+  llvm::sort(Result);
+  return Result;
+}
+
 raw_ostream &operator<<(raw_ostream &OS, SymbolOrigin O) {
   if (O == SymbolOrigin::Unknown)
     return OS << "unknown";
@@ -122,24 +143,87 @@ void SymbolSlab::Builder::insert(const Symbol &S) {
   auto R = SymbolIndex.try_emplace(S.ID, Symbols.size());
   if (R.second) {
     Symbols.push_back(S);
-    own(Symbols.back(), UniqueStrings);
+    Owned.push_back(true);
+    if (CopyStrings)
+      own(Symbols.back(), UniqueStrings);
   } else {
     auto &Copy = Symbols[R.first->second] = S;
-    own(Copy, UniqueStrings);
+    Owned[R.first->second] = true;
+    if (CopyStrings)
+      own(Copy, UniqueStrings);
   }
 }
 
+void SymbolSlab::Builder::insert(SymbolSlab &&Slab) {
+  Symbols.reserve(Symbols.size() + Slab.Symbols.size());
+  for (Symbol &S : Slab.Symbols) {
+    auto R = SymbolIndex.try_emplace(S.ID, Symbols.size());
+    if (R.second) {
+      Symbols.push_back(std::move(S));
+      Owned.push_back(false);
+    } else {
+      Symbols[R.first->second] = std::move(S);
+      Owned[R.first->second] = false;
+    }
+  }
+  AdoptedArenas.push_back(std::move(Slab.Arena));
+  for (auto &A : Slab.AdoptedArenas)
+    AdoptedArenas.push_back(std::move(A));
+  AdoptedStrings.push_back(std::move(Slab.Strings));
+  for (auto &L : Slab.AdoptedStrings)
+    AdoptedStrings.push_back(std::move(L));
+  Slab = SymbolSlab();
+}
+
+void SymbolSlab::Builder::merge(const Symbol &S) {
+  auto It = SymbolIndex.find(S.ID);
+  if (It == SymbolIndex.end())
+    return insert(S);
+  if (!CopyStrings) {
+    Symbols[It->second] = mergeSymbol(Symbols[It->second], S);
+    return;
+  }
+  // The existing symbol's strings are already owned, so only copy those of S.
+  Symbol Copy = S;
+  own(Copy, UniqueStrings);
+  Symbols[It->second] = mergeSymbol(Symbols[It->second], Copy);
+  // The result may mix adopted strings with ones in Arena.
+  Owned[It->second] = true;
+}
+
 SymbolSlab SymbolSlab::Builder::build() && {
   Symbols = {Symbols.begin(), Symbols.end()}; // Force shrink-to-fit.
-  // Sort symbols so the slab can binary search over them.
-  llvm::sort(Symbols,
-             [](const Symbol &L, const Symbol &R) { return L.ID < R.ID; });
+  if (!CopyStrings) {
+    sortSymbols();
+    return SymbolSlab(std::move(Arena), std::move(Symbols), {},
+                      std::move(AdoptedArenas), std::move(AdoptedStrings));
+  }
+  if (Pool) {
+    DenseMap<StringRef, StringRef> Pooled;
+    for (auto &S : Symbols)
+      visitStrings(S, [&](StringRef &V) { Pooled.try_emplace(V); });
+    auto Lease = Pool->intern(Pooled);
+    for (auto &S : Symbols)
+      visitStrings(S, [&](StringRef &V) { V = Pooled.lookup(V); });
+    sortSymbols();
+    return SymbolSlab(BumpPtrAllocator(), std::move(Symbols), std::move(Lease));
+  }
   // We may have unused strings from overwritten symbols. Build a new arena.
+  // Symbols of adopted slabs keep pointing into the adopted storage.
   BumpPtrAllocator NewArena;
   UniqueStringSaver Strings(NewArena);
-  for (auto &S : Symbols)
-    own(S, Strings);
-  return SymbolSlab(std::move(NewArena), std::move(Symbols));
+  for (size_t I = 0; I < Symbols.size(); ++I)
+    if (Owned[I])
+      own(Symbols[I], Strings);
+  sortSymbols();
+  return SymbolSlab(std::move(NewArena), std::move(Symbols), {},
+                    std::move(AdoptedArenas), std::move(AdoptedStrings));
+}
+
+void SymbolSlab::Builder::sortSymbols() {
+  // Sort symbols so the slab can binary search over them.
+  llvm::sort(Symbols,
+             [](const Symbol &L, const Symbol &R) { return L.ID < R.ID; });
 }
 
 raw_ostream &operator<<(raw_ostream &OS, RefKind K) {
@@ -165,11 +249,26 @@ raw_ostream &operator<<(raw_ostream &OS, const Ref &R) {
 void RefSlab::Builder::insert(const SymbolID &ID, const Ref &S) {
   auto &M = Refs[ID];
   M.push_back(S);
-  M.back().Location.FileURI =
-      UniqueStrings.save(M.back().Location.FileURI).data();
+  if (CopyStrings)
+    M.back().Location.FileURI =
+        UniqueStrings.save(M.back().Location.FileURI).data();
 }
 
 RefSlab RefSlab::Builder::build() && {
+  // Pooled file URIs replace the ones on the arena, which is then dropped.
+  BumpPtrAllocator PoolArena;
+  StringPool::Lease Lease;
+  if (Pool) {
+    DenseMap<StringRef, StringRef> Pooled;
+    for (auto &Sym : Refs)
+      for (const Ref &R : Sym.second)
+        Pooled.try_emplace(R.Location.FileURI);
+    Lease = Pool->intern(Pooled);
+    for (auto &Sym : Refs)
+      for (Ref &R : Sym.second)
+        R.Location.FileURI = Pooled.lookup(R.Location.FileURI).data();
+  }
+  BumpPtrAllocator &RefArena = Pool ? PoolArena : Arena;
   // We can reuse the arena, as it only has unique strings and we need them all.
   // Reallocate refs on the arena to reduce waste and indirections when reading.
   std::vector<std::pair<SymbolID, ArrayRef<Ref>>> Result;
@@ -182,25 +281,102 @@ RefSlab RefSlab::Builder::build() && {
     SymRefs.erase(std::unique(SymRefs.begin(), SymRefs.end()), SymRefs.end());
 
     NumRefs += SymRefs.size();
-    auto *Array = Arena.Allocate<Ref>(SymRefs.size());
+    auto *Array = RefArena.Allocate<Ref>(SymRefs.size());
     std::uninitialized_copy(SymRefs.begin(), SymRefs.end(), Array);
     Result.emplace_back(Sym.first, ArrayRef<Ref>(Array, SymRefs.size()));
   }
-  return RefSlab(std::move(Result), std::move(Arena), NumRefs);
+  return RefSlab(std::move(Result), std::move(RefArena), NumRefs,
+                 std::move(Lease));
 }
 
+// Readers of a SwapIndex only write to their thread's slot: they count
+// themselves in the current epoch, then load the index. reset() swaps the
+// index, and waits for the readers of both epochs to leave before destroying
+// the old one. It switches epochs before waiting for one, so that readers
+// arriving meanwhile count in the other epoch and can't hold it back forever.
+static unsigned readerSlot() {
+  static std::atomic<unsigned> NextSlot = {0};
+  static thread_local unsigned Slot = NextSlot++;
+  return Slot;
+}
+
+class SwapIndex::Snapshot {
+public:
+  Snapshot(const SwapIndex &S)
+      : Slot(S.Slots[readerSlot() % NumSlots]), Epoch(S.Epoch.load()) {
+    Slot.Readers[Epoch].fetch_add(1);
+    Index = S.Current.load();
+  }
+  ~Snapshot() { Slot.Readers[Epoch].fetch_sub(1, std::memory_order_release); }
+
+  const SymbolIndex *operator->() const { return Index; }
+
+private:
+  ReaderSlot &Slot;
+  unsigned Epoch;
+  const SymbolIndex *Index;
+};
+
 void SwapIndex::reset(std::unique_ptr<SymbolIndex> Index) {
-  // Keep the old index alive, so we don't destroy it under lock (may be slow).
-  std::shared_ptr<SymbolIndex> Pin;
+  std::unique_ptr<SymbolIndex> Old;
   {
-    std::lock_guard<std::mutex> Lock(Mutex);
-    Pin = std::move(this->Index);
-    this->Index = std::move(Index);
+    std::lock_guard<std::mutex> Lock(WriterMutex);
+    Old.reset(Current.exchange(Index.release()));
+    for (int Round = 0; Round < 2; ++Round) {
+      unsigned Drained = Epoch.load();
+      Epoch.store(Drained ^ 1);
+      // Readers stay for a single call, and reset() is rare (the index is
+      // rebuilt or reloaded), so spinning is cheaper than having every reader
+      // notify a condition variable when it leaves.
+      for (const ReaderSlot &S : Slots)
+        while (S.Readers[Drained].load() != 0)
+          std::this_thread::yield();
+    }
+  }
+  // Destroying the old index may be slow, so it is done outside the lock.
+  Old.reset();
+  OnIndexChanged.broadcast(this);
+}
+
+ArrayRef<Ref> filterRefs(ArrayRef<Ref> Refs, RefKind Filter,
+                         std::vector<Ref> &Storage) {
+  auto Matches = [&](const Ref &R) {
+    return static_cast<bool>(Filter & R.Kind);
+  };
+  if (std::all_of(Refs.begin(), Refs.end(), Matches))
+    return Refs;
+  Storage.clear();
+  std::copy_if(Refs.begin(), Refs.end(), std::back_inserter(Storage), Matches);
+  return Storage;
+}
+
+void SymbolIndex::refsBySymbol(
+    const RefsRequest &Req,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> Callback) const {
+  // Refs passed to the refs() callback may not outlive it, so they are copied.
+  RefSlab::Builder Results;
+  for (const SymbolID &ID : Req.IDs) {
+    RefsRequest Single;
+    Single.IDs.insert(ID);
+    Single.Filter = Req.Filter;
+    refs(Single, [&](const Ref &R) { Results.insert(ID, R); });
   }
+  for (const auto &Sym : std::move(Results).build())
+    Callback(Sym.first, Sym.second);
 }
-std::shared_ptr<SymbolIndex> SwapIndex::snapshot() const {
-  std::lock_guard<std::mutex> Lock(Mutex);
-  return Index;
+
+bool SymbolIndex::fuzzyFindScored(
+    const FuzzyFindRequest &Req,
+    function_ref<void(const Symbol &, float)> Callback) const {
+  FuzzyMatcher Filter(Req.Query);
+  return fuzzyFind(Req, [&](const Symbol &Sym) {
+    if (auto NameMatch = Filter.match(Sym.Name))
+      Callback(Sym, *NameMatch);
+  });
+}
+
+void SymbolIndex::profile(MemoryTree &MT) const {
+  MT.addUsage(estimateMemoryUsage());
 }
 
 bool fromJSON(const json::Value &Parameters, FuzzyFindRequest &Request) {
@@ -229,19 +405,30 @@ json::Value toJSON(const FuzzyFindRequest &Request) {
 
 bool SwapIndex::fuzzyFind(const FuzzyFindRequest &R,
                           function_ref<void(const Symbol &)> CB) const {
-  return snapshot()->fuzzyFind(R, CB);
+  return Snapshot(*this)->fuzzyFind(R, CB);
+}
+bool SwapIndex::fuzzyFindScored(
+    const FuzzyFindRequest &R,
+    function_ref<void(const Symbol &, float)> CB) const {
+  return Snapshot(*this)->fuzzyFindScored(R, CB);
 }
 void SwapIndex::lookup(const LookupRequest &R,
                        function_ref<void(const Symbol &)> CB) const {
-  return snapshot()->lookup(R, CB);
+  return Snapshot(*this)->lookup(R, CB);
 }
 void SwapIndex::refs(const RefsRequest &R,
                      function_ref<void(const Ref &)> CB) const {
-  return snapshot()->refs(R, CB);
+  return Snapshot(*this)->refs(R, CB);
+}
+void SwapIndex::refsBySymbol(
+    const RefsRequest &R,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> CB) const {
+  return Snapshot(*this)->refsBySymbol(R, CB);
 }
 size_t SwapIndex::estimateMemoryUsage() const {
-  return snapshot()->estimateMemoryUsage();
+  return Snapshot(*this)->estimateMemoryUsage();
 }
+void SwapIndex::profile(MemoryTree &MT) const { Snapshot(*this)->profile(MT); }
 
 } // namespace clangd
 } // namespace clang
@@ -11,6 +11,9 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_INDEX_H
 
 #include "ExpectedTypes.h"
+#include "Function.h"
+#include "MemoryTree.h"
+#include "StringPool.h"
 #include "clang/Index/IndexSymbol.h"
 #include "clang/Lex/Lexer.h"
 #include "llvm/ADT/DenseMap.h"
@@ -23,6 +26,7 @@
 #include "llvm/Support/JSON.h"
 #include "llvm/Support/StringSaver.h"
 #include <array>
+#include <atomic>
 #include <limits>
 #include <mutex>
 #include <string>
@@ -167,6 +171,22 @@ template <> struct DenseMapInfo<clang::clangd::SymbolID> {
 namespace clang {
 namespace clangd {
 
+/// Finds the SymbolIDs shared by different USRs, which truncating their hash
+/// to SymbolID::RawSize bytes makes possible. A second, independent hash of
+/// the USR is kept for each ID. Threadsafe.
+class SymbolIDCollisionDetector {
+public:
+  /// Records that \p ID was computed from \p USR.
+  void record(const SymbolID &ID, llvm::StringRef USR);
+  /// Returns the IDs recorded for several USRs.
+  std::vector<SymbolID> collisions() const;
+
+private:
+  mutable std::mutex Mu;
+  llvm::DenseMap<SymbolID, uint64_t> USRHashes;
+  llvm::DenseSet<SymbolID> Collisions;
+};
+
 // Describes the source of information about a symbol.
 // Mainly useful for debugging, e.g. understanding code completion reuslts.
 // This is a bitfield as information can be combined from several sources.
@@ -343,19 +363,36 @@ public:
   bool empty() const { return Symbols.empty(); }
   // Estimates the total memory usage.
   size_t bytes() const {
-    return sizeof(*this) + Arena.getTotalMemory() +
-           Symbols.capacity() * sizeof(Symbol);
+    size_t Bytes = sizeof(*this) + Arena.getTotalMemory() +
+                   Symbols.capacity() * sizeof(Symbol);
+    for (const auto &Adopted : AdoptedArenas)
+      Bytes += Adopted.getTotalMemory();
+    return Bytes;
   }
 
   // SymbolSlab::Builder is a mutable container that can 'freeze' to SymbolSlab.
   // The frozen SymbolSlab will use less memory.
   class Builder {
   public:
-    Builder() : UniqueStrings(Arena) {}
+    // If CopyStrings is false, strings of inserted symbols are not copied.
+    // They must outlive the slab, e.g. by pointing into a mapped index file.
+    explicit Builder(bool CopyStrings = true)
+        : UniqueStrings(Arena), CopyStrings(CopyStrings) {}
+    // If Pool is set, strings are copied into it rather than into the slab,
+    // which is worthwhile for the many small slabs of a FileIndex.
+    explicit Builder(StringPool *Pool)
+        : UniqueStrings(Arena), CopyStrings(true), Pool(Pool) {}
 
     // Adds a symbol, overwriting any existing one with the same ID.
     // This is a deep copy: underlying strings will be owned by the slab.
     void insert(const Symbol &S);
+    // Adds all symbols of a slab, overwriting existing ones with the same IDs.
+    // The storage of the slab is adopted rather than copied, so the strings
+    // of overwritten symbols are only freed with the built slab.
+    void insert(SymbolSlab &&Slab);
+    // Merges a symbol into an existing one with the same ID using
+    // mergeSymbol(), or adds it. Only the strings of S are copied.
+    void merge(const Symbol &S);
 
     // Returns the symbol with an ID, if it exists. Valid until next insert().
     const Symbol *find(const SymbolID &ID) {
@@ -367,20 +404,39 @@ public:
     SymbolSlab build() &&;
 
   private:
+    void sortSymbols();
+
     llvm::BumpPtrAllocator Arena;
     // Intern table for strings. Contents are on the arena.
     llvm::UniqueStringSaver UniqueStrings;
+    bool CopyStrings;
+    StringPool *Pool = nullptr;
     std::vector<Symbol> Symbols;
+    // Whether the strings of each symbol are owned by Arena, rather than by
+    // the storage of an adopted slab.
+    std::vector<bool> Owned;
     // Values are indices into Symbols vector.
     llvm::DenseMap<SymbolID, size_t> SymbolIndex;
+    // Storage of adopted slabs.
+    std::vector<llvm::BumpPtrAllocator> AdoptedArenas;
+    std::vector<StringPool::Lease> AdoptedStrings;
   };
 
 private:
-  SymbolSlab(llvm::BumpPtrAllocator Arena, std::vector<Symbol> Symbols)
-      : Arena(std::move(Arena)), Symbols(std::move(Symbols)) {}
+  SymbolSlab(llvm::BumpPtrAllocator Arena, std::vector<Symbol> Symbols,
+             StringPool::Lease Strings = {},
+             std::vector<llvm::BumpPtrAllocator> AdoptedArenas = {},
+             std::vector<StringPool::Lease> AdoptedStrings = {})
+      : Arena(std::move(Arena)), Symbols(std::move(Symbols)),
+        Strings(std::move(Strings)), AdoptedArenas(std::move(AdoptedArenas)),
+        AdoptedStrings(std::move(AdoptedStrings)) {}
 
   llvm::BumpPtrAllocator Arena; // Owns Symbol data that the Symbols do not.
   std::vector<Symbol> Symbols;  // Sorted by SymbolID to allow lookup.
+  StringPool::Lease Strings;    // Pooled strings of the Symbols, if any.
+  // Storage of slabs adopted by the builder, holding strings of the Symbols.
+  std::vector<llvm::BumpPtrAllocator> AdoptedArenas;
+  std::vector<StringPool::Lease> AdoptedStrings;
 };
 
 // Describes the kind of a cross-reference.
@@ -448,7 +504,13 @@ public:
   // RefSlab::Builder is a mutable container that can 'freeze' to RefSlab.
   class Builder {
   public:
-    Builder() : UniqueStrings(Arena) {}
+    // If CopyStrings is false, file URIs of inserted refs are not copied.
+    // They must outlive the slab, e.g. by pointing into a mapped index file.
+    explicit Builder(bool CopyStrings = true)
+        : UniqueStrings(Arena), CopyStrings(CopyStrings) {}
+    // If Pool is set, file URIs are copied into it rather than into the slab.
+    explicit Builder(StringPool *Pool)
+        : UniqueStrings(Arena), CopyStrings(true), Pool(Pool) {}
     // Adds a ref to the slab. Deep copy: Strings will be owned by the slab.
     void insert(const SymbolID &ID, const Ref &S);
     // Consumes the builder to finalize the slab.
@@ -457,18 +519,23 @@ public:
   private:
     llvm::BumpPtrAllocator Arena;
     llvm::UniqueStringSaver UniqueStrings; // Contents on the arena.
+    bool CopyStrings;
+    StringPool *Pool = nullptr;
     llvm::DenseMap<SymbolID, std::vector<Ref>> Refs;
   };
 
 private:
   RefSlab(std::vector<value_type> Refs, llvm::BumpPtrAllocator Arena,
-          size_t NumRefs)
-      : Arena(std::move(Arena)), Refs(std::move(Refs)), NumRefs(NumRefs) {}
+          size_t NumRefs, StringPool::Lease Strings = {})
+      : Arena(std::move(Arena)), Refs(std::move(Refs)), NumRefs(NumRefs),
+        Strings(std::move(Strings)) {}
 
   llvm::BumpPtrAllocator Arena;
   std::vector<value_type> Refs;
   // Number of all references.
   size_t NumRefs = 0;
+  // Pooled file URIs of the refs, if any.
+  StringPool::Lease Strings;
 };
 
 struct FuzzyFindRequest {
@@ -516,6 +583,11 @@ struct RefsRequest {
   RefKind Filter = RefKind::All;
 };
 
+// Returns the refs of kinds in Filter: Refs itself if all of them are, or a
+// copy of the matching ones in Storage.
+llvm::ArrayRef<Ref> filterRefs(llvm::ArrayRef<Ref> Refs, RefKind Filter,
+                               std::vector<Ref> &Storage);
+
 /// Interface for symbol indexes that can be used for searching or
 /// matching symbols among a set of symbols based on names or unique IDs.
 class SymbolIndex {
@@ -531,6 +603,17 @@ public:
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const = 0;
 
+  /// Like fuzzyFind(), but also passes \p Callback how well the name of each
+  /// symbol matches Req.Query, as scored by FuzzyMatcher. Indexes score the
+  /// names to rank their results, so callers ranking them again can reuse the
+  /// scores rather than matching every name a second time. Symbols whose names
+  /// don't match are not returned.
+  ///
+  /// The default implementation calls fuzzyFind() and matches the names.
+  virtual bool fuzzyFindScored(
+      const FuzzyFindRequest &Req,
+      llvm::function_ref<void(const Symbol &, float NameMatch)> Callback) const;
+
   /// Looks up symbols with any of the given symbol IDs and applies \p Callback
   /// on each matched symbol.
   /// The returned symbol must be deep-copied if it's used outside Callback.
@@ -546,11 +629,25 @@ public:
   virtual void refs(const RefsRequest &Req,
                     llvm::function_ref<void(const Ref &)> Callback) const = 0;
 
+  /// Like refs(), but applies \p Callback once per symbol to all of its refs.
+  /// The refs may point into the index's storage, saving a call and a copy per
+  /// ref when there are many. They are only valid during the callback.
+  ///
+  /// The default implementation calls refs() and copies the results.
+  virtual void refsBySymbol(
+      const RefsRequest &Req,
+      llvm::function_ref<void(const SymbolID &, llvm::ArrayRef<Ref>)> Callback)
+      const;
+
   /// Returns estimated size of index (in bytes).
   // FIXME(kbobyrev): Currently, this only returns the size of index itself
   // excluding the size of actual symbol slab index refers to. We should include
   // both.
   virtual size_t estimateMemoryUsage() const = 0;
+
+  /// Records the memory used by the index in \p MT, broken down by part.
+  /// The default implementation adds estimateMemoryUsage() to \p MT itself.
+  virtual void profile(MemoryTree &MT) const;
 };
 
 // Delegating implementation of SymbolIndex whose delegate can be swapped out.
@@ -558,23 +655,56 @@ class SwapIndex : public SymbolIndex {
 public:
   // If an index is not provided, reset() must be called.
   SwapIndex(std::unique_ptr<SymbolIndex> Index = nullptr)
-      : Index(std::move(Index)) {}
+      : Current(Index.release()) {}
+  ~SwapIndex() override { delete Current.load(); }
+  // Replaces the index, and destroys the old one once the calls using it
+  // returned. This blocks until then, so it must not be called from within a
+  // call to this index.
   void reset(std::unique_ptr<SymbolIndex>);
 
+  /// The event is broadcast after reset() replaced the index, e.g. to let
+  /// caches of query results drop them.
+  using IndexChanged = Event<const SwapIndex *>;
+  IndexChanged::Subscription watch(IndexChanged::Listener L) const {
+    return OnIndexChanged.observe(std::move(L));
+  }
+
   // SymbolIndex methods delegate to the current index, which is kept alive
   // until the call returns (even if reset() is called).
   bool fuzzyFind(const FuzzyFindRequest &,
                  llvm::function_ref<void(const Symbol &)>) const override;
+  bool fuzzyFindScored(
+      const FuzzyFindRequest &,
+      llvm::function_ref<void(const Symbol &, float)>) const override;
   void lookup(const LookupRequest &,
               llvm::function_ref<void(const Symbol &)>) const override;
   void refs(const RefsRequest &,
             llvm::function_ref<void(const Ref &)>) const override;
+  void refsBySymbol(
+      const RefsRequest &,
+      llvm::function_ref<void(const SymbolID &, llvm::ArrayRef<Ref>)>)
+      const override;
   size_t estimateMemoryUsage() const override;
+  void profile(MemoryTree &MT) const override;
 
 private:
-  std::shared_ptr<SymbolIndex> snapshot() const;
-  mutable std::mutex Mutex;
-  std::shared_ptr<SymbolIndex> Index;
+  // Keeps the current index alive while it is used, see Index.cpp.
+  class Snapshot;
+
+  // Calls in progress are counted in a slot picked per thread, so that
+  // concurrent readers don't write to a shared cache line. A slot counts the
+  // calls that started in each of two alternating epochs. Slots are aligned
+  // to (and so fill) a cache line of 64 bytes.
+  static constexpr unsigned NumSlots = 64;
+  struct alignas(64) ReaderSlot {
+    std::atomic<unsigned> Readers[2] = {{0}, {0}};
+  };
+
+  std::atomic<SymbolIndex *> Current;
+  mutable std::array<ReaderSlot, NumSlots> Slots;
+  std::atomic<unsigned> Epoch = {0};
+  std::mutex WriterMutex; // Serializes reset().
+  mutable IndexChanged OnIndexChanged;
 };
 
 } // namespace clangd
@@ -1,5 +1,6 @@
 #include "IndexAction.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/MultiplexConsumer.h"
 #include "clang/Index/IndexDataConsumer.h"
 #include "clang/Index/IndexingAction.h"
 #include "clang/Tooling/Tooling.h"
@@ -9,6 +10,40 @@ namespace clang {
 namespace clangd {
 namespace {
 
+using FileFilter = std::function<bool(const SourceManager &, FileID)>;
+
+std::vector<std::unique_ptr<ASTConsumer>>
+consumers(std::unique_ptr<ASTConsumer> Consumer) {
+  std::vector<std::unique_ptr<ASTConsumer>> Consumers;
+  Consumers.push_back(std::move(Consumer));
+  return Consumers;
+}
+
+// Skips the bodies of functions declared in files without symbols to collect,
+// e.g. unchanged headers, for which only the declarations are needed.
+class SkipBodiesConsumer : public MultiplexConsumer {
+public:
+  SkipBodiesConsumer(std::unique_ptr<ASTConsumer> Consumer,
+                     const SourceManager &SM, FileFilter Filter)
+      : MultiplexConsumer(consumers(std::move(Consumer))), SM(SM),
+        Filter(std::move(Filter)) {}
+
+  bool shouldSkipFunctionBody(Decl *D) override {
+    FileID FID = SM.getFileID(SM.getExpansionLoc(D->getLocation()));
+    if (FID == SM.getMainFileID())
+      return false;
+    auto It = Indexed.try_emplace(FID, false);
+    if (It.second)
+      It.first->second = Filter(SM, FID);
+    return !It.first->second;
+  }
+
+private:
+  const SourceManager &SM;
+  FileFilter Filter;
+  llvm::DenseMap<FileID, bool> Indexed;
+};
+
 // Wraps the index action and reports index data after each translation unit.
 class IndexAction : public WrapperFrontendAction {
 public:
@@ -16,21 +51,30 @@ public:
               std::unique_ptr<CanonicalIncludes> Includes,
               const index::IndexingOptions &Opts,
               std::function<void(SymbolSlab)> SymbolsCallback,
-              std::function<void(RefSlab)> RefsCallback)
+              std::function<void(RefSlab)> RefsCallback,
+              FileFilter SkipBodiesFilter)
       : WrapperFrontendAction(index::createIndexingAction(C, Opts, nullptr)),
         SymbolsCallback(SymbolsCallback), RefsCallback(RefsCallback),
-        Collector(C), Includes(std::move(Includes)),
+        SkipBodiesFilter(std::move(SkipBodiesFilter)), Collector(C),
+        Includes(std::move(Includes)),
         PragmaHandler(collectIWYUHeaderMaps(this->Includes.get())) {}
 
   std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI,
                                                  StringRef InFile) override {
     CI.getPreprocessor().addCommentHandler(PragmaHandler.get());
-    return WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+    auto Consumer = WrapperFrontendAction::CreateASTConsumer(CI, InFile);
+    if (!Consumer || !SkipBodiesFilter)
+      return Consumer;
+    return llvm::make_unique<SkipBodiesConsumer>(
+        std::move(Consumer), CI.getSourceManager(), SkipBodiesFilter);
   }
 
   bool BeginInvocation(CompilerInstance &CI) override {
     // We want all comments, not just the doxygen ones.
     CI.getLangOpts().CommentOpts.ParseAllComments = true;
+    // The parser asks the consumer about each function body.
+    if (SkipBodiesFilter)
+      CI.getFrontendOpts().SkipFunctionBodies = true;
     return WrapperFrontendAction::BeginInvocation(CI);
   }
 
@@ -51,6 +95,7 @@ public:
 private:
   std::function<void(SymbolSlab)> SymbolsCallback;
   std::function<void(RefSlab)> RefsCallback;
+  FileFilter SkipBodiesFilter;
   std::shared_ptr<SymbolCollector> Collector;
   std::unique_ptr<CanonicalIncludes> Includes;
   std::unique_ptr<CommentHandler> PragmaHandler;
@@ -75,9 +120,10 @@ createStaticIndexingAction(SymbolCollector::Options Opts,
   auto Includes = llvm::make_unique<CanonicalIncludes>();
   addSystemHeadersMapping(Includes.get());
   Opts.Includes = Includes.get();
+  FileFilter SkipBodiesFilter = Opts.FileFilter;
   return llvm::make_unique<IndexAction>(
       std::make_shared<SymbolCollector>(std::move(Opts)), std::move(Includes),
-      IndexOpts, SymbolsCallback, RefsCallback);
+      IndexOpts, SymbolsCallback, RefsCallback, std::move(SkipBodiesFilter));
 }
 
 } // namespace clangd
@@ -23,6 +23,8 @@ namespace clangd {
 //   - references are always counted
 //   - all references are collected (if RefsCallback is non-null)
 //   - the symbol origin is always Static
+// If Opts.FileFilter is set, the bodies of functions in files it rejects are
+// not parsed, as nothing is collected from them.
 std::unique_ptr<FrontendAction>
 createStaticIndexingAction(SymbolCollector::Options Opts,
                            std::function<void(SymbolSlab)> SymbolsCallback,
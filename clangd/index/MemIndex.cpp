@@ -8,6 +8,7 @@
 //===-------------------------------------------------------------------===//
 
 #include "MemIndex.h"
+#include "Cancellation.h"
 #include "FuzzyMatch.h"
 #include "Logger.h"
 #include "Quality.h"
@@ -27,15 +28,28 @@ std::unique_ptr<SymbolIndex> MemIndex::build(SymbolSlab Slab, RefSlab Refs) {
 
 bool MemIndex::fuzzyFind(const FuzzyFindRequest &Req,
                          function_ref<void(const Symbol &)> Callback) const {
+  return fuzzyFindScored(
+      Req, [&](const Symbol &Sym, float NameMatch) { Callback(Sym); });
+}
+
+bool MemIndex::fuzzyFindScored(
+    const FuzzyFindRequest &Req,
+    function_ref<void(const Symbol &, float)> Callback) const {
   assert(!StringRef(Req.Query).contains("::") &&
          "There must be no :: in query.");
   trace::Span Tracer("MemIndex fuzzyFind");
 
-  TopN<std::pair<float, const Symbol *>> Top(
+  // Scores and symbols, with the name matches.
+  TopN<std::tuple<float, const Symbol *, float>> Top(
       Req.Limit ? *Req.Limit : std::numeric_limits<size_t>::max());
   FuzzyMatcher Filter(Req.Query);
   bool More = false;
+  CancellationCheckpoint Checkpoint;
   for (const auto Pair : Index) {
+    if (Checkpoint.cancelled()) {
+      More = true;
+      break;
+    }
     const Symbol *Sym = Pair.second;
 
     // Exact match against all possible scopes.
@@ -46,13 +60,13 @@ bool MemIndex::fuzzyFind(const FuzzyFindRequest &Req,
       continue;
 
     if (auto Score = Filter.match(Sym->Name))
-      if (Top.push({*Score * quality(*Sym), Sym}))
+      if (Top.push(std::make_tuple(*Score * quality(*Sym), Sym, *Score)))
         More = true; // An element with smallest score was discarded.
   }
   auto Results = std::move(Top).items();
   SPAN_ATTACH(Tracer, "results", static_cast<int>(Results.size()));
   for (const auto &Item : Results)
-    Callback(*Item.second);
+    Callback(*std::get<1>(Item), std::get<2>(Item));
   return More;
 }
 
@@ -79,9 +93,30 @@ void MemIndex::refs(const RefsRequest &Req,
   }
 }
 
+void MemIndex::refsBySymbol(
+    const RefsRequest &Req,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> Callback) const {
+  trace::Span Tracer("MemIndex refsBySymbol");
+  std::vector<Ref> Filtered;
+  for (const auto &ReqID : Req.IDs) {
+    auto SymRefs = Refs.find(ReqID);
+    if (SymRefs == Refs.end())
+      continue;
+    auto Matching = filterRefs(SymRefs->second, Req.Filter, Filtered);
+    if (!Matching.empty())
+      Callback(ReqID, Matching);
+  }
+}
+
 size_t MemIndex::estimateMemoryUsage() const {
   return Index.getMemorySize() + Refs.getMemorySize() + BackingDataSize;
 }
 
+void MemIndex::profile(MemoryTree &MT) const {
+  MT.child("symbols").addUsage(Index.getMemorySize());
+  MT.child("refs").addUsage(Refs.getMemorySize());
+  MT.child("backing").addUsage(BackingDataSize);
+}
+
 } // namespace clangd
 } // namespace clang
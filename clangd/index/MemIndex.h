@@ -45,6 +45,9 @@ public:
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const override;
+  bool fuzzyFindScored(const FuzzyFindRequest &Req,
+                       llvm::function_ref<void(const Symbol &, float)> Callback)
+      const override;
 
   void lookup(const LookupRequest &Req,
               llvm::function_ref<void(const Symbol &)> Callback) const override;
@@ -52,7 +55,13 @@ public:
   void refs(const RefsRequest &Req,
             llvm::function_ref<void(const Ref &)> Callback) const override;
 
+  void refsBySymbol(const RefsRequest &Req,
+                    llvm::function_ref<void(const SymbolID &,
+                                            llvm::ArrayRef<Ref>)>
+                        Callback) const override;
+
   size_t estimateMemoryUsage() const override;
+  void profile(MemoryTree &MT) const override;
 
 private:
   // Index is a set of symbols that are deduplicated by symbol IDs.
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Merge.h"
+#include "Cancellation.h"
 #include "Logger.h"
 #include "Trace.h"
 #include "llvm/ADT/STLExtras.h"
@@ -18,47 +19,149 @@ using namespace llvm;
 namespace clang {
 namespace clangd {
 
+namespace {
+// Queries Index, with the name matches of the symbols if Scored.
+bool query(const SymbolIndex &Index, const FuzzyFindRequest &Req, bool Scored,
+           function_ref<void(const Symbol &, float)> Callback) {
+  if (Scored)
+    return Index.fuzzyFindScored(Req, Callback);
+  return Index.fuzzyFind(Req, [&](const Symbol &S) { Callback(S, 0); });
+}
+} // namespace
+
+bool MergedIndex::fuzzyFind(const FuzzyFindRequest &Req,
+                            function_ref<void(const Symbol &)> Callback) const {
+  return fuzzyFindMerged(Req, /*Scored=*/false,
+                         [&](const Symbol &S, float) { Callback(S); });
+}
+
+bool MergedIndex::fuzzyFindScored(
+    const FuzzyFindRequest &Req,
+    function_ref<void(const Symbol &, float)> Callback) const {
+  return fuzzyFindMerged(Req, /*Scored=*/true, Callback);
+}
+
 // FIXME: Deleted symbols in dirty files are still returned (from Static).
 //        To identify these eliminate these, we should:
 //          - find the generating file from each Symbol which is Static-only
 //          - ask Dynamic if it has that file (needs new SymbolIndex method)
 //          - if so, drop the Symbol.
-bool MergedIndex::fuzzyFind(const FuzzyFindRequest &Req,
-                            function_ref<void(const Symbol &)> Callback) const {
+bool MergedIndex::fuzzyFindMerged(
+    const FuzzyFindRequest &Req, bool Scored,
+    function_ref<void(const Symbol &, float)> Callback) const {
   // We can't step through both sources in parallel. So:
   //  1) query all dynamic symbols, slurping results into a slab
   //  2) query the static symbols, for each one:
   //    a) if it's not in the dynamic slab, yield it directly
   //    b) if it's in the dynamic slab, merge it and yield the result
   //  3) now yield all the dynamic symbols we haven't processed.
+  if (StaticTimeout)
+    return fuzzyFindConcurrently(Req, Scored, Callback);
   trace::Span Tracer("MergedIndex fuzzyFind");
   bool More = false; // We'll be incomplete if either source was.
   SymbolSlab::Builder DynB;
+  DenseMap<SymbolID, float> DynNameMatches;
   unsigned DynamicCount = 0;
   unsigned StaticCount = 0;
   unsigned MergedCount = 0;
-  More |= Dynamic->fuzzyFind(Req, [&](const Symbol &S) {
+  More |= query(*Dynamic, Req, Scored, [&](const Symbol &S, float NameMatch) {
     ++DynamicCount;
     DynB.insert(S);
+    DynNameMatches[S.ID] = NameMatch;
   });
   SymbolSlab Dyn = std::move(DynB).build();
 
   DenseSet<SymbolID> SeenDynamicSymbols;
-  More |= Static->fuzzyFind(Req, [&](const Symbol &S) {
+  More |= query(*Static, Req, Scored, [&](const Symbol &S, float NameMatch) {
     auto DynS = Dyn.find(S.ID);
     ++StaticCount;
     if (DynS == Dyn.end())
-      return Callback(S);
+      return Callback(S, NameMatch);
     ++MergedCount;
     SeenDynamicSymbols.insert(S.ID);
-    Callback(mergeSymbol(*DynS, S));
+    Callback(mergeSymbol(*DynS, S), NameMatch);
   });
   SPAN_ATTACH(Tracer, "dynamic", DynamicCount);
   SPAN_ATTACH(Tracer, "static", StaticCount);
   SPAN_ATTACH(Tracer, "merged", MergedCount);
   for (const Symbol &S : Dyn)
     if (!SeenDynamicSymbols.count(S.ID))
-      Callback(S);
+      Callback(S, DynNameMatches.lookup(S.ID));
+  return More;
+}
+
+bool MergedIndex::fuzzyFindConcurrently(
+    const FuzzyFindRequest &Req, bool Scored,
+    function_ref<void(const Symbol &, float)> Callback) const {
+  // As above, but the static symbols are slurped into a slab on another
+  // thread while the dynamic ones are. The static results are shared with
+  // that thread, which keeps running if we stop waiting.
+  trace::Span Tracer("MergedIndex fuzzyFind");
+  struct StaticResults {
+    std::mutex Mu;
+    std::condition_variable CV;
+    bool Done = false; /* GUARDED_BY(Mu) */
+    bool More = false;
+    SymbolSlab Symbols;
+    // As returned by the static index, with the name matches.
+    std::vector<std::pair<SymbolID, float>> Order;
+  };
+  auto Results = std::make_shared<StaticResults>();
+  Deadline StaticDeadline(std::chrono::steady_clock::now() + *StaticTimeout);
+  StaticQueries.runAsync("static-fuzzyfind", [this, Req, Scored, Results] {
+    SymbolSlab::Builder B;
+    std::vector<std::pair<SymbolID, float>> Order;
+    bool More =
+        query(*Static, Req, Scored, [&](const Symbol &S, float NameMatch) {
+          B.insert(S);
+          Order.emplace_back(S.ID, NameMatch);
+        });
+    std::lock_guard<std::mutex> Lock(Results->Mu);
+    Results->Symbols = std::move(B).build();
+    Results->Order = std::move(Order);
+    Results->More = More;
+    Results->Done = true;
+    Results->CV.notify_all();
+  });
+
+  SymbolSlab::Builder DynB;
+  DenseMap<SymbolID, float> DynNameMatches;
+  bool More =
+      query(*Dynamic, Req, Scored, [&](const Symbol &S, float NameMatch) {
+        DynB.insert(S);
+        DynNameMatches[S.ID] = NameMatch;
+      });
+  SymbolSlab Dyn = std::move(DynB).build();
+  SPAN_ATTACH(Tracer, "dynamic", static_cast<int>(Dyn.size()));
+
+  {
+    std::unique_lock<std::mutex> Lock(Results->Mu);
+    if (!wait(Lock, Results->CV, StaticDeadline,
+              [&] { return Results->Done; })) {
+      SPAN_ATTACH(Tracer, "static", "timeout");
+      for (const Symbol &S : Dyn)
+        Callback(S, DynNameMatches.lookup(S.ID));
+      return true;
+    }
+  }
+  // The results are not modified once Done is set.
+  SPAN_ATTACH(Tracer, "static", static_cast<int>(Results->Order.size()));
+  More |= Results->More;
+  DenseSet<SymbolID> SeenDynamicSymbols;
+  for (const auto &IDAndMatch : Results->Order) {
+    const SymbolID &ID = IDAndMatch.first;
+    const Symbol &S = *Results->Symbols.find(ID);
+    auto DynS = Dyn.find(ID);
+    if (DynS == Dyn.end()) {
+      Callback(S, IDAndMatch.second);
+      continue;
+    }
+    SeenDynamicSymbols.insert(ID);
+    Callback(mergeSymbol(*DynS, S), IDAndMatch.second);
+  }
+  for (const Symbol &S : Dyn)
+    if (!SeenDynamicSymbols.count(S.ID))
+      Callback(S, DynNameMatches.lookup(S.ID));
   return More;
 }
 
@@ -99,12 +202,46 @@ void MergedIndex::refs(const RefsRequest &Req,
     DynamicIndexFileURIs.insert(O.Location.FileURI);
     Callback(O);
   });
+  if (isCancelled())
+    return;
   Static->refs(Req, [&](const Ref &O) {
     if (!DynamicIndexFileURIs.count(O.Location.FileURI))
       Callback(O);
   });
 }
 
+void MergedIndex::refsBySymbol(
+    const RefsRequest &Req,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> Callback) const {
+  trace::Span Tracer("MergedIndex refsBySymbol");
+  // As in refs(), static index refs are only reported from files the dynamic
+  // index doesn't have. A symbol's static refs are passed on without copying
+  // unless some of them must be dropped.
+  StringSet<> DynamicIndexFileURIs;
+  Dynamic->refsBySymbol(Req, [&](const SymbolID &ID, ArrayRef<Ref> Refs) {
+    for (const auto &O : Refs)
+      DynamicIndexFileURIs.insert(O.Location.FileURI);
+    Callback(ID, Refs);
+  });
+  if (isCancelled())
+    return;
+  std::vector<Ref> Filtered;
+  Static->refsBySymbol(Req, [&](const SymbolID &ID, ArrayRef<Ref> Refs) {
+    auto IsStale = [&](const Ref &O) {
+      return DynamicIndexFileURIs.count(O.Location.FileURI) != 0;
+    };
+    if (llvm::any_of(Refs, IsStale)) {
+      Filtered.clear();
+      for (const auto &O : Refs)
+        if (!IsStale(O))
+          Filtered.push_back(O);
+      Refs = Filtered;
+    }
+    if (!Refs.empty())
+      Callback(ID, Refs);
+  });
+}
+
 Symbol mergeSymbol(const Symbol &L, const Symbol &R) {
   assert(L.ID == R.ID);
   // We prefer information from TUs that saw the definition.
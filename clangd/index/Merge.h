@@ -11,6 +11,8 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_MERGE_H
 
 #include "Index.h"
+#include "Threading.h"
+#include <chrono>
 
 namespace clang {
 namespace clangd {
@@ -28,24 +30,52 @@ Symbol mergeSymbol(const Symbol &L, const Symbol &R);
 // FIXME: We don't have a mechanism in Index to track deleted symbols and
 // refs in dirty files, so the merged index may return stale symbols
 // and refs from Static index.
+//
+// If StaticTimeout is set, fuzzyFind() queries the static index on another
+// thread while the dynamic index is queried. If the static index doesn't
+// answer within the timeout, only the dynamic results are returned (and
+// flagged as incomplete): a slow static index doesn't block code completion.
 class MergedIndex : public SymbolIndex {
   const SymbolIndex *Dynamic, *Static;
+  llvm::Optional<std::chrono::milliseconds> StaticTimeout;
+  // Runs the static queries, which may outlive the fuzzyFind() call.
+  mutable AsyncTaskRunner StaticQueries;
+
+  // Implements fuzzyFind(), and fuzzyFindScored() if Scored is set.
+  bool fuzzyFindMerged(const FuzzyFindRequest &, bool Scored,
+                       llvm::function_ref<void(const Symbol &, float)>) const;
+  bool fuzzyFindConcurrently(
+      const FuzzyFindRequest &, bool Scored,
+      llvm::function_ref<void(const Symbol &, float)>) const;
 
 public:
   // The constructor does not access the symbols.
   // It's safe to inherit from this class and pass pointers to derived members.
-  MergedIndex(const SymbolIndex *Dynamic, const SymbolIndex *Static)
-      : Dynamic(Dynamic), Static(Static) {}
+  MergedIndex(const SymbolIndex *Dynamic, const SymbolIndex *Static,
+              llvm::Optional<std::chrono::milliseconds> StaticTimeout =
+                  llvm::None)
+      : Dynamic(Dynamic), Static(Static), StaticTimeout(StaticTimeout) {}
 
   bool fuzzyFind(const FuzzyFindRequest &,
                  llvm::function_ref<void(const Symbol &)>) const override;
+  bool fuzzyFindScored(
+      const FuzzyFindRequest &,
+      llvm::function_ref<void(const Symbol &, float)>) const override;
   void lookup(const LookupRequest &,
               llvm::function_ref<void(const Symbol &)>) const override;
   void refs(const RefsRequest &,
             llvm::function_ref<void(const Ref &)>) const override;
+  void refsBySymbol(
+      const RefsRequest &,
+      llvm::function_ref<void(const SymbolID &, llvm::ArrayRef<Ref>)>)
+      const override;
   size_t estimateMemoryUsage() const override {
     return Dynamic->estimateMemoryUsage() + Static->estimateMemoryUsage();
   }
+  void profile(MemoryTree &MT) const override {
+    Dynamic->profile(MT.child("dynamic"));
+    Static->profile(MT.child("static"));
+  }
 };
 
 } // namespace clangd
@@ -0,0 +1,104 @@
+//===--- ReferencingFiles.cpp - Files referencing symbols -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ReferencingFiles.h"
+#include "URI.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+#include <tuple>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// Returns Path without "." and ".." components, nor an extension if
+// RemoveExtension is set.
+std::string normalizePath(StringRef Path, bool RemoveExtension = false) {
+  SmallString<128> Normalized(Path);
+  sys::path::remove_dots(Normalized, /*remove_dot_dot=*/true);
+  if (RemoveExtension)
+    sys::path::replace_extension(Normalized, "");
+  return Normalized.str();
+}
+
+} // namespace
+
+DenseSet<SymbolID> findSymbolsInNamespace(const SymbolIndex &Index,
+                                          StringRef Namespace) {
+  Namespace.consume_front("::");
+  std::string Scope = (Namespace + "::").str();
+  // Symbols can't be requested by a scope and the scopes nested in it, all
+  // of them are filtered.
+  FuzzyFindRequest Req;
+  Req.AnyScope = true;
+  DenseSet<SymbolID> IDs;
+  Index.fuzzyFind(Req, [&](const Symbol &Sym) {
+    if (Sym.Scope.startswith(Scope))
+      IDs.insert(Sym.ID);
+  });
+  return IDs;
+}
+
+DenseSet<SymbolID> findSymbolsByName(const SymbolIndex &Index,
+                                     ArrayRef<std::string> Names) {
+  DenseSet<SymbolID> IDs;
+  for (StringRef Name : Names) {
+    Name.consume_front("::");
+    StringRef Scope, Unqualified;
+    std::tie(Scope, Unqualified) = Name.rsplit("::");
+    if (Unqualified.empty())
+      std::swap(Scope, Unqualified);
+    FuzzyFindRequest Req;
+    Req.Query = Unqualified;
+    Req.Scopes.push_back(Scope.empty() ? "" : (Scope + "::").str());
+    // The fuzzy matches include the names sharing the trigrams of the query.
+    Index.fuzzyFind(Req, [&](const Symbol &Sym) {
+      if (Sym.Name == Unqualified)
+        IDs.insert(Sym.ID);
+    });
+  }
+  return IDs;
+}
+
+ReferencingFiles::ReferencingFiles(const SymbolIndex &Index,
+                                   const DenseSet<SymbolID> &IDs) {
+  if (IDs.empty())
+    return;
+  RefsRequest Req;
+  Req.IDs = IDs;
+  // Many refs share a file, each URI is only resolved once.
+  StringSet<> SeenURIs;
+  Index.refsBySymbol(Req, [&](const SymbolID &, ArrayRef<Ref> Refs) {
+    for (const Ref &R : Refs) {
+      if (!SeenURIs.insert(R.Location.FileURI).second)
+        continue;
+      auto U = URI::parse(R.Location.FileURI);
+      if (!U) {
+        consumeError(U.takeError());
+        continue;
+      }
+      auto Path = URI::resolve(*U);
+      if (!Path) {
+        consumeError(Path.takeError());
+        continue;
+      }
+      Files.insert(normalizePath(*Path));
+      Stems.insert(normalizePath(*Path, /*RemoveExtension=*/true));
+    }
+  });
+}
+
+bool ReferencingFiles::mayReference(StringRef MainFile) const {
+  return Files.count(normalizePath(MainFile)) ||
+         Stems.count(normalizePath(MainFile, /*RemoveExtension=*/true));
+}
+
+} // namespace clangd
+} // namespace clang
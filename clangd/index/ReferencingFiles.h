@@ -0,0 +1,60 @@
+//===--- ReferencingFiles.h - Files referencing symbols ----------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REFERENCINGFILES_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REFERENCINGFILES_H
+
+#include "Index.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include <string>
+
+namespace clang {
+namespace clangd {
+
+/// Returns the IDs of the symbols of \p Index declared in \p Namespace, e.g.
+/// "a::b", or in a namespace nested in it.
+llvm::DenseSet<SymbolID> findSymbolsInNamespace(const SymbolIndex &Index,
+                                                llvm::StringRef Namespace);
+
+/// Returns the IDs of the symbols of \p Index with the fully qualified
+/// \p Names, e.g. "a::Foo" or "::a::Foo".
+llvm::DenseSet<SymbolID> findSymbolsByName(const SymbolIndex &Index,
+                                           llvm::ArrayRef<std::string> Names);
+
+/// The files referencing some symbols in an index, used by refactoring tools
+/// to only parse the translation units that may need to be changed.
+///
+/// The index doesn't record which translation units include a header, so a
+/// header referencing the symbols is only reached through the source files
+/// next to it with the same name, e.g. foo.cc for foo.h.
+class ReferencingFiles {
+public:
+  ReferencingFiles(const SymbolIndex &Index,
+                   const llvm::DenseSet<SymbolID> &IDs);
+
+  /// Whether the translation unit of the absolute path \p MainFile may
+  /// reference the symbols.
+  bool mayReference(llvm::StringRef MainFile) const;
+
+  /// Returns the number of files referencing the symbols.
+  size_t size() const { return Files.size(); }
+
+private:
+  llvm::StringSet<> Files;
+  /// The paths of the referencing files, without their extensions.
+  llvm::StringSet<> Stems;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif
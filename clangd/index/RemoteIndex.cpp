@@ -0,0 +1,493 @@
+//===--- RemoteIndex.cpp - Index hosted by a server --------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RemoteIndex.h"
+#include "Logger.h"
+#include "Serialization.h"
+#include "Trace.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FormatVariadic.h"
+#include <cerrno>
+#include <cstring>
+#ifdef LLVM_ON_UNIX
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+// Messages larger than this are considered corrupt.
+constexpr uint32_t MaxMessageSize = 1 << 30;
+// Number of results sent in each response message.
+constexpr unsigned BatchSize = 256;
+
+json::Value toJSON(const DenseSet<SymbolID> &IDs) {
+  json::Array Result;
+  for (const SymbolID &ID : IDs)
+    Result.push_back(ID.str());
+  return std::move(Result);
+}
+
+bool fromJSON(const json::Value *V, DenseSet<SymbolID> &IDs) {
+  const json::Array *A = V ? V->getAsArray() : nullptr;
+  if (!A)
+    return false;
+  for (const json::Value &E : *A) {
+    auto S = E.getAsString();
+    if (!S)
+      return false;
+    auto ID = SymbolID::fromStr(*S);
+    if (!ID) {
+      consumeError(ID.takeError());
+      return false;
+    }
+    IDs.insert(*ID);
+  }
+  return true;
+}
+
+#ifdef LLVM_ON_UNIX
+#ifdef MSG_NOSIGNAL
+// Report closed connections as errors rather than with SIGPIPE.
+constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+constexpr int SendFlags = 0;
+#endif
+
+// Waits until FD can be read. Returns false if D expires or WakeFD becomes
+// readable first.
+bool waitReadable(int FD, Deadline D, int WakeFD) {
+  while (true) {
+    int Timeout = -1;
+    if (D == Deadline::zero())
+      Timeout = 0;
+    else if (!(D == Deadline::infinity()))
+      Timeout = std::max<int64_t>(
+          0, std::chrono::duration_cast<std::chrono::milliseconds>(
+                 D.time() - std::chrono::steady_clock::now())
+                 .count());
+    pollfd FDs[] = {{FD, POLLIN, 0}, {WakeFD, POLLIN, 0}};
+    int Ready = poll(FDs, WakeFD < 0 ? 1 : 2, Timeout);
+    if (Ready < 0 && errno == EINTR)
+      continue;
+    if (Ready <= 0)
+      return false;
+    return FDs[0].revents && (WakeFD < 0 || !FDs[1].revents);
+  }
+}
+
+bool readFully(int FD, char *Buf, size_t Size, Deadline D, int WakeFD) {
+  while (Size) {
+    if (!waitReadable(FD, D, WakeFD))
+      return false;
+    ssize_t Read = read(FD, Buf, Size);
+    if (Read < 0 && errno == EINTR)
+      continue;
+    if (Read <= 0)
+      return false;
+    Buf += Read;
+    Size -= Read;
+  }
+  return true;
+}
+
+bool writeFully(int FD, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t Written = send(FD, Data.data(), Data.size(), SendFlags);
+    if (Written < 0 && errno == EINTR)
+      continue;
+    if (Written <= 0)
+      return false;
+    Data = Data.drop_front(Written);
+  }
+  return true;
+}
+
+bool writeMessage(int FD, StringRef Payload) {
+  char Size[4];
+  support::endian::write32le(Size, Payload.size());
+  return writeFully(FD, StringRef(Size, sizeof(Size))) &&
+         writeFully(FD, Payload);
+}
+
+bool readMessage(int FD, std::string &Payload, Deadline D, int WakeFD = -1) {
+  char Size[4];
+  if (!readFully(FD, Size, sizeof(Size), D, WakeFD))
+    return false;
+  uint32_t PayloadSize = support::endian::read32le(Size);
+  if (PayloadSize > MaxMessageSize)
+    return false;
+  Payload.resize(PayloadSize);
+  return readFully(FD, &Payload[0], PayloadSize, D, WakeFD);
+}
+
+class RemoteIndex : public SymbolIndex {
+public:
+  RemoteIndex(std::string Host, std::string Port,
+              std::chrono::milliseconds Timeout)
+      : Host(std::move(Host)), Port(std::move(Port)), Timeout(Timeout) {}
+  ~RemoteIndex() override { disconnect(); }
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 function_ref<void(const Symbol &)> Callback) const override {
+    trace::Span Tracer("RemoteIndex fuzzyFind");
+    bool More = false;
+    call("fuzzyFind", toJSON(Req),
+         [&](const IndexFileIn &Batch) {
+           if (Batch.Symbols)
+             for (const auto &Sym : *Batch.Symbols)
+               Callback(Sym);
+         },
+         More);
+    return More;
+  }
+
+  void lookup(const LookupRequest &Req,
+              function_ref<void(const Symbol &)> Callback) const override {
+    trace::Span Tracer("RemoteIndex lookup");
+    bool More;
+    // All IDs are sent at once, so the lookup takes a single round trip.
+    call("lookup", json::Object{{"IDs", toJSON(Req.IDs)}},
+         [&](const IndexFileIn &Batch) {
+           if (Batch.Symbols)
+             for (const auto &Sym : *Batch.Symbols)
+               Callback(Sym);
+         },
+         More);
+  }
+
+  void refs(const RefsRequest &Req,
+            function_ref<void(const Ref &)> Callback) const override {
+    trace::Span Tracer("RemoteIndex refs");
+    bool More;
+    call("refs",
+         json::Object{{"IDs", toJSON(Req.IDs)},
+                      {"Filter", static_cast<int64_t>(Req.Filter)}},
+         [&](const IndexFileIn &Batch) {
+           if (Batch.Refs)
+             for (const auto &Sym : *Batch.Refs)
+               for (const auto &Ref : Sym.second)
+                 Callback(Ref);
+         },
+         More);
+  }
+
+  // The data lives on the server.
+  size_t estimateMemoryUsage() const override { return 0; }
+
+private:
+  // Sends a request and passes the batches of results to OnBatch as they
+  // arrive. Returns false if the request failed or timed out, in which case
+  // results may be partial.
+  bool call(StringRef Method, json::Value Params,
+            function_ref<void(const IndexFileIn &)> OnBatch,
+            bool &More) const {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Deadline D(std::chrono::steady_clock::now() + Timeout);
+    if (FD < 0 && !connect())
+      return false;
+    json::Value Request =
+        json::Object{{"method", Method}, {"params", std::move(Params)}};
+    std::string Message = formatv("{0}", Request);
+    if (!writeMessage(FD, Message)) {
+      elog("Failed to send {0} request to remote index {1}:{2}", Method, Host,
+           Port);
+      disconnect();
+      return false;
+    }
+    while (readMessage(FD, Message, D)) {
+      StringRef Payload = Message;
+      if (Payload.consume_front("d")) {
+        // Message outlives the callbacks, strings don't need copying.
+        auto Batch = readIndexFile(Payload, /*CopyStrings=*/false);
+        if (!Batch) {
+          elog("Bad response from remote index: {0}", Batch.takeError());
+          break;
+        }
+        OnBatch(*Batch);
+      } else if (Payload.consume_front("e")) {
+        More = Payload == "\1";
+        return true;
+      } else if (Payload.consume_front("x")) {
+        elog("Remote index failed {0} request: {1}", Method, Payload);
+        return false;
+      } else {
+        elog("Bad response from remote index");
+        break;
+      }
+    }
+    // The rest of the response may still arrive, so the connection can't be
+    // reused for the next request.
+    elog("Remote index {0}:{1} failed or timed out on {2} request", Host, Port,
+         Method);
+    disconnect();
+    return false;
+  }
+
+  bool connect() const {
+    addrinfo Hints;
+    std::memset(&Hints, 0, sizeof(Hints));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+    addrinfo *Addrs;
+    if (int Err = getaddrinfo(Host.c_str(), Port.c_str(), &Hints, &Addrs)) {
+      elog("Failed to resolve remote index {0}: {1}", Host, gai_strerror(Err));
+      return false;
+    }
+    for (addrinfo *A = Addrs; A && FD < 0; A = A->ai_next) {
+      FD = socket(A->ai_family, A->ai_socktype, A->ai_protocol);
+      if (FD >= 0 && ::connect(FD, A->ai_addr, A->ai_addrlen) != 0) {
+        close(FD);
+        FD = -1;
+      }
+    }
+    freeaddrinfo(Addrs);
+    if (FD < 0)
+      elog("Failed to connect to remote index {0}:{1}", Host, Port);
+    else
+      log("Connected to remote index {0}:{1}", Host, Port);
+    return FD >= 0;
+  }
+
+  void disconnect() const {
+    if (FD >= 0)
+      close(FD);
+    FD = -1;
+  }
+
+  const std::string Host;
+  const std::string Port;
+  const std::chrono::milliseconds Timeout;
+  mutable std::mutex Mu;
+  mutable int FD = -1; /* GUARDED_BY(Mu) */
+};
+
+// Sends the results of a request in batches as they are found.
+class BatchWriter {
+public:
+  BatchWriter(int FD) : FD(FD) {
+    Symbols.emplace();
+    Refs.emplace();
+  }
+
+  void add(const Symbol &Sym) {
+    Symbols->insert(Sym);
+    if (++Pending == BatchSize)
+      flush();
+  }
+
+  void add(const SymbolID &ID, const Ref &R) {
+    Refs->insert(ID, R);
+    if (++Pending == BatchSize)
+      flush();
+  }
+
+  // Sends the remaining results and the end of the response, returns false if
+  // writing failed.
+  bool finish(bool More) {
+    flush();
+    return OK && writeMessage(FD, StringRef(More ? "e\1" : "e\0", 2));
+  }
+
+private:
+  void flush() {
+    if (!Pending)
+      return;
+    Pending = 0;
+    SymbolSlab SymbolBatch = std::move(*Symbols).build();
+    RefSlab RefBatch = std::move(*Refs).build();
+    Symbols.emplace();
+    Refs.emplace();
+    if (!OK) // The client is gone, but the search can't be interrupted.
+      return;
+    IndexFileOut Out;
+    Out.Symbols = &SymbolBatch;
+    Out.Refs = &RefBatch;
+    std::string Message = "d";
+    {
+      raw_string_ostream OS(Message);
+      OS << Out;
+    }
+    OK = writeMessage(FD, Message);
+  }
+
+  int FD;
+  bool OK = true;
+  unsigned Pending = 0;
+  // Builders can't be reassigned, they are created again for each batch.
+  Optional<SymbolSlab::Builder> Symbols;
+  Optional<RefSlab::Builder> Refs;
+};
+#endif
+
+} // namespace
+
+std::unique_ptr<SymbolIndex>
+connectRemoteIndex(StringRef Address, std::chrono::milliseconds Timeout) {
+#ifdef LLVM_ON_UNIX
+  StringRef Host, Port;
+  std::tie(Host, Port) = Address.rsplit(':');
+  // The connection is established by the first request, so that clangd starts
+  // even if the server is down.
+  return llvm::make_unique<RemoteIndex>(Host, Port, Timeout);
+#else
+  elog("Remote indexes are not supported on this platform");
+  return nullptr;
+#endif
+}
+
+Expected<std::unique_ptr<RemoteIndexServer>>
+RemoteIndexServer::listen(const SymbolIndex &Index, unsigned Port) {
+#ifdef LLVM_ON_UNIX
+  auto Fail = [](const char *What) {
+    return createStringError(std::error_code(errno, std::generic_category()),
+                             What);
+  };
+  int ListenFD = socket(AF_INET, SOCK_STREAM, 0);
+  if (ListenFD < 0)
+    return Fail("Failed to create socket");
+  int Reuse = 1;
+  setsockopt(ListenFD, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+  sockaddr_in Addr;
+  std::memset(&Addr, 0, sizeof(Addr));
+  Addr.sin_family = AF_INET;
+  Addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  Addr.sin_port = htons(Port);
+  socklen_t AddrSize = sizeof(Addr);
+  int WakeFDs[2];
+  if (bind(ListenFD, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) != 0 ||
+      ::listen(ListenFD, /*backlog=*/64) != 0 ||
+      getsockname(ListenFD, reinterpret_cast<sockaddr *>(&Addr), &AddrSize) !=
+          0 ||
+      pipe(WakeFDs) != 0) {
+    auto Err = Fail("Failed to listen");
+    close(ListenFD);
+    return std::move(Err);
+  }
+  return std::unique_ptr<RemoteIndexServer>(
+      new RemoteIndexServer(Index, ListenFD, WakeFDs, ntohs(Addr.sin_port)));
+#else
+  return createStringError(inconvertibleErrorCode(),
+                           "Remote indexes are not supported on this platform");
+#endif
+}
+
+RemoteIndexServer::RemoteIndexServer(const SymbolIndex &Index, int ListenFD,
+                                     int WakeFDs[2], unsigned Port)
+    : Index(Index), ListenFD(ListenFD), WakeFDs{WakeFDs[0], WakeFDs[1]},
+      Port(Port) {}
+
+RemoteIndexServer::~RemoteIndexServer() {
+#ifdef LLVM_ON_UNIX
+  stop();
+  Connections.wait();
+  close(ListenFD);
+  close(WakeFDs[0]);
+  close(WakeFDs[1]);
+#endif
+}
+
+void RemoteIndexServer::stop() {
+#ifdef LLVM_ON_UNIX
+  // The byte is never read, so every thread polling WakeFDs[0] wakes up.
+  char Stop = 0;
+  while (write(WakeFDs[1], &Stop, 1) < 0 && errno == EINTR)
+    ;
+#endif
+}
+
+void RemoteIndexServer::run() {
+#ifdef LLVM_ON_UNIX
+  while (true) {
+    pollfd FDs[] = {{ListenFD, POLLIN, 0}, {WakeFDs[0], POLLIN, 0}};
+    if (poll(FDs, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      elog("Remote index server failed: {0}", std::strerror(errno));
+      return;
+    }
+    if (FDs[1].revents)
+      return;
+    int FD = accept(ListenFD, nullptr, nullptr);
+    if (FD < 0)
+      continue;
+    Connections.runAsync("remote-index-conn", [this, FD] {
+      serve(FD);
+      close(FD);
+    });
+  }
+#endif
+}
+
+void RemoteIndexServer::serve(int FD) {
+#ifdef LLVM_ON_UNIX
+  std::string Message;
+  while (readMessage(FD, Message, Deadline::infinity(), WakeFDs[0])) {
+    auto Request = json::parse(Message);
+    if (!Request) {
+      elog("Bad remote index request: {0}", Request.takeError());
+      return;
+    }
+    if (!handle(FD, *Request))
+      return;
+  }
+#endif
+}
+
+bool RemoteIndexServer::handle(int FD, const json::Value &Request) {
+#ifdef LLVM_ON_UNIX
+  const json::Object *O = Request.getAsObject();
+  auto Method = O ? O->getString("method") : None;
+  const json::Object *Params = O ? O->getObject("params") : nullptr;
+  if (!Method || !Params)
+    return writeMessage(FD, "xmalformed request");
+  trace::Span Tracer("RemoteIndexServer " + Method->str());
+  BatchWriter Out(FD);
+  bool More = false;
+  if (*Method == "fuzzyFind") {
+    FuzzyFindRequest Req;
+    if (!fromJSON(*O->get("params"), Req))
+      return writeMessage(FD, "xmalformed fuzzyFind request");
+    More = Index.fuzzyFind(Req, [&](const Symbol &Sym) { Out.add(Sym); });
+  } else if (*Method == "lookup") {
+    LookupRequest Req;
+    if (!fromJSON(Params->get("IDs"), Req.IDs))
+      return writeMessage(FD, "xmalformed lookup request");
+    Index.lookup(Req, [&](const Symbol &Sym) { Out.add(Sym); });
+  } else if (*Method == "refs") {
+    RefsRequest Req;
+    auto Filter = Params->getInteger("Filter");
+    if (!fromJSON(Params->get("IDs"), Req.IDs) || !Filter)
+      return writeMessage(FD, "xmalformed refs request");
+    Req.Filter = static_cast<RefKind>(*Filter);
+    // Refs don't carry their symbol, so each ID is queried separately.
+    for (const SymbolID &ID : Req.IDs) {
+      RefsRequest Single;
+      Single.IDs.insert(ID);
+      Single.Filter = Req.Filter;
+      Index.refs(Single, [&](const Ref &R) { Out.add(ID, R); });
+    }
+  } else {
+    return writeMessage(FD, "xunknown method " + Method->str());
+  }
+  return Out.finish(More);
+#else
+  return false;
+#endif
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,90 @@
+//===--- RemoteIndex.h - Index hosted by a server ----------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A static index may be too large to be loaded by every clangd process. It can
+// instead be hosted by a RemoteIndexServer, and queried through the index
+// returned by connectRemoteIndex().
+//
+// Client and server talk over TCP. Messages are framed by their 32-bit little
+// endian size:
+//  - a request is a JSON object {"method": ..., "params": ...}, where method
+//    is fuzzyFind, lookup or refs.
+//  - a response is a sequence of messages, starting with a kind byte:
+//     'd': a batch of results, as a RIFF index file;
+//     'e': the end of the results, followed by a byte: 1 if fuzzyFind had more
+//          results, 0 otherwise;
+//     'x': the request failed, followed by an error message.
+// Results are streamed in batches, so the client sees the first results before
+// the server found them all. Within a batch, symbols are ordered by ID.
+//
+// Only supported on Unix.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REMOTEINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REMOTEINDEX_H
+
+#include "Index.h"
+#include "Threading.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/JSON.h"
+#include <chrono>
+#include <memory>
+
+namespace clang {
+namespace clangd {
+
+/// Returns an index forwarding requests to the server at \p Address, given as
+/// host:port. Requests that don't complete within \p Timeout return partial
+/// results. Returns nullptr if remote indexes are not supported.
+///
+/// Requests are sent over a single connection, re-established after failures,
+/// and are not processed concurrently.
+std::unique_ptr<SymbolIndex>
+connectRemoteIndex(llvm::StringRef Address,
+                   std::chrono::milliseconds Timeout = std::chrono::seconds(5));
+
+/// Serves requests for an index to remote clients, each connection on its own
+/// thread.
+class RemoteIndexServer {
+public:
+  /// Listens on \p Port, or on a free port if it is 0. \p Index must outlive
+  /// the server.
+  static llvm::Expected<std::unique_ptr<RemoteIndexServer>>
+  listen(const SymbolIndex &Index, unsigned Port);
+  /// Stops the server and waits for connections to close.
+  ~RemoteIndexServer();
+
+  /// The port the server is listening on.
+  unsigned port() const { return Port; }
+  /// Accepts connections until stop() is called.
+  void run();
+  /// Makes run() return and closes connections. Threadsafe.
+  void stop();
+
+private:
+  RemoteIndexServer(const SymbolIndex &Index, int ListenFD, int WakeFDs[2],
+                    unsigned Port);
+  // Serves the requests sent over FD until it's closed or the server stops.
+  void serve(int FD);
+  // Answers a single request, returns false if writing the response failed.
+  bool handle(int FD, const llvm::json::Value &Request);
+
+  const SymbolIndex &Index;
+  int ListenFD;
+  // Written to when the server is stopped, to wake up all threads.
+  int WakeFDs[2];
+  unsigned Port;
+  AsyncTaskRunner Connections;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_REMOTEINDEX_H
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Serialization.h"
+#include "CompressedStrings.h"
 #include "Index.h"
 #include "Logger.h"
 #include "RIFF.h"
@@ -16,6 +17,7 @@
 #include "llvm/Support/Compression.h"
 #include "llvm/Support/Endian.h"
 #include "llvm/Support/Error.h"
+#include "llvm/Support/MathExtras.h"
 
 using namespace llvm;
 namespace clang {
@@ -138,39 +140,52 @@ void writeVar(uint32_t I, raw_ostream &OS) {
 // CompressedData is a zlib-compressed byte[UncompressedSize].
 // It contains a sequence of null-terminated strings, e.g. "foo\0bar\0".
 // These are sorted to improve compression.
-
-// Maps each string to a canonical representation.
-// Strings remain owned externally (e.g. by SymbolSlab).
+// An uncompressed table can be used in place: the strings are null-terminated,
+// so symbols can point straight into the file data.
+//
+// If the file was written with a string dictionary, the strings of the
+// dictionary follow those of the table: the N strings of the table have
+// indexes 0 to N-1, the dictionary strings N and up.
+
+// Assigns each distinct string an index.
+// Strings remain owned externally (e.g. by SymbolSlab). They are looked up by
+// content, so the data being written needn't be copied to point to canonical
+// strings.
 class StringTableOut {
   DenseSet<StringRef> Unique;
   std::vector<StringRef> Sorted;
-  // Since strings are interned, look up can be by pointer.
-  DenseMap<std::pair<const char *, size_t>, unsigned> Index;
+  DenseMap<StringRef, unsigned> Index;
+  const StringDictionary *Dictionary;
 
 public:
-  StringTableOut() {
+  StringTableOut(const StringDictionary *Dictionary = nullptr)
+      : Dictionary(Dictionary) {
     // Ensure there's at least one string in the table.
     // Table size zero is reserved to indicate no compression.
     Unique.insert("");
   }
-  // Add a string to the table. Overwrites S if an identical string exists.
-  void intern(StringRef &S) { S = *Unique.insert(S).first; };
+  // Add a string to the table.
+  void intern(StringRef S) { Unique.insert(S); };
   // Finalize the table and write it to OS. No more strings may be added.
-  void finalize(raw_ostream &OS) {
-    Sorted = {Unique.begin(), Unique.end()};
+  void finalize(raw_ostream &OS, bool Compress) {
+    for (StringRef S : Unique)
+      // The empty string is kept, so that the table isn't empty.
+      if (!Dictionary || S.empty() || !Dictionary->index(S))
+        Sorted.push_back(S);
     llvm::sort(Sorted);
     for (unsigned I = 0; I < Sorted.size(); ++I)
-      Index.try_emplace({Sorted[I].data(), Sorted[I].size()}, I);
+      Index.try_emplace(Sorted[I], I);
 
     std::string RawTable;
     for (StringRef S : Sorted) {
       RawTable.append(S);
       RawTable.push_back(0);
     }
-    if (zlib::isAvailable()) {
+    if (Compress && zlib::isAvailable()) {
       SmallString<1> Compressed;
       cantFail(zlib::compress(RawTable, Compressed));
       write32(RawTable.size(), OS);
+      std::string().swap(RawTable); // Release it before copying Compressed.
       OS << Compressed;
     } else {
       write32(0, OS); // No compression.
@@ -180,41 +195,51 @@ public:
   // Get the ID of an string, which must be interned. Table must be finalized.
   unsigned index(StringRef S) const {
     assert(!Sorted.empty() && "table not finalized");
-    assert(Index.count({S.data(), S.size()}) && "string not interned");
-    return Index.find({S.data(), S.size()})->second;
+    auto It = Index.find(S);
+    if (It != Index.end())
+      return It->second;
+    assert(Dictionary && Dictionary->index(S) && "string not interned");
+    return Sorted.size() + *Dictionary->index(S);
   }
 };
 
+// The strings point into the read data or into the decompressed table, they
+// are not copied: the slab builders copy the strings they need anyway, unless
+// the strings are borrowed from the file data.
 struct StringTableIn {
-  BumpPtrAllocator Arena;
+  // No inline storage, so that moving the table doesn't move the characters.
+  SmallVector<char, 0> Uncompressed;
   std::vector<StringRef> Strings;
+  // Whether Strings point into the data the table was read from, and may be
+  // used after the table is destroyed.
+  bool Borrowed = false;
 };
 
-Expected<StringTableIn> readStringTable(StringRef Data) {
+// If CopyStrings is false, strings of an uncompressed table may be borrowed.
+Expected<StringTableIn> readStringTable(StringRef Data, bool CopyStrings) {
   Reader R(Data);
   size_t UncompressedSize = R.consume32();
   if (R.err())
     return makeError("Truncated string table");
 
+  StringTableIn Table;
   StringRef Uncompressed;
-  SmallString<1> UncompressedStorage;
   if (UncompressedSize == 0) // No compression
     Uncompressed = R.rest();
   else {
-    if (Error E = llvm::zlib::uncompress(R.rest(), UncompressedStorage,
+    if (Error E = llvm::zlib::uncompress(R.rest(), Table.Uncompressed,
                                          UncompressedSize))
       return std::move(E);
-    Uncompressed = UncompressedStorage;
+    Uncompressed = StringRef(Table.Uncompressed.data(),
+                             Table.Uncompressed.size());
   }
 
-  StringTableIn Table;
-  StringSaver Saver(Table.Arena);
-  R = Reader(Uncompressed);
+  Table.Borrowed = UncompressedSize == 0 && !CopyStrings;
   for (Reader R(Uncompressed); !R.eof();) {
     auto Len = R.rest().find(0);
     if (Len == StringRef::npos)
       return makeError("Bad string table: not null terminated");
-    Table.Strings.push_back(Saver.save(R.consume(Len)));
+    Table.Strings.push_back(R.consume(Len));
     R.consume8();
   }
   if (R.err())
@@ -329,21 +354,99 @@ std::pair<SymbolID, std::vector<Ref>> readRefs(Reader &Data,
   return Result;
 }
 
+// POSTINGS ENCODING
+// A postings section describes the DocIDs Dex assigns to the symbols, followed
+// by the posting lists:
+//  - NumDocs: varint
+//  - SymbolOrder[NumDocs]: varint, index of the symbol in the symb section
+//  - SymbolQuality[NumDocs]: 4 bytes, IEEE-754 float
+//  - then until the end of the section, one entry per token:
+//    - Kind: 1 byte
+//    - Data: varint length, then raw bytes
+//    - NumChunks: varint
+//    - Chunk[NumChunks]: 4 byte head, then the VByte payload verbatim
+
+void writePostings(const dex::Postings &P, raw_ostream &OS) {
+  writeVar(P.SymbolOrder.size(), OS);
+  for (uint32_t Index : P.SymbolOrder)
+    writeVar(Index, OS);
+  for (float Quality : P.SymbolQuality)
+    write32(FloatToBits(Quality), OS);
+  for (const auto &TokenAndList : P.InvertedIndex) {
+    const dex::Token &Tok = TokenAndList.first;
+    OS.write(static_cast<uint8_t>(Tok.TokenKind));
+    writeVar(Tok.Data.size(), OS);
+    OS << Tok.Data;
+    auto Chunks = TokenAndList.second.chunks();
+    writeVar(Chunks.size(), OS);
+    for (const dex::Chunk &C : Chunks) {
+      write32(C.Head, OS);
+      OS.write(reinterpret_cast<const char *>(C.Payload.data()),
+               C.Payload.size());
+    }
+  }
+}
+
+Expected<dex::Postings> readPostings(StringRef Data, size_t NumSymbols) {
+  Reader R(Data);
+  dex::Postings Result;
+  size_t NumDocs = R.consumeVar();
+  if (NumDocs != NumSymbols)
+    return makeError("postings don't match symbols");
+  Result.SymbolOrder.resize(NumDocs);
+  for (auto &Index : Result.SymbolOrder)
+    if ((Index = R.consumeVar()) >= NumSymbols)
+      return makeError("bad symbol index in postings");
+  Result.SymbolQuality.resize(NumDocs);
+  for (auto &Quality : Result.SymbolQuality)
+    Quality = BitsToFloat(R.consume32());
+
+  while (!R.eof()) {
+    auto Kind = static_cast<dex::Token::Kind>(R.consume8());
+    if (Kind > dex::Token::Kind::Sentinel)
+      return makeError("bad token kind in postings");
+    dex::Token Tok(Kind, R.consume(R.consumeVar()));
+    std::vector<dex::Chunk> Chunks(R.consumeVar());
+    if (R.err() || Chunks.size() > R.rest().size() / sizeof(dex::Chunk))
+      return makeError("malformed or truncated postings");
+    for (auto &C : Chunks) {
+      C.Head = R.consume32();
+      StringRef Payload = R.consume(C.Payload.size());
+      std::copy(Payload.bytes_begin(), Payload.bytes_end(), C.Payload.begin());
+      // DocIDs index the symbols directly, so reject corrupted lists up front.
+      if (R.err() || C.decompress().back() >= NumDocs)
+        return makeError("bad DocID in postings");
+    }
+    Result.InvertedIndex.try_emplace(std::move(Tok), std::move(Chunks));
+  }
+  if (R.err())
+    return makeError("malformed or truncated postings");
+  return std::move(Result);
+}
+
 // FILE ENCODING
 // A file is a RIFF chunk with type 'CdIx'.
 // It contains the sections:
 //   - meta: version number
 //   - srcs: checksum of the source file
+//   - deps: checksums of the files the source file depends on
 //   - stri: string table
+//   - dict: hash of the string dictionary the string table refers to, as two
+//           uint32 (low bits first)
 //   - symb: symbols
 //   - refs: references to symbols
+//   - post: Dex posting lists over symbols
+//   - docs: block-compressed documentation of the symbols, in symb order. If
+//           present, the documentation in symb is empty.
 
 // The current versioning scheme is simple - non-current versions are rejected.
 // If you make a breaking change, bump this version number to invalidate stored
 // data. Later we may want to support some backward compatibility.
-constexpr static uint32_t Version = 8;
+constexpr static uint32_t Version = 10;
 
-Expected<IndexFileIn> readRIFF(StringRef Data) {
+Expected<IndexFileIn> readRIFF(StringRef Data, bool CopyStrings,
+                               bool DecompressDocumentation,
+                               const StringDictionary *Dictionary) {
   auto RIFF = riff::readFile(Data);
   if (!RIFF)
     return RIFF.takeError();
@@ -361,9 +464,21 @@ Expected<IndexFileIn> readRIFF(StringRef Data) {
   if (Meta.consume32() != Version)
     return makeError("wrong version");
 
-  auto Strings = readStringTable(Chunks.lookup("stri"));
+  auto Strings = readStringTable(Chunks.lookup("stri"), CopyStrings);
   if (!Strings)
     return Strings.takeError();
+  if (Chunks.count("dict")) {
+    Reader Dict(Chunks.lookup("dict"));
+    uint64_t Hash = Dict.consume32();
+    Hash |= uint64_t(Dict.consume32()) << 32;
+    if (Dict.err())
+      return makeError("malformed or truncated string dictionary hash");
+    if (!Dictionary || Dictionary->hash() != Hash)
+      return makeError("missing the string dictionary of the file");
+    Strings->Strings.insert(Strings->Strings.end(),
+                            Dictionary->strings().begin(),
+                            Dictionary->strings().end());
+  }
 
   IndexFileIn Result;
   if (Chunks.count("srcs")) {
@@ -372,19 +487,56 @@ Expected<IndexFileIn> readRIFF(StringRef Data) {
     llvm::StringRef Digest = Hash.consume(Result.Digest->size());
     std::copy(Digest.bytes_begin(), Digest.bytes_end(), Result.Digest->begin());
   }
+  if (Chunks.count("deps")) {
+    // A sequence of (path length, path, digest).
+    Reader Deps(Chunks.lookup("deps"));
+    Result.Dependencies.emplace();
+    while (!Deps.eof()) {
+      StringRef Path = Deps.consume(Deps.consumeVar());
+      StringRef Digest = Deps.consume(IndexFileIn::FileDigest().size());
+      if (Deps.err())
+        return makeError("malformed or truncated dependencies");
+      std::copy(Digest.bytes_begin(), Digest.bytes_end(),
+                (*Result.Dependencies)[Path].begin());
+    }
+  }
 
+  Optional<CompressedStrings> Docs;
+  if (Chunks.count("docs")) {
+    auto D = CompressedStrings::fromData(Chunks.lookup("docs"),
+                                         /*CopyData=*/CopyStrings);
+    if (!D)
+      return D.takeError();
+    Docs = std::move(*D);
+  }
   if (Chunks.count("symb")) {
     Reader SymbolReader(Chunks.lookup("symb"));
-    SymbolSlab::Builder Symbols;
-    while (!SymbolReader.eof())
-      Symbols.insert(readSymbol(SymbolReader, Strings->Strings));
+    // The decompressed documentation must be copied.
+    bool Decompress = Docs && DecompressDocumentation;
+    SymbolSlab::Builder Symbols(/*CopyStrings=*/!Strings->Borrowed ||
+                                Decompress);
+    size_t NumSymbols = 0;
+    while (!SymbolReader.eof()) {
+      Symbol Sym = readSymbol(SymbolReader, Strings->Strings);
+      std::string Doc;
+      if (Decompress && NumSymbols < Docs->size()) {
+        Doc = Docs->get(NumSymbols);
+        Sym.Documentation = Doc;
+      }
+      Symbols.insert(Sym);
+      ++NumSymbols;
+    }
     if (SymbolReader.err())
       return makeError("malformed or truncated symbol");
+    if (Docs && Docs->size() != NumSymbols)
+      return makeError("documentation doesn't match the symbols");
     Result.Symbols = std::move(Symbols).build();
   }
+  if (Docs && !DecompressDocumentation)
+    Result.Documentation = std::move(Docs);
   if (Chunks.count("refs")) {
     Reader RefsReader(Chunks.lookup("refs"));
-    RefSlab::Builder Refs;
+    RefSlab::Builder Refs(/*CopyStrings=*/!Strings->Borrowed);
     while (!RefsReader.eof()) {
       auto RefsBundle = readRefs(RefsReader, Strings->Strings);
       for (const auto &Ref : RefsBundle.second) // FIXME: bulk insert?
@@ -394,6 +546,15 @@ Expected<IndexFileIn> readRIFF(StringRef Data) {
       return makeError("malformed or truncated refs");
     Result.Refs = std::move(Refs).build();
   }
+  if (Chunks.count("post")) {
+    // Posting lists refer to symbols by position in the symb section. As the
+    // section is written in slab order, this is also the order of the slab.
+    auto Postings = readPostings(Chunks.lookup("post"),
+                                 Result.Symbols ? Result.Symbols->size() : 0);
+    if (!Postings)
+      return Postings.takeError();
+    Result.Postings = std::move(*Postings);
+  }
   return std::move(Result);
 }
 
@@ -415,36 +576,84 @@ void writeRIFF(const IndexFileOut &Data, raw_ostream &OS) {
     RIFF.Chunks.push_back({riff::fourCC("srcs"), Hash});
   }
 
-  StringTableOut Strings;
-  std::vector<Symbol> Symbols;
-  for (const auto &Sym : *Data.Symbols) {
-    Symbols.emplace_back(Sym);
-    visitStrings(Symbols.back(), [&](StringRef &S) { Strings.intern(S); });
-  }
-  std::vector<std::pair<SymbolID, std::vector<Ref>>> Refs;
-  if (Data.Refs) {
-    for (const auto &Sym : *Data.Refs) {
-      Refs.emplace_back(Sym);
-      for (auto &Ref : Refs.back().second) {
-        StringRef File = Ref.Location.FileURI;
-        Strings.intern(File);
-        Ref.Location.FileURI = File.data();
+  std::string DepsSection;
+  if (Data.Dependencies) {
+    {
+      raw_string_ostream DepsOS(DepsSection);
+      std::vector<StringRef> Paths;
+      for (const auto &Dep : *Data.Dependencies)
+        Paths.push_back(Dep.first());
+      llvm::sort(Paths); // For deterministic output.
+      for (StringRef Path : Paths) {
+        const auto &Digest = Data.Dependencies->find(Path)->second;
+        writeVar(Path.size(), DepsOS);
+        DepsOS << Path;
+        DepsOS.write(reinterpret_cast<const char *>(Digest.data()),
+                     Digest.size());
       }
     }
+    RIFF.Chunks.push_back({riff::fourCC("deps"), DepsSection});
   }
 
+  // The symbols and refs are written straight from the slabs, large indexes
+  // can't afford another copy of them.
+  StringTableOut Strings(Data.Dictionary);
+  std::vector<StringRef> Docs;
+  for (const auto &Sym : *Data.Symbols) {
+    Symbol Copy = Sym; // visitStrings() needs a mutable symbol.
+    if (Data.CompressDocumentation) {
+      Docs.push_back(Sym.Documentation);
+      Copy.Documentation = "";
+    }
+    visitStrings(Copy, [&](StringRef &S) { Strings.intern(S); });
+  }
+  if (Data.Refs)
+    for (const auto &Sym : *Data.Refs)
+      for (const auto &Ref : Sym.second)
+        Strings.intern(Ref.Location.FileURI);
+
   std::string StringSection;
   {
     raw_string_ostream StringOS(StringSection);
-    Strings.finalize(StringOS);
+    Strings.finalize(StringOS, Data.CompressStrings);
+  }
+  // Pad the file so that an uncompressed string table starts on a page
+  // boundary, which keeps the strings of a mapped file on as few pages as
+  // possible. Chunk sizes are even, so the padding is too.
+  std::string Padding;
+  if (!Data.CompressStrings) {
+    constexpr size_t PageSize = 4096;
+    // RIFF header, preceding chunks, then the pad and stri chunk headers.
+    size_t Offset = 12 + 8 + 8;
+    for (const auto &C : RIFF.Chunks)
+      Offset += 8 + C.Data.size() + C.Data.size() % 2;
+    Padding.assign((PageSize - Offset % PageSize) % PageSize, '\0');
+    RIFF.Chunks.push_back({riff::fourCC("pad "), Padding});
   }
   RIFF.Chunks.push_back({riff::fourCC("stri"), StringSection});
 
+  SmallString<8> DictionarySection;
+  if (Data.Dictionary) {
+    {
+      raw_svector_ostream DictionaryOS(DictionarySection);
+      write32(Data.Dictionary->hash(), DictionaryOS);
+      write32(Data.Dictionary->hash() >> 32, DictionaryOS);
+    }
+    RIFF.Chunks.push_back({riff::fourCC("dict"), DictionarySection});
+  }
+
   std::string SymbolSection;
   {
     raw_string_ostream SymbolOS(SymbolSection);
-    for (const auto &Sym : Symbols)
-      writeSymbol(Sym, Strings, SymbolOS);
+    for (const auto &Sym : *Data.Symbols) {
+      if (!Data.CompressDocumentation) {
+        writeSymbol(Sym, Strings, SymbolOS);
+        continue;
+      }
+      Symbol Copy = Sym;
+      Copy.Documentation = "";
+      writeSymbol(Copy, Strings, SymbolOS);
+    }
   }
   RIFF.Chunks.push_back({riff::fourCC("symb"), SymbolSection});
 
@@ -452,12 +661,28 @@ void writeRIFF(const IndexFileOut &Data, raw_ostream &OS) {
   if (Data.Refs) {
     {
       raw_string_ostream RefsOS(RefsSection);
-      for (const auto &Sym : Refs)
+      for (const auto &Sym : *Data.Refs)
         writeRefs(Sym.first, Sym.second, Strings, RefsOS);
     }
     RIFF.Chunks.push_back({riff::fourCC("refs"), RefsSection});
   }
 
+  std::string PostingsSection;
+  if (Data.Postings) {
+    {
+      raw_string_ostream PostingsOS(PostingsSection);
+      writePostings(*Data.Postings, PostingsOS);
+    }
+    RIFF.Chunks.push_back({riff::fourCC("post"), PostingsSection});
+  }
+
+  // Only the compressed blocks are kept, not the documentation they hold.
+  CompressedStrings CompressedDocs;
+  if (Data.CompressDocumentation) {
+    CompressedDocs = CompressedStrings(Docs);
+    RIFF.Chunks.push_back({riff::fourCC("docs"), CompressedDocs.data()});
+  }
+
   OS << RIFF;
 }
 
@@ -479,9 +704,11 @@ raw_ostream &operator<<(raw_ostream &OS, const IndexFileOut &O) {
   return OS;
 }
 
-Expected<IndexFileIn> readIndexFile(StringRef Data) {
+Expected<IndexFileIn> readIndexFile(StringRef Data, bool CopyStrings,
+                                    bool DecompressDocumentation,
+                                    const StringDictionary *Dictionary) {
   if (Data.startswith("RIFF")) {
-    return readRIFF(Data);
+    return readRIFF(Data, CopyStrings, DecompressDocumentation, Dictionary);
   } else if (auto YAMLContents = readYAML(Data)) {
     return std::move(*YAMLContents);
   } else {
@@ -492,21 +719,31 @@ Expected<IndexFileIn> readIndexFile(StringRef Data) {
 
 std::unique_ptr<SymbolIndex> loadIndex(StringRef SymbolFilename, bool UseDex) {
   trace::Span OverallTracer("LoadIndex");
-  auto Buffer = MemoryBuffer::getFile(SymbolFilename);
+  // Large files are memory-mapped. If the string table is uncompressed, the
+  // symbols refer to it in place and the index keeps the mapping alive.
+  auto Buffer = MemoryBuffer::getFile(SymbolFilename, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
   if (!Buffer) {
     errs() << "Can't open " << SymbolFilename << "\n";
     return nullptr;
   }
+  std::shared_ptr<MemoryBuffer> File = std::move(*Buffer);
 
   SymbolSlab Symbols;
   RefSlab Refs;
+  Optional<dex::Postings> Postings;
+  Optional<CompressedStrings> Docs;
   {
     trace::Span Tracer("ParseIndex");
-    if (auto I = readIndexFile(Buffer->get()->getBuffer())) {
+    // Dex can keep compressed documentation compressed.
+    if (auto I = readIndexFile(File->getBuffer(), /*CopyStrings=*/false,
+                               /*DecompressDocumentation=*/!UseDex)) {
       if (I->Symbols)
         Symbols = std::move(*I->Symbols);
       if (I->Refs)
         Refs = std::move(*I->Refs);
+      Postings = std::move(I->Postings);
+      Docs = std::move(I->Documentation);
     } else {
       errs() << "Bad Index: " << toString(I.takeError()) << "\n";
       return nullptr;
@@ -517,13 +754,39 @@ std::unique_ptr<SymbolIndex> loadIndex(StringRef SymbolFilename, bool UseDex) {
   size_t NumRefs = Refs.numRefs();
 
   trace::Span Tracer("BuildIndex");
-  auto Index = UseDex ? dex::Dex::build(std::move(Symbols), std::move(Refs))
-                      : MemIndex::build(std::move(Symbols), std::move(Refs));
+  // The mapped file lives in the shared page cache, so it isn't counted.
+  size_t BackingDataSize = Symbols.bytes() + Refs.bytes();
+  auto Data = std::make_tuple(std::move(Symbols), std::move(Refs),
+                              std::move(File));
+  std::unique_ptr<SymbolIndex> Index;
+  if (!UseDex)
+    Index = llvm::make_unique<MemIndex>(std::get<0>(Data), std::get<1>(Data),
+                                        std::move(Data), BackingDataSize);
+  else if (Docs) {
+    if (!Postings) {
+      std::vector<const Symbol *> Pointers;
+      for (const auto &Sym : std::get<0>(Data))
+        Pointers.push_back(&Sym);
+      Postings = dex::buildPostings(Pointers);
+    }
+    Index = llvm::make_unique<dex::Dex>(
+        std::get<0>(Data), std::get<1>(Data), std::move(*Postings),
+        std::move(*Docs), std::move(Data), BackingDataSize);
+  } else if (Postings)
+    Index = llvm::make_unique<dex::Dex>(std::get<0>(Data), std::get<1>(Data),
+                                        std::move(*Postings), std::move(Data),
+                                        BackingDataSize);
+  else
+    Index = llvm::make_unique<dex::Dex>(std::get<0>(Data), std::get<1>(Data),
+                                        std::move(Data), BackingDataSize);
   vlog("Loaded {0} from {1} with estimated memory usage {2} bytes\n"
        "  - number of symbols: {3}\n"
-       "  - number of refs: {4}\n",
+       "  - number of refs: {4}\n"
+       "  - prebuilt posting lists: {5}\n"
+       "  - compressed documentation: {6}\n",
        UseDex ? "Dex" : "MemIndex", SymbolFilename,
-       Index->estimateMemoryUsage(), NumSym, NumRefs);
+       Index->estimateMemoryUsage(), NumSym, NumRefs, Postings.hasValue(),
+       Docs.hasValue());
   return Index;
 }
 
@@ -13,6 +13,7 @@
 //  - metadata such as version info
 //  - a string table (which is compressed)
 //  - lists of encoded symbols
+//  - optionally, prebuilt Dex posting lists
 //
 // The format has a simple versioning scheme: the format version number is
 // written in the file and non-current versions are rejected when reading.
@@ -24,7 +25,11 @@
 
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_RIFF_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_RIFF_H
+#include "CompressedStrings.h"
 #include "Index.h"
+#include "StringDictionary.h"
+#include "dex/PostingList.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/Error.h"
 
 namespace clang {
@@ -42,9 +47,26 @@ struct IndexFileIn {
   llvm::Optional<RefSlab> Refs;
   // Digest of the source file that generated the contents.
   llvm::Optional<FileDigest> Digest;
+  // Digests of all the files the source file depended on when it was indexed,
+  // keyed by absolute path.
+  llvm::Optional<llvm::StringMap<FileDigest>> Dependencies;
+  // Dex posting lists over Symbols, in slab order.
+  llvm::Optional<dex::Postings> Postings;
+  // The documentation of Symbols, in slab order, if it was compressed and left
+  // so. Symbols then have no documentation.
+  llvm::Optional<CompressedStrings> Documentation;
 };
 // Parse an index file. The input must be a RIFF or YAML file.
-llvm::Expected<IndexFileIn> readIndexFile(llvm::StringRef);
+// If CopyStrings is false and the file has an uncompressed string table, the
+// returned slabs point into \p Data, which must outlive them.
+// If DecompressDocumentation is false, compressed documentation is returned in
+// IndexFileIn::Documentation rather than in the symbols.
+// A file written with a string dictionary can only be read with \p Dictionary,
+// which must outlive the result unless the strings are copied.
+llvm::Expected<IndexFileIn>
+readIndexFile(llvm::StringRef Data, bool CopyStrings = true,
+              bool DecompressDocumentation = true,
+              const StringDictionary *Dictionary = nullptr);
 
 // Specifies the contents of an index file to be written.
 struct IndexFileOut {
@@ -52,13 +74,31 @@ struct IndexFileOut {
   const RefSlab *Refs = nullptr;
   // Digest of the source file that generated the contents.
   const IndexFileIn::FileDigest *Digest = nullptr;
-  // TODO: Support serializing Dex posting lists.
+  // Digests of the files the source file depends on. Only supported by the
+  // RIFF format.
+  const llvm::StringMap<IndexFileIn::FileDigest> *Dependencies = nullptr;
+  // Dex posting lists built over Symbols (in slab order) by
+  // dex::buildPostings(). Only supported by the RIFF format.
+  const dex::Postings *Postings = nullptr;
   IndexFileFormat Format = IndexFileFormat::RIFF;
+  // Whether the RIFF string table may be compressed. An uncompressed table is
+  // page-aligned and can be used in place when the file is memory-mapped, so
+  // processes loading the same index share its strings through the page cache.
+  bool CompressStrings = true;
+  // Whether the documentation of the symbols is written apart from the string
+  // table, in compressed blocks of a few symbols. Only supported by the RIFF
+  // format. A Dex index loaded from the file keeps the blocks compressed and
+  // decompresses the documentation of the symbols it returns.
+  bool CompressDocumentation = false;
+  // If set, the string table refers to the strings of the dictionary rather
+  // than storing them. Only supported by the RIFF format.
+  const StringDictionary *Dictionary = nullptr;
 
   IndexFileOut() = default;
   IndexFileOut(const IndexFileIn &I)
       : Symbols(I.Symbols ? I.Symbols.getPointer() : nullptr),
-        Refs(I.Refs ? I.Refs.getPointer() : nullptr) {}
+        Refs(I.Refs ? I.Refs.getPointer() : nullptr),
+        Postings(I.Postings ? I.Postings.getPointer() : nullptr) {}
 };
 // Serializes an index file.
 llvm::raw_ostream &operator<<(llvm::raw_ostream &OS, const IndexFileOut &O);
@@ -69,6 +109,8 @@ std::string toYAML(const std::pair<SymbolID, ArrayRef<Ref>> &);
 
 // Build an in-memory static index from an index file.
 // The size should be relatively small, so data can be managed in memory.
+// If the file has an uncompressed string table, it is memory-mapped and the
+// index refers to the strings in place.
 std::unique_ptr<SymbolIndex> loadIndex(llvm::StringRef Filename,
                                        bool UseDex = true);
 
@@ -0,0 +1,98 @@
+//===--- StringDictionary.cpp - Strings shared by index files -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StringDictionary.h"
+#include "Serialization.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/xxhash.h"
+#include <algorithm>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+
+void StringDictionary::Builder::addSample(const IndexFileOut &File) {
+  // Strings are counted once per sample.
+  DenseSet<StringRef> Unique;
+  if (File.Symbols)
+    for (const auto &Sym : *File.Symbols) {
+      Symbol Copy = Sym; // visitStrings() needs a mutable symbol.
+      visitStrings(Copy, [&](StringRef &S) { Unique.insert(S); });
+    }
+  if (File.Refs)
+    for (const auto &Sym : *File.Refs)
+      for (const auto &Ref : Sym.second)
+        Unique.insert(Ref.Location.FileURI);
+  for (StringRef S : Unique)
+    // The string table of a file always has the empty string.
+    if (!S.empty() && S.find('\0') == StringRef::npos)
+      ++Occurrences[S];
+  ++NumSamples;
+}
+
+StringDictionary StringDictionary::Builder::build() const {
+  unsigned MinOccurrences = std::max<size_t>(2, (NumSamples + 3) / 4);
+  std::vector<std::pair<unsigned, StringRef>> Candidates;
+  for (const auto &Entry : Occurrences)
+    if (Entry.second >= MinOccurrences)
+      Candidates.emplace_back(Entry.second, Entry.first());
+  // Keep the most shared strings, and the longest of those.
+  llvm::sort(Candidates, [](const std::pair<unsigned, StringRef> &L,
+                            const std::pair<unsigned, StringRef> &R) {
+    if (L.first != R.first)
+      return L.first > R.first;
+    if (L.second.size() != R.second.size())
+      return L.second.size() > R.second.size();
+    return L.second < R.second;
+  });
+  if (Candidates.size() > MaxStrings)
+    Candidates.resize(MaxStrings);
+
+  std::vector<StringRef> Strings;
+  for (const auto &Candidate : Candidates)
+    Strings.push_back(Candidate.second);
+  llvm::sort(Strings); // For deterministic output.
+  std::string Data;
+  for (StringRef S : Strings) {
+    Data.append(S);
+    Data.push_back(0);
+  }
+  return cantFail(StringDictionary::fromData(Data));
+}
+
+Expected<StringDictionary> StringDictionary::fromData(StringRef Data) {
+  if (!Data.empty() && Data.back() != 0)
+    return make_error<StringError>("Bad string dictionary: not null terminated",
+                                   inconvertibleErrorCode());
+  StringDictionary Result;
+  Result.Data.assign(Data.begin(), Data.end());
+  Result.Hash = xxHash64(Data);
+  for (StringRef Rest = Result.data(); !Rest.empty();) {
+    size_t Len = Rest.find('\0');
+    StringRef S = Rest.take_front(Len);
+    Result.Index.try_emplace(S, Result.Strings.size());
+    Result.Strings.push_back(S);
+    Rest = Rest.drop_front(Len + 1);
+  }
+  if (Result.Strings.size() > MaxStrings)
+    return make_error<StringError>("Bad string dictionary: too many strings",
+                                   inconvertibleErrorCode());
+  return std::move(Result);
+}
+
+Optional<unsigned> StringDictionary::index(StringRef S) const {
+  auto It = Index.find(S);
+  if (It == Index.end())
+    return None;
+  return It->second;
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,86 @@
+//===--- StringDictionary.h - Strings shared by index files -----*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_STRINGDICTIONARY_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_STRINGDICTIONARY_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+struct IndexFileOut;
+
+/// Strings shared by many small index files, e.g. the shards of the background
+/// index of a project. Most strings of a shard, like the URIs of the headers
+/// and the common scopes and types, are in many other shards. The string table
+/// of a file written with a dictionary refers to its strings instead of storing
+/// them, so the file is smaller and faster to read.
+///
+/// A file written with a dictionary can only be read with the same dictionary.
+class StringDictionary {
+public:
+  /// Collects the strings of sample index files, and keeps those that several
+  /// of them share.
+  class Builder {
+  public:
+    void addSample(const IndexFileOut &File);
+    size_t samples() const { return NumSamples; }
+    /// Builds a dictionary of the strings in at least a quarter of the
+    /// samples, and at least two.
+    StringDictionary build() const;
+
+  private:
+    // The number of samples each string occurs in.
+    llvm::StringMap<unsigned> Occurrences;
+    size_t NumSamples = 0;
+  };
+
+  /// The maximum number of strings of a dictionary. Their indexes must stay
+  /// small, as they are written for every string field.
+  static constexpr unsigned MaxStrings = 1 << 14;
+
+  StringDictionary() = default;
+  // Strings point into Data, so a copy would point into the original.
+  StringDictionary(const StringDictionary &) = delete;
+  StringDictionary &operator=(const StringDictionary &) = delete;
+  StringDictionary(StringDictionary &&) = default;
+  StringDictionary &operator=(StringDictionary &&) = default;
+
+  /// Reads a dictionary serialized by data().
+  static llvm::Expected<StringDictionary> fromData(llvm::StringRef Data);
+  /// The serialized dictionary: its strings, each followed by a null.
+  llvm::StringRef data() const {
+    return llvm::StringRef(Data.data(), Data.size());
+  }
+  /// Identifies the dictionary, so that files aren't read with another one.
+  uint64_t hash() const { return Hash; }
+
+  llvm::ArrayRef<llvm::StringRef> strings() const { return Strings; }
+  /// Returns the position of \p S in strings(), if it's there.
+  llvm::Optional<unsigned> index(llvm::StringRef S) const;
+
+private:
+  // Strings point into Data, whose characters don't move with it.
+  std::vector<char> Data;
+  std::vector<llvm::StringRef> Strings;
+  llvm::DenseMap<llvm::StringRef, unsigned> Index;
+  uint64_t Hash = 0;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_STRINGDICTIONARY_H
@@ -0,0 +1,78 @@
+//===--- StringPool.cpp - Strings shared between slabs --------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "StringPool.h"
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+
+static size_t entryBytes(const StringMapEntry<unsigned> &E) {
+  return sizeof(E) + E.getKeyLength() + 1;
+}
+
+StringPool::Lease &StringPool::Lease::operator=(Lease &&Other) {
+  if (this != &Other) {
+    release();
+    Pool = Other.Pool;
+    Entries = std::move(Other.Entries);
+    Other.Pool = nullptr;
+    Other.Entries.clear();
+  }
+  return *this;
+}
+
+void StringPool::Lease::release() {
+  if (!Pool || Entries.empty())
+    return;
+  std::lock_guard<std::mutex> Lock(Pool->Mu);
+  for (auto *E : Entries) {
+    if (--E->getValue() != 0)
+      continue;
+    Pool->Bytes -= entryBytes(*E);
+    Pool->Strings.remove(E);
+    E->Destroy(Pool->Strings.getAllocator());
+  }
+  Entries.clear();
+}
+
+StringPool::Lease
+StringPool::intern(DenseMap<StringRef, StringRef> &Strings) {
+  Lease Result;
+  Result.Pool = this;
+  Result.Entries.reserve(Strings.size());
+  std::lock_guard<std::mutex> Lock(Mu);
+  for (auto &S : Strings) {
+    auto It = this->Strings.try_emplace(S.first, 0).first;
+    if (It->second++ == 0)
+      Bytes += entryBytes(*It);
+    S.second = It->first();
+    Result.Entries.push_back(&*It);
+  }
+  return Result;
+}
+
+size_t StringPool::size() const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  return Strings.size();
+}
+
+size_t StringPool::bytes() const {
+  std::lock_guard<std::mutex> Lock(Mu);
+  return sizeof(*this) + Strings.getNumBuckets() * sizeof(void *) + Bytes;
+}
+
+StringPool &StringPool::global() {
+  // Never destroyed, as slabs in static objects may outlive it.
+  static StringPool *Pool = new StringPool();
+  return *Pool;
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,70 @@
+//===--- StringPool.h - Strings shared between slabs -------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Indexes that keep a slab per file (FileIndex, BackgroundIndex) would store
+// the strings common to many files, like scopes ("std::") and header URIs, in
+// each of the slabs. A StringPool stores them once for all slabs instead.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_STRINGPOOL_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_STRINGPOOL_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <mutex>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// A thread-safe table of refcounted strings. A string is freed once no lease
+/// holds it anymore.
+class StringPool {
+public:
+  /// Holds strings of the pool, and releases them when destroyed.
+  /// The pool must outlive its leases.
+  class Lease {
+  public:
+    Lease() = default;
+    Lease(Lease &&Other) { *this = std::move(Other); }
+    Lease &operator=(Lease &&Other);
+    ~Lease() { release(); }
+
+  private:
+    friend class StringPool;
+    void release();
+
+    StringPool *Pool = nullptr;
+    std::vector<llvm::StringMapEntry<unsigned> *> Entries;
+  };
+
+  /// Sets each value of \p Strings to the pooled copy of its key. The copies
+  /// are valid as long as the returned lease.
+  Lease intern(llvm::DenseMap<llvm::StringRef, llvm::StringRef> &Strings);
+
+  /// Returns the number of distinct strings in the pool.
+  size_t size() const;
+  size_t bytes() const;
+
+  /// The pool shared by the dynamic and background indexes.
+  static StringPool &global();
+
+private:
+  mutable std::mutex Mu;
+  // Values are the number of leases that hold the string.
+  llvm::StringMap<unsigned> Strings /* GUARDED_BY(Mu) */;
+  size_t Bytes /* GUARDED_BY(Mu) */ = 0;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_STRINGPOOL_H
@@ -18,6 +18,7 @@
 #include "clang/AST/Decl.h"
 #include "clang/AST/DeclBase.h"
 #include "clang/AST/DeclCXX.h"
+#include "clang/AST/DeclObjC.h"
 #include "clang/AST/DeclTemplate.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Basic/SourceManager.h"
@@ -250,7 +251,8 @@ template <class T> bool explicitTemplateSpecialization(const NamedDecl &ND) {
 
 } // namespace
 
-SymbolCollector::SymbolCollector(Options Opts) : Opts(std::move(Opts)) {}
+SymbolCollector::SymbolCollector(Options Opts)
+    : Symbols(Opts.Strings), Refs(Opts.Strings), Opts(std::move(Opts)) {}
 
 void SymbolCollector::initialize(ASTContext &Ctx) {
   ASTCtx = &Ctx;
@@ -364,10 +366,21 @@ bool SymbolCollector::handleDeclOccurence(
   // Don't continue indexing if this is a mere reference.
   if (IsOnlyRef)
     return true;
+  // Skip the declarations in files that are filtered out, e.g. headers that
+  // were indexed before. This saves computing signatures and documentation.
+  // A definition elsewhere may still add the canonical declaration below.
+  if (!shouldIndexFile(SM, SM.getFileID(SpellingLoc), Opts,
+                       &FilesToIndexCache))
+    return true;
 
   auto ID = getSymbolID(ND);
   if (!ID)
     return true;
+  if (Opts.IDCollisions) {
+    SmallString<128> USR;
+    if (!index::generateUSRForDecl(ND, USR))
+      Opts.IDCollisions->record(*ID, USR);
+  }
 
   const NamedDecl &OriginalDecl = *cast<NamedDecl>(ASTNode.OrigD);
   const Symbol *BasicSymbol = Symbols.find(*ID);
@@ -401,6 +414,9 @@ bool SymbolCollector::handleMacroOccurence(const IdentifierInfo *Name,
   // useful locations and are not needed for code completions.
   if (MI->isUsedForHeaderGuard() || MI->isBuiltinMacro())
     return true;
+  if (!shouldIndexFile(SM, SM.getFileID(SM.getSpellingLoc(DefLoc)), Opts,
+                       &FilesToIndexCache))
+    return true;
 
   // Mark the macro as referenced if this is a reference coming from the main
   // file. The macro may not be an interesting symbol, but it's cheaper to check
@@ -418,6 +434,12 @@ bool SymbolCollector::handleMacroOccurence(const IdentifierInfo *Name,
   auto ID = getSymbolID(*Name, MI, SM);
   if (!ID)
     return true;
+  if (Opts.IDCollisions) {
+    SmallString<128> USR;
+    if (!index::generateUSRForMacro(Name->getName(), MI->getDefinitionLoc(),
+                                    SM, USR))
+      Opts.IDCollisions->record(*ID, USR);
+  }
 
   // Only collect one instance in case there are multiple.
   if (Symbols.find(*ID) != nullptr)
@@ -429,8 +451,6 @@ bool SymbolCollector::handleMacroOccurence(const IdentifierInfo *Name,
   S.Flags |= Symbol::IndexedForCodeCompletion;
   S.SymInfo = index::getSymbolInfoForMacro(*MI);
   std::string FileURI;
-  // FIXME: use the result to filter out symbols.
-  shouldIndexFile(SM, SM.getFileID(Loc), Opts, &FilesToIndexCache);
   if (auto DeclLoc =
           getTokenLocation(DefLoc, SM, Opts, PP->getLangOpts(), FileURI))
     S.CanonicalDeclaration = *DeclLoc;
@@ -507,8 +527,8 @@ void SymbolCollector::finish() {
       if (auto ID = getSymbolID(It.first)) {
         for (const auto &LocAndRole : It.second) {
           auto FileID = SM.getFileID(LocAndRole.first);
-          // FIXME: use the result to filter out references.
-          shouldIndexFile(SM, FileID, Opts, &FilesToIndexCache);
+          if (!shouldIndexFile(SM, FileID, Opts, &FilesToIndexCache))
+            continue;
           if (auto FileURI = GetURI(FileID)) {
             auto Range =
                 getTokenRange(LocAndRole.first, SM, ASTCtx->getLangOpts());
@@ -549,8 +569,6 @@ const Symbol *SymbolCollector::addDeclaration(const NamedDecl &ND,
   S.SymInfo = index::getSymbolInfo(&ND);
   std::string FileURI;
   auto Loc = findNameLoc(&ND);
-  // FIXME: use the result to filter out symbols.
-  shouldIndexFile(SM, SM.getFileID(Loc), Opts, &FilesToIndexCache);
   if (auto DeclLoc =
           getTokenLocation(Loc, SM, Opts, ASTCtx->getLangOpts(), FileURI))
     S.CanonicalDeclaration = *DeclLoc;
@@ -560,17 +578,28 @@ const Symbol *SymbolCollector::addDeclaration(const NamedDecl &ND,
   assert(ASTCtx && PP.get() && "ASTContext and Preprocessor must be set.");
   // We use the primary template, as clang does during code completion.
   CodeCompletionResult SymbolCompletion(&getTemplateOrThis(ND), 0);
-  const auto *CCS = SymbolCompletion.CreateCodeCompletionString(
-      *ASTCtx, *PP, CodeCompletionContext::CCC_Symbol, *CompletionAllocator,
-      *CompletionTUInfo,
-      /*IncludeBriefComments*/ false);
+  bool WantSignature = !Opts.SkipUnusedCompletionInfo ||
+                       (S.Flags & Symbol::IndexedForCodeCompletion);
+  bool WantDocumentation = WantSignature || isa<FunctionDecl>(ND) ||
+                           isa<FunctionTemplateDecl>(ND) ||
+                           isa<ObjCMethodDecl>(ND);
   std::string Signature;
   std::string SnippetSuffix;
-  getSignature(*CCS, &Signature, &SnippetSuffix);
-  std::string Documentation =
-      formatDocumentation(*CCS, getDocComment(Ctx, SymbolCompletion,
-                                              /*CommentsFromHeaders=*/true));
-  std::string ReturnType = getReturnType(*CCS);
+  std::string Documentation;
+  std::string ReturnType;
+  if (WantDocumentation) {
+    const auto *CCS = SymbolCompletion.CreateCodeCompletionString(
+        *ASTCtx, *PP, CodeCompletionContext::CCC_Symbol, *CompletionAllocator,
+        *CompletionTUInfo,
+        /*IncludeBriefComments*/ false);
+    if (WantSignature) {
+      getSignature(*CCS, &Signature, &SnippetSuffix);
+      ReturnType = getReturnType(*CCS);
+    }
+    Documentation =
+        formatDocumentation(*CCS, getDocComment(Ctx, SymbolCompletion,
+                                                /*CommentsFromHeaders=*/true));
+  }
 
   std::string Include;
   if (Opts.CollectIncludePath && shouldCollectIncludePath(S.SymInfo.Kind)) {
@@ -612,8 +641,6 @@ void SymbolCollector::addDefinition(const NamedDecl &ND,
   std::string FileURI;
   auto Loc = findNameLoc(&ND);
   const auto &SM = ND.getASTContext().getSourceManager();
-  // FIXME: use the result to filter out symbols.
-  shouldIndexFile(SM, SM.getFileID(Loc), Opts, &FilesToIndexCache);
   if (auto DefLoc =
           getTokenLocation(Loc, SM, Opts, ASTCtx->getLangOpts(), FileURI))
     S.Definition = *DefLoc;
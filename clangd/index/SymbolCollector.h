@@ -75,6 +75,17 @@ public:
     /// If this is set, only collect symbols/references from a file if
     /// `FileFilter(SM, FID)` is true. If not set, all files are indexed.
     std::function<bool(const SourceManager &, FileID)> FileFilter = nullptr;
+    /// If set, strings of the collected symbols and refs are stored in this
+    /// pool rather than in their slabs.
+    StringPool *Strings = nullptr;
+    /// If set, the signature, snippet suffix and return type are only
+    /// collected for symbols indexed for code completion, which shows them.
+    /// Documentation is also collected for functions, whose docs signature
+    /// help looks up. This spares formatting e.g. fields and nested types.
+    bool SkipUnusedCompletionInfo = false;
+    /// If set, the USR of each declaration and macro definition is recorded
+    /// in it with its SymbolID, to find IDs shared by different symbols.
+    SymbolIDCollisionDetector *IDCollisions = nullptr;
   };
 
   SymbolCollector(Options Opts);
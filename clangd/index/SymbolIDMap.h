@@ -0,0 +1,117 @@
+//===--- SymbolIDMap.h - Immutable map keyed by SymbolID ---------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SYMBOLIDMAP_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SYMBOLIDMAP_H
+
+#include "Index.h"
+#include "llvm/Support/Endian.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+
+/// An immutable map from SymbolIDs to values, for indexes that are built once.
+/// The IDs and values are stored in two sorted arrays, which take 8 bytes plus
+/// sizeof(T) per entry, where a DenseMap has buckets of both and keeps up to a
+/// quarter of them empty.
+///
+/// SymbolIDs are hashes, so they are uniformly distributed and lookups use
+/// interpolation search, which needs O(log log N) probes on average. Lookups
+/// whose guesses keep missing fall back to binary search.
+template <typename T> class SymbolIDMap {
+  static_assert(SymbolID::RawSize == sizeof(uint64_t),
+                "SymbolIDs are stored as 64-bit integers");
+
+public:
+  SymbolIDMap() = default;
+  /// Builds the map from pairs of IDs and values. If an ID occurs several
+  /// times, its first value is kept.
+  explicit SymbolIDMap(std::vector<std::pair<SymbolID, T>> Entries) {
+    std::stable_sort(Entries.begin(), Entries.end(),
+                     [](const std::pair<SymbolID, T> &L,
+                        const std::pair<SymbolID, T> &R) {
+                       return L.first < R.first;
+                     });
+    Keys.reserve(Entries.size());
+    Values.reserve(Entries.size());
+    for (auto &Entry : Entries) {
+      uint64_t K = key(Entry.first);
+      if (!Keys.empty() && Keys.back() == K)
+        continue;
+      Keys.push_back(K);
+      Values.push_back(std::move(Entry.second));
+    }
+    Keys.shrink_to_fit();
+    Values.shrink_to_fit();
+  }
+
+  /// Returns the value of \p ID, or null if it's not in the map.
+  const T *find(const SymbolID &ID) const {
+    const uint64_t K = key(ID);
+    // Searches [Lo, Hi).
+    size_t Lo = 0, Hi = Keys.size();
+    for (unsigned Probes = 0; Lo < Hi; ++Probes) {
+      uint64_t LoKey = Keys[Lo], HiKey = Keys[Hi - 1];
+      if (K < LoKey || K > HiKey)
+        return nullptr;
+      if (Probes == MaxInterpolationProbes) {
+        auto It = std::lower_bound(Keys.begin() + Lo, Keys.begin() + Hi, K);
+        return *It == K ? &Values[It - Keys.begin()] : nullptr;
+      }
+      // Guess the position of K, assuming the keys in between are uniformly
+      // distributed.
+      size_t Mid = Lo;
+      if (HiKey != LoKey)
+        Mid += static_cast<size_t>(double(K - LoKey) / double(HiKey - LoKey) *
+                                   double(Hi - 1 - Lo));
+      Mid = std::min(Mid, Hi - 1);
+      if (Keys[Mid] == K)
+        return &Values[Mid];
+      if (Keys[Mid] < K)
+        Lo = Mid + 1;
+      else
+        Hi = Mid;
+    }
+    return nullptr;
+  }
+
+  /// Returns the value of \p ID, or a default-constructed value if it's not
+  /// in the map.
+  T lookup(const SymbolID &ID) const {
+    const T *V = find(ID);
+    return V ? *V : T();
+  }
+
+  size_t size() const { return Keys.size(); }
+  bool empty() const { return Keys.empty(); }
+  size_t getMemorySize() const {
+    return Keys.capacity() * sizeof(uint64_t) + Values.capacity() * sizeof(T);
+  }
+
+private:
+  /// The interpolation guesses after which a lookup uses binary search.
+  static constexpr unsigned MaxInterpolationProbes = 8;
+
+  /// Reads the ID as a big-endian integer, so that integers are ordered like
+  /// SymbolIDs.
+  static uint64_t key(const SymbolID &ID) {
+    return llvm::support::endian::read64be(ID.raw().data());
+  }
+
+  std::vector<uint64_t> Keys;
+  std::vector<T> Values;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SYMBOLIDMAP_H
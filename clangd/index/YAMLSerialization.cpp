@@ -14,7 +14,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "Index.h"
+#include "Logger.h"
 #include "Serialization.h"
+#include "Threading.h"
 #include "Trace.h"
 #include "dex/Dex.h"
 #include "llvm/ADT/Optional.h"
@@ -26,7 +28,9 @@
 #include "llvm/Support/StringSaver.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <cstdint>
+#include <thread>
 
 using namespace llvm;
 
@@ -309,25 +313,107 @@ void writeYAML(const IndexFileOut &O, raw_ostream &OS) {
     }
 }
 
-Expected<IndexFileIn> readYAML(StringRef Data) {
+namespace {
+// Chunks smaller than this parse faster than a thread starts.
+constexpr size_t MinBytesPerParseThread = 1 << 20;
+
+// Splits Data into about N chunks, at document markers ("---").
+std::vector<StringRef> splitDocuments(StringRef Data, unsigned N) {
+  std::vector<StringRef> Chunks;
+  size_t ChunkSize = Data.size() / N;
+  size_t From = ChunkSize;
+  while (Chunks.size() + 1 < N && From < Data.size()) {
+    size_t End = Data.find("\n---", From);
+    if (End == StringRef::npos)
+      break;
+    // Only split at document markers, not at lines like "----".
+    StringRef Marker = Data.drop_front(End + 4);
+    if (!Marker.empty() && Marker.front() != ' ' && Marker.front() != '\n') {
+      From = End + 4;
+      continue;
+    }
+    Chunks.push_back(Data.take_front(End + 1));
+    Data = Data.drop_front(End + 1);
+    From = ChunkSize;
+  }
+  Chunks.push_back(Data);
+  return Chunks;
+}
+
+struct ParsedEntries {
   SymbolSlab::Builder Symbols;
   RefSlab::Builder Refs;
+  std::error_code Error;
+};
+
+void parseDocuments(StringRef Data, ParsedEntries &Out) {
   BumpPtrAllocator Arena; // store the underlying data of Position::FileURI.
   UniqueStringSaver Strings(Arena);
   yaml::Input Yin(Data, &Strings);
   do {
     VariantEntry Variant;
     Yin >> Variant;
-    if (Yin.error())
-      return errorCodeToError(Yin.error());
+    if (Yin.error()) {
+      Out.Error = Yin.error();
+      return;
+    }
     if (Variant.Symbol)
-      Symbols.insert(*Variant.Symbol);
+      Out.Symbols.insert(*Variant.Symbol);
     if (Variant.Refs)
       for (const auto &Ref : Variant.Refs->second)
-        Refs.insert(Variant.Refs->first, Ref);
+        Out.Refs.insert(Variant.Refs->first, Ref);
   } while (Yin.nextDocument());
+}
+} // namespace
+
+Expected<IndexFileIn> readYAML(StringRef Data) {
+  trace::Span Tracer("ReadYAML");
+  // Parsing YAML dominates loading large legacy indexes. Each document stands
+  // alone, so chunks of them are parsed concurrently and merged in order, and
+  // later entries still override earlier ones.
+  unsigned NumThreads = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(),
+                          Data.size() / MinBytesPerParseThread));
+  std::vector<StringRef> Chunks = splitDocuments(Data, NumThreads);
+  std::vector<ParsedEntries> Parsed(Chunks.size());
+  if (Chunks.size() == 1) {
+    parseDocuments(Chunks.front(), Parsed.front());
+  } else {
+    AsyncTaskRunner Runner;
+    for (unsigned I = 0; I < Chunks.size(); ++I)
+      Runner.runAsync("yaml-parse:" + Twine(I),
+                      [&, I] { parseDocuments(Chunks[I], Parsed[I]); });
+    Runner.wait();
+  }
+  SPAN_ATTACH(Tracer, "chunks", int(Chunks.size()));
 
   IndexFileIn Result;
+  auto TakeAll = [&](ParsedEntries &Entries) -> Expected<IndexFileIn> {
+    if (Entries.Error)
+      return errorCodeToError(Entries.Error);
+    Result.Symbols.emplace(std::move(Entries.Symbols).build());
+    Result.Refs.emplace(std::move(Entries.Refs).build());
+    return std::move(Result);
+  };
+  if (Parsed.size() == 1)
+    return TakeAll(Parsed.front());
+  // A split inside a multi-line string makes its chunks fail to parse. The
+  // whole file is then parsed at once, to report the real error if any.
+  if (llvm::any_of(Parsed,
+                   [](const ParsedEntries &P) { return bool(P.Error); })) {
+    vlog("Failed to parse YAML in chunks, parsing it at once");
+    ParsedEntries Whole;
+    parseDocuments(Data, Whole);
+    return TakeAll(Whole);
+  }
+  SymbolSlab::Builder Symbols;
+  RefSlab::Builder Refs;
+  for (auto &Chunk : Parsed) {
+    Symbols.insert(std::move(Chunk.Symbols).build());
+    for (const auto &Sym : std::move(Chunk.Refs).build())
+      for (const auto &Ref : Sym.second)
+        Refs.insert(Sym.first, Ref);
+  }
   Result.Symbols.emplace(std::move(Symbols).build());
   Result.Refs.emplace(std::move(Refs).build());
   return std::move(Result);
@@ -8,10 +8,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "Dex.h"
+#include "Cancellation.h"
 #include "FileDistance.h"
 #include "FuzzyMatch.h"
 #include "Logger.h"
 #include "Quality.h"
+#include "Threading.h"
 #include "Trace.h"
 #include "index/Index.h"
 #include "index/dex/Iterator.h"
@@ -25,10 +27,24 @@ namespace clang {
 namespace clangd {
 namespace dex {
 
+// The index owns the refs, so they are encoded compactly and the slab is freed.
 std::unique_ptr<SymbolIndex> Dex::build(SymbolSlab Symbols, RefSlab Refs) {
-  auto Size = Symbols.bytes() + Refs.bytes();
-  auto Data = std::make_pair(std::move(Symbols), std::move(Refs));
-  return llvm::make_unique<Dex>(Data.first, Data.second, std::move(Data), Size);
+  auto Size = Symbols.bytes();
+  auto Index = llvm::make_unique<Dex>(
+      Symbols, std::vector<std::pair<SymbolID, ArrayRef<Ref>>>(),
+      std::move(Symbols), Size);
+  Index->OwnedRefs = CompactRefs(Refs);
+  return std::move(Index);
+}
+
+std::unique_ptr<SymbolIndex> Dex::build(SymbolSlab Symbols, RefSlab Refs,
+                                        Postings P) {
+  auto Size = Symbols.bytes();
+  auto Index = llvm::make_unique<Dex>(
+      Symbols, std::vector<std::pair<SymbolID, ArrayRef<Ref>>>(), std::move(P),
+      std::move(Symbols), Size);
+  Index->OwnedRefs = CompactRefs(Refs);
+  return std::move(Index);
 }
 
 namespace {
@@ -37,17 +53,17 @@ namespace {
 const Token RestrictedForCodeCompletion =
     Token(Token::Kind::Sentinel, "Restricted For Code Completion");
 
-// Returns the tokens which are given symbol's characteristics. Currently, the
-// generated tokens only contain fuzzy matching trigrams and symbol's scope,
-// but in the future this will also return path proximity tokens and other
-// types of tokens such as symbol type (if applicable).
-// Returns the tokens which are given symbols's characteristics. For example,
-// trigrams and scopes.
+// Fuzzy matching this many candidates is cheaper than intersecting them with
+// the posting lists of more trigrams.
+constexpr size_t FewCandidates = 2048;
+
+// Returns the tokens which are given symbols's characteristics, except for the
+// trigrams of its name: scope, proximity paths and restriction.
 // FIXME(kbobyrev): Support more token types:
 // * Types
 // * Namespace proximity
 std::vector<Token> generateSearchTokens(const Symbol &Sym) {
-  std::vector<Token> Result = generateIdentifierTrigrams(Sym.Name);
+  std::vector<Token> Result;
   Result.emplace_back(Token::Kind::Scope, Sym.Scope);
   // Skip token generation for symbols with unknown declaration location.
   if (!StringRef(Sym.CanonicalDeclaration.FileURI).empty())
@@ -99,42 +115,148 @@ createFileProximityIterator(ArrayRef<std::string> ProximityPaths,
   return Corpus.unionOf(std::move(BoostingIterators));
 }
 
-} // namespace
+// With fewer symbols per thread, spawning threads costs more than it saves.
+constexpr size_t MinSymbolsPerBuildThread = 5000;
 
-void Dex::buildIndex() {
-  this->Corpus = dex::Corpus(Symbols.size());
-  std::vector<std::pair<float, const Symbol *>> ScoredSymbols(Symbols.size());
+// Runs Action(0), ..., Action(N - 1), concurrently if N > 1.
+void runConcurrently(unsigned N, function_ref<void(unsigned)> Action) {
+  if (N == 1)
+    return Action(0);
+  AsyncTaskRunner Runner;
+  for (unsigned I = 0; I < N; ++I)
+    Runner.runAsync("dex-build:" + Twine(I), [Action, I] { Action(I); });
+  Runner.wait();
+}
 
-  for (size_t I = 0; I < Symbols.size(); ++I) {
-    const Symbol *Sym = Symbols[I];
-    LookupTable[Sym->ID] = Sym;
-    ScoredSymbols[I] = {quality(*Sym), Sym};
-  }
+} // namespace
+
+Postings buildPostings(ArrayRef<const Symbol *> Symbols) {
+  Postings Result;
+  std::vector<std::pair<float, uint32_t>> ScoredSymbols(Symbols.size());
+  for (size_t I = 0; I < Symbols.size(); ++I)
+    ScoredSymbols[I] = {quality(*Symbols[I]), I};
 
   // Symbols are sorted by symbol qualities so that items in the posting lists
   // are stored in the descending order of symbol quality.
-  llvm::sort(ScoredSymbols, std::greater<std::pair<float, const Symbol *>>());
+  llvm::sort(ScoredSymbols, [](const std::pair<float, uint32_t> &L,
+                               const std::pair<float, uint32_t> &R) {
+    return L.first > R.first || (L.first == R.first && L.second < R.second);
+  });
 
-  // SymbolQuality was empty up until now.
-  SymbolQuality.resize(Symbols.size());
-  // Populate internal storage using Symbol + Score pairs.
+  Result.SymbolOrder.resize(Symbols.size());
+  Result.SymbolQuality.resize(Symbols.size());
   for (size_t I = 0; I < ScoredSymbols.size(); ++I) {
-    SymbolQuality[I] = ScoredSymbols[I].first;
-    Symbols[I] = ScoredSymbols[I].second;
+    Result.SymbolQuality[I] = ScoredSymbols[I].first;
+    Result.SymbolOrder[I] = ScoredSymbols[I].second;
   }
 
-  // Populate TempInvertedIndex with lists for index symbols.
-  DenseMap<Token, std::vector<DocID>> TempInvertedIndex;
-  for (DocID SymbolRank = 0; SymbolRank < Symbols.size(); ++SymbolRank) {
-    const auto *Sym = Symbols[SymbolRank];
-    for (const auto &Token : generateSearchTokens(*Sym))
-      TempInvertedIndex[Token].push_back(SymbolRank);
+  // Token generation dominates the build time of large indexes, so the
+  // symbols are split into contiguous DocID ranges handled by separate threads.
+  unsigned NumThreads = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(),
+                          Symbols.size() / MinSymbolsPerBuildThread));
+  size_t ShardSize = (Symbols.size() + NumThreads - 1) / NumThreads;
+  // Shards[I] maps tokens to the (sorted) DocIDs they characterize in shard I.
+  std::vector<DenseMap<Token, std::vector<DocID>>> Shards(NumThreads);
+  runConcurrently(NumThreads, [&](unsigned Shard) {
+    // Trigrams are most of the tokens: they are kept packed until each
+    // distinct one is turned into a Token.
+    DenseMap<PackedTrigram, std::vector<DocID>> TrigramDocs;
+    std::vector<PackedTrigram> Trigrams;
+    DocID End = std::min(Symbols.size(), (Shard + 1) * ShardSize);
+    for (DocID SymbolRank = Shard * ShardSize; SymbolRank < End; ++SymbolRank) {
+      const auto *Sym = Symbols[Result.SymbolOrder[SymbolRank]];
+      generateIdentifierTrigrams(Sym->Name, Trigrams);
+      for (PackedTrigram Trigram : Trigrams)
+        TrigramDocs[Trigram].push_back(SymbolRank);
+      for (const auto &Token : generateSearchTokens(*Sym))
+        Shards[Shard][Token].push_back(SymbolRank);
+    }
+    for (auto &Entry : TrigramDocs)
+      Shards[Shard][unpackTrigram(Entry.first)] = std::move(Entry.second);
+  });
+
+  // Each thread then concatenates and compresses the lists of a disjoint
+  // subset of tokens. Shards cover increasing DocID ranges, so concatenating
+  // them in order keeps the lists sorted.
+  std::vector<std::vector<std::pair<Token, PostingList>>> Lists(NumThreads);
+  runConcurrently(NumThreads, [&](unsigned Part) {
+    for (unsigned Shard = 0; Shard < NumThreads; ++Shard) {
+      for (const auto &TokenAndDocs : Shards[Shard]) {
+        const Token &Tok = TokenAndDocs.first;
+        if (DenseMapInfo<Token>::getHashValue(Tok) % NumThreads != Part)
+          continue;
+        // Only handle each token when it's first seen.
+        bool SeenBefore = false;
+        for (unsigned Prev = 0; Prev < Shard && !SeenBefore; ++Prev)
+          SeenBefore = Shards[Prev].count(Tok);
+        if (SeenBefore)
+          continue;
+        ArrayRef<DocID> Docs = TokenAndDocs.second;
+        std::vector<DocID> Concatenated;
+        for (unsigned Next = Shard + 1; Next < NumThreads; ++Next) {
+          auto It = Shards[Next].find(Tok);
+          if (It == Shards[Next].end())
+            continue;
+          if (Concatenated.empty())
+            Concatenated.assign(Docs.begin(), Docs.end());
+          Concatenated.insert(Concatenated.end(), It->second.begin(),
+                              It->second.end());
+        }
+        if (!Concatenated.empty())
+          Docs = Concatenated;
+        Lists[Part].emplace_back(Tok, PostingList(Docs));
+      }
+    }
+  });
+
+  size_t NumTokens = 0;
+  for (const auto &PartLists : Lists)
+    NumTokens += PartLists.size();
+  Result.InvertedIndex.reserve(NumTokens);
+  for (auto &PartLists : Lists)
+    for (auto &TokenAndList : PartLists)
+      Result.InvertedIndex.insert(std::move(TokenAndList));
+  return Result;
+}
+
+void Dex::buildIndex(Postings P) {
+  assert(P.SymbolOrder.size() == Symbols.size() &&
+         P.SymbolQuality.size() == Symbols.size() &&
+         "Postings were built for different symbols");
+  this->Corpus = dex::Corpus(Symbols.size());
+
+  // Reorder symbols so that they are indexed by DocID.
+  std::vector<const Symbol *> SortedSymbols(Symbols.size());
+  std::vector<std::pair<SymbolID, uint32_t>> DocIDs(Symbols.size());
+  NameData.clear();
+  NameOffsets.resize(Symbols.size() + 1);
+  for (size_t I = 0; I < Symbols.size(); ++I) {
+    SortedSymbols[I] = Symbols[P.SymbolOrder[I]];
+    NameOffsets[I] = NameData.size();
+    NameData += SortedSymbols[I]->Name;
+    DocIDs[I] = {SortedSymbols[I]->ID, static_cast<uint32_t>(I)};
+  }
+  NameOffsets.back() = NameData.size();
+  Symbols = std::move(SortedSymbols);
+  LookupTable = SymbolIDMap<uint32_t>(std::move(DocIDs));
+  if (Docs) {
+    assert(Docs->size() == Symbols.size() && "Docs are for other symbols");
+    DocsOrder = std::move(P.SymbolOrder);
   }
+  SymbolQuality = std::move(P.SymbolQuality);
+  InvertedIndex = std::move(P.InvertedIndex);
+}
 
-  // Convert lists of items to posting lists.
-  for (const auto &TokenToPostingList : TempInvertedIndex)
-    InvertedIndex.insert(
-        {TokenToPostingList.first, PostingList(TokenToPostingList.second)});
+void Dex::emit(DocID ID,
+               function_ref<void(const Symbol &)> Callback) const {
+  if (!Docs)
+    return Callback(*Symbols[ID]);
+  // Symbols are only valid during the callback, so a copy will do.
+  Symbol Sym = *Symbols[ID];
+  std::string Documentation = Docs->get(DocsOrder[ID]);
+  Sym.Documentation = Documentation;
+  Callback(Sym);
 }
 
 std::unique_ptr<Iterator> Dex::iterator(const Token &Tok) const {
@@ -143,11 +265,18 @@ std::unique_ptr<Iterator> Dex::iterator(const Token &Tok) const {
                                    : It->second.iterator(&It->first);
 }
 
+bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
+                    function_ref<void(const Symbol &)> Callback) const {
+  return fuzzyFindScored(
+      Req, [&](const Symbol &Sym, float NameMatch) { Callback(Sym); });
+}
+
 /// Constructs iterators over tokens extracted from the query and exhausts it
 /// while applying Callback to each symbol in the order of decreasing quality
 /// of the matched symbols.
-bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
-                    function_ref<void(const Symbol &)> Callback) const {
+bool Dex::fuzzyFindScored(
+    const FuzzyFindRequest &Req,
+    function_ref<void(const Symbol &, float)> Callback) const {
   assert(!StringRef(Req.Query).contains("::") &&
          "There must be no :: in query.");
   trace::Span Tracer("Dex fuzzyFind");
@@ -156,6 +285,18 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
   // Prevent clients from postfiltering them for longer queries.
   bool More = !Req.Query.empty() && Req.Query.size() < 3;
 
+  // The posting list sizes of the query tokens, when tracing.
+  json::Array PostingSizes;
+  auto PostingIterator = [&](const Token &Tok) {
+    auto It = iterator(Tok);
+    if (Tracer.Args)
+      PostingSizes.push_back(json::Object{
+          {"token", to_string(Tok)},
+          {"size", static_cast<int64_t>(It->estimateSize())},
+      });
+    return It;
+  };
+
   std::vector<std::unique_ptr<Iterator>> Criteria;
   const auto TrigramTokens = generateQueryTrigrams(Req.Query);
 
@@ -163,13 +304,36 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
   // trigrams.
   std::vector<std::unique_ptr<Iterator>> TrigramIterators;
   for (const auto &Trigram : TrigramTokens)
-    TrigramIterators.push_back(iterator(Trigram));
+    TrigramIterators.push_back(PostingIterator(Trigram));
+  // Trigrams only prefilter the candidates of the fuzzy matcher, so the others
+  // are dropped once the rarest one leaves few candidates. Posting list sizes
+  // are estimated within a factor of 2, and dropping must not let more
+  // candidates than the limit below allows through, or results would be lost.
+  size_t Bound = FewCandidates;
+  if (Req.Limit)
+    Bound = std::min<size_t>(Bound, *Req.Limit * 100 / 2);
+  size_t DroppedTrigrams = 0;
+  if (TrigramIterators.size() > 1) {
+    auto Rarest = std::min_element(
+        TrigramIterators.begin(), TrigramIterators.end(),
+        [](const std::unique_ptr<Iterator> &L,
+           const std::unique_ptr<Iterator> &R) {
+          return L->estimateSize() < R->estimateSize();
+        });
+    if ((*Rarest)->estimateSize() <= Bound) {
+      DroppedTrigrams = TrigramIterators.size() - 1;
+      std::swap(*Rarest, TrigramIterators.front());
+      TrigramIterators.resize(1);
+    }
+  }
+  SPAN_ATTACH(Tracer, "droppedTrigrams", static_cast<int64_t>(DroppedTrigrams));
   Criteria.push_back(Corpus.intersect(move(TrigramIterators)));
 
   // Generate scope tokens for search query.
   std::vector<std::unique_ptr<Iterator>> ScopeIterators;
   for (const auto &Scope : Req.Scopes)
-    ScopeIterators.push_back(iterator(Token(Token::Kind::Scope, Scope)));
+    ScopeIterators.push_back(
+        PostingIterator(Token(Token::Kind::Scope, Scope)));
   if (Req.AnyScope)
     ScopeIterators.push_back(
         Corpus.boost(Corpus.all(), ScopeIterators.empty() ? 1.0 : 0.2));
@@ -191,69 +355,144 @@ bool Dex::fuzzyFind(const FuzzyFindRequest &Req,
   if (Req.Limit)
     Root = Corpus.limit(move(Root), *Req.Limit * 100);
   SPAN_ATTACH(Tracer, "query", to_string(*Root));
+  SPAN_ATTACH(Tracer, "postings", std::move(PostingSizes));
+  SPAN_ATTACH(Tracer, "estimatedSize",
+              static_cast<int64_t>(Root->estimateSize()));
   vlog("Dex query tree: {0}", *Root);
 
-  using IDAndScore = std::pair<DocID, float>;
-  std::vector<IDAndScore> IDAndScores = consume(*Root);
-
-  auto Compare = [](const IDAndScore &LHS, const IDAndScore &RHS) {
-    return LHS.second > RHS.second;
+  struct ScoredDoc {
+    DocID ID;
+    float Score;
+    float NameMatch;
   };
-  TopN<IDAndScore, decltype(Compare)> Top(
-      Req.Limit ? *Req.Limit : std::numeric_limits<size_t>::max(), Compare);
-  for (const auto &IDAndScore : IDAndScores) {
-    const DocID SymbolDocID = IDAndScore.first;
-    const auto *Sym = Symbols[SymbolDocID];
-    const Optional<float> Score = Filter.match(Sym->Name);
+  auto Compare = [](const ScoredDoc &LHS, const ScoredDoc &RHS) {
+    return LHS.Score > RHS.Score;
+  };
+  const size_t Limit = Req.Limit ? *Req.Limit : 0;
+  TopN<ScoredDoc, decltype(Compare)> Top(
+      Req.Limit ? Limit : std::numeric_limits<size_t>::max(), Compare);
+  // The lowest score among the Limit best items seen so far, once there are
+  // that many.
+  float MinTopScore = 0;
+  size_t Scored = 0;
+  // The items come in order of decreasing quality, so no item past the
+  // current one can score higher than its quality times the maximal boost of
+  // the query tree and the maximal fuzzy matching score. The latter is above 1
+  // for exact matches.
+  const float MaxFactor = Root->maxBoost() * FuzzyMatcher::MaxScore;
+  CancellationCheckpoint Checkpoint;
+  size_t Visited = 0, Matched = 0;
+  for (; !Root->reachedEnd(); Root->advance(), ++Visited) {
+    // Requests superseded by later ones, e.g. those of workspace symbols typed
+    // a keystroke ago, are cancelled.
+    if (Checkpoint.cancelled()) {
+      More = true;
+      break;
+    }
+    const DocID SymbolDocID = Root->peek();
+    if (Limit && Scored >= Limit &&
+        SymbolQuality[SymbolDocID] * MaxFactor <= MinTopScore) {
+      More = true;
+      break;
+    }
+    const float Boost = Root->consume();
+    const Optional<float> Score = Filter.match(name(SymbolDocID));
     if (!Score)
       continue;
+    ++Matched;
     // Combine Fuzzy Matching score, precomputed symbol quality and boosting
     // score for a cumulative final symbol score.
-    const float FinalScore =
-        (*Score) * SymbolQuality[SymbolDocID] * IDAndScore.second;
+    const float FinalScore = (*Score) * SymbolQuality[SymbolDocID] * Boost;
     // If Top.push(...) returns true, it means that it had to pop an item. In
     // this case, it is possible to retrieve more symbols.
-    if (Top.push({SymbolDocID, FinalScore}))
+    if (Top.push({SymbolDocID, FinalScore, *Score}))
       More = true;
+    if (Limit && ++Scored >= Limit)
+      MinTopScore = Top.worst().Score;
   }
 
+  SPAN_ATTACH(Tracer, "visited", static_cast<int64_t>(Visited));
+  SPAN_ATTACH(Tracer, "matched", static_cast<int64_t>(Matched));
+
   // Apply callback to the top Req.Limit items in the descending
   // order of cumulative score.
   for (const auto &Item : std::move(Top).items())
-    Callback(*Symbols[Item.first]);
+    emit(Item.ID, [&](const Symbol &Sym) { Callback(Sym, Item.NameMatch); });
   return More;
 }
 
 void Dex::lookup(const LookupRequest &Req,
                  function_ref<void(const Symbol &)> Callback) const {
   trace::Span Tracer("Dex lookup");
-  for (const auto &ID : Req.IDs) {
-    auto I = LookupTable.find(ID);
-    if (I != LookupTable.end())
-      Callback(*I->second);
-  }
+  for (const auto &ID : Req.IDs)
+    if (const uint32_t *DocID = LookupTable.find(ID))
+      emit(*DocID, Callback);
 }
 
 void Dex::refs(const RefsRequest &Req,
                function_ref<void(const Ref &)> Callback) const {
   trace::Span Tracer("Dex refs");
-  for (const auto &ID : Req.IDs)
-    for (const auto &Ref : Refs.lookup(ID))
+  CancellationCheckpoint Checkpoint;
+  for (const auto &ID : Req.IDs) {
+    for (const auto &Ref : Refs.lookup(ID)) {
+      if (Checkpoint.cancelled())
+        return;
       if (static_cast<int>(Req.Filter & Ref.Kind))
         Callback(Ref);
+    }
+    OwnedRefs.refs(ID, Req.Filter, Callback);
+  }
+}
+
+void Dex::refsBySymbol(
+    const RefsRequest &Req,
+    function_ref<void(const SymbolID &, ArrayRef<Ref>)> Callback) const {
+  trace::Span Tracer("Dex refsBySymbol");
+  std::vector<Ref> Filtered;
+  for (const auto &ID : Req.IDs) {
+    auto Matching = filterRefs(Refs.lookup(ID), Req.Filter, Filtered);
+    if (Matching.empty()) {
+      Filtered.clear();
+      OwnedRefs.refs(ID, Req.Filter,
+                     [&](const Ref &R) { Filtered.push_back(R); });
+      Matching = Filtered;
+    }
+    if (!Matching.empty())
+      Callback(ID, Matching);
+  }
 }
 
 size_t Dex::estimateMemoryUsage() const {
   size_t Bytes = Symbols.size() * sizeof(const Symbol *);
   Bytes += SymbolQuality.size() * sizeof(float);
+  Bytes += NameData.capacity() + NameOffsets.size() * sizeof(uint32_t);
   Bytes += LookupTable.getMemorySize();
   Bytes += InvertedIndex.getMemorySize();
   for (const auto &TokenToPostingList : InvertedIndex)
     Bytes += TokenToPostingList.second.bytes();
-  Bytes += Refs.getMemorySize();
+  Bytes += Refs.getMemorySize() + OwnedRefs.bytes();
+  if (Docs)
+    Bytes += Docs->bytes() + DocsOrder.capacity() * sizeof(uint32_t);
   return Bytes + BackingDataSize;
 }
 
+void Dex::profile(MemoryTree &MT) const {
+  MT.child("symbols").addUsage(Symbols.size() * sizeof(const Symbol *) +
+                               SymbolQuality.size() * sizeof(float) +
+                               NameData.capacity() +
+                               NameOffsets.size() * sizeof(uint32_t));
+  MT.child("lookup").addUsage(LookupTable.getMemorySize());
+  MemoryTree &Postings = MT.child("postings");
+  Postings.addUsage(InvertedIndex.getMemorySize());
+  for (const auto &TokenToPostingList : InvertedIndex)
+    Postings.addUsage(TokenToPostingList.second.bytes());
+  MT.child("refs").addUsage(Refs.getMemorySize() + OwnedRefs.bytes());
+  if (Docs)
+    MT.child("docs").addUsage(Docs->bytes() +
+                              DocsOrder.capacity() * sizeof(uint32_t));
+  MT.child("backing").addUsage(BackingDataSize);
+}
+
 std::vector<std::string> generateProximityURIs(StringRef URIPath) {
   std::vector<std::string> Result;
   auto ParsedURI = URI::parse(URIPath);
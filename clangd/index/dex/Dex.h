@@ -25,6 +25,9 @@
 #include "PostingList.h"
 #include "Token.h"
 #include "Trigram.h"
+#include "index/CompactRefs.h"
+#include "index/CompressedStrings.h"
+#include "index/SymbolIDMap.h"
 #include "index/Index.h"
 #include "index/MemIndex.h"
 #include "index/SymbolCollector.h"
@@ -34,21 +37,24 @@ namespace clangd {
 namespace dex {
 
 /// In-memory Dex trigram-based index implementation.
-// FIXME(kbobyrev): Introduce serialization and deserialization of the symbol
-// index so that it can be loaded from the disk. Since static index is not
-// changed frequently, it's safe to assume that it has to be built only once
-// (when the clangd process starts). Therefore, it can be easier to store built
-// index on disk and then load it if available.
+///
+/// The posting lists can be serialized along with the symbols (see
+/// buildPostings() and IndexFileOut), so that a static index loaded from disk
+/// doesn't need to rebuild them.
 class Dex : public SymbolIndex {
 public:
   // All data must outlive this index.
   template <typename SymbolRange, typename RefsRange>
   Dex(SymbolRange &&Symbols, RefsRange &&Refs) : Corpus(0) {
-    for (auto &&Sym : Symbols)
-      this->Symbols.push_back(&Sym);
-    for (auto &&Ref : Refs)
-      this->Refs.try_emplace(Ref.first, Ref.second);
-    buildIndex();
+    init(Symbols, Refs);
+    buildIndex(buildPostings(this->Symbols));
+  }
+  // Uses Postings previously computed by buildPostings() over Symbols, which
+  // must be in the same order.
+  template <typename SymbolRange, typename RefsRange>
+  Dex(SymbolRange &&Symbols, RefsRange &&Refs, Postings P) : Corpus(0) {
+    init(Symbols, Refs);
+    buildIndex(std::move(P));
   }
   // Symbols and Refs are owned by BackingData, Index takes ownership.
   template <typename SymbolRange, typename RefsRange, typename Payload>
@@ -59,13 +65,42 @@ public:
         std::make_shared<Payload>(std::move(BackingData)), nullptr);
     this->BackingDataSize = BackingDataSize;
   }
+  // Postings as above, with symbols and refs owned by BackingData.
+  template <typename SymbolRange, typename RefsRange, typename Payload>
+  Dex(SymbolRange &&Symbols, RefsRange &&Refs, Postings P,
+      Payload &&BackingData, size_t BackingDataSize)
+      : Dex(std::forward<SymbolRange>(Symbols), std::forward<RefsRange>(Refs),
+            std::move(P)) {
+    KeepAlive = std::shared_ptr<void>(
+        std::make_shared<Payload>(std::move(BackingData)), nullptr);
+    this->BackingDataSize = BackingDataSize;
+  }
+  // As above, with the documentation of the symbols kept compressed. Docs is in
+  // the order of Symbols, whose own documentation is ignored.
+  template <typename SymbolRange, typename RefsRange, typename Payload>
+  Dex(SymbolRange &&Symbols, RefsRange &&Refs, Postings P,
+      CompressedStrings Docs, Payload &&BackingData, size_t BackingDataSize)
+      : Corpus(0) {
+    init(Symbols, Refs);
+    this->Docs = std::move(Docs);
+    buildIndex(std::move(P));
+    KeepAlive = std::shared_ptr<void>(
+        std::make_shared<Payload>(std::move(BackingData)), nullptr);
+    this->BackingDataSize = BackingDataSize;
+  }
 
   /// Builds an index from slabs. The index takes ownership of the slab.
   static std::unique_ptr<SymbolIndex> build(SymbolSlab, RefSlab);
+  /// Builds an index from slabs and postings computed by buildPostings() over
+  /// the symbols of the slab, in slab order.
+  static std::unique_ptr<SymbolIndex> build(SymbolSlab, RefSlab, Postings);
 
   bool
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const override;
+  bool fuzzyFindScored(const FuzzyFindRequest &Req,
+                       llvm::function_ref<void(const Symbol &, float)> Callback)
+      const override;
 
   void lookup(const LookupRequest &Req,
               llvm::function_ref<void(const Symbol &)> Callback) const override;
@@ -73,17 +108,45 @@ public:
   void refs(const RefsRequest &Req,
             llvm::function_ref<void(const Ref &)> Callback) const override;
 
+  void refsBySymbol(const RefsRequest &Req,
+                    llvm::function_ref<void(const SymbolID &,
+                                            llvm::ArrayRef<Ref>)>
+                        Callback) const override;
+
   size_t estimateMemoryUsage() const override;
+  void profile(MemoryTree &MT) const override;
 
 private:
-  void buildIndex();
+  template <typename SymbolRange, typename RefsRange>
+  void init(SymbolRange &&Symbols, RefsRange &&Refs) {
+    for (auto &&Sym : Symbols)
+      this->Symbols.push_back(&Sym);
+    std::vector<std::pair<SymbolID, llvm::ArrayRef<Ref>>> SymbolRefs;
+    for (auto &&Ref : Refs)
+      SymbolRefs.emplace_back(Ref.first, Ref.second);
+    this->Refs = SymbolIDMap<llvm::ArrayRef<Ref>>(std::move(SymbolRefs));
+  }
+  void buildIndex(Postings P);
+  /// Calls \p Callback on Symbols[ID], with its documentation if it's
+  /// compressed.
+  void emit(DocID ID, llvm::function_ref<void(const Symbol &)> Callback) const;
   std::unique_ptr<Iterator> iterator(const Token &Tok) const;
+  llvm::StringRef name(DocID ID) const {
+    return llvm::StringRef(NameData).slice(NameOffsets[ID],
+                                           NameOffsets[ID + 1]);
+  }
 
   /// Stores symbols sorted in the descending order of symbol quality..
   std::vector<const Symbol *> Symbols;
   /// SymbolQuality[I] is the quality of Symbols[I].
   std::vector<float> SymbolQuality;
-  llvm::DenseMap<SymbolID, const Symbol *> LookupTable;
+  /// The names of Symbols, concatenated in DocID order: the name of Symbols[I]
+  /// is NameData[NameOffsets[I], NameOffsets[I + 1]). Scoring only reads names
+  /// and qualities, so it doesn't follow a pointer per symbol.
+  std::string NameData;
+  std::vector<uint32_t> NameOffsets;
+  /// The position of each symbol in Symbols.
+  SymbolIDMap<uint32_t> LookupTable;
   /// Inverted index is a mapping from the search token to the posting list,
   /// which contains all items which can be characterized by such search token.
   /// For example, if the search token is scope "std::", the corresponding
@@ -92,12 +155,22 @@ private:
   /// during the fuzzyFind process.
   llvm::DenseMap<Token, PostingList> InvertedIndex;
   dex::Corpus Corpus;
-  llvm::DenseMap<SymbolID, llvm::ArrayRef<Ref>> Refs;
+  SymbolIDMap<llvm::ArrayRef<Ref>> Refs;
+  /// Refs owned by the index, when it was built from a RefSlab.
+  CompactRefs OwnedRefs;
+  /// The compressed documentation of the symbols, if any. DocsOrder[I] is the
+  /// position of the documentation of Symbols[I] in Docs.
+  llvm::Optional<CompressedStrings> Docs;
+  std::vector<uint32_t> DocsOrder;
   std::shared_ptr<void> KeepAlive; // poor man's move-only std::any
   // Size of memory retained by KeepAlive.
   size_t BackingDataSize = 0;
 };
 
+/// Computes the search structures of a Dex index built from \p Symbols.
+/// The result only refers to symbols by their position in \p Symbols.
+Postings buildPostings(llvm::ArrayRef<const Symbol *> Symbols);
+
 /// Returns Search Token for a number of parent directories of given Path.
 /// Should be used within the index build process.
 ///
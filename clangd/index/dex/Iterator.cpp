@@ -29,21 +29,20 @@ public:
   explicit AndIterator(std::vector<std::unique_ptr<Iterator>> AllChildren)
       : Iterator(Kind::And), Children(std::move(AllChildren)) {
     assert(!Children.empty() && "AND iterator should have at least one child.");
-    // Establish invariants.
-    for (const auto &Child : Children)
-      ReachedEnd |= Child->reachedEnd();
-    sync();
     // When children are sorted by the estimateSize(), sync() calls are more
-    // effective. Each sync() starts with the first child and makes sure all
-    // children point to the same element. If any child is "above" the previous
-    // ones, the algorithm resets and and advances the children to the next
-    // highest element starting from the front. When child iterators in the
-    // beginning have smaller estimated size, the sync() will have less restarts
-    // and become more effective.
+    // effective. The first (shortest) child leads: each candidate it proposes
+    // is checked against the longer children, which skip ahead to it. If any
+    // child is "above" the candidate, the leader skips ahead to that child
+    // instead. Galloping through the long posting lists this way touches far
+    // fewer of their items than advancing them in lockstep.
     llvm::sort(Children, [](const std::unique_ptr<Iterator> &LHS,
                             const std::unique_ptr<Iterator> &RHS) {
       return LHS->estimateSize() < RHS->estimateSize();
     });
+    // Establish invariants.
+    for (const auto &Child : Children)
+      ReachedEnd |= Child->reachedEnd();
+    sync();
   }
 
   bool reachedEnd() const override { return ReachedEnd; }
@@ -76,6 +75,13 @@ public:
     return Children.front()->estimateSize();
   }
 
+  float maxBoost() const override {
+    float Boost = 1;
+    for (const auto &Child : Children)
+      Boost *= Child->maxBoost();
+    return Boost;
+  }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override {
     OS << "(& ";
@@ -95,25 +101,29 @@ private:
     if (ReachedEnd)
       return;
     auto SyncID = Children.front()->peek();
-    // Indicates whether any child needs to be advanced to new SyncID.
-    bool NeedsAdvance = false;
-    do {
-      NeedsAdvance = false;
-      for (auto &Child : Children) {
-        Child->advanceTo(SyncID);
-        ReachedEnd |= Child->reachedEnd();
-        // If any child reaches end And iterator can not match any other items.
-        // In this case, just terminate the process.
-        if (ReachedEnd)
-          return;
-        // If any child goes beyond given ID (i.e. ID is not the common item),
-        // all children should be advanced to the next common item.
-        if (Child->peek() > SyncID) {
-          SyncID = Child->peek();
-          NeedsAdvance = true;
-        }
+    // Children[0, Synced) are known to point to SyncID.
+    size_t Synced = 1;
+    while (Synced < Children.size()) {
+      auto &Child = Children[Synced];
+      Child->advanceTo(SyncID);
+      // If any child reaches end And iterator can not match any other items.
+      // In this case, just terminate the process.
+      ReachedEnd |= Child->reachedEnd();
+      if (ReachedEnd)
+        return;
+      if (Child->peek() == SyncID) {
+        ++Synced;
+        continue;
       }
-    } while (NeedsAdvance);
+      // The child went beyond SyncID, so SyncID is not a common item. The
+      // leader skips to the child's item, which becomes the new candidate.
+      Children.front()->advanceTo(Child->peek());
+      ReachedEnd |= Children.front()->reachedEnd();
+      if (ReachedEnd)
+        return;
+      SyncID = Children.front()->peek();
+      Synced = 1;
+    }
   }
 
   /// AndIterator owns its children and ensures that all of them point to the
@@ -197,6 +207,14 @@ public:
     return Size;
   }
 
+  float maxBoost() const override {
+    float Boost = 1;
+    for (const auto &Child : Children)
+      if (!Child->reachedEnd())
+        Boost = std::max(Boost, Child->maxBoost());
+    return Boost;
+  }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override {
     OS << "(| ";
@@ -245,6 +263,8 @@ public:
 
   size_t estimateSize() const override { return Size; }
 
+  float maxBoost() const override { return 1; }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override { return OS << "true"; }
 
@@ -270,6 +290,8 @@ public:
   }
   size_t estimateSize() const override { return 0; }
 
+  float maxBoost() const override { return 0; }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override { return OS << "false"; }
 };
@@ -293,6 +315,8 @@ public:
 
   size_t estimateSize() const override { return Child->estimateSize(); }
 
+  float maxBoost() const override { return Child->maxBoost() * Factor; }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override {
     return OS << "(* " << Factor << ' ' << *Child << ')';
@@ -333,6 +357,8 @@ public:
     return std::min(Child->estimateSize(), Limit);
   }
 
+  float maxBoost() const override { return Child->maxBoost(); }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override {
     return OS << "(LIMIT " << Limit << " " << *Child << ')';
@@ -81,6 +81,9 @@ public:
   virtual float consume() = 0;
   /// Returns an estimate of advance() calls before the iterator is exhausted.
   virtual size_t estimateSize() const = 0;
+  /// Returns an upper bound of the boost returned by consume() for any item
+  /// this iterator can still produce.
+  virtual float maxBoost() const = 0;
 
   virtual ~Iterator() {}
 
@@ -12,6 +12,11 @@
 #include "Token.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/MathExtras.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 using namespace llvm;
 namespace clang {
@@ -27,7 +32,7 @@ public:
   explicit ChunkIterator(const Token *Tok, ArrayRef<Chunk> Chunks)
       : Tok(Tok), Chunks(Chunks), CurrentChunk(Chunks.begin()) {
     if (!Chunks.empty()) {
-      DecompressedChunk = CurrentChunk->decompress();
+      CurrentChunk->decompress(DecompressedChunk);
       CurrentID = DecompressedChunk.begin();
     }
   }
@@ -70,6 +75,8 @@ public:
     return Chunks.size() * ApproxEntriesPerChunk;
   }
 
+  float maxBoost() const override { return 1; }
+
 private:
   raw_ostream &dump(raw_ostream &OS) const override {
     if (Tok != nullptr)
@@ -94,20 +101,34 @@ private:
     ++CurrentChunk;
     if (CurrentChunk == Chunks.end()) // Reached the end of PostingList.
       return;
-    DecompressedChunk = CurrentChunk->decompress();
+    CurrentChunk->decompress(DecompressedChunk);
     CurrentID = DecompressedChunk.begin();
   }
 
-  /// Advances CurrentChunk to the chunk which might contain ID.
+  /// Advances CurrentChunk to the chunk which might contain ID. Chunks that
+  /// are skipped over are never decompressed: only their heads are examined.
   void advanceToChunk(DocID ID) {
     if ((CurrentChunk != Chunks.end() - 1) &&
         ((CurrentChunk + 1)->Head <= ID)) {
-      // Find the next chunk with Head >= ID.
+      // Gallop over the chunk heads to bound the target chunk, then binary
+      // search within that range. When intersecting with a denser list most
+      // skips are short, and this only touches a few heads near the cursor.
+      auto Last = CurrentChunk + 1; // Last known chunk with Head <= ID.
+      size_t Step = 1;
+      while (Step < static_cast<size_t>(Chunks.end() - Last) &&
+             Last[Step].Head <= ID) {
+        Last += Step;
+        Step *= 2;
+      }
+      auto Limit = Step < static_cast<size_t>(Chunks.end() - Last)
+                       ? Last + Step
+                       : Chunks.end();
+      // Find the first chunk with Head > ID, the target is the one before.
       CurrentChunk = std::lower_bound(
-          CurrentChunk + 1, Chunks.end(), ID,
+          Last + 1, Limit, ID,
           [](const Chunk &C, const DocID ID) { return C.Head <= ID; });
       --CurrentChunk;
-      DecompressedChunk = CurrentChunk->decompress();
+      CurrentChunk->decompress(DecompressedChunk);
       CurrentID = DecompressedChunk.begin();
     }
   }
@@ -183,38 +204,78 @@ std::vector<Chunk> encodeStream(ArrayRef<DocID> Documents) {
   return std::vector<Chunk>(Result); // no move, shrink-to-fit
 }
 
-/// Reads variable length DocID from the buffer and updates the buffer size. If
-/// the stream is terminated, return None.
-Optional<DocID> readVByte(ArrayRef<uint8_t> &Bytes) {
-  if (Bytes.front() == 0 || Bytes.empty())
-    return None;
-  DocID Result = 0;
-  bool HasNextByte = true;
-  for (size_t Length = 0; HasNextByte && !Bytes.empty(); ++Length) {
-    assert(Length <= 5 && "Malformed VByte encoding sequence.");
-    // Write meaningful bits to the correct place in the document decoding.
-    Result |= (Bytes.front() & 0x7f) << (BitsPerEncodingByte * Length);
-    if ((Bytes.front() & 0x80) == 0)
-      HasNextByte = false;
-    Bytes = Bytes.drop_front();
-  }
-  return Result;
+static_assert(Chunk::PayloadSize <= 32 && Chunk::PayloadSize >= 16,
+              "terminatorMask() expects the payload to fit two 16-byte loads");
+
+/// Returns a mask with bit I set if Payload[I] ends a VByte-encoded delta, i.e.
+/// if its continuation bit is clear.
+uint32_t
+terminatorMask(const std::array<uint8_t, Chunk::PayloadSize> &Payload) {
+  constexpr uint32_t AllBytes = (uint64_t(1) << Chunk::PayloadSize) - 1;
+#if defined(__SSE2__)
+  // Cover the payload with two (possibly overlapping) unaligned loads.
+  constexpr unsigned HighOffset = Chunk::PayloadSize - 16;
+  __m128i Low =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(Payload.data()));
+  __m128i High = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(Payload.data() + HighOffset));
+  uint32_t Continuation =
+      static_cast<uint32_t>(_mm_movemask_epi8(Low)) |
+      static_cast<uint32_t>(_mm_movemask_epi8(High)) << HighOffset;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  // NEON has no movemask: weight each byte's top bit by its position within
+  // the half-vector, and add the weights up.
+  static const uint8_t WeightData[16] = {1, 2, 4, 8, 16, 32, 64, 128,
+                                         1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t Weights = vld1q_u8(WeightData);
+  auto MoveMask = [&](const uint8_t *Bytes) -> uint32_t {
+    uint8x16_t Bits = vandq_u8(vcltzq_s8(vreinterpretq_s8_u8(vld1q_u8(Bytes))),
+                               Weights);
+    return vaddv_u8(vget_low_u8(Bits)) |
+           static_cast<uint32_t>(vaddv_u8(vget_high_u8(Bits))) << 8;
+  };
+  constexpr unsigned HighOffset = Chunk::PayloadSize - 16;
+  uint32_t Continuation = MoveMask(Payload.data()) |
+                          MoveMask(Payload.data() + HighOffset) << HighOffset;
+#else
+  uint32_t Continuation = 0;
+  for (unsigned I = 0; I < Chunk::PayloadSize; ++I)
+    Continuation |= static_cast<uint32_t>(Payload[I] >> 7) << I;
+#endif
+  return ~Continuation & AllBytes;
 }
 
 } // namespace
 
 SmallVector<DocID, Chunk::PayloadSize + 1> Chunk::decompress() const {
-  SmallVector<DocID, Chunk::PayloadSize + 1> Result{Head};
-  ArrayRef<uint8_t> Bytes(Payload);
-  DocID Delta;
-  for (DocID Current = Head; !Bytes.empty(); Current += Delta) {
-    auto MaybeDelta = readVByte(Bytes);
-    if (!MaybeDelta)
+  SmallVector<DocID, Chunk::PayloadSize + 1> Result;
+  decompress(Result);
+  return Result;
+}
+
+void Chunk::decompress(SmallVectorImpl<DocID> &Result) const {
+  Result.clear();
+  Result.push_back(Head);
+  // Rather than testing the continuation bit of every byte, find the last
+  // byte of each delta up front and decode deltas one at a time.
+  uint32_t Terminators = terminatorMask(Payload);
+  DocID Current = Head;
+  unsigned Start = 0;
+  while (Terminators) {
+    // A delta is never zero, so its first byte isn't either. Zero bytes are
+    // the padding after the last delta.
+    if (Payload[Start] == 0)
       break;
-    Delta = *MaybeDelta;
-    Result.push_back(Current + Delta);
+    unsigned End = countTrailingZeros(Terminators);
+    Terminators &= Terminators - 1;
+    assert(End - Start < 5 && "Malformed VByte encoding sequence.");
+    DocID Delta = 0;
+    for (unsigned I = End + 1; I-- > Start;)
+      Delta = (Delta << BitsPerEncodingByte) | (Payload[I] & 0x7f);
+    Current += Delta;
+    Result.push_back(Current);
+    Start = End + 1;
   }
-  return SmallVector<DocID, Chunk::PayloadSize + 1>{Result};
 }
 
 PostingList::PostingList(ArrayRef<DocID> Documents)
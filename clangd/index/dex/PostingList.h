@@ -25,7 +25,9 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_POSTINGLIST_H
 
 #include "Iterator.h"
+#include "Token.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 #include <cstdint>
 #include <vector>
@@ -33,7 +35,6 @@
 namespace clang {
 namespace clangd {
 namespace dex {
-struct Token;
 
 /// NOTE: This is an implementation detail.
 ///
@@ -45,6 +46,9 @@ struct Chunk {
   static constexpr size_t PayloadSize = 32 - sizeof(DocID);
 
   llvm::SmallVector<DocID, PayloadSize + 1> decompress() const;
+  /// Decompresses into \p Result, replacing its contents. This avoids copies
+  /// when the same buffer is reused for many chunks.
+  void decompress(llvm::SmallVectorImpl<DocID> &Result) const;
 
   /// The first element of decompressed Chunk.
   DocID Head;
@@ -60,6 +64,9 @@ static_assert(sizeof(Chunk) == 32, "Chunk should take 32 bytes of memory.");
 class PostingList {
 public:
   explicit PostingList(llvm::ArrayRef<DocID> Documents);
+  /// Constructs a posting list from chunks previously obtained from chunks(),
+  /// e.g. when reading a serialized index.
+  explicit PostingList(std::vector<Chunk> Chunks) : Chunks(std::move(Chunks)) {}
 
   /// Constructs DocumentIterator over given posting list. DocumentIterator will
   /// go through the chunks and decompress them on-the-fly when necessary.
@@ -69,8 +76,25 @@ public:
   /// Returns in-memory size of external storage.
   size_t bytes() const { return Chunks.capacity() * sizeof(Chunk); }
 
+  /// Compressed representation of the posting list, used for serialization.
+  llvm::ArrayRef<Chunk> chunks() const { return Chunks; }
+
 private:
-  const std::vector<Chunk> Chunks;
+  std::vector<Chunk> Chunks;
+};
+
+/// The search structures Dex builds over a list of symbols. Computing these is
+/// the expensive part of building Dex, so they can be serialized along with
+/// the symbols (see IndexFileOut) and loaded instead of being rebuilt.
+struct Postings {
+  /// SymbolOrder[DocID] is the position of the symbol with that DocID in the
+  /// symbol list the postings were built from. DocIDs are assigned in the
+  /// order of decreasing symbol quality.
+  std::vector<uint32_t> SymbolOrder;
+  /// SymbolQuality[DocID] is the quality of the corresponding symbol.
+  std::vector<float> SymbolQuality;
+  /// Mapping from search tokens to the symbols characterized by them.
+  llvm::DenseMap<Token, PostingList> InvertedIndex;
 };
 
 } // namespace dex
@@ -12,7 +12,12 @@
 #include "Token.h"
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringExtras.h"
+#include <algorithm>
+#include <array>
 #include <cctype>
 #include <queue>
 #include <string>
@@ -22,13 +27,35 @@ namespace clang {
 namespace clangd {
 namespace dex {
 
-std::vector<Token> generateIdentifierTrigrams(StringRef Identifier) {
+PackedTrigram packTrigram(StringRef Chars) {
+  assert(!Chars.empty() && Chars.size() <= 3 && "Not a trigram");
+  PackedTrigram Result = Chars.size() << 24;
+  for (unsigned I = 0; I < Chars.size(); ++I)
+    Result |= static_cast<unsigned char>(Chars[I]) << (8 * I);
+  return Result;
+}
+
+Token unpackTrigram(PackedTrigram Packed) {
+  char Chars[3];
+  unsigned Size = Packed >> 24;
+  for (unsigned I = 0; I < Size; ++I)
+    Chars[I] = (Packed >> (8 * I)) & 0xff;
+  return Token(Token::Kind::Trigram, StringRef(Chars, Size));
+}
+
+void generateIdentifierTrigrams(StringRef Identifier,
+                                std::vector<PackedTrigram> &Out) {
+  Out.clear();
+  // Buffers are inline for typical identifiers, so that indexing millions of
+  // symbols doesn't allocate for each of them.
   // Apply fuzzy matching text segmentation.
-  std::vector<CharRole> Roles(Identifier.size());
+  SmallVector<CharRole, 64> Roles(Identifier.size());
   calculateRoles(Identifier,
                  makeMutableArrayRef(Roles.data(), Identifier.size()));
 
-  std::string LowercaseIdentifier = Identifier.lower();
+  SmallString<64> LowercaseIdentifier;
+  for (char C : Identifier)
+    LowercaseIdentifier.push_back(toLower(C));
 
   // For each character, store indices of the characters to which fuzzy matching
   // algorithm can jump. There are 3 possible variants:
@@ -38,7 +65,7 @@ std::vector<Token> generateIdentifierTrigrams(StringRef Identifier) {
   //
   // Next stores tuples of three indices in the presented order, if a variant is
   // not available then 0 is stored.
-  std::vector<std::array<unsigned, 3>> Next(LowercaseIdentifier.size());
+  SmallVector<std::array<unsigned, 3>, 64> Next(LowercaseIdentifier.size());
   unsigned NextTail = 0, NextHead = 0;
   for (int I = LowercaseIdentifier.size() - 1; I >= 0; --I) {
     Next[I] = {{NextTail, NextHead}};
@@ -48,11 +75,7 @@ std::vector<Token> generateIdentifierTrigrams(StringRef Identifier) {
     }
   }
 
-  DenseSet<Token> UniqueTrigrams;
-
-  auto Add = [&](std::string Chars) {
-    UniqueTrigrams.insert(Token(Token::Kind::Trigram, Chars));
-  };
+  auto Add = [&](StringRef Chars) { Out.push_back(packTrigram(Chars)); };
 
   // Iterate through valid sequneces of three characters Fuzzy Matcher can
   // process.
@@ -66,23 +89,36 @@ std::vector<Token> generateIdentifierTrigrams(StringRef Identifier) {
       for (const unsigned K : Next[J]) {
         if (K == 0)
           continue;
-        Add({{LowercaseIdentifier[I], LowercaseIdentifier[J],
-              LowercaseIdentifier[K]}});
+        char Chars[] = {LowercaseIdentifier[I], LowercaseIdentifier[J],
+                        LowercaseIdentifier[K]};
+        Add(StringRef(Chars, 3));
       }
     }
   }
   // Emit short-query trigrams: FooBar -> f, fo, fb.
   if (!LowercaseIdentifier.empty())
-    Add({LowercaseIdentifier[0]});
+    Add(LowercaseIdentifier.substr(0, 1));
   if (LowercaseIdentifier.size() >= 2)
-    Add({LowercaseIdentifier[0], LowercaseIdentifier[1]});
+    Add(LowercaseIdentifier.substr(0, 2));
   for (size_t I = 1; I < LowercaseIdentifier.size(); ++I)
     if (Roles[I] == Head) {
-      Add({LowercaseIdentifier[0], LowercaseIdentifier[I]});
+      char Chars[] = {LowercaseIdentifier[0], LowercaseIdentifier[I]};
+      Add(StringRef(Chars, 2));
       break;
     }
 
-  return {UniqueTrigrams.begin(), UniqueTrigrams.end()};
+  llvm::sort(Out);
+  Out.erase(std::unique(Out.begin(), Out.end()), Out.end());
+}
+
+std::vector<Token> generateIdentifierTrigrams(StringRef Identifier) {
+  std::vector<PackedTrigram> Packed;
+  generateIdentifierTrigrams(Identifier, Packed);
+  std::vector<Token> Result;
+  Result.reserve(Packed.size());
+  for (PackedTrigram T : Packed)
+    Result.push_back(unpackTrigram(T));
+  return Result;
 }
 
 std::vector<Token> generateQueryTrigrams(StringRef Query) {
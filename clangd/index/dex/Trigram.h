@@ -26,7 +26,9 @@
 
 #include "Token.h"
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace clang {
 namespace clangd {
@@ -50,6 +52,23 @@ namespace dex {
 /// Trigrams in the returned list are deduplicated.
 std::vector<Token> generateIdentifierTrigrams(llvm::StringRef Identifier);
 
+/// A trigram, or a shorter trigram for short queries, packed in an integer:
+/// the characters are stored from the lowest byte, and the length in the top
+/// byte. Packed trigrams are cheap to store, hash and compare while building
+/// an index. They never collide with the empty and tombstone keys of
+/// DenseMap<PackedTrigram>.
+using PackedTrigram = uint32_t;
+/// Packs 1 to 3 characters.
+PackedTrigram packTrigram(llvm::StringRef Chars);
+/// Returns the trigram token of a packed trigram.
+Token unpackTrigram(PackedTrigram Packed);
+
+/// Like generateIdentifierTrigrams(), but replaces the contents of \p Out
+/// with the packed trigrams, sorted and deduplicated. Doesn't allocate unless
+/// \p Out grows or the identifier is unusually long.
+void generateIdentifierTrigrams(llvm::StringRef Identifier,
+                                std::vector<PackedTrigram> &Out);
+
 /// Returns list of unique fuzzy-search trigrams given a query.
 ///
 /// Query is segmented using FuzzyMatch API and downcasted to lowercase. Then,
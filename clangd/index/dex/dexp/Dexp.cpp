@@ -13,6 +13,8 @@
 //===----------------------------------------------------------------------===//
 
 #include "SourceCode.h"
+#include "Trace.h"
+#include "index/RemoteIndex.h"
 #include "index/Serialization.h"
 #include "index/dex/Dex.h"
 #include "llvm/ADT/SmallVector.h"
@@ -20,7 +22,10 @@
 #include "llvm/ADT/StringSwitch.h"
 #include "llvm/LineEditor/LineEditor.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Signals.h"
+#include <atomic>
+#include <thread>
 
 using namespace llvm;
 using namespace clang;
@@ -31,6 +36,27 @@ namespace {
 cl::opt<std::string> IndexPath("index-path", cl::desc("Path to the index"),
                                cl::Positional, cl::Required);
 
+cl::opt<unsigned>
+    ServePort("serve",
+              cl::desc("Instead of running the REPL, serve the index to "
+                       "clangd instances started with --remote-index=host:port "
+                       "on this port (0 picks a free one)"));
+
+cl::opt<std::string> ReplayRequests(
+    "replay",
+    cl::desc("Instead of running the REPL, replay the fuzzyFind requests of "
+             "this file (a JSON array, as read by IndexBenchmark) and report "
+             "their latencies"));
+
+cl::opt<unsigned> ReplayThreads("replay-threads",
+                                cl::desc("Threads replaying the requests"),
+                                cl::init(1));
+
+cl::opt<bool> ReplayPlans(
+    "replay-plans",
+    cl::desc("Print the query tree, posting list sizes and the estimated and "
+             "actual number of documents visited by each replayed request"));
+
 static const std::string Overview = R"(
 This is an **experimental** interactive tool to process user-provided search
 queries over given symbol collection obtained via clangd-indexer. The
@@ -73,6 +99,36 @@ std::vector<SymbolID> getSymbolIDsFromIndex(StringRef QualifiedName,
   return SymIDs;
 }
 
+// Saves the args of "Dex fuzzyFind" spans, which describe the query plan, in
+// the object of PlanKey in the current context.
+class QueryPlanTracer : public trace::EventTracer {
+public:
+  static Key<json::Object *> PlanKey;
+
+  Context beginSpan(StringRef Name, json::Object *Args) override {
+    json::Object *const *Plan = Context::current().get(PlanKey);
+    if (Name != "Dex fuzzyFind" || !Plan)
+      return Context::current().clone();
+    return Context::current().derive(SpanKey,
+                                     llvm::make_unique<PlanSpan>(**Plan, Args));
+  }
+
+  void instant(StringRef Name, json::Object &&Args) override {}
+
+private:
+  // Args are complete when the span's context is destroyed.
+  struct PlanSpan {
+    PlanSpan(json::Object &Plan, json::Object *Args) : Plan(Plan), Args(Args) {}
+    ~PlanSpan() { Plan = std::move(*Args); }
+    json::Object &Plan;
+    json::Object *Args;
+  };
+  static Key<std::unique_ptr<PlanSpan>> SpanKey;
+};
+
+Key<json::Object *> QueryPlanTracer::PlanKey;
+Key<std::unique_ptr<QueryPlanTracer::PlanSpan>> QueryPlanTracer::SpanKey;
+
 // REPL commands inherit from Command and contain their options as members.
 // Creating a Command populates parser options, parseAndRun() resets them.
 class Command {
@@ -133,6 +189,10 @@ class FuzzyFind : public Command {
       cl::init(10),
       cl::desc("Max results to display"),
   };
+  cl::opt<bool> Plan{
+      "plan",
+      cl::desc("Print the query plan chosen by the index"),
+  };
 
   void run() override {
     FuzzyFindRequest Request;
@@ -148,9 +208,19 @@ class FuzzyFind : public Command {
     static const auto OutputFormat = "{0,-4} | {1,-40} | {2,-25}\n";
     outs() << formatv(OutputFormat, "Rank", "Symbol ID", "Symbol Name");
     size_t Rank = 0;
-    Index->fuzzyFind(Request, [&](const Symbol &Sym) {
-      outs() << formatv(OutputFormat, Rank++, Sym.ID.str(), Sym.Name);
-    });
+    QueryPlanTracer Tracer;
+    json::Object QueryPlan;
+    {
+      Optional<trace::Session> Session;
+      if (Plan)
+        Session.emplace(Tracer);
+      WithContextValue WithPlan(QueryPlanTracer::PlanKey, &QueryPlan);
+      Index->fuzzyFind(Request, [&](const Symbol &Sym) {
+        outs() << formatv(OutputFormat, Rank++, Sym.ID.str(), Sym.Name);
+      });
+    }
+    if (Plan)
+      outs() << formatv("{0:2}\n", json::Value(std::move(QueryPlan)));
   }
 };
 
@@ -260,6 +330,78 @@ std::unique_ptr<SymbolIndex> openIndex(StringRef Index) {
   return loadIndex(Index, /*UseDex=*/true);
 }
 
+int replay(const SymbolIndex &Index) {
+  auto Buffer = MemoryBuffer::getFile(ReplayRequests);
+  if (!Buffer) {
+    outs() << "Can't open " << ReplayRequests << ": "
+           << Buffer.getError().message() << "\n";
+    return -1;
+  }
+  auto JSON = json::parse((*Buffer)->getBuffer());
+  if (!JSON || !JSON->getAsArray()) {
+    outs() << "Expected a JSON array of requests: "
+           << (JSON ? "not an array" : toString(JSON.takeError())) << "\n";
+    return -1;
+  }
+  std::vector<FuzzyFindRequest> Requests;
+  for (const json::Value &Item : *JSON->getAsArray()) {
+    Requests.emplace_back();
+    if (!fromJSON(Item, Requests.back())) {
+      outs() << "Bad request: " << Item << "\n";
+      return -1;
+    }
+  }
+
+  QueryPlanTracer Tracer;
+  Optional<trace::Session> Session;
+  if (ReplayPlans)
+    Session.emplace(Tracer);
+  using Clock = std::chrono::steady_clock;
+  std::vector<double> Latencies(Requests.size());
+  std::vector<json::Object> Plans(Requests.size());
+  std::atomic<size_t> Next{0};
+  auto Replay = [&] {
+    for (size_t I; (I = Next++) < Requests.size();) {
+      WithContextValue WithPlan(QueryPlanTracer::PlanKey, &Plans[I]);
+      auto Start = Clock::now();
+      Index.fuzzyFind(Requests[I], [](const Symbol &) {});
+      Latencies[I] =
+          std::chrono::duration<double, std::milli>(Clock::now() - Start)
+              .count();
+    }
+  };
+  auto Start = Clock::now();
+  std::vector<std::thread> Threads;
+  for (unsigned I = 0; I < std::max(1u, unsigned(ReplayThreads)); ++I)
+    Threads.emplace_back(Replay);
+  for (auto &Thread : Threads)
+    Thread.join();
+  double Seconds =
+      std::chrono::duration<double>(Clock::now() - Start).count();
+
+  if (ReplayPlans)
+    for (size_t I = 0; I < Requests.size(); ++I)
+      outs() << json::Value(json::Object{{"request", toJSON(Requests[I])},
+                                         {"latency_ms", Latencies[I]},
+                                         {"plan", std::move(Plans[I])}})
+             << "\n";
+  std::vector<double> Sorted = Latencies;
+  llvm::sort(Sorted);
+  auto Percentile = [&](double P) {
+    return Sorted.empty() ? 0 : Sorted[std::min<size_t>(
+                                    Sorted.size() - 1, P * Sorted.size())];
+  };
+  outs() << formatv("{0} requests on {1} threads in {2:f3}s: {3:f1} "
+                    "requests/s\n",
+                    Requests.size(), Threads.size(), Seconds,
+                    Seconds > 0 ? Requests.size() / Seconds : 0);
+  outs() << formatv("Latency: p50 {0:f3}ms, p90 {1:f3}ms, p99 {2:f3}ms, "
+                    "max {3:f3}ms\n",
+                    Percentile(0.5), Percentile(0.9), Percentile(0.99),
+                    Sorted.empty() ? 0 : Sorted.back());
+  return 0;
+}
+
 } // namespace
 
 int main(int argc, const char *argv[]) {
@@ -277,6 +419,21 @@ int main(int argc, const char *argv[]) {
     return -1;
   }
 
+  if (ServePort.getNumOccurrences()) {
+    auto Server = RemoteIndexServer::listen(*Index, ServePort);
+    if (!Server) {
+      outs() << toString(Server.takeError()) << "\n";
+      return -1;
+    }
+    outs() << formatv("Serving the index on port {0}.\n", (*Server)->port());
+    outs().flush();
+    (*Server)->run();
+    return 0;
+  }
+
+  if (ReplayRequests.getNumOccurrences())
+    return replay(*Index);
+
   LineEditor LE("dexp");
 
   while (Optional<std::string> Request = LE.readLine()) {
@@ -13,14 +13,18 @@
 
 #include "index/Index.h"
 #include "index/IndexAction.h"
-#include "index/Merge.h"
 #include "index/Serialization.h"
 #include "index/SymbolCollector.h"
+#include "index/dex/Dex.h"
+#include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Execution.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/xxhash.h"
 
 using namespace llvm;
 using namespace clang::tooling;
@@ -37,30 +41,104 @@ static cl::opt<IndexFileFormat>
                                  "binary RIFF format")),
            cl::init(IndexFileFormat::RIFF));
 
+static cl::opt<bool> DexPostings(
+    "dex-postings",
+    cl::desc("Include prebuilt Dex posting lists in the binary index, so that "
+             "clangd doesn't need to rebuild them when loading it"),
+    cl::init(true));
+
+static cl::opt<bool> CompressStrings(
+    "compress-strings",
+    cl::desc("Compress the string table of the binary index. An uncompressed "
+             "index is larger, but clangd uses its strings in place, so "
+             "processes loading the same index share them"),
+    cl::init(true));
+
+static cl::opt<bool> CompressDocumentation(
+    "compress-documentation",
+    cl::desc("Write the documentation of the symbols to the binary index in "
+             "compressed blocks, which clangd decompresses on demand"),
+    cl::init(false));
+
+static cl::opt<std::string> PartitionSpec(
+    "shard",
+    cl::desc("Only index the translation units of partition I out of N, "
+             "given as I/N. Indexes of all partitions can be combined with "
+             "'clangd-indexer merge'"),
+    cl::init(""));
+
+static cl::opt<bool> CheckIDCollisions(
+    "check-id-collisions",
+    cl::desc("Report the symbol IDs shared by different symbols. Symbols whose "
+             "IDs collide are merged in the index"),
+    cl::init(false));
+
+// Parses a --shard value of the form I/N.
+bool parsePartition(StringRef Spec, unsigned &Partition,
+                    unsigned &NumPartitions) {
+  StringRef I, N;
+  std::tie(I, N) = Spec.split('/');
+  return !I.getAsInteger(10, Partition) && !N.getAsInteger(10, NumPartitions) &&
+         Partition < NumPartitions;
+}
+
+// Symbols and refs are merged into shards by SymbolID, so that TUs finishing
+// at the same time rarely contend for the same lock. The shards hold disjoint
+// symbols, and are combined without merging once all TUs are indexed.
 class IndexActionFactory : public tooling::FrontendActionFactory {
 public:
-  IndexActionFactory(IndexFileIn &Result) : Result(Result) {}
+  IndexActionFactory(IndexFileIn &Result, unsigned Partition = 0,
+                     unsigned NumPartitions = 1,
+                     SymbolIDCollisionDetector *IDCollisions = nullptr)
+      : Result(Result), Partition(Partition), NumPartitions(NumPartitions),
+        IDCollisions(IDCollisions) {}
+
+  // Skips the translation units of other partitions. They are assigned by a
+  // hash of the main file's path, so that workers agree on the partitions
+  // without coordination.
+  bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                     FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     DiagnosticConsumer *DiagConsumer) override {
+    const auto &Inputs = Invocation->getFrontendOpts().Inputs;
+    if (NumPartitions > 1 && !Inputs.empty() &&
+        xxHash64(Inputs.front().getFile()) % NumPartitions != Partition)
+      return true;
+    return FrontendActionFactory::runInvocation(
+        std::move(Invocation), Files, std::move(PCHContainerOps),
+        DiagConsumer);
+  }
 
   clang::FrontendAction *create() override {
     SymbolCollector::Options Opts;
+    Opts.IDCollisions = IDCollisions;
     return createStaticIndexingAction(
                Opts,
                [&](SymbolSlab S) {
                  // Merge as we go.
-                 std::lock_guard<std::mutex> Lock(SymbolsMu);
-                 for (const auto &Sym : S) {
-                   if (const auto *Existing = Symbols.find(Sym.ID))
-                     Symbols.insert(mergeSymbol(*Existing, Sym));
-                   else
-                     Symbols.insert(Sym);
+                 std::vector<const Symbol *> Buckets[NumShards];
+                 for (const auto &Sym : S)
+                   Buckets[shardFor(Sym.ID)].push_back(&Sym);
+                 for (unsigned I = 0; I < NumShards; ++I) {
+                   if (Buckets[I].empty())
+                     continue;
+                   std::lock_guard<std::mutex> Lock(Shards[I].Mu);
+                   for (const Symbol *Sym : Buckets[I])
+                     Shards[I].Symbols.merge(*Sym);
                  }
                },
                [&](RefSlab S) {
-                 std::lock_guard<std::mutex> Lock(SymbolsMu);
-                 for (const auto &Sym : S) {
+                 std::vector<const RefSlab::value_type *> Buckets[NumShards];
+                 for (const auto &Sym : S)
+                   Buckets[shardFor(Sym.first)].push_back(&Sym);
+                 for (unsigned I = 0; I < NumShards; ++I) {
+                   if (Buckets[I].empty())
+                     continue;
+                   std::lock_guard<std::mutex> Lock(Shards[I].Mu);
                    // No need to merge as currently all Refs are from main file.
-                   for (const auto &Ref : Sym.second)
-                     Refs.insert(Sym.first, Ref);
+                   for (const auto *Sym : Buckets[I])
+                     for (const auto &Ref : Sym->second)
+                       Shards[I].Refs.insert(Sym->first, Ref);
                  }
                })
         .release();
@@ -69,16 +147,110 @@ public:
   // Awkward: we write the result in the destructor, because the executor
   // takes ownership so it's the easiest way to get our data back out.
   ~IndexActionFactory() {
+    SymbolSlab SymbolShards[NumShards];
+    RefSlab RefShards[NumShards];
+    {
+      ThreadPool Pool;
+      for (unsigned I = 0; I < NumShards; ++I)
+        Pool.async([&, I] {
+          SymbolShards[I] = std::move(Shards[I].Symbols).build();
+          RefShards[I] = std::move(Shards[I].Refs).build();
+        });
+    }
+    SymbolSlab::Builder Symbols;
+    RefSlab::Builder Refs;
+    for (unsigned I = 0; I < NumShards; ++I) {
+      // Shards have disjoint symbols, so adopt them without copying.
+      Symbols.insert(std::move(SymbolShards[I]));
+      for (const auto &Sym : RefShards[I])
+        for (const auto &Ref : Sym.second)
+          Refs.insert(Sym.first, Ref);
+      RefShards[I] = RefSlab();
+    }
     Result.Symbols = std::move(Symbols).build();
     Result.Refs = std::move(Refs).build();
   }
 
 private:
+  static constexpr unsigned NumShards = 64;
+  static unsigned shardFor(const SymbolID &ID) {
+    return hash_value(ID) % NumShards;
+  }
+
+  struct Shard {
+    std::mutex Mu;
+    SymbolSlab::Builder Symbols;
+    RefSlab::Builder Refs;
+  };
+
   IndexFileIn &Result;
-  std::mutex SymbolsMu;
+  unsigned Partition;
+  unsigned NumPartitions;
+  SymbolIDCollisionDetector *IDCollisions;
+  Shard Shards[NumShards];
+};
+
+// Combines index files, e.g. of several partitions, into one.
+Expected<IndexFileIn> mergeIndexFiles(ArrayRef<std::string> Paths) {
   SymbolSlab::Builder Symbols;
   RefSlab::Builder Refs;
-};
+  for (const auto &Path : Paths) {
+    auto Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer)
+      return make_error<StringError>("Can't open " + Path, Buffer.getError());
+    auto Partial = readIndexFile((*Buffer)->getBuffer());
+    if (!Partial)
+      return make_error<StringError>("Bad index file " + Path + ": " +
+                                         toString(Partial.takeError()),
+                                     inconvertibleErrorCode());
+    if (Partial->Symbols)
+      for (const auto &Sym : *Partial->Symbols)
+        Symbols.merge(Sym);
+    if (Partial->Refs)
+      for (const auto &Sym : *Partial->Refs)
+        // Each translation unit is indexed by exactly one partition, and refs
+        // are only collected from main files, so there are no duplicates.
+        for (const auto &Ref : Sym.second)
+          Refs.insert(Sym.first, Ref);
+  }
+  IndexFileIn Result;
+  Result.Symbols = std::move(Symbols).build();
+  Result.Refs = std::move(Refs).build();
+  return std::move(Result);
+}
+
+void writeIndex(const IndexFileIn &Data) {
+  IndexFileOut Out(Data);
+  Out.Format = Format;
+  Out.CompressStrings = CompressStrings;
+  Out.CompressDocumentation = CompressDocumentation;
+  dex::Postings Postings;
+  if (DexPostings && Out.Format == IndexFileFormat::RIFF) {
+    std::vector<const Symbol *> Symbols;
+    for (const auto &Sym : *Data.Symbols)
+      Symbols.push_back(&Sym);
+    Postings = dex::buildPostings(Symbols);
+    Out.Postings = &Postings;
+  }
+  outs() << Out;
+}
+
+// Implements 'clangd-indexer merge'. Argv[0] is the subcommand.
+int mergeMain(int Argc, const char **Argv) {
+  static cl::list<std::string> Inputs(cl::Positional, cl::OneOrMore,
+                                      cl::desc("<index files>"));
+  cl::ParseCommandLineOptions(
+      Argc, Argv,
+      "Merges index files, e.g. produced by --shard, into one index.\n\n"
+      "  $ clangd-indexer merge part0.idx part1.idx > clangd.dex\n");
+  auto Data = mergeIndexFiles(Inputs);
+  if (!Data) {
+    errs() << toString(Data.takeError()) << "\n";
+    return 1;
+  }
+  writeIndex(*Data);
+  return 0;
+}
 
 } // namespace
 } // namespace clangd
@@ -98,9 +270,23 @@ int main(int argc, const char **argv) {
 
   $ clangd-indexer File1.cpp File2.cpp ... FileN.cpp > clangd.dex
 
+  Example usage for indexing one of 8 partitions of a project, and combining
+  the partial indexes:
+
+  $ clangd-indexer --executor=all-TUs --shard=3/8 compile_commands.json > 3.idx
+  $ clangd-indexer merge 0.idx 1.idx ... 7.idx > clangd.dex
+
+  Example usage for converting a YAML index to the binary format, which loads
+  much faster:
+
+  $ clangd-indexer merge index.yaml > clangd.dex
+
   Note: only symbols from header files will be indexed.
   )";
 
+  if (argc > 1 && StringRef(argv[1]) == "merge")
+    return clang::clangd::mergeMain(argc - 1, argv + 1);
+
   auto Executor = clang::tooling::createExecutorFromCommandLineArgs(
       argc, argv, cl::GeneralCategory, Overview);
 
@@ -109,17 +295,28 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
+  unsigned Partition = 0, NumPartitions = 1;
+  StringRef Spec = clang::clangd::PartitionSpec;
+  if (!Spec.empty() &&
+      !clang::clangd::parsePartition(Spec, Partition, NumPartitions)) {
+    errs() << "--shard must be I/N with I < N, got " << Spec << "\n";
+    return 1;
+  }
+
   // Collect symbols found in each translation unit, merging as we go.
   clang::clangd::IndexFileIn Data;
+  clang::clangd::SymbolIDCollisionDetector IDCollisions;
   auto Err = Executor->get()->execute(
-      llvm::make_unique<clang::clangd::IndexActionFactory>(Data));
+      llvm::make_unique<clang::clangd::IndexActionFactory>(
+          Data, Partition, NumPartitions,
+          clang::clangd::CheckIDCollisions ? &IDCollisions : nullptr));
   if (Err) {
     errs() << toString(std::move(Err)) << "\n";
   }
+  for (const auto &ID : IDCollisions.collisions())
+    errs() << "Symbol ID " << ID << " is shared by several symbols\n";
 
   // Emit collected data.
-  clang::clangd::IndexFileOut Out(Data);
-  Out.Format = clang::clangd::Format;
-  outs() << Out;
+  clang::clangd::writeIndex(Data);
   return 0;
 }
@@ -0,0 +1,27 @@
+# Generates the decision forest runtime for code completion ranking.
+# The model in ${model} is compiled by CompletionModelCodegen.py into
+# ${filename}.h and ${filename}.cpp in the current binary directory, defining
+# the example class ${cpp_class} and `float Evaluate(const ${cpp_class} &)`.
+set(CLANGD_COMPLETION_MODEL_COMPILER
+  ${CMAKE_CURRENT_LIST_DIR}/CompletionModelCodegen.py)
+
+function(gen_decision_forest model filename cpp_class)
+  set(output_dir ${CMAKE_CURRENT_BINARY_DIR})
+  set(header_file ${output_dir}/${filename}.h)
+  set(cpp_file ${output_dir}/${filename}.cpp)
+
+  add_custom_command(OUTPUT ${header_file} ${cpp_file}
+    COMMAND "${PYTHON_EXECUTABLE}" ${CLANGD_COMPLETION_MODEL_COMPILER}
+      --model ${model}
+      --output_dir ${output_dir}
+      --filename ${filename}
+      --cpp_class ${cpp_class}
+    COMMENT "Generating code completion model runtime..."
+    DEPENDS ${CLANGD_COMPLETION_MODEL_COMPILER}
+      ${model}/forest.json
+      ${model}/features.json
+    VERBATIM)
+
+  set_source_files_properties(${header_file} ${cpp_file} PROPERTIES
+    GENERATED 1)
+endfunction()
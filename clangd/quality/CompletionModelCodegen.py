@@ -0,0 +1,142 @@
+#!/usr/bin/env python
+"""Compiles the decision forest that ranks code completion candidates.
+
+Reads the model in MODEL_DIR: features.json lists the features of an example,
+and forest.json the trees. Writes OUTPUT_DIR/FILENAME.h, declaring the
+example class CPP_CLASS with a setter per feature, and OUTPUT_DIR/FILENAME.cpp,
+defining `float Evaluate(const CPP_CLASS &)` as straight-line code: each tree
+becomes a block of branches, so scoring an example interprets nothing.
+
+A tree node is one of:
+  {"operation": "if_greater", "feature": F, "threshold": T,
+   "then": NODE, "else": NODE}          for NUMBER features, tests F > T.
+  {"operation": "if_member", "feature": F, "set": [ENUMERATOR...],
+   "then": NODE, "else": NODE}          for ENUM features.
+  {"operation": "boost", "score": S}    adds S to the score.
+"""
+
+import argparse
+import json
+import os
+
+
+def header_guard(filename):
+    return "GENERATED_DECISION_FOREST_MODEL_%s_H" % filename.upper()
+
+
+def split_class(cpp_class):
+    parts = cpp_class.split("::")
+    return [ns for ns in parts[:-1] if ns], parts[-1]
+
+
+def gen_header(features, filename, cpp_class):
+    namespaces, name = split_class(cpp_class)
+    headers = sorted(set(f["header"] for f in features if "header" in f))
+    lines = ["// Generated by CompletionModelCodegen.py. Do not edit.",
+             "#ifndef %s" % header_guard(filename),
+             "#define %s" % header_guard(filename), "",
+             "#include <cstdint>"]
+    lines += ['#include "%s"' % h for h in headers]
+    lines.append("")
+    lines += ["namespace %s {" % ns for ns in namespaces]
+    lines += ["class %s {" % name, "public:"]
+    for f in features:
+        if f["kind"] == "NUMBER":
+            lines.append("  void set%s(float V) { %s = V; }" %
+                         (f["name"], f["name"]))
+        else:
+            lines.append("  void set%s(unsigned V) { %s = 1u << V; }" %
+                         (f["name"], f["name"]))
+    lines += ["", "private:"]
+    for f in features:
+        if f["kind"] == "NUMBER":
+            lines.append("  float %s = 0;" % f["name"])
+        else:
+            # A bit set with the enumerator, tested against sets of them.
+            lines.append("  uint32_t %s = 0;" % f["name"])
+    lines += ["", "  friend float Evaluate(const %s &);" % name, "};", "",
+              "float Evaluate(const %s &);" % name]
+    lines += ["} // namespace %s" % ns for ns in reversed(namespaces)]
+    lines += ["", "#endif // %s" % header_guard(filename), ""]
+    return "\n".join(lines)
+
+
+class TreeCompiler(object):
+    def __init__(self, features, tree_id):
+        self.features = {f["name"]: f for f in features}
+        self.tree_id = tree_id
+        self.next_label = 0
+        self.lines = []
+
+    def label(self):
+        self.next_label += 1
+        return "t%d_n%d" % (self.tree_id, self.next_label)
+
+    def end(self):
+        return "t%d_end" % self.tree_id
+
+    def compile(self, node):
+        op = node["operation"]
+        if op == "boost":
+            self.lines.append("  Score += %rf;" % float(node["score"]))
+            self.lines.append("  goto %s;" % self.end())
+            return
+        feature = self.features[node["feature"]]
+        if op == "if_greater":
+            assert feature["kind"] == "NUMBER", node
+            cond = "E.%s > %rf" % (feature["name"],
+                                   float(node["threshold"]))
+        elif op == "if_member":
+            assert feature["kind"] == "ENUM", node
+            mask = " | ".join("(1u << unsigned(%s::%s))" %
+                              (feature["type"], e) for e in node["set"])
+            cond = "E.%s & (%s)" % (feature["name"], mask)
+        else:
+            raise ValueError("Unknown operation: %s" % op)
+        then_label = self.label()
+        self.lines.append("  if (%s)" % cond)
+        self.lines.append("    goto %s;" % then_label)
+        self.compile(node["else"])
+        self.lines.append("%s:" % then_label)
+        self.compile(node["then"])
+
+
+def gen_cpp(features, forest, filename, cpp_class):
+    namespaces, name = split_class(cpp_class)
+    lines = ["// Generated by CompletionModelCodegen.py. Do not edit.",
+             '#include "%s.h"' % filename, ""]
+    lines += ["namespace %s {" % ns for ns in namespaces]
+    lines += ["float Evaluate(const %s &E) {" % name, "  float Score = 0;"]
+    for tree_id, tree in enumerate(forest):
+        compiler = TreeCompiler(features, tree_id)
+        compiler.compile(tree)
+        lines.append("")
+        lines += compiler.lines
+        lines.append("%s:;" % compiler.end())
+    lines += ["  return Score;", "}"]
+    lines += ["} // namespace %s" % ns for ns in reversed(namespaces)]
+    lines.append("")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--model", required=True, help="MODEL_DIR")
+    parser.add_argument("--output_dir", required=True, help="OUTPUT_DIR")
+    parser.add_argument("--filename", required=True, help="FILENAME")
+    parser.add_argument("--cpp_class", required=True, help="CPP_CLASS")
+    args = parser.parse_args()
+
+    with open(os.path.join(args.model, "features.json")) as f:
+        features = json.load(f)
+    with open(os.path.join(args.model, "forest.json")) as f:
+        forest = json.load(f)
+
+    with open(os.path.join(args.output_dir, args.filename + ".h"), "w") as f:
+        f.write(gen_header(features, args.filename, args.cpp_class))
+    with open(os.path.join(args.output_dir, args.filename + ".cpp"), "w") as f:
+        f.write(gen_cpp(features, forest, args.filename, args.cpp_class))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,336 @@
+//===--- ReplayMain.cpp - Replay recorded LSP sessions against clangd -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// clangd-replay sends the messages of a session recorded by
+// `clangd -record-session` to an in-process ClangdLSPServer, and reports:
+//  - the latency of requests, per method;
+//  - the time from opening a file to its first diagnostics;
+//  - the peak resident memory of the process.
+//
+// Messages are sent at their recorded times, scaled by -time-scale. With
+// -time-scale=0, each message is sent once the previous requests were answered
+// instead, so that the server sees the same sequence of events on every run.
+// Files referenced by the session must still exist on disk.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangdLSPServer.h"
+#include "Logger.h"
+#include "Path.h"
+#include "Transport.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace llvm;
+using namespace clang;
+using namespace clang::clangd;
+
+static cl::opt<std::string> SessionFile(cl::Positional, cl::Required,
+                                        cl::desc("<session recording>"));
+
+static cl::opt<double> TimeScale(
+    "time-scale",
+    cl::desc("Multiplies the recorded delays between messages. 0 sends each "
+             "message as soon as the previous requests were answered, which "
+             "makes runs deterministic."),
+    cl::init(1.0));
+
+static cl::opt<unsigned>
+    WorkerThreadsCount("j", cl::desc("Number of async workers used by clangd"),
+                       cl::init(getDefaultAsyncThreadsCount()));
+
+static cl::opt<bool> EnableIndex("index",
+                                 cl::desc("Enable the dynamic index of clangd"),
+                                 cl::init(true));
+
+static cl::opt<Path> CompileCommandsDir(
+    "compile-commands-dir",
+    cl::desc("Specify a path to look for compile_commands.json. If path "
+             "is invalid, clangd will look in the current directory and "
+             "parent paths of each source file."));
+
+static cl::opt<Logger::Level> LogLevel(
+    "log", cl::desc("Verbosity of log messages written to stderr"),
+    cl::values(clEnumValN(Logger::Error, "error", "Error messages only"),
+               clEnumValN(Logger::Info, "info", "High level execution tracing"),
+               clEnumValN(Logger::Debug, "verbose", "Low level details")),
+    cl::init(Logger::Error));
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Milliseconds = std::chrono::duration<double, std::milli>;
+
+struct RecordedMessage {
+  // Time since the start of the session.
+  Milliseconds Time;
+  json::Value Message;
+};
+
+// Reads a session written by newRecordingTransport().
+Expected<std::vector<RecordedMessage>> readSession(StringRef Data) {
+  std::vector<RecordedMessage> Messages;
+  Milliseconds Time(0);
+  std::string JSON;
+  auto Flush = [&]() -> Error {
+    if (StringRef(JSON).trim().empty())
+      return Error::success();
+    auto Message = json::parse(JSON);
+    if (!Message)
+      return Message.takeError();
+    Messages.push_back({Time, std::move(*Message)});
+    JSON.clear();
+    return Error::success();
+  };
+  SmallVector<StringRef, 0> Lines;
+  Data.split(Lines, '\n');
+  for (StringRef Line : Lines) {
+    if (Line.consume_front("#")) {
+      StringRef Comment = Line.trim();
+      double T;
+      if (Comment.consume_front("t=") && !Comment.getAsDouble(T))
+        Time = Milliseconds(T);
+    } else if (Line.rtrim() == "---") {
+      if (auto Err = Flush())
+        return std::move(Err);
+    } else {
+      JSON += Line;
+      JSON += '\n';
+    }
+  }
+  if (auto Err = Flush())
+    return std::move(Err);
+  return std::move(Messages);
+}
+
+// Feeds recorded messages to the server, and times its responses.
+class ReplayTransport : public Transport {
+public:
+  ReplayTransport(std::vector<RecordedMessage> Messages)
+      : Messages(std::move(Messages)) {}
+
+  void notify(StringRef Method, json::Value Params) override {
+    if (Method != "textDocument/publishDiagnostics")
+      return;
+    const json::Object *O = Params.getAsObject();
+    if (!O)
+      return;
+    auto URI = O->getString("uri");
+    if (!URI)
+      return;
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto Opened = OpenTimes.find(*URI);
+    if (Opened != OpenTimes.end()) {
+      FirstDiagnostics.push_back(Clock::now() - Opened->second);
+      OpenTimes.erase(Opened);
+    }
+  }
+  // Requests of the server are not answered, the session contains the
+  // recorded replies of the client.
+  void call(StringRef Method, json::Value Params, json::Value ID) override {}
+  void reply(json::Value ID, Expected<json::Value> Result) override {
+    if (!Result)
+      consumeError(Result.takeError());
+    std::lock_guard<std::mutex> Lock(Mu);
+    auto It = Pending.find(key(ID));
+    if (It == Pending.end())
+      return;
+    Latencies[It->second.first].push_back(Clock::now() - It->second.second);
+    Pending.erase(It);
+    PendingChanged.notify_all();
+  }
+
+  Error loop(MessageHandler &Handler) override {
+    auto Start = Clock::now();
+    for (RecordedMessage &M : Messages) {
+      const json::Object *O = M.Message.getAsObject();
+      if (!O)
+        continue;
+      auto Method = O->getString("method");
+      // Let exit wait for pending requests, they would be cancelled.
+      if (TimeScale == 0 || (Method && *Method == "exit"))
+        waitForPending();
+      else
+        std::this_thread::sleep_until(
+            Start + std::chrono::duration_cast<Clock::duration>(M.Time) *
+                        double(TimeScale));
+      if (!dispatch(*O, Handler))
+        return Error::success();
+    }
+    // The session was cut short, shut down like a client would.
+    waitForPending();
+    Handler.onCall("shutdown", nullptr, "replay-shutdown");
+    Handler.onNotify("exit", nullptr);
+    return Error::success();
+  }
+
+  void printReport(raw_ostream &OS) {
+    std::lock_guard<std::mutex> Lock(Mu);
+    OS << formatv("{0,-40} {1,7} {2,9} {3,9} {4,9} {5,9}\n", "method",
+                  "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    std::vector<StringRef> Methods;
+    for (const auto &L : Latencies)
+      Methods.push_back(L.first());
+    llvm::sort(Methods);
+    for (StringRef Method : Methods)
+      printPercentiles(OS, Method, Latencies[Method]);
+    printPercentiles(OS, "(first diagnostics after didOpen)",
+                     FirstDiagnostics);
+    if (!OpenTimes.empty())
+      OS << OpenTimes.size() << " opened files got no diagnostics\n";
+    if (!Pending.empty())
+      OS << Pending.size() << " requests got no reply\n";
+  }
+
+private:
+  static std::string key(const json::Value &ID) {
+    return formatv("{0}", ID).str();
+  }
+
+  static void printPercentiles(raw_ostream &OS, StringRef Name,
+                               std::vector<Milliseconds> Times) {
+    if (Times.empty())
+      return;
+    llvm::sort(Times);
+    auto At = [&](double P) {
+      size_t Rank = std::ceil(P * Times.size());
+      return Times[std::min(Times.size(), std::max<size_t>(Rank, 1)) - 1]
+          .count();
+    };
+    OS << formatv("{0,-40} {1,7} {2,9:f1} {3,9:f1} {4,9:f1} {5,9:f1}\n", Name,
+                  Times.size(), At(0.5), At(0.9), At(0.99),
+                  Times.back().count());
+  }
+
+  void waitForPending() {
+    std::unique_lock<std::mutex> Lock(Mu);
+    PendingChanged.wait(Lock, [&] { return Pending.empty(); });
+  }
+
+  // Sends a message to the server, as JSONTransport would.
+  bool dispatch(const json::Object &Message, MessageHandler &Handler) {
+    auto Method = Message.getString("method");
+    const json::Value *ID = Message.get("id");
+    json::Value Params = nullptr;
+    if (const json::Value *P = Message.get("params"))
+      Params = *P;
+    if (!Method) {
+      if (!ID)
+        return true;
+      if (const json::Value *R = Message.get("result"))
+        return Handler.onReply(*ID, *R);
+      return Handler.onReply(*ID, nullptr);
+    }
+    {
+      std::lock_guard<std::mutex> Lock(Mu);
+      if (ID)
+        Pending[key(*ID)] = {*Method, Clock::now()};
+      if (*Method == "textDocument/didOpen")
+        if (const json::Object *P = Params.getAsObject())
+          if (const json::Object *Doc = P->getObject("textDocument"))
+            if (auto URI = Doc->getString("uri"))
+              OpenTimes.try_emplace(*URI, Clock::now());
+    }
+    if (ID)
+      return Handler.onCall(*Method, std::move(Params), *ID);
+    return Handler.onNotify(*Method, std::move(Params));
+  }
+
+  std::vector<RecordedMessage> Messages;
+
+  std::mutex Mu;
+  std::condition_variable PendingChanged;
+  // Requests without a reply yet, by ID: their method and send time.
+  std::map<std::string, std::pair<std::string, Clock::time_point>> Pending;
+  StringMap<std::vector<Milliseconds>> Latencies;
+  // Opened files that didn't get diagnostics yet, by URI.
+  StringMap<Clock::time_point> OpenTimes;
+  std::vector<Milliseconds> FirstDiagnostics;
+};
+
+// Returns the peak resident memory of the process in bytes, or 0 if unknown.
+size_t peakRSS() {
+#ifdef LLVM_ON_UNIX
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) == 0) {
+#ifdef __APPLE__
+    return Usage.ru_maxrss;
+#else
+    return size_t(Usage.ru_maxrss) * 1024;
+#endif
+  }
+#endif
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "Replays a recorded LSP session against clangd "
+                              "and reports its latencies.\n");
+  if (TimeScale < 0) {
+    errs() << "-time-scale must not be negative\n";
+    return 1;
+  }
+
+  auto Buffer = MemoryBuffer::getFile(SessionFile);
+  if (!Buffer) {
+    errs() << "Can't open " << SessionFile << ": "
+           << Buffer.getError().message() << "\n";
+    return 1;
+  }
+  auto Messages = readSession((*Buffer)->getBuffer());
+  if (!Messages) {
+    errs() << "Can't read " << SessionFile << ": "
+           << toString(Messages.takeError()) << "\n";
+    return 1;
+  }
+
+  StreamLogger Logger(errs(), LogLevel);
+  LoggingSession LoggingSession(Logger);
+
+  ClangdServer::Options Opts;
+  Opts.AsyncThreadsCount = WorkerThreadsCount;
+  Opts.BuildDynamicSymbolIndex = EnableIndex;
+  clangd::CodeCompleteOptions CCOpts;
+  Optional<Path> CompileCommandsDirPath;
+  if (!CompileCommandsDir.empty())
+    CompileCommandsDirPath = CompileCommandsDir;
+
+  ReplayTransport Transport(std::move(*Messages));
+  auto Start = Clock::now();
+  {
+    ClangdLSPServer LSPServer(Transport, CCOpts, CompileCommandsDirPath,
+                              /*UseDirBasedCDB=*/true, Opts);
+    LSPServer.run();
+  }
+  Milliseconds Elapsed = Clock::now() - Start;
+
+  Transport.printReport(outs());
+  outs() << formatv("total time: {0:f1} ms\n", Elapsed.count());
+  if (size_t RSS = peakRSS())
+    outs() << formatv("peak RSS: {0} MB\n", RSS >> 20);
+  return 0;
+}
@@ -0,0 +1,242 @@
+//===--- Check.cpp - Offline performance check of a single file -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs clangd on a single file without an editor, to reproduce reports like
+// "clangd is slow on this file". The file is built through ClangdServer as if
+// it was opened, then code completion, hover and go-to-definition run at a
+// sample of its identifiers. The report is a JSON object with:
+//   - build_ms: the time to build the preamble and the AST, and to index them
+//   - diagnostics, errors: the number of diagnostics and errors of the file
+//   - memory, disk: the memory used by the files and the indexes, and the
+//     preambles stored on disk, as by ClangdServer::profile()
+//   - requests: the latencies of each kind of request
+//   - trace: the latencies of the spans traced meanwhile, e.g. the preamble
+//     and AST builds and the index queries, and the recorded metrics
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangdServer.h"
+#include "CodeComplete.h"
+#include "GlobalCompilationDatabase.h"
+#include "Logger.h"
+#include "MemoryTree.h"
+#include "SourceCode.h"
+#include "Trace.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <mutex>
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point Start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - Start)
+      .count();
+}
+
+class CountingDiagnostics : public DiagnosticsConsumer {
+public:
+  void onDiagnosticsReady(PathRef File,
+                          std::vector<Diag> Diagnostics) override {
+    std::lock_guard<std::mutex> Lock(Mu);
+    Count = Diagnostics.size();
+    Errors = 0;
+    for (const auto &D : Diagnostics)
+      if (D.Severity >= DiagnosticsEngine::Error)
+        ++Errors;
+  }
+
+  size_t count() {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return Count;
+  }
+  size_t errors() {
+    std::lock_guard<std::mutex> Lock(Mu);
+    return Errors;
+  }
+
+private:
+  std::mutex Mu;
+  size_t Count = 0;
+  size_t Errors = 0;
+};
+
+// The latencies of the requests of a kind.
+class Latencies {
+public:
+  void add(bool Succeeded, double Milliseconds) {
+    Times.push_back(Milliseconds);
+    if (!Succeeded)
+      ++Failed;
+  }
+
+  json::Value toJSON() const {
+    std::vector<double> Sorted = Times;
+    llvm::sort(Sorted);
+    double Total = 0;
+    for (double T : Sorted)
+      Total += T;
+    auto Percentile = [&](double P) {
+      return Sorted.empty() ? 0 : Sorted[size_t(P * (Sorted.size() - 1))];
+    };
+    return json::Object{
+        {"count", int64_t(Sorted.size())},
+        {"failed", int64_t(Failed)},
+        {"mean_ms", Sorted.empty() ? 0 : Total / Sorted.size()},
+        {"p50_ms", Percentile(0.5)},
+        {"p95_ms", Percentile(0.95)},
+        {"max_ms", Sorted.empty() ? 0 : Sorted.back()},
+    };
+  }
+
+private:
+  std::vector<double> Times;
+  unsigned Failed = 0;
+};
+
+// Runs a request of ClangdServer and waits for its result.
+template <typename T>
+void runTimed(function_ref<void(Callback<T>)> Request, Latencies &Out) {
+  auto Start = Clock::now();
+  std::promise<bool> Done;
+  Request([&](Expected<T> Result) {
+    if (!Result) {
+      vlog("Check request failed: {0}", Result.takeError());
+      Done.set_value(false);
+      return;
+    }
+    Done.set_value(true);
+  });
+  bool Succeeded = Done.get_future().get();
+  Out.add(Succeeded, millisecondsSince(Start));
+}
+
+// Returns the positions of up to MaxPositions identifiers, spread over the
+// file.
+std::vector<Position> sampleIdentifiers(StringRef Code,
+                                        const LangOptions &LangOpts,
+                                        unsigned MaxPositions) {
+  std::vector<size_t> Offsets;
+  Lexer RawLexer(SourceLocation(), LangOpts, Code.begin(), Code.begin(),
+                 Code.end());
+  Token Tok;
+  do {
+    RawLexer.LexFromRawLexer(Tok);
+    if (Tok.is(tok::raw_identifier))
+      Offsets.push_back(Tok.getRawIdentifier().data() - Code.data());
+  } while (Tok.isNot(tok::eof));
+
+  std::vector<Position> Positions;
+  if (Offsets.empty() || MaxPositions == 0)
+    return Positions;
+  size_t Step = (Offsets.size() + MaxPositions - 1) / MaxPositions;
+  for (size_t I = 0; I < Offsets.size(); I += Step)
+    Positions.push_back(offsetToPosition(Code, Offsets[I]));
+  return Positions;
+}
+
+} // namespace
+
+// Declared in ClangdMain.cpp.
+bool check(StringRef File, Optional<Path> CompileCommandsDir,
+           const ClangdServer::Options &Opts,
+           const clangd::CodeCompleteOptions &CCOpts, unsigned MaxPositions,
+           trace::EventTracer *Next, raw_ostream &OS) {
+  SmallString<128> AbsPath(File);
+  if (std::error_code EC = sys::fs::make_absolute(AbsPath)) {
+    elog("Can't make {0} absolute: {1}", File, EC.message());
+    return false;
+  }
+  auto Buffer = MemoryBuffer::getFile(AbsPath);
+  if (!Buffer) {
+    elog("Can't read {0}: {1}", AbsPath, Buffer.getError().message());
+    return false;
+  }
+  std::string Contents = Buffer->get()->getBuffer();
+
+  json::Object Report{{"file", AbsPath.str().str()}};
+  json::Value Trace = nullptr;
+  {
+    // Exports a single snapshot, when it's destroyed.
+    auto Tracer = trace::createMetricsTracer(
+        std::chrono::hours(24),
+        [&Trace](const json::Value &Snapshot) { Trace = Snapshot; }, Next);
+    trace::Session Session(*Tracer);
+
+    DirectoryBasedGlobalCompilationDatabase BaseCDB(CompileCommandsDir);
+    OverlayCDB CDB(&BaseCDB);
+    RealFileSystemProvider FSProvider;
+    CountingDiagnostics Diags;
+    ClangdServer Server(CDB, FSProvider, Diags, Opts);
+
+    auto Start = Clock::now();
+    Server.addDocument(AbsPath, Contents, WantDiagnostics::Yes);
+    if (!Server.blockUntilIdleForTest(/*TimeoutSeconds=*/None)) {
+      elog("Timed out while building {0}", AbsPath);
+      return false;
+    }
+    Report["build_ms"] = millisecondsSince(Start);
+    Report["diagnostics"] = int64_t(Diags.count());
+    Report["errors"] = int64_t(Diags.errors());
+
+    MemoryTree Memory, Disk;
+    Server.profile(Memory, Disk);
+    Report["memory"] = toJSON(Memory);
+    Report["disk"] = toJSON(Disk);
+
+    LangOptions LangOpts;
+    LangOpts.CPlusPlus = true;
+    LangOpts.CPlusPlus11 = true;
+    auto Positions = sampleIdentifiers(Contents, LangOpts, MaxPositions);
+    Latencies Completions, Hovers, Definitions;
+    for (const Position &Pos : Positions) {
+      runTimed<CodeCompleteResult>(
+          [&](Callback<CodeCompleteResult> CB) {
+            Server.codeComplete(AbsPath, Pos, CCOpts, std::move(CB));
+          },
+          Completions);
+      runTimed<Optional<Hover>>(
+          [&](Callback<Optional<Hover>> CB) {
+            Server.findHover(AbsPath, Pos, std::move(CB));
+          },
+          Hovers);
+      runTimed<std::vector<Location>>(
+          [&](Callback<std::vector<Location>> CB) {
+            Server.findDefinitions(AbsPath, Pos, std::move(CB));
+          },
+          Definitions);
+    }
+    Report["positions"] = int64_t(Positions.size());
+    Report["requests"] = json::Object{
+        {"code_completion", Completions.toJSON()},
+        {"hover", Hovers.toJSON()},
+        {"definition", Definitions.toJSON()},
+    };
+    if (!Server.blockUntilIdleForTest(/*TimeoutSeconds=*/None))
+      elog("Timed out while waiting for the requests on {0}", AbsPath);
+  }
+  Report["trace"] = std::move(Trace);
+
+  OS << formatv("{0:2}", json::Value(std::move(Report))) << "\n";
+  return true;
+}
+
+} // namespace clangd
+} // namespace clang
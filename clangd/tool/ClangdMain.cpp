@@ -7,20 +7,27 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "../../clang-tidy/ClangTidyAllocationHooks.inc"
 #include "ClangdLSPServer.h"
 #include "Path.h"
 #include "Trace.h"
 #include "Transport.h"
+#include "index/CachingIndex.h"
+#include "index/RemoteIndex.h"
 #include "index/Serialization.h"
 #include "clang/Basic/Version.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/CrashRecoveryContext.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/raw_ostream.h"
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <string>
 #include <thread>
@@ -126,6 +133,13 @@ static cl::opt<Path> InputMirrorFile(
         "Mirror all LSP input to the specified file. Useful for debugging."),
     cl::init(""), cl::Hidden);
 
+static cl::opt<Path> RecordSessionFile(
+    "record-session",
+    cl::desc("Record all LSP input to the specified file, with the time each "
+             "message was received. The session can be replayed by "
+             "clangd-replay."),
+    cl::init(""), cl::Hidden);
+
 static cl::opt<bool> EnableIndex(
     "index",
     cl::desc(
@@ -143,6 +157,30 @@ static cl::opt<bool> AllScopesCompletion(
         "can insert scope qualifiers."),
     cl::init(false), cl::Hidden);
 
+static cl::opt<clangd::CodeCompleteOptions::CodeCompletionRankingModel>
+    RankingModel(
+        "ranking-model",
+        cl::desc("Model used to rank code completion candidates"),
+        cl::values(clEnumValN(clangd::CodeCompleteOptions::Heuristics,
+                              "heuristics", "Hand-tuned heuristics"),
+                   clEnumValN(clangd::CodeCompleteOptions::DecisionForest,
+                              "decision_forest",
+                              "Decision forest compiled into clangd")),
+        cl::init(clangd::CodeCompleteOptions::Heuristics), cl::Hidden);
+
+static cl::opt<unsigned> IndexOnlyCompletionDeadline(
+    "index-only-completion-deadline",
+    cl::desc("If code completion takes longer than this many milliseconds, "
+             "reply with index results only, marked incomplete. 0 means "
+             "always wait for the full results"),
+    cl::init(0), cl::Hidden);
+
+static cl::opt<bool> IndexOnlyNamespaceScopeCompletion(
+    "index-only-namespace-scope-completion",
+    cl::desc("Complete at namespace scope from the index only, without "
+             "parsing the file"),
+    cl::init(false), cl::Hidden);
+
 static cl::opt<bool>
     ShowOrigins("debug-origin", cl::desc("Show origins of completion items"),
                 cl::init(clangd::CodeCompleteOptions().ShowOrigins),
@@ -164,12 +202,153 @@ static cl::opt<Path> IndexFile(
         "eventually. Don't rely on it."),
     cl::init(""), cl::Hidden);
 
+static cl::opt<std::string> RemoteIndexAddress(
+    "remote-index",
+    cl::desc("Use the static index served by a remote index server at "
+             "host:port, instead of loading it from --index-file."),
+    cl::init(""), cl::Hidden);
+
+static cl::opt<unsigned> RemoteIndexTimeout(
+    "remote-index-timeout",
+    cl::desc("Milliseconds after which requests to the remote index return "
+             "partial results."),
+    cl::init(5000), cl::Hidden);
+
+static cl::opt<unsigned> StaticIndexTimeout(
+    "static-index-timeout",
+    cl::desc("Query the static index concurrently with the dynamic index, and "
+             "complete without its results if it doesn't answer within this "
+             "many milliseconds. 0 waits for it."),
+    cl::init(0), cl::Hidden);
+
 static cl::opt<bool> EnableBackgroundIndex(
     "background-index",
     cl::desc("Index project code in the background and persist index on disk. "
              "Experimental"),
     cl::init(false), cl::Hidden);
 
+static cl::opt<bool> PackedBackgroundIndexStorage(
+    "background-index-packed-storage",
+    cl::desc("Store the background index of a project in a single file "
+             "rather than a file per source file"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> BackgroundIndexStringDictionary(
+    "background-index-string-dictionary",
+    cl::desc("Build a dictionary of the strings common to the background "
+             "index shards of a project, which the shards refer to"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> LazyBackgroundIndexRefs(
+    "background-index-lazy-refs",
+    cl::desc("Keep the references found by the background index on disk, "
+             "and read them when they are queried"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> ThrottleBackgroundIndex(
+    "background-index-throttle",
+    cl::desc("Index with fewer threads while the machine is busy, and pause "
+             "while a compiler is running or memory is short"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> PersistPreambleIndex(
+    "persist-preamble-index",
+    cl::desc("Store the symbols of each preamble in the project root, and "
+             "load them rather than indexing the same preamble again"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> CacheFileStatus(
+    "cache-file-status",
+    cl::desc("Cache the status of files across all parses, until the client "
+             "reports that they changed"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> RecoverFromCrashes(
+    "recover-from-crashes",
+    cl::desc("Keep running when clang crashes while parsing a file, and leak "
+             "the memory of the failed parse"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<std::string> ImplicitModulesCache(
+    "implicit-modules-cache",
+    cl::desc("Parse files with implicit modules built into this directory, "
+             "and shared by all files. Experimental"),
+    cl::init(""), cl::Hidden);
+
+static cl::opt<unsigned> IdleASTMemoryLimit(
+    "idle-ast-memory-limit",
+    cl::desc("Maximum memory, in MiB, used by the ASTs of files that aren't "
+             "being worked on. The least recently used ASTs are discarded "
+             "first. By default, a fixed number of ASTs is retained."),
+    cl::init(0), cl::Hidden);
+
+static cl::opt<bool> WeighIdleASTsByBuildTime(
+    "weigh-idle-asts-by-build-time",
+    cl::desc("Keep the ASTs of files that were slow to build in preference to "
+             "more recently used ones that are quick to rebuild"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<unsigned> MemoryLimit(
+    "memory-limit",
+    cl::desc("Resident memory, in MiB, above which clangd frees memory: idle "
+             "ASTs first, then preambles are moved to disk. 0 means no limit. "
+             "Only supported on Linux."),
+    cl::init(0), cl::Hidden);
+
+static cl::opt<bool> ParallelFirstBuild(
+    "parallel-first-build",
+    cl::desc("When a file is opened, parse it without a preamble while the "
+             "preamble is being built, to report diagnostics sooner"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<unsigned> SpeculativePreambles(
+    "speculative-preambles",
+    cl::desc("Build the preambles of the files likely to be opened next while "
+             "worker threads are idle, up to this many at once. 0 disables it"),
+    cl::init(0), cl::Hidden);
+
+static cl::opt<unsigned> SpeculativePreambleMemory(
+    "speculative-preamble-memory",
+    cl::desc("Size, in MiB, of the speculative preambles to keep"),
+    cl::init(256), cl::Hidden);
+
+static cl::opt<bool> AsyncCompileCommands(
+    "async-compile-commands",
+    cl::desc("Look up compile commands in the background, using a fallback "
+             "command until they are known"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> IncluderCommands(
+    "includer-commands",
+    cl::desc("Parse the files missing from the compilation database, e.g. "
+             "headers, with the flags of an open or indexed file including "
+             "them instead of a fallback command"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<bool> CrossFileRename(
+    "cross-file-rename",
+    cl::desc("Rename the occurrences of a symbol in the other files too, at "
+             "its references in the index, without parsing them"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<unsigned> LimitReferences(
+    "limit-references",
+    cl::desc("Limit the number of references to a symbol returned by clangd. "
+             "0 means no limit, unlike -limit-results."),
+    cl::init(0), cl::Hidden);
+
+static cl::opt<bool> EnableClangTidy(
+    "clang-tidy",
+    cl::desc("Run the clang-tidy checks enabled by the .clang-tidy files of "
+             "each file on its AST, and report their diagnostics"),
+    cl::init(false), cl::Hidden);
+
+static cl::opt<std::string> ClangTidyChecks(
+    "clang-tidy-checks",
+    cl::desc("List of clang-tidy checks to run with -clang-tidy, overriding "
+             "the .clang-tidy files. Same format as clang-tidy -checks"),
+    cl::init(""), cl::Hidden);
+
 enum CompileArgsFrom { LSPCompileArgs, FilesystemCompileArgs };
 static cl::opt<CompileArgsFrom> CompileArgsFrom(
     "compile_args_from", cl::desc("The source of compile commands"),
@@ -188,6 +367,25 @@ static cl::opt<bool> EnableFunctionArgSnippets(
              "placeholders for method parameters."),
     cl::init(clangd::CodeCompleteOptions().EnableFunctionArgSnippets));
 
+static cl::opt<Path> CheckFile(
+    "check",
+    cl::desc("Build the given file, then run code completion, hover and "
+             "go-to-definition at a sample of its identifiers, and print a "
+             "JSON report of the timings and memory usage. The server isn't "
+             "run"),
+    cl::value_desc("file"), cl::init(""));
+
+static cl::opt<unsigned> CheckPositions(
+    "check-positions",
+    cl::desc("The number of identifiers -check runs requests at"),
+    cl::init(30));
+
+static cl::opt<bool> TrackAllocations(
+    "track-allocations",
+    cl::desc("Count the heap allocations of each traced operation, and add "
+             "them to the traces and metrics"),
+    cl::init(false), cl::Hidden);
+
 namespace {
 
 /// \brief Supports a test URI scheme with relaxed constraints for lit tests.
@@ -237,6 +435,16 @@ const char TestScheme::TestDir[] = "/clangd-test";
 
 }
 
+namespace clang {
+namespace clangd {
+// Defined in Check.cpp.
+bool check(StringRef File, Optional<Path> CompileCommandsDir,
+           const ClangdServer::Options &Opts,
+           const clangd::CodeCompleteOptions &CCOpts, unsigned MaxPositions,
+           trace::EventTracer *Next, raw_ostream &OS);
+} // namespace clangd
+} // namespace clang
+
 int main(int argc, char *argv[]) {
   sys::PrintStackTraceOnErrorSignal(argv[0]);
   cl::SetVersionPrinter([](raw_ostream &OS) {
@@ -255,6 +463,10 @@ int main(int argc, char *argv[]) {
     InputStyle = JSONStreamStyle::Delimited;
     PrettyPrint = true;
   }
+  // Parses run their actions under a CrashRecoveryContext, which only catches
+  // crashes once it's enabled.
+  if (RecoverFromCrashes)
+    CrashRecoveryContext::Enable();
   if (Test || EnableTestScheme) {
     static URISchemeRegistry::Add<TestScheme> X(
         "test", "Test scheme for clangd lit tests.");
@@ -286,9 +498,25 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  Optional<raw_fd_ostream> RecordSessionStream;
+  if (!RecordSessionFile.empty()) {
+    std::error_code EC;
+    RecordSessionStream.emplace(RecordSessionFile, /*ref*/ EC);
+    if (EC) {
+      RecordSessionStream.reset();
+      errs() << "Error while opening a session recording file: "
+             << EC.message();
+    }
+  }
+
+  if (TrackAllocations)
+    tidy::enableAllocationTracking();
+
   // Setup tracing facilities if CLANGD_TRACE is set. In practice enabling a
   // trace flag in your editor's config is annoying, launching with
-  // `CLANGD_TRACE=trace.json vim` is easier.
+  // `CLANGD_TRACE=trace.json vim` is easier. With CLANGD_TRACE_FORMAT=binary,
+  // the trace is written by the low-overhead tracer, and can be converted
+  // with clangd-trace-convert.
   Optional<raw_fd_ostream> TraceStream;
   std::unique_ptr<trace::EventTracer> Tracer;
   if (auto *TraceFile = getenv("CLANGD_TRACE")) {
@@ -300,13 +528,76 @@ int main(int argc, char *argv[]) {
       errs() << "Error while opening trace file " << TraceFile << ": "
              << EC.message();
     } else {
-      Tracer = trace::createJSONTracer(*TraceStream, PrettyPrint);
+      const char *Format = getenv("CLANGD_TRACE_FORMAT");
+      if (Format && StringRef(Format) == "binary")
+        Tracer = trace::createBinaryTracer(*TraceStream);
+      else
+        Tracer = trace::createJSONTracer(*TraceStream, PrettyPrint);
+    }
+  }
+
+  // With CLANGD_METRICS set, latencies and other metrics are aggregated and
+  // written to that file as JSON every CLANGD_METRICS_INTERVAL seconds (60 by
+  // default), in addition to the trace.
+  std::unique_ptr<trace::EventTracer> MetricsTracer;
+  if (auto *MetricsFile = getenv("CLANGD_METRICS")) {
+    unsigned Interval = 60;
+    if (auto *IntervalVar = getenv("CLANGD_METRICS_INTERVAL"))
+      if (StringRef(IntervalVar).getAsInteger(10, Interval) || !Interval)
+        Interval = 60;
+    std::string MetricsPath = MetricsFile;
+    MetricsTracer = trace::createMetricsTracer(
+        std::chrono::seconds(Interval),
+        [MetricsPath](const json::Value &Snapshot) {
+          // Replace the file atomically, it may be read at any time.
+          std::string TempPath = MetricsPath + ".tmp";
+          {
+            std::error_code EC;
+            raw_fd_ostream OS(TempPath, EC);
+            if (EC)
+              return;
+            OS << Snapshot << "\n";
+          }
+          sys::fs::rename(TempPath, MetricsPath);
+        },
+        Tracer.get());
+  }
+  trace::EventTracer *OuterTracer =
+      MetricsTracer ? MetricsTracer.get() : Tracer.get();
+
+  // With CLANGD_SLOW_REQUESTS set, the trace of each request that takes at
+  // least CLANGD_SLOW_REQUESTS_THRESHOLD milliseconds (1000 by default) is
+  // appended to that file as a line of JSON. The other requests are traced in
+  // memory only.
+  Optional<raw_fd_ostream> SlowRequestStream;
+  std::unique_ptr<trace::EventTracer> SlowRequestTracer;
+  if (auto *SlowRequestFile = getenv("CLANGD_SLOW_REQUESTS")) {
+    unsigned Threshold = 1000;
+    if (auto *ThresholdVar = getenv("CLANGD_SLOW_REQUESTS_THRESHOLD"))
+      if (StringRef(ThresholdVar).getAsInteger(10, Threshold))
+        Threshold = 1000;
+    std::error_code EC;
+    SlowRequestStream.emplace(SlowRequestFile, EC, sys::fs::F_Append);
+    if (EC) {
+      SlowRequestStream.reset();
+      errs() << "Error while opening slow request log " << SlowRequestFile
+             << ": " << EC.message();
+    } else {
+      SlowRequestTracer = trace::createSlowRequestTracer(
+          std::chrono::milliseconds(Threshold),
+          [&SlowRequestStream](const json::Value &Request) {
+            *SlowRequestStream << Request << "\n";
+            SlowRequestStream->flush();
+          },
+          OuterTracer);
+      OuterTracer = SlowRequestTracer.get();
     }
   }
 
   Optional<trace::Session> TracingSession;
-  if (Tracer)
-    TracingSession.emplace(*Tracer);
+  // -check traces the events itself, and forwards them.
+  if (CheckFile.empty() && OuterTracer)
+    TracingSession.emplace(*OuterTracer);
 
   // Use buffered stream to stderr (we still flush each log message). Unbuffered
   // stream can cause significant (non-deterministic) latency for the logger.
@@ -351,20 +642,62 @@ int main(int argc, char *argv[]) {
   Opts.BuildDynamicSymbolIndex = EnableIndex;
   Opts.HeavyweightDynamicSymbolIndex = UseDex;
   Opts.BackgroundIndex = EnableBackgroundIndex;
+  Opts.PackedBackgroundIndexStorage = PackedBackgroundIndexStorage;
+  Opts.BackgroundIndexStringDictionary = BackgroundIndexStringDictionary;
+  Opts.LazyBackgroundIndexRefs = LazyBackgroundIndexRefs;
+  Opts.ThrottleBackgroundIndex = ThrottleBackgroundIndex;
+  Opts.PersistPreambleIndex = PersistPreambleIndex;
+  Opts.CacheFileStatus = CacheFileStatus;
+  Opts.ImplicitModulesCachePath = ImplicitModulesCache;
+  if (IdleASTMemoryLimit) {
+    Opts.RetentionPolicy.MaxRetainedASTs = std::numeric_limits<unsigned>::max();
+    Opts.RetentionPolicy.MaxRetainedBytes = size_t(IdleASTMemoryLimit) << 20;
+  }
+  Opts.RetentionPolicy.WeighByBuildTime = WeighIdleASTsByBuildTime;
+  Opts.MemoryLimit = size_t(MemoryLimit) << 20;
+  Opts.ParallelFirstBuild = ParallelFirstBuild;
+  Opts.SpeculativePreambles = SpeculativePreambles;
+  Opts.SpeculativePreambleMemory = size_t(SpeculativePreambleMemory) << 20;
+  Opts.AsyncCompileCommands = AsyncCompileCommands;
+  Opts.IncluderCommands = IncluderCommands;
+  Opts.CrossFileRename = CrossFileRename;
+  Opts.ReferencesLimit = LimitReferences;
+  std::unique_ptr<tidy::ClangTidyOptionsProvider> ClangTidyOptProvider;
+  if (EnableClangTidy) {
+    tidy::ClangTidyOptions OverrideClangTidyOpts;
+    if (!ClangTidyChecks.empty())
+      OverrideClangTidyOpts.Checks = ClangTidyChecks;
+    // Without a .clang-tidy file, no checks run.
+    tidy::ClangTidyOptions DefaultClangTidyOpts;
+    DefaultClangTidyOpts.Checks = "-*";
+    ClangTidyOptProvider = llvm::make_unique<tidy::FileOptionsProvider>(
+        tidy::ClangTidyGlobalOptions(), DefaultClangTidyOpts,
+        OverrideClangTidyOpts);
+    Opts.ClangTidyOptProvider = ClangTidyOptProvider.get();
+  }
   std::unique_ptr<SymbolIndex> StaticIdx;
-  std::future<void> AsyncIndexLoad; // Block exit while loading the index.
-  if (EnableIndex && !IndexFile.empty()) {
-    // Load the index asynchronously. Meanwhile SwapIndex returns no results.
-    SwapIndex *Placeholder;
-    StaticIdx.reset(Placeholder = new SwapIndex(llvm::make_unique<MemIndex>()));
-    AsyncIndexLoad = runAsync<void>([Placeholder] {
-      if (auto Idx = loadIndex(IndexFile, /*UseDex=*/true))
-        Placeholder->reset(std::move(Idx));
-    });
-    if (RunSynchronously)
-      AsyncIndexLoad.wait();
+  // If set, the index file is loaded into this.
+  SwapIndex *IndexPlaceholder = nullptr;
+  // Remembers recent code completion queries, must not outlive StaticIdx.
+  std::unique_ptr<SymbolIndex> CachedStaticIdx;
+  if (EnableIndex && !RemoteIndexAddress.empty()) {
+    if (auto Remote = connectRemoteIndex(
+            RemoteIndexAddress,
+            std::chrono::milliseconds(RemoteIndexTimeout))) {
+      SwapIndex *Placeholder;
+      StaticIdx.reset(Placeholder = new SwapIndex(std::move(Remote)));
+      CachedStaticIdx = llvm::make_unique<CachingIndex>(*Placeholder);
+    }
+  } else if (EnableIndex && !IndexFile.empty()) {
+    // The index is loaded once the server is running. Meanwhile SwapIndex
+    // returns no results.
+    StaticIdx.reset(IndexPlaceholder =
+                        new SwapIndex(llvm::make_unique<MemIndex>()));
+    CachedStaticIdx = llvm::make_unique<CachingIndex>(*IndexPlaceholder);
   }
-  Opts.StaticIndex = StaticIdx.get();
+  Opts.StaticIndex = CachedStaticIdx.get();
+  if (StaticIndexTimeout)
+    Opts.StaticIndexTimeout = std::chrono::milliseconds(StaticIndexTimeout);
   Opts.AsyncThreadsCount = WorkerThreadsCount;
 
   clangd::CodeCompleteOptions CCOpts;
@@ -379,6 +712,20 @@ int main(int argc, char *argv[]) {
   CCOpts.SpeculativeIndexRequest = Opts.StaticIndex;
   CCOpts.EnableFunctionArgSnippets = EnableFunctionArgSnippets;
   CCOpts.AllScopes = AllScopesCompletion;
+  CCOpts.RankingModel = RankingModel;
+  if (IndexOnlyCompletionDeadline)
+    CCOpts.IndexOnlyDeadline =
+        std::chrono::milliseconds(IndexOnlyCompletionDeadline);
+  CCOpts.IndexOnlyAtNamespaceScope = IndexOnlyNamespaceScopeCompletion;
+
+  if (!CheckFile.empty()) {
+    if (IndexPlaceholder)
+      if (auto Idx = loadIndex(IndexFile, /*UseDex=*/true))
+        IndexPlaceholder->reset(std::move(Idx));
+    bool Checked = check(CheckFile, CompileCommandsDirPath, Opts, CCOpts,
+                         CheckPositions, OuterTracer, outs());
+    return Checked ? 0 : 1;
+  }
 
   // Initialize and run ClangdLSPServer.
   // Change stdin to binary to not lose \r\n on windows.
@@ -387,9 +734,36 @@ int main(int argc, char *argv[]) {
       stdin, outs(),
       InputMirrorStream ? InputMirrorStream.getPointer() : nullptr, PrettyPrint,
       InputStyle);
+  if (RecordSessionStream)
+    Transport =
+        newRecordingTransport(std::move(Transport), *RecordSessionStream);
   ClangdLSPServer LSPServer(
       *Transport, CCOpts, CompileCommandsDirPath,
       /*UseDirBasedCDB=*/CompileArgsFrom == FilesystemCompileArgs, Opts);
+  std::future<void> AsyncIndexLoad; // Block exit while loading the index.
+  if (IndexPlaceholder) {
+    // Requests are served from the other indexes until this is done.
+    std::string Path = IndexFile;
+    AsyncIndexLoad = runAsync<void>([IndexPlaceholder, Path, &LSPServer] {
+      auto Start = std::chrono::steady_clock::now();
+      auto Idx = loadIndex(Path, /*UseDex=*/true);
+      if (!Idx)
+        return LSPServer.showMessage(
+            MessageType::Error,
+            formatv("Failed to load the index {0}", Path).str());
+      IndexPlaceholder->reset(std::move(Idx));
+      // Only failures are worth a popup in the editor.
+      LSPServer.logMessage(
+          MessageType::Info,
+          formatv("Loaded the index {0} in {1:f1}s", Path,
+                  std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - Start)
+                      .count())
+              .str());
+    });
+    if (RunSynchronously)
+      AsyncIndexLoad.wait();
+  }
   constexpr int NoShutdownRequestErrorCode = 1;
   set_thread_name("clangd.main");
   return LSPServer.run() ? 0 : NoShutdownRequestErrorCode;
@@ -0,0 +1,54 @@
+//===--- TraceConvertMain.cpp - Convert binary clangd traces --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// clangd-trace-convert reads a trace written with CLANGD_TRACE_FORMAT=binary
+// and writes it in the Trace Event format, for chrome://tracing.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Trace.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFile(cl::Positional, cl::Required,
+                                      cl::desc("<binary trace>"));
+
+static cl::opt<std::string> OutputFile("o", cl::desc("Output JSON trace"),
+                                       cl::init("-"));
+
+int main(int argc, const char *argv[]) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Converts a binary clangd trace to the Trace Event format.\n");
+
+  auto Buffer = MemoryBuffer::getFile(InputFile);
+  if (!Buffer) {
+    errs() << "Can't open " << InputFile << ": "
+           << Buffer.getError().message() << "\n";
+    return 1;
+  }
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFile, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "Can't open " << OutputFile << ": " << EC.message() << "\n";
+    return 1;
+  }
+  if (auto Err = clang::clangd::trace::convertBinaryTrace(
+          (*Buffer)->getBuffer(), OS)) {
+    errs() << toString(std::move(Err)) << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+//===-- BinarySymbolIndex.cpp ---------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolIndex.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/Path.h"
+
+using clang::find_all_symbols::BinarySymbolDatabase;
+using clang::find_all_symbols::SymbolAndSignals;
+
+namespace clang {
+namespace include_fixer {
+
+llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+BinarySymbolIndex::createFromFile(llvm::StringRef FilePath) {
+  // Without a null terminator, the file is mapped rather than read whenever
+  // it is large enough.
+  auto Buffer = llvm::MemoryBuffer::getFile(FilePath, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return Buffer.getError();
+  return createFromBuffer(std::move(*Buffer));
+}
+
+llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+BinarySymbolIndex::createFromDirectory(llvm::StringRef Directory,
+                                       llvm::StringRef Name) {
+  // Walk upwards from Directory, looking for files.
+  for (llvm::SmallString<128> PathStorage = Directory; !Directory.empty();
+       Directory = llvm::sys::path::parent_path(Directory)) {
+    assert(Directory.size() <= PathStorage.size());
+    PathStorage.resize(Directory.size()); // Shrink to parent.
+    llvm::sys::path::append(PathStorage, Name);
+    if (auto DB = createFromFile(PathStorage))
+      return DB;
+  }
+  return llvm::make_error_code(llvm::errc::no_such_file_or_directory);
+}
+
+llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+BinarySymbolIndex::createFromBuffer(
+    std::unique_ptr<llvm::MemoryBuffer> Buffer) {
+  auto Database = BinarySymbolDatabase::create(Buffer->getBuffer());
+  if (!Database)
+    return llvm::make_error_code(llvm::errc::invalid_argument);
+  return std::unique_ptr<BinarySymbolIndex>(
+      new BinarySymbolIndex(std::move(Buffer), std::move(*Database)));
+}
+
+std::vector<SymbolAndSignals>
+BinarySymbolIndex::search(llvm::StringRef Identifier) {
+  return Database.lookup(Identifier);
+}
+
+} // namespace include_fixer
+} // namespace clang
@@ -0,0 +1,53 @@
+//===-- BinarySymbolIndex.h -------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_BINARYSYMBOLINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_BINARYSYMBOLINDEX_H
+
+#include "SymbolIndex.h"
+#include "find-all-symbols/BinarySymbolDatabase.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <vector>
+
+namespace clang {
+namespace include_fixer {
+
+/// Binary format database, written by `find-all-symbols -merge-dir
+/// -db-format=binary`. The file is memory mapped and searched in place, so
+/// loading it doesn't depend on its size.
+class BinarySymbolIndex : public SymbolIndex {
+public:
+  /// Create a new binary db from a file.
+  static llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+  createFromFile(llvm::StringRef FilePath);
+  /// Look for a file called \c Name in \c Directory and all parent directories.
+  static llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+  createFromDirectory(llvm::StringRef Directory, llvm::StringRef Name);
+  /// Create a new binary db from the content of a file.
+  static llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+  createFromBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer);
+
+  std::vector<find_all_symbols::SymbolAndSignals>
+  search(llvm::StringRef Identifier) override;
+
+private:
+  BinarySymbolIndex(std::unique_ptr<llvm::MemoryBuffer> Buffer,
+                    find_all_symbols::BinarySymbolDatabase Database)
+      : Buffer(std::move(Buffer)), Database(std::move(Database)) {}
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  find_all_symbols::BinarySymbolDatabase Database;
+};
+
+} // namespace include_fixer
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_BINARYSYMBOLINDEX_H
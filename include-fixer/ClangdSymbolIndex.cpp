@@ -0,0 +1,133 @@
+//===-- ClangdSymbolIndex.cpp ---------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangdSymbolIndex.h"
+#include "URI.h"
+#include "index/Serialization.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+
+using clang::find_all_symbols::SymbolAndSignals;
+using clang::find_all_symbols::SymbolInfo;
+
+namespace clang {
+namespace include_fixer {
+
+namespace {
+
+/// Returns the kind of a symbol of kind \p Kind in find-all-symbols, or None
+/// for the symbols that find-all-symbols doesn't collect, e.g. the members.
+llvm::Optional<SymbolInfo::SymbolKind> getSymbolKind(index::SymbolKind Kind) {
+  switch (Kind) {
+  case index::SymbolKind::Function:
+    return SymbolInfo::SymbolKind::Function;
+  case index::SymbolKind::Struct:
+  case index::SymbolKind::Class:
+  case index::SymbolKind::Union:
+    return SymbolInfo::SymbolKind::Class;
+  case index::SymbolKind::Variable:
+    return SymbolInfo::SymbolKind::Variable;
+  case index::SymbolKind::TypeAlias:
+    return SymbolInfo::SymbolKind::TypedefName;
+  case index::SymbolKind::Enum:
+    return SymbolInfo::SymbolKind::EnumDecl;
+  case index::SymbolKind::EnumConstant:
+    return SymbolInfo::SymbolKind::EnumConstantDecl;
+  case index::SymbolKind::Macro:
+    return SymbolInfo::SymbolKind::Macro;
+  default:
+    return llvm::None;
+  }
+}
+
+/// Returns the contexts of a symbol in \p Scope, e.g. "a::b::", innermost
+/// first. clangd doesn't tell the records from the namespaces, which the
+/// lookup by qualified name doesn't need.
+std::vector<SymbolInfo::Context> getContexts(llvm::StringRef Scope) {
+  llvm::SmallVector<llvm::StringRef, 4> Names;
+  Scope.split(Names, "::", /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  std::vector<SymbolInfo::Context> Contexts;
+  for (auto I = Names.rbegin(), E = Names.rend(); I != E; ++I)
+    Contexts.emplace_back(SymbolInfo::ContextType::Namespace, *I);
+  return Contexts;
+}
+
+/// Returns the header to include for \p IncludeHeader, either a literal
+/// header or the URI of a file, or an empty string if it can't be resolved.
+std::string getHeader(llvm::StringRef IncludeHeader) {
+  if (IncludeHeader.startswith("<") || IncludeHeader.startswith("\""))
+    return IncludeHeader;
+  auto U = clangd::URI::parse(IncludeHeader);
+  if (!U) {
+    llvm::consumeError(U.takeError());
+    return "";
+  }
+  auto Spelling = clangd::URI::includeSpelling(*U);
+  if (!Spelling)
+    llvm::consumeError(Spelling.takeError());
+  else if (!Spelling->empty())
+    return *Spelling;
+  auto Path = clangd::URI::resolve(*U);
+  if (!Path) {
+    llvm::consumeError(Path.takeError());
+    return "";
+  }
+  return *Path;
+}
+
+} // namespace
+
+llvm::ErrorOr<std::unique_ptr<ClangdSymbolIndex>>
+ClangdSymbolIndex::createFromFile(llvm::StringRef FilePath) {
+  if (!llvm::sys::fs::exists(FilePath))
+    return llvm::errc::no_such_file_or_directory;
+  auto Index = clangd::loadIndex(FilePath, /*UseDex=*/true);
+  if (!Index)
+    return llvm::errc::invalid_argument;
+  return llvm::make_unique<ClangdSymbolIndex>(std::move(Index));
+}
+
+std::vector<SymbolAndSignals>
+ClangdSymbolIndex::search(llvm::StringRef Identifier) {
+  clangd::FuzzyFindRequest Request;
+  Request.Query = Identifier;
+  Request.AnyScope = true;
+  std::vector<SymbolAndSignals> Results;
+  Index->fuzzyFind(Request, [&](const clangd::Symbol &Symbol) {
+    // The fuzzy matches include the names sharing the trigrams of the
+    // identifier.
+    if (Symbol.Name != Identifier)
+      return;
+    auto Kind = getSymbolKind(Symbol.SymInfo.Kind);
+    if (!Kind)
+      return;
+    std::vector<SymbolInfo::Context> Contexts = getContexts(Symbol.Scope);
+    if (Symbol.IncludeHeaders.empty()) {
+      std::string Header = getHeader(Symbol.CanonicalDeclaration.FileURI);
+      if (!Header.empty())
+        Results.push_back({SymbolInfo(Symbol.Name, *Kind, Header, Contexts),
+                           SymbolInfo::Signals(/*Seen=*/Symbol.References,
+                                               /*Used=*/Symbol.References)});
+      return;
+    }
+    for (const auto &Include : Symbol.IncludeHeaders) {
+      std::string Header = getHeader(Include.IncludeHeader);
+      if (Header.empty())
+        continue;
+      Results.push_back({SymbolInfo(Symbol.Name, *Kind, Header, Contexts),
+                         SymbolInfo::Signals(/*Seen=*/Include.References,
+                                             /*Used=*/Symbol.References)});
+    }
+  });
+  return Results;
+}
+
+} // namespace include_fixer
+} // namespace clang
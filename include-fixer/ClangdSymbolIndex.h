@@ -0,0 +1,45 @@
+//===-- ClangdSymbolIndex.h -------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_CLANGDSYMBOLINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_CLANGDSYMBOLINDEX_H
+
+#include "SymbolIndex.h"
+#include "index/Index.h"
+#include "llvm/Support/ErrorOr.h"
+#include <memory>
+#include <vector>
+
+namespace clang {
+namespace include_fixer {
+
+/// Serves the symbols of a clangd index, e.g. the static index written by
+/// clangd-indexer, so that a project doesn't need a find-all-symbols database
+/// too. The headers of a symbol are its include headers in the clangd index,
+/// and its signals their reference counts.
+class ClangdSymbolIndex : public SymbolIndex {
+public:
+  explicit ClangdSymbolIndex(std::unique_ptr<clangd::SymbolIndex> Index)
+      : Index(std::move(Index)) {}
+
+  /// Load a clangd index file in a Dex index.
+  static llvm::ErrorOr<std::unique_ptr<ClangdSymbolIndex>>
+  createFromFile(llvm::StringRef FilePath);
+
+  std::vector<find_all_symbols::SymbolAndSignals>
+  search(llvm::StringRef Identifier) override;
+
+private:
+  std::unique_ptr<clangd::SymbolIndex> Index;
+};
+
+} // namespace include_fixer
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_CLANGDSYMBOLINDEX_H
@@ -7,7 +7,13 @@
 //
 //===----------------------------------------------------------------------===//
 #include "FuzzySymbolIndex.h"
-#include "llvm/Support/Regex.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include <algorithm>
+#include <iterator>
 
 using clang::find_all_symbols::SymbolAndSignals;
 using llvm::StringRef;
@@ -16,31 +22,74 @@ namespace clang {
 namespace include_fixer {
 namespace {
 
-class MemSymbolIndex : public FuzzySymbolIndex {
-public:
-  MemSymbolIndex(std::vector<SymbolAndSignals> Symbols) {
-    for (auto &Symbol : Symbols) {
-      auto Tokens = tokenize(Symbol.Symbol.getName());
-      this->Symbols.emplace_back(
-          StringRef(llvm::join(Tokens.begin(), Tokens.end(), " ")),
-          std::move(Symbol));
-    }
-  }
+// The keys of the inverted index of the symbols. A query matches a sequence
+// of characters of the symbol tokens in which each character is either the
+// next one in the same token, or the first one of the next token. Every
+// three consecutive query characters are thus a trigram of such a sequence,
+// and the query starts like the symbol.
+enum KeyKind : uint32_t { TRIGRAM = 1, START_UNIGRAM, START_BIGRAM };
 
-  std::vector<SymbolAndSignals> search(StringRef Query) override {
-    auto Tokens = tokenize(Query);
-    llvm::Regex Pattern("^" + queryRegexp(Tokens));
-    std::vector<SymbolAndSignals> Results;
-    for (const Entry &E : Symbols)
-      if (Pattern.match(E.first))
-        Results.push_back(E.second);
-    return Results;
+uint32_t makeKey(KeyKind Kind, char A, char B = 0, char C = 0) {
+  return Kind << 24 | uint32_t(uint8_t(A)) << 16 | uint32_t(uint8_t(B)) << 8 |
+         uint32_t(uint8_t(C));
+}
+
+// Returns the keys of the symbol made of \p Tokens.
+std::vector<uint32_t> symbolKeys(llvm::ArrayRef<StringRef> Tokens) {
+  // The characters, and the position of the first character of the next
+  // token for each of them.
+  std::string Chars;
+  std::vector<size_t> NextToken;
+  for (size_t I = 0; I < Tokens.size(); ++I) {
+    const size_t Next =
+        I + 1 < Tokens.size() ? Chars.size() + Tokens[I].size() : StringRef::npos;
+    Chars.append(Tokens[I].begin(), Tokens[I].end());
+    NextToken.resize(Chars.size(), Next);
   }
+  std::vector<uint32_t> Keys;
+  if (Chars.empty())
+    return Keys;
+  // The positions following the one at I in a matched sequence.
+  auto Successors = [&](size_t I, size_t (&Next)[2]) -> size_t {
+    size_t Count = 0;
+    if (I + 1 < Chars.size() && NextToken[I + 1] == NextToken[I])
+      Next[Count++] = I + 1;
+    if (NextToken[I] != StringRef::npos)
+      Next[Count++] = NextToken[I];
+    return Count;
+  };
+  Keys.push_back(makeKey(START_UNIGRAM, Chars[0]));
+  for (size_t I = 0; I < Chars.size(); ++I) {
+    size_t Second[2];
+    const size_t SecondCount = Successors(I, Second);
+    for (size_t J = 0; J < SecondCount; ++J) {
+      if (I == 0)
+        Keys.push_back(makeKey(START_BIGRAM, Chars[0], Chars[Second[J]]));
+      size_t Third[2];
+      const size_t ThirdCount = Successors(Second[J], Third);
+      for (size_t K = 0; K < ThirdCount; ++K)
+        Keys.push_back(
+            makeKey(TRIGRAM, Chars[I], Chars[Second[J]], Chars[Third[K]]));
+    }
+  }
+  llvm::sort(Keys.begin(), Keys.end());
+  Keys.erase(std::unique(Keys.begin(), Keys.end()), Keys.end());
+  return Keys;
+}
 
-private:
-  using Entry = std::pair<llvm::SmallString<32>, SymbolAndSignals>;
-  std::vector<Entry> Symbols;
-};
+// Returns the keys that the symbols matching the query \p Tokens have.
+std::vector<uint32_t> queryKeys(const std::vector<std::string> &Tokens) {
+  const std::string Chars = llvm::join(Tokens.begin(), Tokens.end(), "");
+  std::vector<uint32_t> Keys;
+  if (Chars.empty())
+    return Keys;
+  Keys.push_back(makeKey(START_UNIGRAM, Chars[0]));
+  if (Chars.size() > 1)
+    Keys.push_back(makeKey(START_BIGRAM, Chars[0], Chars[1]));
+  for (size_t I = 0; I + 2 < Chars.size(); ++I)
+    Keys.push_back(makeKey(TRIGRAM, Chars[I], Chars[I + 1], Chars[I + 2]));
+  return Keys;
+}
 
 // Helpers for tokenize state machine.
 enum TokenizeState {
@@ -62,17 +111,16 @@ CharType classify(char c) {
   return MISC;
 }
 
-} // namespace
-
-std::vector<std::string> FuzzySymbolIndex::tokenize(StringRef Text) {
-  std::vector<std::string> Result;
+// Calls \p CB with each token of \p Text, not lowercased.
+template <typename Callback> void forEachToken(StringRef Text, Callback CB) {
   // State describes the treatment of text from Start to I.
-  // Once text is Flush()ed into Result, we're done with it and advance Start.
+  // Once text is Flush()ed to the callback, we're done with it and advance
+  // Start.
   TokenizeState State = EMPTY;
   size_t Start = 0;
   auto Flush = [&](size_t End) {
     if (State != EMPTY) {
-      Result.push_back(Text.substr(Start, End - Start).lower());
+      CB(Text.substr(Start, End - Start));
       State = EMPTY;
     }
     Start = End;
@@ -112,6 +160,150 @@ std::vector<std::string> FuzzySymbolIndex::tokenize(StringRef Text) {
     }
   }
   Flush(Text.size());
+}
+
+// The query tokens, joined, with the end of the token of each character.
+struct Query {
+  std::string Chars;
+  std::vector<size_t> TokenEnd;
+};
+
+// Returns whether the query \p Q matches a symbol made of \p Tokens, as the
+// regexp of queryRegexp() would on the symbol tokens joined by spaces: the
+// query splits into non-empty prefixes of the first symbol tokens, in order,
+// and each query token starts a new symbol token. \p Reachable and \p Next
+// are scratch buffers of Q.Chars.size() + 1 elements.
+bool matches(const Query &Q, llvm::ArrayRef<StringRef> Tokens,
+             std::vector<char> &Reachable, std::vector<char> &Next) {
+  const size_t Size = Q.Chars.size();
+  if (Size == 0)
+    return true;
+  // The lengths of the query prefixes matched by the symbol tokens so far.
+  std::fill(Reachable.begin(), Reachable.end(), 0);
+  Reachable[0] = 1;
+  for (StringRef Token : Tokens) {
+    std::fill(Next.begin(), Next.end(), 0);
+    bool Any = false;
+    for (size_t J = 0; J < Size; ++J) {
+      if (!Reachable[J])
+        continue;
+      const size_t Limit = std::min(Q.TokenEnd[J] - J, Token.size());
+      for (size_t L = 0; L < Limit && Q.Chars[J + L] == Token[L]; ++L) {
+        Next[J + L + 1] = 1;
+        Any = true;
+      }
+    }
+    if (Next[Size])
+      return true;
+    if (!Any)
+      return false;
+    std::swap(Reachable, Next);
+  }
+  return false;
+}
+
+class MemSymbolIndex : public FuzzySymbolIndex {
+public:
+  MemSymbolIndex(std::vector<SymbolAndSignals> Symbols)
+      : Symbols(std::move(Symbols)) {
+    // The tokens are interned, and the tokens of each symbol are a slice of a
+    // single array of token IDs.
+    llvm::SmallString<32> Lower;
+    llvm::SmallVector<StringRef, 8> Tokens;
+    TokenStarts.reserve(this->Symbols.size() + 1);
+    for (uint32_t I = 0, E = this->Symbols.size(); I != E; ++I) {
+      TokenStarts.push_back(TokenArena.size());
+      Tokens.clear();
+      forEachToken(this->Symbols[I].Symbol.getName(), [&](StringRef Token) {
+        Lower.clear();
+        for (char C : Token)
+          Lower.push_back(llvm::toLower(C));
+        auto Inserted = TokenStrings.try_emplace(Lower, TokenNames.size());
+        if (Inserted.second)
+          TokenNames.push_back(Inserted.first->getKey());
+        TokenArena.push_back(Inserted.first->second);
+        Tokens.push_back(TokenNames[Inserted.first->second]);
+      });
+      for (uint32_t Key : symbolKeys(Tokens))
+        Postings[Key].push_back(I);
+    }
+    TokenStarts.push_back(TokenArena.size());
+  }
+
+  std::vector<SymbolAndSignals> search(StringRef QueryText) override {
+    Query Q;
+    auto QueryTokens = tokenize(QueryText);
+    for (const std::string &Token : QueryTokens) {
+      Q.Chars += Token;
+      Q.TokenEnd.resize(Q.Chars.size(), Q.Chars.size());
+    }
+    std::vector<char> Reachable(Q.Chars.size() + 1), Next(Q.Chars.size() + 1);
+    llvm::SmallVector<StringRef, 8> Tokens;
+    auto Matches = [&](uint32_t Symbol) {
+      Tokens.clear();
+      for (uint32_t I = TokenStarts[Symbol], E = TokenStarts[Symbol + 1];
+           I != E; ++I)
+        Tokens.push_back(TokenNames[TokenArena[I]]);
+      return matches(Q, Tokens, Reachable, Next);
+    };
+
+    std::vector<SymbolAndSignals> Results;
+    auto Keys = queryKeys(QueryTokens);
+    if (Keys.empty()) {
+      for (uint32_t I = 0, E = Symbols.size(); I != E; ++I)
+        if (Matches(I))
+          Results.push_back(Symbols[I]);
+      return Results;
+    }
+
+    // Intersect the posting lists of the query keys, from the shortest one,
+    // and only match the remaining candidates.
+    std::vector<const std::vector<uint32_t> *> Lists;
+    for (uint32_t Key : Keys) {
+      auto I = Postings.find(Key);
+      if (I == Postings.end())
+        return Results;
+      Lists.push_back(&I->second);
+    }
+    llvm::sort(Lists.begin(), Lists.end(),
+               [](const std::vector<uint32_t> *LHS,
+                  const std::vector<uint32_t> *RHS) {
+                 return LHS->size() < RHS->size();
+               });
+    std::vector<uint32_t> Candidates = *Lists.front();
+    for (size_t I = 1; I < Lists.size(); ++I) {
+      std::vector<uint32_t> Intersection;
+      std::set_intersection(Candidates.begin(), Candidates.end(),
+                            Lists[I]->begin(), Lists[I]->end(),
+                            std::back_inserter(Intersection));
+      Candidates = std::move(Intersection);
+      if (Candidates.empty())
+        return Results;
+    }
+    for (uint32_t Candidate : Candidates)
+      if (Matches(Candidate))
+        Results.push_back(Symbols[Candidate]);
+    return Results;
+  }
+
+private:
+  std::vector<SymbolAndSignals> Symbols;
+  // The IDs of the distinct tokens, and the tokens by ID.
+  llvm::StringMap<uint32_t> TokenStrings;
+  std::vector<StringRef> TokenNames;
+  // The token IDs of all the symbols, the ones of symbol I starting at
+  // TokenStarts[I].
+  std::vector<uint32_t> TokenArena;
+  std::vector<uint32_t> TokenStarts;
+  // The symbols having each key, in increasing order.
+  llvm::DenseMap<uint32_t, std::vector<uint32_t>> Postings;
+};
+
+} // namespace
+
+std::vector<std::string> FuzzySymbolIndex::tokenize(StringRef Text) {
+  std::vector<std::string> Result;
+  forEachToken(Text, [&](StringRef Token) { Result.push_back(Token.lower()); });
   return Result;
 }
 
@@ -135,9 +327,14 @@ FuzzySymbolIndex::createFromYAML(StringRef FilePath) {
   auto Buffer = llvm::MemoryBuffer::getFile(FilePath);
   if (!Buffer)
     return llvm::errorCodeToError(Buffer.getError());
-  return llvm::make_unique<MemSymbolIndex>(
+  return createFromSymbols(
       find_all_symbols::ReadSymbolInfosFromYAML(Buffer.get()->getBuffer()));
 }
 
+std::unique_ptr<FuzzySymbolIndex>
+FuzzySymbolIndex::createFromSymbols(std::vector<SymbolAndSignals> Symbols) {
+  return llvm::make_unique<MemSymbolIndex>(std::move(Symbols));
+}
+
 } // namespace include_fixer
 } // namespace clang
@@ -36,6 +36,12 @@ public:
   static llvm::Expected<std::unique_ptr<FuzzySymbolIndex>>
   createFromYAML(llvm::StringRef File);
 
+  // Returns an index serving the specified symbols. The index keeps the
+  // trigrams of the tokenized symbol names, and only matches the query against
+  // the symbols having all the trigrams of the query.
+  static std::unique_ptr<FuzzySymbolIndex>
+  createFromSymbols(std::vector<find_all_symbols::SymbolAndSignals> Symbols);
+
   // Helpers for implementing indexes:
 
   // Transforms a symbol name or query into a sequence of tokens.
@@ -383,17 +383,25 @@ IncludeFixerSemaSource::query(StringRef Query, StringRef ScopedQualifiers,
   //
   // 1. lookup a::b::foo.
   // 2. lookup b::foo.
-  std::string QueryString = ScopedQualifiers.str() + Query.str();
-  // It's unsafe to do nested search for the identifier with scoped namespace
-  // context, it might treat the identifier as a nested class of the scoped
-  // namespace.
-  std::vector<find_all_symbols::SymbolInfo> MatchedSymbols =
-      SymbolIndexMgr.search(QueryString, /*IsNestedSearch=*/false, FileName);
-  if (MatchedSymbols.empty())
+  //
+  // The identifiers can't contain '|', which separates the parts of the key.
+  auto Cached = SearchCache.try_emplace((ScopedQualifiers + "|" + Query).str());
+  std::vector<find_all_symbols::SymbolInfo> &MatchedSymbols =
+      Cached.first->second;
+  if (Cached.second) {
+    std::string QueryString = ScopedQualifiers.str() + Query.str();
+    // It's unsafe to do nested search for the identifier with scoped namespace
+    // context, it might treat the identifier as a nested class of the scoped
+    // namespace.
     MatchedSymbols =
-        SymbolIndexMgr.search(Query, /*IsNestedSearch=*/true, FileName);
+        SymbolIndexMgr.search(QueryString, /*IsNestedSearch=*/false, FileName);
+    if (MatchedSymbols.empty())
+      MatchedSymbols =
+          SymbolIndexMgr.search(Query, /*IsNestedSearch=*/true, FileName);
+  }
   LLVM_DEBUG(llvm::dbgs() << "Having found " << MatchedSymbols.size()
-                          << " symbols\n");
+                          << " symbols" << (Cached.second ? "" : " (cached)")
+                          << "\n");
   // We store a copy of MatchedSymbols in a place where it's globally reachable.
   // This is used by the standalone version of the tool.
   this->MatchedSymbols = MatchedSymbols;
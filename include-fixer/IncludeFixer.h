@@ -16,6 +16,7 @@
 #include "clang/Sema/ExternalSemaSource.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringMap.h"
 #include <memory>
 #include <vector>
 
@@ -143,6 +144,11 @@ private:
   /// recovery.
   std::vector<find_all_symbols::SymbolInfo> MatchedSymbols;
 
+  /// The ranked results of the searches of the translation unit, keyed by
+  /// scoped qualifiers and identifier. Sema queries an unknown identifier
+  /// again at each of its uses, and the empty results are cached as well.
+  llvm::StringMap<std::vector<find_all_symbols::SymbolInfo>> SearchCache;
+
   /// The file path to the file being processed.
   std::string FilePath;
 
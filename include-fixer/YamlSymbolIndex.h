@@ -12,8 +12,8 @@
 
 #include "SymbolIndex.h"
 #include "find-all-symbols/SymbolInfo.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/ErrorOr.h"
-#include <map>
 #include <vector>
 
 namespace clang {
@@ -34,10 +34,12 @@ public:
 
 private:
   explicit YamlSymbolIndex(
-      std::vector<find_all_symbols::SymbolAndSignals> Symbols)
-      : Symbols(std::move(Symbols)) {}
+      std::vector<find_all_symbols::SymbolAndSignals> Symbols);
 
-  std::vector<find_all_symbols::SymbolAndSignals> Symbols;
+  /// The symbols grouped by name, hashed when the database is loaded so that
+  /// each search is a single lookup.
+  llvm::StringMap<std::vector<find_all_symbols::SymbolAndSignals>>
+      SymbolsByName;
 };
 
 } // namespace include_fixer
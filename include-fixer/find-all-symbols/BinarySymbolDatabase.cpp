@@ -0,0 +1,246 @@
+//===-- BinarySymbolDatabase.cpp - Binary symbol database -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/DJB.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+#include <limits>
+#include <map>
+
+namespace clang {
+namespace find_all_symbols {
+
+namespace {
+
+const char Magic[8] = {'\x7f', 'F', 'A', 'S', 'Y', 'M', 'D', 'B'};
+const uint32_t Version = 1;
+
+// The sizes, in 32-bit words, of the records of each section.
+const uint32_t HeaderWords = 2 + 5;
+const uint32_t SymbolWords = 9;
+const uint32_t ContextWords = 3;
+
+uint32_t readWord(const char *Data, uint32_t Index) {
+  return llvm::support::endian::read32le(Data + 4 * Index);
+}
+
+void writeWord(llvm::raw_ostream &OS, uint32_t Word) {
+  char Bytes[4];
+  llvm::support::endian::write32le(Bytes, Word);
+  OS.write(Bytes, sizeof(Bytes));
+}
+
+uint32_t getBucket(llvm::StringRef Name, uint32_t NumBuckets) {
+  return llvm::djbHash(Name) & (NumBuckets - 1);
+}
+
+/// Collects the strings and the contexts of the symbols, each one once.
+class TableBuilder {
+public:
+  /// Returns the offset and size of \p String in the string table.
+  std::pair<uint32_t, uint32_t> addString(llvm::StringRef String) {
+    auto Inserted = StringOffsets.try_emplace(String, Strings.size());
+    if (Inserted.second)
+      Strings += String;
+    return {Inserted.first->second, static_cast<uint32_t>(String.size())};
+  }
+
+  /// Returns the index of the first context of \p SymbolContexts.
+  uint32_t addContexts(const std::vector<SymbolInfo::Context> &SymbolContexts) {
+    auto Inserted =
+        ContextIndexes.emplace(SymbolContexts, Contexts.size() / ContextWords);
+    if (Inserted.second) {
+      for (const auto &Context : SymbolContexts) {
+        const auto Name = addString(Context.second);
+        Contexts.push_back(static_cast<uint32_t>(Context.first));
+        Contexts.push_back(Name.first);
+        Contexts.push_back(Name.second);
+      }
+    }
+    return Inserted.first->second;
+  }
+
+  std::string Strings;
+  std::vector<uint32_t> Contexts;
+
+private:
+  llvm::StringMap<uint32_t> StringOffsets;
+  std::map<std::vector<SymbolInfo::Context>, uint32_t> ContextIndexes;
+};
+
+} // namespace
+
+bool BinarySymbolDatabase::isBinarySymbolDatabase(llvm::StringRef Data) {
+  return Data.startswith(llvm::StringRef(Magic, sizeof(Magic)));
+}
+
+llvm::Optional<BinarySymbolDatabase>
+BinarySymbolDatabase::create(llvm::StringRef Data) {
+  if (!isBinarySymbolDatabase(Data) || Data.size() < 4 * HeaderWords ||
+      readWord(Data.data(), 2) != Version)
+    return llvm::None;
+  BinarySymbolDatabase Database;
+  Database.NumBuckets = readWord(Data.data(), 3);
+  Database.NumSymbols = readWord(Data.data(), 4);
+  Database.NumContexts = readWord(Data.data(), 5);
+  const uint32_t StringsSize = readWord(Data.data(), 6);
+  if (!llvm::isPowerOf2_32(Database.NumBuckets))
+    return llvm::None;
+
+  // The sections must exactly fill the data.
+  const uint64_t BucketsOffset = 4 * uint64_t(HeaderWords);
+  const uint64_t SymbolsOffset =
+      BucketsOffset + 4 * (uint64_t(Database.NumBuckets) + 1);
+  const uint64_t ContextsOffset =
+      SymbolsOffset + 4 * uint64_t(SymbolWords) * Database.NumSymbols;
+  const uint64_t StringsOffset =
+      ContextsOffset + 4 * uint64_t(ContextWords) * Database.NumContexts;
+  if (StringsOffset + StringsSize != Data.size())
+    return llvm::None;
+  Database.Buckets = Data.data() + BucketsOffset;
+  Database.Symbols = Data.data() + SymbolsOffset;
+  Database.Contexts = Data.data() + ContextsOffset;
+  Database.Strings = Data.substr(StringsOffset);
+  return Database;
+}
+
+llvm::Optional<llvm::StringRef>
+BinarySymbolDatabase::getString(const char *Ref) const {
+  const uint64_t Offset = readWord(Ref, 0);
+  const uint64_t Size = readWord(Ref, 1);
+  if (Offset + Size > Strings.size())
+    return llvm::None;
+  return Strings.substr(Offset, Size);
+}
+
+llvm::Optional<SymbolAndSignals>
+BinarySymbolDatabase::getSymbol(uint32_t Index) const {
+  const char *Symbol = Symbols + 4 * SymbolWords * Index;
+  const auto Name = getString(Symbol);
+  const auto FilePath = getString(Symbol + 4 * 2);
+  const uint64_t FirstContext = readWord(Symbol, 4);
+  const uint64_t SymbolNumContexts = readWord(Symbol, 5);
+  const uint32_t Kind = readWord(Symbol, 6);
+  if (!Name || !FilePath || FirstContext + SymbolNumContexts > NumContexts ||
+      Kind > static_cast<uint32_t>(SymbolInfo::SymbolKind::Unknown))
+    return llvm::None;
+
+  std::vector<SymbolInfo::Context> SymbolContexts;
+  SymbolContexts.reserve(SymbolNumContexts);
+  for (uint64_t I = FirstContext, E = FirstContext + SymbolNumContexts; I != E;
+       ++I) {
+    const char *Context = Contexts + 4 * ContextWords * I;
+    const uint32_t Type = readWord(Context, 0);
+    const auto ContextName = getString(Context + 4);
+    if (!ContextName ||
+        Type > static_cast<uint32_t>(SymbolInfo::ContextType::EnumDecl))
+      return llvm::None;
+    SymbolContexts.emplace_back(static_cast<SymbolInfo::ContextType>(Type),
+                                *ContextName);
+  }
+  return SymbolAndSignals{
+      SymbolInfo(*Name, static_cast<SymbolInfo::SymbolKind>(Kind), *FilePath,
+                 SymbolContexts),
+      SymbolInfo::Signals(readWord(Symbol, 7), readWord(Symbol, 8))};
+}
+
+std::vector<SymbolAndSignals>
+BinarySymbolDatabase::lookup(llvm::StringRef Name) const {
+  std::vector<SymbolAndSignals> Results;
+  const uint32_t Bucket = getBucket(Name, NumBuckets);
+  const uint32_t Begin = readWord(Buckets, Bucket);
+  const uint32_t End = readWord(Buckets, Bucket + 1);
+  if (Begin > End || End > NumSymbols)
+    return Results;
+  for (uint32_t I = Begin; I != End; ++I) {
+    // Compare the names before decoding the rest of the symbol.
+    const auto SymbolName = getString(Symbols + 4 * SymbolWords * I);
+    if (!SymbolName || *SymbolName != Name)
+      continue;
+    if (auto Symbol = getSymbol(I))
+      Results.push_back(std::move(*Symbol));
+  }
+  return Results;
+}
+
+bool WriteSymbolInfosToBinary(llvm::raw_ostream &OS,
+                              const SymbolInfo::SignalMap &Symbols) {
+  std::vector<const SymbolInfo::SignalMap::value_type *> Ordered;
+  Ordered.reserve(Symbols.size());
+  for (const auto &Symbol : Symbols)
+    Ordered.push_back(&Symbol);
+  return WriteSymbolInfosToBinary(OS, Ordered);
+}
+
+bool WriteSymbolInfosToBinary(
+    llvm::raw_ostream &OS,
+    llvm::ArrayRef<const SymbolInfo::SignalMap::value_type *> Symbols) {
+  const uint64_t MaxWord = std::numeric_limits<uint32_t>::max();
+  if (Symbols.size() >= MaxWord / 2)
+    return false;
+  const uint32_t NumBuckets =
+      llvm::PowerOf2Ceil(std::max<uint64_t>(Symbols.size(), 1));
+
+  // Group the symbols by bucket, keeping the order of the map in each one.
+  std::vector<std::pair<uint32_t, const SymbolInfo::SignalMap::value_type *>>
+      Sorted;
+  Sorted.reserve(Symbols.size());
+  for (const auto *Symbol : Symbols)
+    Sorted.emplace_back(getBucket(Symbol->first.getName(), NumBuckets),
+                        Symbol);
+  std::stable_sort(Sorted.begin(), Sorted.end(),
+                   [](const decltype(Sorted)::value_type &LHS,
+                      const decltype(Sorted)::value_type &RHS) {
+                     return LHS.first < RHS.first;
+                   });
+
+  TableBuilder Tables;
+  std::vector<uint32_t> Buckets(NumBuckets + 1, 0);
+  std::vector<uint32_t> Records;
+  Records.reserve(SymbolWords * Sorted.size());
+  for (const auto &Entry : Sorted) {
+    const SymbolInfo &Symbol = Entry.second->first;
+    const SymbolInfo::Signals &Signals = Entry.second->second;
+    ++Buckets[Entry.first + 1];
+    const auto Name = Tables.addString(Symbol.getName());
+    const auto FilePath = Tables.addString(Symbol.getFilePath());
+    Records.insert(Records.end(),
+                   {Name.first, Name.second, FilePath.first, FilePath.second,
+                    Tables.addContexts(Symbol.getContexts()),
+                    static_cast<uint32_t>(Symbol.getContexts().size()),
+                    static_cast<uint32_t>(Symbol.getSymbolKind()), Signals.Seen,
+                    Signals.Used});
+    if (Tables.Strings.size() > MaxWord ||
+        Tables.Contexts.size() / ContextWords > MaxWord)
+      return false;
+  }
+  for (uint32_t I = 0; I != NumBuckets; ++I)
+    Buckets[I + 1] += Buckets[I];
+
+  OS.write(Magic, sizeof(Magic));
+  for (uint32_t Word :
+       {Version, NumBuckets, static_cast<uint32_t>(Sorted.size()),
+        static_cast<uint32_t>(Tables.Contexts.size() / ContextWords),
+        static_cast<uint32_t>(Tables.Strings.size())})
+    writeWord(OS, Word);
+  for (uint32_t Word : Buckets)
+    writeWord(OS, Word);
+  for (uint32_t Word : Records)
+    writeWord(OS, Word);
+  for (uint32_t Word : Tables.Contexts)
+    writeWord(OS, Word);
+  OS << Tables.Strings;
+  return true;
+}
+
+} // namespace find_all_symbols
+} // namespace clang
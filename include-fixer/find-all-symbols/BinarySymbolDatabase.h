@@ -0,0 +1,81 @@
+//===-- BinarySymbolDatabase.h - Binary symbol database ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_FIND_ALL_SYMBOLS_BINARY_SYMBOL_DATABASE_H
+#define LLVM_CLANG_TOOLS_EXTRA_FIND_ALL_SYMBOLS_BINARY_SYMBOL_DATABASE_H
+
+#include "SymbolInfo.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+namespace clang {
+namespace find_all_symbols {
+
+/// \brief A read-only view of a symbol database in the binary format, which
+/// is used in place without parsing, e.g. from a memory mapped file.
+///
+/// The database is a header followed by four sections, all made of
+/// little-endian 32-bit words:
+/// - The hash table: the index of the first symbol of each bucket, plus the
+///   number of symbols. A symbol is in the bucket of the djb hash of its name.
+/// - The symbols, grouped by bucket: the offset and size of their name and
+///   file path, the index and number of their contexts, their kind and their
+///   signals.
+/// - The contexts, from the inner-most level to the outer-most level of each
+///   symbol. The symbols with the same contexts share them.
+/// - The string table, holding each name and file path once.
+class BinarySymbolDatabase {
+public:
+  /// \brief Returns the database stored in \p Data, or None if \p Data isn't
+  /// a binary symbol database. Only the header is read, \p Data must outlive
+  /// the database.
+  static llvm::Optional<BinarySymbolDatabase> create(llvm::StringRef Data);
+
+  /// \brief Returns whether \p Data starts like a binary symbol database.
+  static bool isBinarySymbolDatabase(llvm::StringRef Data);
+
+  /// \brief Returns the symbols named \p Name, in the order of the database.
+  std::vector<SymbolAndSignals> lookup(llvm::StringRef Name) const;
+
+  /// \brief Returns the number of symbols of the database.
+  uint32_t size() const { return NumSymbols; }
+
+private:
+  BinarySymbolDatabase() = default;
+
+  llvm::Optional<llvm::StringRef> getString(const char *Ref) const;
+  llvm::Optional<SymbolAndSignals> getSymbol(uint32_t Index) const;
+
+  uint32_t NumBuckets = 0;
+  uint32_t NumSymbols = 0;
+  uint32_t NumContexts = 0;
+  const char *Buckets = nullptr;
+  const char *Symbols = nullptr;
+  const char *Contexts = nullptr;
+  llvm::StringRef Strings;
+};
+
+/// \brief Write SymbolInfos to a stream in the binary format read by
+/// BinarySymbolDatabase. Returns false if the symbols are too large for the
+/// format.
+bool WriteSymbolInfosToBinary(llvm::raw_ostream &OS,
+                              const SymbolInfo::SignalMap &Symbols);
+
+/// \brief Write SymbolInfos to a stream in the binary format, keeping the
+/// order of \p Symbols among the symbols of the same name.
+bool WriteSymbolInfosToBinary(
+    llvm::raw_ostream &OS,
+    llvm::ArrayRef<const SymbolInfo::SignalMap::value_type *> Symbols);
+
+} // namespace find_all_symbols
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_FIND_ALL_SYMBOLS_BINARY_SYMBOL_DATABASE_H
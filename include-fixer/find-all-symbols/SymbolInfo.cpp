@@ -126,6 +126,17 @@ bool WriteSymbolInfosToStream(llvm::raw_ostream &OS,
   return true;
 }
 
+bool WriteSymbolInfosToStream(
+    llvm::raw_ostream &OS,
+    llvm::ArrayRef<const SymbolInfo::SignalMap::value_type *> Symbols) {
+  llvm::yaml::Output yout(OS);
+  for (const auto *Symbol : Symbols) {
+    SymbolAndSignals S{Symbol->first, Symbol->second};
+    yout << S;
+  }
+  return true;
+}
+
 std::vector<SymbolAndSignals> ReadSymbolInfosFromYAML(llvm::StringRef Yaml) {
   std::vector<SymbolAndSignals> Symbols;
   llvm::yaml::Input yin(Yaml);
@@ -10,10 +10,12 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_FIND_ALL_SYMBOLS_SYMBOLINFO_H
 #define LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_FIND_ALL_SYMBOLS_SYMBOLINFO_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/YAMLTraits.h"
 #include "llvm/Support/raw_ostream.h"
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -134,6 +136,12 @@ struct SymbolAndSignals {
 bool WriteSymbolInfosToStream(llvm::raw_ostream &OS,
                               const SymbolInfo::SignalMap &Symbols);
 
+/// \brief Write SymbolInfos to a stream (YAML format), in the order of
+/// \p Symbols, one at a time.
+bool WriteSymbolInfosToStream(
+    llvm::raw_ostream &OS,
+    llvm::ArrayRef<const SymbolInfo::SignalMap::value_type *> Symbols);
+
 /// \brief Read SymbolInfos from a YAML document.
 std::vector<SymbolAndSignals> ReadSymbolInfosFromYAML(llvm::StringRef Yaml);
 
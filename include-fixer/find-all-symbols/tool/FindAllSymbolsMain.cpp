@@ -7,26 +7,34 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "BinarySymbolDatabase.h"
 #include "FindAllSymbolsAction.h"
 #include "STLPostfixHeaderMap.h"
 #include "SymbolInfo.h"
 #include "SymbolReporter.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
 #include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <map>
 #include <mutex>
 #include <set>
@@ -59,6 +67,26 @@ static cl::opt<std::string> MergeDir("merge-dir", cl::desc(R"(
 The directory for merging symbols.)"),
                                      cl::init(""),
                                      cl::cat(FindAllSymbolsCategory));
+
+static cl::opt<bool> Incremental("incremental", cl::desc(R"(
+Keep the symbols of each file in the output directory, with the digests of
+its compile command and of the files it reads, and only index the files
+whose symbols are out of date.)"),
+                                 cl::init(false),
+                                 cl::cat(FindAllSymbolsCategory));
+
+enum DatabaseFormatTy {
+  yaml,   ///< Yaml database, one document per symbol.
+  binary, ///< Binary database, searched in place by clang-include-fixer.
+};
+
+static cl::opt<DatabaseFormatTy> DatabaseFormat(
+    "db-format", cl::desc("The format of the database written by -merge-dir."),
+    cl::values(clEnumVal(yaml, "Yaml database"),
+               clEnumVal(binary, "Binary database, for clang-include-fixer "
+                                 "-db=binary")),
+    cl::init(yaml), cl::cat(FindAllSymbolsCategory));
+
 namespace clang {
 namespace find_all_symbols {
 
@@ -76,15 +104,247 @@ public:
   }
 };
 
+/// \brief Returns the hexadecimal SHA1 digest of \p Content.
+static std::string digest(StringRef Content) {
+  return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(Content)),
+                     /*LowerCase=*/true);
+}
+
+/// \brief Returns the path of a file of the results of the source file
+/// \p AbsolutePath in incremental mode. Like the shards of the clangd
+/// background index, it is named after the source file and the digest of its
+/// path.
+static std::string getShardPath(StringRef AbsolutePath, StringRef Extension) {
+  SmallString<128> Path(OutputDir);
+  llvm::sys::path::append(Path, llvm::sys::path::filename(AbsolutePath) + "." +
+                                    digest(AbsolutePath).substr(0, 16) +
+                                    Extension);
+  return Path.str();
+}
+
+/// \brief Returns the digest of the compile commands of \p File.
+static std::string
+getCommandDigest(const clang::tooling::CompilationDatabase &Compilations,
+                 StringRef File) {
+  std::string Commands;
+  for (const CompileCommand &Command : Compilations.getCompileCommands(File)) {
+    Commands += Command.Directory;
+    Commands += '\0';
+    for (const std::string &Argument : Command.CommandLine) {
+      Commands += Argument;
+      Commands += '\0';
+    }
+  }
+  return digest(Commands);
+}
+
+/// \brief Returns whether the symbols of the source file \p AbsolutePath are
+/// up to date in incremental mode. Its dependencies file holds the digest of
+/// its compile commands, then the digests and paths of the files it read:
+///
+///   command <digest>
+///   <digest> <path>
+///   ...
+static bool isUpToDate(StringRef AbsolutePath, StringRef CommandDigest) {
+  auto Buffer = llvm::MemoryBuffer::getFile(getShardPath(AbsolutePath, ".deps"));
+  if (!Buffer)
+    return false;
+  SmallVector<StringRef, 64> Lines;
+  Buffer.get()->getBuffer().split(Lines, '\n', /*MaxSplit=*/-1,
+                                  /*KeepEmpty=*/false);
+  if (Lines.empty() || Lines.front() != ("command " + CommandDigest).str())
+    return false;
+  for (StringRef Line : makeArrayRef(Lines).drop_front()) {
+    StringRef Digest, Path;
+    std::tie(Digest, Path) = Line.split(' ');
+    auto Content = llvm::MemoryBuffer::getFile(Path);
+    if (!Content || digest(Content.get()->getBuffer()) != Digest)
+      return false;
+  }
+  return true;
+}
+
+/// \brief Writes \p Path through a temporary file, so that it is either
+/// complete or unchanged.
+static bool writeFileAtomically(StringRef Path,
+                                llvm::function_ref<void(raw_ostream &)> Write) {
+  int FD;
+  SmallString<128> TempPath;
+  if (std::error_code EC = llvm::sys::fs::createUniqueFile(
+          Path + "-%%%%%%.tmp", FD, TempPath)) {
+    llvm::errs() << "Can't create '" << Path << "': " << EC.message() << '\n';
+    return false;
+  }
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    Write(OS);
+  }
+  if (std::error_code EC = llvm::sys::fs::rename(TempPath, Path)) {
+    llvm::errs() << "Can't write '" << Path << "': " << EC.message() << '\n';
+    llvm::sys::fs::remove(TempPath);
+    return false;
+  }
+  return true;
+}
+
+/// \brief Collects the symbols of the translation unit being indexed in
+/// incremental mode, which both the AST matchers and the preprocessor
+/// callbacks report.
+class IncrementalReporter : public SymbolReporter {
+public:
+  void reportSymbols(StringRef FileName,
+                     const SymbolInfo::SignalMap &Symbols) override {
+    for (const auto &Symbol : Symbols)
+      this->Symbols[Symbol.first] += Symbol.second;
+  }
+
+  SymbolInfo::SignalMap takeSymbols() {
+    SymbolInfo::SignalMap Result;
+    std::swap(Result, Symbols);
+    return Result;
+  }
+
+private:
+  SymbolInfo::SignalMap Symbols;
+};
+
+/// \brief Indexes a translation unit in incremental mode, and writes its
+/// symbols and dependencies in the output directory.
+class IncrementalAction : public FindAllSymbolsAction {
+public:
+  IncrementalAction(IncrementalReporter &Reporter,
+                    const clang::tooling::CompilationDatabase &Compilations)
+      : FindAllSymbolsAction(&Reporter, getSTLPostfixHeaderMap()),
+        Reporter(Reporter), Compilations(Compilations) {}
+
+protected:
+  void EndSourceFileAction() override {
+    FindAllSymbolsAction::EndSourceFileAction();
+    SourceManager &SM = getCompilerInstance().getSourceManager();
+    FileManager &Files = SM.getFileManager();
+    SmallString<128> MainPath(
+        SM.getFileEntryForID(SM.getMainFileID())->getName());
+    Files.makeAbsolutePath(MainPath);
+
+    std::string Dependencies =
+        "command " + getCommandDigest(Compilations, MainPath) + "\n";
+    for (auto I = SM.fileinfo_begin(), E = SM.fileinfo_end(); I != E; ++I) {
+      const clang::FileEntry *File = I->first;
+      const llvm::MemoryBuffer *Content = SM.getMemoryBufferForFile(File);
+      if (!Content)
+        continue;
+      SmallString<128> Path(File->tryGetRealPathName());
+      if (Path.empty())
+        Path = File->getName();
+      Files.makeAbsolutePath(Path);
+      Dependencies += digest(Content->getBuffer()) + " " + Path.str().str() +
+                      "\n";
+    }
+
+    // The dependencies are written last, the symbols are up to date once they
+    // are.
+    const SymbolInfo::SignalMap Symbols = Reporter.takeSymbols();
+    if (writeFileAtomically(getShardPath(MainPath, ".yaml"),
+                            [&](raw_ostream &OS) {
+                              WriteSymbolInfosToStream(OS, Symbols);
+                            }))
+      writeFileAtomically(getShardPath(MainPath, ".deps"),
+                          [&](raw_ostream &OS) { OS << Dependencies; });
+  }
+
+private:
+  IncrementalReporter &Reporter;
+  const clang::tooling::CompilationDatabase &Compilations;
+};
+
+class IncrementalActionFactory : public clang::tooling::FrontendActionFactory {
+public:
+  explicit IncrementalActionFactory(
+      const clang::tooling::CompilationDatabase &Compilations)
+      : Compilations(Compilations) {}
+
+  clang::FrontendAction *create() override {
+    return new IncrementalAction(Reporter, Compilations);
+  }
+
+private:
+  IncrementalReporter Reporter;
+  const clang::tooling::CompilationDatabase &Compilations;
+};
+
+/// \brief Indexes the \p Sources whose symbols are out of date in the output
+/// directory.
+static int runIncremental(const clang::tooling::CompilationDatabase &Compilations,
+                          ArrayRef<std::string> Sources) {
+  std::vector<std::string> OutOfDate;
+  for (const std::string &Source : Sources) {
+    std::string Path = getAbsolutePath(Source);
+    if (!isUpToDate(Path, getCommandDigest(Compilations, Path)))
+      OutOfDate.push_back(Path);
+  }
+  if (OutOfDate.empty())
+    return 0;
+  ClangTool Tool(Compilations, OutOfDate);
+  IncrementalActionFactory Factory(Compilations);
+  return Tool.run(&Factory);
+}
+
+/// \brief A part of the merged symbols, with its own lock.
+struct SymbolShard {
+  std::mutex Mutex;
+  SymbolInfo::SignalMap Symbols;
+};
+
+/// \brief Returns the symbols of all the \p Shards, in the order of a single
+/// SignalMap. The shards hold distinct symbols.
+static std::vector<const SymbolInfo::SignalMap::value_type *>
+mergeShards(ArrayRef<SymbolShard> Shards) {
+  using Iterator = SymbolInfo::SignalMap::const_iterator;
+  using Range = std::pair<Iterator, Iterator>;
+  // A min-heap of the remaining symbols of each shard.
+  auto Greater = [](const Range &LHS, const Range &RHS) {
+    return RHS.first->first < LHS.first->first;
+  };
+  std::vector<Range> Heap;
+  size_t Size = 0;
+  for (const SymbolShard &Shard : Shards) {
+    Size += Shard.Symbols.size();
+    if (!Shard.Symbols.empty())
+      Heap.emplace_back(Shard.Symbols.begin(), Shard.Symbols.end());
+  }
+  std::make_heap(Heap.begin(), Heap.end(), Greater);
+
+  std::vector<const SymbolInfo::SignalMap::value_type *> Sorted;
+  Sorted.reserve(Size);
+  while (!Heap.empty()) {
+    std::pop_heap(Heap.begin(), Heap.end(), Greater);
+    Range &Next = Heap.back();
+    Sorted.push_back(&*Next.first);
+    if (++Next.first == Next.second)
+      Heap.pop_back();
+    else
+      std::push_heap(Heap.begin(), Heap.end(), Greater);
+  }
+  return Sorted;
+}
+
 bool Merge(llvm::StringRef MergeDir, llvm::StringRef OutputFile) {
   std::error_code EC;
-  SymbolInfo::SignalMap Symbols;
-  std::mutex SymbolMutex;
+  // The symbols are sharded by name, so that the threads parsing the files
+  // rarely wait for each other, and each shard stays smaller to update.
+  const unsigned NumShards = 64;
+  std::vector<SymbolShard> Shards(NumShards);
   auto AddSymbols = [&](ArrayRef<SymbolAndSignals> NewSymbols) {
-    // Synchronize set accesses.
-    std::unique_lock<std::mutex> LockGuard(SymbolMutex);
-    for (const auto &Symbol : NewSymbols) {
-      Symbols[Symbol.Symbol] += Symbol.Signals;
+    std::vector<std::vector<const SymbolAndSignals *>> ByShard(NumShards);
+    for (const auto &Symbol : NewSymbols)
+      ByShard[llvm::hash_value(Symbol.Symbol.getName()) % NumShards].push_back(
+          &Symbol);
+    for (unsigned I = 0; I != NumShards; ++I) {
+      if (ByShard[I].empty())
+        continue;
+      std::lock_guard<std::mutex> LockGuard(Shards[I].Mutex);
+      for (const SymbolAndSignals *Symbol : ByShard[I])
+        Shards[I].Symbols[Symbol->Symbol] += Symbol->Signals;
     }
   };
 
@@ -93,6 +353,9 @@ bool Merge(llvm::StringRef MergeDir, llvm::StringRef OutputFile) {
     llvm::ThreadPool Pool;
     for (llvm::sys::fs::directory_iterator Dir(MergeDir, EC), DirEnd;
          Dir != DirEnd && !EC; Dir.increment(EC)) {
+      // Skip the dependencies and temporary files of the incremental mode.
+      if (llvm::sys::path::extension(Dir->path()) != ".yaml")
+        continue;
       // Parse YAML files in parallel.
       Pool.async(
           [&AddSymbols](std::string Path) {
@@ -108,19 +371,26 @@ bool Merge(llvm::StringRef MergeDir, llvm::StringRef OutputFile) {
               Symbol.Signals.Seen = std::min(Symbol.Signals.Seen, 1u);
               Symbol.Signals.Used = std::min(Symbol.Signals.Used, 1u);
             }
-            // FIXME: Merge without creating such a heavy contention point.
             AddSymbols(Symbols);
           },
           Dir->path());
     }
   }
 
+  const auto Symbols = mergeShards(Shards);
   llvm::raw_fd_ostream OS(OutputFile, EC, llvm::sys::fs::F_None);
   if (EC) {
     llvm::errs() << "Can't open '" << OutputFile << "': " << EC.message()
                  << '\n';
     return false;
   }
+  if (DatabaseFormat == binary) {
+    if (!WriteSymbolInfosToBinary(OS, Symbols)) {
+      llvm::errs() << "Too many symbols for a binary database\n";
+      return false;
+    }
+    return true;
+  }
   WriteSymbolInfosToStream(OS, Symbols);
   return true;
 }
@@ -139,10 +409,13 @@ int main(int argc, const char **argv) {
     return 1;
   }
   if (!MergeDir.empty()) {
-    clang::find_all_symbols::Merge(MergeDir, sources[0]);
-    return 0;
+    return clang::find_all_symbols::Merge(MergeDir, sources[0]) ? 0 : 1;
   }
 
+  if (Incremental)
+    return clang::find_all_symbols::runIncremental(
+        OptionsParser.getCompilations(), sources);
+
   clang::find_all_symbols::YamlReporter Reporter;
 
   auto Factory =
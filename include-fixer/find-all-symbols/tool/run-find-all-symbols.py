@@ -19,11 +19,16 @@ Example invocations.
 - Run find-all-symbols on all files in the current working directory.
     run-find-all-symbols.py <source-file>
 
+- Keep the symbols of each file in a directory, and only index again the
+  files which changed since the previous run.
+    run-find-all-symbols.py -incremental-dir=find_all_symbols_shards
+
 Compilation database setup:
 http://clang.llvm.org/docs/HowToSetupToolingForLLVM.html
 """
 
 import argparse
+import hashlib
 import json
 import multiprocessing
 import os
@@ -48,16 +53,33 @@ def find_compilation_database(path):
 
 def MergeSymbols(directory, args):
   """Merge all symbol files (yaml) in a given directaory into a single file."""
-  invocation = [args.binary, '-merge-dir='+directory, args.saving_path]
+  invocation = [args.binary, '-merge-dir='+directory,
+                '-db-format='+args.db_format, args.saving_path]
   subprocess.call(invocation)
   print 'Merge is finished. Saving results in ' + args.saving_path
 
 
+def shard_name(path):
+  """Returns the name of the symbols of a file in incremental mode, without
+  its extension, the same as find-all-symbols."""
+  return os.path.basename(path) + '.' + hashlib.sha1(path.encode('utf-8')).hexdigest()[:16]
+
+
+def remove_stale_shards(directory, files):
+  """Removes the symbols of the files which left the compilation database."""
+  names = set(shard_name(name) for name in files)
+  for entry in os.listdir(directory):
+    if os.path.splitext(entry)[0] not in names:
+      os.remove(os.path.join(directory, entry))
+
+
 def run_find_all_symbols(args, tmpdir, build_path, queue):
   """Takes filenames out of queue and runs find-all-symbols on them."""
   while True:
     name = queue.get()
     invocation = [args.binary, name, '-output-dir='+tmpdir, '-p='+build_path]
+    if args.incremental_dir:
+      invocation.append('-incremental')
     sys.stdout.write(' '.join(invocation) + '\n')
     subprocess.call(invocation)
     queue.task_done()
@@ -73,9 +95,19 @@ def main():
                       help='number of instances to be run in parallel.')
   parser.add_argument('-p', dest='build_path',
                       help='path used to read a compilation database.')
-  parser.add_argument('-saving-path', default='./find_all_symbols_db.yaml',
-                      help='result saving path')
+  parser.add_argument('-saving-path',
+                      help='result saving path, ./find_all_symbols_db.yaml '
+                      'or ./find_all_symbols_db.bin by default')
+  parser.add_argument('-db-format', choices=['yaml', 'binary'], default='yaml',
+                      help='format of the merged database, binary databases '
+                      'are read with clang-include-fixer -db=binary')
+  parser.add_argument('-incremental-dir', metavar='DIR',
+                      help='keep the symbols of each file in DIR, and only '
+                      'index the files which changed since the previous run')
   args = parser.parse_args()
+  if args.saving_path is None:
+    extension = 'bin' if args.db_format == 'binary' else 'yaml'
+    args.saving_path = './find_all_symbols_db.' + extension
 
   db_path = 'compile_commands.json'
 
@@ -84,11 +116,20 @@ def main():
   else:
     build_path = find_compilation_database(db_path)
 
-  tmpdir = tempfile.mkdtemp()
+  if args.incremental_dir:
+    tmpdir = args.incremental_dir
+    if not os.path.isdir(tmpdir):
+      os.makedirs(tmpdir)
+  else:
+    tmpdir = tempfile.mkdtemp()
 
-  # Load the database and extract all files.
+  # Load the database and extract all files. The absolute paths name the
+  # symbols of the files in incremental mode.
   database = json.load(open(os.path.join(build_path, db_path)))
-  files = [entry['file'] for entry in database]
+  files = [os.path.normpath(os.path.join(entry['directory'], entry['file']))
+           for entry in database]
+  if args.incremental_dir:
+    remove_stale_shards(tmpdir, files)
 
   max_task = args.j
   if max_task == 0:
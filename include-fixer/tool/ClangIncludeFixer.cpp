@@ -7,6 +7,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "BinarySymbolIndex.h"
+#include "ClangdSymbolIndex.h"
 #include "FuzzySymbolIndex.h"
 #include "InMemorySymbolIndex.h"
 #include "IncludeFixer.h"
@@ -18,10 +20,16 @@
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Core/Replacement.h"
+#include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <atomic>
+#include <iostream>
 
 using namespace clang;
 using namespace llvm;
@@ -31,6 +39,17 @@ LLVM_YAML_IS_DOCUMENT_LIST_VECTOR(IncludeFixerContext)
 LLVM_YAML_IS_FLOW_SEQUENCE_VECTOR(IncludeFixerContext::HeaderInfo)
 LLVM_YAML_IS_FLOW_SEQUENCE_VECTOR(IncludeFixerContext::QuerySymbolInfo)
 
+namespace {
+/// \brief A request read by the server mode.
+struct ServerRequest {
+  std::string FilePath;
+  /// The content of the file, read from the disk when empty.
+  std::string Code;
+  /// The symbol to query without parsing the file, if any.
+  std::string QuerySymbol;
+};
+} // namespace
+
 namespace llvm {
 namespace yaml {
 
@@ -76,6 +95,14 @@ template <> struct MappingTraits<IncludeFixerContext> {
     IO.mapRequired("FilePath", Context.FilePath);
   }
 };
+
+template <> struct MappingTraits<ServerRequest> {
+  static void mapping(IO &IO, ServerRequest &Request) {
+    IO.mapRequired("FilePath", Request.FilePath);
+    IO.mapOptional("Code", Request.Code);
+    IO.mapOptional("QuerySymbol", Request.QuerySymbol);
+  }
+};
 } // namespace yaml
 } // namespace llvm
 
@@ -86,13 +113,18 @@ enum DatabaseFormatTy {
   fixed,     ///< Hard-coded mapping.
   yaml,      ///< Yaml database created by find-all-symbols.
   fuzzyYaml, ///< Yaml database with fuzzy-matched identifiers.
+  binary,    ///< Binary database created by find-all-symbols.
+  clangd,    ///< Index file created by clangd-indexer.
 };
 
 cl::opt<DatabaseFormatTy> DatabaseFormat(
     "db", cl::desc("Specify input format"),
     cl::values(clEnumVal(fixed, "Hard-coded mapping"),
                clEnumVal(yaml, "Yaml database created by find-all-symbols"),
-               clEnumVal(fuzzyYaml, "Yaml database, with fuzzy-matched names")),
+               clEnumVal(fuzzyYaml, "Yaml database, with fuzzy-matched names"),
+               clEnumVal(binary, "Binary database created by "
+                                 "find-all-symbols -db-format=binary"),
+               clEnumVal(clangd, "clangd index created by clangd-indexer")),
     cl::init(yaml), cl::cat(IncludeFixerCategory));
 
 cl::opt<std::string> Input("input",
@@ -152,6 +184,34 @@ cl::opt<std::string> InsertHeader(
              "                     QualifiedName: \"a::foo\"} ]}\""),
     cl::init(""), cl::cat(IncludeFixerCategory));
 
+cl::opt<bool> ServerMode(
+    "server",
+    cl::desc("Keep the symbol database loaded and answer the requests read\n"
+             "from stdin, one JSON object per line:\n"
+             "  {\"FilePath\": \"/path/to/foo.cc\", \"Code\": \"...\",\n"
+             "   \"QuerySymbol\": \"a::b::foo\"}\n"
+             "\"Code\" overrides the content of the file and \"QuerySymbol\"\n"
+             "queries a symbol like -query-symbol, both are optional.\n"
+             "Each response is the JSON of -output-headers, or\n"
+             "{\"Error\": \"...\"}, preceded by a\n"
+             "\"Content-Length: <size>\\r\\n\\r\\n\" header. The database is\n"
+             "reloaded when its file changes. The source paths only locate\n"
+             "the compilation database."),
+    cl::init(false), cl::cat(IncludeFixerCategory));
+
+cl::opt<unsigned>
+    Jobs("j",
+         cl::desc("Number of source files processed in parallel, sharing the\n"
+                  "symbol database. 0 uses one thread per hardware thread."),
+         cl::init(1), cl::cat(IncludeFixerCategory));
+
+cl::opt<std::string> ExportFixes(
+    "export-fixes",
+    cl::desc("Write the replacements of all the source files to the given\n"
+             "YAML file, which can be applied by clang-apply-replacements,\n"
+             "instead of changing the files."),
+    cl::value_desc("filename"), cl::cat(IncludeFixerCategory));
+
 cl::opt<std::string>
     Style("style",
           cl::desc("Fallback style for reformatting after inserting new\n"
@@ -217,6 +277,46 @@ createSymbolIndexManager(StringRef FilePath) {
     SymbolIndexMgr->addSymbolIndex(std::move(CreateYamlIdx));
     break;
   }
+  case binary: {
+    auto CreateBinaryIdx =
+        [=]() -> std::unique_ptr<include_fixer::SymbolIndex> {
+      llvm::ErrorOr<std::unique_ptr<include_fixer::BinarySymbolIndex>> DB(
+          nullptr);
+      if (!Input.empty()) {
+        DB = include_fixer::BinarySymbolIndex::createFromFile(Input);
+      } else {
+        // If we don't have any input file, look in the directory of the first
+        // file and its parents.
+        SmallString<128> AbsolutePath(tooling::getAbsolutePath(FilePath));
+        StringRef Directory = llvm::sys::path::parent_path(AbsolutePath);
+        DB = include_fixer::BinarySymbolIndex::createFromDirectory(
+            Directory, "find_all_symbols_db.bin");
+      }
+
+      if (!DB) {
+        llvm::errs() << "Couldn't find binary db: " << DB.getError().message()
+                     << '\n';
+        return nullptr;
+      }
+      return std::move(*DB);
+    };
+
+    SymbolIndexMgr->addSymbolIndex(std::move(CreateBinaryIdx));
+    break;
+  }
+  case clangd: {
+    SymbolIndexMgr->addSymbolIndex(
+        []() -> std::unique_ptr<include_fixer::SymbolIndex> {
+          auto DB = include_fixer::ClangdSymbolIndex::createFromFile(Input);
+          if (!DB) {
+            llvm::errs() << "Couldn't load clangd index: "
+                         << DB.getError().message() << '\n';
+            return nullptr;
+          }
+          return std::move(*DB);
+        });
+    break;
+  }
   case fuzzyYaml: {
     // This mode is not very useful, because we don't correct the identifier.
     // It's main purpose is to expose FuzzySymbolIndex to tests.
@@ -263,8 +363,179 @@ void writeToJson(llvm::raw_ostream &OS, const IncludeFixerContext& Context) {
   OS << "}\n";
 }
 
+/// Returns the context of the headers of the symbols named \p Name, queried
+/// directly in the database.
+IncludeFixerContext
+querySymbol(include_fixer::SymbolIndexManager &SymbolIndexMgr, StringRef Name,
+            StringRef FilePath) {
+  auto MatchedSymbols =
+      SymbolIndexMgr.search(Name, /*IsNestedSearch=*/true, FilePath);
+  for (auto &Symbol : MatchedSymbols) {
+    std::string HeaderPath = Symbol.getFilePath().str();
+    Symbol.SetFilePath(((HeaderPath[0] == '"' || HeaderPath[0] == '<')
+                            ? HeaderPath
+                            : "\"" + HeaderPath + "\""));
+  }
+
+  // We leave an empty symbol range as we don't know the range of the symbol
+  // being queried in this mode. include-fixer won't add namespace qualifiers
+  // if the symbol range is empty, which also fits this case.
+  IncludeFixerContext::QuerySymbolInfo Symbol;
+  Symbol.RawIdentifier = Name;
+  return IncludeFixerContext(FilePath, {Symbol}, MatchedSymbols);
+}
+
+/// Runs the include fixer over \p Files, on -j threads sharing
+/// \p SymbolIndexMgr, and appends their contexts in the order of the files.
+/// Returns whether all the files were parsed.
+bool runIncludeFixer(tooling::ClangTool &Tool,
+                     const tooling::CompilationDatabase &Compilations,
+                     ArrayRef<std::string> Files,
+                     include_fixer::SymbolIndexManager &SymbolIndexMgr,
+                     std::vector<IncludeFixerContext> &Contexts) {
+  if (Jobs == 1 || Files.size() == 1) {
+    include_fixer::IncludeFixerActionFactory Factory(
+        SymbolIndexMgr, Contexts, Style, MinimizeIncludePaths);
+    return Tool.run(&Factory) == 0;
+  }
+
+  std::vector<std::vector<IncludeFixerContext>> FileContexts(Files.size());
+  std::atomic<bool> Parsed(true);
+  {
+    llvm::ThreadPool Pool(Jobs ? Jobs : llvm::hardware_concurrency());
+    for (size_t I = 0, E = Files.size(); I != E; ++I)
+      Pool.async([&, I] {
+        tooling::ClangTool FileTool(Compilations, Files[I]);
+        include_fixer::IncludeFixerActionFactory Factory(
+            SymbolIndexMgr, FileContexts[I], Style, MinimizeIncludePaths);
+        if (FileTool.run(&Factory) != 0)
+          Parsed = false;
+      });
+  }
+  for (auto &Results : FileContexts)
+    Contexts.insert(Contexts.end(), Results.begin(), Results.end());
+  return Parsed;
+}
+
+/// Returns the path of the database file used for \p FilePath, or an empty
+/// string if there is none.
+std::string getDatabasePath(StringRef FilePath) {
+  StringRef Name;
+  switch (DatabaseFormat) {
+  case fixed:
+    return "";
+  case fuzzyYaml:
+  case clangd:
+    return Input;
+  case yaml:
+    Name = "find_all_symbols_db.yaml";
+    break;
+  case binary:
+    Name = "find_all_symbols_db.bin";
+    break;
+  }
+  if (!Input.empty())
+    return Input;
+  // Same lookup as the indexes created from a directory.
+  SmallString<128> AbsolutePath(tooling::getAbsolutePath(FilePath));
+  for (StringRef Directory = llvm::sys::path::parent_path(AbsolutePath);
+       !Directory.empty();
+       Directory = llvm::sys::path::parent_path(Directory)) {
+    SmallString<128> Path(Directory);
+    llvm::sys::path::append(Path, Name);
+    if (llvm::sys::fs::exists(Path))
+      return Path.str();
+  }
+  return "";
+}
+
+/// \brief A symbol index manager kept by the server, with the status of the
+/// database file it was loaded from.
+struct LoadedDatabase {
+  std::unique_ptr<include_fixer::SymbolIndexManager> SymbolIndexMgr;
+  llvm::sys::TimePoint<> ModificationTime;
+  uint64_t Size = 0;
+};
+
+void writeServerResponse(StringRef Response) {
+  llvm::outs() << "Content-Length: " << Response.size() << "\r\n\r\n"
+               << Response;
+  llvm::outs().flush();
+}
+
+void writeServerError(StringRef Message) {
+  writeServerResponse(
+      "{\"Error\": \"" + llvm::yaml::escape(Message) + "\"}\n");
+}
+
+/// Answers the requests read from stdin until its end, see -server.
+int runServer(tooling::CompilationDatabase &Compilations) {
+  // The loaded databases, by path. The indexes are loaded on their first
+  // search, and stay warm for the next requests.
+  std::map<std::string, LoadedDatabase> Databases;
+  std::string Line;
+  while (std::getline(std::cin, Line)) {
+    if (StringRef(Line).trim().empty())
+      continue;
+    ServerRequest Request;
+    llvm::yaml::Input yin(Line);
+    yin >> Request;
+    if (yin.error() || Request.FilePath.empty()) {
+      writeServerError("Invalid request: " + Line);
+      continue;
+    }
+
+    // Reload the database whose file changed since it was loaded.
+    std::string DatabasePath = getDatabasePath(Request.FilePath);
+    llvm::sys::fs::file_status Status;
+    bool HasStatus = !DatabasePath.empty() &&
+                     !llvm::sys::fs::status(DatabasePath, Status);
+    LoadedDatabase &Database = Databases[DatabasePath];
+    if (!Database.SymbolIndexMgr ||
+        (HasStatus &&
+         (Status.getLastModificationTime() != Database.ModificationTime ||
+          Status.getSize() != Database.Size)) ||
+        (DatabasePath.empty() && DatabaseFormat != fixed)) {
+      Database.SymbolIndexMgr = createSymbolIndexManager(Request.FilePath);
+      if (HasStatus) {
+        Database.ModificationTime = Status.getLastModificationTime();
+        Database.Size = Status.getSize();
+      }
+    }
+    include_fixer::SymbolIndexManager &SymbolIndexMgr =
+        *Database.SymbolIndexMgr;
+
+    std::string Response;
+    llvm::raw_string_ostream OS(Response);
+    if (!Request.QuerySymbol.empty()) {
+      writeToJson(OS, querySymbol(SymbolIndexMgr, Request.QuerySymbol,
+                                  Request.FilePath));
+      writeServerResponse(OS.str());
+      continue;
+    }
+
+    tooling::ClangTool Tool(Compilations, Request.FilePath);
+    if (!Request.Code.empty())
+      Tool.mapVirtualFile(Request.FilePath, Request.Code);
+    std::vector<include_fixer::IncludeFixerContext> Contexts;
+    include_fixer::IncludeFixerActionFactory Factory(
+        SymbolIndexMgr, Contexts, Style, MinimizeIncludePaths);
+    if (Tool.run(&Factory) != 0 || Contexts.empty()) {
+      writeServerError("Fatal compiler error occurred while parsing file! "
+                       "(incorrect include paths?)");
+      continue;
+    }
+    writeToJson(OS, Contexts.front());
+    writeServerResponse(OS.str());
+  }
+  return 0;
+}
+
 int includeFixerMain(int argc, const char **argv) {
   tooling::CommonOptionsParser options(argc, argv, IncludeFixerCategory);
+  if (ServerMode)
+    return runServer(options.getCompilations());
+
   tooling::ClangTool tool(options.getCompilations(),
                           options.getSourcePathList());
 
@@ -357,32 +628,16 @@ int includeFixerMain(int argc, const char **argv) {
 
   // Query symbol mode.
   if (!QuerySymbol.empty()) {
-    auto MatchedSymbols = SymbolIndexMgr->search(
-        QuerySymbol, /*IsNestedSearch=*/true, SourceFilePath);
-    for (auto &Symbol : MatchedSymbols) {
-      std::string HeaderPath = Symbol.getFilePath().str();
-      Symbol.SetFilePath(((HeaderPath[0] == '"' || HeaderPath[0] == '<')
-                              ? HeaderPath
-                              : "\"" + HeaderPath + "\""));
-    }
-
-    // We leave an empty symbol range as we don't know the range of the symbol
-    // being queried in this mode. include-fixer won't add namespace qualifiers
-    // if the symbol range is empty, which also fits this case.
-    IncludeFixerContext::QuerySymbolInfo Symbol;
-    Symbol.RawIdentifier = QuerySymbol;
-    auto Context =
-        IncludeFixerContext(SourceFilePath, {Symbol}, MatchedSymbols);
-    writeToJson(llvm::outs(), Context);
+    writeToJson(llvm::outs(),
+                querySymbol(*SymbolIndexMgr, QuerySymbol, SourceFilePath));
     return 0;
   }
 
   // Now run our tool.
   std::vector<include_fixer::IncludeFixerContext> Contexts;
-  include_fixer::IncludeFixerActionFactory Factory(*SymbolIndexMgr, Contexts,
-                                                   Style, MinimizeIncludePaths);
-
-  if (tool.run(&Factory) != 0) {
+  if (!runIncludeFixer(tool, options.getCompilations(),
+                       options.getSourcePathList(), *SymbolIndexMgr,
+                       Contexts)) {
     // We suppress all Clang diagnostics (because they would be wrong,
     // include-fixer does custom recovery) but still want to give some feedback
     // in case there was a compiler error we couldn't recover from. The most
@@ -436,6 +691,25 @@ int includeFixerMain(int argc, const char **argv) {
     }
   }
 
+  if (!ExportFixes.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(ExportFixes, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Error opening output file: " << EC.message() << '\n';
+      return 1;
+    }
+    // One document per source file.
+    llvm::yaml::Output YAML(OS);
+    for (size_t I = 0, E = Contexts.size(); I != E; ++I) {
+      tooling::TranslationUnitReplacements TUR;
+      TUR.MainSourceFile = Contexts[I].getFilePath();
+      TUR.Replacements.assign(FixerReplacements[I].begin(),
+                              FixerReplacements[I].end());
+      YAML << TUR;
+    }
+    return 0;
+  }
+
   if (STDINMode) {
     assert(FixerReplacements.size() == 1);
     auto ChangedCode = tooling::applyAllReplacements(Code->getBuffer(),
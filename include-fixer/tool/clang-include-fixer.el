@@ -43,6 +43,7 @@ This string is passed as -db argument to
   :type '(radio
           (const :tag "Hard-coded mapping" :fixed)
           (const :tag "YAML" yaml)
+          (const :tag "Binary" binary)
           (symbol :tag "Other"))
   :risky t)
 
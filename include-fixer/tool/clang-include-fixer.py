@@ -18,6 +18,7 @@
 import argparse
 import difflib
 import json
+import os
 import re
 import subprocess
 import vim
@@ -49,6 +50,16 @@ query_mode = False
 if vim.eval('exists("g:clang_include_fixer_query_mode")') == "1":
   query_mode = vim.eval('g:clang_include_fixer_query_mode') != "0"
 
+# set g:clang_include_fixer_server to 1 to keep a clang-include-fixer -server
+# process, and its loaded symbol database, across the runs of this script.
+server_mode = False
+if vim.eval('exists("g:clang_include_fixer_server")') == "1":
+  server_mode = vim.eval('g:clang_include_fixer_server') != "0"
+
+# The servers started by this script, which is re-executed by each :pyf in the
+# same namespace.
+servers = globals().setdefault('clang_include_fixer_servers', {})
+
 
 def GetUserSelection(message, headers, maximum_suggested_headers):
   eval_message = message + '\n'
@@ -89,6 +100,34 @@ def execute(command, text):
   return p.communicate(input=text)
 
 
+def query_server(args, request):
+  key = (binary, args.db, args.input, os.getcwd())
+  server = servers.get(key)
+  if server is None or server.poll() is not None:
+    server = subprocess.Popen([binary, "-server", "-db=" + args.db,
+                               "-input=" + args.input,
+                               vim.current.buffer.name],
+                              stdout=subprocess.PIPE, stdin=subprocess.PIPE)
+    servers[key] = server
+  server.stdin.write(json.dumps(request) + '\n')
+  server.stdin.flush()
+  # The responses are preceded by a "Content-Length: <size>" header.
+  length = None
+  while True:
+    line = server.stdout.readline()
+    if not line:
+      raise Exception('clang-include-fixer server exited.')
+    line = line.strip()
+    if not line and length is not None:
+      break
+    if line.startswith('Content-Length:'):
+      length = int(line[len('Content-Length:'):])
+  response = json.loads(server.stdout.read(length))
+  if 'Error' in response:
+    raise Exception(response['Error'])
+  return response
+
+
 def InsertHeaderToVimBuffer(header, text):
   command = [binary, "-stdin", "-insert-header=" + json.dumps(header),
              vim.current.buffer.name]
@@ -152,6 +191,18 @@ def main():
     if len(symbol) == 0:
       print "Skip querying empty symbol."
       return
+
+  if server_mode:
+    request = {'FilePath': vim.current.buffer.name, 'Code': text}
+    if query_mode:
+      request['QuerySymbol'] = symbol
+    try:
+      include_fixer_context = query_server(args, request)
+    except Exception as error:
+      print >> sys.stderr, "Error while running clang-include-fixer: " + str(
+          error)
+      return
+  elif query_mode:
     command = [binary, "-stdin", "-query-symbol="+get_symbol_under_cursor(),
                "-db=" + args.db, "-input=" + args.input,
                vim.current.buffer.name]
@@ -159,12 +210,13 @@ def main():
     # Run command to get all headers.
     command = [binary, "-stdin", "-output-headers", "-db=" + args.db,
                "-input=" + args.input, vim.current.buffer.name]
-  stdout, stderr = execute(command, text)
-  if stderr:
-    print >> sys.stderr, "Error while running clang-include-fixer: " + stderr
-    return
+  if not server_mode:
+    stdout, stderr = execute(command, text)
+    if stderr:
+      print >> sys.stderr, "Error while running clang-include-fixer: " + stderr
+      return
+    include_fixer_context = json.loads(stdout)
 
-  include_fixer_context = json.loads(stdout)
   query_symbol_infos = include_fixer_context["QuerySymbolInfos"]
   if not query_symbol_infos:
     print "The file is fine, no need to add a header."
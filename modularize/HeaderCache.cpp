@@ -0,0 +1,196 @@
+//===--- HeaderCache.cpp - Cached results of headers ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===--------------------------------------------------------------------===//
+//
+// The entries are JSON files named after a hash of their header and
+// configuration, which are stored in the entries too, to detect collisions.
+// A rerun loads the entry of each header, and rehashes the files it read.
+// Headers that changed, and the headers including them, are compiled again.
+//
+//===--------------------------------------------------------------------===//
+
+#include "HeaderCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+
+namespace Modularize {
+
+// Changes whenever the summaries change, to ignore entries of older versions.
+static const int CacheVersion = 1;
+
+static json::Value toJSON(const HeaderSummary::Input &I) {
+  return json::Object{{"path", I.Path}, {"hash", I.Hash}};
+}
+static bool fromJSON(const json::Value &V, HeaderSummary::Input &I) {
+  json::ObjectMapper O(V);
+  return O && O.map("path", I.Path) && O.map("hash", I.Hash);
+}
+
+static json::Value toJSON(const HeaderSummary::Entity &E) {
+  return json::Object{{"name", E.Name}, {"kind", E.Kind},
+                      {"file", E.File}, {"line", E.Line},
+                      {"column", E.Column}};
+}
+static bool fromJSON(const json::Value &V, HeaderSummary::Entity &E) {
+  json::ObjectMapper O(V);
+  return O && O.map("name", E.Name) && O.map("kind", E.Kind) &&
+         O.map("file", E.File) && O.map("line", E.Line) &&
+         O.map("column", E.Column);
+}
+
+static json::Value toJSON(const HeaderSummary::MacroExpansion &M) {
+  return json::Object{
+      {"file", M.File},
+      {"line", M.Line},
+      {"column", M.Column},
+      {"name", M.Name},
+      {"definitionLine", M.DefinitionLine},
+      {"definitionColumn", M.DefinitionColumn},
+      {"unexpanded", M.Unexpanded},
+      {"expanded", M.Expanded},
+      {"definitionSourceLine", M.DefinitionSourceLine},
+      {"instanceSourceLine", M.InstanceSourceLine},
+      {"inclusionPath", M.InclusionPath},
+  };
+}
+static bool fromJSON(const json::Value &V, HeaderSummary::MacroExpansion &M) {
+  json::ObjectMapper O(V);
+  return O && O.map("file", M.File) && O.map("line", M.Line) &&
+         O.map("column", M.Column) && O.map("name", M.Name) &&
+         O.map("definitionLine", M.DefinitionLine) &&
+         O.map("definitionColumn", M.DefinitionColumn) &&
+         O.map("unexpanded", M.Unexpanded) && O.map("expanded", M.Expanded) &&
+         O.map("definitionSourceLine", M.DefinitionSourceLine) &&
+         O.map("instanceSourceLine", M.InstanceSourceLine) &&
+         O.map("inclusionPath", M.InclusionPath);
+}
+
+static json::Value toJSON(const HeaderSummary::Conditional &C) {
+  return json::Object{
+      {"file", C.File},
+      {"line", C.Line},
+      {"column", C.Column},
+      {"directiveKind", C.DirectiveKind},
+      {"value", C.Value},
+      {"unexpanded", C.Unexpanded},
+      {"inclusionPath", C.InclusionPath},
+  };
+}
+static bool fromJSON(const json::Value &V, HeaderSummary::Conditional &C) {
+  json::ObjectMapper O(V);
+  return O && O.map("file", C.File) && O.map("line", C.Line) &&
+         O.map("column", C.Column) &&
+         O.map("directiveKind", C.DirectiveKind) && O.map("value", C.Value) &&
+         O.map("unexpanded", C.Unexpanded) &&
+         O.map("inclusionPath", C.InclusionPath);
+}
+
+static bool fromJSON(const json::Value &V, HeaderSummary &S) {
+  json::ObjectMapper O(V);
+  return O && O.map("inputs", S.Inputs) && O.map("headers", S.Headers) &&
+         O.map("macroExpansions", S.MacroExpansions) &&
+         O.map("conditionals", S.Conditionals) &&
+         O.map("entities", S.Entities) &&
+         O.map("blockCheckErrors", S.BlockCheckErrors);
+}
+
+HeaderCache::HeaderCache(StringRef Directory) : Directory(Directory) {}
+
+Optional<HeaderSummary> HeaderCache::load(StringRef Header,
+                                          StringRef Configuration) {
+  auto Buffer = MemoryBuffer::getFile(pathFor(Header, Configuration));
+  if (!Buffer)
+    return None;
+  auto Entry = json::parse((*Buffer)->getBuffer());
+  if (!Entry) {
+    consumeError(Entry.takeError());
+    return None;
+  }
+  const json::Object *Object = Entry->getAsObject();
+  if (!Object ||
+      Object->getInteger("version") != Optional<int64_t>(CacheVersion) ||
+      Object->getString("header") != Optional<StringRef>(Header) ||
+      Object->getString("configuration") !=
+          Optional<StringRef>(Configuration))
+    return None;
+  HeaderSummary Summary;
+  const json::Value *SummaryJSON = Object->get("summary");
+  if (!SummaryJSON || !fromJSON(*SummaryJSON, Summary))
+    return None;
+  for (const HeaderSummary::Input &I : Summary.Inputs)
+    if (hashFile(I.Path) != I.Hash)
+      return None;
+  return std::move(Summary);
+}
+
+void HeaderCache::store(StringRef Header, StringRef Configuration,
+                        const HeaderSummary &Summary) const {
+  json::Object Entry{
+      {"version", CacheVersion},
+      {"header", Header},
+      {"configuration", Configuration},
+      {"summary",
+       json::Object{
+           {"inputs", Summary.Inputs},
+           {"headers", Summary.Headers},
+           {"macroExpansions", Summary.MacroExpansions},
+           {"conditionals", Summary.Conditionals},
+           {"entities", Summary.Entities},
+           {"blockCheckErrors", Summary.BlockCheckErrors},
+       }},
+  };
+
+  // Write to a temporary file first, so that concurrent readers never see a
+  // partial entry.
+  if (sys::fs::create_directories(Directory))
+    return;
+  std::string Path = pathFor(Header, Configuration);
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Path + "-%%%%%%.tmp", FD, TempPath))
+    return;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << json::Value(std::move(Entry));
+  }
+  if (sys::fs::rename(TempPath, Path))
+    sys::fs::remove(TempPath);
+}
+
+std::string HeaderCache::hashContents(StringRef Contents) {
+  return utohexstr(xxHash64(Contents));
+}
+
+std::string HeaderCache::pathFor(StringRef Header,
+                                 StringRef Configuration) const {
+  std::string Key = Header;
+  Key += '\0';
+  Key += Configuration;
+  SmallString<128> Path(Directory);
+  sys::path::append(Path, utohexstr(xxHash64(Key)) + ".json");
+  return Path.str();
+}
+
+StringRef HeaderCache::hashFile(StringRef Path) {
+  auto Inserted = FileHashes.try_emplace(Path);
+  std::string &Hash = Inserted.first->second;
+  if (Inserted.second)
+    if (auto Buffer = MemoryBuffer::getFile(Path))
+      Hash = hashContents((*Buffer)->getBuffer());
+  return Hash;
+}
+
+} // end namespace Modularize
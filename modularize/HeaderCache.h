@@ -0,0 +1,128 @@
+//===--- HeaderCache.h - Cached results of headers -*- C++ -*------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===--------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Persistent cache of the results of compiling each header.
+///
+//===--------------------------------------------------------------------===//
+
+#ifndef MODULARIZE_HEADER_CACHE_H
+#define MODULARIZE_HEADER_CACHE_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+namespace Modularize {
+
+/// \brief The results of compiling a header of the header list.
+///
+/// The results are recorded without source locations, so that they can be
+/// stored by a HeaderCache and replayed by a later run into the entity map
+/// and the PreprocessorTracker, as if the header was compiled again.
+struct HeaderSummary {
+  /// A file read by the compilation, with a hash of its contents.
+  struct Input {
+    std::string Path;
+    std::string Hash;
+  };
+
+  /// A declaration or macro definition collected from the header. The kind
+  /// is an Entry::EntryKind of Modularize.cpp.
+  struct Entity {
+    std::string Name;
+    int Kind;
+    std::string File;
+    int Line;
+    int Column;
+  };
+
+  /// A macro expansion, or a defined() operator, seen by the
+  /// PreprocessorTracker.
+  struct MacroExpansion {
+    std::string File;
+    int Line;
+    int Column;
+    std::string Name;
+    int DefinitionLine;
+    int DefinitionColumn;
+    std::string Unexpanded;
+    std::string Expanded;
+    std::string DefinitionSourceLine;
+    std::string InstanceSourceLine;
+    std::vector<std::string> InclusionPath;
+  };
+
+  /// A preprocessor conditional directive seen by the PreprocessorTracker.
+  /// The directive is a clang::tok::PPKeywordKind and the value a
+  /// clang::PPCallbacks::ConditionValueKind.
+  struct Conditional {
+    std::string File;
+    int Line;
+    int Column;
+    int DirectiveKind;
+    int Value;
+    std::string Unexpanded;
+    std::vector<std::string> InclusionPath;
+  };
+
+  /// The files read by the compilation: the header and its include closure.
+  std::vector<Input> Inputs;
+  /// The headers entered by the preprocessor, in order.
+  std::vector<std::string> Headers;
+  std::vector<MacroExpansion> MacroExpansions;
+  std::vector<Conditional> Conditionals;
+  std::vector<Entity> Entities;
+  /// The errors of the check for #include directives in extern and namespace
+  /// blocks, as reported.
+  std::string BlockCheckErrors;
+};
+
+/// \brief Stores the summaries of the headers in a directory, so that a later
+/// run only compiles the headers that changed, or whose includes changed.
+///
+/// There is an entry per header and configuration, i.e. the compile options
+/// and the dependencies of the header. An entry is valid as long as the files
+/// read by the compilation of its header have the same contents. A new header
+/// that would shadow one found later in the include paths isn't detected.
+/// Entries are written atomically, so several runs can share a directory.
+class HeaderCache {
+public:
+  explicit HeaderCache(llvm::StringRef Directory);
+
+  /// \brief Returns the summary stored for \p Header and \p Configuration,
+  /// unless one of the files it read changed since.
+  llvm::Optional<HeaderSummary> load(llvm::StringRef Header,
+                                     llvm::StringRef Configuration);
+
+  /// \brief Stores the summary of \p Header for \p Configuration. Its inputs
+  /// must be set.
+  void store(llvm::StringRef Header, llvm::StringRef Configuration,
+             const HeaderSummary &Summary) const;
+
+  /// \brief Returns the hash of the contents of an input.
+  static std::string hashContents(llvm::StringRef Contents);
+
+private:
+  std::string pathFor(llvm::StringRef Header,
+                      llvm::StringRef Configuration) const;
+  // Returns the hash of the current contents of a file, empty if it can't be
+  // read.
+  llvm::StringRef hashFile(llvm::StringRef Path);
+
+  std::string Directory;
+  // The hashes of the files read so far, as inputs are shared by many headers.
+  llvm::StringMap<std::string> FileHashes;
+};
+
+} // end namespace Modularize
+
+#endif // MODULARIZE_HEADER_CACHE_H
@@ -227,14 +227,17 @@
 
 #include "Modularize.h"
 #include "ModularizeUtilities.h"
+#include "HeaderCache.h"
 #include "PreprocessorTracker.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/SourceManager.h"
+#include "clang/Basic/Version.h"
 #include "clang/Driver/Options.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Tooling.h"
@@ -246,10 +249,12 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 #include <algorithm>
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace clang;
@@ -330,6 +335,22 @@ DisplayFileLists("display-file-lists", cl::init(false),
 cl::desc("Display lists of good files (no compile errors), problem files,"
   " and a combined list with problem files preceded by a '#'."));
 
+// Option for the number of headers compiled in parallel by the stand-alone
+// compile check of the file lists.
+static cl::opt<unsigned>
+Jobs("j", cl::init(1),
+cl::desc("Number of headers compiled in parallel when checking which headers"
+  " compile stand-alone for -display-file-lists. 0 uses one thread per"
+  " hardware thread."));
+
+// Option for the directory of the persistent cache of the results of each
+// header, so that a rerun only compiles the headers that changed.
+static cl::opt<std::string>
+HeaderCacheDirectory("header-cache", cl::init(""), cl::value_desc("directory"),
+cl::desc("Cache the results of each header in this directory, and reuse them"
+  " in later runs as long as the header and the files it includes don't"
+  " change."));
+
 // Save the program name for error messages.
 const char *Argv0;
 // Save the command line for comments.
@@ -357,14 +378,14 @@ getModularizeArgumentsAdjuster(DependencyMap &Dependencies) {
   return [&Dependencies](const CommandLineArguments &Args,
                          StringRef /*unused*/) {
     std::string InputFile = findInputFile(Args);
-    DependentsVector &FileDependents = Dependencies[InputFile];
+    // Don't insert missing entries, the headers may be compiled concurrently.
+    DependencyMap::const_iterator FileDependents =
+        Dependencies.find(InputFile);
     CommandLineArguments NewArgs(Args);
-    if (int Count = FileDependents.size()) {
-      for (int Index = 0; Index < Count; ++Index) {
+    if (FileDependents != Dependencies.end()) {
+      for (const std::string &Dependent : FileDependents->second) {
         NewArgs.push_back("-include");
-        std::string File(std::string("\"") + FileDependents[Index] +
-                         std::string("\""));
-        NewArgs.push_back(FileDependents[Index]);
+        NewArgs.push_back(Dependent);
       }
     }
     // Ignore warnings.  (Insert after "clang_tool" at beginning.)
@@ -378,6 +399,34 @@ getModularizeArgumentsAdjuster(DependencyMap &Dependencies) {
   };
 }
 
+// Returns everything the results of a header depend on, other than the
+// contents of the files it reads, for the header cache: the compiler, the
+// options, and the dependencies of the header.
+static std::string
+getHeaderCacheConfiguration(StringRef File, StringRef WorkingDirectory,
+                            ArrayRef<std::string> HeaderFileNames,
+                            const DependencyMap &Dependencies) {
+  std::string Configuration = getClangFullVersion();
+  raw_string_ostream OS(Configuration);
+  OS << "\ndirectory: " << WorkingDirectory << "\narguments:";
+  for (const std::string &Argument : CC1Arguments)
+    OS << " " << Argument;
+  DependencyMap::const_iterator FileDependents =
+      Dependencies.find(ModularizeUtilities::getCanonicalPath(File));
+  if (FileDependents != Dependencies.end()) {
+    OS << "\ndependencies:";
+    for (const std::string &Dependent : FileDependents->second)
+      OS << " " << Dependent;
+  }
+  // The block check then depends on all the headers of the list.
+  if (BlockCheckHeaderListOnly) {
+    OS << "\nblock-check-header-list-only:";
+    for (const std::string &Header : HeaderFileNames)
+      OS << " " << Header;
+  }
+  return OS.str();
+}
+
 // FIXME: The Location class seems to be something that we might
 // want to design to be applicable to a wider range of tools, and stick it
 // somewhere into Tooling/ in mainline
@@ -387,6 +436,9 @@ struct Location {
 
   Location() : File(), Line(), Column() {}
 
+  Location(const FileEntry *File, unsigned Line, unsigned Column)
+      : File(File), Line(Line), Column(Column) {}
+
   Location(SourceManager &SM, SourceLocation Loc) : File(), Line(), Column() {
     Loc = SM.getExpansionLoc(Loc);
     if (Loc.isInvalid())
@@ -486,8 +538,17 @@ typedef std::vector<HeaderEntry> HeaderContents;
 class EntityMap : public StringMap<SmallVector<Entry, 2> > {
 public:
   DenseMap<const FileEntry *, HeaderContents> HeaderContentMismatches;
+  // If set, the entities are recorded in this summary instead.
+  HeaderSummary *Recording = nullptr;
 
   void add(const std::string &Name, enum Entry::EntryKind Kind, Location Loc) {
+    if (Recording) {
+      HeaderSummary::Entity E = {Name, Kind, Loc.File->getName().str(),
+                                 int(Loc.Line), int(Loc.Column)};
+      Recording->Entities.push_back(E);
+      return;
+    }
+
     // Record this entity in its header.
     HeaderEntry HE = { Name, Loc };
     CurHeaderContents[Loc.File].push_back(HE);
@@ -535,6 +596,19 @@ public:
     CurHeaderContents.clear();
   }
 
+  // Add the entities recorded in a summary, as if its header was compiled
+  // again. The files are looked up in FM, which must be the same for all the
+  // summaries, as the locations are compared by file entry.
+  void replay(const HeaderSummary &Summary, FileManager &FM) {
+    for (const HeaderSummary::Entity &E : Summary.Entities) {
+      const FileEntry *File = FM.getFile(E.File);
+      if (!File)
+        continue;
+      add(E.Name, Entry::EntryKind(E.Kind), Location(File, E.Line, E.Column));
+    }
+    mergeCurHeaderContents();
+  }
+
 private:
   DenseMap<const FileEntry *, HeaderContents> CurHeaderContents;
   DenseMap<const FileEntry *, HeaderContents> AllHeaderContents;
@@ -545,9 +619,9 @@ class CollectEntitiesVisitor
 public:
   CollectEntitiesVisitor(SourceManager &SM, EntityMap &Entities,
                          Preprocessor &PP, PreprocessorTracker &PPTracker,
-                         int &HadErrors)
+                         int &HadErrors, raw_ostream &OS)
       : SM(SM), Entities(Entities), PP(PP), PPTracker(PPTracker),
-        HadErrors(HadErrors) {}
+        HadErrors(HadErrors), OS(OS) {}
 
   bool TraverseStmt(Stmt *S) { return true; }
   bool TraverseType(QualType T) { return true; }
@@ -589,8 +663,7 @@ public:
       LinkageLabel = "extern \"C++\" {}";
       break;
     }
-    if (!PPTracker.checkForIncludesInBlock(PP, BlockRange, LinkageLabel,
-                                           errs()))
+    if (!PPTracker.checkForIncludesInBlock(PP, BlockRange, LinkageLabel, OS))
       HadErrors = 1;
     return true;
   }
@@ -601,8 +674,7 @@ public:
     std::string Label("namespace ");
     Label += D->getName();
     Label += " {}";
-    if (!PPTracker.checkForIncludesInBlock(PP, BlockRange, Label.c_str(),
-                                           errs()))
+    if (!PPTracker.checkForIncludesInBlock(PP, BlockRange, Label.c_str(), OS))
       HadErrors = 1;
     return true;
   }
@@ -650,25 +722,42 @@ private:
   Preprocessor &PP;
   PreprocessorTracker &PPTracker;
   int &HadErrors;
+  raw_ostream &OS;
 };
 
+// Collects the entities of a header, and checks its preprocessing. With a
+// summary, the results are recorded in it instead, to be replayed later.
 class CollectEntitiesConsumer : public ASTConsumer {
 public:
   CollectEntitiesConsumer(EntityMap &Entities,
                           PreprocessorTracker &preprocessorTracker,
-                          Preprocessor &PP, StringRef InFile, int &HadErrors)
+                          Preprocessor &PP, StringRef InFile, int &HadErrors,
+                          HeaderSummary *Summary)
       : Entities(Entities), PPTracker(preprocessorTracker), PP(PP),
-        HadErrors(HadErrors) {
+        HadErrors(HadErrors), Summary(Summary) {
+    if (Summary) {
+      Entities.Recording = Summary;
+      PPTracker.recordInto(Summary);
+    }
     PPTracker.handlePreprocessorEntry(PP, InFile);
   }
 
-  ~CollectEntitiesConsumer() override { PPTracker.handlePreprocessorExit(); }
+  ~CollectEntitiesConsumer() override {
+    PPTracker.handlePreprocessorExit();
+    if (Summary) {
+      Entities.Recording = nullptr;
+      PPTracker.recordInto(nullptr);
+    }
+  }
 
   void HandleTranslationUnit(ASTContext &Ctx) override {
     SourceManager &SM = Ctx.getSourceManager();
 
     // Collect declared entities.
-    CollectEntitiesVisitor(SM, Entities, PP, PPTracker, HadErrors)
+    std::string BlockCheckErrors;
+    raw_string_ostream BlockCheckStream(BlockCheckErrors);
+    CollectEntitiesVisitor(SM, Entities, PP, PPTracker, HadErrors,
+                           Summary ? BlockCheckStream : errs())
         .TraverseDecl(Ctx.getTranslationUnitDecl());
 
     // Collect macro definitions.
@@ -684,6 +773,23 @@ public:
 
     // Merge header contents.
     Entities.mergeCurHeaderContents();
+
+    if (Summary) {
+      Summary->BlockCheckErrors = BlockCheckStream.str();
+      // Record the files read, to invalidate the summary when they change.
+      for (auto I = SM.fileinfo_begin(), E = SM.fileinfo_end(); I != E; ++I) {
+        const llvm::MemoryBuffer *Buffer = SM.getMemoryBufferForFile(I->first);
+        if (!Buffer)
+          continue;
+        HeaderSummary::Input Input = {I->first->getName().str(),
+                                      HeaderCache::hashContents(
+                                          Buffer->getBuffer())};
+        Summary->Inputs.push_back(Input);
+      }
+      std::sort(Summary->Inputs.begin(), Summary->Inputs.end(),
+                [](const HeaderSummary::Input &A,
+                   const HeaderSummary::Input &B) { return A.Path < B.Path; });
+    }
   }
 
 private:
@@ -691,45 +797,49 @@ private:
   PreprocessorTracker &PPTracker;
   Preprocessor &PP;
   int &HadErrors;
+  HeaderSummary *Summary;
 };
 
 class CollectEntitiesAction : public SyntaxOnlyAction {
 public:
   CollectEntitiesAction(EntityMap &Entities,
                         PreprocessorTracker &preprocessorTracker,
-                        int &HadErrors)
+                        int &HadErrors, HeaderSummary *Summary)
       : Entities(Entities), PPTracker(preprocessorTracker),
-        HadErrors(HadErrors) {}
+        HadErrors(HadErrors), Summary(Summary) {}
 
 protected:
   std::unique_ptr<clang::ASTConsumer>
   CreateASTConsumer(CompilerInstance &CI, StringRef InFile) override {
     return llvm::make_unique<CollectEntitiesConsumer>(
-        Entities, PPTracker, CI.getPreprocessor(), InFile, HadErrors);
+        Entities, PPTracker, CI.getPreprocessor(), InFile, HadErrors, Summary);
   }
 
 private:
   EntityMap &Entities;
   PreprocessorTracker &PPTracker;
   int &HadErrors;
+  HeaderSummary *Summary;
 };
 
 class ModularizeFrontendActionFactory : public FrontendActionFactory {
 public:
   ModularizeFrontendActionFactory(EntityMap &Entities,
                                   PreprocessorTracker &preprocessorTracker,
-                                  int &HadErrors)
+                                  int &HadErrors,
+                                  HeaderSummary *Summary = nullptr)
       : Entities(Entities), PPTracker(preprocessorTracker),
-        HadErrors(HadErrors) {}
+        HadErrors(HadErrors), Summary(Summary) {}
 
   CollectEntitiesAction *create() override {
-    return new CollectEntitiesAction(Entities, PPTracker, HadErrors);
+    return new CollectEntitiesAction(Entities, PPTracker, HadErrors, Summary);
   }
 
 private:
   EntityMap &Entities;
   PreprocessorTracker &PPTracker;
   int &HadErrors;
+  HeaderSummary *Summary;
 };
 
 class CompileCheckVisitor
@@ -879,17 +989,46 @@ int main(int Argc, const char **Argv) {
   // for display, we do a first compile pass on individual
   // files to find which ones don't compile stand-alone.
   if (DisplayFileLists) {
-    // First, make a pass to just get compile errors.
-    for (auto &CompileCheckFile : ModUtil->HeaderFileNames) {
+    // First, make a pass to just get compile errors. The headers are compiled
+    // in parallel, each one by its own tool, and their diagnostics are buffered
+    // to be reported in the order of the header list.
+    const SmallVectorImpl<std::string> &CompileCheckFiles =
+        ModUtil->HeaderFileNames;
+    std::vector<int> CompileCheckFileErrors(CompileCheckFiles.size());
+    std::vector<std::string> CompileCheckDiagnostics(CompileCheckFiles.size());
+    auto CompileCheck = [&](size_t Index) {
       llvm::SmallVector<std::string, 32> CompileCheckFileArray;
-      CompileCheckFileArray.push_back(CompileCheckFile);
+      CompileCheckFileArray.push_back(CompileCheckFiles[Index]);
+      // All the headers share the working directory of the fixed compilation
+      // database, which the concurrent tools set.
       ClangTool CompileCheckTool(*Compilations, CompileCheckFileArray);
       CompileCheckTool.appendArgumentsAdjuster(
         getModularizeArgumentsAdjuster(ModUtil->Dependencies));
-      int CompileCheckFileErrors = 0;
+      raw_string_ostream DiagnosticStream(CompileCheckDiagnostics[Index]);
+      IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts(new DiagnosticOptions());
+      TextDiagnosticPrinter DiagnosticPrinter(DiagnosticStream, &*DiagOpts);
+      CompileCheckTool.setDiagnosticConsumer(&DiagnosticPrinter);
       CompileCheckFrontendActionFactory CompileCheckFactory;
-      CompileCheckFileErrors |= CompileCheckTool.run(&CompileCheckFactory);
-      if (CompileCheckFileErrors != 0) {
+      CompileCheckFileErrors[Index] =
+          CompileCheckTool.run(&CompileCheckFactory);
+      DiagnosticStream.flush();
+    };
+    unsigned ThreadCount =
+        Jobs == 0 ? std::max(1u, std::thread::hardware_concurrency()) : Jobs;
+    if (ThreadCount == 1 || CompileCheckFiles.size() <= 1) {
+      for (size_t Index = 0, E = CompileCheckFiles.size(); Index != E; ++Index)
+        CompileCheck(Index);
+    } else {
+      ThreadPool Pool(ThreadCount);
+      for (size_t Index = 0, E = CompileCheckFiles.size(); Index != E; ++Index)
+        Pool.async(CompileCheck, Index);
+      Pool.wait();
+    }
+
+    for (size_t Index = 0, E = CompileCheckFiles.size(); Index != E; ++Index) {
+      errs() << CompileCheckDiagnostics[Index];
+      const std::string &CompileCheckFile = CompileCheckFiles[Index];
+      if (CompileCheckFileErrors[Index] != 0) {
         ModUtil->addUniqueProblemFile(CompileCheckFile);   // Save problem file.
         HadErrors |= 1;
       }
@@ -899,12 +1038,51 @@ int main(int Argc, const char **Argv) {
   }
 
   // Then we make another pass on the good files to do the rest of the work.
-  ClangTool Tool(*Compilations,
-    (DisplayFileLists ? ModUtil->GoodFileNames : ModUtil->HeaderFileNames));
-  Tool.appendArgumentsAdjuster(
-    getModularizeArgumentsAdjuster(ModUtil->Dependencies));
-  ModularizeFrontendActionFactory Factory(Entities, *PPTracker, HadErrors);
-  HadErrors |= Tool.run(&Factory);
+  const SmallVectorImpl<std::string> &CheckFiles =
+      DisplayFileLists ? ModUtil->GoodFileNames : ModUtil->HeaderFileNames;
+  if (HeaderCacheDirectory.empty()) {
+    ClangTool Tool(*Compilations, CheckFiles);
+    Tool.appendArgumentsAdjuster(
+      getModularizeArgumentsAdjuster(ModUtil->Dependencies));
+    ModularizeFrontendActionFactory Factory(Entities, *PPTracker, HadErrors);
+    HadErrors |= Tool.run(&Factory);
+  } else {
+    // Compile the headers whose results aren't cached one at a time, by a
+    // tracker that only records their results. Then replay the results of
+    // all the headers, in the order of the header list, as the reports
+    // depend on it.
+    HeaderCache Cache(HeaderCacheDirectory);
+    std::unique_ptr<PreprocessorTracker> RecordingPPTracker(
+      PreprocessorTracker::create(ModUtil->HeaderFileNames,
+                                  BlockCheckHeaderListOnly));
+    EntityMap RecordingEntities;
+    FileManager Files((FileSystemOptions()));
+    for (const std::string &File : CheckFiles) {
+      std::string Configuration = getHeaderCacheConfiguration(
+          File, PathBuf, ModUtil->HeaderFileNames, ModUtil->Dependencies);
+      Optional<HeaderSummary> Summary = Cache.load(File, Configuration);
+      if (!Summary) {
+        Summary.emplace();
+        ClangTool Tool(*Compilations, File);
+        Tool.appendArgumentsAdjuster(
+          getModularizeArgumentsAdjuster(ModUtil->Dependencies));
+        ModularizeFrontendActionFactory Factory(
+            RecordingEntities, *RecordingPPTracker, HadErrors, &*Summary);
+        // Don't cache the results of headers with compile errors, so that
+        // the errors are reported again.
+        if (Tool.run(&Factory) == 0)
+          Cache.store(File, Configuration, *Summary);
+        else
+          HadErrors = 1;
+      }
+      Entities.replay(*Summary, Files);
+      PPTracker->replay(*Summary);
+      if (!Summary->BlockCheckErrors.empty()) {
+        errs() << Summary->BlockCheckErrors;
+        HadErrors = 1;
+      }
+    }
+  }
 
   // Create a place to save duplicate entity locations, separate bins per kind.
   typedef SmallVector<Location, 8> LocationArray;
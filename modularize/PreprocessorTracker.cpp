@@ -180,8 +180,17 @@
 // functions to get the pre-formatted location and source line strings for
 // the macro reference and the macro definition stored as string handles.
 // These helper functions use the current source manager from the
-// preprocessor. This is done in advance at this point in time because the
-// source manager doesn't exist at the time of the reporting.
+// preprocessor, because the source manager doesn't exist at the time of the
+// reporting. The string of the macro reference is only formatted when a
+// second MacroExpansionInstance is added, i.e. when there is a mismatch to
+// report, and the strings of the macro definitions are formatted once per
+// definition in each compilation.
+//
+// The maps of MacroExpansionTracker and ConditionalTracker objects are hash
+// maps keyed on the PPItemKey, whose name is an interned string handle, so
+// that the keys are hashed and compared by identity rather than by string
+// comparisons. The reporting functions sort the keys of the mismatches to
+// keep the report in the order of the names, files, lines and columns.
 //
 // For conditional check, the PreprocessorCallbacks class overrides the
 // PPCallbacks handlers for #if, #elif, #ifdef, and #ifndef.  These handlers
@@ -246,12 +255,20 @@
 
 #include "clang/Lex/LexDiagnostic.h"
 #include "PreprocessorTracker.h"
+#include "HeaderCache.h"
 #include "clang/Lex/MacroArgs.h"
 #include "clang/Lex/PPCallbacks.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/StringPool.h"
 #include "llvm/Support/raw_ostream.h"
 #include "ModularizeUtilities.h"
+#include <unordered_map>
 
 namespace Modularize {
 
@@ -369,6 +386,14 @@ static std::string getSourceLine(clang::Preprocessor &PP, clang::FileID FileID,
   return llvm::StringRef(BeginPtr, Length).str();
 }
 
+// Get the "file:line:column" source location string followed by the source
+// line, as displayed in the reports.
+static std::string getSourceLocationAndLine(clang::Preprocessor &PP,
+                                            clang::SourceLocation Loc) {
+  return getSourceLocationString(PP, Loc) + ":\n" + getSourceLine(PP, Loc) +
+         "\n";
+}
+
 // Get the string for the Unexpanded macro instance.
 // The soureRange is expected to end at the last token
 // for the macro instance, which in the case of a function-style
@@ -528,6 +553,23 @@ public:
   int Column;
 };
 
+// Preprocessor item key hash.
+//
+// The names are interned, so that the address of the string identifies it.
+struct PPItemKeyHash {
+  size_t operator()(const PPItemKey &Key) const {
+    const char *Name = (Key.Name ? *Key.Name : nullptr);
+    return llvm::hash_combine(Name, Key.File, Key.Line, Key.Column);
+  }
+};
+
+// Header inclusion path hash.
+struct HeaderInclusionPathHash {
+  size_t operator()(const std::vector<HeaderHandle> &Path) const {
+    return llvm::hash_combine_range(Path.begin(), Path.end());
+  }
+};
+
 // Header inclusion path.
 class HeaderInclusionPath {
 public:
@@ -591,12 +633,10 @@ class MacroExpansionTracker {
 public:
   MacroExpansionTracker(StringHandle MacroUnexpanded,
                         StringHandle MacroExpanded,
-                        StringHandle InstanceSourceLine,
                         PPItemKey &DefinitionLocation,
                         StringHandle DefinitionSourceLine,
                         InclusionPathHandle InclusionPathHandle)
-      : MacroUnexpanded(MacroUnexpanded),
-        InstanceSourceLine(InstanceSourceLine) {
+      : MacroUnexpanded(MacroUnexpanded) {
     addMacroExpansionInstance(MacroExpanded, DefinitionLocation,
                               DefinitionSourceLine, InclusionPathHandle);
   }
@@ -632,7 +672,8 @@ public:
 
   // A string representing the macro instance without expansion.
   StringHandle MacroUnexpanded;
-  // A place to save the macro instance source line string.
+  // A place to save the macro instance source line string, only set once
+  // there is a mismatch.
   StringHandle InstanceSourceLine;
   // The macro expansion instances.
   // If all instances of the macro expansion expand to the same value,
@@ -779,14 +820,35 @@ private:
 };
 
 // Preprocessor macro expansion item map types.
-typedef std::map<PPItemKey, MacroExpansionTracker> MacroExpansionMap;
-typedef std::map<PPItemKey, MacroExpansionTracker>::iterator
-MacroExpansionMapIter;
+typedef std::unordered_map<PPItemKey, MacroExpansionTracker, PPItemKeyHash>
+MacroExpansionMap;
+typedef MacroExpansionMap::iterator MacroExpansionMapIter;
 
 // Preprocessor conditional expansion item map types.
-typedef std::map<PPItemKey, ConditionalTracker> ConditionalExpansionMap;
-typedef std::map<PPItemKey, ConditionalTracker>::iterator
-ConditionalExpansionMapIter;
+typedef std::unordered_map<PPItemKey, ConditionalTracker, PPItemKeyHash>
+ConditionalExpansionMap;
+typedef ConditionalExpansionMap::iterator ConditionalExpansionMapIter;
+
+// Header inclusion path map type.
+typedef std::unordered_map<std::vector<HeaderHandle>, InclusionPathHandle,
+                           HeaderInclusionPathHash>
+InclusionPathMap;
+
+// Get the entries of a map sorted by their key, for a stable report order.
+template <typename MapType>
+static std::vector<typename MapType::value_type *> getSortedEntries(
+    MapType &Map) {
+  std::vector<typename MapType::value_type *> Entries;
+  Entries.reserve(Map.size());
+  for (auto &Entry : Map)
+    Entries.push_back(&Entry);
+  std::sort(Entries.begin(), Entries.end(),
+            [](const typename MapType::value_type *E1,
+               const typename MapType::value_type *E2) {
+              return E1->first < E2->first;
+            });
+  return Entries;
+}
 
 // Preprocessor tracker for modularize.
 //
@@ -798,12 +860,12 @@ public:
         bool DoBlockCheckHeaderListOnly)
       : BlockCheckHeaderListOnly(DoBlockCheckHeaderListOnly),
         CurrentInclusionPathHandle(InclusionPathHandleInvalid),
-        InNestedHeader(false) {
+        InNestedHeader(false), Recording(nullptr) {
     // Use canonical header path representation.
     for (llvm::ArrayRef<std::string>::iterator I = Headers.begin(),
       E = Headers.end();
       I != E; ++I) {
-      HeaderList.push_back(getCanonicalPath(*I));
+      HeaderList.insert(getCanonicalPath(*I));
     }
   }
 
@@ -813,8 +875,11 @@ public:
   void handlePreprocessorEntry(clang::Preprocessor &PP,
                                llvm::StringRef rootHeaderFile) override {
     HeadersInThisCompile.clear();
+    DefinitionSourceLines.clear();
     assert((HeaderStack.size() == 0) && "Header stack should be empty.");
-    pushHeaderHandle(addHeader(rootHeaderFile));
+    HeaderHandle H = addHeader(rootHeaderFile);
+    recordHeader(H);
+    pushHeaderHandle(H);
     PP.addPPCallbacks(llvm::make_unique<PreprocessorCallbacks>(*this, PP,
                                                                rootHeaderFile));
   }
@@ -899,6 +964,7 @@ public:
     if (HeaderPath.startswith("<"))
       return;
     HeaderHandle H = addHeader(HeaderPath);
+    recordHeader(H);
     if (H != getCurrentHeaderHandle())
       pushHeaderHandle(H);
     // Check for nested header.
@@ -934,27 +1000,16 @@ public:
 
   // Return true if the given header is in the header list.
   bool isHeaderListHeader(llvm::StringRef HeaderPath) const {
-    std::string CanonicalPath = getCanonicalPath(HeaderPath);
-    for (llvm::ArrayRef<std::string>::iterator I = HeaderList.begin(),
-        E = HeaderList.end();
-        I != E; ++I) {
-      if (*I == CanonicalPath)
-        return true;
-    }
-    return false;
+    return HeaderList.count(getCanonicalPath(HeaderPath));
   }
 
   // Get the handle of a header file entry.
   // Return HeaderHandleInvalid if not found.
   HeaderHandle findHeaderHandle(llvm::StringRef HeaderPath) const {
-    std::string CanonicalPath = getCanonicalPath(HeaderPath);
-    HeaderHandle H = 0;
-    for (auto I = HeaderPaths.begin(), E = HeaderPaths.end(); I != E;
-         ++I, ++H) {
-      if (**I == CanonicalPath)
-        return H;
-    }
-    return HeaderHandleInvalid;
+    auto I = HeaderHandles.find(getCanonicalPath(HeaderPath));
+    if (I == HeaderHandles.end())
+      return HeaderHandleInvalid;
+    return I->second;
   }
 
   // Add a new header file entry, or return existing handle.
@@ -965,6 +1020,7 @@ public:
     if (H == HeaderHandleInvalid) {
       H = HeaderPaths.size();
       HeaderPaths.push_back(addString(CanonicalPath));
+      HeaderHandles[CanonicalPath] = H;
     }
     return H;
   }
@@ -976,6 +1032,20 @@ public:
     return StringHandle();
   }
 
+  // Return a header file path given its handle, empty for an invalid handle,
+  // as recorded in a summary.
+  std::string getHeaderFilePathString(HeaderHandle H) const {
+    StringHandle Path = getHeaderFilePath(H);
+    return Path ? std::string(*Path) : std::string();
+  }
+
+  // Return the handle of a header recorded in a summary.
+  HeaderHandle addRecordedHeader(llvm::StringRef HeaderPath) {
+    if (HeaderPath.empty())
+      return HeaderHandleInvalid;
+    return addHeader(HeaderPath);
+  }
+
   // Returns a handle to the inclusion path.
   InclusionPathHandle pushHeaderHandle(HeaderHandle H) {
     HeaderStack.push_back(H);
@@ -1009,13 +1079,10 @@ public:
   // Return InclusionPathHandleInvalid if not found.
   InclusionPathHandle
   findInclusionPathHandle(const std::vector<HeaderHandle> &Path) const {
-    InclusionPathHandle H = 0;
-    for (auto I = InclusionPaths.begin(), E = InclusionPaths.end(); I != E;
-         ++I, ++H) {
-      if (I->Path == Path)
-        return H;
-    }
-    return HeaderHandleInvalid;
+    auto I = InclusionPathLookup.find(Path);
+    if (I == InclusionPathLookup.end())
+      return HeaderHandleInvalid;
+    return I->second;
   }
   // Add a new header inclusion path entry, or return existing handle.
   // Return the header inclusion path entry handle.
@@ -1025,6 +1092,7 @@ public:
     if (H == HeaderHandleInvalid) {
       H = InclusionPaths.size();
       InclusionPaths.push_back(HeaderInclusionPath(Path));
+      InclusionPathLookup[Path] = H;
     }
     return H;
   }
@@ -1042,6 +1110,72 @@ public:
     return Empty;
   }
 
+  // Convert an inclusion path to the header paths recorded in a summary.
+  std::vector<std::string> getRecordedInclusionPath(InclusionPathHandle H) {
+    std::vector<std::string> Path;
+    for (HeaderHandle Header : getInclusionPath(H))
+      Path.push_back(getHeaderFilePathString(Header));
+    return Path;
+  }
+
+  // Convert the header paths of an inclusion path recorded in a summary back
+  // to a handle.
+  InclusionPathHandle
+  addRecordedInclusionPath(const std::vector<std::string> &RecordedPath) {
+    std::vector<HeaderHandle> Path;
+    for (const std::string &Header : RecordedPath)
+      Path.push_back(addRecordedHeader(Header));
+    return addInclusionPathHandle(Path);
+  }
+
+  void recordInto(HeaderSummary *Summary) override {
+    Recording = Summary;
+    RecordedHeaders.clear();
+  }
+
+  // Record a header entered by the preprocessor the first time.
+  void recordHeader(HeaderHandle H) {
+    if (Recording && RecordedHeaders.insert(H).second)
+      Recording->Headers.push_back(getHeaderFilePathString(H));
+  }
+
+  void replay(const HeaderSummary &Summary) override {
+    // Add the headers first, so that the handles, and thus the order of the
+    // reports, are the same as when compiling the header.
+    for (const std::string &Header : Summary.Headers)
+      addHeader(Header);
+    for (const HeaderSummary::MacroExpansion &M : Summary.MacroExpansions) {
+      StringHandle MacroName = addString(M.Name);
+      HeaderHandle H = addRecordedHeader(M.File);
+      PPItemKey InstanceKey(MacroName, H, M.Line, M.Column);
+      PPItemKey DefinitionKey(MacroName, H, M.DefinitionLine,
+                              M.DefinitionColumn);
+      trackMacroExpansion(
+          InstanceKey, DefinitionKey, M.Unexpanded, M.Expanded,
+          [&] { return addString(M.DefinitionSourceLine); },
+          [&] { return addString(M.InstanceSourceLine); },
+          addRecordedInclusionPath(M.InclusionPath));
+    }
+    for (const HeaderSummary::Conditional &C : Summary.Conditionals) {
+      PPItemKey InstanceKey(addString(C.Unexpanded),
+                            addRecordedHeader(C.File), C.Line, C.Column);
+      trackConditional(
+          InstanceKey, clang::tok::PPKeywordKind(C.DirectiveKind),
+          clang::PPCallbacks::ConditionValueKind(C.Value),
+          addRecordedInclusionPath(C.InclusionPath));
+    }
+  }
+
+  // Get the source line string of a macro definition, formatted once per
+  // definition in the current compilation.
+  StringHandle getDefinitionSourceLine(clang::Preprocessor &PP,
+                                       clang::SourceLocation DefinitionLoc) {
+    StringHandle &Line = DefinitionSourceLines[DefinitionLoc.getRawEncoding()];
+    if (!Line)
+      Line = addString(getSourceLocationAndLine(PP, DefinitionLoc));
+    return Line;
+  }
+
   // Add a macro expansion instance.
   void addMacroExpansionInstance(clang::Preprocessor &PP, HeaderHandle H,
                                  clang::SourceLocation InstanceLoc,
@@ -1055,19 +1189,44 @@ public:
     StringHandle MacroName = addString(II->getName());
     PPItemKey InstanceKey(PP, MacroName, H, InstanceLoc);
     PPItemKey DefinitionKey(PP, MacroName, H, DefinitionLoc);
+    if (Recording) {
+      // The source lines can't be formatted on replay, so record them now.
+      HeaderSummary::MacroExpansion M;
+      M.File = getHeaderFilePathString(H);
+      M.Line = InstanceKey.Line;
+      M.Column = InstanceKey.Column;
+      M.Name = II->getName();
+      M.DefinitionLine = DefinitionKey.Line;
+      M.DefinitionColumn = DefinitionKey.Column;
+      M.Unexpanded = MacroUnexpanded;
+      M.Expanded = MacroExpanded;
+      M.DefinitionSourceLine = *getDefinitionSourceLine(PP, DefinitionLoc);
+      M.InstanceSourceLine = getSourceLocationAndLine(PP, InstanceLoc);
+      M.InclusionPath = getRecordedInclusionPath(InclusionPathHandle);
+      Recording->MacroExpansions.push_back(std::move(M));
+      return;
+    }
+    trackMacroExpansion(
+        InstanceKey, DefinitionKey, MacroUnexpanded, MacroExpanded,
+        [&] { return getDefinitionSourceLine(PP, DefinitionLoc); },
+        [&] { return addString(getSourceLocationAndLine(PP, InstanceLoc)); },
+        InclusionPathHandle);
+  }
+
+  // Track a macro expansion instance. The source lines are only formatted
+  // when needed.
+  void trackMacroExpansion(
+      PPItemKey &InstanceKey, PPItemKey &DefinitionKey,
+      llvm::StringRef MacroUnexpanded, llvm::StringRef MacroExpanded,
+      llvm::function_ref<StringHandle()> GetDefinitionSourceLine,
+      llvm::function_ref<StringHandle()> GetInstanceSourceLine,
+      InclusionPathHandle InclusionPathHandle) {
     auto I = MacroExpansions.find(InstanceKey);
     // If existing instance of expansion not found, add one.
     if (I == MacroExpansions.end()) {
-      std::string InstanceSourceLine =
-          getSourceLocationString(PP, InstanceLoc) + ":\n" +
-          getSourceLine(PP, InstanceLoc) + "\n";
-      std::string DefinitionSourceLine =
-          getSourceLocationString(PP, DefinitionLoc) + ":\n" +
-          getSourceLine(PP, DefinitionLoc) + "\n";
       MacroExpansions[InstanceKey] = MacroExpansionTracker(
-          addString(MacroUnexpanded), addString(MacroExpanded),
-          addString(InstanceSourceLine), DefinitionKey,
-          addString(DefinitionSourceLine), InclusionPathHandle);
+          addString(MacroUnexpanded), addString(MacroExpanded), DefinitionKey,
+          GetDefinitionSourceLine(), InclusionPathHandle);
     } else {
       // We've seen the macro before.  Get its tracker.
       MacroExpansionTracker &CondTracker = I->second;
@@ -1079,13 +1238,13 @@ public:
       if (MacroInfo)
         MacroInfo->addInclusionPathHandle(InclusionPathHandle);
       else {
-        // Otherwise add a new instance with the unique value.
-        std::string DefinitionSourceLine =
-            getSourceLocationString(PP, DefinitionLoc) + ":\n" +
-            getSourceLine(PP, DefinitionLoc) + "\n";
+        // Otherwise add a new instance with the unique value, which is a
+        // mismatch to report.
         CondTracker.addMacroExpansionInstance(
-            addString(MacroExpanded), DefinitionKey,
-            addString(DefinitionSourceLine), InclusionPathHandle);
+            addString(MacroExpanded), DefinitionKey, GetDefinitionSourceLine(),
+            InclusionPathHandle);
+        if (!CondTracker.InstanceSourceLine)
+          CondTracker.InstanceSourceLine = GetInstanceSourceLine();
       }
     }
   }
@@ -1103,15 +1262,33 @@ public:
       return;
     StringHandle ConditionUnexpandedHandle(addString(ConditionUnexpanded));
     PPItemKey InstanceKey(PP, ConditionUnexpandedHandle, H, InstanceLoc);
+    if (Recording) {
+      HeaderSummary::Conditional C;
+      C.File = getHeaderFilePathString(H);
+      C.Line = InstanceKey.Line;
+      C.Column = InstanceKey.Column;
+      C.DirectiveKind = DirectiveKind;
+      C.Value = ConditionValue;
+      C.Unexpanded = ConditionUnexpanded;
+      C.InclusionPath = getRecordedInclusionPath(InclusionPathHandle);
+      Recording->Conditionals.push_back(std::move(C));
+      return;
+    }
+    trackConditional(InstanceKey, DirectiveKind, ConditionValue,
+                     InclusionPathHandle);
+  }
+
+  // Track a conditional expansion instance.
+  void trackConditional(const PPItemKey &InstanceKey,
+                        clang::tok::PPKeywordKind DirectiveKind,
+                        clang::PPCallbacks::ConditionValueKind ConditionValue,
+                        InclusionPathHandle InclusionPathHandle) {
     auto I = ConditionalExpansions.find(InstanceKey);
     // If existing instance of condition not found, add one.
     if (I == ConditionalExpansions.end()) {
-      std::string InstanceSourceLine =
-          getSourceLocationString(PP, InstanceLoc) + ":\n" +
-          getSourceLine(PP, InstanceLoc) + "\n";
       ConditionalExpansions[InstanceKey] =
-          ConditionalTracker(DirectiveKind, ConditionValue,
-                             ConditionUnexpandedHandle, InclusionPathHandle);
+          ConditionalTracker(DirectiveKind, ConditionValue, InstanceKey.Name,
+                             InclusionPathHandle);
     } else {
       // We've seen the conditional before.  Get its tracker.
       ConditionalTracker &CondTracker = I->second;
@@ -1134,8 +1311,7 @@ public:
   bool reportInconsistentMacros(llvm::raw_ostream &OS) override {
     bool ReturnValue = false;
     // Walk all the macro expansion trackers in the map.
-    for (auto I = MacroExpansions.begin(), E = MacroExpansions.end(); I != E;
-         ++I) {
+    for (auto *I : getSortedEntries(MacroExpansions)) {
       const PPItemKey &ItemKey = I->first;
       MacroExpansionTracker &MacroExpTracker = I->second;
       // If no mismatch (only one instance value) continue.
@@ -1192,9 +1368,7 @@ public:
   bool reportInconsistentConditionals(llvm::raw_ostream &OS) override {
     bool ReturnValue = false;
     // Walk all the conditional trackers in the map.
-    for (auto I = ConditionalExpansions.begin(),
-              E = ConditionalExpansions.end();
-         I != E; ++I) {
+    for (auto *I : getSortedEntries(ConditionalExpansions)) {
       const PPItemKey &ItemKey = I->first;
       ConditionalTracker &CondTracker = I->second;
       if (!CondTracker.hasMismatch())
@@ -1253,19 +1427,27 @@ public:
   }
 
 private:
-  llvm::SmallVector<std::string, 32> HeaderList;
+  llvm::StringSet<> HeaderList;
   // Only do extern, namespace check for headers in HeaderList.
   bool BlockCheckHeaderListOnly;
   llvm::StringPool Strings;
   std::vector<StringHandle> HeaderPaths;
+  llvm::StringMap<HeaderHandle> HeaderHandles;
   std::vector<HeaderHandle> HeaderStack;
   std::vector<HeaderInclusionPath> InclusionPaths;
+  InclusionPathMap InclusionPathLookup;
   InclusionPathHandle CurrentInclusionPathHandle;
   llvm::SmallSet<HeaderHandle, 32> HeadersInThisCompile;
   std::vector<PPItemKey> IncludeDirectives;
   MacroExpansionMap MacroExpansions;
   ConditionalExpansionMap ConditionalExpansions;
+  // The macro definition source lines of the current compilation.
+  llvm::DenseMap<unsigned, StringHandle> DefinitionSourceLines;
   bool InNestedHeader;
+  // The summary the preprocessing sessions are recorded in, if any, and the
+  // headers recorded in it.
+  HeaderSummary *Recording;
+  llvm::DenseSet<HeaderHandle> RecordedHeaders;
 };
 
 } // namespace
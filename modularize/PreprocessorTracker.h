@@ -19,6 +19,8 @@
 
 namespace Modularize {
 
+struct HeaderSummary;
+
 /// \brief Preprocessor tracker for modularize.
 ///
 /// The PreprocessorTracker class defines an API for
@@ -39,6 +41,10 @@ namespace Modularize {
 /// functions respectively.  The handlePreprocessorExit informs the
 /// implementation that a preprocessing session is complete, allowing
 /// it to do any needed compilation completion activities in the checker.
+///
+/// With a persistent HeaderCache, the macro expansions and conditionals of
+/// each header are recorded in its HeaderSummary instead, and replayed in
+/// the order of the header list, whether they come from the cache or not.
 class PreprocessorTracker {
 public:
   virtual ~PreprocessorTracker();
@@ -68,6 +74,15 @@ public:
                                        const char *BlockIdentifierMessage,
                                        llvm::raw_ostream &OS) = 0;
 
+  // Record the macro expansions and conditionals of the following
+  // preprocessing sessions, and the headers they enter, in Summary instead of
+  // tracking them. Recording stops when called with nullptr.
+  virtual void recordInto(HeaderSummary *Summary) = 0;
+
+  // Track the macro expansions and conditionals recorded in a summary, as if
+  // its header was preprocessed again.
+  virtual void replay(const HeaderSummary &Summary) = 0;
+
   // Report on inconsistent macro instances.
   // Returns true if any mismatches.
   virtual bool reportInconsistentMacros(llvm::raw_ostream &OS) = 0;
@@ -87,14 +87,26 @@ static const char *const MappingStrings[] = { "0",          "MAP_IGNORE",
                                               "MAP_REMARK", "MAP_WARNING",
                                               "MAP_ERROR",  "MAP_FATAL" };
 
+// Trace output functions.
+
+// Write a callback call as an item of the YAML trace sequence.
+void writeCallbackCall(const CallbackCall &Callback, llvm::raw_ostream &OS) {
+  OS << "- Callback: " << Callback.Name << "\n";
+  for (const Argument &Arg : Callback.Arguments)
+    OS << "  " << Arg.Name << ": " << Arg.Value << "\n";
+}
+
 // PPCallbacksTracker functions.
 
 PPCallbacksTracker::PPCallbacksTracker(llvm::SmallSet<std::string, 4> &Ignore,
                                        std::vector<CallbackCall> &CallbackCalls,
-                                       clang::Preprocessor &PP)
-    : CallbackCalls(CallbackCalls), Ignore(Ignore), PP(PP) {}
+                                       clang::Preprocessor &PP,
+                                       llvm::raw_ostream *StreamOS)
+    : CallbackCalls(CallbackCalls), Ignore(Ignore), DisableTrace(false),
+      PP(PP), StreamOS(StreamOS) {}
 
-PPCallbacksTracker::~PPCallbacksTracker() {}
+// The preprocessor destroys the tracker once it's done, write the last call.
+PPCallbacksTracker::~PPCallbacksTracker() { flushCallbacks(); }
 
 // Callback functions.
 
@@ -271,6 +283,8 @@ void PPCallbacksTracker::PragmaWarning(clang::SourceLocation Loc,
   beginCallback("PragmaWarning");
   appendArgument("Loc", Loc);
   appendArgument("WarningSpec", WarningSpec);
+  if (DisableTrace)
+    return;
 
   std::string Str;
   llvm::raw_string_ostream SS(Str);
@@ -410,12 +424,23 @@ void PPCallbacksTracker::Endif(clang::SourceLocation Loc,
 
 // Start a new callback.
 void PPCallbacksTracker::beginCallback(const char *Name) {
-  DisableTrace = Ignore.count(std::string(Name));
+  DisableTrace = !Ignore.empty() && Ignore.count(std::string(Name));
   if (DisableTrace)
     return;
+  // The previous call is complete.
+  flushCallbacks();
   CallbackCalls.push_back(CallbackCall(Name));
 }
 
+// Write the traced calls to the output stream.
+void PPCallbacksTracker::flushCallbacks() {
+  if (!StreamOS)
+    return;
+  for (const CallbackCall &Callback : CallbackCalls)
+    writeCallbackCall(Callback, *StreamOS);
+  CallbackCalls.clear();
+}
+
 // Append a bool argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name, bool Value) {
   appendArgument(Name, (Value ? "true" : "false"));
@@ -423,6 +448,8 @@ void PPCallbacksTracker::appendArgument(const char *Name, bool Value) {
 
 // Append an int argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name, int Value) {
+  if (DisableTrace)
+    return;
   std::string Str;
   llvm::raw_string_ostream SS(Str);
   SS << Value;
@@ -439,6 +466,8 @@ void PPCallbacksTracker::appendArgument(const char *Name, const char *Value) {
 // Append a string object argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         llvm::StringRef Value) {
+  if (DisableTrace)
+    return;
   appendArgument(Name, Value.str());
 }
 
@@ -451,6 +480,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a token argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         const clang::Token &Value) {
+  if (DisableTrace)
+    return;
   appendArgument(Name, PP.getSpelling(Value));
 }
 
@@ -462,6 +493,8 @@ void PPCallbacksTracker::appendArgument(const char *Name, int Value,
 
 // Append a FileID argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name, clang::FileID Value) {
+  if (DisableTrace)
+    return;
   if (Value.isInvalid()) {
     appendArgument(Name, "(invalid)");
     return;
@@ -478,6 +511,8 @@ void PPCallbacksTracker::appendArgument(const char *Name, clang::FileID Value) {
 // Append a FileEntry argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         const clang::FileEntry *Value) {
+  if (DisableTrace)
+    return;
   if (!Value) {
     appendArgument(Name, "(null)");
     return;
@@ -488,6 +523,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a SourceLocation argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         clang::SourceLocation Value) {
+  if (DisableTrace)
+    return;
   if (Value.isInvalid()) {
     appendArgument(Name, "(invalid)");
     return;
@@ -514,6 +551,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a CharSourceRange argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         clang::CharSourceRange Value) {
+  if (DisableTrace)
+    return;
   if (Value.isInvalid()) {
     appendArgument(Name, "(invalid)");
     return;
@@ -543,6 +582,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append an IdentifierInfo argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         const clang::IdentifierInfo *Value) {
+  if (DisableTrace)
+    return;
   if (!Value) {
     appendArgument(Name, "(null)");
     return;
@@ -563,6 +604,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a MacroDefinition argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         const clang::MacroDefinition &Value) {
+  if (DisableTrace)
+    return;
   std::string Str;
   llvm::raw_string_ostream SS(Str);
   SS << "[";
@@ -582,6 +625,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a MacroArgs argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         const clang::MacroArgs *Value) {
+  if (DisableTrace)
+    return;
   if (!Value) {
     appendArgument(Name, "(null)");
     return;
@@ -620,6 +665,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a Module argument to the top trace item.
 void PPCallbacksTracker::appendArgument(const char *Name,
                                         const clang::Module *Value) {
+  if (DisableTrace)
+    return;
   if (!Value) {
     appendArgument(Name, "(null)");
     return;
@@ -630,6 +677,8 @@ void PPCallbacksTracker::appendArgument(const char *Name,
 // Append a double-quoted argument to the top trace item.
 void PPCallbacksTracker::appendQuotedArgument(const char *Name,
                                               const std::string &Value) {
+  if (DisableTrace)
+    return;
   std::string Str;
   llvm::raw_string_ostream SS(Str);
   SS << "\"" << Value << "\"";
@@ -639,6 +688,8 @@ void PPCallbacksTracker::appendQuotedArgument(const char *Name,
 // Append a double-quoted file path argument to the top trace item.
 void PPCallbacksTracker::appendFilePathArgument(const char *Name,
                                                 llvm::StringRef Value) {
+  if (DisableTrace)
+    return;
   std::string Path(Value);
   // YAML treats backslash as escape, so use forward slashes.
   std::replace(Path.begin(), Path.end(), '\\', '/');
@@ -15,7 +15,7 @@
 /// and collects information about each callback call, saving it in a
 /// data structure built up of CallbackCall and Argument objects, which
 /// record the preprocessor callback name and arguments in high-level string
-/// form for later inspection.
+/// form for later inspection, or write them to a stream as they are traced.
 ///
 //===----------------------------------------------------------------------===//
 
@@ -28,6 +28,7 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
 #include <string>
 #include <vector>
 
@@ -54,6 +55,9 @@ public:
   std::vector<Argument> Arguments;
 };
 
+/// \brief Write a callback call as an item of the YAML trace sequence.
+void writeCallbackCall(const CallbackCall &Callback, llvm::raw_ostream &OS);
+
 /// \brief This class overrides the PPCallbacks class for tracking preprocessor
 ///   activity by means of its callback functions.
 ///
@@ -65,7 +69,11 @@ public:
 ///
 /// This class supports a mechanism for inhibiting trace output for
 /// specific callbacks by name, for the purpose of eliminating output for
-/// callbacks of no interest that might clutter the output.
+/// callbacks of no interest that might clutter the output.  The arguments
+/// of the ignored callbacks aren't converted to strings.
+///
+/// When given an output stream, each callback call is written to it as soon
+/// as it is complete, instead of keeping the whole trace in the vector.
 ///
 /// Following the constructor and destructor function declarations, the
 /// overidden callback functions are defined.  The remaining functions are
@@ -78,9 +86,12 @@ public:
   /// \param Ignore - Set of names of callbacks to ignore.
   /// \param CallbackCalls - Trace buffer.
   /// \param PP - The preprocessor.  Needed for getting some argument strings.
+  /// \param StreamOS - The stream to write the calls to as they are traced,
+  /// or null to keep them in the trace buffer.
   PPCallbacksTracker(llvm::SmallSet<std::string, 4> &Ignore,
                      std::vector<CallbackCall> &CallbackCalls,
-                     clang::Preprocessor &PP);
+                     clang::Preprocessor &PP,
+                     llvm::raw_ostream *StreamOS = nullptr);
 
   ~PPCallbacksTracker() override;
 
@@ -166,6 +177,10 @@ public:
   /// \brief Start a new callback.
   void beginCallback(const char *Name);
 
+  /// \brief Write the traced calls to the output stream, if any, and remove
+  /// them from the trace buffer.
+  void flushCallbacks();
+
   /// \brief Append a string to the top trace item.
   void append(const char *Str);
 
@@ -244,6 +259,9 @@ public:
   bool DisableTrace;
 
   clang::Preprocessor &PP;
+
+  /// \brief Stream the calls are written to as they are traced, if any.
+  llvm::raw_ostream *StreamOS;
 };
 
 #endif // PPTRACE_PPCALLBACKSTRACKER_H
@@ -0,0 +1,175 @@
+//===--- PPProfiler.cpp - Preprocessor profiler ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Implementations for preprocessor profiling.
+///
+/// See the header for details.
+///
+//===----------------------------------------------------------------------===//
+
+#include "PPProfiler.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+
+// Utility functions.
+
+// Get the path of a file as output, with forward slashes since YAML treats
+// backslash as escape.
+static std::string getOutputPath(llvm::StringRef Path) {
+  std::string Result(Path);
+  std::replace(Result.begin(), Result.end(), '\\', '/');
+  return Result;
+}
+
+// PPProfile functions.
+
+// Output the profile of the files and macros.
+void PPProfile::writeReport(llvm::raw_ostream &OS) const {
+  std::vector<const llvm::StringMapEntry<FileProfile> *> SortedFiles;
+  for (const auto &File : Files)
+    SortedFiles.push_back(&File);
+  std::sort(SortedFiles.begin(), SortedFiles.end(),
+            [](const llvm::StringMapEntry<FileProfile> *F1,
+               const llvm::StringMapEntry<FileProfile> *F2) {
+              if (F1->getValue().ExclusiveTime != F2->getValue().ExclusiveTime)
+                return F1->getValue().ExclusiveTime >
+                       F2->getValue().ExclusiveTime;
+              return F1->getKey() < F2->getKey();
+            });
+
+  std::vector<const llvm::StringMapEntry<uint64_t> *> SortedMacros;
+  for (const auto &Macro : MacroExpansions)
+    SortedMacros.push_back(&Macro);
+  std::sort(SortedMacros.begin(), SortedMacros.end(),
+            [](const llvm::StringMapEntry<uint64_t> *M1,
+               const llvm::StringMapEntry<uint64_t> *M2) {
+              if (M1->getValue() != M2->getValue())
+                return M1->getValue() > M2->getValue();
+              return M1->getKey() < M2->getKey();
+            });
+
+  // Mark start of document.
+  OS << "---\n";
+
+  OS << "Files:\n";
+  for (const auto *File : SortedFiles) {
+    const FileProfile &Profile = File->getValue();
+    OS << "  - File: \"" << getOutputPath(File->getKey()) << "\"\n";
+    OS << "    Inclusions: " << Profile.Inclusions << "\n";
+    OS << "    InclusiveTime: " << llvm::format("%.6f", Profile.InclusiveTime)
+       << "\n";
+    OS << "    ExclusiveTime: " << llvm::format("%.6f", Profile.ExclusiveTime)
+       << "\n";
+    OS << "    InclusiveTokens: " << Profile.InclusiveTokens << "\n";
+    OS << "    ExclusiveTokens: " << Profile.ExclusiveTokens << "\n";
+  }
+
+  OS << "Macros:\n";
+  for (const auto *Macro : SortedMacros) {
+    OS << "  - Macro: " << Macro->getKey() << "\n";
+    OS << "    Expansions: " << Macro->getValue() << "\n";
+  }
+
+  // Mark end of document.
+  OS << "...\n";
+}
+
+// Output the exclusive time of each include stack as folded stacks.
+void PPProfile::writeFlameGraph(llvm::raw_ostream &OS) const {
+  std::vector<llvm::StringRef> SortedStacks;
+  for (const auto &Stack : Stacks)
+    SortedStacks.push_back(Stack.getKey());
+  std::sort(SortedStacks.begin(), SortedStacks.end());
+  for (llvm::StringRef Stack : SortedStacks)
+    OS << getOutputPath(Stack) << " " << Stacks.lookup(Stack) << "\n";
+}
+
+// PPProfiler functions.
+
+PPProfiler::PPProfiler(PPProfile &Profile, clang::Preprocessor &PP)
+    : Profile(Profile), PP(PP) {}
+
+PPProfiler::~PPProfiler() {}
+
+// Callback functions.
+
+// Callback invoked whenever a source file is entered or exited.
+void PPProfiler::FileChanged(clang::SourceLocation Loc,
+                             clang::PPCallbacks::FileChangeReason Reason,
+                             clang::SrcMgr::CharacteristicKind FileType,
+                             clang::FileID PrevFID) {
+  switch (Reason) {
+  case EnterFile: {
+    // Use the name of the buffer rather than the one of the line markers.
+    clang::PresumedLoc PLoc =
+        PP.getSourceManager().getPresumedLoc(Loc, /*UseLineDirectives=*/false);
+    pushFrame(PLoc.isValid() ? PLoc.getFilename() : "(invalid)");
+    break;
+  }
+  case ExitFile:
+    // The main file is never exited.
+    if (Frames.size() > 1)
+      popFrame();
+    break;
+  case SystemHeaderPragma:
+  case RenameFile:
+    break;
+  }
+}
+
+// Called by Preprocessor::HandleMacroExpandedIdentifier when a
+// macro invocation is found.
+void PPProfiler::MacroExpands(const clang::Token &MacroNameTok,
+                              const clang::MacroDefinition &MD,
+                              clang::SourceRange Range,
+                              const clang::MacroArgs *Args) {
+  ++Profile.MacroExpansions[MacroNameTok.getIdentifierInfo()->getName()];
+}
+
+// Callback invoked when the end of the main file is reached.
+void PPProfiler::EndOfMainFile() {
+  while (!Frames.empty())
+    popFrame();
+}
+
+// Helper functions.
+
+// Enter a file.
+void PPProfiler::pushFrame(llvm::StringRef Path) {
+  Frame F;
+  F.Profile = &Profile.Files[Path];
+  F.Stack = Frames.empty() ? Path.str()
+                           : (Frames.back().Stack + ";" + Path).str();
+  F.ChildTime = 0;
+  F.ChildTokens = 0;
+  F.Tokens = 0;
+  // Start the clock last, to leave the bookkeeping out of the time.
+  F.Start = Clock::now();
+  Frames.push_back(std::move(F));
+}
+
+// Exit the current file.
+void PPProfiler::popFrame() {
+  Frame &F = Frames.back();
+  double Time = std::chrono::duration<double>(Clock::now() - F.Start).count();
+  double ExclusiveTime = std::max(Time - F.ChildTime, 0.0);
+  uint64_t Tokens = F.Tokens + F.ChildTokens;
+  ++F.Profile->Inclusions;
+  F.Profile->InclusiveTime += Time;
+  F.Profile->ExclusiveTime += ExclusiveTime;
+  F.Profile->InclusiveTokens += Tokens;
+  F.Profile->ExclusiveTokens += F.Tokens;
+  Profile.Stacks[F.Stack] += static_cast<uint64_t>(ExclusiveTime * 1e6);
+  Frames.pop_back();
+  if (!Frames.empty()) {
+    Frames.back().ChildTime += Time;
+    Frames.back().ChildTokens += Tokens;
+  }
+}
@@ -0,0 +1,131 @@
+//===--- PPProfiler.h - Preprocessor profiling ------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// \brief Classes and definitions for preprocessor profiling.
+///
+/// The PPProfiler class, derived from Clang's PPCallbacks class like
+/// PPCallbacksTracker, follows the files entered and exited by the
+/// preprocessor to attribute the preprocessing wall time and the lexed tokens
+/// to each included file, and counts the expansions of each macro. The
+/// results are accumulated in a PPProfile object over all the translation
+/// units, which outputs them as a YAML report or as folded stacks for the
+/// flame graph tools.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef PPTRACE_PPPROFILER_H
+#define PPTRACE_PPPROFILER_H
+
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// \brief The preprocessing profile of one file, over all its inclusions.
+///
+/// The inclusive values include the files it includes, the exclusive ones
+/// don't.
+class FileProfile {
+public:
+  unsigned Inclusions = 0;
+  double InclusiveTime = 0;
+  double ExclusiveTime = 0;
+  uint64_t InclusiveTokens = 0;
+  uint64_t ExclusiveTokens = 0;
+};
+
+/// \brief The preprocessing profile of the traced translation units.
+class PPProfile {
+public:
+  /// \brief Output the profile of the files and macros in a YAML format, the
+  /// most expensive first.
+  void writeReport(llvm::raw_ostream &OS) const;
+
+  /// \brief Output the exclusive time of each include stack in microseconds,
+  /// in the folded stacks format of the flame graph tools, i.e.:
+  ///   main.cpp;a.h;b.h 1234
+  void writeFlameGraph(llvm::raw_ostream &OS) const;
+
+  /// \brief File profiles by file path.
+  llvm::StringMap<FileProfile> Files;
+
+  /// \brief Expansion counts by macro name.
+  llvm::StringMap<uint64_t> MacroExpansions;
+
+  /// \brief Exclusive times in microseconds by include stack.
+  llvm::StringMap<uint64_t> Stacks;
+};
+
+/// \brief This class overrides the PPCallbacks class for profiling the
+///   preprocessing of a translation unit.
+///
+/// The tokens aren't seen by the callbacks: whoever runs the preprocessor
+/// calls countToken for each token it lexes, which is attributed to the file
+/// being preprocessed.
+class PPProfiler : public clang::PPCallbacks {
+public:
+  /// \param Profile - The profile to accumulate the results in, owned by the
+  /// caller.
+  /// \param PP - The preprocessor.
+  PPProfiler(PPProfile &Profile, clang::Preprocessor &PP);
+
+  ~PPProfiler() override;
+
+  // Overidden callback functions.
+
+  void FileChanged(clang::SourceLocation Loc,
+                   clang::PPCallbacks::FileChangeReason Reason,
+                   clang::SrcMgr::CharacteristicKind FileType,
+                   clang::FileID PrevFID = clang::FileID()) override;
+  void MacroExpands(const clang::Token &MacroNameTok,
+                    const clang::MacroDefinition &MD, clang::SourceRange Range,
+                    const clang::MacroArgs *Args) override;
+  void EndOfMainFile() override;
+
+  /// \brief Count a token lexed in the current file.
+  void countToken() {
+    if (!Frames.empty())
+      ++Frames.back().Tokens;
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  /// \brief A file being preprocessed, in the include stack.
+  struct Frame {
+    /// The profile of the file.
+    FileProfile *Profile;
+    /// The include stack down to the file, as "main.cpp;a.h".
+    std::string Stack;
+    Clock::time_point Start;
+    /// The inclusive time and tokens of the files it included.
+    double ChildTime;
+    uint64_t ChildTokens;
+    /// The tokens lexed in the file itself.
+    uint64_t Tokens;
+  };
+
+  /// \brief Enter a file.
+  void pushFrame(llvm::StringRef Path);
+
+  /// \brief Exit the current file, and add its results to its profile.
+  void popFrame();
+
+  PPProfile &Profile;
+  clang::Preprocessor &PP;
+  std::vector<Frame> Frames;
+};
+
+#endif // PPTRACE_PPPROFILER_H
@@ -39,6 +39,19 @@
 //                                  (etc.)
 //                                  ...
 //
+//    -stream                     Write each callback call to the output as
+//                                soon as it is traced, instead of keeping
+//                                the whole trace in memory until the end.
+//
+//    -profile                    Instead of the trace, output the time and
+//                                tokens of each included file and the
+//                                expansion counts of each macro.
+//
+//    -flame-graph (file)         With -profile, also output the time of each
+//                                include stack to the given file, in the
+//                                folded stacks format of the flame graph
+//                                tools.
+//
 // Future Directions:
 //
 // 1. Add option opposite to "-ignore" that specifys a comma-separated option
@@ -47,6 +60,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "PPCallbacksTracker.h"
+#include "PPProfiler.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/RecursiveASTVisitor.h"
@@ -93,6 +107,26 @@ static cl::opt<std::string> OutputFileName(
     "output", cl::init(""),
     cl::desc("Output trace to the given file name or '-' for stdout."));
 
+// Option to write the trace as the callbacks are called.
+static cl::opt<bool> Stream(
+    "stream", cl::init(false),
+    cl::desc("Write each callback call as soon as it is traced, instead of\n"
+             "keeping the whole trace in memory until the end."));
+
+// Option to profile the preprocessing instead of tracing it.
+static cl::opt<bool> ProfilePreprocessing(
+    "profile", cl::init(false),
+    cl::desc("Output the preprocessing time and tokens of each included\n"
+             "file and the expansion counts of each macro, instead of the\n"
+             "trace."));
+
+// Option to specify the flame graph output file name.
+static cl::opt<std::string> FlameGraphFileName(
+    "flame-graph", cl::init(""),
+    cl::desc("With -profile, output the time of each include stack to the\n"
+             "given file name, in the folded stacks format of the flame\n"
+             "graph tools."));
+
 // Collect all other arguments, which will be passed to the front end.
 static cl::list<std::string>
     CC1Arguments(cl::ConsumeAfter,
@@ -105,47 +139,122 @@ namespace {
 class PPTraceConsumer : public ASTConsumer {
 public:
   PPTraceConsumer(SmallSet<std::string, 4> &Ignore,
-                  std::vector<CallbackCall> &CallbackCalls, Preprocessor &PP) {
+                  std::vector<CallbackCall> &CallbackCalls, Preprocessor &PP,
+                  raw_ostream *StreamOS) {
     // PP takes ownership.
-    PP.addPPCallbacks(llvm::make_unique<PPCallbacksTracker>(Ignore,
-                                                            CallbackCalls, PP));
+    PP.addPPCallbacks(llvm::make_unique<PPCallbacksTracker>(
+        Ignore, CallbackCalls, PP, StreamOS));
   }
 };
 
 class PPTraceAction : public SyntaxOnlyAction {
 public:
   PPTraceAction(SmallSet<std::string, 4> &Ignore,
-                std::vector<CallbackCall> &CallbackCalls)
-      : Ignore(Ignore), CallbackCalls(CallbackCalls) {}
+                std::vector<CallbackCall> &CallbackCalls,
+                raw_ostream *StreamOS)
+      : Ignore(Ignore), CallbackCalls(CallbackCalls), StreamOS(StreamOS) {}
 
 protected:
   std::unique_ptr<clang::ASTConsumer>
   CreateASTConsumer(CompilerInstance &CI, StringRef InFile) override {
     return llvm::make_unique<PPTraceConsumer>(Ignore, CallbackCalls,
-                                              CI.getPreprocessor());
+                                              CI.getPreprocessor(), StreamOS);
   }
 
 private:
   SmallSet<std::string, 4> &Ignore;
   std::vector<CallbackCall> &CallbackCalls;
+  raw_ostream *StreamOS;
 };
 
 class PPTraceFrontendActionFactory : public FrontendActionFactory {
 public:
   PPTraceFrontendActionFactory(SmallSet<std::string, 4> &Ignore,
-                               std::vector<CallbackCall> &CallbackCalls)
-      : Ignore(Ignore), CallbackCalls(CallbackCalls) {}
+                               std::vector<CallbackCall> &CallbackCalls,
+                               raw_ostream *StreamOS)
+      : Ignore(Ignore), CallbackCalls(CallbackCalls), StreamOS(StreamOS) {}
 
   PPTraceAction *create() override {
-    return new PPTraceAction(Ignore, CallbackCalls);
+    return new PPTraceAction(Ignore, CallbackCalls, StreamOS);
   }
 
 private:
   SmallSet<std::string, 4> &Ignore;
   std::vector<CallbackCall> &CallbackCalls;
+  raw_ostream *StreamOS;
+};
+
+// Preprocesses the source without parsing it, to profile the preprocessing.
+class PPProfileAction : public PreprocessorFrontendAction {
+public:
+  PPProfileAction(PPProfile &Profile) : Profile(Profile) {}
+
+protected:
+  void ExecuteAction() override {
+    Preprocessor &PP = getCompilerInstance().getPreprocessor();
+    auto Profiler = llvm::make_unique<PPProfiler>(Profile, PP);
+    PPProfiler &P = *Profiler;
+    // PP takes ownership.
+    PP.addPPCallbacks(std::move(Profiler));
+
+    // Ignore unknown pragmas.
+    PP.IgnorePragmas();
+
+    // The callbacks don't see the tokens, count them as they are lexed.
+    Token Tok;
+    PP.EnterMainSourceFile();
+    do {
+      PP.Lex(Tok);
+      if (Tok.isNot(tok::eof))
+        P.countToken();
+    } while (Tok.isNot(tok::eof));
+  }
+
+private:
+  PPProfile &Profile;
+};
+
+class PPProfileFrontendActionFactory : public FrontendActionFactory {
+public:
+  PPProfileFrontendActionFactory(PPProfile &Profile) : Profile(Profile) {}
+
+  PPProfileAction *create() override { return new PPProfileAction(Profile); }
+
+private:
+  PPProfile &Profile;
 };
 } // namespace
 
+// Output the profile, and the flame graph if requested.
+static int outputPPProfile(const PPProfile &Profile) {
+  if (!FlameGraphFileName.empty()) {
+    std::error_code EC;
+    llvm::ToolOutputFile Out(FlameGraphFileName, EC, llvm::sys::fs::F_Text);
+    if (EC) {
+      llvm::errs() << "pp-trace: error creating " << FlameGraphFileName << ":"
+                   << EC.message() << "\n";
+      return 1;
+    }
+    Profile.writeFlameGraph(Out.os());
+    Out.keep();
+  }
+
+  if (!OutputFileName.size()) {
+    Profile.writeReport(llvm::outs());
+    return 0;
+  }
+  std::error_code EC;
+  llvm::ToolOutputFile Out(OutputFileName, EC, llvm::sys::fs::F_Text);
+  if (EC) {
+    llvm::errs() << "pp-trace: error creating " << OutputFileName << ":"
+                 << EC.message() << "\n";
+    return 1;
+  }
+  Profile.writeReport(Out.os());
+  Out.keep();
+  return 0;
+}
+
 // Output the trace given its data structure and a stream.
 static int outputPPTrace(std::vector<CallbackCall> &CallbackCalls,
                          llvm::raw_ostream &OS) {
@@ -154,16 +263,8 @@ static int outputPPTrace(std::vector<CallbackCall> &CallbackCalls,
 
   for (std::vector<CallbackCall>::const_iterator I = CallbackCalls.begin(),
                                                  E = CallbackCalls.end();
-       I != E; ++I) {
-    const CallbackCall &Callback = *I;
-    OS << "- Callback: " << Callback.Name << "\n";
-
-    for (auto AI = Callback.Arguments.begin(), AE = Callback.Arguments.end();
-         AI != AE; ++AI) {
-      const Argument &Arg = *AI;
-      OS << "  " << Arg.Name << ": " << Arg.Value << "\n";
-    }
-  }
+       I != E; ++I)
+    writeCallbackCall(*I, OS);
 
   // Mark end of document.
   OS << "...\n";
@@ -197,9 +298,45 @@ int main(int Argc, const char **Argv) {
   // Store the callback trace information here.
   std::vector<CallbackCall> CallbackCalls;
 
-  // Create the tool and run the compilation.
+  // Create the tool.
   ClangTool Tool(*Compilations, SourcePaths);
-  PPTraceFrontendActionFactory Factory(Ignore, CallbackCalls);
+
+  // In profile mode, the preprocessing is profiled instead of traced.
+  if (ProfilePreprocessing) {
+    PPProfile PreprocessingProfile;
+    PPProfileFrontendActionFactory Factory(PreprocessingProfile);
+    if (int HadErrors = Tool.run(&Factory))
+      return HadErrors;
+    return outputPPProfile(PreprocessingProfile);
+  }
+
+  // In stream mode, the calls are written as the compilation runs.
+  if (Stream) {
+    std::unique_ptr<llvm::ToolOutputFile> Out;
+    if (OutputFileName.size()) {
+      std::error_code EC;
+      Out = llvm::make_unique<llvm::ToolOutputFile>(OutputFileName, EC,
+                                                    llvm::sys::fs::F_Text);
+      if (EC) {
+        llvm::errs() << "pp-trace: error creating " << OutputFileName << ":"
+                     << EC.message() << "\n";
+        return 1;
+      }
+    }
+    raw_ostream &OS = Out ? Out->os() : llvm::outs();
+    OS << "---\n";
+    PPTraceFrontendActionFactory Factory(Ignore, CallbackCalls, &OS);
+    int HadErrors = Tool.run(&Factory);
+    OS << "...\n";
+    // Keep the partial trace of the failed compilations too.
+    if (Out)
+      Out->keep();
+    return HadErrors;
+  }
+
+  // Run the compilation.
+  PPTraceFrontendActionFactory Factory(Ignore, CallbackCalls,
+                                       /*StreamOS=*/nullptr);
   int HadErrors = Tool.run(&Factory);
 
   // If we had errors, exit early.
@@ -0,0 +1,30 @@
+// RUN: rm -rf %t
+// RUN: mkdir -p %t/include
+// RUN: sed 's|$test_dir|%/t|g' %S/Inputs/database_template.json > %t/compile_commands.json
+// RUN: echo 'namespace na {' > %t/include/header.h
+// RUN: echo 'namespace nb {' >> %t/include/header.h
+// RUN: echo 'class A {};' >> %t/include/header.h
+// RUN: echo '} // namespace nb' >> %t/include/header.h
+// RUN: echo '} // namespace na' >> %t/include/header.h
+// RUN: echo '#include "header.h"' > %t/a.cpp
+// RUN: echo 'na::nb::A a;' >> %t/a.cpp
+// RUN: echo '#include "header.h"' > %t/b.cpp
+// RUN: echo 'na::nb::A b;' >> %t/b.cpp
+//
+// Both translation units of the compilation database include the header, its
+// edits are applied once.
+// RUN: clang-change-namespace -executor=all-TUs -p %t -old_namespace "na::nb" -new_namespace "x::y" --file_pattern ".*" -i
+// RUN: FileCheck -input-file=%t/include/header.h -check-prefix=CHECK-HEADER %s
+// RUN: FileCheck -input-file=%t/a.cpp -check-prefix=CHECK-A %s
+// RUN: FileCheck -input-file=%t/b.cpp -check-prefix=CHECK-B %s
+//
+// CHECK-HEADER-NOT: namespace na
+// CHECK-HEADER: namespace x {
+// CHECK-HEADER-NEXT: namespace y {
+// CHECK-HEADER-NEXT: class A {};
+// CHECK-HEADER-NEXT: } // namespace y
+// CHECK-HEADER-NEXT: } // namespace x
+// CHECK-HEADER-NOT: namespace
+//
+// CHECK-A: x::y::A a;
+// CHECK-B: x::y::A b;
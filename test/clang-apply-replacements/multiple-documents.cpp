@@ -0,0 +1,5 @@
+// RUN: mkdir -p %T/Inputs/multiple-documents
+// RUN: grep -Ev "// *[A-Z-]+:" %S/Inputs/basic/basic.h > %T/Inputs/multiple-documents/basic.h
+// RUN: cat %S/Inputs/basic/file1.yaml %S/Inputs/basic/file2.yaml | sed -e "s#\$(path)#%/T/Inputs/multiple-documents#" -e "s#/\.\./basic/#/../multiple-documents/#" > %T/Inputs/multiple-documents/file.yaml
+// RUN: clang-apply-replacements %T/Inputs/multiple-documents
+// RUN: FileCheck -input-file=%T/Inputs/multiple-documents/basic.h %S/Inputs/basic/basic.h
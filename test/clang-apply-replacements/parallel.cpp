@@ -0,0 +1,6 @@
+// RUN: mkdir -p %T/Inputs/parallel
+// RUN: grep -Ev "// *[A-Z-]+:" %S/Inputs/basic/basic.h > %T/Inputs/parallel/basic.h
+// RUN: sed -e "s#\$(path)#%/T/Inputs/parallel#" -e "s#/\.\./basic/#/../parallel/#" %S/Inputs/basic/file1.yaml > %T/Inputs/parallel/file1.yaml
+// RUN: sed -e "s#\$(path)#%/T/Inputs/parallel#" -e "s#/\.\./basic/#/../parallel/#" %S/Inputs/basic/file2.yaml > %T/Inputs/parallel/file2.yaml
+// RUN: clang-apply-replacements -j=4 %T/Inputs/parallel
+// RUN: FileCheck -input-file=%T/Inputs/parallel/basic.h %S/Inputs/basic/basic.h
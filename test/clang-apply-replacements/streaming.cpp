@@ -0,0 +1,25 @@
+// Check that the replacements spilled to several runs are merged per file,
+// with the paths of a file deduplicated.
+// RUN: mkdir -p %T/Inputs/streaming
+// RUN: grep -Ev "// *[A-Z-]+:" %S/Inputs/basic/basic.h > %T/Inputs/streaming/basic.h
+// RUN: sed -e "s#\$(path)#%/T/Inputs/streaming#" -e "s#/\.\./basic/#/../streaming/#" %S/Inputs/basic/file1.yaml > %T/Inputs/streaming/file1.yaml
+// RUN: sed -e "s#\$(path)#%/T/Inputs/streaming#" -e "s#/\.\./basic/#/../streaming/#" %S/Inputs/basic/file2.yaml > %T/Inputs/streaming/file2.yaml
+// RUN: clang-apply-replacements -streaming -streaming-buffer-size=2 %T/Inputs/streaming
+// RUN: FileCheck -input-file=%T/Inputs/streaming/basic.h %S/Inputs/basic/basic.h
+//
+// Check that the identical replacements of diagnostics are deduplicated.
+// RUN: mkdir -p %T/Inputs/streaming-identical
+// RUN: grep -Ev "// *[A-Z-]+:" %S/Inputs/identical/identical.cpp > %T/Inputs/streaming-identical/identical.cpp
+// RUN: sed "s#\$(path)#%/T/Inputs/streaming-identical#" %S/Inputs/identical/file1.yaml > %T/Inputs/streaming-identical/file1.yaml
+// RUN: sed "s#\$(path)#%/T/Inputs/streaming-identical#" %S/Inputs/identical/file2.yaml > %T/Inputs/streaming-identical/file2.yaml
+// RUN: clang-apply-replacements -streaming -streaming-buffer-size=1 %T/Inputs/streaming-identical
+// RUN: FileCheck -input-file=%T/Inputs/streaming-identical/identical.cpp %S/Inputs/identical/identical.cpp
+//
+// Check that no file is changed when there are conflicts.
+// RUN: mkdir -p %T/Inputs/streaming-conflict
+// RUN: cp %S/Inputs/conflict/common.h %T/Inputs/streaming-conflict/common.h
+// RUN: sed "s#\$(path)#%/T/Inputs/streaming-conflict#" %S/Inputs/conflict/file1.yaml > %T/Inputs/streaming-conflict/file1.yaml
+// RUN: sed "s#\$(path)#%/T/Inputs/streaming-conflict#" %S/Inputs/conflict/file2.yaml > %T/Inputs/streaming-conflict/file2.yaml
+// RUN: sed "s#\$(path)#%/T/Inputs/streaming-conflict#" %S/Inputs/conflict/file3.yaml > %T/Inputs/streaming-conflict/file3.yaml
+// RUN: not clang-apply-replacements -streaming %T/Inputs/streaming-conflict
+// RUN: diff %S/Inputs/conflict/common.h %T/Inputs/streaming-conflict/common.h
@@ -0,0 +1,39 @@
+// RUN: rm -rf %t
+// RUN: mkdir %t
+// RUN: echo "" > %t/compile_flags.txt
+// RUN: echo "class H {};" > %t/h.h
+// RUN: echo '#include "h.h"' > %t/a.cpp
+// RUN: echo "class A {};" >> %t/a.cpp
+// RUN: echo "class B {};" > %t/b.cpp
+// RUN: clang-doc --executor=standalone -p %t %t/a.cpp %t/b.cpp -output=%t/docs -incremental-dir=%t/cache
+// RUN: find %t/docs -name "*.yaml" | sed -e "s|.*/||" | sort | FileCheck %s --check-prefix=CHECK-ALL
+//
+// The docs of the infos only b.cpp contributed to are generated again, a.cpp
+// isn't mapped again.
+// RUN: find %t/docs -name A.yaml -delete
+// RUN: find %t/docs -name B.yaml -delete
+// RUN: find %t/docs -name H.yaml -delete
+// RUN: echo "class B { int X; };" > %t/b.cpp
+// RUN: clang-doc --executor=standalone -p %t %t/a.cpp %t/b.cpp -output=%t/docs -incremental-dir=%t/cache
+// RUN: find %t/docs -name "*.yaml" | sed -e "s|.*/||" | sort | FileCheck %s --check-prefix=CHECK-SOURCE
+//
+// A change to h.h invalidates a.cpp which includes it.
+// RUN: find %t/docs -name B.yaml -delete
+// RUN: echo "class H { int Y; };" > %t/h.h
+// RUN: clang-doc --executor=standalone -p %t %t/a.cpp %t/b.cpp -output=%t/docs -incremental-dir=%t/cache
+// RUN: find %t/docs -name "*.yaml" | sed -e "s|.*/||" | sort | FileCheck %s --check-prefix=CHECK-HEADER
+// RUN: rm -rf %t
+
+// CHECK-ALL: A.yaml
+// CHECK-ALL-NEXT: B.yaml
+// CHECK-ALL-NEXT: GlobalNamespace.yaml
+// CHECK-ALL-NEXT: H.yaml
+
+// CHECK-SOURCE-NOT: A.yaml
+// CHECK-SOURCE: B.yaml
+// CHECK-SOURCE-NEXT: GlobalNamespace.yaml
+// CHECK-SOURCE-NOT: H.yaml
+
+// CHECK-HEADER: A.yaml
+// CHECK-HEADER-NEXT: GlobalNamespace.yaml
+// CHECK-HEADER-NEXT: H.yaml
@@ -0,0 +1,30 @@
+// RUN: rm -rf %t
+// RUN: mkdir -p %t/build
+// RUN: mkdir -p %t/include
+// RUN: mkdir -p %t/src
+// RUN: sed 's|$test_dir|%/t|g' %S/Inputs/executor_database_template.json > %t/compile_commands.json
+// RUN: cp %S/Inputs/test.h %t/include
+// RUN: cp %S/Inputs/test.cpp %t/src
+// RUN: touch %t/include/test2.h
+// RUN: echo '#include "test.h"' > %t/src/user.cpp
+// RUN: echo 'int g() { return a::Foo().f(); }' >> %t/src/user.cpp
+// RUN: cd %t/build
+//
+// Both translation units of the compilation database include the old header,
+// its edits are applied once.
+// RUN: clang-move -executor=all-TUs -p %t -names="a::Foo" -new_cc=%t/new_test.cpp -new_header=%t/new_test.h -old_cc=%t/src/test.cpp -old_header=%t/include/test.h
+// RUN: FileCheck -input-file=%t/new_test.h -check-prefix=CHECK-NEW-TEST-H %s
+// RUN: FileCheck -input-file=%t/new_test.cpp -check-prefix=CHECK-NEW-TEST-CPP %s
+// RUN: FileCheck -input-file=%t/include/test.h -check-prefix=CHECK-OLD-TEST-EMPTY -allow-empty %s
+//
+// CHECK-NEW-TEST-H: #ifndef TEST_H // comment 1
+// CHECK-NEW-TEST-H: class Foo {
+// CHECK-NEW-TEST-H-NOT: class Foo {
+// CHECK-NEW-TEST-H: #endif // TEST_H
+// CHECK-NEW-TEST-H-NOT: #endif
+//
+// CHECK-NEW-TEST-CPP: #include "{{.*}}new_test.h"
+// CHECK-NEW-TEST-CPP: int Foo::f() { return 0; }
+// CHECK-NEW-TEST-CPP-NOT: int Foo::f() { return 0; }
+//
+// CHECK-OLD-TEST-EMPTY: {{^}}{{$}}
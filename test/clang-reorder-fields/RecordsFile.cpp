@@ -0,0 +1,32 @@
+// RUN: echo "[{RecordName: Foo, FieldsOrder: [z, y, x]}, {RecordName: '::bar::Bar', FieldsOrder: [s, a]}, {RecordName: Baz, FieldsOrder: [c, b]}]" > %t.yaml
+// RUN: clang-reorder-fields -records-file %t.yaml %s -- -std=c++11 | FileCheck %s
+
+struct Foo {
+  int x;    // CHECK:      {{^  double z;}}
+  char y;   // CHECK-NEXT: {{^  char y;}}
+  double z; // CHECK-NEXT: {{^  int x;}}
+};
+
+namespace bar {
+class Bar {
+public:
+  Bar() : a(1), s("abc") {} // CHECK: {{^  Bar\(\) : s\("abc"\), a\(1\)}}
+
+private:
+  int a;         // CHECK:      {{^  const char \*s;}}
+  const char *s; // CHECK-NEXT: {{^  int a;}}
+};
+} // end namespace bar
+
+// Baz is partially initialized, so it isn't reordered, unlike the others.
+struct Baz {
+  int b; // CHECK:      {{^  int b;}}
+  int c; // CHECK-NEXT: {{^  int c;}}
+};
+
+int main() {
+  Foo foo = {1, 'a', 2.5}; // CHECK: {{^  Foo foo = {2.5, 'a', 1};}}
+  Baz baz = {1};           // CHECK: {{^  Baz baz = {1};}}
+  bar::Bar b;
+  return 0;
+}
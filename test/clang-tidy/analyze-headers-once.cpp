@@ -0,0 +1,22 @@
+// RUN: mkdir -p %t-dir
+// RUN: echo 'int *H = 0;' > %t-dir/header.h
+// RUN: echo '#include "header.h"' > %t-dir/a.cpp
+// RUN: echo 'int *A = 0;' >> %t-dir/a.cpp
+// RUN: echo '#include "header.h"' > %t-dir/b.cpp
+// RUN: echo 'int *B = 0;' >> %t-dir/b.cpp
+
+// The translation unit with the smallest name always analyzes the header. A
+// translation unit processed before it analyzes the header too, and the
+// duplicate diagnostics are merged.
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -header-filter=.* -analyze-headers-once %t-dir/a.cpp %t-dir/b.cpp -- 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -header-filter=.* -analyze-headers-once %t-dir/b.cpp %t-dir/a.cpp -- 2>&1 | FileCheck %s -check-prefix=CHECK-REVERSED -implicit-check-not='warning:'
+// CHECK: 2 warnings generated.
+// CHECK-NEXT: 1 warning generated.
+// CHECK-REVERSED: 2 warnings generated.
+// CHECK-REVERSED-NEXT: 2 warnings generated.
+// CHECK-DAG: a.cpp:2:10: warning: use nullptr
+// CHECK-DAG: b.cpp:2:10: warning: use nullptr
+// CHECK-DAG: header.h:1:10: warning: use nullptr
+// CHECK-REVERSED-DAG: a.cpp:2:10: warning: use nullptr
+// CHECK-REVERSED-DAG: b.cpp:2:10: warning: use nullptr
+// CHECK-REVERSED-DAG: header.h:1:10: warning: use nullptr
@@ -0,0 +1,19 @@
+// RUN: clang-tidy -aggregate-check-profile -j 2 -checks='-*,readability-function-size' %s %s -- 2>&1 | FileCheck --match-full-lines -implicit-check-not='{{warning:|error:}}' %s
+
+// CHECK-NOT: {{.*}}  --- Name ---
+
+// CHECK: ===-------------------------------------------------------------------------===
+// CHECK-NEXT: clang-tidy checks profiling of 2 translation units
+// CHECK-NEXT: ===-------------------------------------------------------------------------===
+// CHECK-NEXT:   Total Wall Time: {{.*}} seconds
+
+// CHECK: {{.*}}  Name
+// CHECK-NEXT: {{ +[0-9.]+ +[0-9.]+ +[0-9.]+ +[0-9]+ +-?[0-9]+ +}}2  readability-function-size
+// CHECK-NEXT: {{ +[0-9.]+}}  slowest in {{.*}}clang-tidy-aggregate-check-profile.cpp
+// CHECK-NEXT: {{ +[0-9.]+}}  slowest in {{.*}}clang-tidy-aggregate-check-profile.cpp
+
+class A {
+  A() {}
+  ~A() {}
+  void f() {}
+};
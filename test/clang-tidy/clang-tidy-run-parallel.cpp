@@ -0,0 +1,32 @@
+// RUN: mkdir -p %T/parallel-test/include
+// RUN: mkdir -p %T/parallel-test/a
+// RUN: mkdir -p %T/parallel-test/b
+// RUN: echo 'int *AA = 0;' > %T/parallel-test/a/a.cpp
+// RUN: echo 'int *AB = 0;' > %T/parallel-test/a/b.cpp
+// RUN: echo 'int *BB = 0;' > %T/parallel-test/b/b.cpp
+// RUN: echo 'int *BC = 0;' > %T/parallel-test/b/c.cpp
+// RUN: echo 'int *HP = 0;' > %T/parallel-test/include/header.h
+// RUN: echo '#include "header.h"' > %T/parallel-test/b/d.cpp
+// RUN: mkdir -p %T/parallel-test/db
+// RUN: sed 's|test_dir|%/T/parallel-test|g' %S/Inputs/compilation-database/template.json > %T/parallel-test/db/compile_commands.json
+
+// The diagnostics of the files processed by the threads are merged.
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/parallel-test/db %T/parallel-test/a/a.cpp %T/parallel-test/a/b.cpp %T/parallel-test/b/b.cpp %T/parallel-test/b/c.cpp %T/parallel-test/b/d.cpp -header-filter=.* -j 3 2>&1 | FileCheck %s -check-prefix=CHECK-MESSAGES -implicit-check-not='warning:'
+// CHECK-MESSAGES-DAG: a{{[/\\]}}a.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-DAG: a{{[/\\]}}b.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-DAG: b{{[/\\]}}b.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-DAG: c.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-DAG: header.h:1:11: warning: use nullptr
+
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/parallel-test/db %T/parallel-test/a/a.cpp %T/parallel-test/a/b.cpp %T/parallel-test/b/b.cpp %T/parallel-test/b/c.cpp %T/parallel-test/b/d.cpp -header-filter=.* -j 3 -fix
+// RUN: FileCheck -input-file=%T/parallel-test/a/a.cpp %s -check-prefix=CHECK-FIX1
+// RUN: FileCheck -input-file=%T/parallel-test/a/b.cpp %s -check-prefix=CHECK-FIX2
+// RUN: FileCheck -input-file=%T/parallel-test/b/b.cpp %s -check-prefix=CHECK-FIX3
+// RUN: FileCheck -input-file=%T/parallel-test/b/c.cpp %s -check-prefix=CHECK-FIX4
+// RUN: FileCheck -input-file=%T/parallel-test/include/header.h %s -check-prefix=CHECK-FIX5
+
+// CHECK-FIX1: int *AA = nullptr;
+// CHECK-FIX2: int *AB = nullptr;
+// CHECK-FIX3: int *BB = nullptr;
+// CHECK-FIX4: int *BC = nullptr;
+// CHECK-FIX5: int *HP = nullptr;
@@ -0,0 +1,10 @@
+// RUN: mkdir -p %t-dir
+// RUN: printf 'int *A = 0;\nnamespace n {\nint *B = 0;\nint *C = 0;\n}\n' > %t-dir/file.cpp
+// RUN: printf -- '--- a/file.cpp\n+++ b/file.cpp\n@@ -3,0 +4 @@\n+int *C = 0;\n' > %t-dir/file.diff
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -diff=%t-dir/file.diff %t-dir/file.cpp -- 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -diff=- %t-dir/file.cpp -- < %t-dir/file.diff 2>&1 | FileCheck %s -implicit-check-not='warning:'
+
+// Only the changed declaration in the namespace is matched.
+// CHECK: 1 warning generated.
+// CHECK: file.cpp:4:10: warning: use nullptr
+
@@ -0,0 +1,30 @@
+// RUN: rm -rf %t
+// RUN: mkdir -p %t/include
+// RUN: mkdir -p %t/a
+// RUN: echo 'int *HP = 0;' > %t/include/header.h
+// RUN: echo '#include "header.h"' > %t/a/a.cpp
+// RUN: echo 'int *AA = 0;' >> %t/a/a.cpp
+// RUN: echo '#include "header.h"' > %t/a/b.cpp
+// RUN: echo 'int *AB = 0;' >> %t/a/b.cpp
+// RUN: sed 's|test_dir|%/t|g' %S/Inputs/executor/template.json > %t/compile_commands.json
+
+// The executor runs all the translation units of the compilation database, and
+// the warnings in the header they share are reported once.
+// RUN: clang-tidy -executor=all-TUs --checks=-*,modernize-use-nullptr -p %t -header-filter=.* 2>&1 | FileCheck %s -check-prefix=CHECK-MESSAGES
+// RUN: clang-tidy -executor=all-TUs --checks=-*,modernize-use-nullptr -p %t -header-filter=.* 2>&1 | grep -c 'header.h:1:11: warning' | FileCheck %s -check-prefix=CHECK-ONCE
+// CHECK-MESSAGES-DAG: a.cpp:2:11: warning: use nullptr [modernize-use-nullptr]
+// CHECK-MESSAGES-DAG: b.cpp:2:11: warning: use nullptr [modernize-use-nullptr]
+// CHECK-MESSAGES-DAG: header.h:1:11: warning: use nullptr [modernize-use-nullptr]
+// CHECK-ONCE: {{^}}1{{$}}
+
+// The fixes of all translation units are applied, the one in the header once.
+// RUN: clang-tidy -executor=all-TUs --checks=-*,modernize-use-nullptr -p %t -header-filter=.* -fix
+// RUN: FileCheck -input-file=%t/a/a.cpp %s -check-prefix=CHECK-FIX1
+// RUN: FileCheck -input-file=%t/a/b.cpp %s -check-prefix=CHECK-FIX2
+// RUN: FileCheck -input-file=%t/include/header.h %s -check-prefix=CHECK-FIX3
+// CHECK-FIX1: int *AA = nullptr;
+// CHECK-FIX2: int *AB = nullptr;
+// CHECK-FIX3: int *HP = nullptr;
+
+// RUN: not clang-tidy -executor=all-TUs -j 2 --checks=-*,modernize-use-nullptr -p %t 2>&1 | FileCheck %s -check-prefix=CHECK-JOBS
+// CHECK-JOBS: Error: -executor can't be used with -j
@@ -0,0 +1,20 @@
+// RUN: clang-tidy -checks='-*,google-explicit-constructor' -header-filter='header2\.h' -match-user-code-only %s -- -I %S/Inputs/file-filter -isystem %S/Inputs/file-filter/system 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: clang-tidy -checks='-*,google-explicit-constructor' -header-filter='.*' -system-headers -match-user-code-only %s -- -I %S/Inputs/file-filter/system/.. -isystem %S/Inputs/file-filter/system 2>&1 | FileCheck --check-prefix=CHECK-SYSTEM %s
+
+// The declarations of the headers whose diagnostics are discarded aren't
+// matched, so no warnings are suppressed.
+#include "header1.h"
+#include "header2.h"
+// CHECK: header2.h:1:12: warning: single-argument constructors
+// CHECK-SYSTEM: header1.h:1:12: warning: single-argument constructors
+// CHECK-SYSTEM: header2.h:1:12: warning: single-argument constructors
+
+#include <system-header.h>
+// CHECK-SYSTEM: system-header.h:1:12: warning: single-argument constructors
+
+class A { A(int); };
+// CHECK: :[[@LINE-1]]:11: warning: single-argument constructors
+// CHECK-SYSTEM: :[[@LINE-2]]:11: warning: single-argument constructors
+
+// CHECK-NOT: Suppressed
+// CHECK-SYSTEM-NOT: Suppressed
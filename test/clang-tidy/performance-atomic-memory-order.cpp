@@ -0,0 +1,91 @@
+// RUN: %check_clang_tidy %s performance-atomic-memory-order %t -- \
+// RUN:   -config="{CheckOptions: [{key: performance-atomic-memory-order.Counters, value: '^num'}]}" -- -std=c++11
+
+namespace std {
+enum memory_order {
+  memory_order_relaxed,
+  memory_order_acquire,
+  memory_order_release,
+  memory_order_seq_cst
+};
+
+template <typename T>
+struct atomic {
+  T load(memory_order = memory_order_seq_cst) const;
+  void store(T, memory_order = memory_order_seq_cst);
+  T fetch_add(T, memory_order = memory_order_seq_cst);
+  T fetch_sub(T, memory_order = memory_order_seq_cst);
+  bool compare_exchange_weak(T &, T, memory_order = memory_order_seq_cst);
+  operator T() const;
+  T operator=(T);
+  T operator++();
+  T operator++(int);
+  T operator--(int);
+  T operator+=(T);
+  T operator|=(T);
+};
+} // namespace std
+
+struct Stats {
+  __attribute__((annotate("counter"))) std::atomic<long> Hits;
+  std::atomic<long> numMisses;
+  std::atomic<bool> Ready;
+};
+
+void counters(Stats &S, long N) {
+  S.Hits++;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: atomic 'operator++' is implicitly sequentially consistent, which costs a full fence on weakly ordered architectures; consider 'std::memory_order_relaxed' for this counter [performance-atomic-memory-order]
+  // CHECK-FIXES: {{^}}  S.Hits.fetch_add(1, std::memory_order_relaxed);{{$}}
+  S.numMisses += N;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: atomic 'operator+=' is {{.*}} for this counter
+  // CHECK-FIXES: {{^}}  S.numMisses.fetch_add(N, std::memory_order_relaxed);{{$}}
+  S.Hits = 0;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: atomic 'operator=' is {{.*}} for this counter
+  // CHECK-FIXES: {{^}}  S.Hits.store(0, std::memory_order_relaxed);{{$}}
+  long Total = S.Hits + S.numMisses.load();
+  // CHECK-MESSAGES: :[[@LINE-1]]:16: warning: atomic 'load' is {{.*}} for this counter
+  // CHECK-MESSAGES: :[[@LINE-2]]:25: warning: atomic 'load' is {{.*}} for this counter
+  // CHECK-FIXES: {{^}}  long Total = S.Hits.load(std::memory_order_relaxed) + S.numMisses.load(std::memory_order_relaxed);{{$}}
+  S.Hits.fetch_sub(Total);
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: atomic 'fetch_sub' is {{.*}} for this counter
+  // CHECK-FIXES: {{^}}  S.Hits.fetch_sub(Total, std::memory_order_relaxed);{{$}}
+
+  // The value of the operators isn't the value of the methods.
+  long Previous = ++S.Hits;
+  // CHECK-MESSAGES: :[[@LINE-1]]:19: warning: atomic 'operator++' is {{.*}} for this counter
+  // CHECK-FIXES: {{^}}  long Previous = ++S.Hits;{{$}}
+  S.Hits.compare_exchange_weak(Previous, 0);
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: atomic 'compare_exchange_weak' is {{.*}} for this counter
+  // CHECK-FIXES: {{^}}  S.Hits.compare_exchange_weak(Previous, 0);{{$}}
+
+  // Explicit memory orders.
+  S.Hits.fetch_add(1, std::memory_order_relaxed);
+  S.numMisses.store(0, std::memory_order_release);
+
+  // Not a counter, nor in a loop.
+  S.Ready = true;
+}
+
+void loops(Stats &S, std::atomic<int> *Flag, int N) {
+  for (int I = 0; I < N; ++I) {
+    while (!S.Ready.load()) {
+      // CHECK-MESSAGES: :[[@LINE-1]]:13: warning: atomic 'load' is implicitly sequentially consistent in a loop, which costs a full fence on weakly ordered architectures; consider an explicit memory order [performance-atomic-memory-order]
+      // CHECK-FIXES: {{^}}    while (!S.Ready.load()) {{{$}}
+    }
+    Flag->store(I);
+    // CHECK-MESSAGES: :[[@LINE-1]]:5: warning: atomic 'store' is implicitly sequentially consistent in a loop, {{.*}} an explicit memory order
+    S.numMisses++;
+    // CHECK-MESSAGES: :[[@LINE-1]]:5: warning: atomic 'operator++' is implicitly sequentially consistent in a loop, {{.*}} for this counter
+    // CHECK-FIXES: {{^}}    S.numMisses.fetch_add(1, std::memory_order_relaxed);{{$}}
+    Flag->load(std::memory_order_acquire);
+  }
+}
+
+template <typename T>
+void increment(std::atomic<T> &Value) {
+  for (int I = 0; I < 10; ++I)
+    Value++;
+  // CHECK-MESSAGES: :[[@LINE-1]]:5: warning: atomic 'operator++' is implicitly sequentially consistent in a loop
+}
+
+void instantiate(std::atomic<long> &Value) { increment(Value); }
@@ -0,0 +1,44 @@
+// RUN: %check_clang_tidy %s performance-avoid-std-function-in-hot-params %t -- \
+// RUN:   -config="{CheckOptions: [{key: performance-avoid-std-function-in-hot-params.FunctionRefClass, value: 'llvm::function_ref'}, {key: performance-avoid-std-function-in-hot-params.FunctionRefHeader, value: 'llvm/ADT/STLExtras.h'}]}" --
+
+// CHECK-FIXES: #include "llvm/ADT/STLExtras.h"
+
+namespace std {
+template <typename>
+class function;
+
+template <typename R, typename... Args>
+class function<R(Args...)> {
+public:
+  function();
+  template <typename F>
+  function(F);
+  R operator()(Args...) const;
+  explicit operator bool() const;
+};
+} // namespace std
+
+void declared(const std::function<void(int)> &F);
+// CHECK-FIXES: {{^}}void declared(llvm::function_ref<void(int)> F);{{$}}
+
+void declared(const std::function<void(int)> &F) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:47: warning: parameter 'F' of type 'const std::function<void (int)> &' is only invoked; consider passing it as 'llvm::function_ref' to avoid constructing a 'std::function' for each call [performance-avoid-std-function-in-hot-params]
+  // CHECK-FIXES: {{^}}void declared(llvm::function_ref<void(int)> F) {{{$}}
+  F(1);
+}
+
+int byValue(std::function<int()> F) { return F() + 1; }
+// CHECK-MESSAGES: :[[@LINE-1]]:34: warning: parameter 'F' of type
+// CHECK-FIXES: {{^}}int byValue(llvm::function_ref<int()> F) { return F() + 1; }{{$}}
+
+void tested(const std::function<void()> &F) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:42: warning: parameter 'F' of type
+  // CHECK-FIXES: {{^}}void tested(const std::function<void()> &F) {{{$}}
+  if (F)
+    F();
+}
+
+void addressTaken(const std::function<void()> &F) { F(); }
+// CHECK-MESSAGES: :[[@LINE-1]]:48: warning: parameter 'F' of type
+// CHECK-FIXES: {{^}}void addressTaken(const std::function<void()> &F) { F(); }{{$}}
+void (*Pointer)(const std::function<void()> &) = addressTaken;
@@ -0,0 +1,99 @@
+// RUN: %check_clang_tidy %s performance-avoid-std-function-in-hot-params %t
+
+namespace std {
+template <typename>
+class function;
+
+template <typename R, typename... Args>
+class function<R(Args...)> {
+public:
+  function();
+  function(decltype(nullptr));
+  template <typename F>
+  function(F);
+  function(const function &);
+  R operator()(Args...) const;
+  explicit operator bool() const;
+};
+
+template <typename R, typename... Args>
+bool operator==(const function<R(Args...)> &, decltype(nullptr));
+
+template <typename T>
+T &&move(T &);
+} // namespace std
+
+void byValue(std::function<void(int)> F) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:39: warning: parameter 'F' of type 'std::function<void (int)>' is only invoked; consider making its type a template parameter to avoid constructing a 'std::function' for each call [performance-avoid-std-function-in-hot-params]
+  F(1);
+}
+
+int byConstReference(const std::function<int(int)> &F) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:53: warning: parameter 'F' of type 'const std::function<int (int)> &' is only invoked
+  int Sum = 0;
+  for (int I = 0; I < 10; ++I)
+    Sum += F(I);
+  return Sum;
+}
+
+void tested(const std::function<void()> &F, const std::function<void()> &G) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:42: warning: parameter 'F' of type
+  // CHECK-MESSAGES: :[[@LINE-2]]:74: warning: parameter 'G' of type
+  if (F)
+    F();
+  if (!(G == nullptr))
+    G();
+}
+
+void capturedByReference(const std::function<void()> &F) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:55: warning: parameter 'F' of type
+  auto L = [&] { F(); };
+  L();
+}
+
+struct Widget {
+  void method(const std::function<void()> &F) { F(); }
+  // CHECK-MESSAGES: :[[@LINE-1]]:44: warning: parameter 'F' of type
+  virtual void virtualMethod(const std::function<void()> &F) { F(); }
+};
+
+// Negative tests.
+
+void sink(std::function<void()>);
+std::function<void()> Stored;
+
+void notInvoked(const std::function<void()> &F) {}
+
+void stored(const std::function<void()> &F) {
+  F();
+  Stored = F;
+}
+
+void passedOn(const std::function<void()> &F) {
+  F();
+  sink(F);
+}
+
+void moved(std::function<void()> F) {
+  F();
+  Stored = std::move(F);
+}
+
+void capturedByCopy(const std::function<void()> &F) {
+  auto L = [F] { F(); };
+  L();
+}
+
+void rvalueReference(std::function<void()> &&F) { F(); }
+
+void mutableReference(std::function<void()> &F) { F(); }
+
+struct Holder {
+  Holder(const std::function<void()> &F) : Callback(F) { F(); }
+  std::function<void()> Callback;
+};
+
+template <typename T>
+void dependent(std::function<void(T)> F, T Value) { F(Value); }
+
+void instantiate() { dependent<int>([](int) {}, 1); }
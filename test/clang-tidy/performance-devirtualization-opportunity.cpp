@@ -0,0 +1,65 @@
+// RUN: %check_clang_tidy %s performance-devirtualization-opportunity %t
+
+struct Shape {
+  virtual ~Shape();
+  virtual double area() const = 0;
+  virtual const char *name() const;
+  virtual void draw();
+  // CHECK-MESSAGES: :[[@LINE-1]]:16: warning: virtual method 'draw' has no overrides
+  // CHECK-FIXES: {{^}}  virtual void draw() final;{{$}}
+};
+
+struct Circle : Shape {
+  // CHECK-MESSAGES: :[[@LINE-1]]:8: warning: polymorphic class 'Circle' has no derived classes in this translation unit; consider marking it 'final' to let the compiler devirtualize its calls [performance-devirtualization-opportunity]
+  // CHECK-FIXES: {{^}}struct Circle final : Shape {{{$}}
+  double area() const override;
+  double Radius;
+};
+
+struct Polygon : Shape {
+  double area() const override;
+  // CHECK-MESSAGES: :[[@LINE-1]]:10: warning: virtual method 'area' has no overrides in this translation unit; consider marking it 'final' to let the compiler devirtualize its calls
+  // CHECK-FIXES: {{^}}  double area() const final override;{{$}}
+  const char *name() const override;
+  virtual int sides() const;
+  // CHECK-MESSAGES: :[[@LINE-1]]:15: warning: virtual method 'sides' has no overrides
+  // CHECK-FIXES: {{^}}  virtual int sides() const final;{{$}}
+};
+
+struct Square : Polygon {
+  // CHECK-MESSAGES: :[[@LINE-1]]:8: warning: polymorphic class 'Square' has no derived classes
+  // CHECK-FIXES: {{^}}struct Square final : Polygon {{{$}}
+  const char *name() const override;
+};
+
+double total(Circle *Circles, int N) {
+  double Total = 0;
+  for (int I = 0; I < N; ++I)
+    Total += Circles[I].area();
+  // CHECK-MESSAGES: :[[@LINE-1]]:14: note: virtual call in a loop here
+  return Total;
+}
+
+// Only the derived classes declared in this translation unit are known, so
+// Shape::draw is reported above. A virtual call outside of a loop gets no note.
+void draw(Shape &S) { S.draw(); }
+
+struct AlreadyFinal final : Shape {
+  double area() const override;
+};
+
+struct Abstract {
+  virtual void run() = 0;
+};
+
+struct NotPolymorphic {
+  void run();
+};
+
+template <typename T>
+struct Wrapper : Shape {
+  double area() const override;
+  T Value;
+};
+
+Wrapper<int> W;
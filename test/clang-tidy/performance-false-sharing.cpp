@@ -0,0 +1,86 @@
+// RUN: %check_clang_tidy %s performance-false-sharing %t -- -- -target x86_64-unknown-linux
+
+namespace std {
+template <typename T>
+struct atomic {
+  atomic() = default;
+  T operator++();
+  T fetch_add(T);
+  T load() const;
+  T Value;
+};
+
+struct mutex {
+  void lock();
+  void unlock();
+  long Storage[5];
+};
+
+template <typename T>
+struct vector {
+  T &operator[](unsigned long);
+};
+} // namespace std
+
+struct Queue {
+  std::atomic<unsigned> Head;
+  std::atomic<unsigned> Tail;
+  // CHECK-MESSAGES: :[[@LINE-1]]:25: warning: 'Tail' is 4 bytes after 'Head' and may share a cache line with it; consider aligning it with 'alignas(std::hardware_destructive_interference_size)' [performance-false-sharing]
+};
+
+struct Locked {
+  std::mutex Mutex;
+  int Data;
+  std::atomic<int> Count;
+  // CHECK-MESSAGES: :[[@LINE-1]]:20: warning: 'Count' is 44 bytes after 'Mutex'
+};
+
+struct Separated {
+  std::atomic<unsigned> Head;
+  alignas(64) std::atomic<unsigned> Tail;
+};
+
+struct Single {
+  std::atomic<unsigned> Count;
+  long Data[20];
+};
+
+template <typename T>
+struct Template {
+  std::atomic<T> Head;
+  std::atomic<T> Tail;
+};
+Template<int> TI;
+
+struct Counter {
+  long Hits;
+  std::atomic<long> Misses;
+};
+Counter Counters[16];
+int Totals[16];
+std::vector<int> Results;
+
+struct alignas(64) Padded {
+  long Hits;
+};
+Padded PaddedCounters[16];
+
+void work(unsigned ThreadId, unsigned I) {
+  ++Counters[ThreadId].Hits;
+  // CHECK-MESSAGES: :[[@LINE-1]]:5: warning: the elements of type 'Counter' indexed by the thread index 'ThreadId' are 16 bytes and may share a cache line with the elements of other threads; consider aligning them with 'alignas(std::hardware_destructive_interference_size)' [performance-false-sharing]
+  Counters[ThreadId].Misses.fetch_add(1);
+  Totals[ThreadId] += 1;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: the elements of type 'int' indexed by the thread index 'ThreadId' are 4 bytes
+  Results[ThreadId] = 1;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: the elements of type 'int' indexed by the thread index 'ThreadId' are 4 bytes
+  ++PaddedCounters[ThreadId].Hits;
+  int Sum = Totals[ThreadId] + Counters[ThreadId].Misses.load();
+  Totals[I] = Sum;
+}
+
+short Slots[8];
+
+void worker(int tid) {
+  Slots[tid] = 0;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: the elements of type 'short' indexed by the thread index 'tid'
+}
@@ -1,4 +1,5 @@
 // RUN: %check_clang_tidy %s performance-inefficient-vector-operation %t -- -format-style=llvm -- --std=c++11
+// RUN: %check_clang_tidy -check-suffixes=,PROTO %s performance-inefficient-vector-operation %t -- -format-style=llvm -config='{CheckOptions: [{key: performance-inefficient-vector-operation.EnableProto, value: 1}]}' -- --std=c++11
 
 namespace std {
 
@@ -48,8 +49,56 @@ class vector {
   const_iterator begin() const;
   const_iterator end() const;
 };
+
+template <class C>
+class basic_string {
+ public:
+  basic_string();
+
+  void push_back(C c);
+  basic_string &operator+=(C c);
+  basic_string &operator+=(const C *s);
+
+  void reserve(size_t n);
+};
+typedef basic_string<char> string;
+
+template <class T1, class T2> struct pair {
+  pair(const T1 &, const T2 &);
+};
+
+template <class K, class V>
+class unordered_map {
+ public:
+  unordered_map();
+
+  typedef pair<const K, V> value_type;
+  pair<int, bool> insert(const value_type &v);
+  void insert(initializer_list<value_type> il);
+  template <class... Args> pair<int, bool> emplace(Args &&... args);
+
+  void reserve(size_t n);
+};
 } // namespace std
 
+namespace google {
+namespace protobuf {
+class MessageLite {};
+class Message : public MessageLite {};
+template <class T> class RepeatedField {
+ public:
+  void Reserve(int n);
+};
+} // namespace protobuf
+} // namespace google
+
+class ProtoMessage : public google::protobuf::Message {
+ public:
+  void add_values(int v);
+  google::protobuf::RepeatedField<int> *mutable_values();
+  int *add_items();
+};
+
 class Foo {
  public:
   explicit Foo(int);
@@ -275,3 +324,62 @@ void f(std::vector<int>& t) {
     }
   }
 }
+
+void g(const std::vector<int> &t, const std::string &u) {
+  {
+    std::string s0;
+    // CHECK-FIXES: s0.reserve(10);
+    for (int i = 0; i < 10; ++i)
+      s0.push_back('a');
+      // CHECK-MESSAGES: :[[@LINE-1]]:7: warning: 'push_back' is called inside a loop; consider pre-allocating the string capacity before the loop
+  }
+  {
+    std::string s1;
+    char c = 'a';
+    // CHECK-FIXES: s1.reserve(t.size());
+    for (int e : t)
+      s1 += c;
+      // CHECK-MESSAGES: :[[@LINE-1]]:7: warning: 'operator+=' is called inside a loop; consider pre-allocating the string capacity before the loop
+  }
+  {
+    std::string s2;
+    // Appending strings needs more than one character per iteration.
+    for (int i = 0; i < 10; ++i)
+      s2 += "ab";
+  }
+  {
+    std::unordered_map<int, int> m0;
+    // CHECK-FIXES: m0.reserve(10);
+    for (int i = 0; i < 10; ++i)
+      m0.insert(std::pair<const int, int>(i, i));
+      // CHECK-MESSAGES: :[[@LINE-1]]:7: warning: 'insert' is called inside a loop; consider pre-allocating the container capacity before the loop
+  }
+  {
+    std::unordered_map<int, int> m1;
+    // CHECK-FIXES: m1.reserve(t.size());
+    for (int e : t)
+      m1.emplace(e, e);
+      // CHECK-MESSAGES: :[[@LINE-1]]:7: warning: 'emplace' is called inside a loop; consider pre-allocating the container capacity before the loop
+  }
+  {
+    std::unordered_map<int, int> m2;
+    // Inserting several elements per iteration.
+    for (int i = 0; i < 10; ++i)
+      m2.insert({{i, i}, {i + 1, i}});
+  }
+  {
+    ProtoMessage p0;
+    // CHECK-FIXES-PROTO: p0.mutable_values()->Reserve(10);
+    for (int i = 0; i < 10; ++i)
+      p0.add_values(i);
+      // CHECK-MESSAGES-PROTO: :[[@LINE-1]]:7: warning: 'add_values' is called inside a loop; consider pre-allocating the repeated field capacity before the loop
+  }
+  {
+    ProtoMessage p1;
+    // There is no 'mutable_items()' to reserve the field with.
+    // CHECK-FIXES-PROTO-NOT: p1.mutable_items()->Reserve(10);
+    for (int i = 0; i < 10; ++i)
+      p1.add_items();
+      // CHECK-MESSAGES-PROTO: :[[@LINE-1]]:7: warning: 'add_items' is called inside a loop; consider pre-allocating the repeated field capacity before the loop
+  }
+}
@@ -0,0 +1,162 @@
+// RUN: %check_clang_tidy %s performance-map-double-lookup %t -- -- -std=c++17
+
+namespace std {
+template <typename T1, typename T2>
+struct pair {
+  T1 first;
+  T2 second;
+};
+
+struct string {
+  string(const char *);
+};
+
+template <typename Key, typename Value>
+struct map {
+  struct iterator {
+    pair<const Key, Value> *operator->() const;
+    bool operator==(const iterator &) const;
+    bool operator!=(const iterator &) const;
+  };
+
+  Value &operator[](const Key &);
+  Value &at(const Key &);
+  iterator find(const Key &);
+  iterator end();
+  unsigned long count(const Key &) const;
+  template <typename... Args>
+  pair<iterator, bool> try_emplace(const Key &, Args &&...);
+  void clear();
+};
+} // namespace std
+
+namespace llvm {
+template <typename Key, typename Value>
+struct DenseMap {
+  Value &operator[](const Key &);
+  Value lookup(const Key &) const;
+  unsigned count(const Key &) const;
+  template <typename... Args>
+  void try_emplace(const Key &, Args &&...);
+};
+} // namespace llvm
+
+int use(int);
+void mutate(std::map<int, int> &);
+
+void countThenSubscript(std::map<int, int> &M, int K) {
+  if (M.count(K))
+    use(M[K]);
+  // CHECK-MESSAGES: :[[@LINE-1]]:9: warning: 'M' is looked up again with the same key; consider reusing the result of the previous lookup [performance-map-double-lookup]
+  // CHECK-FIXES: {{^}}  if (auto It = M.find(K); It != M.end()){{$}}
+  // CHECK-FIXES-NEXT: {{^}}    use(It->second);{{$}}
+}
+
+void findThenAt(std::map<int, int> &M, int K) {
+  if (M.find(K) != M.end()) {
+    use(M.at(K));
+    // CHECK-MESSAGES: :[[@LINE-1]]:9: warning: 'M' is looked up again
+    use(M.at(K) + 1);
+    // CHECK-MESSAGES: :[[@LINE-1]]:9: warning: 'M' is looked up again
+  }
+  // CHECK-FIXES: {{^}}  if (auto It = M.find(K); It != M.end()) {{{$}}
+  // CHECK-FIXES-NEXT: {{^}}    use(It->second);{{$}}
+  // CHECK-FIXES-NEXT: {{^}}    use(It->second + 1);{{$}}
+}
+
+void insertIfAbsent(std::map<int, int> &M, int K) {
+  if (!M.count(K))
+    M[K] = 1;
+  // CHECK-MESSAGES: :[[@LINE-1]]:5: warning: 'M' is looked up again
+  // CHECK-FIXES: {{^}}  M.try_emplace(K, 1);{{$}}
+}
+
+void insertIfAbsentWithBraces(llvm::DenseMap<int, int> &M, int K) {
+  if (M.count(K) == 0) {
+    M[K] = 2;
+  }
+  // CHECK-MESSAGES: :[[@LINE-2]]:5: warning: 'M' is looked up again
+  // CHECK-FIXES: {{^}}  M.try_emplace(K, 2);{{$}}
+}
+
+void earlyReturn(llvm::DenseMap<int, int> &M) {
+  if (!M.count(42))
+    return;
+  use(M.lookup(42));
+  // CHECK-MESSAGES: :[[@LINE-1]]:7: warning: 'M' is looked up again
+}
+
+void stringKeys(std::map<std::string, int> &M) {
+  use(M["a"]);
+  // The insertion of another key modifies the map.
+  use(M["b"]);
+  use(M["a"]);
+  use(M["b"]);
+  // CHECK-MESSAGES: :[[@LINE-1]]:7: warning: 'M' is looked up again
+}
+
+void sequenced(std::map<int, int> M, int K) {
+  M[K] = 1;
+  M[K] += 2;
+  // CHECK-MESSAGES: :[[@LINE-1]]:3: warning: 'M' is looked up again
+}
+
+void notFixedWithElseLookup(std::map<int, int> &M, int K) {
+  if (M.count(K))
+    use(M.find(K)->second);
+  // CHECK-MESSAGES: :[[@LINE-1]]:9: warning: 'M' is looked up again
+  // CHECK-FIXES: {{^}}  if (M.count(K)){{$}}
+}
+
+// Negative tests.
+
+void differentKeys(std::map<int, int> &M, int K, int L) {
+  if (M.count(K))
+    use(M[L]);
+}
+
+void differentMaps(std::map<int, int> &M, std::map<int, int> &N, int K) {
+  if (M.count(K))
+    use(N[K]);
+}
+
+void mapModified(std::map<int, int> &M, int K) {
+  if (M.count(K)) {
+    M.clear();
+    use(M[K]);
+  }
+  if (M.count(K)) {
+    mutate(M);
+    use(M[K]);
+  }
+}
+
+void keyModified(std::map<int, int> &M, int K) {
+  if (M.count(K)) {
+    ++K;
+    use(M[K]);
+  }
+}
+
+void otherPath(std::map<int, int> &M, int K, bool B) {
+  if (B)
+    M.count(K);
+  use(M[K]);
+}
+
+void loop(std::map<int, int> &M, int K) {
+  for (int I = 0; I < 10; ++I)
+    use(M[K]);
+}
+
+int GlobalKey;
+void nonConstGlobalKey(std::map<int, int> &M) {
+  if (M.count(GlobalKey))
+    use(M[GlobalKey]);
+}
+
+std::map<int, int> GlobalMap;
+void globalMap(int K) {
+  if (GlobalMap.count(K))
+    use(GlobalMap[K]);
+}
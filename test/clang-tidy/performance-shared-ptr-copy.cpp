@@ -0,0 +1,107 @@
+// RUN: %check_clang_tidy %s performance-shared-ptr-copy %t
+
+namespace std {
+typedef decltype(nullptr) nullptr_t;
+
+template <typename T>
+struct remove_reference { typedef T type; };
+template <typename T>
+struct remove_reference<T &> { typedef T type; };
+template <typename T>
+typename remove_reference<T>::type &&move(T &&);
+
+template <typename T>
+struct shared_ptr {
+  shared_ptr();
+  shared_ptr(const shared_ptr &);
+  shared_ptr(shared_ptr &&);
+  ~shared_ptr();
+  shared_ptr &operator=(const shared_ptr &);
+  T &operator*() const;
+  T *operator->() const;
+  T *get() const;
+  explicit operator bool() const;
+  void reset();
+  long use_count() const;
+};
+
+template <typename T>
+bool operator==(const shared_ptr<T> &, nullptr_t);
+
+template <typename T>
+struct vector {
+  const T *begin() const;
+  const T *end() const;
+};
+} // namespace std
+
+struct Node {
+  int Weight;
+};
+
+void read(const std::shared_ptr<Node> &);
+void take(std::shared_ptr<Node>);
+
+int weight(std::shared_ptr<Node> N) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:34: warning: parameter 'N' copies a shared pointer for each call but is only dereferenced; consider a reference or a pointer to the pointee, or a const reference [performance-shared-ptr-copy]
+  // CHECK-FIXES: int weight(const std::shared_ptr<Node>& N) {
+  if (N == nullptr || !N)
+    return 0;
+  return N->Weight + (*N).Weight + N.get()->Weight;
+}
+
+long count(std::shared_ptr<Node> N);
+// CHECK-FIXES: long count(const std::shared_ptr<Node>& N);
+long count(std::shared_ptr<Node> N) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:34: warning: parameter 'N' copies a shared pointer for each call but is only read; consider a const reference [performance-shared-ptr-copy]
+  // CHECK-FIXES: long count(const std::shared_ptr<Node>& N) {
+  read(N);
+  return N.use_count();
+}
+
+struct Holder {
+  Holder(std::shared_ptr<Node> N) : Member(N) {}
+  void set(std::shared_ptr<Node> N) { Member = N; }
+  void store(std::shared_ptr<Node> N) { Member = std::move(N); }
+  virtual void visit(std::shared_ptr<Node> N) { N->Weight = 0; }
+  // CHECK-MESSAGES: :[[@LINE-1]]:44: warning: parameter 'N' copies a shared pointer
+  // CHECK-FIXES: virtual void visit(std::shared_ptr<Node> N) { N->Weight = 0; }
+  std::shared_ptr<Node> Member;
+};
+
+void forward(std::shared_ptr<Node> N) { take(N); }
+
+void reset(std::shared_ptr<Node> N) { N.reset(); }
+
+void byReference(const std::shared_ptr<Node> &N) { N->Weight = 1; }
+
+void locals(std::shared_ptr<Node> Source, std::shared_ptr<Node> Other) {
+  std::shared_ptr<Node> Copy = Source;
+  // CHECK-MESSAGES: :[[@LINE-1]]:25: warning: local copy 'Copy' of the shared pointer 'Source' is only dereferenced; consider a const reference [performance-shared-ptr-copy]
+  // CHECK-FIXES: const std::shared_ptr<Node>& Copy = Source;
+  Copy->Weight = 1;
+
+  auto Alive = Other;
+  Other.reset();
+  Alive->Weight = 2;
+}
+
+void member(Holder &H) {
+  std::shared_ptr<Node> Copy = H.Member;
+  Copy->Weight = 1;
+}
+
+void loops(const std::vector<std::shared_ptr<Node>> &Nodes) {
+  for (auto N : Nodes)
+    // CHECK-MESSAGES: :[[@LINE-1]]:13: warning: loop variable 'N' copies a shared pointer in each iteration but is only dereferenced; consider a const reference [performance-shared-ptr-copy]
+    // CHECK-FIXES: for (const auto& N : Nodes)
+    N->Weight = 1;
+  for (std::shared_ptr<Node> N : Nodes)
+    // CHECK-MESSAGES: :[[@LINE-1]]:30: warning: loop variable 'N' copies a shared pointer in each iteration but is only read
+    // CHECK-FIXES: for (const std::shared_ptr<Node>& N : Nodes)
+    read(N);
+  for (auto N : Nodes)
+    take(N);
+  for (const auto &N : Nodes)
+    read(N);
+}
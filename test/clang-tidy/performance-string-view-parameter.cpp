@@ -0,0 +1,75 @@
+// RUN: %check_clang_tidy %s performance-string-view-parameter %t -- -- -std=c++17
+
+// CHECK-FIXES: #include <string_view>
+
+namespace std {
+template <typename C>
+struct basic_string {
+  basic_string(const C *);
+  unsigned long size() const;
+  bool empty() const;
+  const C *data() const;
+  const C *c_str() const;
+  unsigned long find(const C *, unsigned long = 0) const;
+  basic_string substr(unsigned long, unsigned long = -1) const;
+  const C &operator[](unsigned long) const;
+  basic_string &operator+=(const C *);
+};
+typedef basic_string<char> string;
+typedef basic_string<wchar_t> wstring;
+
+template <typename C>
+bool operator==(const basic_string<C> &, const C *);
+template <typename C>
+basic_string<C> operator+(const basic_string<C> &, const C *);
+
+struct ostream {};
+ostream &operator<<(ostream &, const string &);
+} // namespace std
+
+bool isHeader(const std::string &Name);
+// CHECK-FIXES: {{^}}bool isHeader(std::string_view Name);{{$}}
+
+bool isHeader(const std::string &Name) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:34: warning: parameter 'Name' is only read with operations that 'std::string_view' supports; consider passing it as 'std::string_view' to avoid constructing a temporary 'std::string' from string literals and character pointers [performance-string-view-parameter]
+  // CHECK-FIXES: {{^}}bool isHeader(std::string_view Name) {{{$}}
+  return Name.size() > 2 && Name.substr(Name.size() - 2) == ".h";
+}
+
+bool search(const std::string& Text, char C) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:32: warning: parameter 'Text'
+  // CHECK-FIXES: {{^}}bool search(std::string_view Text, char C) {{{$}}
+  return !Text.empty() && (Text[0] == C || Text.find("x") != -1UL);
+}
+
+void print(std::ostream &OS, const std::string &S) {
+  // CHECK-MESSAGES: :[[@LINE-1]]:49: warning: parameter 'S'
+  OS << S;
+}
+
+const char *cString(const std::string &S) { return S.c_str(); }
+
+std::string concat(const std::string &S) { return S + "!"; }
+
+std::string substring(const std::string &S) { return S.substr(1); }
+
+void forward(const std::string &S) { isHeader(S); }
+
+bool defaulted(const std::string &S = "a.h") { return S.empty(); }
+// CHECK-MESSAGES: :[[@LINE-1]]:35: warning: parameter 'S'
+// CHECK-FIXES: {{^}}bool defaulted(const std::string &S = "a.h") { return S.empty(); }{{$}}
+
+bool wide(const std::wstring &S) { return S.empty(); }
+
+void unused(const std::string &S) {}
+
+bool byValue(std::string S) { return S.empty(); }
+
+struct Base {
+  virtual bool check(const std::string &S) { return S.empty(); }
+};
+
+bool addressTaken(const std::string &S) { return S.empty(); }
+// CHECK-MESSAGES: :[[@LINE-1]]:38: warning: parameter 'S'
+// CHECK-FIXES: {{^}}bool addressTaken(const std::string &S) { return S.empty(); }{{$}}
+bool (*Pointer)(const std::string &) = addressTaken;
@@ -0,0 +1,67 @@
+// RUN: %check_clang_tidy %s performance-struct-padding %t -- -- -target x86_64-unknown-linux
+
+struct A { char a; int b; char c; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'A' is 12 bytes, 6 of which are padding; ordering its fields by decreasing alignment reduces its size to 8 bytes [performance-struct-padding]
+// CHECK-FIXES: struct A { int b; char a; char c; };
+
+struct Sorted { int b; char a; char c; };
+
+struct Small { double d[10]; char a; int b; char c; };
+
+class Ctor {
+  char a;
+  int b;
+  char c;
+  // CHECK-MESSAGES: :[[@LINE-4]]:7: warning: 'Ctor' is 12 bytes
+  // CHECK-FIXES: {{^}}  int b;{{$}}
+  // CHECK-FIXES-NEXT: {{^}}  char a;{{$}}
+  // CHECK-FIXES-NEXT: {{^}}  char c;{{$}}
+
+public:
+  Ctor() : a(1), b(2), c(3) {}
+  // CHECK-FIXES: Ctor() : b(2), a(1), c(3) {}
+  Ctor(int);
+};
+
+struct Aggregate { char a; int b; char c; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'Aggregate' is 12 bytes
+// CHECK-FIXES: struct Aggregate { int b; char a; char c; };
+Aggregate Agg = {1, 2, 3};
+// CHECK-FIXES: Aggregate Agg = {2, 1, 3};
+Aggregate Empty = {};
+
+struct Partial { char a; int b; char c; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'Partial' is 12 bytes
+// CHECK-FIXES: struct Partial { char a; int b; char c; };
+Partial P = {1};
+
+struct Access { char a; private: int b; public: char c; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'Access' is 12 bytes
+// CHECK-FIXES: struct Access { char a; private: int b; public: char c; };
+
+struct Dependency { char a; int b = a; char c; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'Dependency' is 12 bytes
+// CHECK-FIXES: struct Dependency { char a; int b = a; char c; };
+
+struct Shared { char a; int b; char c, d; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'Shared' is 12 bytes
+// CHECK-FIXES: struct Shared { char a; int b; char c, d; };
+
+#define FIELD(Type, Name) Type Name
+struct Macro { char a; FIELD(int, b); char c; };
+// CHECK-MESSAGES: :[[@LINE-1]]:8: warning: 'Macro' is 12 bytes
+// CHECK-FIXES: struct Macro { char a; FIELD(int, b); char c; };
+
+template <typename T>
+struct Template { char a; T b; char c; };
+Template<int> TI;
+
+struct Derived : Sorted { char a; int b; char c; };
+
+struct Virtual { char a; int b; char c; virtual ~Virtual(); };
+
+struct BitField { char a; int b; char c : 4; };
+
+struct __attribute__((packed)) Packed { char a; int b; char c; };
+
+union Union { char a; int b; };
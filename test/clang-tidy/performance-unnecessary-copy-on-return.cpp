@@ -0,0 +1,177 @@
+// RUN: %check_clang_tidy %s performance-unnecessary-copy-on-return %t
+
+// CHECK-FIXES: #include <utility>
+
+namespace std {
+template <typename>
+struct remove_reference;
+
+template <typename _Tp>
+struct remove_reference {
+  typedef _Tp type;
+};
+
+template <typename _Tp>
+struct remove_reference<_Tp &> {
+  typedef _Tp type;
+};
+
+template <typename _Tp>
+struct remove_reference<_Tp &&> {
+  typedef _Tp type;
+};
+
+template <typename _Tp>
+constexpr typename std::remove_reference<_Tp>::type &&move(_Tp &&__t) {
+  return static_cast<typename std::remove_reference<_Tp>::type &&>(__t);
+}
+} // namespace std
+
+struct Movable {
+  Movable();
+  Movable(const Movable &);
+  Movable(Movable &&);
+  ~Movable();
+};
+
+struct DerivedMovable : Movable {};
+
+// The user-declared copy constructor suppresses the move constructor.
+struct CopyOnly {
+  CopyOnly();
+  CopyOnly(const CopyOnly &);
+  ~CopyOnly();
+};
+
+Movable pessimizingMove() {
+  Movable M;
+  return std::move(M);
+  // CHECK-MESSAGES: [[@LINE-1]]:10: warning: moving the local variable 'M' in a return statement prevents copy elision; remove std::move() [performance-unnecessary-copy-on-return]
+  // CHECK-FIXES: {{^}}  return M;{{$}}
+}
+
+Movable pessimizingMoveOfConstLocal() {
+  const Movable M;
+  return std::move(M);
+  // CHECK-MESSAGES: [[@LINE-1]]:10: warning: moving the local variable 'M'
+  // CHECK-FIXES: {{^}}  return M;{{$}}
+}
+
+Movable redundantMoveOfParameter(Movable P) {
+  return std::move(P);
+  // CHECK-MESSAGES: [[@LINE-1]]:10: warning: the parameter 'P' is moved implicitly in a return statement; remove std::move()
+  // CHECK-FIXES: {{^}}  return P;{{$}}
+}
+
+Movable moveOfConstParameter(const Movable P) {
+  return std::move(P);
+}
+
+Movable moveToConvert() {
+  DerivedMovable D;
+  return std::move(D);
+}
+
+Movable moveOfMember(Movable &R) {
+  return std::move(R);
+}
+
+Movable constLocals(bool C) {
+  const Movable A;
+  const Movable B;
+  if (C)
+    return A;
+  // CHECK-MESSAGES: [[@LINE-1]]:12: warning: the const local variable 'A' is copied on return; consider making it non-const so that it can be moved
+  return B;
+  // CHECK-MESSAGES: [[@LINE-1]]:10: warning: the const local variable 'B' is copied on return
+}
+
+Movable constLocalElided() {
+  const Movable M;
+  return M;
+}
+
+Movable constParameter(const Movable P) {
+  return P;
+  // CHECK-MESSAGES: [[@LINE-1]]:10: warning: the const parameter 'P' is copied on return; consider making it non-const so that it can be moved
+}
+
+CopyOnly constCopyOnlyParameter(const CopyOnly P) {
+  return P;
+}
+
+CopyOnly differentLocals(bool C) {
+  CopyOnly A;
+  CopyOnly B;
+  if (C)
+    return A;
+  // CHECK-MESSAGES: [[@LINE-1]]:12: warning: the local variable 'A' is copied on return because the copy can't be elided; consider returning the same local variable from all the return statements of the function
+  return B;
+  // CHECK-MESSAGES: [[@LINE-1]]:10: warning: the local variable 'B' is copied on return
+}
+
+CopyOnly sameLocal(bool C) {
+  CopyOnly A;
+  if (C)
+    return A;
+  return A;
+}
+
+CopyOnly copyOnlyParameter(CopyOnly P) {
+  return P;
+}
+
+Movable differentMovableLocals(bool C) {
+  Movable A;
+  Movable B;
+  if (C)
+    return A;
+  return B;
+}
+
+int trivialLocals(bool C) {
+  int A = 0;
+  int B = 1;
+  if (C)
+    return A;
+  return std::move(B);
+}
+
+class Holder {
+  Movable M;
+  CopyOnly C;
+  const Movable ConstM;
+  Movable &Ref;
+
+public:
+  Movable take() && {
+    return M;
+    // CHECK-MESSAGES: [[@LINE-1]]:12: warning: the member 'M' is copied on return from an rvalue reference qualified member function; consider moving it
+    // CHECK-FIXES: {{^}}    return std::move(M);{{$}}
+  }
+  Movable takeThis() && {
+    return this->M;
+    // CHECK-MESSAGES: [[@LINE-1]]:12: warning: the member 'M' is copied
+    // CHECK-FIXES: {{^}}    return std::move(this->M);{{$}}
+  }
+  Movable get() const & { return M; }
+  Movable get() & { return M; }
+  Movable getConst() const && { return M; }
+  Movable getConstMember() && { return ConstM; }
+  Movable getReference() && { return Ref; }
+  CopyOnly getCopyOnly() && { return C; }
+};
+
+template <typename T>
+T pessimizingMoveInTemplate() {
+  T t;
+  return std::move(t);
+}
+
+void instantiate() {
+  pessimizingMoveInTemplate<Movable>();
+  auto L = [] {
+    Movable M;
+    return std::move(M);
+  };
+}
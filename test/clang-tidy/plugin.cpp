@@ -0,0 +1,45 @@
+// REQUIRES: shell
+// RUN: rm -rf %t
+// RUN: mkdir -p %t/cache
+// RUN: cp %s %t/test.cpp
+// RUN: echo 'class H { H(int); };' > %t/header.h
+//
+// The checks run in the compiler, filtered as by the clang-tidy tool, and
+// their fixes are exported.
+// RUN: c-index-test -test-load-source all %t/test.cpp -Xclang -add-plugin -Xclang clang-tidy \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -checks=-*,google-explicit-constructor \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -header-filter=header.h \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -export-fixes=%t/fixes.yaml \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -result-cache=%t/cache \
+// RUN:   2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: FileCheck %s -check-prefix=CHECK-YAML -input-file=%t/fixes.yaml
+//
+// The second run replays the results stored by the first one, altered to tell
+// them apart.
+// RUN: sed -i -e 's/unintentional implicit conversions/cached conversions/' %t/cache/*.yaml
+// RUN: c-index-test -test-load-source all %t/test.cpp -Xclang -add-plugin -Xclang clang-tidy \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -checks=-*,google-explicit-constructor \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -header-filter=header.h \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -export-fixes=%t/fixes.yaml \
+// RUN:   -Xclang -plugin-arg-clang-tidy -Xclang -result-cache=%t/cache \
+// RUN:   2>&1 | FileCheck %s -check-prefix=CHECK-CACHED -implicit-check-not='warning:'
+
+#include "header.h"
+
+class A {
+  A(int);
+};
+// CHECK-DAG: header.h:1:11: warning: single-argument constructors must be marked explicit to avoid unintentional implicit conversions [google-explicit-constructor]
+// CHECK-DAG: test.cpp:[[@LINE-3]]:3: warning: single-argument constructors must be marked explicit to avoid unintentional implicit conversions [google-explicit-constructor]
+// CHECK-CACHED-DAG: header.h:1:11: warning: single-argument constructors must be marked explicit to avoid cached conversions [google-explicit-constructor]
+// CHECK-CACHED-DAG: test.cpp:[[@LINE-5]]:3: warning: single-argument constructors must be marked explicit to avoid cached conversions [google-explicit-constructor]
+
+class B {
+  B(int); // NOLINT
+};
+
+// CHECK-YAML: MainSourceFile: '{{.*}}test.cpp'
+// CHECK-YAML: DiagnosticName: google-explicit-constructor
+// CHECK-YAML: ReplacementText: 'explicit '
+// CHECK-YAML: DiagnosticName: google-explicit-constructor
+// CHECK-YAML: ReplacementText: 'explicit '
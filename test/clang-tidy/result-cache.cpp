@@ -0,0 +1,19 @@
+// RUN: rm -rf %t-cache
+// RUN: mkdir -p %t-dir
+// RUN: echo 'int *A = 0;' > %t-dir/a.cpp
+
+// The second run replays the results stored by the first one.
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -result-cache=%t-cache %t-dir/a.cpp -- 2>&1 | FileCheck %s -check-prefix=CHECK-MESSAGES -implicit-check-not='warning:'
+// RUN: ls %t-cache | FileCheck %s -check-prefix=CHECK-CACHE
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -result-cache=%t-cache %t-dir/a.cpp -- 2>&1 | FileCheck %s -check-prefix=CHECK-MESSAGES -implicit-check-not='warning:'
+// CHECK-MESSAGES: a.cpp:1:10: warning: use nullptr
+// CHECK-CACHE: .yaml
+
+// The fixes of the stored results are applied.
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -result-cache=%t-cache %t-dir/a.cpp -fix --
+// RUN: FileCheck -input-file=%t-dir/a.cpp %s -check-prefix=CHECK-FIX
+// CHECK-FIX: int *A = nullptr;
+
+// A changed file is analyzed again.
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -result-cache=%t-cache %t-dir/a.cpp -- 2>&1 | FileCheck %s -check-prefix=CHECK-CHANGED -allow-empty
+// CHECK-CHANGED-NOT: warning:
@@ -0,0 +1,14 @@
+// RUN: mkdir -p %t-dir
+// RUN: echo 'int *H = 0;' > %t-dir/header.h
+// RUN: echo '#include "header.h"' > %t-dir/a.cpp
+// RUN: echo 'int *A = 0;' >> %t-dir/a.cpp
+// RUN: echo '#include "header.h"' > %t-dir/b.cpp
+// RUN: echo 'int *B = H;' >> %t-dir/b.cpp
+
+// Both translation units use the preamble of header.h, whose declarations are
+// still matched.
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -header-filter=.* -reuse-preambles %t-dir/a.cpp %t-dir/b.cpp -- 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -header-filter=.* -reuse-preambles -match-user-code-only %t-dir/a.cpp %t-dir/b.cpp -- 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -header-filter=.* -reuse-preambles -j 2 %t-dir/a.cpp %t-dir/b.cpp -- 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// CHECK-DAG: a.cpp:2:10: warning: use nullptr
+// CHECK-DAG: header.h:1:10: warning: use nullptr
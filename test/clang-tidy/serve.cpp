@@ -0,0 +1,20 @@
+// RUN: mkdir -p %t-dir
+// RUN: printf 'int *A = 0;\n' > %t-dir/a.cpp
+// RUN: printf 'int B = 0;\n' > %t-dir/b.cpp
+// RUN: echo %t-dir/a.cpp > %t-dir/requests
+// RUN: echo %t-dir/b.cpp >> %t-dir/requests
+// RUN: echo >> %t-dir/requests
+// RUN: echo %t-dir/a.cpp >> %t-dir/requests
+// RUN: clang-tidy -serve -checks=-*,modernize-use-nullptr -- < %t-dir/requests | FileCheck %s
+// RUN: not clang-tidy -serve -fix -checks=-*,modernize-use-nullptr -- < %t-dir/requests 2>&1 | FileCheck -check-prefix=CHECK-FIX %s
+
+// There is a document per requested file, also without diagnostics, and the
+// last request ends with the input.
+// CHECK: MainSourceFile: {{.*}}a.cpp
+// CHECK: DiagnosticName: {{ *}}modernize-use-nullptr
+// CHECK: MainSourceFile: {{.*}}b.cpp
+// CHECK-NOT: DiagnosticName
+// CHECK: MainSourceFile: {{.*}}a.cpp
+// CHECK: DiagnosticName: {{ *}}modernize-use-nullptr
+
+// CHECK-FIX: Error: -serve can't be used with -executor, -fix
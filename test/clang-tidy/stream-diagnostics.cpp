@@ -0,0 +1,21 @@
+// RUN: mkdir -p %t-dir
+// RUN: printf '#include "header.h"\nint *A = 0;\n' > %t-dir/a.cpp
+// RUN: printf '#include "header.h"\nint *B = 0;\n' > %t-dir/b.cpp
+// RUN: printf 'int *H = 0;\n' > %t-dir/header.h
+// RUN: clang-tidy -stream-diagnostics -checks=-*,modernize-use-nullptr -header-filter=.* -export-fixes=%t-dir/fixes.yaml %t-dir/a.cpp %t-dir/b.cpp -- 2>&1 | FileCheck %s -implicit-check-not='warning:'
+// RUN: FileCheck -check-prefix=CHECK-YAML -input-file=%t-dir/fixes.yaml %s
+// RUN: not clang-tidy -stream-diagnostics -fix -checks=-*,modernize-use-nullptr %t-dir/a.cpp -- 2>&1 | FileCheck -check-prefix=CHECK-FIX %s
+
+// The diagnostics of each file are reported once it's processed, those of the
+// header only with the first file including it.
+// CHECK: a.cpp:2:10: warning: use nullptr [modernize-use-nullptr]
+// CHECK: header.h:1:10: warning: use nullptr [modernize-use-nullptr]
+// CHECK: b.cpp:2:10: warning: use nullptr [modernize-use-nullptr]
+
+// CHECK-YAML: MainSourceFile:{{.*}}a.cpp
+// CHECK-YAML: FilePath:{{.*}}a.cpp
+// CHECK-YAML: FilePath:{{.*}}header.h
+// CHECK-YAML: MainSourceFile:{{.*}}b.cpp
+// CHECK-YAML-NOT: header.h
+
+// CHECK-FIX: Error: -stream-diagnostics can't be used with -fix
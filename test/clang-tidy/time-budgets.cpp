@@ -0,0 +1,14 @@
+// RUN: clang-tidy -checks='-*,modernize-use-nullptr' -config='{CheckTimeBudget: 0}' %s -- -std=c++11 2>&1 | FileCheck -check-prefix=CHECK-BUDGET -implicit-check-not='{{warning|error}}:' %s
+// RUN: clang-tidy -checks='-*,modernize-use-nullptr' -config='{TranslationUnitTimeBudget: 0}' %s -- -std=c++11 2>&1 | FileCheck -check-prefix=TU-BUDGET -implicit-check-not='{{warning|error}}:' %s
+// RUN: clang-tidy -checks='-*,modernize-use-nullptr' -config='{CheckTimeBudget: 100000}' %s -- -std=c++11 2>&1 | FileCheck -check-prefix=NO-BUDGET -implicit-check-not='{{warning|error}}:' %s
+
+// The first match is handled, then the check is skipped.
+// CHECK-BUDGET: :1:1: warning: check exceeded its time budget of 0 ms, skipping it for the rest of the translation unit [modernize-use-nullptr]
+// CHECK-BUDGET: :[[@LINE+4]]:10: warning: use nullptr [modernize-use-nullptr]
+
+// TU-BUDGET: :1:1: warning: translation unit exceeded its time budget of 0 ms, skipping all checks for the rest of it [modernize-use-nullptr]
+// TU-BUDGET: :[[@LINE+1]]:10: warning: use nullptr [modernize-use-nullptr]
+int *p = 0;
+// NO-BUDGET: :[[@LINE-1]]:10: warning: use nullptr [modernize-use-nullptr]
+int *q = 0;
+// NO-BUDGET: :[[@LINE-1]]:10: warning: use nullptr [modernize-use-nullptr]
@@ -0,0 +1,21 @@
+// RUN: rm -rf %t
+// RUN: mkdir -p %t
+// RUN: echo 'foo f;' > %t/foo.cpp
+// RUN: echo 'bar b;' > %t/bar.cpp
+// RUN: clang-include-fixer -j 2 -export-fixes=%t/fixes.yaml -db=fixed -input='foo= "foo.h";bar= "bar.h"' %t/foo.cpp %t/bar.cpp --
+// RUN: FileCheck -input-file=%t/fixes.yaml %s
+// RUN: FileCheck -input-file=%t/foo.cpp %s -check-prefix=CHECK-UNCHANGED
+//
+// The replacements of both files are merged, in the order of the files.
+// CHECK:      ---
+// CHECK-NEXT: MainSourceFile: '{{.*}}foo.cpp'
+// CHECK:        - FilePath: '{{.*}}foo.cpp'
+// CHECK:          ReplacementText: {{.*}}#include \"foo.h\"
+// CHECK:      ---
+// CHECK-NEXT: MainSourceFile: '{{.*}}bar.cpp'
+// CHECK:        - FilePath: '{{.*}}bar.cpp'
+// CHECK:          ReplacementText: {{.*}}#include \"bar.h\"
+//
+// The files are left unchanged.
+// CHECK-UNCHANGED-NOT: #include
+// CHECK-UNCHANGED: foo f;
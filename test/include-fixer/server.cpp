@@ -0,0 +1,39 @@
+// REQUIRES: shell
+// RUN: rm -rf %t
+// RUN: mkdir -p %t
+// RUN: cp %p/Inputs/fake_yaml_db.yaml %t/db.yaml
+// RUN: echo 'b::a::foo f;' > %t/test.cpp
+//
+// The database file is changed once the first three requests are answered,
+// or after a minute, then the last request is sent.
+// RUN: (echo '{"FilePath": "%/t/test.cpp", "QuerySymbol": "b::a::foo"}'; \
+// RUN:  echo '{"FilePath": "%/t/test.cpp", "Code": "b::a::foo g;"}'; \
+// RUN:  echo 'not a request'; \
+// RUN:  for i in $(seq 600); do \
+// RUN:    [ "$(grep -c Content-Length %t/out 2>/dev/null)" = 3 ] && break; \
+// RUN:    sleep 0.1; \
+// RUN:  done; \
+// RUN:  sed -e 's/foo\.h/foo2.h/' %p/Inputs/fake_yaml_db.yaml > %t/db.yaml; \
+// RUN:  echo '{"FilePath": "%/t/test.cpp", "QuerySymbol": "b::a::foo"}') \
+// RUN:  | clang-include-fixer -server -db=yaml -input=%t/db.yaml %t/test.cpp -- > %t/out
+// RUN: FileCheck %s -input-file=%t/out
+
+// CHECK:      Content-Length:
+// CHECK:      "QuerySymbolInfos": [
+// CHECK-NEXT:    {"RawIdentifier": "b::a::foo",
+// CHECK:      "HeaderInfos": [
+// CHECK-NEXT:    {"Header": "\"foo.h\"",
+// CHECK-NEXT:     "QualifiedName": "b::a::foo"}
+
+// CHECK:      Content-Length:
+// CHECK:      "HeaderInfos": [
+// CHECK-NEXT:    {"Header": "\"foo.h\"",
+// CHECK-NEXT:     "QualifiedName": "b::a::foo"}
+
+// CHECK:      Content-Length:
+// CHECK:      {"Error": "Invalid request: not a request"}
+
+// CHECK:      Content-Length:
+// CHECK:      "HeaderInfos": [
+// CHECK-NEXT:    {"Header": "\"foo2.h\"",
+// CHECK-NEXT:     "QualifiedName": "b::a::foo"}
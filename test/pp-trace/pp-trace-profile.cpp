@@ -0,0 +1,23 @@
+// RUN: pp-trace -profile -flame-graph %t.folded %s -undef -target x86_64 -std=c++11 | FileCheck --strict-whitespace %s
+// RUN: FileCheck --check-prefix=FLAME %s < %t.folded
+
+#include "Inputs/Level1A.h"
+
+int A = MACRO_1A;
+int B = MACRO_2A + MACRO_2A;
+
+// CHECK: ---
+// CHECK-NEXT: Files:
+// CHECK-DAG: - File: "{{.*}}/pp-trace-profile.cpp"
+// CHECK-DAG: - File: "{{.*}}/Inputs/Level1A.h"
+// CHECK-DAG: - File: "{{.*}}/Inputs/Level2A.h"
+// CHECK: Macros:
+// CHECK-NEXT:   - Macro: MACRO_2A
+// CHECK-NEXT:     Expansions: 2
+// CHECK-NEXT:   - Macro: MACRO_1A
+// CHECK-NEXT:     Expansions: 1
+// CHECK-NEXT: ...
+
+// FLAME-DAG: {{.*}}/pp-trace-profile.cpp {{[0-9]+}}
+// FLAME-DAG: {{.*}}/pp-trace-profile.cpp;{{.*}}/Inputs/Level1A.h {{[0-9]+}}
+// FLAME-DAG: {{.*}}/pp-trace-profile.cpp;{{.*}}/Inputs/Level1A.h;{{.*}}/Inputs/Level2A.h {{[0-9]+}}
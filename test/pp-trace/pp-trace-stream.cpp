@@ -0,0 +1,19 @@
+// RUN: pp-trace -stream -ignore FileChanged,MacroDefined %s -undef -target x86_64 -std=c++11 | FileCheck --strict-whitespace %s
+
+#ident "$Id$"
+#if 1
+#endif
+
+// CHECK: ---
+// CHECK-NEXT: - Callback: Ident
+// CHECK-NEXT:   Loc: "{{.*}}{{[/\\]}}pp-trace-stream.cpp:3:2"
+// CHECK-NEXT:   Str: "$Id$"
+// CHECK-NEXT: - Callback: If
+// CHECK-NEXT:   Loc: "{{.*}}{{[/\\]}}pp-trace-stream.cpp:4:2"
+// CHECK-NEXT:   ConditionRange: ["{{.*}}{{[/\\]}}pp-trace-stream.cpp:4:4", "{{.*}}{{[/\\]}}pp-trace-stream.cpp:5:1"]
+// CHECK-NEXT:   ConditionValue: CVK_True
+// CHECK-NEXT: - Callback: Endif
+// CHECK-NEXT:   Loc: "{{.*}}{{[/\\]}}pp-trace-stream.cpp:5:2"
+// CHECK-NEXT:   IfLoc: "{{.*}}{{[/\\]}}pp-trace-stream.cpp:4:2"
+// CHECK-NEXT: - Callback: EndOfMainFile
+// CHECK-NEXT: ...
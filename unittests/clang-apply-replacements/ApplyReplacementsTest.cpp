@@ -9,6 +9,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "clang-apply-replacements/Tooling/ApplyReplacements.h"
+#include "clang-apply-replacements/Tooling/BinaryReplacements.h"
 #include "clang/Format/Format.h"
 #include "gtest/gtest.h"
 
@@ -51,5 +52,47 @@ TEST(ApplyReplacementsTest, mergeDiagnosticsWithNoFixes) {
   EXPECT_TRUE(ReplacementsMap.empty());
 }
 
+// Test that the fixes written in the binary format are read back, and that
+// the identical fixes of a file are only read once through a filter.
+TEST(ApplyReplacementsTest, binaryReplacementsRoundTrip) {
+  Replacements Header;
+  cantFail(Header.add(Replacement("path/to/header.h", 10, 2, "override")));
+  cantFail(Header.add(Replacement("path/to/header.h", 40, 0, "const ")));
+  Replacements Source(Replacement("path/to/source.cpp", 5, 1, "const "));
+  StringMap<Replacements> Fix;
+  Fix["path/to/header.h"] = Header;
+  Fix["path/to/source.cpp"] = Source;
+  TUDiagnostics Written =
+      makeTUDiagnostics("path/to/source.cpp", "diagnostic", {}, Fix, "path/to");
+
+  std::string Buffer;
+  raw_string_ostream OS(Buffer);
+  writeBinaryReplacements(Written.front(), OS);
+  writeBinaryReplacements(Written.front(), OS);
+  OS.flush();
+  EXPECT_TRUE(isBinaryReplacements(Buffer));
+
+  TUDiagnostics Read;
+  ASSERT_FALSE(llvm::errorToBool(readBinaryReplacements(Buffer, Read)));
+  ASSERT_EQ(2u, Read.size());
+  EXPECT_EQ("path/to/source.cpp", Read[0].MainSourceFile);
+  ASSERT_EQ(2u, Read[0].Diagnostics.size());
+  EXPECT_EQ(Header, Read[0].Diagnostics[0].Fix.lookup("path/to/header.h"));
+  EXPECT_EQ(Source, Read[0].Diagnostics[1].Fix.lookup("path/to/source.cpp"));
+
+  BinaryReplacementsFilter Filter;
+  TUDiagnostics Filtered;
+  ASSERT_FALSE(
+      llvm::errorToBool(readBinaryReplacements(Buffer, Filtered, &Filter)));
+  ASSERT_EQ(2u, Filtered.size());
+  EXPECT_EQ(2u, Filtered[0].Diagnostics.size());
+  EXPECT_TRUE(Filtered[1].Diagnostics.empty());
+
+  TUDiagnostics Malformed;
+  EXPECT_TRUE(llvm::errorToBool(
+      readBinaryReplacements(StringRef(Buffer).drop_back(), Malformed)));
+  EXPECT_EQ(1u, Malformed.size());
+}
+
 } // end namespace tooling
 } // end namespace clang
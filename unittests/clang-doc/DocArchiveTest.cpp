@@ -0,0 +1,63 @@
+//===-- clang-doc/DocArchiveTest.cpp --------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DocArchive.h"
+#include "llvm/Support/FileSystem.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace doc {
+
+TEST(DocArchiveTest, readWrittenDocs) {
+  llvm::SmallString<128> Directory;
+  ASSERT_FALSE(
+      llvm::sys::fs::createUniqueDirectory("clang-doc-archive", Directory));
+
+  DocArchiveWriter Writer(Directory);
+  std::vector<std::thread> Threads;
+  for (unsigned T = 0; T < 4; ++T)
+    Threads.emplace_back([&Writer, T]() {
+      for (unsigned I = 0; I < 100; ++I)
+        Writer.addDoc("A/" + std::to_string(T) + "/C" + std::to_string(I) +
+                          ".md",
+                      "# class C" + std::to_string(I) + "\n");
+    });
+  for (std::thread &Thread : Threads)
+    Thread.join();
+  Writer.addDoc("GlobalNamespace.md", "First");
+  Writer.addDoc("GlobalNamespace.md", std::string("Second\0", 7));
+  ASSERT_FALSE(llvm::errorToBool(Writer.close()));
+
+  auto Reader = DocArchiveReader::open(Directory);
+  ASSERT_TRUE(bool(Reader));
+  EXPECT_EQ(401u, Reader.get()->size());
+  EXPECT_EQ(llvm::Optional<StringRef>(StringRef("# class C42\n")),
+            Reader.get()->getDoc("A/3/C42.md"));
+  EXPECT_EQ(llvm::Optional<StringRef>(StringRef("Second\0", 7)),
+            Reader.get()->getDoc("GlobalNamespace.md"));
+  EXPECT_FALSE(Reader.get()->getDoc("A/C42.md"));
+
+  // A new archive replaces the previous one.
+  DocArchiveWriter Rewriter(Directory);
+  Rewriter.addDoc("B.md", "B");
+  ASSERT_FALSE(llvm::errorToBool(Rewriter.close()));
+  Reader = DocArchiveReader::open(Directory);
+  ASSERT_TRUE(bool(Reader));
+  EXPECT_EQ(1u, Reader.get()->size());
+  EXPECT_EQ(llvm::Optional<StringRef>(StringRef("B")),
+            Reader.get()->getDoc("B.md"));
+
+  llvm::sys::fs::remove_directories(Directory);
+}
+
+} // namespace doc
+} // namespace clang
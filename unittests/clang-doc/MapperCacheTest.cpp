@@ -0,0 +1,137 @@
+//===-- clang-doc/MapperCacheTest.cpp -------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MapperCache.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/FileManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace doc {
+
+class MapperCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    ASSERT_FALSE(
+        llvm::sys::fs::createUniqueDirectory("clang-doc-cache", Directory));
+    CacheDirectory = Directory;
+    llvm::sys::path::append(CacheDirectory, "cache");
+    ASSERT_FALSE(llvm::sys::fs::create_directory(CacheDirectory));
+  }
+
+  void TearDown() override { llvm::sys::fs::remove_directories(Directory); }
+
+  std::string writeFile(StringRef Name, StringRef Content) {
+    llvm::SmallString<128> Path(Directory);
+    llvm::sys::path::append(Path, Name);
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+    EXPECT_FALSE(EC);
+    OS << Content;
+    return Path.str();
+  }
+
+  // Stores Results as mapped from the TU of Main, which read the files of
+  // Read.
+  void store(MapperCache &Cache, StringRef Main,
+             ArrayRef<std::string> Read, const MapperResults &Results) {
+    FileManager Files((FileSystemOptions()));
+    DiagnosticsEngine Diags(new DiagnosticIDs, new DiagnosticOptions,
+                            new IgnoringDiagConsumer);
+    SourceManager SM(Diags, Files);
+    for (const std::string &Path : Read)
+      SM.createFileID(Files.getFile(Path), SourceLocation(), SrcMgr::C_User);
+    Cache.store(Main, "command", SM, Results);
+  }
+
+  llvm::SmallString<128> Directory;
+  llvm::SmallString<128> CacheDirectory;
+};
+
+TEST_F(MapperCacheTest, SkipsUnchangedTUs) {
+  std::string Main = writeFile("a.cpp", "#include \"h.h\"");
+  std::string Header = writeFile("h.h", "class H {};");
+  MapperResults Results = {{"usr1", "info1"}, {"usr2", "info2"}};
+  {
+    MapperCache Cache(CacheDirectory);
+    EXPECT_FALSE(Cache.lookup(Main, "command"));
+    store(Cache, Main, {Main, Header}, Results);
+  }
+
+  MapperCache Cache(CacheDirectory);
+  auto Cached = Cache.lookup(Main, "command");
+  ASSERT_TRUE(Cached);
+  EXPECT_EQ(Results, *Cached);
+  // The TU wasn't mapped again, so its infos are up to date.
+  EXPECT_FALSE(Cache.isChanged("usr1"));
+  EXPECT_FALSE(Cache.isChanged("usr2"));
+  // The TU is mapped again with another command.
+  EXPECT_FALSE(Cache.lookup(Main, "other command"));
+}
+
+TEST_F(MapperCacheTest, ChangedHeaderInvalidatesIncluders) {
+  std::string Includer = writeFile("a.cpp", "#include \"h.h\"");
+  std::string Other = writeFile("b.cpp", "class B {};");
+  std::string Header = writeFile("h.h", "class H {};");
+  {
+    MapperCache Cache(CacheDirectory);
+    store(Cache, Includer, {Includer, Header}, {{"usr1", "info1"}});
+    store(Cache, Other, {Other}, {{"usr2", "info2"}});
+  }
+
+  writeFile("h.h", "class H { int X; };");
+  MapperCache Cache(CacheDirectory);
+  EXPECT_FALSE(Cache.lookup(Includer, "command"));
+  EXPECT_TRUE(Cache.lookup(Other, "command"));
+}
+
+TEST_F(MapperCacheTest, RecordsChangedKeys) {
+  std::string Changed = writeFile("a.cpp", "class A {};");
+  std::string Unchanged = writeFile("b.cpp", "class B {};");
+  {
+    MapperCache Cache(CacheDirectory);
+    store(Cache, Changed, {Changed}, {{"usr1", "info1"}, {"usr2", "info2"}});
+    store(Cache, Unchanged, {Unchanged}, {{"usr3", "info3"}});
+  }
+
+  // Only a.cpp is mapped again. The infos it contributed to before are
+  // generated again too, they may have lost its contribution.
+  writeFile("a.cpp", "class A2 {};");
+  MapperCache Cache(CacheDirectory);
+  EXPECT_FALSE(Cache.lookup(Changed, "command"));
+  store(Cache, Changed, {Changed}, {{"usr2", "info2"}, {"usr4", "info4"}});
+  EXPECT_TRUE(Cache.lookup(Unchanged, "command"));
+  EXPECT_TRUE(Cache.isChanged("usr1"));
+  EXPECT_TRUE(Cache.isChanged("usr2"));
+  EXPECT_TRUE(Cache.isChanged("usr4"));
+  EXPECT_FALSE(Cache.isChanged("usr3"));
+}
+
+TEST_F(MapperCacheTest, GeneratedStamp) {
+  {
+    MapperCache Cache(CacheDirectory);
+    EXPECT_FALSE(Cache.takeGenerated("yaml docs"));
+    Cache.setGenerated("yaml docs");
+  }
+  {
+    MapperCache Cache(CacheDirectory);
+    EXPECT_TRUE(Cache.takeGenerated("yaml docs"));
+    // Until the docs are generated again, e.g. if this run fails.
+    EXPECT_FALSE(Cache.takeGenerated("yaml docs"));
+    Cache.setGenerated("yaml docs");
+  }
+  MapperCache Cache(CacheDirectory);
+  EXPECT_FALSE(Cache.takeGenerated("md docs"));
+}
+
+} // namespace doc
+} // namespace clang
@@ -0,0 +1,26 @@
+//===-- clang-doc/MapperTest.cpp ------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Mapper.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace doc {
+
+TEST(MapperTest, reportedResultsDeduplicateIdenticalResults) {
+  ReportedResults Reported;
+  EXPECT_TRUE(Reported.insert("0123", "Value"));
+  EXPECT_FALSE(Reported.insert("0123", "Value"));
+  EXPECT_TRUE(Reported.insert("0123", "OtherValue"));
+  EXPECT_TRUE(Reported.insert("4567", "Value"));
+  EXPECT_FALSE(Reported.insert("4567", "Value"));
+}
+
+} // namespace doc
+} // namespace clang
@@ -0,0 +1,57 @@
+//===-- clang-doc/ResultStoreTest.cpp -------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ResultStore.h"
+#include "llvm/Support/FileSystem.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <map>
+
+namespace clang {
+namespace doc {
+
+TEST(ResultStoreTest, readGroupedPartitions) {
+  llvm::SmallString<128> Directory;
+  ASSERT_FALSE(
+      llvm::sys::fs::createUniqueDirectory("clang-doc-results", Directory));
+
+  // Two processes sharing the directory.
+  ResultStoreWriter First(Directory);
+  First.addResult("00aa", "One");
+  First.addResult("ff00", "Two");
+  ASSERT_FALSE(llvm::errorToBool(First.close()));
+  ResultStoreWriter Second(Directory);
+  Second.addResult("00aa", "Three");
+  Second.addResult("00bb", std::string("Four\0", 5));
+  ASSERT_FALSE(llvm::errorToBool(Second.close()));
+
+  std::vector<std::map<std::string, std::vector<std::string>>> Partitions;
+  ASSERT_FALSE(llvm::errorToBool(readResultPartitions(
+      Directory, [&](llvm::StringMap<std::vector<StringRef>> &Groups) {
+        Partitions.emplace_back();
+        for (const auto &Group : Groups)
+          for (StringRef Value : Group.getValue())
+            Partitions.back()[Group.getKey().str()].push_back(Value.str());
+        return llvm::Error::success();
+      })));
+
+  ASSERT_EQ(2u, Partitions.size());
+  EXPECT_EQ(2u, Partitions[0].size());
+  auto Values = Partitions[0]["00aa"];
+  std::sort(Values.begin(), Values.end());
+  EXPECT_EQ(std::vector<std::string>({"One", "Three"}), Values);
+  EXPECT_EQ(std::vector<std::string>({std::string("Four\0", 5)}),
+            Partitions[0]["00bb"]);
+  EXPECT_EQ(std::vector<std::string>({"Two"}), Partitions[1]["ff00"]);
+
+  llvm::sys::fs::remove_directories(Directory);
+}
+
+} // namespace doc
+} // namespace clang
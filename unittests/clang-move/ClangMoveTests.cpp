@@ -248,6 +248,34 @@ runClangMoveOnCode(const move::MoveDefinitionSpec &Spec,
   return Results;
 }
 
+// Runs the moves of Specs against a single parse of TestCC, returning the
+// replacements of each move.
+std::vector<std::map<std::string, tooling::Replacements>>
+runClangMovesOnCode(llvm::ArrayRef<move::MoveDefinitionSpec> Specs) {
+  clang::RewriterTestContext Context;
+  Context.InMemoryFileSystem->setCurrentWorkingDirectory(WorkingDir);
+  Context.createInMemoryFile(TestHeaderName, TestHeader);
+  Context.createInMemoryFile(TestCCName, TestCC);
+
+  std::vector<std::map<std::string, tooling::Replacements>> FileToReplacements(
+      Specs.size());
+  std::vector<ClangMoveContext> MoveContexts;
+  for (size_t I = 0; I < Specs.size(); ++I)
+    MoveContexts.push_back(
+        {Specs[I], FileToReplacements[I], WorkingDir, "LLVM", false});
+  std::vector<ClangMoveContext *> MoveContextPtrs;
+  for (ClangMoveContext &MoveContext : MoveContexts)
+    MoveContextPtrs.push_back(&MoveContext);
+
+  auto Factory =
+      llvm::make_unique<clang::move::ClangMoveActionFactory>(MoveContextPtrs);
+  tooling::runToolOnCodeWithArgs(
+      Factory->create(), TestCC, Context.InMemoryFileSystem,
+      {"-std=c++11", "-fparse-all-comments", "-I."}, TestCCName, "clang-move",
+      std::make_shared<PCHContainerOperations>());
+  return FileToReplacements;
+}
+
 TEST(ClangMove, MoveHeaderAndCC) {
   move::MoveDefinitionSpec Spec;
   Spec.Names = {std::string("a::b::Foo")};
@@ -639,3 +667,22 @@ TEST(ClangMove, DumpDecls) {
 } // namespace
 } // namespce move
 } // namespace clang
+
+TEST(ClangMove, MovesSharingParse) {
+  move::MoveDefinitionSpec Spec;
+  Spec.Names = {std::string("a::b::Foo")};
+  Spec.OldHeader = "foo.h";
+  Spec.OldCC = "foo.cc";
+  Spec.NewHeader = "new_foo.h";
+  Spec.NewCC = "new_foo.cc";
+  move::MoveDefinitionSpec Spec2 = Spec;
+  Spec2.Names = {std::string("a::b::Foo2")};
+  Spec2.NewHeader = "new_foo2.h";
+  Spec2.NewCC = "new_foo2.cc";
+
+  // Each move gets the replacements it gets when run on its own.
+  auto Results = runClangMovesOnCode({Spec, Spec2});
+  ASSERT_EQ(2u, Results.size());
+  EXPECT_EQ(runClangMovesOnCode(Spec).front(), Results[0]);
+  EXPECT_EQ(runClangMovesOnCode(Spec2).front(), Results[1]);
+}
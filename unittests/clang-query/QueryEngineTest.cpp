@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Query.h"
+#include "QueryBatch.h"
 #include "QueryParser.h"
 #include "QuerySession.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
@@ -160,3 +161,55 @@ TEST_F(QueryEngineTest, LetAndMatch) {
             "1:10: Value not found: x\n", OS.str());
   Str.clear();
 }
+
+TEST_F(QueryEngineTest, Profile) {
+  DynTypedMatcher FooMatcher = functionDecl(hasName("foo1"));
+
+  EXPECT_TRUE(SetQuery<bool>(&QuerySession::Profile, true).run(OS, S));
+  EXPECT_TRUE(MatchQuery("functionDecl(hasName(\"foo1\"))", FooMatcher)
+                  .run(OS, S));
+
+  EXPECT_TRUE(OS.str().find("Profile of functionDecl(hasName(\"foo1\")):") !=
+              std::string::npos);
+  EXPECT_TRUE(OS.str().find("foo.cc: ") != std::string::npos);
+  EXPECT_TRUE(OS.str().find("s wall, ") != std::string::npos);
+  // Each AST has two function declarations, and foo1 is matched once.
+  EXPECT_TRUE(OS.str().find("2 candidate nodes, 1 match\n") !=
+              std::string::npos);
+  EXPECT_TRUE(OS.str().find("Total: ") != std::string::npos);
+  EXPECT_TRUE(OS.str().find("4 candidate nodes, 1 match\n") !=
+              std::string::npos);
+}
+
+TEST(BatchQueryRunnerTest, CountsMatchesOnce) {
+  QuerySession S(None);
+  std::string Str;
+  llvm::raw_string_ostream OS(Str);
+  BatchQueryRunner Runner(S, /*CountOnly=*/false);
+  QueryRef Q = QueryParser::parse("match functionDecl()", S);
+  EXPECT_TRUE(Runner.addQuery(Q, OS));
+  EXPECT_EQ("", OS.str());
+
+  // The same file built twice stands for a header included twice: its
+  // matches are only counted for the first one.
+  auto BuildAST = [](StringRef File) {
+    return buildASTFromCode(File == "bar.cc" ? "void bar(void) {}"
+                                             : "void foo1(void) {}\n"
+                                               "void foo2(void) {}",
+                            File);
+  };
+  std::vector<std::string> Files = {"foo.cc", "bar.cc", "foo.cc"};
+  EXPECT_TRUE(Runner.run(Files, BuildAST, /*Threads=*/2, OS));
+  EXPECT_TRUE(OS.str().find("Match #3:") != std::string::npos);
+  EXPECT_TRUE(OS.str().find("Match #4:") == std::string::npos);
+  EXPECT_TRUE(OS.str().find("3 matches.") != std::string::npos);
+}
+
+TEST(BatchQueryRunnerTest, InvalidMatcher) {
+  QuerySession S(None);
+  std::string Str;
+  llvm::raw_string_ostream OS(Str);
+  BatchQueryRunner Runner(S, /*CountOnly=*/true);
+  EXPECT_FALSE(Runner.addQuery(new MatchQuery("isMain()", isMain()), OS));
+  EXPECT_EQ("Not a valid top-level matcher.\n", OS.str());
+}
@@ -0,0 +1,44 @@
+//===---- ClangTidyAllocationsTest.cpp - clang-tidy -----------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidyAllocations.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace tidy {
+namespace test {
+
+// The test binary doesn't replace operator new, so allocations are recorded
+// by hand.
+TEST(ClangTidyAllocations, NestedScopes) {
+  AllocationCount Outer, Inner;
+  AllocationScope::recordAllocation(1);
+  {
+    AllocationScope OuterScope(Outer);
+    AllocationScope::recordAllocation(10);
+    EXPECT_EQ(0u, Outer.Calls) << "tracking isn't enabled";
+    enableAllocationTracking();
+    AllocationScope::recordAllocation(100);
+    {
+      AllocationScope InnerScope(Inner);
+      AllocationScope::recordAllocation(1000);
+      AllocationScope::recordAllocation(1000);
+    }
+    AllocationScope::recordAllocation(100);
+  }
+  AllocationScope::recordAllocation(1);
+  EXPECT_EQ(2000u, Inner.Bytes);
+  EXPECT_EQ(2u, Inner.Calls);
+  EXPECT_EQ(2200u, Outer.Bytes);
+  EXPECT_EQ(4u, Outer.Calls);
+}
+
+} // namespace test
+} // namespace tidy
+} // namespace clang
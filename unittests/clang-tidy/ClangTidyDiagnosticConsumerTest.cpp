@@ -29,6 +29,31 @@ TEST(ClangTidyDiagnosticConsumer, SortsErrors) {
   EXPECT_EQ("variable", Errors[1].Message.Message);
 }
 
+class FooCheck : public ClangTidyCheck {
+public:
+  FooCheck(StringRef Name, ClangTidyContext *Context)
+      : ClangTidyCheck(Name, Context) {}
+  bool isApplicable(const ASTContext &Context) const override {
+    return mentionsIdentifier(Context, "foo");
+  }
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override {
+    Finder->addMatcher(ast_matchers::varDecl().bind("var"), this);
+  }
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override {
+    diag(Result.Nodes.getNodeAs<VarDecl>("var")->getLocation(), "variable");
+  }
+};
+
+TEST(ClangTidyCheck, SkipsInapplicableChecks) {
+  std::vector<ClangTidyError> Errors;
+  runCheckOnCode<FooCheck>("int a;", &Errors);
+  EXPECT_EQ(0ul, Errors.size());
+  runCheckOnCode<FooCheck>("int a;\n#define foo", &Errors);
+  EXPECT_EQ(1ul, Errors.size());
+  runCheckOnCode<FooCheck>("int foo, b;", &Errors);
+  EXPECT_EQ(2ul, Errors.size());
+}
+
 TEST(GlobList, Empty) {
   GlobList Filter("");
 
@@ -1,6 +1,9 @@
 #include "ClangTidyOptions.h"
 #include "gtest/gtest.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 
 namespace clang {
 namespace tidy {
@@ -54,6 +57,52 @@ TEST(ParseLineFilter, ValidFilter) {
   EXPECT_EQ(1000u, Options.LineFilter[2].LineRanges[0].second);
 }
 
+TEST(ParseUnifiedDiff, AddedLines) {
+  ClangTidyGlobalOptions Options;
+  std::error_code Error = parseUnifiedDiff(
+      "diff --git a/dir/file1.cpp b/dir/file1.cpp\n"
+      "--- a/dir/file1.cpp\n"
+      "+++ b/dir/file1.cpp\n"
+      "@@ -1,3 +1,5 @@\n"
+      " int a;\n"
+      "-int b;\n"
+      "+int b2;\n"
+      "+++ c;\n"
+      " int d;\n"
+      "+int e;\n"
+      "@@ -10 +11,0 @@\n"
+      "-int f;\n"
+      "--- a/file2.h\n"
+      "+++ b/file2.h\n"
+      "@@ -7,0 +8 @@\n"
+      "+int g;\n"
+      "--- a/removed.h\n"
+      "+++ /dev/null\n"
+      "@@ -1 +0,0 @@\n"
+      "-int h;\n",
+      1, Options);
+  EXPECT_FALSE(Error);
+  ASSERT_EQ(2u, Options.LineFilter.size());
+  EXPECT_EQ("dir/file1.cpp", Options.LineFilter[0].Name);
+  ASSERT_EQ(2u, Options.LineFilter[0].LineRanges.size());
+  EXPECT_EQ(2u, Options.LineFilter[0].LineRanges[0].first);
+  EXPECT_EQ(3u, Options.LineFilter[0].LineRanges[0].second);
+  EXPECT_EQ(5u, Options.LineFilter[0].LineRanges[1].first);
+  EXPECT_EQ(5u, Options.LineFilter[0].LineRanges[1].second);
+  EXPECT_EQ("file2.h", Options.LineFilter[1].Name);
+  ASSERT_EQ(1u, Options.LineFilter[1].LineRanges.size());
+  EXPECT_EQ(8u, Options.LineFilter[1].LineRanges[0].first);
+  EXPECT_EQ(8u, Options.LineFilter[1].LineRanges[0].second);
+}
+
+TEST(ParseUnifiedDiff, InvalidDiff) {
+  ClangTidyGlobalOptions Options;
+  EXPECT_TRUE(!!parseUnifiedDiff("+++ b/file.cpp\n@@ -1 +x @@\n", 1, Options));
+  EXPECT_TRUE(
+      !!parseUnifiedDiff("+++ b/file.cpp\n@@ -1 +1,2 @@\n+int a;\n", 1,
+                         Options));
+}
+
 TEST(ParseConfiguration, ValidConfiguration) {
   llvm::ErrorOr<ClangTidyOptions> Options =
       parseConfiguration("Checks: \"-*,misc-*\"\n"
@@ -66,6 +115,28 @@ TEST(ParseConfiguration, ValidConfiguration) {
   EXPECT_EQ("some.user", *Options->User);
 }
 
+TEST(ParseConfiguration, Budgets) {
+  llvm::ErrorOr<ClangTidyOptions> Options1 =
+      parseConfiguration("CheckTimeBudget: 100\n"
+                         "TranslationUnitTimeBudget: 1000\n"
+                         "TranslationUnitMemoryBudget: 512");
+  ASSERT_TRUE(!!Options1);
+  EXPECT_EQ(100u, *Options1->CheckTimeBudget);
+  EXPECT_EQ(1000u, *Options1->TranslationUnitTimeBudget);
+  EXPECT_EQ(512u, *Options1->TranslationUnitMemoryBudget);
+  EXPECT_FALSE(Options1->AnalyzerNodeBudget.hasValue());
+
+  llvm::ErrorOr<ClangTidyOptions> Options2 =
+      parseConfiguration("CheckTimeBudget: 200\n"
+                         "AnalyzerNodeBudget: 10000");
+  ASSERT_TRUE(!!Options2);
+  ClangTidyOptions Options = Options1->mergeWith(*Options2);
+  EXPECT_EQ(200u, *Options.CheckTimeBudget);
+  EXPECT_EQ(1000u, *Options.TranslationUnitTimeBudget);
+  EXPECT_EQ(512u, *Options.TranslationUnitMemoryBudget);
+  EXPECT_EQ(10000u, *Options.AnalyzerNodeBudget);
+}
+
 TEST(ParseConfiguration, MergeConfigurations) {
   llvm::ErrorOr<ClangTidyOptions> Options1 = parseConfiguration(R"(
       Checks: "check1,check2"
@@ -97,6 +168,51 @@ TEST(ParseConfiguration, MergeConfigurations) {
             llvm::join(Options.ExtraArgsBefore->begin(),
                        Options.ExtraArgsBefore->end(), ","));
 }
+
+static void writeFile(llvm::StringRef Path, llvm::StringRef Contents) {
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path, EC, llvm::sys::fs::F_None);
+  ASSERT_FALSE(EC);
+  OS << Contents;
+}
+
+TEST(FileOptionsProvider, ConfigCache) {
+  llvm::SmallString<128> Root;
+  ASSERT_FALSE(
+      llvm::sys::fs::createUniqueDirectory("clang-tidy-config-cache", Root));
+  llvm::SmallString<128> Project(Root), Source(Root), Config(Root),
+      Cache(Root);
+  llvm::sys::path::append(Project, "project", "src");
+  ASSERT_FALSE(llvm::sys::fs::create_directories(Project));
+  llvm::sys::path::append(Source, "project", "src", "file.cpp");
+  llvm::sys::path::append(Config, "project", ".clang-tidy");
+  llvm::sys::path::append(Cache, "cache");
+  writeFile(Config, "Checks: 'check1'\n");
+
+  auto getChecks = [&]() {
+    FileOptionsProvider Provider(ClangTidyGlobalOptions(), ClangTidyOptions(),
+                                 ClangTidyOptions());
+    Provider.setConfigCacheDirectory(Cache);
+    return Provider.getOptions(Source).Checks.getValueOr("");
+  };
+  EXPECT_EQ("check1", getChecks());
+  // Another process reads the stored configuration.
+  EXPECT_EQ("check1", getChecks());
+  std::error_code EC;
+  EXPECT_NE(llvm::sys::fs::directory_iterator(Cache, EC),
+            llvm::sys::fs::directory_iterator());
+
+  // The changed configuration files invalidate the stored configuration.
+  writeFile(Config, "Checks: 'check1,check2'\n");
+  EXPECT_EQ("check1,check2", getChecks());
+  llvm::SmallString<128> SourceConfig(Project);
+  llvm::sys::path::append(SourceConfig, ".clang-tidy");
+  writeFile(SourceConfig, "Checks: 'check3'\n");
+  EXPECT_EQ("check3", getChecks());
+
+  llvm::sys::fs::remove_directories(Root);
+}
+
 } // namespace test
 } // namespace tidy
 } // namespace clang
@@ -40,13 +40,31 @@ private:
     Context.setCurrentFile(File);
     Context.setASTContext(&Compiler.getASTContext());
 
-    for (auto &Check : Checks) {
-      Check->registerMatchers(&Finder);
+    for (auto &Check : Checks)
       Check->registerPPCallbacks(Compiler);
-    }
-    return Finder.newASTConsumer();
+    return llvm::make_unique<MatchConsumer>(Checks, Finder);
   }
 
+  // Registers the matchers of the applicable checks once the file is parsed,
+  // as ClangTidyASTConsumer does.
+  class MatchConsumer : public ASTConsumer {
+  public:
+    MatchConsumer(SmallVectorImpl<std::unique_ptr<ClangTidyCheck>> &Checks,
+                  ast_matchers::MatchFinder &Finder)
+        : Checks(Checks), Finder(Finder) {}
+
+    void HandleTranslationUnit(ASTContext &Context) override {
+      for (auto &Check : Checks)
+        if (Check->isApplicable(Context))
+          Check->registerMatchers(&Finder);
+      Finder.matchAST(Context);
+    }
+
+  private:
+    SmallVectorImpl<std::unique_ptr<ClangTidyCheck>> &Checks;
+    ast_matchers::MatchFinder &Finder;
+  };
+
   SmallVectorImpl<std::unique_ptr<ClangTidyCheck>> &Checks;
   ast_matchers::MatchFinder &Finder;
   ClangTidyContext &Context;
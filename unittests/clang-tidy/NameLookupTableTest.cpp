@@ -0,0 +1,89 @@
+//===---- NameLookupTableTest.cpp - clang-tidy ----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../clang-tidy/utils/Matchers.h"
+
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace tidy {
+namespace utils {
+
+using namespace ast_matchers;
+
+namespace {
+
+const char Code[] = "namespace std {\n"
+                    "inline namespace __1 {\n"
+                    "template <typename T> struct vector {\n"
+                    "  void push_back(const T &);\n"
+                    "};\n"
+                    "}\n"
+                    "int remove();\n"
+                    "}\n"
+                    "namespace other {\n"
+                    "int remove();\n"
+                    "struct S { bool operator==(const S &) const; };\n"
+                    "}\n"
+                    "extern \"C\" int atoi(const char *);\n";
+
+/// Returns the names of the declarations of \p Code that the table of
+/// \p Names matches.
+std::vector<std::string> matchedNames(std::vector<std::string> Names) {
+  std::unique_ptr<ASTUnit> AST = tooling::buildASTFromCode(Code);
+  std::vector<std::string> Matched;
+  for (const auto &Nodes :
+       match(decl(forEachDescendant(
+                 namedDecl(unless(classTemplateDecl()),
+                           matchers::hasAnyListedName(Names))
+                     .bind("decl"))),
+             *AST->getASTContext().getTranslationUnitDecl(),
+             AST->getASTContext()))
+    Matched.push_back(
+        Nodes.getNodeAs<NamedDecl>("decl")->getQualifiedNameAsString());
+  return Matched;
+}
+
+} // namespace
+
+TEST(NameLookupTableTest, FullyQualifiedNames) {
+  EXPECT_EQ(std::vector<std::string>({"std::remove"}),
+            matchedNames({"::std::remove"}));
+  EXPECT_EQ(std::vector<std::string>(), matchedNames({"::remove"}));
+  EXPECT_EQ(std::vector<std::string>({"atoi"}), matchedNames({"::atoi"}));
+}
+
+TEST(NameLookupTableTest, UnqualifiedNames) {
+  EXPECT_EQ(std::vector<std::string>({"std::remove", "other::remove"}),
+            matchedNames({"remove"}));
+  EXPECT_EQ(std::vector<std::string>({"other::remove"}),
+            matchedNames({"other::remove", "other::missing"}));
+}
+
+TEST(NameLookupTableTest, InlineNamespaces) {
+  EXPECT_EQ(std::vector<std::string>({"std::__1::vector"}),
+            matchedNames({"::std::vector"}));
+  EXPECT_EQ(std::vector<std::string>({"std::__1::vector"}),
+            matchedNames({"::std::__1::vector"}));
+  EXPECT_EQ(std::vector<std::string>({"std::__1::vector::push_back"}),
+            matchedNames({"::std::vector::push_back"}));
+}
+
+TEST(NameLookupTableTest, NonIdentifierNames) {
+  EXPECT_EQ(std::vector<std::string>({"other::S::operator=="}),
+            matchedNames({"::other::S::operator=="}));
+}
+
+} // namespace utils
+} // namespace tidy
+} // namespace clang
@@ -1,9 +1,13 @@
 #include "SyncAPI.h"
 #include "TestFS.h"
 #include "index/Background.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/ScopedPrinter.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <thread>
 
 using testing::_;
 using testing::AllOf;
@@ -115,6 +119,93 @@ TEST(BackgroundIndexTest, IndexTwoFiles) {
                        FileURI("unittest:///root/B.cc")}));
 }
 
+TEST(BackgroundIndexTest, ReadsSharedHeadersOnce) {
+  // Counts the files opened on a single filesystem.
+  class CountingFS : public vfs::ProxyFileSystem {
+  public:
+    CountingFS(IntrusiveRefCntPtr<vfs::FileSystem> FS, StringMap<int> &Opens)
+        : ProxyFileSystem(std::move(FS)), Opens(Opens) {}
+    ErrorOr<std::unique_ptr<vfs::File>>
+    openFileForRead(const Twine &Path) override {
+      ++Opens[sys::path::filename(Path.str())];
+      return ProxyFileSystem::openFileForRead(Path);
+    }
+
+  private:
+    StringMap<int> &Opens;
+  };
+  class FixedFSProvider : public FileSystemProvider {
+  public:
+    IntrusiveRefCntPtr<vfs::FileSystem> getFileSystem() const override {
+      return FS;
+    }
+    IntrusiveRefCntPtr<vfs::FileSystem> FS;
+  };
+
+  StringMap<std::string> Files;
+  Files[testPath("root/A.h")] = "void common();";
+  Files[testPath("root/A.cc")] = "#include \"A.h\"";
+  Files[testPath("root/B.cc")] = "#include \"A.h\"";
+  StringMap<int> Opens;
+  FixedFSProvider FS;
+  FS.FS = new CountingFS(buildTestFS(Files), Opens);
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                      [&](llvm::StringRef) { return &MSS; },
+                      /*LazyRefs=*/false, /*ThreadPoolSize=*/1);
+
+  tooling::CompileCommand Cmd;
+  Cmd.Directory = testPath("root");
+  for (StringRef File : {"A.cc", "B.cc"}) {
+    Cmd.Filename = testPath(("root/" + File).str());
+    Cmd.CommandLine = {"clang++", Cmd.Filename};
+    CDB.setCompileCommand(Cmd.Filename, Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  }
+  EXPECT_THAT(runFuzzyFind(Idx, "common"),
+              UnorderedElementsAre(Named("common")));
+  EXPECT_EQ(Opens.lookup("A.h"), 1);
+  EXPECT_EQ(Opens.lookup("A.cc"), 1);
+  EXPECT_EQ(Opens.lookup("B.cc"), 1);
+}
+
+TEST(BackgroundIndexTest, IndexesUncoveredHeaders) {
+  // Knows the command of A.cc, in the project at root/.
+  class ProjectCDB : public GlobalCompilationDatabase {
+  public:
+    llvm::Optional<tooling::CompileCommand>
+    getCompileCommand(PathRef File, ProjectInfo *Project) const override {
+      if (File != testPath("root/A.cc"))
+        return None;
+      if (Project)
+        Project->SourceRoot = testPath("root");
+      return tooling::CompileCommand(testPath("root"), File,
+                                     {"clang++", "-DX=1", File}, "");
+    }
+  };
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"";
+  FS.Files[testPath("root/A.h")] = "void a();";
+  // Not included by any TU. The flags of A.cc are used.
+  FS.Files[testPath("root/B.h")] = "#if X\nclass B {};\n#endif";
+  FS.Files[testPath("root/B.txt")] = "";
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  ProjectCDB CDB;
+  BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                      [&](llvm::StringRef) { return &MSS; });
+  Idx.enqueue(std::vector<std::string>{testPath("root/A.cc")});
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+
+  EXPECT_THAT(runFuzzyFind(Idx, ""),
+              UnorderedElementsAre(Named("a"), Named("B")));
+  EXPECT_EQ(Storage.count(testPath("root/B.h")), 1u);
+}
+
 TEST(BackgroundIndexTest, ShardStorageWriteTest) {
   MockFSProvider FS;
   FS.Files[testPath("root/A.h")] = R"cpp(
@@ -163,5 +254,366 @@ TEST(BackgroundIndexTest, ShardStorageWriteTest) {
   EXPECT_EQ(*ShardSource->Digest, Digest);
 }
 
+TEST(BackgroundIndexTest, LoadsUnchangedShards) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "void common();\nclass A_CC {};";
+  FS.Files[testPath("root/A.cc")] =
+      "#include \"A.h\"\nvoid g() { (void)common; }";
+
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+
+  tooling::CompileCommand Cmd;
+  Cmd.Filename = testPath("root/A.cc");
+  Cmd.Directory = testPath("root");
+  Cmd.CommandLine = {"clang++", testPath("root/A.cc")};
+  {
+    OverlayCDB CDB(/*Base=*/nullptr);
+    BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                        [&](llvm::StringRef) { return &MSS; });
+    CDB.setCompileCommand(testPath("root"), Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  }
+  EXPECT_EQ(CacheHits, 0U);
+  auto ShardSource = MSS.loadShard(testPath("root/A.cc"));
+  ASSERT_NE(ShardSource, nullptr);
+  ASSERT_TRUE(ShardSource->Dependencies);
+  EXPECT_EQ(ShardSource->Dependencies->count(testPath("root/A.h")), 1U);
+  CacheHits = 0;
+
+  // Nothing changed, the symbols come from the stored shards of A.cc and A.h.
+  {
+    OverlayCDB CDB(/*Base=*/nullptr);
+    BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                        [&](llvm::StringRef) { return &MSS; });
+    CDB.setCompileCommand(testPath("root"), Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+    EXPECT_EQ(CacheHits, 2U);
+    EXPECT_THAT(runFuzzyFind(Idx, ""),
+                UnorderedElementsAre(Named("common"), Named("A_CC")));
+  }
+
+  // A.h changed, so A.cc is indexed again.
+  FS.Files[testPath("root/A.h")] = "void common();\nclass A_CC2 {};";
+  {
+    OverlayCDB CDB(/*Base=*/nullptr);
+    BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                        [&](llvm::StringRef) { return &MSS; });
+    CDB.setCompileCommand(testPath("root"), Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+    EXPECT_THAT(runFuzzyFind(Idx, ""),
+                UnorderedElementsAre(Named("common"), Named("A_CC2")));
+  }
+}
+
+TEST(BackgroundIndexTest, ReloadsShardsAfterMacroHeaderChanges) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/config.h")] = "#define USE_FOO 1";
+  FS.Files[testPath("root/A.cc")] =
+      "#include \"config.h\"\n#if USE_FOO\nvoid foo();\n#else\nvoid bar();\n"
+      "#endif";
+
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+
+  tooling::CompileCommand Cmd;
+  Cmd.Filename = testPath("root/A.cc");
+  Cmd.Directory = testPath("root");
+  Cmd.CommandLine = {"clang++", testPath("root/A.cc")};
+  {
+    OverlayCDB CDB(/*Base=*/nullptr);
+    BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                        [&](llvm::StringRef) { return &MSS; });
+    CDB.setCompileCommand(testPath("root"), Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  }
+  // config.h has no symbols, but A.cc still depends on it.
+  auto ShardSource = MSS.loadShard(testPath("root/A.cc"));
+  ASSERT_NE(ShardSource, nullptr);
+  ASSERT_TRUE(ShardSource->Dependencies);
+  EXPECT_EQ(ShardSource->Dependencies->count(testPath("root/config.h")), 1U);
+
+  // The stored shard of A.cc is stale once config.h changes.
+  FS.Files[testPath("root/config.h")] = "#define USE_FOO 0";
+  {
+    OverlayCDB CDB(/*Base=*/nullptr);
+    BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                        [&](llvm::StringRef) { return &MSS; });
+    CDB.setCompileCommand(testPath("root"), Cmd);
+    ASSERT_TRUE(Idx.blockUntilIdleForTest());
+    EXPECT_THAT(runFuzzyFind(Idx, ""), UnorderedElementsAre(Named("bar")));
+  }
+}
+
+TEST(BackgroundIndexTest, LazyRefs) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "void common();";
+  FS.Files[testPath("root/A.cc")] =
+      "#include \"A.h\"\nvoid g() { (void)common; }";
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                      [&](llvm::StringRef) { return &MSS; },
+                      /*LazyRefs=*/true);
+
+  tooling::CompileCommand Cmd;
+  Cmd.Filename = testPath("root/A.cc");
+  Cmd.Directory = testPath("root");
+  Cmd.CommandLine = {"clang++", testPath("root/A.cc")};
+  CDB.setCompileCommand(testPath("root"), Cmd);
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+
+  auto Syms = runFuzzyFind(Idx, "common");
+  ASSERT_THAT(Syms, UnorderedElementsAre(Named("common")));
+  SymbolID Common = Syms.begin()->ID;
+  EXPECT_EQ(CacheHits, 0U);
+  auto CommonRefs = RefsAre(
+      {FileURI("unittest:///root/A.h"), FileURI("unittest:///root/A.cc")});
+  // The refs are read from the shards of A.h and A.cc.
+  EXPECT_THAT(getRefs(Idx, Common), CommonRefs);
+  EXPECT_EQ(CacheHits, 2U);
+  // Then they are cached.
+  EXPECT_THAT(getRefs(Idx, Common), CommonRefs);
+  EXPECT_EQ(CacheHits, 2U);
+
+  Idx.dropCachedRefs();
+  EXPECT_THAT(getRefs(Idx, Common), CommonRefs);
+  EXPECT_EQ(CacheHits, 4U);
+}
+
+TEST(BackgroundIndexTest, ReindexesDependentsOfChangedFiles) {
+  MockFSProvider FS;
+  FS.Files[testPath("root/A.h")] = "class A_CC {};";
+  FS.Files[testPath("root/B.h")] = "class B_CC {};";
+  FS.Files[testPath("root/A.cc")] = "#include \"A.h\"";
+  llvm::StringMap<std::string> Storage;
+  size_t CacheHits = 0;
+  MemoryShardStorage MSS(Storage, CacheHits);
+  OverlayCDB CDB(/*Base=*/nullptr);
+  BackgroundIndex Idx(Context::empty(), "", FS, CDB,
+                      [&](llvm::StringRef) { return &MSS; });
+
+  tooling::CompileCommand Cmd;
+  Cmd.Filename = testPath("root/A.cc");
+  Cmd.Directory = testPath("root");
+  Cmd.CommandLine = {"clang++", testPath("root/A.cc")};
+  CDB.setCompileCommand(testPath("root"), Cmd);
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  EXPECT_THAT(runFuzzyFind(Idx, ""), UnorderedElementsAre(Named("A_CC")));
+
+  // A.cc doesn't include B.h.
+  FS.Files[testPath("root/B.h")] = "class B2_CC {};";
+  Idx.filesChanged({testPath("root/B.h")});
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  EXPECT_EQ(Storage.size(), 2U);
+
+  FS.Files[testPath("root/A.h")] = "class A2_CC {};";
+  Idx.filesChanged({testPath("root/A.h"), testPath("root/B.h")});
+  ASSERT_TRUE(Idx.blockUntilIdleForTest());
+  EXPECT_THAT(runFuzzyFind(Idx, ""), UnorderedElementsAre(Named("A2_CC")));
+}
+
+TEST(BackgroundIndexStorageTest, PackedStorage) {
+  SmallString<128> Root;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clangd-packed", Root));
+  auto Cleanup = llvm::make_scope_exit(
+      [&] { llvm::sys::fs::remove_directories(Root); });
+
+  SymbolSlab Symbols;
+  auto Store = [&](BackgroundIndexStorage *Storage, StringRef File,
+                   StringRef Content) {
+    auto Digest = llvm::SHA1::hash(
+        {reinterpret_cast<const uint8_t *>(Content.data()), Content.size()});
+    IndexFileOut Shard;
+    Shard.Symbols = &Symbols;
+    Shard.Digest = &Digest;
+    EXPECT_FALSE(bool(Storage->storeShard(File, Shard)));
+    return Digest;
+  };
+  auto LoadedDigest = [&](BackgroundIndexStorage *Storage, StringRef File) {
+    auto Shard = Storage->loadShard(File);
+    return Shard ? Shard->Digest : llvm::None;
+  };
+
+  decltype(llvm::SHA1::hash({})) A, B;
+  {
+    auto Factory = BackgroundIndexStorage::createPackedDiskStorageFactory();
+    auto *Storage = Factory(Root);
+    EXPECT_EQ(LoadedDigest(Storage, "a.cc"), llvm::None);
+    Store(Storage, "a.cc", "old");
+    A = Store(Storage, "a.cc", "new");
+    B = Store(Storage, "b.cc", "b");
+    EXPECT_EQ(LoadedDigest(Storage, "a.cc"), A);
+  }
+  SmallString<128> PackFile(Root);
+  llvm::sys::path::append(PackFile, ".clangd-index", "shards.pack");
+  {
+    // Simulate a crash in the middle of writing a record.
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(PackFile, EC, llvm::sys::fs::F_Append);
+    ASSERT_FALSE(EC);
+    OS << "\x10\0\0\0\x10\0\0\0";
+  }
+  {
+    auto Factory = BackgroundIndexStorage::createPackedDiskStorageFactory();
+    auto *Storage = Factory(Root);
+    EXPECT_EQ(LoadedDigest(Storage, "a.cc"), A);
+    EXPECT_EQ(LoadedDigest(Storage, "b.cc"), B);
+    // Records are appended after the last complete one.
+    auto C = Store(Storage, "c.cc", "c");
+    EXPECT_EQ(LoadedDigest(Storage, "c.cc"), C);
+  }
+}
+
+TEST(BackgroundIndexStorageTest, PackedStorageSharedByProcesses) {
+  SmallString<128> Root;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clangd-packed", Root));
+  auto Cleanup = llvm::make_scope_exit(
+      [&] { llvm::sys::fs::remove_directories(Root); });
+
+  // Each factory stands for a clangd process, they only share the pack file.
+  constexpr int Writers = 4, ShardsPerWriter = 50;
+  std::vector<BackgroundIndexStorage::Factory> Factories;
+  for (int I = 0; I < Writers; ++I)
+    Factories.push_back(
+        BackgroundIndexStorage::createPackedDiskStorageFactory());
+  auto ShardName = [](int Writer, int I) {
+    return "file" + std::to_string(Writer) + "_" + std::to_string(I) + ".cc";
+  };
+  auto DigestOf = [](StringRef Content) {
+    return llvm::SHA1::hash(
+        {reinterpret_cast<const uint8_t *>(Content.data()), Content.size()});
+  };
+
+  SymbolSlab Symbols;
+  std::vector<std::thread> Threads;
+  for (int W = 0; W < Writers; ++W)
+    Threads.emplace_back([&, W] {
+      auto *Storage = Factories[W](Root);
+      for (int I = 0; I < ShardsPerWriter; ++I) {
+        std::string Name = ShardName(W, I);
+        auto Digest = DigestOf(Name);
+        IndexFileOut Shard;
+        Shard.Symbols = &Symbols;
+        Shard.Digest = &Digest;
+        EXPECT_FALSE(bool(Storage->storeShard(Name, Shard)));
+      }
+    });
+  for (auto &T : Threads)
+    T.join();
+
+  auto LoadedDigest = [&](BackgroundIndexStorage *Storage, StringRef File) {
+    auto Shard = Storage->loadShard(File);
+    return Shard ? Shard->Digest : llvm::None;
+  };
+  // The writers see the shards of each other, and so does a new process.
+  auto Reader = BackgroundIndexStorage::createPackedDiskStorageFactory();
+  for (auto *Storage : {Factories[0](Root), Reader(Root)})
+    for (int W = 0; W < Writers; ++W)
+      for (int I = 0; I < ShardsPerWriter; ++I)
+        EXPECT_EQ(LoadedDigest(Storage, ShardName(W, I)),
+                  DigestOf(ShardName(W, I)))
+            << ShardName(W, I);
+}
+
+TEST(BackgroundQueueTest, Priority) {
+  // Create high and low priority tasks.
+  // Once a bunch of high priority tasks have run, the queue is stopped.
+  // So the low priority tasks should never run.
+  BackgroundQueue Q;
+  std::atomic<unsigned> HiRan(0), LoRan(0);
+  BackgroundQueue::Task Lo([&] { ++LoRan; });
+  BackgroundQueue::Task Hi([&] {
+    if (++HiRan >= 10)
+      Q.stop();
+  });
+  Hi.QueuePri = 100;
+
+  // Enqueuing the low-priority ones first shouldn't make them run first.
+  for (unsigned I = 0; I < 30; ++I)
+    Q.push(Lo);
+  for (unsigned I = 0; I < 30; ++I)
+    Q.push(Hi);
+
+  std::thread Worker([&] { Q.work(); });
+  Worker.join();
+  EXPECT_EQ(10u, HiRan);
+  EXPECT_EQ(0u, LoRan);
+}
+
+TEST(BackgroundQueueTest, Boost) {
+  std::string Sequence;
+
+  BackgroundQueue::Task A([&] { Sequence.push_back('A'); });
+  A.Tag = "A";
+  A.QueuePri = 1;
+
+  BackgroundQueue::Task B([&] { Sequence.push_back('B'); });
+  B.QueuePri = 2;
+  B.Tag = "B";
+
+  {
+    BackgroundQueue Q;
+    Q.append({A, B});
+    Q.push(BackgroundQueue::Task([&] { Q.stop(); }));
+    Q.work();
+    EXPECT_EQ("BA", Sequence) << "priority order";
+  }
+  Sequence.clear();
+  {
+    BackgroundQueue Q;
+    Q.boost("A", 3);
+    Q.append({A, B});
+    Q.push(BackgroundQueue::Task([&] { Q.stop(); }));
+    Q.work();
+    EXPECT_EQ("AB", Sequence) << "A was boosted before enqueueing";
+  }
+  Sequence.clear();
+  {
+    BackgroundQueue Q;
+    Q.append({A, B});
+    Q.boost("A", 3);
+    Q.push(BackgroundQueue::Task([&] { Q.stop(); }));
+    Q.work();
+    EXPECT_EQ("AB", Sequence) << "A was boosted after enqueueing";
+  }
+}
+
+TEST(BackgroundQueueTest, MaxActiveTasks) {
+  BackgroundQueue Q;
+  std::atomic<unsigned> Active(0), MaxActive(0), Ran(0);
+  BackgroundQueue::Task T([&] {
+    unsigned Now = ++Active;
+    unsigned Max = MaxActive;
+    while (Now > Max && !MaxActive.compare_exchange_weak(Max, Now))
+      ;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    --Active;
+    ++Ran;
+  });
+  Q.setMaxActiveTasks(1);
+  for (unsigned I = 0; I < 20; ++I)
+    Q.push(T);
+
+  std::vector<std::thread> Workers;
+  for (unsigned I = 0; I < 4; ++I)
+    Workers.emplace_back([&] { Q.work(); });
+  ASSERT_TRUE(Q.blockUntilIdleForTest(10));
+  EXPECT_EQ(20u, Ran);
+  EXPECT_EQ(1u, MaxActive) << "tasks ran concurrently";
+
+  // A paused queue doesn't run tasks.
+  Q.setMaxActiveTasks(0);
+  Q.push(T);
+  Q.stop();
+  for (auto &Worker : Workers)
+    Worker.join();
+  EXPECT_EQ(20u, Ran);
+}
+
 } // namespace clangd
 } // namespace clang
@@ -410,6 +410,64 @@ int main() { return 0; }
   EXPECT_FALSE(DiagConsumer.hadErrorInLastDiags());
 }
 
+TEST_F(ClangdVFSTest, ImplicitModulesFlags) {
+  MockFSProvider FS;
+  ErrorCheckingDiagConsumer DiagConsumer;
+  MockCompilationDatabase CDB;
+
+  auto FooCpp = testPath("foo.cpp");
+  const auto SourceContents = R"cpp(
+#if !__has_feature(modules)
+#error modules are disabled
+#endif
+)cpp";
+  FS.Files[FooCpp] = "";
+
+  // Without a cache path the command is left alone.
+  {
+    ClangdServer Server(CDB, FS, DiagConsumer, ClangdServer::optsForTest());
+    runAddDocument(Server, FooCpp, SourceContents);
+    EXPECT_TRUE(DiagConsumer.hadErrorInLastDiags());
+  }
+
+  auto Opts = ClangdServer::optsForTest();
+  Opts.ImplicitModulesCachePath = testPath("module-cache");
+  ClangdServer Server(CDB, FS, DiagConsumer, Opts);
+  runAddDocument(Server, FooCpp, SourceContents);
+  EXPECT_FALSE(DiagConsumer.hadErrorInLastDiags());
+}
+
+TEST_F(ClangdVFSTest, AsyncCompileCommands) {
+  MockFSProvider FS;
+  ErrorCheckingDiagConsumer DiagConsumer;
+  MockCompilationDatabase CDB;
+  auto Opts = ClangdServer::optsForTest();
+  Opts.AsyncCompileCommands = true;
+  ClangdServer Server(CDB, FS, DiagConsumer, Opts);
+
+  auto FooCpp = testPath("foo.cpp");
+  const auto SourceContents = R"cpp(
+#ifdef WITH_ERROR
+this
+#endif
+
+int main() { return 0; }
+)cpp";
+  FS.Files[FooCpp] = "";
+
+  // The diagnostics come from a parse with the real command.
+  CDB.ExtraClangFlags = {"-DWITH_ERROR"};
+  Server.addDocument(FooCpp, SourceContents, WantDiagnostics::Yes);
+  ASSERT_TRUE(Server.blockUntilIdleForTest());
+  EXPECT_TRUE(DiagConsumer.hadErrorInLastDiags());
+
+  // The command is cached until the database reports a change.
+  CDB.ExtraClangFlags = {};
+  Server.addDocument(FooCpp, SourceContents, WantDiagnostics::Yes);
+  ASSERT_TRUE(Server.blockUntilIdleForTest());
+  EXPECT_TRUE(DiagConsumer.hadErrorInLastDiags());
+}
+
 // Test ClangdServer.reparseOpenedFiles.
 TEST_F(ClangdVFSTest, ReparseOpenedFiles) {
   Annotations FooSource(R"cpp(
@@ -142,6 +142,9 @@ TEST(DiagnosticsTest, ClangTidy) {
   )cpp");
   auto TU = TestTU::withCode(Test.code());
   TU.HeaderFilename = "assert.h"; // Suppress "not found" error.
+  TU.ClangTidyChecks =
+      "-*,bugprone-sizeof-expression,bugprone-macro-repeated-side-effects,"
+      "modernize-deprecated-headers";
   EXPECT_THAT(
       TU.build().getDiagnostics(),
       UnorderedElementsAre(
@@ -164,6 +167,12 @@ TEST(DiagnosticsTest, ClangTidy) {
                "multiple unsequenced modifications to 'y'")));
 }
 
+TEST(DiagnosticsTest, ClangTidyDisabled) {
+  // Without configured checks, only the compiler diagnostics are reported.
+  auto TU = TestTU::withCode("int main() { return sizeof(sizeof(int)); }");
+  EXPECT_THAT(TU.build().getDiagnostics(), IsEmpty());
+}
+
 TEST(DiagnosticsTest, Preprocessor) {
   // This looks like a preamble, but there's an #else in the middle!
   // Check that:
@@ -325,6 +334,24 @@ MATCHER_P(DeclNamed, Name, "") {
   return false;
 }
 
+TEST(ClangdUnitTest, PreambleSkipsFunctionBodies) {
+  TestTU TU = TestTU::withCode(R"cpp(
+    int x = deduced();
+    static_assert(folded() == 2, "");
+  )cpp");
+  TU.HeaderCode = R"cpp(
+    inline int skipped() { return 1; }
+    inline auto deduced() { return 1; }
+    constexpr int folded() { return 2; }
+  )cpp";
+  auto AST = TU.build();
+  EXPECT_THAT(AST.getDiagnostics(), IsEmpty());
+  EXPECT_FALSE(cast<FunctionDecl>(findDecl(AST, "skipped")).hasBody());
+  // The main file needs these bodies.
+  EXPECT_TRUE(cast<FunctionDecl>(findDecl(AST, "deduced")).hasBody());
+  EXPECT_TRUE(cast<FunctionDecl>(findDecl(AST, "folded")).hasBody());
+}
+
 TEST(ClangdUnitTest, TopLevelDecls) {
   TestTU TU;
   TU.HeaderCode = R"(
@@ -336,6 +363,33 @@ TEST(ClangdUnitTest, TopLevelDecls) {
   EXPECT_THAT(AST.getLocalTopLevelDecls(), ElementsAre(DeclNamed("main")));
 }
 
+TEST(ClangdUnitTest, DeclOccurrences) {
+  Annotations Code(R"cpp(
+    int foo;
+    int bar() { return ^foo + foo; }
+  )cpp");
+  auto AST = TestTU::withCode(Code.code()).build();
+  const SourceManager &SM = AST.getASTContext().getSourceManager();
+  SourceLocation Loc =
+      SM.getLocForStartOfFile(SM.getMainFileID())
+          .getLocWithOffset(cantFail(positionToOffset(Code.code(),
+                                                      Code.point())));
+
+  ArrayRef<DeclOccurrence> All = AST.getDeclOccurrences();
+  EXPECT_TRUE(std::is_sorted(
+      All.begin(), All.end(),
+      [](const DeclOccurrence &L, const DeclOccurrence &R) {
+        return L.Loc < R.Loc;
+      }));
+  // Computed once per AST.
+  EXPECT_EQ(AST.getDeclOccurrences().data(), All.data());
+
+  auto AtLoc = AST.getDeclOccurrencesAt(Loc);
+  ASSERT_EQ(AtLoc.size(), 1u);
+  EXPECT_EQ(AtLoc.front().D, &findDecl(AST, "foo"));
+  EXPECT_THAT(AST.getDeclOccurrencesAt(Loc.getLocWithOffset(1)), IsEmpty());
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
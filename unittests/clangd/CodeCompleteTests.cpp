@@ -204,6 +204,19 @@ int main() { ClassWithMembers().^ }
   EXPECT_THAT(Results.Completions, ElementsAre(Named("AAA"), Named("BBB")));
 }
 
+TEST(CompletionTest, PreselectsManySemaResults) {
+  clangd::CodeCompleteOptions Opts;
+  Opts.Limit = 1;
+  std::string Code = "struct X {\n";
+  for (unsigned I = 0; I < 100; ++I)
+    Code += "  int xxMember" + std::to_string(I) + "();\n";
+  Code += "  int xxm();\n  int yy();\n};\nint main() { X().xxm^ }";
+  auto Results = completions(Code, /*IndexSymbols=*/{}, Opts);
+
+  EXPECT_TRUE(Results.HasMore);
+  EXPECT_THAT(Results.Completions, ElementsAre(Named("xxm")));
+}
+
 TEST(CompletionTest, Filter) {
   std::string Body = R"cpp(
     #define MotorCar
@@ -1956,6 +1969,60 @@ TEST(CompletionTest, EnableSpeculativeIndexRequest) {
   ASSERT_EQ(Reqs3.size(), 2u);
 }
 
+TEST(CompletionTest, IndexOnly) {
+  auto Index =
+      memIndex({func("ns::abc"), func("ns::abd"), func("other::abc")});
+  clangd::CodeCompleteOptions Opts;
+  Opts.Index = Index.get();
+  FuzzyFindRequest CachedReq;
+  CachedReq.Scopes = {"ns::"};
+
+  Annotations Test("void f() { ab^ }");
+  auto Results = indexOnlyCodeComplete(testPath("foo.cpp"), Test.code(),
+                                       Test.point(), CachedReq, Opts);
+  EXPECT_TRUE(Results.HasMore);
+  EXPECT_THAT(Results.Completions,
+              UnorderedElementsAre(AllOf(Named("abc"), Qualifier("")),
+                                   AllOf(Named("abd"), Qualifier(""))));
+
+  // The range to replace is in UTF-16 code units.
+  Annotations Wide("void f() { /* €😂 */ [[ab^]] }");
+  Results = indexOnlyCodeComplete(testPath("foo.cpp"), Wide.code(),
+                                  Wide.point(), CachedReq, Opts);
+  ASSERT_FALSE(Results.Completions.empty());
+  EXPECT_EQ(Results.Completions.front().CompletionTokenRange, Wide.range());
+
+  // Members can't be found without Sema.
+  Annotations Member("void f() { x.ab^ }");
+  Results = indexOnlyCodeComplete(testPath("foo.cpp"), Member.code(),
+                                  Member.point(), CachedReq, Opts);
+  EXPECT_TRUE(Results.HasMore);
+  EXPECT_THAT(Results.Completions, IsEmpty());
+}
+
+TEST(CompletionTest, NamespaceScopesAt) {
+  auto ScopesAt = [](StringRef Code) {
+    Annotations Test(Code);
+    return namespaceScopesAt(Test.code(), Test.point());
+  };
+  ASSERT_TRUE(ScopesAt("^"));
+  EXPECT_THAT(*ScopesAt("^"), ElementsAre(""));
+  auto Scopes = ScopesAt(R"cpp(
+      #include "foo.h" // {
+      namespace a { namespace b::c {
+      void f() { if (1) {} }
+      /* { */ }}
+      namespace a { using namespace ::std; extern "C" { ^
+  )cpp");
+  ASSERT_TRUE(Scopes);
+  EXPECT_THAT(*Scopes, ElementsAre("a::", "", "std::"));
+  Scopes = ScopesAt("namespace a { namespace { ^");
+  ASSERT_TRUE(Scopes);
+  EXPECT_THAT(*Scopes, ElementsAre("a::", ""));
+  EXPECT_FALSE(ScopesAt("void f() { ^"));
+  EXPECT_FALSE(ScopesAt("namespace a { struct X { ^"));
+}
+
 TEST(CompletionTest, InsertTheMostPopularHeader) {
   std::string DeclFile = URI::create(testPath("foo")).toString();
   Symbol sym = func("Func");
@@ -10,6 +10,7 @@
 #include "Context.h"
 
 #include "gtest/gtest.h"
+#include <thread>
 
 namespace clang {
 namespace clangd {
@@ -53,5 +54,40 @@ TEST(ContextTests, Builders) {
   EXPECT_EQ(*ChildCtx.get(ChildParam), 40);
 }
 
+TEST(ContextTests, LargeValues) {
+  // Too large for the recycled nodes.
+  struct Large {
+    char Bytes[256];
+  };
+  Key<Large> LargeParam;
+  Key<std::string> StringParam;
+
+  Large Value;
+  Value.Bytes[200] = 'x';
+  Context Ctx = Context::empty()
+                    .derive(LargeParam, Value)
+                    .derive(StringParam, std::string(100, 'y'));
+  EXPECT_EQ(Ctx.get(LargeParam)->Bytes[200], 'x');
+  EXPECT_EQ(*Ctx.get(StringParam), std::string(100, 'y'));
+}
+
+TEST(ContextTests, ReleasedByOtherThread) {
+  Key<int> Param;
+
+  for (int I = 0; I < 3; ++I) {
+    Context Ctx = Context::empty().derive(Param, I);
+    // The nodes are returned to the free list of the thread releasing them.
+    std::thread Thread([&Ctx, &Param, I] {
+      Context Moved = std::move(Ctx);
+      EXPECT_EQ(*Moved.get(Param), I);
+      Context Child = Moved.derive(Param, I + 1);
+      EXPECT_EQ(*Child.get(Param), I + 1);
+    });
+    Thread.join();
+  }
+  WithContextValue Value(Param, 10);
+  EXPECT_EQ(*Context::current().get(Param), 10);
+}
+
 } // namespace clangd
 } // namespace clang
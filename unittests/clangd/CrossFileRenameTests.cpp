@@ -0,0 +1,106 @@
+//===-- CrossFileRenameTests.cpp ---------------------*- C++ -*------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "Annotations.h"
+#include "CrossFileRename.h"
+#include "TestFS.h"
+#include "TestIndex.h"
+#include "index/MemIndex.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <map>
+
+using namespace llvm;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+
+SymbolLocation::Position toIndexPosition(const Position &P) {
+  SymbolLocation::Position Result;
+  Result.setLine(P.line);
+  Result.setColumn(P.character);
+  return Result;
+}
+
+TEST(CrossFileRenameTest, RenamesTheRefsOfOtherFiles) {
+  Annotations Header(R"cpp(
+    class [[Foo]] {
+    public:
+      [[Foo]]();
+      $dtor^~Foo();
+    };
+  )cpp");
+  Annotations Source(R"cpp(
+    #include "foo.h"
+    void $stale^use() { [[Foo]] F; [[Foo]] G; }
+  )cpp");
+  const char *HeaderURI = "unittest:///foo.h";
+  const char *SourceURI = "unittest:///foo.cc";
+  const char *MainURI = "unittest:///main.cc";
+
+  RefSlab::Builder Refs;
+  auto AddRef = [&](const char *FileURI, const Position &Start) {
+    Ref R;
+    R.Location.FileURI = FileURI;
+    R.Location.Start = toIndexPosition(Start);
+    R.Kind = RefKind::Reference;
+    Refs.insert(SymbolID("Foo"), R);
+  };
+  for (const auto &R : Header.ranges())
+    AddRef(HeaderURI, R.start);
+  AddRef(HeaderURI, Header.point("dtor"));
+  for (const auto &R : Source.ranges())
+    AddRef(SourceURI, R.start);
+  // The same ref reported twice, and one where the file changed.
+  AddRef(SourceURI, Source.ranges()[0].start);
+  AddRef(SourceURI, Source.point("stale"));
+  // The main file is renamed from its AST.
+  AddRef(MainURI, Position());
+  auto I = MemIndex::build(generateSymbols({"Foo"}), std::move(Refs).build());
+
+  StringMap<std::string> Files;
+  Files[testPath("foo.h")] = Header.code();
+  Files[testPath("foo.cc")] = Source.code();
+  Files[testPath("main.cc")] = "";
+  LangOptions LangOpts;
+  LangOpts.CPlusPlus = true;
+  std::vector<tooling::Replacement> Replacements =
+      renameWithIndex(*I, {SymbolID("Foo")}, "Foo", "Bar", testPath("main.cc"),
+                      *buildTestFS(Files), LangOpts);
+
+  std::map<std::string, tooling::Replacements> FileToReplacements;
+  for (const auto &R : Replacements)
+    ASSERT_FALSE(bool(FileToReplacements[R.getFilePath()].add(R)));
+  std::map<std::string, std::string> Results;
+  for (const auto &FileAndReplacements : FileToReplacements) {
+    auto Result = tooling::applyAllReplacements(
+        Files[FileAndReplacements.first], FileAndReplacements.second);
+    ASSERT_TRUE(bool(Result));
+    Results[FileAndReplacements.first] = *Result;
+  }
+  EXPECT_THAT(Results, UnorderedElementsAre(
+                           Pair(testPath("foo.h"), R"cpp(
+    class Bar {
+    public:
+      Bar();
+      ~Bar();
+    };
+  )cpp"),
+                           Pair(testPath("foo.cc"), R"cpp(
+    #include "foo.h"
+    void use() { Bar F; Bar G; }
+  )cpp")));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "Cancellation.h"
 #include "FuzzyMatch.h"
 #include "TestFS.h"
 #include "TestIndex.h"
@@ -25,7 +26,9 @@
 
 using ::testing::AnyOf;
 using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
 using ::testing::UnorderedElementsAre;
+using ::testing::UnorderedElementsAreArray;
 
 using namespace llvm;
 namespace clang {
@@ -68,6 +71,27 @@ TEST(DexIterators, DocumentIterator) {
   EXPECT_TRUE(DocIterator->reachedEnd());
 }
 
+TEST(DexIterators, DocumentIteratorManyChunks) {
+  // Deltas of varying encoded width, spread over many chunks.
+  std::vector<DocID> Docs;
+  for (DocID Doc = 3, Delta = 1; Docs.size() < 1000; Doc += Delta) {
+    Docs.push_back(Doc);
+    Delta = Delta * 7 % 100003 + 1;
+  }
+  const PostingList L(Docs);
+  EXPECT_THAT(consumeIDs(*L.iterator()), ElementsAreArray(Docs));
+
+  auto DocIterator = L.iterator();
+  for (size_t I = 0; I + 1 < Docs.size(); I += 37) {
+    DocIterator->advanceTo(Docs[I]);
+    EXPECT_EQ(DocIterator->peek(), Docs[I]);
+    DocIterator->advanceTo(Docs[I] + 1);
+    EXPECT_EQ(DocIterator->peek(), Docs[I + 1]);
+  }
+  DocIterator->advanceTo(Docs.back() + 1);
+  EXPECT_TRUE(DocIterator->reachedEnd());
+}
+
 TEST(DexIterators, AndTwoLists) {
   Corpus C{10000};
   const PostingList L0({0, 5, 7, 10, 42, 320, 9000});
@@ -316,6 +340,23 @@ TEST(DexIterators, Boost) {
   EXPECT_THAT(ElementBoost, 3);
 }
 
+TEST(DexIterators, MaxBoost) {
+  Corpus C{5};
+  const PostingList L0({2, 4});
+  const PostingList L1({1, 4});
+  EXPECT_EQ(C.all()->maxBoost(), 1);
+  EXPECT_EQ(C.boost(L0.iterator(), 2)->maxBoost(), 2);
+  auto Root = C.intersect(
+      C.unionOf(C.all(), C.boost(L0.iterator(), 2), C.boost(L1.iterator(), 3)),
+      C.boost(C.all(), 0.5));
+  EXPECT_EQ(Root->maxBoost(), 1.5);
+  // Exhausted children no longer contribute to the bound.
+  Root->advanceTo(4);
+  Root->advance();
+  EXPECT_TRUE(Root->reachedEnd());
+  EXPECT_EQ(C.unionOf(C.all(), C.boost(L1.iterator(), 3))->maxBoost(), 3);
+}
+
 TEST(DexIterators, Optimizations) {
   Corpus C{5};
   const PostingList L1{1};
@@ -403,6 +444,21 @@ TEST(DexTrigrams, IdentifierTrigrams) {
                    "hij", "hik", "hkl", "ijk", "ikl", "jkl", "klm"}));
 }
 
+TEST(DexTrigrams, PackedTrigrams) {
+  for (StringRef Chars : {"a", "ab", "abc", "\xff\x01"})
+    EXPECT_EQ(unpackTrigram(packTrigram(Chars)),
+              Token(Token::Kind::Trigram, Chars));
+  EXPECT_NE(packTrigram("a"), packTrigram("ab"));
+
+  std::vector<PackedTrigram> Packed;
+  generateIdentifierTrigrams("FooBar", Packed);
+  std::vector<Token> Unpacked;
+  for (PackedTrigram T : Packed)
+    Unpacked.push_back(unpackTrigram(T));
+  EXPECT_THAT(Unpacked, trigramsAre({"f", "fo", "fb", "foo", "fob", "fba",
+                                     "oob", "oba", "bar"}));
+}
+
 TEST(DexTrigrams, QueryTrigrams) {
   EXPECT_THAT(generateQueryTrigrams("c"), trigramsAre({"c"}));
   EXPECT_THAT(generateQueryTrigrams("cl"), trigramsAre({"cl"}));
@@ -502,6 +558,86 @@ TEST(DexTest, DexLimitedNumMatches) {
   EXPECT_TRUE(Incomplete);
 }
 
+TEST(DexTest, LargeIndexMatchesMemIndex) {
+  // Large enough for the posting lists to be built on several threads.
+  auto DexIndex = Dex::build(generateNumSymbols(0, 30000), RefSlab());
+  auto Mem = MemIndex::build(generateNumSymbols(0, 30000), RefSlab());
+  for (const char *Query : {"100", "123", "2999", "30000"}) {
+    FuzzyFindRequest Req;
+    Req.Query = Query;
+    Req.AnyScope = true;
+    EXPECT_THAT(match(*DexIndex, Req),
+                UnorderedElementsAreArray(match(*Mem, Req)))
+        << Query;
+  }
+}
+
+TEST(DexTest, RareTrigramBoundsCandidates) {
+  // "xyz" is rare, so the other trigrams of the query are dropped. The fuzzy
+  // matcher still filters out the symbols that don't match.
+  std::vector<std::string> Names = {"ns::FooXyz", "ns::FooXy", "ns::XyzBar"};
+  for (int I = 0; I < 5000; ++I)
+    Names.push_back("ns::Foo" + std::to_string(I));
+  auto I = Dex::build(generateSymbols(Names), RefSlab());
+  FuzzyFindRequest Req;
+  Req.Query = "fooxyz";
+  Req.AnyScope = true;
+  EXPECT_THAT(match(*I, Req), ElementsAre("ns::FooXyz"));
+  Req.Limit = 10;
+  EXPECT_THAT(match(*I, Req), ElementsAre("ns::FooXyz"));
+}
+
+TEST(DexTest, CancelledQueryStopsEarly) {
+  auto I = Dex::build(generateNumSymbols(0, 10000), RefSlab());
+  FuzzyFindRequest Req;
+  Req.AnyScope = true;
+  bool Incomplete;
+  EXPECT_EQ(match(*I, Req, &Incomplete).size(), 10001u);
+  EXPECT_FALSE(Incomplete);
+
+  auto Task = cancelableTask();
+  WithContext Cancelled(std::move(Task.first));
+  Task.second();
+  EXPECT_LT(match(*I, Req, &Incomplete).size(), 10001u);
+  EXPECT_TRUE(Incomplete);
+}
+
+TEST(DexTest, LimitedQueryFindsBestMatches) {
+  // Popular symbols have higher quality and come first in the posting lists;
+  // a limited query must still rank the remaining ones correctly.
+  SymbolSlab::Builder B;
+  for (int I = 0; I < 200; ++I) {
+    Symbol Sym = symbol("ns::Foo" + std::to_string(100 + I));
+    Sym.References = (I * 7) % 200;
+    B.insert(Sym);
+  }
+  auto I = Dex::build(std::move(B).build(), RefSlab());
+  FuzzyFindRequest Req;
+  Req.Query = "foo";
+  Req.Scopes = {"ns::"};
+  Req.Limit = 3;
+  bool Incomplete;
+  EXPECT_THAT(match(*I, Req, &Incomplete),
+              UnorderedElementsAre("ns::Foo157", "ns::Foo214", "ns::Foo271"));
+  EXPECT_TRUE(Incomplete);
+}
+
+TEST(DexTest, LimitedQueryFindsExactMatches) {
+  // Exact matches score up to twice the others, so the popular partial match
+  // visited first doesn't bound the score of the unpopular exact one.
+  SymbolSlab::Builder B;
+  Symbol Popular = symbol("ns::FooBar");
+  Popular.References = 5;
+  B.insert(Popular);
+  B.insert(symbol("ns::Foo"));
+  auto I = Dex::build(std::move(B).build(), RefSlab());
+  FuzzyFindRequest Req;
+  Req.Query = "foo";
+  Req.Scopes = {"ns::"};
+  Req.Limit = 1;
+  EXPECT_THAT(match(*I, Req), ElementsAre("ns::Foo"));
+}
+
 TEST(DexTest, FuzzyMatch) {
   auto I = Dex::build(
       generateSymbols({"LaughingOutLoud", "LionPopulation", "LittleOldLady"}),
@@ -514,6 +650,23 @@ TEST(DexTest, FuzzyMatch) {
               UnorderedElementsAre("LaughingOutLoud", "LittleOldLady"));
 }
 
+TEST(DexTest, FuzzyFindScored) {
+  auto I = Dex::build(
+      generateSymbols({"LaughingOutLoud", "LionPopulation", "LittleOldLady"}),
+      RefSlab());
+  FuzzyFindRequest Req;
+  Req.Query = "lol";
+  Req.AnyScope = true;
+  FuzzyMatcher Filter(Req.Query);
+  std::vector<std::string> Matches;
+  I->fuzzyFindScored(Req, [&](const Symbol &Sym, float NameMatch) {
+    Matches.push_back(Sym.Name);
+    EXPECT_EQ(Filter.match(Sym.Name), NameMatch) << Sym.Name;
+  });
+  EXPECT_THAT(Matches,
+              UnorderedElementsAre("LaughingOutLoud", "LittleOldLady"));
+}
+
 TEST(DexTest, ShortQuery) {
   auto I = Dex::build(generateSymbols({"OneTwoThreeFour"}), RefSlab());
   FuzzyFindRequest Req;
@@ -681,6 +834,49 @@ TEST(DexTests, Refs) {
   EXPECT_THAT(Files, ElementsAre("foo.h"));
 }
 
+TEST(DexTests, CompactRefs) {
+  auto Foo = symbol("foo");
+  auto Bar = symbol("bar");
+  std::vector<Ref> FooRefs;
+  auto AddRef = [&](const char *File, unsigned StartLine, unsigned StartCol,
+                    unsigned EndLine, unsigned EndCol, RefKind Kind) {
+    Ref R;
+    R.Location.FileURI = File;
+    R.Location.Start.setLine(StartLine);
+    R.Location.Start.setColumn(StartCol);
+    R.Location.End.setLine(EndLine);
+    R.Location.End.setColumn(EndCol);
+    R.Kind = Kind;
+    FooRefs.push_back(R);
+  };
+  AddRef("unittest:///foo.cc", 1000, 3, 1000, 6, RefKind::Reference);
+  AddRef("unittest:///foo.h", 5, 7, 5, 10, RefKind::Declaration);
+  AddRef("unittest:///foo.cc", 12, 4000, 13, 2, RefKind::Definition);
+  AddRef("unittest:///foo.cc", 12, 1, 12, 4, RefKind::Reference);
+  RefSlab::Builder Builder;
+  for (const Ref &R : FooRefs)
+    Builder.insert(Foo.ID, R);
+  SymbolSlab::Builder Symbols;
+  Symbols.insert(Foo);
+  Symbols.insert(Bar);
+  auto I = Dex::build(std::move(Symbols).build(), std::move(Builder).build());
+
+  RefsRequest Req;
+  Req.IDs = {Foo.ID, Bar.ID};
+  std::vector<Ref> Refs;
+  I->refs(Req, [&](const Ref &R) { Refs.push_back(R); });
+  EXPECT_THAT(Refs, UnorderedElementsAreArray(FooRefs));
+
+  Req.Filter = RefKind::Declaration | RefKind::Definition;
+  unsigned Calls = 0;
+  I->refsBySymbol(Req, [&](const SymbolID &ID, ArrayRef<Ref> Matching) {
+    ++Calls;
+    EXPECT_EQ(ID, Foo.ID);
+    EXPECT_THAT(Matching, UnorderedElementsAre(FooRefs[1], FooRefs[2]));
+  });
+  EXPECT_EQ(Calls, 1u);
+}
+
 } // namespace
 } // namespace dex
 } // namespace clangd
@@ -344,6 +344,45 @@ TEST(DraftStoreIncrementalUpdateTest, InvalidRangeInASequence) {
   EXPECT_EQ(*Contents, OriginalContents);
 }
 
+/// Check that lines are found correctly after a sequence of changes adding and
+/// removing lines was rolled back.
+TEST(DraftStoreIncrementalUpdateTest, LinesAfterInvalidSequence) {
+  DraftStore DS;
+  Path File = "foo.cpp";
+
+  DS.addDraft(File, "int a;\nint b;\nint c;\n");
+
+  auto MakeChange = [](int StartLine, int StartChar, int EndLine, int EndChar,
+                       StringRef Text) {
+    TextDocumentContentChangeEvent Change;
+    Change.range.emplace();
+    Change.range->start.line = StartLine;
+    Change.range->start.character = StartChar;
+    Change.range->end.line = EndLine;
+    Change.range->end.character = EndChar;
+    Change.text = Text;
+    return Change;
+  };
+
+  // Joins the first two lines, then inserts two lines, then fails.
+  Expected<std::string> Result =
+      DS.updateDraft(File, {MakeChange(0, 6, 1, 0, " "),
+                            MakeChange(1, 0, 1, 0, "int x;\nint y;\n"),
+                            MakeChange(10, 0, 10, 0, "oops")});
+  EXPECT_TRUE(!Result);
+  consumeError(Result.takeError());
+  EXPECT_EQ(*DS.getDraft(File), "int a;\nint b;\nint c;\n");
+
+  Result = DS.updateDraft(File, {MakeChange(2, 4, 2, 5, "d"),
+                                 MakeChange(0, 4, 0, 5, "e\n\n")});
+  ASSERT_TRUE(!!Result) << toString(Result.takeError());
+  EXPECT_EQ(*Result, "int e\n\n;\nint b;\nint d;\n");
+
+  Result = DS.updateDraft(File, {MakeChange(4, 4, 4, 5, "f")});
+  ASSERT_TRUE(!!Result) << toString(Result.takeError());
+  EXPECT_EQ(*Result, "int e\n\n;\nint b;\nint f;\n");
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -46,6 +46,38 @@ TEST(FSTests, PreambleStatusCache) {
   EXPECT_EQ(Cached->getName(), S.getName());
 }
 
+TEST(FSTests, SharedStatusCache) {
+  StringMap<std::string> Files;
+  Files["x"] = "";
+  Files["y"] = "";
+  auto FS = buildTestFS(Files);
+  FS->setCurrentWorkingDirectory(testRoot());
+
+  SharedFileStatusCache StatCache;
+  auto CachingFS = StatCache.getFileSystem(FS);
+  EXPECT_TRUE(CachingFS->openFileForRead("x"));
+  EXPECT_TRUE(CachingFS->status(testPath("y")));
+  EXPECT_FALSE(CachingFS->status("z"));
+  EXPECT_TRUE(StatCache.lookup(testPath("x")).hasValue());
+  EXPECT_TRUE(StatCache.lookup(testPath("y")).hasValue());
+  EXPECT_FALSE(StatCache.lookup(testPath("z")).hasValue());
+
+  // Other filesystems share the cache, and see the status under their names.
+  vfs::Status S("fake", sys::fs::UniqueID(0, 0),
+                std::chrono::system_clock::now(), 0, 0, 1024,
+                sys::fs::file_type::regular_file, sys::fs::all_all);
+  StatCache.update(testPath("fake"), S);
+  auto OtherFS = StatCache.getFileSystem(FS);
+  OtherFS->setCurrentWorkingDirectory(testRoot());
+  auto Cached = OtherFS->status("fake");
+  ASSERT_TRUE(Cached);
+  EXPECT_EQ(Cached->getName(), "fake");
+  EXPECT_EQ(Cached->getSize(), 1024u);
+
+  StatCache.invalidate(testPath("fake"));
+  EXPECT_FALSE(OtherFS->status("fake"));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
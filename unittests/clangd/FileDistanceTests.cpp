@@ -11,6 +11,8 @@
 #include "TestFS.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
 
 namespace clang {
 namespace clangd {
@@ -81,6 +83,23 @@ TEST(FileDistanceTests, URI) {
   EXPECT_EQ(D.distance("unittest:///bar"), 1008u);
 }
 
+TEST(FileDistanceTests, SharedURIDistance) {
+  URIDistance D({{testPath("foo"), SourceParams()}});
+  std::vector<std::thread> Threads;
+  std::atomic<unsigned> Mismatches(0);
+  for (unsigned I = 0; I < 4; ++I)
+    Threads.emplace_back([&] {
+      for (unsigned J = 0; J < 100; ++J) {
+        std::string Sub = "unittest:///foo/" + std::to_string(J % 10);
+        if (D.distance(Sub) != 1u || D.distance("unittest:///bar") != 3u)
+          ++Mismatches;
+      }
+    });
+  for (auto &T : Threads)
+    T.join();
+  EXPECT_EQ(Mismatches, 0u);
+}
+
 TEST(FileDistance, LimitUpTraversals) {
   FileDistanceOptions Opts;
   Opts.UpCost = Opts.DownCost = 1;
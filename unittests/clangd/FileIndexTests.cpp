@@ -13,6 +13,7 @@
 #include "SyncAPI.h"
 #include "TestFS.h"
 #include "TestTU.h"
+#include "index/Background.h"
 #include "index/FileIndex.h"
 #include "index/Index.h"
 #include "clang/Frontend/CompilerInvocation.h"
@@ -21,6 +22,7 @@
 #include "clang/Index/IndexSymbol.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/SHA1.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -98,6 +100,19 @@ TEST(FileSymbolsTest, Overlap) {
                                      QName("4"), QName("5")));
 }
 
+TEST(FileSymbolsTest, RemoveEqualRefs) {
+  FileSymbols FS;
+  SymbolID ID("1");
+  // The refs of both files are equal, but in different slabs.
+  FS.update("f1", nullptr, refSlab(ID, "same.cc"));
+  FS.update("f2", nullptr, refSlab(ID, "same.cc"));
+  FS.update("f2", nullptr, nullptr);
+  EXPECT_THAT(getRefs(*FS.buildIndex(IndexType::Light), ID),
+              RefsAre({FileURI("same.cc")}));
+  FS.update("f1", nullptr, nullptr);
+  EXPECT_THAT(getRefs(*FS.buildIndex(IndexType::Light), ID), IsEmpty());
+}
+
 TEST(FileSymbolsTest, MergeOverlap) {
   FileSymbols FS;
   auto OneSymboSlab = [](Symbol Sym) {
@@ -140,6 +155,53 @@ TEST(FileSymbolsTest, SnapshotAliveAfterRemove) {
   EXPECT_THAT(getRefs(*Symbols, ID), RefsAre({FileURI("f1.cc")}));
 }
 
+TEST(FileSymbolsTest, IncrementalUpdate) {
+  FileSymbols FS;
+  auto OneSymbolSlab = [](Symbol Sym) {
+    SymbolSlab::Builder S;
+    S.insert(Sym);
+    return make_unique<SymbolSlab>(std::move(S).build());
+  };
+  auto X1 = symbol("x");
+  X1.CanonicalDeclaration.FileURI = "file:///x1";
+  auto X2 = symbol("x");
+  X2.Definition.FileURI = "file:///x2";
+  SymbolID ID("x");
+
+  FS.update("f1", OneSymbolSlab(X1), refSlab(ID, "f1.cc"));
+  FS.update("f2", OneSymbolSlab(X2), refSlab(ID, "f2.cc"));
+  auto Merged = FS.buildIndex(IndexType::Light, DuplicateHandling::Merge);
+  EXPECT_THAT(runFuzzyFind(*Merged, "x"),
+              UnorderedElementsAre(
+                  AllOf(DeclURI("file:///x1"), DefURI("file:///x2"))));
+  EXPECT_THAT(getRefs(*Merged, ID),
+              RefsAre({FileURI("f1.cc"), FileURI("f2.cc")}));
+
+  // Replacing one file only affects the symbols and refs it contributed.
+  auto X3 = symbol("x");
+  X3.Definition.FileURI = "file:///x3";
+  FS.update("f2", OneSymbolSlab(X3), refSlab(ID, "f3.cc"));
+  auto Updated = FS.buildIndex(IndexType::Light, DuplicateHandling::Merge);
+  EXPECT_THAT(runFuzzyFind(*Updated, "x"),
+              UnorderedElementsAre(
+                  AllOf(DeclURI("file:///x1"), DefURI("file:///x3"))));
+  EXPECT_THAT(getRefs(*Updated, ID),
+              RefsAre({FileURI("f1.cc"), FileURI("f3.cc")}));
+
+  // Indexes built before the update still see the old snapshot.
+  EXPECT_THAT(runFuzzyFind(*Merged, "x"),
+              UnorderedElementsAre(
+                  AllOf(DeclURI("file:///x1"), DefURI("file:///x2"))));
+  EXPECT_THAT(getRefs(*Merged, ID),
+              RefsAre({FileURI("f1.cc"), FileURI("f2.cc")}));
+
+  FS.update("f1", nullptr, nullptr);
+  auto Removed = FS.buildIndex(IndexType::Heavy, DuplicateHandling::Merge);
+  EXPECT_THAT(runFuzzyFind(*Removed, "x"),
+              UnorderedElementsAre(AllOf(DeclURI(""), DefURI("file:///x3"))));
+  EXPECT_THAT(getRefs(*Removed, ID), RefsAre({FileURI("f3.cc")}));
+}
+
 // Adds Basename.cpp, which includes Basename.h, which contains Code.
 void update(FileIndex &M, StringRef Basename, StringRef Code) {
   TestTU File;
@@ -151,6 +213,73 @@ void update(FileIndex &M, StringRef Basename, StringRef Code) {
                    AST.getPreprocessorPtr());
 }
 
+// Keeps shards in memory, and counts the ones that were loaded.
+class MemoryPreambleStorage : public BackgroundIndexStorage {
+public:
+  llvm::Error storeShard(llvm::StringRef ShardIdentifier,
+                         IndexFileOut Shard) const override {
+    Storage[ShardIdentifier] = llvm::to_string(Shard);
+    return llvm::Error::success();
+  }
+  std::unique_ptr<IndexFileIn>
+  loadShard(llvm::StringRef ShardIdentifier) const override {
+    auto It = Storage.find(ShardIdentifier);
+    if (It == Storage.end())
+      return nullptr;
+    auto IndexFile = readIndexFile(It->second);
+    if (!IndexFile) {
+      ADD_FAILURE() << llvm::toString(IndexFile.takeError());
+      return nullptr;
+    }
+    ++Loads;
+    return llvm::make_unique<IndexFileIn>(std::move(*IndexFile));
+  }
+
+  mutable llvm::StringMap<std::string> Storage;
+  mutable unsigned Loads = 0;
+};
+
+TEST(FileIndexTest, PersistPreambleSymbols) {
+  MemoryPreambleStorage Storage;
+  auto GetStorage = [&](PathRef) { return &Storage; };
+  {
+    FileIndex M(/*UseDex=*/true, GetStorage);
+    update(M, "f", "class X {};");
+    EXPECT_THAT(runFuzzyFind(M, ""), ElementsAre(QName("X")));
+  }
+  EXPECT_EQ(Storage.Storage.size(), 1u);
+  EXPECT_EQ(Storage.Loads, 0u);
+
+  // The same preamble is loaded by a new index.
+  FileIndex M(/*UseDex=*/true, GetStorage);
+  update(M, "f", "class X {};");
+  EXPECT_THAT(runFuzzyFind(M, ""), ElementsAre(QName("X")));
+  EXPECT_EQ(Storage.Loads, 1u);
+
+  // A changed header yields a different preamble.
+  update(M, "f", "class Y {};");
+  EXPECT_THAT(runFuzzyFind(M, ""), ElementsAre(QName("Y")));
+  EXPECT_EQ(Storage.Storage.size(), 2u);
+  EXPECT_EQ(Storage.Loads, 1u);
+}
+
+TEST(FileIndexTest, SkipIndexedHeaders) {
+  FileIndex M;
+  std::vector<std::string> Seen;
+  M.skipIndexedHeaders(
+      [&](StringRef AbsPath, const IndexFileIn::FileDigest &Digest) {
+        Seen.push_back(AbsPath);
+        return Digest == SHA1::hash({(const uint8_t *)"class X {};", 11});
+      });
+  update(M, "f", "class X {};");
+  EXPECT_THAT(runFuzzyFind(M, ""), IsEmpty());
+  EXPECT_THAT(Seen, ElementsAre(testPath("f.h")));
+
+  // The header changed, so it's indexed again.
+  update(M, "f", "class Y {};");
+  EXPECT_THAT(runFuzzyFind(M, ""), ElementsAre(QName("Y")));
+}
+
 TEST(FileIndexTest, CustomizedURIScheme) {
   FileIndex M;
   update(M, "f", "class string {};");
@@ -364,7 +493,8 @@ TEST(FileIndexTest, ReferencesInMainFileWithPreamble) {
   auto AST =
       ParsedAST::build(createInvocationFromCommandLine(Cmd), PreambleData,
                        MemoryBuffer::getMemBufferCopy(Main.code()),
-                       std::make_shared<PCHContainerOperations>(), PI.FS);
+                       std::make_shared<PCHContainerOperations>(), PI.FS,
+                       PI.ClangTidyOpts);
   ASSERT_TRUE(AST);
   FileIndex Index;
   Index.updateMain(MainFile, *AST);
@@ -0,0 +1,68 @@
+//===-- FileWatcherTests.cpp ------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FileWatcher.h"
+#include "Threading.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::UnorderedElementsAre;
+
+TEST(FileWatcherTest, ReportsBatchedChanges) {
+  if (!FileWatcher::isSupported())
+    return;
+  llvm::SmallString<128> Root;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clangd-watch", Root));
+  auto Cleanup = llvm::make_scope_exit(
+      [&] { llvm::sys::fs::remove_directories(Root); });
+  auto PathOf = [&](llvm::StringRef Name) {
+    llvm::SmallString<128> Path(Root);
+    llvm::sys::path::append(Path, Name);
+    return Path.str().str();
+  };
+  auto Write = [&](llvm::StringRef Name) {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(PathOf(Name), EC, llvm::sys::fs::F_None);
+    ASSERT_FALSE(EC);
+    OS << "int x;";
+  };
+
+  std::mutex Mu;
+  std::condition_variable CV;
+  std::vector<std::vector<std::string>> Batches;
+  FileWatcher Watcher(
+      [&](std::vector<std::string> Changed) {
+        std::lock_guard<std::mutex> Lock(Mu);
+        Batches.push_back(std::move(Changed));
+        CV.notify_all();
+      },
+      std::chrono::milliseconds(100));
+  Watcher.watchDirectory(Root);
+
+  Write("a.h");
+  Write("b.h");
+  Write("a.h");
+  std::unique_lock<std::mutex> Lock(Mu);
+  ASSERT_TRUE(
+      wait(Lock, CV, timeoutSeconds(10), [&] { return !Batches.empty(); }));
+  EXPECT_THAT(Batches.front(),
+              UnorderedElementsAre(PathOf("a.h"), PathOf("b.h")));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
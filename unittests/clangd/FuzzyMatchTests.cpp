@@ -273,6 +273,19 @@ TEST(FuzzyMatch, Scoring) {
   EXPECT_THAT("Abs", matches("[abs]", 2.f));
 }
 
+TEST(FuzzyMatch, Batch) {
+  std::vector<StringRef> Words = {"emplace_back", "embed", "begin", "",
+                                  "EmplaceBack",  "eb",    "be"};
+  for (StringRef Pattern : {"eb", "", "EB", "xyz"}) {
+    FuzzyMatcher Batch(Pattern), Single(Pattern);
+    std::vector<Optional<float>> Scores(Words.size());
+    Batch.match(Words, Scores);
+    for (size_t I = 0; I < Words.size(); ++I)
+      EXPECT_EQ(Scores[I], Single.match(Words[I]))
+          << Pattern << " vs " << Words[I];
+  }
+}
+
 // Returns pretty-printed segmentation of Text.
 // e.g. std::basic_string --> +--  +---- +-----
 std::string segment(StringRef Text) {
@@ -8,9 +8,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "GlobalCompilationDatabase.h"
+#include "LazyCompilationDatabase.h"
 
 #include "TestFS.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -19,6 +24,7 @@ namespace clang {
 namespace clangd {
 namespace {
 using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAre;
 
 TEST(GlobalCompilationDatabaseTest, FallbackCommand) {
   DirectoryBasedGlobalCompilationDatabase DB(None);
@@ -33,6 +39,23 @@ TEST(GlobalCompilationDatabaseTest, FallbackCommand) {
                                            testPath("foo/bar.h")));
 }
 
+TEST(GlobalCompilationDatabaseTest, TransferCompileCommand) {
+  tooling::CompileCommand TU(testRoot(), testPath("foo.cc"),
+                             {"clang", "-DFOO", testPath("foo.cc"), "-c"},
+                             "foo.o");
+  auto Cmd = transferCompileCommand(TU, testPath("foo.h"));
+  EXPECT_EQ(Cmd.Filename, testPath("foo.h"));
+  EXPECT_EQ(Cmd.Directory, testRoot());
+  // The .h extension doesn't imply C++.
+  EXPECT_THAT(Cmd.CommandLine, ElementsAre("clang", "-DFOO", "-xc++-header",
+                                           testPath("foo.h"), "-c"));
+  // The file of the TU may be relative to its directory.
+  TU.Filename = "foo.cc";
+  TU.CommandLine = {"clang", "./foo.cc"};
+  Cmd = transferCompileCommand(TU, testPath("foo.hpp"));
+  EXPECT_THAT(Cmd.CommandLine, ElementsAre("clang", testPath("foo.hpp")));
+}
+
 static tooling::CompileCommand cmd(StringRef File, StringRef Arg) {
   return tooling::CompileCommand(testRoot(), File, {"clang", Arg, File}, "");
 }
@@ -108,6 +131,79 @@ TEST_F(OverlayCDBTest, Watch) {
                                    ElementsAre("A.cpp"), ElementsAre("C.cpp")));
 }
 
+TEST(LazyJSONCompilationDatabaseTest, Load) {
+  SmallString<128> Root;
+  ASSERT_FALSE(sys::fs::createUniqueDirectory("clangd-lazy-cdb", Root));
+  auto Cleanup =
+      llvm::make_scope_exit([&] { sys::fs::remove_directories(Root); });
+  std::string RootDir = Root.str();
+  auto Path = [&](StringRef A, StringRef B = "") {
+    SmallString<128> Result(Root);
+    sys::path::append(Result, A, B);
+    return Result.str().str();
+  };
+  auto Write = [&](json::Array Entries) {
+    std::error_code EC;
+    raw_fd_ostream OS(Path("compile_commands.json"), EC);
+    ASSERT_FALSE(EC);
+    OS << json::Value(std::move(Entries));
+  };
+  auto Load = [&] {
+    auto CDB = LazyJSONCompilationDatabase::loadFromDirectory(Root);
+    EXPECT_TRUE(bool(CDB)) << toString(CDB.takeError());
+    return CDB ? std::move(*CDB) : nullptr;
+  };
+
+  Write({
+      json::Object{{"directory", RootDir},
+                   {"file", "a.cc"},
+                   {"arguments", json::Array{"clang", "-DA", "a.cc"}}},
+      json::Object{{"directory", Path("sub")},
+                   {"file", "../b.cc"},
+                   {"command", R"(clang -DB="x y" ../b.cc)"},
+                   {"output", "b.o"}},
+      // Unknown keys are skipped, however they're nested.
+      json::Object{{"directory", RootDir},
+                   {"file", "c.cc"},
+                   {"extra", json::Object{{"k", json::Array{1, "]}", true}}}},
+                   {"arguments", json::Array{"clang", "c.cc"}}},
+  });
+  auto CDB = Load();
+  ASSERT_TRUE(CDB);
+  EXPECT_THAT(CDB->getAllFiles(),
+              UnorderedElementsAre(Path("a.cc"), Path("b.cc"), Path("c.cc")));
+  auto A = CDB->getCompileCommands(Path("a.cc"));
+  ASSERT_EQ(A.size(), 1u);
+  EXPECT_EQ(A[0].Directory, RootDir);
+  EXPECT_THAT(A[0].CommandLine, ElementsAre("clang", "-DA", "a.cc"));
+  auto B = CDB->getCompileCommands(Path("b.cc"));
+  ASSERT_EQ(B.size(), 1u);
+  EXPECT_THAT(B[0].CommandLine, ElementsAre("clang", "-DB=x y", "../b.cc"));
+  EXPECT_EQ(B[0].Output, "b.o");
+  EXPECT_THAT(CDB->getCompileCommands(Path("d.cc")), ElementsAre());
+
+  // With a .clangd-index directory, the index is saved and reused.
+  ASSERT_FALSE(sys::fs::create_directory(Path(".clangd-index")));
+  ASSERT_TRUE(Load());
+  EXPECT_TRUE(sys::fs::exists(Path(".clangd-index", "compile_commands.idx")));
+  CDB = Load();
+  ASSERT_TRUE(CDB);
+  auto C = CDB->getCompileCommands(Path("c.cc"));
+  ASSERT_EQ(C.size(), 1u);
+  EXPECT_THAT(C[0].CommandLine, ElementsAre("clang", "c.cc"));
+
+  // The saved index is ignored once compile_commands.json changes.
+  Write({json::Object{{"directory", RootDir},
+                      {"file", "d.cc"},
+                      {"arguments", json::Array{"clang", "-DD", "d.cc"}}}});
+  CDB = Load();
+  ASSERT_TRUE(CDB);
+  EXPECT_THAT(CDB->getAllFiles(), ElementsAre(Path("d.cc")));
+  auto D = CDB->getCompileCommands(Path("d.cc"));
+  ASSERT_EQ(D.size(), 1u);
+  EXPECT_THAT(D[0].CommandLine, ElementsAre("clang", "-DD", "d.cc"));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -98,7 +98,8 @@ protected:
 
     IncludeInserter Inserter(MainFile, /*Code=*/"", format::getLLVMStyle(),
                              CDB.getCompileCommand(MainFile)->Directory,
-                             Clang->getPreprocessor().getHeaderSearchInfo());
+                             Clang->getPreprocessor().getHeaderSearchInfo(),
+                             PathCache);
     for (const auto &Inc : Inclusions)
       Inserter.addExisting(Inc);
     auto Declaring = ToHeaderFile(Original);
@@ -126,6 +127,7 @@ protected:
 
   MockFSProvider FS;
   MockCompilationDatabase CDB;
+  IncludePathCache *PathCache = nullptr;
   std::string MainFile = testPath("main.cpp");
   std::string Subdir = testPath("sub");
   std::string SearchDirArg = (Twine("-I") + Subdir).str();
@@ -182,6 +184,30 @@ TEST_F(HeadersTest, OnlyCollectInclusionsInMain) {
                                    Distance(testPath("sub/baz.h"), 1u)));
 }
 
+TEST_F(HeadersTest, SameIncludes) {
+  std::string BazHeader = testPath("sub/baz.h");
+  FS.Files[BazHeader] = "";
+  std::string BarHeader = testPath("sub/bar.h");
+  FS.Files[BarHeader] = R"cpp(
+#include "baz.h"
+)cpp";
+  FS.Files[MainFile] = R"cpp(
+#include "bar.h"
+)cpp";
+  // Another file of the directory using the preamble of the main file.
+  std::string OtherFile = testPath("other.cpp");
+  auto Includes = collectIncludes();
+  Includes.recordSameIncludes(OtherFile, MainFile);
+  EXPECT_THAT(Includes.includeDepth(OtherFile),
+              UnorderedElementsAre(Distance(OtherFile, 0u),
+                                   Distance(testPath("sub/bar.h"), 1u),
+                                   Distance(testPath("sub/baz.h"), 2u)));
+  EXPECT_THAT(Includes.includeDepth(MainFile),
+              UnorderedElementsAre(Distance(MainFile, 0u),
+                                   Distance(testPath("sub/bar.h"), 1u),
+                                   Distance(testPath("sub/baz.h"), 2u)));
+}
+
 TEST_F(HeadersTest, PreambleIncludesPresentOnce) {
   // We use TestTU here, to ensure we use the preamble replay logic.
   // We're testing that the logic doesn't crash, and doesn't result in duplicate
@@ -214,6 +240,17 @@ TEST_F(HeadersTest, InsertInclude) {
   EXPECT_EQ(calculate(Path), "\"bar.h\"");
 }
 
+TEST_F(HeadersTest, CachedIncludePath) {
+  std::string Path = testPath("sub/bar.h");
+  IncludePathCache Cache;
+  PathCache = &Cache;
+  EXPECT_EQ(calculate(Path), "\"bar.h\"");
+  EXPECT_EQ(Cache.get(Path), std::string("\"bar.h\""));
+  // Cached spellings are used without consulting the header search paths.
+  Cache.set(Path, "<cached.h>");
+  EXPECT_EQ(calculate(Path), "<cached.h>");
+}
+
 TEST_F(HeadersTest, DoNotInsertIfInSameFile) {
   MainFile = testPath("main.h");
   EXPECT_EQ(calculate(MainFile), "");
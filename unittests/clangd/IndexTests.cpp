@@ -8,17 +8,27 @@
 //===----------------------------------------------------------------------===//
 
 #include "Annotations.h"
+#include "FuzzyMatch.h"
+#include "TestFS.h"
 #include "TestIndex.h"
 #include "TestTU.h"
+#include "Threading.h"
+#include "index/CachingIndex.h"
 #include "index/FileIndex.h"
 #include "index/Index.h"
 #include "index/MemIndex.h"
 #include "index/Merge.h"
+#include "index/ReferencingFiles.h"
+#include "index/RemoteIndex.h"
+#include "index/SymbolIDMap.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
 
 using testing::_;
 using testing::AllOf;
+using testing::AnyOf;
 using testing::ElementsAre;
 using testing::Pair;
 using testing::Pointee;
@@ -58,6 +68,36 @@ TEST(SymbolLocation, Position) {
   EXPECT_EQ(Pos.column(), Position::MaxColumn);
 }
 
+TEST(SymbolIDCollisionDetector, DifferentUSRs) {
+  SymbolIDCollisionDetector Detector;
+  SymbolID ID("c:@F@foo#");
+  Detector.record(ID, "c:@F@foo#");
+  Detector.record(ID, "c:@F@foo#");
+  Detector.record(SymbolID("c:@F@bar#"), "c:@F@bar#");
+  EXPECT_THAT(Detector.collisions(), ElementsAre());
+  // Another USR with the same truncated hash.
+  Detector.record(ID, "c:@F@baz#");
+  EXPECT_THAT(Detector.collisions(), ElementsAre(ID));
+}
+
+TEST(SymbolIDMap, Find) {
+  std::vector<std::pair<SymbolID, int>> Entries;
+  for (int I = 0; I < 1000; ++I)
+    Entries.emplace_back(SymbolID("c:@F@f" + std::to_string(I)), I);
+  // The first value of a duplicate ID is kept.
+  Entries.emplace_back(SymbolID("c:@F@f0"), -1);
+  SymbolIDMap<int> Map(Entries);
+  EXPECT_EQ(Map.size(), 1000u);
+  for (const auto &Entry : Entries) {
+    const int *Value = Map.find(Entry.first);
+    ASSERT_NE(Value, nullptr);
+    EXPECT_EQ(*Value, Entry.second == -1 ? 0 : Entry.second);
+  }
+  EXPECT_EQ(Map.find(SymbolID("c:@F@g")), nullptr);
+  EXPECT_EQ(Map.lookup(SymbolID("c:@F@g")), 0);
+  EXPECT_EQ(SymbolIDMap<int>().find(SymbolID("c:@F@f0")), nullptr);
+}
+
 TEST(SymbolSlab, FindAndIterate) {
   SymbolSlab::Builder B;
   B.insert(symbol("Z"));
@@ -74,6 +114,65 @@ TEST(SymbolSlab, FindAndIterate) {
     EXPECT_THAT(*S.find(SymbolID(Sym)), Named(Sym));
 }
 
+TEST(SymbolSlab, AdoptAndMerge) {
+  SymbolSlab::Builder Inner;
+  Inner.insert(symbol("ns::X"));
+  Inner.insert(symbol("ns::Y"));
+  SymbolSlab Adopted = std::move(Inner).build();
+  const char *AdoptedScope = Adopted.find(SymbolID("ns::X"))->Scope.data();
+
+  SymbolSlab::Builder B;
+  B.insert(symbol("ns::Z"));
+  B.insert(std::move(Adopted));
+  Symbol Y = symbol("ns::Y");
+  Y.Documentation = "doc";
+  B.merge(Y);
+  B.merge(symbol("W"));
+  EXPECT_EQ(Adopted.size(), 0u);
+
+  SymbolSlab S = std::move(B).build();
+  EXPECT_THAT(S, UnorderedElementsAre(Named("W"), Named("X"), Named("Y"),
+                                      Named("Z")));
+  EXPECT_EQ(S.find(SymbolID("ns::X"))->Scope.data(), AdoptedScope);
+  EXPECT_EQ(S.find(SymbolID("ns::Y"))->Documentation, "doc");
+  EXPECT_EQ(S.find(SymbolID("ns::Y"))->Scope, "ns::");
+}
+
+TEST(SymbolSlab, PooledStrings) {
+  StringPool Pool;
+  auto Build = [&](const char *Name) {
+    SymbolSlab::Builder B(&Pool);
+    B.insert(symbol(Name));
+    return llvm::make_unique<SymbolSlab>(std::move(B).build());
+  };
+  auto X = Build("ns::X");
+  auto Y = Build("ns::Y");
+  EXPECT_THAT(*X, ElementsAre(Named("X")));
+  EXPECT_THAT(*Y, ElementsAre(Named("Y")));
+  EXPECT_EQ(X->begin()->Scope, "ns::");
+  EXPECT_EQ(X->begin()->Scope.data(), Y->begin()->Scope.data());
+  size_t Shared = Pool.size();
+
+  Ref R;
+  R.Location.FileURI = "unittest:///ns.h";
+  RefSlab::Builder RB1(&Pool), RB2(&Pool);
+  RB1.insert(SymbolID("ns::X"), R);
+  RB2.insert(SymbolID("ns::Y"), R);
+  RefSlab Refs1 = std::move(RB1).build(), Refs2 = std::move(RB2).build();
+  EXPECT_STREQ(Refs1.begin()->second[0].Location.FileURI, "unittest:///ns.h");
+  EXPECT_EQ(Refs1.begin()->second[0].Location.FileURI,
+            Refs2.begin()->second[0].Location.FileURI);
+  EXPECT_EQ(Pool.size(), Shared + 1);
+
+  // Strings are freed with the last slab holding them.
+  X.reset();
+  EXPECT_EQ(Y->begin()->Scope, "ns::");
+  Y.reset();
+  Refs1 = RefSlab();
+  Refs2 = RefSlab();
+  EXPECT_EQ(Pool.size(), 0u);
+}
+
 TEST(SwapIndexTest, OldIndexRecycled) {
   auto Token = std::make_shared<int>();
   std::weak_ptr<int> WeakToken = Token;
@@ -85,6 +184,224 @@ TEST(SwapIndexTest, OldIndexRecycled) {
   EXPECT_TRUE(WeakToken.expired());       // So the token is too.
 }
 
+// Fails if it is destroyed while one of its lookup() calls is running.
+class CheckedIndex : public MemIndex {
+public:
+  ~CheckedIndex() override { EXPECT_EQ(Calls.load(), 0); }
+
+  void lookup(const LookupRequest &Req,
+              function_ref<void(const Symbol &)> Callback) const override {
+    ++Calls;
+    std::this_thread::yield();
+    --Calls;
+  }
+
+private:
+  mutable std::atomic<int> Calls = {0};
+};
+
+TEST(SwapIndexTest, ConcurrentReset) {
+  SwapIndex S(llvm::make_unique<CheckedIndex>());
+  std::atomic<bool> Done = {false};
+  std::vector<std::thread> Readers;
+  for (int I = 0; I < 4; ++I)
+    Readers.emplace_back([&] {
+      while (!Done)
+        S.lookup(LookupRequest(), [](const Symbol &) {});
+    });
+  for (int I = 0; I < 100; ++I)
+    S.reset(llvm::make_unique<CheckedIndex>());
+  Done = true;
+  for (auto &T : Readers)
+    T.join();
+}
+
+// Counts the fuzzyFind and refs requests which reach the wrapped index.
+class CountingIndex : public SymbolIndex {
+public:
+  CountingIndex(std::vector<std::string> QualifiedNames, int &Requests,
+                RefSlab Refs = RefSlab())
+      : Base(MemIndex::build(generateSymbols(std::move(QualifiedNames)),
+                             std::move(Refs))),
+        Requests(Requests) {}
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 function_ref<void(const Symbol &)> Callback) const override {
+    ++Requests;
+    return Base->fuzzyFind(Req, Callback);
+  }
+  void lookup(const LookupRequest &Req,
+              function_ref<void(const Symbol &)> Callback) const override {
+    Base->lookup(Req, Callback);
+  }
+  void refs(const RefsRequest &Req,
+            function_ref<void(const Ref &)> Callback) const override {
+    ++Requests;
+    Base->refs(Req, Callback);
+  }
+  size_t estimateMemoryUsage() const override {
+    return Base->estimateMemoryUsage();
+  }
+
+private:
+  std::unique_ptr<SymbolIndex> Base;
+  int &Requests;
+};
+
+TEST(CachingIndexTest, FuzzyFind) {
+  int Requests = 0;
+  SwapIndex Base(llvm::make_unique<CountingIndex>(
+      std::vector<std::string>{"ns::Foo", "ns::FooBar", "ns::Fob",
+                               "other::FooBar"},
+      Requests));
+  CachingIndex I(Base);
+  FuzzyFindRequest Req;
+  Req.Query = "fo";
+  Req.Scopes = {"ns::"};
+  Req.Limit = 10;
+  EXPECT_THAT(match(I, Req),
+              UnorderedElementsAre("ns::Foo", "ns::FooBar", "ns::Fob"));
+  EXPECT_EQ(Requests, 1);
+  EXPECT_THAT(match(I, Req),
+              UnorderedElementsAre("ns::Foo", "ns::FooBar", "ns::Fob"));
+  EXPECT_EQ(Requests, 1);
+
+  // Longer queries are answered from the results of their prefix.
+  Req.Query = "foob";
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("ns::FooBar"));
+  Req.Query = "foo";
+  Req.Limit = 1;
+  bool Incomplete;
+  EXPECT_THAT(match(I, Req, &Incomplete),
+              ElementsAre(AnyOf("ns::Foo", "ns::FooBar")));
+  EXPECT_TRUE(Incomplete);
+  EXPECT_EQ(Requests, 1);
+
+  // Other filters need a new request.
+  Req.Scopes = {"other::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("other::FooBar"));
+  EXPECT_EQ(Requests, 2);
+
+  // Resetting the base index drops cached results.
+  Base.reset(llvm::make_unique<CountingIndex>(
+      std::vector<std::string>{"other::Food"}, Requests));
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("other::Food"));
+  EXPECT_EQ(Requests, 3);
+}
+
+TEST(CachingIndexTest, Refs) {
+  auto MakeRefs = [](StringRef FileURI) {
+    RefSlab::Builder Refs;
+    Ref R;
+    R.Location.FileURI = FileURI.data();
+    R.Kind = RefKind::Reference;
+    Refs.insert(SymbolID("ns::Foo"), R);
+    return std::move(Refs).build();
+  };
+  int Requests = 0;
+  SwapIndex Base(llvm::make_unique<CountingIndex>(
+      std::vector<std::string>{"ns::Foo", "ns::Bar"}, Requests,
+      MakeRefs("unittest:///foo.cc")));
+  CachingIndex I(Base);
+  auto Files = [&](std::vector<SymbolID> IDs) {
+    RefsRequest Req;
+    Req.IDs.insert(IDs.begin(), IDs.end());
+    std::vector<std::string> Files;
+    I.refs(Req, [&](const Ref &R) { Files.push_back(R.Location.FileURI); });
+    return Files;
+  };
+  SymbolID Foo("ns::Foo"), Bar("ns::Bar");
+  EXPECT_THAT(Files({Foo}), ElementsAre("unittest:///foo.cc"));
+  EXPECT_EQ(Requests, 1);
+  EXPECT_THAT(Files({Foo}), ElementsAre("unittest:///foo.cc"));
+  EXPECT_EQ(Requests, 1);
+
+  // Only the symbols missing from the cache are requested, and those without
+  // refs are remembered too.
+  EXPECT_THAT(Files({Foo, Bar}), ElementsAre("unittest:///foo.cc"));
+  EXPECT_EQ(Requests, 2);
+  EXPECT_THAT(Files({Bar}), ElementsAre());
+  EXPECT_EQ(Requests, 2);
+
+  // Resetting the base index drops cached refs, which outlive the old index.
+  Base.reset(llvm::make_unique<CountingIndex>(
+      std::vector<std::string>{"ns::Foo"}, Requests,
+      MakeRefs("unittest:///bar.cc")));
+  EXPECT_THAT(Files({Foo}), ElementsAre("unittest:///bar.cc"));
+  EXPECT_EQ(Requests, 3);
+}
+
+#ifdef LLVM_ON_UNIX
+TEST(RemoteIndexTest, ForwardsRequests) {
+  RefSlab::Builder Refs;
+  Ref R;
+  R.Location.FileURI = "unittest:///test.cc";
+  R.Kind = RefKind::Reference;
+  Refs.insert(SymbolID("ns::Foo"), R);
+  auto Base =
+      MemIndex::build(generateSymbols({"ns::Foo", "ns::FooBar", "ns::Bar"}),
+                      std::move(Refs).build());
+  auto Server = RemoteIndexServer::listen(*Base, /*Port=*/0);
+  ASSERT_TRUE(bool(Server)) << llvm::toString(Server.takeError());
+  std::thread ServerThread([&] { (*Server)->run(); });
+  auto Remote =
+      connectRemoteIndex("127.0.0.1:" + std::to_string((*Server)->port()));
+
+  FuzzyFindRequest Req;
+  Req.Query = "foo";
+  Req.AnyScope = true;
+  EXPECT_THAT(match(*Remote, Req),
+              UnorderedElementsAre("ns::Foo", "ns::FooBar"));
+  Req.Limit = 1;
+  bool Incomplete;
+  EXPECT_THAT(match(*Remote, Req, &Incomplete),
+              ElementsAre(AnyOf("ns::Foo", "ns::FooBar")));
+  EXPECT_TRUE(Incomplete);
+
+  EXPECT_THAT(lookup(*Remote, {SymbolID("ns::Bar"), SymbolID("ns::Baz")}),
+              ElementsAre("ns::Bar"));
+
+  RefsRequest RefsReq;
+  RefsReq.IDs = {SymbolID("ns::Foo")};
+  std::vector<std::string> Files;
+  Remote->refs(RefsReq,
+               [&](const Ref &R) { Files.push_back(R.Location.FileURI); });
+  EXPECT_THAT(Files, ElementsAre("unittest:///test.cc"));
+
+  (*Server)->stop();
+  ServerThread.join();
+}
+#endif
+
+TEST(ReferencingFilesTest, SelectsTranslationUnits) {
+  RefSlab::Builder Refs;
+  auto AddRef = [&](StringRef QName, const char *FileURI) {
+    Ref R;
+    R.Location.FileURI = FileURI;
+    R.Kind = RefKind::Reference;
+    Refs.insert(SymbolID(QName), R);
+  };
+  AddRef("a::Foo", "unittest:///src/foo.h");
+  AddRef("a::Foo", "unittest:///src/use.cc");
+  AddRef("a::b::Bar", "unittest:///src/bar.cc");
+  AddRef("c::Baz", "unittest:///src/baz.cc");
+  auto I = MemIndex::build(generateSymbols({"a::Foo", "a::b::Bar", "c::Baz"}),
+                           std::move(Refs).build());
+
+  ReferencingFiles InNamespace(*I, findSymbolsInNamespace(*I, "::a"));
+  EXPECT_EQ(InNamespace.size(), 3u);
+  EXPECT_TRUE(InNamespace.mayReference(testPath("src/use.cc")));
+  EXPECT_TRUE(InNamespace.mayReference(testPath("src/./bar.cc")));
+  // The source file next to a referencing header.
+  EXPECT_TRUE(InNamespace.mayReference(testPath("src/foo.cc")));
+  EXPECT_FALSE(InNamespace.mayReference(testPath("src/baz.cc")));
+
+  ReferencingFiles ByName(*I, findSymbolsByName(*I, {"::a::b::Bar"}));
+  EXPECT_EQ(ByName.size(), 1u);
+  EXPECT_TRUE(ByName.mayReference(testPath("src/bar.cc")));
+  EXPECT_FALSE(ByName.mayReference(testPath("src/use.cc")));
+}
+
 TEST(MemIndexTest, MemIndexDeduplicate) {
   std::vector<Symbol> Symbols = {symbol("1"), symbol("2"), symbol("3"),
                                  symbol("2") /* duplicate */};
@@ -197,6 +514,19 @@ TEST(MergeIndexTest, Lookup) {
   EXPECT_THAT(lookup(M, {}), UnorderedElementsAre());
 }
 
+TEST(MergeIndexTest, Profile) {
+  auto I = MemIndex::build(generateSymbols({"ns::A", "ns::B"}), RefSlab()),
+       J = MemIndex::build(generateSymbols({"ns::B", "ns::C"}), RefSlab());
+  MergedIndex M(I.get(), J.get());
+  MemoryTree MT;
+  M.profile(MT);
+  EXPECT_EQ(MT.self(), 0u);
+  EXPECT_EQ(MT.child("dynamic").total(), I->estimateMemoryUsage());
+  EXPECT_GT(MT.child("dynamic").child("symbols").total(), 0u);
+  EXPECT_EQ(MT.child("static").total(), J->estimateMemoryUsage());
+  EXPECT_EQ(MT.total(), M.estimateMemoryUsage());
+}
+
 TEST(MergeIndexTest, FuzzyFind) {
   auto I = MemIndex::build(generateSymbols({"ns::A", "ns::B"}), RefSlab()),
        J = MemIndex::build(generateSymbols({"ns::B", "ns::C"}), RefSlab());
@@ -206,6 +536,79 @@ TEST(MergeIndexTest, FuzzyFind) {
               UnorderedElementsAre("ns::A", "ns::B", "ns::C"));
 }
 
+// Blocks fuzzyFind requests to the wrapped index until released.
+class BlockingIndex : public SymbolIndex {
+public:
+  BlockingIndex(const SymbolIndex &Base, const Notification &Released)
+      : Base(Base), Released(Released) {}
+
+  bool fuzzyFind(const FuzzyFindRequest &Req,
+                 function_ref<void(const Symbol &)> Callback) const override {
+    Released.wait();
+    return Base.fuzzyFind(Req, Callback);
+  }
+  void lookup(const LookupRequest &Req,
+              function_ref<void(const Symbol &)> Callback) const override {
+    Base.lookup(Req, Callback);
+  }
+  void refs(const RefsRequest &Req,
+            function_ref<void(const Ref &)> Callback) const override {
+    Base.refs(Req, Callback);
+  }
+  size_t estimateMemoryUsage() const override {
+    return Base.estimateMemoryUsage();
+  }
+
+private:
+  const SymbolIndex &Base;
+  const Notification &Released;
+};
+
+TEST(MergeIndexTest, FuzzyFindStaticTimeout) {
+  auto I = MemIndex::build(generateSymbols({"ns::A", "ns::B"}), RefSlab()),
+       J = MemIndex::build(generateSymbols({"ns::B", "ns::C"}), RefSlab());
+  FuzzyFindRequest Req;
+  Req.Scopes = {"ns::"};
+  EXPECT_THAT(match(MergedIndex(I.get(), J.get(), std::chrono::seconds(10)),
+                    Req),
+              UnorderedElementsAre("ns::A", "ns::B", "ns::C"));
+
+  Notification Released;
+  BlockingIndex SlowJ(*J, Released);
+  MergedIndex Merged(I.get(), &SlowJ, std::chrono::milliseconds(10));
+  bool Incomplete = false;
+  EXPECT_THAT(match(Merged, Req, &Incomplete),
+              UnorderedElementsAre("ns::A", "ns::B"));
+  EXPECT_TRUE(Incomplete);
+  Released.notify(); // ~MergedIndex waits for the static query to finish.
+}
+
+TEST(MergeIndexTest, FuzzyFindScored) {
+  auto I = MemIndex::build(generateSymbols({"ns::Alpha", "ns::Beta"}),
+                           RefSlab()),
+       J = MemIndex::build(generateSymbols({"ns::Beta", "ns::Alphabet"}),
+                           RefSlab());
+  Notification Released;
+  Released.notify();
+  // Uses the default implementation of fuzzyFindScored().
+  BlockingIndex Other(*J, Released);
+  FuzzyFindRequest Req;
+  Req.Query = "alp";
+  Req.Scopes = {"ns::"};
+  FuzzyMatcher Filter(Req.Query);
+  for (auto Timeout : {Optional<std::chrono::milliseconds>(),
+                       Optional<std::chrono::milliseconds>(
+                           std::chrono::seconds(10))}) {
+    MergedIndex Merged(I.get(), &Other, Timeout);
+    std::vector<std::string> Matches;
+    Merged.fuzzyFindScored(Req, [&](const Symbol &Sym, float NameMatch) {
+      Matches.push_back(Sym.Name);
+      EXPECT_EQ(Filter.match(Sym.Name), NameMatch) << Sym.Name;
+    });
+    EXPECT_THAT(Matches, UnorderedElementsAre("Alpha", "Alphabet"));
+  }
+}
+
 TEST(MergeTest, Merge) {
   Symbol L, R;
   L.ID = R.ID = SymbolID("hello");
@@ -292,13 +695,20 @@ TEST(MergeIndexTest, Refs) {
   RefSlab::Builder Results;
   Merge.refs(Request, [&](const Ref &O) { Results.insert(Foo.ID, O); });
 
-  EXPECT_THAT(
-      std::move(Results).build(),
-      ElementsAre(Pair(
-          _, UnorderedElementsAre(AllOf(RefRange(Test1Code.range("Foo")),
-                                        FileURI("unittest:///test.cc")),
-                                  AllOf(RefRange(Test2Code.range("Foo")),
-                                        FileURI("unittest:///test2.cc"))))));
+  auto ExpectedRefs = ElementsAre(
+      Pair(_, UnorderedElementsAre(AllOf(RefRange(Test1Code.range("Foo")),
+                                         FileURI("unittest:///test.cc")),
+                                   AllOf(RefRange(Test2Code.range("Foo")),
+                                         FileURI("unittest:///test2.cc")))));
+  EXPECT_THAT(std::move(Results).build(), ExpectedRefs);
+
+  RefSlab::Builder BatchResults;
+  Merge.refsBySymbol(Request, [&](const SymbolID &ID, ArrayRef<Ref> Refs) {
+    EXPECT_EQ(ID, Foo.ID);
+    for (const auto &O : Refs)
+      BatchResults.insert(ID, O);
+  });
+  EXPECT_THAT(std::move(BatchResults).build(), ExpectedRefs);
 }
 
 MATCHER_P2(IncludeHeaderWithRef, IncludeHeader, References,  "") {
@@ -184,6 +184,23 @@ Notification exit: null
   EXPECT_EQ(trim(input_mirror()), trim(input()));
 }
 
+// Messages are read into a reused buffer: a short message after a long one
+// must not see the end of the long one.
+TEST_F(JSONTransportTest, ReusedBuffer) {
+  std::string Long = std::string(R"({"jsonrpc": "2.0", "method": "long", )") +
+                     R"("params": ")" + std::string(100000, 'x') + R"("})";
+  auto T = transport("Content-Length: " + std::to_string(Long.size()) +
+                         "\r\n\r\n" + Long +
+                         "Content-Length: 36\r\n\r\n"
+                         R"({"jsonrpc": "2.0", "method": "exit"})",
+                     /*Pretty=*/false, JSONStreamStyle::Standard);
+  Echo E(*T);
+  auto Err = T->loop(E);
+  EXPECT_FALSE(bool(Err)) << toString(std::move(Err));
+  EXPECT_THAT(E.log(), ::testing::HasSubstr("Notification exit: null"));
+  EXPECT_EQ(trim(input_mirror()), trim(input()));
+}
+
 // IO errors such as EOF ane reported.
 // The only successful return from loop() is if a handler returned false.
 TEST_F(JSONTransportTest, EndOfFile) {
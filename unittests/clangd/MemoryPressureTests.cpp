@@ -0,0 +1,63 @@
+//===-- MemoryPressureTests.cpp ---------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MemoryPressure.h"
+#include "Threading.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(MemoryPressureMonitorTest, EscalatesAndClears) {
+  constexpr int Cleared = -1;
+  std::mutex Mu;
+  size_t Resident = 200;   /* GUARDED_BY(Mu) */
+  std::vector<int> Events; /* GUARDED_BY(Mu) */
+  Notification Done;
+  {
+    MemoryPressureMonitor Monitor(
+        /*LimitBytes=*/100, std::chrono::milliseconds(1),
+        [&](unsigned Level) {
+          std::lock_guard<std::mutex> Lock(Mu);
+          Events.push_back(Level);
+          // Memory is only freed at the third level.
+          if (Level == 2)
+            Resident = 50;
+          // Under the limit, but too close to it to undo the actions.
+          if (Events.size() == 5)
+            Resident = 90;
+        },
+        [&] {
+          std::lock_guard<std::mutex> Lock(Mu);
+          Events.push_back(Cleared);
+          if (Events.size() == 4)
+            Resident = 200; // Over the limit again.
+          else
+            Done.notify();
+        },
+        [&] {
+          std::lock_guard<std::mutex> Lock(Mu);
+          // Slowly falls to the margin once it's under the limit.
+          if (Resident < 100 && Resident > 50)
+            return Resident--;
+          return Resident;
+        });
+    Done.wait();
+  }
+  // The levels start over after the pressure cleared.
+  EXPECT_THAT(Events, ElementsAre(0, 1, 2, Cleared, 0, Cleared));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,79 @@
+//===-- MemoryTreeTests.cpp -----------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MemoryTree.h"
+#include "Trace.h"
+#include "llvm/ADT/StringMap.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+namespace clang {
+namespace clangd {
+namespace {
+
+using ::testing::Pair;
+using ::testing::UnorderedElementsAre;
+
+TEST(MemoryTreeTest, Totals) {
+  MemoryTree MT;
+  MT.addUsage(1);
+  MT.child("a").addUsage(10);
+  MT.child("a").child("x").addUsage(100);
+  MT.child("b").addUsage(1000);
+  EXPECT_EQ(MT.self(), 1u);
+  EXPECT_EQ(MT.total(), 1111u);
+  EXPECT_EQ(MT.child("a").self(), 10u);
+  EXPECT_EQ(MT.child("a").total(), 110u);
+  EXPECT_EQ(MT.children().size(), 2u);
+
+  json::Value Expected = json::Object{
+      {"_self", 1},
+      {"_total", 1111},
+      {"a", json::Object{{"_self", 10},
+                         {"_total", 110},
+                         {"x", json::Object{{"_self", 100}, {"_total", 100}}}}},
+      {"b", json::Object{{"_self", 1000}, {"_total", 1000}}},
+  };
+  EXPECT_EQ(toJSON(MT), Expected);
+}
+
+TEST(MemoryTreeTest, Record) {
+  class MetricsRecorder : public trace::EventTracer {
+  public:
+    Context beginSpan(StringRef, json::Object *) override {
+      return Context::current().clone();
+    }
+    void instant(StringRef, json::Object &&) override {}
+    void metric(StringRef Name, double Value) override {
+      Metrics[Name] = Value;
+    }
+    StringMap<double> Metrics;
+  } Recorder;
+
+  MemoryTree MT;
+  MT.child("index").child("symbols").addUsage(10);
+  MT.child("files").addUsage(5);
+  {
+    trace::Session Session(Recorder);
+    record(MT, "clangd");
+  }
+  std::vector<std::pair<std::string, double>> Metrics;
+  for (const auto &M : Recorder.Metrics)
+    Metrics.emplace_back(M.first(), M.second);
+  EXPECT_THAT(Metrics, UnorderedElementsAre(
+                           Pair("MemoryUsage.clangd", 15),
+                           Pair("MemoryUsage.clangd.files", 5),
+                           Pair("MemoryUsage.clangd.index", 10),
+                           Pair("MemoryUsage.clangd.index.symbols", 10)));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
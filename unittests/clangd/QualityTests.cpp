@@ -432,6 +432,34 @@ TEST(QualityTests, ItemWithFixItsRankedDown) {
   EXPECT_LT(RelevanceWithFixIt.evaluate(), RelevanceWithoutFixIt.evaluate());
 }
 
+TEST(QualityTests, DecisionForest) {
+  SymbolQualitySignals Quality;
+  SymbolRelevanceSignals Relevance;
+  float Default = evaluateDecisionForest(Quality, Relevance);
+  EXPECT_GT(Default, 0);
+
+  Relevance.NameMatch = 0.5;
+  EXPECT_FLOAT_EQ(evaluateDecisionForest(Quality, Relevance), Default / 2);
+  Relevance.NameMatch = 1;
+
+  SymbolQualitySignals Deprecated;
+  Deprecated.Deprecated = true;
+  EXPECT_LT(evaluateDecisionForest(Deprecated, Relevance), Default);
+
+  SymbolRelevanceSignals Local;
+  Local.Query = SymbolRelevanceSignals::CodeComplete;
+  Local.Scope = SymbolRelevanceSignals::FunctionScope;
+  EXPECT_GT(evaluateDecisionForest(Quality, Local), Default);
+
+  // The batch scores match the single ones.
+  std::vector<SymbolQualitySignals> Qualities = {Quality, Deprecated};
+  std::vector<SymbolRelevanceSignals> Relevances = {Relevance, Local};
+  std::vector<float> Scores(2);
+  evaluateDecisionForest(Qualities, Relevances, Scores);
+  EXPECT_FLOAT_EQ(Scores[0], Default);
+  EXPECT_FLOAT_EQ(Scores[1], evaluateDecisionForest(Deprecated, Local));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
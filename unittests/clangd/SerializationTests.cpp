@@ -7,8 +7,11 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "Matchers.h"
 #include "index/Index.h"
 #include "index/Serialization.h"
+#include "index/dex/Dex.h"
+#include "llvm/Support/Compression.h"
 #include "llvm/Support/SHA1.h"
 #include "llvm/Support/ScopedPrinter.h"
 #include "gmock/gmock.h"
@@ -16,6 +19,9 @@
 
 using testing::_;
 using testing::AllOf;
+using testing::Contains;
+using testing::ElementsAre;
+using testing::ElementsAreArray;
 using testing::Pair;
 using testing::UnorderedElementsAre;
 using testing::UnorderedElementsAreArray;
@@ -139,6 +145,44 @@ TEST(SerializationTest, YAMLConversions) {
   EXPECT_EQ(StringRef(Ref1.Location.FileURI), "file:///path/foo.cc");
 }
 
+TEST(SerializationTest, LargeYAML) {
+  // Large enough to be parsed in chunks on several threads.
+  SymbolSlab::Builder Builder;
+  std::string Documentation(400, 'x');
+  for (unsigned I = 0; I < 6000; ++I) {
+    Symbol Sym;
+    Sym.ID = SymbolID(("sym" + Twine(I)).str());
+    Sym.Name = "Name";
+    Sym.CanonicalDeclaration.FileURI = "file:///path/foo.h";
+    Sym.Documentation = Documentation;
+    Builder.insert(Sym);
+  }
+  IndexFileIn In;
+  In.Symbols = std::move(Builder).build();
+  IndexFileOut Out(In);
+  Out.Format = IndexFileFormat::YAML;
+  std::string Serialized = to_string(Out);
+  ASSERT_GT(Serialized.size(), 2u << 20);
+  // Later entries override earlier ones, across chunks too.
+  SymbolSlab::Builder Replacement;
+  Symbol Replaced = *In.Symbols->find(SymbolID("sym0"));
+  Replaced.Name = "Replaced";
+  Replacement.insert(Replaced);
+  IndexFileIn ReplacementIn;
+  ReplacementIn.Symbols = std::move(Replacement).build();
+  IndexFileOut ReplacementOut(ReplacementIn);
+  ReplacementOut.Format = IndexFileFormat::YAML;
+  Serialized += to_string(ReplacementOut);
+
+  auto Parsed = readIndexFile(Serialized);
+  ASSERT_TRUE(bool(Parsed)) << Parsed.takeError();
+  ASSERT_TRUE(Parsed->Symbols);
+  EXPECT_EQ(Parsed->Symbols->size(), 6000u);
+  EXPECT_EQ(Parsed->Symbols->find(SymbolID("sym0"))->Name, "Replaced");
+  EXPECT_EQ(Parsed->Symbols->find(SymbolID("sym5999"))->Documentation,
+            Documentation);
+}
+
 std::vector<std::string> YAMLFromSymbols(const SymbolSlab &Slab) {
   std::vector<std::string> Result;
   for (const auto &Sym : Slab)
@@ -173,6 +217,45 @@ TEST(SerializationTest, BinaryConversions) {
               UnorderedElementsAreArray(YAMLFromRefs(*In->Refs)));
 }
 
+TEST(SerializationTest, UncompressedStringsInPlace) {
+  auto In = readIndexFile(YAML);
+  EXPECT_TRUE(bool(In)) << In.takeError();
+
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.CompressStrings = false;
+  std::string Serialized = to_string(Out);
+  // The string table data starts on a page boundary.
+  size_t StringTable = Serialized.find("stri");
+  ASSERT_NE(StringTable, std::string::npos);
+  EXPECT_EQ((StringTable + 8) % 4096, 0u);
+
+  auto Copied = readIndexFile(Serialized);
+  ASSERT_TRUE(bool(Copied)) << Copied.takeError();
+  auto InPlace = readIndexFile(Serialized, /*CopyStrings=*/false);
+  ASSERT_TRUE(bool(InPlace)) << InPlace.takeError();
+  ASSERT_TRUE(InPlace->Symbols);
+  ASSERT_TRUE(InPlace->Refs);
+  EXPECT_THAT(YAMLFromSymbols(*InPlace->Symbols),
+              UnorderedElementsAreArray(YAMLFromSymbols(*In->Symbols)));
+  EXPECT_THAT(YAMLFromRefs(*InPlace->Refs),
+              UnorderedElementsAreArray(YAMLFromRefs(*In->Refs)));
+
+  auto PointsIntoFile = [&](StringRef S) {
+    return S.data() >= Serialized.data() &&
+           S.data() + S.size() <= Serialized.data() + Serialized.size();
+  };
+  for (const auto &Sym : *InPlace->Symbols) {
+    EXPECT_TRUE(PointsIntoFile(Sym.Name)) << Sym.Name.str();
+    EXPECT_TRUE(PointsIntoFile(Sym.CanonicalDeclaration.FileURI));
+  }
+  for (const auto &Sym : *InPlace->Refs)
+    for (const auto &Ref : Sym.second)
+      EXPECT_TRUE(PointsIntoFile(Ref.Location.FileURI));
+  for (const auto &Sym : *Copied->Symbols)
+    EXPECT_FALSE(PointsIntoFile(Sym.Name)) << Sym.Name.str();
+}
+
 TEST(SerializationTest, HashTest) {
   auto In = readIndexFile(YAML);
   EXPECT_TRUE(bool(In)) << In.takeError();
@@ -200,6 +283,161 @@ TEST(SerializationTest, HashTest) {
               UnorderedElementsAreArray(YAMLFromRefs(*In->Refs)));
 }
 
+TEST(SerializationTest, PostingsRoundTrip) {
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+  std::vector<const Symbol *> Symbols;
+  for (const auto &Sym : *In->Symbols)
+    Symbols.push_back(&Sym);
+  dex::Postings Postings = dex::buildPostings(Symbols);
+
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.Postings = &Postings;
+  std::string Serialized = to_string(Out);
+
+  auto In2 = readIndexFile(Serialized);
+  ASSERT_TRUE(bool(In2)) << In2.takeError();
+  ASSERT_TRUE(In2->Symbols);
+  ASSERT_TRUE(In2->Postings);
+  EXPECT_EQ(In2->Postings->SymbolOrder, Postings.SymbolOrder);
+  EXPECT_EQ(In2->Postings->SymbolQuality, Postings.SymbolQuality);
+  ASSERT_EQ(In2->Postings->InvertedIndex.size(),
+            Postings.InvertedIndex.size());
+  for (const auto &TokenAndList : Postings.InvertedIndex) {
+    auto It = In2->Postings->InvertedIndex.find(TokenAndList.first);
+    ASSERT_NE(It, In2->Postings->InvertedIndex.end())
+        << to_string(TokenAndList.first);
+    EXPECT_EQ(to_string(*It->second.iterator()),
+              to_string(*TokenAndList.second.iterator()));
+  }
+
+  // The loaded postings can be used to build a Dex index directly.
+  auto Index = dex::Dex::build(std::move(*In2->Symbols), std::move(*In2->Refs),
+                               std::move(*In2->Postings));
+  FuzzyFindRequest Req;
+  Req.Query = "Foo";
+  Req.Scopes = {"clang::"};
+  std::vector<std::string> Matches;
+  Index->fuzzyFind(Req, [&](const Symbol &Sym) {
+    Matches.push_back((Sym.Scope + Sym.Name).str());
+  });
+  EXPECT_THAT(Matches, UnorderedElementsAre("clang::Foo1", "clang::Foo2"));
+}
+
+TEST(SerializationTest, PostingsMismatch) {
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+  // Postings over no symbols don't describe the symbols in the file.
+  dex::Postings Postings = dex::buildPostings({});
+
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.Postings = &Postings;
+  auto In2 = readIndexFile(to_string(Out));
+  EXPECT_FALSE(bool(In2));
+  llvm::consumeError(In2.takeError());
+}
+
+TEST(SerializationTest, CompressedDocumentation) {
+  // Several blocks of documentation.
+  SymbolSlab::Builder Builder;
+  std::vector<std::string> Docs;
+  for (unsigned I = 0; I < 200; ++I)
+    Docs.push_back(("Documentation of sym" + Twine(I)).str());
+  for (unsigned I = 0; I < 200; ++I) {
+    Symbol Sym;
+    Sym.ID = SymbolID(("sym" + Twine(I)).str());
+    Sym.Name = "Name";
+    Sym.CanonicalDeclaration.FileURI = "file:///path/foo.h";
+    Sym.Documentation = Docs[I];
+    Builder.insert(Sym);
+  }
+  IndexFileIn In;
+  In.Symbols = std::move(Builder).build();
+  IndexFileOut Out(In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.CompressDocumentation = true;
+  std::string Serialized = to_string(Out);
+  if (zlib::isAvailable())
+    EXPECT_EQ(Serialized.find("Documentation of sym"), std::string::npos);
+
+  auto Decompressed = readIndexFile(Serialized);
+  ASSERT_TRUE(bool(Decompressed)) << Decompressed.takeError();
+  ASSERT_TRUE(Decompressed->Symbols);
+  EXPECT_FALSE(Decompressed->Documentation);
+  EXPECT_THAT(YAMLFromSymbols(*Decompressed->Symbols),
+              UnorderedElementsAreArray(YAMLFromSymbols(*In.Symbols)));
+
+  auto Compressed = readIndexFile(Serialized, /*CopyStrings=*/false,
+                                  /*DecompressDocumentation=*/false);
+  ASSERT_TRUE(bool(Compressed)) << Compressed.takeError();
+  ASSERT_TRUE(Compressed->Symbols);
+  ASSERT_TRUE(Compressed->Documentation);
+  ASSERT_EQ(Compressed->Documentation->size(), 200u);
+  std::vector<const Symbol *> Symbols;
+  size_t I = 0;
+  for (const auto &Sym : *Compressed->Symbols) {
+    EXPECT_EQ(Sym.Documentation, "");
+    EXPECT_EQ(Compressed->Documentation->get(I++),
+              In.Symbols->find(Sym.ID)->Documentation);
+    Symbols.push_back(&Sym);
+  }
+
+  // Dex returns the symbols with their documentation.
+  dex::Dex Index(*Compressed->Symbols,
+                 std::vector<std::pair<SymbolID, ArrayRef<Ref>>>(),
+                 dex::buildPostings(Symbols),
+                 std::move(*Compressed->Documentation), /*BackingData=*/0,
+                 /*BackingDataSize=*/0);
+  LookupRequest Req;
+  Req.IDs = {SymbolID("sym7"), SymbolID("sym150")};
+  std::vector<std::string> Looked;
+  Index.lookup(Req, [&](const Symbol &Sym) {
+    Looked.push_back(Sym.Documentation);
+  });
+  EXPECT_THAT(Looked, UnorderedElementsAre(Docs[7], Docs[150]));
+}
+
+TEST(SerializationTest, StringDictionary) {
+  auto In = readIndexFile(YAML);
+  ASSERT_TRUE(bool(In)) << In.takeError();
+  IndexFileOut Out(*In);
+  Out.Format = IndexFileFormat::RIFF;
+  Out.CompressStrings = false;
+
+  // Strings occurring in a single sample aren't in the dictionary.
+  StringDictionary::Builder Samples;
+  Samples.addSample(Out);
+  EXPECT_THAT(Samples.build().strings(), ElementsAre());
+  Samples.addSample(Out);
+  StringDictionary Dictionary = Samples.build();
+  EXPECT_THAT(Dictionary.strings(), Contains("file:///path/foo.h"));
+  auto Reread = StringDictionary::fromData(Dictionary.data());
+  ASSERT_TRUE(bool(Reread)) << Reread.takeError();
+  EXPECT_EQ(Reread->hash(), Dictionary.hash());
+  EXPECT_THAT(Reread->strings(), ElementsAreArray(Dictionary.strings()));
+
+  Out.Dictionary = &Dictionary;
+  std::string Serialized = to_string(Out);
+  EXPECT_EQ(Serialized.find("file:///path/foo.h"), std::string::npos);
+
+  // The file can only be read with its dictionary.
+  EXPECT_ERROR(readIndexFile(Serialized));
+  StringDictionary Other;
+  EXPECT_ERROR(readIndexFile(Serialized, /*CopyStrings=*/true,
+                             /*DecompressDocumentation=*/true, &Other));
+  auto In2 = readIndexFile(Serialized, /*CopyStrings=*/true,
+                           /*DecompressDocumentation=*/true, &Dictionary);
+  ASSERT_TRUE(bool(In2)) << In2.takeError();
+  ASSERT_TRUE(In2->Symbols);
+  ASSERT_TRUE(In2->Refs);
+  EXPECT_THAT(YAMLFromSymbols(*In2->Symbols),
+              UnorderedElementsAreArray(YAMLFromSymbols(*In->Symbols)));
+  EXPECT_THAT(YAMLFromRefs(*In2->Refs),
+              UnorderedElementsAreArray(YAMLFromRefs(*In->Refs)));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -10,6 +10,7 @@
 #include "Annotations.h"
 #include "TestFS.h"
 #include "TestTU.h"
+#include "index/IndexAction.h"
 #include "index/SymbolCollector.h"
 #include "clang/Basic/FileManager.h"
 #include "clang/Basic/FileSystemOptions.h"
@@ -498,6 +499,35 @@ TEST_F(SymbolCollectorTest, RefsInHeaders) {
                                   HaveRanges(Header.ranges()))));
 }
 
+TEST_F(SymbolCollectorTest, FileFilter) {
+  // Only the main file is indexed.
+  CollectorOpts.FileFilter = [](const SourceManager &SM, FileID FID) {
+    return FID == SM.getMainFileID();
+  };
+  CollectorOpts.CollectMacro = true;
+  CollectorOpts.RefFilter = RefKind::All;
+  CollectorOpts.RefsInHeaders = true;
+  const std::string Header = R"(
+    class Foo {};
+    void f();
+    #define MACRO 1
+  )";
+  const std::string Main = R"(
+    void f() {}
+    void g() { Foo x; }
+  )";
+  runSymbolCollector(Header, Main);
+  // Foo and MACRO are only declared in the header. The definition of f in the
+  // main file keeps its declaration from the header.
+  EXPECT_THAT(Symbols, UnorderedElementsAre(AllOf(QName("f"),
+                                                  DeclURI(TestHeaderURI),
+                                                  DefURI(TestFileURI)),
+                                            QName("g")));
+  for (const auto &SymRefs : Refs)
+    for (const auto &R : SymRefs.second)
+      EXPECT_EQ(StringRef(R.Location.FileURI), TestFileURI);
+}
+
 TEST_F(SymbolCollectorTest, References) {
   const std::string Header = R"(
     class W;
@@ -715,6 +745,30 @@ TEST_F(SymbolCollectorTest, SymbolWithDocumentation) {
                              ReturnType("int"), Doc("Foo comment."))));
 }
 
+TEST_F(SymbolCollectorTest, SkipUnusedCompletionInfo) {
+  CollectorOpts.SkipUnusedCompletionInfo = true;
+  const std::string Header = R"(
+    /// Foo comment.
+    int ff(int x);
+    struct S {
+      /// Method comment.
+      int method(int y);
+      /// Field comment.
+      int field;
+    };
+  )";
+  runSymbolCollector(Header, /*Main=*/"");
+  EXPECT_THAT(
+      Symbols,
+      UnorderedElementsAre(
+          AllOf(QName("ff"), Labeled("ff(int x)"), ReturnType("int"),
+                Doc("Foo comment.")),
+          QName("S"),
+          AllOf(QName("S::method"), Labeled("method"), ReturnType(""),
+                Doc("Method comment.")),
+          AllOf(QName("S::field"), Labeled("field"), Doc(""))));
+}
+
 TEST_F(SymbolCollectorTest, Snippet) {
   const std::string Header = R"(
     namespace nx {
@@ -757,6 +811,22 @@ TEST_F(SymbolCollectorTest, CanonicalSTLHeader) {
 }
 #endif
 
+TEST(CanonicalIncludesTest, PathSuffixMapping) {
+  CanonicalIncludes Includes;
+  Includes.addPathSuffixMapping("bits/vector.h", "<vector>");
+  Includes.addPathSuffixMapping("include/bits/vector.h", "<not_used>");
+  Includes.addPathSuffixMapping("string.h", "<string>");
+  auto Map = [&](std::string Header) {
+    return Includes.mapHeader({Header}, "").str();
+  };
+  EXPECT_EQ(Map("/usr/include/bits/vector.h"), "<vector>");
+  EXPECT_EQ(Map("/usr/include/string.h"), "<string>");
+  // Suffixes match whole path components.
+  EXPECT_EQ(Map("/usr/include/xbits/vector.h"), "/usr/include/xbits/vector.h");
+  EXPECT_EQ(Map("/usr/include/vector.h"), "/usr/include/vector.h");
+  EXPECT_EQ(Map("/usr/include/mystring.h"), "/usr/include/mystring.h");
+}
+
 TEST_F(SymbolCollectorTest, STLiosfwd) {
   CollectorOpts.CollectIncludePath = true;
   CanonicalIncludes Includes;
@@ -1028,6 +1098,30 @@ TEST_F(SymbolCollectorTest, ImplementationDetail) {
                   AllOf(QName("Public"), Not(ImplementationDetail()))));
 }
 
+TEST(StaticIndexingActionTest, SkipsBodiesInFilteredFiles) {
+  SymbolCollector::Options Opts;
+  Opts.FileFilter = [](const SourceManager &SM, FileID FID) {
+    const auto *F = SM.getFileEntryForID(FID);
+    return !F || !F->getName().endswith("skipped.h");
+  };
+  SymbolSlab Symbols;
+  bool Reported = false;
+  // The body with an error isn't parsed, so the TU is still indexed.
+  tooling::runToolOnCodeWithArgs(
+      createStaticIndexingAction(Opts,
+                                 [&](SymbolSlab S) {
+                                   Symbols = std::move(S);
+                                   Reported = true;
+                                 },
+                                 nullptr)
+          .release(),
+      "#include \"skipped.h\"\nvoid kept() {}", {"-xc++"},
+      testPath("main.cc"), "clangd", std::make_shared<PCHContainerOperations>(),
+      {{testPath("skipped.h"), "void skipped() { undeclared(); }"}});
+  EXPECT_TRUE(Reported);
+  EXPECT_THAT(Symbols, UnorderedElementsAre(QName("kept")));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -12,6 +12,7 @@
 #include "TUScheduler.h"
 #include "TestFS.h"
 #include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FormatVariadic.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include <algorithm>
@@ -26,8 +27,10 @@ using ::testing::_;
 using ::testing::AnyOf;
 using ::testing::Each;
 using ::testing::ElementsAre;
+using ::testing::IsEmpty;
 using ::testing::Pair;
 using ::testing::Pointee;
+using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
 
 class TUSchedulerTests : public ::testing::Test {
@@ -208,6 +211,28 @@ static std::vector<std::string> includes(const PreambleData *Preamble) {
   return Result;
 }
 
+TEST(DebouncePolicy, Compute) {
+  using ms = std::chrono::milliseconds;
+  DebouncePolicy Policy;
+  Policy.Min = ms(20);
+  Policy.Max = ms(1000);
+  Policy.RebuildRatio = 0.5;
+  auto Compute = [&](std::vector<ms> History) {
+    std::vector<std::chrono::steady_clock::duration> Durations(History.begin(),
+                                                               History.end());
+    return std::chrono::duration_cast<ms>(Policy.compute(Durations)).count();
+  };
+  EXPECT_EQ(Compute({}), 1000);
+  EXPECT_EQ(Compute({ms(200)}), 100);
+  // The median is used, ignoring the outlier.
+  EXPECT_EQ(Compute({ms(200), ms(10000), ms(400)}), 200);
+  EXPECT_EQ(Compute({ms(10)}), 20);
+  EXPECT_EQ(Compute({ms(15000)}), 1000);
+
+  Policy = ms(300);
+  EXPECT_EQ(Compute({ms(10000)}), 300);
+}
+
 TEST_F(TUSchedulerTests, PreambleConsistency) {
   std::atomic<int> CallbackCount(0);
   {
@@ -481,6 +506,105 @@ TEST_F(TUSchedulerTests, EvictedAST) {
               UnorderedElementsAre(Foo, AnyOf(Bar, Baz)));
 }
 
+TEST_F(TUSchedulerTests, EvictedASTOverMemoryLimit) {
+  ASTRetentionPolicy Policy;
+  Policy.MaxRetainedASTs = 10;
+  // Any AST is bigger than that, so only the most recent one is kept.
+  Policy.MaxRetainedBytes = 1;
+  TUScheduler S(
+      /*AsyncThreadsCount=*/1, /*StorePreambleInMemory=*/true,
+      /*ASTCallbacks=*/nullptr,
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(), Policy);
+
+  auto Foo = testPath("foo.cpp");
+  auto Bar = testPath("bar.cpp");
+  S.update(Foo, getInputs(Foo, "int a;"), WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_THAT(S.getFilesWithCachedAST(), UnorderedElementsAre(Foo));
+
+  S.update(Bar, getInputs(Bar, "int b;"), WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_THAT(S.getFilesWithCachedAST(), UnorderedElementsAre(Bar));
+}
+
+TEST_F(TUSchedulerTests, EvictedASTWeighedByBuildTime) {
+  ASTRetentionPolicy Policy;
+  Policy.MaxRetainedASTs = 2;
+  Policy.WeighByBuildTime = true;
+  TUScheduler S(
+      /*AsyncThreadsCount=*/1, /*StorePreambleInMemory=*/true,
+      /*ASTCallbacks=*/nullptr,
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(), Policy);
+
+  // Takes much longer to build than the other files.
+  std::string HeavyContents;
+  for (unsigned I = 0; I < 5000; ++I)
+    HeavyContents +=
+        llvm::formatv("int f{0}(int x) {{ return x + {0}; }\n", I).str();
+  auto Heavy = testPath("heavy.cpp");
+  auto Foo = testPath("foo.cpp");
+  auto Bar = testPath("bar.cpp");
+  S.update(Heavy, getInputs(Heavy, HeavyContents), WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  S.update(Foo, getInputs(Foo, "int a;"), WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  S.update(Bar, getInputs(Bar, "int b;"), WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+
+  // The least recently used AST is kept, as it's the heaviest.
+  EXPECT_THAT(S.getFilesWithCachedAST(), UnorderedElementsAre(Heavy, Bar));
+}
+
+TEST_F(TUSchedulerTests, RelieveMemoryPressure) {
+  TUScheduler S(
+      /*AsyncThreadsCount=*/1, /*StorePreambleInMemory=*/true,
+      /*ASTCallbacks=*/nullptr,
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy());
+  auto Foo = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "void foo();";
+  Timestamps[Header] = time_t(0);
+  auto IsStoredInMemory = [&] {
+    bool InMemory = false;
+    S.runWithPreamble("IsStoredInMemory", Foo, TUScheduler::Stale,
+                      [&](Expected<InputsAndPreamble> Preamble) {
+                        InMemory = cantFail(std::move(Preamble))
+                                       .Preamble->StoredInMemory;
+                      });
+    EXPECT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+    return InMemory;
+  };
+
+  S.update(Foo, getInputs(Foo, "#include \"foo.h\"\nint a;"),
+           WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_THAT(S.getFilesWithCachedAST(), UnorderedElementsAre(Foo));
+  EXPECT_TRUE(IsStoredInMemory());
+
+  S.dropIdleASTs();
+  EXPECT_THAT(S.getFilesWithCachedAST(), IsEmpty());
+
+  // The preamble moves to disk when the file is rebuilt, even if it could be
+  // reused otherwise.
+  S.storePreamblesOnDisk();
+  EXPECT_TRUE(IsStoredInMemory());
+  S.update(Foo, getInputs(Foo, "#include \"foo.h\"\nint b;"),
+           WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_FALSE(IsStoredInMemory());
+
+  // Once the pressure clears, preambles are stored in memory again when they
+  // are rebuilt.
+  S.restorePreambleStorage();
+  Files[Header] = "void foo(int);";
+  Timestamps[Header] = time_t(1);
+  S.update(Foo, getInputs(Foo, "#include \"foo.h\"\nint b;"),
+           WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_TRUE(IsStoredInMemory());
+}
+
 TEST_F(TUSchedulerTests, EmptyPreamble) {
   TUScheduler S(
       /*AsyncThreadsCount=*/4, /*StorePreambleInMemory=*/true,
@@ -524,6 +648,172 @@ TEST_F(TUSchedulerTests, EmptyPreamble) {
                     });
 }
 
+TEST_F(TUSchedulerTests, SharedPreamble) {
+  TUScheduler S(
+      /*AsyncThreadsCount=*/4, /*StorePreambleInMemory=*/true,
+      /*ASTCallbacks=*/nullptr,
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy());
+  auto Foo = testPath("foo.cpp");
+  auto Bar = testPath("bar.cpp");
+  auto Baz = testPath("baz.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "void foo();";
+  Timestamps[Header] = time_t(0);
+
+  auto getPreamble = [&](PathRef File) {
+    const void *Result = nullptr;
+    S.runWithPreamble("getPreamble", File, TUScheduler::Stale,
+                      [&](Expected<InputsAndPreamble> IP) {
+                        Result = cantFail(std::move(IP)).Preamble;
+                      });
+    EXPECT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+    return Result;
+  };
+
+  S.update(Foo, getInputs(Foo, "#include \"foo.h\"\nint a = 1;"),
+           WantDiagnostics::Auto);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  S.update(Bar, getInputs(Bar, "#include \"foo.h\"\nint b = 2;"),
+           WantDiagnostics::Auto);
+  S.update(Baz, getInputs(Baz, "#include \"foo.h\"\n#define BAZ\nint c;"),
+           WantDiagnostics::Auto);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+
+  const void *FooPreamble = getPreamble(Foo);
+  ASSERT_NE(FooPreamble, nullptr);
+  EXPECT_EQ(getPreamble(Bar), FooPreamble);
+  // The preamble of baz.cpp also contains the macro definition.
+  EXPECT_NE(getPreamble(Baz), FooPreamble);
+}
+
+TEST_F(TUSchedulerTests, SpeculativePreamble) {
+  class CountPreambles : public ParsingCallbacks {
+  public:
+    CountPreambles(std::atomic<int> &Count) : Count(Count) {}
+    void onPreambleAST(PathRef Path, ASTContext &Ctx,
+                       std::shared_ptr<clang::Preprocessor> PP) override {
+      ++Count;
+    }
+
+  private:
+    std::atomic<int> &Count;
+  };
+  auto Foo = testPath("foo.cpp");
+  auto Bar = testPath("bar.cpp");
+  auto Baz = testPath("baz.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "void foo();";
+  Timestamps[Header] = time_t(0);
+
+  std::atomic<int> BuiltPreambles(0);
+  SpeculativePreambleBudget Budget;
+  Budget.MaxBuilds = 1;
+  Budget.MaxBytes = 1 << 30;
+  TUScheduler S(
+      /*AsyncThreadsCount=*/4, /*StorePreambleInMemory=*/true,
+      llvm::make_unique<CountPreambles>(BuiltPreambles),
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy(), /*ParallelFirstBuild=*/false, Budget);
+
+  S.buildSpeculativePreamble(Foo,
+                             getInputs(Foo, "#include \"foo.h\"\nint a;"));
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(BuiltPreambles, 1);
+  // A sibling with the same preamble doesn't build another one.
+  S.buildSpeculativePreamble(Bar,
+                             getInputs(Bar, "#include \"foo.h\"\nint b;"));
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(BuiltPreambles, 1);
+
+  // Opening the file reuses the speculative preamble.
+  S.update(Foo, getInputs(Foo, "#include \"foo.h\"\nint a = 1;"),
+           WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(BuiltPreambles, 1);
+
+  // Once dropped, the preamble is built again.
+  ParseInputs BazInputs =
+      getInputs(Baz, "#include \"foo.h\"\n#define BAZ\nint c;");
+  S.buildSpeculativePreamble(Baz, BazInputs);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(BuiltPreambles, 2);
+  S.dropSpeculativePreambles();
+  S.update(Baz, BazInputs, WantDiagnostics::Yes);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(BuiltPreambles, 3);
+}
+
+TEST_F(TUSchedulerTests, ParallelFirstBuild) {
+  TUScheduler S(
+      /*AsyncThreadsCount=*/4, /*StorePreambleInMemory=*/true, captureDiags(),
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy(), /*ParallelFirstBuild=*/true);
+  auto Foo = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "void foo();";
+  Timestamps[Header] = time_t(0);
+
+  std::atomic<int> DiagsCount(0);
+  updateWithDiags(S, Foo, "#include \"foo.h\"\nint a = foo();",
+                  WantDiagnostics::Yes, [&](std::vector<Diag> Diags) {
+                    ++DiagsCount;
+                    // The error is reported by the AST built without a
+                    // preamble too.
+                    EXPECT_EQ(Diags.size(), 1u);
+                  });
+  S.runWithAST("CheckAST", Foo, [](Expected<InputsAndAST> AST) {
+    ASSERT_TRUE(bool(AST));
+    EXPECT_FALSE(AST->AST.getDiagnostics().empty());
+  });
+  const PreambleData *Preamble = nullptr;
+  S.runWithPreamble("CheckPreamble", Foo, TUScheduler::Stale,
+                    [&](Expected<InputsAndPreamble> IP) {
+                      Preamble = cantFail(std::move(IP)).Preamble;
+                    });
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(DiagsCount, 1);
+  ASSERT_NE(Preamble, nullptr);
+  EXPECT_THAT(includes(Preamble), ElementsAre("\"foo.h\""));
+
+  // Later updates reuse the preamble built in parallel.
+  updateWithDiags(S, Foo, "#include \"foo.h\"\nvoid bar() { foo(); }",
+                  WantDiagnostics::Yes, [&](std::vector<Diag> Diags) {
+                    ++DiagsCount;
+                    EXPECT_TRUE(Diags.empty());
+                  });
+  S.runWithPreamble("CheckPreamble", Foo, TUScheduler::Stale,
+                    [&](Expected<InputsAndPreamble> IP) {
+                      EXPECT_EQ(cantFail(std::move(IP)).Preamble, Preamble);
+                    });
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(DiagsCount, 2);
+}
+
+TEST_F(TUSchedulerTests, ParallelFirstBuildSingleThread) {
+  // The preamble built in parallel and the next update share the only slot.
+  TUScheduler S(
+      /*AsyncThreadsCount=*/1, /*StorePreambleInMemory=*/true, captureDiags(),
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy(), /*ParallelFirstBuild=*/true);
+  auto Foo = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "void foo();";
+  Timestamps[Header] = time_t(0);
+
+  std::atomic<int> DiagsCount(0);
+  updateWithDiags(S, Foo, "#include \"foo.h\"\nint a = foo();",
+                  WantDiagnostics::Yes,
+                  [&](std::vector<Diag> Diags) { ++DiagsCount; });
+  updateWithDiags(S, Foo, "#include \"foo.h\"\nvoid bar() { foo(); }",
+                  WantDiagnostics::Yes, [&](std::vector<Diag> Diags) {
+                    ++DiagsCount;
+                    EXPECT_TRUE(Diags.empty());
+                  });
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(DiagsCount, 2);
+}
+
 TEST_F(TUSchedulerTests, RunWaitsForPreamble) {
   // Testing strategy: we update the file and schedule a few preamble reads at
   // the same time. All reads should get the same non-null preamble.
@@ -611,6 +901,83 @@ TEST_F(TUSchedulerTests, NoopOnEmptyChanges) {
   ASSERT_FALSE(DoUpdate(OtherSourceContents));
 }
 
+TEST_F(TUSchedulerTests, ReparseIncludingFiles) {
+  TUScheduler S(
+      /*AsyncThreadsCount=*/getDefaultAsyncThreadsCount(),
+      /*StorePreambleInMemory=*/true, captureDiags(),
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy());
+
+  auto Foo = testPath("foo.cpp");
+  auto Bar = testPath("bar.cpp");
+  auto PreambleHeader = testPath("preamble.h");
+  auto MainHeader = testPath("main.h");
+  Files[PreambleHeader] = "int a;";
+  Files[MainHeader] = "int b;";
+  Timestamps[PreambleHeader] = Timestamps[MainHeader] = time_t(0);
+
+  updateWithDiags(S, Foo, "#include \"preamble.h\"\nint x = a;",
+                  WantDiagnostics::Yes, [](std::vector<Diag>) {});
+  // Not in the preamble, only the AST reads it.
+  updateWithDiags(S, Bar, "int x;\n#include \"main.h\"\nint y = b;",
+                  WantDiagnostics::Yes, [](std::vector<Diag>) {});
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+
+  EXPECT_THAT(S.getFilesIncluding({PreambleHeader}), ElementsAre(Foo));
+  EXPECT_THAT(S.getFilesIncluding({MainHeader}), ElementsAre(Bar));
+  EXPECT_THAT(S.getFilesIncluding({testPath("other.h")}), IsEmpty());
+
+  // The changed header is picked up without changes to the file.
+  Files[MainHeader] = "int c;";
+  Timestamps[MainHeader] = time_t(1);
+  std::atomic<bool> SeenDiags(false);
+  {
+    WithContextValue Ctx(DiagsCallbackKey,
+                         [&](PathRef File, std::vector<Diag> Diags) {
+                           EXPECT_EQ(File, Bar);
+                           EXPECT_THAT(Diags, SizeIs(1));
+                           SeenDiags = true;
+                         });
+    S.reparse(Bar, buildTestFS(Files, Timestamps));
+  }
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_TRUE(SeenDiags);
+}
+
+TEST_F(TUSchedulerTests, IncluderCommand) {
+  TUScheduler S(
+      /*AsyncThreadsCount=*/getDefaultAsyncThreadsCount(),
+      /*StorePreambleInMemory=*/true, captureDiags(),
+      /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+      ASTRetentionPolicy());
+
+  auto Foo = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "int a;";
+  Timestamps[Header] = time_t(0);
+  CDB.ExtraClangFlags = {"-DFOO"};
+
+  EXPECT_FALSE(S.getIncluderCommand(Header));
+  updateWithDiags(S, Foo, "#include \"foo.h\"\nint x = a;",
+                  WantDiagnostics::Yes, [](std::vector<Diag>) {});
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+
+  auto Cmd = S.getIncluderCommand(Header);
+  ASSERT_TRUE(Cmd);
+  EXPECT_THAT(Cmd->CommandLine, ElementsAre("clang", "-DFOO", Foo));
+  // The header is open too, but doesn't include itself.
+  updateWithDiags(S, Header, "int a;", WantDiagnostics::Yes,
+                  [](std::vector<Diag>) {});
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  Cmd = S.getIncluderCommand(Header);
+  ASSERT_TRUE(Cmd);
+  EXPECT_THAT(Cmd->CommandLine, ElementsAre("clang", "-DFOO", Foo));
+  EXPECT_FALSE(S.getIncluderCommand(Foo));
+
+  S.remove(Foo);
+  EXPECT_FALSE(S.getIncluderCommand(Header));
+}
+
 TEST_F(TUSchedulerTests, NoChangeDiags) {
   TUScheduler S(
       /*AsyncThreadsCount=*/getDefaultAsyncThreadsCount(),
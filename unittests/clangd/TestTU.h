@@ -49,6 +49,9 @@ struct TestTU {
   // Extra arguments for the compiler invocation.
   std::vector<const char *> ExtraArgs;
 
+  // The clang-tidy checks to run on the AST, none if empty.
+  std::string ClangTidyChecks;
+
   ParsedAST build() const;
   SymbolSlab headerSymbols() const;
   std::unique_ptr<SymbolIndex> index() const;
@@ -9,7 +9,9 @@
 
 #include "Threading.h"
 #include "gtest/gtest.h"
+#include <chrono>
 #include <mutex>
+#include <string>
 
 namespace clang {
 namespace clangd {
@@ -61,5 +63,62 @@ TEST_F(ThreadingTest, TaskRunner) {
   std::lock_guard<std::mutex> Lock(Mutex);
   ASSERT_EQ(Counter, TasksCnt * IncrementsPerTask);
 }
+
+TEST_F(ThreadingTest, TaskThreadPool) {
+  TaskThreadPool Pool(/*MaxIdleThreads=*/1);
+  // A task waiting for another doesn't keep it from running.
+  Notification Started, Done;
+  std::thread::id FirstThread, SecondThread;
+  Pool.run("first", ThreadPriority::Normal, [&] {
+    FirstThread = std::this_thread::get_id();
+    Started.wait();
+  });
+  Pool.run("second", ThreadPriority::Normal, [&] {
+    SecondThread = std::this_thread::get_id();
+    Started.notify();
+    Done.notify();
+  });
+  Done.wait();
+  // Only one of the threads is kept once they're idle.
+  Pool.waitUntilIdle();
+  EXPECT_NE(FirstThread, SecondThread);
+
+  Notification ThirdDone;
+  std::thread::id ThirdThread;
+  Pool.run("third", ThreadPriority::Normal, [&] {
+    ThirdThread = std::this_thread::get_id();
+    ThirdDone.notify();
+  });
+  ThirdDone.wait();
+  EXPECT_TRUE(ThirdThread == FirstThread || ThirdThread == SecondThread);
+}
+
+TEST_F(ThreadingTest, SemaphorePriority) {
+  Semaphore S(1);
+  std::mutex Mutex;
+  std::vector<std::string> Order; /* GUARDED_BY(Mutex) */
+  S.lock();
+  {
+    AsyncTaskRunner Tasks;
+    auto lockAndRecord = [&](TaskPriority Priority) {
+      Tasks.runAsync("task", [&, Priority]() {
+        S.lock(Priority);
+        {
+          std::lock_guard<std::mutex> Lock(Mutex);
+          Order.push_back(toString(Priority));
+        }
+        S.unlock();
+      });
+    };
+    lockAndRecord(TaskPriority::Normal);
+    lockAndRecord(TaskPriority::Interactive);
+    // Release the slot once both tasks wait for it.
+    while (S.waiting() < 2)
+      std::this_thread::yield();
+    S.unlock();
+  }
+  std::lock_guard<std::mutex> Lock(Mutex);
+  ASSERT_EQ(Order, (std::vector<std::string>{"interactive", "normal"}));
+}
 } // namespace clangd
 } // namespace clang
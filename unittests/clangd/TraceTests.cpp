@@ -122,6 +122,136 @@ TEST(TraceTest, SmokeTest) {
   ASSERT_EQ(++Prop, Root->end());
 }
 
+TEST(TraceTest, BinaryTracer) {
+  std::string Binary;
+  {
+    raw_string_ostream OS(Binary);
+    auto BinaryTracer = trace::createBinaryTracer(OS);
+    trace::Session Session(*BinaryTracer);
+    {
+      trace::Span Outer("A");
+      trace::log("B");
+      trace::Span Inner("C");
+    }
+    trace::Span Again("A");
+  }
+
+  std::string JSON;
+  {
+    raw_string_ostream OS(JSON);
+    Error Err = trace::convertBinaryTrace(Binary, OS);
+    ASSERT_FALSE(bool(Err)) << toString(std::move(Err));
+  }
+  auto Root = json::parse(JSON);
+  ASSERT_TRUE(bool(Root)) << toString(Root.takeError());
+  auto *Events = Root->getAsObject()->getArray("traceEvents");
+  ASSERT_NE(Events, nullptr);
+  std::vector<std::string> Spans, Instants;
+  for (const json::Value &E : *Events) {
+    auto Phase = E.getAsObject()->getString("ph");
+    auto Name = E.getAsObject()->getString("name");
+    ASSERT_TRUE(Phase && Name);
+    if (*Phase == "X")
+      Spans.push_back(*Name);
+    else if (*Phase == "i")
+      Instants.push_back(*Name);
+  }
+  // Spans are recorded when they end.
+  EXPECT_THAT(Spans, testing::ElementsAre("C", "A", "A"));
+  EXPECT_THAT(Instants, testing::ElementsAre("Log"));
+
+  std::string Truncated;
+  raw_string_ostream OS(Truncated);
+  Error Err = trace::convertBinaryTrace(Binary.substr(0, 10), OS);
+  EXPECT_TRUE(bool(Err));
+  consumeError(std::move(Err));
+}
+
+TEST(TraceTest, MetricsTracer) {
+  std::vector<json::Value> Snapshots;
+  {
+    auto MetricsTracer = trace::createMetricsTracer(
+        std::chrono::hours(1),
+        [&](const json::Value &Snapshot) { Snapshots.push_back(Snapshot); });
+    trace::Session Session(*MetricsTracer);
+    { trace::Span Tracer("Hover"); }
+    { trace::Span Tracer("Update:foo.cpp"); }
+    { trace::Span Tracer("Update:bar.cpp"); }
+    trace::metric("Hit");
+    trace::metric("Hit");
+    trace::metric("Bytes", 100);
+    trace::metric("Bytes", 50);
+  }
+  // The tracer exports a final snapshot when it's destroyed.
+  ASSERT_EQ(Snapshots.size(), 1u);
+  const json::Object *Root = Snapshots.front().getAsObject();
+  ASSERT_NE(Root, nullptr);
+  const json::Object *Spans = Root->getObject("spans");
+  ASSERT_NE(Spans, nullptr);
+  EXPECT_EQ(Spans->size(), 2u);
+  ASSERT_NE(Spans->getObject("Update"), nullptr);
+  EXPECT_EQ(Spans->getObject("Update")->getInteger("count").getValueOr(0), 2);
+  ASSERT_NE(Spans->getObject("Hover"), nullptr);
+  EXPECT_EQ(Spans->getObject("Hover")->getInteger("count").getValueOr(0), 1);
+
+  const json::Object *Metrics = Root->getObject("metrics");
+  ASSERT_NE(Metrics, nullptr);
+  ASSERT_NE(Metrics->getObject("Hit"), nullptr);
+  EXPECT_EQ(Metrics->getObject("Hit")->getNumber("sum").getValueOr(0), 2.0);
+  ASSERT_NE(Metrics->getObject("Bytes"), nullptr);
+  EXPECT_EQ(Metrics->getObject("Bytes")->getNumber("last").getValueOr(0), 50.0);
+}
+
+TEST(TraceTest, SlowRequestTracer) {
+  std::vector<json::Value> Slow;
+  auto Export = [&](const json::Value &Request) { Slow.push_back(Request); };
+  {
+    auto Tracer = trace::createSlowRequestTracer(std::chrono::hours(1), Export);
+    trace::Session Session(*Tracer);
+    { trace::Span Request("Hover"); }
+  }
+  EXPECT_TRUE(Slow.empty()) << "fast requests are discarded";
+
+  auto Tracer =
+      trace::createSlowRequestTracer(std::chrono::milliseconds(0), Export);
+  trace::Session Session(*Tracer);
+  Context RequestContext = Context::empty();
+  {
+    trace::Span Request("CodeComplete");
+    SPAN_ATTACH(Request, "id", 1);
+    {
+      trace::Span Sema("Sema");
+      trace::log("Cached");
+    }
+    // Work on the request continues after its span ends.
+    RequestContext = Context::current().clone();
+  }
+  EXPECT_TRUE(Slow.empty()) << "the request isn't done";
+  {
+    WithContext Late(std::move(RequestContext));
+    trace::Span Index("Index");
+  }
+  ASSERT_EQ(Slow.size(), 1u);
+  const json::Object *Root = Slow.front().getAsObject();
+  ASSERT_NE(Root, nullptr);
+  EXPECT_EQ(Root->getString("request"), Optional<StringRef>("CodeComplete"));
+  const json::Object *Request = Root->getObject("spans");
+  ASSERT_NE(Request, nullptr);
+  ASSERT_NE(Request->getObject("args"), nullptr);
+  EXPECT_EQ(Request->getObject("args")->getInteger("id"), Optional<int64_t>(1));
+  const json::Array *Children = Request->getArray("children");
+  ASSERT_NE(Children, nullptr);
+  ASSERT_EQ(Children->size(), 2u);
+  const json::Object *Sema = (*Children)[0].getAsObject();
+  ASSERT_NE(Sema, nullptr);
+  EXPECT_EQ(Sema->getString("name"), Optional<StringRef>("Sema"));
+  ASSERT_NE(Sema->getArray("children"), nullptr);
+  EXPECT_EQ((*Sema->getArray("children"))[0].getAsObject()->getString("name"),
+            Optional<StringRef>("Log"));
+  EXPECT_EQ((*Children)[1].getAsObject()->getString("name"),
+            Optional<StringRef>("Index"));
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -160,6 +160,27 @@ TEST(URITest, ResolveFailed) {
   EXPECT_TRUE(FailedResolve("file:a/b/c"));
 }
 
+TEST(URITest, CachedResolve) {
+  CachedURIResolver URIs(testPath("x"));
+  auto Path = URIs.resolve("unittest:///a");
+  ASSERT_TRUE(bool(Path)) << Path.takeError();
+  EXPECT_EQ(*Path, testPath("a"));
+  // The memoized path is returned again.
+  auto Again = URIs.resolve("unittest:///a");
+  ASSERT_TRUE(bool(Again)) << Again.takeError();
+  EXPECT_EQ(Again->data(), Path->data());
+  auto Spelling = URIs.includeSpelling("unittest:///a");
+  ASSERT_TRUE(bool(Spelling)) << Spelling.takeError();
+  EXPECT_EQ(*Spelling, "");
+
+  // Errors are reported each time.
+  for (unsigned I = 0; I < 2; ++I) {
+    EXPECT_ERROR(URIs.resolve("no:/a/b/c"));
+    EXPECT_ERROR(URIs.resolve("file:a/b/c"));
+    EXPECT_ERROR(URIs.includeSpelling(""));
+  }
+}
+
 } // namespace
 } // namespace clangd
 } // namespace clang
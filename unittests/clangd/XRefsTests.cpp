@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "Annotations.h"
+#include "Cancellation.h"
 #include "ClangdUnit.h"
 #include "Compiler.h"
 #include "Matchers.h"
@@ -1246,6 +1247,10 @@ TEST(FindReferences, NeedsIndex) {
   IndexedTU.HeaderCode = Header;
   EXPECT_THAT(findReferences(AST, Main.point(), IndexedTU.index().get()),
               ElementsAre(RangeIs(Main.range()), RangeIs(IndexedMain.range())));
+  // References in the main file come first.
+  EXPECT_THAT(
+      findReferences(AST, Main.point(), IndexedTU.index().get(), /*Limit=*/1),
+      ElementsAre(RangeIs(Main.range())));
 
   // If the main file is in the index, we don't return duplicates.
   // (even if the references are in a different location)
@@ -1254,6 +1259,27 @@ TEST(FindReferences, NeedsIndex) {
               ElementsAre(RangeIs(Main.range())));
 }
 
+TEST(FindReferences, Cancelled) {
+  const char *Header = "int foo();";
+  Annotations Main("int main() { [[f^oo]](); }");
+  TestTU TU;
+  TU.Code = Main.code();
+  TU.HeaderCode = Header;
+  auto AST = TU.build();
+  TestTU IndexedTU;
+  IndexedTU.Code = "int main() { foo(); }";
+  IndexedTU.Filename = "Indexed.cpp";
+  IndexedTU.HeaderCode = Header;
+  auto Index = IndexedTU.index();
+
+  // A cancelled request doesn't query the index.
+  auto Task = cancelableTask();
+  WithContext Cancelled(std::move(Task.first));
+  Task.second();
+  EXPECT_THAT(findReferences(AST, Main.point(), Index.get()),
+              ElementsAre(RangeIs(Main.range())));
+}
+
 TEST(FindReferences, NoQueryForLocalSymbols) {
   struct RecordingIndex : public MemIndex {
     mutable Optional<DenseSet<SymbolID>> RefIDs;
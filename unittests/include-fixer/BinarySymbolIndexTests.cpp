@@ -0,0 +1,77 @@
+//===-- BinarySymbolIndexTests.cpp - Binary symbol index unit tests -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolIndex.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace include_fixer {
+namespace {
+
+using find_all_symbols::SymbolAndSignals;
+using find_all_symbols::SymbolInfo;
+
+std::string writeBinary(const SymbolInfo::SignalMap &Symbols) {
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  EXPECT_TRUE(find_all_symbols::WriteSymbolInfosToBinary(OS, Symbols));
+  return OS.str();
+}
+
+std::unique_ptr<BinarySymbolIndex> createIndex(llvm::StringRef Data) {
+  auto Index = BinarySymbolIndex::createFromBuffer(
+      llvm::MemoryBuffer::getMemBuffer(Data, "db", false));
+  if (!Index)
+    return nullptr;
+  return std::move(*Index);
+}
+
+TEST(BinarySymbolIndexTest, Search) {
+  const std::vector<SymbolInfo::Context> Contexts = {
+      {SymbolInfo::ContextType::Record, "B"},
+      {SymbolInfo::ContextType::Namespace, "a"}};
+  const SymbolInfo Foo("foo", SymbolInfo::SymbolKind::Function, "foo.h",
+                       Contexts);
+  const SymbolInfo OtherFoo("foo", SymbolInfo::SymbolKind::Variable,
+                            "other/foo.h", {});
+  const SymbolInfo Bar("bar", SymbolInfo::SymbolKind::Class, "bar.h",
+                       Contexts);
+  SymbolInfo::SignalMap Symbols = {{Foo, SymbolInfo::Signals(2, 1)},
+                                   {OtherFoo, SymbolInfo::Signals(1, 0)},
+                                   {Bar, SymbolInfo::Signals(3, 3)}};
+
+  const std::string Data = writeBinary(Symbols);
+  auto Index = createIndex(Data);
+  ASSERT_TRUE(Index);
+  EXPECT_EQ((std::vector<SymbolAndSignals>{
+                {Foo, SymbolInfo::Signals(2, 1)},
+                {OtherFoo, SymbolInfo::Signals(1, 0)}}),
+            Index->search("foo"));
+  EXPECT_EQ((std::vector<SymbolAndSignals>{{Bar, SymbolInfo::Signals(3, 3)}}),
+            Index->search("bar"));
+  EXPECT_TRUE(Index->search("baz").empty());
+}
+
+TEST(BinarySymbolIndexTest, Empty) {
+  auto Index = createIndex(writeBinary({}));
+  ASSERT_TRUE(Index);
+  EXPECT_TRUE(Index->search("foo").empty());
+}
+
+TEST(BinarySymbolIndexTest, Invalid) {
+  EXPECT_FALSE(createIndex("---\nName: foo\n"));
+
+  const SymbolInfo Foo("foo", SymbolInfo::SymbolKind::Function, "foo.h", {});
+  const std::string Data = writeBinary({{Foo, SymbolInfo::Signals(1, 1)}});
+  EXPECT_FALSE(createIndex(llvm::StringRef(Data).drop_back()));
+}
+
+} // namespace
+} // namespace include_fixer
+} // namespace clang
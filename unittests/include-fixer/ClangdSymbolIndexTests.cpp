@@ -0,0 +1,82 @@
+//===-- ClangdSymbolIndexTests.cpp - clangd symbol index unit tests -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangdSymbolIndex.h"
+#include "index/dex/Dex.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace include_fixer {
+namespace {
+
+using find_all_symbols::SymbolAndSignals;
+using find_all_symbols::SymbolInfo;
+
+clangd::Symbol createSymbol(llvm::StringRef Scope, llvm::StringRef Name,
+                            index::SymbolKind Kind, unsigned References) {
+  clangd::Symbol Symbol;
+  Symbol.ID = clangd::SymbolID((Scope + Name).str());
+  Symbol.Scope = Scope;
+  Symbol.Name = Name;
+  Symbol.SymInfo.Kind = Kind;
+  Symbol.SymInfo.Lang = index::SymbolLanguage::CXX;
+  Symbol.References = References;
+  return Symbol;
+}
+
+TEST(ClangdSymbolIndexTest, Search) {
+  clangd::SymbolSlab::Builder Builder;
+  clangd::Symbol Foo =
+      createSymbol("a::b::", "foo", index::SymbolKind::Function, 5);
+  Foo.IncludeHeaders.emplace_back("\"foo.h\"", 4);
+  Foo.IncludeHeaders.emplace_back("<foo>", 1);
+  Builder.insert(Foo);
+  clangd::Symbol OtherFoo =
+      createSymbol("", "foo", index::SymbolKind::Variable, 2);
+  OtherFoo.IncludeHeaders.emplace_back("\"other/foo.h\"", 2);
+  Builder.insert(OtherFoo);
+  // The members can't be included on their own, and the fuzzy matches of the
+  // identifier are different names.
+  clangd::Symbol MemberFoo =
+      createSymbol("a::B::", "foo", index::SymbolKind::Field, 3);
+  MemberFoo.IncludeHeaders.emplace_back("\"b.h\"", 3);
+  Builder.insert(MemberFoo);
+  clangd::Symbol FooBar =
+      createSymbol("", "foobar", index::SymbolKind::Class, 1);
+  FooBar.IncludeHeaders.emplace_back("\"foobar.h\"", 1);
+  Builder.insert(FooBar);
+
+  ClangdSymbolIndex Index(
+      clangd::dex::Dex::build(std::move(Builder).build(), clangd::RefSlab()));
+  auto Results = Index.search("foo");
+  std::sort(Results.begin(), Results.end(),
+            [](const SymbolAndSignals &A, const SymbolAndSignals &B) {
+              return A.Symbol < B.Symbol;
+            });
+  const std::vector<SymbolInfo::Context> Contexts = {
+      {SymbolInfo::ContextType::Namespace, "b"},
+      {SymbolInfo::ContextType::Namespace, "a"}};
+  EXPECT_EQ(
+      (std::vector<SymbolAndSignals>{
+          {SymbolInfo("foo", SymbolInfo::SymbolKind::Function, "\"foo.h\"",
+                      Contexts),
+           SymbolInfo::Signals(4, 5)},
+          {SymbolInfo("foo", SymbolInfo::SymbolKind::Function, "<foo>",
+                      Contexts),
+           SymbolInfo::Signals(1, 5)},
+          {SymbolInfo("foo", SymbolInfo::SymbolKind::Variable,
+                      "\"other/foo.h\"", {}),
+           SymbolInfo::Signals(2, 2)}}),
+      Results);
+  EXPECT_TRUE(Index.search("bar").empty());
+}
+
+} // namespace
+} // namespace include_fixer
+} // namespace clang
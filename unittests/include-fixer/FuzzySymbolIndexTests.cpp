@@ -56,6 +56,35 @@ TEST(FuzzySymbolIndexTest, QueryRegexp) {
   EXPECT_THAT(QueryRegexp("UniP"), MatchesSymbol("unique_ptr"));
 }
 
+TEST(FuzzySymbolIndexTest, Search) {
+  using find_all_symbols::SymbolAndSignals;
+  using find_all_symbols::SymbolInfo;
+  std::vector<SymbolAndSignals> Symbols;
+  for (StringRef Name : {"URLHandlerCallback", "unique_ptr", "UniquePtrTest",
+                         "urlHandler", "u", "shared_ptr", "StringRef"})
+    Symbols.push_back({SymbolInfo(Name, SymbolInfo::SymbolKind::Class,
+                                  "header.h", {}),
+                       SymbolInfo::Signals()});
+  auto Index = FuzzySymbolIndex::createFromSymbols(Symbols);
+  auto Search = [&](StringRef Query) {
+    std::vector<std::string> Names;
+    for (const auto &Symbol : Index->search(Query))
+      Names.push_back(Symbol.Symbol.getName().str());
+    return Names;
+  };
+
+  EXPECT_THAT(Search("uhc"), ElementsAre("URLHandlerCallback"));
+  EXPECT_THAT(Search("urlha"), ElementsAre("URLHandlerCallback", "urlHandler"));
+  EXPECT_THAT(Search("uptr"), ElementsAre("unique_ptr", "UniquePtrTest"));
+  EXPECT_THAT(Search("u"), ElementsAre("URLHandlerCallback", "unique_ptr",
+                                       "UniquePtrTest", "urlHandler", "u"));
+  EXPECT_THAT(Search("uc"), ElementsAre());
+  EXPECT_THAT(Search("sptr"), ElementsAre("shared_ptr"));
+  EXPECT_THAT(Search("StR"), ElementsAre("StringRef"));
+  EXPECT_THAT(Search("STr"), ElementsAre());
+  EXPECT_THAT(Search(""), testing::SizeIs(7));
+}
+
 } // namespace
 } // namespace include_fixer
 } // namespace clang